@@ -30,22 +30,26 @@
 /*** Input is TRWLayer ***/
 extern VikDataSourceInterface vik_datasource_bfilter_simplify_interface;
 extern VikDataSourceInterface vik_datasource_bfilter_compress_interface;
+extern VikDataSourceInterface vik_datasource_bfilter_thin_interface;
 extern VikDataSourceInterface vik_datasource_bfilter_dup_interface;
 extern VikDataSourceInterface vik_datasource_bfilter_manual_interface;
 
 /*** Input is a track and a TRWLayer ***/
 extern VikDataSourceInterface vik_datasource_bfilter_polygon_interface;
 extern VikDataSourceInterface vik_datasource_bfilter_exclude_polygon_interface;
+extern VikDataSourceInterface vik_datasource_bfilter_arc_interface;
 
 /*** Input is a track ***/
 
 const VikDataSourceInterface *filters[] = {
   &vik_datasource_bfilter_simplify_interface,
   &vik_datasource_bfilter_compress_interface,
+  &vik_datasource_bfilter_thin_interface,
   &vik_datasource_bfilter_dup_interface,
   &vik_datasource_bfilter_manual_interface,
   &vik_datasource_bfilter_polygon_interface,
   &vik_datasource_bfilter_exclude_polygon_interface,
+  &vik_datasource_bfilter_arc_interface,
 };
 
 const guint N_FILTERS = sizeof(filters) / sizeof(filters[0]);
@@ -268,6 +272,42 @@ static void acquire ( VikWindow *vw,
       return; /* TODO: do we have to free anything here? */
   }
 
+  /* FILTER DIRECTLY IF POSSIBLE, SAVING WRITING OUT AND READING BACK ALL THE DATA */
+  if ( source_interface->filter_func && mode == VIK_DATASOURCE_CREATENEWLAYER ) {
+    VikTrwLayer *vtl_dest = VIK_TRW_LAYER ( vik_layer_create ( VIK_LAYER_TRW, vvp, FALSE ) );
+    vik_layer_rename ( VIK_LAYER(vtl_dest), _(source_interface->layer_title) );
+
+    vik_window_set_busy_cursor ( vw );
+    gboolean filtered = source_interface->filter_func ( pass_along_data, vtl, track, vtl_dest );
+    vik_window_clear_busy_cursor ( vw );
+
+    if ( filtered ) {
+      if ( source_interface->params )
+        a_uibuilder_free_paramdatas ( paramdatas, source_interface->params, source_interface->params_count );
+      if ( source_interface->cleanup_func )
+        source_interface->cleanup_func ( user_data );
+      g_free ( options );
+
+      /* Only create the layer if it actually contains anything useful */
+      if ( vik_trw_layer_is_empty ( vtl_dest ) ) {
+        g_object_unref ( vtl_dest );
+        a_dialog_info_msg ( GTK_WINDOW(vw), _("No data.") );
+      }
+      else {
+        vik_layer_post_read ( VIK_LAYER(vtl_dest), vvp, TRUE );
+        vik_aggregate_layer_add_layer ( vik_layers_panel_get_top_layer(vlp), VIK_LAYER(vtl_dest), TRUE );
+        if ( source_interface->autoview )
+          vik_trw_layer_auto_set_view ( vtl_dest, vik_layers_panel_get_viewport(vlp) );
+        vik_layers_panel_emit_update ( vlp );
+      }
+
+      if ( cleanup_function )
+        cleanup_function ( source_interface );
+      return;
+    }
+    g_object_unref ( vtl_dest );
+  }
+
   /* CREATE INPUT DATA & GET OPTIONS */
   ProcessOptions *po = g_malloc0 ( sizeof(ProcessOptions) );
 
@@ -465,10 +505,6 @@ static GtkWidget *acquire_build_menu ( VikWindow *vw, VikLayersPanel *vlp, VikVi
   GtkWidget *item=NULL;
   int i;
 
-  // ATM All the filter options invoke GPSBabel
-  if ( !a_babel_available() )
-    return NULL;
-
   pass_along[0] = vw;
   pass_along[1] = vlp;
   pass_along[2] = vvp;
@@ -476,7 +512,8 @@ static GtkWidget *acquire_build_menu ( VikWindow *vw, VikLayersPanel *vlp, VikVi
   pass_along[4] = track;
 
   for ( i = 0; i < N_FILTERS; i++ ) {
-    if ( filters[i]->inputtype == inputtype ) {
+    // Without GPSBabel only the filters done directly are available
+    if ( filters[i]->inputtype == inputtype && (filters[i]->filter_func || a_babel_available()) ) {
       if ( ! menu_item ) { /* do this just once, but return NULL if no filters */
         menu = gtk_menu_new();
         menu_item = gtk_image_menu_item_new_with_mnemonic ( menu_title );
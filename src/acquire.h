@@ -136,6 +136,19 @@ typedef void (*VikDataSourceCleanupFunc) ( gpointer user_data );
 
 typedef void (*VikDataSourceOffFunc) ( gpointer user_data, gchar **babelargs, gchar **file_descriptor );
 
+/**
+ * VikDataSourceFilterFunc:
+ * @user_data: provided by #VikDataSourceInterface.init_func or dialog with params
+ * @vtl: the layer to filter, for the input types using a layer
+ * @track: the track to filter with, for the input types using a track
+ * @vtl_dest: the new layer for the results
+ *
+ * Filter the data directly, rather than via GPSBabel.
+ *
+ * Returns: %FALSE to fall back to #VikDataSourceInterface.process_func
+ */
+typedef gboolean (*VikDataSourceFilterFunc) ( gpointer user_data, VikTrwLayer *vtl, VikTrack *track, VikTrwLayer *vtl_dest );
+
 /**
  * VikDataSourceInterface:
  * 
@@ -173,6 +186,8 @@ struct _VikDataSourceInterface {
   gchar **                          params_groups;
   guint8                            params_groups_count;
 
+  /*** In process filtering ***/
+  VikDataSourceFilterFunc filter_func;
 };
 
 /**********************************/
@@ -0,0 +1,523 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "viking.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <errno.h>
+#ifndef WINDOWS
+#include <signal.h>
+#endif
+#include <glib/gstdio.h>
+
+#include "autosave.h"
+#include "dir.h"
+#include "file.h"
+#include "settings.h"
+
+/*
+ * Saving a large project takes a while, so rather than saving everything every so often,
+ *  each edit the TrackWaypoint layers make to their undo journal is also appended to a journal file,
+ *  which costs only the size of the change.
+ * The journal applies to a 'base' - the project file as last loaded or saved,
+ *  or a checkpoint, being a full save into the recovery directory.
+ * A checkpoint is made periodically whilst there are changes, since not every change is journalled
+ *  (and once one has been, later records may no longer identify their items correctly).
+ *
+ * After a crash, the base is loaded and the records replayed onto it,
+ *  as far as they still fit (see vik_trw_layer_replay()).
+ *
+ * Journal file layout: magic, then entries each of a little endian u32 length and a serialised GVariant.
+ *  The first entry is the header "(ss)" of the project and base filenames ("" when none),
+ *  then each record is "(uv)" of the TrackWaypoint layer (by position) and the layer's own record.
+ */
+
+#define VIK_SETTINGS_AUTOSAVE_INTERVAL "autosave_interval"
+#define AUTOSAVE_INTERVAL_DEFAULT 300
+// Beyond this a checkpoint is made at the next interval regardless, so there is not too much to replay
+#define JOURNAL_MAX_SIZE (4 * 1024 * 1024)
+
+#define JOURNAL_MAGIC "VIKJRNL1"
+#define JOURNAL_MAGIC_LEN 8
+#define JOURNAL_EXT ".journal"
+
+typedef struct {
+  gpointer window;
+  VikAggregateLayer *top;
+  VikViewport *vp;
+  guint number;       // Unique to the window in this process
+  guint checkpoints;
+  gchar *project;     // The file the window is for, or NULL when untitled
+  gchar *checkpoint;  // The latest checkpoint made, if any
+  GList *layers;      // The TrackWaypoint layers as in the base, as records identify their layer by position
+  FILE *journal;      // Open whenever there is a base
+  gsize journal_size;
+  gboolean changed;   // Since the base
+  gboolean suspended; // Something has not been recorded, so the journal is not usable until the next checkpoint
+} Autosave;
+
+static GList *autosaves = NULL;
+static guint autosave_count = 0;
+static guint autosave_timer = 0;
+static gchar *recovery_dir = NULL;
+
+/**
+ * Files are named by the process and the window, so any left by a process no longer running can be found
+ */
+static gchar *autosave_filename ( Autosave *as, const gchar *suffix )
+{
+  gchar *name = g_strdup_printf ( "%d-%u%s", (gint)getpid(), as->number, suffix );
+  gchar *filename = g_build_filename ( recovery_dir, name, NULL );
+  g_free ( name );
+  return filename;
+}
+
+static GList *autosave_get_layers ( Autosave *as )
+{
+  return vik_aggregate_layer_get_all_layers_of_type ( as->top, NULL, VIK_LAYER_TRW, TRUE );
+}
+
+static void journal_write ( Autosave *as, GVariant *value )
+{
+  g_variant_ref_sink ( value );
+  gsize size = g_variant_get_size ( value );
+  guint32 length = GUINT32_TO_LE ( (guint32)size );
+  // Flushed each time, so it survives the program crashing
+  if ( fwrite ( &length, 4, 1, as->journal ) != 1 ||
+       (size && fwrite ( g_variant_get_data(value), 1, size, as->journal ) != size) ||
+       fflush ( as->journal ) != 0 ) {
+    g_warning ( "%s: %s", __FUNCTION__, g_strerror(errno) );
+    as->suspended = TRUE;
+  }
+  as->journal_size += size + 4;
+  g_variant_unref ( value );
+}
+
+static void journal_stop ( Autosave *as, gboolean remove )
+{
+  if ( as->journal ) {
+    fclose ( as->journal );
+    as->journal = NULL;
+  }
+  if ( remove ) {
+    gchar *filename = autosave_filename ( as, JOURNAL_EXT );
+    (void)g_remove ( filename );
+    g_free ( filename );
+  }
+  g_list_free ( as->layers );
+  as->layers = NULL;
+  as->journal_size = 0;
+}
+
+/**
+ * Start the journal afresh, for changes from the base, or stop it when there is none
+ */
+static void journal_start ( Autosave *as, const gchar *base )
+{
+  journal_stop ( as, base == NULL );
+  as->changed = FALSE;
+  as->suspended = FALSE;
+  if ( !base )
+    return;
+
+  gchar *filename = autosave_filename ( as, JOURNAL_EXT );
+  as->journal = g_fopen ( filename, "wb" );
+  if ( as->journal ) {
+    (void)fwrite ( JOURNAL_MAGIC, 1, JOURNAL_MAGIC_LEN, as->journal );
+    as->journal_size = JOURNAL_MAGIC_LEN;
+    journal_write ( as, g_variant_new ( "(ss)", as->project ? as->project : "", base ) );
+    as->layers = autosave_get_layers ( as );
+  }
+  else {
+    g_warning ( "%s: Unable to create %s: %s", __FUNCTION__, filename, g_strerror(errno) );
+    as->suspended = TRUE;
+  }
+  g_free ( filename );
+}
+
+static void checkpoint_remove ( Autosave *as )
+{
+  if ( as->checkpoint ) {
+    (void)g_remove ( as->checkpoint );
+    g_free ( as->checkpoint );
+    as->checkpoint = NULL;
+  }
+}
+
+static void autosave_checkpoint ( Autosave *as )
+{
+  // Nothing worth recovering
+  if ( vik_aggregate_layer_is_empty ( as->top ) ) {
+    journal_start ( as, NULL );
+    checkpoint_remove ( as );
+    return;
+  }
+
+  gchar *suffix = g_strdup_printf ( "-%u.vik", ++as->checkpoints );
+  gchar *filename = autosave_filename ( as, suffix );
+  g_free ( suffix );
+  if ( !a_file_save ( as->top, as->vp, filename, NULL, NULL ) ) {
+    g_warning ( "%s: Unable to save %s", __FUNCTION__, filename );
+    g_free ( filename );
+    return;
+  }
+  // The journal must not restart until its new base is certain to be there
+  if ( !a_file_save_wait () ) {
+    g_warning ( "%s: Unable to save %s", __FUNCTION__, filename );
+    g_free ( filename );
+    return;
+  }
+  // The previous checkpoint is kept until then, so the old journal always has its base
+  journal_start ( as, filename );
+  checkpoint_remove ( as );
+  as->checkpoint = filename;
+}
+
+static void autosave_free ( Autosave *as )
+{
+  // Finished with normally, so nothing to recover
+  journal_start ( as, NULL );
+  checkpoint_remove ( as );
+  g_free ( as->project );
+  g_free ( as );
+}
+
+static Autosave *autosave_find ( gpointer window )
+{
+  for ( GList *iter = autosaves; iter; iter = iter->next )
+    if ( ((Autosave*)iter->data)->window == window )
+      return iter->data;
+  return NULL;
+}
+
+static Autosave *autosave_find_layer ( VikLayer *vl )
+{
+  if ( !autosaves || !vl->vt )
+    return NULL;
+  return autosave_find ( VIK_GTK_WINDOW_FROM_LAYER(vl) );
+}
+
+static gboolean autosave_timeout ( gpointer data )
+{
+  for ( GList *iter = autosaves; iter; iter = iter->next ) {
+    Autosave *as = iter->data;
+    if ( as->changed || as->journal_size > JOURNAL_MAX_SIZE )
+      autosave_checkpoint ( as );
+  }
+  return TRUE;
+}
+
+/**
+ * a_autosave_init:
+ *
+ * Autosave is turned off by setting the interval to 0
+ */
+void a_autosave_init ( void )
+{
+  recovery_dir = g_build_filename ( a_get_viking_dir(), "recovery", NULL );
+
+  gint interval = AUTOSAVE_INTERVAL_DEFAULT;
+  (void)a_settings_get_integer ( VIK_SETTINGS_AUTOSAVE_INTERVAL, &interval );
+  if ( interval <= 0 )
+    return;
+  if ( g_mkdir_with_parents ( recovery_dir, 0700 ) != 0 ) {
+    g_warning ( "%s: Unable to create %s: %s", __FUNCTION__, recovery_dir, g_strerror(errno) );
+    return;
+  }
+  autosave_timer = g_timeout_add_seconds ( interval, autosave_timeout, NULL );
+}
+
+void a_autosave_uninit ( void )
+{
+  if ( autosave_timer )
+    (void)g_source_remove ( autosave_timer );
+  autosave_timer = 0;
+  g_list_free_full ( autosaves, (GDestroyNotify)autosave_free );
+  autosaves = NULL;
+  g_free ( recovery_dir );
+  recovery_dir = NULL;
+}
+
+void a_autosave_add_window ( gpointer window, VikAggregateLayer *top, VikViewport *vp )
+{
+  if ( !autosave_timer )
+    return;
+  Autosave *as = g_malloc0 ( sizeof(Autosave) );
+  as->window = window;
+  as->top = top;
+  as->vp = vp;
+  as->number = ++autosave_count;
+  autosaves = g_list_prepend ( autosaves, as );
+}
+
+void a_autosave_remove_window ( gpointer window )
+{
+  Autosave *as = autosave_find ( window );
+  if ( as ) {
+    autosaves = g_list_remove ( autosaves, as );
+    autosave_free ( as );
+  }
+}
+
+/**
+ * a_autosave_set_project:
+ * @filename: The .vik file, or NULL for an untitled project
+ */
+void a_autosave_set_project ( gpointer window, const gchar *filename )
+{
+  Autosave *as = autosave_find ( window );
+  if ( !as )
+    return;
+  // Likewise the file must be completely saved before the journal depends on it,
+  //  otherwise the journal carries on from its current base
+  if ( filename && !a_file_save_wait () )
+    return;
+  g_free ( as->project );
+  as->project = g_strdup ( filename );
+  journal_start ( as, filename );
+  checkpoint_remove ( as );
+}
+
+void a_autosave_changed ( gpointer window )
+{
+  Autosave *as = autosave_find ( window );
+  if ( as )
+    as->changed = TRUE;
+}
+
+void a_autosave_checkpoint ( gpointer window )
+{
+  Autosave *as = autosave_find ( window );
+  if ( as )
+    autosave_checkpoint ( as );
+}
+
+/**
+ * a_autosave_wanted:
+ *
+ * Returns: Whether changes to the layer are being recorded, so the layer need not prepare records otherwise
+ */
+gboolean a_autosave_wanted ( VikLayer *vl )
+{
+  Autosave *as = autosave_find_layer ( vl );
+  return as && as->journal && !as->suspended;
+}
+
+/**
+ * a_autosave_record:
+ * @record: (transfer floating): The change made
+ */
+void a_autosave_record ( VikLayer *vl, GVariant *record )
+{
+  g_variant_ref_sink ( record );
+  Autosave *as = autosave_find_layer ( vl );
+  if ( as && as->journal && !as->suspended ) {
+    // Layers added, removed or moved since the base would be identified wrongly
+    GList *layers = autosave_get_layers ( as );
+    GList *iter = layers, *base = as->layers;
+    for ( ; iter && base && iter->data == base->data; iter = iter->next, base = base->next );
+    gint index = ( iter || base ) ? -1 : g_list_index ( layers, vl );
+    g_list_free ( layers );
+
+    if ( index < 0 )
+      as->suspended = TRUE;
+    else
+      journal_write ( as, g_variant_new ( "(uv)", (guint32)index, record ) );
+  }
+  g_variant_unref ( record );
+}
+
+void a_autosave_suspend ( VikLayer *vl )
+{
+  Autosave *as = autosave_find_layer ( vl );
+  if ( as ) {
+    as->suspended = TRUE;
+    as->changed = TRUE;
+  }
+}
+
+/**
+ * Returns: Whether the process of the given id is running, as far as can be told
+ */
+static gboolean process_running ( gint pid )
+{
+  if ( pid == (gint)getpid() )
+    return TRUE;
+#ifdef WINDOWS
+  return FALSE;
+#else
+  return kill ( pid, 0 ) == 0 || errno == EPERM;
+#endif
+}
+
+/**
+ * a_autosave_get_orphans:
+ *
+ * Returns: The journal filenames of processes that are no longer running
+ */
+GList *a_autosave_get_orphans ( void )
+{
+  GList *orphans = NULL;
+  GDir *dir = g_dir_open ( recovery_dir, 0, NULL );
+  if ( !dir )
+    return NULL;
+  const gchar *name;
+  while ( (name = g_dir_read_name ( dir )) ) {
+    gint pid;
+    guint number;
+    if ( !g_str_has_suffix ( name, JOURNAL_EXT ) || sscanf ( name, "%d-%u", &pid, &number ) != 2 )
+      continue;
+    if ( !process_running ( pid ) )
+      orphans = g_list_prepend ( orphans, g_build_filename ( recovery_dir, name, NULL ) );
+  }
+  g_dir_close ( dir );
+  return orphans;
+}
+
+/**
+ * Returns: The next entry of the journal, or NULL at the end (including when the last entry is incomplete)
+ */
+static GVariant *journal_read ( const gchar **pos, const gchar *end, const GVariantType *type )
+{
+  guint32 length;
+  if ( end - *pos < 4 )
+    return NULL;
+  memcpy ( &length, *pos, 4 );
+  length = GUINT32_FROM_LE ( length );
+  if ( length > (gsize)(end - *pos - 4) )
+    return NULL;
+  // Copied, for the alignment GVariant expects
+  GBytes *bytes = g_bytes_new ( *pos + 4, length );
+  GVariant *value = g_variant_ref_sink ( g_variant_new_from_bytes ( type, bytes, FALSE ) );
+  g_bytes_unref ( bytes );
+  *pos += 4 + length;
+  return value;
+}
+
+/**
+ * Returns: The contents, or NULL if the file is not a journal
+ */
+static gchar *journal_load ( const gchar *journal, const gchar **pos, const gchar **end, gchar **project, gchar **base )
+{
+  gchar *contents;
+  gsize length;
+  if ( !g_file_get_contents ( journal, &contents, &length, NULL ) )
+    return NULL;
+  *pos = contents + JOURNAL_MAGIC_LEN;
+  *end = contents + length;
+  GVariant *header = NULL;
+  if ( length >= JOURNAL_MAGIC_LEN && !memcmp ( contents, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN ) )
+    header = journal_read ( pos, *end, G_VARIANT_TYPE("(ss)") );
+  if ( !header ) {
+    g_free ( contents );
+    return NULL;
+  }
+  const gchar *hproject, *hbase;
+  g_variant_get ( header, "(&s&s)", &hproject, &hbase );
+  if ( project )
+    *project = *hproject ? g_strdup ( hproject ) : NULL;
+  if ( base )
+    *base = *hbase ? g_strdup ( hbase ) : NULL;
+  g_variant_unref ( header );
+  return contents;
+}
+
+/**
+ * a_autosave_read_header:
+ * @project: (out): The file the changes were made to, or NULL if untitled
+ * @base:    (out): The file the journal is to be replayed onto
+ */
+gboolean a_autosave_read_header ( const gchar *journal, gchar **project, gchar **base )
+{
+  const gchar *pos, *end;
+  gchar *contents = journal_load ( journal, &pos, &end, project, base );
+  g_free ( contents );
+  return contents != NULL;
+}
+
+/**
+ * a_autosave_replay:
+ * @top:   Having loaded the journal's base
+ * @total: (out): The number of records
+ *
+ * Returns: The number of records replayed, which stops at the first that no longer fits
+ */
+guint a_autosave_replay ( const gchar *journal, VikAggregateLayer *top, guint *total )
+{
+  const gchar *pos, *end;
+  guint applied = 0;
+  *total = 0;
+  gchar *contents = journal_load ( journal, &pos, &end, NULL, NULL );
+  if ( !contents )
+    return 0;
+
+  GList *layers = vik_aggregate_layer_get_all_layers_of_type ( top, NULL, VIK_LAYER_TRW, TRUE );
+  gboolean ok = TRUE;
+  GVariant *entry;
+  while ( (entry = journal_read ( &pos, end, G_VARIANT_TYPE("(uv)") )) ) {
+    (*total)++;
+    if ( ok ) {
+      guint32 index;
+      GVariant *record;
+      g_variant_get ( entry, "(uv)", &index, &record );
+      VikLayer *vl = g_list_nth_data ( layers, index );
+      ok = vl && vik_trw_layer_replay ( VIK_TRW_LAYER(vl), record );
+      if ( ok )
+        applied++;
+      g_variant_unref ( record );
+    }
+    g_variant_unref ( entry );
+  }
+  g_list_free ( layers );
+  g_free ( contents );
+  return applied;
+}
+
+/**
+ * a_autosave_discard:
+ *
+ * Remove the journal along with any checkpoints of the same window
+ */
+void a_autosave_discard ( const gchar *journal )
+{
+  gchar *basename = g_path_get_basename ( journal );
+  gchar *prefix = g_strndup ( basename, strlen(basename) - strlen(JOURNAL_EXT) );
+  gchar *checkpoint_prefix = g_strconcat ( prefix, "-", NULL );
+  GDir *dir = g_dir_open ( recovery_dir, 0, NULL );
+  if ( dir ) {
+    const gchar *name;
+    while ( (name = g_dir_read_name ( dir )) ) {
+      if ( g_str_has_prefix ( name, checkpoint_prefix ) && g_str_has_suffix ( name, ".vik" ) ) {
+        gchar *filename = g_build_filename ( recovery_dir, name, NULL );
+        (void)g_remove ( filename );
+        g_free ( filename );
+      }
+    }
+    g_dir_close ( dir );
+  }
+  (void)g_remove ( journal );
+  g_free ( checkpoint_prefix );
+  g_free ( prefix );
+  g_free ( basename );
+}
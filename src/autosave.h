@@ -0,0 +1,58 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_AUTOSAVE_H
+#define __VIKING_AUTOSAVE_H
+
+#include <glib.h>
+
+#include "vikaggregatelayer.h"
+#include "vikviewport.h"
+
+G_BEGIN_DECLS
+
+// Journals of the edits made in each window, for recovery after a crash
+void a_autosave_init ( void );
+void a_autosave_uninit ( void );
+
+// The window is identified by its GtkWindow, as found from its layers
+void a_autosave_add_window ( gpointer window, VikAggregateLayer *top, VikViewport *vp );
+void a_autosave_remove_window ( gpointer window );
+// The window's layers have been loaded from, or saved to, the file
+void a_autosave_set_project ( gpointer window, const gchar *filename );
+// The layers have changed, in some way that may not have been journalled
+void a_autosave_changed ( gpointer window );
+// Save everything now, so the journal starts afresh
+void a_autosave_checkpoint ( gpointer window );
+
+// For the layer to record a change, as a record it can replay (see vik_trw_layer_replay())
+gboolean a_autosave_wanted ( VikLayer *vl );
+void a_autosave_record ( VikLayer *vl, GVariant *record );
+// The layer has changed in a way it could not record, so the journal can not be used until the next checkpoint
+void a_autosave_suspend ( VikLayer *vl );
+
+// Journals left by a previous run that did not finish
+GList *a_autosave_get_orphans ( void );
+gboolean a_autosave_read_header ( const gchar *journal, gchar **project, gchar **base );
+guint a_autosave_replay ( const gchar *journal, VikAggregateLayer *top, guint *total );
+void a_autosave_discard ( const gchar *journal );
+
+G_END_DECLS
+
+#endif
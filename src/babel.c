@@ -33,6 +33,8 @@
 #include "viking.h"
 #include "gpx.h"
 #include "babel.h"
+#include "curl_download.h"
+#include "dir.h"
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -60,12 +62,30 @@ static GList *a_babel_file_list = NULL;
  */
 static GList *a_babel_device_list = NULL;
 
+/**
+ * Finding the features means running gpsbabel which can take a while,
+ *  so it is done in the background and only waited for when the lists are needed.
+ */
+static GThread *feature_thread = NULL;
+G_LOCK_DEFINE_STATIC(feature_thread);
+
+static void babel_features_wait ()
+{
+  G_LOCK ( feature_thread );
+  if ( feature_thread ) {
+    g_thread_join ( feature_thread );
+    feature_thread = NULL;
+  }
+  G_UNLOCK ( feature_thread );
+}
+
 /**
  * Run a function on all file formats supporting a given mode.
  */
 void a_babel_foreach_file_with_mode (BabelMode mode, GFunc func, gpointer user_data)
 {
   GList *current;
+  babel_features_wait ();
   for ( current = g_list_first (a_babel_file_list) ;
         current != NULL ;
         current = g_list_next (current) )
@@ -96,6 +116,7 @@ void a_babel_foreach_file_with_mode (BabelMode mode, GFunc func, gpointer user_d
 void a_babel_foreach_file_read_any (GFunc func, gpointer user_data)
 {
   GList *current;
+  babel_features_wait ();
   for ( current = g_list_first (a_babel_file_list) ;
         current != NULL ;
         current = g_list_next (current) )
@@ -388,6 +409,24 @@ gboolean a_babel_convert_from_shellcommand ( VikTrwLayer *vt, const char *input_
  * Returns: %TRUE on successful invocation of GPSBabel or read of the GPX
  *
  */
+static gboolean gpx_read_download_data ( const gchar *data, gsize len, GpxReader *gr )
+{
+  return a_gpx_read_data ( gr, data, len );
+}
+
+/**
+ * Parse GPX whilst it is being downloaded, instead of after saving it all to a file first
+ */
+static gboolean read_gpx_from_url ( VikTrwLayer *vt, const char *url, DownloadFileOptions *options )
+{
+  GpxReader *gr = a_gpx_read_begin ( vt, NULL, FALSE );
+  CURL_download_t dl = curl_download_uri_to_func ( url, options, (CurlDataFunc)gpx_read_download_data, gr );
+  gboolean ret = a_gpx_read_end ( gr );
+  if ( dl != CURL_DOWNLOAD_NO_ERROR )
+    ret = FALSE;
+  return ret;
+}
+
 gboolean a_babel_convert_from_url_filter ( VikTrwLayer *vt, const char *url, const char *input_type, const char *babelfilters, BabelStatusFunc cb, gpointer user_data, DownloadFileOptions *options )
 {
   // If no download options specified, use defaults:
@@ -402,6 +441,21 @@ gboolean a_babel_convert_from_url_filter ( VikTrwLayer *vt, const char *url, con
 
   g_debug("%s: input_type=%s url=%s", __FUNCTION__, input_type, url);
 
+  // Without any conversion or checks of the downloaded file, the GPX can be read as it arrives
+  if ( input_type == NULL && babelfilters == NULL &&
+       myoptions.check_file == NULL && myoptions.convert_file == NULL &&
+       strstr ( url, "://" ) != NULL ) {
+    ret = read_gpx_from_url ( vt, url, &myoptions );
+    // Try to avoid adding the description if URL is OAuth signed
+    if ( !g_ascii_strncasecmp(url, "?oauth_consumer_key=", 20) ) {
+      VikTRWMetadata *meta = vik_trw_layer_get_metadata(vt);
+      if ( meta && !meta->description ) {
+        meta->description = g_strdup ( url );
+      }
+    }
+    return ret;
+  }
+
   if ((fd_src = g_file_open_tmp("tmp-viking.XXXXXX", &name_src, NULL)) >= 0) {
     g_debug ("%s: temporary file: %s", __FUNCTION__, name_src);
     close(fd_src);
@@ -605,8 +659,110 @@ static void load_feature_parse_line (gchar *line)
 
 static void load_feature_cb (BabelProgressCode code, gpointer line, gpointer user_data)
 {
-  if (line != NULL)
+  if (line != NULL) {
     load_feature_parse_line (line);
+    // Keep the raw output for the cache
+    g_string_append ( (GString*)user_data, line );
+  }
+}
+
+/**
+ * load_feature_parse_lines:
+ *
+ * Load all the features in the text, as output by gpsbabel.
+ */
+static void load_feature_parse_lines ( const gchar *text )
+{
+  const gchar *start = text;
+  while ( *start ) {
+    // Lines are handled with their line ending just as when read directly from gpsbabel
+    const gchar *end = strchr ( start, '\n' );
+    gsize len = end ? (end - start + 1) : strlen ( start );
+    gchar *line = g_strndup ( start, len );
+    load_feature_parse_line ( line );
+    g_free ( line );
+    start += len;
+  }
+}
+
+#define BABEL_CACHE_FILE "gpsbabel_features.ini"
+#define BABEL_CACHE_GROUP "gpsbabel"
+
+/**
+ * The features of a gpsbabel program are cached between runs of Viking.
+ * The cache is only valid for the same program file,
+ *  which is determined from its location, modification time and size.
+ * (The version of gpsbabel could only be found by running it, which is what the cache avoids)
+ */
+static gchar *babel_cache_filename ()
+{
+  return g_build_filename ( a_get_viking_dir(), BABEL_CACHE_FILE, NULL );
+}
+
+static gboolean babel_program_stat ( GStatBuf *stat_buf )
+{
+  return gpsbabel_loc && g_stat ( gpsbabel_loc, stat_buf ) == 0;
+}
+
+/**
+ * load_feature_from_cache:
+ *
+ * Returns: %TRUE if the features were loaded from the cache
+ */
+static gboolean load_feature_from_cache ()
+{
+  GStatBuf stat_buf;
+  if ( !babel_program_stat ( &stat_buf ) )
+    return FALSE;
+
+  gboolean ans = FALSE;
+  gchar *fn = babel_cache_filename ();
+  GKeyFile *kf = g_key_file_new ();
+  if ( g_key_file_load_from_file ( kf, fn, G_KEY_FILE_NONE, NULL ) ) {
+    gchar *path = g_key_file_get_string ( kf, BABEL_CACHE_GROUP, "path", NULL );
+    gint64 mtime = g_key_file_get_int64 ( kf, BABEL_CACHE_GROUP, "mtime", NULL );
+    gint64 size = g_key_file_get_int64 ( kf, BABEL_CACHE_GROUP, "size", NULL );
+    gchar *features = g_key_file_get_string ( kf, BABEL_CACHE_GROUP, "features", NULL );
+    if ( g_strcmp0 ( path, gpsbabel_loc ) == 0 &&
+         mtime == (gint64)stat_buf.st_mtime &&
+         size == (gint64)stat_buf.st_size &&
+         features && *features ) {
+      load_feature_parse_lines ( features );
+      ans = TRUE;
+    }
+    else
+      g_debug ( "%s: cache of features for %s is out of date", __FUNCTION__, gpsbabel_loc );
+    g_free ( path );
+    g_free ( features );
+  }
+  g_key_file_free ( kf );
+  g_free ( fn );
+  return ans;
+}
+
+static void save_feature_to_cache ( const gchar *features )
+{
+  GStatBuf stat_buf;
+  if ( !babel_program_stat ( &stat_buf ) )
+    return;
+
+  GKeyFile *kf = g_key_file_new ();
+  g_key_file_set_string ( kf, BABEL_CACHE_GROUP, "path", gpsbabel_loc );
+  g_key_file_set_int64 ( kf, BABEL_CACHE_GROUP, "mtime", (gint64)stat_buf.st_mtime );
+  g_key_file_set_int64 ( kf, BABEL_CACHE_GROUP, "size", (gint64)stat_buf.st_size );
+  g_key_file_set_string ( kf, BABEL_CACHE_GROUP, "features", features );
+
+  gsize size;
+  gchar *contents = g_key_file_to_data ( kf, &size, NULL );
+  gchar *fn = babel_cache_filename ();
+  GError *error = NULL;
+  if ( !g_file_set_contents ( fn, contents, size, &error ) ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+  }
+  g_free ( fn );
+  g_free ( contents );
+  g_key_file_free ( kf );
 }
 
 static gboolean load_feature ()
@@ -623,12 +779,26 @@ static gboolean load_feature ()
     args[i++] = "-^3";
     args[i] = NULL;
 
-    ret = babel_general_convert (load_feature_cb, args, NULL);
+    GString *features = g_string_new ( NULL );
+    ret = babel_general_convert (load_feature_cb, args, features);
+    // Only remember a successful run
+    if ( ret && a_babel_device_list && a_babel_file_list )
+      save_feature_to_cache ( features->str );
+    g_string_free ( features, TRUE );
   }
 
   return ret;
 }
 
+static gpointer load_feature_thread ( gpointer data )
+{
+  gint64 start = g_get_monotonic_time ();
+  if ( !load_feature() )
+    g_warning ( "%s: running gpsbabel to get features failed", __FUNCTION__ );
+  g_debug ( "%s: took %.1f ms", __FUNCTION__, (g_get_monotonic_time() - start) / 1000.0 );
+  return NULL;
+}
+
 static VikLayerParamData gb_default ( void ) {
   VikLayerParamData vlpd;
 #ifdef WINDOWS
@@ -647,6 +817,8 @@ static VikLayerParamData gb_default ( void ) {
 static VikLayerParam prefs[] = {
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_IO_NAMESPACE "gpsbabel", VIK_LAYER_PARAM_STRING, VIK_LAYER_GROUP_NONE, N_("GPSBabel:"), VIK_LAYER_WIDGET_FILEENTRY, NULL, NULL,
       N_("Allow setting the specific instance of GPSBabel. You must restart Viking for this value to take effect."), gb_default, NULL, NULL },
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_IO_NAMESPACE "gpsbabel_cache_features", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Remember GPSBabel Formats:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
+      N_("Remember the file formats and devices supported by GPSBabel, rather than asking GPSBabel at every startup. They are asked for again whenever the GPSBabel program changes, or when this is turned off."), vik_lpd_true_default, NULL, NULL },
 };
 
 /**
@@ -657,6 +829,7 @@ static VikLayerParam prefs[] = {
 void a_babel_init ()
 {
   a_preferences_register ( &prefs[0], (VikLayerParamData){0}, VIKING_PREFERENCES_IO_GROUP_KEY );
+  a_preferences_register ( &prefs[1], (VikLayerParamData){0}, VIKING_PREFERENCES_IO_GROUP_KEY );
 }
 
 /**
@@ -664,7 +837,8 @@ void a_babel_init ()
  *
  * Initialises babel module.
  * Mainly check existence of gpsbabel progam
- * and load all features available in that version.
+ * and start loading all features available in that version.
+ * The features are loaded in the background, see a_babel_available().
  */
 void a_babel_post_init ()
 {
@@ -688,9 +862,14 @@ void a_babel_post_init ()
 #endif
 
   if ( gpsbabel_loc ) {
-    if ( !load_feature() ) {
-      g_warning ( "%s: running gpsbabel to get features failed", __FUNCTION__ );
-    }
+    // Reading the cache is quick enough to do now, so the features are available straight away
+    if ( a_preferences_get(VIKING_PREFERENCES_IO_NAMESPACE "gpsbabel_cache_features")->b )
+      if ( load_feature_from_cache() )
+        return;
+
+    G_LOCK ( feature_thread );
+    feature_thread = g_thread_new ( "babel features", load_feature_thread, NULL );
+    G_UNLOCK ( feature_thread );
   }
 }
 
@@ -701,6 +880,8 @@ void a_babel_post_init ()
  */
 void a_babel_uninit ()
 {
+  babel_features_wait ();
+
   g_free ( gpsbabel_loc );
   g_free ( unbuffer_loc );
 
@@ -733,14 +914,30 @@ void a_babel_uninit ()
  * a_babel_available:
  *
  * Indicates if babel is available or not.
+ * This waits for the features of gpsbabel to be loaded.
  *
  * Returns: true if babel available
  */
 gboolean a_babel_available ()
 {
+  babel_features_wait ();
   return a_babel_device_list != NULL;
 }
 
+/**
+ * a_babel_found:
+ *
+ * Indicates if the gpsbabel program has been found,
+ *  without waiting for its features to be loaded.
+ * Hence suitable for use during startup.
+ *
+ * Returns: true if the gpsbabel program was found
+ */
+gboolean a_babel_found ()
+{
+  return gpsbabel_loc != NULL;
+}
+
 /**
  * a_babel_file_list_get:
  *
@@ -748,6 +945,7 @@ gboolean a_babel_available ()
  */
 GList *a_babel_file_list_get ()
 {
+  babel_features_wait ();
   return a_babel_file_list;
 }
 
@@ -758,5 +956,6 @@ GList *a_babel_file_list_get ()
  */
 GList *a_babel_device_list_get ()
 {
+  babel_features_wait ();
   return a_babel_device_list;
 }
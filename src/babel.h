@@ -122,6 +122,7 @@ void a_babel_post_init ();
 void a_babel_uninit ();
 
 gboolean a_babel_available ();
+gboolean a_babel_found ();
 
 GList *a_babel_file_list_get ();
 GList *a_babel_device_list_get ();
@@ -30,14 +30,41 @@
 #include "uibuilder.h"
 #include "globals.h"
 #include "preferences.h"
+#include "mapcache.h"
+#include "diskcache.h"
+#include "peercache.h"
+#include "trace.h"
 
-static GThreadPool *thread_pool_remote = NULL;
-static GThreadPool *thread_pool_local = NULL;
-#ifdef HAVE_LIBMAPNIK
-static GThreadPool *thread_pool_local_mapnik = NULL;
-#endif
+// A pool for each Background_Pool_Type
+typedef struct {
+  GThreadPool *pool;
+  guint threads;
+  guint bulk_max;     // Maximum of the threads running bulk jobs
+  guint bulk_running;
+  guint paused;       // Bulk jobs waiting for interactive ones to start, whose threads have been lent out
+  gint waiting[BACKGROUND_PRIORITY_NUM]; // Jobs in the pool not yet started, by priority
+  GQueue deferred;    // Bulk jobs waiting for another bulk job to finish
+} pool_t;
+
+static pool_t pools[3];
+static gdouble bulk_fraction = 0.5;
 static gboolean stop_all_threads = FALSE;
 
+// All jobs not yet finished, for changing priorities
+// Protects the pool counts and job priority/state
+static GMutex jobs_lock;
+static GCond jobs_cond;
+static GList *jobs = NULL;
+static guint jobs_sequence = 0;
+
+// State of a job
+enum {
+  JOB_QUEUED = 0,
+  JOB_DEFERRED,
+  JOB_RUNNING,
+  JOB_RUNNING_BULK,
+};
+
 // A single store of background items for all Windows
 // Must always be accessed in the main thread
 static GtkListStore *bgstore = NULL;
@@ -46,9 +73,15 @@ G_LOCK_DEFINE_STATIC(window_list);
 // Still only actually updating the statusbar though
 static GSList *windows_to_update = NULL;
 
-static gint bgitemcount = 0;
+static gint bgitemcount = 0; // Atomic
 
-#define VIK_BG_NUM_ARGS 8
+// Progress of the jobs is only stored by the threads and then shown at this rate,
+//  rather than waking up the main loop for every item
+#define PROGRESS_POLL_MS 100
+static guint progress_timer = 0; // Protected by the jobs_lock
+static gint progress_itemcount = -1;
+
+#define VIK_BG_NUM_ARGS 13
 
 enum
 {
@@ -61,7 +94,7 @@ enum
 void a_background_update_status ( VikWindow *vw, gpointer data )
 {
   static gchar buf[20];
-  g_snprintf(buf, sizeof(buf), _("%d items"), bgitemcount);
+  g_snprintf(buf, sizeof(buf), _("%d items"), g_atomic_int_get(&bgitemcount));
   vik_window_statusbar_update ( vw, buf, VIK_STATUSBAR_ITEMS );
 }
 
@@ -73,19 +106,33 @@ static void background_thread_update ()
   G_UNLOCK(window_list);
 }
 
-typedef struct {
-  GtkTreeIter *iter;
-  gdouble percent;
-} progress_t;
-
 // In main thread
-static gboolean idle_progress_update ( gpointer user_data )
+// Show the latest progress of each job (only where it has changed) and the number of items
+static gboolean progress_poll ( gpointer user_data )
 {
-  progress_t *progress = user_data;
-  if ( bgstore && progress->iter )
-    gtk_list_store_set ( GTK_LIST_STORE(bgstore), progress->iter, PROGRESS_COLUMN, progress->percent, -1 );
-  g_free ( progress );
-  return FALSE;
+  gint count = g_atomic_int_get ( &bgitemcount );
+  if ( count != progress_itemcount ) {
+    progress_itemcount = count;
+    background_thread_update ();
+  }
+
+  gboolean more = TRUE;
+  g_mutex_lock ( &jobs_lock );
+  for ( GList *iter = jobs; iter; iter = iter->next ) {
+    gpointer *args = iter->data;
+    gint progress = GPOINTER_TO_INT(g_atomic_pointer_get(&args[7]));
+    if ( bgstore && args[5] && progress != GPOINTER_TO_INT(args[12]) ) {
+      args[12] = GINT_TO_POINTER(progress);
+      gtk_list_store_set ( GTK_LIST_STORE(bgstore), (GtkTreeIter*)args[5], PROGRESS_COLUMN, progress / 100.0, -1 );
+    }
+  }
+  // Stop until the next job, once the final item count is shown
+  if ( !jobs && count == progress_itemcount ) {
+    progress_timer = 0;
+    more = FALSE;
+  }
+  g_mutex_unlock ( &jobs_lock );
+  return more;
 }
 
 /**
@@ -95,25 +142,330 @@ static gboolean idle_progress_update ( gpointer user_data )
  *
  * Called from other threads
  *
+ * The progress is only stored here, to be shown a few times a second by the main thread.
+ * The thread data may be NULL when the job's function is called directly (e.g. by viking-batch),
+ *  in which case there is no progress to keep.
+ *
  * Returns a non zero number if the thread should be terminated
  */
 int a_background_thread_progress ( gpointer callbackdata, gdouble fraction )
 {
   gpointer *args = (gpointer *) callbackdata;
   int res = a_background_testcancel ( callbackdata );
-  if (args[5] != NULL) {
-    gdouble myfraction = fabs(fraction);
-    if ( myfraction > 1.0 )
-      myfraction = 1.0;
-    progress_t *progress = g_malloc0 ( sizeof(progress_t) );
-    progress->percent = myfraction * 100;
-    progress->iter = (GtkTreeIter*)args[5];
-    args[7] = GUINT_TO_POINTER(gdk_threads_add_idle ( idle_progress_update, progress ));
-  }
+  if ( !args )
+    return res;
+  gdouble myfraction = fabs(fraction);
+  if ( myfraction > 1.0 )
+    myfraction = 1.0;
+  // In hundredths of a percent
+  g_atomic_pointer_set ( &args[7], GINT_TO_POINTER((gint)(myfraction * 10000)) );
+  VIK_TRACE_ARGS ( "background", "progress", TRACE_PHASE_INSTANT, "job", GPOINTER_TO_UINT(args[10]), "percent", (gint)(myfraction * 100) );
 
   args[6] = GINT_TO_POINTER(GPOINTER_TO_INT(args[6])-1);
-  bgitemcount--;
-  background_thread_update();
+  g_atomic_int_add ( &bgitemcount, -1 );
+  return res;
+}
+
+/*
+ * Tasks are shared out over a worker thread per CPU, separately from the pools of whole jobs.
+ * Each worker has its own deque of the tasks it adds: it takes the newest of these itself,
+ *  whereas idle workers steal the oldest. Tasks added by any other thread go in a shared queue.
+ * Waiting for a group runs tasks meanwhile, so a task can itself wait on a group of subtasks.
+ */
+struct _VikTaskGroup {
+  GMutex lock;
+  GCond cond;
+  guint remaining; // Protected by the lock
+  gint cancelled;
+};
+
+typedef struct {
+  GFunc func;
+  gpointer item;
+  gpointer user_data;
+  VikTaskGroup *group;
+} task_t;
+
+typedef struct {
+  GMutex lock;
+  GQueue tasks;
+} task_worker_t;
+
+static task_worker_t *task_workers = NULL;
+static guint n_task_workers = 0;
+static GPrivate task_worker_key;
+// The shared queue and sleeping of idle workers
+static GMutex task_lock;
+static GCond task_cond;
+static GQueue task_queue = G_QUEUE_INIT;
+static gint tasks_queued = 0; // In all queues
+static gboolean task_workers_stop = FALSE;
+
+static void task_run ( task_t *task )
+{
+  VikTaskGroup *group = task->group;
+  if ( !g_atomic_int_get ( &group->cancelled ) )
+    task->func ( task->item, task->user_data );
+  g_free ( task );
+
+  g_mutex_lock ( &group->lock );
+  if ( --group->remaining == 0 )
+    g_cond_broadcast ( &group->cond );
+  g_mutex_unlock ( &group->lock );
+}
+
+/**
+ * Get the next task for a worker: its own newest, otherwise the oldest shared or of another worker
+ */
+static task_t *task_find ( task_worker_t *self )
+{
+  if ( g_atomic_int_get ( &tasks_queued ) <= 0 )
+    return NULL;
+
+  task_t *task = NULL;
+  g_mutex_lock ( &self->lock );
+  task = g_queue_pop_tail ( &self->tasks );
+  g_mutex_unlock ( &self->lock );
+
+  if ( !task ) {
+    g_mutex_lock ( &task_lock );
+    task = g_queue_pop_head ( &task_queue );
+    g_mutex_unlock ( &task_lock );
+  }
+
+  guint me = self - task_workers;
+  for ( guint nn = 1; !task && nn < n_task_workers; nn++ ) {
+    task_worker_t *victim = &task_workers[(me + nn) % n_task_workers];
+    g_mutex_lock ( &victim->lock );
+    task = g_queue_pop_head ( &victim->tasks );
+    g_mutex_unlock ( &victim->lock );
+  }
+
+  if ( task )
+    g_atomic_int_add ( &tasks_queued, -1 );
+  return task;
+}
+
+/**
+ * Get a shared task belonging to the group, for a thread that is not a worker to help with
+ *  (rather than with anything else, which could take much longer)
+ */
+static task_t *task_find_in_group ( VikTaskGroup *group )
+{
+  task_t *task = NULL;
+  g_mutex_lock ( &task_lock );
+  for ( GList *iter = task_queue.head; iter; iter = iter->next ) {
+    if ( ((task_t*)iter->data)->group == group ) {
+      task = iter->data;
+      g_queue_delete_link ( &task_queue, iter );
+      break;
+    }
+  }
+  g_mutex_unlock ( &task_lock );
+  if ( task )
+    g_atomic_int_add ( &tasks_queued, -1 );
+  return task;
+}
+
+static gpointer task_worker_thread ( task_worker_t *self )
+{
+  g_private_set ( &task_worker_key, self );
+  while ( TRUE ) {
+    task_t *task = task_find ( self );
+    if ( task ) {
+      task_run ( task );
+      continue;
+    }
+    g_mutex_lock ( &task_lock );
+    while ( !task_workers_stop && g_atomic_int_get ( &tasks_queued ) <= 0 )
+      g_cond_wait ( &task_cond, &task_lock );
+    gboolean stop = task_workers_stop;
+    g_mutex_unlock ( &task_lock );
+    if ( stop )
+      break;
+  }
+  return NULL;
+}
+
+/**
+ * a_background_tasks_new:
+ *
+ * Returns: A new group for adding tasks to, to be freed with a_background_tasks_free()
+ */
+VikTaskGroup *a_background_tasks_new ( void )
+{
+  VikTaskGroup *group = g_malloc0 ( sizeof(VikTaskGroup) );
+  g_mutex_init ( &group->lock );
+  g_cond_init ( &group->cond );
+  return group;
+}
+
+/**
+ * a_background_tasks_add:
+ * @func: Called with @item and @user_data from one of the worker threads
+ *
+ * Tasks may be added from any thread, including from within another task.
+ */
+void a_background_tasks_add ( VikTaskGroup *group, GFunc func, gpointer item, gpointer user_data )
+{
+  task_t *task = g_malloc ( sizeof(task_t) );
+  task->func = func;
+  task->item = item;
+  task->user_data = user_data;
+  task->group = group;
+
+  g_mutex_lock ( &group->lock );
+  group->remaining++;
+  g_mutex_unlock ( &group->lock );
+
+  // No workers (e.g. not initialized or shutting down), so do it now
+  if ( !n_task_workers || task_workers_stop ) {
+    task_run ( task );
+    return;
+  }
+
+  // Counted before being available, so no worker goes to sleep with it pending
+  g_atomic_int_inc ( &tasks_queued );
+  task_worker_t *self = g_private_get ( &task_worker_key );
+  if ( self ) {
+    g_mutex_lock ( &self->lock );
+    g_queue_push_tail ( &self->tasks, task );
+    g_mutex_unlock ( &self->lock );
+    g_mutex_lock ( &task_lock );
+  }
+  else {
+    g_mutex_lock ( &task_lock );
+    g_queue_push_tail ( &task_queue, task );
+  }
+  g_cond_signal ( &task_cond );
+  g_mutex_unlock ( &task_lock );
+}
+
+/**
+ * a_background_tasks_wait:
+ * @timeout_ms: How long to wait, or -1 to wait until all are done
+ *
+ * Meanwhile tasks are run in this thread too.
+ * NB The timeout is only checked between tasks.
+ *
+ * Returns: TRUE when all tasks in the group are done
+ */
+gboolean a_background_tasks_wait ( VikTaskGroup *group, gint timeout_ms )
+{
+  gint64 end_time = timeout_ms < 0 ? G_MAXINT64 : g_get_monotonic_time() + timeout_ms * G_TIME_SPAN_MILLISECOND;
+  task_worker_t *self = g_private_get ( &task_worker_key );
+  while ( TRUE ) {
+    g_mutex_lock ( &group->lock );
+    gboolean done = ( group->remaining == 0 );
+    g_mutex_unlock ( &group->lock );
+    if ( done )
+      return TRUE;
+    if ( g_get_monotonic_time() >= end_time )
+      return FALSE;
+
+    task_t *task = self ? task_find ( self ) : task_find_in_group ( group );
+    if ( task ) {
+      task_run ( task );
+      continue;
+    }
+
+    // The rest are already running elsewhere
+    // A worker checks again soon, as more tasks may become available to help with
+    gint64 until = self ? MIN ( end_time, g_get_monotonic_time() + G_TIME_SPAN_MILLISECOND ) : end_time;
+    g_mutex_lock ( &group->lock );
+    if ( group->remaining )
+      (void)g_cond_wait_until ( &group->cond, &group->lock, until );
+    g_mutex_unlock ( &group->lock );
+  }
+}
+
+/**
+ * a_background_tasks_cancel:
+ *
+ * Tasks of the group not yet started are skipped.
+ * Running tasks can check a_background_tasks_cancelled() to stop early.
+ */
+void a_background_tasks_cancel ( VikTaskGroup *group )
+{
+  g_atomic_int_set ( &group->cancelled, 1 );
+}
+
+gboolean a_background_tasks_cancelled ( VikTaskGroup *group )
+{
+  return g_atomic_int_get ( &group->cancelled );
+}
+
+/**
+ * a_background_tasks_free:
+ *
+ * Waits for all tasks in the group to be done first
+ */
+void a_background_tasks_free ( VikTaskGroup *group )
+{
+  (void)a_background_tasks_wait ( group, -1 );
+  g_mutex_clear ( &group->lock );
+  g_cond_clear ( &group->cond );
+  g_free ( group );
+}
+
+typedef struct {
+  GFunc func;
+  gpointer user_data;
+  gint done;
+} parallel_t;
+
+static void parallel_item ( gpointer item, parallel_t *pt )
+{
+  pt->func ( item, pt->user_data );
+  g_atomic_int_inc ( &pt->done );
+}
+
+/**
+ * a_background_thread_parallel:
+ * @callbackdata: Thread data of the background thread this is called from
+ * @func:         Called for each item (with @user_data), from several threads at once
+ * @items:        The items, which must not be NULL
+ * @count:        The number of items
+ * @progress:     Whether each item done counts as progress of the background thread
+ *
+ * For a background thread to share out independent pieces of work as tasks
+ *
+ * Returns a non zero number if the thread should be terminated,
+ *  in which case not all of the items will have been processed
+ */
+int a_background_thread_parallel ( gpointer callbackdata, GFunc func, gpointer *items, guint count, gpointer user_data, gboolean progress )
+{
+  parallel_t pt;
+  pt.func = func;
+  pt.user_data = user_data;
+  pt.done = 0;
+
+  VikTaskGroup *group = a_background_tasks_new ();
+  for ( guint ii = 0; ii < count; ii++ )
+    a_background_tasks_add ( group, (GFunc)parallel_item, items[ii], &pt );
+
+  int res = 0;
+  guint reported = 0;
+  gboolean finished = FALSE;
+  while ( !finished ) {
+    finished = a_background_tasks_wait ( group, 100 );
+    if ( res )
+      continue;
+    if ( progress ) {
+      guint done = g_atomic_int_get ( &pt.done );
+      while ( !res && reported < done ) {
+        reported++;
+        res = a_background_thread_progress ( callbackdata, (gdouble)reported / count );
+      }
+    }
+    else
+      res = a_background_testcancel ( callbackdata );
+    // Skip whatever is remaining
+    if ( res )
+      a_background_tasks_cancel ( group );
+  }
+
+  a_background_tasks_free ( group );
   return res;
 }
 
@@ -124,24 +476,51 @@ static void thread_die ( gpointer args[VIK_BG_NUM_ARGS] )
   if ( userdata_free_func != NULL )
     userdata_free_func ( args[2] );
 
-  if ( GPOINTER_TO_INT(args[6]) )
-  {
-    bgitemcount -= GPOINTER_TO_INT(args[6]);
-    background_thread_update ();
-  }
-
   g_free ( args );
 }
 
+/**
+ * A running bulk job pauses while any interactive jobs are waiting to start in its pool,
+ *  with its thread lent out to them meanwhile
+ */
+static void job_give_way ( gpointer args[VIK_BG_NUM_ARGS] )
+{
+  pool_t *pl = &pools[GPOINTER_TO_INT(args[9])];
+  // Quick check without the lock, as this is called for every item
+  if ( GPOINTER_TO_INT(args[11]) != JOB_RUNNING_BULK ||
+       !g_atomic_int_get(&pl->waiting[BACKGROUND_PRIORITY_INTERACTIVE]) )
+    return;
+  g_mutex_lock ( &jobs_lock );
+  if ( GPOINTER_TO_INT(args[11]) == JOB_RUNNING_BULK &&
+       GPOINTER_TO_INT(args[8]) == BACKGROUND_PRIORITY_BULK &&
+       pl->waiting[BACKGROUND_PRIORITY_INTERACTIVE] ) {
+    pl->paused++;
+    g_thread_pool_set_max_threads ( pl->pool, pl->threads + pl->paused, NULL );
+    while ( pl->waiting[BACKGROUND_PRIORITY_INTERACTIVE] &&
+            GPOINTER_TO_INT(args[8]) == BACKGROUND_PRIORITY_BULK &&
+            !args[0] && !stop_all_threads ) {
+      gint64 end_time = g_get_monotonic_time () + 100 * G_TIME_SPAN_MILLISECOND;
+      (void)g_cond_wait_until ( &jobs_cond, &jobs_lock, end_time );
+    }
+    pl->paused--;
+    g_thread_pool_set_max_threads ( pl->pool, pl->threads + pl->paused, NULL );
+  }
+  g_mutex_unlock ( &jobs_lock );
+}
+
 // Called from other threads
 // Returns a non zero number if the thread should be terminated
+// Bulk jobs may also be paused here, to let interactive jobs go first
 int a_background_testcancel ( gpointer callbackdata )
 {
   gpointer *args = (gpointer *) callbackdata;
   if ( stop_all_threads ) 
     return -1;
+  if ( args && !args[0] )
+    job_give_way ( args );
   if ( args && args[0] )
   {
+    VIK_TRACE_ARG ( "background", "cancel", TRACE_PHASE_INSTANT, "job", GPOINTER_TO_UINT(args[10]) );
     vik_thr_free_func cleanup = args[4];
     if ( cleanup )
       cleanup ( args[2] );
@@ -166,17 +545,77 @@ static void thread_helper ( gpointer args[VIK_BG_NUM_ARGS], gpointer user_data )
   /* unpack args */
   vik_thr_func func = args[1];
   gpointer userdata = args[2];
+  pool_t *pl = &pools[GPOINTER_TO_INT(args[9])];
 
   g_debug(__FUNCTION__);
 
+  g_mutex_lock ( &jobs_lock );
+  Background_Priority priority = GPOINTER_TO_INT(args[8]);
+  pl->waiting[priority]--;
+  if ( priority == BACKGROUND_PRIORITY_BULK && pl->bulk_running >= pl->bulk_max ) {
+    // Put aside until another bulk job finishes, leaving this thread for other jobs
+    args[11] = GINT_TO_POINTER(JOB_DEFERRED);
+    g_queue_push_tail ( &pl->deferred, args );
+    g_mutex_unlock ( &jobs_lock );
+    VIK_TRACE_ARG ( "background", "defer", TRACE_PHASE_INSTANT, "job", GPOINTER_TO_UINT(args[10]) );
+    return;
+  }
+  if ( priority == BACKGROUND_PRIORITY_BULK ) {
+    pl->bulk_running++;
+    args[11] = GINT_TO_POINTER(JOB_RUNNING_BULK);
+  }
+  else
+    args[11] = GINT_TO_POINTER(JOB_RUNNING);
+  // Any paused bulk jobs can continue once no interactive jobs are waiting
+  if ( priority == BACKGROUND_PRIORITY_INTERACTIVE && !pl->waiting[priority] )
+    g_cond_broadcast ( &jobs_cond );
+  g_mutex_unlock ( &jobs_lock );
+
+  VIK_TRACE_ARGS ( "background", "job", TRACE_PHASE_BEGIN, "job", GPOINTER_TO_UINT(args[10]), "priority", priority );
   func ( userdata, args );
+  VIK_TRACE_ARG ( "background", "job", TRACE_PHASE_END, "cancelled", GPOINTER_TO_INT(args[0]) );
+
+  // Any items not reported as done
+  if ( GPOINTER_TO_INT(args[6]) )
+    g_atomic_int_add ( &bgitemcount, -GPOINTER_TO_INT(args[6]) );
+
+  gpointer *next = NULL;
+  g_mutex_lock ( &jobs_lock );
+  // No more progress to show, before the list item goes
+  jobs = g_list_remove ( jobs, args );
+  if ( GPOINTER_TO_INT(args[11]) == JOB_RUNNING_BULK ) {
+    pl->bulk_running--;
+    next = g_queue_pop_head ( &pl->deferred );
+    if ( next ) {
+      next[11] = GINT_TO_POINTER(JOB_QUEUED);
+      pl->waiting[GPOINTER_TO_INT(next[8])]++;
+    }
+  }
+  g_mutex_unlock ( &jobs_lock );
+  if ( next )
+    g_thread_pool_push ( pl->pool, next, NULL );
 
   if ( ! args[0] ) {
     gdk_threads_add_idle ( idle_remove, args[5] );
   }
+
   thread_die ( args );
 }
 
+// Highest priority first, and otherwise in order of being added
+static gint job_compare ( gconstpointer a, gconstpointer b, gpointer user_data )
+{
+  gpointer *args_a = (gpointer *)a;
+  gpointer *args_b = (gpointer *)b;
+  gint pa = GPOINTER_TO_INT(args_a[8]);
+  gint pb = GPOINTER_TO_INT(args_b[8]);
+  if ( pa != pb )
+    return pa - pb;
+  guint sa = GPOINTER_TO_UINT(args_a[10]);
+  guint sb = GPOINTER_TO_UINT(args_b[10]);
+  return sa < sb ? -1 : (sa > sb ? 1 : 0);
+}
+
 /**
  * a_background_thread:
  * @bp:      Which pool this thread should run in
@@ -191,6 +630,19 @@ static void thread_helper ( gpointer args[VIK_BG_NUM_ARGS], gpointer user_data )
  * Function to enlist new background function.
  */
 void a_background_thread ( Background_Pool_Type bp, GtkWindow *parent, const gchar *message, vik_thr_func func, gpointer userdata, vik_thr_free_func userdata_free_func, vik_thr_free_func userdata_cancel_cleanup_func, gint number_items )
+{
+  a_background_thread_with_priority ( bp, BACKGROUND_PRIORITY_NORMAL, parent, message, func, userdata, userdata_free_func, userdata_cancel_cleanup_func, number_items );
+}
+
+/**
+ * a_background_thread_with_priority:
+ * @priority: Jobs of higher priority are started first.
+ *            Bulk jobs are also limited to some of the threads of the pool,
+ *            and pause to let any waiting interactive jobs start.
+ *
+ * As a_background_thread()
+ */
+void a_background_thread_with_priority ( Background_Pool_Type bp, Background_Priority priority, GtkWindow *parent, const gchar *message, vik_thr_func func, gpointer userdata, vik_thr_free_func userdata_free_func, vik_thr_free_func userdata_cancel_cleanup_func, gint number_items )
 {
   GtkTreeIter *piter = g_malloc ( sizeof ( GtkTreeIter ) );
   gpointer *args = g_malloc ( sizeof(gpointer) * VIK_BG_NUM_ARGS );
@@ -204,9 +656,13 @@ void a_background_thread ( Background_Pool_Type bp, GtkWindow *parent, const gch
   args[4] = userdata_cancel_cleanup_func;
   args[5] = piter;
   args[6] = GINT_TO_POINTER(number_items);
-  args[7] = GUINT_TO_POINTER(0); // Will be id of progress update func
+  args[7] = GINT_TO_POINTER(0); // Progress as stored by the thread
+  args[12] = GINT_TO_POINTER(0); // Progress as shown
+  args[8] = GINT_TO_POINTER(priority);
+  args[9] = GINT_TO_POINTER(bp);
+  args[11] = GINT_TO_POINTER(JOB_QUEUED);
 
-  bgitemcount += number_items;
+  g_atomic_int_add ( &bgitemcount, number_items );
 
   gtk_list_store_append ( bgstore, piter );
   gtk_list_store_set ( bgstore, piter,
@@ -215,15 +671,94 @@ void a_background_thread ( Background_Pool_Type bp, GtkWindow *parent, const gch
 		       DATA_COLUMN, args,
 		       -1 );
 
+  g_mutex_lock ( &jobs_lock );
+  args[10] = GUINT_TO_POINTER(jobs_sequence++);
+  VIK_TRACE_ARGS ( "background", "enqueue", TRACE_PHASE_INSTANT, "job", GPOINTER_TO_UINT(args[10]), "pool", bp );
+  pools[bp].waiting[priority]++;
+  jobs = g_list_prepend ( jobs, args );
+  if ( !progress_timer )
+    progress_timer = gdk_threads_add_timeout ( PROGRESS_POLL_MS, progress_poll, NULL );
+  g_mutex_unlock ( &jobs_lock );
+
   /* run the thread in the background */
-  if ( bp == BACKGROUND_POOL_REMOTE )
-    g_thread_pool_push( thread_pool_remote, args, NULL );
-#ifdef HAVE_LIBMAPNIK
-  else if ( bp == BACKGROUND_POOL_LOCAL_MAPNIK )
-    g_thread_pool_push( thread_pool_local_mapnik, args, NULL );
-#endif
-  else
-    g_thread_pool_push( thread_pool_local, args, NULL );
+  g_thread_pool_push( pools[bp].pool, args, NULL );
+}
+
+/**
+ * a_background_get_pool_stats:
+ * @queued: Returns the number of jobs waiting to start (including any put aside)
+ * @running: Returns the number of jobs in progress
+ *
+ * For the performance display.
+ */
+void a_background_get_pool_stats ( Background_Pool_Type bp, guint *queued, guint *running )
+{
+  *queued = 0;
+  *running = 0;
+  g_mutex_lock ( &jobs_lock );
+  for ( GList *iter = jobs; iter; iter = iter->next ) {
+    gpointer *args = iter->data;
+    if ( GPOINTER_TO_INT(args[9]) != bp )
+      continue;
+    gint state = GPOINTER_TO_INT(args[11]);
+    if ( state == JOB_RUNNING || state == JOB_RUNNING_BULK )
+      (*running)++;
+    else
+      (*queued)++;
+  }
+  g_mutex_unlock ( &jobs_lock );
+}
+
+/**
+ * a_background_thread_raise_priority:
+ * @userdata: Of the job, as given to a_background_thread_with_priority()
+ *
+ * Such as when the results of a job become needed for display.
+ * Nothing happens if the job has finished or already has the priority (or higher).
+ */
+void a_background_thread_raise_priority ( gpointer userdata, Background_Priority priority )
+{
+  pool_t *resort = NULL;
+  pool_t *requeue = NULL;
+  gpointer *args = NULL;
+
+  g_mutex_lock ( &jobs_lock );
+  for ( GList *iter = jobs; iter; iter = iter->next ) {
+    if ( ((gpointer*)iter->data)[2] == userdata ) {
+      args = iter->data;
+      break;
+    }
+  }
+  if ( args && priority < GPOINTER_TO_INT(args[8]) ) {
+    pool_t *pl = &pools[GPOINTER_TO_INT(args[9])];
+    switch ( GPOINTER_TO_INT(args[11]) ) {
+    case JOB_QUEUED:
+      pl->waiting[GPOINTER_TO_INT(args[8])]--;
+      pl->waiting[priority]++;
+      resort = pl;
+      break;
+    case JOB_DEFERRED:
+      if ( priority != BACKGROUND_PRIORITY_BULK ) {
+        g_queue_remove ( &pl->deferred, args );
+        args[11] = GINT_TO_POINTER(JOB_QUEUED);
+        pl->waiting[priority]++;
+        requeue = pl;
+      }
+      break;
+    default:
+      // Now no longer pausing if a running bulk job
+      g_cond_broadcast ( &jobs_cond );
+      break;
+    }
+    args[8] = GINT_TO_POINTER(priority);
+  }
+  g_mutex_unlock ( &jobs_lock );
+
+  // Setting the function again reorders those already in the pool
+  if ( resort )
+    g_thread_pool_set_sort_function ( resort->pool, job_compare, NULL );
+  if ( requeue )
+    g_thread_pool_push ( requeue->pool, args, NULL );
 }
 
 // In main thread
@@ -238,12 +773,40 @@ static void cancel_job_with_iter ( GtkTreeIter *piter )
     /* we know args still exists because it is free _after_ the list item is destroyed */
     /* need MUTEX ? */
     args[0] = GINT_TO_POINTER(1); /* set killswitch */
-    (void)g_source_remove ( GPOINTER_TO_UINT(args[7]) ); // Stop next idle_progress_update() from running
     g_free ( args[5] );
     args[5] = NULL;
 }
 
 static GtkWidget *bgwindow = NULL;
+static GtkWidget *bgwindow_cache_label = NULL;
+static guint bgwindow_cache_timer = 0;
+
+// In main thread
+static gboolean bgwindow_cache_label_update ( gpointer user_data )
+{
+  if ( !bgwindow_cache_label )
+    return FALSE;
+  mapcache_stats_t stats;
+  a_mapcache_get_stats ( &stats );
+  gchar *stats_str = a_mapcache_stats_to_string ( &stats );
+  a_mapcache_get_stats_encoded ( &stats );
+  gchar *enc_stats_str = a_mapcache_stats_to_string ( &stats );
+  gchar *disk_str = a_diskcache_usage_string ();
+  gchar *msg = g_strdup_printf ( _("Map Cache: %s\nMap File Cache: %s\nMap Disk Cache: %s"), stats_str, enc_stats_str, disk_str );
+  gchar *peer_str = a_peercache_usage_string ();
+  if ( peer_str ) {
+    gchar *full = g_strdup_printf ( _("%s\nMap Peers: %s"), msg, peer_str );
+    g_free ( msg );
+    msg = full;
+    g_free ( peer_str );
+  }
+  gtk_label_set_text ( GTK_LABEL(bgwindow_cache_label), msg );
+  g_free ( msg );
+  g_free ( disk_str );
+  g_free ( enc_stats_str );
+  g_free ( stats_str );
+  return TRUE;
+}
 
 // In main thread
 static void bgwindow_response (GtkDialog *dialog, gint response_id, GtkTreeView *bgtreeview )
@@ -252,6 +815,10 @@ static void bgwindow_response (GtkDialog *dialog, gint response_id, GtkTreeView
   case GTK_RESPONSE_DELETE_EVENT:
     // Delibrate fall through
   case GTK_RESPONSE_CLOSE:
+    if ( bgwindow_cache_timer )
+      (void)g_source_remove ( bgwindow_cache_timer );
+    bgwindow_cache_timer = 0;
+    bgwindow_cache_label = NULL;
     bgwindow = NULL;
     gtk_widget_destroy ( GTK_WIDGET(dialog) );
     break;
@@ -281,16 +848,21 @@ static void bgwindow_response (GtkDialog *dialog, gint response_id, GtkTreeView
 
 #define VIK_SETTINGS_BACKGROUND_MAX_THREADS "background_max_threads"
 #define VIK_SETTINGS_BACKGROUND_MAX_THREADS_LOCAL "background_max_threads_local"
+#define VIK_SETTINGS_BACKGROUND_BULK_FRACTION "background_bulk_fraction"
 
 #ifdef HAVE_LIBMAPNIK
-// Default to 1 thread due to potential crashing issues
-static VikLayerParamData mpk_thrds_default ( void ) { return VIK_LPD_UINT(1); }
+// Each render thread has its own Mapnik map instance, so default to the same as other local tasks
+static VikLayerParamData mpk_thrds_default ( void )
+{
+  guint cores = util_get_number_of_cores ();
+  return VIK_LPD_UINT ( cores > 1 ? cores-1 : 1 );
+}
 
 VikLayerParamScale params_threads[] = { {1, 64, 1, 0} }; // 64 threads should be enough for anyone...
 // implicit use of 'MAPNIK_PREFS_NAMESPACE' to avoid dependency issues
 static VikLayerParam prefs_mapnik[] = {
   { VIK_LAYER_NUM_TYPES, "mapnik.background_max_threads_local_mapnik", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Threads:"), VIK_LAYER_WIDGET_SPINBUTTON, params_threads, NULL,
-    N_("Number of threads to use for Mapnik tasks. You need to restart Viking for a change to this value to be used"), mpk_thrds_default, NULL, NULL },
+    N_("Number of threads to use for Mapnik tasks"), mpk_thrds_default, NULL, NULL },
 };
 #endif
 
@@ -307,6 +879,35 @@ void a_background_init ()
 #endif
 }
 
+/**
+ * Change the number of threads of a pool, which takes effect as running jobs finish
+ */
+static void pool_set_threads ( pool_t *pl, guint threads )
+{
+  g_mutex_lock ( &jobs_lock );
+  pl->threads = MAX ( 1, threads );
+  pl->bulk_max = MAX ( 1, (guint)(pl->threads * bulk_fraction) );
+  // Any threads lent out by paused bulk jobs remain on top
+  g_thread_pool_set_max_threads ( pl->pool, pl->threads + pl->paused, NULL );
+  g_mutex_unlock ( &jobs_lock );
+}
+
+/**
+ * a_background_refresh_preferences:
+ *
+ * Resize the pools whose size is a preference,
+ *  call whenever the preferences may have been changed.
+ */
+void a_background_refresh_preferences ()
+{
+#ifdef HAVE_LIBMAPNIK
+  // implicit use of 'MAPNIK_PREFS_NAMESPACE' to avoid dependency issues
+  guint threads = a_preferences_get("mapnik.background_max_threads_local_mapnik")->u;
+  if ( threads != pools[BACKGROUND_POOL_LOCAL_MAPNIK].threads )
+    pool_set_threads ( &pools[BACKGROUND_POOL_LOCAL_MAPNIK], threads );
+#endif
+}
+
 /**
  * a_background_post_init:
  *
@@ -320,23 +921,46 @@ void a_background_post_init()
   if ( a_settings_get_integer ( VIK_SETTINGS_BACKGROUND_MAX_THREADS, &maxt ) )
     max_threads = maxt;
 
-  thread_pool_remote = g_thread_pool_new ( (GFunc) thread_helper, NULL, max_threads, FALSE, NULL );
+  pools[BACKGROUND_POOL_REMOTE].threads = max_threads;
 
   if ( a_settings_get_integer ( VIK_SETTINGS_BACKGROUND_MAX_THREADS_LOCAL, &maxt ) )
     max_threads = maxt;
   else {
-    guint cpus = util_get_number_of_cpus ();
-    max_threads = cpus > 1 ? cpus-1 : 1; // Don't use all available CPUs!
+    // Decoding and drawing tiles gains little from SMT siblings, so size by the physical cores
+    guint cores = util_get_number_of_cores ();
+    max_threads = cores > 1 ? cores-1 : 1; // Don't use all available CPUs!
   }
+  pools[BACKGROUND_POOL_LOCAL].threads = max_threads;
 
-  thread_pool_local = g_thread_pool_new ( (GFunc) thread_helper, NULL, max_threads, FALSE, NULL );
+  // By default bulk jobs can only use half of each pool, so there are always threads for other jobs
+  gdouble bf;
+  if ( a_settings_get_double ( VIK_SETTINGS_BACKGROUND_BULK_FRACTION, &bf ) )
+    bulk_fraction = CLAMP ( bf, 0.0, 1.0 );
 
+  guint n_pools = 2;
 #ifdef HAVE_LIBMAPNIK
   // implicit use of 'MAPNIK_PREFS_NAMESPACE' to avoid dependency issues
-  guint mapnik_threads = a_preferences_get("mapnik.background_max_threads_local_mapnik")->u;
-  thread_pool_local_mapnik = g_thread_pool_new ( (GFunc) thread_helper, NULL, mapnik_threads, FALSE, NULL );
+  pools[BACKGROUND_POOL_LOCAL_MAPNIK].threads = a_preferences_get("mapnik.background_max_threads_local_mapnik")->u;
+  n_pools = 3;
 #endif
 
+  for ( guint pp = 0; pp < n_pools; pp++ ) {
+    pools[pp].threads = MAX ( 1, pools[pp].threads );
+    pools[pp].bulk_max = MAX ( 1, (guint)(pools[pp].threads * bulk_fraction) );
+    g_queue_init ( &pools[pp].deferred );
+    pools[pp].pool = g_thread_pool_new ( (GFunc) thread_helper, NULL, pools[pp].threads, FALSE, NULL );
+    g_thread_pool_set_sort_function ( pools[pp].pool, job_compare, NULL );
+  }
+
+  n_task_workers = MAX ( 1, util_get_number_of_cpus () );
+  task_workers = g_new0 ( task_worker_t, n_task_workers );
+  for ( guint nn = 0; nn < n_task_workers; nn++ ) {
+    g_mutex_init ( &task_workers[nn].lock );
+    g_queue_init ( &task_workers[nn].tasks );
+  }
+  for ( guint nn = 0; nn < n_task_workers; nn++ )
+    g_thread_unref ( g_thread_new ( "viking-tasks", (GThreadFunc)task_worker_thread, &task_workers[nn] ) );
+
   bgstore = gtk_list_store_new ( N_COLUMNS, G_TYPE_STRING, G_TYPE_DOUBLE, G_TYPE_POINTER );
 }
 
@@ -378,6 +1002,13 @@ void a_background_show_window ()
 
   bgwindow = gtk_dialog_new_with_buttons ( _("Viking Background Jobs"), NULL, 0, GTK_STOCK_CLOSE, GTK_RESPONSE_CLOSE, GTK_STOCK_DELETE, 1, GTK_STOCK_CLEAR, 2, NULL );
   gtk_box_pack_start ( GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(bgwindow))), scrolled_window, TRUE, TRUE, 0 );
+
+  // Since the background jobs are mostly map tile related, show the cache effectiveness too
+  bgwindow_cache_label = gtk_label_new ( NULL );
+  gtk_misc_set_alignment ( GTK_MISC(bgwindow_cache_label), 0.0, 0.5 );
+  gtk_box_pack_start ( GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(bgwindow))), bgwindow_cache_label, FALSE, FALSE, 5 );
+  (void)bgwindow_cache_label_update ( NULL );
+  bgwindow_cache_timer = g_timeout_add_seconds ( 2, bgwindow_cache_label_update, NULL );
   gtk_window_set_default_size ( GTK_WINDOW(bgwindow), 400, 400 );
 
   g_signal_connect ( G_OBJECT(bgwindow), "response", G_CALLBACK(bgwindow_response), GTK_TREE_VIEW(bgtreeview) );
@@ -395,12 +1026,22 @@ void a_background_show_window ()
 void a_background_uninit()
 {
   stop_all_threads = TRUE;
+  // As for the pools, the task workers are not waited for (and so their data is left)
+  g_mutex_lock ( &task_lock );
+  task_workers_stop = TRUE;
+  g_cond_broadcast ( &task_cond );
+  g_mutex_unlock ( &task_lock );
   // Don't wait for these threads to complete - i.e. end now.
-  g_thread_pool_free ( thread_pool_remote, TRUE, FALSE );
-  g_thread_pool_free ( thread_pool_local, TRUE, FALSE );
+  g_thread_pool_free ( pools[BACKGROUND_POOL_REMOTE].pool, TRUE, FALSE );
+  g_thread_pool_free ( pools[BACKGROUND_POOL_LOCAL].pool, TRUE, FALSE );
 #ifdef HAVE_LIBMAPNIK
-  g_thread_pool_free ( thread_pool_local_mapnik, TRUE, FALSE );
+  g_thread_pool_free ( pools[BACKGROUND_POOL_LOCAL_MAPNIK].pool, TRUE, FALSE );
 #endif
+  g_mutex_lock ( &jobs_lock );
+  if ( progress_timer )
+    (void)g_source_remove ( progress_timer );
+  progress_timer = 0;
+  g_mutex_unlock ( &jobs_lock );
   gtk_list_store_clear ( bgstore );
   g_object_unref ( bgstore );
   bgstore = NULL;
@@ -41,12 +41,33 @@ typedef enum {
 #endif
 } Background_Pool_Type;
 
+typedef enum {
+  BACKGROUND_PRIORITY_INTERACTIVE, // e.g. For what is currently being displayed
+  BACKGROUND_PRIORITY_NORMAL,
+  BACKGROUND_PRIORITY_BULK,        // e.g. Downloading maps for a large area
+  BACKGROUND_PRIORITY_NUM,
+} Background_Priority;
+
 void a_background_thread ( Background_Pool_Type bp, GtkWindow *parent, const gchar *message, vik_thr_func func, gpointer userdata, vik_thr_free_func userdata_free_func, vik_thr_free_func userdata_cancel_cleanup_func, gint number_items );
+void a_background_thread_with_priority ( Background_Pool_Type bp, Background_Priority priority, GtkWindow *parent, const gchar *message, vik_thr_func func, gpointer userdata, vik_thr_free_func userdata_free_func, vik_thr_free_func userdata_cancel_cleanup_func, gint number_items );
+void a_background_thread_raise_priority ( gpointer userdata, Background_Priority priority );
+void a_background_get_pool_stats ( Background_Pool_Type bp, guint *queued, guint *running );
 int a_background_thread_progress ( gpointer callbackdata, gdouble fraction );
 int a_background_testcancel ( gpointer callbackdata );
+int a_background_thread_parallel ( gpointer callbackdata, GFunc func, gpointer *items, guint count, gpointer user_data, gboolean progress );
+
+// A group of lightweight tasks to be run in parallel, such as for each track or tile of a background job
+typedef struct _VikTaskGroup VikTaskGroup;
+VikTaskGroup *a_background_tasks_new ( void );
+void a_background_tasks_add ( VikTaskGroup *group, GFunc func, gpointer item, gpointer user_data );
+gboolean a_background_tasks_wait ( VikTaskGroup *group, gint timeout_ms );
+void a_background_tasks_cancel ( VikTaskGroup *group );
+gboolean a_background_tasks_cancelled ( VikTaskGroup *group );
+void a_background_tasks_free ( VikTaskGroup *group );
 void a_background_show_window ();
 void a_background_init ();
 void a_background_post_init ();
+void a_background_refresh_preferences ();
 void a_background_uninit ();
 void a_background_add_window (VikWindow *vw);
 void a_background_remove_window (VikWindow *vw);
@@ -0,0 +1,391 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * viking-batch: Viking's file processing without its window, e.g. for nightly jobs on a server
+ *
+ * All the files given are loaded into one top level layer, as if opened together
+ *  (so GPX files are read in parallel), then the operations requested are applied in this order:
+ *   tidy and simplify the tracks, apply DEM data, smooth missing elevations,
+ *   calculate the Tracks Area Coverage, write the MBTiles files, the image and the output file.
+ * A summary of what was done is written to stdout as JSON.
+ *
+ * Everything except the image can be done without a display.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "viking.h"
+#include "background.h"
+#include "curl_download.h"
+#include "dems.h"
+#include "mapcache.h"
+#include "modules.h"
+#include "vikmapslayer.h"
+
+static gboolean tidy = FALSE;
+static gdouble simplify = 0.0;
+static gchar *dem = NULL;
+static gchar *smooth = NULL;
+static gboolean tac_stats = FALSE;
+static gchar *tac_mbtiles = NULL;
+static gchar *heatmap_mbtiles = NULL;
+static gchar *image = NULL;
+static gint image_width = 1024;
+static gint image_height = 768;
+static gchar *output = NULL;
+static gboolean binary = FALSE;
+
+static GOptionEntry entries[] =
+{
+  { "debug", 'd', 0, G_OPTION_ARG_NONE, &vik_debug, N_("Enable debug output"), NULL },
+  { "verbose", 'V', 0, G_OPTION_ARG_NONE, &vik_verbose, N_("Enable verbose output"), NULL },
+  { "tidy", 0, 0, G_OPTION_ARG_NONE, &tidy, N_("Remove duplicate trackpoints, those at the same time and any dodgy first point"), NULL },
+  { "simplify", 0, 0, G_OPTION_ARG_DOUBLE, &simplify, N_("Simplify the tracks, keeping within this many metres of the original"), N_("METRES") },
+  { "dem", 0, 0, G_OPTION_ARG_STRING, &dem, N_("Apply DEM data to the tracks, downloading SRTM data as needed"), "overwrite|keep" },
+  { "smooth", 0, 0, G_OPTION_ARG_STRING, &smooth, N_("Fill in missing elevations of the tracks"), "interpolated|flat" },
+  { "tac-stats", 0, 0, G_OPTION_ARG_NONE, &tac_stats, N_("Calculate the Tracks Area Coverage"), NULL },
+  { "tac-mbtiles", 0, 0, G_OPTION_ARG_FILENAME, &tac_mbtiles, N_("Write the Tracks Area Coverage tiles to an MBTiles file"), N_("FILE") },
+  { "heatmap-mbtiles", 0, 0, G_OPTION_ARG_FILENAME, &heatmap_mbtiles, N_("Write the tiled heatmap of the tracks to an MBTiles file"), N_("FILE") },
+  { "image", 0, 0, G_OPTION_ARG_FILENAME, &image, N_("Draw the layers to a PNG or JPEG image (needs a display)"), N_("FILE") },
+  { "image-width", 0, 0, G_OPTION_ARG_INT, &image_width, N_("Width of the image"), NULL },
+  { "image-height", 0, 0, G_OPTION_ARG_INT, &image_height, N_("Height of the image"), NULL },
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, N_("Save the result as a Viking (.vik) or GPX (.gpx) file"), N_("FILE") },
+  { "binary", 0, 0, G_OPTION_ARG_NONE, &binary, N_("Save Viking files in the binary format"), NULL },
+  { NULL }
+};
+
+// highly unlikely to be going faster than this, especially for the first point
+#define TIDY_MAX_SPEED 340 // Speed of Sound
+
+typedef struct {
+  gint tidied;     // Atomic counts of the trackpoints removed
+  gint simplified;
+} TrackOpsT;
+
+static void track_ops_task ( VikTrack *trk, TrackOpsT *ops )
+{
+  if ( tidy )
+    g_atomic_int_add ( &ops->tidied, (gint)vik_track_tidy ( trk, VIK_TRACK_TIDY_DODGY_FIRST_POINT | VIK_TRACK_TIDY_DUP_POINTS | VIK_TRACK_TIDY_SAME_TIME_POINTS, TIDY_MAX_SPEED, TRUE ) );
+  if ( simplify > 0.0 )
+    g_atomic_int_add ( &ops->simplified, (gint)vik_track_simplify ( trk, simplify ) );
+}
+
+/**
+ * Tidy and simplify every track and route, each as a separate task across all CPUs
+ */
+static void track_ops ( GList *trws, TrackOpsT *ops )
+{
+  VikTaskGroup *group = a_background_tasks_new ();
+  for ( GList *iter = trws; iter; iter = iter->next ) {
+    VikTrwLayer *vtl = VIK_TRW_LAYER(iter->data);
+    GHashTable *tables[2] = { vik_trw_layer_get_tracks(vtl), vik_trw_layer_get_routes(vtl) };
+    for ( guint tt = 0; tt < G_N_ELEMENTS(tables); tt++ ) {
+      GHashTableIter hti;
+      gpointer value;
+      g_hash_table_iter_init ( &hti, tables[tt] );
+      while ( g_hash_table_iter_next ( &hti, NULL, &value ) )
+        a_background_tasks_add ( group, (GFunc)track_ops_task, value, ops );
+    }
+  }
+  a_background_tasks_free ( group );
+
+  for ( GList *iter = trws; iter; iter = iter->next )
+    trw_layer_calculate_bounds_tracks ( VIK_TRW_LAYER(iter->data) );
+}
+
+/**
+ * Let any jobs started in the background, such as loading map tiles, finish
+ */
+static void wait_for_background ( void )
+{
+  while ( TRUE ) {
+    while ( g_main_context_iteration ( NULL, FALSE ) );
+    guint queued, running, queued_remote, running_remote;
+    a_background_get_pool_stats ( BACKGROUND_POOL_LOCAL, &queued, &running );
+    a_background_get_pool_stats ( BACKGROUND_POOL_REMOTE, &queued_remote, &running_remote );
+    if ( !(queued + running + queued_remote + running_remote) )
+      break;
+    g_usleep ( G_USEC_PER_SEC / 50 );
+  }
+}
+
+/**
+ * Draw the layers in the view stored in a .vik file, or otherwise to show all the TrackWaypoint layers
+ */
+static gboolean save_image ( VikAggregateLayer *top, VikViewport *vvp, GList *trws, gboolean have_view, const gchar *fn )
+{
+  if ( !have_view ) {
+    struct LatLon maxmin[2] = { {0,0}, {0,0} };
+    gboolean have_bbox = FALSE;
+    for ( GList *iter = trws; iter; iter = iter->next ) {
+      VikTrwLayer *vtl = VIK_TRW_LAYER(iter->data);
+      if ( vik_trw_layer_is_empty(vtl) )
+        continue;
+      LatLonBBox bbox = vik_trw_layer_get_bbox ( vtl );
+      if ( !have_bbox || bbox.north > maxmin[0].lat ) maxmin[0].lat = bbox.north;
+      if ( !have_bbox || bbox.south < maxmin[1].lat ) maxmin[1].lat = bbox.south;
+      if ( !have_bbox || bbox.east > maxmin[0].lon ) maxmin[0].lon = bbox.east;
+      if ( !have_bbox || bbox.west < maxmin[1].lon ) maxmin[1].lon = bbox.west;
+      have_bbox = TRUE;
+    }
+    if ( have_bbox )
+      vu_zoom_to_show_latlons ( vik_viewport_get_coord_mode(vvp), vvp, maxmin );
+  }
+
+  vik_viewport_clear ( vvp );
+  vik_aggregate_layer_draw ( top, vvp );
+  // Map tiles are loaded in the background, so draw again once they are all available
+  wait_for_background ();
+  vik_viewport_clear ( vvp );
+  vik_aggregate_layer_draw ( top, vvp );
+
+  GdkPixbuf *pixbuf = gdk_pixbuf_get_from_drawable ( NULL, GDK_DRAWABLE(vik_viewport_get_pixmap(vvp)), NULL, 0, 0, 0, 0, image_width, image_height );
+  if ( !pixbuf ) {
+    g_critical ( "Failed to generate the image of size %d x %d", image_width, image_height );
+    return FALSE;
+  }
+  GError *error = NULL;
+  gboolean jpeg = a_file_check_ext ( fn, ".jpg" ) || a_file_check_ext ( fn, ".jpeg" );
+  (void)gdk_pixbuf_save ( pixbuf, fn, jpeg ? "jpeg" : "png", &error, NULL );
+  g_object_unref ( pixbuf );
+  if ( error ) {
+    g_critical ( "Unable to write to file %s: %s", fn, error->message );
+    g_error_free ( error );
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static void print_string ( const gchar *name, const gchar *value, gboolean *first )
+{
+  gchar *str = g_strescape ( value, NULL );
+  printf ( "%s\n  \"%s\": \"%s\"", *first ? "" : ",", name, str );
+  g_free ( str );
+  *first = FALSE;
+}
+
+static void print_number ( const gchar *name, gint64 value, gboolean *first )
+{
+  printf ( "%s\n  \"%s\": %" G_GINT64_FORMAT, *first ? "" : ",", name, value );
+  *first = FALSE;
+}
+
+int main ( int argc, char *argv[] )
+{
+  GError *error = NULL;
+  int exit_code = EXIT_SUCCESS;
+
+  bindtextdomain ( GETTEXT_PACKAGE, LOCALEDIR );
+  bind_textdomain_codeset ( GETTEXT_PACKAGE, "UTF-8" );
+  textdomain ( GETTEXT_PACKAGE );
+
+  GOptionContext *context = g_option_context_new ( "FILE..." );
+  g_option_context_set_summary ( context, _("Process GPS files with Viking, without its window.") );
+  g_option_context_add_main_entries ( context, entries, GETTEXT_PACKAGE );
+  if ( !g_option_context_parse ( context, &argc, &argv, &error ) ) {
+    (void)g_fprintf ( stderr, "Parsing command line options failed: %s\n", error->message );
+    g_error_free ( error );
+    return EXIT_FAILURE;
+  }
+  g_option_context_free ( context );
+
+  if ( argc < 2 ) {
+    (void)g_fprintf ( stderr, "No files to process. Run \"%s --help\" to see the options.\n", argv[0] );
+    return EXIT_FAILURE;
+  }
+  if ( (dem && g_strcmp0(dem, "overwrite") && g_strcmp0(dem, "keep")) ||
+       (smooth && g_strcmp0(smooth, "interpolated") && g_strcmp0(smooth, "flat")) ) {
+    (void)g_fprintf ( stderr, "Unknown --dem or --smooth method\n" );
+    return EXIT_FAILURE;
+  }
+  if ( output && !a_file_check_ext ( output, ".vik" ) && !a_file_check_ext ( output, ".gpx" ) ) {
+    (void)g_fprintf ( stderr, "The output must be a .vik or .gpx file\n" );
+    return EXIT_FAILURE;
+  }
+  // Only drawing needs the display
+  if ( image && !gtk_init_check ( NULL, NULL ) ) {
+    (void)g_fprintf ( stderr, "An image can only be drawn with a display, e.g. run via xvfb-run\n" );
+    return EXIT_FAILURE;
+  }
+
+  g_set_application_name ( "Viking" );
+
+  // As for the main program, but without anything only needed by a window
+  a_settings_init ();
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_layer_defaults_init ();
+  a_download_init ();
+  curl_download_init ();
+  modules_init ();
+  maps_layer_init ();
+  a_mapcache_init ();
+  a_background_init ();
+  a_preferences_finished_registering ();
+  a_background_post_init ();
+  a_vik_refresh_preferences ();
+  a_mapcache_refresh_preferences ();
+  modules_post_init ();
+
+  if ( binary )
+    a_preferences_get ( VIKING_PREFERENCES_ADVANCED_NAMESPACE "save_binary_format" )->b = TRUE;
+
+  VikViewport *vvp = vik_viewport_new ();
+  GtkWidget *window = NULL;
+  if ( image ) {
+    // The viewport needs a realized (but not shown) window to create its drawing buffers
+    window = gtk_window_new ( GTK_WINDOW_TOPLEVEL );
+    gtk_container_add ( GTK_CONTAINER(window), GTK_WIDGET(vvp) );
+    gtk_widget_realize ( GTK_WIDGET(vvp) );
+    (void)vik_viewport_configure ( vvp );
+    vik_viewport_configure_manually ( vvp, image_width, image_height );
+  }
+  VikAggregateLayer *top = vik_aggregate_layer_new ( vvp );
+
+  gint64 start = g_get_monotonic_time ();
+  printf ( "{" );
+  gboolean first = TRUE;
+
+  // Load everything as one, so the GPX files are read in parallel
+  GSList *files = NULL;
+  for ( gint ii = 1; ii < argc; ii++ )
+    files = g_slist_append ( files, argv[ii] );
+  if ( argc > 2 )
+    a_file_preload ( files, vvp );
+  gboolean have_view = FALSE;
+  for ( gint ii = 1; ii < argc; ii++ ) {
+    VikLoadType_t lt = a_file_load ( top, vvp, NULL, argv[ii], TRUE, FALSE, NULL );
+    if ( lt < LOAD_TYPE_OTHER_FAILURE_NON_FATAL ) {
+      g_critical ( "Could not load %s", argv[ii] );
+      exit_code = EXIT_FAILURE;
+    }
+    else if ( lt == LOAD_TYPE_VIK_SUCCESS || lt == LOAD_TYPE_VIK_FAILURE_NON_FATAL )
+      have_view = TRUE;
+  }
+  a_file_preload_clear ();
+  g_slist_free ( files );
+  print_number ( "load_ms", (g_get_monotonic_time () - start) / 1000, &first );
+
+  GList *trws = vik_aggregate_layer_get_all_layers_of_type ( top, NULL, VIK_LAYER_TRW, TRUE );
+  guint tracks = 0, waypoints = 0;
+  for ( GList *iter = trws; iter; iter = iter->next ) {
+    VikTrwLayer *vtl = VIK_TRW_LAYER(iter->data);
+    tracks += g_hash_table_size ( vik_trw_layer_get_tracks(vtl) ) + g_hash_table_size ( vik_trw_layer_get_routes(vtl) );
+    waypoints += g_hash_table_size ( vik_trw_layer_get_waypoints(vtl) );
+  }
+  print_number ( "trw_layers", g_list_length(trws), &first );
+  print_number ( "tracks", tracks, &first );
+  print_number ( "waypoints", waypoints, &first );
+
+  if ( tidy || simplify > 0.0 ) {
+    TrackOpsT ops = { 0, 0 };
+    track_ops ( trws, &ops );
+    if ( tidy )
+      print_number ( "tidy_removed", ops.tidied, &first );
+    if ( simplify > 0.0 )
+      print_number ( "simplify_removed", ops.simplified, &first );
+  }
+
+  if ( dem ) {
+    gint changed = vik_aggregate_layer_apply_dem ( top, g_strcmp0(dem, "keep") == 0 );
+    if ( changed < 0 )
+      exit_code = EXIT_FAILURE;
+    print_number ( "dem_changed", changed, &first );
+  }
+
+  if ( smooth )
+    print_number ( "smooth_changed", vik_aggregate_layer_smooth_elevations ( top, g_strcmp0(smooth, "flat") == 0 ), &first );
+
+  if ( tac_stats || tac_mbtiles ) {
+    vik_aggregate_layer_tac_calculate ( top );
+    guint zoom, tiles, max_square, contiguous, cluster;
+    vik_aggregate_layer_tac_get_stats ( top, &zoom, &tiles, &max_square, &contiguous, &cluster );
+    printf ( "%s\n  \"tac\": { \"zoom\": %u, \"tiles\": %u, \"max_square\": %u, \"contiguous\": %u, \"cluster\": %u }",
+             first ? "" : ",", zoom, tiles, max_square, contiguous, cluster );
+    first = FALSE;
+  }
+
+  const gchar *mbtiles[2] = { tac_mbtiles, heatmap_mbtiles };
+  for ( guint mm = 0; mm < G_N_ELEMENTS(mbtiles); mm++ ) {
+    if ( !mbtiles[mm] )
+      continue;
+    gchar *msg = NULL;
+    gboolean ok = mm == 0 ? vik_aggregate_layer_tac_export_mbtiles ( top, mbtiles[mm], &msg )
+                          : vik_aggregate_layer_heatmap_export_mbtiles ( top, mbtiles[mm], &msg );
+    if ( !ok ) {
+      g_critical ( "MBTiles file write problem: %s", msg ? msg : mbtiles[mm] );
+      exit_code = EXIT_FAILURE;
+    }
+    g_free ( msg );
+    print_string ( mm == 0 ? "tac_mbtiles" : "heatmap_mbtiles", mbtiles[mm], &first );
+  }
+
+  if ( image ) {
+    if ( !save_image ( top, vvp, trws, have_view, image ) )
+      exit_code = EXIT_FAILURE;
+    print_string ( "image", image, &first );
+  }
+
+  if ( output ) {
+    gboolean ok;
+    if ( a_file_check_ext ( output, ".gpx" ) )
+      ok = vik_aggregate_layer_export_gpx ( top, output );
+    else {
+      ok = a_file_save ( top, vvp, output, NULL, NULL );
+      // Only once completed is it known whether the save worked
+      ok = a_file_save_wait () && ok;
+    }
+    if ( ok )
+      print_string ( "output", output, &first );
+    else {
+      g_critical ( "Could not save %s", output );
+      exit_code = EXIT_FAILURE;
+    }
+  }
+
+  print_number ( "total_ms", (g_get_monotonic_time () - start) / 1000, &first );
+  printf ( "\n}\n" );
+  g_list_free ( trws );
+
+  g_object_unref ( top );
+  if ( window )
+    gtk_widget_destroy ( window );
+
+  vik_trwlayer_uninit ();
+  vik_aggregate_layer_uninit ();
+  a_background_uninit ();
+  maps_layer_uninit ();
+  a_mapcache_uninit ();
+  a_dems_uninit ();
+  a_layer_defaults_uninit ();
+  a_preferences_uninit ();
+  a_settings_uninit ();
+  modules_uninit ();
+  curl_download_uninit ();
+
+  g_free ( dem );
+  g_free ( smooth );
+  g_free ( tac_mbtiles );
+  g_free ( heatmap_mbtiles );
+  g_free ( image );
+  g_free ( output );
+
+  return exit_code;
+}
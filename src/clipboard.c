@@ -45,6 +45,11 @@ typedef struct {
   guint8 data[0];
 } vik_clipboard_t;
 
+// While we are the owner: our clipboard contents,
+//  and for a TrackWaypoint sublayer the item itself which is only marshalled on demand
+static vik_clipboard_t *clip_local = NULL;
+static gpointer clip_local_item = NULL;
+
 static GtkTargetEntry target_table[] = {
   { "application/viking", 0, 0 },
   { "STRING", 0, 1 },
@@ -60,7 +65,21 @@ static void clip_get ( GtkClipboard *c, GtkSelectionData *selection_data, guint
   if ( info == 0 ) {
     // Viking Data Type
     //    g_print("clip_get: vc = %p, size = %d\n", vc, sizeof(*vc) + vc->len);
-    gtk_selection_data_set ( selection_data, gtk_selection_data_get_target(selection_data), 8, (void *)vc, sizeof(*vc) + vc->len );
+    if ( vc == clip_local && clip_local_item ) {
+      // Another process wants it, so now make the marshalled form
+      guint8 *data = NULL;
+      guint len = 0;
+      vik_trw_layer_marshall_shared_item ( vc->subtype, clip_local_item, &data, &len );
+      vik_clipboard_t *vcm = g_malloc ( sizeof(*vc) + len );
+      *vcm = *vc;
+      vcm->len = len;
+      memcpy ( vcm->data, data, len );
+      gtk_selection_data_set ( selection_data, gtk_selection_data_get_target(selection_data), 8, (void *)vcm, sizeof(*vcm) + len );
+      g_free ( vcm );
+      g_free ( data );
+    }
+    else
+      gtk_selection_data_set ( selection_data, gtk_selection_data_get_target(selection_data), 8, (void *)vc, sizeof(*vc) + vc->len );
   }
   if ( info == 1 ) {
     // Should be a string, but make sure it's something
@@ -73,6 +92,11 @@ static void clip_get ( GtkClipboard *c, GtkSelectionData *selection_data, guint
 static void clip_clear ( GtkClipboard *c, gpointer p )
 {
   vik_clipboard_t* vc = (vik_clipboard_t*)p;
+  if ( vc == clip_local ) {
+    vik_trw_layer_free_shared_item ( vc->subtype, clip_local_item );
+    clip_local_item = NULL;
+    clip_local = NULL;
+  }
   g_free(vc->text);
   g_free(vc);
 }
@@ -82,6 +106,26 @@ static void clip_clear ( GtkClipboard *c, gpointer p )
  ** functions which receive from the clipboard owner (we are the client) **
  **************************************************************************/
 
+/**
+ * Paste into the selected layer, either the marshalled data or otherwise the shared item
+ */
+static void clip_paste_sublayer ( VikLayersPanel *vlp, vik_clipboard_t *vc, gpointer item )
+{
+  VikLayer *sel = vik_layers_panel_get_selected ( vlp );
+  if ( sel && sel->type == vc->layer_type)
+  {
+    if ( item )
+      (void)vik_trw_layer_paste_shared_item ( VIK_TRW_LAYER(sel), vc->subtype, item );
+    else if ( vik_layer_get_interface(vc->layer_type)->paste_item )
+      vik_layer_get_interface(vc->layer_type)->paste_item ( sel, vc->subtype, vc->data, vc->len);
+  }
+  else
+    a_dialog_error_msg_extra ( VIK_GTK_WINDOW_FROM_WIDGET(GTK_WIDGET(vlp)),
+                               _("The clipboard contains sublayer data for %s layers. "
+                                 "You must select a layer of this type to paste the clipboard data."),
+                               vik_layer_get_interface(vc->layer_type)->name );
+}
+
 /* our own data type */
 static void clip_receive_viking ( GtkClipboard *c, GtkSelectionData *sd, gpointer p ) 
 {
@@ -108,19 +152,7 @@ static void clip_receive_viking ( GtkClipboard *c, GtkSelectionData *sd, gpointe
     vik_layers_panel_add_layer ( vlp, new_layer );
   }
   else if ( vc->type == VIK_CLIPBOARD_DATA_SUBLAYER )
-  {
-    VikLayer *sel = vik_layers_panel_get_selected ( vlp );
-    if ( sel && sel->type == vc->layer_type)
-    {
-      if ( vik_layer_get_interface(vc->layer_type)->paste_item )
-        vik_layer_get_interface(vc->layer_type)->paste_item ( sel, vc->subtype, vc->data, vc->len);
-    }
-    else
-      a_dialog_error_msg_extra ( VIK_GTK_WINDOW_FROM_WIDGET(GTK_WIDGET(vlp)),
-				 _("The clipboard contains sublayer data for %s layers. "
-				   "You must select a layer of this type to paste the clipboard data."),
-				 vik_layer_get_interface(vc->layer_type)->name );
-  }
+    clip_paste_sublayer ( vlp, vc, NULL );
 }
 
 
@@ -411,6 +443,13 @@ void a_clipboard_copy_selected ( VikLayersPanel *vlp )
   else {
     if ( vik_treeview_item_get_type ( sel->vt, &iter ) == VIK_TREEVIEW_TYPE_SUBLAYER ) {
       type = VIK_CLIPBOARD_DATA_SUBLAYER;
+      if ( layer_type == VIK_LAYER_TRW ) {
+        subtype = vik_treeview_item_get_data(sel->vt, &iter);
+        gpointer item = vik_trw_layer_copy_shared_item ( VIK_TRW_LAYER(sel), subtype, vik_treeview_item_get_pointer(sel->vt, &iter) );
+        if ( item )
+          a_clipboard_copy_trw_item ( subtype, vik_treeview_item_get_name(sel->vt, &iter), item );
+        return;
+      }
       if ( vik_layer_get_interface(layer_type)->copy_item) {
         subtype = vik_treeview_item_get_data(sel->vt, &iter);
         vik_layer_get_interface(layer_type)->copy_item(sel, subtype, vik_treeview_item_get_pointer(sel->vt, &iter), &data, &len );
@@ -446,8 +485,39 @@ void a_clipboard_copy( VikClipboardDataType type, guint16 layer_type, gint subty
   // Simple clipboard copy when necessary
   if ( type == VIK_CLIPBOARD_DATA_TEXT )
     gtk_clipboard_set_text ( c, text, -1 );
-  else
-    gtk_clipboard_set_with_data ( c, target_table, G_N_ELEMENTS(target_table), clip_get, clip_clear, vc );
+  else if ( gtk_clipboard_set_with_data ( c, target_table, G_N_ELEMENTS(target_table), clip_get, clip_clear, vc ) )
+    clip_local = vc;
+}
+
+/**
+ * a_clipboard_copy_trw_item:
+ * @item: From vik_trw_layer_copy_shared_item(), which becomes owned by the clipboard
+ *
+ * Pasting within this process uses the item directly.
+ * Only if another process asks for the data does it get marshalled.
+ */
+void a_clipboard_copy_trw_item ( gint subtype, const gchar *text, gpointer item )
+{
+  vik_clipboard_t *vc = g_malloc0 ( sizeof(*vc) );
+  GtkClipboard *c = gtk_clipboard_get ( GDK_SELECTION_CLIPBOARD );
+
+  vc->type = VIK_CLIPBOARD_DATA_SUBLAYER;
+  vc->layer_type = VIK_LAYER_TRW;
+  vc->subtype = subtype;
+  vc->len = 0;
+  vc->text = g_strdup ( text );
+  vc->pid = getpid();
+
+  // NB Any previous contents of ours is cleared during the set
+  if ( gtk_clipboard_set_with_data ( c, target_table, G_N_ELEMENTS(target_table), clip_get, clip_clear, vc ) ) {
+    clip_local = vc;
+    clip_local_item = item;
+  }
+  else {
+    vik_trw_layer_free_shared_item ( subtype, item );
+    g_free ( vc->text );
+    g_free ( vc );
+  }
 }
 
 /**
@@ -458,6 +528,10 @@ void a_clipboard_copy( VikClipboardDataType type, guint16 layer_type, gint subty
  */
 gboolean a_clipboard_paste ( VikLayersPanel *vlp )
 {
+  if ( clip_local && clip_local_item ) {
+    clip_paste_sublayer ( vlp, clip_local, clip_local_item );
+    return TRUE;
+  }
   GtkClipboard *c = gtk_clipboard_get ( GDK_SELECTION_CLIPBOARD );
   gtk_clipboard_request_targets ( c, clip_receive_targets, vlp );
   return TRUE;
@@ -520,6 +594,10 @@ static void clip_determine_type ( GtkClipboard *c, GdkAtom *a, gint n, gpointer
  */
 VikClipboardDataType a_clipboard_type ( )
 {
+  // No need to ask when it is our own
+  if ( clip_local )
+    return clip_local->type;
+
   GtkClipboard *c = gtk_clipboard_get ( GDK_SELECTION_CLIPBOARD );
   VikClipboardDataType *vcdt = g_malloc ( sizeof (VikClipboardDataType) );
 
@@ -35,6 +35,7 @@ typedef enum {
 
 void a_clipboard_copy(VikClipboardDataType  type, guint16 layer_type, gint subtype, guint len, const gchar* text, guint8 * data);
 void a_clipboard_copy_selected ( VikLayersPanel *vlp );
+void a_clipboard_copy_trw_item ( gint subtype, const gchar *text, gpointer item );
 gboolean a_clipboard_paste ( VikLayersPanel *vlp );
 VikClipboardDataType a_clipboard_type ( );
 
@@ -36,6 +36,14 @@
 
 #ifdef HAVE_ZIP_H
 #include <zip.h>
+// Older libzip compatibility:
+#ifndef zip_t
+typedef struct zip zip_t;
+typedef struct zip_file zip_file_t;
+#endif
+#ifndef ZIP_RDONLY
+#define ZIP_RDONLY 0
+#endif
 #endif
 
 #include "compression.h"
@@ -44,6 +52,72 @@
 #include <gio/gio.h>
 #include <glib/gstdio.h>
 
+#ifdef HAVE_FOPENCOOKIE
+/**
+ * Decompressed data is read on demand through a FILE,
+ *  so that the normal file parsers can use it without it first being written out in full
+ */
+typedef ssize_t (*stream_read_func) ( gpointer handle, gchar *buf, size_t size );
+typedef void (*stream_close_func) ( gpointer handle );
+
+typedef struct {
+	gpointer handle;
+	stream_read_func read;
+	stream_close_func close;
+	gboolean eof;
+} stream_cookie_t;
+
+static ssize_t stream_cookie_read ( void *cookie, char *buf, size_t size )
+{
+	stream_cookie_t *sc = cookie;
+	if ( sc->eof )
+		return 0;
+	ssize_t nn = sc->read ( sc->handle, buf, MIN(size, G_MAXINT) );
+	if ( nn == 0 )
+		sc->eof = TRUE;
+	return nn;
+}
+
+static int stream_cookie_close ( void *cookie )
+{
+	stream_cookie_t *sc = cookie;
+	if ( sc->close )
+		sc->close ( sc->handle );
+	g_free ( sc );
+	return 0;
+}
+
+/**
+ * Returns: A read only FILE taking ownership of the handle, which is closed with the FILE
+ *  or NULL on failure, in which case the handle is left for the caller to close
+ */
+static FILE *stream_open ( gpointer handle, stream_read_func read, stream_close_func close )
+{
+	stream_cookie_t *sc = g_malloc0 ( sizeof(stream_cookie_t) );
+	sc->handle = handle;
+	sc->read = read;
+	sc->close = close;
+	cookie_io_functions_t funcs = { stream_cookie_read, NULL, NULL, stream_cookie_close };
+	FILE *ff = fopencookie ( sc, "r", funcs );
+	if ( !ff )
+		g_free ( sc );
+	return ff;
+}
+
+/**
+ * The name for the decompressed contents is the file without the compression extension,
+ *  so the detection of the type of contents is as per the original file name
+ */
+static gchar *stream_name ( const gchar *filename )
+{
+	gchar *name = g_strdup ( filename );
+	gchar *ext = strrchr ( name, '.' );
+	if ( ext && ext > name && !strchr ( ext, G_DIR_SEPARATOR ) )
+		*ext = '\0';
+	return name;
+}
+#endif
+
 #ifdef HAVE_ZIP_H
 /**
  * figure_out_answer:
@@ -76,6 +150,13 @@ VikLoadType_t figure_out_answer ( VikLoadType_t current_ans, VikLoadType_t last_
 }
 #endif
 
+#if defined(HAVE_ZIP_H) && defined(HAVE_FOPENCOOKIE)
+static ssize_t zip_stream_read ( zip_file_t *zf, gchar *buf, size_t size )
+{
+	return zip_fread ( zf, buf, size );
+}
+#endif
+
 /**
  * NB is typically called from file.c and circularly calls back into file.c
  * ATM this works OK!
@@ -91,15 +172,6 @@ VikLoadType_t uncompress_load_zip_file ( const gchar *filename,
 {
 	VikLoadType_t ans = LOAD_TYPE_READ_FAILURE;
 #ifdef HAVE_ZIP_H
-// Older libzip compatibility:
-#ifndef zip_t
-typedef struct zip zip_t;
-typedef struct zip_file zip_file_t;
-#endif
-#ifndef ZIP_RDONLY
-#define ZIP_RDONLY 0
-#endif
-
 	int zans = ZIP_ER_OK;
 	zip_t *archive = zip_open ( filename, ZIP_RDONLY, &zans );
 	if ( !archive ) {
@@ -117,6 +189,19 @@ typedef struct zip_file zip_file_t;
 		if ( zip_stat_index( archive, ii, 0, &zs ) == 0) {
 			zip_file_t *zf = zip_fopen_index ( archive, ii, 0 );
 			if ( zf ) {
+#ifdef HAVE_FOPENCOOKIE
+				// The member is decompressed as it is parsed
+				FILE *ff = stream_open ( zf, (stream_read_func)zip_stream_read, (stream_close_func)zip_fclose );
+				if ( ff ) {
+					VikLoadType_t current_ans = a_file_load_stream ( ff, zs.name, top, vp, vtl, new_layer, external, dirpath, zs.name );
+					(void)fclose ( ff );
+					ans = figure_out_answer ( current_ans, ans, ii, entries );
+				}
+				else {
+					g_warning ( "%s: Unable to load stream: %d in '%s'", __FUNCTION__, ii, filename );
+					zip_fclose ( zf );
+				}
+#else
 				char *buffer = g_malloc(zs.size);
 				int len = zip_fread ( zf, buffer, zs.size );
 				if ( len == zs.size ) {
@@ -143,6 +228,9 @@ typedef struct zip_file zip_file_t;
 				else {
 					g_warning ( "%s: Unable to read index: %d in '%s', got %d, wanted %ld", __FUNCTION__, ii, filename, len, zs.size );
 				}
+				g_free ( buffer );
+				zip_fclose ( zf );
+#endif
 			}
 			else {
 				g_warning ( "%s: Unable to open index: %d in '%s'", __FUNCTION__, ii, filename );
@@ -332,6 +420,64 @@ gchar* uncompress_bzip2 ( const gchar *name )
 #endif
 }
 
+#if defined(HAVE_BZLIB_H) && defined(HAVE_FOPENCOOKIE)
+typedef struct {
+	FILE *ff;
+	BZFILE *bf;
+	gboolean end;
+} bzip2_stream_t;
+
+static ssize_t bzip2_stream_read ( bzip2_stream_t *bs, gchar *buf, size_t size )
+{
+	if ( bs->end )
+		return 0;
+	int bzerror;
+	int nn = BZ2_bzRead ( &bzerror, bs->bf, buf, size );
+	if ( bzerror == BZ_STREAM_END )
+		bs->end = TRUE;
+	else if ( bzerror != BZ_OK ) {
+		g_warning ( "%s: BZ error :( %d", __FUNCTION__, bzerror );
+		return -1;
+	}
+	return nn;
+}
+
+static void bzip2_stream_close ( bzip2_stream_t *bs )
+{
+	int bzerror;
+	BZ2_bzReadClose ( &bzerror, bs->bf );
+	fclose ( bs->ff );
+	g_free ( bs );
+}
+
+/**
+ * Returns: A FILE of the decompressed contents of the .bz2 file, or NULL
+ */
+static FILE *bzip2_stream_open ( const gchar *name )
+{
+	FILE *ff = g_fopen ( name, "rb" );
+	if ( !ff )
+		return NULL;
+
+	int bzerror;
+	BZFILE *bf = BZ2_bzReadOpen ( &bzerror, ff, 0, 0, NULL, 0 );
+	if ( bzerror != BZ_OK ) {
+		BZ2_bzReadClose ( &bzerror, bf );
+		g_warning ( "%s: BZ ReadOpen error on %s", __FUNCTION__, name );
+		fclose ( ff );
+		return NULL;
+	}
+
+	bzip2_stream_t *bs = g_malloc0 ( sizeof(bzip2_stream_t) );
+	bs->ff = ff;
+	bs->bf = bf;
+	FILE *bff = stream_open ( bs, (stream_read_func)bzip2_stream_read, (stream_close_func)bzip2_stream_close );
+	if ( !bff )
+		bzip2_stream_close ( bs );
+	return bff;
+}
+#endif
+
 VikLoadType_t uncompress_load_bzip_file ( const gchar *filename,
                                           VikAggregateLayer *top,
                                           VikViewport *vp,
@@ -339,8 +485,122 @@ VikLoadType_t uncompress_load_bzip_file ( const gchar *filename,
                                           gboolean new_layer,
                                           gboolean external )
 {
+#ifdef HAVE_FOPENCOOKIE
+	FILE *ff = bzip2_stream_open ( filename );
+	if ( !ff )
+		return LOAD_TYPE_READ_FAILURE;
+	// Binary .vik files are read with random access, so still need extracting in full
+	if ( !a_file_check_binary_magic ( ff ) ) {
+		gchar *name = stream_name ( filename );
+		gchar *dirpath = g_path_get_dirname ( filename );
+		VikLoadType_t ans = a_file_load_stream ( ff, name, top, vp, vtl, new_layer, external, dirpath, filename );
+		(void)fclose ( ff );
+		g_free ( dirpath );
+		g_free ( name );
+		return ans;
+	}
+	(void)fclose ( ff );
+#endif
 	gchar *tmp_name = uncompress_bzip2 ( filename );
 	VikLoadType_t ans = a_file_load ( top, vp, vtl, tmp_name, new_layer, external, filename );
 	(void)util_remove ( tmp_name );
+	g_free ( tmp_name );
+	return ans;
+}
+
+#if defined(HAVE_LIBZ) && defined(HAVE_FOPENCOOKIE)
+static ssize_t gzip_stream_read ( gzFile gz, gchar *buf, size_t size )
+{
+	return gzread ( gz, buf, size );
+}
+#endif
+
+#ifdef HAVE_LIBZ
+/**
+ * uncompress_gzip:
+ * @name: The name of the file to attempt to decompress
+ *
+ * Returns: The name of the uncompressed file (in a temporary location) or NULL
+ *   free the returned name after use.
+ */
+static gchar* uncompress_gzip ( const gchar *name )
+{
+	gzFile gz = gzopen ( name, "rb" );
+	if ( !gz )
+		return NULL;
+
+	GFileIOStream *gios;
+	GError *error = NULL;
+	GFile *gf = g_file_new_tmp ( "vik-gz-tmp.XXXXXX", &gios, &error );
+	if ( !gf ) {
+		g_critical ( "Couldn't create gz tmp file due to %s", error->message );
+		g_error_free ( error );
+		gzclose ( gz );
+		return NULL;
+	}
+	gchar *tmpname = g_file_get_path ( gf );
+	g_object_unref ( gf );
+
+	GOutputStream *gos = g_io_stream_get_output_stream ( G_IO_STREAM(gios) );
+	char buf[65536];
+	int nn;
+	while ( (nn = gzread ( gz, buf, sizeof(buf) )) > 0 ) {
+		if ( g_output_stream_write ( gos, buf, nn, NULL, &error ) < 0 ) {
+			g_critical ( "Couldn't write gz tmp %s file due to %s", tmpname, error->message );
+			g_error_free ( error );
+			break;
+		}
+	}
+	if ( nn < 0 )
+		g_warning ( "%s: gz read error on %s", __FUNCTION__, name );
+	g_output_stream_close ( gos, NULL, NULL );
+	g_object_unref ( gios );
+	gzclose ( gz );
+	return tmpname;
+}
+#endif
+
+/**
+ * uncompress_load_gzip_file:
+ *
+ * Load the contents of a gzip file, such as a .gpx.gz
+ */
+VikLoadType_t uncompress_load_gzip_file ( const gchar *filename,
+                                          VikAggregateLayer *top,
+                                          VikViewport *vp,
+                                          VikTrwLayer *vtl,
+                                          gboolean new_layer,
+                                          gboolean external )
+{
+	VikLoadType_t ans = LOAD_TYPE_READ_FAILURE;
+#ifdef HAVE_LIBZ
+#ifdef HAVE_FOPENCOOKIE
+	gzFile gz = gzopen ( filename, "rb" );
+	if ( !gz )
+		return ans;
+	FILE *ff = stream_open ( gz, (stream_read_func)gzip_stream_read, (stream_close_func)gzclose );
+	if ( !ff ) {
+		gzclose ( gz );
+		return ans;
+	}
+	// Binary .vik files are read with random access, so still need extracting in full
+	if ( !a_file_check_binary_magic ( ff ) ) {
+		gchar *name = stream_name ( filename );
+		gchar *dirpath = g_path_get_dirname ( filename );
+		ans = a_file_load_stream ( ff, name, top, vp, vtl, new_layer, external, dirpath, filename );
+		(void)fclose ( ff );
+		g_free ( dirpath );
+		g_free ( name );
+		return ans;
+	}
+	(void)fclose ( ff );
+#endif
+	gchar *tmp_name = uncompress_gzip ( filename );
+	if ( tmp_name ) {
+		ans = a_file_load ( top, vp, vtl, tmp_name, new_layer, external, filename );
+		(void)util_remove ( tmp_name );
+		g_free ( tmp_name );
+	}
+#endif
 	return ans;
 }
@@ -49,6 +49,13 @@ VikLoadType_t uncompress_load_bzip_file ( const gchar *filename,
                                           VikTrwLayer *vtl,
                                           gboolean new_layer,
                                           gboolean external );
+
+VikLoadType_t uncompress_load_gzip_file ( const gchar *filename,
+                                          VikAggregateLayer *top,
+                                          VikViewport *vp,
+                                          VikTrwLayer *vtl,
+                                          gboolean new_layer,
+                                          gboolean external );
 G_END_DECLS
 
 #endif
@@ -0,0 +1,305 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include "contours.h"
+
+/*
+ * Each cell of four samples gets the segments crossing it for every level between its lowest and highest corner,
+ *  a sample being above a level when at or over it.
+ * A segment joins points on two edges of the cell, and as each edge is shared by at most two cells,
+ *  the segments of a level are joined into lines through the edges they have in common.
+ * The edges of the cell from (x,y) are numbered 0: to (x+1,y), 1: (x+1,y) to (x+1,y+1), 2: (x,y+1) to (x+1,y+1), 3: (x,y) to (x,y+1)
+ */
+
+typedef struct {
+  guint edge[2];   // Grid wide ids
+  gfloat pt[4];
+} CSegment;
+
+// The pairs of edges of the segments for each case of corners above the level,
+//  corners (x,y) = 1, (x+1,y) = 2, (x+1,y+1) = 4, (x,y+1) = 8
+// The two saddles (5 and 10) are given here for the middle being above the level
+static const gint8 case_edges[16][4] = {
+  { -1, -1, -1, -1 },
+  {  0,  3, -1, -1 },
+  {  0,  1, -1, -1 },
+  {  3,  1, -1, -1 },
+  {  1,  2, -1, -1 },
+  {  0,  1,  2,  3 },
+  {  0,  2, -1, -1 },
+  {  2,  3, -1, -1 },
+  {  2,  3, -1, -1 },
+  {  0,  2, -1, -1 },
+  {  0,  3,  1,  2 },
+  {  1,  2, -1, -1 },
+  {  3,  1, -1, -1 },
+  {  0,  1, -1, -1 },
+  {  0,  3, -1, -1 },
+  { -1, -1, -1, -1 },
+};
+
+void a_contour_free ( Contour *contour )
+{
+  g_free ( contour->points );
+  g_free ( contour );
+}
+
+/**
+ * The id of the edge of the cell at x,y, along with where the level crosses it
+ */
+static guint contour_edge ( guint cols, guint x, guint y, guint edge, const gdouble vv[4], gdouble level, gfloat *pt )
+{
+  // The corners each edge is between, in the order of the case bits
+  static const guint ends[4][2] = { { 0, 1 }, { 1, 2 }, { 3, 2 }, { 0, 3 } };
+  static const guint dx[4] = { 0, 1, 0, 0 };
+  static const guint dy[4] = { 0, 0, 1, 0 };
+  gdouble va = vv[ends[edge][0]];
+  gdouble vb = vv[ends[edge][1]];
+  gdouble tt = (level - va) / (vb - va);
+  if ( edge == 0 || edge == 2 ) {
+    pt[0] = x + tt;
+    pt[1] = y + dy[edge];
+    return 2 * ((y + dy[edge]) * cols + x);
+  }
+  pt[0] = x + dx[edge];
+  pt[1] = y + tt;
+  return 2 * (y * cols + x + dx[edge]) + 1;
+}
+
+static gfloat contour_distance ( const gfloat *pt, const gfloat *aa, const gfloat *bb )
+{
+  gfloat dx = bb[0] - aa[0];
+  gfloat dy = bb[1] - aa[1];
+  gfloat len2 = dx*dx + dy*dy;
+  if ( len2 <= 0.0 )
+    return hypotf ( pt[0] - aa[0], pt[1] - aa[1] );
+  return fabsf ( dx * (aa[1] - pt[1]) - dy * (aa[0] - pt[0]) ) / sqrtf ( len2 );
+}
+
+/**
+ * Douglas-Peucker, without recursion as lines can have many thousands of points
+ * Returns: The number of points kept, which are moved to the start
+ */
+static guint contour_simplify ( gfloat *points, guint count, gdouble tolerance )
+{
+  if ( count < 3 || tolerance <= 0.0 )
+    return count;
+  gboolean *keep = g_new0 ( gboolean, count );
+  keep[0] = keep[count-1] = TRUE;
+  GArray *stack = g_array_new ( FALSE, FALSE, sizeof(guint) );
+  guint range[2] = { 0, count-1 };
+  g_array_append_vals ( stack, range, 2 );
+  while ( stack->len ) {
+    guint hi = g_array_index ( stack, guint, stack->len-1 );
+    guint lo = g_array_index ( stack, guint, stack->len-2 );
+    g_array_set_size ( stack, stack->len-2 );
+    gfloat furthest = 0.0;
+    guint index = lo;
+    for ( guint ii = lo+1; ii < hi; ii++ ) {
+      gfloat dd = contour_distance ( points + 2*ii, points + 2*lo, points + 2*hi );
+      if ( dd > furthest ) {
+        furthest = dd;
+        index = ii;
+      }
+    }
+    if ( furthest > tolerance ) {
+      keep[index] = TRUE;
+      guint left[2] = { lo, index };
+      guint right[2] = { index, hi };
+      g_array_append_vals ( stack, left, 2 );
+      g_array_append_vals ( stack, right, 2 );
+    }
+  }
+  g_array_free ( stack, TRUE );
+
+  guint kept = 0;
+  for ( guint ii = 0; ii < count; ii++ ) {
+    if ( keep[ii] ) {
+      points[2*kept] = points[2*ii];
+      points[2*kept+1] = points[2*ii+1];
+      kept++;
+    }
+  }
+  g_free ( keep );
+  return kept;
+}
+
+/**
+ * The other segment at the edge, or -1
+ */
+static gint contour_other ( GHashTable *first, GHashTable *second, guint edge, guint seg )
+{
+  guint aa = GPOINTER_TO_UINT ( g_hash_table_lookup ( first, GUINT_TO_POINTER(edge) ) );
+  guint bb = GPOINTER_TO_UINT ( g_hash_table_lookup ( second, GUINT_TO_POINTER(edge) ) );
+  // Stored one more so none is zero
+  if ( aa && aa - 1 != seg )
+    return aa - 1;
+  if ( bb && bb - 1 != seg )
+    return bb - 1;
+  return -1;
+}
+
+/**
+ * Join the segments of a level into lines
+ */
+static void contour_join ( GArray *segments, gdouble level, gdouble tolerance, GPtrArray *contours )
+{
+  CSegment *segs = (CSegment*)segments->data;
+  GHashTable *first = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  GHashTable *second = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  for ( guint ss = 0; ss < segments->len; ss++ ) {
+    for ( guint ee = 0; ee < 2; ee++ ) {
+      gpointer key = GUINT_TO_POINTER ( segs[ss].edge[ee] );
+      g_hash_table_insert ( g_hash_table_contains(first, key) ? second : first, key, GUINT_TO_POINTER(ss+1) );
+    }
+  }
+
+  gboolean *done = g_new0 ( gboolean, segments->len );
+  GArray *points = g_array_new ( FALSE, FALSE, sizeof(gfloat) );
+  // Lines with open ends first, then the loops that are left
+  for ( guint pass = 0; pass < 2; pass++ ) {
+    for ( guint ss = 0; ss < segments->len; ss++ ) {
+      if ( done[ss] )
+        continue;
+      guint start_end;
+      if ( contour_other ( first, second, segs[ss].edge[0], ss ) < 0 )
+        start_end = 0;
+      else if ( contour_other ( first, second, segs[ss].edge[1], ss ) < 0 )
+        start_end = 1;
+      else if ( pass == 1 )
+        start_end = 0;
+      else
+        continue;
+
+      g_array_set_size ( points, 0 );
+      g_array_append_vals ( points, segs[ss].pt + 2*start_end, 2 );
+      gint seg = ss;
+      guint from = start_end;
+      while ( seg >= 0 && !done[seg] ) {
+        done[seg] = TRUE;
+        guint to = 1 - from;
+        g_array_append_vals ( points, segs[seg].pt + 2*to, 2 );
+        guint edge = segs[seg].edge[to];
+        gint next = contour_other ( first, second, edge, seg );
+        if ( next >= 0 )
+          from = segs[next].edge[0] == edge ? 0 : 1;
+        seg = next;
+      }
+
+      // Nothing to see where the level only touches a sample
+      gfloat *pts = (gfloat*)points->data;
+      gboolean moves = FALSE;
+      for ( guint ii = 2; ii < points->len && !moves; ii += 2 )
+        moves = pts[ii] != pts[0] || pts[ii+1] != pts[1];
+      if ( !moves )
+        continue;
+
+      Contour *contour = g_new ( Contour, 1 );
+      contour->level = level;
+      contour->n_points = contour_simplify ( (gfloat*)points->data, points->len / 2, tolerance );
+      contour->points = g_memdup ( points->data, contour->n_points * 2 * sizeof(gfloat) );
+      g_ptr_array_add ( contours, contour );
+    }
+  }
+  g_array_free ( points, TRUE );
+  g_free ( done );
+  g_hash_table_destroy ( first );
+  g_hash_table_destroy ( second );
+}
+
+GPtrArray *a_contours_trace ( const gint16 *grid, guint cols, guint rows, gint16 invalid, gdouble interval, gdouble tolerance )
+{
+  GPtrArray *contours = g_ptr_array_new_with_free_func ( (GDestroyNotify)a_contour_free );
+  if ( cols < 2 || rows < 2 || interval <= 0.0 )
+    return contours;
+
+  // The range of levels over the grid
+  gint lowest = G_MAXINT16, highest = G_MININT16;
+  for ( guint ii = 0; ii < cols * rows; ii++ ) {
+    if ( grid[ii] == invalid )
+      continue;
+    lowest = MIN ( lowest, grid[ii] );
+    highest = MAX ( highest, grid[ii] );
+  }
+  if ( lowest >= highest )
+    return contours;
+  // Levels above the lowest, up to the highest
+  const gint kmin = (gint)floor ( lowest / interval ) + 1;
+  const gint kmax = (gint)floor ( highest / interval );
+  if ( kmax < kmin )
+    return contours;
+
+  GArray **levels = g_new0 ( GArray*, kmax - kmin + 1 );
+  for ( guint y = 0; y + 1 < rows; y++ ) {
+    for ( guint x = 0; x + 1 < cols; x++ ) {
+      const gint16 corners[4] = { grid[y*cols + x], grid[y*cols + x+1], grid[(y+1)*cols + x+1], grid[(y+1)*cols + x] };
+      if ( corners[0] == invalid || corners[1] == invalid || corners[2] == invalid || corners[3] == invalid )
+        continue;
+      const gdouble vv[4] = { corners[0], corners[1], corners[2], corners[3] };
+      const gdouble low = MIN ( MIN(vv[0], vv[1]), MIN(vv[2], vv[3]) );
+      const gdouble high = MAX ( MAX(vv[0], vv[1]), MAX(vv[2], vv[3]) );
+      for ( gint kk = (gint)floor(low / interval) + 1; kk * interval <= high; kk++ ) {
+        const gdouble level = kk * interval;
+        guint cc = 0;
+        for ( guint ii = 0; ii < 4; ii++ )
+          if ( vv[ii] >= level )
+            cc |= 1 << ii;
+        const gint8 *edges = case_edges[cc];
+        // Saddles with the middle below the level join the other way around
+        gint8 saddle[4];
+        if ( (cc == 5 || cc == 10) && (vv[0] + vv[1] + vv[2] + vv[3]) / 4 < level ) {
+          const gint8 *other = case_edges[cc == 5 ? 10 : 5];
+          for ( guint ii = 0; ii < 4; ii++ )
+            saddle[ii] = other[ii];
+          edges = saddle;
+        }
+        GArray **segments = &levels[kk - kmin];
+        if ( !*segments )
+          *segments = g_array_new ( FALSE, FALSE, sizeof(CSegment) );
+        for ( guint ss = 0; ss < 4 && edges[ss] >= 0; ss += 2 ) {
+          CSegment seg;
+          seg.edge[0] = contour_edge ( cols, x, y, edges[ss], vv, level, seg.pt );
+          seg.edge[1] = contour_edge ( cols, x, y, edges[ss+1], vv, level, seg.pt + 2 );
+          g_array_append_val ( *segments, seg );
+        }
+      }
+    }
+  }
+
+  for ( gint kk = kmin; kk <= kmax; kk++ ) {
+    if ( !levels[kk - kmin] )
+      continue;
+    contour_join ( levels[kk - kmin], kk * interval, tolerance, contours );
+    g_array_free ( levels[kk - kmin], TRUE );
+  }
+  g_free ( levels );
+  return contours;
+}
+
+gsize a_contours_get_size ( GPtrArray *contours )
+{
+  gsize size = sizeof(GPtrArray) + contours->len * (sizeof(gpointer) + sizeof(Contour));
+  for ( guint ii = 0; ii < contours->len; ii++ )
+    size += ((Contour*)g_ptr_array_index(contours, ii))->n_points * 2 * sizeof(gfloat);
+  return size;
+}
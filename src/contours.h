@@ -0,0 +1,46 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_CONTOURS_H
+#define __VIKING_CONTOURS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// A line of equal height through a grid of heights
+typedef struct {
+  gdouble level;
+  guint n_points;
+  gfloat *points;  // Pairs of x,y in grid units (fractions between the samples)
+} Contour;
+
+void a_contour_free ( Contour *contour );
+
+// Contours by marching squares at each multiple of the interval,
+//  through a grid of cols x rows heights with each row of cols one after another
+// Cells with an invalid height at any corner are left out
+// tolerance: Points that are less than this (in grid units) from the simplified line are removed
+// Returns: A #GPtrArray of #Contour, which frees them
+GPtrArray *a_contours_trace ( const gint16 *grid, guint cols, guint rows, gint16 invalid, gdouble interval, gdouble tolerance );
+gsize a_contours_get_size ( GPtrArray *contours );
+
+G_END_DECLS
+
+#endif
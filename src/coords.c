@@ -119,7 +119,7 @@ double a_coords_utm_diff( const struct UTM *utm1, const struct UTM *utm2 )
 
 double a_coords_latlon_diff ( const struct LatLon *ll1, const struct LatLon *ll2 )
 {
-  static struct LatLon tmp1, tmp2;
+  struct LatLon tmp1, tmp2;
   gdouble tmp3;
   tmp1.lat = ll1->lat * PIOVER180;
   tmp1.lon = ll1->lon * PIOVER180;
@@ -130,13 +130,86 @@ double a_coords_latlon_diff ( const struct LatLon *ll1, const struct LatLon *ll2
   return isnan(tmp3)?0:tmp3;
 }
 
-void a_coords_latlon_to_utm( const struct LatLon *latlon, struct UTM *utm )
+/* Beyond these the fast distance defers to a_coords_latlon_diff() */
+#define FAST_DIFF_MAX_DEGREES 0.1
+#define FAST_DIFF_MAX_LATITUDE 80.0
+
+/**
+ * a_coords_latlon_diff_cos:
+ * @cos1: The cosine of the latitude of @ll1
+ * @cos2: The cosine of the latitude of @ll2
+ *
+ * As a_coords_latlon_diff_fast(), for when the cosines are already known
+ */
+double a_coords_latlon_diff_cos ( const struct LatLon *ll1, double cos1, const struct LatLon *ll2, double cos2 )
+{
+  gdouble dlat = ll2->lat - ll1->lat;
+  gdouble dlon = ll2->lon - ll1->lon;
+  if ( dlon > 180.0 )
+    dlon -= 360.0;
+  else if ( dlon < -180.0 )
+    dlon += 360.0;
+  if ( fabs(dlat) > FAST_DIFF_MAX_DEGREES || fabs(dlon) > FAST_DIFF_MAX_DEGREES ||
+       fabs(ll1->lat) > FAST_DIFF_MAX_LATITUDE || fabs(ll2->lat) > FAST_DIFF_MAX_LATITUDE )
+    return a_coords_latlon_diff ( ll1, ll2 );
+  // Equirectangular, with the east-west scale taken midway between the points
+  dlon *= 0.5 * ( cos1 + cos2 );
+  return EquatorialRadius * PIOVER180 * sqrt ( dlat*dlat + dlon*dlon );
+}
+
+/**
+ * a_coords_latlon_diff_fast:
+ *
+ * An approximation of a_coords_latlon_diff() for nearby points,
+ *  treating the sphere as flat around them.
+ * For points within 10km of each other (and below 80 degrees latitude)
+ *  the relative error is under 0.001% of the great circle distance,
+ *  otherwise the result is that of a_coords_latlon_diff().
+ * For points very close together it is the more accurate,
+ *  since the acos() of a_coords_latlon_diff() loses precision there.
+ */
+double a_coords_latlon_diff_fast ( const struct LatLon *ll1, const struct LatLon *ll2 )
+{
+  return a_coords_latlon_diff_cos ( ll1, cos(ll1->lat * PIOVER180), ll2, cos(ll2->lat * PIOVER180) );
+}
+
+/**
+ * a_coords_latlon_diffs:
+ * @diffs: Filled with the @count-1 distances between each position and the next
+ *
+ * As a_coords_latlon_diff_fast() for a sequence of positions,
+ *  with the cosine of each latitude only calculated once
+ */
+void a_coords_latlon_diffs ( const struct LatLon *latlon, double *diffs, guint count )
+{
+  if ( count < 2 )
+    return;
+  gdouble cos_prev = cos ( latlon[0].lat * PIOVER180 );
+  for ( guint ii = 1; ii < count; ii++ ) {
+    gdouble cos_this = cos ( latlon[ii].lat * PIOVER180 );
+    diffs[ii-1] = a_coords_latlon_diff_cos ( &latlon[ii-1], cos_prev, &latlon[ii], cos_this );
+    cos_prev = cos_this;
+  }
+}
+
+/* Terms of the series expansions, which only depend on the ellipsoid */
+#define ECC2 EccentricitySquared
+#define ECC_PRIME2 ( ECC2 / ( 1.0 - ECC2 ) )
+#define M_C0 ( 1.0 - ECC2 / 4 - 3 * ECC2 * ECC2 / 64 - 5 * ECC2 * ECC2 * ECC2 / 256 )
+#define M_C2 ( 3 * ECC2 / 8 + 3 * ECC2 * ECC2 / 32 + 45 * ECC2 * ECC2 * ECC2 / 1024 )
+#define M_C4 ( 15 * ECC2 * ECC2 / 256 + 45 * ECC2 * ECC2 * ECC2 / 1024 )
+#define M_C6 ( 35 * ECC2 * ECC2 * ECC2 / 3072 )
+
+/*
+ * The multiple angle terms are derived from a single sin & cos,
+ *  rather than each being a separate (and relatively slow) trig call
+ */
+static inline void latlon_to_utm ( const struct LatLon *latlon, struct UTM *utm )
     {
     double latitude;
     double longitude;
     double lat_rad, long_rad;
     double long_origin, long_origin_rad;
-    double eccPrimeSquared;
     double N, T, C, A, M;
     int zone;
     double northing, easting;
@@ -167,16 +240,24 @@ void a_coords_latlon_to_utm( const struct LatLon *latlon, struct UTM *utm )
 	}
     long_origin = ( zone - 1 ) * 6 - 180 + 3;	/* +3 puts origin in middle of zone */
     long_origin_rad = DEG2RAD(long_origin);
-    eccPrimeSquared = EccentricitySquared / ( 1.0 - EccentricitySquared );
-    N = EquatorialRadius / sqrt( 1.0 - EccentricitySquared * sin( lat_rad ) * sin( lat_rad ) );
-    T = tan( lat_rad ) * tan( lat_rad );
-    C = eccPrimeSquared * cos( lat_rad ) * cos( lat_rad );
-    A = cos( lat_rad ) * ( long_rad - long_origin_rad );
-    M = EquatorialRadius * ( ( 1.0 - EccentricitySquared / 4 - 3 * EccentricitySquared * EccentricitySquared / 64 - 5 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 256 ) * lat_rad - ( 3 * EccentricitySquared / 8 + 3 * EccentricitySquared * EccentricitySquared / 32 + 45 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 1024 ) * sin( 2 * lat_rad ) + ( 15 * EccentricitySquared * EccentricitySquared / 256 + 45 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 1024 ) * sin( 4 * lat_rad ) - ( 35 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 3072 ) * sin( 6 * lat_rad ) );
+
+    double s = sin ( lat_rad );
+    double c = cos ( lat_rad );
+    double t = s / c;
+    double s2 = 2 * s * c, c2 = c * c - s * s;
+    double s4 = 2 * s2 * c2, c4 = c2 * c2 - s2 * s2;
+    double s6 = s4 * c2 + c4 * s2;
+
+    N = EquatorialRadius / sqrt( 1.0 - ECC2 * s * s );
+    T = t * t;
+    C = ECC_PRIME2 * c * c;
+    A = c * ( long_rad - long_origin_rad );
+    M = EquatorialRadius * ( M_C0 * lat_rad - M_C2 * s2 + M_C4 * s4 - M_C6 * s6 );
+    double A2 = A * A;
     easting =
-	K0 * N * ( A + ( 1 - T + C ) * A * A * A / 6 + ( 5 - 18 * T + T * T + 72 * C - 58 * eccPrimeSquared ) * A * A * A * A * A / 120 ) + 500000.0;
+	K0 * N * A * ( 1 + A2 * ( ( 1 - T + C ) / 6 + A2 * ( 5 - 18 * T + T * T + 72 * C - 58 * ECC_PRIME2 ) / 120 ) ) + 500000.0;
     northing =
-	K0 * ( M + N * tan( lat_rad ) * ( A * A / 2 + ( 5 - T + 9 * C + 4 * C * C ) * A * A * A * A / 24 + ( 61 - 58 * T + T * T + 600 * C - 330 * eccPrimeSquared ) * A * A * A * A * A * A / 720 ) );
+	K0 * ( M + N * t * A2 * ( 0.5 + A2 * ( ( 5 - T + 9 * C + 4 * C * C ) / 24 + A2 * ( 61 - 58 * T + T * T + 600 * C - 330 * ECC_PRIME2 ) / 720 ) ) );
     if ( latitude < 0.0 )
 	northing += 10000000.0;  /* 1e7 meter offset for southern hemisphere */
 
@@ -188,6 +269,21 @@ void a_coords_latlon_to_utm( const struct LatLon *latlon, struct UTM *utm )
     /* All done. */
     }
 
+void a_coords_latlon_to_utm( const struct LatLon *latlon, struct UTM *utm )
+{
+  latlon_to_utm ( latlon, utm );
+}
+
+/**
+ * a_coords_latlon_to_utm_array:
+ *
+ * Convert many positions in one go, such as all the points of a track
+ */
+void a_coords_latlon_to_utm_array ( const struct LatLon *latlon, struct UTM *utm, guint count )
+{
+  for ( guint ii = 0; ii < count; ii++ )
+    latlon_to_utm ( &latlon[ii], &utm[ii] );
+}
 
 static char coords_utm_letter( double latitude )
     {
@@ -220,46 +316,47 @@ static char coords_utm_letter( double latitude )
 
 
 
-void a_coords_utm_to_latlon( const struct UTM *utm, struct LatLon *latlon )
+static inline void utm_to_latlon ( const struct UTM *utm, struct LatLon *latlon )
     {
-    double northing, easting;
-    int zone;
-    char letter[100];
     double x, y;
-    double eccPrimeSquared;
-    double e1;
     double N1, T1, C1, R1, D, M;
     double long_origin;
     double mu, phi1_rad;
     double latitude, longitude;
 
-    northing = utm->northing;
-    easting = utm->easting;
-    zone = utm->zone;
-    letter[0] = utm->letter;
-
     /* Now convert. */
-    x = easting - 500000.0;	/* remove 500000 meter offset */
-    y = northing;
-    if ( ( *letter - 'N' ) < 0 ) {
+    x = utm->easting - 500000.0;	/* remove 500000 meter offset */
+    y = utm->northing;
+    if ( ( utm->letter - 'N' ) < 0 ) {
       /* southern hemisphere */
       y -= 10000000.0;	/* remove 1e7 meter offset */
     }
 
-    long_origin = ( zone - 1 ) * 6 - 180 + 3;	/* +3 puts origin in middle of zone */
-    eccPrimeSquared = EccentricitySquared / ( 1.0 - EccentricitySquared );
-    e1 = ( 1.0 - sqrt( 1.0 - EccentricitySquared ) ) / ( 1.0 + sqrt( 1.0 - EccentricitySquared ) );
+    long_origin = ( utm->zone - 1 ) * 6 - 180 + 3;	/* +3 puts origin in middle of zone */
+    const double e1 = ( 1.0 - sqrt( 1.0 - ECC2 ) ) / ( 1.0 + sqrt( 1.0 - ECC2 ) );
     M = y / K0;
-    mu = M / ( EquatorialRadius * ( 1.0 - EccentricitySquared / 4 - 3 * EccentricitySquared * EccentricitySquared / 64 - 5 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 256 ) );
-    phi1_rad = mu + ( 3 * e1 / 2 - 27 * e1 * e1 * e1 / 32 )* sin( 2 * mu ) + ( 21 * e1 * e1 / 16 - 55 * e1 * e1 * e1 * e1 / 32 ) * sin( 4 * mu ) + ( 151 * e1 * e1 * e1 / 96 ) * sin( 6 *mu );
-    N1 = EquatorialRadius / sqrt( 1.0 - EccentricitySquared * sin( phi1_rad ) * sin( phi1_rad ) );
-    T1 = tan( phi1_rad ) * tan( phi1_rad );
-    C1 = eccPrimeSquared * cos( phi1_rad ) * cos( phi1_rad );
-    R1 = EquatorialRadius * ( 1.0 - EccentricitySquared ) / pow( 1.0 - EccentricitySquared * sin( phi1_rad ) * sin( phi1_rad ), 1.5 );
+    mu = M / ( EquatorialRadius * M_C0 );
+
+    double smu = sin ( mu );
+    double cmu = cos ( mu );
+    double s2 = 2 * smu * cmu, c2 = cmu * cmu - smu * smu;
+    double s4 = 2 * s2 * c2, c4 = c2 * c2 - s2 * s2;
+    double s6 = s4 * c2 + c4 * s2;
+    phi1_rad = mu + ( 3 * e1 / 2 - 27 * e1 * e1 * e1 / 32 ) * s2 + ( 21 * e1 * e1 / 16 - 55 * e1 * e1 * e1 * e1 / 32 ) * s4 + ( 151 * e1 * e1 * e1 / 96 ) * s6;
+
+    double s = sin ( phi1_rad );
+    double c = cos ( phi1_rad );
+    double t = s / c;
+    double w = 1.0 - ECC2 * s * s;
+    N1 = EquatorialRadius / sqrt( w );
+    T1 = t * t;
+    C1 = ECC_PRIME2 * c * c;
+    R1 = EquatorialRadius * ( 1.0 - ECC2 ) / ( w * sqrt( w ) );
     D = x / ( N1 * K0 );
-    latitude = phi1_rad - ( N1 * tan( phi1_rad ) / R1 ) * ( D * D / 2 -( 5 + 3 * T1 + 10 * C1 - 4 * C1 * C1 - 9 * eccPrimeSquared ) * D * D * D * D / 24 + ( 61 + 90 * T1 + 298 * C1 + 45 * T1 * T1 - 252 * eccPrimeSquared - 3 * C1 * C1 ) * D * D * D * D * D * D / 720 );
+    double D2 = D * D;
+    latitude = phi1_rad - ( N1 * t / R1 ) * D2 * ( 0.5 - D2 * ( ( 5 + 3 * T1 + 10 * C1 - 4 * C1 * C1 - 9 * ECC_PRIME2 ) / 24 - D2 * ( 61 + 90 * T1 + 298 * C1 + 45 * T1 * T1 - 252 * ECC_PRIME2 - 3 * C1 * C1 ) / 720 ) );
     latitude = RAD2DEG(latitude);
-    longitude = ( D - ( 1 + 2 * T1 + C1 ) * D * D * D / 6 + ( 5 - 2 * C1 + 28 * T1 - 3 * C1 * C1 + 8 * eccPrimeSquared + 24 * T1 * T1 ) * D * D * D * D * D / 120 ) / cos( phi1_rad );
+    longitude = D * ( 1 - D2 * ( ( 1 + 2 * T1 + C1 ) / 6 - D2 * ( 5 - 2 * C1 + 28 * T1 - 3 * C1 * C1 + 8 * ECC_PRIME2 + 24 * T1 * T1 ) / 120 ) ) / c;
     longitude = long_origin + RAD2DEG(longitude);
 
     /* Show results. */
@@ -269,6 +366,22 @@ void a_coords_utm_to_latlon( const struct UTM *utm, struct LatLon *latlon )
 
     }
 
+void a_coords_utm_to_latlon( const struct UTM *utm, struct LatLon *latlon )
+{
+  utm_to_latlon ( utm, latlon );
+}
+
+/**
+ * a_coords_utm_to_latlon_array:
+ *
+ * Convert many positions in one go, such as all the points of a track
+ */
+void a_coords_utm_to_latlon_array ( const struct UTM *utm, struct LatLon *latlon, guint count )
+{
+  for ( guint ii = 0; ii < count; ii++ )
+    utm_to_latlon ( &utm[ii], &latlon[ii] );
+}
+
 void a_coords_latlon_to_string ( const struct LatLon *latlon,
 				 gchar **lat,
 				 gchar **lon )
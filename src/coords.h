@@ -56,8 +56,13 @@ struct LatLon {
 int a_coords_utm_equal( const struct UTM *utm1, const struct UTM *utm2 );
 void a_coords_latlon_to_utm ( const struct LatLon *latlon, struct UTM *utm );
 void a_coords_utm_to_latlon ( const struct UTM *utm, struct LatLon *latlon );
+void a_coords_latlon_to_utm_array ( const struct LatLon *latlon, struct UTM *utm, guint count );
+void a_coords_utm_to_latlon_array ( const struct UTM *utm, struct LatLon *latlon, guint count );
 double a_coords_utm_diff( const struct UTM *utm1, const struct UTM *utm2 );
 double a_coords_latlon_diff ( const struct LatLon *ll1, const struct LatLon *ll2 );
+double a_coords_latlon_diff_fast ( const struct LatLon *ll1, const struct LatLon *ll2 );
+double a_coords_latlon_diff_cos ( const struct LatLon *ll1, double cos1, const struct LatLon *ll2, double cos2 );
+void a_coords_latlon_diffs ( const struct LatLon *latlon, double *diffs, guint count );
 
 /**
  * Convert a double to a string WITHOUT LOCALE.
@@ -87,6 +87,8 @@ static int curl_progress_func(void *clientp, double dltotal, double dlnow, doubl
 
 static gint curl_ssl_verifypeer = 1; // https://curl.haxx.se/libcurl/c/CURLOPT_SSL_VERIFYPEER.html
 static gchar* curl_cainfo = NULL;    // https://curl.haxx.se/libcurl/c/CURLOPT_CAINFO.html
+static gboolean curl_http2 = TRUE;   // https://curl.haxx.se/libcurl/c/CURLOPT_HTTP_VERSION.html
+static gint curl_max_host_connections = 4; // https://curl.haxx.se/libcurl/c/CURLMOPT_MAX_HOST_CONNECTIONS.html
 
 /* This should to be called from main() to make sure thread safe */
 void curl_download_init()
@@ -105,6 +107,11 @@ void curl_download_init()
     curl_cainfo = g_strdup ( str );
     g_free ( str );
   }
+  if ( a_settings_get_boolean ( "curl_http2", &tmp ) )
+    curl_http2 = tmp;
+  gint num;
+  if ( a_settings_get_integer ( "curl_max_host_connections", &num ) )
+    curl_max_host_connections = CLAMP ( num, 1, 32 );
 }
 
 /* This should to be called from main() to make sure thread safe */
@@ -145,18 +152,14 @@ static void common_opts ( CURL *curl, const char *uri, DownloadFileOptions *opti
 }
 
 /**
+ * Set the options for downloading into a file on this curl handle
  *
+ * Returns the list of headers to be freed once the transfer has finished (may be NULL)
  */
-CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOptions *options, CurlDownloadOptions *cdo, void *handle )
+static struct curl_slist *download_opts ( CURL *curl, const char *uri, FILE *f, DownloadFileOptions *options, CurlDownloadOptions *cdo )
 {
-  CURL *curl;
   struct curl_slist *curl_send_headers = NULL;
-  CURLcode res = CURLE_FAILED_INIT;
 
-  curl = handle ? handle : curl_easy_init ();
-  if ( !curl ) {
-    return CURL_DOWNLOAD_ERROR;
-  }
   common_opts ( curl, uri, options );
   curl_easy_setopt ( curl, CURLOPT_WRITEDATA, f );
   curl_easy_setopt ( curl, CURLOPT_WRITEFUNCTION, curl_write_func);
@@ -192,16 +195,31 @@ CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOption
   if ( curl_cainfo )
      curl_easy_setopt ( curl, CURLOPT_CAINFO, curl_cainfo );
 
+#if LIBCURL_VERSION_NUM >= 0x072f00
+  // Negotiate HTTP/2 for https servers (otherwise stays with HTTP/1.1)
+  if ( curl_http2 ) {
+    curl_easy_setopt ( curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS );
+    // Prefer waiting to multiplex on an existing connection over opening a new one
+    curl_easy_setopt ( curl, CURLOPT_PIPEWAIT, 1L );
+  }
+#endif
+
   if ( curl_send_headers )
     curl_easy_setopt ( curl, CURLOPT_HTTPHEADER , curl_send_headers );
 
-  res = curl_easy_perform ( curl );
+  return curl_send_headers;
+}
 
+/**
+ * Convert the outcome of a (finished) transfer into our return value
+ */
+static CURL_download_t download_result ( CURL *curl, CURLcode res, const char *uri )
+{
   if (res == CURLE_OK) {
     glong response;
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response);
     if (response == 304) {         // 304 = Not Modified
-      res = CURL_DOWNLOAD_NO_NEWER_FILE;
+      return CURL_DOWNLOAD_NO_NEWER_FILE;
     } else if (response == 200 ||  // http: 200 = Ok
                response == 226) {  // ftp:  226 = sucess
       gdouble size;
@@ -209,17 +227,35 @@ CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOption
          when the server has a (incorrect) time earlier than the time on the file we already have */
       curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD, &size);
       if (size == 0)
-        res = CURL_DOWNLOAD_ERROR;
+        return CURL_DOWNLOAD_ERROR;
       else
-        res = CURL_DOWNLOAD_NO_ERROR;
+        return CURL_DOWNLOAD_NO_ERROR;
     } else {
       g_warning("%s: http response: %ld for uri %s", __FUNCTION__, response, uri);
-      res = CURL_DOWNLOAD_ERROR;
+      return CURL_DOWNLOAD_ERROR;
     }
-  } else {
-    g_warning ( "%s: curl error: %d for uri %s", __FUNCTION__, res, uri );
-    res = CURL_DOWNLOAD_ERROR;
   }
+  g_warning ( "%s: curl error: %d for uri %s", __FUNCTION__, res, uri );
+  return CURL_DOWNLOAD_ERROR;
+}
+
+/**
+ *
+ */
+CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOptions *options, CurlDownloadOptions *cdo, void *handle )
+{
+  CURL *curl;
+  struct curl_slist *curl_send_headers = NULL;
+  CURL_download_t ret;
+
+  curl = handle ? handle : curl_easy_init ();
+  if ( !curl ) {
+    return CURL_DOWNLOAD_ERROR;
+  }
+  curl_send_headers = download_opts ( curl, uri, f, options, cdo );
+
+  ret = download_result ( curl, curl_easy_perform ( curl ), uri );
+
   if (curl_send_headers) {
     curl_slist_free_all(curl_send_headers);
     curl_send_headers = NULL;
@@ -227,64 +263,88 @@ CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOption
   }
   if (!handle)
      curl_easy_cleanup ( curl );
-  return res;
+  return ret;
 }
 
 /**
- * curl_download_get_url:
- *  Either hostname and/or uri should be defined
+ * Compose the full url from the hostname and/or uri
  *
+ * Returns a newly allocated string or NULL if neither is usable
  */
-CURL_download_t curl_download_get_url ( const char *hostname, const char *uri, FILE *f, DownloadFileOptions *options, gboolean ftp, CurlDownloadOptions *cdo, void *handle )
+static gchar *get_full_url ( const char *hostname, const char *uri, gboolean ftp )
 {
-  gchar *full = NULL;
-
   if ( hostname && strstr ( hostname, "://" ) != NULL ) {
     if ( uri && strlen ( uri ) > 1 )
       // Simply append them together
-      full = g_strdup_printf ( "%s%s", hostname, uri );
+      return g_strdup_printf ( "%s%s", hostname, uri );
     else
       /* Already full url */
-      full = (gchar *) hostname;
+      return g_strdup ( hostname );
   }
   else if ( uri && strstr ( uri, "://" ) != NULL )
     /* Already full url */
-    full = (gchar *) uri;
+    return g_strdup ( uri );
   else if ( hostname && uri )
     /* Compose the full url */
-    full = g_strdup_printf ( "%s://%s%s", (ftp?"ftp":"http"), hostname, uri );
-  else {
+    return g_strdup_printf ( "%s://%s%s", (ftp?"ftp":"http"), hostname, uri );
+  return NULL;
+}
+
+/**
+ * curl_download_get_url:
+ *  Either hostname and/or uri should be defined
+ *
+ */
+CURL_download_t curl_download_get_url ( const char *hostname, const char *uri, FILE *f, DownloadFileOptions *options, gboolean ftp, CurlDownloadOptions *cdo, void *handle )
+{
+  gchar *full = get_full_url ( hostname, uri, ftp );
+  if ( !full )
     return CURL_DOWNLOAD_ERROR;
-  }
 
   CURL_download_t ret = curl_download_uri ( full, f, options, cdo, handle );
-  // Only free newly allocated memory
-  if ( hostname != full && uri != full )
-    g_free ( full );
+  g_free ( full );
 
   return ret;
 }
 
 
-struct MemoryStruct {
-  char *data;
-  size_t size;
-};
+typedef struct {
+  CURL *curl;
+  GByteArray *data;
+} MemoryDownload;
 
 static size_t WriteMemoryCallback(void *ptr, size_t size, size_t nmemb, void *data)
 {
   size_t realsize = size * nmemb;
-  struct MemoryStruct *mem = (struct MemoryStruct *)data;
-
-  mem->data = (char *)realloc(mem->data, mem->size + realsize + 1);
-  if (mem->data) {
-    memcpy(&(mem->data[mem->size]), ptr, realsize);
-    mem->size += realsize;
-    mem->data[mem->size] = 0;
+  MemoryDownload *md = (MemoryDownload *)data;
+  if ( !md->data ) {
+    // Allocate all that is needed up front when the server says how much is coming (and the terminator),
+    //  otherwise GByteArray grows its allocation geometrically, rather than for every piece received
+    gdouble length = -1;
+    curl_easy_getinfo ( md->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &length );
+    md->data = length > 0 && length < G_MAXUINT ? g_byte_array_sized_new ( (guint)length + 1 ) : g_byte_array_new ();
   }
+  g_byte_array_append ( md->data, ptr, realsize );
   return realsize;
 }
 
+/**
+ * Returns: The (terminated) data received, even if empty, which is given to the caller
+ */
+static gchar *memory_download_steal ( MemoryDownload *md, gsize *size )
+{
+  if ( !md->data )
+    md->data = g_byte_array_new ();
+  if ( size )
+    *size = md->data->len;
+  // Always terminated, as the data is normally treated as a string
+  guint8 nul = 0;
+  g_byte_array_append ( md->data, &nul, 1 );
+  gchar *data = (gchar*)g_byte_array_free ( md->data, FALSE );
+  md->data = NULL;
+  return data;
+}
+
 /**
  * Download data from an URL into a memory buffer
  *  (hence no need to save to a temporary file)
@@ -294,24 +354,23 @@ static size_t WriteMemoryCallback(void *ptr, size_t size, size_t nmemb, void *da
  */
 char* curl_download_get_ptr ( const char *uri, DownloadFileOptions *options )
 {
-  struct MemoryStruct mem;
   CURL *curl = curl_easy_init ();
   if ( !curl )
     return NULL;
 
-  mem.data = NULL;
-  mem.size = 0;
+  MemoryDownload md = { curl, NULL };
   common_opts ( curl, uri, options );
 
-  curl_easy_setopt ( curl, CURLOPT_WRITEDATA, (void *)&mem );
+  curl_easy_setopt ( curl, CURLOPT_WRITEDATA, (void *)&md );
   curl_easy_setopt ( curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback );
 
   CURLcode result = curl_easy_perform ( curl );
 
-  curl_easy_cleanup ( curl );
-
   if ( result != CURLE_OK ) {
     g_warning ( "%s: curl error: %d for uri %s", __FUNCTION__, result, uri );
+    curl_easy_cleanup ( curl );
+    if ( md.data )
+      g_byte_array_free ( md.data, TRUE );
     return NULL;
   }
   else if ( vik_debug ) {
@@ -321,8 +380,86 @@ char* curl_download_get_ptr ( const char *uri, DownloadFileOptions *options )
       curl_easy_getinfo ( curl, CURLINFO_SIZE_DOWNLOAD, &size );
       g_debug ( "%s: received %.0f bytes in response %ld", __FUNCTION__, size, response );
   }
+  curl_easy_cleanup ( curl );
+
+  return memory_download_steal ( &md, NULL );
+}
+
+/**
+ * curl_download_get_data:
+ * @size: Returns the length of the data (not including the terminator)
+ *
+ * As curl_download_uri() but into memory, with the same checks of the response
+ *
+ * Returns: The data (always terminated) or NULL on failure. Free the returned data after use
+ */
+gchar* curl_download_get_data ( const char *uri, DownloadFileOptions *options, gsize *size )
+{
+  CURL *curl = curl_easy_init ();
+  if ( !curl )
+    return NULL;
+
+  MemoryDownload md = { curl, NULL };
+  struct curl_slist *curl_send_headers = download_opts ( curl, uri, NULL, options, NULL );
+  curl_easy_setopt ( curl, CURLOPT_WRITEDATA, (void *)&md );
+  curl_easy_setopt ( curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback );
+
+  CURL_download_t ret = download_result ( curl, curl_easy_perform ( curl ), uri );
+
+  if ( curl_send_headers )
+    curl_slist_free_all ( curl_send_headers );
+  curl_easy_cleanup ( curl );
+
+  if ( ret != CURL_DOWNLOAD_NO_ERROR ) {
+    if ( md.data )
+      g_byte_array_free ( md.data, TRUE );
+    return NULL;
+  }
+  return memory_download_steal ( &md, size );
+}
+
+typedef struct {
+  CurlDataFunc func;
+  gpointer user_data;
+  CURL *curl;
+} DataCallback;
+
+static size_t curl_data_func ( void *ptr, size_t size, size_t nmemb, DataCallback *dc )
+{
+  // Only pass on the actual content, not an error page
+  glong response = 0;
+  curl_easy_getinfo ( dc->curl, CURLINFO_RESPONSE_CODE, &response );
+  if ( response >= 400 )
+    return size * nmemb;
+  // Returning less than given aborts the transfer
+  if ( !dc->func ( ptr, size * nmemb, dc->user_data ) )
+    return 0;
+  return size * nmemb;
+}
+
+/**
+ * curl_download_uri_to_func:
+ * @func: Given the data as it is received, returning FALSE to abort the download
+ *
+ * Download without storing the data anywhere, so it can be processed as it arrives
+ */
+CURL_download_t curl_download_uri_to_func ( const char *uri, DownloadFileOptions *options, CurlDataFunc func, gpointer user_data )
+{
+  CURL *curl = curl_easy_init ();
+  if ( !curl )
+    return CURL_DOWNLOAD_ERROR;
+
+  DataCallback dc = { func, user_data, curl };
+  struct curl_slist *curl_send_headers = download_opts ( curl, uri, NULL, options, NULL );
+  curl_easy_setopt ( curl, CURLOPT_WRITEDATA, &dc );
+  curl_easy_setopt ( curl, CURLOPT_WRITEFUNCTION, curl_data_func );
 
-  return mem.data;
+  CURL_download_t ret = download_result ( curl, curl_easy_perform ( curl ), uri );
+
+  if ( curl_send_headers )
+    curl_slist_free_all ( curl_send_headers );
+  curl_easy_cleanup ( curl );
+  return ret;
 }
 
 void * curl_download_handle_init ()
@@ -334,3 +471,232 @@ void curl_download_handle_cleanup ( void *handle )
 {
   curl_easy_cleanup(handle);
 }
+
+/**
+ * A single transfer within a #CurlMultiDownload
+ */
+typedef struct {
+  gchar *uri;
+  struct curl_slist *headers;
+  CurlMultiDoneFunc done;
+  gpointer user_data;
+  DataCallback dc; // Only for transfers passing on the data as it arrives
+} CurlMultiTransfer;
+
+struct _CurlMultiDownload {
+  CURLM *multi;
+  GHashTable *active; // Easy handles currently attached to the multi handle
+  GQueue idle; // Finished easy handles available for reuse
+  guint pending;
+};
+
+/**
+ * curl_download_multi_new:
+ *
+ * Create a download engine which runs many transfers concurrently from one thread.
+ * Connections are kept and reused per host for the lifetime of the engine,
+ *  with HTTP/2 streams multiplexed over a single connection where the server allows it.
+ * The number of simultaneous connections to any one host is limited by the
+ *  'curl_max_host_connections' setting; further transfers wait for a free connection.
+ */
+CurlMultiDownload *curl_download_multi_new ()
+{
+  CURLM *multi = curl_multi_init ();
+  if ( !multi )
+    return NULL;
+
+  CurlMultiDownload *cmd = g_malloc0 ( sizeof(CurlMultiDownload) );
+  cmd->multi = multi;
+  cmd->active = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  g_queue_init ( &cmd->idle );
+#if LIBCURL_VERSION_NUM >= 0x072b00
+  curl_multi_setopt ( multi, CURLMOPT_PIPELINING, curl_http2 ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING );
+#endif
+#if LIBCURL_VERSION_NUM >= 0x071e00
+  curl_multi_setopt ( multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)curl_max_host_connections );
+#endif
+  return cmd;
+}
+
+/**
+ * Queue the transfer, taking ownership of the full url
+ */
+static gboolean multi_add ( CurlMultiDownload *cmd, gchar *full, FILE *f, DownloadFileOptions *options, CurlDownloadOptions *cdo, CurlDataFunc func, CurlMultiDoneFunc done, gpointer user_data )
+{
+  CURL *curl = g_queue_pop_head ( &cmd->idle );
+  if ( !curl )
+    curl = curl_easy_init ();
+  if ( !curl ) {
+    g_free ( full );
+    return FALSE;
+  }
+
+  CurlMultiTransfer *cmt = g_malloc0 ( sizeof(CurlMultiTransfer) );
+  cmt->uri = full;
+  cmt->done = done;
+  cmt->user_data = user_data;
+  cmt->headers = download_opts ( curl, full, f, options, cdo );
+  if ( func ) {
+    cmt->dc.func = func;
+    cmt->dc.user_data = user_data;
+    cmt->dc.curl = curl;
+    curl_easy_setopt ( curl, CURLOPT_WRITEDATA, &cmt->dc );
+    curl_easy_setopt ( curl, CURLOPT_WRITEFUNCTION, curl_data_func );
+  }
+  curl_easy_setopt ( curl, CURLOPT_PRIVATE, cmt );
+
+  if ( curl_multi_add_handle ( cmd->multi, curl ) != CURLM_OK ) {
+    g_warning ( "%s: failed to add transfer for uri %s", __FUNCTION__, full );
+    curl_slist_free_all ( cmt->headers );
+    curl_easy_cleanup ( curl );
+    g_free ( cmt->uri );
+    g_free ( cmt );
+    return FALSE;
+  }
+  g_hash_table_add ( cmd->active, curl );
+  cmd->pending++;
+  return TRUE;
+}
+
+/**
+ * curl_download_multi_add:
+ * @done: Called once the transfer has finished, from within curl_download_multi_perform()
+ *        Return FALSE from this to abandon all the remaining transfers.
+ *
+ * Queue a download to be performed by curl_download_multi_perform()
+ * The file and the curl options must remain valid until @done is called.
+ *
+ * Returns: FALSE if the transfer could not be queued, in which case @done is not called.
+ */
+gboolean curl_download_multi_add ( CurlMultiDownload *cmd, const char *hostname, const char *uri, FILE *f, DownloadFileOptions *options, gboolean ftp, CurlDownloadOptions *cdo, CurlMultiDoneFunc done, gpointer user_data )
+{
+  gchar *full = get_full_url ( hostname, uri, ftp );
+  if ( !full )
+    return FALSE;
+  return multi_add ( cmd, full, f, options, cdo, NULL, done, user_data );
+}
+
+/**
+ * curl_download_multi_add_func:
+ * @func: Given the data as it is received, returning FALSE to abort this transfer
+ * @done: As per curl_download_multi_add()
+ *
+ * As curl_download_multi_add() but without storing the data anywhere,
+ *  so it can be processed as it arrives (c.f. curl_download_uri_to_func())
+ *
+ * Returns: FALSE if the transfer could not be queued, in which case @done is not called.
+ */
+gboolean curl_download_multi_add_func ( CurlMultiDownload *cmd, const char *uri, DownloadFileOptions *options, CurlDataFunc func, CurlMultiDoneFunc done, gpointer user_data )
+{
+  return multi_add ( cmd, g_strdup(uri), NULL, options, NULL, func, done, user_data );
+}
+
+/**
+ * Detach the transfer from the multi handle and keep the easy handle for reuse
+ */
+static CurlMultiTransfer *multi_transfer_finish ( CurlMultiDownload *cmd, CURL *curl )
+{
+  CurlMultiTransfer *cmt = NULL;
+  curl_easy_getinfo ( curl, CURLINFO_PRIVATE, (char**)&cmt );
+  curl_multi_remove_handle ( cmd->multi, curl );
+  g_hash_table_remove ( cmd->active, curl );
+  curl_slist_free_all ( cmt->headers );
+  curl_easy_reset ( curl );
+  g_queue_push_tail ( &cmd->idle, curl );
+  cmd->pending--;
+  return cmt;
+}
+
+/**
+ * Process transfers that have finished
+ *
+ * Returns: FALSE if a callback requested to stop
+ */
+static gboolean multi_check_done ( CurlMultiDownload *cmd )
+{
+  gboolean carry_on = TRUE;
+  CURLMsg *msg;
+  int msgs_left;
+  while ( (msg = curl_multi_info_read ( cmd->multi, &msgs_left )) ) {
+    if ( msg->msg != CURLMSG_DONE )
+      continue;
+    CURL *curl = msg->easy_handle;
+    CURLcode res = msg->data.result;
+    // Get result before the handle is reset
+    CurlMultiTransfer *cmt = NULL;
+    curl_easy_getinfo ( curl, CURLINFO_PRIVATE, (char**)&cmt );
+    CURL_download_t ret = download_result ( curl, res, cmt->uri );
+    (void)multi_transfer_finish ( cmd, curl );
+    if ( cmt->done && !cmt->done ( ret, cmt->user_data ) )
+      carry_on = FALSE;
+    g_free ( cmt->uri );
+    g_free ( cmt );
+  }
+  return carry_on;
+}
+
+/**
+ * Abandon all transfers still in progress
+ */
+static void multi_abort_all ( CurlMultiDownload *cmd )
+{
+  GList *handles = g_hash_table_get_keys ( cmd->active );
+  for ( GList *iter = handles; iter; iter = iter->next ) {
+    CurlMultiTransfer *cmt = multi_transfer_finish ( cmd, (CURL*)iter->data );
+    if ( cmt->done )
+      (void)cmt->done ( CURL_DOWNLOAD_ERROR, cmt->user_data );
+    g_free ( cmt->uri );
+    g_free ( cmt );
+  }
+  g_list_free ( handles );
+}
+
+/**
+ * curl_download_multi_perform:
+ * @max_pending: Return once no more than this number of transfers are outstanding.
+ *               Use 0 to complete all transfers.
+ *
+ * Run the queued transfers, calling the done function of each as it finishes.
+ * By returning early once enough transfers have completed, the caller can keep
+ *  the queue topped up and so the connections busy.
+ *
+ * Returns: 0 when successful or -1 when the transfers have been abandoned
+ *  (all outstanding transfers will have had their done function called with an error)
+ */
+gint curl_download_multi_perform ( CurlMultiDownload *cmd, guint max_pending )
+{
+  while ( cmd->pending > max_pending ) {
+    int running = 0;
+    CURLMcode mc = curl_multi_perform ( cmd->multi, &running );
+    if ( mc != CURLM_OK ) {
+      g_warning ( "%s: curl multi error: %d", __FUNCTION__, mc );
+      multi_abort_all ( cmd );
+      return -1;
+    }
+    if ( !multi_check_done ( cmd ) || a_background_testcancel(NULL) ) {
+      multi_abort_all ( cmd );
+      return -1;
+    }
+    if ( cmd->pending > max_pending && running )
+      (void)curl_multi_wait ( cmd->multi, NULL, 0, 1000, NULL );
+  }
+  return 0;
+}
+
+/**
+ * curl_download_multi_free:
+ *
+ * Any transfers still outstanding are abandoned.
+ */
+void curl_download_multi_free ( CurlMultiDownload *cmd )
+{
+  if ( !cmd )
+    return;
+  multi_abort_all ( cmd );
+  CURL *curl;
+  while ( (curl = g_queue_pop_head ( &cmd->idle )) )
+    curl_easy_cleanup ( curl );
+  curl_multi_cleanup ( cmd->multi );
+  g_hash_table_destroy ( cmd->active );
+  g_free ( cmd );
+}
@@ -59,6 +59,29 @@ void * curl_download_handle_init ();
 void curl_download_handle_cleanup ( void * handle );
 
 char* curl_download_get_ptr ( const char *uri, DownloadFileOptions *options );
+gchar* curl_download_get_data ( const char *uri, DownloadFileOptions *options, gsize *size );
+
+/**
+ * Called with each piece of data as it is downloaded
+ * Return FALSE to abort the download
+ */
+typedef gboolean (*CurlDataFunc) ( const gchar *data, gsize len, gpointer user_data );
+
+CURL_download_t curl_download_uri_to_func ( const char *uri, DownloadFileOptions *options, CurlDataFunc func, gpointer user_data );
+
+/**
+ * Called when a transfer of a #CurlMultiDownload has finished
+ * Return FALSE to abandon the remaining transfers
+ */
+typedef gboolean (*CurlMultiDoneFunc) ( CURL_download_t result, gpointer user_data );
+
+typedef struct _CurlMultiDownload CurlMultiDownload;
+
+CurlMultiDownload *curl_download_multi_new ();
+gboolean curl_download_multi_add ( CurlMultiDownload *cmd, const char *hostname, const char *uri, FILE *f, DownloadFileOptions *options, gboolean ftp, CurlDownloadOptions *curl_options, CurlMultiDoneFunc done, gpointer user_data );
+gboolean curl_download_multi_add_func ( CurlMultiDownload *cmd, const char *uri, DownloadFileOptions *options, CurlDataFunc func, CurlMultiDoneFunc done, gpointer user_data );
+gint curl_download_multi_perform ( CurlMultiDownload *cmd, guint max_pending );
+void curl_download_multi_free ( CurlMultiDownload *cmd );
 
 G_END_DECLS
 
@@ -25,6 +25,96 @@
 #include "gpx.h"
 #include "acquire.h"
 #include "settings.h"
+#include "background.h"
+
+/************************************ Direct filtering *****************************/
+
+/*
+ * The common filters are done here directly on the layer's data, rather than writing it
+ *  all out for GPSBabel and reading the results back in.
+ * The tracks are filtered in parallel.
+ */
+
+#define VIK_SETTINGS_BFILTER_GPSBABEL "bfilter_use_gpsbabel"
+
+/**
+ * Whether to filter via GPSBabel even when it can be done directly
+ */
+static gboolean bfilter_use_gpsbabel ( void )
+{
+  gboolean use = FALSE;
+  if ( !a_settings_get_boolean ( VIK_SETTINGS_BFILTER_GPSBABEL, &use ) )
+    use = FALSE;
+  return use && a_babel_available();
+}
+
+typedef VikTrack* (*BFilterTrackFunc) ( const VikTrack *trk, gpointer options );
+typedef gboolean (*BFilterWaypointFunc) ( VikWaypoint *wp, gpointer options );
+
+typedef struct {
+  VikTrack *trk;
+  VikTrack *result;
+} BFilterJob;
+
+typedef struct {
+  BFilterTrackFunc func;
+  gpointer options;
+} BFilterCalc;
+
+static void bfilter_track_thread ( BFilterJob *job, BFilterCalc *calc )
+{
+  if ( calc->func )
+    job->result = calc->func ( job->trk, calc->options );
+  else
+    job->result = vik_track_copy ( job->trk, TRUE );
+}
+
+static void bfilter_add_job ( gpointer key, VikTrack *trk, GArray *jobs )
+{
+  BFilterJob job = { trk, NULL };
+  g_array_append_val ( jobs, job );
+}
+
+static gint bfilter_waypoint_compare ( gconstpointer a, gconstpointer b )
+{
+  return g_strcmp0 ( VIK_WAYPOINT(a)->name, VIK_WAYPOINT(b)->name );
+}
+
+/**
+ * Put copies of the layer's items into the new layer
+ * @track_func: To make the filtered version of each track and route in parallel, or NULL for a plain copy
+ * @wp_func:    Whether to keep each waypoint (in name order), or NULL to keep all of them
+ */
+static void bfilter_layer ( VikTrwLayer *vtl, VikTrwLayer *vtl_dest, BFilterTrackFunc track_func, BFilterWaypointFunc wp_func, gpointer options )
+{
+  GArray *jobs = g_array_new ( FALSE, FALSE, sizeof(BFilterJob) );
+  g_hash_table_foreach ( vik_trw_layer_get_tracks(vtl), (GHFunc)bfilter_add_job, jobs );
+  g_hash_table_foreach ( vik_trw_layer_get_routes(vtl), (GHFunc)bfilter_add_job, jobs );
+
+  BFilterCalc calc = { track_func, options };
+  VikTaskGroup *group = a_background_tasks_new ();
+  for ( guint ii = 0; ii < jobs->len; ii++ )
+    a_background_tasks_add ( group, (GFunc)bfilter_track_thread, &g_array_index(jobs, BFilterJob, ii), &calc );
+  (void)a_background_tasks_wait ( group, -1 );
+  a_background_tasks_free ( group );
+
+  for ( guint ii = 0; ii < jobs->len; ii++ ) {
+    VikTrack *result = g_array_index(jobs, BFilterJob, ii).result;
+    if ( result->is_route )
+      vik_trw_layer_add_route ( vtl_dest, NULL, result );
+    else
+      vik_trw_layer_add_track ( vtl_dest, NULL, result );
+  }
+  g_array_free ( jobs, TRUE );
+
+  GList *wps = g_list_sort ( g_hash_table_get_values ( vik_trw_layer_get_waypoints(vtl) ), bfilter_waypoint_compare );
+  for ( GList *gl = wps; gl; gl = g_list_next(gl) ) {
+    VikWaypoint *wp = VIK_WAYPOINT(gl->data);
+    if ( !wp_func || wp_func ( wp, options ) )
+      vik_trw_layer_add_waypoint ( vtl_dest, NULL, vik_waypoint_copy ( wp ) );
+  }
+  g_list_free ( wps );
+}
 
 /************************************ Simplify (Count) *****************************/
 
@@ -57,6 +147,23 @@ static void datasource_bfilter_simplify_get_process_options ( VikLayerParamData
   bfilter_simplify_params_defaults[0].u = paramdatas[0].u;
 }
 
+static VikTrack *bfilter_simplify_track ( const VikTrack *trk, guint *count )
+{
+  return vik_track_copy_reduced ( trk, *count );
+}
+
+static gboolean datasource_bfilter_simplify_filter ( VikLayerParamData *paramdatas, VikTrwLayer *vtl, VikTrack *not_used, VikTrwLayer *vtl_dest )
+{
+  if ( bfilter_use_gpsbabel() )
+    return FALSE;
+  guint count = paramdatas[0].u;
+  bfilter_layer ( vtl, vtl_dest, (BFilterTrackFunc)bfilter_simplify_track, NULL, &count );
+
+  // Store for subsequent default use
+  bfilter_simplify_params_defaults[0].u = paramdatas[0].u;
+  return TRUE;
+}
+
 #define VIK_SETTINGS_BFILTER_SIMPLIFY "bfilter_simplify"
 static gboolean bfilter_simplify_default_set = FALSE;
 
@@ -93,7 +200,8 @@ VikDataSourceInterface vik_datasource_bfilter_simplify_interface = {
   sizeof(bfilter_simplify_params)/sizeof(bfilter_simplify_params[0]),
   bfilter_simplify_params_defaults,
   NULL,
-  0
+  0,
+  (VikDataSourceFilterFunc)            datasource_bfilter_simplify_filter,
 };
 
 /**************************** Compress (Simplify by Error Factor Method) *****************************/
@@ -136,6 +244,27 @@ static void datasource_bfilter_compress_get_process_options ( VikLayerParamData
   bfilter_compress_params_defaults[0].d = paramdatas[0].d;
 }
 
+static VikTrack *bfilter_compress_track ( const VikTrack *trk, gdouble *tolerance )
+{
+  return vik_track_copy_simplified ( trk, *tolerance );
+}
+
+/**
+ * Douglas-Peucker simplification, with the same idea of the error as the GPSBabel crosstrack method
+ */
+static gboolean datasource_bfilter_compress_filter ( VikLayerParamData *paramdatas, VikTrwLayer *vtl, VikTrack *not_used, VikTrwLayer *vtl_dest )
+{
+  if ( bfilter_use_gpsbabel() )
+    return FALSE;
+  // As for GPSBabel, the error is in miles unless using kilometres
+  gdouble tolerance = paramdatas[0].d * (a_vik_get_units_distance() == VIK_UNITS_DISTANCE_KILOMETRES ? 1000.0 : 1609.344);
+  bfilter_layer ( vtl, vtl_dest, (BFilterTrackFunc)bfilter_compress_track, NULL, &tolerance );
+
+  // Store for subsequent default use
+  bfilter_compress_params_defaults[0].d = paramdatas[0].d;
+  return TRUE;
+}
+
 #define VIK_SETTINGS_BFILTER_COMPRESS "bfilter_compress"
 static gboolean bfilter_compress_default_set = FALSE;
 
@@ -175,7 +304,71 @@ VikDataSourceInterface vik_datasource_bfilter_compress_interface = {
   sizeof(bfilter_compress_params)/sizeof(bfilter_compress_params[0]),
   bfilter_compress_params_defaults,
   NULL,
-  0
+  0,
+  (VikDataSourceFilterFunc)            datasource_bfilter_compress_filter,
+};
+
+/************************************ Thin (Distance and Time) *****************************/
+
+static VikLayerParamScale thin_distance_scales[] = { {0, 100000, 1, 0} };
+static VikLayerParamScale thin_time_scales[] = { {0, 86400, 1, 0} };
+
+VikLayerParam bfilter_thin_params[] = {
+  { VIK_LAYER_NUM_TYPES, "thindistance", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Distance (m):"), VIK_LAYER_WIDGET_SPINBUTTON, thin_distance_scales, NULL,
+      N_("Keep a trackpoint once it is at least this far from the last one kept. Zero to not thin by distance."), NULL, NULL, NULL },
+  { VIK_LAYER_NUM_TYPES, "thintime", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Time (s):"), VIK_LAYER_WIDGET_SPINBUTTON, thin_time_scales, NULL,
+      N_("Keep a trackpoint once it is at least this long after the last one kept. Zero to not thin by time."), NULL, NULL, NULL },
+};
+
+VikLayerParamData bfilter_thin_params_defaults[] = {
+  { .u = 10 },
+  { .u = 0 },
+};
+
+typedef struct {
+  gdouble distance;
+  guint seconds;
+} BFilterThinT;
+
+static VikTrack *bfilter_thin_track ( const VikTrack *trk, BFilterThinT *thin )
+{
+  return vik_track_copy_thinned ( trk, thin->distance, thin->seconds );
+}
+
+/**
+ * No GPSBabel equivalent, so always done directly
+ */
+static gboolean datasource_bfilter_thin_filter ( VikLayerParamData *paramdatas, VikTrwLayer *vtl, VikTrack *not_used, VikTrwLayer *vtl_dest )
+{
+  BFilterThinT thin = { paramdatas[0].u, paramdatas[1].u };
+  bfilter_layer ( vtl, vtl_dest, (BFilterTrackFunc)bfilter_thin_track, NULL, &thin );
+
+  // Store for subsequent default use
+  bfilter_thin_params_defaults[0].u = paramdatas[0].u;
+  bfilter_thin_params_defaults[1].u = paramdatas[1].u;
+  return TRUE;
+}
+
+VikDataSourceInterface vik_datasource_bfilter_thin_interface = {
+  N_("Thin Tracks..."),
+  N_("Thinned Tracks"),
+  VIK_DATASOURCE_CREATENEWLAYER,
+  VIK_DATASOURCE_INPUTTYPE_TRWLAYER,
+  TRUE,
+  FALSE, // Close the dialog after successful operation
+  TRUE,
+  NULL, NULL, NULL,
+  NULL,
+  NULL,
+  NULL, NULL, NULL,
+  (VikDataSourceOffFunc) NULL,
+
+  bfilter_thin_params,
+  sizeof(bfilter_thin_params)/sizeof(bfilter_thin_params[0]),
+  bfilter_thin_params_defaults,
+  NULL,
+  0,
+  (VikDataSourceFilterFunc)            datasource_bfilter_thin_filter,
 };
 
 /************************************ Duplicate Location ***********************************/
@@ -187,6 +380,32 @@ static void datasource_bfilter_dup_get_process_options ( VikLayerParamData *para
   po->babel_filters = g_strdup ( "-x duplicate,location" );
 }
 
+static gboolean bfilter_dup_waypoint ( VikWaypoint *wp, GHashTable *seen )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( &wp->coord, &ll );
+  gchar *key = g_strdup_printf ( "%.6f %.6f", ll.lat, ll.lon );
+  if ( g_hash_table_contains ( seen, key ) ) {
+    g_free ( key );
+    return FALSE;
+  }
+  g_hash_table_add ( seen, key );
+  return TRUE;
+}
+
+/**
+ * The first waypoint (by name) at each location is kept
+ */
+static gboolean datasource_bfilter_dup_filter ( gpointer not_used, VikTrwLayer *vtl, VikTrack *not_used2, VikTrwLayer *vtl_dest )
+{
+  if ( bfilter_use_gpsbabel() )
+    return FALSE;
+  GHashTable *seen = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  bfilter_layer ( vtl, vtl_dest, NULL, (BFilterWaypointFunc)bfilter_dup_waypoint, seen );
+  g_hash_table_destroy ( seen );
+  return TRUE;
+}
+
 VikDataSourceInterface vik_datasource_bfilter_dup_interface = {
   N_("Remove Duplicate Waypoints"),
   N_("Remove Duplicate Waypoints"),
@@ -201,7 +420,8 @@ VikDataSourceInterface vik_datasource_bfilter_dup_interface = {
   NULL, NULL, NULL,
   (VikDataSourceOffFunc) NULL,
 
-  NULL, 0, NULL, NULL, 0
+  NULL, 0, NULL, NULL, 0,
+  (VikDataSourceFilterFunc)            datasource_bfilter_dup_filter,
 };
 
 
@@ -246,6 +466,57 @@ VikDataSourceInterface vik_datasource_bfilter_manual_interface = {
 
 /************************************ Polygon ***********************************/
 
+typedef struct {
+  struct LatLon *lls;
+  guint count;
+  gboolean exclude;
+} BFilterPolygonT;
+
+/**
+ * Even-odd rule, with the track being implicitly closed
+ */
+static gboolean bfilter_polygon_waypoint ( VikWaypoint *wp, BFilterPolygonT *poly )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( &wp->coord, &ll );
+  gboolean inside = FALSE;
+  for ( guint ii = 0, jj = poly->count - 1; ii < poly->count; jj = ii++ ) {
+    const struct LatLon *aa = &poly->lls[ii];
+    const struct LatLon *bb = &poly->lls[jj];
+    if ( (aa->lat > ll.lat) != (bb->lat > ll.lat) &&
+         ll.lon < (bb->lon - aa->lon) * (ll.lat - aa->lat) / (bb->lat - aa->lat) + aa->lon )
+      inside = !inside;
+  }
+  return inside != poly->exclude;
+}
+
+static gboolean bfilter_polygon ( VikTrwLayer *vtl, VikTrack *track, VikTrwLayer *vtl_dest, gboolean exclude )
+{
+  if ( bfilter_use_gpsbabel() || !track )
+    return FALSE;
+
+  BFilterPolygonT poly;
+  poly.count = g_list_length ( track->trackpoints );
+  poly.lls = g_new ( struct LatLon, poly.count );
+  poly.exclude = exclude;
+  guint ii = 0;
+  for ( GList *iter = track->trackpoints; iter; iter = iter->next, ii++ )
+    vik_coord_to_latlon ( &(VIK_TRACKPOINT(iter->data)->coord), &poly.lls[ii] );
+
+  // Not an area, so nothing is inside
+  if ( poly.count < 3 )
+    poly.count = 0;
+
+  bfilter_layer ( vtl, vtl_dest, NULL, (BFilterWaypointFunc)bfilter_polygon_waypoint, &poly );
+  g_free ( poly.lls );
+  return TRUE;
+}
+
+static gboolean datasource_bfilter_polygon_filter ( gpointer not_used, VikTrwLayer *vtl, VikTrack *track, VikTrwLayer *vtl_dest )
+{
+  return bfilter_polygon ( vtl, track, vtl_dest, FALSE );
+}
+
 static void datasource_bfilter_polygon_get_process_options ( VikLayerParamData *paramdatas, ProcessOptions *po, gpointer not_used, const gchar *input_filename, const gchar *input_track_filename )
 {
   po->shell_command = g_strdup_printf ( "gpsbabel -i gpx -f %s -o arc -F - | gpsbabel -i gpx -f %s -x polygon,file=- -o gpx -F -", input_track_filename, input_filename );
@@ -270,11 +541,17 @@ VikDataSourceInterface vik_datasource_bfilter_polygon_interface = {
   0,
   NULL,
   NULL,
-  0
+  0,
+  (VikDataSourceFilterFunc)            datasource_bfilter_polygon_filter,
 };
 
 /************************************ Exclude Polygon ***********************************/
 
+static gboolean datasource_bfilter_exclude_polygon_filter ( gpointer not_used, VikTrwLayer *vtl, VikTrack *track, VikTrwLayer *vtl_dest )
+{
+  return bfilter_polygon ( vtl, track, vtl_dest, TRUE );
+}
+
 static void datasource_bfilter_exclude_polygon_get_process_options ( VikLayerParamData *paramdatas, ProcessOptions *po, gpointer not_used, const gchar *input_filename, const gchar *input_track_filename )
 {
   po->shell_command = g_strdup_printf ( "gpsbabel -i gpx -f %s -o arc -F - | gpsbabel -i gpx -f %s -x polygon,exclude,file=- -o gpx -F -", input_track_filename, input_filename );
@@ -299,5 +576,113 @@ VikDataSourceInterface vik_datasource_bfilter_exclude_polygon_interface = {
   0,
   NULL,
   NULL,
-  0
+  0,
+  (VikDataSourceFilterFunc)            datasource_bfilter_exclude_polygon_filter,
+};
+
+/************************************ Arc (Near Track) ***********************************/
+
+static VikLayerParamScale arc_distance_scales[] = { {1, 100000, 10, 0} };
+
+VikLayerParam bfilter_arc_params[] = {
+  { VIK_LAYER_NUM_TYPES, "arcdistance", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Distance (m):"), VIK_LAYER_WIDGET_SPINBUTTON, arc_distance_scales, NULL,
+      N_("Keep waypoints within this distance of the track."), NULL, NULL, NULL },
+};
+
+VikLayerParamData bfilter_arc_params_defaults[] = {
+  { .u = 100 },
+};
+
+typedef struct {
+  struct LatLon *lls;
+  gboolean *gap; // Before each trackpoint
+  guint count;
+  gdouble distance;
+} BFilterArcT;
+
+/**
+ * Within the distance of any part of the track, measured in a local projection about the waypoint
+ */
+static gboolean bfilter_arc_waypoint ( VikWaypoint *wp, BFilterArcT *arc )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( &wp->coord, &ll );
+  const gdouble scale = cos ( DEG2RAD(ll.lat) ) * 111319.49;
+  const gdouble dist_sq = arc->distance * arc->distance;
+  gdouble ax = 0.0, ay = 0.0;
+  for ( guint ii = 0; ii < arc->count; ii++ ) {
+    gdouble bx = (arc->lls[ii].lon - ll.lon) * scale;
+    gdouble by = (arc->lls[ii].lat - ll.lat) * 111319.49;
+    gdouble t = 0.0;
+    if ( ii > 0 && !arc->gap[ii] ) {
+      gdouble dx = bx - ax;
+      gdouble dy = by - ay;
+      gdouble len_sq = dx*dx + dy*dy;
+      if ( len_sq > 0.0 )
+        t = CLAMP ( -(ax*dx + ay*dy) / len_sq, 0.0, 1.0 );
+      gdouble ex = ax + t*dx;
+      gdouble ey = ay + t*dy;
+      if ( ex*ex + ey*ey <= dist_sq )
+        return TRUE;
+    }
+    else if ( bx*bx + by*by <= dist_sq )
+      return TRUE;
+    ax = bx;
+    ay = by;
+  }
+  return FALSE;
+}
+
+static gboolean datasource_bfilter_arc_filter ( VikLayerParamData *paramdatas, VikTrwLayer *vtl, VikTrack *track, VikTrwLayer *vtl_dest )
+{
+  // Store for subsequent default use
+  bfilter_arc_params_defaults[0].u = paramdatas[0].u;
+
+  if ( bfilter_use_gpsbabel() || !track )
+    return FALSE;
+
+  BFilterArcT arc;
+  arc.count = g_list_length ( track->trackpoints );
+  arc.lls = g_new ( struct LatLon, arc.count );
+  arc.gap = g_new ( gboolean, arc.count );
+  arc.distance = paramdatas[0].u;
+  guint ii = 0;
+  for ( GList *iter = track->trackpoints; iter; iter = iter->next, ii++ ) {
+    vik_coord_to_latlon ( &(VIK_TRACKPOINT(iter->data)->coord), &arc.lls[ii] );
+    arc.gap[ii] = VIK_TRACKPOINT(iter->data)->newsegment;
+  }
+
+  bfilter_layer ( vtl, vtl_dest, NULL, (BFilterWaypointFunc)bfilter_arc_waypoint, &arc );
+  g_free ( arc.gap );
+  g_free ( arc.lls );
+  return TRUE;
+}
+
+static void datasource_bfilter_arc_get_process_options ( VikLayerParamData *paramdatas, ProcessOptions *po, gpointer not_used, const gchar *input_filename, const gchar *input_track_filename )
+{
+  po->shell_command = g_strdup_printf ( "gpsbabel -i gpx -f %s -o arc -F - | gpsbabel -i gpx -f %s -x arc,file=-,distance=%.3fk -o gpx -F -",
+                                        input_track_filename, input_filename, paramdatas[0].u / 1000.0 );
+}
+/* TODO: shell_escape stuff */
+
+VikDataSourceInterface vik_datasource_bfilter_arc_interface = {
+  N_("Waypoints Near This..."),
+  N_("Waypoints Near Track"),
+  VIK_DATASOURCE_CREATENEWLAYER,
+  VIK_DATASOURCE_INPUTTYPE_TRWLAYER_TRACK,
+  TRUE,
+  FALSE, /* keep dialog open after success */
+  TRUE,
+  NULL, NULL, NULL,
+  (VikDataSourceGetProcessOptionsFunc) datasource_bfilter_arc_get_process_options,
+  (VikDataSourceProcessFunc)           a_babel_convert_from,
+  NULL, NULL, NULL,
+  (VikDataSourceOffFunc) NULL,
+
+  bfilter_arc_params,
+  sizeof(bfilter_arc_params)/sizeof(bfilter_arc_params[0]),
+  bfilter_arc_params_defaults,
+  NULL,
+  0,
+  (VikDataSourceFilterFunc)            datasource_bfilter_arc_filter,
 };
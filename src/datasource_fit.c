@@ -0,0 +1,155 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#include <glib/gstdio.h>
+#include "viking.h"
+#include "acquire.h"
+#include "babel.h"
+#include "fit.h"
+
+typedef struct {
+  GtkWidget *files;
+  GSList *filelist;  // Files selected
+} datasource_fit_user_data_t;
+
+// The last used directory
+static gchar *last_folder_uri = NULL;
+
+static gpointer datasource_fit_init ( acq_vik_t *avt );
+static void datasource_fit_add_setup_widgets ( GtkWidget *dialog, VikViewport *vvp, gpointer user_data );
+static void datasource_fit_get_process_options ( datasource_fit_user_data_t *user_data, ProcessOptions *po, gpointer not_used, const gchar *not_used2, const gchar *not_used3 );
+static gboolean datasource_fit_process ( VikTrwLayer *vtl, ProcessOptions *process_options, BabelStatusFunc status_cb, acq_dialog_widgets_t *adw, DownloadFileOptions *options_unused );
+static void datasource_fit_cleanup ( gpointer data );
+
+VikDataSourceInterface vik_datasource_fit_interface = {
+  N_("Import FIT Files"),
+  N_("FIT"),
+  VIK_DATASOURCE_AUTO_LAYER_MANAGEMENT,
+  VIK_DATASOURCE_INPUTTYPE_NONE,
+  TRUE,
+  FALSE, // We should be able to see the data on the screen so no point in keeping the dialog open
+  TRUE,  // Thread method - decoding many files can take a while
+  (VikDataSourceInitFunc)               datasource_fit_init,
+  (VikDataSourceCheckExistenceFunc)     NULL,
+  (VikDataSourceAddSetupWidgetsFunc)    datasource_fit_add_setup_widgets,
+  (VikDataSourceGetProcessOptionsFunc)  datasource_fit_get_process_options,
+  (VikDataSourceProcessFunc)            datasource_fit_process,
+  (VikDataSourceProgressFunc)           NULL,
+  (VikDataSourceAddProgressWidgetsFunc) NULL,
+  (VikDataSourceCleanupFunc)            datasource_fit_cleanup,
+  (VikDataSourceOffFunc)                NULL,
+  NULL,
+  0,
+  NULL,
+  NULL,
+  0
+};
+
+static gpointer datasource_fit_init ( acq_vik_t *avt )
+{
+  datasource_fit_user_data_t *user_data = g_malloc(sizeof(datasource_fit_user_data_t));
+  user_data->filelist = NULL;
+  return user_data;
+}
+
+static void datasource_fit_add_setup_widgets ( GtkWidget *dialog, VikViewport *vvp, gpointer user_data )
+{
+  datasource_fit_user_data_t *ud = (datasource_fit_user_data_t *)user_data;
+
+  ud->files = gtk_file_chooser_widget_new ( GTK_FILE_CHOOSER_ACTION_OPEN );
+
+  // try to make it a nice size - otherwise seems to default to something impractically small
+  gtk_window_set_default_size ( GTK_WINDOW (dialog) , 600, 300 );
+
+  if ( last_folder_uri )
+    gtk_file_chooser_set_current_folder_uri ( GTK_FILE_CHOOSER(ud->files), last_folder_uri );
+
+  GtkFileChooser *chooser = GTK_FILE_CHOOSER ( ud->files );
+
+  // Add filters
+  GtkFileFilter *filter;
+  filter = gtk_file_filter_new ();
+  gtk_file_filter_set_name ( filter, _("All") );
+  gtk_file_filter_add_pattern ( filter, "*" );
+  gtk_file_chooser_add_filter ( chooser, filter );
+
+  filter = gtk_file_filter_new ();
+  gtk_file_filter_set_name ( filter, _("FIT") );
+  gtk_file_filter_add_pattern ( filter, "*.fit" );
+  gtk_file_filter_add_pattern ( filter, "*.FIT" );
+  gtk_file_chooser_add_filter ( chooser, filter );
+
+  // Default to fit
+  gtk_file_chooser_set_filter ( chooser, filter );
+
+  // Allow selecting more than one - e.g. a whole activity folder from a watch
+  gtk_file_chooser_set_select_multiple ( chooser, TRUE );
+
+  // Packing all widgets
+  GtkBox *box = GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(dialog)));
+  gtk_box_pack_start ( box, ud->files, TRUE, TRUE, 0 );
+
+  gtk_widget_show_all ( dialog );
+}
+
+static void datasource_fit_get_process_options ( datasource_fit_user_data_t *userdata, ProcessOptions *po, gpointer not_used, const gchar *not_used2, const gchar *not_used3 )
+{
+  // Retrieve the files selected
+  userdata->filelist = gtk_file_chooser_get_filenames ( GTK_FILE_CHOOSER(userdata->files) ); // Not reusable !!
+
+  // Memorize the directory for later reuse
+  g_free ( last_folder_uri );
+  last_folder_uri = gtk_file_chooser_get_current_folder_uri ( GTK_FILE_CHOOSER(userdata->files) );
+
+  // return some value so *thread* processing will continue
+  po->babelargs = g_strdup ("fake command"); // Not really used, thus no translations
+}
+
+/**
+ * Decode the selected files directly into the given vtl, one track per file
+ */
+static gboolean datasource_fit_process ( VikTrwLayer *vtl, ProcessOptions *process_options, BabelStatusFunc status_cb, acq_dialog_widgets_t *adw, DownloadFileOptions *options_unused )
+{
+  datasource_fit_user_data_t *user_data = (datasource_fit_user_data_t *)adw->user_data;
+  guint failures = 0;
+
+  for ( GSList *cur_file = user_data->filelist; cur_file; cur_file = g_slist_next ( cur_file ) ) {
+    const gchar *filename = cur_file->data;
+
+    // Allows the import to be cancelled between files
+    status_cb ( BABEL_DIAG_OUTPUT, NULL, adw );
+
+    FILE *ff = g_fopen ( filename, "rb" );
+    if ( !ff || !a_fit_read_file ( vtl, ff, a_file_basename ( filename ) ) ) {
+      g_warning ( "%s: Unable to import from: %s", __FUNCTION__, filename );
+      failures++;
+    }
+    if ( ff )
+      fclose ( ff );
+  }
+
+  // Only a failure if nothing could be read
+  return failures < g_slist_length ( user_data->filelist );
+}
+
+static void datasource_fit_cleanup ( gpointer data )
+{
+  datasource_fit_user_data_t *user_data = (datasource_fit_user_data_t *)data;
+  g_slist_free_full ( user_data->filelist, g_free );
+  g_free ( user_data );
+}
@@ -22,6 +22,7 @@
 #include "viking.h"
 #include "acquire.h"
 #include "geotag_exif.h"
+#include "geotagindex.h"
 
 typedef struct {
 	GtkWidget *files;
@@ -141,12 +142,19 @@ static gboolean datasource_geotag_process ( VikTrwLayer *vtl, ProcessOptions *po
 	datasource_geotag_user_data_t *user_data = (datasource_geotag_user_data_t *)adw->user_data;
 
 	// Process selected files
-	// In prinicple this loading should be quite fast and so don't need to have any progress monitoring
-	GSList *cur_file = user_data->filelist;
-	while ( cur_file ) {
-		gchar *filename = cur_file->data;
+	// The images are read in parallel, unless already known from a previous import
+	guint count = g_slist_length ( user_data->filelist );
+	const gchar **filenames = g_malloc ( sizeof(gchar*) * count );
+	geotag_info_t *infos = g_malloc ( sizeof(geotag_info_t) * count );
+	guint ii = 0;
+	for ( GSList *cur_file = user_data->filelist; cur_file; cur_file = g_slist_next ( cur_file ) )
+		filenames[ii++] = cur_file->data;
+	a_geotag_index_get_many ( filenames, count, infos );
+
+	for ( ii = 0; ii < count; ii++ ) {
+		gchar *filename = (gchar*)filenames[ii];
 		gchar *name;
-		VikWaypoint *wp = a_geotag_create_waypoint_from_file ( filename, vik_viewport_get_coord_mode ( adw->vvp ), &name );
+		VikWaypoint *wp = a_geotag_create_waypoint_from_info ( filename, &infos[ii], vik_viewport_get_coord_mode ( adw->vvp ), &name );
 		if ( wp ) {
 			// Create name if geotag method didn't return one
 			if ( !name )
@@ -159,9 +167,11 @@ static gboolean datasource_geotag_process ( VikTrwLayer *vtl, ProcessOptions *po
 			vik_window_statusbar_update ( adw->vw, msg, VIK_STATUSBAR_INFO );
 			g_free (msg);
 		}
+		a_geotag_info_clear ( &infos[ii] );
 		g_free ( filename );
-		cur_file = g_slist_next ( cur_file );
 	}
+	g_free ( infos );
+	g_free ( filenames );
 
 	/* Free memory */
 	g_slist_free ( user_data->filelist );
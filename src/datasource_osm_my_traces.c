@@ -27,12 +27,18 @@
 #include "osm-traces.h"
 #include "datasource_gps.h"
 #include "bbox.h"
+#include "curl_download.h"
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 
 /**
  * See http://wiki.openstreetmap.org/wiki/API_v0.6#GPS_Traces
  */
 #define DS_OSM_TRACES_GPX_URL_FMT "https://api.openstreetmap.org/api/0.6/gpx/%d/data"
 #define DS_OSM_TRACES_GPX_FILES "https://api.openstreetmap.org/api/0.6/user/gpx_files"
+// Number of traces downloaded at once
+#define DS_OSM_TRACES_MAX_DOWNLOADS 6
 
 typedef struct {
 	GtkWidget *user_entry;
@@ -334,32 +340,19 @@ static void gpx_meta_data_cdata ( xml_data *xd, const XML_Char *s, int len )
 	}
 }
 
-static gboolean read_gpx_files_metadata_xml ( gchar *tmpname, xml_data *xd )
+static gboolean read_gpx_files_metadata_xml ( const gchar *data, gsize len, xml_data *xd )
 {
-	FILE *ff = g_fopen (tmpname, "r");
-	if ( !ff )
-		return FALSE;
-
 	XML_Parser parser = XML_ParserCreate(NULL);
-	enum XML_Status status = XML_STATUS_ERROR;
 
 	XML_SetElementHandler(parser, (XML_StartElementHandler) gpx_meta_data_start, (XML_EndElementHandler) gpx_meta_data_end);
 	XML_SetUserData(parser, xd);
 	XML_SetCharacterDataHandler(parser, (XML_CharacterDataHandler) gpx_meta_data_cdata);
 
-	gchar buf[4096];
-
-	int done=0, len;
-	while (!done) {
-		len = fread(buf, 1, sizeof(buf)-7, ff);
-		done = feof(ff) || !len;
-		status = XML_Parse(parser, buf, len, done);
-	}
+	// The whole listing is already in memory, so parse it in one go
+	enum XML_Status status = XML_Parse(parser, data, len, TRUE);
 
 	XML_ParserFree (parser);
 
-	fclose  ( ff );
-
 	return status != XML_STATUS_ERROR;
 }
 
@@ -543,6 +536,108 @@ static void set_in_current_view_property ( VikTrwLayer *vtl, datasource_osm_my_t
 	}
 }
 
+typedef struct {
+	acq_dialog_widgets_t *adw;
+	VikTrwLayer *vtl_last; // Only update the screen on the last layer acquired
+	gboolean got_something;
+	guint total;
+	guint done;
+} traces_download_t;
+
+typedef struct {
+	traces_download_t *tsd;
+	VikTrwLayer *vtl;
+	gboolean created;      // Whether the layer is specifically for this trace
+	gchar *url;
+	GpxReader *gr;         // Plain GPX is read as it arrives
+	FILE *ff;              // Otherwise (i.e. compressed) the data is saved to a file first
+	gchar *tmpname;
+} trace_download_t;
+
+static gboolean trace_download_data ( const gchar *data, gsize len, trace_download_t *td )
+{
+	if ( !td->gr && !td->ff ) {
+		// Uploaded traces are returned in their original form, which may be compressed
+		if ( len && (data[0] == '<' || (guchar)data[0] == 0xEF) ) // i.e. XML, maybe with a UTF-8 BOM
+			td->gr = a_gpx_read_begin ( td->vtl, NULL, FALSE );
+		else {
+			gint fd = g_file_open_tmp ( "tmp-viking.XXXXXX", &td->tmpname, NULL );
+			if ( fd < 0 )
+				return FALSE;
+			close ( fd );
+			td->ff = g_fopen ( td->tmpname, "wb" );
+			if ( !td->ff )
+				return FALSE;
+		}
+	}
+	if ( td->gr )
+		return a_gpx_read_data ( td->gr, data, len );
+	return fwrite ( data, 1, len, td->ff ) == len;
+}
+
+/**
+ * Use the trace as soon as it has been read, rather than waiting for the others
+ */
+static gboolean trace_download_done ( CURL_download_t result, trace_download_t *td )
+{
+	traces_download_t *tsd = td->tsd;
+	gboolean ok = FALSE;
+	if ( td->gr )
+		ok = a_gpx_read_end ( td->gr );
+	if ( td->ff ) {
+		fclose ( td->ff );
+		if ( result == CURL_DOWNLOAD_NO_ERROR ) {
+			// Support .zip + bzip2 files directly
+			a_try_decompress_file ( td->tmpname );
+			FILE *ff = g_fopen ( td->tmpname, "r" );
+			if ( ff ) {
+				ok = a_gpx_read_file ( td->vtl, ff, NULL, FALSE );
+				fclose ( ff );
+			}
+		}
+	}
+	if ( td->tmpname ) {
+		(void)util_remove ( td->tmpname );
+		g_free ( td->tmpname );
+	}
+	ok = ok && result == CURL_DOWNLOAD_NO_ERROR;
+
+	tsd->got_something = tsd->got_something || ok;
+	if ( ok ) {
+		// Can use the layer
+		vik_aggregate_layer_add_layer ( vik_layers_panel_get_top_layer (tsd->adw->vlp), VIK_LAYER(td->vtl), TRUE );
+		// Move to area of the track
+		vik_layer_post_read ( VIK_LAYER(td->vtl), vik_window_viewport(tsd->adw->vw), TRUE );
+		vik_trw_layer_auto_set_view ( td->vtl, vik_window_viewport(tsd->adw->vw) );
+		tsd->vtl_last = td->vtl;
+	}
+	else {
+		// Report errors to the status bar
+		gchar* msg = g_strdup_printf ( _("Unable to get trace: %s"), td->url );
+		vik_window_statusbar_update ( tsd->adw->vw, msg, VIK_STATUSBAR_INFO );
+		g_free (msg);
+		if ( td->created )
+			// Layer not needed as no data has been acquired
+			g_object_unref ( td->vtl );
+	}
+
+	// Show progress (unless an error is being shown)
+	tsd->done++;
+	if ( !vik_datasource_osm_my_traces_interface.is_thread ) {
+		if ( ok ) {
+			gchar *msg = g_strdup_printf ( _("Downloaded %d of %d OSM traces"), tsd->done, tsd->total );
+			vik_window_statusbar_update ( tsd->adw->vw, msg, VIK_STATUSBAR_INFO );
+			g_free ( msg );
+		}
+		while ( gtk_events_pending() )
+			gtk_main_iteration ();
+	}
+
+	g_free ( td->url );
+	g_free ( td );
+	return TRUE;
+}
+
 static gboolean datasource_osm_my_traces_process ( VikTrwLayer *vtl, ProcessOptions *process_options, BabelStatusFunc status_cb, acq_dialog_widgets_t *adw, DownloadFileOptions *options_unused )
 {
 	gboolean result;
@@ -564,13 +659,15 @@ static gboolean datasource_osm_my_traces_process ( VikTrwLayer *vtl, ProcessOpti
 	}
 #endif
 
-	// Support .zip + bzip2 files directly
-	DownloadFileOptions options = { FALSE, FALSE, NULL, 2, NULL, NULL, user_pass, a_try_decompress_file }; // Allow a couple of redirects
+	DownloadFileOptions options = { FALSE, FALSE, NULL, 2, NULL, NULL, user_pass, NULL }; // Allow a couple of redirects
 
-	gchar *tmpname = a_download_uri_to_tmp_file ( uri, &options );
+	gsize len = 0;
+	gchar *listing = curl_download_get_data ( uri, &options, &len );
 	g_free ( uri );
-    if ( !tmpname )
+	if ( !listing ) {
+		g_free ( user_pass );
 		return FALSE;
+	}
 
 	xml_data *xd = g_malloc ( sizeof (xml_data) );
 	//xd->xpath = g_string_new ( "" );
@@ -579,14 +676,8 @@ static gboolean datasource_osm_my_traces_process ( VikTrwLayer *vtl, ProcessOpti
 	xd->current_gpx_meta_data = new_gpx_meta_data_t();
 	xd->list_of_gpx_meta_data = NULL;
 
-	result = read_gpx_files_metadata_xml ( tmpname, xd );
-	// Test already downloaded metadata file: eg:
-	//result = read_gpx_files_metadata_xml ( "/tmp/viking-download.GI47PW", xd );
-
-	if ( tmpname ) {
-		(void)util_remove ( tmpname );
-		g_free ( tmpname );
-	}
+	result = read_gpx_files_metadata_xml ( listing, len, xd );
+	g_free ( listing );
 
 	if ( ! result ) {
 		g_free ( xd );
@@ -619,66 +710,60 @@ static gboolean datasource_osm_my_traces_process ( VikTrwLayer *vtl, ProcessOpti
 
 	gboolean create_new_layer = ( !vtl );
 
-	// Only update the screen on the last layer acquired
-	VikTrwLayer *vtl_last = vtl;
-	gboolean got_something = FALSE;
+	traces_download_t tsd = { adw, vtl, FALSE, g_list_length ( selected ), 0 };
+
+	// Fetch several traces at once over shared connections,
+	//  with each one read and added as it arrives
+	CurlMultiDownload *cmd = curl_download_multi_new ();
+	gint res = cmd ? 0 : -1;
 
 	GList *selected_iterator = selected;
-	while ( selected_iterator ) {
+	while ( selected_iterator && !res ) {
+		gpx_meta_data_t *gmd = (gpx_meta_data_t*)selected_iterator->data;
+		selected_iterator = g_list_next ( selected_iterator );
+		if ( !gmd->id ) {
+			tsd.done++;
+			continue;
+		}
 
-		VikTrwLayer *vtlX = vtl;
+		trace_download_t *td = g_malloc0 ( sizeof(trace_download_t) );
+		td->tsd = &tsd;
+		td->vtl = vtl;
+		td->url = g_strdup_printf ( DS_OSM_TRACES_GPX_URL_FMT, gmd->id );
 
 		if ( create_new_layer ) {
 			// Have data but no layer - so create one
-			vtlX = VIK_TRW_LAYER ( vik_layer_create ( VIK_LAYER_TRW, adw->vvp, FALSE ) );
-			if ( ((gpx_meta_data_t*)selected_iterator->data)->name )
-				vik_layer_rename ( VIK_LAYER ( vtlX ), ((gpx_meta_data_t*)selected_iterator->data)->name );
+			td->vtl = VIK_TRW_LAYER ( vik_layer_create ( VIK_LAYER_TRW, adw->vvp, FALSE ) );
+			td->created = TRUE;
+			if ( gmd->name )
+				vik_layer_rename ( VIK_LAYER ( td->vtl ), gmd->name );
 			else
-				vik_layer_rename ( VIK_LAYER ( vtlX ), _("My OSM Traces") );
+				vik_layer_rename ( VIK_LAYER ( td->vtl ), _("My OSM Traces") );
 		}
 
-		result = FALSE;
-		gint gpx_id = ((gpx_meta_data_t*)selected_iterator->data)->id;
-		if ( gpx_id ) {
-			gchar *url = g_strdup_printf ( DS_OSM_TRACES_GPX_URL_FMT, gpx_id );
-
-			// NB download type is GPX (or a compressed version)
-			ProcessOptions my_po = *process_options;
+		// NB download type is GPX (or a compressed version)
 #ifdef HAVE_OAUTH_H
-			my_po.url = osm_oauth_sign_url ( url, NULL );
+		gchar *signed_url = osm_oauth_sign_url ( td->url, NULL );
+		gboolean queued = curl_download_multi_add_func ( cmd, signed_url ? signed_url : td->url, &options, (CurlDataFunc)trace_download_data, (CurlMultiDoneFunc)trace_download_done, td );
+		g_free ( signed_url );
 #else
-			my_po.url = url;
+		gboolean queued = curl_download_multi_add_func ( cmd, td->url, &options, (CurlDataFunc)trace_download_data, (CurlMultiDoneFunc)trace_download_done, td );
 #endif
-			result = a_babel_convert_from ( vtlX, &my_po, status_cb, adw, &options );
-			// TODO investigate using a progress bar:
-			// http://developer.gnome.org/gtk/2.24/GtkProgressBar.html
-
-			got_something = got_something || result;
-			if ( !result ) {
-				// Report errors to the status bar
-				gchar* msg = g_strdup_printf ( _("Unable to get trace: %s"), url );
-				vik_window_statusbar_update ( adw->vw, msg, VIK_STATUSBAR_INFO );
-				g_free (msg);
-			}
-			g_free ( url );
-		}
-
-		if ( result ) {
-			// Can use the layer
-			vik_aggregate_layer_add_layer ( vik_layers_panel_get_top_layer (adw->vlp), VIK_LAYER(vtlX), TRUE );
-			// Move to area of the track
-			vik_layer_post_read ( VIK_LAYER(vtlX), vik_window_viewport(adw->vw), TRUE );
-			vik_trw_layer_auto_set_view ( vtlX, vik_window_viewport(adw->vw) );
-			vtl_last = vtlX;
-		}
-		else if ( create_new_layer ) {
-			// Layer not needed as no data has been acquired
-			g_object_unref ( vtlX );
-		}
-
-		selected_iterator = g_list_next ( selected_iterator );
+		if ( queued )
+			// Keep the queue topped up, only waiting for transfers when it is full
+			res = curl_download_multi_perform ( cmd, DS_OSM_TRACES_MAX_DOWNLOADS - 1 );
+		else
+			(void)trace_download_done ( CURL_DOWNLOAD_ERROR, td );
+	}
+	if ( cmd ) {
+		if ( !res )
+			(void)curl_download_multi_perform ( cmd, 0 );
+		curl_download_multi_free ( cmd );
 	}
 
+	VikTrwLayer *vtl_last = tsd.vtl_last;
+	gboolean got_something = tsd.got_something;
+
 	// Free memory
 	if ( xd->current_gpx_meta_data )
 		free_gpx_meta_data ( xd->current_gpx_meta_data, NULL );
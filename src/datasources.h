@@ -27,6 +27,7 @@ G_BEGIN_DECLS
 
 extern VikDataSourceInterface vik_datasource_gps_interface;
 extern VikDataSourceInterface vik_datasource_file_interface;
+extern VikDataSourceInterface vik_datasource_fit_interface;
 extern VikDataSourceInterface vik_datasource_routing_interface;
 #ifdef VIK_CONFIG_OPENSTREETMAP
 extern VikDataSourceInterface vik_datasource_osm_interface;
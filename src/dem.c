@@ -50,80 +50,104 @@
 #include "fileutils.h"
 
 #define DEM_BLOCK_SIZE 1024
+// Number of columns of a mapped SRTM file decoded together
+#define DEM_DECODE_COLUMNS 64
+
+G_LOCK_DEFINE_STATIC(dem_decode);
 #define GET_COLUMN(dem,n) ((VikDEMColumn *)g_ptr_array_index( (dem)->columns, (n) ))
 
-static gboolean get_double_and_continue ( gchar **buffer, gdouble *tmp, gboolean warn )
+/*
+ * USGS DEM files are read in a single pass over the mapped file.
+ * The elevations are all integers, so are converted directly rather than each going via strtol().
+ * Each profile (Class B record) starts on a new block, with any space after its last point left blank.
+ */
+typedef struct {
+  const gchar *start;
+  const gchar *pos;
+  const gchar *end;
+} DemReader;
+
+static inline void dem_skip_space ( DemReader *rd )
 {
-  gchar *endptr;
-  *tmp = g_strtod(*buffer, &endptr);
-  if ( endptr == NULL|| endptr == *buffer ) {
-    if ( warn )
-      g_warning(_("Invalid DEM"));
-    return FALSE;
+  while ( rd->pos < rd->end && g_ascii_isspace(*rd->pos) )
+    rd->pos++;
+}
+
+static gboolean dem_read_int ( DemReader *rd, gint *val )
+{
+  dem_skip_space ( rd );
+  const gchar *pp = rd->pos;
+  gboolean negative = FALSE;
+  if ( pp < rd->end && (*pp == '-' || *pp == '+') ) {
+    negative = (*pp == '-');
+    pp++;
   }
-  *buffer=endptr;
+  if ( pp >= rd->end || !g_ascii_isdigit(*pp) )
+    return FALSE;
+  gint ans = 0;
+  while ( pp < rd->end && g_ascii_isdigit(*pp) )
+    ans = ans*10 + (*pp++ - '0');
+  *val = negative ? -ans : ans;
+  rd->pos = pp;
   return TRUE;
 }
 
-
-static gboolean get_int_and_continue ( gchar **buffer, gint *tmp, gboolean warn )
+static gboolean dem_read_double ( DemReader *rd, gdouble *val )
 {
+  gchar token[G_ASCII_DTOSTR_BUF_SIZE];
+  guint len = 0;
+  dem_skip_space ( rd );
+  // Values may follow on without a space, so only what converts is used
+  for ( const gchar *pp = rd->pos; pp < rd->end && !g_ascii_isspace(*pp) && len < sizeof(token)-1; pp++ )
+    /* fix Fortran-style exponentiation 1.0D5 -> 1.0E5 */
+    token[len++] = (*pp == 'D') ? 'E' : *pp;
+  token[len] = '\0';
+
   gchar *endptr;
-  *tmp = strtol(*buffer, &endptr, 10);
-  if ( endptr == NULL|| endptr == *buffer ) {
-    if ( warn )
-      g_warning(_("Invalid DEM"));
+  *val = g_ascii_strtod ( token, &endptr );
+  if ( endptr == token )
     return FALSE;
-  }
-  *buffer=endptr;
+  rd->pos += endptr - token;
   return TRUE;
 }
 
-static gboolean dem_parse_header ( gchar *buffer, VikDEM *dem )
+static gboolean dem_parse_header ( DemReader *rd, VikDEM *dem )
 {
   gdouble val;
-  gint int_val;
+  gint int_val = 0;
   guint i;
-  gchar *tmp = buffer;
 
   /* incomplete header */
-  if ( strlen(buffer) != 1024 )
+  if ( rd->end - rd->start < DEM_BLOCK_SIZE )
     return FALSE;
 
-  /* fix Fortran-style exponentiation 1.0D5 -> 1.0E5 */
-  while (*tmp) {
-    if ( *tmp=='D')
-      *tmp='E';
-    tmp++;
-  }
-
   /* skip name */
-  buffer += 149;
+  rd->pos = rd->start + 149;
 
   /* "DEM level code, pattern code, palaimetric reference system code" -- skip */
-  get_int_and_continue(&buffer, &int_val, TRUE);
-  get_int_and_continue(&buffer, &int_val, TRUE);
-  get_int_and_continue(&buffer, &int_val, TRUE);
+  dem_read_int ( rd, &int_val );
+  dem_read_int ( rd, &int_val );
+  dem_read_int ( rd, &int_val );
 
   /* zone */
-  get_int_and_continue(&buffer, &int_val, TRUE);
+  if ( !dem_read_int ( rd, &int_val ) )
+    g_warning(_("Invalid DEM"));
   dem->utm_zone = int_val;
   /* TODO -- southern or northern hemisphere?! */
   dem->utm_letter = 'N';
 
-  /* skip numbers 5-19  */
-  for ( i = 0; i < 15; i++ ) {
-    if ( ! get_double_and_continue(&buffer, &val, FALSE) ) {
+  /* skip numbers 5-19, then 20 -- horizontal unit code (utm/ll), the vertical unit code
+     and the next, then the four corner points */
+  gdouble vals[26];
+  for ( i = 0; i < G_N_ELEMENTS(vals); i++ ) {
+    if ( ! dem_read_double ( rd, &vals[i] ) ) {
       g_warning (_("Invalid DEM header"));
       return FALSE;
     }
   }
 
-  /* number 20 -- horizontal unit code (utm/ll) */
-  get_double_and_continue(&buffer, &val, TRUE);
-  dem->horiz_units = val;
-  get_double_and_continue(&buffer, &val, TRUE);
-  /* dem->orig_vert_units = val; now done below */
+  dem->horiz_units = vals[15];
+  /* dem->orig_vert_units = vals[16]; now done below */
 
   /* TODO: do this for real. these are only for 1:24k and 1:250k USGS */
   if ( dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
@@ -136,20 +160,14 @@ static gboolean dem_parse_header ( gchar *buffer, VikDEM *dem )
     dem->orig_vert_units = VIK_DEM_VERT_METERS;
   }
 
-  /* skip next */
-  get_double_and_continue(&buffer, &val, TRUE);
-
   /* now we get the four corner points. record the min and max. */
-  get_double_and_continue(&buffer, &val, TRUE);
-  dem->min_east = dem->max_east = val;
-  get_double_and_continue(&buffer, &val, TRUE);
-  dem->min_north = dem->max_north = val;
-
+  dem->min_east = dem->max_east = vals[18];
+  dem->min_north = dem->max_north = vals[19];
   for ( i = 0; i < 3; i++ ) {
-    get_double_and_continue(&buffer, &val, TRUE);
+    val = vals[20+i*2];
     if ( val < dem->min_east ) dem->min_east = val;
     if ( val > dem->max_east ) dem->max_east = val;
-    get_double_and_continue(&buffer, &val, TRUE);
+    val = vals[21+i*2];
     if ( val < dem->min_north ) dem->min_north = val;
     if ( val > dem->max_north ) dem->max_north = val;
   }
@@ -157,94 +175,364 @@ static gboolean dem_parse_header ( gchar *buffer, VikDEM *dem )
   return TRUE;
 }
 
-static void dem_parse_block_as_cont ( gchar *buffer, VikDEM *dem, gint *cur_column, gint *cur_row )
-{
-  gint tmp;
-  while ( *cur_row < GET_COLUMN(dem, *cur_column)->n_points ) {
-    if ( get_int_and_continue(&buffer, &tmp,FALSE) ) {
-      if ( dem->orig_vert_units == VIK_DEM_VERT_DECIMETERS )
-        GET_COLUMN(dem, *cur_column)->points[*cur_row] = (gint16) (tmp / 10);
-      else
-        GET_COLUMN(dem, *cur_column)->points[*cur_row] = (gint16) tmp;
-    } else
-      return;
-    (*cur_row)++;
-  }
-  *cur_row = -1; /* expecting new column */
-}
-
-static void dem_parse_block_as_header ( gchar *buffer, VikDEM *dem, gint *cur_column, gint *cur_row )
+/**
+ * Read the profile starting at the current block, appending its points
+ *  (after blanks for those south of the DEM's area that are skipped)
+ *
+ * Returns: FALSE if this is not a profile
+ */
+static gboolean dem_parse_profile ( DemReader *rd, VikDEM *dem, GArray *points, GArray *offsets )
 {
-  guint n_rows;
-  gint i;
-  gdouble east_west, south;
-  gdouble tmp;
+  gdouble tmp, east_west, south;
+  guint n_rows, i;
 
   /* 1 x n_rows 1 east_west south x x x DATA */
 
-  if ( (!get_double_and_continue(&buffer, &tmp, TRUE)) || tmp != 1 ) {
+  if ( !dem_read_double ( rd, &tmp ) || tmp != 1 ) {
     g_warning(_("Incorrect DEM Class B record: expected 1"));
-    return;
+    return FALSE;
   }
 
   /* don't need this */
-  if ( !get_double_and_continue(&buffer, &tmp, TRUE ) ) return;
+  if ( !dem_read_double ( rd, &tmp ) ) return FALSE;
 
-  /* n_rows */
-  if ( !get_double_and_continue(&buffer, &tmp, TRUE ) )
-    return;
+  /* n_rows - which must fit in the rest of the file */
+  if ( !dem_read_double ( rd, &tmp ) || tmp < 0 || tmp > rd->end - rd->pos )
+    return FALSE;
   n_rows = (guint) tmp;
 
-  if ( (!get_double_and_continue(&buffer, &tmp, TRUE)) || tmp != 1 ) {
+  if ( !dem_read_double ( rd, &tmp ) || tmp != 1 ) {
     g_warning(_("Incorrect DEM Class B record: expected 1"));
-    return;
+    return FALSE;
   }
-  
-  if ( !get_double_and_continue(&buffer, &east_west, TRUE) )
-    return;
-  if ( !get_double_and_continue(&buffer, &south, TRUE) )
-    return;
+
+  if ( !dem_read_double ( rd, &east_west ) )
+    return FALSE;
+  if ( !dem_read_double ( rd, &south ) )
+    return FALSE;
 
   /* next three things we don't need */
-  if ( !get_double_and_continue(&buffer, &tmp, TRUE)) return;
-  if ( !get_double_and_continue(&buffer, &tmp, TRUE)) return;
-  if ( !get_double_and_continue(&buffer, &tmp, TRUE)) return;
+  for ( i = 0; i < 3; i++ )
+    if ( !dem_read_double ( rd, &tmp ) ) return FALSE;
 
+  /* empty spaces for things before that were skipped */
+  gint cur_row = (south - dem->min_north) / dem->north_scale;
+  if ( south > dem->max_north || cur_row < 0 )
+    cur_row = 0;
+
+  VikDEMColumn *column = g_malloc(sizeof(VikDEMColumn));
+  column->east_west = east_west;
+  column->south = south;
+  column->n_points = cur_row + n_rows;
+  column->points = NULL; // Set once all are read
+  g_ptr_array_add ( dem->columns, column );
+  dem->n_columns++;
+
+  guint offset = points->len;
+  g_array_append_val ( offsets, offset );
+  g_array_set_size ( points, offset + column->n_points );
+  gint16 *point = &g_array_index ( points, gint16, offset );
 
-  dem->n_columns ++;
-  (*cur_column) ++;
+  /* no information for things before that */
+  for ( i = 0; i < (guint)cur_row; i++ )
+    *point++ = VIK_DEM_INVALID_ELEVATION;
+
+  const gboolean decimeters = ( dem->orig_vert_units == VIK_DEM_VERT_DECIMETERS );
+  for ( i = 0; i < n_rows; i++ ) {
+    gint val;
+    if ( !dem_read_int ( rd, &val ) )
+      break;
+    *point++ = decimeters ? (gint16)(val / 10) : (gint16)val;
+  }
+  /* truncated */
+  for ( ; i < n_rows; i++ )
+    *point++ = VIK_DEM_INVALID_ELEVATION;
 
-  /* empty spaces for things before that were skipped */
-  (*cur_row) = (south - dem->min_north) / dem->north_scale;
-  if ( south > dem->max_north || (*cur_row) < 0 )
-    (*cur_row) = 0;
+  return TRUE;
+}
 
-  n_rows += *cur_row;
+/**
+ * Put all the points into one grid, with every column having the same number of points,
+ *  so they can be accessed directly
+ */
+static void dem_make_grid ( VikDEM *dem, GArray *points, GArray *offsets )
+{
+  guint i, rows = 0;
+  gboolean same = TRUE;
+  for ( i = 0; i < dem->n_columns; i++ ) {
+    if ( i > 0 && GET_COLUMN(dem, i)->n_points != rows )
+      same = FALSE;
+    rows = MAX ( rows, GET_COLUMN(dem, i)->n_points );
+  }
+  dem->grid_rows = rows;
 
-  g_ptr_array_add ( dem->columns, g_malloc(sizeof(VikDEMColumn)) );
-  GET_COLUMN(dem,*cur_column)->east_west = east_west;
-  GET_COLUMN(dem,*cur_column)->south = south;
-  GET_COLUMN(dem,*cur_column)->n_points = n_rows;
-  GET_COLUMN(dem,*cur_column)->points = g_malloc(sizeof(gint16)*n_rows);
+  if ( same )
+    dem->grid = (gint16*)g_array_free ( points, FALSE );
+  else {
+    dem->grid = g_malloc ( sizeof(gint16) * dem->n_columns * rows );
+    for ( i = 0; i < dem->n_columns; i++ ) {
+      guint n_points = GET_COLUMN(dem, i)->n_points;
+      gint16 *column = dem->grid + i*rows;
+      memcpy ( column, &g_array_index(points, gint16, g_array_index(offsets, guint, i)), sizeof(gint16)*n_points );
+      for ( guint j = n_points; j < rows; j++ )
+        column[j] = VIK_DEM_INVALID_ELEVATION;
+    }
+    g_array_free ( points, TRUE );
+  }
 
-  /* no information for things before that */
-  for ( i = 0; i < (*cur_row); i++ )
-    GET_COLUMN(dem,*cur_column)->points[i] = VIK_DEM_INVALID_ELEVATION;
+  for ( i = 0; i < dem->n_columns; i++ ) {
+    GET_COLUMN(dem, i)->n_points = rows;
+    GET_COLUMN(dem, i)->points = dem->grid + i*rows;
+  }
+}
+
+static VikDEM *vik_dem_read_usgs ( const gchar *file )
+{
+  GError *error = NULL;
+  GMappedFile *mf = g_mapped_file_new ( file, FALSE, &error );
+  if ( !mf ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+    return NULL;
+  }
+
+  VikDEM *rv = g_malloc0(sizeof(VikDEM));
+  DemReader rd;
+  rd.start = g_mapped_file_get_contents ( mf );
+  rd.end = rd.start + g_mapped_file_get_length ( mf );
+  rd.pos = rd.start;
+
+      /* Header */
+  if ( ! dem_parse_header ( &rd, rv ) ) {
+    g_free ( rv );
+    g_mapped_file_unref ( mf );
+    return NULL;
+  }
+  /* TODO: actually use header -- i.e. GET # OF COLUMNS EXPECTED */
+
+  rv->columns = g_ptr_array_new();
+  rv->n_columns = 0;
+
+      /* Column -- Data */
+  GArray *points = g_array_new ( FALSE, FALSE, sizeof(gint16) );
+  GArray *offsets = g_array_new ( FALSE, FALSE, sizeof(guint) );
+  for ( gsize block = DEM_BLOCK_SIZE; block < (gsize)(rd.end - rd.start); ) {
+    rd.pos = rd.start + block;
+    dem_skip_space ( &rd );
+    if ( rd.pos == rd.end )
+      break;
+    dem_parse_profile ( &rd, rv, points, offsets );
+    /* on to the next block */
+    block = MAX ( block + DEM_BLOCK_SIZE, ((rd.pos - rd.start) + DEM_BLOCK_SIZE - 1) / DEM_BLOCK_SIZE * DEM_BLOCK_SIZE );
+  }
+
+     /* TODO - class C records (right now says 'Invalid' and dies) */
+
+  dem_make_grid ( rv, points, offsets );
+  g_array_free ( offsets, TRUE );
+  g_mapped_file_unref ( mf );
 
-  /* now just continue */
-  dem_parse_block_as_cont ( buffer, dem, cur_column, cur_row );
+  /* 24k scale */
+  if ( rv->horiz_units == VIK_DEM_HORIZ_UTM_METERS && rv->n_columns >= 2 )
+    rv->north_scale = rv->east_scale = GET_COLUMN(rv, 1)->east_west - GET_COLUMN(rv,0)->east_west;
+
+  /* FIXME bug in 10m DEM's */
+  if ( rv->horiz_units == VIK_DEM_HORIZ_UTM_METERS && rv->north_scale == 10 ) {
+    rv->min_east -= 100;
+    rv->min_north += 200;
+  }
+
+  return rv;
+}
 
+/*
+ * The parsed DEM is kept in a binary file next to the original,
+ *  so it can be loaded again by just reading it in.
+ * It is in the native byte order, and is only used whilst the original is unchanged.
+ */
+#define DEM_CACHE_SUFFIX ".vikdem"
+#define DEM_CACHE_MAGIC "VIKDEM01"
+
+typedef struct {
+  gchar magic[8];
+  guint32 byte_order;
+  guint32 n_columns;
+  gint64 source_size;
+  gint64 source_mtime;
+  gdouble east_scale, north_scale;
+  gdouble min_east, min_north, max_east, max_north;
+  guint32 grid_rows;
+  guint8 horiz_units;
+  guint8 orig_vert_units;
+  guint8 utm_zone;
+  gchar utm_letter;
+  // Followed by the east_west and south of each column, then the grid
+} DemCacheHeader;
 
+/**
+ * Whether the header is for this source file, with the length of what follows it
+ */
+static gboolean dem_cache_header_valid ( const DemCacheHeader *hdr, GStatBuf *source, gsize length )
+{
+  return !memcmp ( hdr->magic, DEM_CACHE_MAGIC, sizeof(hdr->magic) ) && hdr->byte_order == G_BYTE_ORDER &&
+    hdr->source_size == source->st_size && hdr->source_mtime == source->st_mtime &&
+    length == hdr->n_columns * 2 * sizeof(gdouble) + (gsize)hdr->n_columns * hdr->grid_rows * sizeof(gint16);
 }
 
-static void dem_parse_block ( gchar *buffer, VikDEM *dem, gint *cur_column, gint *cur_row )
+/**
+ * @columns: The east_west and south of each column
+ * @grid:    (transfer full): The points
+ */
+static VikDEM *dem_cache_new ( const DemCacheHeader *hdr, const gchar *columns, gint16 *grid )
 {
-  /* if haven't read anything or have read all items in a columns and are expecting a new column */
-  if ( *cur_column == -1 || *cur_row == -1 ) {
-    dem_parse_block_as_header(buffer, dem, cur_column, cur_row);
-  } else {
-    dem_parse_block_as_cont(buffer, dem, cur_column, cur_row);
+  VikDEM *dem = g_malloc0 ( sizeof(VikDEM) );
+  dem->horiz_units = hdr->horiz_units;
+  dem->orig_vert_units = hdr->orig_vert_units;
+  dem->east_scale = hdr->east_scale;
+  dem->north_scale = hdr->north_scale;
+  dem->min_east = hdr->min_east;
+  dem->min_north = hdr->min_north;
+  dem->max_east = hdr->max_east;
+  dem->max_north = hdr->max_north;
+  dem->utm_zone = hdr->utm_zone;
+  dem->utm_letter = hdr->utm_letter;
+  dem->grid_rows = hdr->grid_rows;
+  dem->grid = grid;
+  dem->columns = g_ptr_array_new();
+  dem->n_columns = hdr->n_columns;
+
+  const gchar *pos = columns;
+  for ( guint i = 0; i < hdr->n_columns; i++ ) {
+    VikDEMColumn *column = g_malloc(sizeof(VikDEMColumn));
+    memcpy ( &column->east_west, pos, sizeof(gdouble) );
+    memcpy ( &column->south, pos + sizeof(gdouble), sizeof(gdouble) );
+    pos += 2 * sizeof(gdouble);
+    column->n_points = hdr->grid_rows;
+    column->points = dem->grid + i*hdr->grid_rows;
+    g_ptr_array_add ( dem->columns, column );
   }
+  return dem;
+}
+
+static VikDEM *dem_cache_load ( const gchar *file, GStatBuf *source )
+{
+  gchar *cache_file = g_strconcat ( file, DEM_CACHE_SUFFIX, NULL );
+  gchar *contents = NULL;
+  gsize length = 0;
+  gboolean ok = g_file_get_contents ( cache_file, &contents, &length, NULL );
+  g_free ( cache_file );
+  if ( !ok )
+    return NULL;
+
+  DemCacheHeader hdr;
+  VikDEM *dem = NULL;
+  if ( length < sizeof(hdr) )
+    goto out;
+  memcpy ( &hdr, contents, sizeof(hdr) );
+  if ( !dem_cache_header_valid ( &hdr, source, length - sizeof(hdr) ) )
+    goto out;
+  gsize grid_size = (gsize)hdr.n_columns * hdr.grid_rows * sizeof(gint16);
+  dem = dem_cache_new ( &hdr, contents + sizeof(hdr), g_memdup ( contents + length - grid_size, grid_size ) );
+
+ out:
+  g_free ( contents );
+  return dem;
+}
+
+/**
+ * The header, followed by the east_west and south of each column
+ */
+static GByteArray *dem_cache_header_new ( GStatBuf *source, VikDEM *dem )
+{
+  DemCacheHeader hdr;
+  memset ( &hdr, 0, sizeof(hdr) );
+  memcpy ( hdr.magic, DEM_CACHE_MAGIC, sizeof(hdr.magic) );
+  hdr.byte_order = G_BYTE_ORDER;
+  hdr.n_columns = dem->n_columns;
+  hdr.source_size = source->st_size;
+  hdr.source_mtime = source->st_mtime;
+  hdr.east_scale = dem->east_scale;
+  hdr.north_scale = dem->north_scale;
+  hdr.min_east = dem->min_east;
+  hdr.min_north = dem->min_north;
+  hdr.max_east = dem->max_east;
+  hdr.max_north = dem->max_north;
+  hdr.grid_rows = dem->grid_rows;
+  hdr.horiz_units = dem->horiz_units;
+  hdr.orig_vert_units = dem->orig_vert_units;
+  hdr.utm_zone = dem->utm_zone;
+  hdr.utm_letter = dem->utm_letter;
+
+  GByteArray *buf = g_byte_array_new ();
+  g_byte_array_append ( buf, (guint8*)&hdr, sizeof(hdr) );
+  for ( guint i = 0; i < dem->n_columns; i++ ) {
+    g_byte_array_append ( buf, (guint8*)&GET_COLUMN(dem, i)->east_west, sizeof(gdouble) );
+    g_byte_array_append ( buf, (guint8*)&GET_COLUMN(dem, i)->south, sizeof(gdouble) );
+  }
+  return buf;
+}
+
+static void dem_cache_save ( const gchar *file, GStatBuf *source, VikDEM *dem )
+{
+  GByteArray *buf = dem_cache_header_new ( source, dem );
+  if ( dem->grid )
+    g_byte_array_append ( buf, (guint8*)dem->grid, dem->n_columns * dem->grid_rows * sizeof(gint16) );
+
+  // Not being able to write next to the original (e.g. read only media) only means it gets parsed again
+  GError *error = NULL;
+  gchar *cache_file = g_strconcat ( file, DEM_CACHE_SUFFIX, NULL );
+  if ( !g_file_set_contents ( cache_file, (const gchar*)buf->data, buf->len, &error ) ) {
+    g_debug ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+  }
+  g_free ( cache_file );
+  g_byte_array_free ( buf, TRUE );
+}
+
+/**
+ * The DEM as kept from the previous session, with its grid left in the mapped file
+ */
+static VikDEM *dem_warm_load ( const gchar *file, GStatBuf *source )
+{
+  GBytes *header, *data;
+  if ( !a_warmcache_lookup ( WARMCACHE_DEM, file, strlen(file), &header, &data ) )
+    return NULL;
+
+  VikDEM *dem = NULL;
+  gsize length = 0;
+  const gchar *contents = g_bytes_get_data ( header, &length );
+  DemCacheHeader hdr;
+  if ( length < sizeof(hdr) )
+    goto out;
+  memcpy ( &hdr, contents, sizeof(hdr) );
+  if ( !dem_cache_header_valid ( &hdr, source, length - sizeof(hdr) + g_bytes_get_size(data) ) )
+    goto out;
+  dem = dem_cache_new ( &hdr, contents + sizeof(hdr), (gint16*)g_bytes_get_data(data, NULL) );
+  dem->grid_bytes = data;
+  data = NULL;
+
+ out:
+  g_bytes_unref ( header );
+  if ( data )
+    g_bytes_unref ( data );
+  return dem;
+}
+
+/**
+ * vik_dem_warm_save:
+ *
+ * Write the DEM for the next session, as long as it is all in memory
+ *  (uncompressed SRTM files are mapped directly anyway)
+ */
+void vik_dem_warm_save ( VikDEM *dem, const gchar *file, WarmCacheWriter *wcw )
+{
+  GStatBuf source;
+  if ( !dem->grid || dem->mapped_file || g_stat ( file, &source ) != 0 )
+    return;
+  GByteArray *buf = dem_cache_header_new ( &source, dem );
+  (void)a_warmcache_write ( wcw, WARMCACHE_DEM, file, strlen(file), buf->data, buf->len,
+                            dem->grid, dem->n_columns * dem->grid_rows * sizeof(gint16) );
+  g_byte_array_free ( buf, TRUE );
 }
 
 static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basename, gboolean zip)
@@ -262,6 +550,11 @@ static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basena
   GError *error = NULL;
 
   dem = g_malloc(sizeof(VikDEM));
+  dem->grid = NULL;
+  dem->grid_rows = 0;
+  dem->mapped_file = NULL;
+  dem->blocks_decoded = NULL;
+  dem->grid_bytes = NULL;
 
   dem->horiz_units = VIK_DEM_HORIZ_LL_ARCSECONDS;
   dem->orig_vert_units = VIK_DEM_VERT_DECIMETERS;
@@ -321,26 +614,38 @@ static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basena
   num_rows = (arcsec == 3) ? num_rows_3sec : num_rows_1sec;
   dem->east_scale = dem->north_scale = arcsec;
 
+  // NB Memory for the grid only becomes resident as it gets filled in
+  dem->grid = g_malloc(sizeof(gint16)*num_rows*num_rows);
+  dem->grid_rows = num_rows;
   for ( i = 0; i < num_rows; i++ ) {
     dem->n_columns++;
     g_ptr_array_add ( dem->columns, g_malloc(sizeof(VikDEMColumn)) );
     GET_COLUMN(dem,i)->east_west = dem->min_east + arcsec*i;
     GET_COLUMN(dem,i)->south = dem->min_north;
     GET_COLUMN(dem,i)->n_points = num_rows;
-    GET_COLUMN(dem,i)->points = g_malloc(sizeof(gint16)*num_rows);
+    GET_COLUMN(dem,i)->points = dem->grid + i*num_rows;
+  }
+
+  if (!zip) {
+    // Keep the file and only decode the parts that get used
+    dem->mapped_file = mf;
+    dem->blocks_decoded = g_new0(gint, (num_rows + DEM_DECODE_COLUMNS - 1) / DEM_DECODE_COLUMNS);
+    return dem;
   }
 
+  // The file is stored row by row from the north
   int ent = 0;
   for ( i = (num_rows - 1); i >= 0; i-- ) {
+    gint16 *point = dem->grid + i;
     for ( j = 0; j < num_rows; j++ ) {
-      GET_COLUMN(dem,j)->points[i] = GINT16_FROM_BE(dem_mem[ent]);
+      *point = GINT16_FROM_BE(dem_mem[ent]);
+      point += num_rows;
       ent++;
     }
 
   }
 
-  if (zip)
-    g_free(dem_mem);
+  g_free(dem_mem);
   g_mapped_file_unref(mf);
   return dem;
 }
@@ -349,18 +654,19 @@ static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basena
 
 VikDEM *vik_dem_new_from_file(const gchar *file)
 {
-  FILE *f=NULL;
   VikDEM *rv;
-  gchar buffer[DEM_BLOCK_SIZE+1];
-
-  /* use to record state for dem_parse_block */
-  gint cur_column = -1;
-  gint cur_row = -1;
   const gchar *basename = a_file_basename(file);
 
   if ( g_access ( file, R_OK ) != 0 )
     return NULL;
 
+  GStatBuf source;
+  if ( g_stat ( file, &source ) != 0 )
+    return NULL;
+  rv = dem_warm_load ( file, &source );
+  if ( rv )
+    return rv;
+
   if ( (strlen(basename)==11 || ((strlen(basename) == 15) && (basename[11] == '.' && basename[12] == 'z' && basename[13] == 'i' && basename[14] == 'p'))) &&
        basename[7]=='.' && basename[8]=='h' && basename[9]=='g' && basename[10]=='t' &&
        (basename[0] == 'N' || basename[0] == 'S') && (basename[3] == 'E' || basename[3] =='W')) {
@@ -369,75 +675,85 @@ VikDEM *vik_dem_new_from_file(const gchar *file)
     return(rv);
   }
 
-      /* Create Structure */
-  rv = g_malloc(sizeof(VikDEM));
-
-      /* Header */
-  f = g_fopen(file, "r");
-  if ( !f ) {
-    g_free ( rv );
-    return NULL;
-  }
-  buffer[fread(buffer, 1, DEM_BLOCK_SIZE, f)] = '\0';
-  if ( ! dem_parse_header ( buffer, rv ) ) {
-    g_free ( rv );
-    fclose(f);
-    return NULL;
-  }
-  /* TODO: actually use header -- i.e. GET # OF COLUMNS EXPECTED */
-
-  rv->columns = g_ptr_array_new();
-  rv->n_columns = 0;
-
-      /* Column -- Data */
-  while (! feof(f) ) {
-     gchar *tmp;
-
-     /* read block */
-     buffer[fread(buffer, 1, DEM_BLOCK_SIZE, f)] = '\0';
-
-     /* Fix Fortran-style exponentiation */
-     tmp = buffer;
-     while (*tmp) {
-       if ( *tmp=='D')
-         *tmp='E';
-       tmp++;
-     }
-
-     dem_parse_block(buffer, rv, &cur_column, &cur_row);
-  }
-
-     /* TODO - class C records (right now says 'Invalid' and dies) */
-
-  fclose(f);
-  f = NULL;
-
-  /* 24k scale */
-  if ( rv->horiz_units == VIK_DEM_HORIZ_UTM_METERS && rv->n_columns >= 2 )
-    rv->north_scale = rv->east_scale = GET_COLUMN(rv, 1)->east_west - GET_COLUMN(rv,0)->east_west;
-
-  /* FIXME bug in 10m DEM's */
-  if ( rv->horiz_units == VIK_DEM_HORIZ_UTM_METERS && rv->north_scale == 10 ) {
-    rv->min_east -= 100;
-    rv->min_north += 200;
-  }
-
+  rv = dem_cache_load ( file, &source );
+  if ( rv )
+    return rv;
 
+  rv = vik_dem_read_usgs ( file );
+  if ( rv && rv->n_columns > 0 )
+    dem_cache_save ( file, &source, rv );
   return rv;
 }
 
 void vik_dem_free ( VikDEM *dem )
 {
   guint i;
-  for ( i = 0; i < dem->n_columns; i++)
-    g_free ( GET_COLUMN(dem, i)->points );
+  if ( dem->mapped_file ) {
+    g_mapped_file_unref ( dem->mapped_file );
+    g_free ( dem->blocks_decoded );
+  }
+  if ( dem->grid_bytes )
+    g_bytes_unref ( dem->grid_bytes );
+  else if ( dem->grid )
+    g_free ( dem->grid );
+  else
+    for ( i = 0; i < dem->n_columns; i++)
+      g_free ( GET_COLUMN(dem, i)->points );
   g_ptr_array_foreach ( dem->columns, (GFunc)g_free, NULL );
   g_ptr_array_free ( dem->columns, TRUE );
   g_free ( dem );
 }
 
+/**
+ * Fill in the grid for a block of columns from the mapped file
+ * A DEM may be used from several threads, hence the lock
+ */
+static void dem_decode_columns ( VikDEM *dem, guint block )
+{
+  G_LOCK(dem_decode);
+  if ( !g_atomic_int_get(&dem->blocks_decoded[block]) ) {
+    const gint16 *dem_mem = (const gint16 *)g_mapped_file_get_contents(dem->mapped_file);
+    const guint num_rows = dem->grid_rows;
+    const guint first = block * DEM_DECODE_COLUMNS;
+    const guint last = MIN(first + DEM_DECODE_COLUMNS, dem->n_columns);
+    // The file is stored row by row from the north
+    for ( guint i = 0; i < num_rows; i++ ) {
+      const gint16 *file_row = dem_mem + (num_rows - 1 - i) * num_rows;
+      for ( guint j = first; j < last; j++ )
+        dem->grid[j*num_rows + i] = GINT16_FROM_BE(file_row[j]);
+    }
+    g_atomic_int_set(&dem->blocks_decoded[block], 1);
+  }
+  G_UNLOCK(dem_decode);
+}
+
+static inline void dem_ensure_column ( VikDEM *dem, guint col )
+{
+  if ( dem->mapped_file && !g_atomic_int_get(&dem->blocks_decoded[col / DEM_DECODE_COLUMNS]) )
+    dem_decode_columns ( dem, col / DEM_DECODE_COLUMNS );
+}
+
+/**
+ * Returns: The column, with its points ready to use, or NULL if out of range
+ */
+VikDEMColumn *vik_dem_get_column ( VikDEM *dem, guint col )
+{
+  if ( col >= dem->n_columns )
+    return NULL;
+  dem_ensure_column ( dem, col );
+  return GET_COLUMN(dem, col);
+}
+
 gint16 vik_dem_get_xy ( VikDEM *dem, guint col, guint row )
 {
+  // Avoid going via the column when all the points are together
+  if ( dem->grid ) {
+    if ( col < dem->n_columns && row < dem->grid_rows ) {
+      dem_ensure_column ( dem, col );
+      return dem->grid[col*dem->grid_rows + row];
+    }
+    return VIK_DEM_INVALID_ELEVATION;
+  }
   if ( col < dem->n_columns )
     if ( row < GET_COLUMN(dem, col)->n_points )
       return GET_COLUMN(dem, col)->points[row];
@@ -610,3 +926,24 @@ LatLonBBox vik_dem_get_bbox ( const VikDEM *dem )
   }
   return bbox;
 }
+
+/**
+ * Returns: Approximate memory used by the elevation values
+ */
+gsize vik_dem_get_size ( const VikDEM *dem )
+{
+  gsize size = 0;
+  if ( dem->mapped_file ) {
+    // Only the decoded parts use memory
+    const guint blocks = (dem->n_columns + DEM_DECODE_COLUMNS - 1) / DEM_DECODE_COLUMNS;
+    for ( guint bb = 0; bb < blocks; bb++ )
+      if ( g_atomic_int_get(&dem->blocks_decoded[bb]) )
+        size += DEM_DECODE_COLUMNS * dem->grid_rows * sizeof(gint16);
+  }
+  else if ( dem->grid )
+    size = dem->n_columns * dem->grid_rows * sizeof(gint16);
+  else
+    for ( guint i = 0; i < dem->n_columns; i++ )
+      size += GET_COLUMN(dem, i)->n_points * sizeof(gint16);
+  return size;
+}
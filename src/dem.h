@@ -24,6 +24,7 @@
 
 #include <glib.h>
 #include "bbox.h"
+#include "warmcache.h"
 
 G_BEGIN_DECLS
 
@@ -51,6 +52,21 @@ typedef struct {
 
   guint8 utm_zone;
   gchar utm_letter;
+
+  /* When every column has the same number of points (e.g. SRTM)
+     all the points are kept in one block, one column after another.
+     The columns then point into this block. Otherwise NULL. */
+  gint16 *grid;
+  guint grid_rows;
+
+  /* Uncompressed SRTM files stay mapped and the grid gets filled in
+     a block of columns at a time as they are first accessed */
+  GMappedFile *mapped_file;
+  gint *blocks_decoded;
+
+  /* When the grid is in the file kept between sessions (see warmcache.c),
+     that holds it rather than it being allocated */
+  GBytes *grid_bytes;
 } VikDEM;
 
 typedef struct {
@@ -69,6 +85,7 @@ typedef struct {
 VikDEM *vik_dem_new_from_file(const gchar *file);
 void vik_dem_free ( VikDEM *dem );
 gint16 vik_dem_get_xy ( VikDEM *dem, guint x, guint y );
+VikDEMColumn *vik_dem_get_column ( VikDEM *dem, guint x );
 
 gint16 vik_dem_get_east_north ( VikDEM *dem, gdouble east, gdouble north );
 gint16 vik_dem_get_simple_interpol ( VikDEM *dem, gdouble east, gdouble north );
@@ -78,6 +95,9 @@ gint16 vik_dem_get_best_interpol ( VikDEM *dem, gdouble east, gdouble north );
 void vik_dem_east_north_to_xy ( VikDEM *dem, gdouble east, gdouble north, guint *col, guint *row );
 
 LatLonBBox vik_dem_get_bbox ( const VikDEM *dem );
+gsize vik_dem_get_size ( const VikDEM *dem );
+// Keep the DEM read from the file for the next session
+void vik_dem_warm_save ( VikDEM *dem, const gchar *file, WarmCacheWriter *wcw );
 
 G_END_DECLS
 
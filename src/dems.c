@@ -23,64 +23,205 @@
 
 #include "dems.h"
 #include "background.h"
+#include "settings.h"
 
 typedef struct {
   VikDEM *dem;
   guint ref_count;
+  GList *unused; // Link in unused_dems when no longer referenced
+  gsize size;
 } LoadedDEM;
 
 GHashTable *loaded_dems = NULL;
 /* filename -> DEM */
 
+// Elevations may be looked up from several threads at once,
+//  while DEMs may be loaded (e.g. once downloaded) from another
+static GRWLock dems_lock;
+
+// DEMs no longer referenced are kept for reuse (most recently used first)
+//  until their total size reaches the cache limit
+static GQueue unused_dems = G_QUEUE_INIT;
+static gsize unused_size = 0;
+static guint cache_hits = 0;
+static guint cache_loads = 0;
+static guint cache_evictions = 0;
+// Number of times the DEMs available for lookups have changed, see a_dems_get_changes_count()
+static gint dems_changes = 0;
+
+#define VIK_SETTINGS_DEMS_CACHE_MB "dems_cache_mb"
+
+static gsize dems_cache_limit ()
+{
+  static gsize limit = 0;
+  static gboolean limit_read = FALSE;
+  if ( !limit_read ) {
+    gint mb = 256;
+    (void)a_settings_get_integer ( VIK_SETTINGS_DEMS_CACHE_MB, &mb );
+    limit = (gsize)MAX(mb, 0) * 1024 * 1024;
+    limit_read = TRUE;
+  }
+  return limit;
+}
+
 static void loaded_dem_free ( LoadedDEM *ldem )
 {
+  if ( ldem->unused ) {
+    g_queue_delete_link ( &unused_dems, ldem->unused );
+    unused_size -= ldem->size;
+  }
   vik_dem_free ( ldem->dem );
   g_free ( ldem );
 }
 
+/**
+ * Drop the least recently used of the unreferenced DEMs until within the cache limit
+ */
+static void dems_cache_trim ()
+{
+  while ( unused_size > dems_cache_limit() && !g_queue_is_empty(&unused_dems) ) {
+    const gchar *filename = g_queue_peek_tail ( &unused_dems );
+    cache_evictions++;
+    g_debug ( "%s: %s (hits %d, loads %d, evictions %d)", __FUNCTION__, filename, cache_hits, cache_loads, cache_evictions );
+    g_hash_table_remove ( loaded_dems, filename );
+    g_atomic_int_inc ( &dems_changes );
+  }
+}
+
+/**
+ * a_dems_get_cache_stats:
+ *
+ * Counts of DEM loads satisfied from those already loaded,
+ *  of those actually read from file and of those dropped from the cache
+ */
+void a_dems_get_cache_stats ( guint *hits, guint *loads, guint *evictions )
+{
+  *hits = cache_hits;
+  *loads = cache_loads;
+  *evictions = cache_evictions;
+}
+
+/**
+ * a_dems_get_changes_count:
+ *
+ * Returns: A count that changes whenever DEMs are added to or dropped from those used for lookups,
+ *  so anything remembering elevations can tell when they may be out of date
+ */
+guint a_dems_get_changes_count ( void )
+{
+  return (guint)g_atomic_int_get ( &dems_changes );
+}
+
 void a_dems_uninit ()
 {
+  g_rw_lock_writer_lock ( &dems_lock );
   if ( loaded_dems )
     g_hash_table_destroy ( loaded_dems );
+  loaded_dems = NULL;
+  g_atomic_int_inc ( &dems_changes );
+  g_rw_lock_writer_unlock ( &dems_lock );
+}
+
+/**
+ * a_dems_warm_save:
+ *
+ * Write the DEMs loaded, whether in use or not, for the next session
+ */
+void a_dems_warm_save ( WarmCacheWriter *wcw )
+{
+  g_rw_lock_reader_lock ( &dems_lock );
+  if ( loaded_dems ) {
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init ( &iter, loaded_dems );
+    while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+      vik_dem_warm_save ( ((LoadedDEM*)value)->dem, key, wcw );
+  }
+  g_rw_lock_reader_unlock ( &dems_lock );
 }
 
 /* To load a dem. if it was already loaded, will simply
  * reference the one already loaded and return it.
  */
+/**
+ * Reference a DEM already loaded
+ * Must be called with the lock held for writing
+ */
+static VikDEM *dems_ref ( const gchar *filename )
+{
+  LoadedDEM *ldem = loaded_dems ? (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename ) : NULL;
+  if ( !ldem )
+    return NULL;
+  if ( ldem->unused ) {
+    g_queue_delete_link ( &unused_dems, ldem->unused );
+    ldem->unused = NULL;
+    unused_size -= ldem->size;
+  }
+  cache_hits++;
+  ldem->ref_count++;
+  return ldem->dem;
+}
+
 VikDEM *a_dems_load(const gchar *filename)
 {
-  LoadedDEM *ldem;
+  g_rw_lock_writer_lock ( &dems_lock );
+  VikDEM *dem = dems_ref ( filename );
+  g_rw_lock_writer_unlock ( &dems_lock );
+  if ( dem )
+    return dem;
+
+  // Read the file without holding up any lookups meanwhile
+  dem = vik_dem_new_from_file ( filename );
+  if ( ! dem )
+    return NULL;
 
+  g_rw_lock_writer_lock ( &dems_lock );
   /* dems init hash table */
   if ( ! loaded_dems )
     loaded_dems = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify) loaded_dem_free );
 
-  ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
-  if ( ldem ) {
-    ldem->ref_count++;
-    return ldem->dem;
-  } else {
-    VikDEM *dem = vik_dem_new_from_file ( filename );
-    if ( ! dem )
-      return NULL;
-    ldem = g_malloc ( sizeof(LoadedDEM) );
+  // Another thread may have loaded the same file in the meantime
+  VikDEM *loaded = dems_ref ( filename );
+  if ( loaded ) {
+    vik_dem_free ( dem );
+    dem = loaded;
+  }
+  else {
+    cache_loads++;
+    LoadedDEM *ldem = g_malloc ( sizeof(LoadedDEM) );
     ldem->ref_count = 1;
     ldem->dem = dem;
+    ldem->unused = NULL;
+    ldem->size = 0;
     g_hash_table_insert ( loaded_dems, g_strdup(filename), ldem );
-    return dem;
+    g_atomic_int_inc ( &dems_changes );
   }
+  g_rw_lock_writer_unlock ( &dems_lock );
+  return dem;
 }
 
 void a_dems_unref(const gchar *filename)
 {
-  LoadedDEM *ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
+  g_rw_lock_writer_lock ( &dems_lock );
+  LoadedDEM *ldem = loaded_dems ? (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename ) : NULL;
   if ( !ldem ) {
     /* This is fine - probably means the loaded list was aborted / not completed for some reason */
+    g_rw_lock_writer_unlock ( &dems_lock );
     return;
   }
   ldem->ref_count--;
-  if ( ldem->ref_count == 0 )
-    g_hash_table_remove ( loaded_dems, filename );
+  if ( ldem->ref_count == 0 ) {
+    // Keep it in case it gets loaded again soon (e.g. a DEM layer's list being changed)
+    gpointer key = NULL;
+    (void)g_hash_table_lookup_extended ( loaded_dems, filename, &key, NULL );
+    g_queue_push_head ( &unused_dems, key );
+    ldem->unused = g_queue_peek_head_link ( &unused_dems );
+    // Measured now as SRTM tiles grow as they get used
+    ldem->size = vik_dem_get_size ( ldem->dem );
+    unused_size += ldem->size;
+    dems_cache_trim ();
+  }
+  g_rw_lock_writer_unlock ( &dems_lock );
 }
 
 /* to get a DEM that was already loaded.
@@ -89,12 +230,44 @@ void a_dems_unref(const gchar *filename)
  */
 VikDEM *a_dems_get(const gchar *filename)
 {
-  LoadedDEM *ldem = g_hash_table_lookup ( loaded_dems, filename );
-  if ( ldem )
-    return ldem->dem;
-  return NULL;
+  VikDEM *dem = NULL;
+  g_rw_lock_reader_lock ( &dems_lock );
+  LoadedDEM *ldem = loaded_dems ? g_hash_table_lookup ( loaded_dems, filename ) : NULL;
+  if ( ldem && ldem->ref_count )
+    dem = ldem->dem;
+  g_rw_lock_reader_unlock ( &dems_lock );
+  return dem;
 }
 
+/**
+ * a_dems_get_size:
+ *
+ * Returns: The memory used by the DEM if it is loaded, otherwise 0
+ *  (NB A DEM used by several layers is shared between them)
+ */
+gsize a_dems_get_size ( const gchar *filename )
+{
+  gsize size = 0;
+  g_rw_lock_reader_lock ( &dems_lock );
+  LoadedDEM *ldem = loaded_dems ? g_hash_table_lookup ( loaded_dems, filename ) : NULL;
+  if ( ldem && ldem->ref_count )
+    size = ldem->size;
+  g_rw_lock_reader_unlock ( &dems_lock );
+  return size;
+}
+
+/**
+ * a_dems_get_unused_size:
+ *
+ * Returns: The memory used by the DEMs no longer referenced but kept for reuse
+ */
+gsize a_dems_get_unused_size ( void )
+{
+  g_rw_lock_reader_lock ( &dems_lock );
+  gsize size = unused_size;
+  g_rw_lock_reader_unlock ( &dems_lock );
+  return size;
+}
 
 /* Load a string list (GList of strings) of dems. You have to use get to at them later.
  * When updating a list as a parameter, this should be bfore freeing the list so
@@ -107,11 +280,51 @@ VikDEM *a_dems_get(const gchar *filename)
  * we need to know that they weren't referenced though when we
  * do the a_dems_list_free().
  */
+typedef struct {
+  const gchar *filename;
+  gboolean done;
+  gboolean loaded;
+} DemLoad;
+
+static void dem_load_item ( DemLoad *dl, gpointer user_data )
+{
+  dl->loaded = a_dems_load ( dl->filename ) != NULL;
+  dl->done = TRUE;
+}
+
 int a_dems_load_list ( GList **dems, gpointer threaddata )
 {
   GList *iter = *dems;
-  guint dem_count = 0;
-  const guint dem_total = g_list_length ( *dems );
+  if ( threaddata ) {
+    // Each file is read and decoded independently, so load them all at once
+    const guint dem_total = g_list_length ( *dems );
+    DemLoad *loads = g_new0 ( DemLoad, dem_total );
+    gpointer *items = g_new ( gpointer, dem_total );
+    guint ii = 0;
+    for ( ; iter; iter = iter->next, ii++ ) {
+      loads[ii].filename = iter->data;
+      items[ii] = &loads[ii];
+    }
+    /* NB Progress also detects abort request via the returned value */
+    int result = a_background_thread_parallel ( threaddata, (GFunc)dem_load_item, items, dem_total, NULL, TRUE );
+
+    // Remove those that did not load, even if aborted
+    ii = 0;
+    iter = *dems;
+    while ( iter ) {
+      GList *iter_temp = iter->next;
+      if ( loads[ii].done && !loads[ii].loaded ) {
+        g_free ( iter->data );
+        (*dems) = g_list_delete_link ( (*dems), iter );
+      }
+      iter = iter_temp;
+      ii++;
+    }
+    g_free ( items );
+    g_free ( loads );
+    return result ? -1 : 0;
+  }
+
   while ( iter ) {
     if ( ! a_dems_load((const gchar *) (iter->data)) ) {
       GList *iter_temp = iter->next;
@@ -121,14 +334,6 @@ int a_dems_load_list ( GList **dems, gpointer threaddata )
     } else {
       iter = iter->next;
     }
-    /* When running a thread - inform of progress */
-    if ( threaddata ) {
-      dem_count++;
-      /* NB Progress also detects abort request via the returned value */
-      int result = a_background_thread_progress ( threaddata, ((gdouble)dem_count) / dem_total );
-      if ( result != 0 )
-	return -1; /* Abort thread */
-    }
   }
   return 0;
 }
@@ -167,8 +372,8 @@ GList *a_dems_list_copy ( GList *dems )
 
 gint16 a_dems_list_get_elev_by_coord ( GList *dems, const VikCoord *coord )
 {
-  static struct UTM utm_tmp;
-  static struct LatLon ll_tmp;
+  struct UTM utm_tmp;
+  struct LatLon ll_tmp;
   GList *iter = dems;
   VikDEM *dem;
   gint elev;
@@ -201,38 +406,45 @@ typedef struct {
   gint elev;
 } CoordElev;
 
+static gint16 dem_get_elev ( VikDEM *dem, gdouble east, gdouble north, VikDemInterpol method )
+{
+  switch (method) {
+    case VIK_DEM_INTERPOL_NONE:
+      return vik_dem_get_east_north(dem, east, north);
+    case VIK_DEM_INTERPOL_SIMPLE:
+      return vik_dem_get_simple_interpol(dem, east, north);
+    case VIK_DEM_INTERPOL_BEST:
+      return vik_dem_get_shepard_interpol(dem, east, north);
+    default: break;
+  }
+  return VIK_DEM_INVALID_ELEVATION;
+}
+
 static gboolean get_elev_by_coord(gpointer key, LoadedDEM *ldem, CoordElev *ce)
 {
   VikDEM *dem = ldem->dem;
   gdouble lat, lon;
 
+  // Only cached
+  if ( !ldem->ref_count )
+    return FALSE;
+
   if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
     struct LatLon ll_tmp;
     vik_coord_to_latlon (ce->coord, &ll_tmp );
     lat = ll_tmp.lat * 3600;
     lon = ll_tmp.lon * 3600;
   } else if (dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS) {
-    static struct UTM utm_tmp;
+    struct UTM utm_tmp;
+    vik_coord_to_utm (ce->coord, &utm_tmp);
     if (utm_tmp.zone != dem->utm_zone)
       return FALSE;
-    vik_coord_to_utm (ce->coord, &utm_tmp);
     lat = utm_tmp.northing;
     lon = utm_tmp.easting;
   } else
     return FALSE;
 
-  switch (ce->method) {
-    case VIK_DEM_INTERPOL_NONE:
-      ce->elev = vik_dem_get_east_north(dem, lon, lat);
-      break;
-    case VIK_DEM_INTERPOL_SIMPLE:
-      ce->elev = vik_dem_get_simple_interpol(dem, lon, lat);
-      break;
-    case VIK_DEM_INTERPOL_BEST:
-      ce->elev = vik_dem_get_shepard_interpol(dem, lon, lat);
-      break;
-    default: break;
-  }
+  ce->elev = dem_get_elev ( dem, lon, lat, ce->method );
   return (ce->elev != VIK_DEM_INVALID_ELEVATION);
 }
 
@@ -240,19 +452,92 @@ static gboolean get_elev_by_coord(gpointer key, LoadedDEM *ldem, CoordElev *ce)
 gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method )
 {
   CoordElev ce;
-
-  if (!loaded_dems)
-    return VIK_DEM_INVALID_ELEVATION;
-
   ce.coord = coord;
   ce.method = method;
   ce.elev = VIK_DEM_INVALID_ELEVATION;
 
-  if(!g_hash_table_find(loaded_dems, (GHRFunc)get_elev_by_coord, &ce))
-    return VIK_DEM_INVALID_ELEVATION;
+  g_rw_lock_reader_lock ( &dems_lock );
+  if ( !loaded_dems || !g_hash_table_find(loaded_dems, (GHRFunc)get_elev_by_coord, &ce) )
+    ce.elev = VIK_DEM_INVALID_ELEVATION;
+  g_rw_lock_reader_unlock ( &dems_lock );
   return ce.elev;
 }
 
+/**
+ * a_dems_get_elevs_by_coords:
+ * @coords: The positions to look up
+ * @n:      The number of positions
+ * @method: The interpolation method
+ * @elevs:  Array of @n to store the elevations in,
+ *          positions not covered by any DEM get VIK_DEM_INVALID_ELEVATION
+ *
+ * Bulk version of a_dems_get_elev_by_coord().
+ * Rather than searching through all the DEMs for every position,
+ *  each DEM is visited once and handles all the remaining positions it covers.
+ * DEMs are visited in the same order as the single position version.
+ *
+ * Returns: The number of positions that were given an elevation
+ */
+guint a_dems_get_elevs_by_coords ( const VikCoord *coords, guint n, VikDemInterpol method, gint16 *elevs )
+{
+  for ( guint ii = 0; ii < n; ii++ )
+    elevs[ii] = VIK_DEM_INVALID_ELEVATION;
+
+  if ( !n )
+    return 0;
+  g_rw_lock_reader_lock ( &dems_lock );
+  if ( !loaded_dems ) {
+    g_rw_lock_reader_unlock ( &dems_lock );
+    return 0;
+  }
+
+  // Positions still without an elevation, packed as lat/lon in arcseconds
+  guint *todo = g_new ( guint, n );
+  struct LatLon *lls = g_new ( struct LatLon, n );
+  guint remaining = n;
+  for ( guint ii = 0; ii < n; ii++ ) {
+    todo[ii] = ii;
+    vik_coord_to_latlon ( &coords[ii], &lls[ii] );
+    lls[ii].lat *= 3600;
+    lls[ii].lon *= 3600;
+  }
+
+  gpointer key, value;
+  GHashTableIter ght_iter;
+  g_hash_table_iter_init ( &ght_iter, loaded_dems );
+  while ( remaining && g_hash_table_iter_next (&ght_iter, &key, &value) ) {
+    if ( !((LoadedDEM*)value)->ref_count )
+      continue;
+    VikDEM *dem = ((LoadedDEM*)value)->dem;
+    guint kept = 0;
+    for ( guint jj = 0; jj < remaining; jj++ ) {
+      guint ii = todo[jj];
+      gint16 elev = VIK_DEM_INVALID_ELEVATION;
+      if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
+        // Cheap rejection of positions outside of this DEM
+        if ( lls[ii].lon >= dem->min_east && lls[ii].lon <= dem->max_east &&
+             lls[ii].lat >= dem->min_north && lls[ii].lat <= dem->max_north )
+          elev = dem_get_elev ( dem, lls[ii].lon, lls[ii].lat, method );
+      } else if ( dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
+        struct UTM utm;
+        vik_coord_to_utm ( &coords[ii], &utm );
+        if ( utm.zone == dem->utm_zone )
+          elev = dem_get_elev ( dem, utm.easting, utm.northing, method );
+      }
+      if ( elev != VIK_DEM_INVALID_ELEVATION )
+        elevs[ii] = elev;
+      else
+        todo[kept++] = ii;
+    }
+    remaining = kept;
+  }
+  g_rw_lock_reader_unlock ( &dems_lock );
+
+  g_free ( lls );
+  g_free ( todo );
+  return n - remaining;
+}
+
 /**
  * a_dems_overlaps_bbox
  *
@@ -261,21 +546,26 @@ gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method )
  */
 gboolean a_dems_overlaps_bbox ( LatLonBBox bbox )
 {
-  if (!loaded_dems)
-    return FALSE;
-
   gboolean ans = FALSE;
+  g_rw_lock_reader_lock ( &dems_lock );
+  if (!loaded_dems) {
+    g_rw_lock_reader_unlock ( &dems_lock );
+    return FALSE;
+  }
   LatLonBBox dem_bbox;
 
   gpointer key, value;
   GHashTableIter ght_iter;
   g_hash_table_iter_init ( &ght_iter, loaded_dems );
   while ( g_hash_table_iter_next (&ght_iter, &key, &value) ) {
+    if ( !((LoadedDEM*)value)->ref_count )
+      continue;
     dem_bbox = vik_dem_get_bbox ( ((LoadedDEM*)value)->dem );
     if ( BBOX_INTERSECT(dem_bbox, bbox) ) {
       ans = TRUE;
       break;
     }
   }
+  g_rw_lock_reader_unlock ( &dems_lock );
   return ans;
 }
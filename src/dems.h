@@ -34,17 +34,25 @@ typedef enum {
 } VikDemInterpol;
 
 void a_dems_uninit ();
+// Keeping the DEMs loaded between sessions
+void a_dems_warm_save ( WarmCacheWriter *wcw );
 VikDEM *a_dems_load(const gchar *filename);
 void a_dems_unref(const gchar *filename);
 VikDEM *a_dems_get(const gchar *filename);
+gsize a_dems_get_size ( const gchar *filename );
+gsize a_dems_get_unused_size ( void );
 int a_dems_load_list ( GList **dems, gpointer threaddata );
 void a_dems_list_free ( GList *dems );
 GList *a_dems_list_copy ( GList *dems );
 gint16 a_dems_list_get_elev_by_coord ( GList *dems, const VikCoord *coord );
 gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method);
+guint a_dems_get_elevs_by_coords ( const VikCoord *coords, guint n, VikDemInterpol method, gint16 *elevs );
 
 gboolean a_dems_overlaps_bbox ( LatLonBBox bbox );
 
+void a_dems_get_cache_stats ( guint *hits, guint *loads, guint *evictions );
+guint a_dems_get_changes_count ( void );
+
 G_END_DECLS
 
 #endif
@@ -927,6 +927,84 @@ gboolean a_dialog_map_n_zoom(GtkWindow *parent, gchar *mapnames[], gint default_
   return TRUE;
 }
 
+/**
+ * Display a dialog to choose the map and zoom levels to pre-seed,
+ *  and whether that is in a corridor along the track or the area it encloses.
+ */
+gboolean a_dialog_map_seed ( GtkWindow *parent, gchar *mapnames[], gint default_map, gchar *zoom_list[], gint default_zoom, gint *selected_map, gint *zoom_first, gint *zoom_last, gboolean *enclosed, gdouble *corridor )
+{
+  gchar **s;
+
+  GtkWidget *dialog = gtk_dialog_new_with_buttons ( _("Pre-seed Maps"), parent,
+                                                    GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                    GTK_STOCK_OK, GTK_RESPONSE_ACCEPT, GTK_STOCK_CANCEL, GTK_RESPONSE_REJECT, NULL );
+  gtk_dialog_set_default_response ( GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT );
+  GtkWidget *response_w = NULL;
+#if GTK_CHECK_VERSION (2, 20, 0)
+  response_w = gtk_dialog_get_widget_for_response ( GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT );
+#endif
+
+  GtkWidget *map_label = gtk_label_new ( _("Map type:") );
+  GtkWidget *map_combo = vik_combo_box_text_new ();
+  for ( s = mapnames; *s; s++ )
+    vik_combo_box_text_append ( GTK_COMBO_BOX(map_combo), *s );
+  gtk_combo_box_set_active ( GTK_COMBO_BOX(map_combo), default_map );
+
+  GtkWidget *first_label = gtk_label_new ( _("Zoom from:") );
+  GtkWidget *first_combo = vik_combo_box_text_new ();
+  GtkWidget *last_label = gtk_label_new ( _("Zoom to:") );
+  GtkWidget *last_combo = vik_combo_box_text_new ();
+  for ( s = zoom_list; *s; s++ ) {
+    vik_combo_box_text_append ( GTK_COMBO_BOX(first_combo), *s );
+    vik_combo_box_text_append ( GTK_COMBO_BOX(last_combo), *s );
+  }
+  gtk_combo_box_set_active ( GTK_COMBO_BOX(first_combo), default_zoom );
+  gtk_combo_box_set_active ( GTK_COMBO_BOX(last_combo), default_zoom );
+
+  GtkWidget *area_label = gtk_label_new ( _("Area:") );
+  GtkWidget *area_combo = vik_combo_box_text_new ();
+  vik_combo_box_text_append ( GTK_COMBO_BOX(area_combo), _("Corridor along the track") );
+  vik_combo_box_text_append ( GTK_COMBO_BOX(area_combo), _("Enclosed by the track") );
+  gtk_combo_box_set_active ( GTK_COMBO_BOX(area_combo), 0 );
+
+  GtkWidget *corridor_label = gtk_label_new ( _("Corridor width (m):") );
+  GtkWidget *corridor_spin = gtk_spin_button_new_with_range ( 0.0, 100000.0, 100.0 );
+  gtk_spin_button_set_value ( GTK_SPIN_BUTTON(corridor_spin), 1000.0 );
+  gtk_widget_set_tooltip_text ( corridor_spin, _("The distance either side of the track") );
+
+  GtkTable *box = GTK_TABLE(gtk_table_new(5, 2, FALSE));
+  gtk_table_attach_defaults ( box, map_label, 0, 1, 0, 1 );
+  gtk_table_attach_defaults ( box, map_combo, 1, 2, 0, 1 );
+  gtk_table_attach_defaults ( box, first_label, 0, 1, 1, 2 );
+  gtk_table_attach_defaults ( box, first_combo, 1, 2, 1, 2 );
+  gtk_table_attach_defaults ( box, last_label, 0, 1, 2, 3 );
+  gtk_table_attach_defaults ( box, last_combo, 1, 2, 2, 3 );
+  gtk_table_attach_defaults ( box, area_label, 0, 1, 3, 4 );
+  gtk_table_attach_defaults ( box, area_combo, 1, 2, 3, 4 );
+  gtk_table_attach_defaults ( box, corridor_label, 0, 1, 4, 5 );
+  gtk_table_attach_defaults ( box, corridor_spin, 1, 2, 4, 5 );
+
+  gtk_box_pack_start ( GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(dialog))), GTK_WIDGET(box), FALSE, FALSE, 5 );
+
+  if ( response_w )
+    gtk_widget_grab_focus ( response_w );
+
+  gtk_widget_show_all ( dialog );
+  if ( gtk_dialog_run ( GTK_DIALOG(dialog) ) != GTK_RESPONSE_ACCEPT ) {
+    gtk_widget_destroy ( dialog );
+    return FALSE;
+  }
+
+  *selected_map = gtk_combo_box_get_active ( GTK_COMBO_BOX(map_combo) );
+  *zoom_first = gtk_combo_box_get_active ( GTK_COMBO_BOX(first_combo) );
+  *zoom_last = gtk_combo_box_get_active ( GTK_COMBO_BOX(last_combo) );
+  *enclosed = gtk_combo_box_get_active ( GTK_COMBO_BOX(area_combo) ) == 1;
+  *corridor = gtk_spin_button_get_value ( GTK_SPIN_BUTTON(corridor_spin) );
+
+  gtk_widget_destroy ( dialog );
+  return TRUE;
+}
+
 /**
  * Display a dialog presenting the license of a map.
  * Allow to read the license by launching a web browser.
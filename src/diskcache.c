@@ -0,0 +1,477 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+#include <glib/gstdio.h>
+#include <glib/gi18n.h>
+#include "globals.h"
+#include "preferences.h"
+#include "background.h"
+#include "existcache.h"
+#include "diskcache.h"
+
+/*
+ * Each area (normally the tiles of one map source) is kept within the quota
+ *  by a background job that lists all its files and removes the least recently used.
+ * A tile's last use is the later of its file modification time (i.e. when downloaded)
+ *  and when it was last read, as recorded in a small index file kept in the area
+ *  (file access times are not reliable, since filesystems are often mounted with noatime).
+ */
+
+// Not more often than this, as each check lists the whole area
+#define DC_CHECK_INTERVAL (10 * 60 * G_USEC_PER_SEC)
+// When over the quota, remove tiles until this percentage of it is used,
+//  so the next few downloads do not immediately need another pass
+#define DC_TRIM_PERCENT 90
+#define DC_INDEX_NAME ".viking-access"
+// Downloads in progress are written to .tmp files, so any older than this were abandoned
+#define DC_STALE_TMP_AGE (24 * 60 * 60)
+
+struct _DiskCacheArea {
+  gchar *root;
+  gchar *prefix;
+  gchar *index_file;
+  GMutex mutex;
+  GHashTable *access;   // Relative path -> last read time (GUINT_TO_POINTER of seconds)
+  gboolean loaded;
+  gboolean dirty;
+  gboolean running;     // A check is queued or in progress
+  gint64 last_check;    // Monotonic
+  gboolean measured;
+  guint64 bytes;
+  guint files;
+  guint64 removed_bytes;
+  guint removed_files;
+};
+
+typedef struct {
+  gchar *path; // Relative to the root
+  guint64 size;
+  guint32 used;
+} dc_file_t;
+
+static GMutex dc_mutex;
+static GHashTable *dc_areas = NULL; // root + prefix -> DiskCacheArea
+
+static VikLayerParamScale params_scales[] = {
+  /* min, max, step, digits (decimal places) */
+ { 0, 1024*1024, 100, 0 },
+};
+
+static VikLayerParamData dcq_default ( void ) { return VIK_LPD_UINT(0); }
+
+static VikLayerParam prefs[] = {
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "disk_cache_quota", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Map disk cache limit per map (MB):"), VIK_LAYER_WIDGET_SPINBUTTON, params_scales, NULL,
+    N_("When the downloaded tiles of a map use more disk space than this, the least recently used are removed. 0 means no limit. The space in use is shown in the background jobs window."), dcq_default, NULL, NULL },
+};
+
+static guint64 dc_quota ( void )
+{
+  VikLayerParamData *pd = a_preferences_get ( VIKING_PREFERENCES_NAMESPACE "disk_cache_quota" );
+  return pd ? (guint64)pd->u * 1024 * 1024 : 0;
+}
+
+static void dc_area_free ( DiskCacheArea *area )
+{
+  g_free ( area->root );
+  g_free ( area->prefix );
+  g_free ( area->index_file );
+  g_hash_table_destroy ( area->access );
+  g_mutex_clear ( &area->mutex );
+  g_free ( area );
+}
+
+void a_diskcache_init ( void )
+{
+  a_preferences_register ( &prefs[0], (VikLayerParamData){0}, VIKING_PREFERENCES_GROUP_KEY );
+  dc_areas = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)dc_area_free );
+}
+
+/**
+ * Read the index of when tiles were last used, keeping the later of any times already known
+ * Must be called with the area lock held
+ */
+static void dc_index_load ( DiskCacheArea *area )
+{
+  gchar *contents = NULL;
+  area->loaded = TRUE;
+  if ( !g_file_get_contents ( area->index_file, &contents, NULL, NULL ) )
+    return;
+  // Each line is the time then the relative path
+  gchar *line = contents;
+  while ( line && *line ) {
+    gchar *eol = strchr ( line, '\n' );
+    if ( eol )
+      *eol = '\0';
+    gchar *path = NULL;
+    guint64 used = g_ascii_strtoull ( line, &path, 10 );
+    if ( path && *path == ' ' && path[1] ) {
+      path++;
+      if ( used > GPOINTER_TO_UINT(g_hash_table_lookup ( area->access, path )) )
+        g_hash_table_insert ( area->access, g_strdup ( path ), GUINT_TO_POINTER((guint32)used) );
+    }
+    line = eol ? eol + 1 : NULL;
+  }
+  g_free ( contents );
+}
+
+/**
+ * Must be called with the area lock held
+ */
+static void dc_index_save ( DiskCacheArea *area )
+{
+  if ( !area->dirty )
+    return;
+  GString *gs = g_string_sized_new ( g_hash_table_size ( area->access ) * 32 );
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, area->access );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+    g_string_append_printf ( gs, "%u %s\n", GPOINTER_TO_UINT(value), (const gchar*)key );
+  GError *error = NULL;
+  if ( g_file_set_contents ( area->index_file, gs->str, gs->len, &error ) )
+    area->dirty = FALSE;
+  else {
+    g_debug ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+  }
+  g_string_free ( gs, TRUE );
+}
+
+void a_diskcache_uninit ( void )
+{
+  if ( !dc_areas )
+    return;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, dc_areas );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    DiskCacheArea *area = value;
+    g_mutex_lock ( &area->mutex );
+    if ( area->dirty ) {
+      // Keep any times recorded by a previous run that have not been read in yet
+      if ( !area->loaded )
+        dc_index_load ( area );
+      dc_index_save ( area );
+    }
+    g_mutex_unlock ( &area->mutex );
+  }
+  // NB Not freed, as a background check may still be running
+}
+
+DiskCacheArea *a_diskcache_area_get ( const gchar *root, const gchar *prefix )
+{
+  if ( !dc_areas )
+    return NULL;
+  gchar *key = g_strconcat ( root, "\n", prefix ? prefix : "", NULL );
+  g_mutex_lock ( &dc_mutex );
+  DiskCacheArea *area = g_hash_table_lookup ( dc_areas, key );
+  if ( !area ) {
+    area = g_new0 ( DiskCacheArea, 1 );
+    area->root = g_strdup ( root );
+    area->prefix = g_strdup ( prefix );
+    area->index_file = prefix ? g_strconcat ( root, DC_INDEX_NAME "-", prefix, NULL ) : g_strconcat ( root, DC_INDEX_NAME, NULL );
+    g_mutex_init ( &area->mutex );
+    area->access = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+    g_hash_table_insert ( dc_areas, key, area );
+  }
+  else
+    g_free ( key );
+  g_mutex_unlock ( &dc_mutex );
+  return area;
+}
+
+void a_diskcache_area_used ( DiskCacheArea *area, const gchar *filename )
+{
+  // Only worth keeping the times when anything is being limited
+  if ( !area || !dc_quota() || !g_str_has_prefix ( filename, area->root ) )
+    return;
+  guint32 now = (guint32)(g_get_real_time () / G_USEC_PER_SEC);
+  const gchar *path = filename + strlen ( area->root );
+  g_mutex_lock ( &area->mutex );
+  // Only the day matters for deciding what to remove, which saves rewriting the index for every redraw
+  guint32 last = GPOINTER_TO_UINT(g_hash_table_lookup ( area->access, path ));
+  if ( now - last > 24*60*60 ) {
+    g_hash_table_insert ( area->access, g_strdup ( path ), GUINT_TO_POINTER(now) );
+    area->dirty = TRUE;
+  }
+  g_mutex_unlock ( &area->mutex );
+}
+
+static gboolean dc_is_zoom_dir ( const gchar *name )
+{
+  for ( const gchar *ptr = name; *ptr; ptr++ )
+    if ( !g_ascii_isdigit ( *ptr ) )
+      return FALSE;
+  return *name != '\0';
+}
+
+typedef struct {
+  DiskCacheArea *area;
+  GArray *files;    // dc_file_t
+  guint64 bytes;
+  gpointer threaddata;
+  guint count;
+  gboolean cancelled;
+} dc_scan_t;
+
+static void dc_scan_dir ( dc_scan_t *scan, const gchar *relpath )
+{
+  gchar *dirname = g_strconcat ( scan->area->root, relpath, NULL );
+  GDir *dir = g_dir_open ( dirname, 0, NULL );
+  if ( !dir ) {
+    g_free ( dirname );
+    return;
+  }
+  const gchar *name;
+  while ( !scan->cancelled && (name = g_dir_read_name ( dir )) ) {
+    // Hidden files include the index
+    if ( name[0] == '.' || g_str_has_suffix ( name, ".etag" ) )
+      continue;
+    if ( g_str_has_suffix ( name, ".tmp" ) ) {
+      gchar *fullpath = g_build_filename ( dirname, name, NULL );
+      GStatBuf sb;
+      if ( g_lstat ( fullpath, &sb ) == 0 && S_ISREG(sb.st_mode) && g_get_real_time() / G_USEC_PER_SEC - sb.st_mtime > DC_STALE_TMP_AGE )
+        (void)g_remove ( fullpath );
+      g_free ( fullpath );
+      continue;
+    }
+    if ( !relpath[0] ) {
+      if ( scan->area->prefix ? !g_str_has_prefix ( name, scan->area->prefix ) : !dc_is_zoom_dir ( name ) )
+        continue;
+    }
+    gchar *path = relpath[0] ? g_strconcat ( relpath, G_DIR_SEPARATOR_S, name, NULL ) : g_strdup ( name );
+    gchar *fullpath = g_build_filename ( dirname, name, NULL );
+    GStatBuf sb;
+    if ( g_lstat ( fullpath, &sb ) == 0 ) {
+      if ( S_ISDIR(sb.st_mode) ) {
+        dc_scan_dir ( scan, path );
+        g_free ( path );
+      }
+      else if ( S_ISREG(sb.st_mode) ) {
+        dc_file_t df = { path, sb.st_size, (guint32)sb.st_mtime };
+        g_array_append_val ( scan->files, df );
+        scan->bytes += sb.st_size;
+      }
+      else
+        g_free ( path );
+    }
+    else
+      g_free ( path );
+    g_free ( fullpath );
+    if ( (++scan->count & 0xff) == 0 && a_background_testcancel ( scan->threaddata ) )
+      scan->cancelled = TRUE;
+  }
+  g_dir_close ( dir );
+  g_free ( dirname );
+}
+
+static gint dc_file_compare ( gconstpointer a, gconstpointer b )
+{
+  guint32 ua = ((const dc_file_t*)a)->used;
+  guint32 ub = ((const dc_file_t*)b)->used;
+  return ua < ub ? -1 : ua > ub;
+}
+
+/**
+ * Remove the directories of the removed file, if now empty
+ */
+static void dc_remove_empty_dirs ( DiskCacheArea *area, const gchar *path )
+{
+  gchar *dir = g_path_get_dirname ( path );
+  while ( strcmp ( dir, "." ) ) {
+    gchar *fulldir = g_strconcat ( area->root, dir, NULL );
+    gboolean removed = g_rmdir ( fulldir ) == 0;
+    g_free ( fulldir );
+    if ( !removed )
+      break;
+    gchar *parent = g_path_get_dirname ( dir );
+    g_free ( dir );
+    dir = parent;
+  }
+  g_free ( dir );
+}
+
+static void dc_check_thread ( DiskCacheArea *area, gpointer threaddata )
+{
+  dc_scan_t scan = { area, g_array_new ( FALSE, FALSE, sizeof(dc_file_t) ), 0, threaddata, 0, FALSE };
+  dc_scan_dir ( &scan, "" );
+
+  g_mutex_lock ( &area->mutex );
+  if ( !area->loaded )
+    dc_index_load ( area );
+  // Only keep times for the tiles still present
+  GHashTable *access = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  for ( guint ii = 0; ii < scan.files->len; ii++ ) {
+    dc_file_t *df = &g_array_index ( scan.files, dc_file_t, ii );
+    guint32 used = GPOINTER_TO_UINT(g_hash_table_lookup ( area->access, df->path ));
+    if ( used ) {
+      g_hash_table_insert ( access, g_strdup ( df->path ), GUINT_TO_POINTER(used) );
+      df->used = MAX ( df->used, used );
+    }
+  }
+  if ( !scan.cancelled ) {
+    area->dirty = area->dirty || g_hash_table_size ( access ) != g_hash_table_size ( area->access );
+    g_hash_table_destroy ( area->access );
+    area->access = access;
+  }
+  else
+    g_hash_table_destroy ( access );
+  g_mutex_unlock ( &area->mutex );
+
+  guint64 quota = dc_quota ();
+  guint64 bytes = scan.bytes;
+  guint files = scan.files->len;
+  if ( !scan.cancelled && quota && bytes > quota ) {
+    g_array_sort ( scan.files, dc_file_compare );
+    guint64 target = quota / 100 * DC_TRIM_PERCENT;
+    for ( guint ii = 0; ii < scan.files->len && bytes > target; ii++ ) {
+      dc_file_t *df = &g_array_index ( scan.files, dc_file_t, ii );
+      gchar *fullpath = g_strconcat ( area->root, df->path, NULL );
+      if ( g_remove ( fullpath ) == 0 ) {
+        a_existcache_remove ( fullpath );
+        // Any ETag kept alongside is no longer of use
+        gchar *etag = g_strconcat ( fullpath, ".etag", NULL );
+        (void)g_remove ( etag );
+        g_free ( etag );
+        dc_remove_empty_dirs ( area, df->path );
+        bytes -= df->size;
+        files--;
+        g_mutex_lock ( &area->mutex );
+        area->removed_bytes += df->size;
+        area->removed_files++;
+        if ( g_hash_table_remove ( area->access, df->path ) )
+          area->dirty = TRUE;
+        g_mutex_unlock ( &area->mutex );
+      }
+      g_free ( fullpath );
+      if ( (ii & 0xff) == 0 && a_background_testcancel ( threaddata ) )
+        break;
+    }
+    g_debug ( "%s: %s%s now %" G_GUINT64_FORMAT " bytes", __FUNCTION__, area->root, area->prefix ? area->prefix : "", bytes );
+  }
+
+  g_mutex_lock ( &area->mutex );
+  if ( !scan.cancelled ) {
+    area->measured = TRUE;
+    area->bytes = bytes;
+    area->files = files;
+  }
+  dc_index_save ( area );
+  g_mutex_unlock ( &area->mutex );
+
+  for ( guint ii = 0; ii < scan.files->len; ii++ )
+    g_free ( g_array_index ( scan.files, dc_file_t, ii ).path );
+  g_array_free ( scan.files, TRUE );
+}
+
+static void dc_check_done ( DiskCacheArea *area )
+{
+  g_mutex_lock ( &area->mutex );
+  area->running = FALSE;
+  g_mutex_unlock ( &area->mutex );
+}
+
+/**
+ * a_diskcache_area_check:
+ *
+ * Only does anything when a limit is set, and not if checked recently
+ */
+void a_diskcache_area_check ( DiskCacheArea *area )
+{
+  if ( !area || !dc_quota() )
+    return;
+  gint64 now = g_get_monotonic_time ();
+  g_mutex_lock ( &area->mutex );
+  gboolean start = !area->running && ( !area->last_check || now - area->last_check > DC_CHECK_INTERVAL );
+  if ( start ) {
+    area->running = TRUE;
+    area->last_check = now;
+  }
+  g_mutex_unlock ( &area->mutex );
+  if ( !start )
+    return;
+
+  gchar *msg = g_strdup_printf ( _("Checking map disk cache %s%s"), area->root, area->prefix ? area->prefix : "" );
+  a_background_thread_with_priority ( BACKGROUND_POOL_LOCAL, BACKGROUND_PRIORITY_BULK, NULL, msg,
+                                      (vik_thr_func) dc_check_thread, area,
+                                      (vik_thr_free_func) dc_check_done, (vik_thr_free_func) dc_check_done, 1 );
+  g_free ( msg );
+}
+
+static gchar *dc_usage_string ( guint64 bytes, guint files, guint64 removed_bytes, guint removed_files )
+{
+  gchar *size = g_format_size ( bytes );
+  gchar *removed = g_format_size ( removed_bytes );
+  guint64 quota = dc_quota ();
+  gchar *limit = quota ? g_format_size ( quota ) : g_strdup ( _("no limit") );
+  gchar *msg = g_strdup_printf ( _("%s in %u tiles (%s). Removed %u tiles, %s"), size, files, limit, removed_files, removed );
+  g_free ( limit );
+  g_free ( removed );
+  g_free ( size );
+  return msg;
+}
+
+/**
+ * a_diskcache_area_usage_string:
+ *
+ * Returns: A newly allocated description of the space used by the area
+ */
+gchar *a_diskcache_area_usage_string ( DiskCacheArea *area )
+{
+  if ( !area )
+    return g_strdup ( _("Not applicable") );
+  g_mutex_lock ( &area->mutex );
+  gchar *msg = area->measured ? dc_usage_string ( area->bytes, area->files, area->removed_bytes, area->removed_files ) :
+                                g_strdup ( dc_quota() ? _("Not yet measured") : _("Not measured as there is no limit") );
+  g_mutex_unlock ( &area->mutex );
+  return msg;
+}
+
+/**
+ * a_diskcache_usage_string:
+ *
+ * Returns: A newly allocated description of the space used by all the areas measured so far
+ */
+gchar *a_diskcache_usage_string ( void )
+{
+  guint64 bytes = 0, removed_bytes = 0;
+  guint files = 0, removed_files = 0;
+  if ( dc_areas ) {
+    g_mutex_lock ( &dc_mutex );
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init ( &iter, dc_areas );
+    while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+      DiskCacheArea *area = value;
+      g_mutex_lock ( &area->mutex );
+      bytes += area->bytes;
+      files += area->files;
+      removed_bytes += area->removed_bytes;
+      removed_files += area->removed_files;
+      g_mutex_unlock ( &area->mutex );
+    }
+    g_mutex_unlock ( &dc_mutex );
+  }
+  return dc_usage_string ( bytes, files, removed_bytes, removed_files );
+}
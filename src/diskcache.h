@@ -0,0 +1,47 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_DISKCACHE_H
+#define __VIKING_DISKCACHE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Keeping the tile files of each map source on disk within a size limit,
+//  removing the least recently used ones first
+typedef struct _DiskCacheArea DiskCacheArea;
+
+void a_diskcache_init ( void );
+void a_diskcache_uninit ( void );
+
+// The tiles under root (which ends with a separator) in top level entries starting with prefix,
+//  or if prefix is NULL, in top level entries that are all digits (i.e. zoom levels)
+// Areas last until uninit, so the pointer may be kept
+DiskCacheArea *a_diskcache_area_get ( const gchar *root, const gchar *prefix );
+// Record the tile file has been used - safe to call from any thread
+void a_diskcache_area_used ( DiskCacheArea *area, const gchar *filename );
+// Start removing old tiles in the background if the area may be over its limit
+void a_diskcache_area_check ( DiskCacheArea *area );
+gchar *a_diskcache_area_usage_string ( DiskCacheArea *area );
+gchar *a_diskcache_usage_string ( void );
+
+G_END_DECLS
+
+#endif
@@ -36,6 +36,10 @@
 #ifdef HAVE_UTIME_H
 #include <utime.h>
 #endif
+#include <fcntl.h>
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <glib/gi18n.h>
@@ -48,6 +52,9 @@
 #include "preferences.h"
 #include "globals.h"
 #include "vik_compat.h"
+#include "trace.h"
+#include "existcache.h"
+#include "peercache.h"
 
 /**
  * a_download_file_options_free:
@@ -121,8 +128,10 @@ gboolean a_check_kml_file(FILE* f)
   return check_file_first_line(f, kml_str);
 }
 
-static GList *file_list = NULL;
-static GMutex *file_list_mutex = NULL;
+// Files being downloaded, split by hash so concurrent downloads rarely wait on the same lock
+#define DOWNLOAD_CLAIM_SHARDS 16
+static GHashTable *claims[DOWNLOAD_CLAIM_SHARDS];
+static GMutex *claims_mutex[DOWNLOAD_CLAIM_SHARDS];
 
 /* spin button scales */
 static VikLayerParamScale params_scales[] = {
@@ -150,33 +159,48 @@ static VikLayerParam prefs[] = {
 void a_download_init (void)
 {
 	a_preferences_register ( prefs, (VikLayerParamData){0}, VIKING_PREFERENCES_GROUP_KEY );
-	file_list_mutex = vik_mutex_new();
+	for ( guint ii = 0; ii < DOWNLOAD_CLAIM_SHARDS; ii++ ) {
+		claims[ii] = g_hash_table_new ( g_str_hash, g_str_equal );
+		claims_mutex[ii] = vik_mutex_new();
+	}
 }
 
 void a_download_uninit (void)
 {
-	vik_mutex_free(file_list_mutex);
+	for ( guint ii = 0; ii < DOWNLOAD_CLAIM_SHARDS; ii++ ) {
+		g_hash_table_destroy ( claims[ii] );
+		vik_mutex_free ( claims_mutex[ii] );
+	}
 }
 
-static gboolean lock_file(const char *fn)
+/**
+ * Claim the file for downloading, so only one download of it is made at a time
+ * The filename must stay valid until unclaim_file()
+ *
+ * Returns: FALSE if the file is already being downloaded
+ */
+static gboolean claim_file(const char *fn)
 {
-	gboolean locked = FALSE;
-	g_mutex_lock(file_list_mutex);
-	if (g_list_find_custom(file_list, fn, (GCompareFunc)g_strcmp0) == NULL)
-	{
-		// The filename is not yet locked
-		file_list = g_list_append(file_list, (gpointer)fn),
-		locked = TRUE;
-	}
-	g_mutex_unlock(file_list_mutex);
-	return locked;
+	guint shard = g_str_hash ( fn ) % DOWNLOAD_CLAIM_SHARDS;
+	VIK_TRACE ( "download", "claims_mutex", TRACE_PHASE_BEGIN );
+	g_mutex_lock ( claims_mutex[shard] );
+	VIK_TRACE ( "download", "claims_mutex", TRACE_PHASE_END );
+	// Not replacing the key of an existing claim, as that belongs to the other download
+	gboolean claimed = !g_hash_table_contains ( claims[shard], fn );
+	if ( claimed )
+		g_hash_table_add ( claims[shard], (gpointer)fn );
+	g_mutex_unlock ( claims_mutex[shard] );
+	if ( !claimed )
+		VIK_TRACE ( "download", "claim busy", TRACE_PHASE_INSTANT );
+	return claimed;
 }
 
-static void unlock_file(const char *fn)
+static void unclaim_file(const char *fn)
 {
-	g_mutex_lock(file_list_mutex);
-	file_list = g_list_remove(file_list, (gconstpointer)fn);
-	g_mutex_unlock(file_list_mutex);
+	guint shard = g_str_hash ( fn ) % DOWNLOAD_CLAIM_SHARDS;
+	g_mutex_lock ( claims_mutex[shard] );
+	g_hash_table_remove ( claims[shard], fn );
+	g_mutex_unlock ( claims_mutex[shard] );
 }
 
 /**
@@ -332,15 +356,40 @@ static void set_etag(const char *fn, const char *fntmp, CurlDownloadOptions *cdo
   }
 }
 
-static DownloadResult_t download( const char *hostname, const char *uri, const char *fn, DownloadFileOptions *options, gboolean ftp, void *handle)
-{
-  FILE *f;
+/**
+ * State of a single file download, from preparing the temporary file to moving it into place
+ */
+typedef struct {
+  gchar *fn;
   gchar *tmpfilename;
-  gboolean failure = FALSE;
-  CurlDownloadOptions cdo = {0, NULL, NULL};
+  FILE *f;
+  DownloadFileOptions *options;
+  CurlDownloadOptions cdo;
+  gboolean refresh; // Replacing an existing file, so only the server will do
+} DownloadJob;
 
-  /* Check file */
-  if ( g_file_test ( fn, G_FILE_TEST_EXISTS ) == TRUE )
+static void download_job_clear ( DownloadJob *job )
+{
+  g_free ( job->fn );
+  g_free ( job->tmpfilename );
+  g_free ( job->cdo.etag );
+  g_free ( job->cdo.new_etag );
+}
+
+/**
+ * Perform the checks before downloading and open the temporary file to download into
+ *
+ * Returns: DOWNLOAD_SUCCESS if the transfer should now be performed,
+ *  otherwise the result of the download (and there is nothing further to do).
+ */
+static DownloadResult_t download_begin ( const char *hostname, const char *uri, DownloadJob *job )
+{
+  const char *fn = job->fn;
+  DownloadFileOptions *options = job->options;
+
+  /* Check file - also getting its modified time in the same call */
+  GStatBuf buf;
+  if ( g_stat ( fn, &buf ) == 0 )
   {
     if (options == NULL || (!options->check_file_server_time &&
                             !options->use_etag)) {
@@ -349,9 +398,6 @@ static DownloadResult_t download( const char *hostname, const char *uri, const c
     }
 
     time_t tile_age = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "download_tile_age")->u;
-    /* Get the modified time of this file */
-    GStatBuf buf;
-    (void)g_stat ( fn, &buf );
     time_t file_time = buf.st_mtime;
     if ( (time(NULL) - file_time) < tile_age ) {
       /* File cache is too recent, so return */
@@ -359,11 +405,12 @@ static DownloadResult_t download( const char *hostname, const char *uri, const c
     }
 
     if (options != NULL && options->check_file_server_time) {
-      cdo.time_condition = file_time;
+      job->cdo.time_condition = file_time;
     }
     if (options != NULL && options->use_etag) {
-      get_etag(fn, &cdo);
+      get_etag(fn, &job->cdo);
     }
+    job->refresh = TRUE;
 
   } else {
     gchar *dir = g_path_get_dirname ( fn );
@@ -378,27 +425,40 @@ static DownloadResult_t download( const char *hostname, const char *uri, const c
     return DOWNLOAD_PARAMETERS_ERROR;
   }
 
-  tmpfilename = g_strdup_printf("%s.tmp", fn);
-  if (!lock_file ( tmpfilename ) )
+  if ( !claim_file ( fn ) )
   {
-    g_debug("%s: Couldn't take lock on temporary file \"%s\"", __FUNCTION__, tmpfilename);
-    g_free ( tmpfilename );
-    if (options->use_etag)
-      g_free ( cdo.etag );
+    g_debug("%s: Already downloading \"%s\"", __FUNCTION__, fn);
     return DOWNLOAD_FILE_WRITE_ERROR;
   }
-  f = g_fopen ( tmpfilename, "w+b" );  /* truncate file and open it */
-  if ( ! f ) {
-    g_warning("Couldn't open temporary file \"%s\": %s", tmpfilename, g_strerror(errno));
-    g_free ( tmpfilename );
-    if (options->use_etag)
-      g_free ( cdo.etag );
+  // A name of its own, so nothing else can be writing to it
+  //  and the file only appears in place once complete, when renamed
+  job->tmpfilename = g_strdup_printf("%s.XXXXXX.tmp", fn);
+  // With the usual permissions, as g_mkstemp() would make the tile only readable by its owner
+  gint fd = g_mkstemp_full ( job->tmpfilename, O_RDWR | O_BINARY, 0666 );
+  if ( fd != -1 ) {
+    job->f = fdopen ( fd, "w+b" );
+    if ( !job->f ) {
+      (void)g_close ( fd, NULL );
+      (void)g_remove ( job->tmpfilename );
+    }
+  }
+  if ( ! job->f ) {
+    g_warning("Couldn't open temporary file \"%s\": %s", job->tmpfilename, g_strerror(errno));
+    unclaim_file ( fn );
     return DOWNLOAD_FILE_WRITE_ERROR;
   }
+  return DOWNLOAD_SUCCESS;
+}
 
-  /* Call the backend function */
-  CURL_download_t ret = curl_download_get_url ( hostname, uri, f, options, ftp, &cdo, handle );
-
+/**
+ * Check the downloaded temporary file and move it into place
+ */
+static DownloadResult_t download_end ( DownloadJob *job, CURL_download_t ret )
+{
+  const char *fn = job->fn;
+  const char *tmpfilename = job->tmpfilename;
+  DownloadFileOptions *options = job->options;
+  gboolean failure = FALSE;
   DownloadResult_t result = DOWNLOAD_SUCCESS;
 
   if (ret != CURL_DOWNLOAD_NO_ERROR && ret != CURL_DOWNLOAD_NO_NEWER_FILE) {
@@ -407,30 +467,26 @@ static DownloadResult_t download( const char *hostname, const char *uri, const c
     result = DOWNLOAD_HTTP_ERROR;
   }
 
-  if (!failure && options != NULL && options->check_file != NULL && ! options->check_file(f)) {
+  if (!failure && options != NULL && options->check_file != NULL && ! options->check_file(job->f)) {
     g_debug("%s: file content checking failed", __FUNCTION__);
     failure = TRUE;
     result = DOWNLOAD_CONTENT_ERROR;
   }
 
-  fclose ( f );
-  f = NULL;
+  fclose ( job->f );
+  job->f = NULL;
 
   if (failure)
   {
     g_warning(_("Download error: %s"), fn);
     if ( g_remove ( tmpfilename ) != 0 )
       g_warning( ("Failed to remove: %s"), tmpfilename);
-    unlock_file ( tmpfilename );
-    g_free ( tmpfilename );
-    if ( options != NULL && options->use_etag ) {
-      g_free ( cdo.etag );
-      g_free ( cdo.new_etag );
-    }
+    unclaim_file ( fn );
     return result;
   }
 
   if (ret == CURL_DOWNLOAD_NO_NEWER_FILE)  {
+    result = DOWNLOAD_NOT_MODIFIED;
     (void)g_remove ( tmpfilename );
      // update mtime of local copy
      // Not security critical, thus potential Time of Check Time of Use race condition is not bad
@@ -439,27 +495,46 @@ static DownloadResult_t download( const char *hostname, const char *uri, const c
        g_warning ( "%s couldn't set time on: %s", __FUNCTION__, fn );
   } else {
     if ( options != NULL && options->convert_file )
-      options->convert_file ( tmpfilename );
+      options->convert_file ( job->tmpfilename );
 
     if ( options != NULL && options->use_etag ) {
-      if ( cdo.new_etag ) {
+      if ( job->cdo.new_etag ) {
         /* server returned an etag value */
-        set_etag(fn, tmpfilename, &cdo);
+        set_etag(fn, tmpfilename, &job->cdo);
       }
     }
 
      /* move completely-downloaded file to permanent location */
      if ( g_rename ( tmpfilename, fn ) )
         g_warning ("%s: file rename failed [%s] to [%s]", __FUNCTION__, tmpfilename, fn );
+     else
+        a_existcache_add ( fn );
   }
-  unlock_file ( tmpfilename );
-  g_free ( tmpfilename );
+  unclaim_file ( fn );
+  return result;
+}
 
-  if ( options != NULL && options->use_etag ) {
-    g_free ( cdo.etag );
-    g_free ( cdo.new_etag );
+static DownloadResult_t download( const char *hostname, const char *uri, const char *fn, DownloadFileOptions *options, gboolean ftp, void *handle)
+{
+  DownloadJob job = { g_strdup(fn), NULL, NULL, options, {0, NULL, NULL}, FALSE };
+
+  DownloadResult_t result = download_begin ( hostname, uri, &job );
+  if ( result == DOWNLOAD_SUCCESS ) {
+    CURL_download_t ret;
+    if ( !job.refresh && a_peercache_fetch ( fn, job.f ) )
+      ret = CURL_DOWNLOAD_NO_ERROR;
+    else {
+      /* Call the backend function */
+      VIK_TRACE ( "download", "curl", TRACE_PHASE_BEGIN );
+      ret = curl_download_get_url ( hostname, uri, job.f, options, ftp, &job.cdo, handle );
+      VIK_TRACE_ARG ( "download", "curl", TRACE_PHASE_END, "result", ret );
+    }
+    VIK_TRACE ( "download", "file write", TRACE_PHASE_BEGIN );
+    result = download_end ( &job, ret );
+    VIK_TRACE_ARG ( "download", "file write", TRACE_PHASE_END, "result", result );
   }
-  return DOWNLOAD_SUCCESS;
+  download_job_clear ( &job );
+  return result;
 }
 
 /**
@@ -486,6 +561,94 @@ void a_download_handle_cleanup ( void *handle )
   curl_download_handle_cleanup ( handle );
 }
 
+typedef struct {
+  DownloadJob job;
+  DownloadBatchDoneFunc done;
+  gpointer user_data;
+} BatchJob;
+
+static void batch_job_free ( BatchJob *bj )
+{
+  download_job_clear ( &bj->job );
+  if ( bj->job.options )
+    a_download_file_options_free ( bj->job.options );
+  g_free ( bj );
+}
+
+static gboolean batch_job_done ( CURL_download_t ret, gpointer user_data )
+{
+  BatchJob *bj = (BatchJob*)user_data;
+  VIK_TRACE_ARG ( "download", "batch transfer done", TRACE_PHASE_INSTANT, "result", ret );
+  VIK_TRACE ( "download", "file write", TRACE_PHASE_BEGIN );
+  DownloadResult_t result = download_end ( &bj->job, ret );
+  VIK_TRACE_ARG ( "download", "file write", TRACE_PHASE_END, "result", result );
+  gboolean carry_on = bj->done ( result, bj->user_data );
+  batch_job_free ( bj );
+  return carry_on;
+}
+
+/**
+ * a_download_batch_new:
+ *
+ * Create a batch for downloading many files concurrently,
+ *  sharing connections to the same host.
+ * Free with a_download_batch_free().
+ */
+void *a_download_batch_new ()
+{
+  return curl_download_multi_new ();
+}
+
+/**
+ * a_http_download_batch_add:
+ * @batch: The batch created by a_download_batch_new()
+ * @opt:   Download options - the batch takes ownership of these
+ * @done:  Called exactly once with the result of this download;
+ *         either immediately (e.g. if no download is required) or from a_download_batch_run()
+ *
+ * Same as a_http_download_get_url() but the transfer is queued in the batch.
+ */
+void a_http_download_batch_add ( void *batch, const char *hostname, const char *uri, const char *fn, DownloadFileOptions *opt, DownloadBatchDoneFunc done, gpointer user_data )
+{
+  BatchJob *bj = g_malloc0 ( sizeof(BatchJob) );
+  bj->job.fn = g_strdup ( fn );
+  bj->job.options = opt;
+  bj->done = done;
+  bj->user_data = user_data;
+
+  DownloadResult_t result = download_begin ( hostname, uri, &bj->job );
+  if ( result == DOWNLOAD_SUCCESS ) {
+    if ( !bj->job.refresh && a_peercache_fetch ( fn, bj->job.f ) ) {
+      (void)done ( download_end ( &bj->job, CURL_DOWNLOAD_NO_ERROR ), user_data );
+      batch_job_free ( bj );
+      return;
+    }
+    if ( curl_download_multi_add ( (CurlMultiDownload*)batch, hostname, uri, bj->job.f, opt, FALSE, &bj->job.cdo, batch_job_done, bj ) )
+      return;
+    result = download_end ( &bj->job, CURL_DOWNLOAD_ERROR );
+  }
+  (void)done ( result, user_data );
+  batch_job_free ( bj );
+}
+
+/**
+ * a_download_batch_run:
+ * @max_pending: Return once no more than this number of downloads are outstanding
+ *               (so more can be added to keep the connections busy). Use 0 to complete them all.
+ *
+ * Returns: 0 when successful or -1 if the downloads have been abandoned,
+ *  either by a done function returning FALSE or the program stopping.
+ */
+gint a_download_batch_run ( void *batch, guint max_pending )
+{
+  return curl_download_multi_perform ( (CurlMultiDownload*)batch, max_pending );
+}
+
+void a_download_batch_free ( void *batch )
+{
+  curl_download_multi_free ( (CurlMultiDownload*)batch );
+}
+
 /**
  * a_download_url_to_tmp_file:
  * @uri:         The URI (Uniform Resource Identifier)
@@ -96,6 +96,7 @@ typedef enum {
   DOWNLOAD_CONTENT_ERROR = -1,
   DOWNLOAD_SUCCESS = 0,
   DOWNLOAD_NOT_REQUIRED = 1, // Also 'successful'. e.g. Because file already exists and no time checks used
+  DOWNLOAD_NOT_MODIFIED = 2, // Also 'successful'. Server confirmed the existing file is still current (so only its time is updated)
 } DownloadResult_t;
 
 /* TODO: convert to Glib */
@@ -104,6 +105,17 @@ DownloadResult_t a_ftp_download_get_url ( const char *hostname, const char *uri,
 void *a_download_handle_init ();
 void a_download_handle_cleanup ( void *handle );
 
+/**
+ * Called with the result of each download in a batch
+ * Return FALSE to abandon the remaining downloads
+ */
+typedef gboolean (*DownloadBatchDoneFunc) ( DownloadResult_t result, gpointer user_data );
+
+void *a_download_batch_new ();
+void a_http_download_batch_add ( void *batch, const char *hostname, const char *uri, const char *fn, DownloadFileOptions *opt, DownloadBatchDoneFunc done, gpointer user_data );
+gint a_download_batch_run ( void *batch, guint max_pending );
+void a_download_batch_free ( void *batch );
+
 gchar *a_download_uri_to_tmp_file ( const gchar *uri, DownloadFileOptions *options );
 
 G_END_DECLS
@@ -0,0 +1,318 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <gio/gio.h>
+#include "existcache.h"
+#include "settings.h"
+
+/*
+ * Drawing maps or DEM coverage tests for the files of every tile in view, most of which
+ *  may not exist. Each test is a filesystem lookup, which on network filesystems is slow.
+ * Instead each directory is listed once (which is a single request for all of its files),
+ *  and the names kept for a while, so each test is just a hash lookup.
+ *
+ * Files that Viking itself downloads or removes are kept up to date.
+ * Changes by other programs are seen once the listing expires,
+ *  or straight away when the directories are monitored.
+ */
+
+// Maximum number of directory listings kept
+#define VIK_SETTINGS_EXISTCACHE_DIRS "existence_cache_directories"
+#define EC_MAX_DIRS 1024
+// Seconds a listing is used for, when the directory is not monitored
+#define VIK_SETTINGS_EXISTCACHE_TTL "existence_cache_ttl"
+#define EC_TTL 60
+#define VIK_SETTINGS_EXISTCACHE_MONITOR "existence_cache_monitor"
+
+// Bound on the total names kept
+#define EC_MAX_NAMES 1000000
+// Directories with more files than this are not listed, as reading them would cost more than it saves
+#define EC_MAX_DIR_NAMES 100000
+
+typedef struct {
+  gchar *dirname;
+  GHashTable *names;     // Set of file names, or NULL if the directory does not exist
+  gboolean too_big;      // Too many files to list, so use a stat per file
+  gint64 read_time;
+  GFileMonitor *monitor; // Optional
+  GList link;            // Embedded node in the LRU queue
+} ec_dir_t;
+
+static GMutex ec_mutex;
+static GHashTable *ec_dirs = NULL; // dirname -> ec_dir_t
+static GQueue ec_lru = G_QUEUE_INIT; // Head is the most recently used
+static guint ec_names = 0;
+
+static guint ec_max_dirs = EC_MAX_DIRS;
+static gint64 ec_ttl = EC_TTL * G_USEC_PER_SEC;
+static gboolean ec_monitor = FALSE;
+
+static void ec_dir_free ( ec_dir_t *ed )
+{
+  if ( ed->monitor ) {
+    g_file_monitor_cancel ( ed->monitor );
+    g_object_unref ( ed->monitor );
+  }
+  if ( ed->names )
+    g_hash_table_destroy ( ed->names );
+  g_free ( ed->dirname );
+  g_free ( ed );
+}
+
+/**
+ * Must be called with the lock held
+ */
+static void ec_dir_remove ( ec_dir_t *ed )
+{
+  g_queue_unlink ( &ec_lru, &ed->link );
+  if ( ed->names )
+    ec_names -= g_hash_table_size ( ed->names );
+  g_hash_table_steal ( ec_dirs, ed->dirname );
+  ec_dir_free ( ed );
+}
+
+static void ec_dir_changed_cb ( GFileMonitor *monitor, GFile *file, GFile *other_file, GFileMonitorEvent event, gpointer user_data )
+{
+  if ( event != G_FILE_MONITOR_EVENT_CREATED && event != G_FILE_MONITOR_EVENT_DELETED )
+    return;
+  gchar *path = g_file_get_path ( file );
+  if ( path ) {
+    if ( event == G_FILE_MONITOR_EVENT_CREATED )
+      a_existcache_add ( path );
+    else
+      a_existcache_remove ( path );
+    g_free ( path );
+  }
+}
+
+/**
+ * a_existcache_init:
+ *
+ * Without this the functions still work, but always go to the filesystem
+ */
+void a_existcache_init ( void )
+{
+  gint tmp;
+  if ( a_settings_get_integer ( VIK_SETTINGS_EXISTCACHE_DIRS, &tmp ) )
+    ec_max_dirs = MAX ( 0, tmp );
+  if ( a_settings_get_integer ( VIK_SETTINGS_EXISTCACHE_TTL, &tmp ) )
+    ec_ttl = (gint64)MAX ( 0, tmp ) * G_USEC_PER_SEC;
+  gboolean btmp;
+  if ( a_settings_get_boolean ( VIK_SETTINGS_EXISTCACHE_MONITOR, &btmp ) )
+    ec_monitor = btmp;
+
+  if ( ec_max_dirs )
+    ec_dirs = g_hash_table_new ( g_str_hash, g_str_equal );
+}
+
+void a_existcache_uninit ( void )
+{
+  if ( !ec_dirs )
+    return;
+  a_existcache_flush ();
+  g_mutex_lock ( &ec_mutex );
+  g_hash_table_destroy ( ec_dirs );
+  ec_dirs = NULL;
+  g_mutex_unlock ( &ec_mutex );
+}
+
+/**
+ * Returns: The length of the directory part of the filename, or -1 if there is none
+ */
+static gssize ec_dirname_len ( const gchar *filename )
+{
+  const gchar *sep = strrchr ( filename, G_DIR_SEPARATOR );
+#ifdef G_OS_WIN32
+  const gchar *sep2 = strrchr ( filename, '/' );
+  if ( sep2 > sep )
+    sep = sep2;
+#endif
+  if ( !sep || !sep[1] )
+    return -1;
+  // Keep the separator for the root directory
+  return sep == filename ? 1 : sep - filename;
+}
+
+/**
+ * Read the names of the files in the directory, in one pass
+ */
+static GHashTable *ec_dir_read ( const gchar *dirname, gboolean *too_big )
+{
+  GDir *dir = g_dir_open ( dirname, 0, NULL );
+  if ( !dir )
+    return NULL;
+  GHashTable *names = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  const gchar *name;
+  while ( (name = g_dir_read_name ( dir )) ) {
+    if ( g_hash_table_size ( names ) >= EC_MAX_DIR_NAMES ) {
+      *too_big = TRUE;
+      break;
+    }
+    g_hash_table_add ( names, g_strdup ( name ) );
+  }
+  g_dir_close ( dir );
+  return names;
+}
+
+/**
+ * Must be called with the lock held
+ */
+static void ec_trim ( ec_dir_t *keep )
+{
+  while ( ec_lru.length > ec_max_dirs || ec_names > EC_MAX_NAMES ) {
+    ec_dir_t *ed = ec_lru.tail->data;
+    if ( ed == keep )
+      break;
+    ec_dir_remove ( ed );
+  }
+}
+
+/**
+ * a_existcache_file_exists:
+ *
+ * Safe to call from any thread
+ *
+ * Returns: Whether the file exists, as of the last listing of its directory
+ */
+gboolean a_existcache_file_exists ( const gchar *filename )
+{
+  gssize len = ec_dirname_len ( filename );
+  if ( !ec_dirs || len < 0 )
+    return g_file_test ( filename, G_FILE_TEST_EXISTS );
+
+  gchar *dirname = g_strndup ( filename, len );
+  const gchar *basename = filename + len + (len == 1 && filename[0] == G_DIR_SEPARATOR ? 0 : 1);
+  gboolean ans;
+
+  g_mutex_lock ( &ec_mutex );
+  ec_dir_t *ed = g_hash_table_lookup ( ec_dirs, dirname );
+  if ( ed && !ed->monitor && ec_ttl && g_get_monotonic_time() - ed->read_time > ec_ttl ) {
+    ec_dir_remove ( ed );
+    ed = NULL;
+  }
+  if ( ed ) {
+    g_queue_unlink ( &ec_lru, &ed->link );
+    g_queue_push_head_link ( &ec_lru, &ed->link );
+    gboolean too_big = ed->too_big;
+    ans = ed->names && g_hash_table_contains ( ed->names, basename );
+    g_mutex_unlock ( &ec_mutex );
+    g_free ( dirname );
+    return too_big ? g_file_test ( filename, G_FILE_TEST_EXISTS ) : ans;
+  }
+  g_mutex_unlock ( &ec_mutex );
+
+  // The slow part is done without holding the lock
+  gboolean too_big = FALSE;
+  GHashTable *names = ec_dir_read ( dirname, &too_big );
+  if ( too_big ) {
+    g_hash_table_destroy ( names );
+    names = NULL;
+    ans = g_file_test ( filename, G_FILE_TEST_EXISTS );
+  }
+  else
+    ans = names && g_hash_table_contains ( names, basename );
+
+  ed = g_new0 ( ec_dir_t, 1 );
+  ed->dirname = dirname;
+  ed->names = names;
+  ed->too_big = too_big;
+  ed->read_time = g_get_monotonic_time ();
+  ed->link.data = ed;
+  if ( ec_monitor && names ) {
+    GFile *gf = g_file_new_for_path ( dirname );
+    ed->monitor = g_file_monitor_directory ( gf, G_FILE_MONITOR_NONE, NULL, NULL );
+    if ( ed->monitor )
+      g_signal_connect ( ed->monitor, "changed", G_CALLBACK(ec_dir_changed_cb), NULL );
+    g_object_unref ( gf );
+  }
+
+  g_mutex_lock ( &ec_mutex );
+  if ( ec_dirs && !g_hash_table_contains ( ec_dirs, dirname ) ) {
+    g_hash_table_insert ( ec_dirs, ed->dirname, ed );
+    g_queue_push_head_link ( &ec_lru, &ed->link );
+    if ( names )
+      ec_names += g_hash_table_size ( names );
+    ec_trim ( ed );
+    ed = NULL;
+  }
+  g_mutex_unlock ( &ec_mutex );
+
+  // Another thread read it meanwhile
+  if ( ed )
+    ec_dir_free ( ed );
+  return ans;
+}
+
+static void ec_update ( const gchar *filename, gboolean exists )
+{
+  gssize len = ec_dirname_len ( filename );
+  if ( !ec_dirs || len < 0 )
+    return;
+
+  gchar *dirname = g_strndup ( filename, len );
+  const gchar *basename = filename + len + (len == 1 && filename[0] == G_DIR_SEPARATOR ? 0 : 1);
+
+  g_mutex_lock ( &ec_mutex );
+  ec_dir_t *ed = g_hash_table_lookup ( ec_dirs, dirname );
+  if ( ed && !ed->too_big ) {
+    if ( exists ) {
+      // e.g. the directory has just been created for a download
+      if ( !ed->names )
+        ed->names = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+      if ( g_hash_table_add ( ed->names, g_strdup ( basename ) ) )
+        ec_names++;
+    }
+    else if ( ed->names && g_hash_table_remove ( ed->names, basename ) )
+      ec_names--;
+  }
+  g_mutex_unlock ( &ec_mutex );
+  g_free ( dirname );
+}
+
+/**
+ * a_existcache_add:
+ *
+ * Record that the file now exists
+ */
+void a_existcache_add ( const gchar *filename )
+{
+  ec_update ( filename, TRUE );
+}
+
+/**
+ * a_existcache_remove:
+ *
+ * Record that the file no longer exists
+ */
+void a_existcache_remove ( const gchar *filename )
+{
+  ec_update ( filename, FALSE );
+}
+
+void a_existcache_flush ( void )
+{
+  g_mutex_lock ( &ec_mutex );
+  while ( ec_lru.head )
+    ec_dir_remove ( ec_lru.head->data );
+  g_mutex_unlock ( &ec_mutex );
+}
@@ -0,0 +1,41 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_EXISTCACHE_H
+#define __VIKING_EXISTCACHE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Which files exist in the (tile or DEM) cache directories,
+//  learnt from one listing of each directory rather than a stat per file
+void a_existcache_init ( void );
+void a_existcache_uninit ( void );
+
+gboolean a_existcache_file_exists ( const gchar *filename );
+// For files created or removed by Viking itself
+void a_existcache_add ( const gchar *filename );
+void a_existcache_remove ( const gchar *filename );
+// Forget everything, e.g. as files may have been changed by other programs
+void a_existcache_flush ( void );
+
+G_END_DECLS
+
+#endif
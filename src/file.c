@@ -26,6 +26,7 @@
 #include "gpx.h"
 #include "kml.h"
 #include "tcx.h"
+#include "fit.h"
 #include "geojson.h"
 #include "babel.h"
 #include "gpsmapper.h"
@@ -37,8 +38,18 @@
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#include <errno.h>
+#include <fcntl.h>
+#ifdef WINDOWS
+#include <io.h>
+#endif
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
 
 #include "file.h"
+#include "trwbinary.h"
+#include "background.h"
 #include "misc/strtod.h"
 
 #define TEST_BOOLEAN(str) (! ((str)[0] == '\0' || (str)[0] == '0' || (str)[0] == 'n' || (str)[0] == 'N' || (str)[0] == 'f' || (str)[0] == 'F') )
@@ -49,6 +60,38 @@
 
 #define VIKING_FILE_VERSION 1
 
+/*
+ * Binary .vik file layout (little endian):
+ *   header: magic, u32 version, u32 number of blocks, u64 offset of the table of contents, u64 offset of the text
+ *   blocks: the binary layer data, each 8 byte aligned
+ *   table of contents: u64 offset and u64 length of each block
+ *   text: the normal .vik text, but with '~LayerBlock N' in place of the layer data of TrackWaypoint layers
+ * Having the text last means it can be read as normal until the end of the file.
+ */
+#define VIKBIN_MAGIC "VIKBIN\r\n"
+#define VIKBIN_MAGIC_LEN 8
+#define VIKBIN_HEADER_SIZE 32
+#define VIKBIN_VERSION 1
+
+typedef struct {
+  guint64 offset;
+  guint64 length;
+} FileBlock;
+
+typedef struct {
+  FILE *file;     // Where the blocks are written
+  guint64 offset; // Current position in file
+  GArray *toc;    // Of #FileBlock
+} FileBinWriter;
+
+typedef struct {
+  GBytes *bytes;      // The whole file
+  const guint8 *data;
+  gsize size;
+  guint32 n_blocks;
+  const guint8 *toc;
+} FileBinReader;
+
 typedef struct _Stack Stack;
 
 struct _Stack {
@@ -82,6 +125,15 @@ static gboolean check_magic ( FILE *f, const gchar *magic_number, guint magic_le
   return rv;
 }
 
+static gboolean check_fit_magic ( FILE *f )
+{
+  guint8 header[FIT_HEADER_MIN_SIZE];
+  size_t len = fread ( header, 1, sizeof(header), f );
+  gboolean rv = a_fit_check_header ( header, len );
+  while ( len > 0 ) /* the ol' pushback */
+    ungetc ( header[--len], f );
+  return rv;
+}
 
 static gboolean str_starts_with ( const gchar *haystack, const gchar *needle, guint16 len_needle, gboolean must_be_longer )
 {
@@ -125,7 +177,27 @@ void file_write_layer_param ( FILE *f, const gchar *name, VikLayerParamType type
       }
 }
 
-static void write_layer_params_and_data ( VikLayer *l, FILE *f, const gchar *dirpath )
+/**
+ * Append a block to the binary file
+ *
+ * Returns: The block number
+ */
+static guint file_bin_write_block ( FileBinWriter *bw, GByteArray *block )
+{
+  static const guint8 padding[8] = { 0 };
+  guint pad = (8 - (bw->offset % 8)) % 8;
+  if ( pad )
+    (void)fwrite ( padding, 1, pad, bw->file );
+  bw->offset += pad;
+
+  FileBlock fb = { bw->offset, block->len };
+  (void)fwrite ( block->data, 1, block->len, bw->file );
+  bw->offset += block->len;
+  g_array_append_val ( bw->toc, fb );
+  return bw->toc->len - 1;
+}
+
+static void write_layer_params_and_data ( VikLayer *l, FILE *f, const gchar *dirpath, FileBinWriter *bw )
 {
   VikLayerParam *params = vik_layer_get_interface(l->type)->params;
   VikLayerFuncGetParam get_param = vik_layer_get_interface(l->type)->get_param;
@@ -144,7 +216,22 @@ static void write_layer_params_and_data ( VikLayer *l, FILE *f, const gchar *dir
       file_write_layer_param(f, params[i].name, params[i].type, data);
     }
   }
-  if ( vik_layer_get_interface(l->type)->write_file_data )
+  if ( bw && l->type == VIK_LAYER_TRW && !vik_trw_layer_is_external(VIK_TRW_LAYER(l)) )
+  {
+    GByteArray *block = g_byte_array_new ();
+    // A layer still to be loaded is copied as is
+    GBytes *pending = vik_trw_layer_get_pending_data ( VIK_TRW_LAYER(l) );
+    if ( pending ) {
+      gsize length;
+      gconstpointer data = g_bytes_get_data ( pending, &length );
+      g_byte_array_append ( block, data, length );
+    }
+    else
+      a_trwbinary_write_layer ( VIK_TRW_LAYER(l), block, dirpath );
+    fprintf ( f, "\n\n~LayerBlock %u\n", file_bin_write_block ( bw, block ) );
+    g_byte_array_free ( block, TRUE );
+  }
+  else if ( vik_layer_get_interface(l->type)->write_file_data )
   {
     fprintf ( f, "\n\n~LayerData\n" );
     vik_layer_get_interface(l->type)->write_file_data ( l, f, dirpath );
@@ -156,7 +243,10 @@ static void write_layer_params_and_data ( VikLayer *l, FILE *f, const gchar *dir
   */
 }
 
-static void file_write ( VikAggregateLayer *top, FILE *f, gpointer vp, const gchar *dirpath )
+/**
+ * @bw: When not NULL, TrackWaypoint layer data is written to the binary blocks instead of @f
+ */
+static void file_write ( VikAggregateLayer *top, FILE *f, gpointer vp, const gchar *dirpath, FileBinWriter *bw )
 {
   Stack *stack = NULL;
   VikLayer *current_layer;
@@ -192,13 +282,13 @@ static void file_write ( VikAggregateLayer *top, FILE *f, gpointer vp, const gch
       vik_viewport_get_draw_highlight(VIK_VIEWPORT(vp)) ? "t" : "f" );
 
   fprintf ( f, "\n~TopLayer %s\n", vik_layer_get_interface(VIK_LAYER(top)->type)->fixed_layer_name );
-  write_layer_params_and_data ( VIK_LAYER(top), f, dirpath );
+  write_layer_params_and_data ( VIK_LAYER(top), f, dirpath, bw );
 
   while (stack && stack->data)
   {
     current_layer = VIK_LAYER(((GList *)stack->data)->data);
     fprintf ( f, "\n~Layer %s\n", vik_layer_get_interface(current_layer->type)->fixed_layer_name );
-    write_layer_params_and_data ( current_layer, f, dirpath );
+    write_layer_params_and_data ( current_layer, f, dirpath, bw );
     if ( current_layer->type == VIK_LAYER_AGGREGATE && !vik_aggregate_layer_is_empty(VIK_AGGREGATE_LAYER(current_layer)) )
     {
       push(&stack);
@@ -270,7 +360,24 @@ static void string_list_set_param (gint i, GList *list, gpointer *layer_and_vp)
  * TODO flow up line number(s) / error messages of problems encountered...
  *
  */
-static gboolean file_read ( VikAggregateLayer *top, FILE *f, const gchar *dirpath, VikViewport *vp )
+static GBytes *file_bin_get_block ( FileBinReader *br, guint block )
+{
+  if ( !br || block >= br->n_blocks )
+    return NULL;
+  guint64 offset, len;
+  memcpy ( &offset, br->toc + block*16, sizeof(offset) );
+  memcpy ( &len, br->toc + block*16 + 8, sizeof(len) );
+  offset = GUINT64_FROM_LE ( offset );
+  len = GUINT64_FROM_LE ( len );
+  if ( offset > br->size || len > br->size - offset )
+    return NULL;
+  return g_bytes_new_from_bytes ( br->bytes, offset, len );
+}
+
+/**
+ * @br: The blocks of a binary file, otherwise NULL
+ */
+static gboolean file_read ( VikAggregateLayer *top, FILE *f, const gchar *dirpath, VikViewport *vp, FileBinReader *br )
 {
   Stack *stack = NULL;
   struct LatLon ll = { 0.0, 0.0 };
@@ -431,6 +538,19 @@ static gboolean file_read ( VikAggregateLayer *top, FILE *f, const gchar *dirpat
           continue;
         }
       }
+      else if ( str_starts_with ( line, "LayerBlock ", 11, TRUE ) )
+      {
+        GBytes *block = file_bin_get_block ( br, strtoul(line+11, NULL, 10) );
+        if ( !block || !stack->data || VIK_LAYER(stack->data)->type != VIK_LAYER_TRW ) {
+          successful_read = FALSE;
+          g_warning ( "Line %ld: Invalid layer block", line_num );
+        }
+        else
+          // Only decoded when the layer is first needed
+          vik_trw_layer_set_pending_data ( VIK_TRW_LAYER(stack->data), block, dirpath );
+        if ( block )
+          g_bytes_unref ( block );
+      }
       else if ( str_starts_with ( line, "EndTopLayer", 11, FALSE ) )
       {
         if ( stack )
@@ -611,6 +731,109 @@ if "[LayerData]"
 
 */
 
+/**
+ * Read in a binary Viking file
+ * The file is mapped and TrackWaypoint layers keep a reference to their block,
+ *  so the data of a layer is only paged in when that layer gets loaded
+ */
+static gboolean file_read_binary ( VikAggregateLayer *top, const gchar *filename, const gchar *dirpath, VikViewport *vp )
+{
+  GError *error = NULL;
+  GMappedFile *mf = g_mapped_file_new ( filename, FALSE, &error );
+  if ( !mf ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+    return FALSE;
+  }
+
+  GBytes *bytes = g_mapped_file_get_bytes ( mf );
+  FileBinReader br = { bytes, g_bytes_get_data(bytes, NULL), g_bytes_get_size(bytes), 0, NULL };
+  gboolean ans = FALSE;
+  if ( br.size >= VIKBIN_HEADER_SIZE ) {
+    guint32 version, n_blocks;
+    guint64 toc_offset, text_offset;
+    memcpy ( &version, br.data + 8, sizeof(version) );
+    memcpy ( &n_blocks, br.data + 12, sizeof(n_blocks) );
+    memcpy ( &toc_offset, br.data + 16, sizeof(toc_offset) );
+    memcpy ( &text_offset, br.data + 24, sizeof(text_offset) );
+    version = GUINT32_FROM_LE ( version );
+    br.n_blocks = GUINT32_FROM_LE ( n_blocks );
+    toc_offset = GUINT64_FROM_LE ( toc_offset );
+    text_offset = GUINT64_FROM_LE ( text_offset );
+
+    if ( version > VIKBIN_VERSION )
+      g_warning ( "%s: unsupported version %d", __FUNCTION__, version );
+    else if ( toc_offset > br.size || (guint64)br.n_blocks * 16 > br.size - toc_offset || text_offset > br.size )
+      g_warning ( "%s: %s is damaged", __FUNCTION__, filename );
+    else {
+      br.toc = br.data + toc_offset;
+      // A separate stream opened in binary mode, so the offset is exact on all systems
+      FILE *f = g_fopen ( filename, "rb" );
+      if ( f ) {
+        if ( fseek ( f, (long)text_offset, SEEK_SET ) == 0 )
+          ans = file_read ( top, f, dirpath, vp, &br );
+        fclose ( f );
+      }
+    }
+  }
+
+  g_bytes_unref ( bytes );
+  g_mapped_file_unref ( mf );
+  return ans;
+}
+
+/**
+ * Write a binary Viking file
+ * The text part is collected separately so that it can go at the end
+ */
+static gboolean file_write_binary ( VikAggregateLayer *top, FILE *f, gpointer vp, const gchar *dirpath )
+{
+  FILE *text = tmpfile ();
+  if ( !text ) {
+    g_warning ( "%s: could not create temporary file", __FUNCTION__ );
+    return FALSE;
+  }
+
+  guint8 header[VIKBIN_HEADER_SIZE] = { 0 };
+  (void)fwrite ( header, 1, sizeof(header), f );
+
+  FileBinWriter bw = { f, VIKBIN_HEADER_SIZE, g_array_new (FALSE, FALSE, sizeof(FileBlock)) };
+  file_write ( top, text, vp, dirpath, &bw );
+
+  static const guint8 padding[8] = { 0 };
+  guint pad = (8 - (bw.offset % 8)) % 8;
+  (void)fwrite ( padding, 1, pad, f );
+  guint64 toc_offset = bw.offset + pad;
+  for ( guint ii = 0; ii < bw.toc->len; ii++ ) {
+    FileBlock *fb = &g_array_index ( bw.toc, FileBlock, ii );
+    guint64 le[2] = { GUINT64_TO_LE(fb->offset), GUINT64_TO_LE(fb->length) };
+    (void)fwrite ( le, 1, sizeof(le), f );
+  }
+  guint64 text_offset = toc_offset + bw.toc->len * 16;
+
+  gchar buf[65536];
+  size_t nn;
+  rewind ( text );
+  while ( (nn = fread ( buf, 1, sizeof(buf), text )) > 0 )
+    (void)fwrite ( buf, 1, nn, f );
+  fclose ( text );
+
+  memcpy ( header, VIKBIN_MAGIC, VIKBIN_MAGIC_LEN );
+  guint32 version = GUINT32_TO_LE ( VIKBIN_VERSION );
+  guint32 n_blocks = GUINT32_TO_LE ( bw.toc->len );
+  toc_offset = GUINT64_TO_LE ( toc_offset );
+  text_offset = GUINT64_TO_LE ( text_offset );
+  memcpy ( header + 8, &version, sizeof(version) );
+  memcpy ( header + 12, &n_blocks, sizeof(n_blocks) );
+  memcpy ( header + 16, &toc_offset, sizeof(toc_offset) );
+  memcpy ( header + 24, &text_offset, sizeof(text_offset) );
+  rewind ( f );
+  (void)fwrite ( header, 1, sizeof(header), f );
+
+  g_array_free ( bw.toc, TRUE );
+  return !ferror ( f );
+}
+
 /* ---------------------------------------------------- */
 
 static FILE *xfopen ( const char *fn )
@@ -637,12 +860,17 @@ gboolean check_file_magic_vik ( const gchar *filename )
   gboolean result = FALSE;
   FILE *ff = xfopen ( filename );
   if ( ff ) {
-    result = check_magic ( ff, VIK_MAGIC, VIK_MAGIC_LEN );
+    result = check_magic ( ff, VIK_MAGIC, VIK_MAGIC_LEN ) || check_magic ( ff, VIKBIN_MAGIC, VIKBIN_MAGIC_LEN );
     xfclose ( ff );
   }
   return result;
 }
 
+gboolean a_file_check_binary_magic ( FILE *f )
+{
+  return check_magic ( f, VIKBIN_MAGIC, VIKBIN_MAGIC_LEN );
+}
+
 /**
  * append_file_ext:
  *
@@ -684,6 +912,146 @@ gchar *append_file_ext ( const gchar *filename, VikFileType_t type )
   return new_name;
 }
 
+typedef enum {
+  PRELOAD_PENDING,
+  PRELOAD_SKIPPED, // Not a GPX (or TCX) file after all, so left for the normal load
+  PRELOAD_READ,
+  PRELOAD_FAILED,
+} preload_state_t;
+
+typedef struct {
+  gchar *filename;
+  VikTrwLayer *vtl;      // For a GPX file
+  VikCoordMode coord_mode;
+  TcxRead *tcx;          // For a TCX file, which may have several layers so they are only created on attaching
+  preload_state_t state;
+} FilePreload;
+
+// Files already read by a_file_preload(), keyed by filename
+static GHashTable *preloads = NULL;
+
+static void file_preload_free ( FilePreload *fp )
+{
+  if ( fp->vtl )
+    g_object_unref ( fp->vtl );
+  if ( fp->tcx )
+    a_tcx_read_free ( fp->tcx );
+  g_free ( fp->filename );
+  g_free ( fp );
+}
+
+// Runs in a worker thread, the layer is not yet attached to anything
+static void file_preload_thread ( FilePreload *fp, gpointer user_data )
+{
+  FILE *f = g_fopen ( fp->filename, "r" );
+  if ( !f ) {
+    fp->state = PRELOAD_SKIPPED;
+    return;
+  }
+  if ( !fp->vtl ) {
+    // NB TCX files are XML
+    if ( check_magic ( f, GPX_MAGIC, GPX_MAGIC_LEN ) ) {
+      fp->tcx = a_tcx_read ( f, fp->filename, fp->coord_mode );
+      fp->state = PRELOAD_READ;
+    }
+    else
+      fp->state = PRELOAD_SKIPPED;
+  }
+  else if ( check_magic ( f, VIK_MAGIC, VIK_MAGIC_LEN ) )
+    fp->state = PRELOAD_SKIPPED;
+  else {
+    gchar *absolute = file_realpath_dup ( fp->filename );
+    gchar *dirpath = absolute ? g_path_get_dirname ( absolute ) : NULL;
+    g_free ( absolute );
+    fp->state = a_gpx_read_file ( fp->vtl, f, dirpath, FALSE ) ? PRELOAD_READ : PRELOAD_FAILED;
+    g_free ( dirpath );
+  }
+  fclose ( f );
+}
+
+/**
+ * a_file_preload:
+ * @filenames: The list of files about to be opened via a_file_load() into new layers
+ *
+ * Read any GPX or TCX files in the list in parallel, so the subsequent a_file_load()
+ *  of each of them only has to attach the already read layers.
+ * Call a_file_preload_clear() once all of the files have been loaded.
+ */
+void a_file_preload ( GSList *filenames, VikViewport *vp )
+{
+  // GPX files may go in to an existing layer instead, so leave them to the normal load
+  gboolean gpx = !a_vik_get_open_files_in_selected_layer();
+
+  VikTaskGroup *group = NULL;
+  for ( GSList *iter = filenames; iter; iter = iter->next ) {
+    const gchar *filename = iter->data;
+    if ( strncmp(filename, "file://", 7) == 0 )
+      filename = filename + 7;
+    gboolean tcx = a_file_check_ext ( filename, ".tcx" );
+    if ( !tcx && !(gpx && a_file_check_ext ( filename, ".gpx" )) )
+      continue;
+    if ( !preloads )
+      preloads = g_hash_table_new_full ( g_str_hash, g_str_equal, NULL, (GDestroyNotify)file_preload_free );
+    if ( g_hash_table_lookup ( preloads, filename ) )
+      continue;
+    if ( !group )
+      group = a_background_tasks_new ();
+
+    // Layers are created here as they use the viewport's GCs
+    FilePreload *fp = g_new0 ( FilePreload, 1 );
+    fp->filename = g_strdup ( filename );
+    fp->coord_mode = vik_viewport_get_coord_mode ( vp );
+    if ( !tcx ) {
+      fp->vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, vp, FALSE ));
+      vik_layer_rename ( VIK_LAYER(fp->vtl), a_file_basename ( filename ) );
+    }
+    g_hash_table_insert ( preloads, fp->filename, fp );
+    a_background_tasks_add ( group, (GFunc)file_preload_thread, fp, NULL );
+  }
+  if ( group )
+    a_background_tasks_free ( group );
+}
+
+/**
+ * a_file_preload_clear:
+ *
+ * Release anything from a_file_preload() that was not then loaded
+ */
+void a_file_preload_clear ( void )
+{
+  if ( preloads ) {
+    g_hash_table_destroy ( preloads );
+    preloads = NULL;
+  }
+}
+
+/**
+ * Complete the load of a file read by a_file_preload(),
+ *  as a_file_load_stream() would have done for a GPX or TCX file
+ */
+static VikLoadType_t file_preload_attach ( FilePreload *fp, VikAggregateLayer *top, VikViewport *vp, gboolean external, const gchar *name )
+{
+  VikLoadType_t load_answer = LOAD_TYPE_GPX_FAILURE;
+  if ( fp->tcx ) {
+    load_answer = a_tcx_attach ( fp->tcx, top, vp ) ? LOAD_TYPE_OTHER_SUCCESS : LOAD_TYPE_TCX_FAILURE;
+    fp->tcx = NULL;
+  }
+  else if ( fp->state == PRELOAD_READ ) {
+    load_answer = LOAD_TYPE_OTHER_SUCCESS;
+    VikTrwLayer *vtl = fp->vtl;
+    fp->vtl = NULL;
+    if ( name )
+      vik_layer_rename ( VIK_LAYER(vtl), name );
+    if ( external )
+      trw_layer_replace_external ( vtl, fp->filename, NULL );
+    vik_layer_post_read ( VIK_LAYER(vtl), vp, TRUE );
+    vik_aggregate_layer_add_layer ( top, VIK_LAYER(vtl), FALSE );
+    vik_trw_layer_auto_set_view ( vtl, vp );
+  }
+  g_hash_table_remove ( preloads, fp->filename );
+  return load_answer;
+}
+
 /**
  * a_file_load_stream:
  *
@@ -703,7 +1071,14 @@ VikLoadType_t a_file_load_stream ( FILE *f,
   // Attempt loading the primary file type first - our internal .vik file:
   if ( check_magic ( f, VIK_MAGIC, VIK_MAGIC_LEN ) )
   {
-    if ( file_read ( top, f, dirpath, vp ) )
+    if ( file_read ( top, f, dirpath, vp, NULL ) )
+      load_answer = LOAD_TYPE_VIK_SUCCESS;
+    else
+      load_answer = LOAD_TYPE_VIK_FAILURE_NON_FATAL;
+  }
+  else if ( check_magic ( f, VIKBIN_MAGIC, VIKBIN_MAGIC_LEN ) )
+  {
+    if ( file_read_binary ( top, filename, dirpath, vp ) )
       load_answer = LOAD_TYPE_VIK_SUCCESS;
     else
       load_answer = LOAD_TYPE_VIK_FAILURE_NON_FATAL;
@@ -715,6 +1090,9 @@ VikLoadType_t a_file_load_stream ( FILE *f,
   else if ( file_magic_check ( filename, "application/x-bzip2", ".bz2" ) ) {
     load_answer = uncompress_load_bzip_file ( filename, top, vp, vtl, new_layer, external );
   }
+  else if ( file_magic_check ( filename, "application/gzip", ".gz" ) || file_magic_check ( filename, "application/x-gzip", ".gz" ) ) {
+    load_answer = uncompress_load_gzip_file ( filename, top, vp, vtl, new_layer, external );
+  }
   else if ( a_jpg_magic_check ( filename ) ) {
     if ( ! a_jpg_load_file ( top, filename, vp ) )
       load_answer = LOAD_TYPE_UNSUPPORTED_FAILURE;
@@ -753,8 +1131,20 @@ VikLoadType_t a_file_load_stream ( FILE *f,
       vik_layer_rename ( VIK_LAYER(vtl), name ? name : a_file_basename ( filename ) );
     }
 
+    // FIT files are binary, with a signature in the header
+    if ( check_fit_magic ( f ) ) {
+      if ( ! ( success = a_fit_read_file ( vtl, f, a_file_basename ( filename ) ) ) ) {
+        load_answer = LOAD_TYPE_FIT_FAILURE;
+      }
+    }
+    // GeoJSON has no signature as such, being any JSON document
+    else if ( a_file_check_ext ( filename, ".geojson" ) ) {
+      if ( ! ( success = a_geojson_read_file ( vtl, f ) ) ) {
+        load_answer = LOAD_TYPE_GEOJSON_FAILURE;
+      }
+    }
     // In fact both kml & gpx files start the same as they are in xml
-    if ( a_file_check_ext ( filename, ".kml" ) && check_magic ( f, GPX_MAGIC, GPX_MAGIC_LEN ) ) {
+    else if ( a_file_check_ext ( filename, ".kml" ) && check_magic ( f, GPX_MAGIC, GPX_MAGIC_LEN ) ) {
       if ( ! ( success = a_kml_read_file ( vtl, f ) ) ) {
         load_answer = LOAD_TYPE_KML_FAILURE;
       }
@@ -762,14 +1152,22 @@ VikLoadType_t a_file_load_stream ( FILE *f,
     // NB use a extension check first, as a GPX file header may have a Byte Order Mark (BOM) in it
     //    - which currently confuses our check_magic function
     else if ( a_file_check_ext ( filename, ".gpx" ) || check_magic ( f, GPX_MAGIC, GPX_MAGIC_LEN ) ) {
-      if ( ! ( success = a_gpx_read_file ( vtl, f, dirpath, !add_new ) ) ) {
+      // External layers remember where the read stopped, so any later additions to the file can be read on from there
+      GpxResume *resume = NULL;
+      if ( external && add_new )
+        success = a_gpx_read_file_resumable ( vtl, f, dirpath, &resume );
+      else
+        success = a_gpx_read_file ( vtl, f, dirpath, !add_new );
+      if ( ! success ) {
         load_answer = LOAD_TYPE_GPX_FAILURE;
       }
       if ( load_answer == LOAD_TYPE_OTHER_SUCCESS ) {
 	if ( external )
 	  // TODO may have to make absolute??
-	  trw_layer_replace_external ( vtl, filename );
+	  trw_layer_replace_external ( vtl, filename, resume );
       }
+      else
+        a_gpx_resume_free ( resume );
     }
     else {
       // Try final supported file type
@@ -813,6 +1211,9 @@ VikLoadType_t a_file_load ( VikAggregateLayer *top,
 {
   g_return_val_if_fail ( vp != NULL, LOAD_TYPE_READ_FAILURE );
 
+  // Ensure a file just saved is read as it was saved
+  a_file_save_wait ();
+
   char *filename = (char *)filename_or_uri;
   if (strncmp(filename, "file://", 7) == 0) {
     // Consider replacing this with:
@@ -821,6 +1222,12 @@ VikLoadType_t a_file_load ( VikAggregateLayer *top,
     filename = filename + 7;
     g_debug ( "Loading file %s from URI %s", filename, filename_or_uri );
   }
+
+  FilePreload *fp = preloads ? g_hash_table_lookup ( preloads, filename ) : NULL;
+  // TCX files always go in new layers
+  if ( fp && fp->state != PRELOAD_SKIPPED && (new_layer || !fp->vtl) )
+    return file_preload_attach ( fp, top, vp, external, name );
+
   FILE *f = xfopen ( filename );
 
   if ( ! f )
@@ -839,17 +1246,137 @@ VikLoadType_t a_file_load ( VikAggregateLayer *top,
   return load_answer;
 }
 
-gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filename )
+/*
+ * A file is saved by writing it out to a temporary file alongside,
+ *  which then replaces the original once it is safely on disk.
+ * So a crash or a full disk part way through never leaves a truncated file.
+ *
+ * The layers can only be read in the main thread, which also means what is written is consistent;
+ *  but waiting for the data to reach the disk (which can take seconds for a large file)
+ *  and the replacement are done in the save thread.
+ * Saves are completed in the order they were made.
+ * Whether that worked is only known then, so it is told to the saved function
+ *  and also counted for a_file_save_wait().
+ */
+typedef struct {
+  FILE *f;
+  gchar *tmp_filename;
+  gchar *filename;
+  VikFileSavedFunc saved;
+  gpointer user_data;
+  gboolean success;
+} FileSaveInfo;
+
+static GThreadPool *save_pool = NULL;
+static GMutex save_mutex;
+static GCond save_cond;
+static guint saves_pending = 0;
+static guint saves_failed = 0; // Since the last a_file_save_wait()
+
+static void file_save_info_free ( FileSaveInfo *fsi )
+{
+  g_free ( fsi->tmp_filename );
+  g_free ( fsi->filename );
+  g_free ( fsi );
+}
+
+static gboolean file_save_notify ( FileSaveInfo *fsi )
+{
+  fsi->saved ( fsi->filename, fsi->success, fsi->user_data );
+  file_save_info_free ( fsi );
+  return FALSE;
+}
+
+static void file_save_complete ( FileSaveInfo *fsi, gpointer user_data )
+{
+  gboolean ok = ( fflush ( fsi->f ) == 0 );
+#ifdef WINDOWS
+  ok = ok && ( _commit ( fileno ( fsi->f ) ) == 0 );
+#else
+  ok = ok && ( fsync ( fileno ( fsi->f ) ) == 0 );
+#endif
+  ok = ( fclose ( fsi->f ) == 0 ) && ok;
+
+  fsi->success = ok && g_rename ( fsi->tmp_filename, fsi->filename ) == 0;
+  if ( fsi->success )
+    g_debug ( "%s: %s", __FUNCTION__, fsi->filename );
+  else {
+    g_warning ( "Failed to save %s: %s", fsi->filename, g_strerror(errno) );
+    (void)g_remove ( fsi->tmp_filename );
+  }
+
+  g_mutex_lock ( &save_mutex );
+  saves_pending--;
+  if ( !fsi->success )
+    saves_failed++;
+  g_cond_broadcast ( &save_cond );
+  g_mutex_unlock ( &save_mutex );
+
+  if ( fsi->saved )
+    (void)gdk_threads_add_idle ( (GSourceFunc)file_save_notify, fsi );
+  else
+    file_save_info_free ( fsi );
+}
+
+/**
+ * a_file_save_wait:
+ *
+ * Wait for any saves still being completed, e.g. before exiting
+ *
+ * Returns: %FALSE if any save completed since the previous wait failed,
+ *  in which case the file it was to replace is left as it was
+ */
+gboolean a_file_save_wait ( void )
+{
+  g_mutex_lock ( &save_mutex );
+  while ( saves_pending )
+    g_cond_wait ( &save_cond, &save_mutex );
+  gboolean ok = ( saves_failed == 0 );
+  saves_failed = 0;
+  g_mutex_unlock ( &save_mutex );
+  return ok;
+}
+
+/**
+ * a_file_save:
+ * @saved: Optional function called in the main thread once the save is complete,
+ *  only when %TRUE is returned
+ *
+ * Returns: %FALSE if the file could not be written.
+ *  Otherwise the save is completed in the background,
+ *  and its final result is given to @saved or by a_file_save_wait()
+ */
+gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filename, VikFileSavedFunc saved, gpointer user_data )
 {
   FILE *f;
 
   if (strncmp(filename, "file://", 7) == 0)
     filename = filename + 7;
 
-  f = g_fopen(filename, "w");
-
-  if ( ! f )
+  // Layers not yet loaded may refer to the file about to be overwritten
+  GList *trws = vik_aggregate_layer_get_all_layers_of_type ( top, NULL, VIK_LAYER_TRW, TRUE );
+  for ( GList *iter = trws; iter; iter = iter->next )
+    vik_trw_layer_detach_pending_data ( VIK_TRW_LAYER(iter->data) );
+  g_list_free ( trws );
+
+  gboolean binary = a_vik_get_save_binary_format ();
+  gchar *tmp_filename = g_strconcat ( filename, ".XXXXXX", NULL );
+  gint fd = g_mkstemp_full ( tmp_filename, O_RDWR | O_CREAT | O_EXCL | (binary ? O_BINARY : 0), 0666 );
+  f = ( fd < 0 ) ? NULL : fdopen ( fd, binary ? "w+b" : "w+" );
+
+  if ( ! f ) {
+    if ( fd >= 0 ) {
+      close ( fd );
+      (void)g_remove ( tmp_filename );
+    }
+    g_free ( tmp_filename );
     return FALSE;
+  }
+
+  // Keep the permissions of the file being replaced
+  GStatBuf stat_buf;
+  if ( g_stat ( filename, &stat_buf ) == 0 )
+    (void)g_chmod ( tmp_filename, stat_buf.st_mode & 0777 );
 
   // Enable relative paths in .vik files to work
   gchar *cwd = g_get_current_dir();
@@ -860,7 +1387,11 @@ gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filenam
     }
   }
 
-  file_write ( top, f, vp, dir );
+  gboolean ans = TRUE;
+  if ( binary )
+    ans = file_write_binary ( top, f, vp, dir );
+  else
+    file_write ( top, f, vp, dir, NULL );
   g_free (dir);
 
   // Restore previous working directory
@@ -871,8 +1402,26 @@ gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filenam
     g_free (cwd);
   }
 
-  fclose(f);
-  f = NULL;
+  if ( !ans || ferror ( f ) ) {
+    fclose ( f );
+    (void)g_remove ( tmp_filename );
+    g_free ( tmp_filename );
+    return FALSE;
+  }
+
+  FileSaveInfo *fsi = g_malloc ( sizeof(FileSaveInfo) );
+  fsi->f = f;
+  fsi->tmp_filename = tmp_filename;
+  fsi->filename = g_strdup ( filename );
+  fsi->saved = saved;
+  fsi->user_data = user_data;
+
+  g_mutex_lock ( &save_mutex );
+  saves_pending++;
+  if ( !save_pool )
+    save_pool = g_thread_pool_new ( (GFunc)file_save_complete, NULL, 1, FALSE, NULL );
+  g_mutex_unlock ( &save_mutex );
+  g_thread_pool_push ( save_pool, fsi, NULL );
 
   return TRUE;
 }
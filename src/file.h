@@ -48,12 +48,19 @@ gboolean a_file_check_ext ( const gchar *filename, const gchar *fileext );
  */
 gboolean check_file_magic_vik ( const gchar *filename );
 
+/*
+ * Whether a stream is a binary 'viking' file, which needs to be read from a file rather than a stream
+ */
+gboolean a_file_check_binary_magic ( FILE *f );
+
 typedef enum {
   LOAD_TYPE_READ_FAILURE,
   LOAD_TYPE_GPSBABEL_FAILURE,
   LOAD_TYPE_GPX_FAILURE,
   LOAD_TYPE_TCX_FAILURE,
   LOAD_TYPE_KML_FAILURE,
+  LOAD_TYPE_FIT_FAILURE,
+  LOAD_TYPE_GEOJSON_FAILURE,
   LOAD_TYPE_UNSUPPORTED_FAILURE,
   LOAD_TYPE_OTHER_FAILURE_NON_FATAL,
   LOAD_TYPE_VIK_FAILURE_NON_FATAL,
@@ -81,7 +88,12 @@ VikLoadType_t a_file_load ( VikAggregateLayer *top,
                             gboolean external,
                             const gchar *name );
 
-gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filename );
+void a_file_preload ( GSList *filenames, VikViewport *vp );
+void a_file_preload_clear ( void );
+
+typedef void (*VikFileSavedFunc) ( const gchar *filename, gboolean success, gpointer user_data );
+gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filename, VikFileSavedFunc saved, gpointer user_data );
+gboolean a_file_save_wait ( void );
 /* Only need to define VikTrack if the file type is FILE_TYPE_GPX_TRACK */
 gboolean a_file_export ( VikTrwLayer *vtl, const gchar *filename, VikFileType_t file_type, VikTrack *trk, gboolean write_hidden );
 gboolean a_file_export_babel ( VikTrwLayer *vtl, const gchar *filename, const gchar *format,
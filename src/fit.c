@@ -0,0 +1,450 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * Native reading of Garmin FIT (Flexible and Interoperable Data Transfer) activity files,
+ *  so that watch/bike computer recordings can be imported without going via GPSBabel.
+ *
+ * Only the messages needed to build a track are interpreted:
+ *  file_id (to detect courses), record (the trackpoints), event (timer stops start new segments)
+ *  and course (for the name).
+ * Everything else, including any developer data fields, is skipped over.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <string.h>
+#include <math.h>
+#include "fit.h"
+#include "viking.h"
+
+// Seconds between the Unix epoch and the FIT epoch of 1989-12-31 00:00:00 UTC
+#define FIT_EPOCH_OFFSET 631065600
+
+#define FIT_SEMICIRCLES_TO_DEGREES (180.0 / 2147483648.0)
+
+#define FIT_FIELD_TIMESTAMP 253
+
+// Global message numbers
+#define FIT_MESG_FILE_ID 0
+#define FIT_MESG_RECORD 20
+#define FIT_MESG_EVENT 21
+#define FIT_MESG_COURSE 31
+
+#define FIT_FILE_TYPE_COURSE 6
+
+#define FIT_EVENT_TIMER 0
+#define FIT_EVENT_TYPE_STOP 1
+#define FIT_EVENT_TYPE_STOP_ALL 4
+
+#define FIT_BASE_STRING 0x07
+#define FIT_NUM_BASE_TYPES 17
+
+// Indexed by the base type number (the low 5 bits of the base type field)
+static const guint8 base_type_sizes[FIT_NUM_BASE_TYPES] = {
+  1, // enum
+  1, // sint8
+  1, // uint8
+  2, // sint16
+  2, // uint16
+  4, // sint32
+  4, // uint32
+  1, // string
+  4, // float32
+  8, // float64
+  1, // uint8z
+  2, // uint16z
+  4, // uint32z
+  1, // byte
+  8, // sint64
+  8, // uint64
+  8, // uint64z
+};
+
+typedef struct {
+  guint8 number;
+  guint8 size;
+  guint8 base_type;
+} FitFieldDef;
+
+typedef struct {
+  gboolean defined;
+  gboolean big_endian;
+  guint16 global;
+  guint8 n_fields;
+  FitFieldDef fields[255];
+  gsize size;     // Total size of the normal fields
+  gsize dev_size; // Total size of any developer fields, which are always skipped
+} FitMessageDef;
+
+typedef struct {
+  VikTrwLayer *vtl;
+  VikTrack *trk;        // Track being built, trackpoints are in reverse order until finished
+  gchar *name;          // From a course message, if any
+  gboolean is_course;
+  gboolean newsegment;  // Next trackpoint starts a new segment
+  guint32 last_timestamp;
+  FitMessageDef defs[16]; // Definitions by local message type
+} FitReader;
+
+/**
+ * a_fit_check_header:
+ *
+ * Returns: TRUE if the data starts with a FIT file header
+ *  (at least FIT_HEADER_MIN_SIZE bytes are needed)
+ */
+gboolean a_fit_check_header ( const guint8 *header, gsize length )
+{
+  if ( length < FIT_HEADER_MIN_SIZE )
+    return FALSE;
+  if ( header[0] < FIT_HEADER_MIN_SIZE )
+    return FALSE;
+  return memcmp ( header+8, ".FIT", 4 ) == 0;
+}
+
+static guint16 fit_crc ( guint16 crc, const guint8 *data, gsize length )
+{
+  static const guint16 crc_table[16] = {
+    0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+    0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400
+  };
+  for ( gsize ii = 0; ii < length; ii++ ) {
+    guint16 tmp = crc_table[crc & 0xF];
+    crc = (crc >> 4) & 0x0FFF;
+    crc = crc ^ tmp ^ crc_table[data[ii] & 0xF];
+    tmp = crc_table[crc & 0xF];
+    crc = (crc >> 4) & 0x0FFF;
+    crc = crc ^ tmp ^ crc_table[(data[ii] >> 4) & 0xF];
+  }
+  return crc;
+}
+
+/**
+ * Get an integer field value
+ *
+ * Returns: FALSE if the value is the 'invalid' marker for the base type,
+ *  or not an integer type (or not the expected size)
+ */
+static gboolean fit_get_value ( const guint8 *data, const FitFieldDef *fd, gboolean big_endian, gint64 *value )
+{
+  guint type = fd->base_type & 0x1F;
+  if ( type >= FIT_NUM_BASE_TYPES || fd->size != base_type_sizes[type] )
+    return FALSE;
+
+  guint64 raw = 0;
+  for ( guint ii = 0; ii < fd->size; ii++ )
+    raw |= (guint64)data[big_endian ? fd->size-1-ii : ii] << (8*ii);
+
+  switch ( type ) {
+  case 0x00: // enum
+  case 0x02: // uint8
+  case 0x0D: // byte
+    if ( raw == 0xFF ) return FALSE;
+    *value = raw;
+    break;
+  case 0x01: // sint8
+    if ( raw == 0x7F ) return FALSE;
+    *value = (gint8)raw;
+    break;
+  case 0x03: // sint16
+    if ( raw == 0x7FFF ) return FALSE;
+    *value = (gint16)raw;
+    break;
+  case 0x04: // uint16
+    if ( raw == 0xFFFF ) return FALSE;
+    *value = raw;
+    break;
+  case 0x05: // sint32
+    if ( raw == 0x7FFFFFFF ) return FALSE;
+    *value = (gint32)raw;
+    break;
+  case 0x06: // uint32
+    if ( raw == 0xFFFFFFFF ) return FALSE;
+    *value = raw;
+    break;
+  case 0x0A: // uint8z
+  case 0x0B: // uint16z
+  case 0x0C: // uint32z
+  case 0x10: // uint64z
+    if ( raw == 0 ) return FALSE;
+    *value = raw;
+    break;
+  case 0x0E: // sint64
+    if ( raw == G_GUINT64_CONSTANT(0x7FFFFFFFFFFFFFFF) ) return FALSE;
+    *value = (gint64)raw;
+    break;
+  case 0x0F: // uint64
+    if ( raw == G_MAXUINT64 || raw > G_MAXINT64 ) return FALSE;
+    *value = raw;
+    break;
+  default: // string, floats
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static void fit_record ( FitReader *fr, FitMessageDef *def, const guint8 *data, gint64 timestamp )
+{
+  VikTrackpoint *tp = vik_trackpoint_new ();
+  gboolean has_lat = FALSE, has_lon = FALSE;
+  gint64 lat = 0, lon = 0;
+  gdouble altitude = NAN, enhanced_altitude = NAN;
+  gdouble speed = NAN, enhanced_speed = NAN;
+  gint64 value;
+
+  if ( timestamp >= 0 )
+    tp->timestamp = timestamp + FIT_EPOCH_OFFSET;
+
+  for ( guint ii = 0; ii < def->n_fields; ii++ ) {
+    const FitFieldDef *fd = &def->fields[ii];
+    if ( fit_get_value ( data, fd, def->big_endian, &value ) ) {
+      switch ( fd->number ) {
+      case FIT_FIELD_TIMESTAMP:
+        fr->last_timestamp = value;
+        tp->timestamp = value + FIT_EPOCH_OFFSET;
+        break;
+      case 0: lat = value; has_lat = TRUE; break;
+      case 1: lon = value; has_lon = TRUE; break;
+      case 2: altitude = value / 5.0 - 500.0; break;
+      case 3: tp->heart_rate = value; break;
+      case 4: tp->cadence = value; break;
+      case 6: speed = value / 1000.0; break;
+      case 7: tp->power = value; break;
+      case 13: tp->temp = value; break;
+      case 73: enhanced_speed = value / 1000.0; break;
+      case 78: enhanced_altitude = value / 5.0 - 500.0; break;
+      default: break;
+      }
+    }
+    data += fd->size;
+  }
+
+  // Records without a position (e.g. indoors, or before a fix) are only sensor data
+  if ( !has_lat || !has_lon ) {
+    vik_trackpoint_free ( tp );
+    return;
+  }
+
+  // The enhanced versions have greater range, so take precedence
+  tp->altitude = isnan(enhanced_altitude) ? altitude : enhanced_altitude;
+  tp->speed = isnan(enhanced_speed) ? speed : enhanced_speed;
+
+  struct LatLon ll;
+  ll.lat = lat * FIT_SEMICIRCLES_TO_DEGREES;
+  ll.lon = lon * FIT_SEMICIRCLES_TO_DEGREES;
+  vik_coord_load_from_latlon ( &tp->coord, vik_trw_layer_get_coord_mode(fr->vtl), &ll );
+
+  if ( !fr->trk ) {
+    fr->trk = vik_track_new ();
+    fr->trk->visible = TRUE;
+    fr->newsegment = TRUE;
+  }
+  tp->newsegment = fr->newsegment;
+  fr->newsegment = FALSE;
+  fr->trk->trackpoints = g_list_prepend ( fr->trk->trackpoints, tp );
+}
+
+static void fit_data_message ( FitReader *fr, FitMessageDef *def, const guint8 *data, gint64 timestamp )
+{
+  if ( def->global == FIT_MESG_RECORD ) {
+    fit_record ( fr, def, data, timestamp );
+    return;
+  }
+
+  gint64 event = -1, event_type = -1;
+  gint64 value;
+  for ( guint ii = 0; ii < def->n_fields; ii++ ) {
+    const FitFieldDef *fd = &def->fields[ii];
+    if ( fd->number == FIT_FIELD_TIMESTAMP ) {
+      if ( fit_get_value ( data, fd, def->big_endian, &value ) )
+        fr->last_timestamp = value;
+    }
+    else if ( def->global == FIT_MESG_FILE_ID && fd->number == 0 ) {
+      if ( fit_get_value ( data, fd, def->big_endian, &value ) )
+        fr->is_course = (value == FIT_FILE_TYPE_COURSE);
+    }
+    else if ( def->global == FIT_MESG_EVENT && fd->number <= 1 ) {
+      if ( fit_get_value ( data, fd, def->big_endian, &value ) ) {
+        if ( fd->number == 0 )
+          event = value;
+        else
+          event_type = value;
+      }
+    }
+    else if ( def->global == FIT_MESG_COURSE && fd->number == 5 &&
+              (fd->base_type & 0x1F) == FIT_BASE_STRING && fd->size && data[0] ) {
+      g_free ( fr->name );
+      fr->name = g_strndup ( (const gchar*)data, fd->size );
+    }
+    data += fd->size;
+  }
+
+  // Pausing the timer ends the current segment
+  if ( event == FIT_EVENT_TIMER && (event_type == FIT_EVENT_TYPE_STOP || event_type == FIT_EVENT_TYPE_STOP_ALL) )
+    fr->newsegment = TRUE;
+}
+
+/**
+ * Read the data records of one FIT file
+ *
+ * Returns: FALSE if the data is damaged. Anything read before that point is retained.
+ */
+static gboolean fit_read_records ( FitReader *fr, const guint8 *pos, const guint8 *end )
+{
+  while ( pos < end ) {
+    guint8 header = *pos++;
+    guint local;
+    gint64 timestamp = -1;
+
+    if ( header & 0x80 ) {
+      // Compressed timestamp header - an offset to the last full timestamp
+      local = (header >> 5) & 0x3;
+      guint32 offset = header & 0x1F;
+      guint32 ts = (fr->last_timestamp & ~0x1F) + offset;
+      if ( offset < (fr->last_timestamp & 0x1F) )
+        ts += 0x20;
+      fr->last_timestamp = ts;
+      timestamp = ts;
+    }
+    else {
+      local = header & 0x0F;
+      if ( header & 0x40 ) {
+        // Definition message
+        if ( end - pos < 5 )
+          return FALSE;
+        FitMessageDef *def = &fr->defs[local];
+        def->big_endian = (pos[1] == 1);
+        def->global = def->big_endian ? (pos[2] << 8 | pos[3]) : (pos[3] << 8 | pos[2]);
+        def->n_fields = pos[4];
+        pos += 5;
+        if ( end - pos < def->n_fields * 3 )
+          return FALSE;
+        def->size = 0;
+        for ( guint ii = 0; ii < def->n_fields; ii++ ) {
+          def->fields[ii].number = pos[0];
+          def->fields[ii].size = pos[1];
+          def->fields[ii].base_type = pos[2];
+          def->size += pos[1];
+          pos += 3;
+        }
+        def->dev_size = 0;
+        if ( header & 0x20 ) {
+          if ( pos >= end )
+            return FALSE;
+          guint n_dev = *pos++;
+          if ( end - pos < n_dev * 3 )
+            return FALSE;
+          for ( guint ii = 0; ii < n_dev; ii++ ) {
+            def->dev_size += pos[1];
+            pos += 3;
+          }
+        }
+        def->defined = TRUE;
+        continue;
+      }
+    }
+
+    FitMessageDef *def = &fr->defs[local];
+    if ( !def->defined )
+      return FALSE;
+    if ( (gsize)(end - pos) < def->size + def->dev_size )
+      return FALSE;
+    fit_data_message ( fr, def, pos, timestamp );
+    pos += def->size + def->dev_size;
+  }
+  return TRUE;
+}
+
+/**
+ * a_fit_read_file:
+ * @vtl:  The layer to add the track to
+ * @ff:   The FIT file stream
+ * @name: Name for the track, if the file does not provide one
+ *
+ * Read a FIT file (or several chained FIT files) into a single track.
+ *
+ * Returns: TRUE if the file was understood
+ */
+gboolean a_fit_read_file ( VikTrwLayer *vtl, FILE *ff, const gchar *name )
+{
+  g_return_val_if_fail ( ff != NULL, FALSE );
+
+  // Files are small enough (typically less than a few MB) to be decoded from memory
+  GByteArray *ba = g_byte_array_new ();
+  guint8 buf[65536];
+  size_t nn;
+  while ( (nn = fread ( buf, 1, sizeof(buf), ff )) > 0 )
+    g_byte_array_append ( ba, buf, nn );
+
+  FitReader *fr = g_new0 ( FitReader, 1 );
+  fr->vtl = vtl;
+
+  gboolean success = TRUE;
+  gboolean any = FALSE;
+  gsize pos = 0;
+  while ( success && a_fit_check_header ( ba->data + pos, ba->len - pos ) ) {
+    const guint8 *header = ba->data + pos;
+    gsize header_size = header[0];
+    gsize data_size = header[4] | header[5] << 8 | header[6] << 16 | (guint32)header[7] << 24;
+    gsize available = ba->len - pos;
+
+    if ( header_size > available ) {
+      success = FALSE;
+      break;
+    }
+    if ( data_size > available - header_size ) {
+      // Typically a recording that was not finished properly; use what is there
+      g_warning ( "%s: FIT file truncated", __FUNCTION__ );
+      data_size = available - header_size;
+    }
+    else if ( data_size + 2 <= available - header_size ) {
+      guint16 crc = header[header_size+data_size] | header[header_size+data_size+1] << 8;
+      if ( crc != fit_crc ( 0, header, header_size+data_size ) )
+        g_warning ( "%s: FIT file CRC mismatch", __FUNCTION__ );
+    }
+
+    // Local message definitions only apply within each file
+    memset ( fr->defs, 0, sizeof(fr->defs) );
+    if ( !fit_read_records ( fr, header + header_size, header + header_size + data_size ) ) {
+      g_warning ( "%s: FIT file damaged at offset %" G_GSIZE_FORMAT, __FUNCTION__, pos );
+      success = any || fr->trk != NULL;
+      break;
+    }
+    any = TRUE;
+    pos += header_size + data_size + 2;
+    if ( pos >= ba->len )
+      break;
+  }
+
+  if ( !any && !fr->trk )
+    success = FALSE;
+
+  if ( fr->trk ) {
+    VikTrack *trk = fr->trk;
+    trk->trackpoints = g_list_reverse ( trk->trackpoints );
+    trk->is_route = fr->is_course;
+    vik_trw_layer_filein_add_track ( vtl, fr->name ? fr->name : (gchar*)(name ? name : "FIT"), trk );
+    // Heart rate, cadence etc. need GPX 1.1 extensions to be written out again
+    vik_trw_layer_set_gpx_version ( vtl, GPX_V1_1 );
+  }
+
+  g_free ( fr->name );
+  g_free ( fr );
+  g_byte_array_free ( ba, TRUE );
+  return success;
+}
@@ -0,0 +1,288 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <math.h>
+#include "flatkdtree.h"
+
+/*
+ * The points of the range [lo, hi) are split at mid = lo + (hi-lo)/2,
+ *  on the first coordinate at even depths and the second at odd depths,
+ *  with those no greater before mid and those no less after it.
+ */
+
+struct _FlatKDTree {
+  guint count;
+  const gdouble *coords;
+  gdouble *owned;  // When copied
+  guint32 *ids;    // NULL when the ids are the positions
+};
+
+// Fewer queries than this per thread are not worth starting another for
+#define BATCH_MIN_PER_THREAD 256
+
+static inline void kd_swap ( gdouble *coords, guint32 *ids, gint a, gint b )
+{
+  gdouble x = coords[2*a], y = coords[2*a+1];
+  coords[2*a] = coords[2*b];
+  coords[2*a+1] = coords[2*b+1];
+  coords[2*b] = x;
+  coords[2*b+1] = y;
+  if ( ids ) {
+    guint32 id = ids[a];
+    ids[a] = ids[b];
+    ids[b] = id;
+  }
+}
+
+/**
+ * Move the nth point of the range to where it would be if sorted on the dimension,
+ *  with none greater before it and none less after it
+ */
+static void kd_select ( gdouble *coords, guint32 *ids, gint lo, gint hi, gint nth, guint dim )
+{
+  while ( hi - lo > 1 ) {
+    gdouble pivot = coords[2*(lo + (hi - lo) / 2) + dim];
+    gint ii = lo, jj = hi - 1;
+    while ( ii <= jj ) {
+      while ( coords[2*ii + dim] < pivot ) ii++;
+      while ( coords[2*jj + dim] > pivot ) jj--;
+      if ( ii <= jj )
+        kd_swap ( coords, ids, ii++, jj-- );
+    }
+    // Now [lo, jj] are no greater and [ii, hi) no less than the pivot, and anything between equals it
+    if ( nth <= jj )
+      hi = jj + 1;
+    else if ( nth >= ii )
+      lo = ii;
+    else
+      return;
+  }
+}
+
+static void kd_order ( gdouble *coords, guint32 *ids, gint lo, gint hi, guint depth )
+{
+  while ( hi - lo > 1 ) {
+    gint mid = lo + (hi - lo) / 2;
+    kd_select ( coords, ids, lo, hi, mid, depth % 2 );
+    depth++;
+    kd_order ( coords, ids, lo, mid, depth );
+    lo = mid + 1;
+  }
+}
+
+/**
+ * a_flat_kdtree_order:
+ * @coords: The points as pairs of coordinates
+ * @ids:    Values to be kept with each point, or NULL
+ *
+ * Put the points into the order used by the tree, e.g. to store them for a_flat_kdtree_new_static()
+ */
+void a_flat_kdtree_order ( gdouble *coords, guint32 *ids, guint count )
+{
+  g_return_if_fail ( count <= G_MAXINT );
+  kd_order ( coords, ids, 0, count, 0 );
+}
+
+FlatKDTree *a_flat_kdtree_new ( const gdouble *coords, guint count )
+{
+  FlatKDTree *tree = g_new0 ( FlatKDTree, 1 );
+  tree->count = count;
+  tree->owned = g_memdup ( coords, 2 * count * sizeof(gdouble) );
+  tree->ids = g_new ( guint32, count );
+  for ( guint ii = 0; ii < count; ii++ )
+    tree->ids[ii] = ii;
+  a_flat_kdtree_order ( tree->owned, tree->ids, count );
+  tree->coords = tree->owned;
+  return tree;
+}
+
+FlatKDTree *a_flat_kdtree_new_static ( const gdouble *coords, guint count )
+{
+  FlatKDTree *tree = g_new0 ( FlatKDTree, 1 );
+  tree->count = count;
+  tree->coords = coords;
+  return tree;
+}
+
+void a_flat_kdtree_free ( FlatKDTree *tree )
+{
+  if ( !tree )
+    return;
+  g_free ( tree->owned );
+  g_free ( tree->ids );
+  g_free ( tree );
+}
+
+guint a_flat_kdtree_size ( FlatKDTree *tree )
+{
+  return tree->count;
+}
+
+static inline guint32 kd_id ( const FlatKDTree *tree, guint pos )
+{
+  return tree->ids ? tree->ids[pos] : pos;
+}
+
+static void kd_nearest ( const FlatKDTree *tree, guint lo, guint hi, guint depth, const gdouble pt[2], gdouble *best_sq, gint *best )
+{
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    const gdouble *node = tree->coords + 2 * mid;
+    gdouble d0 = pt[0] - node[0];
+    gdouble d1 = pt[1] - node[1];
+    gdouble dist_sq = d0*d0 + d1*d1;
+    if ( dist_sq < *best_sq ) {
+      *best_sq = dist_sq;
+      *best = mid;
+    }
+    gdouble diff = (depth % 2) ? d1 : d0;
+    depth++;
+    // Search the side containing the point first, then the other only if it could be closer
+    if ( diff < 0 ) {
+      kd_nearest ( tree, lo, mid, depth, pt, best_sq, best );
+      if ( diff*diff >= *best_sq )
+        return;
+      lo = mid + 1;
+    } else {
+      kd_nearest ( tree, mid + 1, hi, depth, pt, best_sq, best );
+      if ( diff*diff >= *best_sq )
+        return;
+      hi = mid;
+    }
+  }
+}
+
+gint a_flat_kdtree_nearest ( FlatKDTree *tree, const gdouble pt[2], gdouble *distance )
+{
+  gdouble best_sq = *distance * *distance;
+  gint best = -1;
+  kd_nearest ( tree, 0, tree->count, 0, pt, &best_sq, &best );
+  if ( best < 0 )
+    return -1;
+  *distance = sqrt ( best_sq );
+  return kd_id ( tree, best );
+}
+
+typedef struct {
+  guint k;
+  guint found;
+  guint32 *ids;
+  gdouble *dist_sq;
+  gdouble bound_sq; // Anything further away is not wanted
+} KDKnn;
+
+static inline void knn_add ( KDKnn *knn, guint32 id, gdouble dist_sq )
+{
+  // Kept in order, as k is expected to be small
+  guint pos = knn->found < knn->k ? knn->found++ : knn->k - 1;
+  while ( pos > 0 && knn->dist_sq[pos-1] > dist_sq ) {
+    knn->dist_sq[pos] = knn->dist_sq[pos-1];
+    knn->ids[pos] = knn->ids[pos-1];
+    pos--;
+  }
+  knn->dist_sq[pos] = dist_sq;
+  knn->ids[pos] = id;
+  if ( knn->found == knn->k )
+    knn->bound_sq = knn->dist_sq[knn->k-1];
+}
+
+static void kd_knn ( const FlatKDTree *tree, guint lo, guint hi, guint depth, const gdouble pt[2], KDKnn *knn )
+{
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    const gdouble *node = tree->coords + 2 * mid;
+    gdouble d0 = pt[0] - node[0];
+    gdouble d1 = pt[1] - node[1];
+    gdouble dist_sq = d0*d0 + d1*d1;
+    if ( dist_sq < knn->bound_sq )
+      knn_add ( knn, kd_id ( tree, mid ), dist_sq );
+    gdouble diff = (depth % 2) ? d1 : d0;
+    depth++;
+    if ( diff < 0 ) {
+      kd_knn ( tree, lo, mid, depth, pt, knn );
+      if ( diff*diff >= knn->bound_sq )
+        return;
+      lo = mid + 1;
+    } else {
+      kd_knn ( tree, mid + 1, hi, depth, pt, knn );
+      if ( diff*diff >= knn->bound_sq )
+        return;
+      hi = mid;
+    }
+  }
+}
+
+guint a_flat_kdtree_knn ( FlatKDTree *tree, const gdouble pt[2], guint k, gdouble max_distance, guint32 *ids, gdouble *distances )
+{
+  if ( !k )
+    return 0;
+  KDKnn knn = { k, 0, ids, distances, max_distance * max_distance };
+  kd_knn ( tree, 0, tree->count, 0, pt, &knn );
+  for ( guint ii = 0; ii < knn.found; ii++ )
+    distances[ii] = sqrt ( distances[ii] );
+  return knn.found;
+}
+
+typedef struct {
+  FlatKDTree *tree;
+  const gdouble *pts;
+  guint start, end;
+  guint k;
+  gdouble max_distance;
+  guint32 *ids;
+  gdouble *distances;
+  guint *counts;
+} KDBatch;
+
+static gpointer kd_batch_run ( gpointer data )
+{
+  KDBatch *kb = data;
+  for ( guint ii = kb->start; ii < kb->end; ii++ )
+    kb->counts[ii] = a_flat_kdtree_knn ( kb->tree, kb->pts + 2*ii, kb->k, kb->max_distance,
+                                         kb->ids + (gsize)ii * kb->k, kb->distances + (gsize)ii * kb->k );
+  return NULL;
+}
+
+void a_flat_kdtree_knn_batch ( FlatKDTree *tree, const gdouble *pts, guint count, guint k, gdouble max_distance,
+                               guint32 *ids, gdouble *distances, guint *counts, guint threads )
+{
+  if ( !threads )
+    threads = g_get_num_processors ();
+  threads = CLAMP ( count / BATCH_MIN_PER_THREAD, 1, threads );
+
+  KDBatch *batches = g_new ( KDBatch, threads );
+  GThread **workers = g_new0 ( GThread*, threads );
+  for ( guint tt = 0; tt < threads; tt++ ) {
+    KDBatch kb = { tree, pts, (guint64)count * tt / threads, (guint64)count * (tt + 1) / threads,
+                   k, max_distance, ids, distances, counts };
+    batches[tt] = kb;
+    // This thread takes the first share
+    if ( tt > 0 )
+      workers[tt] = g_thread_new ( "kdtree", kd_batch_run, &batches[tt] );
+  }
+  (void)kd_batch_run ( &batches[0] );
+  for ( guint tt = 1; tt < threads; tt++ )
+    g_thread_join ( workers[tt] );
+  g_free ( workers );
+  g_free ( batches );
+}
@@ -0,0 +1,56 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_FLATKDTREE_H
+#define __VIKING_FLATKDTREE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// A 2D kd-tree built once from all its points and stored in a flat array,
+//  the node of each range of the array being its middle point, so it has no pointers
+// Searches do not allocate memory, so any number of threads can search the same tree
+typedef struct _FlatKDTree FlatKDTree;
+
+// Put the points (pairs of coordinates, with an optional id each) into the tree order
+void a_flat_kdtree_order ( gdouble *coords, guint32 *ids, guint count );
+
+// Copies the points. Their ids are their positions in coords
+FlatKDTree *a_flat_kdtree_new ( const gdouble *coords, guint count );
+// Uses points already in the tree order, which must remain whilst the tree is used. Their ids are their positions
+FlatKDTree *a_flat_kdtree_new_static ( const gdouble *coords, guint count );
+void a_flat_kdtree_free ( FlatKDTree *tree );
+guint a_flat_kdtree_size ( FlatKDTree *tree );
+
+// Distances are in the units of the coordinates
+// distance: On entry the furthest to look, on return the distance of the point found
+// Returns: The id of the nearest point, or -1 if none is within the distance
+gint a_flat_kdtree_nearest ( FlatKDTree *tree, const gdouble pt[2], gdouble *distance );
+// Fills ids and distances (each of k values) nearest first
+// Returns: The number found
+guint a_flat_kdtree_knn ( FlatKDTree *tree, const gdouble pt[2], guint k, gdouble max_distance, guint32 *ids, gdouble *distances );
+// k nearest for each of the points, with the results of query i from ids[i*k] and distances[i*k], and counts[i]
+// threads: 0 for one per processor
+void a_flat_kdtree_knn_batch ( FlatKDTree *tree, const gdouble *pts, guint count, guint k, gdouble max_distance,
+                               guint32 *ids, gdouble *distances, guint *counts, guint threads );
+
+G_END_DECLS
+
+#endif
@@ -23,166 +23,880 @@
  */
 
 #include "geojson.h"
-#include "gpx.h"
+#include "coords.h"
 #include "globals.h"
-#include "vikwindow.h"
 
+#include <math.h>
+#include <string.h>
 #include <glib.h>
-#include <glib/gstdio.h>
-#include <glib/gi18n.h>
 
-/**
- * Perform any cleanup actions once program has completed running
+#define GEOJSON_WRITE_BUFFER_SIZE (64*1024)
+#define GEOJSON_READ_BUFFER_SIZE (64*1024)
+// Far deeper than any GeoJSON needs, while limiting the recursion of the parser
+#define JSON_MAX_DEPTH 64
+
+/*
+ * Writing
+ *
+ * Waypoints become Point features and tracks or routes become LineString features,
+ *  or MultiLineString when a track has more than one segment.
+ * Properties follow those used by togeojson, so other tools see the usual names.
  */
-static void my_watch ( GPid pid,
-                       gint status,
-                       gpointer user_data )
+
+static void geojson_flush ( GString *out, FILE *ff, gboolean force )
+{
+	if ( out->len >= GEOJSON_WRITE_BUFFER_SIZE || (force && out->len) ) {
+		(void)fwrite ( out->str, 1, out->len, ff );
+		g_string_truncate ( out, 0 );
+	}
+}
+
+static void geojson_append_string ( GString *out, const gchar *str )
+{
+	g_string_append_c ( out, '"' );
+	for ( const guchar *ptr = (const guchar*)str; *ptr; ptr++ ) {
+		switch ( *ptr ) {
+		case '"':  g_string_append ( out, "\\\"" ); break;
+		case '\\': g_string_append ( out, "\\\\" ); break;
+		case '\n': g_string_append ( out, "\\n" ); break;
+		case '\r': g_string_append ( out, "\\r" ); break;
+		case '\t': g_string_append ( out, "\\t" ); break;
+		default:
+			if ( *ptr < 0x20 )
+				g_string_append_printf ( out, "\\u%04x", *ptr );
+			else
+				g_string_append_c ( out, *ptr );
+			break;
+		}
+	}
+	g_string_append_c ( out, '"' );
+}
+
+static void geojson_append_number ( GString *out, gdouble val )
+{
+	gchar buf[COORDS_STR_BUFFER_SIZE];
+	a_coords_dtostr_buffer ( val, buf );
+	g_string_append ( out, buf );
+}
+
+static void geojson_append_time ( GString *out, gdouble timestamp )
+{
+	GTimeVal tv;
+	gdouble secs = floor ( timestamp );
+	tv.tv_sec = (glong)secs;
+	tv.tv_usec = (glong)((timestamp - secs) * G_USEC_PER_SEC);
+	gchar *str = g_time_val_to_iso8601 ( &tv );
+	if ( str ) {
+		geojson_append_string ( out, str );
+		g_free ( str );
+	}
+	else
+		g_string_append ( out, "null" );
+}
+
+static void geojson_append_property ( GString *out, const gchar *key, const gchar *value, gboolean *first )
+{
+	if ( !value || !value[0] )
+		return;
+	g_string_append ( out, *first ? "" : "," );
+	geojson_append_string ( out, key );
+	g_string_append_c ( out, ':' );
+	geojson_append_string ( out, value );
+	*first = FALSE;
+}
+
+static void geojson_append_position ( GString *out, const VikCoord *coord, gdouble altitude )
 {
-	g_spawn_close_pid ( pid );
+	struct LatLon ll;
+	vik_coord_to_latlon ( coord, &ll );
+	g_string_append_c ( out, '[' );
+	geojson_append_number ( out, ll.lon );
+	g_string_append_c ( out, ',' );
+	geojson_append_number ( out, ll.lat );
+	if ( !isnan(altitude) ) {
+		g_string_append_c ( out, ',' );
+		geojson_append_number ( out, altitude );
+	}
+	g_string_append_c ( out, ']' );
+}
+
+static void geojson_write_waypoint ( GString *out, VikWaypoint *wp, gboolean *first )
+{
+	g_string_append ( out, *first ? "\n" : ",\n" );
+	*first = FALSE;
+	g_string_append ( out, "{\"type\":\"Feature\",\"geometry\":{\"type\":\"Point\",\"coordinates\":" );
+	geojson_append_position ( out, &wp->coord, wp->altitude );
+	g_string_append ( out, "},\"properties\":{" );
+	gboolean first_prop = TRUE;
+	geojson_append_property ( out, "name", wp->name, &first_prop );
+	geojson_append_property ( out, "cmt", wp->comment, &first_prop );
+	geojson_append_property ( out, "desc", wp->description, &first_prop );
+	geojson_append_property ( out, "type", wp->type, &first_prop );
+	geojson_append_property ( out, "sym", wp->symbol, &first_prop );
+	if ( !isnan(wp->timestamp) ) {
+		g_string_append ( out, first_prop ? "\"time\":" : ",\"time\":" );
+		geojson_append_time ( out, wp->timestamp );
+	}
+	g_string_append ( out, "}}" );
+}
+
+static void geojson_write_track ( GString *out, FILE *ff, VikTrack *trk, gboolean *first )
+{
+	if ( !trk->trackpoints )
+		return;
+
+	gboolean multi = FALSE;
+	gboolean has_times = FALSE;
+	for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+		VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+		if ( iter != trk->trackpoints && tp->newsegment )
+			multi = TRUE;
+		if ( !isnan(tp->timestamp) )
+			has_times = TRUE;
+	}
+
+	g_string_append ( out, *first ? "\n" : ",\n" );
+	*first = FALSE;
+	g_string_append ( out, "{\"type\":\"Feature\",\"geometry\":{\"type\":" );
+	g_string_append ( out, multi ? "\"MultiLineString\",\"coordinates\":[[" : "\"LineString\",\"coordinates\":[" );
+	for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+		VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+		if ( iter != trk->trackpoints )
+			g_string_append ( out, (multi && tp->newsegment) ? "],[" : "," );
+		geojson_append_position ( out, &tp->coord, tp->altitude );
+		geojson_flush ( out, ff, FALSE );
+	}
+	g_string_append ( out, multi ? "]]}" : "]}" );
+
+	g_string_append ( out, ",\"properties\":{" );
+	gboolean first_prop = TRUE;
+	geojson_append_property ( out, "_gpxType", trk->is_route ? "rte" : "trk", &first_prop );
+	geojson_append_property ( out, "name", trk->name, &first_prop );
+	geojson_append_property ( out, "cmt", trk->comment, &first_prop );
+	geojson_append_property ( out, "desc", trk->description, &first_prop );
+	geojson_append_property ( out, "type", trk->type, &first_prop );
+	if ( has_times ) {
+		// Matching the shape of the coordinates
+		g_string_append ( out, multi ? ",\"coordTimes\":[[" : ",\"coordTimes\":[" );
+		for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+			VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+			if ( iter != trk->trackpoints )
+				g_string_append ( out, (multi && tp->newsegment) ? "],[" : "," );
+			if ( isnan(tp->timestamp) )
+				g_string_append ( out, "null" );
+			else
+				geojson_append_time ( out, tp->timestamp );
+			geojson_flush ( out, ff, FALSE );
+		}
+		g_string_append ( out, multi ? "]]" : "]" );
+	}
+	g_string_append ( out, "}}" );
+}
+
+static gint geojson_waypoint_compare ( gconstpointer a, gconstpointer b )
+{
+	return g_strcmp0 ( VIK_WAYPOINT(a)->name, VIK_WAYPOINT(b)->name );
+}
+
+static void geojson_write_tracks ( GString *out, FILE *ff, GHashTable *tracks, gboolean *first )
+{
+	// As per the GPX export, the order of forming the list is more likely to be the creation order
+	GList *gl = NULL;
+	GHashTableIter iter;
+	gpointer key, value;
+	g_hash_table_iter_init ( &iter, tracks );
+	while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+		gl = g_list_prepend ( gl, value );
+	gl = g_list_reverse ( gl );
+
+	for ( GList *it = gl; it; it = it->next ) {
+		geojson_write_track ( out, ff, VIK_TRACK(it->data), first );
+		geojson_flush ( out, ff, FALSE );
+	}
+	g_list_free ( gl );
 }
 
 /**
  * a_geojson_write_file:
  *
+ * Write the visible kinds of items of the layer as a GeoJSON FeatureCollection
+ *
  * Returns TRUE if successfully written
  */
 gboolean a_geojson_write_file ( VikTrwLayer *vtl, FILE *ff )
 {
-	gboolean result = FALSE;
+	GString *out = g_string_sized_new ( GEOJSON_WRITE_BUFFER_SIZE + 4096 );
+	gboolean first = TRUE;
+
+	g_string_append ( out, "{\"type\":\"FeatureCollection\",\"features\":[" );
+
+	if ( vik_trw_layer_get_waypoints_visibility(vtl) ) {
+		GList *gl = g_hash_table_get_values ( vik_trw_layer_get_waypoints(vtl) );
+		gl = g_list_sort ( gl, geojson_waypoint_compare );
+		for ( GList *iter = gl; iter; iter = iter->next ) {
+			geojson_write_waypoint ( out, VIK_WAYPOINT(iter->data), &first );
+			geojson_flush ( out, ff, FALSE );
+		}
+		g_list_free ( gl );
+	}
+
+	if ( vik_trw_layer_get_tracks_visibility(vtl) )
+		geojson_write_tracks ( out, ff, vik_trw_layer_get_tracks(vtl), &first );
+
+	if ( vik_trw_layer_get_routes_visibility(vtl) )
+		geojson_write_tracks ( out, ff, vik_trw_layer_get_routes(vtl), &first );
+
+	g_string_append ( out, "\n]}\n" );
+	geojson_flush ( out, ff, TRUE );
+	g_string_free ( out, TRUE );
+
+	return !ferror ( ff );
+}
+
+/*
+ * Reading
+ *
+ * A SAX style JSON parser reads the file in blocks, passing each value to a handler as it goes.
+ * The GeoJSON handler only keeps the feature currently being read,
+ *  so memory use does not depend on the size of the FeatureCollection as a whole.
+ */
+
+typedef enum {
+	JSON_LITERAL_NULL,
+	JSON_LITERAL_TRUE,
+	JSON_LITERAL_FALSE,
+} JsonLiteral;
 
-	gchar *tmp_filename = a_gpx_write_tmp_file ( vtl, NULL );
-	if ( !tmp_filename )
-		return result;
+typedef struct {
+	void (*start_object) ( gpointer user_data );
+	void (*end_object) ( gpointer user_data );
+	void (*start_array) ( gpointer user_data );
+	void (*end_array) ( gpointer user_data );
+	// The strings are only valid during the call
+	void (*key) ( gpointer user_data, const gchar *key );
+	void (*string) ( gpointer user_data, const gchar *str );
+	void (*number) ( gpointer user_data, gdouble val );
+	void (*literal) ( gpointer user_data, JsonLiteral lit );
+} JsonHandler;
 
-	GPid pid;
-	gint mystdout;
+typedef struct {
+	FILE *ff;
+	guchar buf[GEOJSON_READ_BUFFER_SIZE];
+	gsize pos;
+	gsize len;
+	GString *str;
+	guint depth;
+	const JsonHandler *handler;
+	gpointer user_data;
+} JsonReader;
 
-	// geojson program should be on the $PATH
-	gchar **argv;
-	argv = g_new (gchar*, 5);
-	argv[0] = g_strdup (a_geojson_program_export());
-	argv[1] = g_strdup ("-f");
-	argv[2] = g_strdup ("gpx");
-	argv[3] = g_strdup (tmp_filename);
-	argv[4] = NULL;
+static gint json_peek ( JsonReader *jr )
+{
+	if ( jr->pos == jr->len ) {
+		jr->len = fread ( jr->buf, 1, sizeof(jr->buf), jr->ff );
+		jr->pos = 0;
+		if ( jr->len == 0 )
+			return EOF;
+	}
+	return jr->buf[jr->pos];
+}
 
-	GError *error = NULL;
-	// TODO: monitor stderr?
-	if (!g_spawn_async_with_pipes (NULL, argv, NULL, (GSpawnFlags) G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid, NULL, &mystdout, NULL, &error)) {
+static gint json_getc ( JsonReader *jr )
+{
+	gint ch = json_peek ( jr );
+	if ( ch != EOF )
+		jr->pos++;
+	return ch;
+}
 
-		if ( IS_VIK_WINDOW ((VikWindow *)VIK_GTK_WINDOW_FROM_LAYER(vtl)) ) {
-			gchar* msg = g_strdup_printf ( _("%s command failed: %s"), argv[0], error->message );
-			vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vtl), msg, VIK_STATUSBAR_INFO );
-			g_free (msg);
+/**
+ * Returns: the next character that is not whitespace, having read it
+ */
+static gint json_next ( JsonReader *jr )
+{
+	gint ch;
+	do {
+		ch = json_getc ( jr );
+	} while ( ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t' );
+	return ch;
+}
+
+static gint json_hex4 ( JsonReader *jr )
+{
+	gint val = 0;
+	for ( guint ii = 0; ii < 4; ii++ ) {
+		gint ch = json_getc ( jr );
+		if ( ch == EOF || !g_ascii_isxdigit(ch) )
+			return -1;
+		val = (val << 4) | g_ascii_xdigit_value ( ch );
+	}
+	return val;
+}
+
+/**
+ * Read a string, the opening quote having been read, into jr->str
+ */
+static gboolean json_parse_string ( JsonReader *jr )
+{
+	g_string_truncate ( jr->str, 0 );
+	while ( TRUE ) {
+		gint ch = json_getc ( jr );
+		if ( ch == EOF || ch < 0x20 )
+			return FALSE;
+		if ( ch == '"' )
+			return TRUE;
+		if ( ch != '\\' ) {
+			g_string_append_c ( jr->str, ch );
+			continue;
 		}
-		else
-			g_warning ("Async command failed: %s", error->message);
+		ch = json_getc ( jr );
+		switch ( ch ) {
+		case '"':
+		case '\\':
+		case '/': g_string_append_c ( jr->str, ch ); break;
+		case 'b': g_string_append_c ( jr->str, '\b' ); break;
+		case 'f': g_string_append_c ( jr->str, '\f' ); break;
+		case 'n': g_string_append_c ( jr->str, '\n' ); break;
+		case 'r': g_string_append_c ( jr->str, '\r' ); break;
+		case 't': g_string_append_c ( jr->str, '\t' ); break;
+		case 'u': {
+			gint uc = json_hex4 ( jr );
+			if ( uc < 0 )
+				return FALSE;
+			// Characters outside the BMP are a surrogate pair
+			if ( uc >= 0xd800 && uc < 0xdc00 ) {
+				if ( json_getc(jr) != '\\' || json_getc(jr) != 'u' )
+					return FALSE;
+				gint lo = json_hex4 ( jr );
+				if ( lo < 0xdc00 || lo >= 0xe000 )
+					return FALSE;
+				uc = 0x10000 + ((uc - 0xd800) << 10) + (lo - 0xdc00);
+			}
+			else if ( uc >= 0xdc00 && uc < 0xe000 )
+				return FALSE;
+			g_string_append_unichar ( jr->str, uc );
+			break;
+		}
+		default:
+			return FALSE;
+		}
+	}
+}
 
-		g_error_free(error);
+static gboolean json_parse_number ( JsonReader *jr, gint first )
+{
+	gchar buf[64];
+	guint len = 0;
+	buf[len++] = first;
+	while ( TRUE ) {
+		gint ch = json_peek ( jr );
+		if ( !(g_ascii_isdigit(ch) || ch == '.' || ch == 'e' || ch == 'E' || ch == '+' || ch == '-') )
+			break;
+		if ( len == sizeof(buf) - 1 )
+			return FALSE;
+		buf[len++] = json_getc ( jr );
 	}
-	else {
-		// Probably should use GIOChannels...
-		gchar line[512];
-		FILE *fout = fdopen(mystdout, "r");
-		setvbuf(fout, NULL, _IONBF, 0);
+	buf[len] = '\0';
+	gchar *end = NULL;
+	gdouble val = g_ascii_strtod ( buf, &end );
+	if ( end != buf + len )
+		return FALSE;
+	jr->handler->number ( jr->user_data, val );
+	return TRUE;
+}
+
+static gboolean json_parse_literal ( JsonReader *jr, const gchar *word, JsonLiteral lit )
+{
+	// The first character has been read already
+	for ( const gchar *ptr = word + 1; *ptr; ptr++ )
+		if ( json_getc ( jr ) != *ptr )
+			return FALSE;
+	jr->handler->literal ( jr->user_data, lit );
+	return TRUE;
+}
 
-		while (fgets(line, sizeof(line), fout)) {
-			fprintf ( ff, "%s", line );
+static gboolean json_parse_value ( JsonReader *jr, gint ch );
+
+static gboolean json_parse_object ( JsonReader *jr )
+{
+	if ( ++jr->depth > JSON_MAX_DEPTH )
+		return FALSE;
+	jr->handler->start_object ( jr->user_data );
+	gint ch = json_next ( jr );
+	if ( ch != '}' ) {
+		while ( TRUE ) {
+			if ( ch != '"' || !json_parse_string ( jr ) )
+				return FALSE;
+			if ( json_next ( jr ) != ':' )
+				return FALSE;
+			jr->handler->key ( jr->user_data, jr->str->str );
+			if ( !json_parse_value ( jr, json_next ( jr ) ) )
+				return FALSE;
+			ch = json_next ( jr );
+			if ( ch == '}' )
+				break;
+			if ( ch != ',' )
+				return FALSE;
+			ch = json_next ( jr );
 		}
+	}
+	jr->handler->end_object ( jr->user_data );
+	jr->depth--;
+	return TRUE;
+}
 
-		fclose(fout);
+static gboolean json_parse_array ( JsonReader *jr )
+{
+	if ( ++jr->depth > JSON_MAX_DEPTH )
+		return FALSE;
+	jr->handler->start_array ( jr->user_data );
+	gint ch = json_next ( jr );
+	if ( ch != ']' ) {
+		while ( TRUE ) {
+			if ( !json_parse_value ( jr, ch ) )
+				return FALSE;
+			ch = json_next ( jr );
+			if ( ch == ']' )
+				break;
+			if ( ch != ',' )
+				return FALSE;
+			ch = json_next ( jr );
+		}
+	}
+	jr->handler->end_array ( jr->user_data );
+	jr->depth--;
+	return TRUE;
+}
 
-		g_child_watch_add ( pid, (GChildWatchFunc) my_watch, NULL );
-		result = TRUE;
+/**
+ * Parse the value starting with the (already read) character @ch
+ */
+static gboolean json_parse_value ( JsonReader *jr, gint ch )
+{
+	switch ( ch ) {
+	case '{': return json_parse_object ( jr );
+	case '[': return json_parse_array ( jr );
+	case '"':
+		if ( !json_parse_string ( jr ) )
+			return FALSE;
+		jr->handler->string ( jr->user_data, jr->str->str );
+		return TRUE;
+	case 't': return json_parse_literal ( jr, "true", JSON_LITERAL_TRUE );
+	case 'f': return json_parse_literal ( jr, "false", JSON_LITERAL_FALSE );
+	case 'n': return json_parse_literal ( jr, "null", JSON_LITERAL_NULL );
+	default:
+		if ( ch == '-' || g_ascii_isdigit(ch) )
+			return json_parse_number ( jr, ch );
+		return FALSE;
 	}
+}
+
+/**
+ * Parse a whole JSON document, passing each part to the handler
+ */
+static gboolean json_parse_file ( FILE *ff, const JsonHandler *handler, gpointer user_data )
+{
+	JsonReader *jr = g_new0 ( JsonReader, 1 );
+	jr->ff = ff;
+	jr->str = g_string_new ( NULL );
+	jr->handler = handler;
+	jr->user_data = user_data;
+
+	// Skip any UTF-8 Byte Order Mark
+	if ( json_peek ( jr ) == 0xef && jr->len >= 3 && jr->buf[1] == 0xbb && jr->buf[2] == 0xbf )
+		jr->pos = 3;
 
-	g_strfreev (argv);
+	gboolean ans = json_parse_value ( jr, json_next ( jr ) ) && json_next ( jr ) == EOF;
+	if ( !ans )
+		g_warning ( "%s: JSON error near byte %ld", __FUNCTION__, ftell(ff) - (glong)(jr->len - jr->pos) );
 
-	// Delete the temporary file
-	(void)g_remove (tmp_filename);
-	g_free (tmp_filename);
+	g_string_free ( jr->str, TRUE );
+	g_free ( jr );
+	return ans;
+}
+
+// What each object or array being read is, as far as GeoJSON is concerned
+typedef enum {
+	GJ_OTHER = 0,
+	GJ_FEATURE = 1 << 0,     // An object with geometry and properties (or features)
+	GJ_GEOMETRY = 1 << 1,    // An object with a type and coordinates (or geometries)
+	GJ_FEATURES = 1 << 2,
+	GJ_GEOMETRIES = 1 << 3,
+	GJ_PROPERTIES = 1 << 4,
+	GJ_COORDINATES = 1 << 5, // Including each array within
+	GJ_TIMES = 1 << 6,       // The coordTimes property, including each array within
+} GeoJSONKind;
+
+typedef struct {
+	struct LatLon ll;
+	gdouble altitude;
+	gboolean newsegment;
+} GeoJSONPosition;
+
+typedef struct {
+	gchar *type;
+	GArray *positions;
+	gdouble vals[3];
+	guint n_vals;
+	gboolean new_line; // The next position starts a new line (or ring)
+} GeoJSONGeometry;
+
+typedef struct {
+	GList *waypoints; // Most recent first
+	GList *tracks;    // Most recent first
+	gchar *name;
+	gchar *comment;
+	gchar *description;
+	gchar *type;
+	gchar *symbol;
+	gdouble timestamp;
+	gboolean is_route;
+	GArray *times;
+} GeoJSONFeature;
+
+typedef struct {
+	GeoJSONKind kind;
+	gchar *key;                 // The key of the value being read, for objects
+	GeoJSONFeature *feature;    // Belonging to this frame when it is a GJ_FEATURE
+	GeoJSONGeometry *geometry;  // Belonging to this frame when it is a GJ_GEOMETRY
+} GeoJSONFrame;
 
-	return result;
+typedef struct {
+	VikTrwLayer *vtl;
+	GeoJSONFrame frames[JSON_MAX_DEPTH];
+	guint depth;
+	guint unnamed_waypoints;
+	guint unnamed_tracks;
+	guint unnamed_routes;
+} GeoJSONReader;
+
+static GeoJSONFrame *geojson_top ( GeoJSONReader *gr )
+{
+	return gr->depth ? &gr->frames[gr->depth-1] : NULL;
 }
 
-//
-// https://github.com/mapbox/togeojson
-//
-// https://www.npmjs.org/package/togeojson
-//
-// Tested with version 0.7.0
-const gchar* a_geojson_program_export ( void )
+static void geojson_feature_free ( GeoJSONFeature *ft )
 {
-	return "togeojson";
+	g_list_free_full ( ft->waypoints, (GDestroyNotify)vik_waypoint_free );
+	g_list_free_full ( ft->tracks, (GDestroyNotify)vik_track_free );
+	g_free ( ft->name );
+	g_free ( ft->comment );
+	g_free ( ft->description );
+	g_free ( ft->type );
+	g_free ( ft->symbol );
+	g_array_free ( ft->times, TRUE );
+	g_free ( ft );
 }
 
-//
-// https://github.com/tyrasd/togpx
-//
-// https://www.npmjs.org/package/togpx
-//
-// Tested with version 0.3.1
-const gchar* a_geojson_program_import ( void )
+static void geojson_geometry_free ( GeoJSONGeometry *geom )
 {
-	return "togpx";
+	g_free ( geom->type );
+	g_array_free ( geom->positions, TRUE );
+	g_free ( geom );
 }
 
 /**
- * a_geojson_import_to_gpx:
- *
- * @filename: The source GeoJSON file
- *
- * Returns: The name of newly created temporary GPX file
- *          This file should be removed once used and the string freed.
- *          If NULL then the process failed.
+ * Turn the geometry into waypoints or a track of the feature
  */
-gchar* a_geojson_import_to_gpx ( const gchar *filename )
-{
-	gchar *gpx_filename = NULL;
-	GError *error = NULL;
-	// Opening temporary file
-	int fd = g_file_open_tmp("vik_geojson_XXXXXX.gpx", &gpx_filename, &error);
-	if (fd < 0) {
-		g_warning ( _("failed to open temporary file: %s"), error->message );
-		g_clear_error ( &error );
-		return NULL;
-	}
-	g_debug ( "%s: temporary file = %s", __FUNCTION__, gpx_filename );
-
-	GPid pid;
-	gint mystdout;
-
-	// geojson program should be on the $PATH
-	gchar **argv;
-	argv = g_new (gchar*, 3);
-	argv[0] = g_strdup (a_geojson_program_import());
-	argv[1] = g_strdup (filename);
-	argv[2] = NULL;
-
-	FILE *gpxfile = fdopen (fd, "w");
-
-	// TODO: monitor stderr?
-	if (!g_spawn_async_with_pipes (NULL, argv, NULL, (GSpawnFlags) G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid, NULL, &mystdout, NULL, &error)) {
-		g_warning ("Async command failed: %s", error->message);
-		g_error_free(error);
-	}
-	else {
-		// Probably should use GIOChannels...
-		gchar line[512];
-		FILE *fout = fdopen(mystdout, "r");
-		setvbuf(fout, NULL, _IONBF, 0);
-
-		while (fgets(line, sizeof(line), fout)) {
-			fprintf ( gpxfile, "%s", line );
+static void geojson_geometry_finish ( GeoJSONReader *gr, GeoJSONGeometry *geom, GeoJSONFeature *ft )
+{
+	if ( !ft || !geom->type || !geom->positions->len )
+		return;
+
+	VikCoordMode mode = vik_trw_layer_get_coord_mode ( gr->vtl );
+	if ( !strcmp ( geom->type, "Point" ) || !strcmp ( geom->type, "MultiPoint" ) ) {
+		for ( guint ii = 0; ii < geom->positions->len; ii++ ) {
+			GeoJSONPosition *pos = &g_array_index ( geom->positions, GeoJSONPosition, ii );
+			VikWaypoint *wp = vik_waypoint_new ();
+			vik_coord_load_from_latlon ( &wp->coord, mode, &pos->ll );
+			wp->altitude = pos->altitude;
+			ft->waypoints = g_list_prepend ( ft->waypoints, wp );
 		}
+	}
+	// Viking has no areas, so the rings of polygons become track segments
+	else if ( !strcmp ( geom->type, "LineString" ) || !strcmp ( geom->type, "MultiLineString" ) ||
+	          !strcmp ( geom->type, "Polygon" ) || !strcmp ( geom->type, "MultiPolygon" ) ) {
+		VikTrack *trk = vik_track_new ();
+		for ( guint ii = 0; ii < geom->positions->len; ii++ ) {
+			GeoJSONPosition *pos = &g_array_index ( geom->positions, GeoJSONPosition, ii );
+			VikTrackpoint *tp = vik_trackpoint_new ();
+			vik_coord_load_from_latlon ( &tp->coord, mode, &pos->ll );
+			tp->altitude = pos->altitude;
+			tp->newsegment = pos->newsegment;
+			trk->trackpoints = g_list_prepend ( trk->trackpoints, tp );
+		}
+		trk->trackpoints = g_list_reverse ( trk->trackpoints );
+		ft->tracks = g_list_prepend ( ft->tracks, trk );
+	}
+}
 
-		fclose(fout);
-		g_child_watch_add ( pid, (GChildWatchFunc) my_watch, NULL );
+/**
+ * Add the items of the feature to the layer, now all its properties are known
+ */
+static void geojson_feature_finish ( GeoJSONReader *gr, GeoJSONFeature *ft )
+{
+	ft->waypoints = g_list_reverse ( ft->waypoints );
+	for ( GList *iter = ft->waypoints; iter; iter = iter->next ) {
+		VikWaypoint *wp = VIK_WAYPOINT(iter->data);
+		if ( ft->comment )
+			vik_waypoint_set_comment ( wp, ft->comment );
+		if ( ft->description )
+			vik_waypoint_set_description ( wp, ft->description );
+		if ( ft->type )
+			vik_waypoint_set_type ( wp, ft->type );
+		if ( ft->symbol )
+			vik_waypoint_set_symbol ( wp, ft->symbol );
+		wp->timestamp = ft->timestamp;
+		gchar *name = ft->name ? g_strdup ( ft->name ) : g_strdup_printf ( "VIKING_WP%04d", gr->unnamed_waypoints++ );
+		vik_trw_layer_filein_add_waypoint ( gr->vtl, name, wp );
+		g_free ( name );
 	}
+	g_list_free ( ft->waypoints );
+	ft->waypoints = NULL;
 
-	fclose (gpxfile);
+	// coordTimes follow the order of all the coordinates of the feature
+	guint nt = 0;
+	ft->tracks = g_list_reverse ( ft->tracks );
+	for ( GList *iter = ft->tracks; iter; iter = iter->next ) {
+		VikTrack *trk = VIK_TRACK(iter->data);
+		trk->is_route = ft->is_route;
+		if ( ft->comment )
+			vik_track_set_comment ( trk, ft->comment );
+		if ( ft->description )
+			vik_track_set_description ( trk, ft->description );
+		if ( ft->type )
+			vik_track_set_type ( trk, ft->type );
+		for ( GList *tpl = trk->trackpoints; tpl && nt < ft->times->len; tpl = tpl->next )
+			VIK_TRACKPOINT(tpl->data)->timestamp = g_array_index ( ft->times, gdouble, nt++ );
+		gchar *name = ft->name ? g_strdup ( ft->name ) :
+			ft->is_route ? g_strdup_printf ( "VIKING_RT%03d", gr->unnamed_routes++ ) :
+			               g_strdup_printf ( "VIKING_TR%03d", gr->unnamed_tracks++ );
+		vik_trw_layer_filein_add_track ( gr->vtl, name, trk );
+		g_free ( name );
+	}
+	g_list_free ( ft->tracks );
+	ft->tracks = NULL;
+}
 
-	g_strfreev (argv);
+static GeoJSONKind geojson_child_kind ( GeoJSONFrame *parent, gboolean is_array )
+{
+	if ( !parent )
+		return is_array ? GJ_OTHER : (GJ_FEATURE | GJ_GEOMETRY);
+	if ( parent->kind & GJ_COORDINATES )
+		return is_array ? GJ_COORDINATES : GJ_OTHER;
+	if ( parent->kind & GJ_TIMES )
+		return is_array ? GJ_TIMES : GJ_OTHER;
+	if ( parent->kind & GJ_FEATURES )
+		return is_array ? GJ_OTHER : GJ_FEATURE;
+	if ( parent->kind & GJ_GEOMETRIES )
+		return is_array ? GJ_OTHER : GJ_GEOMETRY;
 
-	return gpx_filename;
+	const gchar *key = parent->key;
+	if ( !key )
+		return GJ_OTHER;
+	if ( parent->kind & GJ_FEATURE ) {
+		if ( is_array && !strcmp ( key, "features" ) )
+			return GJ_FEATURES;
+		if ( !is_array && !strcmp ( key, "geometry" ) )
+			return GJ_GEOMETRY;
+		if ( !is_array && !strcmp ( key, "properties" ) )
+			return GJ_PROPERTIES;
+	}
+	if ( parent->kind & GJ_GEOMETRY ) {
+		if ( is_array && !strcmp ( key, "coordinates" ) )
+			return GJ_COORDINATES;
+		if ( is_array && !strcmp ( key, "geometries" ) )
+			return GJ_GEOMETRIES;
+	}
+	if ( (parent->kind & GJ_PROPERTIES) && is_array && !strcmp ( key, "coordTimes" ) )
+		return GJ_TIMES;
+	return GJ_OTHER;
+}
+
+static void geojson_push ( GeoJSONReader *gr, gboolean is_array )
+{
+	GeoJSONFrame *parent = geojson_top ( gr );
+	GeoJSONFrame *frame = &gr->frames[gr->depth++];
+	frame->kind = geojson_child_kind ( parent, is_array );
+	frame->key = NULL;
+	frame->feature = parent ? parent->feature : NULL;
+	frame->geometry = parent ? parent->geometry : NULL;
+
+	if ( frame->kind & GJ_FEATURE ) {
+		frame->feature = g_new0 ( GeoJSONFeature, 1 );
+		frame->feature->timestamp = NAN;
+		frame->feature->times = g_array_new ( FALSE, FALSE, sizeof(gdouble) );
+	}
+	if ( frame->kind & GJ_GEOMETRY ) {
+		frame->geometry = g_new0 ( GeoJSONGeometry, 1 );
+		frame->geometry->positions = g_array_new ( FALSE, FALSE, sizeof(GeoJSONPosition) );
+		frame->geometry->new_line = TRUE;
+	}
+	if ( (frame->kind & GJ_COORDINATES) && frame->geometry )
+		frame->geometry->n_vals = 0;
+}
+
+static void geojson_pop ( GeoJSONReader *gr )
+{
+	GeoJSONFrame *frame = &gr->frames[--gr->depth];
+	GeoJSONGeometry *geom = frame->geometry;
+
+	if ( (frame->kind & GJ_COORDINATES) && geom ) {
+		// An array of numbers is a position, otherwise it was a line (or ring, etc...)
+		if ( geom->n_vals >= 2 ) {
+			GeoJSONPosition pos;
+			pos.ll.lon = geom->vals[0];
+			pos.ll.lat = geom->vals[1];
+			pos.altitude = geom->n_vals > 2 ? geom->vals[2] : NAN;
+			pos.newsegment = geom->new_line;
+			g_array_append_val ( geom->positions, pos );
+			geom->new_line = FALSE;
+		}
+		else
+			geom->new_line = TRUE;
+		geom->n_vals = 0;
+	}
+	if ( frame->kind & GJ_GEOMETRY ) {
+		geojson_geometry_finish ( gr, geom, frame->feature );
+		geojson_geometry_free ( geom );
+	}
+	if ( frame->kind & GJ_FEATURE ) {
+		geojson_feature_finish ( gr, frame->feature );
+		geojson_feature_free ( frame->feature );
+	}
+	g_free ( frame->key );
+}
+
+static void geojson_start_object ( gpointer user_data )
+{
+	geojson_push ( (GeoJSONReader*)user_data, FALSE );
+}
+
+static void geojson_start_array ( gpointer user_data )
+{
+	geojson_push ( (GeoJSONReader*)user_data, TRUE );
+}
+
+static void geojson_end ( gpointer user_data )
+{
+	geojson_pop ( (GeoJSONReader*)user_data );
+}
+
+static void geojson_key ( gpointer user_data, const gchar *key )
+{
+	GeoJSONFrame *frame = geojson_top ( (GeoJSONReader*)user_data );
+	g_free ( frame->key );
+	frame->key = g_strdup ( key );
+}
+
+static void geojson_time ( GeoJSONFeature *ft, const gchar *str )
+{
+	GTimeVal tv;
+	gdouble timestamp = NAN;
+	if ( str && g_time_val_from_iso8601 ( str, &tv ) )
+		timestamp = tv.tv_sec + (gdouble)tv.tv_usec/G_USEC_PER_SEC;
+	g_array_append_val ( ft->times, timestamp );
+}
+
+static void geojson_property ( GeoJSONFeature *ft, const gchar *key, const gchar *str )
+{
+	gchar **field = NULL;
+	if ( !strcmp ( key, "name" ) || !strcmp ( key, "title" ) )
+		field = &ft->name;
+	else if ( !strcmp ( key, "cmt" ) || !strcmp ( key, "comment" ) )
+		field = &ft->comment;
+	else if ( !strcmp ( key, "desc" ) || !strcmp ( key, "description" ) )
+		field = &ft->description;
+	else if ( !strcmp ( key, "type" ) )
+		field = &ft->type;
+	else if ( !strcmp ( key, "sym" ) )
+		field = &ft->symbol;
+	else if ( !strcmp ( key, "_gpxType" ) )
+		ft->is_route = !strcmp ( str, "rte" );
+	else if ( !strcmp ( key, "time" ) ) {
+		GTimeVal tv;
+		if ( g_time_val_from_iso8601 ( str, &tv ) )
+			ft->timestamp = tv.tv_sec + (gdouble)tv.tv_usec/G_USEC_PER_SEC;
+	}
+	if ( field && !*field )
+		*field = g_strdup ( str );
+}
+
+static void geojson_string ( gpointer user_data, const gchar *str )
+{
+	GeoJSONFrame *frame = geojson_top ( (GeoJSONReader*)user_data );
+	if ( !frame )
+		return;
+	if ( frame->kind & GJ_TIMES )
+		geojson_time ( frame->feature, str );
+	else if ( (frame->kind & GJ_PROPERTIES) && frame->key )
+		geojson_property ( frame->feature, frame->key, str );
+	else if ( (frame->kind & GJ_GEOMETRY) && frame->key && !strcmp ( frame->key, "type" ) ) {
+		g_free ( frame->geometry->type );
+		frame->geometry->type = g_strdup ( str );
+	}
+}
+
+static void geojson_number ( gpointer user_data, gdouble val )
+{
+	GeoJSONFrame *frame = geojson_top ( (GeoJSONReader*)user_data );
+	if ( !frame )
+		return;
+	if ( (frame->kind & GJ_COORDINATES) && frame->geometry ) {
+		// Any values beyond altitude are ignored
+		GeoJSONGeometry *geom = frame->geometry;
+		if ( geom->n_vals < G_N_ELEMENTS(geom->vals) )
+			geom->vals[geom->n_vals] = val;
+		geom->n_vals++;
+	}
+}
+
+static void geojson_literal ( gpointer user_data, JsonLiteral lit )
+{
+	GeoJSONFrame *frame = geojson_top ( (GeoJSONReader*)user_data );
+	// Keep the times in step with the coordinates
+	if ( frame && (frame->kind & GJ_TIMES) && lit == JSON_LITERAL_NULL )
+		geojson_time ( frame->feature, NULL );
+}
+
+static const JsonHandler geojson_handler = {
+	geojson_start_object,
+	geojson_end,
+	geojson_start_array,
+	geojson_end,
+	geojson_key,
+	geojson_string,
+	geojson_number,
+	geojson_literal,
+};
+
+/**
+ * a_geojson_read_file:
+ *
+ * Read the Point, LineString and Polygon (and Multi...) features of a GeoJSON file,
+ *  as waypoints and tracks (or routes) respectively.
+ * Only one feature is held at a time, so any size of FeatureCollection can be read.
+ *
+ * Returns: FALSE if the file is not valid JSON
+ */
+gboolean a_geojson_read_file ( VikTrwLayer *vtl, FILE *ff )
+{
+	g_assert ( ff != NULL && vtl != NULL );
+
+	GeoJSONReader *gr = g_new0 ( GeoJSONReader, 1 );
+	gr->vtl = vtl;
+
+	gboolean ans = json_parse_file ( ff, &geojson_handler, gr );
+
+	// Discard whatever was being read when an error occurred
+	while ( gr->depth ) {
+		GeoJSONFrame *frame = &gr->frames[--gr->depth];
+		if ( frame->kind & GJ_GEOMETRY )
+			geojson_geometry_free ( frame->geometry );
+		if ( frame->kind & GJ_FEATURE )
+			geojson_feature_free ( frame->feature );
+		g_free ( frame->key );
+	}
+	g_free ( gr );
+	return ans;
 }
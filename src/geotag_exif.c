@@ -30,6 +30,7 @@
  */
 #include <string.h>
 #include "geotag_exif.h"
+#include "geotagindex.h"
 #include "config.h"
 #include "globals.h"
 #include "file.h"
@@ -262,144 +263,189 @@ MyReturn0:
 }
 
 /**
- * a_geotag_create_waypoint_from_file:
+ * a_geotag_info_clear:
+ *
+ * Free the strings of the info and reset it to having nothing known
+ */
+void a_geotag_info_clear ( geotag_info_t *info )
+{
+	g_free ( info->datetime );
+	g_free ( info->name );
+	g_free ( info->comment );
+	memset ( info, 0, sizeof(geotag_info_t) );
+	info->altitude = NAN;
+	info->direction = NAN;
+	info->direction_ref = WP_IMAGE_DIRECTION_REF_TRUE;
+}
+
+/**
+ * a_geotag_read_info:
  * @filename: The image file to process
- * @vcmode:   The current location mode to use in the positioning of Waypoint
- * @name:     Returns a name for the Waypoint (can be NULL)
+ * @info:     Returns everything about the image that is used for geotagging,
+ *            to be freed with a_geotag_info_clear()
  *
- * Returns: An allocated Waypoint or NULL if Waypoint could not be generated (e.g. no EXIF info)
+ * Returns: %FALSE if the EXIF information could not be read (the info is then still cleared)
+ *
+ *  The EXIF data is read only once for the position, time, direction, name and comment
  *
  */
-VikWaypoint* a_geotag_create_waypoint_from_file ( const gchar *filename, VikCoordMode vcmode, gchar **name )
+gboolean a_geotag_read_info ( const gchar *filename, geotag_info_t *info )
 {
-	// Default return values (for failures)
-	*name = NULL;
-	VikWaypoint *wp = NULL;
+	gboolean ans = FALSE;
+	memset ( info, 0, sizeof(geotag_info_t) );
+	a_geotag_info_clear ( info );
 
 #ifdef HAVE_LIBGEXIV2
 	GExiv2Metadata *gemd = gexiv2_metadata_new ();
 	if ( gexiv2_metadata_open_path ( gemd, filename, NULL ) ) {
-		gdouble lat;
-		gdouble lon;
-		gdouble alt;
-		if ( gexiv2_metadata_get_gps_info ( gemd, &lon, &lat, &alt ) ) {
-			struct LatLon ll;
-			ll.lat = lat;
-			ll.lon = lon;
-
-			//
-			// Now create Waypoint with acquired information
-			//
-			wp = vik_waypoint_new();
-			// Set info from exif values
-			// Location
-			vik_coord_load_from_latlon ( &(wp->coord), vcmode, &ll );
-			// Altitude
-			wp->altitude = alt;
-
-			if ( gexiv2_metadata_has_tag ( gemd, "Exif.Image.XPTitle" ) )
-				*name = g_strdup ( gexiv2_metadata_get_tag_interpreted_string ( gemd, "Exif.Image.XPTitle" ) );
-			wp->comment = geotag_get_exif_comment ( gemd );
-
-			// Direction
-			VikWaypointImageDirectionRef ref = WP_IMAGE_DIRECTION_REF_TRUE;
-			if ( gexiv2_metadata_has_tag ( gemd, EXIF_GPS_IMGDIR_REF ) ) {
-				gchar* ref_str = gexiv2_metadata_get_tag_interpreted_string(gemd, EXIF_GPS_IMGDIR_REF);
-				if ( ref_str && g_ascii_strncasecmp ("M", ref_str, 1) == 0 )
-					ref = WP_IMAGE_DIRECTION_REF_MAGNETIC;
-				g_free ( ref_str );
-			}
-			if ( gexiv2_metadata_has_tag ( gemd, EXIF_GPS_IMGDIR ) ) {
-				gint nom;
-				gint den;
-				gdouble direction = NAN;
-				if ( gexiv2_metadata_get_exif_tag_rational (gemd, EXIF_GPS_IMGDIR, &nom, &den) )
-					if ( den != 0 )
-						direction = (gdouble)nom/(gdouble)den;
-
-				if ( !isnan(direction) )
-					vik_waypoint_set_image_direction_info ( wp, direction, ref );
-			}
+		ans = TRUE;
+		gdouble lat, lon, alt;
+		if ( gexiv2_metadata_get_gps_longitude ( gemd, &lon ) && gexiv2_metadata_get_gps_latitude ( gemd, &lat ) ) {
+			info->has_gps = TRUE;
+			info->ll.lat = lat;
+			info->ll.lon = lon;
+			if ( gexiv2_metadata_get_gps_altitude ( gemd, &alt ) )
+				info->altitude = alt;
+		}
 
-			vik_waypoint_set_image ( wp, filename );
+		// Prefer 'Photo' version over 'Image'
+		if ( gexiv2_metadata_has_tag ( gemd, "Exif.Photo.DateTimeOriginal" ) )
+			info->datetime = gexiv2_metadata_get_tag_interpreted_string ( gemd, "Exif.Photo.DateTimeOriginal" );
+		else
+			info->datetime = gexiv2_metadata_get_tag_interpreted_string ( gemd, "Exif.Image.DateTimeOriginal" );
+
+		if ( gexiv2_metadata_has_tag ( gemd, "Exif.Image.XPTitle" ) )
+			info->name = gexiv2_metadata_get_tag_interpreted_string ( gemd, "Exif.Image.XPTitle" );
+		info->comment = geotag_get_exif_comment ( gemd );
+
+		// Direction
+		if ( gexiv2_metadata_has_tag ( gemd, EXIF_GPS_IMGDIR_REF ) ) {
+			gchar* ref_str = gexiv2_metadata_get_tag_interpreted_string(gemd, EXIF_GPS_IMGDIR_REF);
+			if ( ref_str && g_ascii_strncasecmp ("M", ref_str, 1) == 0 )
+				info->direction_ref = WP_IMAGE_DIRECTION_REF_MAGNETIC;
+			g_free ( ref_str );
+		}
+		if ( gexiv2_metadata_has_tag ( gemd, EXIF_GPS_IMGDIR ) ) {
+			gint nom;
+			gint den;
+			if ( gexiv2_metadata_get_exif_tag_rational (gemd, EXIF_GPS_IMGDIR, &nom, &den) )
+				if ( den != 0 )
+					info->direction = (gdouble)nom/(gdouble)den;
 		}
 	}
 	metadata_free ( gemd );
 #else
 #ifdef HAVE_LIBEXIF
-	// TODO use log?
-	//ExifLog *log = NULL;
-
-	// open image with libexif
 	ExifData *ed = exif_data_new_from_file ( filename );
 
 	// Detect EXIF load failure
 	if ( !ed )
-		// return with no Waypoint
-		return wp;
-
-	struct LatLon ll;
+		return ans;
+	ans = TRUE;
 
 	gchar str[128];
 	ExifEntry *ee;
 
+	ee = exif_content_get_entry (ed->ifd[EXIF_IFD_EXIF], EXIF_TAG_DATE_TIME_ORIGINAL);
+	if ( ee ) {
+		exif_entry_get_value ( ee, str, 128 );
+		info->datetime = g_strdup ( str );
+	}
+
 	ee = exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_VERSION_ID);
 	// Confirm this has a GPS Id - normally "2.0.0.0" or "2.2.0.0"
-	if ( ! ( ee && ee->components == 4 ) )
-		goto MyReturn;
-	// Could test for these versions explicitly but may have byte order issues...
-	//if ( ! ( ee->data[0] == 2 && ee->data[2] == 0 && ee->data[3] == 0 ) )
-	//	goto MyReturn;
-
-	ll = get_latlon ( ed );
-
-	// Hopefully won't have valid images at 0,0!
-	if ( ll.lat == 0.0 && ll.lon == 0.0 )
-		goto MyReturn;
-
-	//
-	// Not worried if none of the other fields exist, as can default the values to something
-	//
-
-	gdouble alt = NAN;
-	ee = exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_ALTITUDE);
-	if ( ee && ee->components == 1 && ee->format == EXIF_FORMAT_RATIONAL ) {
-		alt = Rational2Double ( ee->data,
-								0,
-								exif_data_get_byte_order(ed) );
-
-		ee = exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_ALTITUDE_REF);
-		if ( ee && ee->components == 1 && ee->format == EXIF_FORMAT_BYTE && ee->data[0] == 1 )
-			alt = -alt;
+	//  and the basic GPS fields as well, as some images have just the version
+	if ( ee && ee->components == 4 &&
+	     exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_LATITUDE) &&
+	     exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_LONGITUDE) ) {
+		info->has_gps = TRUE;
+		info->ll = get_latlon ( ed );
+
+		ee = exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_ALTITUDE);
+		if ( ee && ee->components == 1 && ee->format == EXIF_FORMAT_RATIONAL ) {
+			info->altitude = Rational2Double ( ee->data,
+											   0,
+											   exif_data_get_byte_order(ed) );
+
+			ee = exif_content_get_entry (ed->ifd[EXIF_IFD_GPS], EXIF_TAG_GPS_ALTITUDE_REF);
+			if ( ee && ee->components == 1 && ee->format == EXIF_FORMAT_BYTE && ee->data[0] == 1 )
+				info->altitude = -info->altitude;
+		}
 	}
 
 	// Name
 	ee = exif_content_get_entry (ed->ifd[EXIF_IFD_0], EXIF_TAG_XP_TITLE);
 	if ( ee ) {
 		exif_entry_get_value ( ee, str, 128 );
-		*name = g_strdup ( str );
+		info->name = g_strdup ( str );
 	}
 
+	info->comment = geotag_get_exif_comment ( ed );
+
+	// Finished with EXIF
+	exif_data_free ( ed );
+#endif
+#endif
+
+	return ans;
+}
+
+/**
+ * a_geotag_create_waypoint_from_info:
+ * @filename: The image file the info is from
+ * @info:     The EXIF details of the image, see a_geotag_read_info()
+ * @vcmode:   The current location mode to use in the positioning of Waypoint
+ * @name:     Returns a name for the Waypoint (can be NULL)
+ *
+ * Returns: An allocated Waypoint or NULL if Waypoint could not be generated (e.g. no GPS info)
+ *
+ */
+VikWaypoint* a_geotag_create_waypoint_from_info ( const gchar *filename, const geotag_info_t *info, VikCoordMode vcmode, gchar **name )
+{
+	*name = NULL;
+
+	// Hopefully won't have valid images at 0,0!
+	if ( !info->has_gps || (info->ll.lat == 0.0 && info->ll.lon == 0.0) )
+		return NULL;
+
 	//
 	// Now create Waypoint with acquired information
 	//
-	wp = vik_waypoint_new();
+	VikWaypoint *wp = vik_waypoint_new();
 	// Set info from exif values
 	// Location
-	vik_coord_load_from_latlon ( &(wp->coord), vcmode, &ll );
+	vik_coord_load_from_latlon ( &(wp->coord), vcmode, &info->ll );
 	// Altitude
-	wp->altitude = alt;
+	wp->altitude = info->altitude;
 
-	wp->comment = geotag_get_exif_comment ( ed );
+	*name = g_strdup ( info->name );
+	wp->comment = g_strdup ( info->comment );
+
+	if ( !isnan(info->direction) )
+		vik_waypoint_set_image_direction_info ( wp, info->direction, info->direction_ref );
 
 	vik_waypoint_set_image ( wp, filename );
 
-MyReturn:
-	// Finished with EXIF
-	exif_data_free ( ed );
-#endif
-#endif
+	return wp;
+}
 
+/**
+ * a_geotag_create_waypoint_from_file:
+ * @filename: The image file to process
+ * @vcmode:   The current location mode to use in the positioning of Waypoint
+ * @name:     Returns a name for the Waypoint (can be NULL)
+ *
+ * Returns: An allocated Waypoint or NULL if Waypoint could not be generated (e.g. no EXIF info)
+ *
+ */
+VikWaypoint* a_geotag_create_waypoint_from_file ( const gchar *filename, VikCoordMode vcmode, gchar **name )
+{
+	geotag_info_t info;
+	VikWaypoint *wp = NULL;
+	*name = NULL;
+	if ( a_geotag_read_info ( filename, &info ) )
+		wp = a_geotag_create_waypoint_from_info ( filename, &info, vcmode, name );
+	a_geotag_info_clear ( &info );
 	return wp;
 }
 
@@ -904,5 +950,8 @@ gint a_geotag_write_exif_gps ( const gchar *filename, VikCoord coord, gdouble al
 			g_warning ( "%s couldn't set time on: %s", __FUNCTION__, filename );
 	}
 
+	// The size may not have changed either
+	a_geotag_index_forget ( filename );
+
 	return result;
 }
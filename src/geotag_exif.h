@@ -34,6 +34,24 @@ typedef struct {
 	VikWaypointImageDirectionRef directionRef;
 } exif_gps_info_t;
 
+// The EXIF details of an image that are used for geotagging and creating waypoints
+typedef struct {
+	gboolean has_gps;
+	struct LatLon ll;
+	gdouble altitude;  // NAN when not known
+	gdouble direction; // NAN when not known
+	VikWaypointImageDirectionRef direction_ref;
+	gchar *datetime;   // In EXIF_DATE_FORMAT, or NULL
+	gchar *name;
+	gchar *comment;
+} geotag_info_t;
+
+gboolean a_geotag_read_info ( const gchar *filename, geotag_info_t *info );
+
+void a_geotag_info_clear ( geotag_info_t *info );
+
+VikWaypoint* a_geotag_create_waypoint_from_info ( const gchar *filename, const geotag_info_t *info, VikCoordMode vcmode, gchar **name );
+
 VikWaypoint* a_geotag_create_waypoint_from_file ( const gchar *filename, VikCoordMode vcmode, gchar **name );
 
 VikWaypoint* a_geotag_waypoint_positioned ( const gchar *filename, VikCoord coord, gdouble alt, gchar **name, VikWaypoint *wp );
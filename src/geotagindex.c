@@ -0,0 +1,394 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <glib/gstdio.h>
+#include "geotagindex.h"
+#include "background.h"
+#include "settings.h"
+#include "dir.h"
+
+/*
+ * Creating waypoints from a folder of photos, or geotagging them, reads the EXIF data of every image,
+ *  which means opening and parsing each file. The same folders tend to be used again and again,
+ *  so the details that are needed are kept in a file in the Viking directory.
+ * An entry is only used while the image's size and modification time are unchanged.
+ *
+ * The index is loaded when first needed and saved after reading new images, and on exit.
+ */
+
+#define VIK_SETTINGS_GEOTAG_INDEX "geotag_index"
+// Maximum number of images remembered; the least recently used are dropped when saving
+#define VIK_SETTINGS_GEOTAG_INDEX_SIZE "geotag_index_size"
+#define GI_MAX_ENTRIES 100000
+
+#define GI_FILE "geotag_index.txt"
+#define GI_HEADER "# Viking geotag index 1"
+#define GI_FIELDS 14
+
+typedef struct {
+  gint64 size;
+  gint64 mtime;
+  gint64 used;   // When last looked up, in seconds
+  gboolean read; // Whether the EXIF data could be read
+  geotag_info_t info;
+} gi_entry_t;
+
+static GMutex gi_mutex;
+static GHashTable *gi_entries = NULL; // filename -> gi_entry_t
+static gboolean gi_loaded = FALSE;
+static gboolean gi_enabled = TRUE;
+static gboolean gi_changed = FALSE;
+static guint gi_max_entries = GI_MAX_ENTRIES;
+
+static void gi_entry_free ( gi_entry_t *entry )
+{
+  a_geotag_info_clear ( &entry->info );
+  g_free ( entry );
+}
+
+static void gi_info_copy ( geotag_info_t *dest, const geotag_info_t *src )
+{
+  *dest = *src;
+  dest->datetime = g_strdup ( src->datetime );
+  dest->name = g_strdup ( src->name );
+  dest->comment = g_strdup ( src->comment );
+}
+
+static gchar *gi_filename ( void )
+{
+  return g_build_filename ( a_get_viking_dir(), GI_FILE, NULL );
+}
+
+static gboolean gi_stat ( const gchar *filename, gint64 *size, gint64 *mtime )
+{
+  GStatBuf stat_buf;
+  if ( g_stat ( filename, &stat_buf ) != 0 )
+    return FALSE;
+  *size = (gint64)stat_buf.st_size;
+  *mtime = (gint64)stat_buf.st_mtime;
+  return TRUE;
+}
+
+/**
+ * Strings are escaped so tabs and line endings in them can't break up the lines
+ *  An empty string is a NULL one
+ */
+static gchar *gi_unescape ( const gchar *str )
+{
+  return *str ? g_strcompress ( str ) : NULL;
+}
+
+static void gi_append_string ( GString *gs, const gchar *str )
+{
+  g_string_append_c ( gs, '\t' );
+  if ( str ) {
+    gchar *escaped = g_strescape ( str, NULL );
+    g_string_append ( gs, escaped );
+    g_free ( escaped );
+  }
+}
+
+static void gi_append_double ( GString *gs, gdouble value )
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+  g_string_append_c ( gs, '\t' );
+  g_string_append ( gs, isnan(value) ? "nan" : g_ascii_dtostr ( buf, sizeof(buf), value ) );
+}
+
+static gdouble gi_parse_double ( const gchar *str )
+{
+  return g_strcmp0 ( str, "nan" ) == 0 ? NAN : g_ascii_strtod ( str, NULL );
+}
+
+/**
+ * Each line is:
+ *  path size mtime used read has_gps lat lon altitude direction direction_ref datetime name comment
+ * separated by tabs
+ */
+static void gi_parse_line ( const gchar *line )
+{
+  gchar **fields = g_strsplit ( line, "\t", GI_FIELDS );
+  if ( g_strv_length ( fields ) == GI_FIELDS && *fields[0] ) {
+    gi_entry_t *entry = g_malloc0 ( sizeof(gi_entry_t) );
+    entry->size = g_ascii_strtoll ( fields[1], NULL, 10 );
+    entry->mtime = g_ascii_strtoll ( fields[2], NULL, 10 );
+    entry->used = g_ascii_strtoll ( fields[3], NULL, 10 );
+    entry->read = atoi ( fields[4] );
+    entry->info.has_gps = atoi ( fields[5] );
+    entry->info.ll.lat = gi_parse_double ( fields[6] );
+    entry->info.ll.lon = gi_parse_double ( fields[7] );
+    entry->info.altitude = gi_parse_double ( fields[8] );
+    entry->info.direction = gi_parse_double ( fields[9] );
+    entry->info.direction_ref = atoi ( fields[10] ) ? WP_IMAGE_DIRECTION_REF_MAGNETIC : WP_IMAGE_DIRECTION_REF_TRUE;
+    entry->info.datetime = gi_unescape ( fields[11] );
+    entry->info.name = gi_unescape ( fields[12] );
+    entry->info.comment = gi_unescape ( fields[13] );
+    g_hash_table_replace ( gi_entries, g_strcompress(fields[0]), entry );
+  }
+  g_strfreev ( fields );
+}
+
+/**
+ * Must be called with the lock held
+ *
+ * Returns: Whether the index is in use
+ */
+static gboolean gi_load ( void )
+{
+  if ( gi_loaded )
+    return gi_enabled;
+  gi_loaded = TRUE;
+
+  gboolean btmp;
+  if ( a_settings_get_boolean ( VIK_SETTINGS_GEOTAG_INDEX, &btmp ) )
+    gi_enabled = btmp;
+  gint tmp;
+  if ( a_settings_get_integer ( VIK_SETTINGS_GEOTAG_INDEX_SIZE, &tmp ) )
+    gi_max_entries = MAX ( 0, tmp );
+  if ( !gi_max_entries )
+    gi_enabled = FALSE;
+  if ( !gi_enabled )
+    return FALSE;
+
+  gi_entries = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)gi_entry_free );
+
+  gchar *fn = gi_filename ();
+  gchar *contents = NULL;
+  if ( g_file_get_contents ( fn, &contents, NULL, NULL ) ) {
+    gchar **lines = g_strsplit ( contents, "\n", -1 );
+    // Ignore an index in some other format
+    if ( lines[0] && g_strcmp0 ( lines[0], GI_HEADER ) == 0 )
+      for ( guint ii = 1; lines[ii]; ii++ )
+        gi_parse_line ( lines[ii] );
+    g_strfreev ( lines );
+    g_free ( contents );
+    g_debug ( "%s: %d images from %s", __FUNCTION__, g_hash_table_size(gi_entries), fn );
+  }
+  g_free ( fn );
+  return TRUE;
+}
+
+static gint gi_used_compare ( gconstpointer a, gconstpointer b )
+{
+  const gi_entry_t *ea = ((gpointer*)a)[1];
+  const gi_entry_t *eb = ((gpointer*)b)[1];
+  // Most recent first
+  return ea->used > eb->used ? -1 : (ea->used < eb->used ? 1 : 0);
+}
+
+/**
+ * Write the index if anything has been added
+ */
+static void gi_save ( void )
+{
+  g_mutex_lock ( &gi_mutex );
+  if ( !gi_entries || !gi_changed ) {
+    g_mutex_unlock ( &gi_mutex );
+    return;
+  }
+  gi_changed = FALSE;
+
+  // Pairs of filename and entry, so the most recently used can be kept
+  guint count = g_hash_table_size ( gi_entries );
+  gpointer *pairs = g_malloc ( sizeof(gpointer) * 2 * count );
+  GHashTableIter iter;
+  gpointer key, value;
+  guint ii = 0;
+  g_hash_table_iter_init ( &iter, gi_entries );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    pairs[2*ii] = key;
+    pairs[2*ii+1] = value;
+    ii++;
+  }
+  if ( count > gi_max_entries )
+    qsort ( pairs, count, sizeof(gpointer) * 2, gi_used_compare );
+
+  GString *gs = g_string_new ( GI_HEADER "\n" );
+  for ( ii = 0; ii < count; ii++ ) {
+    const gi_entry_t *entry = pairs[2*ii+1];
+    if ( ii >= gi_max_entries ) {
+      g_hash_table_remove ( gi_entries, pairs[2*ii] );
+      continue;
+    }
+    gchar *path = g_strescape ( pairs[2*ii], NULL );
+    g_string_append_printf ( gs, "%s\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%d\t%d",
+                             path, entry->size, entry->mtime, entry->used, entry->read ? 1 : 0, entry->info.has_gps ? 1 : 0 );
+    g_free ( path );
+    gi_append_double ( gs, entry->info.ll.lat );
+    gi_append_double ( gs, entry->info.ll.lon );
+    gi_append_double ( gs, entry->info.altitude );
+    gi_append_double ( gs, entry->info.direction );
+    g_string_append_printf ( gs, "\t%d", entry->info.direction_ref == WP_IMAGE_DIRECTION_REF_MAGNETIC ? 1 : 0 );
+    gi_append_string ( gs, entry->info.datetime );
+    gi_append_string ( gs, entry->info.name );
+    gi_append_string ( gs, entry->info.comment );
+    g_string_append_c ( gs, '\n' );
+  }
+  g_free ( pairs );
+  g_mutex_unlock ( &gi_mutex );
+
+  gchar *fn = gi_filename ();
+  GError *error = NULL;
+  if ( !g_file_set_contents ( fn, gs->str, gs->len, &error ) ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+  }
+  g_free ( fn );
+  g_string_free ( gs, TRUE );
+}
+
+void a_geotag_index_uninit ( void )
+{
+  gi_save ();
+  g_mutex_lock ( &gi_mutex );
+  if ( gi_entries )
+    g_hash_table_destroy ( gi_entries );
+  gi_entries = NULL;
+  gi_loaded = FALSE;
+  g_mutex_unlock ( &gi_mutex );
+}
+
+/**
+ * Returns: %TRUE if the image is in the index (with the same size and mtime),
+ *  in which case the read result and info are filled in
+ */
+static gboolean gi_lookup ( const gchar *filename, gint64 size, gint64 mtime, gboolean *read, geotag_info_t *info )
+{
+  gboolean ans = FALSE;
+  g_mutex_lock ( &gi_mutex );
+  if ( gi_load () ) {
+    gi_entry_t *entry = g_hash_table_lookup ( gi_entries, filename );
+    if ( entry && entry->size == size && entry->mtime == mtime ) {
+      entry->used = g_get_real_time () / G_USEC_PER_SEC;
+      *read = entry->read;
+      gi_info_copy ( info, &entry->info );
+      ans = TRUE;
+    }
+  }
+  g_mutex_unlock ( &gi_mutex );
+  return ans;
+}
+
+static void gi_store ( const gchar *filename, gint64 size, gint64 mtime, gboolean read, const geotag_info_t *info )
+{
+  g_mutex_lock ( &gi_mutex );
+  if ( gi_load () ) {
+    gi_entry_t *entry = g_malloc0 ( sizeof(gi_entry_t) );
+    entry->size = size;
+    entry->mtime = mtime;
+    entry->used = g_get_real_time () / G_USEC_PER_SEC;
+    entry->read = read;
+    gi_info_copy ( &entry->info, info );
+    g_hash_table_replace ( gi_entries, g_strdup(filename), entry );
+    gi_changed = TRUE;
+  }
+  g_mutex_unlock ( &gi_mutex );
+}
+
+/**
+ * a_geotag_index_get:
+ * @filename: The image file
+ * @info:     Returns the EXIF details of the image, to be freed with a_geotag_info_clear()
+ *
+ * Returns: %FALSE if the image could not be read
+ */
+gboolean a_geotag_index_get ( const gchar *filename, geotag_info_t *info )
+{
+  gint64 size, mtime;
+  if ( !gi_stat ( filename, &size, &mtime ) )
+    return a_geotag_read_info ( filename, info );
+
+  gboolean read;
+  if ( gi_lookup ( filename, size, mtime, &read, info ) )
+    return read;
+
+  read = a_geotag_read_info ( filename, info );
+  gi_store ( filename, size, mtime, read, info );
+  return read;
+}
+
+typedef struct {
+  const gchar *filename;
+  gint64 size;
+  gint64 mtime;
+  gboolean stat;
+  geotag_info_t *info;
+} gi_read_t;
+
+static void gi_read_cb ( gi_read_t *rd, gpointer user_data )
+{
+  gboolean read = a_geotag_read_info ( rd->filename, rd->info );
+  if ( rd->stat )
+    gi_store ( rd->filename, rd->size, rd->mtime, read, rd->info );
+}
+
+/**
+ * a_geotag_index_get_many:
+ * @filenames: The image files
+ * @count:     The number of files
+ * @infos:     An array of @count to return the EXIF details of each image in,
+ *             each to be freed with a_geotag_info_clear()
+ *
+ * Images that are not in the index are read in parallel.
+ * The info of an image that could not be read is left cleared.
+ */
+void a_geotag_index_get_many ( const gchar **filenames, guint count, geotag_info_t *infos )
+{
+  gi_read_t *reads = g_malloc ( sizeof(gi_read_t) * count );
+  guint misses = 0;
+  for ( guint ii = 0; ii < count; ii++ ) {
+    gi_read_t *rd = &reads[misses];
+    rd->filename = filenames[ii];
+    rd->info = &infos[ii];
+    rd->stat = gi_stat ( filenames[ii], &rd->size, &rd->mtime );
+    gboolean read;
+    if ( rd->stat && gi_lookup ( filenames[ii], rd->size, rd->mtime, &read, &infos[ii] ) )
+      continue;
+    misses++;
+  }
+
+  if ( misses ) {
+    VikTaskGroup *group = a_background_tasks_new ();
+    for ( guint ii = 0; ii < misses; ii++ )
+      a_background_tasks_add ( group, (GFunc)gi_read_cb, &reads[ii], NULL );
+    a_background_tasks_free ( group );
+    gi_save ();
+  }
+  g_debug ( "%s: %d of %d images read", __FUNCTION__, misses, count );
+  g_free ( reads );
+}
+
+/**
+ * a_geotag_index_forget:
+ *
+ * For when the image has been changed, in case its size and mtime stay the same
+ */
+void a_geotag_index_forget ( const gchar *filename )
+{
+  g_mutex_lock ( &gi_mutex );
+  if ( gi_entries && g_hash_table_remove ( gi_entries, filename ) )
+    gi_changed = TRUE;
+  g_mutex_unlock ( &gi_mutex );
+}
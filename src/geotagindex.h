@@ -0,0 +1,43 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_GEOTAGINDEX_H
+#define __VIKING_GEOTAGINDEX_H
+
+#include <glib.h>
+#include "geotag_exif.h"
+
+G_BEGIN_DECLS
+
+// The EXIF details of images kept between runs, keyed by each file's path, size and modification time,
+//  so images that have been seen before need not be read again
+void a_geotag_index_uninit ( void );
+
+// Returns: %FALSE if the image could not be read
+//  The info is a copy, to be freed with a_geotag_info_clear()
+gboolean a_geotag_index_get ( const gchar *filename, geotag_info_t *info );
+// The same for many images, where those not in the index are read in parallel
+// infos: An array of count to fill in
+void a_geotag_index_get_many ( const gchar **filenames, guint count, geotag_info_t *infos );
+// For images changed by Viking itself
+void a_geotag_index_forget ( const gchar *filename );
+
+G_END_DECLS
+
+#endif
@@ -132,10 +132,16 @@ static gchar * params_pos_type[] = {N_("None"), N_("Bottom"), N_("Middle"), N_("
 // Seemingly GTK's default for the number of recent files
 static VikLayerParamData rcnt_files_default ( void ) { return VIK_LPD_INT(10); }
 static VikLayerParamData rlr_lbl_pos_default ( void ) { return VIK_LPD_UINT(VIK_POSITIONAL_MIDDLE); }
+static VikLayerParamScale params_thumbnail_cache[] = { {8, 1024, 8, 0} };
+static VikLayerParamData thumbnail_cache_default ( void ) { return VIK_LPD_UINT(64); }
+static VikLayerParamScale params_memory_warning[] = { {0, 65536, 64, 0} };
+static VikLayerParamData memory_warning_default ( void ) { return VIK_LPD_UINT(1024); }
 
 static VikLayerParam prefs_advanced[] = {
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "save_file_reference_mode", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Save File Reference Mode:"), VIK_LAYER_WIDGET_COMBOBOX, params_vik_fileref, NULL,
     N_("When saving a Viking .vik file, this determines how the directory paths of filenames are written."), NULL, NULL, NULL },
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "save_binary_format", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Save in Binary Format:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
+    N_("Save Viking .vik files in a binary format, which is much quicker to open for large amounts of track data. Such files can not be read by older versions of Viking."), vik_lpd_false_default, NULL, NULL },
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "ask_for_create_track_name", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Ask for Name before Track Creation:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, NULL, vik_lpd_true_default, NULL, NULL },
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "create_track_tooltip", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Show Tooltip during Track Creation:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, NULL, vik_lpd_true_default, NULL, NULL },
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "trw_layer_show_graph", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Show Graph for TrackWaypoint Layer:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, N_("Show graph automatically for a track or route if only one is in the layer"), vik_lpd_true_default, NULL, NULL },
@@ -152,6 +158,18 @@ static VikLayerParam prefs_advanced[] = {
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "select_tool_double_click_to_zoom", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Select Tool Double Click to Zoom:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, NULL, vik_lpd_false_default, NULL, NULL },
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "auto_trackpoint_select", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Auto Select Trackpoint:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
     N_("Select trackpoint from mouse over graph on main display"), vik_lpd_true_default, NULL, NULL },
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "pan_by_scrolling", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Pan by Scrolling:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
+    N_("Whilst dragging the map, move what is already drawn and only draw the newly exposed parts"), vik_lpd_true_default, NULL, NULL },
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "zoom_preview", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Preview Zooming:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
+    N_("Whilst scroll zooming, show what is already drawn enlarged or reduced until the map is drawn again"), vik_lpd_true_default, NULL, NULL },
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "antialias", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Antialiased Drawing:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
+    N_("Smooth the track and route lines, by rendering them client side"), vik_lpd_true_default, NULL, NULL },
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "hide_overlapping_labels", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Hide Overlapping Labels:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
+    N_("Only draw the track and waypoint labels that do not overlap others of the same layer"), vik_lpd_true_default, NULL, NULL },
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "thumbnail_cache_size", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Thumbnail Memory Cache (MB):"), VIK_LAYER_WIDGET_SPINBUTTON, params_thumbnail_cache, NULL,
+    N_("Memory for keeping the thumbnails of waypoint images, shared by all layers"), thumbnail_cache_default, NULL, NULL },
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "memory_warning_size", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Layer Memory Warning (MB):"), VIK_LAYER_WIDGET_SPINBUTTON, params_memory_warning, NULL,
+    N_("Warn when a single layer uses more memory than this. 0 means no warning."), memory_warning_default, NULL, NULL },
 };
 
 static gchar * params_startup_methods[] = {N_("Home Location"), N_("Last Location"), N_("Specified File"), N_("Auto Location"), NULL};
@@ -218,8 +236,52 @@ void a_vik_preferences_init ()
     a_preferences_register ( &prefs_advanced[ii], (VikLayerParamData){0}, VIKING_PREFERENCES_ADVANCED_GROUP_KEY );
 }
 
+/*
+ * The preferences read for every item whilst drawing or formatting (possibly from worker threads),
+ *  copied out so reading one is just a field access rather than a lookup by name.
+ * Filled in by a_vik_refresh_preferences() in the main thread - into the copy not in use,
+ *  which is then switched to, so readers never see one partly updated.
+ */
+typedef struct {
+  vik_degree_format_t degree_format;
+  vik_units_distance_t units_distance;
+  vik_units_speed_t units_speed;
+  vik_units_height_t units_height;
+  vik_units_temp_t units_temp;
+  vik_time_ref_frame_t time_ref_frame;
+  gboolean use_large_waypoint_icons;
+  gboolean antialias;
+  gboolean hide_overlapping_labels;
+} PrefsSnapshot;
+
+static PrefsSnapshot snapshots[2];
+static PrefsSnapshot *snapshot = NULL; // Until the first refresh, read the preferences directly
+
+/**
+ * a_vik_refresh_preferences:
+ *
+ * Call once preferences are available and whenever they may have been changed
+ */
+void a_vik_refresh_preferences ()
+{
+  PrefsSnapshot *next = ( g_atomic_pointer_get ( &snapshot ) == &snapshots[0] ) ? &snapshots[1] : &snapshots[0];
+  next->degree_format = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "degree_format")->u;
+  next->units_distance = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "units_distance")->u;
+  next->units_speed = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "units_speed")->u;
+  next->units_height = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "units_height")->u;
+  next->units_temp = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "units_temperature")->u;
+  next->time_ref_frame = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "time_reference_frame")->u;
+  next->use_large_waypoint_icons = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "use_large_waypoint_icons")->b;
+  next->antialias = a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "antialias")->b;
+  next->hide_overlapping_labels = a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "hide_overlapping_labels")->b;
+  g_atomic_pointer_set ( &snapshot, next );
+}
+
 vik_degree_format_t a_vik_get_degree_format ( )
 {
+  const PrefsSnapshot *ss = g_atomic_pointer_get ( &snapshot );
+  if ( ss )
+    return ss->degree_format;
   vik_degree_format_t format;
   format = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "degree_format")->u;
   return format;
@@ -227,6 +289,9 @@ vik_degree_format_t a_vik_get_degree_format ( )
 
 vik_units_distance_t a_vik_get_units_distance ( )
 {
+  const PrefsSnapshot *ss = g_atomic_pointer_get ( &snapshot );
+  if ( ss )
+    return ss->units_distance;
   vik_units_distance_t units;
   units = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "units_distance")->u;
   return units;
@@ -234,6 +299,9 @@ vik_units_distance_t a_vik_get_units_distance ( )
 
 vik_units_speed_t a_vik_get_units_speed ( )
 {
+  const PrefsSnapshot *ss = g_atomic_pointer_get ( &snapshot );
+  if ( ss )
+    return ss->units_speed;
   vik_units_speed_t units;
   units = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "units_speed")->u;
   return units;
@@ -241,6 +309,9 @@ vik_units_speed_t a_vik_get_units_speed ( )
 
 vik_units_height_t a_vik_get_units_height ( )
 {
+  const PrefsSnapshot *ss = g_atomic_pointer_get ( &snapshot );
+  if ( ss )
+    return ss->units_height;
   vik_units_height_t units;
   units = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "units_height")->u;
   return units;
@@ -248,11 +319,17 @@ vik_units_height_t a_vik_get_units_height ( )
 
 vik_units_temp_t a_vik_get_units_temp ( )
 {
+  const PrefsSnapshot *ss = g_atomic_pointer_get ( &snapshot );
+  if ( ss )
+    return ss->units_temp;
   return a_preferences_get(VIKING_PREFERENCES_NAMESPACE "units_temperature")->u;
 }
 
 gboolean a_vik_get_use_large_waypoint_icons ( )
 {
+  const PrefsSnapshot *ss = g_atomic_pointer_get ( &snapshot );
+  if ( ss )
+    return ss->use_large_waypoint_icons;
   gboolean use_large_waypoint_icons;
   use_large_waypoint_icons = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "use_large_waypoint_icons")->b;
   return use_large_waypoint_icons;
@@ -274,6 +351,9 @@ gdouble a_vik_get_default_long ( )
 
 vik_time_ref_frame_t a_vik_get_time_ref_frame ( )
 {
+  const PrefsSnapshot *ss = g_atomic_pointer_get ( &snapshot );
+  if ( ss )
+    return ss->time_ref_frame;
   return a_preferences_get(VIKING_PREFERENCES_NAMESPACE "time_reference_frame")->u;
 }
 
@@ -340,6 +420,11 @@ vik_file_ref_format_t a_vik_get_file_ref_format ( )
   return format;
 }
 
+gboolean a_vik_get_save_binary_format ( )
+{
+  return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "save_binary_format")->b;
+}
+
 gboolean a_vik_get_ask_for_create_track_name ( )
 {
   return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "ask_for_create_track_name")->b;
@@ -395,6 +480,42 @@ gboolean a_vik_get_auto_trackpoint_select ( )
   return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "auto_trackpoint_select")->b;
 }
 
+gboolean a_vik_get_pan_by_scrolling ( )
+{
+  return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "pan_by_scrolling")->b;
+}
+
+gboolean a_vik_get_zoom_preview ( )
+{
+  return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "zoom_preview")->b;
+}
+
+gboolean a_vik_get_antialias ( )
+{
+  const PrefsSnapshot *ss = g_atomic_pointer_get ( &snapshot );
+  if ( ss )
+    return ss->antialias;
+  return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "antialias")->b;
+}
+
+gboolean a_vik_get_hide_overlapping_labels ( )
+{
+  const PrefsSnapshot *ss = g_atomic_pointer_get ( &snapshot );
+  if ( ss )
+    return ss->hide_overlapping_labels;
+  return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "hide_overlapping_labels")->b;
+}
+
+guint a_vik_get_thumbnail_cache_size ( )
+{
+  return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "thumbnail_cache_size")->u;
+}
+
+guint a_vik_get_memory_warning_size ( )
+{
+  return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "memory_warning_size")->u;
+}
+
 // Startup Options
 gboolean a_vik_get_restore_window_state ( )
 {
@@ -124,6 +124,9 @@ void a_vik_preferences_init ();
 /* Reset global preferences */
 void a_vik_preferences_reset_defaults ();
 
+/* Update the values of the global preferences read in drawing and formatting */
+void a_vik_refresh_preferences ();
+
 /* Coord display preferences */
 typedef enum {
   VIK_DEGREE_FORMAT_DDD,
@@ -240,6 +243,8 @@ typedef enum {
 
 vik_file_ref_format_t a_vik_get_file_ref_format ( );
 
+gboolean a_vik_get_save_binary_format ( );
+
 gboolean a_vik_get_ask_for_create_track_name ( );
 
 gboolean a_vik_get_create_track_tooltip ( );
@@ -267,6 +272,18 @@ gboolean a_vik_get_select_double_click_to_zoom ( );
 
 gboolean a_vik_get_auto_trackpoint_select ( );
 
+gboolean a_vik_get_pan_by_scrolling ( );
+gboolean a_vik_get_zoom_preview ( );
+
+gboolean a_vik_get_antialias ( );
+
+gboolean a_vik_get_hide_overlapping_labels ( );
+
+guint a_vik_get_thumbnail_cache_size ( );
+
+// MB, 0 for no warning
+guint a_vik_get_memory_warning_size ( );
+
 gboolean a_vik_get_restore_window_state ( );
 
 gboolean a_vik_get_add_default_map_layer ( );
@@ -102,6 +102,7 @@ static gint line_power = VIK_TRKPT_POWER_NONE;
 
 static void gpspoint_process_tag ( const gchar *tag, guint len );
 static void gpspoint_process_key_and_value ( const gchar *key, guint key_len, const gchar *value, guint value_len );
+static void key_slots_init ( void );
 
 static gchar *slashdup(const gchar *str)
 {
@@ -187,15 +188,19 @@ gboolean a_gpspoint_read_file(VikTrwLayer *trw, FILE *f, const gchar *dirpath )
   current_track = NULL;
   gboolean have_read_something = FALSE;
 
+  key_slots_init ();
+
   while (fgets(line_buffer, VIKING_LINE_SIZE, f))
   {
     gboolean inside_quote = 0;
     gboolean backslash = 0;
 
-    line_buffer[strlen(line_buffer)-1] = '\0'; /* chop off newline */
+    gsize line_len = strlen ( line_buffer );
+    if ( line_len > 0 && line_buffer[line_len-1] == '\n' )
+      line_buffer[--line_len] = '\0'; /* chop off newline */
 
     /* for gpspoint files wrapped inside */
-    if ( strlen(line_buffer) >= 13 && strncmp ( line_buffer, "~EndLayerData", 13 ) == 0 ) {
+    if ( line_len >= 13 && strncmp ( line_buffer, "~EndLayerData", 13 ) == 0 ) {
       // Even just a blank TRW is ok when in a .vik file
       have_read_something = TRUE;
       break;
@@ -206,7 +211,7 @@ gboolean a_gpspoint_read_file(VikTrwLayer *trw, FILE *f, const gchar *dirpath )
     for (;;)
     {
       /* my addition: find first non-whitespace character. if the null, skip line. */
-      while (*tag_start != '\0' && isspace(*tag_start))
+      while (*tag_start != '\0' && g_ascii_isspace(*tag_start))
         tag_start++;
       if (*tag_start == '\0')
         break;
@@ -217,7 +222,7 @@ gboolean a_gpspoint_read_file(VikTrwLayer *trw, FILE *f, const gchar *dirpath )
       tag_end = tag_start;
         if (*tag_end == '"')
           inside_quote = !inside_quote;
-      while (*tag_end != '\0' && (!isspace(*tag_end) || inside_quote)) {
+      while (*tag_end != '\0' && (!g_ascii_isspace(*tag_end) || inside_quote)) {
         tag_end++;
         if (*tag_end == '\\' && !backslash)
           backslash = TRUE;
@@ -488,33 +493,124 @@ static void gpspoint_process_tag ( const gchar *tag, guint len )
   }
 }
 
+typedef enum {
+  KEY_NONE = 0,
+  KEY_LATITUDE,
+  KEY_LONGITUDE,
+  KEY_UNIXTIME,
+  KEY_ALTITUDE,
+  KEY_TYPE,
+  KEY_NAME,
+  KEY_COMMENT,
+  KEY_DESCRIPTION,
+  KEY_SOURCE,
+  KEY_NUMBER,
+  KEY_XTYPE,
+  KEY_COLOR,
+  KEY_DRAW_NAME_MODE,
+  KEY_NUMBER_DIST_LABELS,
+  KEY_IMAGE,
+  KEY_IMAGE_DIRECTION,
+  KEY_IMAGE_DIRECTION_REF,
+  KEY_VISIBLE,
+  KEY_SYMBOL,
+  KEY_NEWSEGMENT,
+  KEY_EXTENDED,
+  KEY_SPEED,
+  KEY_COURSE,
+  KEY_SAT,
+  KEY_FIX,
+  KEY_HDOP,
+  KEY_VDOP,
+  KEY_PDOP,
+  KEY_HR,
+  KEY_CAD,
+  KEY_TEMP,
+  KEY_POW,
+  KEY_MAGVAR,
+  KEY_GEOIDHEIGHT,
+  KEY_URL,
+  KEY_URL_NAME,
+  KEY_AGEOFDGPSDATA,
+  KEY_DGPSID,
+  KEY_HIDE_NAME,
+  NUM_KEYS
+} gpspoint_key_t;
+
+// Indexed by gpspoint_key_t
+static const gchar *key_names[NUM_KEYS] = {
+  NULL,
+  "latitude", "longitude", "unixtime", "altitude", "type", "name", "comment", "description",
+  "source", "number", "xtype", "color", "draw_name_mode", "number_dist_labels", "image",
+  "image_direction", "image_direction_ref", "visible", "symbol", "newsegment", "extended",
+  "speed", "course", "sat", "fix", "hdop", "vdop", "pdop", "hr", "cad", "temp", "pow",
+  "magvar", "geoidheight", "url", "url_name", "ageofdgpsdata", "dgpsid", "hide_name",
+};
+
+// The hash is collision free for the above keys, so normally a single comparison finds the key
+#define KEY_SLOTS 128
+static guint8 key_slots[KEY_SLOTS];
+
+static inline guint key_hash ( const gchar *key, guint len )
+{
+  // NB '| 0x20' lowercases letters
+  return ( len * 12 + (key[0] | 0x20) * 7 + (key[len > 1 ? 1 : 0] | 0x20) + (key[len-1] | 0x20) * 3 ) & (KEY_SLOTS-1);
+}
+
+static void key_slots_init ( void )
+{
+  static gsize init = 0;
+  if ( g_once_init_enter ( &init ) ) {
+    for ( guint kk = 1; kk < NUM_KEYS; kk++ ) {
+      guint slot = key_hash ( key_names[kk], strlen(key_names[kk]) );
+      // Linear probing, should another key be added that collides
+      while ( key_slots[slot] )
+        slot = (slot + 1) & (KEY_SLOTS-1);
+      key_slots[slot] = kk;
+    }
+    g_once_init_leave ( &init, 1 );
+  }
+}
+
+static gpspoint_key_t key_lookup ( const gchar *key, guint len )
+{
+  for ( guint slot = key_hash ( key, len ); key_slots[slot]; slot = (slot + 1) & (KEY_SLOTS-1) ) {
+    const gchar *name = key_names[key_slots[slot]];
+    if ( g_ascii_strncasecmp ( key, name, len ) == 0 && name[len] == '\0' )
+      return key_slots[slot];
+  }
+  return KEY_NONE;
+}
+
 /*
 value = NULL for none
 */
 static void gpspoint_process_key_and_value ( const gchar *key, guint key_len, const gchar *value, guint value_len )
 {
-  // Most commonlly encountered keys should be tested first
-  if (key_len == 8 && strncasecmp( key, "latitude", key_len ) == 0 && value != NULL)
-  {
-    line_latlon.lat = g_ascii_strtod(value, NULL);
-  }
-  else if (key_len == 9 && strncasecmp( key, "longitude", key_len ) == 0 && value != NULL)
-  {
-    line_latlon.lon = g_ascii_strtod(value, NULL);
-  }
-  else if (key_len == 8 && strncasecmp( key, "unixtime", key_len ) == 0 && value != NULL)
-  {
-    line_timestamp = g_ascii_strtod(value, NULL);
-  }
-  else if (key_len == 8 && strncasecmp( key, "altitude", key_len ) == 0 && value != NULL)
-  {
-    line_altitude = g_ascii_strtod(value, NULL);
-  }
-  else if (key_len == 4 && strncasecmp( key, "type", key_len ) == 0 )
-  {
-    if (value == NULL)
+  gpspoint_key_t kk = key_lookup ( key, key_len );
+
+  // Only 'type' has a meaning without a value
+  if ( value == NULL ) {
+    if ( kk == KEY_TYPE )
       line_type = GPSPOINT_TYPE_NONE;
-    else if (value_len == 5 && strncasecmp( value, "track", value_len ) == 0 )
+    return;
+  }
+
+  switch ( kk ) {
+  case KEY_LATITUDE:
+    line_latlon.lat = util_strtod_len ( value, value_len );
+    break;
+  case KEY_LONGITUDE:
+    line_latlon.lon = util_strtod_len ( value, value_len );
+    break;
+  case KEY_UNIXTIME:
+    line_timestamp = util_strtod_len ( value, value_len );
+    break;
+  case KEY_ALTITUDE:
+    line_altitude = util_strtod_len ( value, value_len );
+    break;
+  case KEY_TYPE:
+    if (value_len == 5 && strncasecmp( value, "track", value_len ) == 0 )
       line_type = GPSPOINT_TYPE_TRACK;
     else if (value_len == 8 && strncasecmp( value, "trackend", value_len ) == 0 )
       line_type = GPSPOINT_TYPE_TRACK_END;
@@ -531,152 +627,124 @@ static void gpspoint_process_key_and_value ( const gchar *key, guint key_len, co
     else
       /* all others are ignored */
       line_type = GPSPOINT_TYPE_NONE;
-  }
-  else if (key_len == 4 && strncasecmp( key, "name", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_NAME:
     if (line_name == NULL)
-    {
       line_name = deslashndup ( value, value_len );
-    }
-  }
-  else if (key_len == 7 && strncasecmp( key, "comment", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_COMMENT:
     if (line_comment == NULL)
       line_comment = deslashndup ( value, value_len );
-  }
-  else if (key_len == 11 && strncasecmp( key, "description", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_DESCRIPTION:
     if (line_description == NULL)
       line_description = deslashndup ( value, value_len );
-  }
-  else if (key_len == 6 && strncasecmp( key, "source", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_SOURCE:
     if (line_source == NULL)
       line_source = deslashndup ( value, value_len );
-  }
-  else if (key_len == 6 && strncasecmp( key, "number", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_NUMBER:
     line_number = atoi(value);
-  }
+    break;
   // NB using 'xtype' to differentiate from our own 'type' key
-  else if (key_len == 5 && strncasecmp( key, "xtype", key_len ) == 0 && value != NULL)
-  {
+  case KEY_XTYPE:
     if (line_xtype == NULL)
       line_xtype = deslashndup ( value, value_len );
-  }
-  else if (key_len == 5 && strncasecmp( key, "color", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_COLOR:
     if (line_color == NULL)
       line_color = deslashndup ( value, value_len );
-  }
-  else if (key_len == 14 && strncasecmp( key, "draw_name_mode", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_DRAW_NAME_MODE:
     line_name_label = atoi(value);
-  }
-  else if (key_len == 18 && strncasecmp( key, "number_dist_labels", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_NUMBER_DIST_LABELS:
     line_dist_label = atoi(value);
-  }
-  else if (key_len == 5 && strncasecmp( key, "image", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_IMAGE:
     if (line_image == NULL)
       line_image = deslashndup ( value, value_len );
-  }
-  else if (key_len == 15 && strncasecmp( key, "image_direction", key_len ) == 0 && value != NULL)
-  {
-    line_image_direction = g_ascii_strtod(value, NULL);
-  }
-  else if (key_len == 19 && strncasecmp( key, "image_direction_ref", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_IMAGE_DIRECTION:
+    line_image_direction = util_strtod_len ( value, value_len );
+    break;
+  case KEY_IMAGE_DIRECTION_REF:
     line_image_direction_ref = atoi(value);
-  }
-  else if (key_len == 7 && strncasecmp( key, "visible", key_len ) == 0 && value != NULL && value[0] != 'y' && value[0] != 'Y' && value[0] != 't' && value[0] != 'T')
-  {
-    line_visible = FALSE;
-  }
-  else if (key_len == 6 && strncasecmp( key, "symbol", key_len ) == 0 && value != NULL)
-  {
-    line_symbol = g_strndup ( value, value_len );
-  }
-  else if (key_len == 10 && strncasecmp( key, "newsegment", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_VISIBLE:
+    if (value[0] != 'y' && value[0] != 'Y' && value[0] != 't' && value[0] != 'T')
+      line_visible = FALSE;
+    break;
+  case KEY_SYMBOL:
+    if (line_symbol == NULL)
+      line_symbol = g_strndup ( value, value_len );
+    break;
+  case KEY_NEWSEGMENT:
     line_newsegment = TRUE;
-  }
-  else if (key_len == 8 && strncasecmp( key, "extended", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_EXTENDED:
     line_extended = TRUE;
-  }
-  else if (key_len == 5 && strncasecmp( key, "speed", key_len ) == 0 && value != NULL)
-  {
-    line_speed = g_ascii_strtod(value, NULL);
-  }
-  else if (key_len == 6 && strncasecmp( key, "course", key_len ) == 0 && value != NULL)
-  {
-    line_course = g_ascii_strtod(value, NULL);
-  }
-  else if (key_len == 3 && strncasecmp( key, "sat", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_SPEED:
+    line_speed = util_strtod_len ( value, value_len );
+    break;
+  case KEY_COURSE:
+    line_course = util_strtod_len ( value, value_len );
+    break;
+  case KEY_SAT:
     line_sat = (guint)atoi(value);
-  }
-  else if (key_len == 3 && strncasecmp( key, "fix", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_FIX:
     line_fix = (guint)atoi(value);
-  }
-  else if (key_len == 4 && strncasecmp( key, "hdop", key_len ) == 0 && value != NULL)
-  {
-    line_hdop = g_ascii_strtod(value, NULL);
-  }
-  else if (key_len == 4 && strncasecmp( key, "vdop", key_len ) == 0 && value != NULL)
-  {
-    line_vdop = g_ascii_strtod(value, NULL);
-  }
-  else if (key_len == 4 && strncasecmp( key, "pdop", key_len ) == 0 && value != NULL)
-  {
-    line_pdop = g_ascii_strtod(value, NULL);
-  }
-  else if (key_len == 2 && strncasecmp( key, "hr", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_HDOP:
+    line_hdop = util_strtod_len ( value, value_len );
+    break;
+  case KEY_VDOP:
+    line_vdop = util_strtod_len ( value, value_len );
+    break;
+  case KEY_PDOP:
+    line_pdop = util_strtod_len ( value, value_len );
+    break;
+  case KEY_HR:
     line_hr = (guint)atoi(value);
-  }
-  else if (key_len == 3 && strncasecmp( key, "cad", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_CAD:
     line_cad = (guint)atoi(value);
-  }
-  else if (key_len == 4 && strncasecmp( key, "temp", key_len ) == 0 && value != NULL)
-  {
-    line_temp = g_ascii_strtod(value, NULL);
-  }
-  else if (key_len == 3 && strncasecmp( key, "pow", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_TEMP:
+    line_temp = util_strtod_len ( value, value_len );
+    break;
+  case KEY_POW:
     line_power = (guint)atoi(value);
-  }
-  else if (key_len == 6 && strncasecmp( key, "magvar", key_len ) == 0 && value != NULL)
-  {
-    line_magvar = g_ascii_strtod(value, NULL);
-  }
-  else if (key_len == 11 && strncasecmp( key, "geoidheight", key_len ) == 0 && value != NULL)
-  {
-    line_geoidheight = g_ascii_strtod(value, NULL);
-  }
-  else if (key_len == 3 && strncasecmp( key, "url", key_len ) == 0 && value != NULL)
-  {
-    line_url = deslashndup ( value, value_len );
-  }
-  else if (key_len == 8 && strncasecmp( key, "url_name", key_len ) == 0 && value != NULL)
-  {
-    line_url_name = deslashndup ( value, value_len );
-  }
-  else if (key_len == 13 && strncasecmp( key, "ageofdgpsdata", key_len ) == 0 && value != NULL)
-  {
-    line_ageofdgpsdata = g_ascii_strtod(value, NULL);
-  }
-  else if (key_len == 6 && strncasecmp( key, "dgpsid", key_len ) == 0 && value != NULL)
-  {
+    break;
+  case KEY_MAGVAR:
+    line_magvar = util_strtod_len ( value, value_len );
+    break;
+  case KEY_GEOIDHEIGHT:
+    line_geoidheight = util_strtod_len ( value, value_len );
+    break;
+  case KEY_URL:
+    if (line_url == NULL)
+      line_url = deslashndup ( value, value_len );
+    break;
+  case KEY_URL_NAME:
+    if (line_url_name == NULL)
+      line_url_name = deslashndup ( value, value_len );
+    break;
+  case KEY_AGEOFDGPSDATA:
+    line_ageofdgpsdata = util_strtod_len ( value, value_len );
+    break;
+  case KEY_DGPSID:
     line_dgpsid = (guint)atoi(value);
-  }
-  else if (key_len == 9 && strncasecmp( key, "hide_name", key_len ) == 0 && value != NULL && (value[0] == 'y' || value[0] == 'Y' || value[0] == 't' || value[0] == 'T'))
-  {
-    line_hide_name = TRUE;
+    break;
+  case KEY_HIDE_NAME:
+    if (value[0] == 'y' || value[0] == 'Y' || value[0] == 't' || value[0] == 'T')
+      line_hide_name = TRUE;
+    break;
+  default:
+    break;
   }
 }
 
@@ -844,6 +912,8 @@ static void a_gpspoint_write_track ( const VikTrack *trk, FILE *f )
   if ( !(trk->name) )
     return;
 
+  vik_track_decode_extensions ( (VikTrack*)trk );
+
   gchar *tmp_name = slashdup(trk->name);
   fprintf ( f, "type=\"%s\" name=\"%s\"", trk->is_route ? "route" : "track", tmp_name );
   g_free ( tmp_name );
@@ -28,6 +28,7 @@
  */
 #include "gpx.h"
 #include "viking.h"
+#include "background.h"
 #include <expat.h>
 #include "misc/gtkhtml-private.h"
 
@@ -117,6 +118,9 @@ typedef struct {
 	FILE *file;
 	const gchar *dirpath;
 	VikTrwLayer *vtl;
+	GString *out;      // Trackpoints are formatted in to here, then written in large blocks
+	gint64 date_day;   // The day (since the epoch) that date_str is for
+	gchar date_str[12]; // "YYYY-MM-DDT" of the most recent time written
 } GpxWritingContext;
 
 /*
@@ -236,49 +240,109 @@ static tag_type get_tag_extension ( const char *tt )
   return tt_unknown;
 }
 
+static GHashTable *tag_path_hash = NULL;
+
 static tag_type get_tag(const char *t)
 {
-        tag_mapping *tm;
-        for (tm = tag_path_map; tm->tag_type != 0; tm++)
-                if (0 == strcmp(tm->tag_name, t))
-                        return tm->tag_type;
-        return tt_unknown;
+        // Built once, as this is looked up on every element start & end
+        if ( g_once_init_enter ( &tag_path_hash ) ) {
+                GHashTable *ht = g_hash_table_new ( g_str_hash, g_str_equal );
+                for ( tag_mapping *tm = tag_path_map; tm->tag_type != 0; tm++ )
+                        g_hash_table_insert ( ht, (gpointer)tm->tag_name, GINT_TO_POINTER(tm->tag_type) );
+                g_once_init_leave ( &tag_path_hash, ht );
+        }
+        return GPOINTER_TO_INT ( g_hash_table_lookup ( tag_path_hash, t ) );
 }
 
 /******************************************/
 
-static tag_type current_tag = tt_unknown;
-static GString *xpath = NULL;
-
-/* current ("c_") objects */
-static VikTrackpoint *c_tp = NULL;
-static VikWaypoint *c_wp = NULL;
-static VikTrack *c_tr = NULL;
-static VikTRWMetadata *c_md = NULL;
-static GString *c_cdata = NULL;
-static GString *c_ext = NULL;
-static GString *c_trkpt_ext = NULL;
-
-static gchar *c_wp_name = NULL;
-static gchar *c_tr_name = NULL;
-
-/* temporary things so we don't have to create them lots of times */
-static const gchar *c_slat, *c_slon;
-static struct LatLon c_ll;
-
-/* specialty flags / etc */
-static gboolean f_tr_newseg;
-static const gchar *c_link = NULL;
-static guint unnamed_waypoints = 0;
-static guint unnamed_tracks = 0;
-static guint unnamed_routes = 0;
+// Secondary parser for extension fragments, its text buffer
+//  and whichever track or trackpoint the values are for
+typedef struct {
+	GMarkupParseContext *context;
+	GString *text;
+	VikTrackpoint *tp;
+	VikTrack *tr;
+} ExtParserT;
 
+// All the state of reading one file, so that several files may be read at once in different threads
 typedef struct {
 	VikTrwLayer *vtl;
 	const gchar *dirpath;
 	gboolean append;
+
+	tag_type current_tag;
+	GString *xpath;
+	// The tag type of each enclosing element, so ending an element needn't look up its parent again
+	GArray *tag_stack;
+
+	/* current ("c_") objects */
+	VikTrackpoint *c_tp;
+	VikWaypoint *c_wp;
+	VikTrack *c_tr;
+	VikTRWMetadata *c_md;
+	GString *c_cdata;
+	GString *c_ext;
+	GString *c_trkpt_ext;
+
+	gchar *c_wp_name;
+	gchar *c_tr_name;
+
+	/* temporary things so we don't have to create them lots of times */
+	const gchar *c_slat, *c_slon;
+	struct LatLon c_ll;
+
+	/* specialty flags / etc */
+	gboolean f_tr_newseg;
+	const gchar *c_link;
+	guint unnamed_waypoints;
+	guint unnamed_tracks;
+	guint unnamed_routes;
+
+	// Secondary parser for extension fragments
+	ExtParserT ext;
+	gboolean lazy_extensions;
+
+	// Only when the reading may be continued later on (see a_gpx_read_file_resumable())
+	GpxResume *resume;
+	XML_Parser parser;
+	goffset base_offset;  // File position of the first byte given to the parser
+	VikTrack *resume_trk; // Existing track that the trackpoints of c_tr are to be added to
+	guint items;          // Tracks, routes and waypoints added to the layer
 } UserDataT;
 
+#define GPX_RESUME_CHECK_LEN 32
+
+// A point in the file after which reading can carry on, i.e. just after the end of an element
+//  at one of the levels that are revisited as a file grows (e.g. as each trackpoint is logged)
+typedef struct {
+	gboolean valid;
+	goffset offset;
+	GString *xpath;          // Elements open at this point
+	GArray *tag_stack;
+	tag_type current_tag;
+	gboolean f_tr_newseg;
+	VikTrack *trk;           // Track open at this point (a reference is held), or NULL
+	VikTrackpoint *last_tp;  // Its last trackpoint at this point, or NULL if none yet
+	guint unnamed_waypoints;
+	guint unnamed_tracks;
+	guint unnamed_routes;
+	guint items;             // Counting any open track as already added
+	guchar check[GPX_RESUME_CHECK_LEN]; // File content just before the offset
+	gsize check_len;
+} GpxResumePoint;
+
+// Levels: /gpx, /gpx/trk and /gpx/trk/trkseg
+#define GPX_RESUME_LEVELS 3
+
+struct _GpxResume {
+	VikTrwLayer *vtl;
+	gchar *dirpath;
+	gchar *encoding;
+	guint items;
+	GpxResumePoint points[GPX_RESUME_LEVELS];
+};
+
 static const char *get_attr ( const char **attr, const char *key )
 {
   while ( *attr ) {
@@ -321,11 +385,19 @@ static GString *get_header ( const char **attr )
   return gs;
 }
 
-static gboolean set_c_ll ( const char **attr )
+/**
+ * Convert the plain decimal numbers normally found in GPX files (e.g. "-1.2345")
+ */
+static gdouble gpx_strtod ( const gchar *str )
+{
+  return util_strtod_len ( str, strlen(str) );
+}
+
+static gboolean set_c_ll ( UserDataT *ud, const char **attr )
 {
-  if ( (c_slat = get_attr ( attr, "lat" )) && (c_slon = get_attr ( attr, "lon" )) ) {
-    c_ll.lat = g_ascii_strtod(c_slat, NULL);
-    c_ll.lon = g_ascii_strtod(c_slon, NULL);
+  if ( (ud->c_slat = get_attr ( attr, "lat" )) && (ud->c_slon = get_attr ( attr, "lon" )) ) {
+    ud->c_ll.lat = gpx_strtod(ud->c_slat);
+    ud->c_ll.lon = gpx_strtod(ud->c_slon);
     return TRUE;
   }
   return FALSE;
@@ -391,8 +463,6 @@ static tag_type_ext get_tag_ext_specific (const char *tt)
  return ext_unknown;
 }
 
-GString *gs_ext;
-
 // Reprocess the extension text to extract tags we handle
 static void ext_start_element ( GMarkupParseContext *context,
                                 const gchar         *element_name,
@@ -401,7 +471,8 @@ static void ext_start_element ( GMarkupParseContext *context,
                                 gpointer             user_data,
                                 GError             **error )
 {
-  g_string_erase ( gs_ext, 0, -1 ); // Reset the tmp string buffer
+  ExtParserT *ep = user_data;
+  g_string_erase ( ep->text, 0, -1 ); // Reset the tmp string buffer
 }
 
 // NB Text is not null terminated
@@ -411,8 +482,9 @@ static void ext_text ( GMarkupParseContext *context,
                        gpointer             user_data,
                        GError             **error )
 {
+  ExtParserT *ep = user_data;
   // Store tag contents
-  g_string_append_len ( gs_ext, text, text_len );
+  g_string_append_len ( ep->text, text, text_len );
 }
 
 // Main trackpoint extension processing here
@@ -421,58 +493,103 @@ static void ext_end_element ( GMarkupParseContext *context,
                               gpointer             user_data,
                               GError             **error )
 {
+  ExtParserT *ep = user_data;
   // If it is any of the extended tags we are interested in,
   //  then use the text stored in the string buffer to set the appropriate track or trackpoint value
   tag_type tag = get_tag_ext_specific ( element_name );
   switch ( tag ) {
   case ext_tp_heart_rate:
-    if ( c_tp ) c_tp->heart_rate = atoi ( gs_ext->str ); // bpm
+    if ( ep->tp ) ep->tp->heart_rate = atoi ( ep->text->str ); // bpm
     break;
   case ext_tp_cadence:
-    if ( c_tp ) c_tp->cadence = atoi ( gs_ext->str ); // RPM
+    if ( ep->tp ) ep->tp->cadence = atoi ( ep->text->str ); // RPM
     break;
   case ext_tp_speed:
-    if ( c_tp ) c_tp->speed = g_ascii_strtod ( gs_ext->str, NULL ); // m/s
+    if ( ep->tp ) ep->tp->speed = g_ascii_strtod ( ep->text->str, NULL ); // m/s
     break;
   case ext_tp_course:
-    if ( c_tp ) c_tp->course = g_ascii_strtod ( gs_ext->str, NULL ); // Degrees
+    if ( ep->tp ) ep->tp->course = g_ascii_strtod ( ep->text->str, NULL ); // Degrees
     break;
   case ext_tp_temp:
-    if ( c_tp ) c_tp->temp = g_ascii_strtod ( gs_ext->str, NULL ); // Degrees Celsius
+    if ( ep->tp ) ep->tp->temp = g_ascii_strtod ( ep->text->str, NULL ); // Degrees Celsius
     break;
   case ext_tp_power:
-    if ( c_tp ) c_tp->power = atoi ( gs_ext->str ); // Watts
+    if ( ep->tp ) ep->tp->power = atoi ( ep->text->str ); // Watts
     break;
   case ext_trk_color:
-    if ( c_tr ) {
+    if ( ep->tr ) {
       GdkColor gclr;
-      if ( gdk_color_parse ( gs_ext->str, &gclr ) ) {
-        c_tr->has_color = TRUE;
-        c_tr->color = gclr;
+      if ( gdk_color_parse ( ep->text->str, &gclr ) ) {
+        ep->tr->has_color = TRUE;
+        ep->tr->color = gclr;
       }
     }
     break;
   default:
     break;
   }
-  g_string_erase ( gs_ext, 0, -1 );
+  g_string_erase ( ep->text, 0, -1 );
 }
 
-GMarkupParser gparser;
-GMarkupParseContext *gcontext;
+static const GMarkupParser ext_parser = {
+  ext_start_element,
+  ext_end_element,
+  ext_text,
+  NULL,
+  NULL
+};
+
+static void ext_parser_init ( ExtParserT *ep )
+{
+  // Seems to work better on xml fragments compared to expat,
+  //  and also a single parser can be reused,
+  //  rather than having to create an expat parser each time on each <extension> tag group
+  ep->context = g_markup_parse_context_new ( &ext_parser, 0, ep, NULL );
+  ep->text = g_string_new ( NULL );
+  ep->tp = NULL;
+  ep->tr = NULL;
+}
+
+static void ext_parser_free ( ExtParserT *ep )
+{
+  g_markup_parse_context_free ( ep->context );
+  g_string_free ( ep->text, TRUE );
+}
 
-static void track_or_trackpoint_extension_process ( gchar *str )
+static void ext_parser_process ( ExtParserT *ep, VikTrack *tr, VikTrackpoint *tp, const gchar *str )
 {
   if ( !str )
     return;
 
+  ep->tr = tr;
+  ep->tp = tp;
   // Parse xml fragment to extract extension tag values
   GError *error = NULL;
-  if ( !g_markup_parse_context_parse ( gcontext, str, strlen(str), &error ) )
+  if ( !g_markup_parse_context_parse ( ep->context, str, strlen(str), &error ) )
     g_warning ( "%s: parse error %s on:%s", __FUNCTION__, error ? error->message : "???", str );
+  g_clear_error ( &error );
 
-  if ( !g_markup_parse_context_end_parse ( gcontext, &error) )
+  if ( !g_markup_parse_context_end_parse ( ep->context, &error) )
     g_warning ( "%s: error %s occurred on end of:%s", __FUNCTION__, error ? error->message : "???", str );
+  g_clear_error ( &error );
+}
+
+/**
+ * a_gpx_decode_trackpoint_extensions:
+ * @tpl: The trackpoints
+ *
+ * Set the values of the trackpoints held in their GPX extensions,
+ *  for when this is not done on reading the file, see VIK_SETTINGS_GPX_LAZY_EXTENSIONS
+ */
+void a_gpx_decode_trackpoint_extensions ( GList *tpl )
+{
+  ExtParserT ep;
+  ext_parser_init ( &ep );
+  for ( GList *iter = tpl; iter; iter = iter->next ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    ext_parser_process ( &ep, NULL, tp, tp->extensions );
+  }
+  ext_parser_free ( &ep );
 }
 
 static void extension_append_attributions ( GString *gs, const char *el, const char **attr )
@@ -492,25 +609,26 @@ static void extension_append_attributions ( GString *gs, const char *el, const c
 
 static void gpx_start(UserDataT *ud, const char *el, const char **attr)
 {
-  static const gchar *tmp;
+  const gchar *tmp;
   VikTrwLayer *vtl = ud->vtl;
 
-  g_string_append_c ( xpath, '/' );
-  g_string_append ( xpath, el );
-  current_tag = get_tag ( xpath->str );
-  if ( current_tag == tt_unknown )
-    current_tag = get_tag_extension ( xpath->str );
+  g_array_append_val ( ud->tag_stack, ud->current_tag );
+  g_string_append_c ( ud->xpath, '/' );
+  g_string_append ( ud->xpath, el );
+  ud->current_tag = get_tag ( ud->xpath->str );
+  if ( ud->current_tag == tt_unknown )
+    ud->current_tag = get_tag_extension ( ud->xpath->str );
 
-  switch ( current_tag ) {
+  switch ( ud->current_tag ) {
 
      case tt_gpx:
        {
-         c_md = vik_trw_metadata_new();
+         ud->c_md = vik_trw_metadata_new();
          // Store creator information if possible
          const gchar *crt = get_attr ( attr, "creator" );
          if ( crt ) {
            // If there is an actual description field it will overwrite this value
-           c_md->description = g_strdup_printf ( _("Created by: %s"), crt );
+           ud->c_md->description = g_strdup_printf ( _("Created by: %s"), crt );
          }
 
          const gchar *version = get_attr ( attr, "version" );
@@ -534,42 +652,42 @@ static void gpx_start(UserDataT *ud, const char *el, const char **attr)
        }
        break;
      case tt_wpt:
-       if ( set_c_ll( attr ) ) {
-         c_wp = vik_waypoint_new ();
+       if ( set_c_ll( ud, attr ) ) {
+         ud->c_wp = vik_waypoint_new ();
          if ( get_attr ( attr, "hidden" ) )
-           c_wp->visible = FALSE;
+           ud->c_wp->visible = FALSE;
 
-         vik_coord_load_from_latlon ( &(c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &c_ll );
+         vik_coord_load_from_latlon ( &(ud->c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &ud->c_ll );
        }
        break;
 
      case tt_trk:
      case tt_rte:
-       c_tr = vik_track_new ();
-       c_tr->is_route = (current_tag == tt_rte) ? TRUE : FALSE;
+       ud->c_tr = vik_track_new ();
+       ud->c_tr->is_route = (ud->current_tag == tt_rte) ? TRUE : FALSE;
        if ( get_attr ( attr, "hidden" ) )
-         c_tr->visible = FALSE;
+         ud->c_tr->visible = FALSE;
        break;
 
      case tt_trk_trkseg:
-       f_tr_newseg = TRUE;
+       ud->f_tr_newseg = TRUE;
        break;
 
      case tt_trk_trkseg_trkpt:
-       if ( set_c_ll( attr ) ) {
-         c_tp = vik_trackpoint_new ();
-         vik_coord_load_from_latlon ( &(c_tp->coord), vik_trw_layer_get_coord_mode ( vtl ), &c_ll );
-         if ( f_tr_newseg ) {
-           c_tp->newsegment = TRUE;
-           f_tr_newseg = FALSE;
+       if ( set_c_ll( ud, attr ) ) {
+         ud->c_tp = vik_trackpoint_new ();
+         vik_coord_load_from_latlon ( &(ud->c_tp->coord), vik_trw_layer_get_coord_mode ( vtl ), &ud->c_ll );
+         if ( ud->f_tr_newseg ) {
+           ud->c_tp->newsegment = TRUE;
+           ud->f_tr_newseg = FALSE;
          }
-         c_tr->trackpoints = g_list_prepend ( c_tr->trackpoints, c_tp );
+         ud->c_tr->trackpoints = g_list_prepend ( ud->c_tr->trackpoints, ud->c_tp );
        }
        break;
 
      case tt_gpx_url:
      case tt_wpt_link:
-       c_link = get_attr ( attr, "href" );
+       ud->c_link = get_attr ( attr, "href" );
        break;
      case tt_gpx_name:
      case tt_gpx_author:
@@ -605,42 +723,42 @@ static void gpx_start(UserDataT *ud, const char *el, const char **attr)
      case tt_trk_number:
      case tt_trk_type:
      case tt_trk_name:
-       g_string_erase ( c_cdata, 0, -1 ); /* clear the cdata buffer */
+       g_string_erase ( ud->c_cdata, 0, -1 ); /* clear the cdata buffer */
        break;
 
      case tt_waypoint:
-       c_wp = vik_waypoint_new ();
+       ud->c_wp = vik_waypoint_new ();
        break;
 
      case tt_waypoint_coord:
-       if ( set_c_ll( attr ) )
-         vik_coord_load_from_latlon ( &(c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &c_ll );
+       if ( set_c_ll( ud, attr ) )
+         vik_coord_load_from_latlon ( &(ud->c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &ud->c_ll );
        break;
 
      case tt_waypoint_name:
        if ( ( tmp = get_attr(attr, "id") ) ) {
-         if ( c_wp_name )
-           g_free ( c_wp_name );
-         c_wp_name = g_strdup ( tmp );
+         if ( ud->c_wp_name )
+           g_free ( ud->c_wp_name );
+         ud->c_wp_name = g_strdup ( tmp );
        }
-       g_string_erase ( c_cdata, 0, -1 ); /* clear the cdata buffer for description */
+       g_string_erase ( ud->c_cdata, 0, -1 ); /* clear the cdata buffer for description */
        break;
         
      case tt_gpx_extensions:
      case tt_wpt_extensions:
      case tt_trk_extensions:
-       g_string_erase ( c_ext, 0, -1 ); // clear the buffer
+       g_string_erase ( ud->c_ext, 0, -1 ); // clear the buffer
        break;      
      case tt_trk_trkseg_trkpt_extensions:
-       g_string_erase ( c_trkpt_ext, 0, -1 ); // clear the buffer
+       g_string_erase ( ud->c_trkpt_ext, 0, -1 ); // clear the buffer
        break;
      case tt_gpx_an_extension:
      case tt_wpt_an_extension:
      case tt_trk_an_extension:
-       extension_append_attributions ( c_ext, el, attr );
+       extension_append_attributions ( ud->c_ext, el, attr );
        break;
      case tt_trk_trkseg_trkpt_an_extension:
-       extension_append_attributions ( c_trkpt_ext, el, attr );
+       extension_append_attributions ( ud->c_trkpt_ext, el, attr );
        break;
 
      default: break;
@@ -650,6 +768,8 @@ static void gpx_start(UserDataT *ud, const char *el, const char **attr)
 // Allow user override / refinement of GPX tidying
 #define VIK_SETTINGS_GPX_TIDY "gpx_tidy_points"
 #define VIK_SETTINGS_GPX_TIDY_SPEED "gpx_tidy_points_max_speed"
+// Leave reading trackpoint sensor values (heart rate, cadence, etc...) until first needed
+#define VIK_SETTINGS_GPX_LAZY_EXTENSIONS "gpx_lazy_trackpoint_extensions"
 
 /**
  *
@@ -676,375 +796,454 @@ static void track_tidy_processing ( VikTrwLayer *vtl )
   }
 }
 
+/**
+ * The end of the track or route being read, so add it to the layer
+ *  (or its trackpoints to the existing track when carrying on reading a file)
+ */
+static void gpx_track_end ( UserDataT *ud )
+{
+  ud->c_tr->trackpoints = g_list_reverse ( ud->c_tr->trackpoints );
+  if ( ud->resume_trk ) {
+    (void)vik_track_append_trackpoints ( ud->resume_trk, NULL, ud->c_tr->trackpoints );
+    ud->c_tr->trackpoints = NULL;
+    vik_track_free ( ud->c_tr );
+    ud->resume_trk = NULL;
+  }
+  else {
+    if ( ! ud->c_tr_name ) {
+      if ( ud->c_tr->is_route )
+        ud->c_tr_name = g_strdup_printf("VIKING_RT%03d", ud->unnamed_routes++);
+      else
+        ud->c_tr_name = g_strdup_printf("VIKING_TR%03d", ud->unnamed_tracks++);
+    }
+    vik_trw_layer_filein_add_track ( ud->vtl, ud->c_tr_name, ud->c_tr );
+    ud->items++;
+  }
+  g_free ( ud->c_tr_name );
+  ud->c_tr = NULL;
+  ud->c_tr_name = NULL;
+}
+
+static void gpx_resume_point_clear ( GpxResumePoint *pt )
+{
+  if ( pt->xpath )
+    g_string_free ( pt->xpath, TRUE );
+  if ( pt->tag_stack )
+    g_array_free ( pt->tag_stack, TRUE );
+  if ( pt->trk )
+    vik_track_free ( pt->trk );
+  memset ( pt, 0, sizeof(GpxResumePoint) );
+}
+
+/**
+ * Record the state of reading at the end of the current element
+ */
+static void gpx_resume_point_save ( UserDataT *ud, guint level )
+{
+  GpxResumePoint *pt = &ud->resume->points[level];
+  gpx_resume_point_clear ( pt );
+  pt->valid = TRUE;
+  pt->offset = ud->base_offset + XML_GetCurrentByteIndex ( ud->parser ) + XML_GetCurrentByteCount ( ud->parser );
+  pt->xpath = g_string_new ( ud->xpath->str );
+  pt->tag_stack = g_array_sized_new ( FALSE, FALSE, sizeof(tag_type), ud->tag_stack->len );
+  g_array_append_vals ( pt->tag_stack, ud->tag_stack->data, ud->tag_stack->len );
+  pt->current_tag = ud->current_tag;
+  pt->f_tr_newseg = ud->f_tr_newseg;
+  pt->unnamed_waypoints = ud->unnamed_waypoints;
+  pt->unnamed_tracks = ud->unnamed_tracks;
+  pt->unnamed_routes = ud->unnamed_routes;
+  pt->items = ud->items;
+  if ( level > 0 && ud->c_tr ) {
+    pt->trk = ud->resume_trk ? ud->resume_trk : ud->c_tr;
+    vik_track_ref ( pt->trk );
+    if ( ud->c_tr->trackpoints )
+      pt->last_tp = VIK_TRACKPOINT(ud->c_tr->trackpoints->data);
+    else if ( ud->resume_trk ) {
+      GList *last = g_list_last ( ud->resume_trk->trackpoints );
+      pt->last_tp = last ? VIK_TRACKPOINT(last->data) : NULL;
+    }
+    // The track is added once it ends, but for this point it is treated as though already added
+    if ( !ud->resume_trk )
+      pt->items++;
+  }
+}
+
+static void gpx_xml_decl ( UserDataT *ud, const XML_Char *version, const XML_Char *encoding, int standalone )
+{
+  if ( ud->resume && encoding ) {
+    g_free ( ud->resume->encoding );
+    ud->resume->encoding = g_strdup ( encoding );
+  }
+}
+
 static void gpx_end(UserDataT *ud, const char *el)
 {
-  static GTimeVal tp_time;
-  static GTimeVal wp_time;
   VikTrwLayer *vtl = ud->vtl;
 
-  g_string_truncate ( xpath, xpath->len - strlen(el) - 1 );
+  g_string_truncate ( ud->xpath, ud->xpath->len - strlen(el) - 1 );
 
-  switch ( current_tag ) {
+  switch ( ud->current_tag ) {
 
      case tt_gpx:
-       vik_trw_layer_set_metadata ( vtl, c_md );
-       c_md = NULL;
-
-       // Essentially the end for a TrackWaypoint layer,
-       //  so any specific GPX post processing can occur here
-       track_tidy_processing ( vtl );
-
+       // Not when continuing a file, as the start was not read this time
+       if ( ud->c_md ) {
+         vik_trw_layer_set_metadata ( vtl, ud->c_md );
+         ud->c_md = NULL;
+
+         // Essentially the end for a TrackWaypoint layer,
+         //  so any specific GPX post processing can occur here
+         track_tidy_processing ( vtl );
+       }
        break;
 
      case tt_gpx_name:
-       vik_layer_rename ( VIK_LAYER(vtl), c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_layer_rename ( VIK_LAYER(vtl), ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_author:
-       if ( c_md->author )
-         g_free ( c_md->author );
-       c_md->author = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_md->author )
+         g_free ( ud->c_md->author );
+       ud->c_md->author = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_desc:
-       if ( c_md->description )
-         g_free ( c_md->description );
-       c_md->description = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_md->description )
+         g_free ( ud->c_md->description );
+       ud->c_md->description = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_keywords:
-       if ( c_md->keywords )
-         g_free ( c_md->keywords );
-       c_md->keywords = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_md->keywords )
+         g_free ( ud->c_md->keywords );
+       ud->c_md->keywords = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_time:
-       if ( c_md->timestamp )
-         g_free ( c_md->timestamp );
-       c_md->timestamp = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_md->timestamp )
+         g_free ( ud->c_md->timestamp );
+       ud->c_md->timestamp = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_url:
-       if ( c_md->url )
-         g_free ( c_md->url );
-       if ( c_link ) {
-         c_md->url = g_strdup ( c_link );
-         c_link = NULL;
-       } else if ( c_cdata->len > 0 ) {
-         c_md->url = g_strdup ( c_cdata->str );
-         g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_md->url )
+         g_free ( ud->c_md->url );
+       if ( ud->c_link ) {
+         ud->c_md->url = g_strdup ( ud->c_link );
+         ud->c_link = NULL;
+       } else if ( ud->c_cdata->len > 0 ) {
+         ud->c_md->url = g_strdup ( ud->c_cdata->str );
+         g_string_erase ( ud->c_cdata, 0, -1 );
        }
        break;
 
      case tt_waypoint:
      case tt_wpt:
-       if ( ! c_wp_name )
-         c_wp_name = g_strdup_printf("VIKING_WP%04d", unnamed_waypoints++);
-       vik_trw_layer_filein_add_waypoint ( vtl, c_wp_name, c_wp );
-       g_free ( c_wp_name );
-       c_wp = NULL;
-       c_wp_name = NULL;
+       if ( ! ud->c_wp_name )
+         ud->c_wp_name = g_strdup_printf("VIKING_WP%04d", ud->unnamed_waypoints++);
+       vik_trw_layer_filein_add_waypoint ( vtl, ud->c_wp_name, ud->c_wp );
+       ud->items++;
+       g_free ( ud->c_wp_name );
+       ud->c_wp = NULL;
+       ud->c_wp_name = NULL;
        break;
 
      case tt_trk:
-       if ( ! c_tr_name )
-         c_tr_name = g_strdup_printf("VIKING_TR%03d", unnamed_tracks++);
-       // Delibrate fall through
      case tt_rte:
-       if ( ! c_tr_name )
-         c_tr_name = g_strdup_printf("VIKING_RT%03d", unnamed_routes++);
-       c_tr->trackpoints = g_list_reverse ( c_tr->trackpoints );
-       vik_trw_layer_filein_add_track ( vtl, c_tr_name, c_tr );
-       g_free ( c_tr_name );
-       c_tr = NULL;
-       c_tr_name = NULL;
+       gpx_track_end ( ud );
        break;
 
      case tt_wpt_name:
-       if ( c_wp_name )
-         g_free ( c_wp_name );
-       c_wp_name = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_wp_name )
+         g_free ( ud->c_wp_name );
+       ud->c_wp_name = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_name:
-       if ( c_tr_name )
-         g_free ( c_tr_name );
-       c_tr_name = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_tr_name )
+         g_free ( ud->c_tr_name );
+       ud->c_tr_name = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_ele:
-       c_wp->altitude = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->altitude = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_ele:
-       c_tp->altitude = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->altitude = gpx_strtod ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_waypoint_name: /* .loc name is really description. */
      case tt_wpt_desc:
-       vik_waypoint_set_description ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_description ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_cmt:
-       vik_waypoint_set_comment ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_comment ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_src:
-       vik_waypoint_set_source ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_source ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_type:
-       vik_waypoint_set_type ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_type ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_url:
-       vik_waypoint_set_url ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_url ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_url_name:
-       vik_waypoint_set_url_name ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_url_name ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_link:
-       if ( c_link ) {
+       if ( ud->c_link ) {
          // Correct <link href="uri"></link> format
-         if ( util_is_url(c_link) ) {
-           vik_waypoint_set_url ( c_wp, c_link );
+         if ( util_is_url(ud->c_link) ) {
+           vik_waypoint_set_url ( ud->c_wp, ud->c_link );
          }
          else {
-           vu_waypoint_set_image_uri ( c_wp, c_link, ud->dirpath );
+           vu_waypoint_set_image_uri ( ud->c_wp, ud->c_link, ud->dirpath );
          }
        }
        else {
          // Fallback for incorrect GPX <link> format (probably from previous versions of Viking!)
          //  of the form <link>file</link>
-         gchar *fn = util_make_absolute_filename ( c_cdata->str, ud->dirpath );
-         vik_waypoint_set_image ( c_wp, fn ? fn : c_cdata->str );
+         gchar *fn = util_make_absolute_filename ( ud->c_cdata->str, ud->dirpath );
+         vik_waypoint_set_image ( ud->c_wp, fn ? fn : ud->c_cdata->str );
          g_free ( fn );
        }
-       c_link = NULL;
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_link = NULL;
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_sym:
-       vik_waypoint_set_symbol ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_symbol ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_course:
-       c_wp->course = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->course = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_speed:
-       c_wp->speed = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->speed = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_magvar:
-       c_wp->magvar = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->magvar = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_geoidheight:
-       c_wp->geoidheight = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->geoidheight = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_fix:
-       if (!strcmp("2d", c_cdata->str))
-         c_wp->fix_mode = VIK_GPS_MODE_2D;
-       else if (!strcmp("3d", c_cdata->str))
-         c_wp->fix_mode = VIK_GPS_MODE_3D;
-       else if (!strcmp("dgps", c_cdata->str))
-         c_wp->fix_mode = VIK_GPS_MODE_DGPS;
-       else if (!strcmp("pps", c_cdata->str))
-         c_wp->fix_mode = VIK_GPS_MODE_PPS;
+       if (!strcmp("2d", ud->c_cdata->str))
+         ud->c_wp->fix_mode = VIK_GPS_MODE_2D;
+       else if (!strcmp("3d", ud->c_cdata->str))
+         ud->c_wp->fix_mode = VIK_GPS_MODE_3D;
+       else if (!strcmp("dgps", ud->c_cdata->str))
+         ud->c_wp->fix_mode = VIK_GPS_MODE_DGPS;
+       else if (!strcmp("pps", ud->c_cdata->str))
+         ud->c_wp->fix_mode = VIK_GPS_MODE_PPS;
        else
-         c_wp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
-       g_string_erase ( c_cdata, 0, -1 );
+         ud->c_wp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_sat:
-       c_wp->nsats = atoi ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->nsats = atoi ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_hdop:
-       c_wp->hdop = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->hdop = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_vdop:
-       c_wp->vdop = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->vdop = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_pdop:
-       c_wp->pdop = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->pdop = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_ageofdgpsdata:
-       c_wp->ageofdgpsdata = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->ageofdgpsdata = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_dgpsid:
-       c_wp->dgpsid = atoi ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->dgpsid = atoi ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_desc:
-       vik_track_set_description ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_description ( ud->c_tr, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_src:
-       vik_track_set_source ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_source ( ud->c_tr, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_number:
-       c_tr->number = atoi ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tr->number = atoi ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_type:
-       vik_track_set_type ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_type ( ud->c_tr, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_cmt:
-       vik_track_set_comment ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_comment ( ud->c_tr, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_time:
-       if ( g_time_val_from_iso8601(c_cdata->str, &wp_time) ) {
-	 gdouble d1 = wp_time.tv_sec;
-	 gdouble d2 = (gdouble)wp_time.tv_usec/G_USEC_PER_SEC;
-         c_wp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
-       }
-       g_string_erase ( c_cdata, 0, -1 );
+       util_time_from_iso8601 ( ud->c_cdata->str, &ud->c_wp->timestamp );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_name:
-       vik_trackpoint_set_name ( c_tp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_trackpoint_set_name ( ud->c_tp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_time:
-       if ( g_time_val_from_iso8601(c_cdata->str, &tp_time) ) {
-	 gdouble d1 = tp_time.tv_sec;
-	 gdouble d2 = (gdouble)tp_time.tv_usec/G_USEC_PER_SEC;
-         c_tp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
-       }
-       g_string_erase ( c_cdata, 0, -1 );
+       util_time_from_iso8601 ( ud->c_cdata->str, &ud->c_tp->timestamp );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_course:
-       c_tp->course = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->course = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_speed:
-       c_tp->speed = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->speed = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_fix:
-       if (!strcmp("2d", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_2D;
-       else if (!strcmp("3d", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_3D;
-       else if (!strcmp("dgps", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_DGPS;
-       else if (!strcmp("pps", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_PPS;
+       if (!strcmp("2d", ud->c_cdata->str))
+         ud->c_tp->fix_mode = VIK_GPS_MODE_2D;
+       else if (!strcmp("3d", ud->c_cdata->str))
+         ud->c_tp->fix_mode = VIK_GPS_MODE_3D;
+       else if (!strcmp("dgps", ud->c_cdata->str))
+         ud->c_tp->fix_mode = VIK_GPS_MODE_DGPS;
+       else if (!strcmp("pps", ud->c_cdata->str))
+         ud->c_tp->fix_mode = VIK_GPS_MODE_PPS;
        else
-         c_tp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
-       g_string_erase ( c_cdata, 0, -1 );
+         ud->c_tp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_sat:
-       c_tp->nsats = atoi ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->nsats = atoi ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_hdop:
-       c_tp->hdop = g_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->hdop = g_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_vdop:
-       c_tp->vdop = g_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->vdop = g_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_pdop:
-       c_tp->pdop = g_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->pdop = g_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_an_extension:
      case tt_wpt_an_extension:
      case tt_trk_an_extension:
-       g_string_append_printf ( c_ext, "</%s>", el );
+       g_string_append_printf ( ud->c_ext, "</%s>", el );
        break;
      case tt_trk_trkseg_trkpt_an_extension:
-       g_string_append_printf ( c_trkpt_ext, "</%s>", el );
+       g_string_append_printf ( ud->c_trkpt_ext, "</%s>", el );
        break;
 
      case tt_trk_extensions:
-       if ( current_tag == tt_trk_extensions )
-         track_or_trackpoint_extension_process ( c_ext->str );
-       vik_track_set_extensions ( c_tr, c_ext->str );
-       g_string_erase ( c_ext, 0, -1 );
+       if ( ud->current_tag == tt_trk_extensions )
+         ext_parser_process ( &ud->ext, ud->c_tr, ud->c_tp, ud->c_ext->str );
+       vik_track_set_extensions ( ud->c_tr, ud->c_ext->str );
+       g_string_erase ( ud->c_ext, 0, -1 );
        break;
 
      case tt_gpx_extensions:
-       vik_trw_layer_set_gpx_extensions ( vtl, c_ext->str );
-       g_string_erase ( c_ext, 0, -1 );
+       vik_trw_layer_set_gpx_extensions ( vtl, ud->c_ext->str );
+       g_string_erase ( ud->c_ext, 0, -1 );
        break;
 
      case tt_wpt_extensions:
-       vik_waypoint_set_extensions ( c_wp, c_ext->str );
-       g_string_erase ( c_ext, 0, -1 );
+       vik_waypoint_set_extensions ( ud->c_wp, ud->c_ext->str );
+       g_string_erase ( ud->c_ext, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_extensions:
-       vik_trackpoint_set_extensions ( c_tp, c_trkpt_ext->str );
-       track_or_trackpoint_extension_process ( c_trkpt_ext->str );
-       g_string_erase ( c_trkpt_ext, 0, -1 );
+       vik_trackpoint_set_extensions ( ud->c_tp, ud->c_trkpt_ext->str );
+       // Optionally the sensor values are left to be decoded when first needed,
+       //  unless the speed or course is given as these are used all over
+       if ( ud->lazy_extensions && ud->c_tr &&
+            !strstr ( ud->c_trkpt_ext->str, "speed" ) && !strstr ( ud->c_trkpt_ext->str, "course" ) )
+         ud->c_tr->extensions_pending = TRUE;
+       else
+         ext_parser_process ( &ud->ext, ud->c_tr, ud->c_tp, ud->c_trkpt_ext->str );
+       g_string_erase ( ud->c_trkpt_ext, 0, -1 );
        break;
 
      default: break;
   }
 
-  current_tag = get_tag ( xpath->str );
-  if ( current_tag == tt_unknown )
-    current_tag = get_tag_extension ( xpath->str );
+  ud->current_tag = g_array_index ( ud->tag_stack, tag_type, ud->tag_stack->len - 1 );
+  g_array_set_size ( ud->tag_stack, ud->tag_stack->len - 1 );
+
+  if ( ud->resume ) {
+    if ( !strcmp ( ud->xpath->str, "/gpx" ) )
+      gpx_resume_point_save ( ud, 0 );
+    else if ( !strcmp ( ud->xpath->str, "/gpx/trk" ) )
+      gpx_resume_point_save ( ud, 1 );
+    else if ( !strcmp ( ud->xpath->str, "/gpx/trk/trkseg" ) )
+      gpx_resume_point_save ( ud, 2 );
+  }
 }
 
 static void gpx_cdata(void *dta, const XML_Char *s, int len)
 {
-  switch ( current_tag ) {
+  UserDataT *ud = dta;
+  switch ( ud->current_tag ) {
     case tt_gpx_name:
     case tt_gpx_author:
     case tt_gpx_desc:
@@ -1090,12 +1289,12 @@ static void gpx_cdata(void *dta, const XML_Char *s, int len)
     case tt_trk_trkseg_trkpt_vdop:
     case tt_trk_trkseg_trkpt_pdop:
     case tt_waypoint_name: /* .loc name is really description. */
-      g_string_append_len ( c_cdata, s, len );
+      g_string_append_len ( ud->c_cdata, s, len );
       break;
 
     case tt_trk_trkseg_trkpt_an_extension:
     case tt_trk_trkseg_trkpt_extensions:
-      g_string_append_len ( c_trkpt_ext, s, len );
+      g_string_append_len ( ud->c_trkpt_ext, s, len );
       break;
     case tt_trk_an_extension:
     case tt_trk_extensions:
@@ -1103,23 +1302,35 @@ static void gpx_cdata(void *dta, const XML_Char *s, int len)
     case tt_wpt_extensions:
     case tt_gpx_an_extension:
     case tt_gpx_extensions:
-      g_string_append_len ( c_ext, s, len );
+      g_string_append_len ( ud->c_ext, s, len );
       break;
 
     default: break;  /* ignore cdata from other things */
   }
 }
 
+#define GPX_READ_BUFFER_SIZE (256*1024)
+
+struct _GpxReader {
+  XML_Parser parser;
+  UserDataT *ud;
+  enum XML_Status status;
+};
+
 // make like a "stack" of tag names
 // like gpspoint's separated like /gpx/wpt/whatever
 // @append: Whether the read is to append to the vtl (or otherwise a new layer)
 //  i.e. primarily to decide what to do regarding appending files with different GPX versions
-gboolean a_gpx_read_file( VikTrwLayer *vtl, FILE *f, const gchar* dirpath, gboolean append ) {
+static GpxReader *gpx_reader_new ( VikTrwLayer *vtl, const gchar* dirpath, gboolean append )
+{
+  GpxReader *gr = g_new0 ( GpxReader, 1 );
   XML_Parser parser = XML_ParserCreate(NULL);
-  int done=0, len;
-  enum XML_Status status = XML_STATUS_ERROR;
+  gr->parser = parser;
+  gr->status = XML_STATUS_OK;
 
-  UserDataT *ud = g_malloc (sizeof(UserDataT));
+  UserDataT *ud = g_new0 (UserDataT, 1);
+  gr->ud = ud;
+  ud->parser  = parser;
   ud->vtl     = vtl;
   ud->dirpath = dirpath;
   ud->append  = append;
@@ -1128,54 +1339,353 @@ gboolean a_gpx_read_file( VikTrwLayer *vtl, FILE *f, const gchar* dirpath, gbool
   XML_SetUserData(parser, ud);
   XML_SetCharacterDataHandler(parser, (XML_CharacterDataHandler) gpx_cdata);
 
-  // Secondary parser for trackpoint extension fragments
-  //  seems to work better on xml fragments compared to expat,
-  //  and also we can reuse a single parser,
-  //  rather than having to create an expat parser each time on each <extension> tag group
-  gparser.start_element = &ext_start_element;
-  gparser.end_element = &ext_end_element;
-  gparser.text = &ext_text;
-  gparser.passthrough = NULL;
-  gparser.error = NULL;
-  gcontext = g_markup_parse_context_new ( &gparser, 0, NULL, NULL );
+  ext_parser_init ( &ud->ext );
+  ud->lazy_extensions = FALSE;
+  (void)a_settings_get_boolean ( VIK_SETTINGS_GPX_LAZY_EXTENSIONS, &ud->lazy_extensions );
 
-  gchar buf[4096];
+  ud->current_tag = tt_unknown;
+  ud->tag_stack = g_array_sized_new ( FALSE, FALSE, sizeof(tag_type), 16 );
+  ud->xpath = g_string_new ( "" );
+  ud->c_cdata = g_string_new ( "" );
+  ud->c_ext = g_string_new ( NULL );
+  ud->c_trkpt_ext = g_string_new ( NULL );
 
-  g_assert ( f != NULL && vtl != NULL );
+  ud->unnamed_waypoints = 1;
+  ud->unnamed_tracks = 1;
+  ud->unnamed_routes = 1;
+
+  return gr;
+}
+
+static gboolean gpx_reader_free ( GpxReader *gr )
+{
+  UserDataT *ud = gr->ud;
+  gboolean ans = (gr->status != XML_STATUS_ERROR);
+  if ( !ans ) {
+    g_warning ( "%s: XML error %s at line %ld", __FUNCTION__, XML_ErrorString(XML_GetErrorCode(gr->parser)), XML_GetCurrentLineNumber(gr->parser) );
+  }
+
+  XML_ParserFree (gr->parser);
+  g_array_free ( ud->tag_stack, TRUE );
+  g_string_free ( ud->xpath, TRUE );
+  g_string_free ( ud->c_cdata, TRUE );
+  g_string_free ( ud->c_ext, TRUE );
+  g_string_free ( ud->c_trkpt_ext, TRUE );
+  ext_parser_free ( &ud->ext );
+  g_free ( ud->c_wp_name );
+  g_free ( ud->c_tr_name );
+  g_free ( ud );
+  g_free ( gr );
+
+  return ans;
+}
+
+gboolean a_gpx_read_file( VikTrwLayer *vtl, FILE *f, const gchar* dirpath, gboolean append ) {
+  int done=0, len;
 
-  xpath = g_string_new ( "" );
-  c_cdata = g_string_new ( "" );
-  c_ext = g_string_new ( NULL );
-  c_trkpt_ext = g_string_new ( NULL );
-  gs_ext = g_string_new ( NULL );
+  g_assert ( f != NULL && vtl != NULL );
 
-  unnamed_waypoints = 1;
-  unnamed_tracks = 1;
-  unnamed_routes = 1;
+  GpxReader *gr = gpx_reader_new ( vtl, dirpath, append );
 
+  // Read straight into expat's own buffer, in large blocks
   while (!done) {
-    len = fread(buf, 1, sizeof(buf)-7, f);
+    void *buf = XML_GetBuffer ( gr->parser, GPX_READ_BUFFER_SIZE );
+    if ( !buf ) {
+      gr->status = XML_STATUS_ERROR;
+      break;
+    }
+    len = fread(buf, 1, GPX_READ_BUFFER_SIZE, f);
     done = feof(f) || !len;
-    status = XML_Parse(parser, buf, len, done);
+    gr->status = XML_ParseBuffer(gr->parser, len, done);
+    if ( gr->status == XML_STATUS_ERROR )
+      break;
   }
 
-  gboolean ans = (status != XML_STATUS_ERROR);
-  if ( !ans ) {
-    g_warning ( "%s: XML error %s at line %ld", __FUNCTION__, XML_ErrorString(XML_GetErrorCode(parser)), XML_GetCurrentLineNumber(parser) );
+  return gpx_reader_free ( gr );
+}
+
+/**
+ * Read from the current position to the end of the file, without finishing the document
+ */
+static void gpx_resume_read ( GpxReader *gr, FILE *f )
+{
+#if XML_MAJOR_VERSION > 2 || (XML_MAJOR_VERSION == 2 && XML_MINOR_VERSION >= 6)
+  // Everything available is to be handled now, as more may not come for a long time
+  XML_SetReparseDeferralEnabled ( gr->parser, XML_FALSE );
+#endif
+  size_t len;
+  do {
+    void *buf = XML_GetBuffer ( gr->parser, GPX_READ_BUFFER_SIZE );
+    if ( !buf ) {
+      gr->status = XML_STATUS_ERROR;
+      break;
+    }
+    len = fread ( buf, 1, GPX_READ_BUFFER_SIZE, f );
+    gr->status = XML_ParseBuffer ( gr->parser, len, FALSE );
+  } while ( len && gr->status != XML_STATUS_ERROR );
+}
+
+/**
+ * Drop whatever was partly read after the last resume point, as it will be read again next time,
+ *  except for a track in progress which is added (or extended) up to that point.
+ * Then remember the file content before each point, so changes to it can be detected.
+ */
+static void gpx_resume_finish ( GpxReader *gr, FILE *f )
+{
+  UserDataT *ud = gr->ud;
+  GpxResume *res = ud->resume;
+  GpxResumePoint *last = NULL;
+  for ( guint ii = 0; ii < GPX_RESUME_LEVELS; ii++ )
+    if ( res->points[ii].valid && (!last || res->points[ii].offset > last->offset) )
+      last = &res->points[ii];
+
+  if ( ud->c_tr ) {
+    if ( gr->status != XML_STATUS_ERROR && last && last->trk && (last->trk == ud->c_tr || last->trk == ud->resume_trk) ) {
+      // e.g. the track is still being recorded
+      while ( ud->c_tr->trackpoints && ud->c_tr->trackpoints->data != last->last_tp ) {
+        vik_trackpoint_free ( VIK_TRACKPOINT(ud->c_tr->trackpoints->data) );
+        ud->c_tr->trackpoints = g_list_delete_link ( ud->c_tr->trackpoints, ud->c_tr->trackpoints );
+      }
+      gpx_track_end ( ud );
+    }
+    else {
+      vik_track_free ( ud->c_tr );
+      g_free ( ud->c_tr_name );
+      ud->c_tr = NULL;
+      ud->c_tr_name = NULL;
+    }
+    ud->c_tp = NULL;
   }
+  if ( ud->c_wp ) {
+    vik_waypoint_free ( ud->c_wp );
+    ud->c_wp = NULL;
+  }
+  res->items = ud->items;
 
-  XML_ParserFree (parser);
-  g_free ( ud );
-  g_string_free ( xpath, TRUE );
-  g_string_free ( c_cdata, TRUE );
-  g_string_free ( c_ext, TRUE );
-  g_string_free ( c_trkpt_ext, TRUE );
-  g_string_free ( gs_ext, TRUE );
-  g_markup_parse_context_free ( gcontext );
+  for ( guint ii = 0; ii < GPX_RESUME_LEVELS; ii++ ) {
+    GpxResumePoint *pt = &res->points[ii];
+    if ( !pt->valid )
+      continue;
+    goffset start = MAX ( 0, pt->offset - GPX_RESUME_CHECK_LEN );
+    if ( fseek ( f, (long)start, SEEK_SET ) == 0 )
+      pt->check_len = fread ( pt->check, 1, pt->offset - start, f );
+    else
+      pt->valid = FALSE;
+  }
+}
+
+/**
+ * a_gpx_read_file_resumable:
+ * @resume: Set to what is needed to carry on reading the file later on, or NULL on failure.
+ *          Free with a_gpx_resume_free()
+ *
+ * As a_gpx_read_file(), but allowing for the file being appended to,
+ *  e.g. by a logger whilst recording. Thus a file that has not yet been finished is not an error,
+ *  and any track that is still open is added as far as it goes.
+ *
+ * Once the file has grown, use a_gpx_read_file_resume() to read only the new part.
+ */
+gboolean a_gpx_read_file_resumable ( VikTrwLayer *vtl, FILE *f, const gchar* dirpath, GpxResume **resume )
+{
+  g_assert ( f != NULL && vtl != NULL );
+
+  GpxResume *res = g_new0 ( GpxResume, 1 );
+  res->vtl = vtl;
+  res->dirpath = g_strdup ( dirpath );
+
+  GpxReader *gr = gpx_reader_new ( vtl, res->dirpath, FALSE );
+  gr->ud->resume = res;
+  gr->ud->base_offset = ftell ( f );
+  XML_SetXmlDeclHandler ( gr->parser, (XML_XmlDeclHandler)gpx_xml_decl );
 
+  gpx_resume_read ( gr, f );
+  gpx_resume_finish ( gr, f );
+
+  gboolean ans = gpx_reader_free ( gr );
+  if ( ans )
+    *resume = res;
+  else {
+    a_gpx_resume_free ( res );
+    *resume = NULL;
+  }
   return ans;
 }
 
+/**
+ * a_gpx_read_file_resume:
+ * @resume: From a_gpx_read_file_resumable() (or a previous call of this)
+ *
+ * Carry on reading a file from where it was read up to before,
+ *  adding new trackpoints onto the end of the existing track they belong to
+ *  and any new tracks, routes or waypoints to the layer.
+ * Anything beyond that point from before (such as the closing tags of the document, which
+ *  loggers often rewrite) is replaced by the current content.
+ *
+ * Returns: FALSE if the file has otherwise been changed (or the layer's items it was read into),
+ *  in which case nothing has been read and it should be read again from the start.
+ *  Also FALSE if there is an error in the new part, after which @resume is no longer usable.
+ */
+gboolean a_gpx_read_file_resume ( GpxResume *resume, FILE *f )
+{
+  g_return_val_if_fail ( resume != NULL && f != NULL, FALSE );
+
+  // Carry on from the latest point where the file is the same as before
+  GpxResumePoint *from = NULL;
+  GpxResumePoint *pts[GPX_RESUME_LEVELS];
+  for ( guint ii = 0; ii < GPX_RESUME_LEVELS; ii++ )
+    pts[ii] = &resume->points[ii];
+  for ( guint ii = 0; ii < GPX_RESUME_LEVELS && !from; ii++ ) {
+    // The remaining one with the latest offset
+    for ( guint jj = ii+1; jj < GPX_RESUME_LEVELS; jj++ )
+      if ( pts[jj]->offset > pts[ii]->offset ) {
+        GpxResumePoint *tmp = pts[ii];
+        pts[ii] = pts[jj];
+        pts[jj] = tmp;
+      }
+    GpxResumePoint *pt = pts[ii];
+    // Only usable if no more items were added after it
+    if ( !pt->valid || pt->items != resume->items )
+      continue;
+    guchar check[GPX_RESUME_CHECK_LEN];
+    if ( fseek ( f, (long)(pt->offset - pt->check_len), SEEK_SET ) == 0 &&
+         fread ( check, 1, pt->check_len, f ) == pt->check_len &&
+         memcmp ( check, pt->check, pt->check_len ) == 0 )
+      from = pt;
+  }
+  if ( !from )
+    return FALSE;
+
+  if ( from->trk ) {
+    // The track may have been deleted or edited since
+    if ( !g_hash_table_find ( from->trk->is_route ? vik_trw_layer_get_routes(resume->vtl) : vik_trw_layer_get_tracks(resume->vtl),
+                              (GHRFunc)trw_layer_track_find_uuid, from->trk ) )
+      return FALSE;
+    GList *keep = NULL;
+    if ( from->last_tp ) {
+      for ( keep = g_list_last ( from->trk->trackpoints ); keep; keep = keep->prev )
+        if ( keep->data == from->last_tp )
+          break;
+      if ( !keep )
+        return FALSE;
+    }
+    // Trackpoints read from beyond the point are dropped, as they will be read again
+    GList *drop = keep ? keep->next : from->trk->trackpoints;
+    if ( drop ) {
+      if ( keep )
+        keep->next = NULL;
+      else
+        from->trk->trackpoints = NULL;
+      drop->prev = NULL;
+      g_list_free_full ( drop, (GDestroyNotify)vik_trackpoint_free );
+      vik_track_clear_caches ( from->trk );
+      vik_track_calculate_bounds ( from->trk );
+    }
+  }
+
+  // Recreate the context of the open elements, without acting on them again
+  GString *prefix = g_string_new ( NULL );
+  if ( resume->encoding )
+    g_string_append_printf ( prefix, "<?xml version=\"1.0\" encoding=\"%s\"?>", resume->encoding );
+  gchar **names = g_strsplit ( from->xpath->str, "/", -1 );
+  for ( gchar **name = names; *name; name++ )
+    if ( **name )
+      g_string_append_printf ( prefix, "<%s>", *name );
+  g_strfreev ( names );
+
+  GpxReader *gr = gpx_reader_new ( resume->vtl, resume->dirpath, TRUE );
+  UserDataT *ud = gr->ud;
+  XML_SetElementHandler ( gr->parser, NULL, NULL );
+  gr->status = XML_Parse ( gr->parser, prefix->str, prefix->len, FALSE );
+  XML_SetElementHandler ( gr->parser, (XML_StartElementHandler) gpx_start, (XML_EndElementHandler) gpx_end );
+  ud->base_offset = from->offset - prefix->len;
+  g_string_free ( prefix, TRUE );
+
+  g_string_assign ( ud->xpath, from->xpath->str );
+  g_array_set_size ( ud->tag_stack, 0 );
+  g_array_append_vals ( ud->tag_stack, from->tag_stack->data, from->tag_stack->len );
+  ud->current_tag = from->current_tag;
+  ud->f_tr_newseg = from->f_tr_newseg;
+  ud->unnamed_waypoints = from->unnamed_waypoints;
+  ud->unnamed_tracks = from->unnamed_tracks;
+  ud->unnamed_routes = from->unnamed_routes;
+  ud->items = resume->items;
+  if ( from->trk ) {
+    // New trackpoints are collected here and then added to the existing track
+    ud->c_tr = vik_track_new ();
+    ud->c_tr->is_route = from->trk->is_route;
+    ud->resume_trk = from->trk;
+  }
+  // Held until finished, as the point may be replaced meanwhile
+  VikTrack *held = from->trk;
+  if ( held )
+    vik_track_ref ( held );
+
+  // Points from beyond here are now out of date
+  for ( guint ii = 0; ii < GPX_RESUME_LEVELS; ii++ )
+    if ( resume->points[ii].offset > from->offset )
+      gpx_resume_point_clear ( &resume->points[ii] );
+  ud->resume = resume;
+
+  if ( gr->status != XML_STATUS_ERROR && fseek ( f, (long)from->offset, SEEK_SET ) == 0 )
+    gpx_resume_read ( gr, f );
+  else
+    gr->status = XML_STATUS_ERROR;
+  gpx_resume_finish ( gr, f );
+  if ( held )
+    vik_track_free ( held );
+
+  return gpx_reader_free ( gr );
+}
+
+void a_gpx_resume_free ( GpxResume *resume )
+{
+  if ( !resume )
+    return;
+  for ( guint ii = 0; ii < GPX_RESUME_LEVELS; ii++ )
+    gpx_resume_point_clear ( &resume->points[ii] );
+  g_free ( resume->dirpath );
+  g_free ( resume->encoding );
+  g_free ( resume );
+}
+
+/**
+ * a_gpx_read_begin:
+ *
+ * For reading GPX as it arrives in pieces, such as from a download,
+ *  rather than from a file.
+ * Pass each piece in turn to a_gpx_read_data() and then finish with a_gpx_read_end().
+ */
+GpxReader *a_gpx_read_begin ( VikTrwLayer *vtl, const gchar* dirpath, gboolean append )
+{
+  g_assert ( vtl != NULL );
+  return gpx_reader_new ( vtl, dirpath, append );
+}
+
+/**
+ * a_gpx_read_data:
+ *
+ * Returns: FALSE if the data is not valid GPX, after which any further data is ignored
+ */
+gboolean a_gpx_read_data ( GpxReader *gr, const gchar *data, gsize len )
+{
+  if ( gr->status == XML_STATUS_ERROR )
+    return FALSE;
+  gr->status = XML_Parse ( gr->parser, data, len, FALSE );
+  return gr->status != XML_STATUS_ERROR;
+}
+
+/**
+ * a_gpx_read_end:
+ *
+ * Returns: Whether all the data was read successfully
+ */
+gboolean a_gpx_read_end ( GpxReader *gr )
+{
+  if ( gr->status != XML_STATUS_ERROR )
+    gr->status = XML_Parse ( gr->parser, NULL, 0, TRUE );
+  return gpx_reader_free ( gr );
+}
+
 /**** entitize from GPSBabel ****/
 typedef struct {
         const char * text;
@@ -1409,6 +1919,154 @@ static const gchar * nearest_colour_string ( GdkColor color )
   return allowed_color_names[answer].color_name;
 }
 
+#define GPX_TIME_STR_SIZE 32
+#define GPX_WRITE_BUFFER_SIZE (64*1024)
+
+/**
+ * Format a timestamp the same as g_time_val_to_iso8601() does,
+ *  but without any allocation and only working out the date when the day changes
+ *
+ * Returns: @buf, or NULL if the time could not be represented
+ */
+static const gchar *gpx_format_time ( GpxWritingContext *context, gdouble timestamp, gchar buf[GPX_TIME_STR_SIZE] )
+{
+  gint64 secs = (gint64)timestamp;
+  glong usecs = abs((timestamp-(gint64)timestamp)*G_USEC_PER_SEC);
+
+  gint64 day = secs / 86400;
+  gint64 sod = secs % 86400;
+  if ( sod < 0 ) {
+    sod += 86400;
+    day--;
+  }
+
+  if ( day != context->date_day || !context->date_str[0] ) {
+    // Civil date from the day number, valid for the proleptic Gregorian calendar
+    gint64 zz = day + 719468;
+    gint64 era = (zz >= 0 ? zz : zz - 146096) / 146097;
+    guint doe = (guint)(zz - era * 146097);
+    guint yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+    guint doy = doe - (365*yoe + yoe/4 - yoe/100);
+    guint mp = (5*doy + 2) / 153;
+    guint mday = doy - (153*mp + 2)/5 + 1;
+    guint month = mp < 10 ? mp + 3 : mp - 9;
+    gint64 year = (gint64)yoe + era * 400 + (month <= 2);
+    if ( year < 0 || year > 9999 ) {
+      GTimeVal tv = { secs, usecs };
+      gchar *str = g_time_val_to_iso8601 ( &tv );
+      if ( !str )
+        return NULL;
+      g_strlcpy ( buf, str, GPX_TIME_STR_SIZE );
+      g_free ( str );
+      return buf;
+    }
+    g_snprintf ( context->date_str, sizeof(context->date_str), "%04d-%02d-%02dT", (gint)year, month, mday );
+    context->date_day = day;
+  }
+
+  guint hour = sod / 3600;
+  guint min = (sod / 60) % 60;
+  guint sec = sod % 60;
+  memcpy ( buf, context->date_str, 11 );
+  gchar *ptr = buf + 11;
+  *ptr++ = '0' + hour / 10;
+  *ptr++ = '0' + hour % 10;
+  *ptr++ = ':';
+  *ptr++ = '0' + min / 10;
+  *ptr++ = '0' + min % 10;
+  *ptr++ = ':';
+  *ptr++ = '0' + sec / 10;
+  *ptr++ = '0' + sec % 10;
+  if ( usecs ) {
+    *ptr++ = '.';
+    for ( gint ii = 5; ii >= 0; ii-- ) {
+      ptr[ii] = '0' + usecs % 10;
+      usecs /= 10;
+    }
+    ptr += 6;
+  }
+  *ptr++ = 'Z';
+  *ptr = '\0';
+  return buf;
+}
+
+/**
+ * Without a file (when formatting a track on its own) everything is kept in the buffer
+ */
+static void buffer_flush ( GpxWritingContext *context )
+{
+  if ( context->file && context->out->len ) {
+    fwrite ( context->out->str, 1, context->out->len, context->file );
+    g_string_truncate ( context->out, 0 );
+  }
+}
+
+static inline void buffer_open_tag ( GString *out, guint spaces, const gchar *tag )
+{
+  static const gchar indent[] = "                ";
+  g_string_append_len ( out, indent, MIN(spaces, sizeof(indent)-1) );
+  g_string_append_c ( out, '<' );
+  g_string_append ( out, tag );
+  g_string_append_c ( out, '>' );
+}
+
+static inline void buffer_close_tag ( GString *out, const gchar *tag )
+{
+  g_string_append ( out, "</" );
+  g_string_append ( out, tag );
+  g_string_append ( out, ">\n" );
+}
+
+static void buffer_double ( GString *out, guint spaces, const gchar *tag, gdouble value )
+{
+  if ( !isnan(value) ) {
+    gchar buf[COORDS_STR_BUFFER_SIZE];
+    a_coords_dtostr_buffer ( value, buf );
+    buffer_open_tag ( out, spaces, tag );
+    g_string_append ( out, buf );
+    buffer_close_tag ( out, tag );
+  }
+}
+
+// Value must positive to be written otherwise it is ignored
+static void buffer_positive_uint ( GString *out, guint spaces, const gchar *tag, guint value )
+{
+  if ( value ) {
+    buffer_open_tag ( out, spaces, tag );
+    g_string_append_printf ( out, "%d", value );
+    buffer_close_tag ( out, tag );
+  }
+}
+
+static void buffer_string ( GString *out, guint spaces, const gchar *tag, const gchar *value )
+{
+  if ( value && value[0] ) {
+    buffer_open_tag ( out, spaces, tag );
+    // Only plain ASCII without any XML special characters can be used directly
+    const gchar *ptr;
+    for ( ptr = value; *ptr; ptr++ )
+      if ( (*ptr & 0x80) || strchr ( "&'<>\"", *ptr ) )
+        break;
+    if ( *ptr ) {
+      gchar *tmp = entitize ( value );
+      g_string_append ( out, tmp );
+      g_free ( tmp );
+    }
+    else
+      g_string_append ( out, value );
+    buffer_close_tag ( out, tag );
+  }
+}
+
+static void buffer_string_as_is ( GString *out, guint spaces, const gchar *tag, const gchar *value )
+{
+  if ( value && value[0] ) {
+    buffer_open_tag ( out, spaces, tag );
+    g_string_append ( out, value );
+    buffer_close_tag ( out, tag );
+  }
+}
+
 static void write_double ( FILE *ff, guint spaces, const gchar *tag, gdouble value )
 {
   if ( !isnan(value) ) {
@@ -1468,14 +2126,10 @@ static void gpx_write_waypoint ( VikWaypoint *wp, GpxWritingContext *context )
   write_double ( f, WPT_SPACES, "ele", wp->altitude );
 
   if ( !isnan(wp->timestamp) ) {
-    GTimeVal timestamp;
-    timestamp.tv_sec = wp->timestamp;
-    timestamp.tv_usec = abs((wp->timestamp-(gint64)wp->timestamp)*G_USEC_PER_SEC);
-
-    gchar *time_iso8601 = g_time_val_to_iso8601 ( &timestamp );
+    gchar time_buf[GPX_TIME_STR_SIZE];
+    const gchar *time_iso8601 = gpx_format_time ( context, wp->timestamp, time_buf );
     if ( time_iso8601 != NULL )
       fprintf ( f, "  <time>%s</time>\n", time_iso8601 );
-    g_free ( time_iso8601 );
   }
 
   if ( !context->options || (context->options && context->options->version == GPX_V1_0) ) {
@@ -1565,101 +2219,100 @@ static void gpx_write_waypoint ( VikWaypoint *wp, GpxWritingContext *context )
  */
 static void gpx_write_trackpoint ( VikTrackpoint *tp, GpxWritingContext *context )
 {
-  FILE *f = context->file;
+  GString *out = context->out;
   struct LatLon ll;
   gchar s_lat[COORDS_STR_BUFFER_SIZE];
   gchar s_lon[COORDS_STR_BUFFER_SIZE];
-  gchar s_alt[COORDS_STR_BUFFER_SIZE];
-  gchar *time_iso8601;
   vik_coord_to_latlon ( &(tp->coord), &ll );
+  const gchar *pt = (context->options && context->options->is_route) ? "rtept" : "trkpt";
 
   // No such thing as a rteseg! So make sure we don't put them in
   if ( context->options && !context->options->is_route && tp->newsegment )
-    fprintf ( f, "  </trkseg>\n  <trkseg>\n" );
+    g_string_append ( out, "  </trkseg>\n  <trkseg>\n" );
 
   a_coords_dtostr_buffer ( ll.lat, s_lat );
   a_coords_dtostr_buffer ( ll.lon, s_lon );
-  fprintf ( f, "  <%spt lat=\"%s\" lon=\"%s\">\n", (context->options && context->options->is_route) ? "rte" : "trk", s_lat, s_lon );
+  g_string_append ( out, "  <" );
+  g_string_append ( out, pt );
+  g_string_append ( out, " lat=\"" );
+  g_string_append ( out, s_lat );
+  g_string_append ( out, "\" lon=\"" );
+  g_string_append ( out, s_lon );
+  g_string_append ( out, "\">\n" );
 
   if ( !isnan(tp->altitude) )
-  {
-    a_coords_dtostr_buffer ( tp->altitude, s_alt );
-    fprintf ( f, "    <ele>%s</ele>\n", s_alt );
-  }
+    buffer_double ( out, TRKPT_SPACES, "ele", tp->altitude );
   else if ( context->options != NULL && context->options->force_ele )
-  {
-    fprintf ( f, "    <ele>0</ele>\n" );
-  }
-  
-  time_iso8601 = NULL;
-  if ( !isnan(tp->timestamp) ) {
-    GTimeVal timestamp;
-    timestamp.tv_sec = tp->timestamp;
-    timestamp.tv_usec = abs((tp->timestamp-(gint64)tp->timestamp)*G_USEC_PER_SEC);
-  
-    time_iso8601 = g_time_val_to_iso8601 ( &timestamp );
-  }
-  else if ( context->options != NULL && context->options->force_time )
-  {
+    g_string_append ( out, "    <ele>0</ele>\n" );
+
+  gchar time_buf[GPX_TIME_STR_SIZE];
+  const gchar *time_iso8601 = NULL;
+  if ( !isnan(tp->timestamp) )
+    time_iso8601 = gpx_format_time ( context, tp->timestamp, time_buf );
+  else if ( context->options != NULL && context->options->force_time ) {
     GTimeVal current;
     g_get_current_time ( &current );
-  
-    time_iso8601 = g_time_val_to_iso8601 ( &current );
+    time_iso8601 = gpx_format_time ( context, current.tv_sec + (gdouble)current.tv_usec/G_USEC_PER_SEC, time_buf );
   }
-  if ( time_iso8601 != NULL )
-    fprintf ( f, "    <time>%s</time>\n", time_iso8601 );
-  g_free(time_iso8601);
-  time_iso8601 = NULL;
+  buffer_string_as_is ( out, TRKPT_SPACES, "time", time_iso8601 );
 
   if ( !context->options || (context->options && context->options->version == GPX_V1_0) ) {
-    write_double ( f, TRKPT_SPACES, "course", tp->course );
-    write_double ( f, TRKPT_SPACES, "speed", tp->speed );
+    buffer_double ( out, TRKPT_SPACES, "course", tp->course );
+    buffer_double ( out, TRKPT_SPACES, "speed", tp->speed );
   }
-  write_string ( f, TRKPT_SPACES, "name", tp->name );
+  buffer_string ( out, TRKPT_SPACES, "name", tp->name );
 
   if (tp->fix_mode == VIK_GPS_MODE_2D)
-    fprintf ( f, "    <fix>2d</fix>\n");
+    g_string_append ( out, "    <fix>2d</fix>\n");
   if (tp->fix_mode == VIK_GPS_MODE_3D)
-    fprintf ( f, "    <fix>3d</fix>\n");
+    g_string_append ( out, "    <fix>3d</fix>\n");
   if (tp->fix_mode == VIK_GPS_MODE_DGPS)
-    fprintf ( f, "    <fix>dgps</fix>\n");
+    g_string_append ( out, "    <fix>dgps</fix>\n");
   if (tp->fix_mode == VIK_GPS_MODE_PPS)
-    fprintf ( f, "    <fix>pps</fix>\n");
+    g_string_append ( out, "    <fix>pps</fix>\n");
 
-  write_positive_uint ( f, TRKPT_SPACES, "sat", tp->nsats );
-  write_double ( f, TRKPT_SPACES, "hdop", tp->hdop );
-  write_double ( f, TRKPT_SPACES, "vdop", tp->vdop );
-  write_double ( f, TRKPT_SPACES, "pdop", tp->pdop );
+  buffer_positive_uint ( out, TRKPT_SPACES, "sat", tp->nsats );
+  buffer_double ( out, TRKPT_SPACES, "hdop", tp->hdop );
+  buffer_double ( out, TRKPT_SPACES, "vdop", tp->vdop );
+  buffer_double ( out, TRKPT_SPACES, "pdop", tp->pdop );
 
   // If have the raw extensions - then save that (which should include all of the individual values we use)
   if ( tp->extensions )
-    write_string_as_is ( f, TRKPT_SPACES, "extensions", tp->extensions );
+    buffer_string_as_is ( out, TRKPT_SPACES, "extensions", tp->extensions );
   else {
     // Otherwise write the individual values we are supporting (in Garmin TrackPointExtension/v2 format)
     if ( context->options && context->options->version == GPX_V1_1 ) {
       if ( !isnan(tp->speed) || !isnan(tp->course) ||
            !isnan(tp->temp) || tp->heart_rate || tp->cadence != VIK_TRKPT_CADENCE_NONE ) {
-        fprintf ( f, "    <extensions>\n");
-        fprintf ( f, "      <gpxtpx:TrackPointExtension>\n");
-        write_double ( f, TRKPT_EXT_SPACES, "gpxtpx:atemp", tp->temp );
-        write_positive_uint ( f, TRKPT_EXT_SPACES, "gpxtpx:hr", tp->heart_rate );
-        if ( tp->cadence != VIK_TRKPT_CADENCE_NONE )
-          fprintf ( f, "%*s<%s>%d</%s>\n", TRKPT_EXT_SPACES, "", "gpxtpx:cad", tp->cadence, "gpxtpx:cad" );
-        write_double ( f, TRKPT_EXT_SPACES, "gpxtpx:speed", tp->speed );
-        write_double ( f, TRKPT_EXT_SPACES, "gpxtpx:course", tp->course );
-        fprintf ( f, "      </gpxtpx:TrackPointExtension>\n");
-        fprintf ( f, "    </extensions>\n");
+        g_string_append ( out, "    <extensions>\n");
+        g_string_append ( out, "      <gpxtpx:TrackPointExtension>\n");
+        buffer_double ( out, TRKPT_EXT_SPACES, "gpxtpx:atemp", tp->temp );
+        buffer_positive_uint ( out, TRKPT_EXT_SPACES, "gpxtpx:hr", tp->heart_rate );
+        if ( tp->cadence != VIK_TRKPT_CADENCE_NONE ) {
+          buffer_open_tag ( out, TRKPT_EXT_SPACES, "gpxtpx:cad" );
+          g_string_append_printf ( out, "%d", tp->cadence );
+          buffer_close_tag ( out, "gpxtpx:cad" );
+        }
+        buffer_double ( out, TRKPT_EXT_SPACES, "gpxtpx:speed", tp->speed );
+        buffer_double ( out, TRKPT_EXT_SPACES, "gpxtpx:course", tp->course );
+        g_string_append ( out, "      </gpxtpx:TrackPointExtension>\n");
+        g_string_append ( out, "    </extensions>\n");
       }
     }
   }
-  fprintf ( f, "  </%spt>\n", (context->options && context->options->is_route) ? "rte" : "trk" );
+  g_string_append ( out, "  </" );
+  g_string_append ( out, pt );
+  g_string_append ( out, ">\n" );
+
+  if ( out->len >= GPX_WRITE_BUFFER_SIZE )
+    buffer_flush ( context );
 }
 
 #define TRK_SPACES 2
 
-static void write_track_extension_color_only ( FILE *ff, VikTrack *trk )
+static void buffer_track_extension_color_only ( GString *out, VikTrack *trk )
 {
-  fprintf ( ff, "  <extensions><gpxx:TrackExtension><gpxx:DisplayColor>%s</gpxx:DisplayColor></gpxx:TrackExtension></extensions>\n", nearest_colour_string(trk->color) );
+  g_string_append_printf ( out, "  <extensions><gpxx:TrackExtension><gpxx:DisplayColor>%s</gpxx:DisplayColor></gpxx:TrackExtension></extensions>\n", nearest_colour_string(trk->color) );
 }
 
 static void gpx_write_track ( VikTrack *t, GpxWritingContext *context )
@@ -1668,7 +2321,11 @@ static void gpx_write_track ( VikTrack *t, GpxWritingContext *context )
   if (context->options && !context->options->hidden && !t->visible)
     return;
 
-  FILE *f = context->file;
+  // Use the caller's buffer when given one
+  gboolean own_out = !context->out;
+  if ( own_out )
+    context->out = g_string_sized_new ( GPX_WRITE_BUFFER_SIZE + 4096 );
+  GString *out = context->out;
   gchar *tmp;
   gboolean first_tp_is_newsegment = FALSE; /* must temporarily make it not so, but we want to restore state. not that it matters. */
 
@@ -1680,17 +2337,17 @@ static void gpx_write_track ( VikTrack *t, GpxWritingContext *context )
 
   // NB 'hidden' is not part of any GPX standard - this appears to be a made up Viking 'extension'
   //  luckily most other GPX processing software ignores things they don't understand
-  fprintf ( f, "<%s%s>\n  <name>%s</name>\n",
-	    t->is_route ? "rte" : "trk",
-	    t->visible ? "" : " hidden=\"hidden\"",
-	    tmp );
+  g_string_append_printf ( out, "<%s%s>\n  <name>%s</name>\n",
+                           t->is_route ? "rte" : "trk",
+                           t->visible ? "" : " hidden=\"hidden\"",
+                           tmp );
   g_free ( tmp );
 
-  write_string ( f, TRK_SPACES, "cmt", t->comment );
-  write_string ( f, TRK_SPACES, "desc", t->description );
-  write_string ( f, TRK_SPACES, "src", t->source );
-  write_positive_uint ( f, TRK_SPACES, "number", t->number );
-  write_string ( f, TRK_SPACES, "type", t->type );
+  buffer_string ( out, TRK_SPACES, "cmt", t->comment );
+  buffer_string ( out, TRK_SPACES, "desc", t->description );
+  buffer_string ( out, TRK_SPACES, "src", t->source );
+  buffer_positive_uint ( out, TRK_SPACES, "number", t->number );
+  buffer_string ( out, TRK_SPACES, "type", t->type );
 
   // ATM Track Colour is the only extension Viking supports editing
   //  thus if there is some other track extension Viking will not add in the color,
@@ -1709,7 +2366,7 @@ static void gpx_write_track ( VikTrack *t, GpxWritingContext *context )
         g_strstrip ( text );
         if ( g_str_has_prefix(text, "<gpxx:TrackExtension><gpxx:DisplayColor>") ) {
           if ( g_str_has_suffix(text, "</gpxx:DisplayColor></gpxx:TrackExtension>") )
-            write_track_extension_color_only ( f, t );
+            buffer_track_extension_color_only ( out, t );
           else
             write_as_is = TRUE;
         }
@@ -1718,30 +2375,97 @@ static void gpx_write_track ( VikTrack *t, GpxWritingContext *context )
         g_free ( text );
       }
       if ( write_as_is )
-        write_string_as_is ( f, TRK_SPACES, "extensions", t->extensions );
+        buffer_string_as_is ( out, TRK_SPACES, "extensions", t->extensions );
     }
     else {
       if ( context->options && context->options->version == GPX_V1_1 )
         if ( t->has_color )
-          write_track_extension_color_only ( f, t );
+          buffer_track_extension_color_only ( out, t );
     }
   }
 
   /* No such thing as a rteseg! */
   if ( !t->is_route )
-    fprintf ( f, "  <trkseg>\n" );
+    g_string_append ( out, "  <trkseg>\n" );
 
   if ( t->trackpoints && t->trackpoints->data ) {
     first_tp_is_newsegment = VIK_TRACKPOINT(t->trackpoints->data)->newsegment;
     VIK_TRACKPOINT(t->trackpoints->data)->newsegment = FALSE; /* so we won't write </trkseg><trkseg> already */
-    g_list_foreach ( t->trackpoints, (GFunc) gpx_write_trackpoint, context );
+    for ( GList *iter = t->trackpoints; iter; iter = iter->next )
+      gpx_write_trackpoint ( VIK_TRACKPOINT(iter->data), context );
     VIK_TRACKPOINT(t->trackpoints->data)->newsegment = first_tp_is_newsegment; /* restore state */
   }
 
   /* NB apparently no such thing as a rteseg! */
   if (!t->is_route)
-    fprintf ( f, "  </trkseg>\n");
-  fprintf ( f, "</%s>\n", t->is_route ? "rte" : "trk" );
+    g_string_append ( out, "  </trkseg>\n");
+  g_string_append_printf ( out, "</%s>\n", t->is_route ? "rte" : "trk" );
+
+  if ( own_out ) {
+    buffer_flush ( context );
+    g_string_free ( context->out, TRUE );
+    context->out = NULL;
+  }
+}
+
+typedef struct {
+  VikTrack *trk;
+  GpxWritingContext context;
+} GpxTrackJob;
+
+static void gpx_write_track_job ( GpxTrackJob *job, gpointer user_data )
+{
+  gpx_write_track ( job->trk, &job->context );
+}
+
+// Fewer trackpoints in total than this are quicker to write directly
+#define GPX_PARALLEL_MIN_POINTS 50000
+// The formatted text of each batch of tracks is held until all of them are done,
+//  so this limits the memory used (very roughly 200 bytes per trackpoint)
+#define GPX_PARALLEL_BATCH_POINTS 1000000
+
+/**
+ * Write the tracks in the order of the list
+ * When there are many trackpoints, batches of the tracks are each formatted into their own buffer in parallel
+ */
+static void gpx_write_tracks ( GList *tracks, GpxWritingContext *context )
+{
+  gulong total = 0;
+  for ( GList *iter = tracks; iter; iter = iter->next )
+    total += vik_track_get_tp_count ( VIK_TRACK(iter->data) );
+
+  if ( total < GPX_PARALLEL_MIN_POINTS || !tracks->next ) {
+    for ( GList *iter = tracks; iter; iter = iter->next )
+      gpx_write_track ( VIK_TRACK(iter->data), context );
+    return;
+  }
+
+  GList *iter = tracks;
+  while ( iter ) {
+    GPtrArray *jobs = g_ptr_array_new ();
+    VikTaskGroup *group = a_background_tasks_new ();
+    gulong points = 0;
+    for ( ; iter && points < GPX_PARALLEL_BATCH_POINTS; iter = iter->next ) {
+      GpxTrackJob *job = g_new ( GpxTrackJob, 1 );
+      job->trk = VIK_TRACK(iter->data);
+      job->context = *context;
+      job->context.file = NULL;
+      job->context.out = g_string_new ( NULL );
+      job->context.date_str[0] = '\0';
+      points += vik_track_get_tp_count ( job->trk );
+      g_ptr_array_add ( jobs, job );
+      a_background_tasks_add ( group, (GFunc)gpx_write_track_job, job, NULL );
+    }
+    a_background_tasks_free ( group );
+
+    for ( guint ii = 0; ii < jobs->len; ii++ ) {
+      GpxTrackJob *job = g_ptr_array_index ( jobs, ii );
+      fwrite ( job->context.out->str, 1, job->context.out->len, context->file );
+      g_string_free ( job->context.out, TRUE );
+      g_free ( job );
+    }
+    g_ptr_array_free ( jobs, TRUE );
+  }
 }
 
 static void gpx_write_header( FILE *f, VikTrwLayer *vtl, GpxWritingContext *context )
@@ -1881,16 +2605,14 @@ void a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options, c
     context_tmp.options = &opt_tmp;
   context_tmp.options->is_route = FALSE;
 
-  // Loop around each list and write each one
-  for (GList *iter = g_list_first (gl); iter != NULL; iter = g_list_next (iter)) {
-    gpx_write_track ( (VikTrack*)iter->data, &context_tmp );
-  }
+  // Write each list in turn
+  if ( gl )
+    gpx_write_tracks ( gl, &context_tmp );
 
   // Routes (to get routepoints)
   context_tmp.options->is_route = TRUE;
-  for (GList *iter = g_list_first (glrte); iter != NULL; iter = g_list_next (iter)) {
-    gpx_write_track ( (VikTrack*)iter->data, &context_tmp );
-  }
+  if ( glrte )
+    gpx_write_tracks ( glrte, &context_tmp );
 
   g_list_free ( gl );
   g_list_free ( glrte );
@@ -1968,76 +2690,65 @@ gchar* a_gpx_write_track_tmp_file ( VikTrack *trk, GpxWritingOptions *options )
 	return write_tmp_file ( NULL, trk, options );
 }
 
-static int waypoint_compare_vtwl(const void *x, const void *y)
-{
-  VikWaypoint *a = (VikWaypoint *)((vik_trw_waypoint_list_t*)x)->wpt;
-  VikWaypoint *b = (VikWaypoint *)((vik_trw_waypoint_list_t*)y)->wpt;
-  return strcmp(a->name,b->name);
-}
-
-static int track_compare_name_vtt(const void *x, const void *y)
-{
-  VikTrack *a = (VikTrack *)((vik_trw_and_track_t*)x)->trk;
-  VikTrack *b = (VikTrack *)((vik_trw_and_track_t*)y)->trk;
-  return strcmp(a->name,b->name);
-}
-
-static int track_compare_timestamp_vtt(const void *x, const void *y)
-{
-  VikTrack *a = (VikTrack *)((vik_trw_and_track_t*)x)->trk;
-  VikTrack *b = (VikTrack *)((vik_trw_and_track_t*)y)->trk;
-  return vik_track_compare_timestamp (a, b);
-}
+struct _GpxCombinedWriter {
+  GpxWritingOptions options;
+  GpxWritingContext context;
+};
 
 /*
- * a_gpx_write_combined_file:
+ * a_gpx_write_combined_begin:
  * @name:    The name to use
- * @vtt:     A #GList of #vik_trw_waypoint_list_t for the tracks & routes to save
- * @vtwl:    A #GList of #vik_trw_and_track_t for the waypoints to save
  * @ff:      The opened #FILE to be written
  * @options: Possible ways of writing the file data
  * @dirpath: Can be NULL
  *
- * Save multiple tracks, routes and waypoints from various VikTrwLayers into a single GPX File.
+ * Start saving multiple tracks, routes and waypoints from various VikTrwLayers into a single GPX File.
+ * Items are written straight away as they are passed in, so the caller controls the ordering.
+ * GPX requires all waypoints to be given first, then tracks and then routes.
  *
+ * This does not touch any GTK state so may be used from a background thread,
+ *  as long as the items are not modified whilst being written.
+ *
+ * Returns: The writer to pass to the other a_gpx_write_combined_*() functions
  */
-void a_gpx_write_combined_file ( const gchar *name, GList *vtt, GList *vtwl, FILE *ff, GpxWritingOptions *options, const gchar *dirpath )
+GpxCombinedWriter *a_gpx_write_combined_begin ( const gchar *name, FILE *ff, GpxWritingOptions *options, const gchar *dirpath )
 {
-  g_return_if_fail ( ff != NULL );
-  g_return_if_fail ( options != NULL );
+  g_return_val_if_fail ( ff != NULL, NULL );
+  g_return_val_if_fail ( options != NULL, NULL );
+
+  GpxCombinedWriter *gcw = g_new0 ( GpxCombinedWriter, 1 );
+  gcw->options = *options;
+  gcw->options.is_route = FALSE;
+  gcw->context.options = &gcw->options;
+  gcw->context.file = ff;
+  gcw->context.dirpath = dirpath;
 
-  GpxWritingContext context = { options, ff, dirpath, NULL };
-  gpx_write_header ( ff, NULL, &context );
+  gpx_write_header ( ff, NULL, &gcw->context );
 
   write_string ( ff, TRK_SPACES, "name", name );
   // NB No overall metadata readily available, so don't bother
 
-  GList *gl = NULL;
-  gl = g_list_sort ( vtwl, waypoint_compare_vtwl );
-  for ( GList *iter = gl; iter != NULL; iter = g_list_next(iter) )
-    gpx_write_waypoint ( ((vik_trw_waypoint_list_t*)iter->data)->wpt, &context );
-
-  // Sort method determined by preference
-  if ( a_vik_get_gpx_export_trk_sort() == VIK_GPX_EXPORT_TRK_SORT_TIME )
-    gl = g_list_sort ( vtt, track_compare_timestamp_vtt );
-  else if ( a_vik_get_gpx_export_trk_sort() == VIK_GPX_EXPORT_TRK_SORT_ALPHA )
-    gl = g_list_sort ( vtt, track_compare_name_vtt );
-
-  // Tracks First
-  for ( GList *iter = gl; iter != NULL; iter = g_list_next(iter) ) {
-    VikTrack *trk = ((vik_trw_and_track_t*)iter->data)->trk;
-    if ( !trk->is_route )
-      gpx_write_track ( trk, &context );
-  }
+  return gcw;
+}
 
-  context.options->is_route = TRUE;
+void a_gpx_write_combined_waypoint ( GpxCombinedWriter *gcw, VikWaypoint *wp )
+{
+  gpx_write_waypoint ( wp, &gcw->context );
+}
 
-  // Finally Routes
-  for ( GList *iter = gl; iter != NULL; iter = g_list_next(iter) ) {
-    VikTrack *trk = ((vik_trw_and_track_t*)iter->data)->trk;
-    if ( trk->is_route )
-      gpx_write_track ( trk, &context );
-  }
+void a_gpx_write_combined_track ( GpxCombinedWriter *gcw, VikTrack *trk )
+{
+  gcw->options.is_route = trk->is_route;
+  gpx_write_track ( trk, &gcw->context );
+}
 
-  gpx_write_footer ( ff );
+/*
+ * a_gpx_write_combined_end:
+ *
+ * Finish the file and free the writer. The #FILE is left open.
+ */
+void a_gpx_write_combined_end ( GpxCombinedWriter *gcw )
+{
+  gpx_write_footer ( gcw->context.file );
+  g_free ( gcw );
 }
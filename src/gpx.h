@@ -39,13 +39,28 @@ typedef struct {
 } GpxWritingOptions;
 
 gboolean a_gpx_read_file ( VikTrwLayer *trw, FILE *f, const gchar* dirpath, gboolean append );
+
+typedef struct _GpxResume GpxResume;
+gboolean a_gpx_read_file_resumable ( VikTrwLayer *trw, FILE *f, const gchar* dirpath, GpxResume **resume );
+gboolean a_gpx_read_file_resume ( GpxResume *resume, FILE *f );
+void a_gpx_resume_free ( GpxResume *resume );
+
+typedef struct _GpxReader GpxReader;
+GpxReader *a_gpx_read_begin ( VikTrwLayer *trw, const gchar* dirpath, gboolean append );
+gboolean a_gpx_read_data ( GpxReader *gr, const gchar *data, gsize len );
+gboolean a_gpx_read_end ( GpxReader *gr );
+void a_gpx_decode_trackpoint_extensions ( GList *tpl );
 void a_gpx_write_file ( VikTrwLayer *trw, FILE *f, GpxWritingOptions *options, const gchar *dirpath );
 void a_gpx_write_track_file ( VikTrack *trk, FILE *f, GpxWritingOptions *options );
 
 gchar* a_gpx_write_tmp_file ( VikTrwLayer *vtl, GpxWritingOptions *options );
 gchar* a_gpx_write_track_tmp_file ( VikTrack *trk, GpxWritingOptions *options );
 
-void a_gpx_write_combined_file ( const gchar *name, GList *vtt, GList *vtwl, FILE *ff, GpxWritingOptions *options, const gchar *dirpath );
+typedef struct _GpxCombinedWriter GpxCombinedWriter;
+GpxCombinedWriter *a_gpx_write_combined_begin ( const gchar *name, FILE *ff, GpxWritingOptions *options, const gchar *dirpath );
+void a_gpx_write_combined_waypoint ( GpxCombinedWriter *gcw, VikWaypoint *wp );
+void a_gpx_write_combined_track ( GpxCombinedWriter *gcw, VikTrack *trk );
+void a_gpx_write_combined_end ( GpxCombinedWriter *gcw );
 
 G_END_DECLS
 
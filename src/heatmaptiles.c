@@ -0,0 +1,730 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "heatmaptiles.h"
+#include "globals.h"
+#include "util.h"
+
+/**
+ * Track positions are held as 32 bit fixed point world (spherical mercator) coordinates,
+ *  i.e. the whole world is 2^32 units across, which is much less than a pixel even at the highest zoom level.
+ *
+ * Line segments are indexed by fixed size buckets (like OSM tiles at BUCKET_LEVEL),
+ *  so a tile only needs to look at the segments near it.
+ */
+#define TILE_SIZE 256
+#define TILE_SHIFT 8 // log2(TILE_SIZE)
+#define BUCKET_LEVEL 12
+#define BUCKET_SHIFT (32 - BUCKET_LEVEL)
+// Segments covering more buckets than this are kept separately, rather than being put in lots of buckets
+#define MAX_BUCKETS_PER_SEGMENT 16
+// Points closer than this to the previous one are skipped (about a pixel at zoom level 16)
+#define MIN_POINT_SPACING 256
+
+typedef struct {
+  guint32 x, y;
+} HmtPoint;
+
+struct _HeatmapTiles {
+  gint ref_count;
+  GArray *points;        // HmtPoint of each run (i.e. track segment) one after another
+  GArray *run_starts;    // guint32 index of the first point of each run, plus a final end when finished
+  GArray *run_tracks;    // guint32 track number of each run
+  guint n_tracks;
+  GHashTable *buckets;   // GArray of guint32 segment start points, keyed by the bucket position
+  GArray *long_segments; // guint32 segment start points
+  gboolean in_run;
+  gboolean all_points;   // Including trackpoints without timestamps
+};
+
+// A rectangle of world coordinates, inclusive
+typedef struct {
+  gint64 x0, y0, x1, y1;
+} HmtRect;
+
+HeatmapTiles *a_heatmap_tiles_new ( void )
+{
+  HeatmapTiles *hmt = g_malloc0 ( sizeof(HeatmapTiles) );
+  hmt->ref_count = 1;
+  hmt->points = g_array_new ( FALSE, FALSE, sizeof(HmtPoint) );
+  hmt->run_starts = g_array_new ( FALSE, FALSE, sizeof(guint32) );
+  hmt->run_tracks = g_array_new ( FALSE, FALSE, sizeof(guint32) );
+  hmt->buckets = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_array_unref );
+  hmt->long_segments = g_array_new ( FALSE, FALSE, sizeof(guint32) );
+  return hmt;
+}
+
+HeatmapTiles *a_heatmap_tiles_ref ( HeatmapTiles *hmt )
+{
+  g_atomic_int_inc ( &hmt->ref_count );
+  return hmt;
+}
+
+void a_heatmap_tiles_unref ( HeatmapTiles *hmt )
+{
+  if ( !hmt )
+    return;
+  if ( !g_atomic_int_dec_and_test ( &hmt->ref_count ) )
+    return;
+  g_array_free ( hmt->points, TRUE );
+  g_array_free ( hmt->run_starts, TRUE );
+  g_array_free ( hmt->run_tracks, TRUE );
+  g_hash_table_destroy ( hmt->buckets );
+  g_array_free ( hmt->long_segments, TRUE );
+  g_free ( hmt );
+}
+
+/**
+ * Use every trackpoint, rather than only those with timestamps
+ *  e.g. for showing the lines of routes as well as tracks.
+ * Must be set before any tracks are added.
+ */
+void a_heatmap_tiles_set_all_points ( HeatmapTiles *hmt, gboolean all_points )
+{
+  hmt->all_points = all_points;
+}
+
+static void world_position ( const VikCoord *coord, HmtPoint *pt )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( coord, &ll );
+  // Limits of the spherical mercator projection
+  gdouble lat = CLAMP ( ll.lat, -85.0511, 85.0511 );
+  gdouble xx = (ll.lon + 180.0) / 360.0 * 4294967296.0;
+  gdouble yy = (180.0 - MERCLAT(lat)) / 360.0 * 4294967296.0;
+  pt->x = (guint32)CLAMP ( xx, 0.0, 4294967295.0 );
+  pt->y = (guint32)CLAMP ( yy, 0.0, 4294967295.0 );
+}
+
+static void run_end ( HeatmapTiles *hmt )
+{
+  if ( !hmt->in_run )
+    return;
+  hmt->in_run = FALSE;
+  // A lone point still marks its position, as a line of no length
+  guint32 start = g_array_index ( hmt->run_starts, guint32, hmt->run_starts->len-1 );
+  if ( hmt->points->len - start == 1 ) {
+    HmtPoint pt = g_array_index ( hmt->points, HmtPoint, start );
+    g_array_append_val ( hmt->points, pt );
+  }
+}
+
+/**
+ * Add the lines between the trackpoints of the track
+ *  Only trackpoints with timestamps are used (unless all points are wanted),
+ *  and lines are not drawn across gaps between track segments.
+ */
+void a_heatmap_tiles_add_track ( HeatmapTiles *hmt, const VikTrackSnapshot *snap )
+{
+  guint32 track = hmt->n_tracks++;
+  HmtPoint last = { 0, 0 };
+  for ( guint ii = 0; ii < snap->n_points; ii++ ) {
+    const VikTrackSnapshotPoint *tp = &snap->points[ii];
+    if ( tp->newsegment )
+      run_end ( hmt );
+    if ( isnan(tp->timestamp) && !hmt->all_points )
+      continue;
+    HmtPoint pt;
+    world_position ( &tp->coord, &pt );
+    if ( hmt->in_run ) {
+      if ( ABS((gint64)pt.x - (gint64)last.x) < MIN_POINT_SPACING &&
+           ABS((gint64)pt.y - (gint64)last.y) < MIN_POINT_SPACING )
+        continue;
+    }
+    else {
+      guint32 start = hmt->points->len;
+      g_array_append_val ( hmt->run_starts, start );
+      g_array_append_val ( hmt->run_tracks, track );
+      hmt->in_run = TRUE;
+    }
+    g_array_append_val ( hmt->points, pt );
+    last = pt;
+  }
+  run_end ( hmt );
+}
+
+static inline gpointer bucket_key ( guint32 bx, guint32 by )
+{
+  return GUINT_TO_POINTER ( (by << BUCKET_LEVEL) | bx );
+}
+
+static void segment_rect ( HeatmapTiles *hmt, guint32 seg, HmtRect *rect )
+{
+  HmtPoint *p0 = &g_array_index ( hmt->points, HmtPoint, seg );
+  HmtPoint *p1 = &g_array_index ( hmt->points, HmtPoint, seg+1 );
+  rect->x0 = MIN ( p0->x, p1->x );
+  rect->x1 = MAX ( p0->x, p1->x );
+  rect->y0 = MIN ( p0->y, p1->y );
+  rect->y1 = MAX ( p0->y, p1->y );
+}
+
+static inline gboolean rect_intersect ( const HmtRect *r1, const HmtRect *r2 )
+{
+  return r1->x0 <= r2->x1 && r2->x0 <= r1->x1 && r1->y0 <= r2->y1 && r2->y0 <= r1->y1;
+}
+
+/**
+ * Build the index, after which no more tracks may be added
+ */
+void a_heatmap_tiles_finish ( HeatmapTiles *hmt )
+{
+  guint32 end = hmt->points->len;
+  g_array_append_val ( hmt->run_starts, end );
+
+  for ( guint rr = 0; rr + 1 < hmt->run_starts->len; rr++ ) {
+    guint32 first = g_array_index ( hmt->run_starts, guint32, rr );
+    guint32 last = g_array_index ( hmt->run_starts, guint32, rr+1 ) - 1;
+    for ( guint32 seg = first; seg < last; seg++ ) {
+      HmtRect rect;
+      segment_rect ( hmt, seg, &rect );
+      guint32 bx0 = rect.x0 >> BUCKET_SHIFT, bx1 = rect.x1 >> BUCKET_SHIFT;
+      guint32 by0 = rect.y0 >> BUCKET_SHIFT, by1 = rect.y1 >> BUCKET_SHIFT;
+      if ( (bx1-bx0+1) * (by1-by0+1) > MAX_BUCKETS_PER_SEGMENT ) {
+        g_array_append_val ( hmt->long_segments, seg );
+        continue;
+      }
+      for ( guint32 by = by0; by <= by1; by++ ) {
+        for ( guint32 bx = bx0; bx <= bx1; bx++ ) {
+          GArray *bucket = g_hash_table_lookup ( hmt->buckets, bucket_key(bx, by) );
+          if ( !bucket ) {
+            bucket = g_array_new ( FALSE, FALSE, sizeof(guint32) );
+            g_hash_table_insert ( hmt->buckets, bucket_key(bx, by), bucket );
+          }
+          g_array_append_val ( bucket, seg );
+        }
+      }
+    }
+  }
+  g_debug ( "%s: %d tracks, %d points, %d buckets, %d long segments", __FUNCTION__,
+            hmt->n_tracks, hmt->points->len, g_hash_table_size(hmt->buckets), hmt->long_segments->len );
+}
+
+guint a_heatmap_tiles_get_number_of_tracks ( HeatmapTiles *hmt )
+{
+  return hmt->n_tracks;
+}
+
+/**
+ * Add the segments of the bucket that are within the area,
+ *  or with no output just test if there are any
+ *
+ * Returns: TRUE when testing and one is found
+ */
+static gboolean bucket_gather ( HeatmapTiles *hmt, GArray *bucket, const HmtRect *area, GArray *out )
+{
+  for ( guint ii = 0; ii < bucket->len; ii++ ) {
+    guint32 seg = g_array_index ( bucket, guint32, ii );
+    HmtRect rect;
+    segment_rect ( hmt, seg, &rect );
+    if ( rect_intersect ( &rect, area ) ) {
+      if ( !out )
+        return TRUE;
+      g_array_append_val ( out, seg );
+    }
+  }
+  return FALSE;
+}
+
+static gint compare_guint32 ( gconstpointer a, gconstpointer b )
+{
+  guint32 aa = *(const guint32*)a;
+  guint32 bb = *(const guint32*)b;
+  return aa < bb ? -1 : (aa > bb ? 1 : 0);
+}
+
+/**
+ * Find the segments within the area, sorted and without duplicates
+ *  (a segment may be in several buckets).
+ * With no output just test if there are any.
+ */
+static gboolean gather ( HeatmapTiles *hmt, const HmtRect *area, GArray *out )
+{
+  gboolean found = FALSE;
+  guint32 bx0 = area->x0 >> BUCKET_SHIFT, bx1 = area->x1 >> BUCKET_SHIFT;
+  guint32 by0 = area->y0 >> BUCKET_SHIFT, by1 = area->y1 >> BUCKET_SHIFT;
+  guint64 n_buckets = (guint64)(bx1-bx0+1) * (by1-by0+1);
+
+  if ( n_buckets > g_hash_table_size(hmt->buckets) ) {
+    // Quicker to consider every bucket in use than to look each one up
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init ( &iter, hmt->buckets );
+    while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+      guint32 bx = GPOINTER_TO_UINT(key) & ((1 << BUCKET_LEVEL) - 1);
+      guint32 by = GPOINTER_TO_UINT(key) >> BUCKET_LEVEL;
+      if ( bx >= bx0 && bx <= bx1 && by >= by0 && by <= by1 )
+        if ( bucket_gather ( hmt, value, area, out ) ) {
+          found = TRUE;
+          break;
+        }
+    }
+  }
+  else {
+    for ( guint32 by = by0; by <= by1 && !found; by++ ) {
+      for ( guint32 bx = bx0; bx <= bx1; bx++ ) {
+        GArray *bucket = g_hash_table_lookup ( hmt->buckets, bucket_key(bx, by) );
+        if ( bucket && bucket_gather ( hmt, bucket, area, out ) ) {
+          found = TRUE;
+          break;
+        }
+      }
+    }
+  }
+  if ( !found )
+    found = bucket_gather ( hmt, hmt->long_segments, area, out );
+
+  if ( out ) {
+    g_array_sort ( out, compare_guint32 );
+    guint nn = 0;
+    for ( guint ii = 0; ii < out->len; ii++ ) {
+      guint32 seg = g_array_index ( out, guint32, ii );
+      if ( nn == 0 || g_array_index ( out, guint32, nn-1 ) != seg )
+        g_array_index ( out, guint32, nn++ ) = seg;
+    }
+    g_array_set_size ( out, nn );
+    found = nn > 0;
+  }
+  return found;
+}
+
+/**
+ * The area of the tile, including a margin of the blur radius
+ */
+static void tile_area ( gint zoom, gint x, gint y, guint radius, HmtRect *area )
+{
+  const gint64 tile_units = G_GINT64_CONSTANT(1) << (32 - zoom);
+  const gint64 margin = (gint64)radius << (32 - zoom - TILE_SHIFT);
+  const gint64 world_max = G_GINT64_CONSTANT(4294967295);
+  area->x0 = CLAMP ( x * tile_units - margin, 0, world_max );
+  area->y0 = CLAMP ( y * tile_units - margin, 0, world_max );
+  area->x1 = CLAMP ( (x+1) * tile_units - 1 + margin, 0, world_max );
+  area->y1 = CLAMP ( (y+1) * tile_units - 1 + margin, 0, world_max );
+}
+
+static gboolean tile_valid ( gint zoom, gint x, gint y )
+{
+  return zoom >= 0 && zoom <= HEATMAP_TILES_MAX_ZOOM && x >= 0 && y >= 0 && x < (1 << zoom) && y < (1 << zoom);
+}
+
+/**
+ * Whether any lines are near enough to the tile to show on it
+ */
+gboolean a_heatmap_tiles_has_data ( HeatmapTiles *hmt, gint zoom, gint x, gint y, guint radius )
+{
+  if ( !tile_valid ( zoom, x, y ) )
+    return FALSE;
+  HmtRect area;
+  tile_area ( zoom, x, y, radius, &area );
+  return gather ( hmt, &area, NULL );
+}
+
+/**
+ * a_heatmap_clip_segment:
+ *
+ * Liang-Barsky clipping of the segment to within the image
+ *
+ * Returns: FALSE if the segment is entirely outside
+ */
+gboolean a_heatmap_clip_segment ( gdouble width, gdouble height, gdouble *x0, gdouble *y0, gdouble *x1, gdouble *y1 )
+{
+  // Keep just inside, so the pixel coordinates are always valid
+  const gdouble xmax = width - 0.001;
+  const gdouble ymax = height - 0.001;
+  gdouble dx = *x1 - *x0;
+  gdouble dy = *y1 - *y0;
+  gdouble pp[4] = { -dx, dx, -dy, dy };
+  gdouble qq[4] = { *x0, xmax - *x0, *y0, ymax - *y0 };
+  gdouble t0 = 0.0;
+  gdouble t1 = 1.0;
+  for ( guint ii = 0; ii < 4; ii++ ) {
+    if ( pp[ii] == 0.0 ) {
+      if ( qq[ii] < 0.0 )
+        return FALSE;
+    }
+    else {
+      gdouble rr = qq[ii] / pp[ii];
+      if ( pp[ii] < 0.0 ) {
+        if ( rr > t1 )
+          return FALSE;
+        if ( rr > t0 )
+          t0 = rr;
+      }
+      else {
+        if ( rr < t0 )
+          return FALSE;
+        if ( rr < t1 )
+          t1 = rr;
+      }
+    }
+  }
+  gdouble sx = *x0;
+  gdouble sy = *y0;
+  *x0 = sx + t0 * dx;
+  *y0 = sy + t0 * dy;
+  *x1 = sx + t1 * dx;
+  *y1 = sy + t1 * dy;
+  return TRUE;
+}
+
+/**
+ * Bresenham line, counting each pixel only once per track
+ */
+static void line_count ( gint width, gfloat *counts, guint32 *marks, guint32 track, gint x0, gint y0, gint x1, gint y1 )
+{
+  gint dx = abs ( x1 - x0 );
+  gint dy = -abs ( y1 - y0 );
+  gint sx = x0 < x1 ? 1 : -1;
+  gint sy = y0 < y1 ? 1 : -1;
+  gint err = dx + dy;
+  while ( TRUE ) {
+    gint idx = y0 * width + x0;
+    if ( marks[idx] != track ) {
+      marks[idx] = track;
+      counts[idx] += 1.0;
+    }
+    if ( x0 == x1 && y0 == y1 )
+      break;
+    gint e2 = 2 * err;
+    if ( e2 >= dy ) {
+      err += dy;
+      x0 += sx;
+    }
+    if ( e2 <= dx ) {
+      err += dx;
+      y0 += sy;
+    }
+  }
+}
+
+/**
+ * a_heatmap_blur:
+ *
+ * Spread the pixel counts with a separable 'tent' kernel of the given radius
+ *  The heatmap buffer must be all clear on entry
+ */
+void a_heatmap_blur ( const gfloat *counts, gint width, gint height, guint radius, heatmap_t *hm )
+{
+  const gint rr = radius;
+  const gint dd = 2*rr + 1;
+  gfloat kernel[dd];
+  for ( gint kk = 0; kk < dd; kk++ )
+    kernel[kk] = 1.0 - (gfloat)abs(kk-rr)/(gfloat)(rr+1);
+
+  // Horizontal pass, only spreading from pixels with some coverage
+  gfloat *tmp = g_new0 ( gfloat, width * height );
+  for ( gint yy = 0; yy < height; yy++ ) {
+    const gfloat *row = counts + yy*width;
+    gfloat *out = tmp + yy*width;
+    for ( gint xx = 0; xx < width; xx++ ) {
+      if ( row[xx] <= 0.5 )
+        continue;
+      gint x0 = MAX ( 0, xx-rr );
+      gint x1 = MIN ( width-1, xx+rr );
+      for ( gint ox = x0; ox <= x1; ox++ )
+        out[ox] += row[xx] * kernel[ox-xx+rr];
+    }
+  }
+
+  // Vertical pass
+  for ( gint yy = 0; yy < height; yy++ ) {
+    gint y0 = MAX ( 0, yy-rr );
+    gint y1 = MIN ( height-1, yy+rr );
+    const gfloat *row = tmp + yy*width;
+    for ( gint xx = 0; xx < width; xx++ ) {
+      if ( row[xx] == 0.0 )
+        continue;
+      for ( gint oy = y0; oy <= y1; oy++ )
+        hm->buf[oy*width + xx] += row[xx] * kernel[oy-yy+rr];
+    }
+  }
+  g_free ( tmp );
+
+  hm->max = 0.0;
+  for ( gint idx = 0; idx < width*height; idx++ )
+    if ( hm->buf[idx] > hm->max )
+      hm->max = hm->buf[idx];
+}
+
+static void image_free ( guchar *pixels, gpointer data )
+{
+  g_free ( pixels );
+}
+
+// Number of heat levels the colours are looked up for (at least, when the scheme has more colours)
+#define HEATMAP_LUT_SIZE 1024
+// Images with more pixels than this are coloured in bands across the CPUs
+#define HEATMAP_PARALLEL_PIXELS (512*512)
+
+typedef struct {
+  const gfloat *heat;
+  guint32 *pixels;
+  gsize count;
+  const guint32 *lut;
+  gfloat scale;   // From heat to LUT index
+  gfloat saturation;
+} HeatmapBand;
+
+static gpointer heatmap_band_colour ( HeatmapBand *band )
+{
+  const gfloat *heat = band->heat;
+  guint32 *pixels = band->pixels;
+  // Simple enough for the compiler to vectorise the index calculation
+  for ( gsize ii = 0; ii < band->count; ii++ ) {
+    gfloat value = heat[ii];
+    // Negative heat can only be a rounding error when tracks are taken away
+    value = value < 0.0f ? 0.0f : (value > band->saturation ? band->saturation : value);
+    pixels[ii] = band->lut[(guint)(value * band->scale + 0.5f)];
+  }
+  return NULL;
+}
+
+/**
+ * a_heatmap_render:
+ * @colorscheme: The colours from cold to hot
+ * @saturation:  Heat at or above this gets the hottest colour
+ * @alpha:       Replaces the alpha of all but fully transparent colours (as per ui_pixbuf_set_alpha()),
+ *               or -1 to keep the colour scheme's alpha
+ * @image:       The RGBA pixel data of the heatmap's size, to be filled in
+ *
+ * As heatmap_render_saturated_to() followed by ui_pixbuf_set_alpha(),
+ *  but the colours (with the alpha already applied) are looked up from a table of quantised heat levels.
+ * Large images are coloured in bands in parallel.
+ */
+void a_heatmap_render ( const heatmap_t *hm, const heatmap_colorscheme_t *colorscheme, gfloat saturation, gint alpha, guchar *image )
+{
+  const guint lut_size = MAX ( HEATMAP_LUT_SIZE, colorscheme->ncolors );
+  guint32 *lut = g_new ( guint32, lut_size );
+  for ( guint ii = 0; ii < lut_size; ii++ ) {
+    // Same rounding as heatmap_render_saturated_to() so the hottest colour is used
+    gsize idx = (gsize)((gfloat)(colorscheme->ncolors-1) * ii / (lut_size-1) + 0.5f);
+    guchar *colour = (guchar*)&lut[ii];
+    memcpy ( colour, colorscheme->colors + idx*4, 4 );
+    if ( alpha >= 0 && colour[3] != 0 )
+      colour[3] = alpha;
+  }
+
+  HeatmapBand whole = { hm->buf, (guint32*)image, (gsize)hm->w * hm->h, lut,
+                        (gfloat)(lut_size-1) / saturation, saturation };
+
+  guint threads = util_get_number_of_cpus ();
+  if ( threads < 2 || whole.count < HEATMAP_PARALLEL_PIXELS ) {
+    heatmap_band_colour ( &whole );
+  }
+  else {
+    // Bands of whole rows
+    gsize rows = (hm->h + threads - 1) / threads;
+    HeatmapBand *bands = g_new ( HeatmapBand, threads );
+    GThread **workers = g_new0 ( GThread*, threads );
+    for ( guint tt = 0; tt < threads; tt++ ) {
+      gsize start = MIN ( tt * rows, hm->h ) * hm->w;
+      gsize end = MIN ( (tt+1) * rows, hm->h ) * hm->w;
+      bands[tt] = whole;
+      bands[tt].heat += start;
+      bands[tt].pixels += start;
+      bands[tt].count = end - start;
+      // The last band is done by this thread
+      if ( tt < threads-1 && bands[tt].count )
+        workers[tt] = g_thread_new ( "heatmap", (GThreadFunc)heatmap_band_colour, &bands[tt] );
+    }
+    heatmap_band_colour ( &bands[threads-1] );
+    for ( guint tt = 0; tt < threads-1; tt++ )
+      if ( workers[tt] )
+        g_thread_join ( workers[tt] );
+    g_free ( workers );
+    g_free ( bands );
+  }
+  g_free ( lut );
+}
+
+/**
+ * Count the number of tracks passing through each pixel of the tile,
+ *  over a grid of gs x gs pixels including a margin of the radius
+ */
+static gfloat *tile_counts ( HeatmapTiles *hmt, gint zoom, gint x, gint y, guint radius, gint gs )
+{
+  HmtRect area;
+  tile_area ( zoom, x, y, radius, &area );
+  GArray *segs = g_array_new ( FALSE, FALSE, sizeof(guint32) );
+  (void)gather ( hmt, &area, segs );
+
+  gfloat *counts = g_new0 ( gfloat, gs*gs );
+  guint32 *marks = g_new0 ( guint32, gs*gs );
+  const gdouble pixel_units = (gdouble)(G_GINT64_CONSTANT(1) << (32 - zoom - TILE_SHIFT));
+  const gdouble origin_x = (gdouble)((gint64)x << (32 - zoom)) - radius * pixel_units;
+  const gdouble origin_y = (gdouble)((gint64)y << (32 - zoom)) - radius * pixel_units;
+
+  guint rr = 0;
+  for ( guint ii = 0; ii < segs->len; ii++ ) {
+    guint32 seg = g_array_index ( segs, guint32, ii );
+    // Segments are in order, so the run containing the segment only ever moves forward
+    while ( g_array_index ( hmt->run_starts, guint32, rr+1 ) <= seg )
+      rr++;
+    // NB +1 so no track matches the initial marks
+    guint32 track = g_array_index ( hmt->run_tracks, guint32, rr ) + 1;
+    HmtPoint *p0 = &g_array_index ( hmt->points, HmtPoint, seg );
+    HmtPoint *p1 = &g_array_index ( hmt->points, HmtPoint, seg+1 );
+    gdouble x0 = (p0->x - origin_x) / pixel_units;
+    gdouble y0 = (p0->y - origin_y) / pixel_units;
+    gdouble x1 = (p1->x - origin_x) / pixel_units;
+    gdouble y1 = (p1->y - origin_y) / pixel_units;
+    if ( a_heatmap_clip_segment ( gs, gs, &x0, &y0, &x1, &y1 ) )
+      line_count ( gs, counts, marks, track, (gint)x0, (gint)y0, (gint)x1, (gint)y1 );
+  }
+  g_array_free ( segs, TRUE );
+  g_free ( marks );
+  return counts;
+}
+
+/**
+ * a_heatmap_tiles_render:
+ * @zoom:   OSM zoom level
+ * @x:      OSM tile x
+ * @y:      OSM tile y
+ * @radius: Of the blur in pixels
+ * @colorscheme: Or NULL for the default
+ * @alpha:  As per a_heatmap_render()
+ *
+ * Each pixel counts the number of tracks passing through it, which is then blurred.
+ * As every tile must use the same colour scale so they join up, heat saturates at a level
+ *  relative to the total number of tracks rather than the maximum of the individual tile.
+ *
+ * Returns: A new RGBA pixbuf of the tile, or NULL if the tile is not valid
+ */
+GdkPixbuf *a_heatmap_tiles_render ( HeatmapTiles *hmt, gint zoom, gint x, gint y, guint radius, const heatmap_colorscheme_t *colorscheme, gint alpha )
+{
+  if ( !tile_valid ( zoom, x, y ) )
+    return NULL;
+
+  // Grid including the margin
+  const gint gs = TILE_SIZE + 2*radius;
+  gfloat *counts = tile_counts ( hmt, zoom, x, y, radius, gs );
+
+  heatmap_t *hm = heatmap_new ( gs, gs );
+  a_heatmap_blur ( counts, gs, gs, radius, hm );
+  g_free ( counts );
+
+  heatmap_t *tile = heatmap_new ( TILE_SIZE, TILE_SIZE );
+  for ( gint yy = 0; yy < TILE_SIZE; yy++ )
+    memcpy ( tile->buf + yy*TILE_SIZE, hm->buf + (yy+radius)*gs + radius, TILE_SIZE*sizeof(gfloat) );
+  heatmap_free ( hm );
+
+  // A single line blurred by the tent kernel peaks at about radius+1
+  gfloat saturation = (radius + 1) * MAX ( 2.0, sqrt(hmt->n_tracks) );
+  guchar *image = g_malloc ( TILE_SIZE*TILE_SIZE*4 );
+  a_heatmap_render ( tile, colorscheme ? colorscheme : heatmap_cs_default, saturation, alpha, image );
+  heatmap_free ( tile );
+
+  return gdk_pixbuf_new_from_data ( image, GDK_COLORSPACE_RGB, TRUE, 8, TILE_SIZE, TILE_SIZE, 4*TILE_SIZE, image_free, NULL );
+}
+
+/**
+ * a_heatmap_tiles_render_lines:
+ * @zoom:   OSM zoom level
+ * @x:      OSM tile x
+ * @y:      OSM tile y
+ * @colour: RGBA of the lines
+ *
+ * The lines drawn one pixel wide without any blurring, as a simplified picture of lots of tracks.
+ * Pixels that only one track passes through are partly transparent,
+ *  so where many tracks run together stands out.
+ *
+ * Returns: A new RGBA pixbuf of the tile, or NULL if the tile is not valid
+ */
+GdkPixbuf *a_heatmap_tiles_render_lines ( HeatmapTiles *hmt, gint zoom, gint x, gint y, const guint8 colour[4] )
+{
+  if ( !tile_valid ( zoom, x, y ) )
+    return NULL;
+
+  gfloat *counts = tile_counts ( hmt, zoom, x, y, 0, TILE_SIZE );
+  guchar *image = g_malloc ( TILE_SIZE*TILE_SIZE*4 );
+  for ( gint idx = 0; idx < TILE_SIZE*TILE_SIZE; idx++ ) {
+    guchar *pixel = image + idx*4;
+    memcpy ( pixel, colour, 3 );
+    pixel[3] = counts[idx] > 0.5 ? (guchar)(colour[3] * MIN ( 1.0, (counts[idx] + 1.0) / 4.0 )) : 0;
+  }
+  g_free ( counts );
+
+  return gdk_pixbuf_new_from_data ( image, GDK_COLORSPACE_RGB, TRUE, 8, TILE_SIZE, TILE_SIZE, 4*TILE_SIZE, image_free, NULL );
+}
+
+/**
+ * a_heatmap_tiles_list:
+ *
+ * Returns: An array of guint32 x,y pairs of all the tiles at the zoom level with something to show
+ */
+GArray *a_heatmap_tiles_list ( HeatmapTiles *hmt, gint zoom, guint radius )
+{
+  GArray *tiles = g_array_new ( FALSE, FALSE, sizeof(guint32) );
+  if ( zoom < 0 || zoom > HEATMAP_TILES_MAX_ZOOM )
+    return tiles;
+
+  // Candidate tiles are those any line passes through, plus their neighbours which the blur may spread on to
+  GHashTable *seen = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, NULL );
+  const gint shift = 32 - zoom;
+  for ( guint rr = 0; rr + 1 < hmt->run_starts->len; rr++ ) {
+    guint32 first = g_array_index ( hmt->run_starts, guint32, rr );
+    guint32 last = g_array_index ( hmt->run_starts, guint32, rr+1 ) - 1;
+    for ( guint32 seg = first; seg < last; seg++ ) {
+      HmtPoint *p0 = &g_array_index ( hmt->points, HmtPoint, seg );
+      HmtPoint *p1 = &g_array_index ( hmt->points, HmtPoint, seg+1 );
+      gint tx0 = (gint)((guint64)p0->x >> shift), ty0 = (gint)((guint64)p0->y >> shift);
+      gint tx1 = (gint)((guint64)p1->x >> shift), ty1 = (gint)((guint64)p1->y >> shift);
+      // Walk the tiles along the segment
+      gint dx = abs ( tx1 - tx0 ), dy = -abs ( ty1 - ty0 );
+      gint sx = tx0 < tx1 ? 1 : -1, sy = ty0 < ty1 ? 1 : -1;
+      gint err = dx + dy;
+      while ( TRUE ) {
+        for ( gint ny = ty0-1; ny <= ty0+1; ny++ ) {
+          for ( gint nx = tx0-1; nx <= tx0+1; nx++ ) {
+            if ( !tile_valid ( zoom, nx, ny ) )
+              continue;
+            gint64 key = ((gint64)nx << 32) | ny;
+            if ( g_hash_table_contains ( seen, &key ) )
+              continue;
+            gint64 *kk = g_new ( gint64, 1 );
+            *kk = key;
+            g_hash_table_add ( seen, kk );
+            if ( (nx == tx0 && ny == ty0) || a_heatmap_tiles_has_data ( hmt, zoom, nx, ny, radius ) ) {
+              guint32 pair[2] = { nx, ny };
+              g_array_append_vals ( tiles, pair, 2 );
+            }
+          }
+        }
+        if ( tx0 == tx1 && ty0 == ty1 )
+          break;
+        gint e2 = 2 * err;
+        if ( e2 >= dy ) {
+          err += dy;
+          tx0 += sx;
+        }
+        if ( e2 <= dx ) {
+          err += dx;
+          ty0 += sy;
+        }
+      }
+    }
+  }
+  g_hash_table_destroy ( seen );
+  return tiles;
+}
@@ -0,0 +1,57 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_HEATMAPTILES_H
+#define __VIKING_HEATMAPTILES_H
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include "viktrack.h"
+#include "misc/heatmap.h"
+
+G_BEGIN_DECLS
+
+// A spatial index of track lines, from which heatmap tiles can be rendered on demand at any zoom level
+// Once finished it is only read, so tiles can be rendered from multiple threads at the same time
+typedef struct _HeatmapTiles HeatmapTiles;
+
+// The highest OSM zoom level tiles can be rendered for
+#define HEATMAP_TILES_MAX_ZOOM 22
+
+HeatmapTiles *a_heatmap_tiles_new ( void );
+HeatmapTiles *a_heatmap_tiles_ref ( HeatmapTiles *hmt );
+void a_heatmap_tiles_unref ( HeatmapTiles *hmt );
+
+void a_heatmap_tiles_set_all_points ( HeatmapTiles *hmt, gboolean all_points );
+void a_heatmap_tiles_add_track ( HeatmapTiles *hmt, const VikTrackSnapshot *snap );
+void a_heatmap_tiles_finish ( HeatmapTiles *hmt );
+guint a_heatmap_tiles_get_number_of_tracks ( HeatmapTiles *hmt );
+
+gboolean a_heatmap_tiles_has_data ( HeatmapTiles *hmt, gint zoom, gint x, gint y, guint radius );
+GdkPixbuf *a_heatmap_tiles_render ( HeatmapTiles *hmt, gint zoom, gint x, gint y, guint radius, const heatmap_colorscheme_t *colorscheme, gint alpha );
+GdkPixbuf *a_heatmap_tiles_render_lines ( HeatmapTiles *hmt, gint zoom, gint x, gint y, const guint8 colour[4] );
+GArray *a_heatmap_tiles_list ( HeatmapTiles *hmt, gint zoom, guint radius );
+
+gboolean a_heatmap_clip_segment ( gdouble width, gdouble height, gdouble *x0, gdouble *y0, gdouble *x1, gdouble *y1 );
+void a_heatmap_blur ( const gfloat *counts, gint width, gint height, guint radius, heatmap_t *hm );
+void a_heatmap_render ( const heatmap_t *hm, const heatmap_colorscheme_t *colorscheme, gfloat saturation, gint alpha, guchar *image );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include "imagecache.h"
+#include "ui_util.h"
+
+/*
+ * Layers such as Georef layers hold the whole of their image in memory.
+ * When the same project is open in more than one window, or several layers use the same image,
+ *  each would otherwise load its own copy.
+ *
+ * The cache does not keep images alive itself: it only has weak references to them,
+ *  so an image is freed as soon as no layer uses it.
+ * An image is loaded again if the file has changed since.
+ */
+
+typedef struct {
+  GWeakRef pixbuf;
+  gint64 mtime;
+  goffset size;
+} ImageEntryT;
+
+static GHashTable *images = NULL; // "alpha filename" -> ImageEntryT
+static GMutex images_mutex;
+
+static void image_entry_free ( ImageEntryT *entry )
+{
+  g_weak_ref_clear ( &entry->pixbuf );
+  g_free ( entry );
+}
+
+void a_image_cache_init ( void )
+{
+  images = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)image_entry_free );
+}
+
+void a_image_cache_uninit ( void )
+{
+  g_hash_table_destroy ( images );
+  images = NULL;
+}
+
+/**
+ * Forget the images no longer used by anything
+ */
+static void image_cache_prune ( void )
+{
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init ( &iter, images );
+  while ( g_hash_table_iter_next ( &iter, NULL, &value ) ) {
+    GdkPixbuf *pixbuf = g_weak_ref_get ( &((ImageEntryT*)value)->pixbuf );
+    if ( pixbuf )
+      g_object_unref ( pixbuf );
+    else
+      g_hash_table_iter_remove ( &iter );
+  }
+}
+
+/**
+ * a_image_cache_load:
+ * @filename: The image file
+ * @alpha:    Transparency to apply to the image, or above 255 for that of the file
+ *
+ * Returns: A new reference to the image, which is shared with anything else using the same file and alpha.
+ *  NULL on failure, with @error set.
+ */
+GdkPixbuf *a_image_cache_load ( const gchar *filename, guint alpha, GError **error )
+{
+  GStatBuf st;
+  if ( g_stat ( filename, &st ) != 0 ) {
+    g_set_error ( error, G_FILE_ERROR, g_file_error_from_errno ( errno ), "%s: %s", filename, g_strerror ( errno ) );
+    return NULL;
+  }
+
+  gchar *key = g_strdup_printf ( "%u %s", MIN(alpha, 256), filename );
+  g_mutex_lock ( &images_mutex );
+  GdkPixbuf *pixbuf = NULL;
+  ImageEntryT *entry = g_hash_table_lookup ( images, key );
+  if ( entry && entry->mtime == (gint64)st.st_mtime && entry->size == (goffset)st.st_size )
+    pixbuf = g_weak_ref_get ( &entry->pixbuf );
+  g_mutex_unlock ( &images_mutex );
+
+  if ( pixbuf ) {
+    g_free ( key );
+    return pixbuf;
+  }
+
+  // Loaded without holding the lock, as large images take a while
+  pixbuf = gdk_pixbuf_new_from_file ( filename, error );
+  if ( !pixbuf ) {
+    g_free ( key );
+    return NULL;
+  }
+  if ( alpha <= 255 )
+    pixbuf = ui_pixbuf_set_alpha ( pixbuf, alpha );
+
+  g_mutex_lock ( &images_mutex );
+  image_cache_prune ();
+  entry = g_malloc0 ( sizeof(ImageEntryT) );
+  g_weak_ref_init ( &entry->pixbuf, pixbuf );
+  entry->mtime = (gint64)st.st_mtime;
+  entry->size = (goffset)st.st_size;
+  g_hash_table_replace ( images, key, entry );
+  g_mutex_unlock ( &images_mutex );
+  return pixbuf;
+}
+
+/**
+ * a_image_cache_get_size:
+ *
+ * Returns: The memory used by the images currently shared
+ */
+gsize a_image_cache_get_size ( void )
+{
+  gsize bytes = 0;
+  GHashTableIter iter;
+  gpointer value;
+  g_mutex_lock ( &images_mutex );
+  g_hash_table_iter_init ( &iter, images );
+  while ( g_hash_table_iter_next ( &iter, NULL, &value ) ) {
+    GdkPixbuf *pixbuf = g_weak_ref_get ( &((ImageEntryT*)value)->pixbuf );
+    if ( pixbuf ) {
+      bytes += ui_pixbuf_get_bytes ( pixbuf );
+      g_object_unref ( pixbuf );
+    }
+  }
+  g_mutex_unlock ( &images_mutex );
+  return bytes;
+}
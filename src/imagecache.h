@@ -0,0 +1,39 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_IMAGECACHE_H
+#define __VIKING_IMAGECACHE_H
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+// Images loaded from files, shared by every layer (in any window) showing the same file
+// The pixbufs returned are shared and so must not be modified; release them with g_object_unref()
+void a_image_cache_init ( void );
+void a_image_cache_uninit ( void );
+
+// An alpha above 255 keeps the transparency of the file
+GdkPixbuf *a_image_cache_load ( const gchar *filename, guint alpha, GError **error );
+gsize a_image_cache_get_size ( void );
+
+G_END_DECLS
+
+#endif
@@ -44,12 +44,19 @@ typedef struct {
 	GQueue *gq_start;
 	GQueue *gq_end;
 	XML_Parser parser;
+	guint unnamed_waypoints;
+	guint unnamed_tracks;
+	// LineString/LinearRing coordinates are converted as they are read,
+	//  rather than buffering what can be a very large amount of text
+	gboolean stream_coords;
+	gboolean coord_error;
+	gboolean coord_newseg;
+	guint coord_part;         // Of the 'lon,lat(,alt)' currently being read
+	gdouble coord_values[3];
+	gchar coord_token[64];    // Text of the number so far, which may span cdata chunks
+	guint coord_token_len;
 } xml_data;
 
-static guint unnamed_waypoints = 0;
-static guint unnamed_tracks = 0;
-static guint unnamed_routes = 0;
-
 // Various helper functions
 
 static void parse_tag_reset ( xml_data *xd )
@@ -163,23 +170,41 @@ static void set_vc_to_ll ( xml_data *xd, VikCoord *vc, VikTrwLayer *vtl, gdouble
 	vik_coord_load_from_latlon ( vc, vik_trw_layer_get_coord_mode(vtl), &c_ll );
 }
 
+/**
+ * Split text such as 'lon,lat,alt' on the separator, converting the first 3 parts
+ * Returns: The number of parts, which may be more than 3
+ */
+static guint coordinate_parts ( const gchar *str, gchar sep, gdouble values[3] )
+{
+	guint nn = 0;
+	const gchar *part = str;
+	for ( const gchar *ptr = str; ; ptr++ ) {
+		if ( *ptr == sep || *ptr == '\0' ) {
+			if ( nn < 3 )
+				values[nn] = util_strtod_len ( part, ptr - part );
+			nn++;
+			if ( *ptr == '\0' )
+				break;
+			part = ptr + 1;
+		}
+	}
+	return nn;
+}
+
 static void point_coordinates_end ( xml_data *xd, const char *el )
 {
 	if ( xd->waypoint ) {
-		gchar **vals = g_strsplit ( xd->c_cdata->str, ",", -1 );
-		guint nn = g_strv_length ( vals );
+		gdouble vals[3];
+		guint nn = coordinate_parts ( xd->c_cdata->str, ',', vals );
 		if ( nn < 2 || nn > 3  )
 			g_warning ( "%s: expected 2 or 3 coordinate parts but got %d at line %ld", G_STRLOC, nn, XML_GetCurrentLineNumber(xd->parser) );
 		else {
 			// Remember KML coordinates are the 'lon,lat(,alt)' order
-			gdouble lat = g_ascii_strtod ( vals[1], NULL );
-			gdouble lon = g_ascii_strtod ( vals[0], NULL );
-			set_vc_to_ll ( xd, &(xd->waypoint->coord), xd->vtl, lat, lon );
+			set_vc_to_ll ( xd, &(xd->waypoint->coord), xd->vtl, vals[1], vals[0] );
 			if ( nn == 3 )
 				// ATM altitude is always interpreted to be in absolute mode (to sea level)
-				xd->waypoint->altitude = g_ascii_strtod ( vals[2], NULL );
+				xd->waypoint->altitude = vals[2];
 		}
-		g_strfreev ( vals );
 	}
 	else
 		g_warning ( "%s: no waypoint", G_STRLOC );
@@ -195,7 +220,7 @@ static void point_end ( xml_data *xd, const char *el )
 				vik_waypoint_set_name ( xd->waypoint, xd->name );
 			} else {
 				xd->waypoint->hide_name = TRUE;
-				gchar *name = g_strdup_printf ( "WP%04d", unnamed_waypoints++ );
+				gchar *name = g_strdup_printf ( "WP%04d", xd->unnamed_waypoints++ );
 				vik_waypoint_set_name ( xd->waypoint, name );
 				g_free ( name );
 			}
@@ -219,68 +244,79 @@ static void point_start ( xml_data *xd, const char *el, const char **attr )
 	xd->waypoint = vik_waypoint_new();
 }
 
-static void linestring_coordinates_end ( xml_data *xd, const char *el )
+// The current number of a coordinates tuple is complete
+static void coords_end_part ( xml_data *xd )
 {
-	if ( xd->track ) {
-		gchar *ptr = xd->c_cdata->str;
-		if ( ptr ) {
-			int len = strlen(ptr);
-			gchar *endptr = ptr + len;
-			gchar *cp;
-			for ( cp = ptr; cp < endptr; cp++ )
-				if ( !isspace(*cp) )
-					break;
-
-			gboolean newseg = TRUE;
-			int val = 0;
-			gdouble values[3];
-			gchar *vp;
-			for ( vp = cp; cp <= endptr; cp++ ) {
-				if ( *cp == ',' ) {
-					// Get string before this comma
-					gchar *str = g_malloc0 ( cp-vp+1 );
-					strncpy ( str, vp, cp-vp );
-					values[val] = g_ascii_strtod ( str, NULL );
-					g_free ( str );
-					val++;
-					vp = cp + 1; // +1 for the next one after the comma
-				} else if ( cp == NULL || isspace(*cp) ) {
-					if ( val < 1 || val > 2 )
-						// Not enough or too many coordinate parts
-						goto end;
-					// Otherwise the value is to end of text block
-					//  (should be the last coordinate part)
-					gchar *str = g_malloc0 ( cp-vp+1 );
-					strncpy ( str, vp, cp-vp );
-					values[val] = g_ascii_strtod ( str, NULL );
-					g_free ( str );
-
-					VikTrackpoint *tp = vik_trackpoint_new();
-					// Remember KML coordinates are the 'lon,lat(,alt)' order
-					set_vc_to_ll ( xd, &(tp->coord), xd->vtl, values[1], values[0] );
-					if ( val == 2 )
-						// ATM altitude is always interpreted to be in absolute mode (to sea level)
-						tp->altitude = values[2];
-					if ( newseg ) {
-						tp->newsegment = TRUE;
-						newseg = FALSE;
-					}
+	if ( xd->coord_part < 3 )
+		xd->coord_values[xd->coord_part] = util_strtod_len ( xd->coord_token, xd->coord_token_len );
+	xd->coord_part++;
+	xd->coord_token_len = 0;
+}
 
-					xd->track->trackpoints = g_list_prepend ( xd->track->trackpoints, tp );
+// The current coordinates tuple is complete
+static void coords_end_tuple ( xml_data *xd )
+{
+	coords_end_part ( xd );
+	if ( xd->coord_part < 2 || xd->coord_part > 3 ) {
+		// Not enough or too many coordinate parts, so ignore anything further
+		g_warning ( "%s: expected 2 or 3 coordinate parts but got %d at line %ld", G_STRLOC, xd->coord_part, XML_GetCurrentLineNumber(xd->parser) );
+		xd->coord_error = TRUE;
+		return;
+	}
+	VikTrackpoint *tp = vik_trackpoint_new();
+	// Remember KML coordinates are the 'lon,lat(,alt)' order
+	set_vc_to_ll ( xd, &(tp->coord), xd->vtl, xd->coord_values[1], xd->coord_values[0] );
+	if ( xd->coord_part == 3 )
+		// ATM altitude is always interpreted to be in absolute mode (to sea level)
+		tp->altitude = xd->coord_values[2];
+	if ( xd->coord_newseg ) {
+		tp->newsegment = TRUE;
+		xd->coord_newseg = FALSE;
+	}
+	xd->track->trackpoints = g_list_prepend ( xd->track->trackpoints, tp );
+	xd->coord_part = 0;
+}
 
-					// Consume any extra space to get to the next coordinate part
-					while ( cp != NULL && isspace(*cp) )
-						cp++;
-					val = 0;
-					vp = cp;
-				}
-			}
+/**
+ * Whitespace separated 'lon,lat(,alt)' tuples, split across however many chunks expat gives
+ */
+static void coords_cdata ( xml_data *xd, const XML_Char *ss, int len )
+{
+	for ( int ii = 0; ii < len && !xd->coord_error; ii++ ) {
+		gchar cc = ss[ii];
+		if ( cc == ',' )
+			coords_end_part ( xd );
+		else if ( g_ascii_isspace(cc) ) {
+			if ( xd->coord_token_len || xd->coord_part )
+				coords_end_tuple ( xd );
+		}
+		else if ( xd->coord_token_len < sizeof(xd->coord_token) )
+			xd->coord_token[xd->coord_token_len++] = cc;
+		else {
+			g_warning ( "%s: invalid coordinate value at line %ld", G_STRLOC, XML_GetCurrentLineNumber(xd->parser) );
+			xd->coord_error = TRUE;
 		}
 	}
-	else
-		g_warning ( "%s: no track", G_STRLOC );
+}
 
-end:
+static void coords_start ( xml_data *xd, gpointer old_end_func, gpointer new_end_func )
+{
+	setup_to_read_leaf_tag ( xd, old_end_func, new_end_func );
+	xd->stream_coords = TRUE;
+	xd->coord_error = FALSE;
+	xd->coord_newseg = TRUE;
+	xd->coord_part = 0;
+	xd->coord_token_len = 0;
+}
+
+static void linestring_coordinates_end ( xml_data *xd, const char *el )
+{
+	if ( !xd->track )
+		g_warning ( "%s: no track", G_STRLOC );
+	// Any final tuple without trailing whitespace
+	else if ( !xd->coord_error && (xd->coord_token_len || xd->coord_part) )
+		coords_end_tuple ( xd );
+	xd->stream_coords = FALSE;
 	end_leaf_tag ( xd );
 }
 
@@ -291,7 +327,7 @@ static void linestring_end ( xml_data *xd, const char *el )
 			if ( xd->name && strlen(xd->name) > 0 ) {
 				vik_track_set_name ( xd->track, xd->name );
 			} else {
-				gchar *name = g_strdup_printf ( "TRK%04d", unnamed_tracks++ );
+				gchar *name = g_strdup_printf ( "TRK%04d", xd->unnamed_tracks++ );
 				vik_track_set_name ( xd->track, name );
 				g_free ( name );
 			}
@@ -310,7 +346,7 @@ static void linestring_start ( xml_data *xd, const char *el, const char **attr )
 {
 	// ATM ignoring at least 'extrude', 'tessellate' & 'altitudeMode'
 	if ( g_strcmp0 ( el, "coordinates" ) == 0 ) {
-		setup_to_read_leaf_tag ( xd, linestring_end, linestring_coordinates_end );
+		coords_start ( xd, linestring_end, linestring_coordinates_end );
 	}
 }
 
@@ -322,7 +358,7 @@ static void linearring_end ( xml_data *xd, const char *el )
 			if ( xd->name && strlen(xd->name) > 0 ) {
 				vik_track_set_name ( xd->track, xd->name );
 			} else {
-				gchar *name = g_strdup_printf ( "TRK%04d", unnamed_tracks++ );
+				gchar *name = g_strdup_printf ( "TRK%04d", xd->unnamed_tracks++ );
 				vik_track_set_name ( xd->track, name );
 				g_free ( name );
 			}
@@ -340,7 +376,7 @@ static void linearring_start ( xml_data *xd, const char *el, const char **attr )
 {
 	// ATM ignoring at least 'extrude', 'tessellate' & 'altitudeMode'
 	if ( g_strcmp0 ( el, "coordinates" ) == 0 ) {
-		setup_to_read_leaf_tag ( xd, linearring_end, linestring_coordinates_end );
+		coords_start ( xd, linearring_end, linestring_coordinates_end );
 	}
 }
 
@@ -364,24 +400,21 @@ static void placemark_end ( xml_data *xd, const char *el )
 static void track_coordinates_end ( xml_data *xd, const char *el )
 {
 	if ( xd->trackpoint && xd->track ) {
-		gchar **vals = g_strsplit ( xd->c_cdata->str, " ", -1 );
-		guint nn = g_strv_length ( vals );
+		gdouble vals[3];
+		guint nn = coordinate_parts ( xd->c_cdata->str, ' ', vals );
 		if ( nn < 2 || nn > 3  )
 			g_warning ( "%s: expected 2 or 3 coordinate parts but got %d at line %ld", G_STRLOC, nn, XML_GetCurrentLineNumber(xd->parser) );
 		else {
 			// Remember KML coordinates are the 'lon,lat(,alt)' order
-			gdouble lat = g_ascii_strtod ( vals[1], NULL );
-			gdouble lon = g_ascii_strtod ( vals[0], NULL );
-			set_vc_to_ll ( xd, &(xd->trackpoint->coord), xd->vtl, lat, lon );
+			set_vc_to_ll ( xd, &(xd->trackpoint->coord), xd->vtl, vals[1], vals[0] );
 			if ( nn == 3 )
 				// ATM altitude is always interpreted to be in absolute mode (to sea level)
-				xd->trackpoint->altitude = g_ascii_strtod ( vals[2], NULL );
+				xd->trackpoint->altitude = vals[2];
 
 			xd->track->trackpoints = g_list_prepend ( xd->track->trackpoints, xd->trackpoint );
 			xd->track->visible = xd->vis;
 			xd->vis = TRUE;
 		}
-		g_strfreev ( vals );
 	}
 	else
 		g_warning ( "%s: no trackpoint", G_STRLOC );
@@ -398,7 +431,7 @@ static void track_end ( xml_data *xd, const char *el )
 				g_free ( xd->name );
 				xd->name = NULL;
 			} else {
-				gchar *name = g_strdup_printf ( "TRK%04d", unnamed_tracks++ );
+				gchar *name = g_strdup_printf ( "TRK%04d", xd->unnamed_tracks++ );
 				vik_track_set_name ( xd->track, name );
 				g_free ( name );
 			}
@@ -700,7 +733,11 @@ static void kml_end ( xml_data *xd, const char *el )
 
 static void kml_cdata ( xml_data *xd, const XML_Char *ss, int len )
 {
-	if ( xd->use_cdata ) {
+	if ( xd->stream_coords ) {
+		if ( xd->track )
+			coords_cdata ( xd, ss, len );
+	}
+	else if ( xd->use_cdata ) {
 		g_string_append_len ( xd->c_cdata, ss, len );
 	}
 }
@@ -723,12 +760,10 @@ gboolean a_kml_read_file ( VikTrwLayer *vtl, FILE *ff )
 	XML_Parser parser = XML_ParserCreate(NULL);
 	enum XML_Status status = XML_STATUS_ERROR;
 
-	unnamed_waypoints = 1;
-	unnamed_tracks = 1;
-	unnamed_routes = 1;
-
 	xml_data *xd = g_malloc0 ( sizeof (xml_data) );
 	// Set default values;
+	xd->unnamed_waypoints = 1;
+	xd->unnamed_tracks = 1;
 	xd->c_cdata = g_string_new ( "" );
 	xd->vis = TRUE;
 	xd->timestamp = NAN;
@@ -184,6 +184,113 @@ typedef struct zip_file zip_file_t;
 #endif
 
 #ifdef HAVE_EXPAT_H
+/**
+ * An image within a KMZ file, only read from the file when it is drawn
+ * The member is found again by its index (the closest libzip offers to its offset in the file),
+ *  with the size and CRC to detect the file having been changed since
+ */
+typedef struct {
+	gchar *filename;
+	zip_uint64_t index;
+	zip_uint64_t size;
+	zip_uint32_t crc;
+} kmz_image;
+
+static void kmz_image_free ( kmz_image *ki )
+{
+	g_free ( ki->filename );
+	g_free ( ki );
+}
+
+typedef struct {
+	guint shrink;
+	gboolean prepared;
+	gint width;
+	gint height;
+} kmz_image_load_t;
+
+static void kmz_image_size_prepared ( GdkPixbufLoader *loader, gint width, gint height, kmz_image_load_t *kil )
+{
+	kil->prepared = TRUE;
+	kil->width = width;
+	kil->height = height;
+	// For a JPEG this makes libjpeg do a reduced DCT, rather than decoding everything and then scaling
+	if ( kil->shrink == 0 )
+		gdk_pixbuf_loader_set_size ( loader, 1, 1 ); // Only the size is wanted, so allocate as little as possible
+	else if ( kil->shrink > 1 )
+		gdk_pixbuf_loader_set_size ( loader, MAX(1, width / (gint)kil->shrink), MAX(1, height / (gint)kil->shrink) );
+}
+
+/**
+ * Stream the image from the archive into a loader, rather than via a temporary file
+ *
+ * @shrink: Divide the image dimensions by this. 0 to only read the size of the image
+ *
+ * Returns: The image, or NULL (which when only reading the size is not an error)
+ */
+static GdkPixbuf *kmz_image_read ( zip_t *archive, kmz_image *ki, guint shrink, gint *width, gint *height, GError **error )
+{
+	struct zip_stat zs;
+	zip_file_t *zf = NULL;
+	if ( zip_stat_index ( archive, ki->index, 0, &zs ) == 0 && zs.size == ki->size && zs.crc == ki->crc )
+		zf = zip_fopen_index ( archive, ki->index, 0 );
+	if ( !zf ) {
+		g_set_error ( error, G_FILE_ERROR, G_FILE_ERROR_FAILED, _("Unable to read image %u from %s"), (guint)ki->index, ki->filename );
+		return NULL;
+	}
+
+	GdkPixbufLoader *loader = gdk_pixbuf_loader_new ();
+	kmz_image_load_t kil = { shrink, FALSE, 0, 0 };
+	g_signal_connect ( loader, "size-prepared", G_CALLBACK(kmz_image_size_prepared), &kil );
+
+	const gsize chunk = 65536;
+	guchar *buffer = g_malloc ( chunk );
+	gboolean ok = TRUE;
+	zip_int64_t len = 0;
+	while ( ok && !(shrink == 0 && kil.prepared) && (len = zip_fread ( zf, buffer, chunk )) > 0 )
+		ok = gdk_pixbuf_loader_write ( loader, buffer, len, error );
+	g_free ( buffer );
+	zip_fclose ( zf );
+
+	if ( ok && len < 0 ) {
+		g_set_error ( error, G_FILE_ERROR, G_FILE_ERROR_IO, _("Unable to read image %u from %s"), (guint)ki->index, ki->filename );
+		ok = FALSE;
+	}
+	// When stopping early the loader complains about the incomplete image
+	if ( !gdk_pixbuf_loader_close ( loader, (ok && shrink) ? error : NULL ) )
+		ok = FALSE;
+
+	GdkPixbuf *pixbuf = NULL;
+	if ( ok && shrink ) {
+		pixbuf = gdk_pixbuf_loader_get_pixbuf ( loader );
+		if ( pixbuf )
+			g_object_ref ( pixbuf );
+	}
+	g_object_unref ( loader );
+
+	if ( width )
+		*width = kil.width;
+	if ( height )
+		*height = kil.height;
+	return pixbuf;
+}
+
+/**
+ * As #VikGeorefSourceFunc
+ */
+static GdkPixbuf *kmz_image_load ( kmz_image *ki, guint shrink, GError **error )
+{
+	int ans = ZIP_ER_OK;
+	zip_t *archive = zip_open ( ki->filename, ZIP_RDONLY, &ans );
+	if ( !archive ) {
+		g_set_error ( error, G_FILE_ERROR, G_FILE_ERROR_FAILED, _("Unable to open archive: '%s' Error code %d"), ki->filename, ans );
+		return NULL;
+	}
+	GdkPixbuf *pixbuf = kmz_image_read ( archive, ki, MAX(1, shrink), NULL, NULL, error );
+	zip_discard ( archive );
+	return pixbuf;
+}
+
 typedef struct {
 	GString *xpath;
 	GString *c_cdata;
@@ -196,6 +303,7 @@ typedef struct {
 	gdouble west;
 	zip_t *archive;
 	struct zip_stat* zs;
+	gchar *filename; // Of the archive, as an absolute path
 	VikViewport *vvp;
 	VikLayersPanel *vlp;
 } xml_data;
@@ -338,39 +446,29 @@ static void ground_overlay_load ( xml_data *xd )
 		return;
 	}
 
-	GdkPixbuf *pixbuf = NULL;
+	kmz_image *ki = NULL;
+	gint width = 0, height = 0;
 
-	// Read zip for image...
+	// Find the image in the zip, but only read enough of it now to get its size
 	if ( xd->image ) {
 		if ( zip_stat ( xd->archive, xd->image, ZIP_FL_NOCASE | ZIP_FL_ENC_GUESS, xd->zs ) == 0) {
-			zip_file_t *zfi = zip_fopen_index ( xd->archive, xd->zs->index, 0 );
-			// Don't know a way to create a pixbuf using streams.
-			// Thus write out to file
-			// Could read in chunks rather than one big buffer, but don't expect images to be that big
-			char *ibuffer = g_malloc(xd->zs->size);
-			int ilen = zip_fread ( zfi, ibuffer, xd->zs->size );
-			if ( ilen != xd->zs->size ) {
+			ki = g_malloc0 ( sizeof(kmz_image) );
+			ki->filename = g_strdup ( xd->filename );
+			ki->index = xd->zs->index;
+			ki->size = xd->zs->size;
+			ki->crc = xd->zs->crc;
+			kmz_image_read ( xd->archive, ki, 0, &width, &height, NULL );
+			if ( width <= 0 || height <= 0 ) {
 				g_warning ( "Unable to read %s from zip file", xd->image );
+				kmz_image_free ( ki );
+				ki = NULL;
 			}
-			else {
-				gchar *image_file = util_write_tmp_file_from_bytes ( ibuffer, ilen );
-				GError *error = NULL;
-				pixbuf = gdk_pixbuf_new_from_file ( image_file, &error );
-				if ( error ) {
-					g_warning ("%s: %s", __FUNCTION__, error->message );
-					g_error_free ( error );
-				}
-				else {
-					util_remove ( image_file );
-				}
-				g_free ( image_file );
-			}
-			g_free ( ibuffer );
 		}
 		g_free ( xd->image );
+		xd->image = NULL;
 	}
 
-	if ( pixbuf ) {
+	if ( ki ) {
 		VikCoord vc_tl, vc_br;
 		struct LatLon ll_tl, ll_br;
 		ll_tl.lat = xd->north;
@@ -380,7 +478,11 @@ static void ground_overlay_load ( xml_data *xd )
 		vik_coord_load_from_latlon ( &vc_tl, vik_viewport_get_coord_mode(xd->vvp), &ll_tl );
 		vik_coord_load_from_latlon ( &vc_br, vik_viewport_get_coord_mode(xd->vvp), &ll_br );
 
-		VikGeorefLayer *vgl = vik_georef_layer_create ( xd->vvp, xd->vlp, xd->name ? xd->name : "GeoRef", pixbuf, &vc_tl, &vc_br );
+		gchar *source_id = g_strdup_printf ( "%s#%u", ki->filename, (guint)ki->index );
+		VikGeorefLayer *vgl = vik_georef_layer_create_from_source ( xd->vvp, xd->vlp, xd->name ? xd->name : "GeoRef", width, height,
+		                                                            (VikGeorefSourceFunc)kmz_image_load, ki, (GDestroyNotify)kmz_image_free,
+		                                                            source_id, &vc_tl, &vc_br );
+		g_free ( source_id );
 		if ( vgl ) {
 			VikAggregateLayer *top = vik_layers_panel_get_top_layer ( xd->vlp );
 			vik_aggregate_layer_add_layer ( top, VIK_LAYER(vgl), FALSE );
@@ -391,7 +493,7 @@ static void ground_overlay_load ( xml_data *xd )
 /**
  *
  */
-static gboolean parse_kml ( const char* buffer, int len, VikViewport *vvp, VikLayersPanel *vlp, zip_t *archive, struct zip_stat* zs )
+static gboolean parse_kml ( const char* buffer, int len, VikViewport *vvp, VikLayersPanel *vlp, zip_t *archive, struct zip_stat* zs, const gchar *filename )
 {
 	XML_Parser parser = XML_ParserCreate(NULL);
 	enum XML_Status status = XML_STATUS_ERROR;
@@ -409,6 +511,9 @@ static gboolean parse_kml ( const char* buffer, int len, VikViewport *vvp, VikLa
 	xd->image = NULL;
 	xd->archive = archive;
 	xd->zs = zs;
+	xd->filename = file_realpath_dup ( filename );
+	if ( !xd->filename )
+		xd->filename = g_strdup ( filename );
 	xd->vvp = vvp;
 	xd->vlp = vlp;
 
@@ -427,6 +532,8 @@ static gboolean parse_kml ( const char* buffer, int len, VikViewport *vvp, VikLa
 
 	g_string_free ( xd->xpath, TRUE );
 	g_string_free ( xd->c_cdata, TRUE );
+	g_free ( xd->name );
+	g_free ( xd->filename );
 	g_free ( xd );
 
 	return ans;
@@ -479,7 +586,7 @@ int kmz_open_file ( const gchar* filename, VikViewport *vvp, VikLayersPanel *vlp
 
 		gboolean parsed = FALSE;
 #ifdef HAVE_EXPAT_H
-		parsed = parse_kml ( buffer, len, vvp, vlp, archive, &zs );
+		parsed = parse_kml ( buffer, len, vvp, vlp, archive, &zs, filename );
 #endif
 		g_free ( buffer );
 
@@ -0,0 +1,242 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * The locations are held as an implicit kd-tree: within any range of the array the middle
+ *  entry is the node, splitting on latitude or longitude by alternate depth, and the
+ *  entries before and after it are its two subtrees. Thus no pointers are needed and the
+ *  binary form can be used directly from a memory mapped file.
+ *
+ * Binary form, in the native byte order of the machine that generated it:
+ *   header (32 bytes): magic, byte order mark, number of entries, size of the names
+ *   doubles of latitude and longitude for each entry
+ *   u32 offset into the names for each entry
+ *   the NUL terminated timezone names
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <string.h>
+#include <stdio.h>
+#include <glib/gstdio.h>
+#include "latlontz.h"
+#include "flatkdtree.h"
+
+#define LATLONTZ_MAGIC "VIKLLTZ1"
+#define LATLONTZ_BYTE_ORDER 0x01020304
+
+typedef struct {
+	gchar magic[8];
+	guint32 byte_order;
+	guint32 count;
+	guint32 names_size;
+	guint32 reserved[3];
+} LatLonTZHeader;
+
+struct _LatLonTZ {
+	GMappedFile *mf; // When loaded from binary
+	gchar *data;     // Otherwise when built here
+	gsize length;
+	guint count;
+	const gdouble *coords;
+	const guint32 *names;
+	const gchar *strings;
+	FlatKDTree *tree;
+};
+
+/**
+ * Point the lookup at the tables within the data, after checking it is all consistent
+ */
+static gboolean latlontz_set_data ( LatLonTZ *lltz, const gchar *data, gsize length )
+{
+	const LatLonTZHeader *header = (const LatLonTZHeader*)data;
+	if ( length < sizeof(LatLonTZHeader) )
+		return FALSE;
+	if ( memcmp ( header->magic, LATLONTZ_MAGIC, sizeof(header->magic) ) )
+		return FALSE;
+	if ( header->byte_order != LATLONTZ_BYTE_ORDER )
+		return FALSE;
+	guint64 expected = sizeof(LatLonTZHeader) + (guint64)header->count * (2 * sizeof(gdouble) + sizeof(guint32)) + header->names_size;
+	if ( expected != length || header->names_size == 0 )
+		return FALSE;
+
+	lltz->count = header->count;
+	lltz->coords = (const gdouble*)(data + sizeof(LatLonTZHeader));
+	lltz->names = (const guint32*)(lltz->coords + 2 * lltz->count);
+	lltz->strings = (const gchar*)(lltz->names + lltz->count);
+	if ( lltz->strings[header->names_size - 1] != '\0' )
+		return FALSE;
+	for ( guint ii = 0; ii < lltz->count; ii++ )
+		if ( lltz->names[ii] >= header->names_size )
+			return FALSE;
+	lltz->tree = a_flat_kdtree_new_static ( lltz->coords, lltz->count );
+	return TRUE;
+}
+
+/**
+ * a_latlontz_new_from_text:
+ * @filename: File with lines of: latitude, longitude and timezone separated by spaces
+ *
+ * Returns: The lookup of the locations, or NULL if the file could not be read
+ */
+LatLonTZ *a_latlontz_new_from_text ( const gchar *filename )
+{
+	FILE *ff = g_fopen ( filename, "r" );
+	if ( !ff ) {
+		g_warning ( "%s: Could not open %s", __FUNCTION__, filename );
+		return NULL;
+	}
+
+	GArray *coords_in = g_array_new ( FALSE, FALSE, sizeof(gdouble) );
+	GArray *names_in = g_array_new ( FALSE, FALSE, sizeof(guint32) );
+	GString *strings = g_string_new ( NULL );
+	GHashTable *offsets = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+
+	gchar buffer[4096];
+	long line_num = 0;
+	while ( fgets ( buffer, 4096, ff ) ) {
+		line_num++;
+		gchar **components = g_strsplit ( buffer, " ", 3 );
+		if ( g_strv_length ( components ) == 3 ) {
+			gdouble coord[2];
+			coord[0] = g_ascii_strtod ( components[0], NULL );
+			coord[1] = g_ascii_strtod ( components[1], NULL );
+			gchar *timezone = g_strchomp ( components[2] );
+			guint32 name;
+			gpointer offset;
+			if ( g_hash_table_lookup_extended ( offsets, timezone, NULL, &offset ) )
+				name = GPOINTER_TO_UINT(offset);
+			else {
+				name = strings->len;
+				g_string_append_len ( strings, timezone, strlen(timezone) + 1 );
+				g_hash_table_insert ( offsets, g_strdup(timezone), GUINT_TO_POINTER(name) );
+			}
+			g_array_append_vals ( coords_in, coord, 2 );
+			g_array_append_val ( names_in, name );
+		} else {
+			g_warning ( "Line %ld of %s does not have 3 parts", line_num, filename );
+		}
+		g_strfreev ( components );
+	}
+	fclose ( ff );
+	g_hash_table_destroy ( offsets );
+
+	LatLonTZ *lltz = NULL;
+	guint count = names_in->len;
+	if ( count ) {
+		// Each name goes along with its location
+		a_flat_kdtree_order ( (gdouble*)coords_in->data, (guint32*)names_in->data, count );
+
+		lltz = g_malloc0 ( sizeof(LatLonTZ) );
+		lltz->length = sizeof(LatLonTZHeader) + count * (2 * sizeof(gdouble) + sizeof(guint32)) + strings->len;
+		lltz->data = g_malloc0 ( lltz->length );
+
+		LatLonTZHeader *header = (LatLonTZHeader*)lltz->data;
+		memcpy ( header->magic, LATLONTZ_MAGIC, sizeof(header->magic) );
+		header->byte_order = LATLONTZ_BYTE_ORDER;
+		header->count = count;
+		header->names_size = strings->len;
+
+		gdouble *coords = (gdouble*)(lltz->data + sizeof(LatLonTZHeader));
+		guint32 *names = (guint32*)(coords + 2 * count);
+		memcpy ( coords, coords_in->data, 2 * count * sizeof(gdouble) );
+		memcpy ( names, names_in->data, count * sizeof(guint32) );
+		memcpy ( names + count, strings->str, strings->len );
+
+		(void)latlontz_set_data ( lltz, lltz->data, lltz->length );
+	}
+
+	g_string_free ( strings, TRUE );
+	g_array_free ( names_in, TRUE );
+	g_array_free ( coords_in, TRUE );
+	return lltz;
+}
+
+/**
+ * a_latlontz_new_from_binary:
+ * @filename: File as written by a_latlontz_write_binary()
+ *
+ * The file is memory mapped rather than read in.
+ *
+ * Returns: The lookup of the locations, or NULL if the file is not available or not valid for this machine
+ */
+LatLonTZ *a_latlontz_new_from_binary ( const gchar *filename )
+{
+	GError *error = NULL;
+	GMappedFile *mf = g_mapped_file_new ( filename, FALSE, &error );
+	if ( !mf ) {
+		g_debug ( "%s: %s", __FUNCTION__, error->message );
+		g_error_free ( error );
+		return NULL;
+	}
+
+	LatLonTZ *lltz = g_malloc0 ( sizeof(LatLonTZ) );
+	lltz->mf = mf;
+	lltz->length = g_mapped_file_get_length ( mf );
+	if ( !latlontz_set_data ( lltz, g_mapped_file_get_contents(mf), lltz->length ) ) {
+		g_warning ( "%s: Ignoring invalid file %s", __FUNCTION__, filename );
+		a_latlontz_free ( lltz );
+		return NULL;
+	}
+	return lltz;
+}
+
+/**
+ * a_latlontz_write_binary:
+ *
+ * Save the lookup for use by a_latlontz_new_from_binary()
+ */
+gboolean a_latlontz_write_binary ( LatLonTZ *lltz, const gchar *filename, GError **error )
+{
+	const gchar *contents = lltz->mf ? g_mapped_file_get_contents ( lltz->mf ) : lltz->data;
+	return g_file_set_contents ( filename, contents, lltz->length, error );
+}
+
+guint a_latlontz_size ( LatLonTZ *lltz )
+{
+	return lltz->count;
+}
+
+/**
+ * a_latlontz_nearest:
+ * @distance: On input the maximum distance (in degrees) to consider,
+ *            updated to the distance of any nearer location found
+ *
+ * Returns: The timezone of the nearest location less than the distance away, or NULL if none.
+ *          The string is owned by the lookup.
+ */
+const gchar *a_latlontz_nearest ( LatLonTZ *lltz, gdouble lat, gdouble lon, gdouble *distance )
+{
+	const gdouble pt[2] = { lat, lon };
+	// The ids of the tree are the positions of the locations
+	gint best = a_flat_kdtree_nearest ( lltz->tree, pt, distance );
+	if ( best < 0 )
+		return NULL;
+	return lltz->strings + lltz->names[best];
+}
+
+void a_latlontz_free ( LatLonTZ *lltz )
+{
+	if ( !lltz )
+		return;
+	a_flat_kdtree_free ( lltz->tree );
+	if ( lltz->mf )
+		g_mapped_file_unref ( lltz->mf );
+	g_free ( lltz->data );
+	g_free ( lltz );
+}
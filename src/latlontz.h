@@ -0,0 +1,39 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _VIKING_LATLONTZ_H
+#define _VIKING_LATLONTZ_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// A lookup of the nearest known location with timezone, as a kd-tree stored in a flat array
+typedef struct _LatLonTZ LatLonTZ;
+
+LatLonTZ *a_latlontz_new_from_text ( const gchar *filename );
+LatLonTZ *a_latlontz_new_from_binary ( const gchar *filename );
+gboolean a_latlontz_write_binary ( LatLonTZ *lltz, const gchar *filename, GError **error );
+guint a_latlontz_size ( LatLonTZ *lltz );
+const gchar *a_latlontz_nearest ( LatLonTZ *lltz, gdouble lat, gdouble lon, gdouble *distance );
+void a_latlontz_free ( LatLonTZ *lltz );
+
+G_END_DECLS
+
+#endif
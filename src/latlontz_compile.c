@@ -0,0 +1,47 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * Build time conversion of latlontz.txt into the binary form that is memory mapped at runtime
+ *
+ * Usage: latlontz_compile latlontz.txt latlontz.bin
+ */
+#include <stdio.h>
+#include "latlontz.h"
+
+int main ( int argc, char *argv[] )
+{
+	if ( argc != 3 ) {
+		fprintf ( stderr, "Usage: %s latlontz.txt latlontz.bin\n", argv[0] );
+		return 1;
+	}
+
+	LatLonTZ *lltz = a_latlontz_new_from_text ( argv[1] );
+	if ( !lltz )
+		return 2;
+
+	int ans = 0;
+	GError *error = NULL;
+	if ( !a_latlontz_write_binary ( lltz, argv[2], &error ) ) {
+		fprintf ( stderr, "%s: %s\n", argv[0], error->message );
+		g_error_free ( error );
+		ans = 3;
+	}
+	a_latlontz_free ( lltz );
+	return ans;
+}
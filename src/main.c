@@ -26,7 +26,17 @@
 #include "viking.h"
 #include "icons/icons.h"
 #include "mapcache.h"
+#include "existcache.h"
+#include "imagecache.h"
+#include "pixbufpool.h"
+#include "diskcache.h"
 #include "background.h"
+#include "autosave.h"
+#include "warmcache.h"
+#include "peercache.h"
+#ifdef VIK_CONFIG_GEOTAG
+#include "geotagindex.h"
+#endif
 #include "dems.h"
 #include "babel.h"
 #include "curl_download.h"
@@ -39,6 +49,8 @@
 #include "thumbnails.h"
 #include "viktrwlayer_export.h"
 #include "modules.h"
+#include "renderbench.h"
+#include "trace.h"
 
 /* FIXME LOCALEDIR must be configured by ./configure --localedir */
 /* But something does not work actually. */
@@ -54,6 +66,14 @@ static gdouble longitude = 0.0;
 static gint zoom_level_osm = -1;
 static gint map_id = -1;
 static gboolean external = FALSE;
+static gboolean profile_startup = FALSE;
+static gboolean render_benchmark = FALSE;
+static gchar *render_script = NULL;
+static gchar *trace_file = NULL;
+static gboolean single_instance = FALSE;
+
+#define VIK_SETTINGS_SINGLE_INSTANCE "single_instance"
+#define VIKING_APPLICATION_ID "net.sourceforge.viking"
 
 /* Options */
 static GOptionEntry entries[] = 
@@ -66,21 +86,216 @@ static GOptionEntry entries[] =
   { "zoom", 'z', 0, G_OPTION_ARG_INT, &zoom_level_osm, N_("Zoom Level (OSM). Value can be 0 - 22"), NULL },
   { "map", 'm', 0, G_OPTION_ARG_INT, &map_id, N_("Add a map layer by id value. Use 0 for the default map."), NULL },
   { "external", 'e', 0, G_OPTION_ARG_NONE, &external, N_("Load all GPX files in external mode."), NULL },
+  { "profile-startup", 0, 0, G_OPTION_ARG_NONE, &profile_startup, N_("Show the time taken by each stage of startup"), NULL },
+  { "render-benchmark", 0, 0, G_OPTION_ARG_NONE, &render_benchmark, N_("Draw each file offscreen through a sequence of views, report the timings and exit"), NULL },
+  { "render-script", 0, 0, G_OPTION_ARG_FILENAME, &render_script, N_("File of views for the render benchmark"), N_("FILE") },
+  { "trace", 0, 0, G_OPTION_ARG_FILENAME, &trace_file, N_("Trace background jobs, downloads and the map cache, saving to this file on exit"), N_("FILE") },
+  { "single-instance", 0, 0, G_OPTION_ARG_NONE, &single_instance, N_("Open the files in the Viking already running, if there is one"), NULL },
   { NULL }
 };
 
+static gint64 startup_begin = 0;
+static gint64 startup_last = 0;
+
+/**
+ * Report the time taken since the previous stage when profiling startup
+ */
+static void startup_stage ( const gchar *stage )
+{
+  if ( !profile_startup )
+    return;
+  gint64 now = g_get_monotonic_time ();
+  (void)g_fprintf ( stderr, "%9.1f ms  %s\n", (now - startup_last) / 1000.0, stage );
+  startup_last = now;
+}
+
+/**
+ * Once the main loop first becomes idle the first window has been shown
+ */
+static gboolean startup_finished ( gpointer data )
+{
+  startup_stage ( "first window shown" );
+  (void)g_fprintf ( stderr, "%9.1f ms  total\n", (startup_last - startup_begin) / 1000.0 );
+  return FALSE;
+}
+
+/**
+ * Open each file on the command line (from argv[1] onwards) into the window,
+ *  except that any further .vik files get a window of their own
+ */
+static void open_files ( VikWindow *first_window, gint argc, gchar **argv, gboolean ext )
+{
+  gboolean dashdash_already = FALSE;
+  for ( gint i = 1; i < argc; i++ ) {
+    if ( strcmp(argv[i],"--") == 0 && !dashdash_already )
+      dashdash_already = TRUE; /* hack to open '-' */
+    else {
+      VikWindow *newvw = first_window;
+      gboolean change_filename = (i == 1);
+
+      // Open any subsequent .vik files in their own window
+      if ( i > 1 && check_file_magic_vik ( argv[i] ) ) {
+        newvw = vik_window_new_window ();
+        change_filename = TRUE;
+      }
+
+      vik_window_open_file ( newvw, argv[i], change_filename, (i==1), (i+1 == argc), TRUE, ext );
+    }
+  }
+}
+
+/*
+ * Single instance mode
+ * The first Viking registers on the session bus, then any started later pass their files
+ *  and positioning options to it (as a command line) and exit,
+ *  so the files get opened in a new window of the first, with everything it already has loaded.
+ */
+static gboolean windows_ready = FALSE;
+static GList *pending_command_lines = NULL;
+
+static void single_instance_open ( GApplicationCommandLine *cmdline )
+{
+  gdouble lat = 0.0;
+  gdouble lon = 0.0;
+  gint zoom = -1;
+  gint map = -1;
+  gboolean ext = FALSE;
+  GOptionEntry forwarded_entries[] = {
+    { "latitude", 0, 0, G_OPTION_ARG_DOUBLE, &lat, NULL, NULL },
+    { "longitude", 0, 0, G_OPTION_ARG_DOUBLE, &lon, NULL, NULL },
+    { "zoom", 'z', 0, G_OPTION_ARG_INT, &zoom, NULL, NULL },
+    { "map", 'm', 0, G_OPTION_ARG_INT, &map, NULL, NULL },
+    { "external", 'e', 0, G_OPTION_ARG_NONE, &ext, NULL, NULL },
+    { NULL }
+  };
+
+  gint argc = 0;
+  gchar **arguments = g_application_command_line_get_arguments ( cmdline, &argc );
+  // Parsing removes the options from the array, so use a copy to still be able to free them all
+  gchar **argv = g_memdup ( arguments, (argc+1) * sizeof(gchar*) );
+  GOptionContext *context = g_option_context_new ( NULL );
+  g_option_context_add_main_entries ( context, forwarded_entries, NULL );
+  g_option_context_set_help_enabled ( context, FALSE );
+  GError *error = NULL;
+  if ( !g_option_context_parse ( context, &argc, &argv, &error ) ) {
+    g_application_command_line_printerr ( cmdline, "%s\n", error->message );
+    g_application_command_line_set_exit_status ( cmdline, EXIT_FAILURE );
+    g_error_free ( error );
+  }
+  else {
+    VikWindow *vw = vik_window_new_window ();
+    if ( vw ) {
+      open_files ( vw, argc, argv, ext );
+      vik_window_new_window_finish ( vw );
+      vu_command_line ( vw, lat, lon, zoom, map );
+      gtk_window_present ( GTK_WINDOW(vw) );
+    }
+    else {
+      g_application_command_line_printerr ( cmdline, "%s\n", _("Too many windows are open") );
+      g_application_command_line_set_exit_status ( cmdline, EXIT_FAILURE );
+    }
+  }
+  g_option_context_free ( context );
+  g_free ( argv );
+  g_strfreev ( arguments );
+}
+
+/**
+ * A later instance has passed on its command line
+ */
+static gint single_instance_command_line ( GApplication *app, GApplicationCommandLine *cmdline, gpointer data )
+{
+  // Until the first window is set up, keep it for then
+  //  (the other instance waits until the command line is released)
+  if ( !windows_ready ) {
+    pending_command_lines = g_list_append ( pending_command_lines, g_object_ref ( cmdline ) );
+    return EXIT_SUCCESS;
+  }
+  single_instance_open ( cmdline );
+  return g_application_command_line_get_exit_status ( cmdline );
+}
+
+static void single_instance_ready ( void )
+{
+  windows_ready = TRUE;
+  for ( GList *iter = pending_command_lines; iter; iter = iter->next ) {
+    single_instance_open ( iter->data );
+    g_object_unref ( iter->data );
+  }
+  g_list_free ( pending_command_lines );
+  pending_command_lines = NULL;
+}
+
+/**
+ * Returns: The application, which is remote if another instance is already running,
+ *  or NULL if registering failed
+ */
+static GApplication *single_instance_register ( void )
+{
+  GApplication *app = g_application_new ( VIKING_APPLICATION_ID, G_APPLICATION_HANDLES_COMMAND_LINE );
+  g_signal_connect ( app, "command-line", G_CALLBACK(single_instance_command_line), NULL );
+  GError *error = NULL;
+  if ( !g_application_register ( app, NULL, &error ) ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+    g_object_unref ( app );
+    return NULL;
+  }
+  return app;
+}
+
+/**
+ * Pass the files and positioning options on to the instance already running,
+ *  as absolute filenames since it has its own working directory
+ *
+ * Returns: FALSE if they can not be passed on (i.e. reading from stdin)
+ */
+static gboolean single_instance_forward ( GApplication *app, gint argc, gchar **argv, gint *status )
+{
+  for ( gint i = 1; i < argc; i++ )
+    if ( strcmp(argv[i], "-") == 0 || strcmp(argv[i], "--") == 0 )
+      return FALSE;
+
+  GPtrArray *args = g_ptr_array_new_with_free_func ( g_free );
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+  g_ptr_array_add ( args, g_strdup ( argv[0] ) );
+  g_ptr_array_add ( args, g_strconcat ( "--latitude=", g_ascii_dtostr ( buf, sizeof(buf), latitude ), NULL ) );
+  g_ptr_array_add ( args, g_strconcat ( "--longitude=", g_ascii_dtostr ( buf, sizeof(buf), longitude ), NULL ) );
+  g_ptr_array_add ( args, g_strdup_printf ( "--zoom=%d", zoom_level_osm ) );
+  g_ptr_array_add ( args, g_strdup_printf ( "--map=%d", map_id ) );
+  if ( external )
+    g_ptr_array_add ( args, g_strdup ( "--external" ) );
+
+  gchar *cwd = g_get_current_dir ();
+  for ( gint i = 1; i < argc; i++ ) {
+    if ( g_path_is_absolute ( argv[i] ) )
+      g_ptr_array_add ( args, g_strdup ( argv[i] ) );
+    else
+      g_ptr_array_add ( args, g_build_filename ( cwd, argv[i], NULL ) );
+  }
+  g_free ( cwd );
+
+  g_ptr_array_add ( args, NULL );
+  *status = g_application_run ( app, args->len - 1, (gchar**)args->pdata );
+  g_ptr_array_free ( args, TRUE );
+  return TRUE;
+}
+
 int main( int argc, char *argv[] )
 {
   VikWindow *first_window;
-  gboolean dashdash_already = FALSE;
+  GApplication *app = NULL;
   int i = 0;
   GError *error = NULL;
   gboolean gui_initialized;
+  int exit_code = EXIT_SUCCESS;
 	
   bindtextdomain (GETTEXT_PACKAGE, LOCALEDIR);  
   bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
   textdomain (GETTEXT_PACKAGE);
 
+  startup_begin = startup_last = g_get_monotonic_time ();
+
   gui_initialized = gtk_init_with_args (&argc, &argv, "files+", entries, NULL, &error);
   if (!gui_initialized)
   {
@@ -107,8 +322,30 @@ int main( int argc, char *argv[] )
     return EXIT_SUCCESS;
   }
 
+  a_settings_init ();
+
+  // Hand over to the instance already running, before doing anything else
+  if ( !single_instance )
+    (void)a_settings_get_boolean ( VIK_SETTINGS_SINGLE_INSTANCE, &single_instance );
+  if ( single_instance && !render_benchmark ) {
+    app = single_instance_register ();
+    if ( app && g_application_get_is_remote ( app ) ) {
+      if ( single_instance_forward ( app, argc, argv, &exit_code ) ) {
+        g_object_unref ( app );
+        a_settings_uninit ();
+        return exit_code;
+      }
+      // Carry on as a separate instance
+      g_clear_object ( &app );
+    }
+  }
+
+  if ( trace_file )
+    a_trace_start ();
+
   // Ensure correct capitalization of the program name
   g_set_application_name ("Viking");
+  startup_stage ( "gtk init" );
 
   a_logging_init ();
 
@@ -118,9 +355,9 @@ int main( int argc, char *argv[] )
   vik_icons_register_resource ();
   ui_load_icons();
 
-  a_settings_init ();
   a_preferences_init ();
   a_thumbnails_init ();
+  startup_stage ( "settings, preferences and icons" );
 
  /*
   * First stage initialization
@@ -137,24 +374,35 @@ int main( int argc, char *argv[] )
 
   a_download_init();
   curl_download_init();
+  startup_stage ( "download" );
 
   a_babel_init ();
 
   /* Init modules/plugins */
   modules_init();
+  startup_stage ( "modules (map sources, tools, routing and datasources)" );
 
   vik_georef_layer_init ();
   maps_layer_init ();
   a_mapcache_init ();
+  a_existcache_init ();
+  a_image_cache_init ();
+  a_pixbuf_pool_init ();
+  a_diskcache_init ();
   a_background_init ();
+  a_autosave_init ();
+  a_warmcache_init ();
+  a_peercache_init ();
 
   a_toolbar_init();
   vik_routing_prefs_init();
   vik_trw_layer_export_init();
   vik_trw_layer_propwin_init();
+  startup_stage ( "layers, toolbar and routing preferences" );
 
   // Registration of preferences has now been done
   a_preferences_finished_registering();
+  startup_stage ( "preferences loaded" );
 
   /*
    * Second stage initialization
@@ -162,12 +410,26 @@ int main( int argc, char *argv[] )
    * Can now use a_preferences_get()
    */
   a_background_post_init ();
+  a_vik_refresh_preferences ();
+  a_mapcache_refresh_preferences ();
+  a_peercache_refresh_preferences ();
+  a_warmcache_post_init ();
+  startup_stage ( "map and DEM cache from the last session" );
   a_babel_post_init ();
+  startup_stage ( "gpsbabel located (features load in the background)" );
   modules_post_init ();
+  startup_stage ( "modules post init" );
 
-  // May need to initialize the Positonal TimeZone lookup
-  if ( a_vik_get_time_ref_frame() == VIK_TIME_REF_WORLD )
-    vu_setup_lat_lon_tz_lookup();
+  // The Positonal TimeZone lookup is initialized when first needed
+  //  see vu_get_tz_at_location()
+
+  if ( render_benchmark ) {
+    while ( ++i < argc ) {
+      if ( !a_render_benchmark ( argv[i], render_script ) )
+        exit_code = EXIT_FAILURE;
+    }
+    goto finish;
+  }
 
   /* Set the icon */
   GdkPixbuf *main_icon = ui_get_icon ( "viking", 48 );
@@ -179,10 +441,12 @@ int main( int argc, char *argv[] )
 
   /* Create the first window */
   first_window = vik_window_new_window();
+  startup_stage ( "first window created" );
 
   a_logging_update();
 
   vu_check_latest_version ( GTK_WINDOW(first_window) );
+  startup_stage ( "logging and version check" );
 
   // Load startup file first so that subsequent files are loaded on top
   // Especially so that new tracks+waypoints will be above any maps in a startup file
@@ -199,37 +463,60 @@ int main( int argc, char *argv[] )
       vik_window_open_file ( first_window, a_vik_get_startup_file(), TRUE, TRUE, TRUE, TRUE, FALSE );
   }
 
-  while ( ++i < argc ) {
-    if ( strcmp(argv[i],"--") == 0 && !dashdash_already )
-      dashdash_already = TRUE; /* hack to open '-' */
-    else {
-      VikWindow *newvw = first_window;
-      gboolean change_filename = (i == 1);
+  open_files ( first_window, argc, argv, external );
 
-      // Open any subsequent .vik files in their own window
-      if ( i > 1 && check_file_magic_vik ( argv[i] ) ) {
-        newvw = vik_window_new_window ();
-        change_filename = TRUE;
-      }
-
-      vik_window_open_file ( newvw, argv[i], change_filename, (i==1), (i+1 == argc), TRUE, external );
-    }
-  }
+  // After the files, so any recovered work goes into the first window only if it is still empty
+  vik_window_recover ( first_window );
 
   vik_window_new_window_finish ( first_window );
+  startup_stage ( "files opened" );
 
   vu_command_line ( first_window, latitude, longitude, zoom_level_osm, map_id );
+  startup_stage ( "command line positioning" );
+
+  // Now any files passed on from later instances can be opened
+  if ( app )
+    single_instance_ready ();
+
+  if ( profile_startup )
+    g_idle_add ( startup_finished, NULL );
 
   gtk_main ();
 
+ finish:
+  if ( trace_file ) {
+    GError *trace_error = NULL;
+    if ( !a_trace_save ( trace_file, &trace_error ) ) {
+      g_warning ( "Failed to save the trace: %s", trace_error->message );
+      g_error_free ( trace_error );
+    }
+  }
+
+  if ( app )
+    g_object_unref ( app );
+
+  // Don't leave before saves are safely written
+  a_file_save_wait ();
+  a_autosave_uninit ();
+  a_warmcache_save ();
+
   vik_trwlayer_uninit ();
   vik_aggregate_layer_uninit ();
   a_babel_uninit ();
   a_toolbar_uninit ();
   a_background_uninit ();
+  a_peercache_uninit ();
+#ifdef VIK_CONFIG_GEOTAG
+  a_geotag_index_uninit ();
+#endif
   maps_layer_uninit ();
   a_mapcache_uninit ();
+  a_existcache_uninit ();
+  a_image_cache_uninit ();
+  a_pixbuf_pool_uninit ();
+  a_diskcache_uninit ();
   a_dems_uninit ();
+  a_warmcache_uninit ();
   a_layer_defaults_uninit ();
   a_thumbnails_uninit ();
   a_preferences_uninit ();
@@ -246,5 +533,8 @@ int main( int argc, char *argv[] )
   // Clean up any temporary files
   util_remove_all_in_deletion_list ();
 
-  return 0;
+  g_free ( render_script );
+  g_free ( trace_file );
+
+  return exit_code;
 }
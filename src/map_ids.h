@@ -30,6 +30,8 @@
 #define MAP_ID_EXPEDIA 5
 
 #define MAP_ID_MAPNIK_RENDER 7
+#define MAP_ID_DEM_RENDER 8
+#define MAP_ID_GEOREF_TILES 9
  
 // Mostly OSM related - except the Blue Marble value
 #define MAP_ID_OSM_MAPNIK 13
@@ -47,6 +49,10 @@
 
 #define MAP_ID_OPEN_TOPO_MAP 901
 
+// The HiDPI version of a map (see the "url-hidpi" property of map sources)
+//  is given the id of the map plus this
+#define MAP_ID_HIDPI_OFFSET 0x8000
+
 // Unfortunately previous ID allocations have been a little haphazard,
 //  but hopefully future IDs can be follow this scheme:
 //   0 to 31 are intended for hard coded internal defaults
@@ -24,243 +24,799 @@
 
 #include <glib/gi18n.h>
 #include <string.h>
+#include <math.h>
 #include "globals.h"
 #include "mapcache.h"
 #include "preferences.h"
 #include "vik_compat.h"
+#include "trace.h"
+#include "warmcache.h"
 
-#define MC_KEY_SIZE 64
-
-typedef struct _List {
-  struct _List *next;
-  gchar *key;
-} List;
-
-/* a circular linked list, a pointer to the tail, and the tail points to the head */
-/* this is so we can free the last */
-static List *queue_tail = NULL;
-static int queue_count = 0;
-
-static guint32 cache_size = 0;
-static guint32 max_cache_size = VIK_CONFIG_MAPCACHE_SIZE * 1024 * 1024;
+/*
+ * The cache is split into a number of shards, selected by the key hash.
+ * Each shard has its own lock, hash table and LRU queue,
+ *  so the main thread, the Mapnik render threads and the download threads do not
+ *  all serialise on a single mutex.
+ * Must be a power of 2.
+ */
+#define MC_NUM_SHARDS 16
 
-static GHashTable *cache = NULL;
+/*
+ * Packed key - replaces the old printf'd string key.
+ * Shrink factors are stored to 3 decimal places (as the old "%.3f" key did),
+ *  so near identical floating point values still map to the same tile.
+ */
+typedef struct {
+  gint32 x;
+  gint32 y;
+  gint32 z;
+  gint32 zoom;
+  guint32 name_hash;
+  gint32 xshrink;
+  gint32 yshrink;
+  guint16 type;
+  guint8 alpha;
+} mc_key_t;
 
 typedef struct {
+  mc_key_t key;
   GdkPixbuf *pixbuf;
   mapcache_extra_t extra;
+  guint32 size;
+  gconstpointer layer; // Layer that added this item (may be NULL) - only used for accounting
+  GList link; // Embedded node in the shard's LRU queue - so no separate allocation
+  GList variant_link; // Embedded node in the pyramid's list of variants of this tile
 } cache_item_t;
 
-static GMutex *mc_mutex = NULL;
+typedef struct {
+  GMutex *mutex;
+  GHashTable *table; // Key is &cache_item_t->key, value is the cache_item_t
+  GQueue lru;        // Head is the most recently used
+  guint32 size;
+  GHashTable *type_stats;  // Map type -> mapcache_stats_t
+} mc_shard_t;
 
-#define HASHKEY_FORMAT_STRING "%d-%d-%d-%d-%d-%d-%d-%.3f-%.3f"
-#define HASHKEY_FORMAT_STRING_NOSHRINK_NOR_ALPHA "%d-%d-%d-%d-%d-%d-"
-#define HASHKEY_FORMAT_STRING_TYPE "%d-"
+static mc_shard_t shards[MC_NUM_SHARDS];
+
+/*
+ * Per layer accounting, across all the shards.
+ * Only layers between a_mapcache_add_layer() and a_mapcache_remove_layer() are accounted,
+ *  so background jobs finishing after their layer has gone do not bring it back.
+ * This lock may be taken with a shard locked, but never the other way round.
+ */
+typedef struct {
+  mapcache_stats_t stats;
+  guint32 quota; // Soft limit on the layer's bytes. 0 means no quota
+  guint next_shard; // Where trimming to the quota carries on from
+} mc_layer_t;
+
+static GMutex layers_mutex;
+static GHashTable *layers = NULL; // Layer pointer -> mc_layer_t
+
+/*
+ * The tile pyramid - which tiles (in any shrinkfactor or alpha variant) are in the cache,
+ *  and how many of the tiles at the higher zoom levels beneath each tile are too.
+ * Thus when a tile is not available, the nearest zoom level that can stand in for it
+ *  is found from this index, rather than probing the cache for every possible scale.
+ * The key is the tile key without the alpha and shrinkfactors.
+ * Items are only added and removed with their shard locked, then taking this lock
+ *  (never the other way round), so an item is always valid whilst in a variants list.
+ */
+#define MC_PYRAMID_LEVELS 8
+
+typedef struct {
+  mc_key_t key;
+  GQueue variants;   // of cache_item_t
+  guint32 descendants; // Tiles in the cache within MC_PYRAMID_LEVELS zoom levels below
+} mc_pyr_node_t;
+
+static GMutex pyr_mutex;
+static GHashTable *pyr_table = NULL; // Key is &mc_pyr_node_t->key
+
+// Only updated via a_mapcache_refresh_preferences()
+static volatile guint32 max_cache_size = VIK_CONFIG_MAPCACHE_SIZE * 1024 * 1024;
+
+/*
+ * The memory limit is for the whole cache rather than a fixed share per shard,
+ *  so all of it is used however the items happen to be spread over the shards.
+ * Thus the sizes of all the shards are also kept in total, only changed atomically.
+ */
+static volatile gsize cache_size = 0;
+
+/*
+ * Second tier - the encoded tile file data (e.g. PNG or JPEG as downloaded)
+ * Much smaller than the decoded pixbufs, so many more tiles can be kept in memory,
+ *  which then avoids filesystem access when the decoded version has been evicted.
+ * The key is as per the first tier, but without the alpha and shrinkfactors.
+ */
+typedef struct {
+  mc_key_t key;
+  GBytes *bytes;
+  guint32 size;
+  GList link;
+} enc_item_t;
+
+typedef struct {
+  GMutex *mutex;
+  GHashTable *table;
+  GQueue lru;
+  guint32 size;
+  mapcache_stats_t stats;
+} enc_shard_t;
+
+static enc_shard_t enc_shards[MC_NUM_SHARDS];
+
+#define VIK_CONFIG_MAPCACHE_ENCODED_SIZE 64
+static volatile guint32 max_enc_cache_size = VIK_CONFIG_MAPCACHE_ENCODED_SIZE * 1024 * 1024;
+static volatile gsize enc_cache_size = 0;
+
+// ATM size of 'extra' data hardly worth trying to count (compared to pixbuf sizes)
+// Not sure what this 100 represents anyway - probably a guess at an average pixbuf metadata size
+#define MC_ITEM_OVERHEAD 100
 
 static VikLayerParamScale params_scales[] = {
   /* min, max, step, digits (decimal places) */
  { 1, 4096, 4, 0 },
 };
 
+static VikLayerParamScale params_scales_enc[] = {
+ { 0, 4096, 4, 0 },
+};
+
 static VikLayerParamData mcs_default ( void ) { return VIK_LPD_UINT(VIK_CONFIG_MAPCACHE_SIZE); }
+static VikLayerParamData mces_default ( void ) { return VIK_LPD_UINT(VIK_CONFIG_MAPCACHE_ENCODED_SIZE); }
 
 static VikLayerParam prefs[] = {
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "mapcache_size", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Map cache memory size (MB):"), VIK_LAYER_WIDGET_HSCALE, params_scales, NULL, NULL, mcs_default, NULL, NULL },
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "mapcache_encoded_size", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Map file cache memory size (MB):"), VIK_LAYER_WIDGET_HSCALE, params_scales_enc, NULL,
+    N_("Memory used to keep the undecoded tile file data, to avoid rereading from disk. 0 disables this cache."), mces_default, NULL, NULL },
 };
 
-static void cache_item_free (cache_item_t *ci)
+static inline gint32 shrink_to_key ( gdouble shrinkfactor )
+{
+  return (gint32)lround ( shrinkfactor * 1000.0 );
+}
+
+static inline void key_set ( mc_key_t *key, gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar *name )
+{
+  // Zero everything first, so any structure padding is consistent
+  memset ( key, 0, sizeof(mc_key_t) );
+  key->x = x;
+  key->y = y;
+  key->z = z;
+  key->zoom = zoom;
+  key->name_hash = name ? g_str_hash ( name ) : 0;
+  key->xshrink = shrink_to_key ( xshrinkfactor );
+  key->yshrink = shrink_to_key ( yshrinkfactor );
+  key->type = type;
+  key->alpha = alpha;
+}
+
+/**
+ * Hash that mixes all the key fields, but deliberately ignores alpha and the shrink factors.
+ * Thus all variants of the same tile end up in the same shard,
+ *  allowing a_mapcache_remove_all_shrinkfactors() to only lock and search one shard.
+ */
+static inline guint32 key_tile_hash ( const mc_key_t *key )
+{
+  guint32 hh = 2166136261u;
+  hh = (hh ^ (guint32)key->x) * 16777619u;
+  hh = (hh ^ (guint32)key->y) * 16777619u;
+  hh = (hh ^ (guint32)key->z) * 16777619u;
+  hh = (hh ^ (guint32)key->zoom) * 16777619u;
+  hh = (hh ^ key->name_hash) * 16777619u;
+  hh = (hh ^ key->type) * 16777619u;
+  // Final avalanche, so the low bits used for the shard selection are well distributed
+  hh ^= hh >> 16;
+  hh *= 0x85ebca6bu;
+  hh ^= hh >> 13;
+  return hh;
+}
+
+static guint mc_key_hash ( gconstpointer ptr )
+{
+  const mc_key_t *key = ptr;
+  guint32 hh = key_tile_hash ( key );
+  hh = (hh ^ (guint32)key->xshrink) * 16777619u;
+  hh = (hh ^ (guint32)key->yshrink) * 16777619u;
+  hh = (hh ^ key->alpha) * 16777619u;
+  return hh;
+}
+
+static gboolean mc_key_equal ( gconstpointer aa, gconstpointer bb )
+{
+  return memcmp ( aa, bb, sizeof(mc_key_t) ) == 0;
+}
+
+static inline mc_shard_t *shard_for_key ( const mc_key_t *key )
+{
+  return &shards[key_tile_hash(key) & (MC_NUM_SHARDS-1)];
+}
+
+static inline void key_parent ( const mc_key_t *key, mc_key_t *parent )
+{
+  *parent = *key;
+  parent->x = key->x / 2;
+  parent->y = key->y / 2;
+  parent->zoom = key->zoom + 1;
+}
+
+/**
+ * Pyramid must be locked
+ */
+static mc_pyr_node_t *pyr_node_get ( const mc_key_t *tile_key )
+{
+  mc_pyr_node_t *node = g_hash_table_lookup ( pyr_table, tile_key );
+  if ( !node ) {
+    node = g_new0 ( mc_pyr_node_t, 1 );
+    node->key = *tile_key;
+    g_hash_table_insert ( pyr_table, &node->key, node );
+  }
+  return node;
+}
+
+/**
+ * Pyramid must be locked
+ */
+static void pyr_node_drop_if_unused ( mc_pyr_node_t *node )
+{
+  if ( !node->variants.length && !node->descendants )
+    g_hash_table_remove ( pyr_table, &node->key );
+}
+
+/**
+ * Pyramid must be locked
+ */
+static void pyr_update_ancestors ( const mc_key_t *tile_key, gint delta )
+{
+  mc_key_t key = *tile_key;
+  for ( guint ll = 0; ll < MC_PYRAMID_LEVELS; ll++ ) {
+    mc_key_t parent;
+    key_parent ( &key, &parent );
+    mc_pyr_node_t *node = pyr_node_get ( &parent );
+    node->descendants += delta;
+    pyr_node_drop_if_unused ( node );
+    key = parent;
+  }
+}
+
+/**
+ * Shard of the item must be locked
+ */
+static void pyr_add ( cache_item_t *ci )
+{
+  mc_key_t tile_key = ci->key;
+  tile_key.xshrink = tile_key.yshrink = 0;
+  tile_key.alpha = 0;
+  ci->variant_link.data = ci;
+  g_mutex_lock ( &pyr_mutex );
+  mc_pyr_node_t *node = pyr_node_get ( &tile_key );
+  g_queue_push_tail_link ( &node->variants, &ci->variant_link );
+  if ( node->variants.length == 1 )
+    pyr_update_ancestors ( &tile_key, 1 );
+  g_mutex_unlock ( &pyr_mutex );
+}
+
+/**
+ * Shard of the item must be locked
+ */
+static void pyr_remove ( cache_item_t *ci )
+{
+  mc_key_t tile_key = ci->key;
+  tile_key.xshrink = tile_key.yshrink = 0;
+  tile_key.alpha = 0;
+  g_mutex_lock ( &pyr_mutex );
+  mc_pyr_node_t *node = g_hash_table_lookup ( pyr_table, &tile_key );
+  if ( node ) {
+    g_queue_unlink ( &node->variants, &ci->variant_link );
+    if ( !node->variants.length ) {
+      pyr_update_ancestors ( &tile_key, -1 );
+      pyr_node_drop_if_unused ( node );
+    }
+  }
+  g_mutex_unlock ( &pyr_mutex );
+}
+
+static void cache_item_free ( cache_item_t *ci )
 {
   g_object_unref ( ci->pixbuf );
   g_free ( ci );
 }
 
+/**
+ * Shard must be locked
+ */
+static mapcache_stats_t *shard_get_type_stats ( mc_shard_t *shard, guint16 type )
+{
+  mapcache_stats_t *stats = g_hash_table_lookup ( shard->type_stats, GUINT_TO_POINTER(type) );
+  if ( !stats ) {
+    stats = g_new0 ( mapcache_stats_t, 1 );
+    g_hash_table_insert ( shard->type_stats, GUINT_TO_POINTER(type), stats );
+  }
+  return stats;
+}
+
+static void enc_item_free ( enc_item_t *ei )
+{
+  g_bytes_unref ( ei->bytes );
+  g_free ( ei );
+}
+
 void a_mapcache_init ()
 {
-  a_preferences_register ( prefs, (VikLayerParamData){0}, VIKING_PREFERENCES_GROUP_KEY );
+  pyr_table = g_hash_table_new_full ( mc_key_hash, mc_key_equal, NULL, g_free );
+  layers = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
 
-  mc_mutex = vik_mutex_new ();
-  cache = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify) cache_item_free );
+  a_preferences_register ( &prefs[0], (VikLayerParamData){0}, VIKING_PREFERENCES_GROUP_KEY );
+  a_preferences_register ( &prefs[1], (VikLayerParamData){0}, VIKING_PREFERENCES_GROUP_KEY );
+
+  for ( guint ss = 0; ss < MC_NUM_SHARDS; ss++ ) {
+    enc_shards[ss].mutex = vik_mutex_new ();
+    enc_shards[ss].table = g_hash_table_new_full ( mc_key_hash, mc_key_equal, NULL, (GDestroyNotify) enc_item_free );
+    g_queue_init ( &enc_shards[ss].lru );
+    enc_shards[ss].size = 0;
+    memset ( &enc_shards[ss].stats, 0, sizeof(mapcache_stats_t) );
+  }
+
+  for ( guint ss = 0; ss < MC_NUM_SHARDS; ss++ ) {
+    shards[ss].mutex = vik_mutex_new ();
+    shards[ss].table = g_hash_table_new_full ( mc_key_hash, mc_key_equal, NULL, (GDestroyNotify) cache_item_free );
+    g_queue_init ( &shards[ss].lru );
+    shards[ss].size = 0;
+    shards[ss].type_stats = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
+  }
 }
 
-static void cache_add(gchar *key, GdkPixbuf *pixbuf, mapcache_extra_t extra)
+/**
+ * a_mapcache_refresh_preferences:
+ *
+ * Update the memory limit from the preference value.
+ * Call once preferences are available and whenever they may have been changed,
+ *  rather than reading the preference on every cache insert.
+ */
+void a_mapcache_refresh_preferences ()
 {
-  cache_item_t *ci = g_malloc ( sizeof(cache_item_t) );
-  ci->pixbuf = pixbuf;
-  ci->extra = extra;
-  if ( g_hash_table_insert ( cache, key, ci ) )
-  {
-    cache_size += gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf);
-    // ATM size of 'extra' data hardly worth trying to count (compared to pixbuf sizes)
-    // Not sure what this 100 represents anyway - probably a guess at an average pixbuf metadata size
-    cache_size += 100;
+  max_cache_size = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "mapcache_size")->u * 1024 * 1024;
+  max_enc_cache_size = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "mapcache_encoded_size")->u * 1024 * 1024;
+}
+
+/**
+ * Remove (and free) the item from the shard
+ * Shard must be locked
+ */
+static void shard_remove_item ( mc_shard_t *shard, cache_item_t *ci, gboolean eviction )
+{
+  mapcache_stats_t *stats = shard_get_type_stats ( shard, ci->key.type );
+  stats->bytes -= ci->size;
+  stats->count--;
+  if ( eviction ) {
+    stats->evictions++;
+    VIK_TRACE_TILE ( "mapcache", "evict", TRACE_PHASE_INSTANT, ci->key.x, ci->key.y, ci->key.zoom );
   }
+
+  if ( ci->layer ) {
+    g_mutex_lock ( &layers_mutex );
+    mc_layer_t *mcl = g_hash_table_lookup ( layers, ci->layer );
+    if ( mcl ) {
+      mcl->stats.bytes -= ci->size;
+      mcl->stats.count--;
+      if ( eviction )
+        mcl->stats.evictions++;
+    }
+    g_mutex_unlock ( &layers_mutex );
+  }
+
+  pyr_remove ( ci );
+  g_queue_unlink ( &shard->lru, &ci->link );
+  shard->size -= ci->size;
+  (void)g_atomic_pointer_add ( &cache_size, -(gssize)ci->size );
+  g_hash_table_remove ( shard->table, &ci->key );
 }
 
-static void cache_remove(const gchar *key)
+/**
+ * Drop least recently used items of the shard until the whole cache is within the memory limit.
+ * As the keys are hashed evenly over the shards,
+ *  a shard's oldest items are much the same age as the oldest of the whole cache.
+ * Shard must be locked
+ */
+static void shard_trim ( mc_shard_t *shard )
 {
-  cache_item_t *ci = g_hash_table_lookup ( cache, key );
-  if (ci && ci->pixbuf) {
-    cache_size -= gdk_pixbuf_get_rowstride(ci->pixbuf) * gdk_pixbuf_get_height(ci->pixbuf);
-    cache_size -= 100;
-    g_hash_table_remove ( cache, key );
+  // Always keep at least the most recent item
+  while ( GPOINTER_TO_SIZE(g_atomic_pointer_get ( &cache_size )) > max_cache_size && shard->lru.length > 1 ) {
+    cache_item_t *oldest = shard->lru.tail->data;
+    shard_remove_item ( shard, oldest, TRUE );
   }
 }
 
-/* returns key from head, adds on newtailkey to tail. */
-static gchar *list_shift_add_entry ( gchar *newtailkey )
+/**
+ * Shard must be locked
+ * Returns: The least recently used item of the layer, other than the one to keep
+ */
+static cache_item_t *shard_oldest_of_layer ( mc_shard_t *shard, gconstpointer layer, const mc_key_t *keep )
 {
-  gchar *oldheadkey = queue_tail->next->key;
-  queue_tail->next->key = newtailkey;
-  queue_tail = queue_tail->next;
-  return oldheadkey;
+  for ( GList *iter = shard->lru.tail; iter; iter = iter->prev ) {
+    cache_item_t *ci = iter->data;
+    if ( ci->layer == layer && !( keep && mc_key_equal ( &ci->key, keep ) ) )
+      return ci;
+  }
+  return NULL;
 }
 
-static gchar *list_shift ()
+/**
+ * Drop least recently used items of the layer until it is within its soft quota.
+ * The quota is for the layer's items in all the shards,
+ *  so the shards take turns to give up their oldest item of the layer.
+ * No locks must be held
+ * @keep: Optionally the item just added, which is always kept
+ */
+static void layer_trim ( gconstpointer layer, const mc_key_t *keep )
 {
-  gchar *oldheadkey = queue_tail->next->key;
-  List *oldhead = queue_tail->next;
-  queue_tail->next = queue_tail->next->next;
-  g_free ( oldhead );
-  queue_count--;
-  return oldheadkey;
+  guint missed = 0; // Shards in a row without an item of the layer that could go
+  while ( missed < MC_NUM_SHARDS ) {
+    g_mutex_lock ( &layers_mutex );
+    mc_layer_t *mcl = g_hash_table_lookup ( layers, layer );
+    gboolean over_quota = mcl && mcl->quota && mcl->stats.bytes > mcl->quota;
+    guint ss = mcl ? mcl->next_shard++ & (MC_NUM_SHARDS-1) : 0;
+    g_mutex_unlock ( &layers_mutex );
+    if ( !over_quota )
+      break;
+
+    g_mutex_lock ( shards[ss].mutex );
+    cache_item_t *oldest = shard_oldest_of_layer ( &shards[ss], layer, keep );
+    if ( oldest ) {
+      shard_remove_item ( &shards[ss], oldest, TRUE );
+      missed = 0;
+    }
+    else
+      missed++;
+    g_mutex_unlock ( shards[ss].mutex );
+  }
 }
 
-/* adds key to tail */
-static void list_add_entry ( gchar *key )
+/**
+ * Put the new item in the cache, replacing any with the same key
+ */
+static void mc_insert ( cache_item_t *ci )
 {
-  List *newlist = g_malloc ( sizeof ( List ) );
-  newlist->key = key;
-  if ( queue_tail ) {
-    newlist->next = queue_tail->next;
-    queue_tail->next = newlist;
-    queue_tail = newlist;
-  } else {
-    newlist->next = newlist;
-    queue_tail = newlist;
+  ci->link.data = ci;
+  ci->link.prev = NULL;
+  ci->link.next = NULL;
+
+  VIK_TRACE_TILE ( "mapcache", "add", TRACE_PHASE_INSTANT, ci->key.x, ci->key.y, ci->key.zoom );
+  mc_shard_t *shard = shard_for_key ( &ci->key );
+  g_mutex_lock ( shard->mutex );
+
+  // Replace any existing entry for the same key
+  cache_item_t *existing = g_hash_table_lookup ( shard->table, &ci->key );
+  if ( existing )
+    shard_remove_item ( shard, existing, FALSE );
+
+  g_hash_table_insert ( shard->table, &ci->key, ci );
+  g_queue_push_head_link ( &shard->lru, &ci->link );
+  shard->size += ci->size;
+  (void)g_atomic_pointer_add ( &cache_size, ci->size );
+  pyr_add ( ci );
+
+  mapcache_stats_t *stats = shard_get_type_stats ( shard, ci->key.type );
+  stats->bytes += ci->size;
+  stats->count++;
+
+  gconstpointer layer = ci->layer;
+  mc_key_t key = ci->key;
+  gboolean over_quota = FALSE;
+  if ( layer ) {
+    g_mutex_lock ( &layers_mutex );
+    mc_layer_t *mcl = g_hash_table_lookup ( layers, layer );
+    if ( mcl ) {
+      mcl->stats.bytes += ci->size;
+      mcl->stats.count++;
+      over_quota = mcl->quota && mcl->stats.bytes > mcl->quota;
+    }
+    else
+      // Added after the layer was removed (e.g. by a render thread still finishing)
+      ci->layer = NULL;
+    g_mutex_unlock ( &layers_mutex );
   }
-  queue_count++;
+
+  shard_trim ( shard );
+  g_mutex_unlock ( shard->mutex );
+
+  if ( over_quota )
+    layer_trim ( layer, &key );
 }
 
 /**
  * Function increments reference counter of pixbuf.
  * Caller may (and should) decrease it's reference.
  */
-void a_mapcache_add ( GdkPixbuf *pixbuf, mapcache_extra_t extra, gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
+void a_mapcache_add ( GdkPixbuf *pixbuf, mapcache_extra_t extra, gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name, gconstpointer layer )
 {
   if ( ! GDK_IS_PIXBUF(pixbuf) ) {
     g_debug ( "Not caching corrupt pixbuf for maptype %d at %d %d %d %d", type, x, y, z, zoom );
     return;
   }
 
-  guint nn = name ? g_str_hash ( name ) : 0;
-  gchar *key = g_strdup_printf ( HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, alpha, xshrinkfactor, yshrinkfactor );
+  cache_item_t *ci = g_malloc ( sizeof(cache_item_t) );
+  key_set ( &ci->key, x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor, name );
+  ci->pixbuf = g_object_ref ( pixbuf );
+  ci->extra = extra;
+  ci->size = gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf) + MC_ITEM_OVERHEAD;
+  ci->layer = layer;
+  mc_insert ( ci );
+}
 
-  g_mutex_lock(mc_mutex);
-  g_object_ref(pixbuf);
-  cache_add(key, pixbuf, extra);
+/**
+ * Function increases reference counter of pixels buffer in behalf of caller.
+ * Caller have to decrease references counter, when buffer is no longer needed.
+ */
+GdkPixbuf *a_mapcache_get ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name, gconstpointer layer )
+{
+  mc_key_t key;
+  key_set ( &key, x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor, name );
+  GdkPixbuf *pixbuf = NULL;
 
-  // TODO: that should be done on preference change only...
-  max_cache_size = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "mapcache_size")->u * 1024 * 1024;
+  mc_shard_t *shard = shard_for_key ( &key );
+  g_mutex_lock ( shard->mutex ); /* prevent returning pixbuf when cache is being cleared */
+  cache_item_t *ci = g_hash_table_lookup ( shard->table, &key );
+  if ( ci ) {
+    // Move to front of the LRU
+    if ( shard->lru.head != &ci->link ) {
+      g_queue_unlink ( &shard->lru, &ci->link );
+      g_queue_push_head_link ( &shard->lru, &ci->link );
+    }
+    pixbuf = g_object_ref ( ci->pixbuf );
+  }
 
-  if ( cache_size > max_cache_size ) {
-    if ( queue_tail ) {
-      gchar *oldkey = list_shift_add_entry ( key );
-      cache_remove(oldkey);
+  mapcache_stats_t *stats = shard_get_type_stats ( shard, type );
+  if ( ci )
+    stats->hits++;
+  else
+    stats->misses++;
+  g_mutex_unlock ( shard->mutex );
 
-      while ( cache_size > max_cache_size &&
-             (queue_tail->next != queue_tail) ) { /* make sure there's more than one thing to delete */
-        oldkey = list_shift ();
-        cache_remove(oldkey);
-      }
+  if ( layer ) {
+    g_mutex_lock ( &layers_mutex );
+    mc_layer_t *mcl = g_hash_table_lookup ( layers, layer );
+    if ( mcl ) {
+      if ( ci )
+        mcl->stats.hits++;
+      else
+        mcl->stats.misses++;
     }
-    /* chop off 'start' etc */
-  } else {
-    list_add_entry ( key );
-    /* business as usual */
+    g_mutex_unlock ( &layers_mutex );
   }
-  g_mutex_unlock(mc_mutex);
+  VIK_TRACE_TILE ( "mapcache", ci ? "hit" : "miss", TRACE_PHASE_INSTANT, x, y, zoom );
+  return pixbuf;
+}
 
-  static int tmp = 0;
-  if ( (++tmp == 100 )) { g_debug("DEBUG: cache count=%d size=%u list count=%d", g_hash_table_size(cache), cache_size, queue_count ); tmp=0; }
+/**
+ * Whether the tile is in the cache, without counting as a use of it
+ */
+gboolean a_mapcache_contains ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
+{
+  mc_key_t key;
+  key_set ( &key, x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor, name );
+
+  mc_shard_t *shard = shard_for_key ( &key );
+  g_mutex_lock ( shard->mutex );
+  gboolean ans = g_hash_table_contains ( shard->table, &key );
+  g_mutex_unlock ( shard->mutex );
+  return ans;
 }
 
 /**
- * Function increases reference counter of pixels buffer in behalf of caller.
- * Caller have to decrease references counter, when buffer is no longer needed.
+ * Pyramid must be locked
+ * Returns: The variant with the most pixels for the alpha, or NULL
  */
-GdkPixbuf *a_mapcache_get ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
+static cache_item_t *pyr_best_variant ( const mc_pyr_node_t *node, guint8 alpha )
 {
-  static char key[MC_KEY_SIZE];
-  guint nn = name ? g_str_hash ( name ) : 0;
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, alpha, xshrinkfactor, yshrinkfactor );
-  g_mutex_lock(mc_mutex); /* prevent returning pixbuf when cache is being cleared */
-  cache_item_t *ci = g_hash_table_lookup ( cache, key );
-  if ( ci ) {
-    g_object_ref(ci->pixbuf);
-    g_mutex_unlock(mc_mutex);
-    return ci->pixbuf;
-  } else {
-    g_mutex_unlock(mc_mutex);
-    return NULL;
+  cache_item_t *best = NULL;
+  for ( GList *iter = node->variants.head; iter; iter = iter->next ) {
+    cache_item_t *ci = iter->data;
+    if ( ci->key.alpha == alpha && ( !best || ci->key.xshrink > best->key.xshrink ) )
+      best = ci;
+  }
+  return best;
+}
+
+/**
+ * Move to the front of the LRU, if still in the cache
+ */
+static void mc_touch ( const mc_key_t *key )
+{
+  mc_shard_t *shard = shard_for_key ( key );
+  g_mutex_lock ( shard->mutex );
+  cache_item_t *ci = g_hash_table_lookup ( shard->table, key );
+  if ( ci && shard->lru.head != &ci->link ) {
+    g_queue_unlink ( &shard->lru, &ci->link );
+    g_queue_push_head_link ( &shard->lru, &ci->link );
+  }
+  g_mutex_unlock ( shard->mutex );
+}
+
+/**
+ * a_mapcache_get_ancestor:
+ * @max_levels: How many zoom levels above the tile to consider
+ * @levels:     Returns how many zoom levels above the tile the found one is
+ *
+ * Find the nearest tile at a lower zoom level covering this tile,
+ *  in whichever shrinkfactor it is cached, so the caller scales the part it needs when drawing.
+ *
+ * Returns: The pixbuf (the caller must unreference it) or NULL
+ */
+GdkPixbuf *a_mapcache_get_ancestor ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, const gchar *name, guint max_levels, guint *levels )
+{
+  mc_key_t key;
+  key_set ( &key, x, y, z, type, zoom, 0, 0.0, 0.0, name );
+  GdkPixbuf *pixbuf = NULL;
+  mc_key_t found;
+
+  g_mutex_lock ( &pyr_mutex );
+  for ( guint ll = 1; ll <= max_levels && ll <= MC_PYRAMID_LEVELS && !pixbuf; ll++ ) {
+    mc_key_t parent;
+    key_parent ( &key, &parent );
+    key = parent;
+    mc_pyr_node_t *node = g_hash_table_lookup ( pyr_table, &key );
+    cache_item_t *ci = node ? pyr_best_variant ( node, alpha ) : NULL;
+    if ( ci ) {
+      pixbuf = g_object_ref ( ci->pixbuf );
+      found = ci->key;
+      *levels = ll;
+    }
   }
+  g_mutex_unlock ( &pyr_mutex );
+
+  // Keep it for as long as it is standing in for other tiles
+  if ( pixbuf )
+    mc_touch ( &found );
+  return pixbuf;
+}
+
+/**
+ * Pyramid must be locked
+ */
+static void pyr_collect_descendants ( const mc_key_t *key, guint8 alpha, guint level, guint max_levels, GArray *tiles )
+{
+  for ( guint ii = 0; ii < 4; ii++ ) {
+    mc_key_t child = *key;
+    child.x = key->x * 2 + (ii & 1);
+    child.y = key->y * 2 + (ii >> 1);
+    child.zoom = key->zoom - 1;
+    mc_pyr_node_t *node = g_hash_table_lookup ( pyr_table, &child );
+    if ( !node )
+      continue;
+    cache_item_t *ci = pyr_best_variant ( node, alpha );
+    if ( ci ) {
+      mapcache_tile_t tile = { child.x, child.y, level, g_object_ref ( ci->pixbuf ) };
+      g_array_append_val ( tiles, tile );
+    }
+    if ( node->descendants && level < max_levels )
+      pyr_collect_descendants ( &child, alpha, level+1, max_levels, tiles );
+  }
+}
+
+static gint tile_level_compare ( gconstpointer aa, gconstpointer bb )
+{
+  return (gint)((const mapcache_tile_t*)aa)->levels - (gint)((const mapcache_tile_t*)bb)->levels;
+}
+
+/**
+ * a_mapcache_get_descendants:
+ * @max_levels: How many zoom levels below the tile to consider
+ *
+ * Find the tiles at higher zoom levels within this tile,
+ *  in whichever shrinkfactor they are cached, so the caller scales them when drawing.
+ * Subtrees without any cached tiles are skipped, so usually this is a single lookup.
+ *
+ * Returns: An array of #mapcache_tile_t ordered by increasing level, to be freed with a_mapcache_tiles_free(),
+ *  or NULL if there are none
+ */
+GArray *a_mapcache_get_descendants ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, const gchar *name, guint max_levels )
+{
+  mc_key_t key;
+  key_set ( &key, x, y, z, type, zoom, 0, 0.0, 0.0, name );
+  GArray *tiles = NULL;
+
+  g_mutex_lock ( &pyr_mutex );
+  mc_pyr_node_t *node = g_hash_table_lookup ( pyr_table, &key );
+  if ( node && node->descendants && max_levels ) {
+    tiles = g_array_new ( FALSE, FALSE, sizeof(mapcache_tile_t) );
+    pyr_collect_descendants ( &key, alpha, 1, MIN(max_levels, MC_PYRAMID_LEVELS), tiles );
+  }
+  g_mutex_unlock ( &pyr_mutex );
+
+  if ( tiles && !tiles->len ) {
+    // e.g. only other alpha variants
+    g_array_free ( tiles, TRUE );
+    tiles = NULL;
+  }
+  if ( tiles )
+    g_array_sort ( tiles, tile_level_compare );
+  return tiles;
+}
+
+void a_mapcache_tiles_free ( GArray *tiles )
+{
+  if ( !tiles )
+    return;
+  for ( guint ii = 0; ii < tiles->len; ii++ )
+    g_object_unref ( g_array_index ( tiles, mapcache_tile_t, ii ).pixbuf );
+  g_array_free ( tiles, TRUE );
 }
 
 mapcache_extra_t a_mapcache_get_extra ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
 {
-  static char key[MC_KEY_SIZE];
-  guint nn = name ? g_str_hash ( name ) : 0;
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, alpha, xshrinkfactor, yshrinkfactor );
-  cache_item_t *ci = g_hash_table_lookup ( cache, key );
+  mc_key_t key;
+  key_set ( &key, x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor, name );
+  mapcache_extra_t extra = { 0.0 };
+
+  mc_shard_t *shard = shard_for_key ( &key );
+  g_mutex_lock ( shard->mutex );
+  cache_item_t *ci = g_hash_table_lookup ( shard->table, &key );
   if ( ci )
-    return ci->extra;
-  else
-    return (mapcache_extra_t) { 0.0 };
+    extra = ci->extra;
+  g_mutex_unlock ( shard->mutex );
+  return extra;
 }
 
+typedef gboolean (*key_match_func) ( const mc_key_t *key, const mc_key_t *match );
+
 /**
- * Common function to remove cache items for keys starting with the specified string
+ * Common function to remove cache items in a shard according to the matching function
  */
-static void flush_matching ( gchar *str )
+static void flush_matching_shard ( mc_shard_t *shard, key_match_func match_func, const mc_key_t *match )
 {
-  g_mutex_lock(mc_mutex);
+  g_mutex_lock ( shard->mutex );
+  GList *iter = shard->lru.head;
+  while ( iter ) {
+    GList *next = iter->next;
+    cache_item_t *ci = iter->data;
+    if ( !match_func || match_func(&ci->key, match) )
+      shard_remove_item ( shard, ci, FALSE );
+    iter = next;
+  }
+  g_mutex_unlock ( shard->mutex );
+}
 
-  if ( queue_tail == NULL ) {
-    g_mutex_unlock(mc_mutex);
-    return;
+/**
+ * Shard must be locked
+ */
+static void enc_shard_remove_item ( enc_shard_t *shard, enc_item_t *ei, gboolean eviction )
+{
+  shard->stats.bytes -= ei->size;
+  shard->stats.count--;
+  if ( eviction )
+    shard->stats.evictions++;
+  g_queue_unlink ( &shard->lru, &ei->link );
+  shard->size -= ei->size;
+  (void)g_atomic_pointer_add ( &enc_cache_size, -(gssize)ei->size );
+  g_hash_table_remove ( shard->table, &ei->key );
+}
+
+static void enc_flush_matching_shard ( enc_shard_t *shard, key_match_func match_func, const mc_key_t *match )
+{
+  g_mutex_lock ( shard->mutex );
+  GList *iter = shard->lru.head;
+  while ( iter ) {
+    GList *next = iter->next;
+    enc_item_t *ei = iter->data;
+    if ( !match_func || match_func(&ei->key, match) )
+      enc_shard_remove_item ( shard, ei, FALSE );
+    iter = next;
   }
+  g_mutex_unlock ( shard->mutex );
+}
 
-  // The 'loop' variable must be assigned within the mutex lock section,
-  //  otherwise where it points to might not be valid anymore when the actual processing occurs
-  List *loop = queue_tail;
-  List *tmp;
-  gint len = strlen(str);
-
-  do {
-    tmp = loop->next;
-    if ( tmp ) {
-    if ( strncmp(tmp->key, str, len) == 0 )
-    {
-      cache_remove(tmp->key);
-      if ( tmp == loop ) /* we deleted the last thing in the queue! */
-        loop = queue_tail = NULL;
-      else {
-        loop->next = tmp->next;
-        if ( tmp == queue_tail )
-          queue_tail = tmp->next;
-      }
-      g_free ( tmp );
-      tmp = NULL;
-      queue_count--;
-    }
-    else
-      loop = tmp;
-    } else
-      loop = NULL;
-  } while ( loop && (loop != queue_tail || tmp == NULL) );
-  /* loop thru list, looking for the one, compare first whatever chars */
+static gboolean match_all_shrinkfactors ( const mc_key_t *key, const mc_key_t *match )
+{
+  return key->type == match->type &&
+    key->x == match->x && key->y == match->y && key->z == match->z &&
+    key->zoom == match->zoom && key->name_hash == match->name_hash;
+}
 
-  cache_remove(str);
-  g_mutex_unlock(mc_mutex);
+static gboolean match_type ( const mc_key_t *key, const mc_key_t *match )
+{
+  return key->type == match->type;
 }
 
 /**
@@ -268,32 +824,21 @@ static void flush_matching ( gchar *str )
  */
 void a_mapcache_remove_all_shrinkfactors ( gint x, gint y, gint z, guint16 type, gint zoom, const gchar* name )
 {
-  char key[MC_KEY_SIZE];
-  guint nn = name ? g_str_hash ( name ) : 0;
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING_NOSHRINK_NOR_ALPHA, type, x, y, z, zoom, nn );
-  flush_matching ( key );
+  mc_key_t match;
+  key_set ( &match, x, y, z, type, zoom, 0, 0.0, 0.0, name );
+  // All shrinkfactor & alpha variants are in the same shard
+  guint shard_index = key_tile_hash(&match) & (MC_NUM_SHARDS-1);
+  flush_matching_shard ( &shards[shard_index], match_all_shrinkfactors, &match );
+  // Ensure the old tile file data is not used either
+  enc_flush_matching_shard ( &enc_shards[shard_index], match_all_shrinkfactors, &match );
 }
 
 void a_mapcache_flush ()
 {
-  // Everything happens within the mutex lock section
-  g_mutex_lock(mc_mutex);
-
-  List *loop = queue_tail;
-  List *tmp;
-
-  while ( loop ) {
-    tmp = loop->next;
-    cache_remove(tmp->key);
-    if ( tmp == queue_tail ) /* we deleted the last thing in the queue */
-      loop = queue_tail = NULL;
-    else
-      loop->next = tmp->next;
-    g_free ( tmp );
-    tmp = NULL;
+  for ( guint ss = 0; ss < MC_NUM_SHARDS; ss++ ) {
+    flush_matching_shard ( &shards[ss], NULL, NULL );
+    enc_flush_matching_shard ( &enc_shards[ss], NULL, NULL );
   }
-
-  g_mutex_unlock(mc_mutex);
 }
 
 /**
@@ -305,27 +850,432 @@ void a_mapcache_flush ()
  */
 void a_mapcache_flush_type ( guint16 type )
 {
-  char key[MC_KEY_SIZE];
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING_TYPE, type );
-  flush_matching ( key );
+  mc_key_t match;
+  memset ( &match, 0, sizeof(mc_key_t) );
+  match.type = type;
+  for ( guint ss = 0; ss < MC_NUM_SHARDS; ss++ ) {
+    flush_matching_shard ( &shards[ss], match_type, &match );
+    enc_flush_matching_shard ( &enc_shards[ss], match_type, &match );
+  }
 }
 
 void a_mapcache_uninit ()
 {
-  g_hash_table_destroy ( cache );
-  /* free list */
-  cache = NULL;
-  vik_mutex_free (mc_mutex);
+  for ( guint ss = 0; ss < MC_NUM_SHARDS; ss++ ) {
+    // Items (and so their embedded queue links) are freed by the hash table
+    g_hash_table_destroy ( shards[ss].table );
+    shards[ss].table = NULL;
+    g_queue_init ( &shards[ss].lru );
+    g_hash_table_destroy ( shards[ss].type_stats );
+
+    g_hash_table_destroy ( enc_shards[ss].table );
+    enc_shards[ss].table = NULL;
+    g_queue_init ( &enc_shards[ss].lru );
+    vik_mutex_free ( enc_shards[ss].mutex );
+    vik_mutex_free ( shards[ss].mutex );
+  }
+  g_hash_table_destroy ( pyr_table );
+  pyr_table = NULL;
+  g_hash_table_destroy ( layers );
+  layers = NULL;
+  cache_size = 0;
+  enc_cache_size = 0;
+}
+
+/*
+ * Keeping the decoded tiles between sessions, see warmcache.c
+ * Each is stored as its key, the header and then its pixels as they are in memory.
+ */
+typedef struct {
+  gint32 width;
+  gint32 height;
+  gint32 rowstride;
+  guint8 has_alpha;
+  guint8 bits_per_sample;
+  guint8 n_channels;
+  guint8 padding;
+  mapcache_extra_t extra;
+} mc_warm_tile_t;
+
+static void mc_warm_pixels_free ( guchar *pixels, gpointer data )
+{
+  g_bytes_unref ( (GBytes*)data );
+}
+
+static void mc_warm_load_tile ( gconstpointer key, gsize key_len, GBytes *header, GBytes *data, gpointer user_data )
+{
+  mc_warm_tile_t wt;
+  gsize data_len = 0;
+  const guchar *pixels = g_bytes_get_data ( data, &data_len );
+  // Only tiles of this build's key, sanity checking the pixel layout
+  if ( key_len != sizeof(mc_key_t) || g_bytes_get_size(header) != sizeof(wt) )
+    goto fail;
+  memcpy ( &wt, g_bytes_get_data(header, NULL), sizeof(wt) );
+  if ( wt.width <= 0 || wt.height <= 0 || wt.bits_per_sample != 8 || wt.n_channels != (wt.has_alpha ? 4 : 3) ||
+       wt.rowstride < wt.width * wt.n_channels ||
+       data_len != (gsize)wt.rowstride * (wt.height - 1) + (gsize)wt.width * wt.n_channels )
+    goto fail;
+
+  // The pixels stay in the mapped file, so are only read in when drawn
+  GdkPixbuf *pixbuf = gdk_pixbuf_new_from_data ( pixels, GDK_COLORSPACE_RGB, wt.has_alpha, wt.bits_per_sample,
+                                                 wt.width, wt.height, wt.rowstride, mc_warm_pixels_free, data );
+  cache_item_t *ci = g_malloc ( sizeof(cache_item_t) );
+  memcpy ( &ci->key, key, sizeof(mc_key_t) );
+  ci->pixbuf = pixbuf;
+  ci->extra = wt.extra;
+  ci->size = wt.rowstride * wt.height + MC_ITEM_OVERHEAD;
+  ci->layer = NULL;
+  mc_insert ( ci );
+  g_bytes_unref ( header );
+  return;
+
+ fail:
+  g_bytes_unref ( header );
+  g_bytes_unref ( data );
+}
+
+/**
+ * a_mapcache_warm_load:
+ *
+ * Fill the cache with the tiles kept from the previous session
+ */
+void a_mapcache_warm_load ( void )
+{
+  a_warmcache_foreach ( WARMCACHE_TILE, mc_warm_load_tile, NULL );
+}
+
+typedef struct {
+  mc_key_t key;
+  mapcache_extra_t extra;
+  GdkPixbuf *pixbuf;
+} mc_warm_item_t;
+
+/**
+ * a_mapcache_warm_save:
+ *
+ * Write the tiles, taking the most recently used of each shard in turn
+ */
+void a_mapcache_warm_save ( WarmCacheWriter *wcw )
+{
+  GArray *items[MC_NUM_SHARDS];
+  guint longest = 0;
+  for ( guint ss = 0; ss < MC_NUM_SHARDS; ss++ ) {
+    items[ss] = g_array_new ( FALSE, FALSE, sizeof(mc_warm_item_t) );
+    g_mutex_lock ( shards[ss].mutex );
+    for ( GList *iter = shards[ss].lru.head; iter; iter = iter->next ) {
+      cache_item_t *ci = iter->data;
+      mc_warm_item_t wi = { ci->key, ci->extra, g_object_ref ( ci->pixbuf ) };
+      g_array_append_val ( items[ss], wi );
+    }
+    g_mutex_unlock ( shards[ss].mutex );
+    longest = MAX ( longest, items[ss]->len );
+  }
+
+  // Written without the shards locked, holding references meanwhile
+  guint written = 0;
+  for ( guint nn = 0; nn < longest; nn++ ) {
+    for ( guint ss = 0; ss < MC_NUM_SHARDS; ss++ ) {
+      if ( nn >= items[ss]->len )
+        continue;
+      mc_warm_item_t *wi = &g_array_index ( items[ss], mc_warm_item_t, nn );
+      GdkPixbuf *pixbuf = wi->pixbuf;
+      if ( gdk_pixbuf_get_colorspace(pixbuf) != GDK_COLORSPACE_RGB || gdk_pixbuf_get_bits_per_sample(pixbuf) != 8 )
+        continue;
+      mc_warm_tile_t wt;
+      memset ( &wt, 0, sizeof(wt) );
+      wt.width = gdk_pixbuf_get_width ( pixbuf );
+      wt.height = gdk_pixbuf_get_height ( pixbuf );
+      wt.rowstride = gdk_pixbuf_get_rowstride ( pixbuf );
+      wt.has_alpha = gdk_pixbuf_get_has_alpha ( pixbuf );
+      wt.bits_per_sample = 8;
+      wt.n_channels = gdk_pixbuf_get_n_channels ( pixbuf );
+      wt.extra = wi->extra;
+      // Continue on after one that does not fit, as there may be space for smaller ones
+      if ( a_warmcache_write ( wcw, WARMCACHE_TILE, &wi->key, sizeof(mc_key_t), &wt, sizeof(wt),
+                               gdk_pixbuf_get_pixels(pixbuf), gdk_pixbuf_get_byte_length(pixbuf) ) )
+        written++;
+    }
+  }
+  g_debug ( "%s: %d tiles", __FUNCTION__, written );
+
+  for ( guint ss = 0; ss < MC_NUM_SHARDS; ss++ ) {
+    for ( guint nn = 0; nn < items[ss]->len; nn++ )
+      g_object_unref ( g_array_index ( items[ss], mc_warm_item_t, nn ).pixbuf );
+    g_array_free ( items[ss], TRUE );
+  }
 }
 
 // Size of mapcache in memory
 gint a_mapcache_get_size ()
 {
-  return cache_size;
+  return GPOINTER_TO_SIZE(g_atomic_pointer_get ( &cache_size ));
+}
+
+// Size the mapcache is allowed to grow to
+gint a_mapcache_get_max_size ()
+{
+  return max_cache_size;
 }
 
 // Count of items in the mapcache
 gint a_mapcache_get_count ()
 {
-  return g_hash_table_size ( cache );
+  gint count = 0;
+  for ( guint ss = 0; ss < MC_NUM_SHARDS; ss++ ) {
+    g_mutex_lock ( shards[ss].mutex );
+    count += g_hash_table_size ( shards[ss].table );
+    g_mutex_unlock ( shards[ss].mutex );
+  }
+  return count;
+}
+
+/**
+ * a_mapcache_encoded_add:
+ * @bytes: The tile file data as read from disk or database
+ *
+ * Store the encoded version of a tile, for use by a_mapcache_encoded_get()
+ *  when the decoded pixbuf is no longer in the cache.
+ * Function increments reference counter of the bytes.
+ */
+void a_mapcache_encoded_add ( GBytes *bytes, gint x, gint y, gint z, guint16 type, gint zoom, const gchar *name )
+{
+  guint32 max_size = max_enc_cache_size;
+  if ( !bytes || !max_size )
+    return;
+
+  enc_item_t *ei = g_malloc ( sizeof(enc_item_t) );
+  key_set ( &ei->key, x, y, z, type, zoom, 0, 0.0, 0.0, name );
+  ei->bytes = g_bytes_ref ( bytes );
+  ei->size = g_bytes_get_size ( bytes ) + MC_ITEM_OVERHEAD;
+  ei->link.data = ei;
+  ei->link.prev = NULL;
+  ei->link.next = NULL;
+
+  enc_shard_t *shard = &enc_shards[key_tile_hash(&ei->key) & (MC_NUM_SHARDS-1)];
+  g_mutex_lock ( shard->mutex );
+
+  enc_item_t *existing = g_hash_table_lookup ( shard->table, &ei->key );
+  if ( existing )
+    enc_shard_remove_item ( shard, existing, FALSE );
+
+  g_hash_table_insert ( shard->table, &ei->key, ei );
+  g_queue_push_head_link ( &shard->lru, &ei->link );
+  shard->size += ei->size;
+  (void)g_atomic_pointer_add ( &enc_cache_size, ei->size );
+  shard->stats.bytes += ei->size;
+  shard->stats.count++;
+
+  // As for the pixbuf cache, keep the latest one (the others to go may be in other shards)
+  while ( GPOINTER_TO_SIZE(g_atomic_pointer_get ( &enc_cache_size )) > max_size && shard->lru.length > 1 )
+    enc_shard_remove_item ( shard, shard->lru.tail->data, TRUE );
+
+  g_mutex_unlock ( shard->mutex );
+}
+
+/**
+ * a_mapcache_encoded_get:
+ *
+ * Returns: The tile file data or NULL if not in the cache.
+ *  Caller must g_bytes_unref() the returned value.
+ */
+GBytes *a_mapcache_encoded_get ( gint x, gint y, gint z, guint16 type, gint zoom, const gchar *name )
+{
+  if ( !max_enc_cache_size )
+    return NULL;
+
+  mc_key_t key;
+  key_set ( &key, x, y, z, type, zoom, 0, 0.0, 0.0, name );
+  GBytes *bytes = NULL;
+
+  enc_shard_t *shard = &enc_shards[key_tile_hash(&key) & (MC_NUM_SHARDS-1)];
+  g_mutex_lock ( shard->mutex );
+  enc_item_t *ei = g_hash_table_lookup ( shard->table, &key );
+  if ( ei ) {
+    if ( shard->lru.head != &ei->link ) {
+      g_queue_unlink ( &shard->lru, &ei->link );
+      g_queue_push_head_link ( &shard->lru, &ei->link );
+    }
+    bytes = g_bytes_ref ( ei->bytes );
+    shard->stats.hits++;
+  }
+  else
+    shard->stats.misses++;
+  g_mutex_unlock ( shard->mutex );
+  return bytes;
+}
+
+/**
+ * Whether the tile file data is in the cache, without counting as a use of it
+ */
+gboolean a_mapcache_encoded_contains ( gint x, gint y, gint z, guint16 type, gint zoom, const gchar *name )
+{
+  if ( !max_enc_cache_size )
+    return FALSE;
+
+  mc_key_t key;
+  key_set ( &key, x, y, z, type, zoom, 0, 0.0, 0.0, name );
+
+  enc_shard_t *shard = &enc_shards[key_tile_hash(&key) & (MC_NUM_SHARDS-1)];
+  g_mutex_lock ( shard->mutex );
+  gboolean ans = g_hash_table_contains ( shard->table, &key );
+  g_mutex_unlock ( shard->mutex );
+  return ans;
+}
+
+static void stats_accumulate ( mapcache_stats_t *total, const mapcache_stats_t *stats )
+{
+  total->bytes += stats->bytes;
+  total->count += stats->count;
+  total->hits += stats->hits;
+  total->misses += stats->misses;
+  total->evictions += stats->evictions;
+}
+
+/**
+ * a_mapcache_get_stats:
+ * @stats: Returned accumulated statistics for the whole cache
+ */
+void a_mapcache_get_stats ( mapcache_stats_t *stats )
+{
+  memset ( stats, 0, sizeof(mapcache_stats_t) );
+  for ( guint ss = 0; ss < MC_NUM_SHARDS; ss++ ) {
+    g_mutex_lock ( shards[ss].mutex );
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init ( &iter, shards[ss].type_stats );
+    while ( g_hash_table_iter_next ( &iter, NULL, &value ) )
+      stats_accumulate ( stats, value );
+    g_mutex_unlock ( shards[ss].mutex );
+  }
+}
+
+/**
+ * a_mapcache_get_stats_type:
+ * @type:  Specified map type
+ * @stats: Returned statistics for this map type
+ */
+void a_mapcache_get_stats_type ( guint16 type, mapcache_stats_t *stats )
+{
+  memset ( stats, 0, sizeof(mapcache_stats_t) );
+  for ( guint ss = 0; ss < MC_NUM_SHARDS; ss++ ) {
+    g_mutex_lock ( shards[ss].mutex );
+    mapcache_stats_t *ts = g_hash_table_lookup ( shards[ss].type_stats, GUINT_TO_POINTER(type) );
+    if ( ts )
+      stats_accumulate ( stats, ts );
+    g_mutex_unlock ( shards[ss].mutex );
+  }
+}
+
+/**
+ * a_mapcache_get_stats_layer:
+ * @layer: The layer used when adding and getting items
+ * @stats: Returned statistics for this layer
+ *
+ * NB Items are shared between layers using the same map type,
+ *  the bytes are accounted to the layer that added the item.
+ */
+void a_mapcache_get_stats_layer ( gconstpointer layer, mapcache_stats_t *stats )
+{
+  memset ( stats, 0, sizeof(mapcache_stats_t) );
+  g_mutex_lock ( &layers_mutex );
+  mc_layer_t *mcl = layer ? g_hash_table_lookup ( layers, layer ) : NULL;
+  if ( mcl )
+    *stats = mcl->stats;
+  g_mutex_unlock ( &layers_mutex );
+}
+
+/**
+ * a_mapcache_set_layer_quota:
+ * @layer: The layer used when adding items
+ * @quota: The soft limit in bytes. 0 means no limit other than the overall cache size
+ *
+ * Once exceeded, items added by this layer are evicted before
+ *  (potentially more useful) items of other layers.
+ */
+void a_mapcache_set_layer_quota ( gconstpointer layer, guint32 quota )
+{
+  if ( !layer )
+    return;
+  g_mutex_lock ( &layers_mutex );
+  mc_layer_t *mcl = g_hash_table_lookup ( layers, layer );
+  if ( mcl )
+    mcl->quota = quota;
+  g_mutex_unlock ( &layers_mutex );
+  layer_trim ( layer, NULL );
+}
+
+/**
+ * a_mapcache_add_layer:
+ * @layer: The layer that will be used when adding and getting items
+ *
+ * Start accounting for this layer (e.g. when the layer is created).
+ */
+void a_mapcache_add_layer ( gconstpointer layer )
+{
+  if ( !layer )
+    return;
+  g_mutex_lock ( &layers_mutex );
+  if ( !g_hash_table_contains ( layers, layer ) )
+    g_hash_table_insert ( layers, (gpointer)layer, g_new0 ( mc_layer_t, 1 ) );
+  g_mutex_unlock ( &layers_mutex );
+}
+
+/**
+ * a_mapcache_remove_layer:
+ * @layer: The layer used when adding and getting items
+ *
+ * Forget about this layer (e.g. when the layer is deleted).
+ * The tiles themselves remain in the cache as they may be used by other layers.
+ * Any items still being added for the layer afterwards are not accounted to it.
+ */
+void a_mapcache_remove_layer ( gconstpointer layer )
+{
+  if ( !layer )
+    return;
+  g_mutex_lock ( &layers_mutex );
+  gboolean removed = g_hash_table_remove ( layers, layer );
+  g_mutex_unlock ( &layers_mutex );
+  if ( !removed )
+    return;
+  // Items are only given a layer that is accounted for, so no new ones for it can turn up now
+  for ( guint ss = 0; ss < MC_NUM_SHARDS; ss++ ) {
+    g_mutex_lock ( shards[ss].mutex );
+    for ( GList *iter = shards[ss].lru.head; iter; iter = iter->next ) {
+      cache_item_t *ci = iter->data;
+      if ( ci->layer == layer )
+        ci->layer = NULL;
+    }
+    g_mutex_unlock ( shards[ss].mutex );
+  }
+}
+
+/**
+ * a_mapcache_stats_to_string:
+ *
+ * Returns: A newly allocated single line description of the statistics
+ */
+gchar *a_mapcache_stats_to_string ( const mapcache_stats_t *stats )
+{
+  gchar *size = g_format_size ( stats->bytes );
+  guint64 lookups = stats->hits + stats->misses;
+  gchar *msg = g_strdup_printf ( _("%s in %u tiles. Hits %" G_GUINT64_FORMAT " (%.0f%%), Misses %" G_GUINT64_FORMAT ", Evictions %" G_GUINT64_FORMAT),
+                                 size, stats->count, stats->hits,
+                                 lookups ? (100.0 * stats->hits / lookups) : 0.0,
+                                 stats->misses, stats->evictions );
+  g_free ( size );
+  return msg;
+}
+
+/**
+ * a_mapcache_get_stats_encoded:
+ * @stats: Returned statistics for the encoded tile data cache tier
+ */
+void a_mapcache_get_stats_encoded ( mapcache_stats_t *stats )
+{
+  memset ( stats, 0, sizeof(mapcache_stats_t) );
+  for ( guint ss = 0; ss < MC_NUM_SHARDS; ss++ ) {
+    g_mutex_lock ( enc_shards[ss].mutex );
+    stats_accumulate ( stats, &enc_shards[ss].stats );
+    g_mutex_unlock ( enc_shards[ss].mutex );
+  }
 }
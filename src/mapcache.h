@@ -24,6 +24,7 @@
 
 #include <glib.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
+#include "warmcache.h"
 
 G_BEGIN_DECLS
 
@@ -31,18 +32,58 @@ typedef struct {
   gdouble duration; // Mostly for Mapnik Rendering duration - negative values indicate not rendered (i.e. read from disk)
 } mapcache_extra_t;
 
+typedef struct {
+  guint64 bytes;
+  guint count;
+  guint64 hits;
+  guint64 misses;
+  guint64 evictions;
+} mapcache_stats_t;
+
+typedef struct {
+  gint x;
+  gint y;
+  guint levels; // Zoom levels below the requested tile
+  GdkPixbuf *pixbuf;
+} mapcache_tile_t;
+
 void a_mapcache_init ();
-void a_mapcache_add ( GdkPixbuf *pixbuf, mapcache_extra_t extra, gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar *name );
-GdkPixbuf *a_mapcache_get ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar *name );
+void a_mapcache_refresh_preferences ();
+// The layer is only used for accounting purposes (once given to a_mapcache_add_layer()) and may be NULL
+void a_mapcache_add ( GdkPixbuf *pixbuf, mapcache_extra_t extra, gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar *name, gconstpointer layer );
+GdkPixbuf *a_mapcache_get ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar *name, gconstpointer layer );
+gboolean a_mapcache_contains ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar *name );
+// Other zoom levels of a tile, whichever shrinkfactors they are cached at
+GdkPixbuf *a_mapcache_get_ancestor ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, const gchar *name, guint max_levels, guint *levels );
+GArray *a_mapcache_get_descendants ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, const gchar *name, guint max_levels );
+void a_mapcache_tiles_free ( GArray *tiles );
+// Second tier of encoded tile file data
+void a_mapcache_encoded_add ( GBytes *bytes, gint x, gint y, gint z, guint16 type, gint zoom, const gchar *name );
+GBytes *a_mapcache_encoded_get ( gint x, gint y, gint z, guint16 type, gint zoom, const gchar *name );
+gboolean a_mapcache_encoded_contains ( gint x, gint y, gint z, guint16 type, gint zoom, const gchar *name );
+
 mapcache_extra_t a_mapcache_get_extra ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name );
 void a_mapcache_remove_all_shrinkfactors ( gint x, gint y, gint z, guint16 type, gint zoom, const gchar* name );
 void a_mapcache_flush ();
 void a_mapcache_flush_type ( guint16 type );
 void a_mapcache_uninit ();
+// Keeping the tiles between sessions
+void a_mapcache_warm_load ( void );
+void a_mapcache_warm_save ( WarmCacheWriter *wcw );
 
 gint a_mapcache_get_size ();
+gint a_mapcache_get_max_size ();
 gint a_mapcache_get_count ();
 
+void a_mapcache_get_stats ( mapcache_stats_t *stats );
+void a_mapcache_get_stats_type ( guint16 type, mapcache_stats_t *stats );
+void a_mapcache_get_stats_encoded ( mapcache_stats_t *stats );
+void a_mapcache_get_stats_layer ( gconstpointer layer, mapcache_stats_t *stats );
+void a_mapcache_set_layer_quota ( gconstpointer layer, guint32 quota );
+void a_mapcache_add_layer ( gconstpointer layer );
+void a_mapcache_remove_layer ( gconstpointer layer );
+gchar *a_mapcache_stats_to_string ( const mapcache_stats_t *stats );
+
 G_END_DECLS
 
 #endif
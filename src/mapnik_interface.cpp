@@ -37,14 +37,17 @@
 #include <memory>
 #include <string>
 #include <stdlib.h>
+#include <string.h>
 
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <glib/gi18n.h>
 
 #include "mapnik_interface.h"
+#include "pixbufpool.h"
 #include "globals.h"
 #include "settings.h"
+#include "vik_compat.h"
 
 #if MAPNIK_VERSION < 200000
 #include <mapnik/envelope.hpp>
@@ -88,6 +91,10 @@ struct _MapnikInterface {
 	GObject obj;
 	mapnik::Map *myMap;
 	gchar *copyright; // Cached Mapnik parameter to save looking it up each time
+	// Copies of myMap for rendering, so each thread renders with its own instance
+	GMutex *pool_mutex;
+	GQueue map_pool;
+	guint generation; // Incremented whenever myMap is reloaded
 };
 
 G_DEFINE_TYPE (MapnikInterface, mapnik_interface, G_TYPE_OBJECT)
@@ -100,18 +107,62 @@ MapnikInterface* mapnik_interface_new ()
 	MapnikInterface* mi = MAPNIK_INTERFACE ( g_object_new ( MAPNIK_INTERFACE_TYPE, NULL ) );
 	mi->myMap = new mapnik::Map;
 	mi->copyright = NULL;
+	mi->pool_mutex = vik_mutex_new ();
+	g_queue_init ( &mi->map_pool );
+	mi->generation = 0;
 	return mi;
 }
 
+/**
+ * Must be called with the pool_mutex held
+ */
+static void map_pool_clear ( MapnikInterface* mi )
+{
+	mapnik::Map *map;
+	while ( (map = (mapnik::Map*)g_queue_pop_head ( &mi->map_pool )) )
+		delete map;
+	mi->generation++;
+}
+
 void mapnik_interface_free (MapnikInterface* mi)
 {
 	if ( mi ) {
 		g_free ( mi->copyright );
+		map_pool_clear ( mi );
+		vik_mutex_free ( mi->pool_mutex );
 		delete mi->myMap;
 	}
 	g_object_unref ( G_OBJECT(mi) );
 }
 
+/**
+ * Get a map instance for the exclusive use of the calling thread
+ *  Copying the main map (and so its style and layers) is only needed
+ *  the first time or after the configuration has been reloaded
+ */
+static mapnik::Map *map_pool_get ( MapnikInterface* mi, guint *generation )
+{
+	g_mutex_lock ( mi->pool_mutex );
+	mapnik::Map *map = (mapnik::Map*)g_queue_pop_head ( &mi->map_pool );
+	if ( !map )
+		map = new mapnik::Map(*mi->myMap);
+	*generation = mi->generation;
+	g_mutex_unlock ( mi->pool_mutex );
+	return map;
+}
+
+static void map_pool_put ( MapnikInterface* mi, mapnik::Map *map, guint generation )
+{
+	g_mutex_lock ( mi->pool_mutex );
+	if ( generation == mi->generation ) {
+		g_queue_push_head ( &mi->map_pool, map );
+		map = NULL;
+	}
+	g_mutex_unlock ( mi->pool_mutex );
+	// Out of date
+	delete map;
+}
+
 /**
  * mapnik_interface_initialize:
  */
@@ -166,6 +217,84 @@ static void set_copyright ( MapnikInterface* mi )
 
 #define VIK_SETTINGS_MAPNIK_BUFFER_SIZE "mapnik_buffer_size"
 
+/*
+ * Maps as loaded from each style file, shared by every layer (in any window) using the same file and tile size.
+ * Parsing a large style and connecting to its datasources can take a long time,
+ *  whereas a copy of a loaded map is quick to make and shares its datasources.
+ */
+typedef struct {
+	mapnik::Map *map;
+	gint64 mtime; // Of the file when it was loaded
+} LoadedMapT;
+
+static GHashTable *loaded_maps = NULL; // Of LoadedMapT by the key from loaded_map_key()
+static GMutex loaded_mutex;
+
+static void loaded_map_free ( LoadedMapT *lm )
+{
+	delete lm->map;
+	g_free ( lm );
+}
+
+static gchar *loaded_map_key ( const gchar *filename, guint width, guint height )
+{
+	return g_strdup_printf ( "%ux%u:%s", width, height, filename );
+}
+
+static gint64 loaded_map_mtime ( const gchar *filename )
+{
+	GStatBuf stat_buf;
+	if ( g_stat ( filename, &stat_buf ) == 0 )
+		return stat_buf.st_mtime;
+	return 0;
+}
+
+/**
+ * Returns: A copy of the map previously loaded from the file (if it hasn't changed since) or NULL
+ */
+static mapnik::Map *loaded_map_get ( const gchar *key, gint64 mtime )
+{
+	mapnik::Map *map = NULL;
+	g_mutex_lock ( &loaded_mutex );
+	LoadedMapT *lm = loaded_maps ? (LoadedMapT*)g_hash_table_lookup ( loaded_maps, key ) : NULL;
+	if ( lm && lm->mtime == mtime )
+		map = new mapnik::Map(*lm->map);
+	g_mutex_unlock ( &loaded_mutex );
+	return map;
+}
+
+static void loaded_map_add ( const gchar *key, gint64 mtime, const mapnik::Map &map )
+{
+	LoadedMapT *lm = g_new0 ( LoadedMapT, 1 );
+	lm->map = new mapnik::Map(map);
+	lm->mtime = mtime;
+	g_mutex_lock ( &loaded_mutex );
+	if ( !loaded_maps )
+		loaded_maps = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)loaded_map_free );
+	g_hash_table_replace ( loaded_maps, g_strdup(key), lm );
+	g_mutex_unlock ( &loaded_mutex );
+}
+
+static gboolean loaded_map_match_file ( gpointer key, gpointer value, gpointer filename )
+{
+	const gchar *name = strchr ( (const gchar*)key, ':' );
+	return name && !g_strcmp0 ( name+1, (const gchar*)filename );
+}
+
+/**
+ * mapnik_interface_forget_map_file:
+ *
+ * Ensure the file is read again when next loaded,
+ *  e.g. for changes in any files it refers to
+ */
+void mapnik_interface_forget_map_file ( const gchar *filename )
+{
+	g_mutex_lock ( &loaded_mutex );
+	if ( loaded_maps )
+		g_hash_table_foreach_remove ( loaded_maps, loaded_map_match_file, (gpointer)filename );
+	g_mutex_unlock ( &loaded_mutex );
+}
+
 /**
  * mapnik_interface_load_map_file:
  *
@@ -179,6 +308,21 @@ gchar* mapnik_interface_load_map_file ( MapnikInterface* mi,
 {
 	gchar *msg = NULL;
 	if ( !mi ) return g_strdup ("Internal Error");
+	gchar *key = loaded_map_key ( filename, width, height );
+	gint64 mtime = loaded_map_mtime ( filename );
+	mapnik::Map *loaded = loaded_map_get ( key, mtime );
+
+	// Prevent copies being made whilst it changes
+	g_mutex_lock ( mi->pool_mutex );
+	map_pool_clear ( mi );
+	if ( loaded ) {
+		delete mi->myMap;
+		mi->myMap = loaded;
+		set_copyright ( mi );
+		g_mutex_unlock ( mi->pool_mutex );
+		g_free ( key );
+		return NULL;
+	}
 	try {
 		mi->myMap->remove_all(); // Support reloading
 		mapnik::load_map(*mi->myMap, filename);
@@ -199,6 +343,7 @@ gchar* mapnik_interface_load_map_file ( MapnikInterface* mi,
 		}
 
 		set_copyright ( mi );
+		loaded_map_add ( key, mtime, *mi->myMap );
 
 		g_debug ("%s layers: %d", __FUNCTION__, (guint)mi->myMap->layer_count() );
 	} catch (std::exception const& ex) {
@@ -206,27 +351,43 @@ gchar* mapnik_interface_load_map_file ( MapnikInterface* mi,
 	} catch (...) {
 		msg = g_strdup ("unknown error");
 	}
+	g_mutex_unlock ( mi->pool_mutex );
+	g_free ( key );
 	return msg;
 }
 
-// GdkPixbufDestroyNotify
-static void destroy_fn ( guchar *pixels, gpointer data )
+/**
+ * mapnik_interface_render:
+ *
+ * Returns a #GdkPixbuf of the specified area. #GdkPixbuf may be NULL
+ */
+GdkPixbuf* mapnik_interface_render ( MapnikInterface* mi, double lat_tl, double lon_tl, double lat_br, double lon_br )
 {
-	g_free ( pixels );
+	if ( !mi ) return NULL;
+	g_mutex_lock ( mi->pool_mutex );
+	guint width = mi->myMap->width();
+	guint height = mi->myMap->height();
+	g_mutex_unlock ( mi->pool_mutex );
+	return mapnik_interface_render_size ( mi, lat_tl, lon_tl, lat_br, lon_br, width, height );
 }
 
 /**
- * mapnik_interface_render:
+ * mapnik_interface_render_size:
+ *
+ * As mapnik_interface_render() but to an image of the given size,
+ *  e.g. to render several tiles at once
  *
  * Returns a #GdkPixbuf of the specified area. #GdkPixbuf may be NULL
  */
-GdkPixbuf* mapnik_interface_render ( MapnikInterface* mi, double lat_tl, double lon_tl, double lat_br, double lon_br )
+GdkPixbuf* mapnik_interface_render_size ( MapnikInterface* mi, double lat_tl, double lon_tl, double lat_br, double lon_br, guint width, guint height )
 {
 	if ( !mi ) return NULL;
 
-	// Copy main object to local map variable
-	//  This enables rendering to work when this function is called from different threads
-	mapnik::Map myMap(*mi->myMap);
+	// Each thread uses its own map object, so rendering can be performed concurrently
+	guint generation;
+	mapnik::Map &myMap = *map_pool_get ( mi, &generation );
+	if ( width != myMap.width() || height != myMap.height() )
+		myMap.resize ( width, height );
 
 	// Note prj & bbox want stuff in lon,lat order!
 	double p0x = lon_tl;
@@ -239,10 +400,15 @@ GdkPixbuf* mapnik_interface_render ( MapnikInterface* mi, double lat_tl, double
 	prj.forward(p1x, p1y);
 
 	GdkPixbuf *pixbuf = NULL;
+	unsigned char *ImageRawDataPtr = a_pixbuf_pool_alloc(width * 4 * height);
+	memset(ImageRawDataPtr, 0, width * 4 * height);
 	try {
-		unsigned width  = myMap.width();
-		unsigned height = myMap.height();
+#if MAPNIK_VERSION >= 300000
+		// Render straight into the memory that becomes the pixbuf's
+		mapnik::image_32 image(width, height, ImageRawDataPtr);
+#else
 		mapnik::image_32 image(width,height);
+#endif
 		mapnik::box2d<double> bbox(p0x, p0y, p1x, p1y);
 		myMap.zoom_to_box(bbox);
 		// FUTURE: option to use cairo / grid renderers?
@@ -250,11 +416,11 @@ GdkPixbuf* mapnik_interface_render ( MapnikInterface* mi, double lat_tl, double
 		render.apply();
 
 		if ( image.painted() ) {
-			unsigned char *ImageRawDataPtr = (unsigned char *) g_malloc(width * 4 * height);
-			if (!ImageRawDataPtr)
-				return NULL;
+#if MAPNIK_VERSION < 300000
 			memcpy(ImageRawDataPtr, image.raw_data(), width * height * 4);
-			pixbuf = gdk_pixbuf_new_from_data(ImageRawDataPtr, GDK_COLORSPACE_RGB, TRUE, 8, width, height, width * 4, destroy_fn, NULL);
+#endif
+			pixbuf = a_pixbuf_pool_wrap(ImageRawDataPtr, TRUE, width, height, width * 4);
+			ImageRawDataPtr = NULL; // Now owned by the pixbuf
 		}
 		else
 			g_warning ("%s not rendered", __FUNCTION__ );
@@ -264,6 +430,9 @@ GdkPixbuf* mapnik_interface_render ( MapnikInterface* mi, double lat_tl, double
 	} catch (...) {
 		g_warning ("An unknown error occurred while rendering");
 	}
+	if ( ImageRawDataPtr )
+		a_pixbuf_pool_free ( ImageRawDataPtr, NULL );
+	map_pool_put ( mi, &myMap, generation );
 
 	return pixbuf;
 }
@@ -0,0 +1,574 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * Tiles are kept in the standard MBTiles schema, so a cache file can also be used directly
+ *  as an MBTiles map or by other programs.
+ *
+ * Each file has a single writer connection, that is only used to commit batches of new tiles
+ *  in one transaction, plus a pool of reader connections, each with its statements already
+ *  prepared, so concurrent lookups don't need to prepare SQL for every tile.
+ * The file uses write-ahead logging so readers are not blocked by the writer.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "mbtilescache.h"
+#include "vik_compat.h"
+
+#ifdef HAVE_SQLITE3_H
+#include "sqlite3.h"
+
+// Writes held in memory before being committed in a single transaction
+#define MBTILES_CACHE_BATCH 64
+// Longest time (in microseconds) a write is held before being committed
+#define MBTILES_CACHE_BATCH_TIME (2 * G_USEC_PER_SEC)
+// Time to wait for another connection's lock (in milliseconds)
+#define MBTILES_CACHE_BUSY_TIMEOUT 5000
+
+typedef struct {
+  sqlite3 *db;
+  sqlite3_stmt *select_data;
+  sqlite3_stmt *select_size;
+  sqlite3_stmt *select_range;
+} MBTilesReader;
+
+struct _MBTilesCache {
+  gint ref_count;          // Protected by the open_files lock
+  gchar *filename;
+  gboolean writable;
+  GMutex *mutex;           // Protects readers, pending & committing
+  GQueue readers;          // Idle reader connections
+  GHashTable *pending;     // Tile key to GBytes (or NULL for a removal) not yet committed
+  GHashTable *committing;  // The batch being committed
+  gint64 pending_since;
+  GMutex *write_mutex;     // Serialises the commits
+  sqlite3 *writer;
+  sqlite3_stmt *insert;
+  sqlite3_stmt *delete;
+};
+
+// Filename to MBTilesCache, so all users of a file share the same connections and pending writes
+static GHashTable *open_files = NULL;
+G_LOCK_DEFINE_STATIC(open_files);
+
+#define MBTILES_KEY_MASK 0x1FFFFFFF
+
+static gint64 *key_new ( gint zoom, gint x, gint y )
+{
+  gint64 *key = g_new ( gint64, 1 );
+  *key = ((gint64)(zoom & 0x1F) << 58) | ((gint64)(x & MBTILES_KEY_MASK) << 29) | (y & MBTILES_KEY_MASK);
+  return key;
+}
+
+// MBTiles stored internally with the flipping y thingy (i.e. TMS scheme).
+static gint flip_y ( gint zoom, gint y )
+{
+  return (1 << zoom) - 1 - y;
+}
+
+static void bytes_unref ( gpointer data )
+{
+  if ( data )
+    g_bytes_unref ( (GBytes*)data );
+}
+
+static GHashTable *pending_new ( void )
+{
+  return g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, bytes_unref );
+}
+
+static gboolean sql_exec ( sqlite3 *db, const gchar *statement )
+{
+  char *errMsg = NULL;
+  int ans = sqlite3_exec ( db, statement, NULL, NULL, &errMsg );
+  if ( ans != SQLITE_OK ) {
+    g_warning ( "%s: %s - %s", __FUNCTION__, statement, errMsg );
+    sqlite3_free ( errMsg );
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static sqlite3_stmt *sql_prepare ( sqlite3 *db, const gchar *statement )
+{
+  sqlite3_stmt *stmt = NULL;
+  int ans = sqlite3_prepare_v2 ( db, statement, -1, &stmt, NULL );
+  if ( ans != SQLITE_OK ) {
+    g_warning ( "%s: %s - %s: %s", __FUNCTION__, "prepare failure", sqlite3_errmsg(db), statement );
+    (void)sqlite3_finalize ( stmt );
+    return NULL;
+  }
+  return stmt;
+}
+
+static sqlite3 *sql_open ( const gchar *filename, int flags )
+{
+  sqlite3 *db = NULL;
+  // Each connection is only used by one thread at a time
+  int ans = sqlite3_open_v2 ( filename, &db, flags | SQLITE_OPEN_NOMUTEX, NULL );
+  if ( ans != SQLITE_OK ) {
+    g_warning ( "%s: %s - %s", __FUNCTION__, filename, sqlite3_errmsg(db) );
+    (void)sqlite3_close ( db );
+    return NULL;
+  }
+  (void)sqlite3_busy_timeout ( db, MBTILES_CACHE_BUSY_TIMEOUT );
+  return db;
+}
+
+static void reader_free ( MBTilesReader *reader )
+{
+  (void)sqlite3_finalize ( reader->select_data );
+  (void)sqlite3_finalize ( reader->select_size );
+  (void)sqlite3_finalize ( reader->select_range );
+  (void)sqlite3_close ( reader->db );
+  g_free ( reader );
+}
+
+static MBTilesReader *reader_new ( MBTilesCache *mbc )
+{
+  sqlite3 *db = sql_open ( mbc->filename, mbc->writable ? SQLITE_OPEN_READWRITE : SQLITE_OPEN_READONLY );
+  if ( !db )
+    return NULL;
+  MBTilesReader *reader = g_malloc0 ( sizeof(MBTilesReader) );
+  reader->db = db;
+  reader->select_data = sql_prepare ( db, "SELECT tile_data FROM tiles WHERE zoom_level=?1 AND tile_column=?2 AND tile_row=?3;" );
+  reader->select_size = sql_prepare ( db, "SELECT length(tile_data) FROM tiles WHERE zoom_level=?1 AND tile_column=?2 AND tile_row=?3;" );
+  reader->select_range = sql_prepare ( db, "SELECT tile_column, tile_row, tile_data FROM tiles WHERE zoom_level=?1 AND tile_column BETWEEN ?2 AND ?3 AND tile_row BETWEEN ?4 AND ?5;" );
+  if ( !reader->select_data || !reader->select_size || !reader->select_range ) {
+    reader_free ( reader );
+    return NULL;
+  }
+  return reader;
+}
+
+/**
+ * Take a reader from the pool, or create a new one if all are in use
+ */
+static MBTilesReader *reader_get ( MBTilesCache *mbc )
+{
+  g_mutex_lock ( mbc->mutex );
+  MBTilesReader *reader = g_queue_pop_head ( &mbc->readers );
+  g_mutex_unlock ( mbc->mutex );
+  if ( !reader )
+    reader = reader_new ( mbc );
+  return reader;
+}
+
+static void reader_put ( MBTilesCache *mbc, MBTilesReader *reader, sqlite3_stmt *stmt )
+{
+  (void)sqlite3_reset ( stmt );
+  (void)sqlite3_clear_bindings ( stmt );
+  g_mutex_lock ( mbc->mutex );
+  g_queue_push_head ( &mbc->readers, reader );
+  g_mutex_unlock ( mbc->mutex );
+}
+
+static gboolean writer_open ( MBTilesCache *mbc )
+{
+  mbc->writer = sql_open ( mbc->filename, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE );
+  if ( !mbc->writer )
+    return FALSE;
+
+  gboolean ans = sql_exec ( mbc->writer, "PRAGMA journal_mode=WAL;" ) &&
+                 // Durability of the last few tiles doesn't matter as they can be downloaded again
+                 sql_exec ( mbc->writer, "PRAGMA synchronous=NORMAL;" ) &&
+                 sql_exec ( mbc->writer, "CREATE TABLE IF NOT EXISTS metadata (name TEXT, value TEXT);" ) &&
+                 sql_exec ( mbc->writer, "CREATE TABLE IF NOT EXISTS tiles (zoom_level INTEGER, tile_column INTEGER, tile_row INTEGER, tile_data BLOB);" ) &&
+                 sql_exec ( mbc->writer, "CREATE UNIQUE INDEX IF NOT EXISTS tile_index ON tiles (zoom_level, tile_column, tile_row);" );
+  if ( ans ) {
+    mbc->insert = sql_prepare ( mbc->writer, "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?1, ?2, ?3, ?4);" );
+    mbc->delete = sql_prepare ( mbc->writer, "DELETE FROM tiles WHERE zoom_level=?1 AND tile_column=?2 AND tile_row=?3;" );
+    ans = mbc->insert && mbc->delete;
+  }
+  return ans;
+}
+
+static void mbtiles_cache_free ( MBTilesCache *mbc )
+{
+  (void)a_mbtiles_cache_flush ( mbc );
+  MBTilesReader *reader;
+  while ( (reader = g_queue_pop_head ( &mbc->readers )) )
+    reader_free ( reader );
+  (void)sqlite3_finalize ( mbc->insert );
+  (void)sqlite3_finalize ( mbc->delete );
+  (void)sqlite3_close ( mbc->writer );
+  g_hash_table_destroy ( mbc->pending );
+  vik_mutex_free ( mbc->write_mutex );
+  vik_mutex_free ( mbc->mutex );
+  g_free ( mbc->filename );
+  g_free ( mbc );
+}
+
+/**
+ * a_mbtiles_cache_open:
+ * @filename: The MBTiles file
+ * @writable: Whether tiles will be stored. The file is created if necessary.
+ *
+ * Returns: The file access, shared with any other users of the same file, or NULL on failure.
+ *  Release with a_mbtiles_cache_unref()
+ */
+MBTilesCache *a_mbtiles_cache_open ( const gchar *filename, gboolean writable )
+{
+  G_LOCK(open_files);
+  if ( !open_files )
+    open_files = g_hash_table_new ( g_str_hash, g_str_equal );
+  MBTilesCache *mbc = g_hash_table_lookup ( open_files, filename );
+  if ( mbc && (mbc->writable || !writable) ) {
+    mbc->ref_count++;
+    G_UNLOCK(open_files);
+    return mbc;
+  }
+  if ( mbc ) {
+    // Existing user only reads it
+    G_UNLOCK(open_files);
+    g_warning ( "%s: %s already open read only", __FUNCTION__, filename );
+    return NULL;
+  }
+
+  mbc = g_malloc0 ( sizeof(MBTilesCache) );
+  mbc->ref_count = 1;
+  mbc->filename = g_strdup ( filename );
+  mbc->writable = writable;
+  mbc->mutex = vik_mutex_new ();
+  mbc->write_mutex = vik_mutex_new ();
+  g_queue_init ( &mbc->readers );
+  mbc->pending = pending_new ();
+
+  // Readers need the schema to exist, so set up the file first
+  MBTilesReader *reader = NULL;
+  if ( writable && !writer_open ( mbc ) ) {
+    mbtiles_cache_free ( mbc );
+    mbc = NULL;
+  }
+  else if ( (reader = reader_new ( mbc )) ) {
+    g_queue_push_head ( &mbc->readers, reader );
+  }
+  else {
+    mbtiles_cache_free ( mbc );
+    mbc = NULL;
+  }
+
+  if ( mbc )
+    g_hash_table_insert ( open_files, mbc->filename, mbc );
+  G_UNLOCK(open_files);
+  return mbc;
+}
+
+MBTilesCache *a_mbtiles_cache_ref ( MBTilesCache *mbc )
+{
+  G_LOCK(open_files);
+  mbc->ref_count++;
+  G_UNLOCK(open_files);
+  return mbc;
+}
+
+/**
+ * Any pending tiles are committed when the last user has finished
+ */
+void a_mbtiles_cache_unref ( MBTilesCache *mbc )
+{
+  if ( !mbc )
+    return;
+  G_LOCK(open_files);
+  gboolean last = ( --mbc->ref_count == 0 );
+  if ( last )
+    (void)g_hash_table_remove ( open_files, mbc->filename );
+  G_UNLOCK(open_files);
+  if ( last )
+    mbtiles_cache_free ( mbc );
+}
+
+const gchar *a_mbtiles_cache_get_filename ( MBTilesCache *mbc )
+{
+  return mbc->filename;
+}
+
+/**
+ * Check the writes not yet in the file
+ * Returns: TRUE if the tile is there, and its data if not removed
+ */
+static gboolean pending_lookup ( MBTilesCache *mbc, gint zoom, gint x, gint y, GBytes **bytes )
+{
+  gint64 *key = key_new ( zoom, x, y );
+  gpointer value = NULL;
+  g_mutex_lock ( mbc->mutex );
+  gboolean found = g_hash_table_lookup_extended ( mbc->pending, key, NULL, &value );
+  if ( !found && mbc->committing )
+    found = g_hash_table_lookup_extended ( mbc->committing, key, NULL, &value );
+  if ( found && value )
+    *bytes = g_bytes_ref ( (GBytes*)value );
+  g_mutex_unlock ( mbc->mutex );
+  g_free ( key );
+  return found;
+}
+
+static void bind_tile ( sqlite3_stmt *stmt, gint zoom, gint x, gint y )
+{
+  (void)sqlite3_bind_int ( stmt, 1, zoom );
+  (void)sqlite3_bind_int ( stmt, 2, x );
+  (void)sqlite3_bind_int ( stmt, 3, flip_y ( zoom, y ) );
+}
+
+/**
+ * a_mbtiles_cache_get:
+ *
+ * Returns: The tile data or NULL if not available
+ */
+GBytes *a_mbtiles_cache_get ( MBTilesCache *mbc, gint zoom, gint x, gint y )
+{
+  GBytes *bytes = NULL;
+  if ( pending_lookup ( mbc, zoom, x, y, &bytes ) )
+    return bytes;
+
+  MBTilesReader *reader = reader_get ( mbc );
+  if ( !reader )
+    return NULL;
+  bind_tile ( reader->select_data, zoom, x, y );
+  int ans = sqlite3_step ( reader->select_data );
+  if ( ans == SQLITE_ROW ) {
+    int len = sqlite3_column_bytes ( reader->select_data, 0 );
+    // Blob is only valid until the statement is reset, so copy it
+    if ( len > 0 )
+      bytes = g_bytes_new ( sqlite3_column_blob ( reader->select_data, 0 ), len );
+  }
+  else if ( ans != SQLITE_DONE )
+    g_warning ( "%s: %s - %s", __FUNCTION__, "step issue", sqlite3_errstr(ans) );
+  reader_put ( mbc, reader, reader->select_data );
+  return bytes;
+}
+
+/**
+ * a_mbtiles_cache_size:
+ *
+ * Returns: The size of the tile data, or -1 if the tile isn't stored
+ */
+goffset a_mbtiles_cache_size ( MBTilesCache *mbc, gint zoom, gint x, gint y )
+{
+  GBytes *bytes = NULL;
+  if ( pending_lookup ( mbc, zoom, x, y, &bytes ) ) {
+    if ( !bytes )
+      return -1;
+    goffset size = g_bytes_get_size ( bytes );
+    g_bytes_unref ( bytes );
+    return size;
+  }
+
+  MBTilesReader *reader = reader_get ( mbc );
+  if ( !reader )
+    return -1;
+  goffset size = -1;
+  bind_tile ( reader->select_size, zoom, x, y );
+  int ans = sqlite3_step ( reader->select_size );
+  if ( ans == SQLITE_ROW )
+    size = sqlite3_column_int64 ( reader->select_size, 0 );
+  else if ( ans != SQLITE_DONE )
+    g_warning ( "%s: %s - %s", __FUNCTION__, "step issue", sqlite3_errstr(ans) );
+  reader_put ( mbc, reader, reader->select_size );
+  return size;
+}
+
+/**
+ * a_mbtiles_cache_get_range:
+ * @func: Called for each tile found
+ *
+ * Get all the stored tiles in the rectangle (inclusive) in a single query.
+ * Intended for prefetching, as tiles not yet written to the file may be missed.
+ *
+ * Returns: The number of tiles found
+ */
+guint a_mbtiles_cache_get_range ( MBTilesCache *mbc, gint zoom, gint x0, gint x1, gint y0, gint y1, MBTilesCacheTileFunc func, gpointer user_data )
+{
+  MBTilesReader *reader = reader_get ( mbc );
+  if ( !reader )
+    return 0;
+
+  guint count = 0;
+  sqlite3_stmt *stmt = reader->select_range;
+  (void)sqlite3_bind_int ( stmt, 1, zoom );
+  (void)sqlite3_bind_int ( stmt, 2, MIN(x0, x1) );
+  (void)sqlite3_bind_int ( stmt, 3, MAX(x0, x1) );
+  (void)sqlite3_bind_int ( stmt, 4, flip_y ( zoom, MAX(y0, y1) ) );
+  (void)sqlite3_bind_int ( stmt, 5, flip_y ( zoom, MIN(y0, y1) ) );
+  int ans;
+  while ( (ans = sqlite3_step ( stmt )) == SQLITE_ROW ) {
+    gint x = sqlite3_column_int ( stmt, 0 );
+    gint y = flip_y ( zoom, sqlite3_column_int ( stmt, 1 ) );
+    GBytes *bytes = NULL;
+    // Newer changes take precedence
+    if ( mbc->writable && pending_lookup ( mbc, zoom, x, y, &bytes ) ) {
+      if ( !bytes )
+        continue;
+    }
+    else {
+      int len = sqlite3_column_bytes ( stmt, 2 );
+      if ( len < 1 )
+        continue;
+      bytes = g_bytes_new ( sqlite3_column_blob ( stmt, 2 ), len );
+    }
+    func ( x, y, bytes, user_data );
+    g_bytes_unref ( bytes );
+    count++;
+  }
+  if ( ans != SQLITE_DONE )
+    g_warning ( "%s: %s - %s", __FUNCTION__, "step issue", sqlite3_errstr(ans) );
+  reader_put ( mbc, reader, stmt );
+  return count;
+}
+
+/**
+ * Queue a change, committing the queue once enough have built up
+ */
+static gboolean pending_add ( MBTilesCache *mbc, gint zoom, gint x, gint y, GBytes *bytes )
+{
+  if ( !mbc->writable )
+    return FALSE;
+  gint64 now = g_get_monotonic_time ();
+  g_mutex_lock ( mbc->mutex );
+  if ( g_hash_table_size ( mbc->pending ) == 0 )
+    mbc->pending_since = now;
+  g_hash_table_replace ( mbc->pending, key_new ( zoom, x, y ), bytes ? g_bytes_ref ( bytes ) : NULL );
+  gboolean commit = g_hash_table_size ( mbc->pending ) >= MBTILES_CACHE_BATCH ||
+                    now - mbc->pending_since >= MBTILES_CACHE_BATCH_TIME;
+  g_mutex_unlock ( mbc->mutex );
+  if ( commit )
+    return a_mbtiles_cache_flush ( mbc );
+  return TRUE;
+}
+
+/**
+ * a_mbtiles_cache_put:
+ *
+ * Store the tile data. It is immediately available to get,
+ *  although written to the file later in a batch.
+ */
+gboolean a_mbtiles_cache_put ( MBTilesCache *mbc, gint zoom, gint x, gint y, GBytes *bytes )
+{
+  return pending_add ( mbc, zoom, x, y, bytes );
+}
+
+void a_mbtiles_cache_remove ( MBTilesCache *mbc, gint zoom, gint x, gint y )
+{
+  (void)pending_add ( mbc, zoom, x, y, NULL );
+}
+
+void a_mbtiles_cache_set_metadata ( MBTilesCache *mbc, const gchar *name, const gchar *value )
+{
+  if ( !mbc->writable )
+    return;
+  g_mutex_lock ( mbc->write_mutex );
+  sqlite3_stmt *del = sql_prepare ( mbc->writer, "DELETE FROM metadata WHERE name=?1;" );
+  sqlite3_stmt *ins = sql_prepare ( mbc->writer, "INSERT INTO metadata (name, value) VALUES (?1, ?2);" );
+  if ( del && ins ) {
+    (void)sqlite3_bind_text ( del, 1, name, -1, SQLITE_STATIC );
+    (void)sqlite3_bind_text ( ins, 1, name, -1, SQLITE_STATIC );
+    (void)sqlite3_bind_text ( ins, 2, value, -1, SQLITE_STATIC );
+    if ( sqlite3_step ( del ) != SQLITE_DONE || sqlite3_step ( ins ) != SQLITE_DONE )
+      g_warning ( "%s: %s - %s", __FUNCTION__, name, sqlite3_errmsg(mbc->writer) );
+  }
+  (void)sqlite3_finalize ( del );
+  (void)sqlite3_finalize ( ins );
+  g_mutex_unlock ( mbc->write_mutex );
+}
+
+/**
+ * a_mbtiles_cache_flush:
+ *
+ * Commit all pending changes to the file in a single transaction
+ */
+gboolean a_mbtiles_cache_flush ( MBTilesCache *mbc )
+{
+  if ( !mbc->writable )
+    return TRUE;
+
+  // One commit at a time, so changes are applied in order
+  g_mutex_lock ( mbc->write_mutex );
+
+  g_mutex_lock ( mbc->mutex );
+  GHashTable *batch = mbc->pending;
+  gboolean empty = g_hash_table_size ( batch ) == 0;
+  if ( !empty ) {
+    // Still visible to lookups until in the file
+    mbc->committing = batch;
+    mbc->pending = pending_new ();
+  }
+  g_mutex_unlock ( mbc->mutex );
+
+  if ( empty ) {
+    g_mutex_unlock ( mbc->write_mutex );
+    return TRUE;
+  }
+
+  gboolean ans = sql_exec ( mbc->writer, "BEGIN IMMEDIATE;" );
+  if ( ans ) {
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init ( &iter, batch );
+    while ( ans && g_hash_table_iter_next ( &iter, &key, &value ) ) {
+      gint64 kk = *(gint64*)key;
+      gint zoom = (gint)(kk >> 58);
+      gint x = (gint)((kk >> 29) & MBTILES_KEY_MASK);
+      gint y = (gint)(kk & MBTILES_KEY_MASK);
+      sqlite3_stmt *stmt = value ? mbc->insert : mbc->delete;
+      bind_tile ( stmt, zoom, x, y );
+      if ( value ) {
+        gsize len = 0;
+        gconstpointer data = g_bytes_get_data ( (GBytes*)value, &len );
+        // Data is held by the batch until after the step
+        (void)sqlite3_bind_blob ( stmt, 4, data, len, SQLITE_STATIC );
+      }
+      if ( sqlite3_step ( stmt ) != SQLITE_DONE ) {
+        g_warning ( "%s: %s - %s", __FUNCTION__, mbc->filename, sqlite3_errmsg(mbc->writer) );
+        ans = FALSE;
+      }
+      (void)sqlite3_reset ( stmt );
+      (void)sqlite3_clear_bindings ( stmt );
+    }
+    if ( ans )
+      ans = sql_exec ( mbc->writer, "COMMIT;" );
+    if ( !ans )
+      (void)sql_exec ( mbc->writer, "ROLLBACK;" );
+  }
+
+  g_mutex_lock ( mbc->mutex );
+  mbc->committing = NULL;
+  g_mutex_unlock ( mbc->mutex );
+  g_hash_table_destroy ( batch );
+
+  g_mutex_unlock ( mbc->write_mutex );
+  return ans;
+}
+
+#else
+
+// Without SQLite support nothing can be opened, so the other functions are never used
+MBTilesCache *a_mbtiles_cache_open ( const gchar *filename, gboolean writable ) { return NULL; }
+MBTilesCache *a_mbtiles_cache_ref ( MBTilesCache *mbc ) { return mbc; }
+void a_mbtiles_cache_unref ( MBTilesCache *mbc ) {}
+const gchar *a_mbtiles_cache_get_filename ( MBTilesCache *mbc ) { return NULL; }
+GBytes *a_mbtiles_cache_get ( MBTilesCache *mbc, gint zoom, gint x, gint y ) { return NULL; }
+goffset a_mbtiles_cache_size ( MBTilesCache *mbc, gint zoom, gint x, gint y ) { return -1; }
+guint a_mbtiles_cache_get_range ( MBTilesCache *mbc, gint zoom, gint x0, gint x1, gint y0, gint y1, MBTilesCacheTileFunc func, gpointer user_data ) { return 0; }
+gboolean a_mbtiles_cache_put ( MBTilesCache *mbc, gint zoom, gint x, gint y, GBytes *bytes ) { return FALSE; }
+void a_mbtiles_cache_remove ( MBTilesCache *mbc, gint zoom, gint x, gint y ) {}
+void a_mbtiles_cache_set_metadata ( MBTilesCache *mbc, const gchar *name, const gchar *value ) {}
+gboolean a_mbtiles_cache_flush ( MBTilesCache *mbc ) { return FALSE; }
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_MBTILESCACHE_H
+#define __VIKING_MBTILESCACHE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Tile storage in a single MBTiles (SQLite) file
+// Safe to use from any thread
+typedef struct _MBTilesCache MBTilesCache;
+
+MBTilesCache *a_mbtiles_cache_open ( const gchar *filename, gboolean writable );
+MBTilesCache *a_mbtiles_cache_ref ( MBTilesCache *mbc );
+void a_mbtiles_cache_unref ( MBTilesCache *mbc );
+const gchar *a_mbtiles_cache_get_filename ( MBTilesCache *mbc );
+
+// Zoom levels and tile positions are as per OSM (i.e. the y flipping is handled internally)
+GBytes *a_mbtiles_cache_get ( MBTilesCache *mbc, gint zoom, gint x, gint y );
+goffset a_mbtiles_cache_size ( MBTilesCache *mbc, gint zoom, gint x, gint y );
+typedef void (*MBTilesCacheTileFunc) ( gint x, gint y, GBytes *bytes, gpointer user_data );
+guint a_mbtiles_cache_get_range ( MBTilesCache *mbc, gint zoom, gint x0, gint x1, gint y0, gint y1, MBTilesCacheTileFunc func, gpointer user_data );
+gboolean a_mbtiles_cache_put ( MBTilesCache *mbc, gint zoom, gint x, gint y, GBytes *bytes );
+void a_mbtiles_cache_remove ( MBTilesCache *mbc, gint zoom, gint x, gint y );
+void a_mbtiles_cache_set_metadata ( MBTilesCache *mbc, const gchar *name, const gchar *value );
+gboolean a_mbtiles_cache_flush ( MBTilesCache *mbc );
+
+G_END_DECLS
+
+#endif
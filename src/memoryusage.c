@@ -0,0 +1,228 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib/gi18n.h>
+#include "viking.h"
+#include "memoryusage.h"
+#include "vikgpslayer.h"
+#include "thumbnails.h"
+#include "imagecache.h"
+#include "pixbufpool.h"
+#include "dems.h"
+
+/*
+ * The figures are what each layer can account for itself - an estimate from the sizes
+ *  of its data structures rather than what the allocator actually holds.
+ * Memory shared between layers (such as DEMs used by several DEM layers)
+ *  is counted by each of the layers using it.
+ */
+
+enum {
+  COL_NAME = 0,
+  COL_TYPE,
+  COL_FIRST_SIZE,
+  COL_TOTAL = COL_FIRST_SIZE + VIK_LAYER_MEMORY_NUM,
+  COL_WEIGHT,
+  COL_NUM
+};
+
+static gsize memory_limit ( void )
+{
+  return (gsize)a_vik_get_memory_warning_size() * 1024 * 1024;
+}
+
+static void size_cell_data_func ( GtkTreeViewColumn *col,
+                                  GtkCellRenderer   *renderer,
+                                  GtkTreeModel      *model,
+                                  GtkTreeIter       *iter,
+                                  gpointer           user_data )
+{
+  guint64 value;
+  gtk_tree_model_get ( model, iter, GPOINTER_TO_INT(user_data), &value, -1 );
+  if ( value ) {
+    gchar *str = g_format_size ( value );
+    g_object_set ( renderer, "text", str, NULL );
+    g_free ( str );
+  }
+  else
+    g_object_set ( renderer, "text", "", NULL );
+}
+
+static void set_row ( GtkTreeStore *store, GtkTreeIter *iter, const gchar *name, const gchar *type, const VikLayerMemory *mem, gboolean over )
+{
+  gtk_tree_store_set ( store, iter,
+                       COL_NAME, name,
+                       COL_TYPE, type,
+                       COL_TOTAL, (guint64)vik_layer_memory_total ( mem ),
+                       COL_WEIGHT, over ? PANGO_WEIGHT_BOLD : PANGO_WEIGHT_NORMAL,
+                       -1 );
+  for ( guint ii = 0; ii < VIK_LAYER_MEMORY_NUM; ii++ )
+    gtk_tree_store_set ( store, iter, COL_FIRST_SIZE + ii, (guint64)mem->bytes[ii], -1 );
+}
+
+/**
+ * Add a row for the layer, with rows for any layers within it
+ *  and add the memory of them all into total
+ */
+static void add_layer ( GtkTreeStore *store, GtkTreeIter *parent, VikLayer *vl, VikLayerMemory *total )
+{
+  VikLayerMemory mem;
+  vik_layer_get_memory ( vl, &mem );
+  gboolean over = memory_limit() && vik_layer_memory_total ( &mem ) > memory_limit();
+
+  GtkTreeIter iter;
+  gtk_tree_store_append ( store, &iter, parent );
+
+  const GList *children = NULL;
+  if ( vl->type == VIK_LAYER_AGGREGATE )
+    children = vik_aggregate_layer_get_children ( VIK_AGGREGATE_LAYER(vl) );
+  else if ( vl->type == VIK_LAYER_GPS )
+    children = vik_gps_layer_get_children ( VIK_GPS_LAYER(vl) );
+  for ( const GList *gl = children; gl; gl = gl->next )
+    add_layer ( store, &iter, VIK_LAYER(gl->data), &mem );
+
+  // Container rows show the sum of their contents
+  set_row ( store, &iter, vl->name, _(vik_layer_get_interface(vl->type)->name), &mem, over );
+
+  for ( guint ii = 0; ii < VIK_LAYER_MEMORY_NUM; ii++ )
+    total->bytes[ii] += mem.bytes[ii];
+}
+
+static void add_shared ( GtkTreeStore *store, const gchar *name, VikLayerMemoryType type, gsize bytes, VikLayerMemory *total )
+{
+  VikLayerMemory mem;
+  memset ( &mem, 0, sizeof(VikLayerMemory) );
+  mem.bytes[type] = bytes;
+  GtkTreeIter iter;
+  gtk_tree_store_append ( store, &iter, NULL );
+  set_row ( store, &iter, name, _("Shared"), &mem, FALSE );
+  total->bytes[type] += bytes;
+}
+
+/**
+ * a_memory_usage_show:
+ * @parent:         The window for the dialog
+ * @vl:             The layer to report on, including any layers within it
+ * @include_shared: Whether to also report the caches not belonging to any one layer
+ *
+ * Show the estimated memory used, by layer and kind of data.
+ * The rows are sortable, so the biggest users can be found quickly.
+ */
+void a_memory_usage_show ( GtkWindow *parent, VikLayer *vl, gboolean include_shared )
+{
+  GtkTreeStore *store = gtk_tree_store_new ( COL_NUM,
+                                             G_TYPE_STRING, G_TYPE_STRING,
+                                             G_TYPE_UINT64, G_TYPE_UINT64, G_TYPE_UINT64,
+                                             G_TYPE_UINT64, G_TYPE_UINT64, G_TYPE_UINT64,
+                                             G_TYPE_UINT64, G_TYPE_INT );
+  VikLayerMemory total;
+  memset ( &total, 0, sizeof(VikLayerMemory) );
+  add_layer ( store, NULL, vl, &total );
+  if ( include_shared ) {
+    add_shared ( store, _("Thumbnail Cache"), VIK_LAYER_MEMORY_IMAGES, a_thumbnails_get_cache_size(), &total );
+    add_shared ( store, _("Shared Images"), VIK_LAYER_MEMORY_IMAGES, a_image_cache_get_size(), &total );
+    add_shared ( store, _("Free Tile Buffers"), VIK_LAYER_MEMORY_IMAGES, a_pixbuf_pool_get_size(), &total );
+    add_shared ( store, _("Unused DEMs"), VIK_LAYER_MEMORY_DEM, a_dems_get_unused_size(), &total );
+  }
+
+  GtkWidget *dialog = gtk_dialog_new_with_buttons ( _("Memory Usage"),
+                                                    parent,
+                                                    GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                    GTK_STOCK_CLOSE,
+                                                    GTK_RESPONSE_CLOSE,
+                                                    NULL );
+
+  GtkWidget *view = gtk_tree_view_new_with_model ( GTK_TREE_MODEL(store) );
+
+  GtkCellRenderer *renderer = gtk_cell_renderer_text_new ();
+  GtkTreeViewColumn *column = ui_new_column_text ( _("Name"), renderer, view, COL_NAME );
+  gtk_tree_view_column_add_attribute ( column, renderer, "weight", COL_WEIGHT );
+  gtk_tree_view_column_set_expand ( column, TRUE );
+  column = ui_new_column_text ( _("Type"), renderer, view, COL_TYPE );
+  gtk_tree_view_column_add_attribute ( column, renderer, "weight", COL_WEIGHT );
+
+  GtkCellRenderer *renderer_size = gtk_cell_renderer_text_new ();
+  g_object_set ( G_OBJECT(renderer_size), "xalign", 1.0, NULL );
+  for ( gint col = COL_FIRST_SIZE; col <= COL_TOTAL; col++ ) {
+    const gchar *title = col == COL_TOTAL ? _("Total") : vik_layer_memory_type_name ( col - COL_FIRST_SIZE );
+    column = ui_new_column_text ( title, renderer_size, view, col );
+    gtk_tree_view_column_add_attribute ( column, renderer_size, "weight", COL_WEIGHT );
+    gtk_tree_view_column_set_cell_data_func ( column, renderer_size, size_cell_data_func, GINT_TO_POINTER(col), NULL );
+  }
+  // Biggest first
+  gtk_tree_sortable_set_sort_column_id ( GTK_TREE_SORTABLE(store), COL_TOTAL, GTK_SORT_DESCENDING );
+  g_object_unref ( store );
+  gtk_tree_view_set_rules_hint ( GTK_TREE_VIEW(view), TRUE );
+  gtk_tree_view_expand_all ( GTK_TREE_VIEW(view) );
+
+  GtkWidget *scrolledwindow = gtk_scrolled_window_new ( NULL, NULL );
+  gtk_scrolled_window_set_policy ( GTK_SCROLLED_WINDOW(scrolledwindow), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC );
+  gtk_container_add ( GTK_CONTAINER(scrolledwindow), view );
+
+  gchar *total_str = g_format_size ( vik_layer_memory_total ( &total ) );
+  gchar *msg;
+  if ( memory_limit() ) {
+    gchar *limit_str = g_format_size ( memory_limit() );
+    msg = g_strdup_printf ( _("Total: %s. Layers over the warning size of %s are shown in bold."), total_str, limit_str );
+    g_free ( limit_str );
+  }
+  else
+    msg = g_strdup_printf ( _("Total: %s"), total_str );
+  GtkWidget *label = gtk_label_new ( msg );
+  g_free ( msg );
+  g_free ( total_str );
+
+  GtkBox *vbox = GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(dialog)));
+  gtk_box_pack_start ( vbox, scrolledwindow, TRUE, TRUE, 0 );
+  gtk_box_pack_end ( vbox, label, FALSE, FALSE, 5 );
+
+  g_signal_connect ( G_OBJECT(dialog), "response", G_CALLBACK(gtk_widget_destroy), NULL );
+  gtk_window_set_default_size ( GTK_WINDOW(dialog), 750, 400 );
+  gtk_widget_show_all ( dialog );
+}
+
+/**
+ * a_memory_usage_check:
+ *
+ * Normally after the layer's data has been read in.
+ * The warning is only given once per layer, so it does not keep interrupting.
+ */
+void a_memory_usage_check ( VikLayer *vl )
+{
+  if ( !memory_limit() || vl->memory_warned )
+    return;
+
+  VikLayerMemory mem;
+  vik_layer_get_memory ( vl, &mem );
+  gsize total = vik_layer_memory_total ( &mem );
+  if ( total <= memory_limit() )
+    return;
+
+  vl->memory_warned = TRUE;
+  gchar *size = g_format_size ( total );
+  gchar *msg = g_strdup_printf ( _("Layer '%s' is using %s of memory"), vl->name, size );
+  g_message ( "%s", msg );
+  if ( vl->vt )
+    vik_window_statusbar_update ( VIK_WINDOW_FROM_WIDGET(vl->vt), msg, VIK_STATUSBAR_INFO );
+  g_free ( msg );
+  g_free ( size );
+}
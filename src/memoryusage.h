@@ -0,0 +1,37 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_MEMORYUSAGE_H
+#define __VIKING_MEMORYUSAGE_H
+
+#include <gtk/gtk.h>
+#include "viklayer.h"
+
+G_BEGIN_DECLS
+
+// Report of the memory held by the layer and any layers within it
+//  (plus the caches shared by all layers when include_shared)
+void a_memory_usage_show ( GtkWindow *parent, VikLayer *vl, gboolean include_shared );
+
+// Warn (once per layer) when the layer uses more than the memory warning preference
+void a_memory_usage_check ( VikLayer *vl );
+
+G_END_DECLS
+
+#endif
@@ -6,6 +6,7 @@ static const char *menu_xml =
 	"  <menubar name='MainMenu'>"
 	"    <menu action='File'>"
 	"      <menuitem action='New'/>"
+	"      <menuitem action='NewView'/>"
 	"      <menuitem action='Open'/>"
 	"      <menuitem action='OpenRecentFile'/>"
 	"      <menuitem action='Append'/>"
@@ -31,6 +32,7 @@ static const char *menu_xml =
 	"        <menuitem action='AcquireGeotag'/>"
 #endif
 	"        <menuitem action='AcquireURL'/>"
+	"        <menuitem action='AcquireFIT'/>"
 #ifdef VIK_CONFIG_GEONAMES
 	"        <menuitem action='AcquireWikipedia'/>"
 #endif
@@ -99,6 +101,7 @@ static const char *menu_xml =
 	"          <menuitem action='ViewSidePanelTabs'/>"
 	"          <menuitem action='ViewSidePanelCalendar'/>"
 	"          <menuitem action='ViewSidePanelGoto'/>"
+	"          <menuitem action='ShowPerformance'/>"
 	"      </menu>"
 	"      <separator/>"
 	"      <menuitem action='ZoomIn'/>"
@@ -116,6 +119,7 @@ static const char *menu_xml =
 	"      <separator/>"
 	"      <menuitem action='BGJobs'/>"
 	"      <menuitem action='Log'/>"
+	"      <menuitem action='MemoryUsage'/>"
 	"    </menu>"
 	"    <menu action='Layers'>"
 	"      <menuitem action='Properties'/>"
@@ -32,6 +32,7 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <glib/gstdio.h>
 
 #include "metatile.h"
 /**
@@ -54,10 +55,6 @@ struct meta_layout {
     // The index offsets are measured from the start of the file
 };
 
-// Use this to enable meta-tiles which will render NxN tiles at once
-// Note: This should be a power of 2 (2, 4, 8, 16 ...)
-#define METATILE (8)
-
 /**
  * xyz_to_meta:
  * Based on function from mod_tile/src/store_file_utils.c
@@ -191,3 +188,264 @@ int metatile_read(const char *dir, int x, int y, int z, char *buf, size_t sz, in
     close(fd);
     return pos;
 }
+
+/**
+ * Metatiles recently read, kept mapped into memory
+ *  so further tiles from the same metatile don't go back to the file
+ */
+#define METATILE_CACHE_SIZE 16
+
+typedef struct {
+    char *path;
+    GMappedFile *mf;
+    gint64 mtime;
+    goffset size;
+    int compressed;
+    struct entry index[METATILE*METATILE];
+} metatile_mapping;
+
+static GQueue mappings = G_QUEUE_INIT; // Most recently used at the head
+G_LOCK_DEFINE_STATIC(mappings);
+
+static void mapping_free(metatile_mapping *mm)
+{
+    g_mapped_file_unref(mm->mf);
+    g_free(mm->path);
+    g_free(mm);
+}
+
+/**
+ * Map the file and take a copy of the parsed header
+ *
+ * Returns NULL on errors, with the message in log_msg
+ */
+static metatile_mapping *mapping_new(const char *path, GStatBuf *sb, char *log_msg)
+{
+    unsigned int header_len = sizeof(struct meta_layout) + METATILE*METATILE*sizeof(struct entry);
+    GError *error = NULL;
+    GMappedFile *mf = g_mapped_file_new(path, FALSE, &error);
+    if (!mf) {
+        snprintf(log_msg, PATH_MAX - 1, "Could not map metatile %s. Reason: %s\n", path, error->message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    const char *contents = g_mapped_file_get_contents(mf);
+    if (g_mapped_file_get_length(mf) < header_len) {
+        snprintf(log_msg, PATH_MAX - 1, "Meta file %s too small to contain header\n", path);
+        g_mapped_file_unref(mf);
+        return NULL;
+    }
+
+    // Copy the header out, since the mapping has no alignment guarantees for the fields
+    metatile_mapping *mm = g_malloc(sizeof(metatile_mapping));
+    struct meta_layout meta;
+    memcpy(&meta, contents, sizeof(struct meta_layout));
+    memcpy(mm->index, contents + sizeof(struct meta_layout), sizeof(mm->index));
+
+    if (memcmp(meta.magic, META_MAGIC, strlen(META_MAGIC))) {
+        if (memcmp(meta.magic, META_MAGIC_COMPRESSED, strlen(META_MAGIC_COMPRESSED))) {
+            snprintf(log_msg, PATH_MAX - 1, "Meta file %s header magic mismatch\n", path);
+            g_mapped_file_unref(mf);
+            g_free(mm);
+            return NULL;
+        } else {
+            mm->compressed = 1;
+        }
+    } else mm->compressed = 0;
+
+    if (meta.count != (METATILE * METATILE)) {
+        snprintf(log_msg, PATH_MAX - 1, "Meta file %s header bad count %d != %d\n", path, meta.count, METATILE * METATILE);
+        g_mapped_file_unref(mf);
+        g_free(mm);
+        return NULL;
+    }
+
+    mm->path = g_strdup(path);
+    mm->mf = mf;
+    mm->mtime = sb->st_mtime;
+    mm->size = sb->st_size;
+    return mm;
+}
+
+/**
+ * Find the mapping for the file, mapping it now if necessary
+ *  (or if the file has changed since it was mapped)
+ *
+ * Must be called with the lock held
+ */
+static metatile_mapping *mapping_get(const char *path, char *log_msg)
+{
+    GStatBuf sb;
+    if (g_stat(path, &sb) != 0) {
+        snprintf(log_msg, PATH_MAX - 1, "Could not open metatile %s. Reason: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    GList *iter;
+    for (iter = mappings.head; iter; iter = iter->next) {
+        metatile_mapping *mm = iter->data;
+        if (strcmp(mm->path, path))
+            continue;
+        g_queue_unlink(&mappings, iter);
+        if (mm->mtime == sb.st_mtime && mm->size == sb.st_size) {
+            g_queue_push_head_link(&mappings, iter);
+            return mm;
+        }
+        // Regenerated since
+        mapping_free(mm);
+        g_list_free_1(iter);
+        break;
+    }
+
+    metatile_mapping *mm = mapping_new(path, &sb, log_msg);
+    if (!mm)
+        return NULL;
+    g_queue_push_head(&mappings, mm);
+    while (g_queue_get_length(&mappings) > METATILE_CACHE_SIZE)
+        mapping_free(g_queue_pop_tail(&mappings));
+    return mm;
+}
+
+/**
+ * metatile_get:
+ *
+ * Like metatile_read(), but the metatile file is mapped into memory and kept
+ *  in a small cache, so reading the other tiles of the same metatile
+ *  is just a lookup in the already parsed index.
+ * Safe to call from any thread.
+ *
+ * Returns the tile data (which refers directly to the mapped file)
+ *  or NULL with the error message in log_msg
+ */
+GBytes *metatile_get(const char *dir, int x, int y, int z, int *compressed, char *log_msg)
+{
+    char path[PATH_MAX];
+    GBytes *bytes = NULL;
+    int meta_offset = xyz_to_meta(path, sizeof(path), dir, x, y, z);
+
+    G_LOCK(mappings);
+    metatile_mapping *mm = mapping_get(path, log_msg);
+    if (mm) {
+        size_t file_offset = mm->index[meta_offset].offset;
+        size_t tile_size = mm->index[meta_offset].size;
+        if (tile_size > METATILE_MAX_SIZE || file_offset + tile_size > g_mapped_file_get_length(mm->mf)) {
+            snprintf(log_msg, PATH_MAX - 1, "Meta file %s bad index entry %d\n", path, meta_offset);
+        } else {
+            *compressed = mm->compressed;
+            // The data stays valid after the mapping leaves the cache, until the bytes are released
+            bytes = g_bytes_new_with_free_func(g_mapped_file_get_contents(mm->mf) + file_offset, tile_size,
+                                               (GDestroyNotify)g_mapped_file_unref, g_mapped_file_ref(mm->mf));
+        }
+    }
+    G_UNLOCK(mappings);
+    return bytes;
+}
+
+/**
+ * Drop any mapping of the file, e.g. when it is about to be rewritten
+ */
+static void mapping_forget(const char *path)
+{
+    G_LOCK(mappings);
+    GList *iter;
+    for (iter = mappings.head; iter; iter = iter->next) {
+        metatile_mapping *mm = iter->data;
+        if (!strcmp(mm->path, path)) {
+            g_queue_delete_link(&mappings, iter);
+            mapping_free(mm);
+            break;
+        }
+    }
+    G_UNLOCK(mappings);
+}
+
+/**
+ * metatile_write:
+ * @tiles: The data of each tile by its offset within the metatile (as from xyz_to_meta()),
+ *         NULL to keep the tile from any existing metatile
+ *
+ * Write the metatile containing the tile x,y,z in the layout renderd uses,
+ *  creating the directories as necessary.
+ * The file is replaced in one go, so readers never see a partially written metatile.
+ *
+ * Returns 0 on success, otherwise negative with the error message in log_msg
+ */
+int metatile_write(const char *dir, int x, int y, int z, GBytes **tiles, char *log_msg)
+{
+    char path[PATH_MAX];
+    int mask = METATILE - 1;
+    GBytes *data[METATILE*METATILE];
+    (void)xyz_to_meta(path, sizeof(path), dir, x, y, z);
+
+    // Merge in the tiles already there
+    G_LOCK(mappings);
+    metatile_mapping *mm = NULL;
+    if (g_file_test(path, G_FILE_TEST_EXISTS))
+        mm = mapping_get(path, log_msg);
+    for (int ii = 0; ii < METATILE*METATILE; ii++) {
+        data[ii] = NULL;
+        if (tiles[ii])
+            data[ii] = g_bytes_ref(tiles[ii]);
+        else if (mm && !mm->compressed && mm->index[ii].size > 0 &&
+                 (size_t)mm->index[ii].offset + mm->index[ii].size <= g_mapped_file_get_length(mm->mf))
+            data[ii] = g_bytes_new(g_mapped_file_get_contents(mm->mf) + mm->index[ii].offset, mm->index[ii].size);
+    }
+    G_UNLOCK(mappings);
+
+    unsigned int header_len = sizeof(struct meta_layout) + METATILE*METATILE*sizeof(struct entry);
+    struct meta_layout *meta = g_malloc0(header_len);
+    memcpy(meta->magic, META_MAGIC, strlen(META_MAGIC));
+    meta->count = METATILE * METATILE;
+    meta->x = x & ~mask;
+    meta->y = y & ~mask;
+    meta->z = z;
+
+    GByteArray *buf = g_byte_array_sized_new(header_len);
+    g_byte_array_set_size(buf, header_len);
+    for (int ii = 0; ii < METATILE*METATILE; ii++) {
+        meta->index[ii].offset = buf->len;
+        if (data[ii]) {
+            gsize size;
+            gconstpointer contents = g_bytes_get_data(data[ii], &size);
+            meta->index[ii].size = size;
+            g_byte_array_append(buf, contents, size);
+            g_bytes_unref(data[ii]);
+        }
+    }
+    memcpy(buf->data, meta, header_len);
+    g_free(meta);
+
+    int ans = 0;
+    gchar *dirname = g_path_get_dirname(path);
+    if (g_mkdir_with_parents(dirname, 0777) != 0) {
+        snprintf(log_msg, PATH_MAX - 1, "Could not create directory %s. Reason: %s
+", dirname, strerror(errno));
+        ans = -1;
+    } else {
+        GError *error = NULL;
+        mapping_forget(path);
+        if (!g_file_set_contents(path, (const gchar*)buf->data, buf->len, &error)) {
+            snprintf(log_msg, PATH_MAX - 1, "Could not write metatile %s. Reason: %s
+", path, error->message);
+            g_error_free(error);
+            ans = -2;
+        }
+    }
+    g_free(dirname);
+    g_byte_array_free(buf, TRUE);
+    return ans;
+}
+
+/**
+ * metatile_cache_clear:
+ *
+ * Release all the mapped metatiles
+ */
+void metatile_cache_clear(void)
+{
+    G_LOCK(mappings);
+    g_queue_foreach(&mappings, (GFunc)mapping_free, NULL);
+    g_queue_clear(&mappings);
+    G_UNLOCK(mappings);
+}
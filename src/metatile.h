@@ -20,9 +20,21 @@
  *
  */
 
+#include <glib.h>
+
+// Use this to enable meta-tiles which will render NxN tiles at once
+// Note: This should be a power of 2 (2, 4, 8, 16 ...)
+#define METATILE (8)
+
 // MAX_SIZE is the biggest file which we will return to the user
 #define METATILE_MAX_SIZE (1 * 1024 * 1024)
 
 int xyz_to_meta(char *path, size_t len, const char *dir, int x, int y, int z);
 
 int metatile_read(const char *dir, int x, int y, int z, char *buf, size_t sz, int * compressed, char * log_msg);
+
+GBytes *metatile_get(const char *dir, int x, int y, int z, int *compressed, char *log_msg);
+
+int metatile_write(const char *dir, int x, int y, int z, GBytes **tiles, char *log_msg);
+
+void metatile_cache_clear(void);
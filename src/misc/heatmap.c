@@ -97,18 +97,23 @@ void heatmap_add_point_with_stamp(heatmap_t* h, unsigned x, unsigned y, const he
             float* line = h->buf + ((y + iy) - stamp->h/2)*h->w + (x + x0) - stamp->w/2;
             const float* stampline = stamp->buf + iy*stamp->w + x0;
 
+            const unsigned n = x1 - x0;
             unsigned ix;
-            for(ix = x0 ; ix < x1 ; ++ix, ++line, ++stampline) {
-                /* TODO: Let's actually accept negatives and try out funky stamps. */
-                /* Note that that might mess with the max though. */
-                /* And that we'll have to clamp the bottom to 0 when rendering. */
-                assert(*stampline >= 0.0f);
+            float linemax = h->max;
 
-                *line += *stampline;
-                if(*line > h->max) {h->max = *line;}
+            /* TODO: Let's actually accept negatives and try out funky stamps. */
+            /* Note that that might mess with the max though. */
+            /* And that we'll have to clamp the bottom to 0 when rendering. */
+            assert(n == 0 || stampline[0] >= 0.0f);
 
-                assert(*line >= 0.0f);
+            /* Kept branch free and separate from the max, so the compiler can vectorize the row. */
+            for(ix = 0 ; ix < n ; ++ix) {
+                line[ix] += stampline[ix];
             }
+            for(ix = 0 ; ix < n ; ++ix) {
+                linemax = line[ix] > linemax ? line[ix] : linemax;
+            }
+            h->max = linemax;
         }
     } /* I hate you very much! */
 }
@@ -150,16 +155,21 @@ void heatmap_add_weighted_point_with_stamp(heatmap_t* h, unsigned x, unsigned y,
             float* line = h->buf + ((y + iy) - stamp->h/2)*h->w + (x + x0) - stamp->w/2;
             const float* stampline = stamp->buf + iy*stamp->w + x0;
 
+            const unsigned n = x1 - x0;
             unsigned ix;
-            for(ix = x0 ; ix < x1 ; ++ix, ++line, ++stampline) {
-                /* TODO: see unweighted function */
-                assert(*stampline >= 0.0f);
+            float linemax = h->max;
 
-                *line += *stampline * w;
-                if(*line > h->max) {h->max = *line;}
+            /* TODO: see unweighted function */
+            assert(n == 0 || stampline[0] >= 0.0f);
 
-                assert(*line >= 0.0f);
+            /* See unweighted function */
+            for(ix = 0 ; ix < n ; ++ix) {
+                line[ix] += stampline[ix] * w;
+            }
+            for(ix = 0 ; ix < n ; ++ix) {
+                linemax = line[ix] > linemax ? line[ix] : linemax;
             }
+            h->max = linemax;
         }
     } /* I hate you very much! */
 }
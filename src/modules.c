@@ -51,11 +51,14 @@
 #include "vikslippymapsource.h"
 #include "viktmsmapsource.h"
 #include "vikwmscmapsource.h"
+#include "vikmvtmapsource.h"
 #include "vikwebtoolcenter.h"
 #include "vikwebtoolbounds.h"
 #include "vikgotoxmltool.h"
+#include "vikgotolocaltool.h"
 #include "vikwebtool_datasource.h"
 #include "vikroutingwebengine.h"
+#include "vikroutinglocalengine.h"
 
 #include "vikgobjectbuilder.h"
 
@@ -210,9 +213,11 @@ register_loadable_types(void)
     VIK_TYPE_SLIPPY_MAP_SOURCE,
     VIK_TYPE_TMS_MAP_SOURCE,
     VIK_TYPE_WMSC_MAP_SOURCE,
+    VIK_TYPE_MVT_MAP_SOURCE,
 
     /* Goto */
     VIK_GOTO_XML_TOOL_TYPE,
+    VIK_GOTO_LOCAL_TOOL_TYPE,
 
     /* Tools */
     VIK_WEBTOOL_CENTER_TYPE,
@@ -222,7 +227,8 @@ register_loadable_types(void)
     VIK_WEBTOOL_DATASOURCE_TYPE,
 
     /* Routing */
-    VIK_ROUTING_WEB_ENGINE_TYPE
+    VIK_ROUTING_WEB_ENGINE_TYPE,
+    VIK_ROUTING_LOCAL_ENGINE_TYPE
   };
 
   /* kill 'unused variable' + argument type warnings */
@@ -0,0 +1,730 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <string.h>
+#include <gio/gio.h>
+#include <gdk/gdk.h>
+#include <cairo.h>
+#include "mvt.h"
+#include "pbf.h"
+#include "pixbufpool.h"
+
+/**
+ * SECTION:mvt
+ * @short_description: Mapbox Vector Tiles
+ *
+ * Only what is needed for drawing is kept from the protocol buffer encoding:
+ *  each layer's features with their type, tags and the still encoded geometry commands.
+ *
+ * The style is a key file, each group being a rule that is drawn in the order given.
+ * The group name is the tile layer the rule applies to, optionally followed by ':' and anything
+ *  to keep the group names unique, e.g.:
+ *
+ * [background]
+ * fill=#f2efe9
+ *
+ * [transportation:major]
+ * where=class=motorway;trunk;primary
+ * stroke=#e892a2
+ * width=2
+ * zoom-min=6
+ *
+ * Keys: fill, stroke (colours), width (in pixels of a 256 pixel tile, the point radius for points),
+ *  opacity, zoom-min, zoom-max, and where (key=value;value... of the feature tags).
+ * The background group is the colour of the whole tile.
+ */
+
+typedef enum {
+  MVT_GEOM_UNKNOWN = 0,
+  MVT_GEOM_POINT,
+  MVT_GEOM_LINESTRING,
+  MVT_GEOM_POLYGON,
+} MvtGeomType;
+
+// Geometry command IDs
+#define MVT_CMD_MOVE_TO 1
+#define MVT_CMD_LINE_TO 2
+#define MVT_CMD_CLOSE_PATH 7
+
+typedef struct {
+  MvtGeomType type;
+  // Positions in the layer's data
+  guint tags_offset;
+  guint n_tags;       // Key and value index pairs, so twice the number of tags
+  guint geom_offset;
+  guint n_geom;
+} MvtFeature;
+
+typedef struct {
+  gchar *name;
+  guint extent;
+  GPtrArray *keys;
+  GPtrArray *values;  // All values are kept as text, since that is all the style compares
+  GArray *features;   // MvtFeature
+  GArray *data;       // guint32 - the tags and geometry of all the features
+} MvtLayer;
+
+struct _MvtTile {
+  gint ref_count;
+  GPtrArray *layers;
+};
+
+typedef struct {
+  gchar *layer;
+  gchar *key;         // Optional feature filter
+  gchar **values;
+  gboolean has_fill;
+  gdouble fill[4];
+  gboolean has_stroke;
+  gdouble stroke[4];
+  gdouble width;
+  guint zoom_min;
+  guint zoom_max;
+} MvtRule;
+
+struct _MvtStyle {
+  gboolean has_background;
+  gdouble background[4];
+  GArray *rules;      // MvtRule
+};
+
+// For the OpenMapTiles schema, as commonly used for OpenStreetMap based vector tiles
+static const gchar *default_style =
+  "[background]\n"
+  "fill=#f2efe9\n"
+  "[landcover:wood]\n"
+  "where=class=wood\n"
+  "fill=#add19e\n"
+  "[landcover:grass]\n"
+  "where=class=grass;farmland\n"
+  "fill=#cdebb0\n"
+  "[landuse]\n"
+  "fill=#e0dfdf\n"
+  "opacity=0.6\n"
+  "[park]\n"
+  "fill=#c8facc\n"
+  "[water]\n"
+  "fill=#aad3df\n"
+  "[waterway]\n"
+  "stroke=#aad3df\n"
+  "width=1.5\n"
+  "[building]\n"
+  "fill=#d9d0c9\n"
+  "stroke=#c4b6ab\n"
+  "width=0.5\n"
+  "zoom-min=14\n"
+  "[transportation:minor]\n"
+  "where=class=minor;service;track;path\n"
+  "stroke=#ffffff\n"
+  "width=1\n"
+  "zoom-min=12\n"
+  "[transportation:secondary]\n"
+  "where=class=secondary;tertiary\n"
+  "stroke=#f7fabf\n"
+  "width=1.5\n"
+  "zoom-min=9\n"
+  "[transportation:major]\n"
+  "where=class=motorway;trunk;primary\n"
+  "stroke=#e892a2\n"
+  "width=2\n"
+  "[transportation:rail]\n"
+  "where=class=rail\n"
+  "stroke=#707070\n"
+  "width=1\n"
+  "zoom-min=10\n"
+  "[boundary]\n"
+  "stroke=#9e9cab\n"
+  "width=1\n";
+
+GQuark a_mvt_error_quark ( void )
+{
+  return g_quark_from_static_string ( "viking-mvt-error-quark" );
+}
+
+/******************************************/
+/*  Tile decoding                         */
+/******************************************/
+
+static gchar *decode_value ( pbf_t *pb )
+{
+  gchar *str = NULL;
+  guint field, wire;
+  while ( pbf_next ( pb, &field, &wire ) ) {
+    guint64 val = 0;
+    gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+    g_free ( str );
+    str = NULL;
+    switch ( field ) {
+    case 1: // string
+      str = pbf_string ( pb, wire );
+      break;
+    case 2: // float
+      if ( wire == PBF_WIRE_32BIT ) {
+        guint32 bits;
+        gfloat ff;
+        if ( pbf_fixed ( pb, 4, &bits ) ) {
+          bits = GUINT32_FROM_LE ( bits );
+          memcpy ( &ff, &bits, 4 );
+          str = g_strdup ( g_ascii_dtostr ( buf, sizeof(buf), ff ) );
+        }
+      }
+      else
+        pbf_skip ( pb, wire );
+      break;
+    case 3: // double
+      if ( wire == PBF_WIRE_64BIT ) {
+        guint64 bits;
+        gdouble dd;
+        if ( pbf_fixed ( pb, 8, &bits ) ) {
+          bits = GUINT64_FROM_LE ( bits );
+          memcpy ( &dd, &bits, 8 );
+          str = g_strdup ( g_ascii_dtostr ( buf, sizeof(buf), dd ) );
+        }
+      }
+      else
+        pbf_skip ( pb, wire );
+      break;
+    case 4: // int
+    case 5: // uint
+    case 6: // sint
+    case 7: // bool
+      if ( wire == PBF_WIRE_VARINT && pbf_varint ( pb, &val ) ) {
+        if ( field == 4 )
+          str = g_strdup_printf ( "%" G_GINT64_FORMAT, (gint64)val );
+        else if ( field == 5 )
+          str = g_strdup_printf ( "%" G_GUINT64_FORMAT, val );
+        else if ( field == 6 )
+          str = g_strdup_printf ( "%" G_GINT64_FORMAT, zigzag64(val) );
+        else
+          str = g_strdup ( val ? "true" : "false" );
+      }
+      else if ( wire != PBF_WIRE_VARINT )
+        pbf_skip ( pb, wire );
+      break;
+    default:
+      pbf_skip ( pb, wire );
+      break;
+    }
+  }
+  return str ? str : g_strdup ( "" );
+}
+
+static void decode_feature ( pbf_t *pb, MvtLayer *layer )
+{
+  MvtFeature ft = { MVT_GEOM_UNKNOWN, 0, 0, 0, 0 };
+  guint field, wire;
+  guint64 val;
+  while ( pbf_next ( pb, &field, &wire ) ) {
+    switch ( field ) {
+    case 2: // tags
+      if ( !ft.n_tags )
+        ft.tags_offset = layer->data->len;
+      pbf_append_uint32s ( pb, wire, layer->data );
+      ft.n_tags = layer->data->len - ft.tags_offset;
+      break;
+    case 3: // type
+      if ( wire == PBF_WIRE_VARINT && pbf_varint ( pb, &val ) )
+        ft.type = val <= MVT_GEOM_POLYGON ? (MvtGeomType)val : MVT_GEOM_UNKNOWN;
+      else if ( wire != PBF_WIRE_VARINT )
+        pbf_skip ( pb, wire );
+      break;
+    case 4: // geometry
+      if ( !ft.n_geom )
+        ft.geom_offset = layer->data->len;
+      pbf_append_uint32s ( pb, wire, layer->data );
+      ft.n_geom = layer->data->len - ft.geom_offset;
+      break;
+    default: // Including the id, which is not needed
+      pbf_skip ( pb, wire );
+      break;
+    }
+  }
+  if ( ft.type != MVT_GEOM_UNKNOWN && ft.n_geom )
+    g_array_append_val ( layer->features, ft );
+}
+
+static void layer_free ( MvtLayer *layer )
+{
+  g_free ( layer->name );
+  g_ptr_array_free ( layer->keys, TRUE );
+  g_ptr_array_free ( layer->values, TRUE );
+  g_array_free ( layer->features, TRUE );
+  g_array_free ( layer->data, TRUE );
+  g_free ( layer );
+}
+
+static MvtLayer *decode_layer ( pbf_t *pb )
+{
+  MvtLayer *layer = g_new0 ( MvtLayer, 1 );
+  layer->extent = 4096;
+  layer->keys = g_ptr_array_new_with_free_func ( g_free );
+  layer->values = g_ptr_array_new_with_free_func ( g_free );
+  layer->features = g_array_new ( FALSE, FALSE, sizeof(MvtFeature) );
+  layer->data = g_array_new ( FALSE, FALSE, sizeof(guint32) );
+
+  guint field, wire;
+  guint64 val;
+  pbf_t sub;
+  while ( pbf_next ( pb, &field, &wire ) ) {
+    switch ( field ) {
+    case 1: // name
+      g_free ( layer->name );
+      layer->name = pbf_string ( pb, wire );
+      break;
+    case 2: // feature
+      if ( wire == PBF_WIRE_LENGTH ) {
+        if ( pbf_sub ( pb, &sub ) ) {
+          decode_feature ( &sub, layer );
+          if ( sub.bad )
+            pb->bad = TRUE;
+        }
+      }
+      else
+        pbf_skip ( pb, wire );
+      break;
+    case 3: // key
+      {
+        gchar *key = pbf_string ( pb, wire );
+        g_ptr_array_add ( layer->keys, key ? key : g_strdup("") );
+      }
+      break;
+    case 4: // value
+      if ( wire == PBF_WIRE_LENGTH ) {
+        if ( pbf_sub ( pb, &sub ) ) {
+          g_ptr_array_add ( layer->values, decode_value ( &sub ) );
+          if ( sub.bad )
+            pb->bad = TRUE;
+        }
+      }
+      else
+        pbf_skip ( pb, wire );
+      break;
+    case 5: // extent
+      if ( wire == PBF_WIRE_VARINT && pbf_varint ( pb, &val ) )
+        layer->extent = val ? (guint)val : 4096;
+      else if ( wire != PBF_WIRE_VARINT )
+        pbf_skip ( pb, wire );
+      break;
+    default: // Including the version
+      pbf_skip ( pb, wire );
+      break;
+    }
+  }
+  return layer;
+}
+
+/**
+ * a_mvt_tile_decode:
+ *
+ * Returns: The tile, or NULL if the data is not a valid vector tile
+ */
+MvtTile *a_mvt_tile_decode ( const guint8 *data, gsize len, GError **error )
+{
+  // A tile starts with a layer (field 3, length delimited = 0x1a), so the compression headers are distinct
+  GBytes *inflated = NULL;
+  if ( len >= 2 && data[0] == 0x1f && data[1] == 0x8b )
+    inflated = pbf_inflate ( data, len, G_ZLIB_COMPRESSOR_FORMAT_GZIP, error );
+  else if ( len >= 2 && data[0] == 0x78 )
+    inflated = pbf_inflate ( data, len, G_ZLIB_COMPRESSOR_FORMAT_ZLIB, error );
+  else
+    inflated = g_bytes_new_static ( data, len );
+  if ( !inflated )
+    return NULL;
+
+  MvtTile *tile = g_new0 ( MvtTile, 1 );
+  tile->ref_count = 1;
+  tile->layers = g_ptr_array_new_with_free_func ( (GDestroyNotify)layer_free );
+
+  gsize size;
+  const guint8 *buf = g_bytes_get_data ( inflated, &size );
+  pbf_t pb = { buf, buf + size, FALSE };
+  guint field, wire;
+  while ( pbf_next ( &pb, &field, &wire ) ) {
+    pbf_t sub;
+    if ( field == 3 && wire == PBF_WIRE_LENGTH ) {
+      if ( pbf_sub ( &pb, &sub ) ) {
+        MvtLayer *layer = decode_layer ( &sub );
+        if ( sub.bad || !layer->name ) {
+          layer_free ( layer );
+          pb.bad = TRUE;
+        }
+        else
+          g_ptr_array_add ( tile->layers, layer );
+      }
+    }
+    else
+      pbf_skip ( &pb, wire );
+  }
+  g_bytes_unref ( inflated );
+
+  if ( pb.bad ) {
+    g_set_error_literal ( error, MVT_ERROR, 0, "Invalid vector tile" );
+    a_mvt_tile_unref ( tile );
+    return NULL;
+  }
+  return tile;
+}
+
+MvtTile *a_mvt_tile_ref ( MvtTile *tile )
+{
+  g_atomic_int_inc ( &tile->ref_count );
+  return tile;
+}
+
+void a_mvt_tile_unref ( MvtTile *tile )
+{
+  if ( !tile )
+    return;
+  if ( g_atomic_int_dec_and_test ( &tile->ref_count ) ) {
+    g_ptr_array_free ( tile->layers, TRUE );
+    g_free ( tile );
+  }
+}
+
+static MvtLayer *tile_find_layer ( MvtTile *tile, const gchar *name )
+{
+  for ( guint ii = 0; ii < tile->layers->len; ii++ ) {
+    MvtLayer *layer = g_ptr_array_index ( tile->layers, ii );
+    if ( !g_strcmp0 ( layer->name, name ) )
+      return layer;
+  }
+  return NULL;
+}
+
+guint a_mvt_tile_get_n_layers ( MvtTile *tile )
+{
+  return tile->layers->len;
+}
+
+/**
+ * Returns: The number of drawable features in the layer, 0 if there is no such layer
+ */
+guint a_mvt_tile_get_n_features ( MvtTile *tile, const gchar *layer )
+{
+  MvtLayer *ml = tile_find_layer ( tile, layer );
+  return ml ? ml->features->len : 0;
+}
+
+/******************************************/
+/*  Style                                 */
+/******************************************/
+
+static gboolean parse_colour ( GKeyFile *kf, const gchar *group, const gchar *key, gdouble opacity, gdouble rgba[4] )
+{
+  gchar *str = g_key_file_get_string ( kf, group, key, NULL );
+  GdkColor color;
+  gboolean ans = str && gdk_color_parse ( g_strstrip(str), &color );
+  if ( str && !ans )
+    g_warning ( "%s: invalid colour '%s' in [%s]", __FUNCTION__, str, group );
+  g_free ( str );
+  if ( ans ) {
+    rgba[0] = color.red / 65535.0;
+    rgba[1] = color.green / 65535.0;
+    rgba[2] = color.blue / 65535.0;
+    rgba[3] = opacity;
+  }
+  return ans;
+}
+
+static gdouble get_double ( GKeyFile *kf, const gchar *group, const gchar *key, gdouble def )
+{
+  GError *error = NULL;
+  gdouble val = g_key_file_get_double ( kf, group, key, &error );
+  if ( error ) {
+    g_error_free ( error );
+    return def;
+  }
+  return val;
+}
+
+static MvtStyle *style_new_from_key_file ( GKeyFile *kf )
+{
+  MvtStyle *style = g_new0 ( MvtStyle, 1 );
+  style->rules = g_array_new ( FALSE, FALSE, sizeof(MvtRule) );
+
+  gchar **groups = g_key_file_get_groups ( kf, NULL );
+  for ( guint gg = 0; groups[gg]; gg++ ) {
+    const gchar *group = groups[gg];
+    gdouble opacity = CLAMP ( get_double ( kf, group, "opacity", 1.0 ), 0.0, 1.0 );
+    if ( !g_strcmp0 ( group, "background" ) ) {
+      style->has_background = parse_colour ( kf, group, "fill", opacity, style->background );
+      continue;
+    }
+
+    MvtRule rule;
+    memset ( &rule, 0, sizeof(rule) );
+    const gchar *colon = strchr ( group, ':' );
+    rule.layer = colon ? g_strndup ( group, colon - group ) : g_strdup ( group );
+    rule.has_fill = parse_colour ( kf, group, "fill", opacity, rule.fill );
+    rule.has_stroke = parse_colour ( kf, group, "stroke", opacity, rule.stroke );
+    rule.width = MAX ( 0.0, get_double ( kf, group, "width", 1.0 ) );
+    rule.zoom_min = (guint)CLAMP ( get_double ( kf, group, "zoom-min", 0 ), 0, 30 );
+    rule.zoom_max = (guint)CLAMP ( get_double ( kf, group, "zoom-max", 30 ), 0, 30 );
+
+    gchar *where = g_key_file_get_string ( kf, group, "where", NULL );
+    if ( where ) {
+      gchar **kv = g_strsplit ( where, "=", 2 );
+      if ( kv[0] && kv[1] ) {
+        rule.key = g_strdup ( g_strstrip(kv[0]) );
+        rule.values = g_strsplit ( kv[1], ";", -1 );
+        for ( guint vv = 0; rule.values[vv]; vv++ )
+          (void)g_strstrip ( rule.values[vv] );
+      }
+      else
+        g_warning ( "%s: invalid where '%s' in [%s]", __FUNCTION__, where, group );
+      g_strfreev ( kv );
+      g_free ( where );
+    }
+    g_array_append_val ( style->rules, rule );
+  }
+  g_strfreev ( groups );
+  return style;
+}
+
+/**
+ * a_mvt_style_new_default:
+ *
+ * A simple style for tiles using the OpenMapTiles schema
+ */
+MvtStyle *a_mvt_style_new_default ( void )
+{
+  GKeyFile *kf = g_key_file_new ();
+  MvtStyle *style = NULL;
+  if ( g_key_file_load_from_data ( kf, default_style, -1, G_KEY_FILE_NONE, NULL ) )
+    style = style_new_from_key_file ( kf );
+  g_key_file_free ( kf );
+  return style;
+}
+
+MvtStyle *a_mvt_style_new_from_file ( const gchar *filename, GError **error )
+{
+  GKeyFile *kf = g_key_file_new ();
+  MvtStyle *style = NULL;
+  if ( g_key_file_load_from_file ( kf, filename, G_KEY_FILE_NONE, error ) )
+    style = style_new_from_key_file ( kf );
+  g_key_file_free ( kf );
+  return style;
+}
+
+void a_mvt_style_free ( MvtStyle *style )
+{
+  if ( !style )
+    return;
+  for ( guint ii = 0; ii < style->rules->len; ii++ ) {
+    MvtRule *rule = &g_array_index ( style->rules, MvtRule, ii );
+    g_free ( rule->layer );
+    g_free ( rule->key );
+    g_strfreev ( rule->values );
+  }
+  g_array_free ( style->rules, TRUE );
+  g_free ( style );
+}
+
+/******************************************/
+/*  Drawing                               */
+/******************************************/
+
+static gint layer_find_key ( MvtLayer *layer, const gchar *key )
+{
+  for ( guint ii = 0; ii < layer->keys->len; ii++ )
+    if ( !g_strcmp0 ( g_ptr_array_index(layer->keys, ii), key ) )
+      return ii;
+  return -1;
+}
+
+static gboolean feature_matches ( MvtLayer *layer, MvtFeature *ft, gint key, gchar **values )
+{
+  guint32 *tags = &g_array_index ( layer->data, guint32, ft->tags_offset );
+  for ( guint ii = 0; ii + 1 < ft->n_tags; ii += 2 ) {
+    if ( tags[ii] != (guint32)key )
+      continue;
+    if ( tags[ii+1] >= layer->values->len )
+      return FALSE;
+    const gchar *value = g_ptr_array_index ( layer->values, tags[ii+1] );
+    for ( guint vv = 0; values[vv]; vv++ )
+      if ( !g_strcmp0 ( values[vv], value ) )
+        return TRUE;
+    return FALSE;
+  }
+  return FALSE;
+}
+
+/**
+ * Add the feature's geometry to the current path
+ *  Points are added as circles of the given radius
+ */
+static void add_geometry ( cairo_t *cr, MvtLayer *layer, MvtFeature *ft, gdouble scale, gdouble radius )
+{
+  guint32 *geom = &g_array_index ( layer->data, guint32, ft->geom_offset );
+  gint32 x = 0, y = 0;
+  guint ii = 0;
+  while ( ii < ft->n_geom ) {
+    guint cmd = geom[ii] & 0x7;
+    guint count = geom[ii] >> 3;
+    ii++;
+    if ( cmd == MVT_CMD_CLOSE_PATH ) {
+      cairo_close_path ( cr );
+      continue;
+    }
+    if ( cmd != MVT_CMD_MOVE_TO && cmd != MVT_CMD_LINE_TO )
+      return;
+    for ( ; count && ii + 2 <= ft->n_geom; count--, ii += 2 ) {
+      x += zigzag32 ( geom[ii] );
+      y += zigzag32 ( geom[ii+1] );
+      if ( ft->type == MVT_GEOM_POINT ) {
+        cairo_new_sub_path ( cr );
+        cairo_arc ( cr, x * scale, y * scale, radius, 0, 2 * G_PI );
+      }
+      else if ( cmd == MVT_CMD_MOVE_TO )
+        cairo_move_to ( cr, x * scale, y * scale );
+      else
+        cairo_line_to ( cr, x * scale, y * scale );
+    }
+  }
+}
+
+/**
+ * Add the geometry of all the features of the type that the rule applies to,
+ *  so each rule is filled or stroked just once
+ *
+ * Returns: Whether anything was added
+ */
+static gboolean add_rule_geometry ( cairo_t *cr, MvtLayer *layer, MvtRule *rule, gint key, MvtGeomType type, gdouble scale, gdouble radius )
+{
+  gboolean added = FALSE;
+  cairo_new_path ( cr );
+  for ( guint ff = 0; ff < layer->features->len; ff++ ) {
+    MvtFeature *ft = &g_array_index ( layer->features, MvtFeature, ff );
+    if ( ft->type != type )
+      continue;
+    if ( rule->key && !feature_matches ( layer, ft, key, rule->values ) )
+      continue;
+    add_geometry ( cr, layer, ft, scale, radius );
+    added = TRUE;
+  }
+  return added;
+}
+
+/**
+ * Convert from Cairo's premultiplied native endian ARGB
+ */
+static GdkPixbuf *pixbuf_from_surface ( cairo_surface_t *surface )
+{
+  cairo_surface_flush ( surface );
+  gint width = cairo_image_surface_get_width ( surface );
+  gint height = cairo_image_surface_get_height ( surface );
+  gint stride = cairo_image_surface_get_stride ( surface );
+  const guchar *src = cairo_image_surface_get_data ( surface );
+
+  GdkPixbuf *pixbuf = a_pixbuf_pool_new ( TRUE, width, height );
+  gint rowstride = gdk_pixbuf_get_rowstride ( pixbuf );
+  guchar *dst = gdk_pixbuf_get_pixels ( pixbuf );
+  for ( gint yy = 0; yy < height; yy++ ) {
+    const guint32 *in = (const guint32*)(src + yy * stride);
+    guchar *out = dst + yy * rowstride;
+    for ( gint xx = 0; xx < width; xx++, out += 4 ) {
+      guint32 px = in[xx];
+      guint aa = px >> 24;
+      guint rr = (px >> 16) & 0xff;
+      guint gg = (px >> 8) & 0xff;
+      guint bb = px & 0xff;
+      if ( aa && aa < 255 ) {
+        rr = (rr * 255 + aa / 2) / aa;
+        gg = (gg * 255 + aa / 2) / aa;
+        bb = (bb * 255 + aa / 2) / aa;
+      }
+      out[0] = rr;
+      out[1] = gg;
+      out[2] = bb;
+      out[3] = aa;
+    }
+  }
+  return pixbuf;
+}
+
+/**
+ * a_mvt_tile_render:
+ * @zoom: The tile's zoom level, for the rules only drawn at some zooms
+ * @size: Of the image in pixels
+ *
+ * Draw the tile as per the style - may be called from any thread
+ */
+GdkPixbuf *a_mvt_tile_render ( MvtTile *tile, MvtStyle *style, guint zoom, guint size )
+{
+  cairo_surface_t *surface = cairo_image_surface_create ( CAIRO_FORMAT_ARGB32, size, size );
+  cairo_t *cr = cairo_create ( surface );
+  // Widths are given for a standard 256 pixel tile
+  gdouble line_scale = size / 256.0;
+
+  if ( style->has_background ) {
+    cairo_set_source_rgba ( cr, style->background[0], style->background[1], style->background[2], style->background[3] );
+    cairo_paint ( cr );
+  }
+  cairo_set_line_join ( cr, CAIRO_LINE_JOIN_ROUND );
+  cairo_set_line_cap ( cr, CAIRO_LINE_CAP_ROUND );
+  cairo_set_fill_rule ( cr, CAIRO_FILL_RULE_WINDING );
+
+  for ( guint rr = 0; rr < style->rules->len; rr++ ) {
+    MvtRule *rule = &g_array_index ( style->rules, MvtRule, rr );
+    if ( zoom < rule->zoom_min || zoom > rule->zoom_max )
+      continue;
+    MvtLayer *layer = tile_find_layer ( tile, rule->layer );
+    if ( !layer )
+      continue;
+    gint key = -1;
+    if ( rule->key ) {
+      key = layer_find_key ( layer, rule->key );
+      if ( key < 0 )
+        continue;
+    }
+    gdouble scale = (gdouble)size / layer->extent;
+    gdouble width = rule->width * line_scale;
+    cairo_set_line_width ( cr, width );
+
+    if ( (rule->has_fill || rule->has_stroke) &&
+         add_rule_geometry ( cr, layer, rule, key, MVT_GEOM_POLYGON, scale, 0 ) ) {
+      if ( rule->has_fill ) {
+        cairo_set_source_rgba ( cr, rule->fill[0], rule->fill[1], rule->fill[2], rule->fill[3] );
+        cairo_fill_preserve ( cr );
+      }
+      if ( rule->has_stroke ) {
+        cairo_set_source_rgba ( cr, rule->stroke[0], rule->stroke[1], rule->stroke[2], rule->stroke[3] );
+        cairo_stroke_preserve ( cr );
+      }
+    }
+    if ( rule->has_stroke &&
+         add_rule_geometry ( cr, layer, rule, key, MVT_GEOM_LINESTRING, scale, 0 ) ) {
+      cairo_set_source_rgba ( cr, rule->stroke[0], rule->stroke[1], rule->stroke[2], rule->stroke[3] );
+      cairo_stroke_preserve ( cr );
+    }
+    if ( rule->has_fill &&
+         add_rule_geometry ( cr, layer, rule, key, MVT_GEOM_POINT, scale, MAX(1.0, width) ) ) {
+      cairo_set_source_rgba ( cr, rule->fill[0], rule->fill[1], rule->fill[2], rule->fill[3] );
+      cairo_fill_preserve ( cr );
+    }
+    cairo_new_path ( cr );
+  }
+
+  cairo_destroy ( cr );
+  GdkPixbuf *pixbuf = pixbuf_from_surface ( surface );
+  cairo_surface_destroy ( surface );
+  return pixbuf;
+}
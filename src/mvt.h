@@ -0,0 +1,52 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_MVT_H
+#define __VIKING_MVT_H
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+// Mapbox Vector Tiles - https://github.com/mapbox/vector-tile-spec
+// Decoded into the geometry of the features of each layer, then drawn with a simple style
+
+typedef struct _MvtTile MvtTile;
+typedef struct _MvtStyle MvtStyle;
+
+#define MVT_ERROR a_mvt_error_quark()
+GQuark a_mvt_error_quark ( void );
+
+// The data may be gzip or zlib compressed, as is normal in MBTiles files
+MvtTile *a_mvt_tile_decode ( const guint8 *data, gsize len, GError **error );
+MvtTile *a_mvt_tile_ref ( MvtTile *tile );
+void a_mvt_tile_unref ( MvtTile *tile );
+guint a_mvt_tile_get_n_layers ( MvtTile *tile );
+guint a_mvt_tile_get_n_features ( MvtTile *tile, const gchar *layer );
+
+MvtStyle *a_mvt_style_new_default ( void );
+MvtStyle *a_mvt_style_new_from_file ( const gchar *filename, GError **error );
+void a_mvt_style_free ( MvtStyle *style );
+
+GdkPixbuf *a_mvt_tile_render ( MvtTile *tile, MvtStyle *style, guint zoom, guint size );
+
+G_END_DECLS
+
+#endif
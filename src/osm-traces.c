@@ -195,7 +195,7 @@ static gint get_new_access_tokens ( gchar *request_token_key, gchar *request_tok
 
 	if ( !liboauth_parse_reply ( reply, access_token_key, access_token_secret ) )
 		return -2;
-	free ( reply );
+	g_free ( reply );
 
 	g_debug ( "%s:%s", __FUNCTION__, *access_token_key );
 	g_debug ( "%s:%s", __FUNCTION__, *access_token_secret );
@@ -218,7 +218,7 @@ static gint get_request_tokens ( gchar **token_key, gchar **token_secret )
 
 	if ( !liboauth_parse_reply ( reply, token_key, token_secret ) )
 		return -2;
-	free ( reply );
+	g_free ( reply );
 
 	g_debug ( "%s:%s", __FUNCTION__, *token_key );
 	g_debug ( "%s:%s", __FUNCTION__, *token_secret );
@@ -0,0 +1,164 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <string.h>
+#include "pbf.h"
+
+gboolean pbf_varint ( pbf_t *pb, guint64 *val )
+{
+  guint64 result = 0;
+  for ( guint shift = 0; shift < 64 && pb->pos < pb->end; shift += 7 ) {
+    guint8 byte = *pb->pos++;
+    result |= (guint64)(byte & 0x7f) << shift;
+    if ( !(byte & 0x80) ) {
+      *val = result;
+      return TRUE;
+    }
+  }
+  pb->bad = TRUE;
+  return FALSE;
+}
+
+/**
+ * Returns: FALSE at the end of the message, or when it is malformed (as flagged by bad)
+ */
+gboolean pbf_next ( pbf_t *pb, guint *field, guint *wire )
+{
+  guint64 key;
+  if ( pb->bad || pb->pos >= pb->end || !pbf_varint ( pb, &key ) )
+    return FALSE;
+  *field = key >> 3;
+  *wire = key & 0x7;
+  return TRUE;
+}
+
+gboolean pbf_sub ( pbf_t *pb, pbf_t *sub )
+{
+  guint64 len;
+  if ( !pbf_varint ( pb, &len ) )
+    return FALSE;
+  if ( len > (guint64)(pb->end - pb->pos) ) {
+    pb->bad = TRUE;
+    return FALSE;
+  }
+  sub->pos = pb->pos;
+  sub->end = pb->pos + len;
+  sub->bad = FALSE;
+  pb->pos += len;
+  return TRUE;
+}
+
+gboolean pbf_fixed ( pbf_t *pb, gsize len, gpointer val )
+{
+  if ( (gsize)(pb->end - pb->pos) < len ) {
+    pb->bad = TRUE;
+    return FALSE;
+  }
+  if ( val )
+    memcpy ( val, pb->pos, len );
+  pb->pos += len;
+  return TRUE;
+}
+
+void pbf_skip ( pbf_t *pb, guint wire )
+{
+  guint64 val;
+  pbf_t sub;
+  switch ( wire ) {
+  case PBF_WIRE_VARINT: (void)pbf_varint ( pb, &val ); break;
+  case PBF_WIRE_64BIT: (void)pbf_fixed ( pb, 8, NULL ); break;
+  case PBF_WIRE_LENGTH: (void)pbf_sub ( pb, &sub ); break;
+  case PBF_WIRE_32BIT: (void)pbf_fixed ( pb, 4, NULL ); break;
+  default: pb->bad = TRUE; break;
+  }
+}
+
+gchar *pbf_string ( pbf_t *pb, guint wire )
+{
+  pbf_t sub;
+  if ( wire != PBF_WIRE_LENGTH ) {
+    pbf_skip ( pb, wire );
+    return NULL;
+  }
+  if ( !pbf_sub ( pb, &sub ) )
+    return NULL;
+  return g_strndup ( (const gchar*)sub.pos, sub.end - sub.pos );
+}
+
+/**
+ * Append a repeated uint32 field, whether packed (as normal) or not
+ */
+void pbf_append_uint32s ( pbf_t *pb, guint wire, GArray *data )
+{
+  guint64 val;
+  if ( wire == PBF_WIRE_LENGTH ) {
+    pbf_t sub;
+    if ( !pbf_sub ( pb, &sub ) )
+      return;
+    while ( sub.pos < sub.end && pbf_varint ( &sub, &val ) ) {
+      guint32 vv = (guint32)val;
+      g_array_append_val ( data, vv );
+    }
+    if ( sub.bad )
+      pb->bad = TRUE;
+  }
+  else if ( wire == PBF_WIRE_VARINT ) {
+    if ( pbf_varint ( pb, &val ) ) {
+      guint32 vv = (guint32)val;
+      g_array_append_val ( data, vv );
+    }
+  }
+  else
+    pbf_skip ( pb, wire );
+}
+
+/**
+ * Returns: The uncompressed data, or NULL on failure with the error set
+ */
+GBytes *pbf_inflate ( const guint8 *data, gsize len, GZlibCompressorFormat format, GError **error )
+{
+  GConverter *conv = G_CONVERTER ( g_zlib_decompressor_new ( format ) );
+  GByteArray *out = g_byte_array_sized_new ( len * 4 );
+  guint8 buf[16384];
+  gsize in_pos = 0;
+  GConverterResult res;
+  do {
+    gsize bytes_read = 0;
+    gsize bytes_written = 0;
+    res = g_converter_convert ( conv, data + in_pos, len - in_pos, buf, sizeof(buf),
+                                G_CONVERTER_INPUT_AT_END, &bytes_read, &bytes_written, error );
+    if ( res == G_CONVERTER_ERROR )
+      break;
+    in_pos += bytes_read;
+    g_byte_array_append ( out, buf, bytes_written );
+    if ( res != G_CONVERTER_FINISHED && !bytes_read && !bytes_written ) {
+      g_set_error_literal ( error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT, "Truncated compressed data" );
+      res = G_CONVERTER_ERROR;
+    }
+  } while ( res != G_CONVERTER_FINISHED && res != G_CONVERTER_ERROR );
+  g_object_unref ( conv );
+
+  if ( res == G_CONVERTER_ERROR ) {
+    g_byte_array_free ( out, TRUE );
+    return NULL;
+  }
+  return g_byte_array_free_to_bytes ( out );
+}
@@ -0,0 +1,63 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_PBF_H
+#define __VIKING_PBF_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+// Reading of protocol buffer encoded data (as used by vector tiles and OpenStreetMap PBF files)
+//  straight from the buffer, without any generated code
+
+typedef struct {
+  const guint8 *pos;
+  const guint8 *end;
+  gboolean bad;
+} pbf_t;
+
+#define PBF_WIRE_VARINT 0
+#define PBF_WIRE_64BIT  1
+#define PBF_WIRE_LENGTH 2
+#define PBF_WIRE_32BIT  5
+
+gboolean pbf_varint ( pbf_t *pb, guint64 *val );
+gboolean pbf_next ( pbf_t *pb, guint *field, guint *wire );
+gboolean pbf_sub ( pbf_t *pb, pbf_t *sub );
+gboolean pbf_fixed ( pbf_t *pb, gsize len, gpointer val );
+void pbf_skip ( pbf_t *pb, guint wire );
+gchar *pbf_string ( pbf_t *pb, guint wire );
+void pbf_append_uint32s ( pbf_t *pb, guint wire, GArray *data );
+
+static inline gint64 zigzag64 ( guint64 val )
+{
+  return (gint64)(val >> 1) ^ -(gint64)(val & 1);
+}
+
+static inline gint32 zigzag32 ( guint32 val )
+{
+  return (gint32)(val >> 1) ^ -(gint32)(val & 1);
+}
+
+GBytes *pbf_inflate ( const guint8 *data, gsize len, GZlibCompressorFormat format, GError **error );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,523 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <gio/gio.h>
+#include <glib/gi18n.h>
+#include "globals.h"
+#include "preferences.h"
+#include "peercache.h"
+
+/*
+ * When sharing, each instance serves the tiles in its map cache directory over HTTP
+ *  and announces itself on the local network, with a small UDP multicast message
+ *  (of the magic, the HTTP port and a random id) sent every so often.
+ * Before downloading a tile from its server, the file is asked for from each instance
+ *  heard from recently, by its path within the map cache directory,
+ *  so this works between instances using the same map sources with the default cache layout.
+ * Instances that can not be reached are left alone for a while,
+ *  so a peer going away only delays a few downloads by the short timeout.
+ * Only clients with a local network address, or that have announced themselves, are served,
+ *  although the HTTP server listens on all interfaces.
+ */
+#define PEER_MAGIC "VIKPEER1"
+#define PEER_GROUP "239.255.86.75"
+#define PEER_PORT 37563
+#define PEER_PATH "/tiles/"
+#define PEER_ANNOUNCE_INTERVAL (20 * G_USEC_PER_SEC)
+#define PEER_EXPIRY (3 * PEER_ANNOUNCE_INTERVAL + G_USEC_PER_SEC)
+#define PEER_DOWN_TIME (60 * G_USEC_PER_SEC)
+#define PEER_TIMEOUT 1 // Seconds
+#define PEER_SERVE_TIMEOUT 5 // Seconds
+#define PEER_MAX_TRIES 3
+#define PEER_MAX_CONNECTIONS 8
+#define PEER_MAX_FILE (16 * 1024 * 1024)
+
+typedef struct {
+  gchar *host;
+  guint16 port;
+  gint64 last_seen;
+  gint64 down_until;
+} Peer;
+
+static GMutex peer_mutex;
+static GHashTable *peers = NULL; // "host:port" -> Peer
+static gchar *root = NULL;       // The map cache directory, ending with a separator, whilst sharing
+
+static GSocketService *service = NULL;
+static guint16 service_port = 0;
+static GThread *discovery_thread = NULL;
+static GCancellable *discovery_cancel = NULL;
+static guint32 instance_id = 0;
+
+static gint fetched = 0;
+static gint served = 0;
+
+static VikLayerParam prefs[] = {
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "peer_cache", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Share map tiles on the local network:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
+    N_("Get map tiles from other Viking instances on the local network before downloading them, and give them ours. Only tiles in the default map layer directory are shared."), NULL, NULL, NULL },
+};
+
+static void peer_free ( Peer *peer )
+{
+  g_free ( peer->host );
+  g_free ( peer );
+}
+
+void a_peercache_init ( void )
+{
+  a_preferences_register ( &prefs[0], (VikLayerParamData){0}, VIKING_PREFERENCES_GROUP_KEY );
+  peers = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)peer_free );
+  instance_id = g_random_int ();
+}
+
+/**
+ * Record an announcement
+ *
+ * Returns: TRUE if the peer is new
+ */
+static gboolean peer_seen ( GSocketAddress *from, const gchar *msg )
+{
+  guint port = 0;
+  guint32 id = 0;
+  if ( !g_str_has_prefix ( msg, PEER_MAGIC " " ) ||
+       sscanf ( msg + strlen(PEER_MAGIC), " %u %u", &port, &id ) != 2 ||
+       id == instance_id || port == 0 || port > G_MAXUINT16 ||
+       !G_IS_INET_SOCKET_ADDRESS(from) )
+    return FALSE;
+
+  gchar *host = g_inet_address_to_string ( g_inet_socket_address_get_address ( G_INET_SOCKET_ADDRESS(from) ) );
+  gchar *key = g_strdup_printf ( "%s:%u", host, port );
+  gboolean added = FALSE;
+  g_mutex_lock ( &peer_mutex );
+  Peer *peer = g_hash_table_lookup ( peers, key );
+  if ( !peer ) {
+    peer = g_new0 ( Peer, 1 );
+    peer->host = host;
+    peer->port = port;
+    g_hash_table_insert ( peers, key, peer );
+    host = key = NULL;
+    added = TRUE;
+  }
+  peer->last_seen = g_get_monotonic_time ();
+  g_mutex_unlock ( &peer_mutex );
+  if ( added )
+    g_debug ( "%s: %s port %d", __FUNCTION__, peer->host, port );
+  g_free ( key );
+  g_free ( host );
+  return added;
+}
+
+/**
+ * Announce this instance and listen for the others, until cancelled
+ */
+static gpointer peer_discovery_thread ( gpointer data )
+{
+  GSocket *sock = data;
+  GInetAddress *group = g_inet_address_new_from_string ( PEER_GROUP );
+  GSocketAddress *group_addr = g_inet_socket_address_new ( group, PEER_PORT );
+  gchar *announce = g_strdup_printf ( PEER_MAGIC " %u %u\n", service_port, instance_id );
+  gint64 next_announce = 0;
+
+  while ( !g_cancellable_is_cancelled ( discovery_cancel ) ) {
+    gint64 now = g_get_monotonic_time ();
+    if ( now >= next_announce ) {
+      (void)g_socket_send_to ( sock, group_addr, announce, strlen(announce), NULL, NULL );
+      next_announce = now + PEER_ANNOUNCE_INTERVAL;
+    }
+    if ( !g_socket_condition_timed_wait ( sock, G_IO_IN, next_announce - now, discovery_cancel, NULL ) )
+      continue;
+    gchar buf[128];
+    GSocketAddress *from = NULL;
+    gssize len = g_socket_receive_from ( sock, &from, buf, sizeof(buf)-1, NULL, NULL );
+    if ( len > 0 && from ) {
+      buf[len] = '\0';
+      // Answer a newcomer straight away, rather than it waiting for the next announcement
+      if ( peer_seen ( from, buf ) )
+        next_announce = 0;
+    }
+    if ( from )
+      g_object_unref ( from );
+  }
+
+  g_free ( announce );
+  g_object_unref ( group_addr );
+  g_object_unref ( group );
+  (void)g_socket_close ( sock, NULL );
+  g_object_unref ( sock );
+  return NULL;
+}
+
+/**
+ * The file for a request line of "GET /tiles/<path> HTTP/1.x", if within the map cache directory
+ */
+static gchar *peer_request_filename ( const gchar *request )
+{
+  gchar *filename = NULL;
+  gchar **parts = g_strsplit ( request, " ", 3 );
+  if ( g_strv_length(parts) >= 2 && strcmp ( parts[0], "GET" ) == 0 && g_str_has_prefix ( parts[1], PEER_PATH ) ) {
+    gchar *path = g_uri_unescape_string ( parts[1] + strlen(PEER_PATH), NULL );
+    if ( path && path[0] && path[0] != '/' && !strstr ( path, ".." ) && !strchr ( path, '\\' ) && !strchr ( path, ':' ) ) {
+      g_strdelimit ( path, "/", G_DIR_SEPARATOR );
+      g_mutex_lock ( &peer_mutex );
+      if ( root )
+        filename = g_strconcat ( root, path, NULL );
+      g_mutex_unlock ( &peer_mutex );
+    }
+    g_free ( path );
+  }
+  g_strfreev ( parts );
+  return filename;
+}
+
+/**
+ * Whether the address is on the local network: loopback, link-local or private
+ */
+static gboolean peer_address_is_local ( GInetAddress *addr )
+{
+  GInetAddress *v4 = NULL;
+  // IPv4 clients of a dual stack socket appear as IPv4 mapped IPv6 addresses (::ffff:a.b.c.d)
+  if ( g_inet_address_get_family ( addr ) == G_SOCKET_FAMILY_IPV6 ) {
+    const guint8 *bytes = g_inet_address_to_bytes ( addr );
+    static const guint8 mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+    if ( memcmp ( bytes, mapped, sizeof(mapped) ) == 0 )
+      addr = v4 = g_inet_address_new_from_bytes ( bytes + sizeof(mapped), G_SOCKET_FAMILY_IPV4 );
+    // Unique local addresses (fc00::/7) are the IPv6 private ranges
+    else if ( (bytes[0] & 0xfe) == 0xfc )
+      return TRUE;
+  }
+  gboolean local = g_inet_address_get_is_loopback ( addr ) ||
+                   g_inet_address_get_is_link_local ( addr ) ||
+                   g_inet_address_get_is_site_local ( addr );
+  if ( v4 )
+    g_object_unref ( v4 );
+  return local;
+}
+
+/**
+ * Only instances on the local network may read the map cache:
+ *  those with a local address or that have announced themselves (as announcements do not leave the LAN)
+ */
+static gboolean peer_client_allowed ( GSocketConnection *connection )
+{
+  GSocketAddress *remote = g_socket_connection_get_remote_address ( connection, NULL );
+  if ( !remote )
+    return FALSE;
+  gboolean allowed = FALSE;
+  if ( G_IS_INET_SOCKET_ADDRESS(remote) ) {
+    GInetAddress *addr = g_inet_socket_address_get_address ( G_INET_SOCKET_ADDRESS(remote) );
+    allowed = peer_address_is_local ( addr );
+    if ( !allowed ) {
+      gchar *host = g_inet_address_to_string ( addr );
+      GHashTableIter iter;
+      gpointer value;
+      g_mutex_lock ( &peer_mutex );
+      g_hash_table_iter_init ( &iter, peers );
+      while ( !allowed && g_hash_table_iter_next ( &iter, NULL, &value ) )
+        allowed = g_strcmp0 ( ((Peer*)value)->host, host ) == 0;
+      g_mutex_unlock ( &peer_mutex );
+      g_free ( host );
+    }
+  }
+  g_object_unref ( remote );
+  return allowed;
+}
+
+/**
+ * Answer a request from another instance (in a thread of the socket service)
+ */
+static gboolean peer_serve ( GThreadedSocketService *ts, GSocketConnection *connection, GObject *source_object, gpointer user_data )
+{
+  g_socket_set_timeout ( g_socket_connection_get_socket(connection), PEER_SERVE_TIMEOUT );
+  GOutputStream *out = g_io_stream_get_output_stream ( G_IO_STREAM(connection) );
+  if ( !peer_client_allowed ( connection ) ) {
+    const gchar *forbidden = "HTTP/1.0 403 Forbidden\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    (void)g_output_stream_write_all ( out, forbidden, strlen(forbidden), NULL, NULL, NULL );
+    return TRUE;
+  }
+  GDataInputStream *din = g_data_input_stream_new ( g_io_stream_get_input_stream ( G_IO_STREAM(connection) ) );
+  g_data_input_stream_set_newline_type ( din, G_DATA_STREAM_NEWLINE_TYPE_ANY );
+
+  gchar *request = g_data_input_stream_read_line ( din, NULL, NULL, NULL );
+  // Skip the headers
+  gchar *line;
+  while ( (line = g_data_input_stream_read_line ( din, NULL, NULL, NULL )) && line[0] )
+    g_free ( line );
+  g_free ( line );
+
+  gchar *filename = request ? peer_request_filename ( request ) : NULL;
+  gchar *contents = NULL;
+  gsize length = 0;
+  if ( filename && g_file_test ( filename, G_FILE_TEST_IS_REGULAR ) &&
+       g_file_get_contents ( filename, &contents, &length, NULL ) && (length == 0 || length > PEER_MAX_FILE) ) {
+    g_free ( contents );
+    contents = NULL;
+  }
+
+  gchar *header;
+  if ( contents )
+    header = g_strdup_printf ( "HTTP/1.0 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: %" G_GSIZE_FORMAT "\r\nConnection: close\r\n\r\n", length );
+  else
+    header = g_strdup ( "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n" );
+  if ( g_output_stream_write_all ( out, header, strlen(header), NULL, NULL, NULL ) && contents &&
+       g_output_stream_write_all ( out, contents, length, NULL, NULL, NULL ) )
+    g_atomic_int_inc ( &served );
+
+  g_free ( header );
+  g_free ( contents );
+  g_free ( filename );
+  g_free ( request );
+  g_object_unref ( din );
+  return TRUE;
+}
+
+static void peercache_stop ( void )
+{
+  if ( discovery_thread ) {
+    g_cancellable_cancel ( discovery_cancel );
+    g_thread_join ( discovery_thread );
+    discovery_thread = NULL;
+    g_clear_object ( &discovery_cancel );
+  }
+  if ( service ) {
+    g_socket_service_stop ( service );
+    g_socket_listener_close ( G_SOCKET_LISTENER(service) );
+    g_clear_object ( &service );
+  }
+  g_mutex_lock ( &peer_mutex );
+  g_hash_table_remove_all ( peers );
+  g_free ( root );
+  root = NULL;
+  g_mutex_unlock ( &peer_mutex );
+}
+
+static void peercache_start ( const gchar *dir )
+{
+  GError *error = NULL;
+  // Any free port will do, as the other instances learn it from the announcements
+  service = g_threaded_socket_service_new ( PEER_MAX_CONNECTIONS );
+  service_port = g_socket_listener_add_any_inet_port ( G_SOCKET_LISTENER(service), NULL, &error );
+  if ( !service_port ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+    g_clear_object ( &service );
+    return;
+  }
+  g_signal_connect ( service, "run", G_CALLBACK(peer_serve), NULL );
+
+  GSocket *sock = g_socket_new ( G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, &error );
+  GInetAddress *any = g_inet_address_new_any ( G_SOCKET_FAMILY_IPV4 );
+  GSocketAddress *bind_addr = g_inet_socket_address_new ( any, PEER_PORT );
+  GInetAddress *group = g_inet_address_new_from_string ( PEER_GROUP );
+  gboolean ok = sock &&
+    g_socket_bind ( sock, bind_addr, TRUE, &error ) &&
+    g_socket_join_multicast_group ( sock, group, FALSE, NULL, &error );
+  g_object_unref ( group );
+  g_object_unref ( bind_addr );
+  g_object_unref ( any );
+  if ( !ok ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+    if ( sock )
+      g_object_unref ( sock );
+    peercache_stop ();
+    return;
+  }
+  // Only on the local network
+  g_socket_set_multicast_ttl ( sock, 1 );
+
+  g_mutex_lock ( &peer_mutex );
+  root = g_str_has_suffix ( dir, G_DIR_SEPARATOR_S ) ? g_strdup ( dir ) : g_strconcat ( dir, G_DIR_SEPARATOR_S, NULL );
+  g_mutex_unlock ( &peer_mutex );
+
+  g_socket_service_start ( service );
+  discovery_cancel = g_cancellable_new ();
+  discovery_thread = g_thread_new ( "peercache", peer_discovery_thread, sock );
+  g_debug ( "%s: Serving %s on port %d", __FUNCTION__, dir, service_port );
+}
+
+/**
+ * a_peercache_refresh_preferences:
+ *
+ * Start or stop sharing tiles, as the preference is now
+ */
+void a_peercache_refresh_preferences ( void )
+{
+  VikLayerParamData *pd = a_preferences_get ( VIKING_PREFERENCES_NAMESPACE "peer_cache" );
+  // The maps layer's preference, so the same directory as new layers use
+  VikLayerParamData *dir = a_preferences_get ( VIKING_PREFERENCES_NAMESPACE "maplayer_default_dir" );
+  gboolean want = pd && pd->b && dir && dir->s && dir->s[0];
+
+  gboolean same_dir = FALSE;
+  g_mutex_lock ( &peer_mutex );
+  if ( want && root )
+    same_dir = g_str_has_prefix ( root, dir->s ) && strlen(root) - strlen(dir->s) <= 1;
+  g_mutex_unlock ( &peer_mutex );
+  if ( service && same_dir )
+    return;
+
+  peercache_stop ();
+  if ( want )
+    peercache_start ( dir->s );
+}
+
+void a_peercache_uninit ( void )
+{
+  peercache_stop ();
+  if ( peers )
+    g_hash_table_destroy ( peers );
+  peers = NULL;
+}
+
+/**
+ * Ask the peer for the file
+ *
+ * Returns: The file contents, or NULL if not available
+ */
+static GBytes *peer_get ( const gchar *host, guint16 port, const gchar *path, gboolean *reachable )
+{
+  GSocketClient *client = g_socket_client_new ();
+  g_socket_client_set_timeout ( client, PEER_TIMEOUT );
+  GSocketConnection *conn = g_socket_client_connect_to_host ( client, host, port, NULL, NULL );
+  g_object_unref ( client );
+  *reachable = FALSE;
+  if ( !conn )
+    return NULL;
+
+  GBytes *body = NULL;
+  GOutputStream *out = g_io_stream_get_output_stream ( G_IO_STREAM(conn) );
+  GDataInputStream *din = g_data_input_stream_new ( g_io_stream_get_input_stream ( G_IO_STREAM(conn) ) );
+  g_data_input_stream_set_newline_type ( din, G_DATA_STREAM_NEWLINE_TYPE_ANY );
+  gchar *request = g_strdup_printf ( "GET " PEER_PATH "%s HTTP/1.0\r\nHost: %s\r\n\r\n", path, host );
+
+  gchar *status = NULL;
+  if ( g_output_stream_write_all ( out, request, strlen(request), NULL, NULL, NULL ) )
+    status = g_data_input_stream_read_line ( din, NULL, NULL, NULL );
+  if ( status ) {
+    // Having answered at all, it is still there
+    *reachable = TRUE;
+    guint64 length = 0;
+    gchar *line;
+    while ( (line = g_data_input_stream_read_line ( din, NULL, NULL, NULL )) && line[0] ) {
+      if ( g_ascii_strncasecmp ( line, "Content-Length:", 15 ) == 0 )
+        length = g_ascii_strtoull ( line + 15, NULL, 10 );
+      g_free ( line );
+    }
+    g_free ( line );
+
+    if ( g_str_has_prefix ( status, "HTTP/1." ) && strstr ( status, " 200 " ) && length && length <= PEER_MAX_FILE ) {
+      gchar *data = g_malloc ( length );
+      gsize got = 0;
+      if ( g_input_stream_read_all ( G_INPUT_STREAM(din), data, length, &got, NULL, NULL ) && got == length )
+        body = g_bytes_new_take ( data, length );
+      else
+        g_free ( data );
+    }
+    g_free ( status );
+  }
+
+  g_free ( request );
+  g_object_unref ( din );
+  g_object_unref ( conn );
+  return body;
+}
+
+/**
+ * a_peercache_fetch:
+ * @fn: The file as it will be in the map cache directory
+ * @f:  Where to write the contents
+ *
+ * Ask each instance heard from recently for the file, stopping at the first that has it
+ */
+gboolean a_peercache_fetch ( const gchar *fn, FILE *f )
+{
+  gchar *path = NULL;
+  GPtrArray *candidates = g_ptr_array_new_with_free_func ( (GDestroyNotify)peer_free );
+
+  g_mutex_lock ( &peer_mutex );
+  if ( root && g_str_has_prefix ( fn, root ) ) {
+    gchar *rel = g_strdup ( fn + strlen(root) );
+    g_strdelimit ( rel, G_DIR_SEPARATOR_S, '/' );
+    path = g_uri_escape_string ( rel, "/", FALSE );
+    g_free ( rel );
+
+    gint64 now = g_get_monotonic_time ();
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init ( &iter, peers );
+    while ( g_hash_table_iter_next ( &iter, NULL, &value ) ) {
+      Peer *peer = value;
+      if ( now - peer->last_seen > PEER_EXPIRY )
+        g_hash_table_iter_remove ( &iter );
+      else if ( now >= peer->down_until && candidates->len < PEER_MAX_TRIES ) {
+        Peer *copy = g_new0 ( Peer, 1 );
+        copy->host = g_strdup ( peer->host );
+        copy->port = peer->port;
+        g_ptr_array_add ( candidates, copy );
+      }
+    }
+  }
+  g_mutex_unlock ( &peer_mutex );
+
+  gboolean ans = FALSE;
+  for ( guint ii = 0; ii < candidates->len && !ans; ii++ ) {
+    Peer *peer = g_ptr_array_index ( candidates, ii );
+    gboolean reachable;
+    GBytes *body = peer_get ( peer->host, peer->port, path, &reachable );
+    if ( body ) {
+      gsize length = 0;
+      gconstpointer data = g_bytes_get_data ( body, &length );
+      ans = fwrite ( data, length, 1, f ) == 1 && fflush ( f ) == 0;
+      g_bytes_unref ( body );
+      if ( ans )
+        g_atomic_int_inc ( &fetched );
+    }
+    if ( !reachable ) {
+      gchar *key = g_strdup_printf ( "%s:%u", peer->host, peer->port );
+      g_mutex_lock ( &peer_mutex );
+      Peer *known = g_hash_table_lookup ( peers, key );
+      if ( known )
+        known->down_until = g_get_monotonic_time () + PEER_DOWN_TIME;
+      g_mutex_unlock ( &peer_mutex );
+      g_free ( key );
+    }
+  }
+
+  g_ptr_array_free ( candidates, TRUE );
+  g_free ( path );
+  return ans;
+}
+
+/**
+ * a_peercache_usage_string:
+ *
+ * Returns: How many instances are known and the tiles exchanged, or NULL when not sharing
+ */
+gchar *a_peercache_usage_string ( void )
+{
+  if ( !service )
+    return NULL;
+  g_mutex_lock ( &peer_mutex );
+  guint count = g_hash_table_size ( peers );
+  g_mutex_unlock ( &peer_mutex );
+  return g_strdup_printf ( _("%d instances, %d tiles received, %d tiles given"), count, g_atomic_int_get(&fetched), g_atomic_int_get(&served) );
+}
@@ -0,0 +1,42 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_PEERCACHE_H
+#define __VIKING_PEERCACHE_H
+
+#include <stdio.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Sharing the downloaded map tiles with other Viking instances on the local network
+void a_peercache_init ( void );
+// Start or stop sharing according to the preference
+void a_peercache_refresh_preferences ( void );
+void a_peercache_uninit ( void );
+
+// Get the file (within the map cache directory) from another instance, writing it to f
+// Returns: TRUE if one had it - safe to call from any thread
+gboolean a_peercache_fetch ( const gchar *fn, FILE *f );
+// NULL when not sharing
+gchar *a_peercache_usage_string ( void );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include "pickbuffer.h"
+
+struct _PickBuffer {
+  gint width, height; // Including the margin on both sides
+  gint margin;
+  guint32 *values;    // 0 for nothing
+};
+
+PickBuffer *a_pick_buffer_new ( gint width, gint height, gint margin )
+{
+  PickBuffer *pb = g_new ( PickBuffer, 1 );
+  pb->margin = MAX ( margin, 0 );
+  pb->width = MAX ( width, 0 ) + 2*pb->margin;
+  pb->height = MAX ( height, 0 ) + 2*pb->margin;
+  pb->values = g_new0 ( guint32, (gsize)pb->width * pb->height );
+  return pb;
+}
+
+void a_pick_buffer_free ( PickBuffer *pb )
+{
+  if ( !pb )
+    return;
+  g_free ( pb->values );
+  g_free ( pb );
+}
+
+gint a_pick_buffer_get_margin ( PickBuffer *pb )
+{
+  return pb->margin;
+}
+
+gboolean a_pick_buffer_set ( PickBuffer *pb, gint x, gint y, guint32 value )
+{
+  x += pb->margin;
+  y += pb->margin;
+  if ( x < 0 || y < 0 || x >= pb->width || y >= pb->height )
+    return FALSE;
+  guint32 *pixel = &pb->values[(gsize)y * pb->width + x];
+  if ( *pixel )
+    return FALSE;
+  *pixel = value;
+  return TRUE;
+}
+
+guint32 a_pick_buffer_closest ( PickBuffer *pb, gint x, gint y, gint size, gint *closest_x, gint *closest_y )
+{
+  gint bx = x + pb->margin, by = y + pb->margin;
+  gint x0 = MAX ( bx - size, 0 ), x1 = MIN ( bx + size, pb->width - 1 );
+  gint y0 = MAX ( by - size, 0 ), y1 = MIN ( by + size, pb->height - 1 );
+  guint32 ans = 0;
+  gint best = G_MAXINT;
+  for ( gint yy = y0; yy <= y1; yy++ ) {
+    const guint32 *row = &pb->values[(gsize)yy * pb->width];
+    for ( gint xx = x0; xx <= x1; xx++ ) {
+      if ( !row[xx] )
+        continue;
+      gint dist = abs ( xx - bx ) + abs ( yy - by );
+      if ( dist < best ) {
+        best = dist;
+        ans = row[xx];
+        *closest_x = xx - pb->margin;
+        *closest_y = yy - pb->margin;
+      }
+    }
+  }
+  return ans;
+}
@@ -0,0 +1,43 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_PICKBUFFER_H
+#define __VIKING_PICKBUFFER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// A value for each pixel of the display (plus a margin around it) identifying what is there,
+//  so finding the nearest item to a screen position only has to look at the pixels around it
+typedef struct _PickBuffer PickBuffer;
+
+PickBuffer *a_pick_buffer_new ( gint width, gint height, gint margin );
+void a_pick_buffer_free ( PickBuffer *pb );
+gint a_pick_buffer_get_margin ( PickBuffer *pb );
+
+// Values must be non zero. Any existing value of the pixel is kept
+// Returns: TRUE if the value was stored
+gboolean a_pick_buffer_set ( PickBuffer *pb, gint x, gint y, guint32 value );
+// Returns: The value of the nearest set pixel (by Manhattan distance) within size of the position, or 0 if none
+guint32 a_pick_buffer_closest ( PickBuffer *pb, gint x, gint y, gint size, gint *closest_x, gint *closest_y );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "pixbufpool.h"
+
+/*
+ * Whilst panning, map tiles are continually decoded (or rendered) and evicted from the map cache,
+ *  each one being a fresh allocation of the same few sizes (e.g. 256x256 RGB or RGBA).
+ * Buffers of this size are typically mapped from and returned to the system every time,
+ *  and otherwise fragment the heap.
+ * So the buffers of freed tile pixbufs are kept in a slab per size, ready for the next tile.
+ *
+ * Each buffer has a small header before the pixels giving its size,
+ *  and whilst in the pool, the next free buffer in its slab.
+ */
+
+typedef union {
+  struct {
+    gsize size;
+    gpointer next;
+  } h;
+  guchar align[16]; // Keep the pixels aligned
+} PoolHeader;
+
+typedef struct {
+  gsize size;         // Of the buffers in this slab, 0 when unused
+  PoolHeader *free;   // List of free buffers, the most recently freed first
+  guint count;
+} PoolSlab;
+
+// Tiles come in only a few sizes at any one time
+#define POOL_SLABS 8
+// Limit on the memory kept in the pool (64 tiles of 256x256 RGBA)
+#define POOL_BYTES (16 * 1024 * 1024)
+
+static PoolSlab slabs[POOL_SLABS];
+static gsize pool_bytes = 0;
+static GMutex pool_mutex;
+
+void a_pixbuf_pool_init ( void )
+{
+  memset ( slabs, 0, sizeof(slabs) );
+  pool_bytes = 0;
+}
+
+void a_pixbuf_pool_uninit ( void )
+{
+  g_mutex_lock ( &pool_mutex );
+  for ( guint ss = 0; ss < POOL_SLABS; ss++ ) {
+    while ( slabs[ss].free ) {
+      PoolHeader *buf = slabs[ss].free;
+      slabs[ss].free = buf->h.next;
+      g_free ( buf );
+    }
+    slabs[ss].size = 0;
+    slabs[ss].count = 0;
+  }
+  pool_bytes = 0;
+  g_mutex_unlock ( &pool_mutex );
+}
+
+gsize a_pixbuf_pool_get_size ( void )
+{
+  g_mutex_lock ( &pool_mutex );
+  gsize bytes = pool_bytes;
+  g_mutex_unlock ( &pool_mutex );
+  return bytes;
+}
+
+/**
+ * Pool must be locked
+ *
+ * Returns: The slab for buffers of this size, or NULL if there is no room for another
+ */
+static PoolSlab *slab_find ( gsize size, gboolean create )
+{
+  PoolSlab *empty = NULL;
+  for ( guint ss = 0; ss < POOL_SLABS; ss++ ) {
+    if ( slabs[ss].size == size )
+      return &slabs[ss];
+    if ( !empty && slabs[ss].count == 0 )
+      empty = &slabs[ss];
+  }
+  // Reuse any slab left empty by a size no longer in use
+  if ( create && empty )
+    empty->size = size;
+  return create ? empty : NULL;
+}
+
+/**
+ * a_pixbuf_pool_alloc:
+ *
+ * Returns: Memory for the pixels of a pixbuf, to be released by a_pixbuf_pool_free()
+ *  (normally via a_pixbuf_pool_wrap())
+ */
+guchar *a_pixbuf_pool_alloc ( gsize size )
+{
+  g_mutex_lock ( &pool_mutex );
+  PoolSlab *slab = slab_find ( size, FALSE );
+  if ( slab && slab->free ) {
+    PoolHeader *buf = slab->free;
+    slab->free = buf->h.next;
+    slab->count--;
+    pool_bytes -= size;
+    g_mutex_unlock ( &pool_mutex );
+    return (guchar*)(buf + 1);
+  }
+  g_mutex_unlock ( &pool_mutex );
+
+  PoolHeader *buf = g_malloc ( sizeof(PoolHeader) + size );
+  buf->h.size = size;
+  return (guchar*)(buf + 1);
+}
+
+/**
+ * a_pixbuf_pool_free:
+ *
+ * Return the pixels to the pool - a GdkPixbufDestroyNotify
+ */
+void a_pixbuf_pool_free ( guchar *pixels, gpointer data )
+{
+  PoolHeader *buf = (PoolHeader*)pixels - 1;
+  g_mutex_lock ( &pool_mutex );
+  if ( pool_bytes + buf->h.size <= POOL_BYTES ) {
+    PoolSlab *slab = slab_find ( buf->h.size, TRUE );
+    if ( slab ) {
+      buf->h.next = slab->free;
+      slab->free = buf;
+      slab->count++;
+      pool_bytes += buf->h.size;
+      buf = NULL;
+    }
+  }
+  g_mutex_unlock ( &pool_mutex );
+  g_free ( buf );
+}
+
+/**
+ * a_pixbuf_pool_rowstride:
+ *
+ * Returns: The rowstride to use for a pixbuf of this width, as gdk_pixbuf_new() would
+ */
+gint a_pixbuf_pool_rowstride ( gboolean has_alpha, gint width )
+{
+  return ( width * (has_alpha ? 4 : 3) + 3 ) & ~3;
+}
+
+/**
+ * a_pixbuf_pool_wrap:
+ * @pixels: From a_pixbuf_pool_alloc(), which the pixbuf then owns
+ */
+GdkPixbuf *a_pixbuf_pool_wrap ( guchar *pixels, gboolean has_alpha, gint width, gint height, gint rowstride )
+{
+  return gdk_pixbuf_new_from_data ( pixels, GDK_COLORSPACE_RGB, has_alpha, 8, width, height, rowstride, a_pixbuf_pool_free, NULL );
+}
+
+/**
+ * a_pixbuf_pool_new:
+ *
+ * Like gdk_pixbuf_new(), but the pixels are uninitialized
+ */
+GdkPixbuf *a_pixbuf_pool_new ( gboolean has_alpha, gint width, gint height )
+{
+  gint rowstride = a_pixbuf_pool_rowstride ( has_alpha, width );
+  guchar *pixels = a_pixbuf_pool_alloc ( (gsize)rowstride * height );
+  return a_pixbuf_pool_wrap ( pixels, has_alpha, width, height, rowstride );
+}
+
+/**
+ * a_pixbuf_pool_copy:
+ *
+ * Like gdk_pixbuf_copy(), e.g. for part of a larger image given by a subpixbuf
+ */
+GdkPixbuf *a_pixbuf_pool_copy ( GdkPixbuf *pixbuf )
+{
+  gboolean has_alpha = gdk_pixbuf_get_has_alpha ( pixbuf );
+  gint width = gdk_pixbuf_get_width ( pixbuf );
+  gint height = gdk_pixbuf_get_height ( pixbuf );
+  gint src_rowstride = gdk_pixbuf_get_rowstride ( pixbuf );
+  const guchar *src = gdk_pixbuf_get_pixels ( pixbuf );
+
+  GdkPixbuf *copy = a_pixbuf_pool_new ( has_alpha, width, height );
+  gint rowstride = gdk_pixbuf_get_rowstride ( copy );
+  guchar *dst = gdk_pixbuf_get_pixels ( copy );
+  gsize row_bytes = (gsize)width * (has_alpha ? 4 : 3);
+  for ( gint yy = 0; yy < height; yy++ )
+    memcpy ( dst + (gsize)yy * rowstride, src + (gsize)yy * src_rowstride, row_bytes );
+  return copy;
+}
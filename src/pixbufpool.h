@@ -0,0 +1,48 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_PIXBUFPOOL_H
+#define __VIKING_PIXBUFPOOL_H
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+// Pixel buffers for map tiles, reused rather than returned to the system when the pixbuf is freed
+// May be used from any thread
+void a_pixbuf_pool_init ( void );
+void a_pixbuf_pool_uninit ( void );
+
+// The pixels are not cleared, so must all be written by the caller
+GdkPixbuf *a_pixbuf_pool_new ( gboolean has_alpha, gint width, gint height );
+GdkPixbuf *a_pixbuf_pool_copy ( GdkPixbuf *pixbuf );
+
+// For decoding directly into memory that then becomes the pixbuf's
+gint a_pixbuf_pool_rowstride ( gboolean has_alpha, gint width );
+guchar *a_pixbuf_pool_alloc ( gsize size );
+void a_pixbuf_pool_free ( guchar *pixels, gpointer data );
+GdkPixbuf *a_pixbuf_pool_wrap ( guchar *pixels, gboolean has_alpha, gint width, gint height, gint rowstride );
+
+// The number of bytes held ready for new pixbufs
+gsize a_pixbuf_pool_get_size ( void );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,461 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <glib/gi18n.h>
+#include "placeindex.h"
+
+/**
+ * SECTION:placeindex
+ * @short_description: Offline search of place names
+ *
+ * The names in a geonames.org dump are converted once into an index file, which is then
+ *  memory mapped to find the places whose name has a word starting with what has been typed.
+ *
+ * Every word start of each (normalized) name is a key, sorted so that all the keys
+ *  with a given prefix are next to each other and can be found with a binary search.
+ * The keys are offsets into the names themselves, so they cost no more than the offsets.
+ *
+ * The index file is in the native byte order, it is not meant to be copied between machines.
+ */
+
+#define PI_MAGIC "VikingPlaceIndex"
+#define PI_VERSION 1
+#define PI_BYTE_ORDER 0x01020304
+
+// Coordinates are stored in units of 1e-7 degrees
+#define PI_SCALE 1e7
+// Limit the work for very short queries, which match a large part of the index
+#define PI_SCAN_MAX 10000
+
+// Columns of the geonames.org dump
+#define GN_NAME 1
+#define GN_ASCIINAME 2
+#define GN_LATITUDE 4
+#define GN_LONGITUDE 5
+#define GN_COUNTRY 8
+#define GN_POPULATION 14
+#define GN_COLUMNS 15
+
+typedef struct {
+  gchar magic[16];
+  guint32 byte_order;
+  guint32 version;
+  guint32 n_places;
+  guint32 n_keys;
+  guint32 pool_size;
+} PiHeader;
+
+typedef struct {
+  gint32 lat;
+  gint32 lon;
+  guint32 name;       // Offset in the pool of the name to show
+  guint32 population;
+} PiPlace;
+
+typedef struct {
+  guint32 key;        // Offset in the pool, within the normalized name of the place
+  guint32 place;
+} PiKey;
+
+struct _PlaceIndex {
+  GMappedFile *mf;
+  const PiHeader *header;
+  const PiPlace *places;
+  const PiKey *keys;
+  const gchar *pool;
+};
+
+GQuark a_place_index_error_quark ( void )
+{
+  return g_quark_from_static_string ( "viking-place-index-error-quark" );
+}
+
+/**
+ * a_place_index_normalize:
+ *
+ * Accents are removed by decomposing the characters and dropping the marks,
+ *  so that 'Zurich' finds 'Zürich'.
+ *
+ * Returns: A newly allocated string, which is empty if there is nothing to search by
+ */
+gchar *a_place_index_normalize ( const gchar *str )
+{
+  if ( !str || !g_utf8_validate ( str, -1, NULL ) )
+    return g_strdup ( "" );
+
+  gchar *decomposed = g_utf8_normalize ( str, -1, G_NORMALIZE_NFD );
+  GString *gs = g_string_sized_new ( strlen(str) );
+  gboolean space = FALSE;
+  for ( const gchar *pp = decomposed; pp && *pp; pp = g_utf8_next_char(pp) ) {
+    gunichar ch = g_utf8_get_char ( pp );
+    if ( g_unichar_ismark ( ch ) )
+      continue;
+    if ( g_unichar_isalnum ( ch ) ) {
+      if ( space && gs->len )
+        g_string_append_c ( gs, ' ' );
+      space = FALSE;
+      g_string_append_unichar ( gs, g_unichar_tolower(ch) );
+    }
+    else
+      space = TRUE;
+  }
+  g_free ( decomposed );
+  return g_string_free ( gs, FALSE );
+}
+
+/**
+ * a_place_index_name_matches:
+ * @name:  Normalized by a_place_index_normalize()
+ * @query: Normalized by a_place_index_normalize()
+ *
+ * The same test as the index makes, for names not in the index.
+ */
+gboolean a_place_index_name_matches ( const gchar *name, const gchar *query )
+{
+  size_t len = strlen ( query );
+  if ( !len )
+    return FALSE;
+  for ( const gchar *pp = name; *pp; pp++ )
+    if ( ( pp == name || pp[-1] == ' ' ) && strncmp ( pp, query, len ) == 0 )
+      return TRUE;
+  return FALSE;
+}
+
+/*
+ * Building the index
+ */
+
+typedef struct {
+  GArray *places;
+  GArray *keys;
+  GString *pool;
+} BuildT;
+
+static gboolean pool_add ( BuildT *bd, const gchar *str, guint32 *offset )
+{
+  gsize len = strlen ( str ) + 1;
+  if ( bd->pool->len + len > G_MAXUINT32 )
+    return FALSE;
+  *offset = bd->pool->len;
+  g_string_append_len ( bd->pool, str, len );
+  return TRUE;
+}
+
+/**
+ * Add a key for every word start of the normalized name, which is already in the pool
+ */
+static void add_keys ( BuildT *bd, guint32 offset, guint32 place )
+{
+  for ( guint32 pos = offset; bd->pool->str[pos]; pos++ )
+    if ( pos == offset || bd->pool->str[pos-1] == ' ' ) {
+      PiKey key = { pos, place };
+      g_array_append_val ( bd->keys, key );
+    }
+}
+
+static gboolean build_line ( BuildT *bd, gchar *line )
+{
+  gchar **cols = g_strsplit ( line, "\t", GN_COLUMNS + 1 );
+  if ( g_strv_length ( cols ) < GN_COLUMNS || !*cols[GN_NAME] || !g_utf8_validate ( cols[GN_NAME], -1, NULL ) ) {
+    g_strfreev ( cols );
+    return TRUE;
+  }
+
+  PiPlace place;
+  guint32 offset;
+  gboolean ok = TRUE;
+  gchar *key = a_place_index_normalize ( cols[GN_NAME] );
+  if ( *key ) {
+    gdouble lat = g_ascii_strtod ( cols[GN_LATITUDE], NULL );
+    gdouble lon = g_ascii_strtod ( cols[GN_LONGITUDE], NULL );
+    place.lat = CLAMP ( lat, -90.0, 90.0 ) * PI_SCALE;
+    place.lon = CLAMP ( lon, -180.0, 180.0 ) * PI_SCALE;
+    place.population = MIN ( g_ascii_strtoull ( cols[GN_POPULATION], NULL, 10 ), G_MAXUINT32 );
+
+    gchar *name = *cols[GN_COUNTRY] ? g_strdup_printf ( "%s, %s", cols[GN_NAME], cols[GN_COUNTRY] ) : g_strdup ( cols[GN_NAME] );
+    ok = pool_add ( bd, name, &place.name ) && pool_add ( bd, key, &offset );
+    g_free ( name );
+    if ( ok ) {
+      guint32 index = bd->places->len;
+      g_array_append_val ( bd->places, place );
+      add_keys ( bd, offset, index );
+
+      // Names in other scripts are also findable by their latin transliteration
+      gchar *ascii = a_place_index_normalize ( cols[GN_ASCIINAME] );
+      if ( *ascii && strcmp ( ascii, key ) != 0 ) {
+        ok = pool_add ( bd, ascii, &offset );
+        if ( ok )
+          add_keys ( bd, offset, index );
+      }
+      g_free ( ascii );
+    }
+  }
+  g_free ( key );
+  g_strfreev ( cols );
+  return ok;
+}
+
+static gint key_compare ( gconstpointer aa, gconstpointer bb, gpointer user_data )
+{
+  const BuildT *bd = user_data;
+  const PiKey *ka = aa;
+  const PiKey *kb = bb;
+  gint ans = strcmp ( bd->pool->str + ka->key, bd->pool->str + kb->key );
+  if ( ans )
+    return ans;
+  // Most populous first
+  guint32 pa = g_array_index ( bd->places, PiPlace, ka->place ).population;
+  guint32 pb = g_array_index ( bd->places, PiPlace, kb->place ).population;
+  return (pa < pb) - (pa > pb);
+}
+
+static gboolean build_write ( BuildT *bd, const gchar *filename, GError **error )
+{
+  PiHeader hdr;
+  memset ( &hdr, 0, sizeof(PiHeader) );
+  memcpy ( hdr.magic, PI_MAGIC, sizeof(hdr.magic) );
+  hdr.byte_order = PI_BYTE_ORDER;
+  hdr.version = PI_VERSION;
+  hdr.n_places = bd->places->len;
+  hdr.n_keys = bd->keys->len;
+  hdr.pool_size = bd->pool->len;
+
+  // Write to a temporary file first, so an interrupted build is not mistaken for an index
+  gchar *tmp_name = g_strconcat ( filename, ".tmp", NULL );
+  FILE *ff = g_fopen ( tmp_name, "wb" );
+  if ( !ff ) {
+    g_set_error ( error, G_FILE_ERROR, g_file_error_from_errno(errno), _("Could not create %s: %s"), tmp_name, g_strerror(errno) );
+    g_free ( tmp_name );
+    return FALSE;
+  }
+  gboolean ok = fwrite ( &hdr, sizeof(PiHeader), 1, ff ) == 1;
+  ok = ok && fwrite ( bd->places->data, sizeof(PiPlace), hdr.n_places, ff ) == hdr.n_places;
+  ok = ok && fwrite ( bd->keys->data, sizeof(PiKey), hdr.n_keys, ff ) == hdr.n_keys;
+  ok = ok && fwrite ( bd->pool->str, 1, hdr.pool_size, ff ) == hdr.pool_size;
+  if ( fclose ( ff ) != 0 )
+    ok = FALSE;
+  if ( ok && g_rename ( tmp_name, filename ) != 0 )
+    ok = FALSE;
+  if ( !ok ) {
+    g_set_error ( error, G_FILE_ERROR, g_file_error_from_errno(errno), _("Could not write %s: %s"), filename, g_strerror(errno) );
+    (void)g_remove ( tmp_name );
+  }
+  g_free ( tmp_name );
+  return ok;
+}
+
+/**
+ * a_place_index_build:
+ * @geonames_file: A tab separated dump from geonames.org
+ * @filename:      The index file to create
+ *
+ * Only the main name and its ASCII form are indexed; the alternate names would make the
+ *  index many times larger. Pick a smaller dump, e.g. cities1000.txt or a single country,
+ *  to reduce the memory needed while building.
+ */
+gboolean a_place_index_build ( const gchar *geonames_file, const gchar *filename, GError **error )
+{
+  GIOChannel *channel = g_io_channel_new_file ( geonames_file, "r", error );
+  if ( !channel )
+    return FALSE;
+  // Any invalid lines are skipped rather than failing the whole file
+  (void)g_io_channel_set_encoding ( channel, NULL, NULL );
+
+  BuildT bd;
+  bd.places = g_array_new ( FALSE, FALSE, sizeof(PiPlace) );
+  bd.keys = g_array_new ( FALSE, FALSE, sizeof(PiKey) );
+  bd.pool = g_string_new ( NULL );
+
+  gint64 start = g_get_monotonic_time ();
+  gboolean ok = TRUE;
+  GString *line = g_string_new ( NULL );
+  gsize terminator;
+  GIOStatus status;
+  while ( ok && (status = g_io_channel_read_line_string ( channel, line, &terminator, error )) == G_IO_STATUS_NORMAL ) {
+    g_string_truncate ( line, terminator );
+    if ( !build_line ( &bd, line->str ) ) {
+      g_set_error ( error, PLACE_INDEX_ERROR, PLACE_INDEX_ERROR_INVALID, _("Too many places for a place index") );
+      ok = FALSE;
+    }
+  }
+  ok = ok && status == G_IO_STATUS_EOF;
+  g_string_free ( line, TRUE );
+  g_io_channel_unref ( channel );
+
+  if ( ok && !bd.places->len ) {
+    g_set_error ( error, PLACE_INDEX_ERROR, PLACE_INDEX_ERROR_INVALID, _("%s is not a geonames file"), geonames_file );
+    ok = FALSE;
+  }
+  if ( ok ) {
+    g_array_sort_with_data ( bd.keys, key_compare, &bd );
+    ok = build_write ( &bd, filename, error );
+  }
+  if ( ok )
+    g_debug ( "%s: %s has %u places giving %u keys, built in %.1fs", __FUNCTION__, geonames_file,
+              bd.places->len, bd.keys->len, (g_get_monotonic_time() - start) / (gdouble)G_USEC_PER_SEC );
+
+  g_array_free ( bd.places, TRUE );
+  g_array_free ( bd.keys, TRUE );
+  g_string_free ( bd.pool, TRUE );
+  return ok;
+}
+
+/*
+ * Using the index
+ */
+
+/**
+ * a_place_index_open:
+ *
+ * Returns: The index or NULL if it is not valid for this version
+ */
+PlaceIndex *a_place_index_open ( const gchar *filename, GError **error )
+{
+  GMappedFile *mf = g_mapped_file_new ( filename, FALSE, error );
+  if ( !mf )
+    return NULL;
+
+  gsize size = g_mapped_file_get_length ( mf );
+  const gchar *data = g_mapped_file_get_contents ( mf );
+  const PiHeader *hdr = (const PiHeader*)data;
+  if ( size < sizeof(PiHeader) || memcmp ( hdr->magic, PI_MAGIC, sizeof(hdr->magic) ) ||
+       hdr->byte_order != PI_BYTE_ORDER || hdr->version != PI_VERSION ) {
+    g_set_error ( error, PLACE_INDEX_ERROR, PLACE_INDEX_ERROR_INVALID, _("%s is not a place index for this version"), filename );
+    g_mapped_file_unref ( mf );
+    return NULL;
+  }
+  guint64 expected = sizeof(PiHeader) +
+                     (guint64)hdr->n_places * sizeof(PiPlace) +
+                     (guint64)hdr->n_keys * sizeof(PiKey) +
+                     hdr->pool_size;
+  // Every string in the pool is terminated, so none can be read past the end
+  if ( expected != size || (hdr->pool_size && data[size-1] != '\0') ) {
+    g_set_error ( error, PLACE_INDEX_ERROR, PLACE_INDEX_ERROR_INVALID, _("%s is not a complete place index"), filename );
+    g_mapped_file_unref ( mf );
+    return NULL;
+  }
+
+  PlaceIndex *pi = g_malloc0 ( sizeof(PlaceIndex) );
+  pi->mf = mf;
+  pi->header = hdr;
+  data += sizeof(PiHeader);
+  pi->places = (const PiPlace*)data;
+  data += hdr->n_places * sizeof(PiPlace);
+  pi->keys = (const PiKey*)data;
+  data += hdr->n_keys * sizeof(PiKey);
+  pi->pool = data;
+  return pi;
+}
+
+void a_place_index_free ( PlaceIndex *pi )
+{
+  if ( !pi )
+    return;
+  g_mapped_file_unref ( pi->mf );
+  g_free ( pi );
+}
+
+guint a_place_index_get_size ( PlaceIndex *pi )
+{
+  return pi->header->n_places;
+}
+
+static const gchar *pool_string ( PlaceIndex *pi, guint32 offset )
+{
+  return offset < pi->header->pool_size ? pi->pool + offset : "";
+}
+
+typedef struct {
+  guint32 place;
+  gboolean at_start;  // The query matches the start of the name, rather than a later word
+  guint32 population;
+} MatchT;
+
+static gint match_compare ( gconstpointer aa, gconstpointer bb )
+{
+  const MatchT *ma = aa;
+  const MatchT *mb = bb;
+  if ( ma->at_start != mb->at_start )
+    return ma->at_start ? -1 : 1;
+  return (ma->population < mb->population) - (ma->population > mb->population);
+}
+
+/**
+ * a_place_index_search:
+ * @query: As typed; it is normalized here
+ * @max:   The most places to give
+ *
+ * Places whose name starts with the query come first, then the most populous.
+ *
+ * Returns: The number of places given to @func
+ */
+guint a_place_index_search ( PlaceIndex *pi, const gchar *query, guint max, PlaceIndexFunc func, gpointer user_data )
+{
+  gchar *norm = a_place_index_normalize ( query );
+  size_t len = strlen ( norm );
+  if ( !len ) {
+    g_free ( norm );
+    return 0;
+  }
+
+  // First key not less than the query; all the keys starting with it follow
+  guint32 lo = 0, hi = pi->header->n_keys;
+  while ( lo < hi ) {
+    guint32 mid = lo + (hi - lo) / 2;
+    if ( strcmp ( pool_string ( pi, pi->keys[mid].key ), norm ) < 0 )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  GArray *matches = g_array_new ( FALSE, FALSE, sizeof(MatchT) );
+  GHashTable *seen = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  for ( guint32 kk = lo; kk < pi->header->n_keys && kk - lo < PI_SCAN_MAX; kk++ ) {
+    const PiKey *key = &pi->keys[kk];
+    if ( strncmp ( pool_string ( pi, key->key ), norm, len ) != 0 )
+      break;
+    if ( key->place >= pi->header->n_places ||
+         g_hash_table_contains ( seen, GUINT_TO_POINTER(key->place) ) )
+      continue;
+    g_hash_table_add ( seen, GUINT_TO_POINTER(key->place) );
+    const PiPlace *place = &pi->places[key->place];
+    // Each normalized name follows the terminator of the previous string
+    MatchT match = { key->place, key->key == 0 || pi->pool[key->key-1] == '\0', place->population };
+    g_array_append_val ( matches, match );
+  }
+  g_hash_table_destroy ( seen );
+  g_free ( norm );
+
+  g_array_sort ( matches, match_compare );
+  guint ans = MIN ( matches->len, max );
+  for ( guint ii = 0; ii < ans; ii++ ) {
+    const PiPlace *place = &pi->places[g_array_index(matches, MatchT, ii).place];
+    struct LatLon ll = { place->lat / PI_SCALE, place->lon / PI_SCALE };
+    func ( pool_string ( pi, place->name ), &ll, user_data );
+  }
+  g_array_free ( matches, TRUE );
+  return ans;
+}
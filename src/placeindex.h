@@ -0,0 +1,56 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_PLACEINDEX_H
+#define __VIKING_PLACEINDEX_H
+
+#include <glib.h>
+#include "coords.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+  PLACE_INDEX_ERROR_INVALID,  // Not a (supported) geonames dump or place index file
+} PlaceIndexError;
+
+#define PLACE_INDEX_ERROR a_place_index_error_quark()
+GQuark a_place_index_error_quark ( void );
+
+typedef struct _PlaceIndex PlaceIndex;
+
+// Lower case, without accents or punctuation and single spaced - as names are compared
+gchar *a_place_index_normalize ( const gchar *str );
+// Whether a word of the name starts with the query, both normalized
+gboolean a_place_index_name_matches ( const gchar *name, const gchar *query );
+
+// From a geonames.org dump (e.g. allCountries.txt or cities1000.txt)
+gboolean a_place_index_build ( const gchar *geonames_file, const gchar *filename, GError **error );
+
+PlaceIndex *a_place_index_open ( const gchar *filename, GError **error );
+void a_place_index_free ( PlaceIndex *pi );
+guint a_place_index_get_size ( PlaceIndex *pi );
+
+// Called with the best matches first; the name is only valid until the index is freed
+typedef void (*PlaceIndexFunc) ( const gchar *name, const struct LatLon *ll, gpointer user_data );
+// Safe to call from any thread
+guint a_place_index_search ( PlaceIndex *pi, const gchar *query, guint max, PlaceIndexFunc func, gpointer user_data );
+
+G_END_DECLS
+
+#endif
@@ -24,6 +24,7 @@
 #include "viking.h"
 #include "print.h"
 #include "print-preview.h"
+#include "background.h"
 
 typedef enum
 {
@@ -60,6 +61,7 @@ typedef struct {
   gdouble             offset_y;
   PrintCenterMode     center;
   gboolean            use_full_page;
+  gboolean            high_res;    /* Draw the map again at the printer's resolution */
   GtkPrintOperation  *operation;
 } PrintData;
 
@@ -75,6 +77,7 @@ void a_print(VikWindow *vw, VikViewport *vvp)
    * viking session
    */
   static GtkPrintSettings *print_settings = NULL;
+  static gboolean high_res = FALSE;
 
   GtkPrintOperation *print_oper;
   GtkPrintOperationResult res;
@@ -89,6 +92,7 @@ void a_print(VikWindow *vw, VikViewport *vvp)
   data.offset_y      = 0;
   data.center        = VIK_PRINT_CENTER_BOTH;
   data.use_full_page = FALSE;
+  data.high_res      = high_res;
   data.operation     = print_oper;
 
   data.xmpp          = vik_viewport_get_xmpp(vvp);
@@ -116,6 +120,7 @@ void a_print(VikWindow *vw, VikViewport *vvp)
     if (print_settings != NULL)
       g_object_unref (print_settings);
     print_settings = g_object_ref (gtk_print_operation_get_print_settings (print_oper));
+    high_res = data.high_res;
   }
 
   g_object_unref (print_oper);
@@ -178,67 +183,224 @@ static void copy_row_from_rgba(guchar *surface_pixels, guchar *pixbuf_pixels, gi
   }
 }
 
+/* Pixels of the image drawn at a time, which bounds the memory used however large the page */
+#define PRINT_BAND_PIXELS (4*1024*1024)
+/* Limit on the resolution the map is drawn at for 'Printer Resolution' */
+#define VIK_SETTINGS_PRINT_MAX_RES "print_max_resolution"
+#define PRINT_MAX_RES 600
+/* Longest time to wait for maps to load for each band */
+#define PRINT_LOAD_WAIT_MAX 30
+
+typedef struct {
+  GdkPixbuf       *pixbuf;
+  cairo_surface_t *surface;
+  gint             y;       /* First row of the image in this band */
+  gint             height;
+  gint             done;    /* Set once the surface has been made */
+  gboolean         failed;  /* Nothing to put on the page */
+} PrintBand;
+
+/**
+ * Converting the pixels is independent of any GDK drawing,
+ *  so is done by the task workers whilst the next band is drawn
+ */
+static void print_band_convert(PrintBand *band, gpointer user_data)
+{
+  gint width = gdk_pixbuf_get_width(band->pixbuf);
+  band->surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, band->height);
+
+  guchar *surface_pixels = cairo_image_surface_get_data(band->surface);
+  gint stride = cairo_image_surface_get_stride(band->surface);
+  guchar *pixbuf_pixels = gdk_pixbuf_get_pixels(band->pixbuf);
+  gint pixbuf_stride = gdk_pixbuf_get_rowstride(band->pixbuf);
+  gint pixbuf_n_channels = gdk_pixbuf_get_n_channels(band->pixbuf);
+
+  /* Assume the pixbuf has 8 bits per channel */
+  for (gint y = 0; y < band->height; y++, surface_pixels += stride, pixbuf_pixels += pixbuf_stride) {
+    switch (pixbuf_n_channels) {
+      case 3:
+        copy_row_from_rgb (surface_pixels, pixbuf_pixels, width);
+        break;
+      case 4:
+        copy_row_from_rgba (surface_pixels, pixbuf_pixels, width);
+        break;
+      default: break;
+    }
+  }
+  cairo_surface_mark_dirty(band->surface);
+
+  g_object_unref(G_OBJECT(band->pixbuf));
+  band->pixbuf = NULL;
+  g_atomic_int_set(&band->done, 1);
+}
+
+/**
+ * Put a converted band into the page, waiting for it (and helping out) if need be
+ */
+static void print_band_paint(cairo_t *cr, VikTaskGroup *group, PrintBand *band, gint width)
+{
+  if (band->failed)
+    return;
+  while (!g_atomic_int_get(&band->done))
+    (void)a_background_tasks_wait(group, 10);
+
+  cairo_set_source_surface(cr, band->surface, 0, band->y);
+  /* Avoid a faint line between bands from the smoothing of the scaled image edges */
+  cairo_pattern_set_extend(cairo_get_source(cr), CAIRO_EXTEND_PAD);
+  cairo_rectangle(cr, 0, band->y, width, band->height);
+  cairo_fill(cr);
+  cairo_surface_destroy(band->surface);
+  band->surface = NULL;
+}
+
+/**
+ * How many times more detail the map is drawn at than on the screen
+ *  Powers of two keep the drawing at the zoom levels of map tiles
+ */
+static gint print_detail_factor(PrintData *data, gdouble dpi)
+{
+  if (!data->high_res)
+    return 1;
+
+  gint max_res = PRINT_MAX_RES;
+  gint tmp;
+  if (a_settings_get_integer(VIK_SETTINGS_PRINT_MAX_RES, &tmp))
+    max_res = tmp;
+
+  gdouble res = MIN(dpi, max_res);
+  gint factor = 1;
+  while (factor < 16 && factor * 2 * data->xres <= res &&
+         MIN(data->xmpp, data->ympp) / (factor * 2) >= VIK_VIEWPORT_MIN_ZOOM)
+    factor *= 2;
+  return factor;
+}
+
+static gboolean print_maps_loading(void)
+{
+  guint queued, running, queued_remote, running_remote;
+  a_background_get_pool_stats ( BACKGROUND_POOL_LOCAL, &queued, &running );
+  a_background_get_pool_stats ( BACKGROUND_POOL_REMOTE, &queued_remote, &running_remote );
+  return queued + running + queued_remote + running_remote > 0;
+}
+
+/**
+ * A viewport of the size of a band, not shown anywhere, for drawing the map in more detail
+ */
+static VikViewport *print_viewport_new(PrintData *data, gint factor, gint width, gint band_height, GtkWidget **window)
+{
+  VikViewport *vvp = vik_viewport_new();
+  /* The viewport needs a realized (but not shown) window to create its drawing buffers */
+  *window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+  gtk_container_add(GTK_CONTAINER(*window), GTK_WIDGET(vvp));
+  gtk_widget_realize(GTK_WIDGET(vvp));
+  (void)vik_viewport_configure(vvp);
+  vik_viewport_configure_manually(vvp, width, band_height);
+
+  vik_viewport_set_drawmode(vvp, vik_viewport_get_drawmode(data->vvp));
+  vik_viewport_set_background_color(vvp, vik_viewport_get_background_color(data->vvp));
+  vik_viewport_set_xmpp(vvp, data->xmpp / factor);
+  vik_viewport_set_ympp(vvp, data->ympp / factor);
+  vik_viewport_set_center_coord(vvp, vik_viewport_get_center(data->vvp), FALSE);
+  return vvp;
+}
+
+/**
+ * The image is put on the page in bands of rows, so only a band or two of it is ever in memory.
+ * Normally the bands are copied from what is shown on the screen.
+ * For 'Printer Resolution' the map is instead drawn again for each band in an offscreen viewport,
+ *  with up to the printer's resolution (in powers of two) of more detail.
+ */
 static void draw_page_cairo(GtkPrintContext *context, PrintData *data)
 {
   cairo_t         *cr;
-  GdkPixbuf       *pixbuf_to_draw; 
-  cairo_surface_t *surface;
-  guchar          *surface_pixels;
-  guchar          *pixbuf_pixels;
-  gint             stride;
-  gint             pixbuf_stride;
-  gint             pixbuf_n_channels;
   gdouble          cr_dpi_x;
   gdouble          cr_dpi_y;
   gdouble          scale_x;
   gdouble          scale_y;
-  gint             y;
 
   cr = gtk_print_context_get_cairo_context(context);
-  pixbuf_to_draw = gdk_pixbuf_get_from_drawable(NULL,
-                               GDK_DRAWABLE(vik_viewport_get_pixmap(data->vvp)),
-                               NULL, 0, 0, 0, 0, data->width, data->height);
-  surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
-                                       data->width, data->height);
-  
+
   cr_dpi_x  = gtk_print_context_get_dpi_x  (context);
   cr_dpi_y  = gtk_print_context_get_dpi_y  (context);
 
-  scale_x = cr_dpi_x / data->xres;
-  scale_y = cr_dpi_y / data->yres;
+  gint factor = print_detail_factor(data, MIN(cr_dpi_x, cr_dpi_y));
+  gint width = data->width * factor;
+  gint height = data->height * factor;
+  gint band_height = CLAMP(PRINT_BAND_PIXELS / width, 1, height);
+  gint n_bands = (height + band_height - 1) / band_height;
+
+  scale_x = cr_dpi_x / (data->xres * factor);
+  scale_y = cr_dpi_y / (data->yres * factor);
 
   cairo_translate (cr,
                    data->offset_x / cr_dpi_x * 72.0,
                    data->offset_y / cr_dpi_y * 72.0);
   cairo_scale (cr, scale_x, scale_y);
 
-  surface_pixels = cairo_image_surface_get_data (surface);
-  stride = cairo_image_surface_get_stride (surface);
-  pixbuf_pixels = gdk_pixbuf_get_pixels (pixbuf_to_draw);
-  pixbuf_stride = gdk_pixbuf_get_rowstride(pixbuf_to_draw);
-  pixbuf_n_channels = gdk_pixbuf_get_n_channels(pixbuf_to_draw);
-
-  // fprintf(stderr, "DEBUG: %s() surface_pixels=%p pixbuf_pixels=%p size=%d surface_width=%d surface_height=%d stride=%d data_height=%d pixmap_stride=%d pixmap_nchannels=%d pixmap_bit_per_Sample=%d\n", __PRETTY_FUNCTION__, surface_pixels, pixbuf_pixels, stride * data->height, cairo_image_surface_get_width(surface), cairo_image_surface_get_height(surface), stride, data->height, gdk_pixbuf_get_rowstride(pixbuf_to_draw), gdk_pixbuf_get_n_channels(pixbuf_to_draw), gdk_pixbuf_get_bits_per_sample(pixbuf_to_draw));
-
-  /* Assume the pixbuf has 8 bits per channel */
-  for (y = 0; y < data->height; y++, surface_pixels += stride, pixbuf_pixels += pixbuf_stride) {
-    switch (pixbuf_n_channels) {
-      case 3:
-        copy_row_from_rgb (surface_pixels, pixbuf_pixels, data->width);
-        break;
-      case 4:
-        copy_row_from_rgba (surface_pixels, pixbuf_pixels, data->width);
-        break;
-      default: break;
-    }
+  GtkWidget *window = NULL;
+  VikViewport *vvp = data->vvp;
+  VikAggregateLayer *top = NULL;
+  VikCoord *centers = NULL;
+  if (factor > 1) {
+    vvp = print_viewport_new(data, factor, width, band_height, &window);
+    top = vik_layers_panel_get_top_layer(vik_window_layers_panel(data->vw));
+    /* Work out where each band is whilst the viewport is at the middle of the page */
+    centers = g_new(VikCoord, n_bands);
+    for (gint nn = 0; nn < n_bands; nn++)
+      vik_viewport_screen_to_coord(vvp, width/2, band_height/2 + nn*band_height + band_height/2 - height/2, &centers[nn]);
   }
+  g_debug("%s: %d x %d in %d bands", __FUNCTION__, width, height, n_bands);
+
+  /* Drawing has to stay in this thread, but each band is converted by the task workers
+     whilst the following band is drawn */
+  VikTaskGroup *group = a_background_tasks_new();
+  PrintBand *bands = g_new0(PrintBand, n_bands);
+
+  for (gint nn = 0; nn < n_bands; nn++) {
+    PrintBand *band = &bands[nn];
+    band->y = nn * band_height;
+    band->height = MIN(band_height, height - band->y);
+
+    gint src_y = band->y;
+    if (factor > 1) {
+      vik_viewport_set_center_coord(vvp, &centers[nn], FALSE);
+      vik_viewport_clear(vvp);
+      vik_aggregate_layer_draw(top, vvp);
+      /* Map tiles are loaded in the background, so draw again once they are available */
+      if (print_maps_loading()) {
+        gint64 end_time = g_get_monotonic_time() + PRINT_LOAD_WAIT_MAX * G_USEC_PER_SEC;
+        while (print_maps_loading() && g_get_monotonic_time() < end_time) {
+          while (gtk_events_pending())
+            gtk_main_iteration();
+          g_usleep(G_USEC_PER_SEC / 50);
+        }
+        vik_viewport_clear(vvp);
+        vik_aggregate_layer_draw(top, vvp);
+      }
+      src_y = 0;
+    }
 
-  g_object_unref(G_OBJECT(pixbuf_to_draw));
+    band->pixbuf = gdk_pixbuf_get_from_drawable(NULL, GDK_DRAWABLE(vik_viewport_get_pixmap(vvp)),
+                                                NULL, 0, src_y, 0, 0, width, band->height);
+    if (!band->pixbuf) {
+      g_warning("%s: Failed to get band %d of %d x %d", __FUNCTION__, nn, width, band->height);
+      band->failed = TRUE;
+    }
+    else
+      a_background_tasks_add(group, (GFunc)print_band_convert, band, NULL);
 
-  cairo_set_source_surface(cr, surface, 0, 0);
-  cairo_rectangle(cr, 0, 0, data->width, data->height);
-  cairo_fill(cr);
-  cairo_surface_destroy(surface);
+    /* Meanwhile put the previous band on the page, which only then can be freed */
+    if (nn > 0)
+      print_band_paint(cr, group, &bands[nn-1], width);
+  }
+  if (n_bands > 0)
+    print_band_paint(cr, group, &bands[n_bands-1], width);
+
+  a_background_tasks_free(group);
+  g_free(bands);
+  g_free(centers);
+  if (window)
+    gtk_widget_destroy(window);
 }
 
 static void draw_page(GtkPrintOperation *print,
@@ -375,6 +537,11 @@ static void full_page_toggled_cb (GtkWidget *widget, CustomWidgetInfo *pinfo)
                                         active);
 }
 
+static void high_res_toggled_cb (GtkWidget *widget, CustomWidgetInfo *pinfo)
+{
+  pinfo->data->high_res = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
+}
+
 static void set_center_none (CustomWidgetInfo *info)
 {
   info->data->center = VIK_PRINT_CENTER_NONE;
@@ -600,6 +767,16 @@ static GtkWidget *create_custom_widget_cb(GtkPrintOperation *operation, PrintDat
                     G_CALLBACK (full_page_toggled_cb),
                     info);
 
+  /* draw the map in more detail */
+  button = gtk_check_button_new_with_mnemonic (_("Draw at Printer _Resolution"));
+  gtk_widget_set_tooltip_text (button, _("Draw the map again with as much detail as the printer can show, rather than printing it as shown on the screen. Lines and text are then finer too."));
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (button),
+                                data->high_res);
+  gtk_box_pack_start (GTK_BOX (main_vbox), button, FALSE, FALSE, 0);
+  g_signal_connect (button, "toggled",
+                    G_CALLBACK (high_res_toggled_cb),
+                    info);
+
   /* scale */
   vbox = gtk_vbox_new (FALSE, 1);
   gtk_box_pack_start (GTK_BOX (main_vbox), vbox, FALSE, FALSE, 0);
@@ -0,0 +1,258 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "viking.h"
+#include "renderbench.h"
+#include "mapcache.h"
+#include "vikmapslayer.h"
+
+/**
+ * The script is a list of views, one per line, each of which is drawn as a frame:
+ *  view               - draw the current view again
+ *  pan DX DY          - move by a fraction of the viewport width and height
+ *  zoom in|out|MPP    - zoom by a step, or to the given metres per pixel
+ *  mode utm|expedia|mercator|latlon
+ *  goto LAT LON       - centre on a position
+ *  size W H           - change the size of the drawing area
+ * Blank lines and lines starting with # are ignored.
+ *
+ * The default starts from the view stored in the file, drawing it twice to show the effect of the caches.
+ */
+static const gchar *default_script =
+  "view\n"
+  "view\n"
+  "pan 0.5 0\n"
+  "pan 0 0.5\n"
+  "pan -0.5 -0.5\n"
+  "zoom in\n"
+  "zoom out\n"
+  "zoom out\n"
+  "zoom in\n"
+  "mode mercator\n"
+  "mode latlon\n"
+  "mode utm\n"
+  "size 1920 1080\n";
+
+#define DEFAULT_WIDTH 1024
+#define DEFAULT_HEIGHT 768
+
+/**
+ * Apply one line of the script to the viewport
+ *
+ * Returns: FALSE if the line is not understood
+ */
+static gboolean apply_view ( VikViewport *vvp, VikAggregateLayer *top, gchar **args )
+{
+  guint nargs = g_strv_length ( args );
+  if ( nargs == 1 && g_strcmp0 ( args[0], "view" ) == 0 )
+    return TRUE;
+
+  if ( nargs == 3 && g_strcmp0 ( args[0], "pan" ) == 0 ) {
+    gint width = vik_viewport_get_width ( vvp );
+    gint height = vik_viewport_get_height ( vvp );
+    vik_viewport_set_center_screen ( vvp,
+                                     width/2 + (gint)(g_ascii_strtod(args[1], NULL) * width),
+                                     height/2 + (gint)(g_ascii_strtod(args[2], NULL) * height) );
+    return TRUE;
+  }
+
+  if ( nargs == 2 && g_strcmp0 ( args[0], "zoom" ) == 0 ) {
+    if ( g_strcmp0 ( args[1], "in" ) == 0 )
+      vik_viewport_zoom_in ( vvp );
+    else if ( g_strcmp0 ( args[1], "out" ) == 0 )
+      vik_viewport_zoom_out ( vvp );
+    else {
+      gdouble mpp = g_ascii_strtod ( args[1], NULL );
+      if ( mpp <= 0.0 )
+        return FALSE;
+      vik_viewport_set_zoom ( vvp, mpp );
+    }
+    return TRUE;
+  }
+
+  if ( nargs == 2 && g_strcmp0 ( args[0], "mode" ) == 0 ) {
+    VikViewportDrawMode drawmode;
+    if ( g_strcmp0 ( args[1], "utm" ) == 0 )
+      drawmode = VIK_VIEWPORT_DRAWMODE_UTM;
+    else if ( g_strcmp0 ( args[1], "expedia" ) == 0 )
+      drawmode = VIK_VIEWPORT_DRAWMODE_EXPEDIA;
+    else if ( g_strcmp0 ( args[1], "mercator" ) == 0 )
+      drawmode = VIK_VIEWPORT_DRAWMODE_MERCATOR;
+    else if ( g_strcmp0 ( args[1], "latlon" ) == 0 )
+      drawmode = VIK_VIEWPORT_DRAWMODE_LATLON;
+    else
+      return FALSE;
+
+    // As per the window, the layers follow the coordinate mode of the viewport
+    VikViewportDrawMode olddrawmode = vik_viewport_get_drawmode ( vvp );
+    vik_viewport_set_drawmode ( vvp, drawmode );
+    if ( drawmode == VIK_VIEWPORT_DRAWMODE_UTM && olddrawmode != drawmode )
+      vik_layer_change_coord_mode ( VIK_LAYER(top), VIK_COORD_UTM );
+    else if ( olddrawmode == VIK_VIEWPORT_DRAWMODE_UTM && olddrawmode != drawmode )
+      vik_layer_change_coord_mode ( VIK_LAYER(top), VIK_COORD_LATLON );
+    return TRUE;
+  }
+
+  if ( nargs == 3 && g_strcmp0 ( args[0], "goto" ) == 0 ) {
+    struct LatLon ll = { g_ascii_strtod(args[1], NULL), g_ascii_strtod(args[2], NULL) };
+    vik_viewport_set_center_latlon ( vvp, &ll, FALSE );
+    return TRUE;
+  }
+
+  if ( nargs == 3 && g_strcmp0 ( args[0], "size" ) == 0 ) {
+    gint width = atoi ( args[1] );
+    gint height = atoi ( args[2] );
+    if ( width < 1 || height < 1 )
+      return FALSE;
+    vik_viewport_configure_manually ( vvp, width, height );
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/**
+ * Ensure all the map layers only draw what is already available,
+ *  since downloads would make the timings meaningless
+ *  (and need an actual window for their progress)
+ */
+static void disable_autodownload ( VikAggregateLayer *val )
+{
+  GList *layers = vik_aggregate_layer_get_all_layers_of_type ( val, NULL, VIK_LAYER_MAPS, TRUE );
+  for ( GList *iter = layers; iter; iter = iter->next )
+    vik_maps_layer_set_autodownload ( VIK_MAPS_LAYER(iter->data), FALSE );
+  g_list_free ( layers );
+}
+
+/**
+ * Draw each of the top level layers as per vik_aggregate_layer_draw(),
+ *  but timing each one
+ */
+static void draw_frame ( VikViewport *vvp, VikAggregateLayer *top, guint frame, const gchar *view )
+{
+  mapcache_stats_t before, after;
+  a_mapcache_get_stats ( &before );
+
+  gint64 frame_start = g_get_monotonic_time ();
+  vik_viewport_clear ( vvp );
+
+  printf ( "%s\n    { \"frame\": %u, \"view\": \"%s\", \"width\": %d, \"height\": %d, \"layers\": [",
+           frame ? "," : "", frame, view, vik_viewport_get_width(vvp), vik_viewport_get_height(vvp) );
+
+  gboolean first = TRUE;
+  for ( const GList *iter = vik_aggregate_layer_get_children ( top ); iter; iter = iter->next ) {
+    VikLayer *vl = VIK_LAYER(iter->data);
+    if ( !vl->visible )
+      continue;
+    gint64 start = g_get_monotonic_time ();
+    vik_layer_draw ( vl, vvp );
+    // Include the time for the X server to actually do the drawing
+    gdk_flush ();
+    gint64 took = g_get_monotonic_time () - start;
+
+    gchar *name = g_strescape ( vik_layer_get_name(vl) ? vik_layer_get_name(vl) : "", NULL );
+    printf ( "%s\n      { \"name\": \"%s\", \"type\": \"%s\", \"ms\": %.3f }",
+             first ? "" : ",", name, vik_layer_get_interface(vl->type)->fixed_layer_name, took / 1000.0 );
+    g_free ( name );
+    first = FALSE;
+  }
+
+  gint64 frame_took = g_get_monotonic_time () - frame_start;
+  a_mapcache_get_stats ( &after );
+  guint64 hits = after.hits - before.hits;
+  guint64 misses = after.misses - before.misses;
+
+  printf ( "\n      ],\n      \"total_ms\": %.3f, \"mapcache_hits\": %" G_GUINT64_FORMAT ", \"mapcache_misses\": %" G_GUINT64_FORMAT ", \"mapcache_hit_rate\": %.3f }",
+           frame_took / 1000.0, hits, misses, (hits + misses) ? (gdouble)hits / (hits + misses) : 0.0 );
+  fflush ( stdout );
+}
+
+gboolean a_render_benchmark ( const gchar *filename, const gchar *script )
+{
+  gchar *contents = NULL;
+  if ( script ) {
+    GError *error = NULL;
+    if ( !g_file_get_contents ( script, &contents, NULL, &error ) ) {
+      g_critical ( "%s: %s", __FUNCTION__, error->message );
+      g_error_free ( error );
+      return FALSE;
+    }
+  }
+
+  // The viewport needs a realized (but not shown) window to create its drawing buffers
+  GtkWidget *window = gtk_window_new ( GTK_WINDOW_TOPLEVEL );
+  VikViewport *vvp = vik_viewport_new ();
+  gtk_container_add ( GTK_CONTAINER(window), GTK_WIDGET(vvp) );
+  gtk_widget_realize ( GTK_WIDGET(vvp) );
+  (void)vik_viewport_configure ( vvp );
+  vik_viewport_configure_manually ( vvp, DEFAULT_WIDTH, DEFAULT_HEIGHT );
+
+  gint64 start = g_get_monotonic_time ();
+  VikAggregateLayer *top = vik_aggregate_layer_new ();
+  VikLoadType_t lt = a_file_load ( top, vvp, NULL, filename, TRUE, FALSE, NULL );
+  gint64 load_took = g_get_monotonic_time () - start;
+
+  gboolean ans = lt >= LOAD_TYPE_OTHER_FAILURE_NON_FATAL;
+  if ( !ans )
+    g_critical ( "%s: could not open %s", __FUNCTION__, filename );
+  else {
+    disable_autodownload ( top );
+
+    gchar *fn = g_strescape ( filename, NULL );
+    printf ( "{\n  \"file\": \"%s\",\n  \"load_ms\": %.3f,\n  \"frames\": [", fn, load_took / 1000.0 );
+    g_free ( fn );
+
+    gchar **lines = g_strsplit ( contents ? contents : default_script, "\n", -1 );
+    guint frame = 0;
+    for ( guint nn = 0; lines[nn]; nn++ ) {
+      gchar *line = g_strstrip ( lines[nn] );
+      if ( line[0] == '\0' || line[0] == '#' )
+        continue;
+      gchar **args = g_strsplit_set ( line, " \t", -1 );
+      // Remove empty entries from repeated separators
+      guint kept = 0;
+      for ( guint aa = 0; args[aa]; aa++ ) {
+        if ( args[aa][0] )
+          args[kept++] = args[aa];
+        else
+          g_free ( args[aa] );
+      }
+      args[kept] = NULL;
+
+      if ( apply_view ( vvp, top, args ) ) {
+        gchar *view = g_strescape ( line, NULL );
+        draw_frame ( vvp, top, frame++, view );
+        g_free ( view );
+      }
+      else
+        g_warning ( "%s: ignoring line %d of the script: %s", __FUNCTION__, nn+1, line );
+      g_strfreev ( args );
+    }
+    g_strfreev ( lines );
+
+    printf ( "\n  ]\n}\n" );
+  }
+
+  g_object_unref ( top );
+  gtk_widget_destroy ( window );
+  g_free ( contents );
+  return ans;
+}
@@ -0,0 +1,33 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_RENDERBENCH_H
+#define __VIKING_RENDERBENCH_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Load a file and draw it offscreen for each view of the script (or a default sequence when NULL),
+//  writing the time taken by each layer and the map cache hit rate as JSON to stdout
+gboolean a_render_benchmark ( const gchar *filename, const gchar *script );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,1441 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <glib/gstdio.h>
+#include <glib/gi18n.h>
+#include "routegraph.h"
+#include "pbf.h"
+
+/**
+ * SECTION:routegraph
+ * @short_description: Offline routing over an OpenStreetMap road graph
+ *
+ * The roads of an OpenStreetMap PBF extract usable by a profile are converted once into
+ *  a graph file, which is then memory mapped to find routes.
+ *
+ * Only junctions and the ends of roads are vertices of the graph; the nodes between them
+ *  are kept as the shape of each edge. This is typically an order of magnitude fewer vertices
+ *  than nodes, so the A* search has correspondingly less to do.
+ * A coarse grid of the edges passing through each cell finds the roads nearest to the ends of a route.
+ *
+ * The graph file is in the native byte order, it is not meant to be copied between machines.
+ */
+
+#define RG_MAGIC "VikingRouteGraph"
+#define RG_VERSION 1
+#define RG_BYTE_ORDER 0x01020304
+#define RG_NO_VERTEX G_MAXUINT32
+#define RG_SHAPE_REVERSED 0x80000000u
+#define RG_PRED_START 0x80000000u
+
+// Coordinates are stored in units of 1e-7 degrees
+#define RG_SCALE 1e7
+// Limits of the spatial grid cell size
+#define RG_GRID_MIN_CELL 20000
+#define RG_GRID_MAX_CELL 10000000
+// How far from the ends of a route to look for roads, in degrees
+#define RG_SNAP_MAX_DEGREES 0.05
+// Candidate roads this close to the nearest (in metres) are also used; e.g. the other direction of a road
+#define RG_SNAP_TOLERANCE 1.0
+#define RG_SNAP_MAX 8
+
+#define RG_FORWARD 1
+#define RG_BACKWARD 2
+
+typedef struct {
+  gchar magic[16];
+  guint32 byte_order;
+  guint32 version;
+  guint32 profile;
+  guint32 n_vertices;
+  guint32 n_edges;
+  guint32 n_shape;
+  guint32 grid_cols;
+  guint32 grid_rows;
+  guint32 n_grid_edges;
+  gint32 grid_lat;    // South west corner of the grid
+  gint32 grid_lon;
+  gint32 grid_cell;   // Size of each cell
+  gfloat max_speed;   // Of the fastest edge in metres per second, for the estimate of the remaining cost
+} RgHeader;
+
+typedef struct {
+  gint32 lat;
+  gint32 lon;
+} RgPoint;
+
+typedef struct {
+  guint32 target;
+  guint32 shape;      // Index of the points between the vertices in the shape array
+  guint32 n_shape;    // Flagged with RG_SHAPE_REVERSED when the points are used backwards
+  guint32 length;     // Decimetres
+  guint32 cost;       // Milliseconds
+} RgEdge;
+
+struct _RouteGraph {
+  GMappedFile *mf;
+  const RgHeader *header;
+  const RgPoint *vertices;
+  const guint32 *first_edge; // Edges of vertex v are from first_edge[v] up to first_edge[v+1]
+  const RgEdge *edges;
+  const RgPoint *shape;
+  const guint32 *grid_first; // Edges of cell c are from grid_first[c] up to grid_first[c+1]
+  const guint32 *grid_edges;
+
+  // Search state, kept between searches since it is the size of the graph
+  GMutex mutex;
+  guint32 *cost;
+  guint32 *pred;             // Edge the vertex was reached by
+  guint32 *stamp;            // The above are only valid for this search
+  guint32 search;
+};
+
+GQuark a_route_graph_error_quark ( void )
+{
+  return g_quark_from_static_string ( "viking-route-graph-error-quark" );
+}
+
+static const gchar *profile_names[ROUTE_GRAPH_NUM_PROFILES] = { "car", "bicycle", "foot" };
+
+/**
+ * a_route_graph_profile_from_name:
+ * @name: "car", "bicycle" or "foot"
+ *
+ * Returns: FALSE if the name is not recognized
+ */
+gboolean a_route_graph_profile_from_name ( const gchar *name, RouteGraphProfile *profile )
+{
+  for ( guint ii = 0; name && ii < ROUTE_GRAPH_NUM_PROFILES; ii++ )
+    if ( g_ascii_strcasecmp ( name, profile_names[ii] ) == 0 ) {
+      *profile = ii;
+      return TRUE;
+    }
+  return FALSE;
+}
+
+/*
+ * Road types and their speeds
+ */
+
+typedef struct {
+  const gchar *highway;
+  guint8 speed[ROUTE_GRAPH_NUM_PROFILES]; // Typical km/h, 0 when not usable unless tagged as allowed
+} HighwayT;
+
+static const HighwayT highways[] = {
+  //                       car bicycle foot
+  { "motorway",         { 110,  0,  0 } },
+  { "motorway_link",    {  60,  0,  0 } },
+  { "trunk",            {  85,  0,  0 } },
+  { "trunk_link",       {  50,  0,  0 } },
+  { "primary",          {  65, 16,  5 } },
+  { "primary_link",     {  45, 16,  5 } },
+  { "secondary",        {  55, 17,  5 } },
+  { "secondary_link",   {  40, 17,  5 } },
+  { "tertiary",         {  45, 18,  5 } },
+  { "tertiary_link",    {  35, 18,  5 } },
+  { "unclassified",     {  35, 18,  5 } },
+  { "residential",      {  25, 18,  5 } },
+  { "living_street",    {  10, 12,  5 } },
+  { "service",          {  15, 15,  5 } },
+  { "road",             {  20, 15,  5 } },
+  { "track",            {   0, 12,  5 } },
+  { "cycleway",         {   0, 18,  5 } },
+  { "path",             {   0, 12,  5 } },
+  { "bridleway",        {   0,  0,  5 } },
+  { "footway",          {   0,  0,  5 } },
+  { "pedestrian",       {   0,  0,  5 } },
+  { "steps",            {   0,  0,  3 } },
+};
+
+// For roads tagged as usable by the profile, when not normally so
+static const gdouble fallback_speed[ROUTE_GRAPH_NUM_PROFILES] = { 20, 10, 5 };
+
+// Access keys from the most general to the most specific; only the profile's own keys can allow access
+static const gchar *access_keys[ROUTE_GRAPH_NUM_PROFILES][5] = {
+  { "access", "vehicle", "motor_vehicle", "motorcar", NULL },
+  { "access", "vehicle", "bicycle", NULL },
+  { "access", "foot", NULL },
+};
+static const guint access_first_own[ROUTE_GRAPH_NUM_PROFILES] = { 2, 2, 1 };
+
+typedef struct {
+  const gchar *str;
+  gsize len;
+} StrSliceT;
+
+typedef struct {
+  StrSliceT key;
+  StrSliceT val;
+} TagT;
+
+static gboolean slice_is ( const StrSliceT *slice, const gchar *str )
+{
+  gsize len = strlen ( str );
+  return slice->len == len && memcmp ( slice->str, str, len ) == 0;
+}
+
+static const StrSliceT *tag_get ( const TagT *tags, guint n_tags, const gchar *key )
+{
+  for ( guint ii = 0; ii < n_tags; ii++ )
+    if ( slice_is ( &tags[ii].key, key ) )
+      return &tags[ii].val;
+  return NULL;
+}
+
+static gboolean tag_is_yes ( const StrSliceT *val )
+{
+  return val && ( slice_is ( val, "yes" ) || slice_is ( val, "true" ) || slice_is ( val, "1" ) );
+}
+
+static gboolean access_is_no ( const StrSliceT *val )
+{
+  return slice_is ( val, "no" ) || slice_is ( val, "private" ) || slice_is ( val, "agricultural" ) ||
+         slice_is ( val, "forestry" ) || slice_is ( val, "delivery" ) || slice_is ( val, "use_sidepath" );
+}
+
+/**
+ * Returns: The speed in km/h the profile can use the way at, or 0 if it can not
+ *  with dirs set to the directions it can be used in
+ */
+static gdouble way_speed ( const TagT *tags, guint n_tags, RouteGraphProfile profile, guint *dirs )
+{
+  const StrSliceT *highway = tag_get ( tags, n_tags, "highway" );
+  if ( !highway || tag_is_yes ( tag_get ( tags, n_tags, "area" ) ) )
+    return 0.0;
+
+  gdouble speed = 0.0;
+  for ( guint ii = 0; ii < G_N_ELEMENTS(highways); ii++ )
+    if ( slice_is ( highway, highways[ii].highway ) ) {
+      speed = highways[ii].speed[profile];
+      break;
+    }
+
+  gint allowed = -1;
+  for ( guint ii = 0; access_keys[profile][ii]; ii++ ) {
+    const StrSliceT *val = tag_get ( tags, n_tags, access_keys[profile][ii] );
+    if ( !val )
+      continue;
+    if ( access_is_no ( val ) )
+      allowed = 0;
+    else if ( ii >= access_first_own[profile] )
+      allowed = 1;
+  }
+  if ( allowed == 0 )
+    return 0.0;
+  if ( allowed == 1 && speed == 0.0 )
+    speed = fallback_speed[profile];
+
+  if ( profile == ROUTE_GRAPH_CAR && speed > 0.0 ) {
+    const StrSliceT *maxspeed = tag_get ( tags, n_tags, "maxspeed" );
+    if ( maxspeed && maxspeed->len < 16 ) {
+      gchar buf[16];
+      memcpy ( buf, maxspeed->str, maxspeed->len );
+      buf[maxspeed->len] = '\0';
+      gchar *end;
+      gdouble limit = g_ascii_strtod ( buf, &end );
+      if ( limit > 0.0 && end != buf ) {
+        if ( strstr ( end, "mph" ) )
+          limit *= 1.609344;
+        // Traffic rarely averages the limit
+        speed = limit * 0.9;
+      }
+    }
+  }
+
+  *dirs = RG_FORWARD | RG_BACKWARD;
+  if ( profile != ROUTE_GRAPH_FOOT ) {
+    const StrSliceT *oneway = tag_get ( tags, n_tags, "oneway" );
+    const StrSliceT *junction = tag_get ( tags, n_tags, "junction" );
+    if ( oneway && tag_is_yes ( oneway ) )
+      *dirs = RG_FORWARD;
+    else if ( oneway && ( slice_is ( oneway, "-1" ) || slice_is ( oneway, "reverse" ) ) )
+      *dirs = RG_BACKWARD;
+    else if ( !oneway && ( slice_is ( highway, "motorway" ) ||
+                           ( junction && ( slice_is ( junction, "roundabout" ) || slice_is ( junction, "circular" ) ) ) ) )
+      *dirs = RG_FORWARD;
+
+    if ( profile == ROUTE_GRAPH_BICYCLE ) {
+      const StrSliceT *oneway_bike = tag_get ( tags, n_tags, "oneway:bicycle" );
+      const StrSliceT *cycleway = tag_get ( tags, n_tags, "cycleway" );
+      if ( ( oneway_bike && slice_is ( oneway_bike, "no" ) ) ||
+           ( cycleway && cycleway->len >= 8 && memcmp ( cycleway->str, "opposite", 8 ) == 0 ) )
+        *dirs = RG_FORWARD | RG_BACKWARD;
+    }
+  }
+  return speed;
+}
+
+/*
+ * Reading the PBF file
+ *
+ * Each block is [4 byte big endian length][BlobHeader][Blob]
+ *  with the Blob holding a (normally zlib compressed) OSMHeader or PrimitiveBlock
+ */
+
+#define PBF_MAX_HEADER (64*1024)
+#define PBF_MAX_BLOB (32*1024*1024)
+
+typedef gboolean (*PbfBlockFunc) ( pbf_t *block, gpointer user_data );
+
+static gboolean read_exactly ( FILE *ff, guint8 *buf, gsize len, const gchar *filename, GError **error )
+{
+  if ( fread ( buf, 1, len, ff ) == len )
+    return TRUE;
+  g_set_error ( error, ROUTE_GRAPH_ERROR, ROUTE_GRAPH_ERROR_INVALID, _("%s is truncated"), filename );
+  return FALSE;
+}
+
+static gboolean check_osm_header ( pbf_t *pb, const gchar *filename, GError **error )
+{
+  guint field, wire;
+  while ( pbf_next ( pb, &field, &wire ) ) {
+    if ( field == 4 ) {
+      // Required features
+      gchar *feature = pbf_string ( pb, wire );
+      if ( feature && g_strcmp0 ( feature, "OsmSchema-V0.6" ) && g_strcmp0 ( feature, "DenseNodes" ) ) {
+        g_set_error ( error, ROUTE_GRAPH_ERROR, ROUTE_GRAPH_ERROR_INVALID, _("%s requires the unsupported feature %s"), filename, feature );
+        g_free ( feature );
+        return FALSE;
+      }
+      g_free ( feature );
+    }
+    else
+      pbf_skip ( pb, wire );
+  }
+  return TRUE;
+}
+
+/**
+ * Call func for each data block of the PBF file, uncompressed
+ */
+static gboolean pbf_file_foreach_block ( const gchar *filename, PbfBlockFunc func, gpointer user_data, GError **error )
+{
+  FILE *ff = g_fopen ( filename, "rb" );
+  if ( !ff ) {
+    g_set_error ( error, G_FILE_ERROR, g_file_error_from_errno(errno), _("Could not open %s: %s"), filename, g_strerror(errno) );
+    return FALSE;
+  }
+
+  gboolean ok = TRUE;
+  guint8 *buf = NULL;
+  while ( ok ) {
+    guint8 len_buf[4];
+    gsize nn = fread ( len_buf, 1, 4, ff );
+    if ( nn == 0 && feof ( ff ) )
+      break;
+    if ( !(ok = (nn == 4)) ) {
+      g_set_error ( error, ROUTE_GRAPH_ERROR, ROUTE_GRAPH_ERROR_INVALID, _("%s is truncated"), filename );
+      break;
+    }
+    guint32 header_len = (guint32)len_buf[0] << 24 | (guint32)len_buf[1] << 16 | (guint32)len_buf[2] << 8 | len_buf[3];
+    if ( !(ok = (header_len <= PBF_MAX_HEADER)) ) {
+      g_set_error ( error, ROUTE_GRAPH_ERROR, ROUTE_GRAPH_ERROR_INVALID, _("%s is not an OpenStreetMap PBF file"), filename );
+      break;
+    }
+    guint8 header_buf[PBF_MAX_HEADER];
+    if ( !(ok = read_exactly ( ff, header_buf, header_len, filename, error )) )
+      break;
+
+    // BlobHeader
+    pbf_t pb = { header_buf, header_buf + header_len, FALSE };
+    guint field, wire;
+    guint64 val;
+    gchar *type = NULL;
+    guint64 data_size = 0;
+    while ( pbf_next ( &pb, &field, &wire ) ) {
+      if ( field == 1 && !type )
+        type = pbf_string ( &pb, wire );
+      else if ( field == 3 && wire == PBF_WIRE_VARINT && pbf_varint ( &pb, &val ) )
+        data_size = val;
+      else
+        pbf_skip ( &pb, wire );
+    }
+    if ( !(ok = (!pb.bad && type && data_size <= PBF_MAX_BLOB)) ) {
+      g_set_error ( error, ROUTE_GRAPH_ERROR, ROUTE_GRAPH_ERROR_INVALID, _("%s is not an OpenStreetMap PBF file"), filename );
+      g_free ( type );
+      break;
+    }
+    buf = g_realloc ( buf, MAX(1, data_size) );
+    if ( !(ok = read_exactly ( ff, buf, data_size, filename, error )) ) {
+      g_free ( type );
+      break;
+    }
+    gboolean is_data = g_strcmp0 ( type, "OSMData" ) == 0;
+    gboolean is_header = g_strcmp0 ( type, "OSMHeader" ) == 0;
+    g_free ( type );
+    if ( !is_data && !is_header )
+      continue; // Unknown blocks are to be skipped
+
+    // Blob
+    pbf_t blob = { buf, buf + data_size, FALSE };
+    pbf_t raw = { NULL, NULL, FALSE };
+    pbf_t zlib = { NULL, NULL, FALSE };
+    gboolean found = FALSE;
+    gboolean compressed = FALSE;
+    while ( pbf_next ( &blob, &field, &wire ) ) {
+      if ( field == 1 && wire == PBF_WIRE_LENGTH )
+        found = pbf_sub ( &blob, &raw );
+      else if ( field == 3 && wire == PBF_WIRE_LENGTH )
+        found = compressed = pbf_sub ( &blob, &zlib );
+      else
+        pbf_skip ( &blob, wire );
+    }
+    if ( !(ok = (found && !blob.bad)) ) {
+      g_set_error ( error, ROUTE_GRAPH_ERROR, ROUTE_GRAPH_ERROR_INVALID, _("%s uses an unsupported compression"), filename );
+      break;
+    }
+
+    GBytes *bytes = NULL;
+    pbf_t block = raw;
+    if ( compressed ) {
+      if ( !(bytes = pbf_inflate ( zlib.pos, zlib.end - zlib.pos, G_ZLIB_COMPRESSOR_FORMAT_ZLIB, error )) ) {
+        ok = FALSE;
+        break;
+      }
+      gsize size;
+      block.pos = g_bytes_get_data ( bytes, &size );
+      block.end = block.pos + size;
+      block.bad = FALSE;
+    }
+
+    if ( is_header )
+      ok = check_osm_header ( &block, filename, error );
+    else if ( !(ok = func ( &block, user_data )) )
+      g_set_error ( error, ROUTE_GRAPH_ERROR, ROUTE_GRAPH_ERROR_INVALID, _("%s has an invalid data block"), filename );
+    if ( bytes )
+      g_bytes_unref ( bytes );
+  }
+
+  g_free ( buf );
+  fclose ( ff );
+  return ok;
+}
+
+/*
+ * Building the graph
+ */
+
+typedef struct {
+  guint32 first_ref;
+  guint32 n_refs;
+  gfloat speed;       // km/h
+  guint8 dirs;
+} WayT;
+
+typedef struct {
+  guint32 source;
+  RgEdge edge;
+} BuildEdgeT;
+
+typedef struct {
+  guint32 cell;
+  guint32 edge;
+} CellEdgeT;
+
+typedef struct {
+  RouteGraphProfile profile;
+  // Per block
+  GArray *strings;    // StrSliceT
+  gint64 granularity;
+  gint64 lat_offset;
+  gint64 lon_offset;
+  GArray *keys;       // guint32
+  GArray *vals;       // guint32
+  GArray *tags;       // TagT
+
+  GArray *ways;       // WayT
+  GArray *refs;       // gint64 node ids of the ways
+  gint64 *ids;        // Sorted ids of the nodes used
+  guint8 *uses;       // How many times each node is used (saturating), with the ends of ways counting twice
+  RgPoint *coords;
+  guint8 *has_coord;
+  guint32 n_ids;
+  guint32 *vertex_of;
+
+  RgHeader header;
+  GArray *vertices;   // RgPoint
+  GArray *edges;      // BuildEdgeT, then RgEdge once sorted
+  GArray *shape;      // RgPoint
+  guint32 *first_edge;
+  guint32 *grid_first;
+  GArray *grid_edges; // guint32
+} BuildT;
+
+static gint64 find_node ( BuildT *bd, gint64 id )
+{
+  gint64 lo = 0, hi = (gint64)bd->n_ids - 1;
+  while ( lo <= hi ) {
+    gint64 mid = (lo + hi) / 2;
+    if ( bd->ids[mid] < id )
+      lo = mid + 1;
+    else if ( bd->ids[mid] > id )
+      hi = mid - 1;
+    else
+      return mid;
+  }
+  return -1;
+}
+
+static void parse_way ( BuildT *bd, pbf_t *pb )
+{
+  guint field, wire;
+  guint64 val;
+  pbf_t refs = { NULL, NULL, FALSE };
+  g_array_set_size ( bd->keys, 0 );
+  g_array_set_size ( bd->vals, 0 );
+  while ( pbf_next ( pb, &field, &wire ) ) {
+    if ( field == 2 )
+      pbf_append_uint32s ( pb, wire, bd->keys );
+    else if ( field == 3 )
+      pbf_append_uint32s ( pb, wire, bd->vals );
+    else if ( field == 8 && wire == PBF_WIRE_LENGTH )
+      (void)pbf_sub ( pb, &refs );
+    else
+      pbf_skip ( pb, wire );
+  }
+  if ( bd->keys->len != bd->vals->len || !refs.pos )
+    return;
+
+  g_array_set_size ( bd->tags, bd->keys->len );
+  for ( guint ii = 0; ii < bd->keys->len; ii++ ) {
+    guint32 key = g_array_index ( bd->keys, guint32, ii );
+    guint32 value = g_array_index ( bd->vals, guint32, ii );
+    if ( key >= bd->strings->len || value >= bd->strings->len )
+      return;
+    TagT *tag = &g_array_index ( bd->tags, TagT, ii );
+    tag->key = g_array_index ( bd->strings, StrSliceT, key );
+    tag->val = g_array_index ( bd->strings, StrSliceT, value );
+  }
+
+  guint dirs = 0;
+  gdouble speed = way_speed ( (TagT*)bd->tags->data, bd->tags->len, bd->profile, &dirs );
+  if ( speed <= 0.0 )
+    return;
+
+  WayT way = { bd->refs->len, 0, speed, dirs };
+  gint64 id = 0;
+  while ( refs.pos < refs.end && pbf_varint ( &refs, &val ) ) {
+    id += zigzag64 ( val );
+    g_array_append_val ( bd->refs, id );
+  }
+  way.n_refs = bd->refs->len - way.first_ref;
+  if ( way.n_refs < 2 )
+    g_array_set_size ( bd->refs, way.first_ref );
+  else
+    g_array_append_val ( bd->ways, way );
+}
+
+static void store_node ( BuildT *bd, gint64 id, gint64 lat, gint64 lon )
+{
+  gint64 idx = find_node ( bd, id );
+  if ( idx < 0 )
+    return;
+  // Nanodegrees to the graph's units
+  bd->coords[idx].lat = (gint32)floor ( (bd->lat_offset + bd->granularity * lat) / 100.0 + 0.5 );
+  bd->coords[idx].lon = (gint32)floor ( (bd->lon_offset + bd->granularity * lon) / 100.0 + 0.5 );
+  bd->has_coord[idx] = 1;
+}
+
+static void parse_node ( BuildT *bd, pbf_t *pb )
+{
+  guint field, wire;
+  guint64 val;
+  gint64 id = 0, lat = 0, lon = 0;
+  while ( pbf_next ( pb, &field, &wire ) ) {
+    if ( wire == PBF_WIRE_VARINT && field == 1 && pbf_varint ( pb, &val ) )
+      id = zigzag64 ( val );
+    else if ( wire == PBF_WIRE_VARINT && field == 8 && pbf_varint ( pb, &val ) )
+      lat = zigzag64 ( val );
+    else if ( wire == PBF_WIRE_VARINT && field == 9 && pbf_varint ( pb, &val ) )
+      lon = zigzag64 ( val );
+    else
+      pbf_skip ( pb, wire );
+  }
+  if ( !pb->bad )
+    store_node ( bd, id, lat, lon );
+}
+
+static void parse_dense_nodes ( BuildT *bd, pbf_t *pb )
+{
+  guint field, wire;
+  pbf_t ids = { NULL, NULL, FALSE };
+  pbf_t lats = { NULL, NULL, FALSE };
+  pbf_t lons = { NULL, NULL, FALSE };
+  while ( pbf_next ( pb, &field, &wire ) ) {
+    if ( wire == PBF_WIRE_LENGTH && field == 1 )
+      (void)pbf_sub ( pb, &ids );
+    else if ( wire == PBF_WIRE_LENGTH && field == 8 )
+      (void)pbf_sub ( pb, &lats );
+    else if ( wire == PBF_WIRE_LENGTH && field == 9 )
+      (void)pbf_sub ( pb, &lons );
+    else
+      pbf_skip ( pb, wire );
+  }
+  // All delta coded
+  guint64 id_val, lat_val, lon_val;
+  gint64 id = 0, lat = 0, lon = 0;
+  while ( ids.pos < ids.end &&
+          pbf_varint ( &ids, &id_val ) && pbf_varint ( &lats, &lat_val ) && pbf_varint ( &lons, &lon_val ) ) {
+    id += zigzag64 ( id_val );
+    lat += zigzag64 ( lat_val );
+    lon += zigzag64 ( lon_val );
+    store_node ( bd, id, lat, lon );
+  }
+}
+
+static gboolean parse_block ( pbf_t *block, BuildT *bd, gboolean ways )
+{
+  guint field, wire;
+  guint64 val;
+  pbf_t pb = *block;
+
+  // First the block wide values, as the groups depend on them
+  g_array_set_size ( bd->strings, 0 );
+  bd->granularity = 100;
+  bd->lat_offset = 0;
+  bd->lon_offset = 0;
+  while ( pbf_next ( &pb, &field, &wire ) ) {
+    if ( field == 1 && wire == PBF_WIRE_LENGTH ) {
+      pbf_t table;
+      if ( !pbf_sub ( &pb, &table ) )
+        break;
+      while ( pbf_next ( &table, &field, &wire ) ) {
+        pbf_t str;
+        if ( field == 1 && wire == PBF_WIRE_LENGTH && pbf_sub ( &table, &str ) ) {
+          StrSliceT slice = { (const gchar*)str.pos, str.end - str.pos };
+          g_array_append_val ( bd->strings, slice );
+        }
+        else
+          pbf_skip ( &table, wire );
+      }
+      if ( table.bad )
+        return FALSE;
+    }
+    else if ( field == 17 && wire == PBF_WIRE_VARINT && pbf_varint ( &pb, &val ) )
+      bd->granularity = val;
+    else if ( field == 19 && wire == PBF_WIRE_VARINT && pbf_varint ( &pb, &val ) )
+      bd->lat_offset = val;
+    else if ( field == 20 && wire == PBF_WIRE_VARINT && pbf_varint ( &pb, &val ) )
+      bd->lon_offset = val;
+    else
+      pbf_skip ( &pb, wire );
+  }
+  if ( pb.bad )
+    return FALSE;
+
+  pb = *block;
+  while ( pbf_next ( &pb, &field, &wire ) ) {
+    pbf_t group;
+    if ( field != 2 || wire != PBF_WIRE_LENGTH ) {
+      pbf_skip ( &pb, wire );
+      continue;
+    }
+    if ( !pbf_sub ( &pb, &group ) )
+      break;
+    while ( pbf_next ( &group, &field, &wire ) ) {
+      pbf_t item;
+      if ( wire != PBF_WIRE_LENGTH ||
+           ( ways && field != 3 ) || ( !ways && field != 1 && field != 2 ) ) {
+        pbf_skip ( &group, wire );
+        continue;
+      }
+      if ( !pbf_sub ( &group, &item ) )
+        break;
+      if ( field == 3 )
+        parse_way ( bd, &item );
+      else if ( field == 2 )
+        parse_dense_nodes ( bd, &item );
+      else
+        parse_node ( bd, &item );
+    }
+    if ( group.bad )
+      return FALSE;
+  }
+  return !pb.bad;
+}
+
+static gboolean ways_cb ( pbf_t *block, gpointer user_data )
+{
+  return parse_block ( block, (BuildT*)user_data, TRUE );
+}
+
+static gboolean nodes_cb ( pbf_t *block, gpointer user_data )
+{
+  return parse_block ( block, (BuildT*)user_data, FALSE );
+}
+
+static gint compare_ids ( gconstpointer a, gconstpointer b )
+{
+  gint64 aa = *(const gint64*)a;
+  gint64 bb = *(const gint64*)b;
+  return aa < bb ? -1 : aa > bb;
+}
+
+/**
+ * The unique node ids used by the ways, and how many times each is used
+ */
+static void build_node_ids ( BuildT *bd )
+{
+  guint n_all = bd->refs->len + 2 * bd->ways->len;
+  gint64 *all = g_malloc ( MAX(1, n_all) * sizeof(gint64) );
+  memcpy ( all, bd->refs->data, bd->refs->len * sizeof(gint64) );
+  guint nn = bd->refs->len;
+  // The ends of each way are always vertices
+  for ( guint ii = 0; ii < bd->ways->len; ii++ ) {
+    WayT *way = &g_array_index ( bd->ways, WayT, ii );
+    all[nn++] = g_array_index ( bd->refs, gint64, way->first_ref );
+    all[nn++] = g_array_index ( bd->refs, gint64, way->first_ref + way->n_refs - 1 );
+  }
+  qsort ( all, n_all, sizeof(gint64), compare_ids );
+
+  bd->ids = g_malloc ( MAX(1, n_all) * sizeof(gint64) );
+  bd->uses = g_malloc ( MAX(1, n_all) );
+  bd->n_ids = 0;
+  for ( guint ii = 0; ii < n_all; ii++ ) {
+    if ( bd->n_ids && bd->ids[bd->n_ids-1] == all[ii] ) {
+      if ( bd->uses[bd->n_ids-1] < G_MAXUINT8 )
+        bd->uses[bd->n_ids-1]++;
+    }
+    else {
+      bd->ids[bd->n_ids] = all[ii];
+      bd->uses[bd->n_ids++] = 1;
+    }
+  }
+  g_free ( all );
+  bd->ids = g_realloc ( bd->ids, MAX(1, bd->n_ids) * sizeof(gint64) );
+  bd->coords = g_malloc ( MAX(1, bd->n_ids) * sizeof(RgPoint) );
+  bd->has_coord = g_malloc0 ( MAX(1, bd->n_ids) );
+}
+
+static void add_edges ( BuildT *bd, guint32 from, guint32 to, guint32 shape, gdouble length, const WayT *way )
+{
+  BuildEdgeT be;
+  be.edge.shape = shape;
+  be.edge.length = (guint32)MIN(G_MAXUINT32, length * 10.0 + 0.5);
+  be.edge.cost = (guint32)MIN(G_MAXUINT32, length / ( way->speed / 3.6 ) * 1000.0 + 0.5);
+  guint32 n_shape = bd->shape->len - shape;
+  if ( way->dirs & RG_FORWARD ) {
+    be.source = from;
+    be.edge.target = to;
+    be.edge.n_shape = n_shape;
+    g_array_append_val ( bd->edges, be );
+  }
+  if ( way->dirs & RG_BACKWARD ) {
+    be.source = to;
+    be.edge.target = from;
+    be.edge.n_shape = n_shape | RG_SHAPE_REVERSED;
+    g_array_append_val ( bd->edges, be );
+  }
+  bd->header.max_speed = MAX(bd->header.max_speed, way->speed / 3.6);
+}
+
+static void point_to_latlon ( const RgPoint *pt, struct LatLon *ll )
+{
+  ll->lat = pt->lat / RG_SCALE;
+  ll->lon = pt->lon / RG_SCALE;
+}
+
+/**
+ * Point ii along the edge, from 0 for its source vertex to n_shape+1 for its target vertex
+ */
+static RgPoint edge_point ( const RgPoint *vertices, const RgPoint *shape, guint32 source, const RgEdge *edge, guint ii )
+{
+  guint n_shape = edge->n_shape & ~RG_SHAPE_REVERSED;
+  if ( ii == 0 )
+    return vertices[source];
+  if ( ii > n_shape )
+    return vertices[edge->target];
+  if ( edge->n_shape & RG_SHAPE_REVERSED )
+    return shape[edge->shape + n_shape - ii];
+  return shape[edge->shape + ii - 1];
+}
+
+/**
+ * Split the ways into edges between the vertices
+ */
+static gboolean build_edges ( BuildT *bd, GError **error )
+{
+  bd->vertex_of = g_malloc ( MAX(1, bd->n_ids) * sizeof(guint32) );
+  for ( guint32 ii = 0; ii < bd->n_ids; ii++ ) {
+    if ( bd->uses[ii] >= 2 && bd->has_coord[ii] ) {
+      bd->vertex_of[ii] = bd->vertices->len;
+      g_array_append_val ( bd->vertices, bd->coords[ii] );
+    }
+    else
+      bd->vertex_of[ii] = RG_NO_VERTEX;
+  }
+
+  for ( guint ii = 0; ii < bd->ways->len; ii++ ) {
+    const WayT *way = &g_array_index ( bd->ways, WayT, ii );
+    guint32 from = RG_NO_VERTEX;
+    guint32 shape = bd->shape->len;
+    gdouble length = 0.0;
+    struct LatLon prev_ll = { 0.0, 0.0 };
+    for ( guint jj = 0; jj < way->n_refs; jj++ ) {
+      gint64 idx = find_node ( bd, g_array_index ( bd->refs, gint64, way->first_ref + jj ) );
+      if ( idx < 0 || !bd->has_coord[idx] ) {
+        // Missing from the extract, so the way is broken here
+        from = RG_NO_VERTEX;
+        g_array_set_size ( bd->shape, shape );
+        continue;
+      }
+      struct LatLon ll;
+      point_to_latlon ( &bd->coords[idx], &ll );
+      if ( from != RG_NO_VERTEX )
+        length += a_coords_latlon_diff_fast ( &prev_ll, &ll );
+      prev_ll = ll;
+
+      guint32 vertex = bd->vertex_of[idx];
+      if ( vertex == RG_NO_VERTEX ) {
+        if ( from != RG_NO_VERTEX )
+          g_array_append_val ( bd->shape, bd->coords[idx] );
+        continue;
+      }
+      if ( from != RG_NO_VERTEX && from != vertex )
+        add_edges ( bd, from, vertex, shape, length, way );
+      else
+        g_array_set_size ( bd->shape, shape ); // Loops back on itself: no use for routing
+      from = vertex;
+      shape = bd->shape->len;
+      length = 0.0;
+    }
+    g_array_set_size ( bd->shape, shape );
+  }
+
+  if ( bd->edges->len >= RG_PRED_START ) {
+    g_set_error ( error, ROUTE_GRAPH_ERROR, ROUTE_GRAPH_ERROR_INVALID, _("Too many roads for a route graph") );
+    return FALSE;
+  }
+
+  // Group the edges by their source vertex
+  guint32 n_vertices = bd->vertices->len;
+  bd->first_edge = g_malloc0 ( (n_vertices + 1) * sizeof(guint32) );
+  for ( guint ii = 0; ii < bd->edges->len; ii++ )
+    bd->first_edge[g_array_index ( bd->edges, BuildEdgeT, ii ).source + 1]++;
+  for ( guint32 ii = 0; ii < n_vertices; ii++ )
+    bd->first_edge[ii+1] += bd->first_edge[ii];
+  guint32 *next = g_memdup ( bd->first_edge, (n_vertices + 1) * sizeof(guint32) );
+  GArray *sorted = g_array_sized_new ( FALSE, FALSE, sizeof(RgEdge), bd->edges->len );
+  g_array_set_size ( sorted, bd->edges->len );
+  for ( guint ii = 0; ii < bd->edges->len; ii++ ) {
+    BuildEdgeT *be = &g_array_index ( bd->edges, BuildEdgeT, ii );
+    g_array_index ( sorted, RgEdge, next[be->source]++ ) = be->edge;
+  }
+  g_free ( next );
+  g_array_free ( bd->edges, TRUE );
+  bd->edges = sorted;
+  return TRUE;
+}
+
+static void add_cell_edge ( GArray *cell_edges, const RgHeader *hdr, const RgPoint *pt, guint32 edge, guint32 *last )
+{
+  guint32 col = MIN(hdr->grid_cols - 1, (guint32)((pt->lon - hdr->grid_lon) / hdr->grid_cell));
+  guint32 row = MIN(hdr->grid_rows - 1, (guint32)((pt->lat - hdr->grid_lat) / hdr->grid_cell));
+  CellEdgeT ce = { row * hdr->grid_cols + col, edge };
+  if ( ce.cell != *last ) {
+    g_array_append_val ( cell_edges, ce );
+    *last = ce.cell;
+  }
+}
+
+/**
+ * Note every cell each edge passes through
+ */
+static void build_grid ( BuildT *bd )
+{
+  RgHeader *hdr = &bd->header;
+  gint32 lat_min = G_MAXINT32, lat_max = G_MININT32, lon_min = G_MAXINT32, lon_max = G_MININT32;
+  for ( guint ii = 0; ii < bd->vertices->len; ii++ ) {
+    RgPoint *pt = &g_array_index ( bd->vertices, RgPoint, ii );
+    lat_min = MIN(lat_min, pt->lat); lat_max = MAX(lat_max, pt->lat);
+    lon_min = MIN(lon_min, pt->lon); lon_max = MAX(lon_max, pt->lon);
+  }
+  for ( guint ii = 0; ii < bd->shape->len; ii++ ) {
+    RgPoint *pt = &g_array_index ( bd->shape, RgPoint, ii );
+    lat_min = MIN(lat_min, pt->lat); lat_max = MAX(lat_max, pt->lat);
+    lon_min = MIN(lon_min, pt->lon); lon_max = MAX(lon_max, pt->lon);
+  }
+  if ( lat_min > lat_max )
+    lat_min = lat_max = lon_min = lon_max = 0;
+
+  // Aim for an edge or two in each cell
+  gdouble area = ((gdouble)lat_max - lat_min + 1) * ((gdouble)lon_max - lon_min + 1);
+  gdouble cell = sqrt ( area / MAX(1, bd->edges->len / 2) );
+  hdr->grid_cell = (gint32)CLAMP(cell, RG_GRID_MIN_CELL, RG_GRID_MAX_CELL);
+  hdr->grid_lat = lat_min;
+  hdr->grid_lon = lon_min;
+  hdr->grid_cols = ((gint64)lon_max - lon_min) / hdr->grid_cell + 1;
+  hdr->grid_rows = ((gint64)lat_max - lat_min) / hdr->grid_cell + 1;
+
+  GArray *cell_edges = g_array_new ( FALSE, FALSE, sizeof(CellEdgeT) );
+  const RgPoint *vertices = (RgPoint*)bd->vertices->data;
+  const RgPoint *shape = (RgPoint*)bd->shape->data;
+  for ( guint32 source = 0; source < bd->vertices->len; source++ ) {
+    for ( guint32 ee = bd->first_edge[source]; ee < bd->first_edge[source+1]; ee++ ) {
+      const RgEdge *edge = &g_array_index ( bd->edges, RgEdge, ee );
+      guint n_points = (edge->n_shape & ~RG_SHAPE_REVERSED) + 2;
+      guint32 last = G_MAXUINT32;
+      RgPoint prev = edge_point ( vertices, shape, source, edge, 0 );
+      add_cell_edge ( cell_edges, hdr, &prev, ee, &last );
+      for ( guint ii = 1; ii < n_points; ii++ ) {
+        RgPoint pt = edge_point ( vertices, shape, source, edge, ii );
+        // Sample often enough along the segment to find every cell it crosses
+        gint64 span = MAX(ABS((gint64)pt.lat - prev.lat), ABS((gint64)pt.lon - prev.lon));
+        gint64 steps = span / (hdr->grid_cell / 2) + 1;
+        for ( gint64 ss = 1; ss <= steps; ss++ ) {
+          RgPoint sample = { prev.lat + ((gint64)pt.lat - prev.lat) * ss / steps,
+                             prev.lon + ((gint64)pt.lon - prev.lon) * ss / steps };
+          add_cell_edge ( cell_edges, hdr, &sample, ee, &last );
+        }
+        prev = pt;
+      }
+    }
+  }
+
+  // Group by cell
+  guint32 n_cells = hdr->grid_cols * hdr->grid_rows;
+  bd->grid_first = g_malloc0 ( (n_cells + 1) * sizeof(guint32) );
+  for ( guint ii = 0; ii < cell_edges->len; ii++ )
+    bd->grid_first[g_array_index ( cell_edges, CellEdgeT, ii ).cell + 1]++;
+  for ( guint32 ii = 0; ii < n_cells; ii++ )
+    bd->grid_first[ii+1] += bd->grid_first[ii];
+  guint32 *next = g_memdup ( bd->grid_first, (n_cells + 1) * sizeof(guint32) );
+  g_array_set_size ( bd->grid_edges, cell_edges->len );
+  for ( guint ii = 0; ii < cell_edges->len; ii++ ) {
+    CellEdgeT *ce = &g_array_index ( cell_edges, CellEdgeT, ii );
+    g_array_index ( bd->grid_edges, guint32, next[ce->cell]++ ) = ce->edge;
+  }
+  g_free ( next );
+  g_array_free ( cell_edges, TRUE );
+}
+
+static gboolean build_write ( BuildT *bd, const gchar *filename, GError **error )
+{
+  RgHeader *hdr = &bd->header;
+  memcpy ( hdr->magic, RG_MAGIC, sizeof(hdr->magic) );
+  hdr->byte_order = RG_BYTE_ORDER;
+  hdr->version = RG_VERSION;
+  hdr->profile = bd->profile;
+  hdr->n_vertices = bd->vertices->len;
+  hdr->n_edges = bd->edges->len;
+  hdr->n_shape = bd->shape->len;
+  hdr->n_grid_edges = bd->grid_edges->len;
+
+  // Write to a temporary file first, so an interrupted build is not mistaken for a graph
+  gchar *tmp_name = g_strconcat ( filename, ".tmp", NULL );
+  FILE *ff = g_fopen ( tmp_name, "wb" );
+  if ( !ff ) {
+    g_set_error ( error, G_FILE_ERROR, g_file_error_from_errno(errno), _("Could not create %s: %s"), tmp_name, g_strerror(errno) );
+    g_free ( tmp_name );
+    return FALSE;
+  }
+  guint32 n_cells = hdr->grid_cols * hdr->grid_rows;
+  gboolean ok = fwrite ( hdr, sizeof(RgHeader), 1, ff ) == 1;
+  ok = ok && fwrite ( bd->vertices->data, sizeof(RgPoint), hdr->n_vertices, ff ) == hdr->n_vertices;
+  ok = ok && fwrite ( bd->first_edge, sizeof(guint32), hdr->n_vertices + 1, ff ) == hdr->n_vertices + 1;
+  ok = ok && fwrite ( bd->edges->data, sizeof(RgEdge), hdr->n_edges, ff ) == hdr->n_edges;
+  ok = ok && fwrite ( bd->shape->data, sizeof(RgPoint), hdr->n_shape, ff ) == hdr->n_shape;
+  ok = ok && fwrite ( bd->grid_first, sizeof(guint32), n_cells + 1, ff ) == n_cells + 1;
+  ok = ok && fwrite ( bd->grid_edges->data, sizeof(guint32), hdr->n_grid_edges, ff ) == hdr->n_grid_edges;
+  if ( fclose ( ff ) != 0 )
+    ok = FALSE;
+  if ( ok && g_rename ( tmp_name, filename ) != 0 )
+    ok = FALSE;
+  if ( !ok ) {
+    g_set_error ( error, G_FILE_ERROR, g_file_error_from_errno(errno), _("Could not write %s: %s"), filename, g_strerror(errno) );
+    (void)g_remove ( tmp_name );
+  }
+  g_free ( tmp_name );
+  return ok;
+}
+
+static void build_free ( BuildT *bd )
+{
+  g_array_free ( bd->strings, TRUE );
+  g_array_free ( bd->keys, TRUE );
+  g_array_free ( bd->vals, TRUE );
+  g_array_free ( bd->tags, TRUE );
+  g_array_free ( bd->ways, TRUE );
+  g_array_free ( bd->refs, TRUE );
+  g_free ( bd->ids );
+  g_free ( bd->uses );
+  g_free ( bd->coords );
+  g_free ( bd->has_coord );
+  g_free ( bd->vertex_of );
+  g_array_free ( bd->vertices, TRUE );
+  g_array_free ( bd->edges, TRUE );
+  g_array_free ( bd->shape, TRUE );
+  g_free ( bd->first_edge );
+  g_free ( bd->grid_first );
+  g_array_free ( bd->grid_edges, TRUE );
+}
+
+/**
+ * a_route_graph_build:
+ * @osm_file: An OpenStreetMap extract in the PBF format
+ * @filename: The graph file to create
+ * @profile:  Which roads are to be included and how fast they are
+ *
+ * The extract is read twice; first for the ways and then for the locations of their nodes,
+ *  so only the nodes on roads need to be held in memory.
+ */
+gboolean a_route_graph_build ( const gchar *osm_file, const gchar *filename, RouteGraphProfile profile, GError **error )
+{
+  g_return_val_if_fail ( profile < ROUTE_GRAPH_NUM_PROFILES, FALSE );
+
+  BuildT bd;
+  memset ( &bd, 0, sizeof(BuildT) );
+  bd.profile = profile;
+  bd.strings = g_array_new ( FALSE, FALSE, sizeof(StrSliceT) );
+  bd.keys = g_array_new ( FALSE, FALSE, sizeof(guint32) );
+  bd.vals = g_array_new ( FALSE, FALSE, sizeof(guint32) );
+  bd.tags = g_array_new ( FALSE, FALSE, sizeof(TagT) );
+  bd.ways = g_array_new ( FALSE, FALSE, sizeof(WayT) );
+  bd.refs = g_array_new ( FALSE, FALSE, sizeof(gint64) );
+  bd.vertices = g_array_new ( FALSE, FALSE, sizeof(RgPoint) );
+  bd.edges = g_array_new ( FALSE, FALSE, sizeof(BuildEdgeT) );
+  bd.shape = g_array_new ( FALSE, FALSE, sizeof(RgPoint) );
+  bd.grid_edges = g_array_new ( FALSE, FALSE, sizeof(guint32) );
+
+  gint64 start = g_get_monotonic_time ();
+  gboolean ok = pbf_file_foreach_block ( osm_file, ways_cb, &bd, error );
+  if ( ok ) {
+    build_node_ids ( &bd );
+    ok = pbf_file_foreach_block ( osm_file, nodes_cb, &bd, error );
+  }
+  ok = ok && build_edges ( &bd, error );
+  if ( ok ) {
+    build_grid ( &bd );
+    ok = build_write ( &bd, filename, error );
+  }
+  if ( ok )
+    g_debug ( "%s: %s has %u ways giving %u vertices and %u edges, built in %.1fs", __FUNCTION__, osm_file,
+              bd.ways->len, bd.vertices->len, bd.edges->len, (g_get_monotonic_time() - start) / (gdouble)G_USEC_PER_SEC );
+  build_free ( &bd );
+  return ok;
+}
+
+/*
+ * Using the graph
+ */
+
+/**
+ * a_route_graph_open:
+ *
+ * Returns: The graph, or NULL with the error set if the file is not a usable graph
+ */
+RouteGraph *a_route_graph_open ( const gchar *filename, GError **error )
+{
+  GMappedFile *mf = g_mapped_file_new ( filename, FALSE, error );
+  if ( !mf )
+    return NULL;
+
+  gsize size = g_mapped_file_get_length ( mf );
+  const gchar *data = g_mapped_file_get_contents ( mf );
+  const RgHeader *hdr = (const RgHeader*)data;
+  if ( size < sizeof(RgHeader) || memcmp ( hdr->magic, RG_MAGIC, sizeof(hdr->magic) ) ||
+       hdr->byte_order != RG_BYTE_ORDER || hdr->version != RG_VERSION ||
+       hdr->profile >= ROUTE_GRAPH_NUM_PROFILES || hdr->grid_cell <= 0 ) {
+    g_set_error ( error, ROUTE_GRAPH_ERROR, ROUTE_GRAPH_ERROR_INVALID, _("%s is not a route graph for this version"), filename );
+    g_mapped_file_unref ( mf );
+    return NULL;
+  }
+  guint64 n_cells = (guint64)hdr->grid_cols * hdr->grid_rows;
+  guint64 expected = sizeof(RgHeader) +
+                     (guint64)hdr->n_vertices * sizeof(RgPoint) +
+                     ((guint64)hdr->n_vertices + 1) * sizeof(guint32) +
+                     (guint64)hdr->n_edges * sizeof(RgEdge) +
+                     (guint64)hdr->n_shape * sizeof(RgPoint) +
+                     (n_cells + 1) * sizeof(guint32) +
+                     (guint64)hdr->n_grid_edges * sizeof(guint32);
+  if ( expected != size ) {
+    g_set_error ( error, ROUTE_GRAPH_ERROR, ROUTE_GRAPH_ERROR_INVALID, _("%s is not a complete route graph"), filename );
+    g_mapped_file_unref ( mf );
+    return NULL;
+  }
+
+  RouteGraph *rg = g_malloc0 ( sizeof(RouteGraph) );
+  rg->mf = mf;
+  rg->header = hdr;
+  data += sizeof(RgHeader);
+  rg->vertices = (const RgPoint*)data;
+  data += hdr->n_vertices * sizeof(RgPoint);
+  rg->first_edge = (const guint32*)data;
+  data += (hdr->n_vertices + 1) * sizeof(guint32);
+  rg->edges = (const RgEdge*)data;
+  data += hdr->n_edges * sizeof(RgEdge);
+  rg->shape = (const RgPoint*)data;
+  data += hdr->n_shape * sizeof(RgPoint);
+  rg->grid_first = (const guint32*)data;
+  data += (n_cells + 1) * sizeof(guint32);
+  rg->grid_edges = (const guint32*)data;
+  g_mutex_init ( &rg->mutex );
+  return rg;
+}
+
+void a_route_graph_free ( RouteGraph *rg )
+{
+  if ( !rg )
+    return;
+  g_mutex_clear ( &rg->mutex );
+  g_free ( rg->cost );
+  g_free ( rg->pred );
+  g_free ( rg->stamp );
+  g_mapped_file_unref ( rg->mf );
+  g_free ( rg );
+}
+
+RouteGraphProfile a_route_graph_get_profile ( RouteGraph *rg )
+{
+  return rg->header->profile;
+}
+
+guint a_route_graph_get_n_vertices ( RouteGraph *rg )
+{
+  return rg->header->n_vertices;
+}
+
+guint a_route_graph_get_n_edges ( RouteGraph *rg )
+{
+  return rg->header->n_edges;
+}
+
+static guint32 edge_source ( RouteGraph *rg, guint32 edge )
+{
+  // The last vertex whose edges start at or before this one
+  guint32 lo = 0, hi = rg->header->n_vertices;
+  while ( hi - lo > 1 ) {
+    guint32 mid = lo + (hi - lo) / 2;
+    if ( rg->first_edge[mid] <= edge )
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+typedef struct {
+  guint32 edge;
+  guint32 source;
+  guint seg;          // The segment of the edge the position is on, numbered by its first point
+  gdouble along;      // Fraction of the edge's length before the position
+  struct LatLon ll;   // Position on the edge
+  gdouble distance;   // Metres from the position wanted
+} SnapT;
+
+static void snap_edge ( RouteGraph *rg, guint32 ee, const struct LatLon *ll, SnapT *snaps, guint *n_snaps )
+{
+  for ( guint ii = 0; ii < *n_snaps; ii++ )
+    if ( snaps[ii].edge == ee )
+      return;
+
+  // Locally flat, in metres from the position wanted
+  const gdouble scale_lat = 111319.49 / RG_SCALE;
+  const gdouble scale_lon = scale_lat * cos ( ll->lat * G_PI / 180.0 );
+  const RgEdge *edge = &rg->edges[ee];
+  guint32 source = edge_source ( rg, ee );
+  guint n_points = (edge->n_shape & ~RG_SHAPE_REVERSED) + 2;
+
+  SnapT best = { ee, source, 0, 0.0, *ll, G_MAXDOUBLE };
+  gdouble best_before = 0.0, before = 0.0;
+  RgPoint pt = edge_point ( rg->vertices, rg->shape, source, edge, 0 );
+  gdouble x1 = (pt.lon - ll->lon * RG_SCALE) * scale_lon;
+  gdouble y1 = (pt.lat - ll->lat * RG_SCALE) * scale_lat;
+  for ( guint ii = 1; ii < n_points; ii++ ) {
+    pt = edge_point ( rg->vertices, rg->shape, source, edge, ii );
+    gdouble x2 = (pt.lon - ll->lon * RG_SCALE) * scale_lon;
+    gdouble y2 = (pt.lat - ll->lat * RG_SCALE) * scale_lat;
+    gdouble dx = x2 - x1, dy = y2 - y1;
+    gdouble seg_len2 = dx*dx + dy*dy;
+    gdouble tt = seg_len2 > 0.0 ? CLAMP(-(x1*dx + y1*dy) / seg_len2, 0.0, 1.0) : 0.0;
+    gdouble px = x1 + tt * dx, py = y1 + tt * dy;
+    gdouble dist = sqrt ( px*px + py*py );
+    gdouble seg_len = sqrt ( seg_len2 );
+    if ( dist < best.distance ) {
+      best.distance = dist;
+      best.seg = ii - 1;
+      best.ll.lat = ll->lat + py / scale_lat / RG_SCALE;
+      best.ll.lon = ll->lon + px / scale_lon / RG_SCALE;
+      best_before = before + tt * seg_len;
+    }
+    before += seg_len;
+    x1 = x2;
+    y1 = y2;
+  }
+  best.along = before > 0.0 ? best_before / before : 0.0;
+
+  // Keep the nearest
+  guint pos = *n_snaps;
+  while ( pos > 0 && snaps[pos-1].distance > best.distance )
+    pos--;
+  if ( pos >= RG_SNAP_MAX )
+    return;
+  if ( *n_snaps < RG_SNAP_MAX )
+    (*n_snaps)++;
+  memmove ( &snaps[pos+1], &snaps[pos], (*n_snaps - pos - 1) * sizeof(SnapT) );
+  snaps[pos] = best;
+}
+
+/**
+ * Find the edges nearest to the position, searching outwards a ring of grid cells at a time
+ *
+ * Returns: The number of edges found
+ */
+static guint snap ( RouteGraph *rg, const struct LatLon *ll, SnapT *snaps )
+{
+  const RgHeader *hdr = rg->header;
+  guint n_snaps = 0;
+  gint64 col = (gint64)floor ( (ll->lon * RG_SCALE - hdr->grid_lon) / hdr->grid_cell );
+  gint64 row = (gint64)floor ( (ll->lat * RG_SCALE - hdr->grid_lat) / hdr->grid_cell );
+  // Nothing in a ring can be nearer than this many metres per ring
+  gdouble ring_metres = hdr->grid_cell / RG_SCALE * 111319.49 * cos ( ll->lat * G_PI / 180.0 );
+  gint max_ring = (gint)ceil ( RG_SNAP_MAX_DEGREES * RG_SCALE / hdr->grid_cell );
+
+  for ( gint ring = 0; ring <= max_ring; ring++ ) {
+    for ( gint64 rr = row - ring; rr <= row + ring; rr++ ) {
+      if ( rr < 0 || rr >= hdr->grid_rows )
+        continue;
+      gboolean edge_row = ( rr == row - ring || rr == row + ring );
+      for ( gint64 cc = col - ring; cc <= col + ring; cc += ( edge_row || ring == 0 ) ? 1 : 2 * ring ) {
+        if ( cc < 0 || cc >= hdr->grid_cols )
+          continue;
+        guint32 cell = rr * hdr->grid_cols + cc;
+        for ( guint32 ii = rg->grid_first[cell]; ii < rg->grid_first[cell+1]; ii++ )
+          snap_edge ( rg, rg->grid_edges[ii], ll, snaps, &n_snaps );
+      }
+    }
+    // An extra ring, since the nearest edge by cell is not necessarily the nearest
+    if ( n_snaps && snaps[0].distance + RG_SNAP_TOLERANCE < ring * ring_metres )
+      break;
+  }
+
+  guint nn = 0;
+  while ( nn < n_snaps && snaps[nn].distance <= snaps[0].distance + RG_SNAP_TOLERANCE )
+    nn++;
+  return nn;
+}
+
+typedef struct {
+  guint32 key;        // Cost so far plus the estimate of the rest
+  guint32 cost;
+  guint32 vertex;
+} HeapItemT;
+
+static void heap_push ( GArray *heap, HeapItemT *item )
+{
+  g_array_append_val ( heap, *item );
+  HeapItemT *items = (HeapItemT*)heap->data;
+  guint pos = heap->len - 1;
+  while ( pos > 0 && items[(pos-1)/2].key > item->key ) {
+    items[pos] = items[(pos-1)/2];
+    pos = (pos-1)/2;
+  }
+  items[pos] = *item;
+}
+
+static HeapItemT heap_pop ( GArray *heap )
+{
+  HeapItemT top = g_array_index ( heap, HeapItemT, 0 );
+  HeapItemT last = g_array_index ( heap, HeapItemT, heap->len - 1 );
+  g_array_set_size ( heap, heap->len - 1 );
+  HeapItemT *items = (HeapItemT*)heap->data;
+  guint nn = heap->len;
+  guint pos = 0;
+  while ( nn ) {
+    guint child = 2 * pos + 1;
+    if ( child >= nn )
+      break;
+    if ( child + 1 < nn && items[child+1].key < items[child].key )
+      child++;
+    if ( items[child].key >= last.key )
+      break;
+    items[pos] = items[child];
+    pos = child;
+  }
+  if ( nn )
+    items[pos] = last;
+  return top;
+}
+
+static void relax ( RouteGraph *rg, GArray *heap, guint32 vertex, guint32 cost, guint32 pred, const struct LatLon *end )
+{
+  if ( rg->stamp[vertex] == rg->search && rg->cost[vertex] <= cost )
+    return;
+  rg->stamp[vertex] = rg->search;
+  rg->cost[vertex] = cost;
+  rg->pred[vertex] = pred;
+
+  // Never overestimate, so the first route found is the best
+  struct LatLon ll;
+  point_to_latlon ( &rg->vertices[vertex], &ll );
+  gdouble estimate = 0.99 * a_coords_latlon_diff_fast ( &ll, end ) / rg->header->max_speed * 1000.0;
+  HeapItemT item = { (guint32)MIN(G_MAXUINT32, cost + estimate), cost, vertex };
+  heap_push ( heap, &item );
+}
+
+static void append_point ( GArray *points, const struct LatLon *ll )
+{
+  if ( points->len ) {
+    struct LatLon *last = &g_array_index ( points, struct LatLon, points->len - 1 );
+    if ( last->lat == ll->lat && last->lon == ll->lon )
+      return;
+  }
+  g_array_append_val ( points, *ll );
+}
+
+/**
+ * Points ii up to jj (inclusive) of the edge
+ */
+static void append_edge_points ( RouteGraph *rg, GArray *points, guint32 source, guint32 ee, guint ii, guint jj )
+{
+  for ( ; ii <= jj; ii++ ) {
+    RgPoint pt = edge_point ( rg->vertices, rg->shape, source, &rg->edges[ee], ii );
+    struct LatLon ll;
+    point_to_latlon ( &pt, &ll );
+    append_point ( points, &ll );
+  }
+}
+
+/**
+ * a_route_graph_find:
+ * @start: Where to start; the nearest road to it is used
+ * @end:   Where to finish; the nearest road to it is used
+ *
+ * Returns: The positions (as struct LatLon) along the quickest route, or NULL with the error set
+ */
+GArray *a_route_graph_find ( RouteGraph *rg, const struct LatLon *start, const struct LatLon *end, GError **error )
+{
+  SnapT starts[RG_SNAP_MAX], ends[RG_SNAP_MAX];
+  guint n_starts = snap ( rg, start, starts );
+  guint n_ends = snap ( rg, end, ends );
+  if ( !n_starts || !n_ends ) {
+    g_set_error ( error, ROUTE_GRAPH_ERROR, ROUTE_GRAPH_ERROR_NO_ROAD, _("No usable road near the %s of the route"), n_starts ? _("end") : _("start") );
+    return NULL;
+  }
+
+  g_mutex_lock ( &rg->mutex );
+  guint32 n_vertices = rg->header->n_vertices;
+  if ( !rg->stamp ) {
+    rg->cost = g_malloc ( MAX(1, n_vertices) * sizeof(guint32) );
+    rg->pred = g_malloc ( MAX(1, n_vertices) * sizeof(guint32) );
+    rg->stamp = g_malloc0 ( MAX(1, n_vertices) * sizeof(guint32) );
+  }
+  if ( ++rg->search == 0 ) {
+    memset ( rg->stamp, 0, n_vertices * sizeof(guint32) );
+    rg->search = 1;
+  }
+
+  // Both ends may be on the same edge
+  guint32 best = G_MAXUINT32;
+  gint best_start = -1, best_end = -1;
+  for ( guint ii = 0; ii < n_starts; ii++ )
+    for ( guint jj = 0; jj < n_ends; jj++ )
+      if ( starts[ii].edge == ends[jj].edge && starts[ii].along <= ends[jj].along ) {
+        guint32 cost = (ends[jj].along - starts[ii].along) * rg->edges[starts[ii].edge].cost;
+        if ( cost < best ) {
+          best = cost;
+          best_start = ii;
+          best_end = jj;
+        }
+      }
+
+  GArray *heap = g_array_new ( FALSE, FALSE, sizeof(HeapItemT) );
+  for ( guint ii = 0; ii < n_starts; ii++ ) {
+    const RgEdge *edge = &rg->edges[starts[ii].edge];
+    relax ( rg, heap, edge->target, (1.0 - starts[ii].along) * edge->cost, starts[ii].edge | RG_PRED_START, end );
+  }
+
+  guint settled = 0;
+  gint via_end = -1;
+  while ( heap->len ) {
+    HeapItemT item = heap_pop ( heap );
+    if ( item.key >= best )
+      break;
+    if ( item.cost > rg->cost[item.vertex] )
+      continue; // Since superseded
+    settled++;
+    for ( guint jj = 0; jj < n_ends; jj++ )
+      if ( ends[jj].source == item.vertex ) {
+        guint32 cost = item.cost + ends[jj].along * rg->edges[ends[jj].edge].cost;
+        if ( cost < best ) {
+          best = cost;
+          via_end = jj;
+          best_start = -1;
+        }
+      }
+    for ( guint32 ee = rg->first_edge[item.vertex]; ee < rg->first_edge[item.vertex+1]; ee++ )
+      relax ( rg, heap, rg->edges[ee].target, item.cost + rg->edges[ee].cost, ee, end );
+  }
+  g_array_free ( heap, TRUE );
+
+  GArray *points = NULL;
+  if ( best_start >= 0 ) {
+    const SnapT *ss = &starts[best_start];
+    const SnapT *se = &ends[best_end];
+    points = g_array_new ( FALSE, FALSE, sizeof(struct LatLon) );
+    append_point ( points, &ss->ll );
+    append_edge_points ( rg, points, ss->source, ss->edge, ss->seg + 1, se->seg );
+    append_point ( points, &se->ll );
+  }
+  else if ( via_end >= 0 ) {
+    // Edges back from the end to the start
+    GArray *path = g_array_new ( FALSE, FALSE, sizeof(guint32) );
+    guint32 vertex = ends[via_end].source;
+    while ( TRUE ) {
+      guint32 pred = rg->pred[vertex];
+      guint32 ee = pred & ~RG_PRED_START;
+      g_array_append_val ( path, ee );
+      if ( pred & RG_PRED_START )
+        break;
+      vertex = edge_source ( rg, ee );
+    }
+
+    points = g_array_new ( FALSE, FALSE, sizeof(struct LatLon) );
+    guint32 first = g_array_index ( path, guint32, path->len - 1 );
+    for ( guint ii = 0; ii < n_starts; ii++ )
+      if ( starts[ii].edge == first ) {
+        append_point ( points, &starts[ii].ll );
+        append_edge_points ( rg, points, starts[ii].source, first, starts[ii].seg + 1,
+                             (rg->edges[first].n_shape & ~RG_SHAPE_REVERSED) + 1 );
+        break;
+      }
+    for ( gint ii = path->len - 2; ii >= 0; ii-- ) {
+      guint32 ee = g_array_index ( path, guint32, ii );
+      append_edge_points ( rg, points, edge_source ( rg, ee ), ee, 1, (rg->edges[ee].n_shape & ~RG_SHAPE_REVERSED) + 1 );
+    }
+    const SnapT *se = &ends[via_end];
+    append_edge_points ( rg, points, se->source, se->edge, 1, se->seg );
+    append_point ( points, &se->ll );
+    g_array_free ( path, TRUE );
+  }
+  g_mutex_unlock ( &rg->mutex );
+
+  g_debug ( "%s: %u vertices settled, cost %ums", __FUNCTION__, settled, best );
+  if ( !points )
+    g_set_error ( error, ROUTE_GRAPH_ERROR, ROUTE_GRAPH_ERROR_NO_ROUTE, _("No route found") );
+  return points;
+}
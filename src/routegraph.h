@@ -0,0 +1,62 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_ROUTEGRAPH_H
+#define __VIKING_ROUTEGRAPH_H
+
+#include <glib.h>
+#include "coords.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+  ROUTE_GRAPH_CAR = 0,
+  ROUTE_GRAPH_BICYCLE,
+  ROUTE_GRAPH_FOOT,
+  ROUTE_GRAPH_NUM_PROFILES
+} RouteGraphProfile;
+
+typedef enum {
+  ROUTE_GRAPH_ERROR_INVALID,  // Not a (supported) OSM PBF or graph file
+  ROUTE_GRAPH_ERROR_NO_ROAD,  // Nothing usable near an end of the route
+  ROUTE_GRAPH_ERROR_NO_ROUTE, // The ends are not connected
+} RouteGraphError;
+
+#define ROUTE_GRAPH_ERROR a_route_graph_error_quark()
+GQuark a_route_graph_error_quark ( void );
+
+typedef struct _RouteGraph RouteGraph;
+
+gboolean a_route_graph_profile_from_name ( const gchar *name, RouteGraphProfile *profile );
+
+// Convert the roads of an OpenStreetMap PBF extract into a graph file. This may take a while.
+gboolean a_route_graph_build ( const gchar *osm_file, const gchar *filename, RouteGraphProfile profile, GError **error );
+
+RouteGraph *a_route_graph_open ( const gchar *filename, GError **error );
+void a_route_graph_free ( RouteGraph *rg );
+RouteGraphProfile a_route_graph_get_profile ( RouteGraph *rg );
+guint a_route_graph_get_n_vertices ( RouteGraph *rg );
+guint a_route_graph_get_n_edges ( RouteGraph *rg );
+
+// Safe to call from any thread
+GArray *a_route_graph_find ( RouteGraph *rg, const struct LatLon *start, const struct LatLon *end, GError **error );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "stringpool.h"
+
+// Of each pooled string, as the key, to its reference count (a guint updated in place)
+static GHashTable *pool = NULL;
+static GMutex pool_lock;
+
+/**
+ * a_string_pool_intern:
+ * @str: The value to share, which can be NULL
+ *
+ * Returns: The pooled copy of the string, with a reference added
+ *  that is to be given up via a_string_pool_release().
+ *  Pass a pooled string to add another reference to it.
+ */
+const gchar *a_string_pool_intern ( const gchar *str )
+{
+  if ( !str )
+    return NULL;
+
+  g_mutex_lock ( &pool_lock );
+  if ( G_UNLIKELY(!pool) )
+    pool = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, g_free );
+  gpointer key, refs;
+  if ( g_hash_table_lookup_extended ( pool, str, &key, &refs ) )
+    (*(guint*)refs)++;
+  else {
+    key = g_strdup ( str );
+    refs = g_new ( guint, 1 );
+    *(guint*)refs = 1;
+    g_hash_table_insert ( pool, key, refs );
+  }
+  g_mutex_unlock ( &pool_lock );
+  return key;
+}
+
+/**
+ * a_string_pool_release:
+ * @str: A string from a_string_pool_intern(), or NULL
+ *
+ * The string is freed once the last reference to it is given up
+ */
+void a_string_pool_release ( const gchar *str )
+{
+  if ( !str )
+    return;
+
+  g_mutex_lock ( &pool_lock );
+  guint *refs = pool ? g_hash_table_lookup ( pool, str ) : NULL;
+  if ( !refs )
+    g_critical ( "%s: %s is not in the pool", __FUNCTION__, str );
+  else if ( --(*refs) == 0 )
+    g_hash_table_remove ( pool, str );
+  g_mutex_unlock ( &pool_lock );
+}
@@ -0,0 +1,36 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_STRINGPOOL_H
+#define __VIKING_STRINGPOOL_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// A process wide pool of reference counted strings,
+//  so that the many repeated values of trackpoint extensions, symbols, types and so on are only held once.
+// The pooled strings must not be modified, and are usable from any thread.
+
+const gchar *a_string_pool_intern ( const gchar *str );
+void a_string_pool_release ( const gchar *str );
+
+G_END_DECLS
+
+#endif
@@ -106,76 +106,124 @@ static tag_mapping tag_path_map[] = {
 	{0}
 };
 
+static GHashTable *tag_path_hash = NULL;
+
 static tag_type get_tag ( const char *tt )
 {
-	tag_mapping *tm;
-	for ( tm = tag_path_map; tm->tag_type != 0; tm++ )
-		if ( 0 == strcmp(tm->tag_name, tt) )
-			return tm->tag_type;
-	return tt_unknown;
+	// Built once, as this is looked up on every element start (and files may be read concurrently)
+	if ( g_once_init_enter ( &tag_path_hash ) ) {
+		GHashTable *hash = g_hash_table_new ( g_str_hash, g_str_equal );
+		for ( tag_mapping *tm = tag_path_map; tm->tag_type != 0; tm++ )
+			g_hash_table_insert ( hash, (gpointer)tm->tag_name, GINT_TO_POINTER(tm->tag_type) );
+		g_once_init_leave ( &tag_path_hash, hash );
+	}
+	return GPOINTER_TO_INT ( g_hash_table_lookup ( tag_path_hash, tt ) );
 }
 
-static tag_type current_tag = tt_unknown;
-static GString *xpath = NULL;
-static GString *c_cdata = NULL;
-
-// current ("c_") objects
-static VikTrackpoint *c_tp = NULL;
-static VikWaypoint *c_wp = NULL;
-static VikTrack *c_tr = NULL;
-static VikTrwLayer *c_vtl = NULL;
-static VikTRWMetadata *c_md = NULL;
-
-static gchar *c_wp_name = NULL;
-static gchar *c_tr_name = NULL;
-static gboolean has_layer_name = FALSE;
+// Layers are numbered across all reads, for when the file gives no name
+static gint unnamed_layers = 0;
 
-// temporary things so we don't have to create them lots of times
-static struct LatLon c_ll;
+// A waypoint or track read, which is only put into a layer when attaching
+typedef struct {
+	gchar *name;
+	VikWaypoint *wp;
+	VikTrack *tr;
+} TcxItem;
 
-// specialty flags / etc
-static gboolean f_tr_newseg;
-static guint unnamed_waypoints = 0;
-static guint unnamed_tracks = 0;
-static guint unnamed_layers = 0;
+// Each course (or lap) becomes a layer
+typedef struct {
+	gchar *name;          // NULL when the file gives none
+	VikTRWMetadata *md;
+	GArray *items;        // Of TcxItem
+} TcxCourse;
+
+struct _TcxRead {
+	gchar *filename;
+	gboolean ok;
+	GList *courses;       // Of TcxCourse, in reverse order
+};
 
+// All the state of reading one file
 typedef struct {
-	VikAggregateLayer *val;
-	VikViewport *vvp;
-	const gchar *filename;
+	TcxRead *read;
+	VikCoordMode coord_mode;
+
+	tag_type current_tag;
+	GString *xpath;
+	// The tag type of each enclosing element, so ending an element needn't look up its parent again
+	GArray *tag_stack;
+	GString *c_cdata;
+
+	// current ("c_") objects
+	VikTrackpoint *c_tp;
+	VikWaypoint *c_wp;
+	VikTrack *c_tr;
+	TcxCourse *c_course;
+
+	gchar *c_wp_name;
+
+	// temporary things so we don't have to create them lots of times
+	struct LatLon c_ll;
+
+	// specialty flags / etc
+	gboolean f_tr_newseg;
+	guint unnamed_waypoints;
+	guint unnamed_tracks;
 } UserDataT;
 
+static void tcx_course_free ( TcxCourse *course )
+{
+	for ( guint ii = 0; ii < course->items->len; ii++ ) {
+		TcxItem *item = &g_array_index ( course->items, TcxItem, ii );
+		g_free ( item->name );
+		if ( item->wp )
+			vik_waypoint_free ( item->wp );
+		if ( item->tr )
+			vik_track_free ( item->tr );
+	}
+	g_array_free ( course->items, TRUE );
+	if ( course->md )
+		vik_trw_metadata_free ( course->md );
+	g_free ( course->name );
+	g_free ( course );
+}
+
+static void tcx_course_add ( TcxCourse *course, gchar *name, VikWaypoint *wp, VikTrack *tr )
+{
+	TcxItem item = { name, wp, tr };
+	g_array_append_val ( course->items, item );
+}
+
 static void tcx_start ( UserDataT *ud, const char *el, const char **attr )
 {
-	g_string_append_c ( xpath, '/' );
-	g_string_append ( xpath, el );
-	current_tag = get_tag ( xpath->str );
+	g_array_append_val ( ud->tag_stack, ud->current_tag );
+	g_string_append_c ( ud->xpath, '/' );
+	g_string_append ( ud->xpath, el );
+	ud->current_tag = get_tag ( ud->xpath->str );
 
-	switch ( current_tag ) {
+	switch ( ud->current_tag ) {
 
-		case tt_tcx: {
-			c_vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, ud->vvp, FALSE ));
-			// Always force V1.1, since we may read in 'extended' data like cadence, etc...
-			vik_trw_layer_set_gpx_version ( c_vtl, GPX_V1_1 );
-			c_md = vik_trw_metadata_new();
+		case tt_tcx:
+			ud->c_course = g_new0 ( TcxCourse, 1 );
+			ud->c_course->md = vik_trw_metadata_new();
+			ud->c_course->items = g_array_new ( FALSE, FALSE, sizeof(TcxItem) );
 			break;
-		}
 
 		case tt_wpt:
-			c_wp = vik_waypoint_new ();
-			c_ll.lat = NAN;
-			c_ll.lon = NAN;
+			ud->c_wp = vik_waypoint_new ();
+			ud->c_ll.lat = NAN;
+			ud->c_ll.lon = NAN;
 			break;
 
 		case tt_trk:
-			c_tr = vik_track_new ();
-			f_tr_newseg = TRUE;
+			ud->c_tr = vik_track_new ();
+			ud->f_tr_newseg = TRUE;
 			break;
 
 		case tt_trk_trkseg_trkpt:
-			c_tp = vik_trackpoint_new ();
-			c_ll.lat = NAN;
-			c_ll.lon = NAN;
+			ud->c_tp = vik_trackpoint_new ();
+			ud->c_ll.lat = NAN;
+			ud->c_ll.lon = NAN;
 			break;
 
 		case tt_tcx_creator:
@@ -195,7 +243,7 @@ static void tcx_start ( UserDataT *ud, const char *el, const char **attr )
 		case tt_wpt_time:
 		case tt_wpt_pos_lat:
 		case tt_wpt_pos_lon:
-			g_string_erase ( c_cdata, 0, -1 ); // clear the cdata buffer
+			g_string_truncate ( ud->c_cdata, 0 ); // clear the cdata buffer
 			break;
 
 		default: break;
@@ -204,214 +252,167 @@ static void tcx_start ( UserDataT *ud, const char *el, const char **attr )
 
 static void tcx_end ( UserDataT *ud, const char *el )
 {
-	static GTimeVal tp_time;
-	static GTimeVal wp_time;
-	VikTrwLayer *vtl = c_vtl; 
+	g_string_truncate ( ud->xpath, ud->xpath->len - strlen(el) - 1 );
 
-	g_string_truncate ( xpath, xpath->len - strlen(el) - 1 );
-
-	switch ( current_tag ) {
+	switch ( ud->current_tag ) {
 
 		case tt_tcx:
-			if ( c_vtl ) {
-				if ( vik_trw_layer_is_empty(c_vtl) ) {
-					// free up layer
-					g_warning ( "%s: No useable geo data found in %s", __FUNCTION__, vik_layer_get_name(VIK_LAYER(c_vtl)) );
-					g_object_unref ( c_vtl );
-				} else {
-					// Add it
-					if ( !has_layer_name ) {
-						unnamed_layers++;
-						gchar *name = g_strdup_printf ( "%s %04d", a_file_basename(ud->filename), unnamed_layers );
-						vik_layer_rename ( VIK_LAYER(c_vtl), name );
-						g_free ( name );
-					}
-					vik_layer_post_read ( VIK_LAYER(c_vtl), ud->vvp, TRUE );
-					vik_aggregate_layer_add_layer ( ud->val, VIK_LAYER(c_vtl), FALSE );
-					vik_trw_layer_set_metadata ( c_vtl, c_md );
-					// TODO - only really need to do this once at the end on the aggregate layer, but no functionality for this yet
-					vik_trw_layer_auto_set_view ( c_vtl, ud->vvp );
-				}
-				c_md = NULL;
-				c_vtl = NULL;
-				has_layer_name = FALSE;
+			if ( ud->c_course ) {
+				ud->read->courses = g_list_prepend ( ud->read->courses, ud->c_course );
+				ud->c_course = NULL;
 			}
 			break;
 
 		case tt_tcx_name:
-			if ( c_vtl ) {
-				vik_layer_rename ( VIK_LAYER(c_vtl), c_cdata->str );
-				has_layer_name = TRUE;
+			if ( ud->c_course ) {
+				g_free ( ud->c_course->name );
+				ud->c_course->name = g_strdup ( ud->c_cdata->str );
 			}
-			g_string_erase ( c_cdata, 0, -1 );
 			break;
 
 		case tt_tcx_creator:
-			if ( c_md ) {
-				if ( c_md->author )
-					g_free ( c_md->author );
-				c_md->author = g_strdup ( c_cdata->str );
+			if ( ud->c_course ) {
+				g_free ( ud->c_course->md->author );
+				ud->c_course->md->author = g_strdup ( ud->c_cdata->str );
 			}
-			g_string_erase ( c_cdata, 0, -1 );
 			break;
 
 		case tt_tcx_cmt:
-			if ( c_md ) {
-				if ( c_md->description )
-					g_free ( c_md->description );
-				c_md->description = g_strdup ( c_cdata->str );
+			if ( ud->c_course ) {
+				g_free ( ud->c_course->md->description );
+				ud->c_course->md->description = g_strdup ( ud->c_cdata->str );
 			}
-			g_string_erase ( c_cdata, 0, -1 );
 			break;
 
 		case tt_wpt:
-			if ( !c_wp_name )
-				c_wp_name = g_strdup_printf ( _("Waypoint%04d"), unnamed_waypoints++ );
+			if ( !ud->c_wp_name )
+				ud->c_wp_name = g_strdup_printf ( _("Waypoint%04d"), ud->unnamed_waypoints++ );
 
-			if ( !isnan(c_ll.lat) && !isnan(c_ll.lon) ) {
-				vik_coord_load_from_latlon ( &(c_wp->coord), vik_trw_layer_get_coord_mode(vtl), &c_ll );
-				vik_trw_layer_filein_add_waypoint ( vtl, c_wp_name, c_wp );
+			if ( ud->c_course && !isnan(ud->c_ll.lat) && !isnan(ud->c_ll.lon) ) {
+				vik_coord_load_from_latlon ( &(ud->c_wp->coord), ud->coord_mode, &ud->c_ll );
+				tcx_course_add ( ud->c_course, ud->c_wp_name, ud->c_wp, NULL );
 			} else {
-				g_warning ( "%s: Missing a coordinate value for %s", __FUNCTION__, c_wp_name );
-				vik_waypoint_free ( c_wp ); 
+				g_warning ( "%s: Missing a coordinate value for %s", __FUNCTION__, ud->c_wp_name );
+				vik_waypoint_free ( ud->c_wp );
+				g_free ( ud->c_wp_name );
 			}
-
-			g_free ( c_wp_name );
-			c_wp = NULL;
-			c_wp_name = NULL;
+			ud->c_wp = NULL;
+			ud->c_wp_name = NULL;
 			break;
 
 		case tt_trk:
-			if ( c_vtl ) {
-				c_tr_name = g_strdup_printf ( _("Track%03d"), unnamed_tracks++ );
-				c_tr->trackpoints = g_list_reverse ( c_tr->trackpoints );
-				vik_trw_layer_filein_add_track ( vtl, c_tr_name, c_tr );
+			if ( ud->c_course ) {
+				ud->c_tr->trackpoints = g_list_reverse ( ud->c_tr->trackpoints );
+				tcx_course_add ( ud->c_course, g_strdup_printf ( _("Track%03d"), ud->unnamed_tracks++ ), NULL, ud->c_tr );
 			}
-			g_free ( c_tr_name );
-			c_tr = NULL;
-			c_tr_name = NULL;
+			else
+				vik_track_free ( ud->c_tr );
+			ud->c_tr = NULL;
 			break;
 
 		case tt_wpt_name:
-			if ( c_wp_name )
-				g_free ( c_wp_name );
-			c_wp_name = g_strdup ( c_cdata->str );
-			g_string_erase ( c_cdata, 0, -1 );
+			g_free ( ud->c_wp_name );
+			ud->c_wp_name = g_strdup ( ud->c_cdata->str );
 			break;
 
 		case tt_wpt_ele:
-			c_wp->altitude = g_ascii_strtod ( c_cdata->str, NULL );
-			g_string_erase ( c_cdata, 0, -1 );
+			ud->c_wp->altitude = util_strtod_len ( ud->c_cdata->str, ud->c_cdata->len );
 			break;
 
 		case tt_trk_trkseg_trkpt_ele:
-			c_tp->altitude = g_ascii_strtod ( c_cdata->str, NULL );
-			g_string_erase ( c_cdata, 0, -1 );
+			ud->c_tp->altitude = util_strtod_len ( ud->c_cdata->str, ud->c_cdata->len );
 			break;
 
 		case tt_wpt_cmt:
-			vik_waypoint_set_comment ( c_wp, c_cdata->str );
-			g_string_erase ( c_cdata, 0, -1 );
+			vik_waypoint_set_comment ( ud->c_wp, ud->c_cdata->str );
 			break;
 
 		case tt_wpt_time:
-			if ( g_time_val_from_iso8601(c_cdata->str, &wp_time) ) {
-				gdouble d1 = wp_time.tv_sec;
-				gdouble d2 = (gdouble)wp_time.tv_usec/G_USEC_PER_SEC;
-				c_wp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
-			}
-			g_string_erase ( c_cdata, 0, -1 );
+			(void)util_time_from_iso8601 ( ud->c_cdata->str, &ud->c_wp->timestamp );
 			break;
 
 		case tt_trk_trkseg_trkpt_time:
-			if ( g_time_val_from_iso8601(c_cdata->str, &tp_time) ) {
-				gdouble d1 = tp_time.tv_sec;
-				gdouble d2 = (gdouble)tp_time.tv_usec/G_USEC_PER_SEC;
-				c_tp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
-			}
-			g_string_erase ( c_cdata, 0, -1 );
+			(void)util_time_from_iso8601 ( ud->c_cdata->str, &ud->c_tp->timestamp );
 			break;
 
 		case tt_trk_trkseg_trkpt_pos_lat: {
-			gdouble dd = g_ascii_strtod ( c_cdata->str, NULL );
+			gdouble dd = util_strtod_len ( ud->c_cdata->str, ud->c_cdata->len );
 			if ( dd < -90.0 || dd > 90.0 )
 				g_warning ( "%s: Invalid trkpt latitude value %.6f", __FUNCTION__, dd );
 			else
-				c_ll.lat = dd;
+				ud->c_ll.lat = dd;
 			}
 			break;
 
 		case tt_trk_trkseg_trkpt_pos_lon: {
-			gdouble dd = g_ascii_strtod ( c_cdata->str, NULL );
+			gdouble dd = util_strtod_len ( ud->c_cdata->str, ud->c_cdata->len );
 			if ( dd < -180.0 || dd > 180.0 )
 				g_warning ( "%s: Invalid trkpt longitude value %.6f", __FUNCTION__, dd );
 			else
-				c_ll.lon = dd;
+				ud->c_ll.lon = dd;
 			}
 			break;
 
 		case tt_trk_trkseg_trkpt:
-			if ( !isnan(c_ll.lat) && !isnan(c_ll.lon) ) {
-				vik_coord_load_from_latlon ( &(c_tp->coord), vik_trw_layer_get_coord_mode(vtl), &c_ll );
-				if ( f_tr_newseg ) {
-					c_tp->newsegment = TRUE;
-					f_tr_newseg = FALSE;
+			if ( !isnan(ud->c_ll.lat) && !isnan(ud->c_ll.lon) ) {
+				vik_coord_load_from_latlon ( &(ud->c_tp->coord), ud->coord_mode, &ud->c_ll );
+				if ( ud->f_tr_newseg ) {
+					ud->c_tp->newsegment = TRUE;
+					ud->f_tr_newseg = FALSE;
 				}
-				c_tr->trackpoints = g_list_prepend ( c_tr->trackpoints, c_tp );
+				ud->c_tr->trackpoints = g_list_prepend ( ud->c_tr->trackpoints, ud->c_tp );
 			} else {
 				g_warning ( "%s: Missing a coordinate value", __FUNCTION__ );
-				vik_trackpoint_free ( c_tp );
+				vik_trackpoint_free ( ud->c_tp );
 			}
-			c_tp = NULL;
+			ud->c_tp = NULL;
 			break;
 
 		case tt_wpt_pos_lat: {
-			gdouble dd = g_ascii_strtod ( c_cdata->str, NULL );
+			gdouble dd = util_strtod_len ( ud->c_cdata->str, ud->c_cdata->len );
 			if ( dd < -90.0 || dd > 90.0 )
 				g_warning ( "%s: Invalid wpt latitude value %.6f", __FUNCTION__, dd );
 			else
-				c_ll.lat = dd;
+				ud->c_ll.lat = dd;
 			}
 			break;
 
 		case tt_wpt_pos_lon: {
-			gdouble dd = g_ascii_strtod ( c_cdata->str, NULL );
+			gdouble dd = util_strtod_len ( ud->c_cdata->str, ud->c_cdata->len );
 			if ( dd < -180.0 || dd > 180.0 )
 				g_warning ( "%s: Invalid wpt longitude value %.6f", __FUNCTION__, dd );
 			else
-				c_ll.lon = dd;
+				ud->c_ll.lon = dd;
 			}
 			break;
 
 		case tt_trk_trkseg_trkpt_cadence:
-			c_tp->cadence = atoi ( c_cdata->str );
-			g_string_erase ( c_cdata, 0, -1 );
+			ud->c_tp->cadence = atoi ( ud->c_cdata->str );
 			break;
 
 		case tt_trk_trkseg_trkpt_hr:
-			c_tp->heart_rate = atoi ( c_cdata->str );
-			g_string_erase ( c_cdata, 0, -1 );
+			ud->c_tp->heart_rate = atoi ( ud->c_cdata->str );
 			break;
 
 		case tt_trk_trkseg_trkpt_power:
-			c_tp->power = g_ascii_strtod ( c_cdata->str, NULL );
-			g_string_erase ( c_cdata, 0, -1 );
+			ud->c_tp->power = util_strtod_len ( ud->c_cdata->str, ud->c_cdata->len );
 			break;
 
 		case tt_trk_trkseg_trkpt_speed:
-			c_tp->speed = g_ascii_strtod ( c_cdata->str, NULL );
-			g_string_erase ( c_cdata, 0, -1 );
+			ud->c_tp->speed = util_strtod_len ( ud->c_cdata->str, ud->c_cdata->len );
 			break;
 
 	        default: break;
 	}
 
-	current_tag = get_tag ( xpath->str );
+	ud->current_tag = g_array_index ( ud->tag_stack, tag_type, ud->tag_stack->len - 1 );
+	g_array_set_size ( ud->tag_stack, ud->tag_stack->len - 1 );
 }
 
 static void tcx_cdata ( void *dta, const XML_Char *ss, int len )
 {
-	switch ( current_tag ) {
+	UserDataT *ud = dta;
+	switch ( ud->current_tag ) {
 		case tt_tcx_name:
 		case tt_tcx_creator:
 		case tt_tcx_cmt:
@@ -429,57 +430,152 @@ static void tcx_cdata ( void *dta, const XML_Char *ss, int len )
 		case tt_trk_trkseg_trkpt_hr:
 		case tt_trk_trkseg_trkpt_power:
 		case tt_trk_trkseg_trkpt_speed:
-			g_string_append_len ( c_cdata, ss, len );
+			g_string_append_len ( ud->c_cdata, ss, len );
 			break;
 		default: break; // ignore cdata from other things
 	}
 }
 
+#define TCX_READ_BUFFER_SIZE (256*1024)
 
 /**
- * Returns TRUE on a successful file read
- *   NB The file of course could contain no actual geo data that we can use!
- * NB2 Filename is used in case a name from within the file itself can not be found
- *   as file access is via the FILE* stream methods
+ * a_tcx_read:
+ * @coord_mode: For the positions, as they will be in the layers
+ * @filename:   Used in case a name from within the file itself can not be found
+ *
+ * Read the file without creating any layers, so it can be done in any thread.
+ * Complete with a_tcx_attach() (or discard with a_tcx_read_free()).
  */
-gboolean a_tcx_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, const gchar* filename )
+TcxRead *a_tcx_read ( FILE *ff, const gchar *filename, VikCoordMode coord_mode )
 {
 	XML_Parser parser = XML_ParserCreate ( NULL );
 	int done=0, len;
 	enum XML_Status status = XML_STATUS_ERROR;
 
-	UserDataT *ud = g_malloc (sizeof(UserDataT));
-	ud->val      = val;
-	ud->vvp      = vvp;
-	ud->filename = filename;
+	TcxRead *read = g_new0 ( TcxRead, 1 );
+	read->filename = g_strdup ( filename );
+
+	UserDataT *ud = g_new0 (UserDataT, 1);
+	ud->read       = read;
+	ud->coord_mode = coord_mode;
 
 	XML_SetElementHandler ( parser, (XML_StartElementHandler)tcx_start, (XML_EndElementHandler)tcx_end );
 	XML_SetUserData ( parser, ud );
 	XML_SetCharacterDataHandler ( parser, (XML_CharacterDataHandler)tcx_cdata );
 
-	gchar buf[4096];
-
-	xpath = g_string_new ( "" );
-	c_cdata = g_string_new ( "" );
+	ud->xpath = g_string_new ( "" );
+	ud->tag_stack = g_array_sized_new ( FALSE, FALSE, sizeof(tag_type), 16 );
+	ud->c_cdata = g_string_new ( "" );
 
-	unnamed_waypoints = 1;
-	unnamed_tracks = 1;
+	ud->unnamed_waypoints = 1;
+	ud->unnamed_tracks = 1;
 
+	// Read straight into expat's own buffer, in large blocks
 	while ( !done ) {
-		len = fread ( buf, 1, sizeof(buf)-7, ff );
+		void *buf = XML_GetBuffer ( parser, TCX_READ_BUFFER_SIZE );
+		if ( !buf ) {
+			status = XML_STATUS_ERROR;
+			break;
+		}
+		len = fread ( buf, 1, TCX_READ_BUFFER_SIZE, ff );
 		done = feof ( ff ) || !len;
-		status = XML_Parse ( parser, buf, len, done );
+		status = XML_ParseBuffer ( parser, len, done );
+		if ( status == XML_STATUS_ERROR )
+			break;
 	}
 
-	gboolean ans = (status != XML_STATUS_ERROR);
-	if ( !ans ) {
+	read->ok = (status != XML_STATUS_ERROR);
+	if ( !read->ok ) {
 		g_warning ( "%s: XML error %s at line %ld", __FUNCTION__, XML_ErrorString(XML_GetErrorCode(parser)), XML_GetCurrentLineNumber(parser) );
 	}
 
 	XML_ParserFree (parser);
+	// Anything left incomplete by an error
+	if ( ud->c_tp )
+		vik_trackpoint_free ( ud->c_tp );
+	if ( ud->c_tr )
+		vik_track_free ( ud->c_tr );
+	if ( ud->c_wp )
+		vik_waypoint_free ( ud->c_wp );
+	if ( ud->c_course )
+		tcx_course_free ( ud->c_course );
+	g_string_free ( ud->xpath, TRUE );
+	g_array_free ( ud->tag_stack, TRUE );
+	g_string_free ( ud->c_cdata, TRUE );
+	g_free ( ud->c_wp_name );
 	g_free ( ud );
-	g_string_free ( xpath, TRUE );
-	g_string_free ( c_cdata, TRUE );
 
+	return read;
+}
+
+void a_tcx_read_free ( TcxRead *read )
+{
+	g_list_free_full ( read->courses, (GDestroyNotify)tcx_course_free );
+	g_free ( read->filename );
+	g_free ( read );
+}
+
+/**
+ * a_tcx_attach:
+ *
+ * Put what a_tcx_read() found into new layers in the aggregate layer, freeing the read
+ *
+ * Returns TRUE on a successful file read
+ *   NB The file of course could contain no actual geo data that we can use!
+ */
+gboolean a_tcx_attach ( TcxRead *read, VikAggregateLayer *val, VikViewport *vvp )
+{
+	read->courses = g_list_reverse ( read->courses );
+	for ( GList *iter = read->courses; iter; iter = iter->next ) {
+		TcxCourse *course = iter->data;
+		if ( !course->items->len ) {
+			g_warning ( "%s: No useable geo data found in %s", __FUNCTION__, course->name ? course->name : read->filename );
+			continue;
+		}
+
+		VikTrwLayer *vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, vvp, FALSE ));
+		// Always force V1.1, since we may read in 'extended' data like cadence, etc...
+		vik_trw_layer_set_gpx_version ( vtl, GPX_V1_1 );
+		if ( course->name )
+			vik_layer_rename ( VIK_LAYER(vtl), course->name );
+		else {
+			gint number = g_atomic_int_add ( &unnamed_layers, 1 ) + 1;
+			gchar *name = g_strdup_printf ( "%s %04d", a_file_basename(read->filename), number );
+			vik_layer_rename ( VIK_LAYER(vtl), name );
+			g_free ( name );
+		}
+
+		// The layer takes over the items
+		for ( guint ii = 0; ii < course->items->len; ii++ ) {
+			TcxItem *item = &g_array_index ( course->items, TcxItem, ii );
+			if ( item->wp )
+				vik_trw_layer_filein_add_waypoint ( vtl, item->name, item->wp );
+			else
+				vik_trw_layer_filein_add_track ( vtl, item->name, item->tr );
+			g_free ( item->name );
+		}
+		g_array_set_size ( course->items, 0 );
+
+		vik_layer_post_read ( VIK_LAYER(vtl), vvp, TRUE );
+		vik_aggregate_layer_add_layer ( val, VIK_LAYER(vtl), FALSE );
+		vik_trw_layer_set_metadata ( vtl, course->md );
+		course->md = NULL;
+		// TODO - only really need to do this once at the end on the aggregate layer, but no functionality for this yet
+		vik_trw_layer_auto_set_view ( vtl, vvp );
+	}
+
+	gboolean ans = read->ok;
+	a_tcx_read_free ( read );
 	return ans;
 }
+
+/**
+ * Returns TRUE on a successful file read
+ *   NB The file of course could contain no actual geo data that we can use!
+ * NB2 Filename is used in case a name from within the file itself can not be found
+ *   as file access is via the FILE* stream methods
+ */
+gboolean a_tcx_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, const gchar* filename )
+{
+	return a_tcx_attach ( a_tcx_read ( ff, filename, vik_viewport_get_coord_mode(vvp) ), val, vvp );
+}
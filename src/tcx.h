@@ -28,6 +28,12 @@ G_BEGIN_DECLS
 
 gboolean a_tcx_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, const gchar* filename );
 
+// Reading in two steps, so the file itself can be read in another thread
+typedef struct _TcxRead TcxRead;
+TcxRead *a_tcx_read ( FILE *ff, const gchar *filename, VikCoordMode coord_mode );
+gboolean a_tcx_attach ( TcxRead *read, VikAggregateLayer *val, VikViewport *vvp );
+void a_tcx_read_free ( TcxRead *read );
+
 G_END_DECLS
 
 #endif
@@ -70,7 +70,7 @@ static void set_thumb_dir ()
 
 #define PIXMAP_THUMB_SIZE  128
 
-static GdkPixbuf *save_thumbnail(const char *pathname, GdkPixbuf *full);
+static GdkPixbuf *save_thumbnail(const char *pathname, GdkPixbuf *full, int original_width, int original_height);
 static GdkPixbuf *child_create_thumbnail(const gchar *path);
 
 gboolean a_thumbnails_exists ( const gchar *filename )
@@ -91,12 +91,18 @@ GdkPixbuf *a_thumbnails_get_default ()
 
 /* filename must be absolute. you could have a function to make sure it exists and absolutize it */
 
+static void cache_forget ( const gchar *filename );
+
 void a_thumbnails_create(const gchar *filename)
 {
   GdkPixbuf *pixbuf = a_thumbnails_get(filename);
 
-  if ( ! pixbuf )
+  if ( ! pixbuf ) {
     pixbuf = child_create_thumbnail(filename);
+    // So it gets loaded next time, rather than still being known as not there
+    if ( pixbuf )
+      cache_forget ( filename );
+  }
 
   if ( pixbuf )
     g_object_unref (  G_OBJECT ( pixbuf ) );
@@ -129,21 +135,39 @@ GdkPixbuf *a_thumbnails_scale_pixbuf(GdkPixbuf *src, int max_w, int max_h)
 	}
 }
 
+/*
+ * Safe to be called from several threads at once
+ */
 static GdkPixbuf *child_create_thumbnail(const gchar *path)
 {
 	GdkPixbuf *image, *tmpbuf;
+	int original_width, original_height;
+
+	if (!gdk_pixbuf_get_file_info(path, &original_width, &original_height))
+		return NULL;
 
-	image = gdk_pixbuf_new_from_file(path, NULL);
+	/* Loading at the thumbnail size lets the JPEG loader decode at a reduced
+	 * scale, rather than decoding the full image only to shrink it. */
+	image = gdk_pixbuf_new_from_file_at_scale(path, PIXMAP_THUMB_SIZE, PIXMAP_THUMB_SIZE, TRUE, NULL);
 	if (!image)
 		return NULL;
 
+	const gchar *orientation = gdk_pixbuf_get_option(image, "orientation");
+	/* Orientations 5 to 8 turn the image by 90 degrees */
+	if (orientation && atoi(orientation) >= 5 && atoi(orientation) <= 8)
+	{
+		int tmp = original_width;
+		original_width = original_height;
+		original_height = tmp;
+	}
+
 	tmpbuf = gdk_pixbuf_apply_embedded_orientation(image);
 	g_object_unref(G_OBJECT(image));
 	image = tmpbuf;
 
 	if (image)
 	{
-		GdkPixbuf *thumb = save_thumbnail(path, image);
+		GdkPixbuf *thumb = save_thumbnail(path, image, original_width, original_height);
 		g_object_unref ( G_OBJECT ( image ) );
 		return thumb;
 	}
@@ -151,15 +175,13 @@ static GdkPixbuf *child_create_thumbnail(const gchar *path)
 	return NULL;
 }
 
-static GdkPixbuf *save_thumbnail(const char *pathname, GdkPixbuf *full)
+static GdkPixbuf *save_thumbnail(const char *pathname, GdkPixbuf *full, int original_width, int original_height)
 {
 	struct stat info;
 	gchar *path;
-	int original_width, original_height;
 	const gchar* orientation;
 	GString *to;
 	char *md5, *swidth, *sheight, *ssize, *smtime, *uri;
-	mode_t old_mask;
 	int name_len;
 	GdkPixbuf *thumb;
 
@@ -170,9 +192,6 @@ static GdkPixbuf *save_thumbnail(const char *pathname, GdkPixbuf *full)
 
 	orientation = gdk_pixbuf_get_option (full, "orientation");
 
-	original_width = gdk_pixbuf_get_width(full);
-	original_height = gdk_pixbuf_get_height(full);
-
 
 	swidth = g_strdup_printf("%d", original_width);
 	sheight = g_strdup_printf("%d", original_height);
@@ -189,10 +208,11 @@ static GdkPixbuf *save_thumbnail(const char *pathname, GdkPixbuf *full)
 		g_warning ("%s: Failed to mkdir %s", __FUNCTION__, to->str );
 	g_string_append(to, md5);
 	name_len = to->len + 4; /* Truncate to this length when renaming */
+	/* Unique to the thread too, as thumbnails may be created in parallel */
 #ifdef WINDOWS
-	g_string_append_printf(to, ".png.Viking");
+	g_string_append_printf(to, ".png.Viking-%p", (void*) g_thread_self());
 #else
-	g_string_append_printf(to, ".png.Viking-%ld", (long) getpid());
+	g_string_append_printf(to, ".png.Viking-%ld-%p", (long) getpid(), (void*) g_thread_self());
 #endif
 
 	g_free(md5);
@@ -207,7 +227,6 @@ static GdkPixbuf *save_thumbnail(const char *pathname, GdkPixbuf *full)
 #else
 	char *thumb_uri = g_strdup ( uri );
 #endif
-	old_mask = umask(0077);
 	GError *error = NULL;
 	gdk_pixbuf_save(thumb, to->str, "png", &error,
 	                "tEXt::Thumb::Image::Width", swidth,
@@ -218,8 +237,10 @@ static GdkPixbuf *save_thumbnail(const char *pathname, GdkPixbuf *full)
 	                "tEXt::Software", PROJECT,
 	                "tEXt::Software::Orientation", orientation ? orientation : "0",
 	                NULL);
-	umask(old_mask);
 	g_free(thumb_uri);
+	/* Rather than changing the umask, which is shared by all threads */
+	if (!error)
+		(void)g_chmod(to->str, 0600);
 
 	if (error) {
 		g_warning ( "%s::%s", __FUNCTION__, error->message );
@@ -304,6 +325,188 @@ out:
 	return thumb;
 }
 
+/*
+ * Memory cache of thumbnails shared by everything drawing them,
+ *  with the thumbnail files read in worker threads
+ */
+
+typedef struct {
+  GdkPixbuf *pixbuf; // NULL whilst loading, or when there is no thumbnail
+  gboolean loading;
+  GList *lru; // Position in cache_lru when there is a pixbuf
+  GSList *updates; // Of ThumbnailUpdateT, for when loading finishes
+} ThumbnailEntryT;
+
+typedef struct {
+  ThumbnailLoadedFunc func;
+  GObject *object;
+} ThumbnailUpdateT;
+
+static GMutex cache_mutex;
+static GHashTable *cache = NULL; // Filename -> ThumbnailEntryT
+static GQueue cache_lru = G_QUEUE_INIT; // Of filenames (the keys of cache), most recently used first
+static gsize cache_bytes = 0;
+static gsize cache_max_bytes = 0;
+static GSList *pending_updates = NULL; // Of ThumbnailUpdateT
+static guint updates_source = 0;
+static GThreadPool *load_pool = NULL;
+
+static gsize pixbuf_bytes ( GdkPixbuf *pixbuf )
+{
+  return gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf);
+}
+
+/**
+ * a_thumbnails_get_cache_size:
+ *
+ * Returns: The memory used by the thumbnails kept in memory, shared by all layers
+ */
+gsize a_thumbnails_get_cache_size ( void )
+{
+  g_mutex_lock ( &cache_mutex );
+  gsize size = cache_bytes;
+  g_mutex_unlock ( &cache_mutex );
+  return size;
+}
+
+static void update_free ( ThumbnailUpdateT *update )
+{
+  g_object_unref ( update->object );
+  g_free ( update );
+}
+
+static void entry_free ( ThumbnailEntryT *entry )
+{
+  if ( entry->pixbuf )
+    g_object_unref ( entry->pixbuf );
+  g_slist_free_full ( entry->updates, (GDestroyNotify)update_free );
+  g_free ( entry );
+}
+
+/**
+ * Remove an entry, which must not be loading. cache_mutex must be held
+ */
+static void cache_remove ( const gchar *filename, ThumbnailEntryT *entry )
+{
+  if ( entry->lru ) {
+    cache_bytes -= pixbuf_bytes ( entry->pixbuf );
+    g_queue_delete_link ( &cache_lru, entry->lru );
+  }
+  g_hash_table_remove ( cache, filename );
+}
+
+static void cache_forget ( const gchar *filename )
+{
+  g_mutex_lock ( &cache_mutex );
+  ThumbnailEntryT *entry = cache ? g_hash_table_lookup ( cache, filename ) : NULL;
+  if ( entry && !entry->loading )
+    cache_remove ( filename, entry );
+  g_mutex_unlock ( &cache_mutex );
+}
+
+static gboolean run_updates ( gpointer data )
+{
+  g_mutex_lock ( &cache_mutex );
+  GSList *updates = pending_updates;
+  pending_updates = NULL;
+  updates_source = 0;
+  g_mutex_unlock ( &cache_mutex );
+
+  // Only once per object, however many of its thumbnails were loaded
+  GHashTable *done = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  for ( GSList *iter = updates; iter; iter = iter->next ) {
+    ThumbnailUpdateT *update = iter->data;
+    if ( !g_hash_table_contains ( done, update->object ) ) {
+      g_hash_table_add ( done, update->object );
+      update->func ( update->object );
+    }
+  }
+  g_hash_table_destroy ( done );
+  g_slist_free_full ( updates, (GDestroyNotify)update_free );
+  return FALSE;
+}
+
+static void load_thread ( gchar *filename, gpointer user_data )
+{
+  GdkPixbuf *pixbuf = a_thumbnails_get ( filename );
+
+  g_mutex_lock ( &cache_mutex );
+  ThumbnailEntryT *entry = g_hash_table_lookup ( cache, filename );
+  if ( entry ) {
+    entry->loading = FALSE;
+    if ( pixbuf ) {
+      entry->pixbuf = pixbuf;
+      gpointer key;
+      (void)g_hash_table_lookup_extended ( cache, filename, &key, NULL );
+      g_queue_push_head ( &cache_lru, key );
+      entry->lru = cache_lru.head;
+      cache_bytes += pixbuf_bytes ( pixbuf );
+      // Make room by dropping the least recently used
+      while ( cache_bytes > cache_max_bytes && cache_lru.length > 1 ) {
+        const gchar *oldest = g_queue_peek_tail ( &cache_lru );
+        cache_remove ( oldest, g_hash_table_lookup(cache, oldest) );
+      }
+    }
+    pending_updates = g_slist_concat ( entry->updates, pending_updates );
+    entry->updates = NULL;
+    // Group together the updates of thumbnails loaded around the same time
+    if ( pending_updates && !updates_source )
+      updates_source = gdk_threads_add_timeout ( 100, run_updates, NULL );
+  }
+  else if ( pixbuf )
+    g_object_unref ( pixbuf );
+  g_mutex_unlock ( &cache_mutex );
+
+  g_free ( filename );
+}
+
+/**
+ * a_thumbnails_get_cached:
+ * @filename: The image file
+ * @func:     Called (with @object) once the thumbnail has been loaded, should it not be available yet
+ * @object:   Kept until @func has been called
+ * @loading:  Set to whether the thumbnail is being loaded
+ *
+ * Get the thumbnail from memory. When not there, the thumbnail file is read in the background.
+ *
+ * Returns: A new reference to the thumbnail, or NULL if there is no thumbnail or it is being loaded
+ */
+GdkPixbuf *a_thumbnails_get_cached ( const gchar *filename, ThumbnailLoadedFunc func, GObject *object, gboolean *loading )
+{
+  GdkPixbuf *pixbuf = NULL;
+  *loading = FALSE;
+
+  g_mutex_lock ( &cache_mutex );
+  cache_max_bytes = (gsize)a_vik_get_thumbnail_cache_size() * 1024 * 1024;
+
+  ThumbnailEntryT *entry = g_hash_table_lookup ( cache, filename );
+  if ( !entry ) {
+    entry = g_malloc0 ( sizeof(ThumbnailEntryT) );
+    entry->loading = TRUE;
+    g_hash_table_insert ( cache, g_strdup(filename), entry );
+    g_thread_pool_push ( load_pool, g_strdup(filename), NULL );
+  }
+
+  if ( entry->loading ) {
+    *loading = TRUE;
+    if ( func && object ) {
+      ThumbnailUpdateT *update = g_malloc ( sizeof(ThumbnailUpdateT) );
+      update->func = func;
+      update->object = g_object_ref ( object );
+      entry->updates = g_slist_prepend ( entry->updates, update );
+    }
+  }
+  else if ( entry->pixbuf ) {
+    // Now the most recently used
+    g_queue_unlink ( &cache_lru, entry->lru );
+    g_queue_push_head_link ( &cache_lru, entry->lru );
+    pixbuf = g_object_ref ( entry->pixbuf );
+  }
+  g_mutex_unlock ( &cache_mutex );
+
+  return pixbuf;
+}
+
 /*
  * Startup and finish routines
  */
@@ -311,9 +514,18 @@ out:
 void a_thumbnails_init ()
 {
   set_thumb_dir ();
+  cache = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)entry_free );
+  load_pool = g_thread_pool_new ( (GFunc)load_thread, NULL, util_get_number_of_cpus(), FALSE, NULL );
 }
 
 void a_thumbnails_uninit ()
 {
+  // Any loads not yet started are dropped
+  g_thread_pool_free ( load_pool, TRUE, TRUE );
+  if ( updates_source )
+    g_source_remove ( updates_source );
+  g_slist_free_full ( pending_updates, (GDestroyNotify)update_free );
+  g_queue_clear ( &cache_lru );
+  g_hash_table_destroy ( cache );
   g_free ( thumb_dir );
 }
@@ -24,6 +24,7 @@
 
 #include <glib.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib-object.h>
 
 G_BEGIN_DECLS
 
@@ -36,6 +37,10 @@ GdkPixbuf *a_thumbnails_get(const gchar *filename);
 GdkPixbuf *a_thumbnails_get_default ();
 GdkPixbuf *a_thumbnails_scale_pixbuf(GdkPixbuf *src, int max_w, int max_h);
 
+typedef void (*ThumbnailLoadedFunc) ( GObject *object );
+GdkPixbuf *a_thumbnails_get_cached ( const gchar *filename, ThumbnailLoadedFunc func, GObject *object, gboolean *loading );
+gsize a_thumbnails_get_cache_size ( void );
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,186 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <gio/gio.h>
+#include "tiledecode.h"
+#include "pixbufpool.h"
+
+#ifdef HAVE_LIBJPEG
+#include <stdio.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+#endif
+#ifdef HAVE_LIBPNG
+#include <png.h>
+#endif
+
+/*
+ * Map tiles are nearly all PNG or JPEG, so these are decoded by calling libpng and libjpeg directly,
+ *  without the GdkPixbuf loader modules and the format probing of a loader stream.
+ * The format is taken from the data itself rather than the file extension,
+ *  since some servers send a different format to the one they are named as.
+ * JPEG tiles can be decoded straight to a reduced size (by skipping DCT coefficients),
+ *  which is much quicker when they will be drawn shrunk anyway.
+ * Anything else goes through GdkPixbuf as before.
+ *
+ * The pixels are decoded straight into buffers from the pixbuf pool.
+ */
+
+/**
+ * Any format that GdkPixbuf supports
+ */
+static GdkPixbuf *decode_generic ( GBytes *bytes, GError **error )
+{
+  GInputStream *stream = g_memory_input_stream_new_from_bytes ( bytes );
+  GdkPixbuf *pixbuf = gdk_pixbuf_new_from_stream ( stream, NULL, error );
+  g_input_stream_close ( stream, NULL, NULL );
+  g_object_unref ( stream );
+  return pixbuf;
+}
+
+#ifdef HAVE_LIBJPEG
+typedef struct {
+  struct jpeg_error_mgr pub;
+  jmp_buf setjmp_buffer;
+  char message[JMSG_LENGTH_MAX];
+} JpegErrorT;
+
+static void jpeg_error_exit ( j_common_ptr cinfo )
+{
+  JpegErrorT *err = (JpegErrorT*)cinfo->err;
+  (*cinfo->err->format_message) ( cinfo, err->message );
+  longjmp ( err->setjmp_buffer, 1 );
+}
+
+static void jpeg_output_message ( j_common_ptr cinfo )
+{
+  // Warnings about slightly damaged data are not worth reporting for a tile
+}
+
+static GdkPixbuf *decode_jpeg ( GBytes *bytes, guint reduce, GError **error )
+{
+  gsize size;
+  const guchar *data = g_bytes_get_data ( bytes, &size );
+  struct jpeg_decompress_struct cinfo;
+  JpegErrorT jerr;
+  guchar * volatile pixels = NULL;
+
+  cinfo.err = jpeg_std_error ( &jerr.pub );
+  jerr.pub.error_exit = jpeg_error_exit;
+  jerr.pub.output_message = jpeg_output_message;
+  if ( setjmp ( jerr.setjmp_buffer ) ) {
+    jpeg_destroy_decompress ( &cinfo );
+    if ( pixels )
+      a_pixbuf_pool_free ( pixels, NULL );
+    g_set_error ( error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_CORRUPT_IMAGE, "%s", jerr.message );
+    return NULL;
+  }
+
+  jpeg_create_decompress ( &cinfo );
+  jpeg_mem_src ( &cinfo, (unsigned char*)data, size );
+  (void)jpeg_read_header ( &cinfo, TRUE );
+  if ( cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK ) {
+    // Adobe's inverted CMYK needs the handling in the GdkPixbuf loader
+    jpeg_destroy_decompress ( &cinfo );
+    return decode_generic ( bytes, error );
+  }
+  cinfo.out_color_space = JCS_RGB;
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = reduce;
+  (void)jpeg_start_decompress ( &cinfo );
+
+  gint width = cinfo.output_width;
+  gint height = cinfo.output_height;
+  gint rowstride = a_pixbuf_pool_rowstride ( FALSE, width );
+  pixels = a_pixbuf_pool_alloc ( (gsize)rowstride * height );
+  while ( cinfo.output_scanline < cinfo.output_height ) {
+    JSAMPROW row = pixels + (gsize)cinfo.output_scanline * rowstride;
+    (void)jpeg_read_scanlines ( &cinfo, &row, 1 );
+  }
+  (void)jpeg_finish_decompress ( &cinfo );
+  jpeg_destroy_decompress ( &cinfo );
+
+  return a_pixbuf_pool_wrap ( pixels, FALSE, width, height, rowstride );
+}
+#endif
+
+#ifdef HAVE_LIBPNG
+static GdkPixbuf *decode_png ( GBytes *bytes, GError **error )
+{
+  gsize size;
+  const guchar *data = g_bytes_get_data ( bytes, &size );
+  png_image image;
+  memset ( &image, 0, sizeof(png_image) );
+  image.version = PNG_IMAGE_VERSION;
+
+  if ( !png_image_begin_read_from_memory ( &image, data, size ) ) {
+    g_set_error ( error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_CORRUPT_IMAGE, "%s", image.message );
+    png_image_free ( &image );
+    return NULL;
+  }
+
+  // Including palettes with transparency
+  gboolean has_alpha = ( image.format & PNG_FORMAT_FLAG_ALPHA ) != 0;
+  image.format = has_alpha ? PNG_FORMAT_RGBA : PNG_FORMAT_RGB;
+  gint rowstride = a_pixbuf_pool_rowstride ( has_alpha, image.width );
+  guchar *pixels = a_pixbuf_pool_alloc ( (gsize)rowstride * image.height );
+
+  if ( !png_image_finish_read ( &image, NULL, pixels, rowstride, NULL ) ) {
+    g_set_error ( error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_CORRUPT_IMAGE, "%s", image.message );
+    png_image_free ( &image );
+    a_pixbuf_pool_free ( pixels, NULL );
+    return NULL;
+  }
+
+  return a_pixbuf_pool_wrap ( pixels, has_alpha, image.width, image.height, rowstride );
+}
+#endif
+
+/**
+ * a_tile_decode:
+ * @bytes:  The image file data
+ * @reduce: The tile will not be drawn larger than 1/reduce of its size, for 1, 2, 4 or 8
+ *
+ * Returns: The image, which may be smaller than the tile by up to the reduction given
+ */
+GdkPixbuf *a_tile_decode ( GBytes *bytes, guint reduce, GError **error )
+{
+  gsize size;
+  const guchar *data = g_bytes_get_data ( bytes, &size );
+
+  if ( reduce != 2 && reduce != 4 && reduce != TILE_DECODE_MAX_REDUCE )
+    reduce = 1;
+
+#ifdef HAVE_LIBJPEG
+  if ( size > 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF )
+    return decode_jpeg ( bytes, reduce, error );
+#endif
+#ifdef HAVE_LIBPNG
+  if ( size > 8 && memcmp ( data, "\x89PNG\r\n\x1a\n", 8 ) == 0 )
+    return decode_png ( bytes, error );
+#endif
+
+  (void)data;
+  (void)size;
+  return decode_generic ( bytes, error );
+}
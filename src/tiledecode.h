@@ -0,0 +1,38 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_TILEDECODE_H
+#define __VIKING_TILEDECODE_H
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+// The largest reduction a tile can be decoded at
+#define TILE_DECODE_MAX_REDUCE 8
+
+// Decode map tile image data
+// Reduce is a hint that the tile will be drawn at 1/reduce of its size or smaller (1, 2, 4 or 8),
+//  in which case the image returned may be smaller by up to that factor
+GdkPixbuf *a_tile_decode ( GBytes *bytes, guint reduce, GError **error );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,310 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "tileset.h"
+
+#define BLOCK_SIZE 64
+#define BLOCK_TILES (BLOCK_SIZE*BLOCK_SIZE)
+
+// Floor division, so negative positions (e.g. neighbours of tile 0) also work
+#define BLOCK_OF(v) ((v) >= 0 ? (v) / BLOCK_SIZE : -((-((v)+1)) / BLOCK_SIZE) - 1)
+#define INDEX_IN_BLOCK(v) ((guint)((v) - BLOCK_OF(v) * BLOCK_SIZE))
+
+typedef struct {
+  gint64 key;                // Packed block position, also used as the hash table key
+  gint bx, by;               // Block position
+  guint64 rows[BLOCK_SIZE];  // One bit per tile: bit x of rows[y]
+  guint *labels;             // BLOCK_TILES values, only allocated when a label is first set
+  guint *counts;             // BLOCK_TILES reference counts, only allocated when first used
+} TileBlock;
+
+struct _TileSet {
+  GHashTable *blocks;
+  guint size;
+};
+
+static inline gint64 block_key ( gint bx, gint by )
+{
+  return (gint64)(((guint64)(guint32)bx << 32) | (guint32)by);
+}
+
+static void block_free ( TileBlock *blk )
+{
+  g_free ( blk->labels );
+  g_free ( blk->counts );
+  g_free ( blk );
+}
+
+TileSet *a_tileset_new ( void )
+{
+  TileSet *ts = g_malloc0 ( sizeof(TileSet) );
+  ts->blocks = g_hash_table_new_full ( g_int64_hash, g_int64_equal, NULL, (GDestroyNotify)block_free );
+  return ts;
+}
+
+void a_tileset_free ( TileSet *ts )
+{
+  if ( !ts )
+    return;
+  g_hash_table_destroy ( ts->blocks );
+  g_free ( ts );
+}
+
+void a_tileset_clear ( TileSet *ts )
+{
+  g_hash_table_remove_all ( ts->blocks );
+  ts->size = 0;
+}
+
+guint a_tileset_size ( TileSet *ts )
+{
+  return ts->size;
+}
+
+static inline TileBlock *get_block ( TileSet *ts, gint bx, gint by )
+{
+  gint64 key = block_key ( bx, by );
+  return g_hash_table_lookup ( ts->blocks, &key );
+}
+
+static TileBlock *get_or_create_block ( TileSet *ts, gint bx, gint by )
+{
+  TileBlock *blk = get_block ( ts, bx, by );
+  if ( !blk ) {
+    blk = g_malloc0 ( sizeof(TileBlock) );
+    blk->key = block_key ( bx, by );
+    blk->bx = bx;
+    blk->by = by;
+    g_hash_table_insert ( ts->blocks, &blk->key, blk );
+  }
+  return blk;
+}
+
+/**
+ * a_tileset_add:
+ *
+ * Returns: TRUE if the tile was not already in the set
+ */
+gboolean a_tileset_add ( TileSet *ts, gint x, gint y )
+{
+  TileBlock *blk = get_or_create_block ( ts, BLOCK_OF(x), BLOCK_OF(y) );
+  guint64 bit = G_GUINT64_CONSTANT(1) << INDEX_IN_BLOCK(x);
+  guint64 *row = &blk->rows[INDEX_IN_BLOCK(y)];
+  if ( *row & bit )
+    return FALSE;
+  *row |= bit;
+  ts->size++;
+  return TRUE;
+}
+
+/**
+ * a_tileset_remove:
+ *
+ * Returns: TRUE if the tile was in the set
+ */
+gboolean a_tileset_remove ( TileSet *ts, gint x, gint y )
+{
+  TileBlock *blk = get_block ( ts, BLOCK_OF(x), BLOCK_OF(y) );
+  if ( !blk )
+    return FALSE;
+  guint64 bit = G_GUINT64_CONSTANT(1) << INDEX_IN_BLOCK(x);
+  guint64 *row = &blk->rows[INDEX_IN_BLOCK(y)];
+  if ( !(*row & bit) )
+    return FALSE;
+  *row &= ~bit;
+  guint idx = INDEX_IN_BLOCK(y) * BLOCK_SIZE + INDEX_IN_BLOCK(x);
+  if ( blk->labels )
+    blk->labels[idx] = 0;
+  if ( blk->counts )
+    blk->counts[idx] = 0;
+  ts->size--;
+  return TRUE;
+}
+
+/**
+ * a_tileset_ref:
+ *
+ * Add the tile (if necessary) and increase its reference count
+ *
+ * Returns: The new reference count
+ */
+guint a_tileset_ref ( TileSet *ts, gint x, gint y )
+{
+  (void)a_tileset_add ( ts, x, y );
+  TileBlock *blk = get_block ( ts, BLOCK_OF(x), BLOCK_OF(y) );
+  if ( !blk->counts )
+    blk->counts = g_malloc0_n ( BLOCK_TILES, sizeof(guint) );
+  return ++blk->counts[INDEX_IN_BLOCK(y) * BLOCK_SIZE + INDEX_IN_BLOCK(x)];
+}
+
+/**
+ * a_tileset_unref:
+ *
+ * Decrease the reference count of the tile, removing it when there are no more references
+ *
+ * Returns: The new reference count
+ */
+guint a_tileset_unref ( TileSet *ts, gint x, gint y )
+{
+  TileBlock *blk = get_block ( ts, BLOCK_OF(x), BLOCK_OF(y) );
+  if ( !blk || !blk->counts )
+    return 0;
+  guint *count = &blk->counts[INDEX_IN_BLOCK(y) * BLOCK_SIZE + INDEX_IN_BLOCK(x)];
+  if ( *count == 0 )
+    return 0;
+  if ( --(*count) == 0 )
+    (void)a_tileset_remove ( ts, x, y );
+  return *count;
+}
+
+gboolean a_tileset_contains ( TileSet *ts, gint x, gint y )
+{
+  TileBlock *blk = get_block ( ts, BLOCK_OF(x), BLOCK_OF(y) );
+  if ( !blk )
+    return FALSE;
+  return (blk->rows[INDEX_IN_BLOCK(y)] >> INDEX_IN_BLOCK(x)) & 1;
+}
+
+/**
+ * a_tileset_contains_run:
+ *
+ * Returns: TRUE if all the @n tiles from @x to @x+@n-1 in row @y are in the set
+ */
+gboolean a_tileset_contains_run ( TileSet *ts, gint x, gint y, guint n )
+{
+  const guint iy = INDEX_IN_BLOCK(y);
+  const gint by = BLOCK_OF(y);
+  while ( n ) {
+    TileBlock *blk = get_block ( ts, BLOCK_OF(x), by );
+    if ( !blk )
+      return FALSE;
+    guint ix = INDEX_IN_BLOCK(x);
+    guint take = MIN ( n, BLOCK_SIZE - ix );
+    guint64 mask = (take == BLOCK_SIZE) ? G_MAXUINT64 : ((G_GUINT64_CONSTANT(1) << take) - 1) << ix;
+    if ( (blk->rows[iy] & mask) != mask )
+      return FALSE;
+    x += take;
+    n -= take;
+  }
+  return TRUE;
+}
+
+static inline guint count_bits ( guint64 bits )
+{
+  guint count = 0;
+  for ( ; bits; count++ )
+    bits &= bits - 1;
+  return count;
+}
+
+/**
+ * a_tileset_union:
+ *
+ * Add all the tiles of @other into @ts (labels are not copied)
+ *
+ * Returns: The number of tiles that were not already in @ts
+ */
+guint a_tileset_union ( TileSet *ts, TileSet *other )
+{
+  guint added = 0;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, other->blocks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    TileBlock *src = value;
+    TileBlock *blk = get_or_create_block ( ts, src->bx, src->by );
+    for ( guint iy = 0; iy < BLOCK_SIZE; iy++ ) {
+      guint64 new_bits = src->rows[iy] & ~blk->rows[iy];
+      if ( new_bits ) {
+        blk->rows[iy] |= new_bits;
+        added += count_bits ( new_bits );
+      }
+    }
+  }
+  ts->size += added;
+  return added;
+}
+
+void a_tileset_set_label ( TileSet *ts, gint x, gint y, guint label )
+{
+  (void)a_tileset_add ( ts, x, y );
+  TileBlock *blk = get_block ( ts, BLOCK_OF(x), BLOCK_OF(y) );
+  if ( !blk->labels ) {
+    if ( !label )
+      return;
+    blk->labels = g_malloc0_n ( BLOCK_TILES, sizeof(guint) );
+  }
+  blk->labels[INDEX_IN_BLOCK(y) * BLOCK_SIZE + INDEX_IN_BLOCK(x)] = label;
+}
+
+guint a_tileset_get_label ( TileSet *ts, gint x, gint y )
+{
+  TileBlock *blk = get_block ( ts, BLOCK_OF(x), BLOCK_OF(y) );
+  if ( !blk || !blk->labels )
+    return 0;
+  return blk->labels[INDEX_IN_BLOCK(y) * BLOCK_SIZE + INDEX_IN_BLOCK(x)];
+}
+
+void a_tileset_iter_init ( TileSetIter *iter, TileSet *ts )
+{
+  g_hash_table_iter_init ( &iter->block_iter, ts->blocks );
+  iter->block = NULL;
+  iter->index = 0;
+}
+
+/**
+ * a_tileset_iter_next:
+ *
+ * Tiles are returned in row order within each block, but the blocks are in no particular order
+ *
+ * Returns: FALSE when there are no more tiles
+ */
+gboolean a_tileset_iter_next ( TileSetIter *iter, gint *x, gint *y )
+{
+  while ( TRUE ) {
+    TileBlock *blk = iter->block;
+    if ( blk ) {
+      while ( iter->index < BLOCK_TILES ) {
+        guint iy = iter->index / BLOCK_SIZE;
+        guint ix = iter->index % BLOCK_SIZE;
+        guint64 bits = blk->rows[iy] >> ix;
+        if ( !bits ) {
+          // Nothing more in this row
+          iter->index = (iy + 1) * BLOCK_SIZE;
+          continue;
+        }
+        while ( !(bits & 1) ) {
+          bits >>= 1;
+          ix++;
+        }
+        iter->index = iy * BLOCK_SIZE + ix + 1;
+        *x = blk->bx * BLOCK_SIZE + (gint)ix;
+        *y = blk->by * BLOCK_SIZE + (gint)iy;
+        return TRUE;
+      }
+    }
+    gpointer key, value;
+    if ( !g_hash_table_iter_next ( &iter->block_iter, &key, &value ) )
+      return FALSE;
+    iter->block = value;
+    iter->index = 0;
+  }
+}
@@ -0,0 +1,63 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_TILESET_H
+#define __VIKING_TILESET_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// A sparse set of tile positions (e.g. as visited by tracks), with an optional label per tile
+// Stored as 64x64 blocks of bits, so neighbouring tiles can be tested with simple bit operations
+// Not thread safe - callers must arrange their own locking if shared between threads
+typedef struct _TileSet TileSet;
+
+TileSet *a_tileset_new ( void );
+void a_tileset_free ( TileSet *ts );
+void a_tileset_clear ( TileSet *ts );
+guint a_tileset_size ( TileSet *ts );
+
+gboolean a_tileset_add ( TileSet *ts, gint x, gint y );
+gboolean a_tileset_remove ( TileSet *ts, gint x, gint y );
+gboolean a_tileset_contains ( TileSet *ts, gint x, gint y );
+gboolean a_tileset_contains_run ( TileSet *ts, gint x, gint y, guint n );
+guint a_tileset_union ( TileSet *ts, TileSet *other );
+
+// Reference counting of tiles, e.g. for the number of tracks visiting each tile
+guint a_tileset_ref ( TileSet *ts, gint x, gint y );
+guint a_tileset_unref ( TileSet *ts, gint x, gint y );
+
+// Labels are 0 unless set; setting a label also adds the tile
+void a_tileset_set_label ( TileSet *ts, gint x, gint y, guint label );
+guint a_tileset_get_label ( TileSet *ts, gint x, gint y );
+
+typedef struct {
+  GHashTableIter block_iter;
+  gpointer block;
+  guint index;
+} TileSetIter;
+
+// As per GHashTableIter, the set must not be changed during iteration (although labels may be)
+void a_tileset_iter_init ( TileSetIter *iter, TileSet *ts );
+gboolean a_tileset_iter_next ( TileSetIter *iter, gint *x, gint *y );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include "trace.h"
+
+gboolean vik_trace = FALSE;
+
+// Events kept per thread (a power of 2), the oldest being overwritten
+#define TRACE_BUFFER_SIZE 16384
+// Events this close to being overwritten are not saved, as a thread may be writing to them meanwhile
+#define TRACE_BUFFER_SLACK 256
+
+typedef struct {
+  gint64 timestamp;
+  const gchar *category;
+  const gchar *name;
+  const gchar *arg[3];
+  gint64 val[3];
+  gchar phase;
+} trace_event_t;
+
+typedef struct {
+  guint tid;
+  gboolean main_thread;
+  gint count; // Atomic - total events written, so the next position is count % TRACE_BUFFER_SIZE
+  trace_event_t events[TRACE_BUFFER_SIZE];
+} trace_buffer_t;
+
+// Buffers are never freed, so that events remain after pool threads have ended
+static GPrivate thread_buffer;
+static GMutex buffers_lock;
+static GSList *buffers = NULL;
+static guint next_tid = 1;
+static gint64 trace_start = 0;
+
+/**
+ * a_trace_start:
+ *
+ * Start recording events, from which point it continues until the program ends
+ */
+void a_trace_start ( void )
+{
+  if ( vik_trace )
+    return;
+  trace_start = g_get_monotonic_time ();
+  vik_trace = TRUE;
+}
+
+static trace_buffer_t *get_thread_buffer ( void )
+{
+  trace_buffer_t *buf = g_private_get ( &thread_buffer );
+  if ( G_UNLIKELY(!buf) ) {
+    buf = g_new0 ( trace_buffer_t, 1 );
+    buf->main_thread = g_main_context_is_owner ( g_main_context_default() );
+    g_mutex_lock ( &buffers_lock );
+    buf->tid = next_tid++;
+    buffers = g_slist_prepend ( buffers, buf );
+    g_mutex_unlock ( &buffers_lock );
+    g_private_set ( &thread_buffer, buf );
+  }
+  return buf;
+}
+
+/**
+ * a_trace_event:
+ * @phase: One of the TRACE_PHASE_ values
+ * @arg1: Optional name of the first value (and similarly for the others)
+ *
+ * Normally use the VIK_TRACE macros instead, which only call this when tracing
+ */
+void a_trace_event ( const gchar *category, const gchar *name, gchar phase,
+                     const gchar *arg1, gint64 val1, const gchar *arg2, gint64 val2, const gchar *arg3, gint64 val3 )
+{
+  trace_buffer_t *buf = get_thread_buffer ();
+  // Only this thread writes to the buffer
+  gint count = g_atomic_int_get ( &buf->count );
+  trace_event_t *ev = &buf->events[count & (TRACE_BUFFER_SIZE-1)];
+  ev->timestamp = g_get_monotonic_time ();
+  ev->category = category;
+  ev->name = name;
+  ev->phase = phase;
+  ev->arg[0] = arg1;
+  ev->val[0] = val1;
+  ev->arg[1] = arg2;
+  ev->val[1] = val2;
+  ev->arg[2] = arg3;
+  ev->val[2] = val3;
+  // Publish the event for saving
+  g_atomic_int_set ( &buf->count, count + 1 );
+}
+
+static void write_buffer ( FILE *ff, trace_buffer_t *buf, gboolean *first )
+{
+  (void)fprintf ( ff, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}",
+                  *first ? "" : ",", buf->tid, buf->main_thread ? "main" : "thread", buf->tid );
+  *first = FALSE;
+
+  gint count = g_atomic_int_get ( &buf->count );
+  gint oldest = MAX ( 0, count - TRACE_BUFFER_SIZE + TRACE_BUFFER_SLACK );
+  for ( gint nn = oldest; nn < count; nn++ ) {
+    trace_event_t *ev = &buf->events[nn & (TRACE_BUFFER_SIZE-1)];
+    (void)fprintf ( ff, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%" G_GINT64_FORMAT ",\"pid\":1,\"tid\":%u",
+                    ev->name, ev->category, ev->phase, ev->timestamp - trace_start, buf->tid );
+    if ( ev->phase == TRACE_PHASE_INSTANT )
+      (void)fprintf ( ff, ",\"s\":\"t\"" );
+    if ( ev->arg[0] ) {
+      (void)fprintf ( ff, ",\"args\":{" );
+      for ( guint aa = 0; aa < G_N_ELEMENTS(ev->arg) && ev->arg[aa]; aa++ )
+        (void)fprintf ( ff, "%s\"%s\":%" G_GINT64_FORMAT, aa ? "," : "", ev->arg[aa], ev->val[aa] );
+      (void)fprintf ( ff, "}" );
+    }
+    (void)fprintf ( ff, "}" );
+  }
+}
+
+/**
+ * a_trace_save:
+ *
+ * Write the events recorded so far in the Chrome JSON trace format.
+ * Recording carries on meanwhile.
+ */
+gboolean a_trace_save ( const gchar *filename, GError **error )
+{
+  FILE *ff = g_fopen ( filename, "w" );
+  if ( !ff ) {
+    g_set_error_literal ( error, G_FILE_ERROR, g_file_error_from_errno(errno), g_strerror(errno) );
+    return FALSE;
+  }
+
+  (void)fprintf ( ff, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" );
+  gboolean first = TRUE;
+  g_mutex_lock ( &buffers_lock );
+  for ( GSList *iter = buffers; iter; iter = iter->next )
+    write_buffer ( ff, iter->data, &first );
+  g_mutex_unlock ( &buffers_lock );
+  (void)fprintf ( ff, "\n]}\n" );
+
+  gboolean ans = !ferror ( ff );
+  if ( fclose ( ff ) != 0 )
+    ans = FALSE;
+  if ( !ans )
+    g_set_error ( error, G_FILE_ERROR, G_FILE_ERROR_IO, "Failed to write %s", filename );
+  return ans;
+}
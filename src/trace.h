@@ -0,0 +1,57 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_TRACE_H
+#define __VIKING_TRACE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Opt in tracing of what the threads are doing, saved in the Chrome trace event format
+//  (as viewed by chrome://tracing or https://ui.perfetto.dev)
+//
+// Each thread records into its own ring buffer without locking, so only the most recent events are kept.
+// The category and name must be static strings, as only the pointers are stored.
+
+// Whether events are being recorded - only to be changed by a_trace_start()
+extern gboolean vik_trace;
+
+#define TRACE_PHASE_BEGIN   'B'
+#define TRACE_PHASE_END     'E'
+#define TRACE_PHASE_INSTANT 'i'
+
+void a_trace_start ( void );
+void a_trace_event ( const gchar *category, const gchar *name, gchar phase,
+                     const gchar *arg1, gint64 val1, const gchar *arg2, gint64 val2, const gchar *arg3, gint64 val3 );
+gboolean a_trace_save ( const gchar *filename, GError **error );
+
+// Check the flag inline, so that there is negligible cost when not tracing
+#define VIK_TRACE(cat,name,phase) \
+  G_STMT_START { if ( G_UNLIKELY(vik_trace) ) a_trace_event ( cat, name, phase, NULL, 0, NULL, 0, NULL, 0 ); } G_STMT_END
+#define VIK_TRACE_ARG(cat,name,phase,arg,val) \
+  G_STMT_START { if ( G_UNLIKELY(vik_trace) ) a_trace_event ( cat, name, phase, arg, val, NULL, 0, NULL, 0 ); } G_STMT_END
+#define VIK_TRACE_ARGS(cat,name,phase,arg1,val1,arg2,val2) \
+  G_STMT_START { if ( G_UNLIKELY(vik_trace) ) a_trace_event ( cat, name, phase, arg1, val1, arg2, val2, NULL, 0 ); } G_STMT_END
+#define VIK_TRACE_TILE(cat,name,phase,x,y,z) \
+  G_STMT_START { if ( G_UNLIKELY(vik_trace) ) a_trace_event ( cat, name, phase, "x", x, "y", y, "z", z ); } G_STMT_END
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,295 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <math.h>
+#include "trackarea.h"
+
+/*
+ * Positions are treated as flat latitude/longitude coordinates,
+ *  which is accurate enough for areas drawn on the map (and not across the antimeridian).
+ */
+
+// Fewer tracks than this per thread are not worth starting another for
+#define FIND_MIN_PER_THREAD 8
+
+struct _TrackArea {
+  guint count;
+  struct LatLon *points;
+  LatLonBBox bbox;
+};
+
+TrackArea *a_track_area_new_polygon ( const struct LatLon *points, guint count )
+{
+  g_return_val_if_fail ( count >= 3, NULL );
+
+  TrackArea *area = g_malloc ( sizeof(TrackArea) );
+  area->count = count;
+  area->points = g_memdup ( points, count * sizeof(struct LatLon) );
+  area->bbox.north = area->bbox.south = points[0].lat;
+  area->bbox.east = area->bbox.west = points[0].lon;
+  for ( guint ii = 1; ii < count; ii++ ) {
+    area->bbox.north = MAX ( area->bbox.north, points[ii].lat );
+    area->bbox.south = MIN ( area->bbox.south, points[ii].lat );
+    area->bbox.east = MAX ( area->bbox.east, points[ii].lon );
+    area->bbox.west = MIN ( area->bbox.west, points[ii].lon );
+  }
+  return area;
+}
+
+TrackArea *a_track_area_new_bbox ( LatLonBBox bbox )
+{
+  struct LatLon corners[4] = { { bbox.north, bbox.west }, { bbox.north, bbox.east },
+                               { bbox.south, bbox.east }, { bbox.south, bbox.west } };
+  return a_track_area_new_polygon ( corners, 4 );
+}
+
+void a_track_area_free ( TrackArea *area )
+{
+  if ( !area )
+    return;
+  g_free ( area->points );
+  g_free ( area );
+}
+
+LatLonBBox a_track_area_get_bbox ( const TrackArea *area )
+{
+  return area->bbox;
+}
+
+static inline gboolean bbox_overlaps ( const LatLonBBox *a, const LatLonBBox *b )
+{
+  // Inclusive, as either may be just a single position
+  return a->south <= b->north && a->north >= b->south && a->west <= b->east && a->east >= b->west;
+}
+
+/**
+ * Even-odd rule: whether a line from the position crosses the boundary an odd number of times
+ */
+static gboolean area_contains ( const TrackArea *area, const struct LatLon *ll )
+{
+  if ( ll->lat < area->bbox.south || ll->lat > area->bbox.north ||
+       ll->lon < area->bbox.west || ll->lon > area->bbox.east )
+    return FALSE;
+  gboolean inside = FALSE;
+  for ( guint ii = 0, jj = area->count - 1; ii < area->count; jj = ii++ ) {
+    const struct LatLon *a = &area->points[ii];
+    const struct LatLon *b = &area->points[jj];
+    if ( (a->lat > ll->lat) != (b->lat > ll->lat) &&
+         ll->lon < (b->lon - a->lon) * (ll->lat - a->lat) / (b->lat - a->lat) + a->lon )
+      inside = !inside;
+  }
+  return inside;
+}
+
+static gint compare_doubles ( gconstpointer a, gconstpointer b )
+{
+  gdouble aa = *(const gdouble*)a;
+  gdouble bb = *(const gdouble*)b;
+  return aa < bb ? -1 : (aa > bb ? 1 : 0);
+}
+
+/**
+ * The fractions along the line where it crosses the boundary, in order
+ */
+static void area_crossings ( const TrackArea *area, const struct LatLon *p0, const struct LatLon *p1, GArray *crossings )
+{
+  g_array_set_size ( crossings, 0 );
+  const gdouble dx = p1->lon - p0->lon;
+  const gdouble dy = p1->lat - p0->lat;
+  for ( guint ii = 0; ii < area->count; ii++ ) {
+    const struct LatLon *a = &area->points[ii];
+    const struct LatLon *b = &area->points[(ii + 1) % area->count];
+    const gdouble ex = b->lon - a->lon;
+    const gdouble ey = b->lat - a->lat;
+    const gdouble denom = dx * ey - dy * ex;
+    if ( denom == 0.0 )
+      continue; // Parallel
+    const gdouble t = ((a->lon - p0->lon) * ey - (a->lat - p0->lat) * ex) / denom;
+    const gdouble u = ((a->lon - p0->lon) * dy - (a->lat - p0->lat) * dx) / denom;
+    if ( t > 0.0 && t < 1.0 && u >= 0.0 && u < 1.0 )
+      g_array_append_val ( crossings, t );
+  }
+  if ( crossings->len > 1 )
+    g_array_sort ( crossings, compare_doubles );
+}
+
+typedef struct {
+  const TrackArea *area;
+  GArray *spans;
+  gboolean open;        // The last span continues to the current trackpoint
+  GList *last;          // The trackpoint last considered and its position
+  struct LatLon last_ll;
+  GArray *crossings;
+} AreaTrack;
+
+static void area_track_inside ( AreaTrack *at, gdouble start, gdouble end )
+{
+  if ( at->open ) {
+    g_array_index ( at->spans, TrackAreaSpan, at->spans->len-1 ).end = end;
+    return;
+  }
+  TrackAreaSpan span = { start, end };
+  g_array_append_val ( at->spans, span );
+  at->open = TRUE;
+}
+
+/**
+ * Follow the line from the previous trackpoint, in and out of the area
+ */
+static void area_track_line ( AreaTrack *at, const VikTrackpoint *tp0, const struct LatLon *p0, const VikTrackpoint *tp1, const struct LatLon *p1 )
+{
+  LatLonBBox line = { MIN(p0->lat, p1->lat), MAX(p0->lat, p1->lat), MAX(p0->lon, p1->lon), MIN(p0->lon, p1->lon) };
+  if ( !bbox_overlaps ( &line, &at->area->bbox ) ) {
+    at->open = FALSE;
+    return;
+  }
+
+  gboolean timed = !isnan(tp0->timestamp) && !isnan(tp1->timestamp);
+  gdouble duration = timed ? tp1->timestamp - tp0->timestamp : NAN;
+  gboolean inside = area_contains ( at->area, p0 );
+  // Continuing inside from the previous line
+  if ( !inside )
+    at->open = FALSE;
+  area_crossings ( at->area, p0, p1, at->crossings );
+  gdouble from = 0.0;
+  for ( guint ii = 0; ii <= at->crossings->len; ii++ ) {
+    gdouble to = ii < at->crossings->len ? g_array_index ( at->crossings, gdouble, ii ) : 1.0;
+    if ( inside ) {
+      area_track_inside ( at, tp0->timestamp + from * duration, tp0->timestamp + to * duration );
+      if ( to < 1.0 )
+        at->open = FALSE;
+    }
+    inside = !inside;
+    from = to;
+  }
+}
+
+static void area_track_point ( AreaTrack *at, GList *iter )
+{
+  const VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+  struct LatLon ll;
+  vik_coord_to_latlon ( &tp->coord, &ll );
+
+  if ( !iter->prev || tp->newsegment ) {
+    at->open = FALSE;
+    if ( area_contains ( at->area, &ll ) )
+      area_track_inside ( at, tp->timestamp, tp->timestamp );
+  }
+  else {
+    struct LatLon prev_ll;
+    if ( at->last == iter->prev )
+      prev_ll = at->last_ll;
+    else
+      vik_coord_to_latlon ( &VIK_TRACKPOINT(iter->prev->data)->coord, &prev_ll );
+    area_track_line ( at, VIK_TRACKPOINT(iter->prev->data), &prev_ll, tp, &ll );
+  }
+  at->last = iter;
+  at->last_ll = ll;
+}
+
+/**
+ * Returns: The times the track was inside the area, or NULL if never
+ */
+static GArray *area_track ( VikTrack *trk, const TrackArea *area )
+{
+  AreaTrack at = { area, g_array_new ( FALSE, FALSE, sizeof(TrackAreaSpan) ), FALSE, NULL, { 0.0, 0.0 },
+                   g_array_new ( FALSE, FALSE, sizeof(gdouble) ) };
+
+  GArray *chunks = vik_track_get_chunks ( trk, trk->trackpoints );
+  for ( guint ii = 0; ii < chunks->len; ii++ ) {
+    VikTrackChunk *chunk = &g_array_index ( chunks, VikTrackChunk, ii );
+    if ( bbox_overlaps ( &chunk->bbox, &area->bbox ) ) {
+      GList *iter = chunk->start;
+      for ( guint jj = 0; jj < chunk->count && iter; jj++, iter = iter->next )
+        area_track_point ( &at, iter );
+    }
+    else {
+      // Only the line joining on from the previous run may reach the area
+      area_track_point ( &at, chunk->start );
+      at.open = FALSE;
+    }
+  }
+  g_array_free ( at.crossings, TRUE );
+
+  if ( !at.spans->len ) {
+    g_array_free ( at.spans, TRUE );
+    return NULL;
+  }
+  return at.spans;
+}
+
+typedef struct {
+  VikTrack **tracks;
+  const guint *candidates;
+  guint count;
+  const TrackArea *area;
+  GArray **results;
+  gint next; // Atomic
+} AreaFind;
+
+static gpointer area_find_run ( gpointer data )
+{
+  AreaFind *af = data;
+  guint nn;
+  // Tracks vary greatly in size, so each thread takes the next one whenever it is free
+  while ( (nn = (guint)g_atomic_int_add ( &af->next, 1 )) < af->count ) {
+    guint ii = af->candidates[nn];
+    af->results[ii] = area_track ( af->tracks[ii], af->area );
+  }
+  return NULL;
+}
+
+GArray **a_track_area_find ( VikTrack **tracks, guint count, const TrackArea *area, guint threads )
+{
+  GArray **results = g_new0 ( GArray*, count );
+
+  guint *candidates = g_new ( guint, count );
+  guint ncandidates = 0;
+  for ( guint ii = 0; ii < count; ii++ )
+    if ( tracks[ii]->trackpoints && bbox_overlaps ( &tracks[ii]->bbox, &area->bbox ) )
+      candidates[ncandidates++] = ii;
+
+  if ( !threads )
+    threads = g_get_num_processors ();
+  threads = CLAMP ( ncandidates / FIND_MIN_PER_THREAD, 1, threads );
+
+  AreaFind af = { tracks, candidates, ncandidates, area, results, 0 };
+  GThread **workers = g_new0 ( GThread*, threads );
+  // This thread is one of them
+  for ( guint tt = 1; tt < threads; tt++ )
+    workers[tt] = g_thread_new ( "trackarea", area_find_run, &af );
+  (void)area_find_run ( &af );
+  for ( guint tt = 1; tt < threads; tt++ )
+    g_thread_join ( workers[tt] );
+  g_free ( workers );
+  g_free ( candidates );
+  return results;
+}
+
+void a_track_area_results_free ( GArray **results, guint count )
+{
+  if ( !results )
+    return;
+  for ( guint ii = 0; ii < count; ii++ )
+    if ( results[ii] )
+      g_array_free ( results[ii], TRUE );
+  g_free ( results );
+}
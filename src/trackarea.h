@@ -0,0 +1,56 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_TRACKAREA_H
+#define __VIKING_TRACKAREA_H
+
+#include <glib.h>
+#include "viktrack.h"
+
+G_BEGIN_DECLS
+
+// An area outlined by a polygon of positions (in order, with the last joining back to the first)
+typedef struct _TrackArea TrackArea;
+
+TrackArea *a_track_area_new_bbox ( LatLonBBox bbox );
+TrackArea *a_track_area_new_polygon ( const struct LatLon *points, guint count );
+void a_track_area_free ( TrackArea *area );
+LatLonBBox a_track_area_get_bbox ( const TrackArea *area );
+
+// A time the track was inside the area, from entering to leaving it
+//  (interpolated between the trackpoints either side of the boundary)
+// The times are NAN when the trackpoints have no timestamps
+typedef struct {
+  gdouble start;
+  gdouble end;
+} TrackAreaSpan;
+
+// Finding which of the tracks pass through the area, including between trackpoints
+// Tracks outside the bounds of the area are skipped straightaway,
+//  then only the runs of trackpoints near the area (see vik_track_get_chunks()) are examined
+// The tracks are shared out over the threads, so they must not be changed meanwhile
+// threads: 0 for one per processor
+// Returns: For each track a #GArray of #TrackAreaSpan, or NULL if it does not pass through
+//  (free with a_track_area_results_free())
+GArray **a_track_area_find ( VikTrack **tracks, guint count, const TrackArea *area, guint threads );
+void a_track_area_results_free ( GArray **results, guint count );
+
+G_END_DECLS
+
+#endif
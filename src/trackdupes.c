@@ -0,0 +1,314 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <math.h>
+#include "trackdupes.h"
+#include "coords.h"
+
+/*
+ * Each track gets several keys from its fingerprint, and the tracks sharing any key are candidates.
+ * A value compared against a tolerance is quantised on two grids offset by half a step,
+ *  so values within half a step of each other always share a key on one of them.
+ *  - Timed: the start and end times
+ *  - Route: the sequence of cells passed through, and the length
+ *  - Ends:  the start and end cells, and the length
+ * Candidates are then compared along the whole of both tracks.
+ */
+
+// Seconds
+#define TIME_STEP 60.0
+#define TIME_TOLERANCE 60.0
+// Relative steps of the length, as log(length)/log(1+LENGTH_STEP)
+#define LENGTH_STEP 0.05
+#define LENGTH_TOLERANCE 0.02
+// Metres, or this fraction of the length if more
+#define DISTANCE_TOLERANCE 50.0
+#define DISTANCE_TOLERANCE_RATIO 0.01
+// 15 bits each of latitude and longitude, which is a geohash of 6 characters (~1.2km x 0.6km at the equator)
+#define CELL_BITS 15
+
+// Fewer comparisons than this per thread are not worth starting another for
+#define VERIFY_MIN_PER_THREAD 16
+
+enum {
+  KEY_TIMED = 1,
+  KEY_ROUTE,
+  KEY_ENDS,
+};
+
+typedef struct {
+  guint count;          // 0 when not fingerprinted
+  struct LatLon *ll;
+  gdouble *dist;        // From the start, in metres
+  gdouble start, end;   // NAN when not known
+} TDTrack;
+
+typedef struct {
+  guint64 key;
+  guint index;
+} TDKey;
+
+static guint64 td_mix ( guint64 hash, guint64 value )
+{
+  // FNV-1a over the 8 bytes
+  for ( guint ii = 0; ii < 8; ii++ ) {
+    hash ^= (value >> (ii*8)) & 0xff;
+    hash *= G_GUINT64_CONSTANT(0x100000001b3);
+  }
+  return hash;
+}
+
+static guint64 td_hash ( guint kind )
+{
+  return td_mix ( G_GUINT64_CONSTANT(0xcbf29ce484222325), kind );
+}
+
+static guint32 td_cell ( const struct LatLon *ll )
+{
+  guint32 max = (1 << CELL_BITS) - 1;
+  guint32 y = CLAMP ( (ll->lat + 90.0) / 180.0 * (1 << CELL_BITS), 0, max );
+  guint32 x = CLAMP ( (ll->lon + 180.0) / 360.0 * (1 << CELL_BITS), 0, max );
+  // Interleave as a geohash does, longitude first
+  guint32 cell = 0;
+  for ( gint bit = CELL_BITS-1; bit >= 0; bit-- )
+    cell = (cell << 2) | (((x >> bit) & 1) << 1) | ((y >> bit) & 1);
+  return cell;
+}
+
+static gint64 td_step ( gdouble value, gdouble step, gboolean offset )
+{
+  return (gint64)floor ( value / step + (offset ? 0.5 : 0.0) );
+}
+
+/**
+ * Fill in the points and times of the track, and add its keys
+ */
+static void td_fingerprint ( VikTrack *trk, guint index, TDTrack *tdt, GArray *keys )
+{
+  guint count = g_list_length ( trk->trackpoints );
+  if ( count < 2 )
+    return;
+
+  tdt->count = count;
+  tdt->ll = g_new ( struct LatLon, count );
+  tdt->dist = g_new ( gdouble, count );
+  guint ii = 0;
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next, ii++ )
+    vik_coord_to_latlon ( &VIK_TRACKPOINT(iter->data)->coord, &tdt->ll[ii] );
+  tdt->start = VIK_TRACKPOINT(trk->trackpoints->data)->timestamp;
+  tdt->end = VIK_TRACKPOINT(g_list_last(trk->trackpoints)->data)->timestamp;
+
+  // Distances between the points, then summed from the start
+  a_coords_latlon_diffs ( tdt->ll, tdt->dist + 1, count );
+  tdt->dist[0] = 0.0;
+  for ( ii = 1; ii < count; ii++ )
+    tdt->dist[ii] += tdt->dist[ii-1];
+  gdouble length = log ( MAX(tdt->dist[count-1], 1.0) ) / log ( 1.0 + LENGTH_STEP );
+
+  guint64 route = td_hash ( KEY_ROUTE );
+  guint32 last = G_MAXUINT32;
+  for ( ii = 0; ii < count; ii++ ) {
+    guint32 cell = td_cell ( &tdt->ll[ii] );
+    if ( cell != last )
+      route = td_mix ( route, cell );
+    last = cell;
+  }
+  guint64 ends = td_mix ( td_mix ( td_hash(KEY_ENDS), td_cell(&tdt->ll[0]) ), last );
+
+  for ( guint oo = 0; oo < 2; oo++ ) {
+    TDKey kr = { td_mix ( route, td_step(length, 1.0, oo) ), index };
+    TDKey ke = { td_mix ( ends, td_step(length, 1.0, oo) ), index };
+    g_array_append_val ( keys, kr );
+    g_array_append_val ( keys, ke );
+    if ( !isnan(tdt->start) && !isnan(tdt->end) ) {
+      for ( guint pp = 0; pp < 2; pp++ ) {
+        TDKey kt = { td_mix ( td_mix ( td_hash(KEY_TIMED), td_step(tdt->start, TIME_STEP, oo) ),
+                              td_step(tdt->end, TIME_STEP, pp) ), index };
+        g_array_append_val ( keys, kt );
+      }
+    }
+  }
+}
+
+static gint td_key_compare ( gconstpointer a, gconstpointer b )
+{
+  const TDKey *ka = a;
+  const TDKey *kb = b;
+  if ( ka->key != kb->key )
+    return ka->key < kb->key ? -1 : 1;
+  return (gint)ka->index - (gint)kb->index;
+}
+
+/**
+ * Whether each point of @a is near the point of @b at the same fraction of its length
+ */
+static gboolean td_follows ( const TDTrack *a, const TDTrack *b, gdouble tolerance )
+{
+  gdouble la = a->dist[a->count-1];
+  gdouble lb = b->dist[b->count-1];
+  guint jj = 0;
+  for ( guint ii = 0; ii < a->count; ii++ ) {
+    gdouble target = la > 0.0 ? a->dist[ii] / la * lb : 0.0;
+    while ( jj + 2 < b->count && b->dist[jj+1] < target )
+      jj++;
+    gdouble span = b->dist[jj+1] - b->dist[jj];
+    gdouble ff = span > 0.0 ? CLAMP ( (target - b->dist[jj]) / span, 0.0, 1.0 ) : 0.0;
+    struct LatLon ll = { b->ll[jj].lat + ff * (b->ll[jj+1].lat - b->ll[jj].lat),
+                         b->ll[jj].lon + ff * (b->ll[jj+1].lon - b->ll[jj].lon) };
+    if ( a_coords_latlon_diff_fast ( &a->ll[ii], &ll ) > tolerance )
+      return FALSE;
+  }
+  return TRUE;
+}
+
+static gboolean td_verify ( const TDTrack *a, const TDTrack *b )
+{
+  if ( !isnan(a->start) && !isnan(b->start) && fabs(a->start - b->start) > TIME_TOLERANCE )
+    return FALSE;
+  if ( !isnan(a->end) && !isnan(b->end) && fabs(a->end - b->end) > TIME_TOLERANCE )
+    return FALSE;
+  gdouble la = a->dist[a->count-1];
+  gdouble lb = b->dist[b->count-1];
+  gdouble longest = MAX ( la, lb );
+  gdouble tolerance = MAX ( DISTANCE_TOLERANCE, longest * DISTANCE_TOLERANCE_RATIO );
+  if ( fabs(la - lb) > longest * LENGTH_TOLERANCE + tolerance )
+    return FALSE;
+  return td_follows ( a, b, tolerance ) && td_follows ( b, a, tolerance );
+}
+
+typedef struct {
+  const TDTrack *tdts;
+  const guint32 *pairs;  // Indices of the two tracks of each
+  gboolean *same;
+  guint start, end;
+} TDVerify;
+
+static gpointer td_verify_run ( gpointer data )
+{
+  TDVerify *tv = data;
+  for ( guint ii = tv->start; ii < tv->end; ii++ )
+    tv->same[ii] = td_verify ( &tv->tdts[tv->pairs[2*ii]], &tv->tdts[tv->pairs[2*ii+1]] );
+  return NULL;
+}
+
+static void td_verify_all ( const TDTrack *tdts, const guint32 *pairs, gboolean *same, guint count, guint threads )
+{
+  if ( !threads )
+    threads = g_get_num_processors ();
+  threads = CLAMP ( count / VERIFY_MIN_PER_THREAD, 1, threads );
+
+  TDVerify *verifies = g_new ( TDVerify, threads );
+  GThread **workers = g_new0 ( GThread*, threads );
+  for ( guint tt = 0; tt < threads; tt++ ) {
+    TDVerify tv = { tdts, pairs, same, (guint64)count * tt / threads, (guint64)count * (tt + 1) / threads };
+    verifies[tt] = tv;
+    // This thread takes the first share
+    if ( tt > 0 )
+      workers[tt] = g_thread_new ( "trackdupes", td_verify_run, &verifies[tt] );
+  }
+  (void)td_verify_run ( &verifies[0] );
+  for ( guint tt = 1; tt < threads; tt++ )
+    g_thread_join ( workers[tt] );
+  g_free ( workers );
+  g_free ( verifies );
+}
+
+static guint td_find_root ( guint *parent, guint ii )
+{
+  while ( parent[ii] != ii ) {
+    parent[ii] = parent[parent[ii]];
+    ii = parent[ii];
+  }
+  return ii;
+}
+
+gint *a_track_dupes_find ( VikTrack **tracks, guint count, guint threads )
+{
+  TDTrack *tdts = g_new0 ( TDTrack, count );
+  GArray *keys = g_array_new ( FALSE, FALSE, sizeof(TDKey) );
+  for ( guint ii = 0; ii < count; ii++ )
+    td_fingerprint ( tracks[ii], ii, &tdts[ii], keys );
+  g_array_sort ( keys, td_key_compare );
+
+  // Each pair of tracks sharing a key, only once however many they share
+  GHashTable *seen = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, NULL );
+  GArray *pairs = g_array_new ( FALSE, FALSE, sizeof(guint32) );
+  TDKey *kk = (TDKey*)keys->data;
+  for ( guint run = 0; run < keys->len; ) {
+    guint next = run + 1;
+    while ( next < keys->len && kk[next].key == kk[run].key )
+      next++;
+    for ( guint ii = run; ii < next; ii++ ) {
+      for ( guint jj = ii + 1; jj < next; jj++ ) {
+        if ( kk[ii].index == kk[jj].index )
+          continue;
+        gint64 *pair = g_new ( gint64, 1 );
+        *pair = ((gint64)kk[ii].index << 32) | kk[jj].index;
+        if ( g_hash_table_contains ( seen, pair ) ) {
+          g_free ( pair );
+          continue;
+        }
+        g_hash_table_add ( seen, pair );
+        guint32 both[2] = { kk[ii].index, kk[jj].index };
+        g_array_append_vals ( pairs, both, 2 );
+      }
+    }
+    run = next;
+  }
+  g_hash_table_destroy ( seen );
+  g_array_free ( keys, TRUE );
+
+  guint npairs = pairs->len / 2;
+  gboolean *same = g_new ( gboolean, npairs );
+  td_verify_all ( tdts, (guint32*)pairs->data, same, npairs, threads );
+
+  // Group the copies under the first of them
+  guint *parent = g_new ( guint, count );
+  for ( guint ii = 0; ii < count; ii++ )
+    parent[ii] = ii;
+  for ( guint pp = 0; pp < npairs; pp++ ) {
+    if ( !same[pp] )
+      continue;
+    guint ra = td_find_root ( parent, g_array_index(pairs, guint32, 2*pp) );
+    guint rb = td_find_root ( parent, g_array_index(pairs, guint32, 2*pp+1) );
+    if ( ra < rb )
+      parent[rb] = ra;
+    else if ( rb < ra )
+      parent[ra] = rb;
+  }
+  gint *first = g_new ( gint, count );
+  for ( guint ii = 0; ii < count; ii++ ) {
+    guint root = td_find_root ( parent, ii );
+    first[ii] = root == ii ? -1 : (gint)root;
+  }
+
+  g_free ( parent );
+  g_free ( same );
+  g_array_free ( pairs, TRUE );
+  for ( guint ii = 0; ii < count; ii++ ) {
+    g_free ( tdts[ii].ll );
+    g_free ( tdts[ii].dist );
+  }
+  g_free ( tdts );
+  return first;
+}
@@ -0,0 +1,38 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_TRACKDUPES_H
+#define __VIKING_TRACKDUPES_H
+
+#include <glib.h>
+#include "viktrack.h"
+
+G_BEGIN_DECLS
+
+// Finding tracks that are copies of each other (e.g. from importing the same device files again)
+// Only the tracks with the same fingerprint (times, places, the cells passed through and length)
+//  are compared point by point, so this is not quadratic in the number of tracks
+// threads: 0 for one per processor
+// Returns: For each track the index of the first track it is a copy of, or -1 for none
+//  (free with g_free)
+gint *a_track_dupes_find ( VikTrack **tracks, guint count, guint threads );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,472 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <string.h>
+#include <glib/gi18n.h>
+#include "tracklod.h"
+#include "heatmaptiles.h"
+#include "mapcache.h"
+#include "maputils.h"
+#include "background.h"
+#include "bbox.h"
+
+#define TRACK_LOD_CACHE_TYPE 65002
+// More tiles than this are not tracked, instead starting afresh (so any in the cache are rendered again)
+#define TRACK_LOD_MAX_TILES 4096
+// Changes in more places than this also start afresh, rather than checking every tile against them
+#define TRACK_LOD_MAX_DIRTY 64
+
+typedef enum {
+  TILE_REQUESTED,
+  TILE_CURRENT,  // Rendered from the current index
+  TILE_STALE,    // Rendered from an earlier index, with changes to the tracks since
+} TileState;
+
+struct _TrackLod {
+  gint ref_count;        // Shared with the background jobs
+  GMutex mutex;          // Everything except the tracks may be used by the background jobs
+  VikLayer *vl;          // NULL once the layer has gone
+  HeatmapTiles *index;
+  GHashTable *tiles;     // TileState of each tile rendered or requested, keyed by the position (see tile_key())
+  gchar *name;           // Tiles in the cache are identified by this
+  guint gen;
+  guint8 colour[4];
+  GArray *dirty;         // LatLonBBox of the changes not yet in an index
+  gboolean building;
+  gboolean started;
+  GHashTable *tracks;    // VikTrackSnapshot of each track, keyed by the track (main thread only)
+};
+
+static void track_lod_unref ( TrackLod *lod )
+{
+  if ( !g_atomic_int_dec_and_test ( &lod->ref_count ) )
+    return;
+  a_heatmap_tiles_unref ( lod->index );
+  g_hash_table_destroy ( lod->tiles );
+  g_hash_table_destroy ( lod->tracks );
+  g_array_free ( lod->dirty, TRUE );
+  g_free ( lod->name );
+  g_mutex_clear ( &lod->mutex );
+  g_free ( lod );
+}
+
+/**
+ * Tiles in the cache are identified by the name,
+ *  thus when it changes any tiles rendered previously are no longer used
+ * Call with the mutex held
+ */
+static void track_lod_name_update ( TrackLod *lod )
+{
+  lod->gen++;
+  g_free ( lod->name );
+  lod->name = g_strdup_printf ( "tracklod-%p-%u", lod, lod->gen );
+  g_hash_table_remove_all ( lod->tiles );
+}
+
+TrackLod *a_track_lod_new ( VikLayer *vl )
+{
+  TrackLod *lod = g_malloc0 ( sizeof(TrackLod) );
+  lod->ref_count = 1;
+  g_mutex_init ( &lod->mutex );
+  lod->vl = vl;
+  a_mapcache_add_layer ( vl );
+  lod->tiles = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, NULL );
+  lod->tracks = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)vik_track_snapshot_unref );
+  lod->dirty = g_array_new ( FALSE, FALSE, sizeof(LatLonBBox) );
+  lod->colour[3] = 255;
+  track_lod_name_update ( lod );
+  return lod;
+}
+
+/**
+ * Any background jobs still going keep what they need until they finish,
+ *  but no longer update the layer
+ */
+void a_track_lod_free ( TrackLod *lod )
+{
+  if ( !lod )
+    return;
+  g_mutex_lock ( &lod->mutex );
+  VikLayer *vl = lod->vl;
+  lod->vl = NULL;
+  g_mutex_unlock ( &lod->mutex );
+  a_mapcache_remove_layer ( vl );
+  track_lod_unref ( lod );
+}
+
+/**
+ * The lines are drawn in a single colour
+ */
+void a_track_lod_set_colour ( TrackLod *lod, const GdkColor *colour )
+{
+  guint8 rgba[4] = { colour->red >> 8, colour->green >> 8, colour->blue >> 8, 255 };
+  g_mutex_lock ( &lod->mutex );
+  if ( memcmp ( rgba, lod->colour, sizeof(rgba) ) ) {
+    memcpy ( lod->colour, rgba, sizeof(rgba) );
+    track_lod_name_update ( lod );
+  }
+  g_mutex_unlock ( &lod->mutex );
+}
+
+/**
+ * Tiles can only be drawn in the Mercator drawmode at one of the standard zoom levels
+ */
+static gboolean track_lod_zoom ( VikViewport *vvp, gint *zoom )
+{
+  if ( vik_viewport_get_drawmode(vvp) != VIK_VIEWPORT_DRAWMODE_MERCATOR )
+    return FALSE;
+  gdouble xmpp = vik_viewport_get_xmpp ( vvp );
+  if ( xmpp != vik_viewport_get_ympp(vvp) )
+    return FALSE;
+  gint scale = map_utils_mpp_to_scale ( xmpp );
+  if ( scale == 255 )
+    return FALSE;
+  *zoom = 17 - scale;
+  return *zoom >= 0 && *zoom <= HEATMAP_TILES_MAX_ZOOM;
+}
+
+gboolean a_track_lod_available ( VikViewport *vvp )
+{
+  gint zoom;
+  return track_lod_zoom ( vvp, &zoom );
+}
+
+static gint64 *tile_key ( const MapCoord *mc )
+{
+  gint64 *key = g_new ( gint64, 1 );
+  *key = ((gint64)(17 - mc->scale) << 48) | ((gint64)mc->x << 24) | mc->y;
+  return key;
+}
+
+static void tile_bbox ( gint64 key, LatLonBBox *bbox )
+{
+  MapCoord mc = { 0 };
+  mc.scale = 17 - (gint)(key >> 48);
+  mc.x = (key >> 24) & 0xffffff;
+  mc.y = key & 0xffffff;
+  VikCoord tl, br;
+  map_utils_iTMS_to_vikcoords ( &mc, &tl, &br );
+  bbox->north = tl.north_south;
+  bbox->west = tl.east_west;
+  bbox->south = br.north_south;
+  bbox->east = br.east_west;
+}
+
+/**
+ * Mark the tiles covering the changes to be rendered again
+ * Call with the mutex held
+ */
+static void track_lod_tiles_changed ( TrackLod *lod, GArray *dirty )
+{
+  if ( dirty->len > TRACK_LOD_MAX_DIRTY ) {
+    track_lod_name_update ( lod );
+    return;
+  }
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, lod->tiles );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    if ( GPOINTER_TO_INT(value) != TILE_CURRENT )
+      continue;
+    LatLonBBox bbox;
+    tile_bbox ( *(gint64*)key, &bbox );
+    for ( guint ii = 0; ii < dirty->len; ii++ ) {
+      // Lines on the boundary may be drawn in the neighbouring tile
+      LatLonBBox *changed = &g_array_index ( dirty, LatLonBBox, ii );
+      if ( changed->south <= bbox.north && changed->north >= bbox.south &&
+           changed->west <= bbox.east && changed->east >= bbox.west ) {
+        g_hash_table_iter_replace ( &iter, GINT_TO_POINTER(TILE_STALE) );
+        break;
+      }
+    }
+  }
+}
+
+typedef struct {
+  TrackLod *lod;
+  GPtrArray *snaps;
+  GArray *dirty;
+  gboolean done;
+} TrackLodBuildT;
+
+static void track_lod_build_free ( TrackLodBuildT *job )
+{
+  TrackLod *lod = job->lod;
+  if ( !job->done ) {
+    // Not built, so the changes are still to do
+    g_mutex_lock ( &lod->mutex );
+    g_array_append_vals ( lod->dirty, job->dirty->data, job->dirty->len );
+    if ( !lod->index )
+      lod->started = FALSE;
+    lod->building = FALSE;
+    g_mutex_unlock ( &lod->mutex );
+  }
+  g_ptr_array_free ( job->snaps, TRUE );
+  g_array_free ( job->dirty, TRUE );
+  track_lod_unref ( lod );
+  g_free ( job );
+}
+
+static gint track_lod_build_thread ( TrackLodBuildT *job, gpointer threaddata )
+{
+  HeatmapTiles *hmt = a_heatmap_tiles_new ();
+  // Routes have no timestamps
+  a_heatmap_tiles_set_all_points ( hmt, TRUE );
+  for ( guint ii = 0; ii < job->snaps->len; ii++ ) {
+    if ( a_background_thread_progress ( threaddata, (gdouble)ii / job->snaps->len ) != 0 ) {
+      a_heatmap_tiles_unref ( hmt );
+      return -1;
+    }
+    a_heatmap_tiles_add_track ( hmt, g_ptr_array_index ( job->snaps, ii ) );
+  }
+  a_heatmap_tiles_finish ( hmt );
+
+  TrackLod *lod = job->lod;
+  g_mutex_lock ( &lod->mutex );
+  HeatmapTiles *previous = lod->index;
+  lod->index = hmt;
+  track_lod_tiles_changed ( lod, job->dirty );
+  lod->building = FALSE;
+  job->done = TRUE;
+  if ( lod->vl )
+    vik_layer_emit_update ( lod->vl ); // NB update display from background
+  g_mutex_unlock ( &lod->mutex );
+
+  a_heatmap_tiles_unref ( previous );
+  return 0;
+}
+
+/**
+ * Build a new index of all the tracks in the background
+ * Call with the mutex held
+ */
+static void track_lod_build ( TrackLod *lod )
+{
+  TrackLodBuildT *job = g_malloc0 ( sizeof(TrackLodBuildT) );
+  job->lod = lod;
+  g_atomic_int_inc ( &lod->ref_count );
+  job->snaps = g_ptr_array_new_full ( g_hash_table_size(lod->tracks), (GDestroyNotify)vik_track_snapshot_unref );
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, lod->tracks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+    g_ptr_array_add ( job->snaps, vik_track_snapshot_ref ( value ) );
+  job->dirty = lod->dirty;
+  lod->dirty = g_array_new ( FALSE, FALSE, sizeof(LatLonBBox) );
+  lod->building = TRUE;
+  lod->started = TRUE;
+
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(lod->vl),
+                        _("Indexing Tracks for Drawing"),
+                        (vik_thr_func)track_lod_build_thread,
+                        job,
+                        (vik_thr_free_func)track_lod_build_free,
+                        NULL,
+                        job->snaps->len );
+}
+
+/**
+ * a_track_lod_update:
+ * @tracks: All the #VikTrack to be drawn
+ *
+ * Compare against the tracks last time (by their snapshots, which are remade whenever a track changes)
+ *  and index them again if any have changed, been added or removed.
+ * Must be called from the main thread.
+ */
+void a_track_lod_update ( TrackLod *lod, GPtrArray *tracks )
+{
+  // Usually nothing has changed, which is quick to find out
+  gboolean changed = ( tracks->len != g_hash_table_size(lod->tracks) );
+  for ( guint ii = 0; ii < tracks->len && !changed; ii++ ) {
+    VikTrack *trk = g_ptr_array_index ( tracks, ii );
+    changed = !trk->snapshot || g_hash_table_lookup ( lod->tracks, trk ) != trk->snapshot;
+  }
+
+  g_mutex_lock ( &lod->mutex );
+  if ( changed ) {
+    GHashTable *previous = lod->tracks;
+    lod->tracks = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)vik_track_snapshot_unref );
+    for ( guint ii = 0; ii < tracks->len; ii++ ) {
+      VikTrack *trk = g_ptr_array_index ( tracks, ii );
+      VikTrackSnapshot *snap = vik_track_get_snapshot ( trk );
+      if ( g_hash_table_lookup ( previous, trk ) == snap )
+        g_hash_table_remove ( previous, trk );
+      else
+        g_array_append_val ( lod->dirty, snap->bbox );
+      g_hash_table_insert ( lod->tracks, trk, snap );
+    }
+    // What remains are the tracks since removed, or as they were before being changed
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init ( &iter, previous );
+    while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+      g_array_append_val ( lod->dirty, ((VikTrackSnapshot*)value)->bbox );
+    g_hash_table_destroy ( previous );
+  }
+  // Any changes whilst building are done after it
+  if ( !lod->building && (lod->dirty->len || !lod->started) )
+    track_lod_build ( lod );
+  g_mutex_unlock ( &lod->mutex );
+}
+
+typedef struct {
+  TrackLod *lod;
+  HeatmapTiles *hmt;
+  MapCoord mc;
+  gint64 *key;
+  guint8 colour[4];
+  gchar *name;
+  gboolean done;
+} TrackLodTileT;
+
+static void track_lod_tile_free ( TrackLodTileT *job )
+{
+  TrackLod *lod = job->lod;
+  if ( !job->done ) {
+    // Allow it to be requested again
+    g_mutex_lock ( &lod->mutex );
+    if ( !g_strcmp0 ( job->name, lod->name ) &&
+         GPOINTER_TO_INT(g_hash_table_lookup ( lod->tiles, job->key )) == TILE_REQUESTED )
+      g_hash_table_remove ( lod->tiles, job->key );
+    g_mutex_unlock ( &lod->mutex );
+  }
+  a_heatmap_tiles_unref ( job->hmt );
+  g_free ( job->key );
+  g_free ( job->name );
+  track_lod_unref ( lod );
+  g_free ( job );
+}
+
+static gint track_lod_tile_thread ( TrackLodTileT *job, gpointer threaddata )
+{
+  if ( a_background_thread_progress ( threaddata, 0 ) != 0 )
+    return -1;
+  GdkPixbuf *pixbuf = a_heatmap_tiles_render_lines ( job->hmt, 17 - job->mc.scale, job->mc.x, job->mc.y, job->colour );
+
+  TrackLod *lod = job->lod;
+  g_mutex_lock ( &lod->mutex );
+  // Unless started afresh since the request
+  if ( pixbuf && lod->vl && !g_strcmp0 ( job->name, lod->name ) ) {
+    a_mapcache_add ( pixbuf, (mapcache_extra_t){ 0.0 }, job->mc.x, job->mc.y, job->mc.z, TRACK_LOD_CACHE_TYPE, job->mc.scale, 255, 0.0, 0.0, job->name, lod->vl );
+    // Made from an earlier index if rebuilt since the request
+    TileState state = ( job->hmt == lod->index ) ? TILE_CURRENT : TILE_STALE;
+    g_hash_table_replace ( lod->tiles, job->key, GINT_TO_POINTER(state) );
+    job->key = NULL;
+    job->done = TRUE;
+    vik_layer_emit_update ( lod->vl ); // NB update display from background
+  }
+  g_mutex_unlock ( &lod->mutex );
+
+  if ( pixbuf )
+    g_object_unref ( pixbuf );
+  return 0;
+}
+
+/**
+ * Render the tile in the background
+ * Call with the mutex held
+ */
+static void track_lod_tile_request ( TrackLod *lod, MapCoord *mc, gint64 *key )
+{
+  if ( g_hash_table_size(lod->tiles) >= TRACK_LOD_MAX_TILES )
+    track_lod_name_update ( lod );
+  g_hash_table_replace ( lod->tiles, key, GINT_TO_POINTER(TILE_REQUESTED) );
+
+  TrackLodTileT *job = g_malloc0 ( sizeof(TrackLodTileT) );
+  job->lod = lod;
+  g_atomic_int_inc ( &lod->ref_count );
+  job->hmt = a_heatmap_tiles_ref ( lod->index );
+  job->mc = *mc;
+  job->key = g_new ( gint64, 1 );
+  *job->key = *key;
+  memcpy ( job->colour, lod->colour, sizeof(job->colour) );
+  job->name = g_strdup ( lod->name );
+
+  gchar *description = g_strdup_printf ( _("Track Tile %d:%d:%d"), 17 - mc->scale, mc->x, mc->y );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(lod->vl),
+                        description,
+                        (vik_thr_func)track_lod_tile_thread,
+                        job,
+                        (vik_thr_free_func)track_lod_tile_free,
+                        NULL,
+                        1 );
+  g_free ( description );
+}
+
+/**
+ * a_track_lod_draw:
+ *
+ * Draw the tiles for the view, requesting any that are not yet available or are out of date
+ *  Out of date tiles are still drawn until replaced, so edits do not make the tracks flicker.
+ * Nothing is drawn until the first index is built.
+ */
+void a_track_lod_draw ( TrackLod *lod, VikViewport *vvp )
+{
+  gint zoom;
+  if ( !track_lod_zoom ( vvp, &zoom ) )
+    return;
+
+  VikCoord ul, br;
+  vik_viewport_screen_to_coord ( vvp, 0, 0, &ul );
+  vik_viewport_screen_to_coord ( vvp, vik_viewport_get_width(vvp), vik_viewport_get_height(vvp), &br );
+  gdouble mpp = vik_viewport_get_xmpp ( vvp );
+  MapCoord ulm, brm;
+  if ( !map_utils_vikcoord_to_iTMS ( &ul, mpp, mpp, &ulm ) ||
+       !map_utils_vikcoord_to_iTMS ( &br, mpp, mpp, &brm ) )
+    return;
+
+  g_mutex_lock ( &lod->mutex );
+  if ( !lod->index ) {
+    g_mutex_unlock ( &lod->mutex );
+    return;
+  }
+  const gint xmin = MIN(ulm.x, brm.x), xmax = MAX(ulm.x, brm.x);
+  const gint ymin = MIN(ulm.y, brm.y), ymax = MAX(ulm.y, brm.y);
+  for ( gint x = xmin; x <= xmax; x++ ) {
+    for ( gint y = ymin; y <= ymax; y++ ) {
+      if ( !a_heatmap_tiles_has_data ( lod->index, zoom, x, y, 0 ) )
+        continue;
+      MapCoord mc = ulm;
+      mc.x = x;
+      mc.y = y;
+      GdkPixbuf *pixbuf = a_mapcache_get ( mc.x, mc.y, mc.z, TRACK_LOD_CACHE_TYPE, mc.scale, 255, 0.0, 0.0, lod->name, lod->vl );
+      if ( pixbuf ) {
+        VikCoord coord;
+        gint xx, yy;
+        map_utils_iTMS_to_vikcoord ( &mc, &coord );
+        vik_viewport_coord_to_screen ( vvp, &coord, &xx, &yy );
+        vik_viewport_draw_pixbuf ( vvp, pixbuf, 0, 0, xx, yy, 256, 256 );
+        g_object_unref ( pixbuf );
+      }
+      gint64 *key = tile_key ( &mc );
+      gpointer state;
+      if ( !g_hash_table_lookup_extended ( lod->tiles, key, NULL, &state ) ||
+           (GPOINTER_TO_INT(state) == TILE_STALE) ||
+           (GPOINTER_TO_INT(state) == TILE_CURRENT && !pixbuf) )
+        track_lod_tile_request ( lod, &mc, key );
+      else
+        g_free ( key );
+    }
+  }
+  g_mutex_unlock ( &lod->mutex );
+}
@@ -0,0 +1,45 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_TRACKLOD_H
+#define __VIKING_TRACKLOD_H
+
+#include <glib.h>
+#include "viklayer.h"
+#include "vikviewport.h"
+#include "viktrack.h"
+
+G_BEGIN_DECLS
+
+// Drawing lots of tracks as raster tiles of their lines, instead of each track individually
+//  The tiles are rendered in the background from an index of the lines (see heatmaptiles.h),
+//  which is rebuilt when the tracks change, and then only the tiles covering the changes are rendered again
+typedef struct _TrackLod TrackLod;
+
+TrackLod *a_track_lod_new ( VikLayer *vl );
+void a_track_lod_free ( TrackLod *lod );
+
+void a_track_lod_set_colour ( TrackLod *lod, const GdkColor *colour );
+gboolean a_track_lod_available ( VikViewport *vvp );
+void a_track_lod_update ( TrackLod *lod, GPtrArray *tracks );
+void a_track_lod_draw ( TrackLod *lod, VikViewport *vvp );
+
+G_END_DECLS
+
+#endif
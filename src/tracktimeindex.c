@@ -0,0 +1,244 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <math.h>
+#include "tracktimeindex.h"
+
+typedef struct {
+  gdouble time;
+  gdouble other; // The end time when sorted by start, and vice versa
+  VikTrack *trk;
+  gpointer id;
+} TimeEntryT;
+
+struct _TrackTimeIndex {
+  GArray *by_start; // Of TimeEntryT, only for tracks with a start time
+  GArray *by_end;   // Of TimeEntryT, only for tracks with an end time
+  guint changes;    // vik_track_get_changes_count() when built
+  gdouble longest;  // Duration of the longest track with both times
+};
+
+static gint entry_compare ( gconstpointer a, gconstpointer b )
+{
+  const TimeEntryT *ea = a;
+  const TimeEntryT *eb = b;
+  if ( ea->time < eb->time )
+    return -1;
+  if ( ea->time > eb->time )
+    return 1;
+  return 0;
+}
+
+/**
+ * Build the index from the track summaries, which themselves are remembered on each track
+ */
+TrackTimeIndex *a_track_time_index_new ( GHashTable *tracks )
+{
+  TrackTimeIndex *tti = g_malloc ( sizeof(TrackTimeIndex) );
+  guint size = g_hash_table_size ( tracks );
+  tti->by_start = g_array_sized_new ( FALSE, FALSE, sizeof(TimeEntryT), size );
+  tti->by_end = g_array_sized_new ( FALSE, FALSE, sizeof(TimeEntryT), size );
+  tti->changes = vik_track_get_changes_count ();
+  tti->longest = 0.0;
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, tracks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    VikTrack *trk = VIK_TRACK(value);
+    VikTrackSummary summary;
+    vik_track_get_summary ( trk, &summary );
+    if ( !isnan(summary.start_time) ) {
+      TimeEntryT te = { summary.start_time, summary.end_time, trk, key };
+      g_array_append_val ( tti->by_start, te );
+      if ( summary.end_time - summary.start_time > tti->longest )
+        tti->longest = summary.end_time - summary.start_time;
+    }
+    if ( !isnan(summary.end_time) ) {
+      TimeEntryT te = { summary.end_time, summary.start_time, trk, key };
+      g_array_append_val ( tti->by_end, te );
+    }
+  }
+  g_array_sort ( tti->by_start, entry_compare );
+  g_array_sort ( tti->by_end, entry_compare );
+  return tti;
+}
+
+void a_track_time_index_free ( TrackTimeIndex *tti )
+{
+  if ( !tti )
+    return;
+  g_array_free ( tti->by_start, TRUE );
+  g_array_free ( tti->by_end, TRUE );
+  g_free ( tti );
+}
+
+/**
+ * Returns: FALSE if any track has been changed since the index was built
+ */
+gboolean a_track_time_index_is_current ( TrackTimeIndex *tti )
+{
+  return tti->changes == vik_track_get_changes_count ();
+}
+
+/**
+ * Returns: The position of the first entry with a time not less than the value
+ */
+static guint lower_bound ( GArray *entries, gdouble time )
+{
+  guint lo = 0;
+  guint hi = entries->len;
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    if ( g_array_index(entries, TimeEntryT, mid).time < time )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * Returns: The track that starts first, or NULL if no tracks have times
+ */
+VikTrack *a_track_time_index_get_first ( TrackTimeIndex *tti, gpointer *id )
+{
+  if ( tti->by_start->len == 0 )
+    return NULL;
+  TimeEntryT *te = &g_array_index ( tti->by_start, TimeEntryT, 0 );
+  if ( id )
+    *id = te->id;
+  return te->trk;
+}
+
+/**
+ * Returns: The earliest track starting within the period [from, to), or NULL if there is none
+ */
+VikTrack *a_track_time_index_find_start ( TrackTimeIndex *tti, gdouble from, gdouble to, gpointer *id )
+{
+  guint pos = lower_bound ( tti->by_start, from );
+  if ( pos >= tti->by_start->len )
+    return NULL;
+  TimeEntryT *te = &g_array_index ( tti->by_start, TimeEntryT, pos );
+  if ( te->time >= to )
+    return NULL;
+  if ( id )
+    *id = te->id;
+  return te->trk;
+}
+
+/**
+ * a_track_time_index_find_overlapping:
+ *
+ * Find the tracks that have any part within the period [from, to];
+ *  those without an end time only if they start within it.
+ * Only tracks starting no earlier than the longest track before the period need to be checked,
+ *  so this is quick for a short period over many tracks of a similar length.
+ *
+ * Returns: A list of VikTrack* in order of their start, which should be freed with g_list_free()
+ */
+GList *a_track_time_index_find_overlapping ( TrackTimeIndex *tti, gdouble from, gdouble to )
+{
+  GList *result = NULL;
+  for ( guint ii = lower_bound ( tti->by_start, from - tti->longest ); ii < tti->by_start->len; ii++ ) {
+    TimeEntryT *te = &g_array_index ( tti->by_start, TimeEntryT, ii );
+    if ( te->time > to )
+      break;
+    if ( isnan(te->other) ? te->time >= from : te->other >= from )
+      result = g_list_prepend ( result, te->trk );
+  }
+  return g_list_reverse ( result );
+}
+
+/**
+ * Add the tracks adjacent in time to the span, excluding those already in the set
+ *
+ * Returns: The number of tracks added
+ */
+static guint add_adjacent ( TrackTimeIndex *tti, gdouble start, gdouble end, gdouble threshold, GHashTable *set, GList **found )
+{
+  guint count = 0;
+  for ( guint ii = lower_bound ( tti->by_end, start - threshold ); ii < tti->by_end->len; ii++ ) {
+    TimeEntryT *te = &g_array_index ( tti->by_end, TimeEntryT, ii );
+    if ( te->time >= start + threshold )
+      break;
+    if ( isnan(te->other) || !(fabs(start - te->time) < threshold) || g_hash_table_contains(set, te->trk) )
+      continue;
+    g_hash_table_add ( set, te->trk );
+    *found = g_list_prepend ( *found, te->trk );
+    count++;
+  }
+  if ( !isnan(end) ) {
+    for ( guint ii = lower_bound ( tti->by_start, end - threshold ); ii < tti->by_start->len; ii++ ) {
+      TimeEntryT *te = &g_array_index ( tti->by_start, TimeEntryT, ii );
+      if ( te->time >= end + threshold )
+        break;
+      if ( isnan(te->other) || !(fabs(te->time - end) < threshold) || g_hash_table_contains(set, te->trk) )
+        continue;
+      g_hash_table_add ( set, te->trk );
+      *found = g_list_prepend ( *found, te->trk );
+      count++;
+    }
+  }
+  return count;
+}
+
+/**
+ * a_track_time_index_find_mergeable:
+ *
+ * Find all the tracks that would be merged into the given track by repeatedly merging
+ *  the other tracks that either end within the threshold of its start, or start within the threshold of its end,
+ *  with each round considering the span of the track combined with those already found.
+ * Only tracks with both start and end times are considered.
+ * This avoids needing to actually merge (and so recalculate) the track for each round.
+ *
+ * Returns: A list of VikTrack*, which should be freed with g_list_free()
+ */
+GList *a_track_time_index_find_mergeable ( TrackTimeIndex *tti, VikTrack *trk, gdouble threshold )
+{
+  GList *result = NULL;
+  VikTrackSummary summary;
+  vik_track_get_summary ( trk, &summary );
+  if ( isnan(summary.start_time) )
+    return NULL;
+
+  GHashTable *set = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  g_hash_table_add ( set, trk );
+
+  gdouble start = summary.start_time;
+  gdouble end = summary.end_time;
+  GList *round = NULL;
+  while ( add_adjacent ( tti, start, end, threshold, set, &round ) ) {
+    // Then the merged track covers all of these
+    for ( GList *gl = round; gl; gl = gl->next ) {
+      VikTrackSummary ts;
+      vik_track_get_summary ( VIK_TRACK(gl->data), &ts );
+      if ( ts.start_time < start )
+        start = ts.start_time;
+      if ( isnan(end) || ts.end_time > end )
+        end = ts.end_time;
+    }
+    result = g_list_concat ( round, result );
+    round = NULL;
+  }
+  g_hash_table_destroy ( set );
+  return result;
+}
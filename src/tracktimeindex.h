@@ -0,0 +1,46 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_TRACKTIMEINDEX_H
+#define __VIKING_TRACKTIMEINDEX_H
+
+#include <glib.h>
+#include "viktrack.h"
+
+G_BEGIN_DECLS
+
+// The tracks of a layer sorted by their start and end times, for range queries by time
+// Built from a snapshot of the tracks; it becomes stale when a track is changed
+//  (see a_track_time_index_is_current()) or when tracks are added or removed,
+//  which the owner must handle by building a new index
+typedef struct _TrackTimeIndex TrackTimeIndex;
+
+// Tracks are a hash table of ids to VikTrack*, as for a TrackWaypoint layer
+TrackTimeIndex *a_track_time_index_new ( GHashTable *tracks );
+void a_track_time_index_free ( TrackTimeIndex *tti );
+gboolean a_track_time_index_is_current ( TrackTimeIndex *tti );
+
+VikTrack *a_track_time_index_get_first ( TrackTimeIndex *tti, gpointer *id );
+VikTrack *a_track_time_index_find_start ( TrackTimeIndex *tti, gdouble from, gdouble to, gpointer *id );
+GList *a_track_time_index_find_overlapping ( TrackTimeIndex *tti, gdouble from, gdouble to );
+GList *a_track_time_index_find_mergeable ( TrackTimeIndex *tti, VikTrack *trk, gdouble threshold );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,920 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * The binary form of a TrackWaypoint layer's data. All values are little endian.
+ *
+ * Layer block:
+ *   u32 version
+ *   u32 number of waypoints, u32 number of tracks, u32 number of routes
+ *   the layer bounds as doubles: north, south, east, west (from version 2)
+ *   u64 offset from the start of the block for each item, in the above order
+ *   the items
+ *
+ * Each item is a sequence of tagged property fields, ending with FIELD_END.
+ * Tracks and routes are then followed by their trackpoints stored by column:
+ *   varint number of trackpoints
+ *   varint mask of the optional columns stored (columns with only default values are left out)
+ *   latitudes, longitudes and then each stored optional column in turn
+ *
+ * Coordinates and other floating point columns are stored as the zigzag varint differences
+ *  between the IEEE-754 bit patterns of successive values.
+ * This is lossless (unlike scaling to integers), yet the slowly changing values of a track
+ *  typically take only a few bytes each.
+ * Optional values have a presence bitmap, so unavailable values take no further space.
+ *
+ * A single track (as used by vik_track_marshall()) is a u32 version followed by the track item.
+ */
+#include "viking.h"
+#include "trwbinary.h"
+#include "stringpool.h"
+
+#define TRWBINARY_VERSION 2
+
+// The top two bits of a field tag define how the value is stored,
+//  so that fields from newer versions can be skipped over
+#define FIELD_KIND_MASK   0xc0
+#define FIELD_KIND_STRING 0x00
+#define FIELD_KIND_DOUBLE 0x40
+#define FIELD_KIND_UINT   0x80
+#define FIELD_SLOTS 64
+#define FIELD_SLOT(tag) ((tag) & ~FIELD_KIND_MASK)
+
+enum {
+  FIELD_END = 0,
+  FIELD_NAME = FIELD_KIND_STRING | 1,
+  FIELD_COMMENT,
+  FIELD_DESCRIPTION,
+  FIELD_SOURCE,
+  FIELD_URL,
+  FIELD_URL_NAME,
+  FIELD_TYPE,
+  FIELD_IMAGE,
+  FIELD_SYMBOL,
+  FIELD_EXTENSIONS,
+  FIELD_LATITUDE = FIELD_KIND_DOUBLE | 1,
+  FIELD_LONGITUDE,
+  FIELD_ALTITUDE,
+  FIELD_TIMESTAMP,
+  FIELD_SPEED,
+  FIELD_COURSE,
+  FIELD_MAGVAR,
+  FIELD_GEOIDHEIGHT,
+  FIELD_HDOP,
+  FIELD_VDOP,
+  FIELD_PDOP,
+  FIELD_AGEOFDGPSDATA,
+  FIELD_IMAGE_DIRECTION,
+  FIELD_FIX = FIELD_KIND_UINT | 1,
+  FIELD_SAT,
+  FIELD_DGPSID,
+  FIELD_IMAGE_DIRECTION_REF,
+  FIELD_HIDDEN,
+  FIELD_HIDE_NAME,
+  FIELD_NUMBER,
+  FIELD_COLOR,  // 0x1RRGGBB when there is a colour
+  FIELD_DRAW_NAME_MODE,
+  FIELD_NUMBER_DIST_LABELS,
+  FIELD_ROUTE,
+};
+
+// Optional trackpoint columns
+enum {
+  COLUMN_TIMESTAMP = 0,
+  COLUMN_ALTITUDE,
+  COLUMN_SPEED,
+  COLUMN_COURSE,
+  COLUMN_HDOP,
+  COLUMN_VDOP,
+  COLUMN_PDOP,
+  COLUMN_TEMP,
+  COLUMN_NSATS,
+  COLUMN_FIX_MODE,
+  COLUMN_HEART_RATE,
+  COLUMN_CADENCE,
+  COLUMN_POWER,
+  COLUMN_NEWSEGMENT,
+  COLUMN_NAME,
+  COLUMN_EXTENSIONS,
+};
+
+#define NUM_DOUBLE_COLUMNS (COLUMN_TEMP+1)
+#define NUM_INT_COLUMNS (COLUMN_POWER-COLUMN_NSATS+1)
+
+static const gsize double_columns[NUM_DOUBLE_COLUMNS] = {
+  G_STRUCT_OFFSET(VikTrackpoint, timestamp),
+  G_STRUCT_OFFSET(VikTrackpoint, altitude),
+  G_STRUCT_OFFSET(VikTrackpoint, speed),
+  G_STRUCT_OFFSET(VikTrackpoint, course),
+  G_STRUCT_OFFSET(VikTrackpoint, hdop),
+  G_STRUCT_OFFSET(VikTrackpoint, vdop),
+  G_STRUCT_OFFSET(VikTrackpoint, pdop),
+  G_STRUCT_OFFSET(VikTrackpoint, temp),
+};
+
+// NB the unsigned members are accessed as gint, which makes no difference for their range of values
+typedef struct {
+  gsize offset;
+  gint none; // Value when unavailable
+} IntColumn;
+
+static const IntColumn int_columns[NUM_INT_COLUMNS] = {
+  { G_STRUCT_OFFSET(VikTrackpoint, nsats), 0 },
+  { G_STRUCT_OFFSET(VikTrackpoint, fix_mode), 0 },
+  { G_STRUCT_OFFSET(VikTrackpoint, heart_rate), 0 },
+  { G_STRUCT_OFFSET(VikTrackpoint, cadence), VIK_TRKPT_CADENCE_NONE },
+  { G_STRUCT_OFFSET(VikTrackpoint, power), VIK_TRKPT_POWER_NONE },
+};
+
+#define BITMAP_SIZE(nn) (((nn)+7)/8)
+#define BITMAP_SET(bm,ii) ((bm)[(ii)>>3] |= (1 << ((ii)&7)))
+#define BITMAP_TEST(bm,ii) ((bm)[(ii)>>3] & (1 << ((ii)&7)))
+
+static inline guint64 double_to_bits ( gdouble value )
+{
+  guint64 bits;
+  memcpy ( &bits, &value, sizeof(bits) );
+  return bits;
+}
+
+static inline gdouble bits_to_double ( guint64 bits )
+{
+  gdouble value;
+  memcpy ( &value, &bits, sizeof(value) );
+  return value;
+}
+
+static inline guint64 zigzag ( gint64 value )
+{
+  return ((guint64)value << 1) ^ (guint64)(value >> 63);
+}
+
+static inline gint64 unzigzag ( guint64 value )
+{
+  return (gint64)(value >> 1) ^ -(gint64)(value & 1);
+}
+
+/* ---------------------------------------------------- */
+/* Writing */
+
+static void put_u8 ( GByteArray *out, guint8 value )
+{
+  g_byte_array_append ( out, &value, 1 );
+}
+
+static void put_u32 ( GByteArray *out, guint32 value )
+{
+  guint32 le = GUINT32_TO_LE ( value );
+  g_byte_array_append ( out, (guint8*)&le, sizeof(le) );
+}
+
+static void put_u64 ( GByteArray *out, guint64 value )
+{
+  guint64 le = GUINT64_TO_LE ( value );
+  g_byte_array_append ( out, (guint8*)&le, sizeof(le) );
+}
+
+static void put_varint ( GByteArray *out, guint64 value )
+{
+  guint8 buf[10];
+  guint nn = 0;
+  while ( value >= 0x80 ) {
+    buf[nn++] = (guint8)(value | 0x80);
+    value >>= 7;
+  }
+  buf[nn++] = (guint8)value;
+  g_byte_array_append ( out, buf, nn );
+}
+
+static void put_string ( GByteArray *out, const gchar *str )
+{
+  gsize len = strlen ( str );
+  put_varint ( out, len );
+  g_byte_array_append ( out, (const guint8*)str, len );
+}
+
+static void put_delta ( GByteArray *out, gdouble value, guint64 *prev )
+{
+  guint64 bits = double_to_bits ( value );
+  put_varint ( out, zigzag ( (gint64)(bits - *prev) ) );
+  *prev = bits;
+}
+
+static void put_field_string ( GByteArray *out, guint8 tag, const gchar *value )
+{
+  if ( value && value[0] ) {
+    put_u8 ( out, tag );
+    put_string ( out, value );
+  }
+}
+
+static void put_field_double ( GByteArray *out, guint8 tag, gdouble value )
+{
+  if ( !isnan(value) ) {
+    put_u8 ( out, tag );
+    put_u64 ( out, double_to_bits(value) );
+  }
+}
+
+static void put_field_uint ( GByteArray *out, guint8 tag, guint64 value )
+{
+  if ( value ) {
+    put_u8 ( out, tag );
+    put_varint ( out, value );
+  }
+}
+
+static void write_waypoint ( GByteArray *out, VikWaypoint *wp, const gchar *dirpath )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( &(wp->coord), &ll );
+
+  put_field_string ( out, FIELD_NAME, wp->name );
+  put_field_double ( out, FIELD_LATITUDE, ll.lat );
+  put_field_double ( out, FIELD_LONGITUDE, ll.lon );
+  put_field_double ( out, FIELD_ALTITUDE, wp->altitude );
+  put_field_double ( out, FIELD_TIMESTAMP, wp->timestamp );
+  put_field_double ( out, FIELD_SPEED, wp->speed );
+  put_field_double ( out, FIELD_COURSE, wp->course );
+  put_field_double ( out, FIELD_MAGVAR, wp->magvar );
+  put_field_double ( out, FIELD_GEOIDHEIGHT, wp->geoidheight );
+  put_field_string ( out, FIELD_COMMENT, wp->comment );
+  put_field_string ( out, FIELD_DESCRIPTION, wp->description );
+  put_field_string ( out, FIELD_SOURCE, wp->source );
+  put_field_string ( out, FIELD_URL, wp->url );
+  put_field_string ( out, FIELD_URL_NAME, wp->url_name );
+  put_field_string ( out, FIELD_TYPE, wp->type );
+  put_field_uint ( out, FIELD_FIX, wp->fix_mode );
+  put_field_uint ( out, FIELD_SAT, wp->nsats );
+  put_field_double ( out, FIELD_HDOP, wp->hdop );
+  put_field_double ( out, FIELD_VDOP, wp->vdop );
+  put_field_double ( out, FIELD_PDOP, wp->pdop );
+  put_field_double ( out, FIELD_AGEOFDGPSDATA, wp->ageofdgpsdata );
+  put_field_uint ( out, FIELD_DGPSID, wp->dgpsid );
+
+  if ( wp->image ) {
+    // As per a_gpspoint_write_file()
+    const gchar *image = NULL;
+    if ( a_vik_get_file_ref_format() == VIK_FILE_REF_FORMAT_RELATIVE && dirpath )
+      image = file_GetRelativeFilename ( (gchar*)dirpath, wp->image );
+    put_field_string ( out, FIELD_IMAGE, image ? image : wp->image );
+  }
+  if ( !isnan(wp->image_direction) ) {
+    put_field_double ( out, FIELD_IMAGE_DIRECTION, wp->image_direction );
+    put_field_uint ( out, FIELD_IMAGE_DIRECTION_REF, wp->image_direction_ref );
+  }
+  put_field_string ( out, FIELD_SYMBOL, wp->symbol );
+  put_field_string ( out, FIELD_EXTENSIONS, wp->extensions );
+  put_field_uint ( out, FIELD_HIDDEN, !wp->visible );
+  put_field_uint ( out, FIELD_HIDE_NAME, wp->hide_name );
+  put_u8 ( out, FIELD_END );
+}
+
+static void write_double_column ( GByteArray *out, VikTrackpoint **tps, guint nn, gsize offset )
+{
+  guint8 *bitmap = g_malloc0 ( BITMAP_SIZE(nn) );
+  gboolean all = TRUE;
+  for ( guint ii = 0; ii < nn; ii++ ) {
+    if ( isnan(G_STRUCT_MEMBER(gdouble, tps[ii], offset)) )
+      all = FALSE;
+    else
+      BITMAP_SET ( bitmap, ii );
+  }
+  // Often everything is available, so then the bitmap is not needed
+  put_u8 ( out, all );
+  if ( !all )
+    g_byte_array_append ( out, bitmap, BITMAP_SIZE(nn) );
+  g_free ( bitmap );
+
+  guint64 prev = 0;
+  for ( guint ii = 0; ii < nn; ii++ ) {
+    gdouble value = G_STRUCT_MEMBER(gdouble, tps[ii], offset);
+    if ( !isnan(value) )
+      put_delta ( out, value, &prev );
+  }
+}
+
+static void write_int_column ( GByteArray *out, VikTrackpoint **tps, guint nn, const IntColumn *column )
+{
+  guint8 *bitmap = g_malloc0 ( BITMAP_SIZE(nn) );
+  for ( guint ii = 0; ii < nn; ii++ )
+    if ( G_STRUCT_MEMBER(gint, tps[ii], column->offset) != column->none )
+      BITMAP_SET ( bitmap, ii );
+  g_byte_array_append ( out, bitmap, BITMAP_SIZE(nn) );
+
+  for ( guint ii = 0; ii < nn; ii++ )
+    if ( BITMAP_TEST(bitmap, ii) )
+      put_varint ( out, zigzag ( G_STRUCT_MEMBER(gint, tps[ii], column->offset) ) );
+  g_free ( bitmap );
+}
+
+static void write_string_column ( GByteArray *out, VikTrackpoint **tps, guint nn, gsize offset )
+{
+  guint8 *bitmap = g_malloc0 ( BITMAP_SIZE(nn) );
+  for ( guint ii = 0; ii < nn; ii++ )
+    if ( G_STRUCT_MEMBER(gchar*, tps[ii], offset) )
+      BITMAP_SET ( bitmap, ii );
+  g_byte_array_append ( out, bitmap, BITMAP_SIZE(nn) );
+  g_free ( bitmap );
+  for ( guint ii = 0; ii < nn; ii++ )
+    if ( G_STRUCT_MEMBER(gchar*, tps[ii], offset) )
+      put_string ( out, G_STRUCT_MEMBER(gchar*, tps[ii], offset) );
+}
+
+static void write_track ( GByteArray *out, VikTrack *trk )
+{
+  vik_track_decode_extensions ( trk );
+  put_field_string ( out, FIELD_NAME, trk->name );
+  put_field_string ( out, FIELD_COMMENT, trk->comment );
+  put_field_string ( out, FIELD_DESCRIPTION, trk->description );
+  put_field_string ( out, FIELD_SOURCE, trk->source );
+  put_field_uint ( out, FIELD_NUMBER, trk->number );
+  put_field_string ( out, FIELD_TYPE, trk->type );
+  if ( trk->has_color )
+    put_field_uint ( out, FIELD_COLOR, 0x1000000 | ((trk->color.red/256) << 16) | ((trk->color.green/256) << 8) | (trk->color.blue/256) );
+  put_field_uint ( out, FIELD_DRAW_NAME_MODE, trk->draw_name_mode );
+  put_field_uint ( out, FIELD_NUMBER_DIST_LABELS, trk->max_number_dist_labels );
+  put_field_string ( out, FIELD_EXTENSIONS, trk->extensions );
+  put_field_uint ( out, FIELD_HIDDEN, !trk->visible );
+  put_field_uint ( out, FIELD_ROUTE, trk->is_route );
+  put_u8 ( out, FIELD_END );
+
+  guint nn = g_list_length ( trk->trackpoints );
+  VikTrackpoint **tps = g_new ( VikTrackpoint*, nn ? nn : 1 );
+  guint32 mask = 0;
+  guint ii = 0;
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    tps[ii++] = tp;
+    for ( guint cc = 0; cc < NUM_DOUBLE_COLUMNS; cc++ )
+      if ( !isnan(G_STRUCT_MEMBER(gdouble, tp, double_columns[cc])) )
+        mask |= 1 << cc;
+    for ( guint cc = 0; cc < NUM_INT_COLUMNS; cc++ )
+      if ( G_STRUCT_MEMBER(gint, tp, int_columns[cc].offset) != int_columns[cc].none )
+        mask |= 1 << (COLUMN_NSATS + cc);
+    if ( tp->newsegment )
+      mask |= 1 << COLUMN_NEWSEGMENT;
+    if ( tp->name )
+      mask |= 1 << COLUMN_NAME;
+    if ( tp->extensions )
+      mask |= 1 << COLUMN_EXTENSIONS;
+  }
+
+  put_varint ( out, nn );
+  put_varint ( out, mask );
+
+  struct LatLon *lls = g_new ( struct LatLon, nn ? nn : 1 );
+  for ( ii = 0; ii < nn; ii++ )
+    vik_coord_to_latlon ( &(tps[ii]->coord), &lls[ii] );
+  guint64 prev = 0;
+  for ( ii = 0; ii < nn; ii++ )
+    put_delta ( out, lls[ii].lat, &prev );
+  prev = 0;
+  for ( ii = 0; ii < nn; ii++ )
+    put_delta ( out, lls[ii].lon, &prev );
+  g_free ( lls );
+
+  for ( guint cc = 0; cc < NUM_DOUBLE_COLUMNS; cc++ )
+    if ( mask & (1 << cc) )
+      write_double_column ( out, tps, nn, double_columns[cc] );
+
+  for ( guint cc = 0; cc < NUM_INT_COLUMNS; cc++ )
+    if ( mask & (1 << (COLUMN_NSATS + cc)) )
+      write_int_column ( out, tps, nn, &int_columns[cc] );
+
+  if ( mask & (1 << COLUMN_NEWSEGMENT) ) {
+    guint8 *bitmap = g_malloc0 ( BITMAP_SIZE(nn) );
+    for ( ii = 0; ii < nn; ii++ )
+      if ( tps[ii]->newsegment )
+        BITMAP_SET ( bitmap, ii );
+    g_byte_array_append ( out, bitmap, BITMAP_SIZE(nn) );
+    g_free ( bitmap );
+  }
+
+  if ( mask & (1 << COLUMN_NAME) )
+    write_string_column ( out, tps, nn, G_STRUCT_OFFSET(VikTrackpoint, name) );
+
+  if ( mask & (1 << COLUMN_EXTENSIONS) )
+    write_string_column ( out, tps, nn, G_STRUCT_OFFSET(VikTrackpoint, extensions) );
+
+  g_free ( tps );
+}
+
+/**
+ * a_trwbinary_write_track:
+ *
+ * The compact form of the single track, as used by vik_track_marshall()
+ */
+void a_trwbinary_write_track ( VikTrack *trk, GByteArray *out )
+{
+  put_u32 ( out, TRWBINARY_VERSION );
+  write_track ( out, trk );
+}
+
+/**
+ * a_trwbinary_write_layer:
+ * @trw:     The layer to write
+ * @out:     Where the layer block is appended
+ * @dirpath: The directory of the .vik file, for relative filenames (can be NULL)
+ *
+ * Items are written in the order they have been read in, as per a_gpspoint_write_file()
+ */
+void a_trwbinary_write_layer ( VikTrwLayer *trw, GByteArray *out, const gchar *dirpath )
+{
+  GList *lists[3];
+  lists[0] = vu_sorted_list_from_hash_table ( vik_trw_layer_get_waypoints(trw), VL_SO_NONE, VIKING_WAYPOINT );
+  lists[1] = vu_sorted_list_from_hash_table ( vik_trw_layer_get_tracks(trw), VL_SO_NONE, VIKING_TRACK );
+  lists[2] = vu_sorted_list_from_hash_table ( vik_trw_layer_get_routes(trw), VL_SO_NONE, VIKING_TRACK );
+
+  guint start = out->len;
+  put_u32 ( out, TRWBINARY_VERSION );
+  guint total = 0;
+  for ( guint ll = 0; ll < G_N_ELEMENTS(lists); ll++ ) {
+    guint count = g_list_length ( lists[ll] );
+    put_u32 ( out, count );
+    total += count;
+  }
+  // Allows the extent of the layer to be known without reading all the items
+  LatLonBBox bbox = vik_trw_layer_get_bbox ( trw );
+  put_u64 ( out, double_to_bits(bbox.north) );
+  put_u64 ( out, double_to_bits(bbox.south) );
+  put_u64 ( out, double_to_bits(bbox.east) );
+  put_u64 ( out, double_to_bits(bbox.west) );
+
+  // Filled in as each item is written
+  guint index = out->len;
+  g_byte_array_set_size ( out, index + total * sizeof(guint64) );
+
+  guint nn = 0;
+  for ( guint ll = 0; ll < G_N_ELEMENTS(lists); ll++ ) {
+    for ( GList *it = lists[ll]; it != NULL; it = it->next ) {
+      guint64 offset = GUINT64_TO_LE ( (guint64)(out->len - start) );
+      memcpy ( out->data + index + nn * sizeof(guint64), &offset, sizeof(offset) );
+      nn++;
+      gpointer item = ((SortTRWHashT*)it->data)->data;
+      if ( ll == 0 )
+        write_waypoint ( out, VIK_WAYPOINT(item), dirpath );
+      else
+        write_track ( out, VIK_TRACK(item) );
+    }
+    g_list_free_full ( lists[ll], g_free );
+  }
+}
+
+/* ---------------------------------------------------- */
+/* Reading */
+
+typedef struct {
+  const guint8 *pos;
+  const guint8 *end;
+  gboolean error;
+} BinReader;
+
+static inline gboolean get_check ( BinReader *br, guint64 len )
+{
+  if ( br->error || len > (guint64)(br->end - br->pos) ) {
+    br->error = TRUE;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static guint8 get_u8 ( BinReader *br )
+{
+  if ( !get_check ( br, 1 ) )
+    return 0;
+  return *br->pos++;
+}
+
+static guint32 get_u32 ( BinReader *br )
+{
+  guint32 le;
+  if ( !get_check ( br, sizeof(le) ) )
+    return 0;
+  memcpy ( &le, br->pos, sizeof(le) );
+  br->pos += sizeof(le);
+  return GUINT32_FROM_LE ( le );
+}
+
+static guint64 get_u64 ( BinReader *br )
+{
+  guint64 le;
+  if ( !get_check ( br, sizeof(le) ) )
+    return 0;
+  memcpy ( &le, br->pos, sizeof(le) );
+  br->pos += sizeof(le);
+  return GUINT64_FROM_LE ( le );
+}
+
+static guint64 get_varint ( BinReader *br )
+{
+  guint64 value = 0;
+  for ( guint shift = 0; shift < 64; shift += 7 ) {
+    if ( !get_check ( br, 1 ) )
+      return 0;
+    guint8 byte = *br->pos++;
+    value |= (guint64)(byte & 0x7f) << shift;
+    if ( !(byte & 0x80) )
+      return value;
+  }
+  br->error = TRUE;
+  return 0;
+}
+
+static gchar *get_string ( BinReader *br )
+{
+  guint64 len = get_varint ( br );
+  if ( !get_check ( br, len ) )
+    return NULL;
+  gchar *str = g_strndup ( (const gchar*)br->pos, len );
+  br->pos += len;
+  return str;
+}
+
+static const guint8 *get_bitmap ( BinReader *br, guint nn )
+{
+  if ( !get_check ( br, BITMAP_SIZE(nn) ) )
+    return NULL;
+  const guint8 *bitmap = br->pos;
+  br->pos += BITMAP_SIZE(nn);
+  return bitmap;
+}
+
+static gdouble get_delta ( BinReader *br, guint64 *prev )
+{
+  *prev += (guint64)unzigzag ( get_varint ( br ) );
+  return bits_to_double ( *prev );
+}
+
+typedef struct {
+  gchar *strings[FIELD_SLOTS];
+  gdouble doubles[FIELD_SLOTS];
+  guint64 uints[FIELD_SLOTS];
+} ItemFields;
+
+#define FIELD_STRING(ff,tag) ((ff)->strings[FIELD_SLOT(tag)])
+#define FIELD_DOUBLE(ff,tag) ((ff)->doubles[FIELD_SLOT(tag)])
+#define FIELD_UINT(ff,tag) ((ff)->uints[FIELD_SLOT(tag)])
+
+static void read_fields ( BinReader *br, ItemFields *fields )
+{
+  memset ( fields->strings, 0, sizeof(fields->strings) );
+  memset ( fields->uints, 0, sizeof(fields->uints) );
+  for ( guint ii = 0; ii < FIELD_SLOTS; ii++ )
+    fields->doubles[ii] = NAN;
+
+  while ( TRUE ) {
+    guint8 tag = get_u8 ( br );
+    if ( br->error || tag == FIELD_END )
+      break;
+    guint slot = FIELD_SLOT(tag);
+    switch ( tag & FIELD_KIND_MASK ) {
+    case FIELD_KIND_STRING:
+      g_free ( fields->strings[slot] );
+      fields->strings[slot] = get_string ( br );
+      break;
+    case FIELD_KIND_DOUBLE:
+      fields->doubles[slot] = bits_to_double ( get_u64 ( br ) );
+      break;
+    case FIELD_KIND_UINT:
+      fields->uints[slot] = get_varint ( br );
+      break;
+    default:
+      br->error = TRUE;
+      break;
+    }
+  }
+}
+
+static void fields_free ( ItemFields *fields )
+{
+  for ( guint ii = 0; ii < FIELD_SLOTS; ii++ )
+    g_free ( fields->strings[ii] );
+}
+
+static void read_waypoint ( BinReader *br, VikTrwLayer *trw, const gchar *dirpath )
+{
+  ItemFields fields;
+  read_fields ( br, &fields );
+
+  // As with the GPSPoint format, unnamed waypoints are not kept
+  if ( br->error || !FIELD_STRING(&fields, FIELD_NAME) ) {
+    fields_free ( &fields );
+    return;
+  }
+
+  VikWaypoint *wp = vik_waypoint_new ();
+  wp->visible = !FIELD_UINT(&fields, FIELD_HIDDEN);
+  wp->hide_name = FIELD_UINT(&fields, FIELD_HIDE_NAME) ? TRUE : FALSE;
+  wp->altitude = FIELD_DOUBLE(&fields, FIELD_ALTITUDE);
+  wp->timestamp = FIELD_DOUBLE(&fields, FIELD_TIMESTAMP);
+  wp->speed = FIELD_DOUBLE(&fields, FIELD_SPEED);
+  wp->course = FIELD_DOUBLE(&fields, FIELD_COURSE);
+  wp->magvar = FIELD_DOUBLE(&fields, FIELD_MAGVAR);
+  wp->geoidheight = FIELD_DOUBLE(&fields, FIELD_GEOIDHEIGHT);
+  wp->nsats = FIELD_UINT(&fields, FIELD_SAT);
+  wp->fix_mode = FIELD_UINT(&fields, FIELD_FIX);
+  wp->hdop = FIELD_DOUBLE(&fields, FIELD_HDOP);
+  wp->vdop = FIELD_DOUBLE(&fields, FIELD_VDOP);
+  wp->pdop = FIELD_DOUBLE(&fields, FIELD_PDOP);
+  wp->ageofdgpsdata = FIELD_DOUBLE(&fields, FIELD_AGEOFDGPSDATA);
+  wp->dgpsid = FIELD_UINT(&fields, FIELD_DGPSID);
+
+  struct LatLon ll = { FIELD_DOUBLE(&fields, FIELD_LATITUDE), FIELD_DOUBLE(&fields, FIELD_LONGITUDE) };
+  vik_coord_load_from_latlon ( &(wp->coord), vik_trw_layer_get_coord_mode(trw), &ll );
+
+  vik_trw_layer_filein_add_waypoint ( trw, FIELD_STRING(&fields, FIELD_NAME), wp );
+
+  if ( FIELD_STRING(&fields, FIELD_COMMENT) )
+    vik_waypoint_set_comment ( wp, FIELD_STRING(&fields, FIELD_COMMENT) );
+  if ( FIELD_STRING(&fields, FIELD_DESCRIPTION) )
+    vik_waypoint_set_description ( wp, FIELD_STRING(&fields, FIELD_DESCRIPTION) );
+  if ( FIELD_STRING(&fields, FIELD_SOURCE) )
+    vik_waypoint_set_source ( wp, FIELD_STRING(&fields, FIELD_SOURCE) );
+  if ( FIELD_STRING(&fields, FIELD_URL) )
+    vik_waypoint_set_url ( wp, FIELD_STRING(&fields, FIELD_URL) );
+  if ( FIELD_STRING(&fields, FIELD_URL_NAME) )
+    vik_waypoint_set_url_name ( wp, FIELD_STRING(&fields, FIELD_URL_NAME) );
+  if ( FIELD_STRING(&fields, FIELD_TYPE) )
+    vik_waypoint_set_type ( wp, FIELD_STRING(&fields, FIELD_TYPE) );
+  if ( FIELD_STRING(&fields, FIELD_IMAGE) ) {
+    gchar *fn = util_make_absolute_filename ( FIELD_STRING(&fields, FIELD_IMAGE), dirpath );
+    vik_waypoint_set_image ( wp, fn ? fn : FIELD_STRING(&fields, FIELD_IMAGE) );
+    g_free ( fn );
+  }
+  if ( !isnan(FIELD_DOUBLE(&fields, FIELD_IMAGE_DIRECTION)) ) {
+    wp->image_direction = FIELD_DOUBLE(&fields, FIELD_IMAGE_DIRECTION);
+    wp->image_direction_ref = FIELD_UINT(&fields, FIELD_IMAGE_DIRECTION_REF);
+  }
+  if ( FIELD_STRING(&fields, FIELD_SYMBOL) )
+    vik_waypoint_set_symbol ( wp, FIELD_STRING(&fields, FIELD_SYMBOL) );
+  if ( FIELD_STRING(&fields, FIELD_EXTENSIONS) )
+    vik_waypoint_set_extensions ( wp, FIELD_STRING(&fields, FIELD_EXTENSIONS) );
+
+  fields_free ( &fields );
+}
+
+static void read_string_column ( BinReader *br, VikTrackpoint **tps, guint nn, gsize offset, gboolean pooled )
+{
+  const guint8 *bitmap = get_bitmap ( br, nn );
+  if ( br->error )
+    return;
+  for ( guint ii = 0; ii < nn && !br->error; ii++ )
+    if ( BITMAP_TEST(bitmap, ii) ) {
+      gchar *str = get_string ( br );
+      if ( pooled && str ) {
+        G_STRUCT_MEMBER(gchar*, tps[ii], offset) = (gchar*)a_string_pool_intern ( str );
+        g_free ( str );
+      }
+      else
+        G_STRUCT_MEMBER(gchar*, tps[ii], offset) = str;
+    }
+}
+
+static void read_trackpoints ( BinReader *br, VikTrackpoint **tps, guint nn, guint32 mask, VikCoordMode coord_mode )
+{
+  gdouble *lats = g_new ( gdouble, nn ? nn : 1 );
+  guint64 prev = 0;
+  for ( guint ii = 0; ii < nn; ii++ )
+    lats[ii] = get_delta ( br, &prev );
+  prev = 0;
+  for ( guint ii = 0; ii < nn; ii++ ) {
+    struct LatLon ll = { lats[ii], get_delta ( br, &prev ) };
+    vik_coord_load_from_latlon ( &(tps[ii]->coord), coord_mode, &ll );
+  }
+  g_free ( lats );
+
+  for ( guint cc = 0; cc < NUM_DOUBLE_COLUMNS && !br->error; cc++ ) {
+    if ( !(mask & (1 << cc)) )
+      continue;
+    gboolean all = get_u8 ( br );
+    const guint8 *bitmap = all ? NULL : get_bitmap ( br, nn );
+    if ( br->error )
+      return;
+    prev = 0;
+    for ( guint ii = 0; ii < nn; ii++ )
+      if ( all || BITMAP_TEST(bitmap, ii) )
+        G_STRUCT_MEMBER(gdouble, tps[ii], double_columns[cc]) = get_delta ( br, &prev );
+  }
+
+  for ( guint cc = 0; cc < NUM_INT_COLUMNS && !br->error; cc++ ) {
+    if ( !(mask & (1 << (COLUMN_NSATS + cc))) )
+      continue;
+    const guint8 *bitmap = get_bitmap ( br, nn );
+    if ( br->error )
+      return;
+    for ( guint ii = 0; ii < nn; ii++ )
+      if ( BITMAP_TEST(bitmap, ii) )
+        G_STRUCT_MEMBER(gint, tps[ii], int_columns[cc].offset) = (gint)unzigzag ( get_varint ( br ) );
+  }
+
+  if ( mask & (1 << COLUMN_NEWSEGMENT) ) {
+    const guint8 *bitmap = get_bitmap ( br, nn );
+    if ( br->error )
+      return;
+    for ( guint ii = 0; ii < nn; ii++ )
+      tps[ii]->newsegment = BITMAP_TEST(bitmap, ii) ? TRUE : FALSE;
+  }
+
+  if ( mask & (1 << COLUMN_NAME) )
+    read_string_column ( br, tps, nn, G_STRUCT_OFFSET(VikTrackpoint, name), FALSE );
+
+  if ( mask & (1 << COLUMN_EXTENSIONS) )
+    read_string_column ( br, tps, nn, G_STRUCT_OFFSET(VikTrackpoint, extensions), TRUE );
+}
+
+/**
+ * Returns: The track, with its name from the data (if any) set in @name, or NULL on an error
+ */
+static VikTrack *read_track_item ( BinReader *br, VikCoordMode coord_mode, gchar **name )
+{
+  ItemFields fields;
+  read_fields ( br, &fields );
+
+  guint64 nn = get_varint ( br );
+  guint32 mask = (guint32)get_varint ( br );
+  // Each trackpoint takes at least two bytes, so this guards against nonsense sizes
+  if ( br->error || nn > (guint64)(br->end - br->pos) / 2 ) {
+    fields_free ( &fields );
+    return NULL;
+  }
+
+  VikTrackpoint **tps = g_new ( VikTrackpoint*, nn ? nn : 1 );
+  for ( guint ii = 0; ii < nn; ii++ )
+    tps[ii] = vik_trackpoint_new ();
+
+  read_trackpoints ( br, tps, nn, mask, coord_mode );
+
+  if ( br->error ) {
+    for ( guint ii = 0; ii < nn; ii++ )
+      vik_trackpoint_free ( tps[ii] );
+    g_free ( tps );
+    fields_free ( &fields );
+    return NULL;
+  }
+
+  VikTrack *trk = vik_track_new ();
+  trk->is_route = FIELD_UINT(&fields, FIELD_ROUTE) ? TRUE : FALSE;
+  trk->visible = !FIELD_UINT(&fields, FIELD_HIDDEN);
+  if ( FIELD_STRING(&fields, FIELD_COMMENT) )
+    vik_track_set_comment ( trk, FIELD_STRING(&fields, FIELD_COMMENT) );
+  if ( FIELD_STRING(&fields, FIELD_DESCRIPTION) )
+    vik_track_set_description ( trk, FIELD_STRING(&fields, FIELD_DESCRIPTION) );
+  if ( FIELD_STRING(&fields, FIELD_SOURCE) )
+    vik_track_set_source ( trk, FIELD_STRING(&fields, FIELD_SOURCE) );
+  if ( FIELD_STRING(&fields, FIELD_TYPE) )
+    vik_track_set_type ( trk, FIELD_STRING(&fields, FIELD_TYPE) );
+  if ( FIELD_STRING(&fields, FIELD_EXTENSIONS) )
+    vik_track_set_extensions ( trk, FIELD_STRING(&fields, FIELD_EXTENSIONS) );
+  trk->number = FIELD_UINT(&fields, FIELD_NUMBER);
+  guint64 color = FIELD_UINT(&fields, FIELD_COLOR);
+  if ( color ) {
+    // Same scaling as gdk_color_parse() does for "#rrggbb"
+    trk->color.red = ((color >> 16) & 0xff) * 257;
+    trk->color.green = ((color >> 8) & 0xff) * 257;
+    trk->color.blue = (color & 0xff) * 257;
+    trk->has_color = TRUE;
+  }
+  trk->draw_name_mode = FIELD_UINT(&fields, FIELD_DRAW_NAME_MODE);
+  trk->max_number_dist_labels = FIELD_UINT(&fields, FIELD_NUMBER_DIST_LABELS);
+
+  for ( guint ii = nn; ii > 0; ii-- )
+    trk->trackpoints = g_list_prepend ( trk->trackpoints, tps[ii-1] );
+  g_free ( tps );
+
+  *name = FIELD_STRING(&fields, FIELD_NAME);
+  FIELD_STRING(&fields, FIELD_NAME) = NULL;
+  fields_free ( &fields );
+  return trk;
+}
+
+static gboolean read_track ( BinReader *br, VikTrwLayer *trw, gboolean is_route )
+{
+  gchar *name = NULL;
+  VikTrack *trk = read_track_item ( br, vik_trw_layer_get_coord_mode(trw), &name );
+  if ( !trk )
+    return FALSE;
+  trk->is_route = is_route;
+  vik_trw_layer_filein_add_track ( trw, name ? name : "UNK", trk );
+  g_free ( name );
+  return TRUE;
+}
+
+/**
+ * a_trwbinary_read_track:
+ * @data:   As written by a_trwbinary_write_track()
+ * @length: The size of the data
+ *
+ * Returns: The track in latitude/longitude coordinates with its bounds calculated,
+ *          or NULL if the data is not readable
+ */
+VikTrack *a_trwbinary_read_track ( const guint8 *data, gsize length )
+{
+  BinReader br = { data, data + length, FALSE };
+
+  guint32 version = get_u32 ( &br );
+  if ( br.error || version > TRWBINARY_VERSION ) {
+    g_warning ( "%s: unsupported track data version %d", __FUNCTION__, version );
+    return NULL;
+  }
+  gchar *name = NULL;
+  VikTrack *trk = read_track_item ( &br, VIK_COORD_LATLON, &name );
+  if ( trk ) {
+    trk->name = name;
+    vik_track_calculate_bounds ( trk );
+  }
+  return trk;
+}
+
+/**
+ * a_trwbinary_read_bounds:
+ * @data:   The layer block, as written by a_trwbinary_write_layer()
+ * @length: The size of the layer block
+ * @bbox:   Set to the bounds of all the items in the layer
+ *
+ * Returns: FALSE if the block does not record the bounds
+ */
+gboolean a_trwbinary_read_bounds ( const guint8 *data, gsize length, LatLonBBox *bbox )
+{
+  BinReader br = { data, data + length, FALSE };
+
+  guint32 version = get_u32 ( &br );
+  if ( version < 2 || version > TRWBINARY_VERSION )
+    return FALSE;
+  // Skip the item counts
+  for ( guint ll = 0; ll < 3; ll++ )
+    (void)get_u32 ( &br );
+  bbox->north = bits_to_double ( get_u64 ( &br ) );
+  bbox->south = bits_to_double ( get_u64 ( &br ) );
+  bbox->east = bits_to_double ( get_u64 ( &br ) );
+  bbox->west = bits_to_double ( get_u64 ( &br ) );
+  return !br.error;
+}
+
+/**
+ * a_trwbinary_read_layer:
+ * @trw:     The layer to add the items to
+ * @data:    The layer block, as written by a_trwbinary_write_layer()
+ * @length:  The size of the layer block
+ * @dirpath: The directory of the .vik file, for relative filenames (can be NULL)
+ *
+ * Returns: FALSE if the block was not fully readable
+ */
+gboolean a_trwbinary_read_layer ( VikTrwLayer *trw, const guint8 *data, gsize length, const gchar *dirpath )
+{
+  BinReader br = { data, data + length, FALSE };
+
+  guint32 version = get_u32 ( &br );
+  if ( version > TRWBINARY_VERSION ) {
+    g_warning ( "%s: unsupported layer data version %d", __FUNCTION__, version );
+    return FALSE;
+  }
+  guint32 counts[3];
+  guint64 total = 0;
+  for ( guint ll = 0; ll < G_N_ELEMENTS(counts); ll++ ) {
+    counts[ll] = get_u32 ( &br );
+    total += counts[ll];
+  }
+  if ( version >= 2 && get_check ( &br, 4 * sizeof(guint64) ) )
+    br.pos += 4 * sizeof(guint64);
+  if ( !get_check ( &br, total * sizeof(guint64) ) )
+    return FALSE;
+
+  gboolean success = TRUE;
+  BinReader index = br;
+  for ( guint ll = 0; ll < G_N_ELEMENTS(counts); ll++ ) {
+    for ( guint nn = 0; nn < counts[ll]; nn++ ) {
+      guint64 offset = get_u64 ( &index );
+      if ( offset >= length ) {
+        success = FALSE;
+        continue;
+      }
+      BinReader item = { data + offset, data + length, FALSE };
+      if ( ll == 0 )
+        read_waypoint ( &item, trw, dirpath );
+      else
+        read_track ( &item, trw, ll == 2 );
+      if ( item.error )
+        success = FALSE;
+    }
+  }
+  if ( !success )
+    g_warning ( "%s: layer data is damaged, some items could not be read", __FUNCTION__ );
+
+  return success;
+}
@@ -0,0 +1,38 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _VIKING_TRWBINARY_H
+#define _VIKING_TRWBINARY_H
+
+#include "viktrwlayer.h"
+
+G_BEGIN_DECLS
+
+// Binary form of the TrackWaypoint layer data, as stored in binary .vik files
+void a_trwbinary_write_layer ( VikTrwLayer *trw, GByteArray *out, const gchar *dirpath );
+gboolean a_trwbinary_read_layer ( VikTrwLayer *trw, const guint8 *data, gsize length, const gchar *dirpath );
+gboolean a_trwbinary_read_bounds ( const guint8 *data, gsize length, LatLonBBox *bbox );
+
+// Single tracks, as used by vik_track_marshall()
+void a_trwbinary_write_track ( VikTrack *trk, GByteArray *out );
+VikTrack *a_trwbinary_read_track ( const guint8 *data, gsize length );
+
+G_END_DECLS
+
+#endif
@@ -219,6 +219,16 @@ GdkPixbuf *ui_pixbuf_new ( GdkColor *color, guint width, guint height )
 	return pixbuf;
 }
 
+/**
+ * Memory used by the pixels of the pixbuf, which may be NULL
+ */
+gsize ui_pixbuf_get_bytes ( GdkPixbuf *pixbuf )
+{
+	if ( !pixbuf )
+		return 0;
+	return (gsize)gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf);
+}
+
 /**
  * Apply the alpha value to the specified pixbuf
  */
@@ -409,6 +419,44 @@ GtkTreeViewColumn *ui_new_column_text ( const gchar *title, GtkCellRenderer *ren
 	return column;
 }
 
+/**
+ * ui_get_text_width:
+ *
+ * Returns: The width in pixels of the (possibly multiline) text when shown in the widget
+ */
+gint ui_get_text_width ( GtkWidget *widget, const gchar *text )
+{
+	PangoLayout *layout = gtk_widget_create_pango_layout ( widget, text );
+	gint width = 0;
+	pango_layout_get_pixel_size ( layout, &width, NULL );
+	g_object_unref ( layout );
+	return width;
+}
+
+/**
+ * ui_tree_view_set_fixed_height_mode:
+ *
+ * Make the view only ask for the values of the rows actually shown,
+ *  rather than measuring every row of the model.
+ * Each column is fixed to the width of its title,
+ *  or any larger fixed width already set on the column.
+ */
+void ui_tree_view_set_fixed_height_mode ( GtkWidget *view )
+{
+	GList *columns = gtk_tree_view_get_columns ( GTK_TREE_VIEW(view) );
+	for ( GList *gl = columns; gl; gl = g_list_next(gl) ) {
+		GtkTreeViewColumn *column = GTK_TREE_VIEW_COLUMN(gl->data);
+		const gchar *title = gtk_tree_view_column_get_title ( column );
+		// Allow for the padding and the sort indicator
+		gint width = (title ? ui_get_text_width ( view, title ) : 0) + 30;
+		width = MAX ( width, gtk_tree_view_column_get_fixed_width(column) );
+		gtk_tree_view_column_set_sizing ( column, GTK_TREE_VIEW_COLUMN_FIXED );
+		gtk_tree_view_column_set_fixed_width ( column, width );
+	}
+	g_list_free ( columns );
+	gtk_tree_view_set_fixed_height_mode ( GTK_TREE_VIEW(view), TRUE );
+}
+
 /**
  * ui_tree_model_number_tooltip_cb:
  *
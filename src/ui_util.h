@@ -43,6 +43,7 @@ GtkWidget *ui_spin_button_new ( GtkAdjustment *adjustment,
                                 guint digits );
 
 GdkPixbuf *ui_pixbuf_new ( GdkColor *color, guint width, guint height );
+gsize ui_pixbuf_get_bytes ( GdkPixbuf *pixbuf );
 GdkPixbuf *ui_pixbuf_set_alpha ( GdkPixbuf *pixbuf, guint8 alpha );
 GdkPixbuf *ui_pixbuf_scale_alpha ( GdkPixbuf *pixbuf, guint8 alpha );
 void ui_add_recent_file ( const gchar *filename );
@@ -54,6 +55,8 @@ void ui_format_1f_cell_data_func ( GtkTreeViewColumn *col,
                                    gpointer           user_data );
 
 GtkTreeViewColumn *ui_new_column_text ( const gchar *title, GtkCellRenderer *renderer, GtkWidget *view, gint column_runner );
+gint ui_get_text_width ( GtkWidget *widget, const gchar *text );
+void ui_tree_view_set_fixed_height_mode ( GtkWidget *view );
 
 gboolean ui_tree_model_number_tooltip_cb ( GtkWidget    *widget,
                                            gint          x,
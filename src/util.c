@@ -31,6 +31,7 @@
 #include <glib/gprintf.h>
 #include <gio/gio.h>
 #include <math.h>
+#include <string.h>
 #include <ctype.h> // For isalpha() etc...
 
 #include "util.h"
@@ -42,6 +43,63 @@ guint util_get_number_of_cpus ()
   return g_get_num_processors();
 }
 
+/**
+ * Read a small number from a file, such as those of the sysfs CPU topology
+ */
+static gboolean read_number_file ( const gchar *filename, gint *value )
+{
+  gchar *contents = NULL;
+  gboolean ans = g_file_get_contents ( filename, &contents, NULL, NULL );
+  if ( ans )
+    *value = (gint)g_ascii_strtoll ( contents, NULL, 10 );
+  g_free ( contents );
+  return ans;
+}
+
+static gpointer count_cores ( gpointer data )
+{
+  guint cores = 0;
+#ifdef __linux__
+  // Each distinct package (socket) and core pair is a physical core, shared by any SMT siblings
+  GHashTable *seen = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  GDir *dir = g_dir_open ( "/sys/devices/system/cpu", 0, NULL );
+  if ( dir ) {
+    const gchar *name;
+    while ( (name = g_dir_read_name ( dir )) ) {
+      if ( !g_str_has_prefix ( name, "cpu" ) || !g_ascii_isdigit ( name[3] ) )
+        continue;
+      gint package, core;
+      gchar *fn_package = g_strdup_printf ( "/sys/devices/system/cpu/%s/topology/physical_package_id", name );
+      gchar *fn_core = g_strdup_printf ( "/sys/devices/system/cpu/%s/topology/core_id", name );
+      if ( read_number_file ( fn_package, &package ) && read_number_file ( fn_core, &core ) )
+        g_hash_table_add ( seen, GINT_TO_POINTER(((package & 0xffff) << 16) | (core & 0xffff)) );
+      g_free ( fn_package );
+      g_free ( fn_core );
+    }
+    g_dir_close ( dir );
+  }
+  cores = g_hash_table_size ( seen );
+  g_hash_table_destroy ( seen );
+#endif
+  // Otherwise no way of telling, so assume there's no SMT
+  guint cpus = util_get_number_of_cpus ();
+  if ( cores == 0 || cores > cpus )
+    cores = cpus;
+  return GUINT_TO_POINTER(cores);
+}
+
+/**
+ * util_get_number_of_cores:
+ *
+ * Returns: The number of physical cores, i.e. not counting SMT (hyperthreading) siblings,
+ *  for sizing the pools of CPU bound work which gains little from the siblings
+ */
+guint util_get_number_of_cores ()
+{
+  static GOnce once = G_ONCE_INIT;
+  return GPOINTER_TO_UINT ( g_once ( &once, count_cores, NULL ) );
+}
+
 /**
  * split_string_from_file_on_equals:
  *
@@ -213,6 +271,127 @@ gchar* util_formatd ( const gchar *format, gdouble dd )
   return buffer;
 }
 
+/**
+ * util_strtod_len:
+ * @str: The text of the number, which need not be nul terminated
+ * @len: The length of the text
+ *
+ * Convert a number WITHOUT LOCALE, as g_ascii_strtod() but just for the given length.
+ * Plain decimal numbers (e.g. "-1.2345", with surrounding whitespace allowed)
+ *  as normally found in our files are converted directly.
+ * While the digits fit in the 53 bit mantissa and the power of ten is at most 10^22,
+ *  both are exact as doubles and so the single division gives the correctly rounded result.
+ * Anything else goes via g_ascii_strtod().
+ */
+gdouble util_strtod_len ( const gchar *str, gsize len )
+{
+  static const gdouble powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+                                    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  const gchar *ptr = str;
+  const gchar *end = str + len;
+  while ( ptr < end && g_ascii_isspace(*ptr) )
+    ptr++;
+  gboolean negative = ( ptr < end && *ptr == '-' );
+  if ( ptr < end && (*ptr == '-' || *ptr == '+') )
+    ptr++;
+
+  guint64 mantissa = 0;
+  guint digits = 0;
+  guint decimals = 0;
+  // Only up to 19 digits can be held (any more takes the slow path)
+  while ( ptr < end && g_ascii_isdigit(*ptr) && digits < 20 ) {
+    mantissa = mantissa * 10 + (*ptr++ - '0');
+    digits++;
+  }
+  if ( ptr < end && *ptr == '.' ) {
+    ptr++;
+    while ( ptr < end && g_ascii_isdigit(*ptr) && digits < 20 ) {
+      mantissa = mantissa * 10 + (*ptr++ - '0');
+      digits++;
+      decimals++;
+    }
+  }
+  while ( ptr < end && g_ascii_isspace(*ptr) )
+    ptr++;
+
+  if ( digits > 0 && digits < 20 && ptr == end &&
+       mantissa <= G_GUINT64_CONSTANT(1) << 53 && decimals < G_N_ELEMENTS(powers) ) {
+    gdouble value = (gdouble)mantissa / powers[decimals];
+    return negative ? -value : value;
+  }
+
+  gchar buf[64];
+  if ( len < sizeof(buf) ) {
+    memcpy ( buf, str, len );
+    buf[len] = '\0';
+    return g_ascii_strtod ( buf, NULL );
+  }
+  gchar *tmp = g_strndup ( str, len );
+  gdouble value = g_ascii_strtod ( tmp, NULL );
+  g_free ( tmp );
+  return value;
+}
+
+/**
+ * util_time_from_iso8601:
+ * @str:       The text of the time
+ * @timestamp: Set to the seconds since the epoch (including any fraction)
+ *
+ * Read an ISO 8601 time, as g_time_val_from_iso8601() but with a quick path
+ *  for the fixed "YYYY-MM-DDTHH:MM:SS[.sss]Z" form that practically all GPS devices write.
+ *
+ * Returns: FALSE if the text is not a time, leaving @timestamp as it was
+ */
+gboolean util_time_from_iso8601 ( const gchar *str, gdouble *timestamp )
+{
+  const gchar *ptr = str;
+  while ( g_ascii_isspace(*ptr) )
+    ptr++;
+
+  static const gchar format[] = "dddd-dd-ddTdd:dd:dd";
+  const guint format_len = sizeof(format) - 1;
+  guint ii;
+  for ( ii = 0; ii < format_len; ii++ ) {
+    if ( format[ii] == 'd' ? !g_ascii_isdigit(ptr[ii]) : ptr[ii] != format[ii] )
+      break;
+  }
+  if ( ii == format_len ) {
+#define UTIL_DIGITS2(p) (((p)[0]-'0')*10 + ((p)[1]-'0'))
+    struct tm tm = { 0 };
+    tm.tm_year = UTIL_DIGITS2(ptr)*100 + UTIL_DIGITS2(ptr+2) - 1900;
+    tm.tm_mon = UTIL_DIGITS2(ptr+5) - 1;
+    tm.tm_mday = UTIL_DIGITS2(ptr+8);
+    tm.tm_hour = UTIL_DIGITS2(ptr+11);
+    tm.tm_min = UTIL_DIGITS2(ptr+14);
+    tm.tm_sec = UTIL_DIGITS2(ptr+17);
+#undef UTIL_DIGITS2
+    const gchar *end = ptr + format_len;
+    gdouble fraction = 0.0;
+    if ( *end == '.' ) {
+      gdouble scale = 0.1;
+      for ( end++; g_ascii_isdigit(*end); end++, scale /= 10 )
+        fraction += (*end - '0') * scale;
+    }
+    if ( end[0] == 'Z' && (end[1] == '\0' || g_ascii_isspace(end[1])) &&
+         tm.tm_mon >= 0 && tm.tm_mon < 12 && tm.tm_mday >= 1 && tm.tm_mday <= 31 &&
+         tm.tm_hour < 24 && tm.tm_min < 60 && tm.tm_sec <= 60 ) {
+      gdouble d1 = util_timegm ( &tm );
+      *timestamp = (d1 < 0) ? d1 - fraction : d1 + fraction;
+      return TRUE;
+    }
+  }
+
+  // Anything else e.g. with a timezone offset
+  GTimeVal tv;
+  if ( g_time_val_from_iso8601(str, &tv) ) {
+    gdouble d1 = tv.tv_sec;
+    gdouble d2 = (gdouble)tv.tv_usec/G_USEC_PER_SEC;
+    *timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
+    return TRUE;
+  }
+  return FALSE;
+}
+
 /**
  * util_make_absolute_filename:
  *
@@ -31,6 +31,7 @@
 G_BEGIN_DECLS
 
 guint util_get_number_of_cpus (void);
+guint util_get_number_of_cores (void);
 
 gboolean split_string_from_file_on_equals ( const gchar *buf, gchar **key, gchar **val );
 
@@ -76,6 +77,10 @@ void util_time_decompose ( gdouble total_seconds, guint *hours, guint *minutes,
 
 gchar* util_formatd ( const gchar *format, gdouble dd );
 
+gdouble util_strtod_len ( const gchar *str, gsize len );
+
+gboolean util_time_from_iso8601 ( const gchar *str, gdouble *timestamp );
+
 gboolean util_is_url ( const gchar *str );
 
 gchar* util_frob ( gchar *str, guint ii );
@@ -23,13 +23,21 @@
 #include "vikgpslayer.h"
 #include "vikgeocluelayer.h"
 #include "viktrwlayer_analysis.h"
+#include "viktrwlayer_playback.h"
 #include "viktrwlayer_tracklist.h"
 #include "viktrwlayer_waypointlist.h"
 #include "viktrwlayer_export.h"
 #include "maputils.h"
 #include "background.h"
+#include "tileset.h"
+#include "heatmaptiles.h"
+#include "trackdupes.h"
+#include "trackarea.h"
+#include "mapcache.h"
 #include "gpx.h"
 #include "dir.h"
+#include "dems.h"
+#include "vikdemlayer.h"
 #ifdef HAVE_SQLITE3_H
 #include "sqlite3.h"
 #endif
@@ -42,6 +50,8 @@ static VikAggregateLayer *aggregate_layer_unmarshall( guint8 *data, guint len, V
 static void aggregate_layer_change_coord_mode ( VikAggregateLayer *val, VikCoordMode mode );
 static void aggregate_layer_drag_drop_request ( VikAggregateLayer *val_src, VikAggregateLayer *val_dest, GtkTreeIter *src_item_iter, GtkTreePath *dest_path );
 static const gchar* aggregate_layer_tooltip ( VikAggregateLayer *val );
+static void aggregate_layer_get_memory ( VikAggregateLayer *val, VikLayerMemory *mem );
+static void hm_tiles_draw ( VikAggregateLayer *val, VikViewport *vvp );
 static void aggregate_layer_add_menu_items ( VikAggregateLayer *val, GtkMenu *menu, gpointer vlp );
 static gboolean aggregate_layer_set_param ( VikAggregateLayer *val, VikLayerSetParam *vlsp );
 static VikLayerParamData aggregate_layer_get_param ( VikAggregateLayer *val, guint16 id, gboolean is_file_operation );
@@ -50,7 +60,16 @@ static void aggregate_layer_post_read ( VikAggregateLayer *val, VikViewport *vvp
 static gboolean aggregate_layer_selected_viewport_menu ( VikAggregateLayer *val, GdkEventButton *event, VikViewport *vvp );
 
 static void tac_calculate ( VikAggregateLayer *val );
+static void tac_track_free ( gpointer data );
+static void hm_track_free ( gpointer data );
 static void hm_calculate ( VikAggregateLayer *val );
+static void hm_tiles_refresh ( VikAggregateLayer *val );
+
+// A mapcache type not used by any map source, for the heatmap tiles
+#define HM_TILES_CACHE_TYPE 65001
+
+// Limit on the tiles kept in the coverage around the display, at 4 bytes per tile
+#define TAC_COVER_MAX_TILES 2097152
 
 static gchar *params_tile_area_levels[] = { "16", "15", "14", "13", "12", "11", "10", "9", "8", "7", "6", "5", "4", NULL };
 static gchar *params_tac_time_ranges[] = { N_("All Time"), "1", "2", "3", "5", "7", "10", "15", "20", "25", NULL };
@@ -116,6 +135,14 @@ static gchar * params_styles[] =
     NULL
   };
 
+static gchar * params_hm_modes[] =
+  { N_("Trackpoints"),
+    N_("Lines"),
+    N_("Lines as Tiles"),
+    NULL
+  };
+enum { HM_MODE_POINTS=0, HM_MODE_LINES, HM_MODE_TILES };
+
 static gchar *params_groups[] = { N_("Tracks Area Coverage"), N_("TAC Advanced"), N_("Tracks Heatmap") };
 enum { GROUP_TAC, GROUP_TAC_ADV, GROUP_THM };
 
@@ -155,6 +182,8 @@ VikLayerParam aggregate_layer_params[] = {
   { VIK_LAYER_AGGREGATE, "hm_factor", VIK_LAYER_PARAM_UINT, GROUP_THM, N_("Width Factor:"), VIK_LAYER_WIDGET_HSCALE, &params_scales[1], NULL,
     N_("Note higher values means the heatmap takes longer to generate"), width_default, NULL, NULL },
   { VIK_LAYER_AGGREGATE, "hm_style", VIK_LAYER_PARAM_UINT, GROUP_THM, N_("Color Style:"), VIK_LAYER_WIDGET_COMBOBOX, params_styles, NULL, NULL, NULL, NULL, NULL },
+  { VIK_LAYER_AGGREGATE, "hm_mode", VIK_LAYER_PARAM_UINT, GROUP_THM, N_("Mode:"), VIK_LAYER_WIDGET_COMBOBOX, params_hm_modes, NULL,
+    N_("Trackpoints weights areas by time spent there. Lines weights areas by the number of tracks covering them, regardless of the recording rate. Lines as Tiles can then be panned and zoomed without recalculating."), NULL, NULL, NULL },
   { VIK_LAYER_AGGREGATE, "reset", VIK_LAYER_PARAM_PTR_DEFAULT, VIK_LAYER_GROUP_NONE, NULL,
     VIK_LAYER_WIDGET_BUTTON, N_("Reset All to Defaults"), NULL, NULL, reset_default, NULL, NULL },
 };
@@ -180,6 +209,7 @@ enum {
       PARAM_HM_ALPHA,
       PARAM_HM_STAMP_FACTOR,
       PARAM_HM_STYLE,
+      PARAM_HM_MODE,
       PARAM_RESET,
       NUM_PARAMS
 };
@@ -247,6 +277,7 @@ VikLayerInterface vik_aggregate_layer_interface = {
   (VikLayerFuncSelectedViewportMenu)    aggregate_layer_selected_viewport_menu,
 
   (VikLayerFuncRefresh)                 NULL,
+  (VikLayerFuncGetMemory)               aggregate_layer_get_memory,
 };
 
 struct _VikAggregateLayer {
@@ -254,6 +285,7 @@ struct _VikAggregateLayer {
   GList *children;
   // One per layer
   GtkWidget *tracks_analysis_dialog;
+  GtkWidget *playback_dialog;
 
   // Tracks Area Coverage
   gboolean calculating;
@@ -263,8 +295,13 @@ struct _VikAggregateLayer {
   gboolean on[CP_NUM];
   guint8 alpha[CP_NUM];
   GdkColor color[CP_NUM];
-  GdkPixbuf *pixbuf[CP_NUM];      // Individual tile
-  GdkPixbuf *full_pixbuf[CP_NUM]; // Whole screen
+  guint tac_gen;                 // Changed whenever the coverage to draw may have changed
+  GdkPixbuf *cover;              // Coverage at one pixel per tile
+  guint cover_gen;               // The tac_gen when cover was made
+  guint cover_zoom;
+  gint cover_xmin, cover_xmax;   // Tiles in cover
+  gint cover_ymin, cover_ymax;
+  GdkPixbuf *full_pixbuf;        // Whole screen
   GdkPixbuf *unreachable_pixbuf; // Whole screen
   guint num_tiles[CP_NUM];
 
@@ -274,10 +311,12 @@ struct _VikAggregateLayer {
   gint xx,yy; // Location of top left max square tile
 
   guint8 tac_time_range; // Years
-  // Maybe a sparse table would be more efficient
-  //  but this seems to work OK at least if all tracks are confined within a not too diverse area
-  GHashTable *tiles;
-  GHashTable *tiles_clust;
+  TileSet *tiles;
+  TileSet *tiles_clust;
+  // Contribution of each track, so only new or changed tracks need to be processed again
+  GHashTable *tac_tracks;   // Keyed by the track pointer (which is never dereferenced)
+  TileSet *tac_track_tiles; // Tiles of all the contributions, reference counted
+  gdouble tac_tracks_zoom;  // The zoom_level of the contributions
 
   // Heatmap
   gboolean hm_calculating;
@@ -288,17 +327,32 @@ struct _VikAggregateLayer {
   gint hm_height;
   LatLonBBox hm_bbox;
   const VikCoord *hm_center;
+  VikCoord hm_calc_center; // Copy of the center as at the original request
   VikCoord hm_tl;
   // Drawing values (zoom level may have changed)
   gint hm_scaled_zoom;
-  gint hm_zoom_max;
   guint8 hm_alpha;
   GdkPixbuf *hm_pixbuf;
-  GdkPixbuf *hm_pbf_scaled;
-  gboolean hm_scaled;
+  GdkPixbuf *hm_window;        // The visible part of hm_pixbuf as scaled for the view
+  gint hm_window_zoom;         // The view hm_window is for
+  gint hm_window_x, hm_window_y;
+  HeatmapTiles *hm_tiles;      // For HM_MODE_TILES
+  guint hm_tiles_gen;
+  gchar *hm_tiles_name;
   guint8 hm_stamp_factor;
   guint8 hm_style;
+  guint8 hm_mode;
+  guint8 hm_calc_mode; // Mode as at the original request
   GdkColor hm_color;
+  // Trackpoints per pixel from each track, for the view settings they were counted with
+  GHashTable *hm_tracks; // HmTrackT keyed by the track pointer (which is never dereferenced)
+  gfloat *hm_counts;
+  gint hm_counts_width;
+  gint hm_counts_height;
+  gint hm_counts_zoom;
+  guint hm_counts_scale;
+  VikCoord hm_counts_center;
+  guint8 hm_counts_mode;
 
   MapCoord rc_menu_mc; // Position of Right Click menu
 };
@@ -425,9 +479,15 @@ const heatmap_colorscheme_t* hm_colorschemes[] =
 // Ensure when 'apply' button heatmap regenerated to use new values
 static void hm_apply ( VikAggregateLayer *val )
 {
-  if ( VIK_LAYER(val)->realized )
-    if ( !val->hm_calculating && val->hm_pixbuf )
-      hm_calculate ( val );
+  if ( VIK_LAYER(val)->realized ) {
+    if ( !val->hm_calculating ) {
+      // Tiles are simply redrawn when the index is still applicable
+      if ( val->hm_tiles && val->hm_mode == HM_MODE_TILES )
+        hm_tiles_refresh ( val );
+      else if ( val->hm_pixbuf || val->hm_tiles )
+        hm_calculate ( val );
+    }
+  }
 }
 
 static void tac_apply ( VikAggregateLayer *val, VikLayerSetParam *vlsp )
@@ -503,8 +563,19 @@ static gboolean aggregate_layer_set_param ( VikAggregateLayer *val, VikLayerSetP
           hm_apply ( val );
       }
       break;
+    case PARAM_HM_MODE:
+      if ( vlsp->data.u <= HM_MODE_TILES ) {
+        guint8 old = val->hm_mode;
+        val->hm_mode = vlsp->data.u;
+        if ( val->hm_mode != old )
+          if ( !vlsp->is_file_operation )
+            hm_apply ( val );
+      }
+      break;
     default: break;
   }
+  // Colours, transparency or what is shown may have changed
+  val->tac_gen++;
   return TRUE;
 }
 
@@ -530,6 +601,7 @@ static VikLayerParamData aggregate_layer_get_param ( VikAggregateLayer *val, gui
     case PARAM_HM_ALPHA: rv.u = val->hm_alpha; break;
     case PARAM_HM_STAMP_FACTOR: rv.u = val->hm_stamp_factor; break;
     case PARAM_HM_STYLE: rv.u = val->hm_style; break;
+    case PARAM_HM_MODE: rv.u = val->hm_mode; break;
     default: break;
   }
   return rv;
@@ -634,8 +706,13 @@ VikAggregateLayer *vik_aggregate_layer_new (VikViewport *vvp)
   vik_layer_set_type ( VIK_LAYER(val), VIK_LAYER_AGGREGATE );
   vik_layer_set_defaults ( VIK_LAYER(val), vvp );
   val->children = NULL;
-  val->tiles = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
-  val->tiles_clust = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  val->tiles = a_tileset_new ();
+  val->tiles_clust = a_tileset_new ();
+  val->tac_tracks = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, tac_track_free );
+  val->tac_track_tiles = a_tileset_new ();
+  val->hm_tracks = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, hm_track_free );
+  // For the heatmap tiles
+  a_mapcache_add_layer ( val );
 
   return val;
 }
@@ -759,42 +836,16 @@ void vik_aggregate_layer_move_layer ( VikAggregateLayer *val, GtkTreeIter *child
     val->children = second;
 }
 
-static gboolean is_tile_occupied ( GHashTable *ght, gint x, gint y )
-{
-  gchar *key = g_strdup_printf ( "%d:%d", x, y );
-  gboolean ans = g_hash_table_contains ( ght, key );
-  g_free ( key );
-  return ans;
-}
-
-static guint tile_label ( GHashTable *ght, gint x, gint y )
-{
-  gchar *key = g_strdup_printf ( "%d:%d", x, y );
-  gpointer gp = g_hash_table_lookup ( ght, key );
-  g_free ( key );
-  if ( gp )
-    return GPOINTER_TO_UINT(gp);
-  else
-    return 0;
-}
-
 /**
  * is_cluster: returns whether a tile is surrounded by occupied tiles
  */
-static gboolean is_cluster ( GHashTable *val, gint x, gint y )
+static gboolean is_cluster ( TileSet *ts, gint x, gint y )
 {
-  //if ( !is_tile_occupied(val, x, y) ) return FALSE;
-  if ( !is_tile_occupied(val, x-1, y) ) return FALSE;
-  if ( !is_tile_occupied(val, x+1, y) ) return FALSE;
-
-  if ( !is_tile_occupied(val, x-1, y-1) ) return FALSE;
-  if ( !is_tile_occupied(val, x+1, y-1) ) return FALSE;
-  if ( !is_tile_occupied(val, x, y-1) ) return FALSE;
-  
-  if ( !is_tile_occupied(val, x-1, y+1) ) return FALSE;
-  if ( !is_tile_occupied(val, x+1, y+1) ) return FALSE;
-  if ( !is_tile_occupied(val, x, y+1) ) return FALSE;
-
+  if ( !a_tileset_contains(ts, x-1, y) ) return FALSE;
+  if ( !a_tileset_contains(ts, x+1, y) ) return FALSE;
+  // Rows above and below
+  if ( !a_tileset_contains_run(ts, x-1, y-1, 3) ) return FALSE;
+  if ( !a_tileset_contains_run(ts, x-1, y+1, 3) ) return FALSE;
   return TRUE;
 }
 
@@ -825,6 +876,107 @@ static void get_pixel_limits ( guint *sizex, guint *sizey, guint *destx, guint *
     *desty = yy;
 }
 
+/**
+ * Blend a colour over a pixel, the same as drawing a pixbuf of that colour and alpha over it
+ */
+static void blend_pixel ( guchar *pix, const GdkColor *color, guint8 alpha )
+{
+  if ( !alpha )
+    return;
+  const guint dst_a = pix[3] * (255 - alpha) / 255;
+  const guint out_a = alpha + dst_a;
+  const guint src[3] = { color->red >> 8, color->green >> 8, color->blue >> 8 };
+  for ( guint ii = 0; ii < 3; ii++ )
+    pix[ii] = ( src[ii] * alpha + pix[ii] * dst_a ) / out_a;
+  pix[3] = out_a;
+}
+
+/**
+ * Blend all the coverage of the tile, in the order each type is drawn over the previous
+ */
+static void tac_blend_tile ( VikAggregateLayer *val, guchar *pix, gint x, gint y )
+{
+  blend_pixel ( pix, &val->color[BASIC], val->alpha[BASIC] );
+
+  if ( val->on[CONTIG] && val->cont_label && (a_tileset_get_label(val->tiles, x, y) == val->cont_label) )
+    blend_pixel ( pix, &val->color[CONTIG], val->alpha[CONTIG] );
+
+  if ( val->on[CLUSTER] && val->clust_label && (a_tileset_get_label(val->tiles_clust, x, y) == val->clust_label) )
+    blend_pixel ( pix, &val->color[CLUSTER], val->alpha[CLUSTER] );
+
+  if ( val->on[MAX_SQR] &&
+       ( x >= val->xx && x < (val->xx + val->max_square) ) &&
+       ( y >= val->yy && y < (val->yy + val->max_square) ) )
+    blend_pixel ( pix, &val->color[MAX_SQR], val->alpha[MAX_SQR] );
+}
+
+/**
+ * Extend a range of tiles by half its size either side, to the next multiple of that half;
+ *  so the area covered only changes once the display has moved some way
+ */
+static void tile_cover ( gint lo, gint hi, gint *cover_lo, gint *cover_hi )
+{
+  const gint half = MAX ( 1, (hi - lo + 1) / 2 );
+  *cover_lo = ( (gint)floor ( (gdouble)lo / half ) - 1 ) * half;
+  *cover_hi = ( (gint)ceil ( (gdouble)(hi + 1) / half ) + 1 ) * half - 1;
+}
+
+/**
+ * The coverage at one pixel per tile for an area including the tiles xmin,ymin to xmax,ymax,
+ *  reusing that from the last draw unless the tiles, their settings or the zoom level have changed since
+ * The area is larger than the display, so the coverage need not be made again whilst panning a little
+ */
+static GdkPixbuf *tac_get_cover ( VikAggregateLayer *val, gint xmin, gint ymin, gint xmax, gint ymax )
+{
+  // Whilst calculating the tiles are still changing, so anything made from them would soon be out of date
+  if ( val->cover && !val->calculating &&
+       val->cover_gen == val->tac_gen && val->cover_zoom == val->zoom_level &&
+       xmin >= val->cover_xmin && xmax <= val->cover_xmax && ymin >= val->cover_ymin && ymax <= val->cover_ymax )
+    return val->cover;
+
+  gint cxmin, cxmax, cymin, cymax;
+  tile_cover ( xmin, xmax, &cxmin, &cxmax );
+  tile_cover ( ymin, ymax, &cymin, &cymax );
+  // Only the display when zoomed out a long way
+  if ( (gint64)(cxmax - cxmin + 1) * (cymax - cymin + 1) > TAC_COVER_MAX_TILES ) {
+    cxmin = xmin; cxmax = xmax;
+    cymin = ymin; cymax = ymax;
+  }
+
+  if ( val->cover )
+    g_object_unref ( val->cover );
+  val->cover = setup_pixbuf ( NULL, cxmax - cxmin + 1, cymax - cymin + 1 );
+  if ( !val->cover )
+    return NULL;
+
+  guchar *pixels = gdk_pixbuf_get_pixels ( val->cover );
+  const gint rowstride = gdk_pixbuf_get_rowstride ( val->cover );
+  const gint64 area = (gint64)(cxmax - cxmin + 1) * (cymax - cymin + 1);
+  gint x, y;
+  // Visit whichever is fewer - the tiles in the set or the positions in the area
+  if ( a_tileset_size(val->tiles) < area ) {
+    TileSetIter iter;
+    a_tileset_iter_init ( &iter, val->tiles );
+    while ( a_tileset_iter_next(&iter, &x, &y) )
+      if ( x >= cxmin && x <= cxmax && y >= cymin && y <= cymax )
+        tac_blend_tile ( val, pixels + (y - cymin) * rowstride + (x - cxmin) * 4, x, y );
+  }
+  else {
+    for ( y = cymin; y <= cymax; y++ )
+      for ( x = cxmin; x <= cxmax; x++ )
+        if ( a_tileset_contains(val->tiles, x, y) )
+          tac_blend_tile ( val, pixels + (y - cymin) * rowstride + (x - cxmin) * 4, x, y );
+  }
+
+  val->cover_gen = val->tac_gen;
+  val->cover_zoom = val->zoom_level;
+  val->cover_xmin = cxmin;
+  val->cover_xmax = cxmax;
+  val->cover_ymin = cymin;
+  val->cover_ymax = cymax;
+  return val->cover;
+}
+
 /**
  *
  */
@@ -871,91 +1023,29 @@ static void tac_draw_section ( VikAggregateLayer *val, VikViewport *vvp, VikCoor
      * eg if tile size 128, shrinkfactor 0.333 */
     const gint base_xx = xx_tmp - (tilesize/2);
     const gint base_yy = yy_tmp - (tilesize/2);
-    xx = base_xx; yy = base_yy;
 
-    // When a single tile bigger than the whole screen, only need to draw part of the tile.
-    // Thus don't draw only the on screen part, to avoid trying to handle a massive pixbuf
     const guint width = vik_viewport_get_width ( vvp );
     const guint height = vik_viewport_get_height ( vvp );
-    gboolean is_big = FALSE;
-    if ( tilesize > width && tilesize > height ) {
-      is_big = TRUE;
-    }
-    else {
-      // Scale up pixbuf size if needed
-      val->pixbuf[BASIC] = layer_pixbuf_update ( val->pixbuf[BASIC], val->color[BASIC], tilesize <= 256 ? 256 : tilesize, tilesize <= 256 ? 256 : tilesize, val->alpha[BASIC] );
-      val->pixbuf[MAX_SQR] = layer_pixbuf_update ( val->pixbuf[MAX_SQR], val->color[MAX_SQR], tilesize <= 256 ? 256 : tilesize, tilesize <= 256 ? 256 : tilesize, val->alpha[MAX_SQR] );
-      val->pixbuf[CONTIG] = layer_pixbuf_update ( val->pixbuf[CONTIG], val->color[CONTIG], tilesize <= 256 ? 256 : tilesize, tilesize <= 256 ? 256 : tilesize, val->alpha[CONTIG] );
-      val->pixbuf[CLUSTER] = layer_pixbuf_update ( val->pixbuf[CLUSTER], val->color[CLUSTER], tilesize <= 256 ? 256 : tilesize, tilesize <= 256 ? 256 : tilesize, val->alpha[CLUSTER] );
-    }
-
-    // Create pixbufs the size of the screen
-    for ( guint ii=0; ii<CP_NUM; ii++ ) {
-      if ( val->on[ii] ) {
-        val->full_pixbuf[ii] = setup_pixbuf ( val->full_pixbuf[ii], width, height );
-      }
-    }
-    if ( tiles_unreachable )
-      val->unreachable_pixbuf = setup_pixbuf ( val->unreachable_pixbuf, width, height );
 
-    guint tile_draw_count = 0;
-    for ( x = ((xinc == 1) ? xmin : xmax); x != xend; x+=xinc ) {
-      yy = base_yy;
-      for ( y = ((yinc == 1) ? ymin : ymax); y != yend; y+=yinc ) {
-        ulm.x = x;
-        ulm.y = y;
-
-        if ( is_tile_occupied(val->tiles, x, y) ) {
-          //g_printf ( "%s1: %d, %d, %d, %d, %d, %d %0.2f\n", __FUNCTION__, xx, yy, tilesize_ceil, tilesize_ceil, width, height, shrinkfactor );
-          if ( !is_big ) {
-
-            // Limit size request of pixbufs at the edge, as to not request a size overflowing the destination pixbuf
-            // otherwise gdk_pixbuf_copy_area() will complain
-            guint sizex, sizey, destx, desty;
-            get_pixel_limits ( &sizex, &sizey, &destx, &desty, xx, yy, width, height, tilesize_ceil );
-
-            gdk_pixbuf_copy_area ( val->pixbuf[BASIC], 0, 0, sizex, sizey, val->full_pixbuf[BASIC], destx, desty );
-
-            if ( val->cont_label && (tile_label(val->tiles, x, y) == val->cont_label) )
-              gdk_pixbuf_copy_area ( val->pixbuf[CONTIG], 0, 0, sizex, sizey, val->full_pixbuf[CONTIG], destx, desty );
-
-            // Cluster drawing
-            if ( val->on[CLUSTER] )
-              if ( val->clust_label && (tile_label(val->tiles_clust, x, y) == val->clust_label) )
-                gdk_pixbuf_copy_area ( val->pixbuf[CLUSTER], 0, 0, sizex, sizey, val->full_pixbuf[CLUSTER], destx, desty );
-
-            // Max Square drawing
-            if ( val->on[MAX_SQR] )
-              if ( ( x >= val->xx && x < (val->xx + val->max_square) )
-                     && ( y >= val->yy && y < (val->yy + val->max_square) ) ) {
-                gdk_pixbuf_copy_area ( val->pixbuf[MAX_SQR], 0, 0, sizex, sizey, val->full_pixbuf[MAX_SQR], destx, desty );                
-              }
-          } else {
-            gint x2 = xx;
-            gint y2 = yy;
-            gint w2 = width;
-            gint h2 = height;
-            if ( x2 < 0 ) {
-              w2 = xx + tilesize_ceil;
-              x2 = 0;
-            }
-            if ( y2 < 0 ) {
-              y2 = 0;
-              h2 = yy + tilesize_ceil;
-            }
-            //g_printf ( "%s: %d, %d, %d, %d\n", __FUNCTION__, x2, y2, w2, h2);
-            val->pixbuf[BASIC] = layer_pixbuf_update ( val->pixbuf[BASIC], val->color[BASIC], w2, h2, val->alpha[BASIC] );
-            vik_viewport_draw_pixbuf ( vvp, val->pixbuf[BASIC], 0, 0, x2, y2, w2, h2 );
-          }
-          tile_draw_count++;
-        }
-        yy += tilesize;
-      }
-      xx += tilesize;
+    // Scale the coverage (at one pixel per tile) up to the display in one go,
+    //  thus however many tiles are shown it is only one pixbuf to draw
+    GdkPixbuf *cover = tac_get_cover ( val, xmin, ymin, xmax, ymax );
+    if ( cover ) {
+      if ( !val->full_pixbuf ||
+           gdk_pixbuf_get_width(val->full_pixbuf) != width || gdk_pixbuf_get_height(val->full_pixbuf) != height )
+        val->full_pixbuf = setup_pixbuf ( val->full_pixbuf, width, height );
+      // Screen position of the top left of the coverage
+      const gdouble cover_x = xx_tmp - (tilesize/2) + (val->cover_xmin - ulm.x) * tilesize;
+      const gdouble cover_y = yy_tmp - (tilesize/2) + (val->cover_ymin - ulm.y) * tilesize;
+      gdk_pixbuf_scale ( cover, val->full_pixbuf, 0, 0, width, height, cover_x, cover_y, tilesize, tilesize, GDK_INTERP_NEAREST );
+      vik_viewport_draw_pixbuf ( vvp, val->full_pixbuf, 0, 0, 0, 0, width, height );
     }
 
     // Draw any unreachable tiles if they are in the display area
-    if ( tiles_unreachable && !is_big ) {
+    // When a single tile is bigger than the whole screen, don't try to handle such a massive pixbuf
+    if ( tiles_unreachable && !(tilesize > width && tilesize > height) ) {
+
+      val->unreachable_pixbuf = setup_pixbuf ( val->unreachable_pixbuf, width, height );
 
       GHashTableIter iter;
       gpointer key, value;
@@ -985,36 +1075,37 @@ static void tac_draw_section ( VikAggregateLayer *val, VikViewport *vvp, VikCoor
         }
       }
       g_object_unref ( pixbuf );
-    }
 
-    if ( !is_big ) {
-      for ( guint ii=0; ii<CP_NUM; ii++ )
-        if ( val->on[ii] && val->full_pixbuf[ii] )
-          vik_viewport_draw_pixbuf ( vvp, val->full_pixbuf[ii], 0, 0, 0, 0, width, height );
-      if ( tiles_unreachable )
-        vik_viewport_draw_pixbuf ( vvp, val->unreachable_pixbuf, 0, 0, 0, 0, width, height );
+      vik_viewport_draw_pixbuf ( vvp, val->unreachable_pixbuf, 0, 0, 0, 0, width, height );
     }
 
-    //g_debug ( "%s: Tiles drawn %d", __FUNCTION__, tile_draw_count );
-
     // Grid lines if wanted and otherwise doesn't dominate the display either...
     // TODO Probably better to determine a value based on the display / HD
     if ( val->draw_grid && tilesize > 4 ) {
       // Grid drawing here so it gets drawn on top of the previous tiles
-      // Thus loop around x & y again, but this time separately
+      // Single grid lines across the whole screen, all drawn together
       GdkGC *black_gc = vik_viewport_get_black_gc ( vvp );
-      // Draw single grid lines across the whole screen
+      GdkSegment *segs = g_new ( GdkSegment, (xmax - xmin + 1) + (ymax - ymin + 1) );
+      gint nn = 0;
       xx = base_xx;
       for ( x = ((xinc == 1) ? xmin : xmax); x != xend; x+=xinc ) {
-         vik_viewport_draw_line ( vvp, black_gc, xx, base_yy, xx, height );
-         xx += tilesize;
+        segs[nn].x1 = segs[nn].x2 = xx;
+        segs[nn].y1 = base_yy;
+        segs[nn].y2 = height;
+        nn++;
+        xx += tilesize;
       }
 
       yy = base_yy;
       for ( y = ((yinc == 1) ? ymin : ymax); y != yend; y+=yinc ) {
-        vik_viewport_draw_line ( vvp, black_gc, base_xx, yy, width, yy );
+        segs[nn].x1 = base_xx;
+        segs[nn].x2 = width;
+        segs[nn].y1 = segs[nn].y2 = yy;
+        nn++;
         yy += tilesize;
       }
+      vik_viewport_draw_segments ( vvp, black_gc, segs, nn );
+      g_free ( segs );
     }
   }
 }
@@ -1054,10 +1145,15 @@ static void hm_clear ( VikAggregateLayer *val )
 {
   if ( val->hm_pixbuf )
     g_object_unref ( val->hm_pixbuf );
-  if ( val->hm_pbf_scaled )
-    g_object_unref ( val->hm_pbf_scaled );
+  if ( val->hm_window )
+    g_object_unref ( val->hm_window );
   val->hm_pixbuf = NULL;
-  val->hm_pbf_scaled = NULL;
+  val->hm_window = NULL;
+  if ( val->hm_tiles ) {
+    a_heatmap_tiles_unref ( val->hm_tiles );
+    val->hm_tiles = NULL;
+    a_mapcache_flush_type ( HM_TILES_CACHE_TYPE );
+  }
 }
 
 /**
@@ -1072,11 +1168,6 @@ static void hm_draw ( VikAggregateLayer *val, VikViewport *vp )
     clock_t begin, end;
 
     gint zz = (gint)vik_viewport_get_zoom ( vp );
-    // Avoid excessive image scaling as it will be too slow
-    //  (and memory intensive) so simply avoid trying.
-    if ( zz < val->hm_zoom_max ) {
-      return;
-    }
 
     if ( val->hm_width != vik_viewport_get_width(vp) ||
          val->hm_height != vik_viewport_get_height(vp) ) {
@@ -1087,69 +1178,102 @@ static void hm_draw ( VikAggregateLayer *val, VikViewport *vp )
     // Calculate width & height (even if no scaling as not excessive computation)
     gint ww = round (val->hm_width * (gdouble)val->hm_zoom/(gdouble)zz );
     gint hh = round (val->hm_height * (gdouble)val->hm_zoom/(gdouble)zz );
-    // Scale only once as necessary when zoom level has changed
-    if ( val->hm_scaled_zoom != zz ) {
-      val->hm_scaled_zoom = zz;
-      // Different zoom level so generate new image from the original image
-      if ( val->hm_scaled_zoom != val->hm_zoom ) {
-        if ( val->hm_pbf_scaled )
-          g_object_unref ( val->hm_pbf_scaled );
-
-        val->hm_scaled = TRUE;
-        GdkInterpType interp_type = GDK_INTERP_BILINEAR;
-        // When scaling up: use the fastest method (as scaling up is much slower than scaling down)
-        //  especially since this is being performed in the main thread
-        if ( val->hm_scaled_zoom < val->hm_zoom )
-          interp_type = GDK_INTERP_NEAREST;
-        begin = clock();
-        val->hm_pbf_scaled = gdk_pixbuf_scale_simple ( val->hm_pixbuf, ww, hh, interp_type );
-        end = clock();
-        double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-        // Last usable zoom-level as the next one is going to be an order of magnitude worse or more
-        if ( interp_type == GDK_INTERP_NEAREST && time_spent > 0.05 )
-          val->hm_zoom_max = zz;
-        g_debug ( "%s: time %f scaling to %d, %d", __FUNCTION__, time_spent, ww, hh );
-      } else {
-        // Use original image
-        val->hm_scaled = FALSE;
-      }
-    }
+    val->hm_scaled_zoom = zz;
     gint xx, yy;
     gdouble mf = mercator_factor ( val->hm_scaled_zoom, val->hm_scale );
     coord_to_screen ( val->hm_width, val->hm_height, mf, (struct LatLon*)val->hm_center, &val->hm_tl, &xx, &yy);
-    vik_viewport_draw_pixbuf ( vp, val->hm_scaled ? val->hm_pbf_scaled : val->hm_pixbuf, 0, 0, xx, yy, ww, hh );
+
+    if ( zz == val->hm_zoom ) {
+      // Use original image
+      vik_viewport_draw_pixbuf ( vp, val->hm_pixbuf, 0, 0, xx, yy, ww, hh );
+      return;
+    }
+
+    // Only scale the part of the image within the viewport,
+    //  thus the time and memory is limited by the viewport size however far zoomed in
+    const gint x0 = MAX ( 0, xx );
+    const gint y0 = MAX ( 0, yy );
+    const gint x1 = MIN ( val->hm_width, xx + ww );
+    const gint y1 = MIN ( val->hm_height, yy + hh );
+    if ( x1 <= x0 || y1 <= y0 )
+      return;
+
+    // Scale only once for each view
+    if ( !val->hm_window || val->hm_window_zoom != zz || val->hm_window_x != xx || val->hm_window_y != yy ) {
+      if ( val->hm_window )
+        g_object_unref ( val->hm_window );
+      val->hm_window = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, TRUE, 8, x1 - x0, y1 - y0 );
+      if ( !val->hm_window )
+        return;
+      GdkInterpType interp_type = GDK_INTERP_BILINEAR;
+      // When scaling up: use the fastest method (as scaling up is much slower than scaling down)
+      //  especially since this is being performed in the main thread
+      if ( zz < val->hm_zoom )
+        interp_type = GDK_INTERP_NEAREST;
+      begin = clock();
+      gdk_pixbuf_scale ( val->hm_pixbuf, val->hm_window, 0, 0, x1 - x0, y1 - y0, xx - x0, yy - y0,
+                         (gdouble)ww / val->hm_width, (gdouble)hh / val->hm_height, interp_type );
+      end = clock();
+      g_debug ( "%s: time %f scaling to %d, %d for %d, %d", __FUNCTION__, (double)(end - begin) / CLOCKS_PER_SEC, ww, hh, x1 - x0, y1 - y0 );
+      val->hm_window_zoom = zz;
+      val->hm_window_x = xx;
+      val->hm_window_y = yy;
+    }
+    vik_viewport_draw_pixbuf ( vp, val->hm_window, 0, 0, x0, y0, x1 - x0, y1 - y0 );
   }
 }
 
 /* Draw the aggregate layer. If vik viewport is in half_drawn mode, this means we are only
- * to draw the layers above and including the trigger layer.
+ * to draw the layers above and including the resume layer.
  * To do this we don't draw any layers if in half drawn mode, unless we find the
- * trigger layer, in which case we pull up the saved pixmap, turn off half drawn mode and
+ * resume layer, in which case we pull up the saved pixmap, turn off half drawn mode and
  * start drawing layers.
- * Also, if we were never in half drawn mode, we save a snapshot
+ * Also, if not in half drawn mode, we save a snapshot
  * of the pixmap before drawing the trigger layer so we can use it again
  * later.
  */
+/**
+ * Lots of tracks spread over the TRW layers are drawn from tiles,
+ *  the same as when there are lots in just one of them (see vik_trw_layer_lod_wanted())
+ * NB Only the TRW layers directly within this layer are counted together
+ */
+static void aggregate_layer_lod_check ( VikAggregateLayer *val, VikViewport *vp )
+{
+  guint count = 0;
+  guint layers = 0;
+  for ( GList *iter = val->children; iter; iter = iter->next ) {
+    VikLayer *vl = VIK_LAYER(iter->data);
+    if ( vl->type == VIK_LAYER_TRW && vl->visible ) {
+      count += vik_trw_layer_count_tracks_in_view ( VIK_TRW_LAYER(vl), vp );
+      layers++;
+    }
+  }
+  // A single layer decides for itself
+  gboolean forced = layers > 1 && vik_trw_layer_lod_wanted ( vp, count );
+  for ( GList *iter = val->children; iter; iter = iter->next )
+    if ( VIK_LAYER(iter->data)->type == VIK_LAYER_TRW )
+      vik_trw_layer_set_lod_forced ( VIK_TRW_LAYER(iter->data), forced );
+}
+
 void vik_aggregate_layer_draw ( VikAggregateLayer *val, VikViewport *vp )
 {
+  aggregate_layer_lod_check ( val, vp );
+
   GList *iter = val->children;
   VikLayer *vl;
-  VikLayer *trigger = VIK_LAYER(vik_viewport_get_trigger( vp ));
   while ( iter ) {
     vl = VIK_LAYER(iter->data);
-    if ( vl == trigger ) {
-      if ( vik_viewport_get_half_drawn ( vp ) ) {
-        vik_viewport_set_half_drawn ( vp, FALSE );
-        vik_viewport_snapshot_load( vp );
-      } else {
-        vik_viewport_snapshot_save( vp );
-      }
-    }
+    vik_viewport_snapshot_reached ( vp, vl );
     if ( vl->type == VIK_LAYER_AGGREGATE || vl->type == VIK_LAYER_GPS || ! vik_viewport_get_half_drawn( vp ) )
       vik_layer_draw ( vl, vp );
     iter = iter->next;
   }
 
+  // Still half drawn means the resume layer comes later,
+  //  so the coverage drawn from this layer is already in the snapshot
+  if ( vik_viewport_get_half_drawn ( vp ) )
+    return;
+
   // Make coverage to be drawn last (i.e. over the top of any maps)
   if ( val->on[BASIC] ) {
     tac_draw ( val, vp );
@@ -1158,6 +1282,10 @@ void vik_aggregate_layer_draw ( VikAggregateLayer *val, VikViewport *vp )
   if ( !val->hm_calculating && val->hm_pixbuf ) {
     hm_draw ( val, vp );
   }
+
+  if ( !val->hm_calculating && val->hm_tiles ) {
+    hm_tiles_draw ( val, vp );
+  }
 }
 
 static void aggregate_layer_change_coord_mode ( VikAggregateLayer *val, VikCoordMode mode )
@@ -1264,17 +1392,21 @@ static void aggregate_layer_sort_z2a ( menu_array_values values )
   val->children = g_list_sort_with_data ( val->children, sort_layer_compare, GINT_TO_POINTER(FALSE) );
 }
 
+typedef struct {
+  VikLayer *vl;
+  gdouble timestamp;
+} LayerTimestampT;
+
 /**
  * If order is true sort ascending, otherwise a descending sort
  */
 static gint sort_layer_compare_timestamp ( gconstpointer a, gconstpointer b, gpointer order )
 {
-  VikLayer *sa = (VikLayer *)a;
-  VikLayer *sb = (VikLayer *)b;
+  const LayerTimestampT *sa = (const LayerTimestampT *)a;
+  const LayerTimestampT *sb = (const LayerTimestampT *)b;
 
   // Default ascending order
-  // NB This might be relatively slow...
-  gint answer = ( vik_layer_get_timestamp(sa) > vik_layer_get_timestamp(sb) );
+  gint answer = ( sa->timestamp > sb->timestamp );
 
   if ( GPOINTER_TO_INT(order) ) {
     // Invert sort order for ascending order
@@ -1284,18 +1416,40 @@ static gint sort_layer_compare_timestamp ( gconstpointer a, gconstpointer b, gpo
   return answer;
 }
 
+/**
+ * Sort the children, getting the timestamp of each layer only once
+ *  rather than for every comparison, as this may be relatively slow
+ */
+static void sort_layers_by_timestamp ( VikAggregateLayer *val, gboolean ascending )
+{
+  GList *tuples = NULL;
+  for ( GList *gl = val->children; gl; gl = gl->next ) {
+    LayerTimestampT *lt = g_malloc ( sizeof(LayerTimestampT) );
+    lt->vl = VIK_LAYER(gl->data);
+    lt->timestamp = vik_layer_get_timestamp ( lt->vl );
+    tuples = g_list_prepend ( tuples, lt );
+  }
+  tuples = g_list_reverse ( tuples );
+  tuples = g_list_sort_with_data ( tuples, sort_layer_compare_timestamp, GINT_TO_POINTER(ascending) );
+
+  GList *gl = val->children;
+  for ( GList *tl = tuples; tl; tl = tl->next, gl = gl->next )
+    gl->data = ((LayerTimestampT*)tl->data)->vl;
+  g_list_free_full ( tuples, g_free );
+}
+
 static void aggregate_layer_sort_timestamp_ascend ( menu_array_values values )
 {
   VikAggregateLayer *val = VIK_AGGREGATE_LAYER ( values[MA_VAL] );
   vik_treeview_sort_children ( VIK_LAYER(val)->vt, &(VIK_LAYER(val)->iter), VL_SO_DATE_ASCENDING );
-  val->children = g_list_sort_with_data ( val->children, sort_layer_compare_timestamp, GINT_TO_POINTER(TRUE) );
+  sort_layers_by_timestamp ( val, TRUE );
 }
 
 static void aggregate_layer_sort_timestamp_descend ( menu_array_values values )
 {
   VikAggregateLayer *val = VIK_AGGREGATE_LAYER ( values[MA_VAL] );
   vik_treeview_sort_children ( VIK_LAYER(val)->vt, &(VIK_LAYER(val)->iter), VL_SO_DATE_DESCENDING );
-  val->children = g_list_sort_with_data ( val->children, sort_layer_compare_timestamp, GINT_TO_POINTER(FALSE) );
+  sort_layers_by_timestamp ( val, FALSE );
 }
 
 /**
@@ -1380,6 +1534,180 @@ static void aggregate_layer_search_date ( menu_array_values values )
   g_free ( date_str );
 }
 
+/**
+ * Return the list passed in as the user data, as it has already been found
+ */
+static GList* aggregate_layer_duplicate_tracks_list ( VikLayer *vl, gpointer user_data )
+{
+  return (GList*)user_data;
+}
+
+/**
+ * Search all TrackWaypoint layers in this aggregate layer for tracks that are copies of another
+ */
+static void aggregate_layer_search_duplicate_tracks ( menu_array_values values )
+{
+  VikAggregateLayer *val = VIK_AGGREGATE_LAYER ( values[MA_VAL] );
+
+  GList *layers = NULL;
+  layers = vik_aggregate_layer_get_all_layers_of_type ( val, layers, VIK_LAYER_TRW, TRUE );
+  GPtrArray *tracks = g_ptr_array_new ();
+  GPtrArray *owners = g_ptr_array_new ();
+  for ( GList *layer = layers; layer != NULL; layer = layer->next ) {
+    GList *trks = g_hash_table_get_values ( vik_trw_layer_get_tracks( VIK_TRW_LAYER(layer->data) ) );
+    for ( GList *iter = trks; iter != NULL; iter = iter->next ) {
+      g_ptr_array_add ( tracks, iter->data );
+      g_ptr_array_add ( owners, layer->data );
+    }
+    g_list_free ( trks );
+  }
+  g_list_free ( layers );
+
+  vik_window_set_busy_cursor ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(val)) );
+  gint *first = a_track_dupes_find ( (VikTrack**)tracks->pdata, tracks->len, 0 );
+  vik_window_clear_busy_cursor ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(val)) );
+
+  // Each original followed by its copies, which always come after it
+  GList **copies_of = g_new0 ( GList*, tracks->len );
+  guint copies = 0;
+  for ( guint ii = 0; ii < tracks->len; ii++ ) {
+    if ( first[ii] >= 0 ) {
+      copies_of[first[ii]] = g_list_prepend ( copies_of[first[ii]], GUINT_TO_POINTER(ii) );
+      copies++;
+    }
+  }
+  GList *found = NULL;
+  for ( gint ii = tracks->len - 1; ii >= 0; ii-- ) {
+    if ( !copies_of[ii] )
+      continue;
+    // The copies are in reverse order, as found is built in reverse
+    copies_of[ii] = g_list_append ( copies_of[ii], GUINT_TO_POINTER(ii) );
+    for ( GList *iter = copies_of[ii]; iter != NULL; iter = iter->next ) {
+      vik_trw_and_track_t *vtdl = g_malloc ( sizeof(vik_trw_and_track_t) );
+      vtdl->trk = VIK_TRACK(g_ptr_array_index(tracks, GPOINTER_TO_UINT(iter->data)));
+      vtdl->vtl = VIK_TRW_LAYER(g_ptr_array_index(owners, GPOINTER_TO_UINT(iter->data)));
+      found = g_list_prepend ( found, vtdl );
+    }
+    g_list_free ( copies_of[ii] );
+  }
+  g_free ( copies_of );
+  g_free ( first );
+  g_ptr_array_free ( owners, TRUE );
+  g_ptr_array_free ( tracks, TRUE );
+
+  if ( !found ) {
+    a_dialog_info_msg ( VIK_GTK_WINDOW_FROM_LAYER(val), _("No duplicate tracks found.") );
+    return;
+  }
+  gchar *title = g_strdup_printf ( ngettext("%s: %d Duplicate Track", "%s: %d Duplicate Tracks", copies), VIK_LAYER(val)->name, copies );
+  vik_trw_layer_track_list_show_dialog ( title, VIK_LAYER(val), found, aggregate_layer_duplicate_tracks_list, TRUE );
+  g_free ( title );
+}
+
+/**
+ * When the track was in the area, e.g. "10/10/26 09:12:05 - 09:20:41"
+ */
+static gchar *aggregate_layer_area_spans_text ( VikTrack *trk, GArray *spans )
+{
+  const VikCoord *coord = &VIK_TRACKPOINT(trk->trackpoints->data)->coord;
+  GString *text = g_string_new ( NULL );
+  for ( guint ii = 0; ii < spans->len; ii++ ) {
+    TrackAreaSpan *span = &g_array_index ( spans, TrackAreaSpan, ii );
+    if ( isnan(span->start) || isnan(span->end) )
+      continue;
+    time_t start = span->start;
+    time_t end = span->end;
+    gchar *start_date = vu_get_time_string_cached ( &start, "%x", coord, &trk->tz_cache );
+    gchar *end_date = vu_get_time_string_cached ( &end, "%x", coord, &trk->tz_cache );
+    gchar *from = vu_get_time_string_cached ( &start, "%x %X", coord, &trk->tz_cache );
+    // Only repeat the date when it has changed
+    gchar *to = vu_get_time_string_cached ( &end, g_strcmp0(start_date, end_date) ? "%x %X" : "%X", coord, &trk->tz_cache );
+    if ( text->len )
+      g_string_append ( text, ", " );
+    g_string_append_printf ( text, "%s - %s", from, to );
+    g_free ( to );
+    g_free ( from );
+    g_free ( end_date );
+    g_free ( start_date );
+  }
+  if ( !text->len )
+    g_string_append ( text, _("No timestamps") );
+  return g_string_free ( text, FALSE );
+}
+
+/**
+ * vik_aggregate_layer_find_tracks_in_area:
+ * @area:    Where to look
+ * @name:    Describes the area for the title of the results
+ * @outline: A track or route to leave out, such as the one the area came from
+ *
+ * List the tracks and routes of all TrackWaypoint layers that pass through the area,
+ *  together with the times they were in it
+ */
+void vik_aggregate_layer_find_tracks_in_area ( VikAggregateLayer *val, const TrackArea *area, const gchar *name, VikTrack *outline )
+{
+  GList *layers = NULL;
+  layers = vik_aggregate_layer_get_all_layers_of_type ( val, layers, VIK_LAYER_TRW, TRUE );
+  GPtrArray *tracks = g_ptr_array_new ();
+  GPtrArray *owners = g_ptr_array_new ();
+  for ( GList *layer = layers; layer != NULL; layer = layer->next ) {
+    GHashTable *tables[2] = { vik_trw_layer_get_tracks ( VIK_TRW_LAYER(layer->data) ),
+                              vik_trw_layer_get_routes ( VIK_TRW_LAYER(layer->data) ) };
+    for ( guint tt = 0; tt < G_N_ELEMENTS(tables); tt++ ) {
+      GList *trks = g_hash_table_get_values ( tables[tt] );
+      for ( GList *iter = trks; iter != NULL; iter = iter->next ) {
+        if ( iter->data == outline )
+          continue;
+        g_ptr_array_add ( tracks, iter->data );
+        g_ptr_array_add ( owners, layer->data );
+      }
+      g_list_free ( trks );
+    }
+  }
+  g_list_free ( layers );
+
+  vik_window_set_busy_cursor ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(val)) );
+  GArray **spans = a_track_area_find ( (VikTrack**)tracks->pdata, tracks->len, area, 0 );
+  vik_window_clear_busy_cursor ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(val)) );
+
+  GHashTable *notes = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
+  GList *found = NULL;
+  for ( gint ii = tracks->len - 1; ii >= 0; ii-- ) {
+    if ( !spans[ii] )
+      continue;
+    vik_trw_and_track_t *vtdl = g_malloc ( sizeof(vik_trw_and_track_t) );
+    vtdl->trk = VIK_TRACK(g_ptr_array_index(tracks, ii));
+    vtdl->vtl = VIK_TRW_LAYER(g_ptr_array_index(owners, ii));
+    found = g_list_prepend ( found, vtdl );
+    g_hash_table_insert ( notes, vtdl->trk, aggregate_layer_area_spans_text ( vtdl->trk, spans[ii] ) );
+  }
+  a_track_area_results_free ( spans, tracks->len );
+  g_ptr_array_free ( owners, TRUE );
+  g_ptr_array_free ( tracks, TRUE );
+
+  if ( found ) {
+    guint count = g_hash_table_size ( notes );
+    gchar *title = g_strdup_printf ( ngettext("%s: %d Track Through %s", "%s: %d Tracks Through %s", count), VIK_LAYER(val)->name, count, name );
+    vik_trw_layer_track_list_show_dialog_notes ( title, VIK_LAYER(val), found, aggregate_layer_duplicate_tracks_list, TRUE, _("Times Inside"), notes );
+    g_free ( title );
+  }
+  else
+    a_dialog_info_msg ( VIK_GTK_WINDOW_FROM_LAYER(val), _("No tracks pass through this area.") );
+  g_hash_table_unref ( notes );
+}
+
+/**
+ * Search all TrackWaypoint layers in this aggregate layer for tracks crossing the part of the map being shown
+ */
+static void aggregate_layer_search_tracks_in_view ( menu_array_values values )
+{
+  VikAggregateLayer *val = VIK_AGGREGATE_LAYER ( values[MA_VAL] );
+  VikViewport *vvp = vik_window_viewport ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(val)) );
+  TrackArea *area = a_track_area_new_bbox ( vik_viewport_get_bbox(vvp) );
+  vik_aggregate_layer_find_tracks_in_area ( val, area, _("View"), NULL );
+  a_track_area_free ( area );
+}
+
 /**
  * aggregate_layer_track_create_list:
  * @vl:        The layer that should create the track and layers list
@@ -1444,6 +1772,34 @@ static void aggregate_layer_analyse ( menu_array_values values )
                                                              aggregate_layer_analyse_close );
 }
 
+static void aggregate_layer_playback_close ( GtkWidget *dialog, gint resp, VikLayer* vl )
+{
+  VikAggregateLayer *val = VIK_AGGREGATE_LAYER(vl);
+  gtk_widget_destroy ( dialog );
+  val->playback_dialog = NULL;
+}
+
+static void aggregate_layer_playback ( menu_array_values values )
+{
+  VikAggregateLayer *val = VIK_AGGREGATE_LAYER ( values[MA_VAL] );
+
+  if ( val->playback_dialog ) {
+    gtk_window_present ( GTK_WINDOW(val->playback_dialog) );
+    return;
+  }
+
+  VikWindow *vw = VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(val));
+  val->playback_dialog = vik_trw_layer_playback_show ( GTK_WINDOW(vw),
+                                                       VIK_LAYER(val)->name,
+                                                       VIK_LAYER(val),
+                                                       vik_window_viewport(vw),
+                                                       aggregate_layer_track_create_list,
+                                                       aggregate_layer_playback_close );
+  // Also goes with the window
+  if ( val->playback_dialog )
+    g_signal_connect ( val->playback_dialog, "destroy", G_CALLBACK(gtk_widget_destroyed), &val->playback_dialog );
+}
+
 static void aggregate_layer_load_external_layers ( VikAggregateLayer *val )
 {
   GList *iter = val->children;
@@ -1553,57 +1909,39 @@ static void aggregate_layer_export_gpx ( menu_array_values values )
 /**
  *
  */
-static void add_tile_label ( GHashTable *ght, gint x, gint y, guint id )
-{
-  gchar *key = g_strdup_printf ( "%d:%d", x, y );
-  g_hash_table_insert ( ght, key, GUINT_TO_POINTER(id) );
-}
-
-/**
- *
- */
-static void add_tile ( GHashTable *ght, gint x, gint y )
-{
-  add_tile_label ( ght, x, y, 0 );
-}
-
-/**
- *
- */
-static void check_point ( VikAggregateLayer *val, VikCoord *coord )
+static void check_point ( TileSet *tiles, gdouble zoom, VikCoord *coord )
 {
   MapCoord mc;
-  gdouble zoom = val->zoom_level;
   // Give up if can't convert - shouldn't happen
   if ( !map_utils_vikcoord_to_iTMS(coord, zoom, zoom, &mc) ) {
     g_warning ( "%s: %s", __FUNCTION__, "Failed to convert positions" );
     return;
   }
 
-  if ( ! is_tile_occupied ( val->tiles, mc.x, mc.y ) ) {
-    add_tile ( val->tiles, mc.x, mc.y );
-    val->num_tiles[BASIC]++;
-  }
+  (void)a_tileset_add ( tiles, mc.x, mc.y );
 }
 
+// A track as seen by the calculation threads
+typedef struct {
+  gconstpointer id;       // The track itself - only for identification, as it may be changed or deleted meanwhile
+  VikTrackSnapshot *snap; // What is actually read
+} CalcTrackT;
+
 /**
  *
  */
-static void check_track ( VikAggregateLayer *val, vik_trw_and_track_t *vtlist )
+static void check_track ( TileSet *tiles, gdouble zoom, CalcTrackT *ctt )
 {
-  VikTrack *trk = vtlist->trk;
-  //g_debug ( "%s: %s", __FUNCTION__, trk->name );
   guint no_times = 0;
-  GList *iter = trk->trackpoints;
-  while ( iter ) {
+  for ( guint ii = 0; ii < ctt->snap->n_points; ii++ ) {
+    VikTrackSnapshotPoint *sp = &ctt->snap->points[ii];
     // Only do trackpoints with timestamps
     // - i.e. hopefully to avoid artificial tracks
-    if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) ) {
-      check_point ( val, &VIK_TRACKPOINT(iter->data)->coord );
+    if ( !isnan(sp->timestamp) ) {
+      check_point ( tiles, zoom, &sp->coord );
     }
     else
       no_times++;
-    iter = iter->next;
   }
   // Handy to find out if your not expecting any of these
   if ( no_times )
@@ -1611,75 +1949,482 @@ static void check_track ( VikAggregateLayer *val, vik_trw_and_track_t *vtlist )
 }
 
 typedef struct {
-  GList *tracks_and_layers;
+  GList *tracks; // Of #CalcTrackT
   VikAggregateLayer *val;
   guint num_of_tracks;
 } CalculateThreadT;
 
-static void ct_free ( CalculateThreadT *ct )
+/**
+ * Take the tracks for the calculation thread,
+ *  as snapshots so the thread is unaffected by any edits made whilst it runs
+ *
+ * @tracks_and_layers: A list of #vik_trw_and_track_t, which is freed
+ */
+static CalculateThreadT *ct_new ( VikAggregateLayer *val, GList *tracks_and_layers )
 {
-  ct->val->calculating = FALSE;
-  g_list_free_full ( ct->tracks_and_layers, g_free );
-  g_free ( ct );
+  CalculateThreadT *ct = g_malloc ( sizeof(CalculateThreadT) );
+  ct->tracks = NULL;
+  for ( GList *tl = tracks_and_layers; tl; tl = tl->next ) {
+    CalcTrackT *ctt = g_malloc ( sizeof(CalcTrackT) );
+    ctt->id = ((vik_trw_and_track_t*)tl->data)->trk;
+    ctt->snap = vik_track_get_snapshot ( ((vik_trw_and_track_t*)tl->data)->trk );
+    ct->tracks = g_list_prepend ( ct->tracks, ctt );
+  }
+  ct->tracks = g_list_reverse ( ct->tracks );
+  g_list_free_full ( tracks_and_layers, g_free );
+  ct->val = val;
+  ct->num_of_tracks = g_list_length ( ct->tracks );
+  return ct;
 }
 
-static void ct_cancel ( CalculateThreadT *ct )
+static void calc_track_free ( CalcTrackT *ctt )
 {
-  // Draw as much as we have processed so far
-  vik_layer_emit_update ( VIK_LAYER(ct->val) ); // NB update display from background
+  vik_track_snapshot_unref ( ctt->snap );
+  g_free ( ctt );
 }
 
-// Since previous square should have been checked, only need to consider the next outer row+column
-//  rather than rechecking the contents of the whole square again
-//  this is obviously gets more efficient as the square that needs checking gets bigger
-static gboolean is_square_next ( VikAggregateLayer *val, gint x, gint y, guint n )
+/**
+ * Identifies the content of a track,
+ *  so a previously calculated contribution can be reused if the track has not changed
+ */
+typedef struct {
+  guint n_points;     // With timestamps, as only those are used
+  gdouble first_ts;
+  gdouble last_ts;
+  gdouble coord_sum;
+} TrackSigT;
+
+static void track_signature ( const VikTrackSnapshot *snap, TrackSigT *sig )
 {
-  gint tmpx = x;
-  gint tmpy = y + n - 1;
-  for ( tmpx = x; tmpx < (x + n); tmpx++ ) {
-    if ( ! is_tile_occupied(val->tiles, tmpx, tmpy) ) {
-      return FALSE;
-    }
+  sig->n_points = 0;
+  sig->first_ts = 0.0;
+  sig->last_ts = 0.0;
+  sig->coord_sum = 0.0;
+  for ( guint ii = 0; ii < snap->n_points; ii++ ) {
+    const VikTrackSnapshotPoint *tp = &snap->points[ii];
+    if ( isnan(tp->timestamp) )
+      continue;
+    if ( !sig->n_points )
+      sig->first_ts = tp->timestamp;
+    sig->last_ts = tp->timestamp;
+    sig->coord_sum += tp->coord.north_south + tp->coord.east_west;
+    sig->n_points++;
   }
-  tmpx = x + n - 1;
-  for ( gint tmpy = y; tmpy < (y + n); tmpy++ ) {
-    if ( ! is_tile_occupied(val->tiles, tmpx, tmpy) ) {
-      return FALSE;
+}
+
+static gboolean track_signature_equal ( const TrackSigT *sig1, const TrackSigT *sig2 )
+{
+  return sig1->n_points == sig2->n_points &&
+    sig1->first_ts == sig2->first_ts &&
+    sig1->last_ts == sig2->last_ts &&
+    sig1->coord_sum == sig2->coord_sum;
+}
+
+/**
+ * As a track pointer is meaningless between sessions, stored contributions are identified by this
+ */
+static guint64 track_signature_hash ( const TrackSigT *sig )
+{
+  // FNV-1a
+  guint64 values[4];
+  values[0] = sig->n_points;
+  memcpy ( &values[1], &sig->first_ts, sizeof(guint64) );
+  memcpy ( &values[2], &sig->last_ts, sizeof(guint64) );
+  memcpy ( &values[3], &sig->coord_sum, sizeof(guint64) );
+  guint64 hash = G_GUINT64_CONSTANT(14695981039346656037);
+  for ( guint ii = 0; ii < G_N_ELEMENTS(values); ii++ ) {
+    for ( guint bb = 0; bb < 8; bb++ ) {
+      hash ^= (values[ii] >> (8*bb)) & 0xFF;
+      hash *= G_GUINT64_CONSTANT(1099511628211);
     }
   }
-  // NB tile (tmpx+n-1, tmpy+n-1) gets checked twice, but this isn't too much of a waste
-  return TRUE;
+  return hash;
 }
 
-static gboolean is_square ( VikAggregateLayer *val, gint x, gint y, guint n )
+// What a single track contributes to the Tracks Area Coverage
+typedef struct {
+  TrackSigT sig;
+  TileSet *tiles;
+  gboolean in_use; // Still one of the tracks being covered
+} TacTrackT;
+
+static void tac_track_free ( gpointer data )
 {
-  for ( gint tmpx = x; tmpx < (x + n); tmpx++ ) {
-     for ( gint tmpy = y; tmpy < (y + n); tmpy++ ) {
-       if ( ! is_tile_occupied(val->tiles, tmpx, tmpy) ) {
-         return FALSE;
-      }
-    }
+  TacTrackT *tt = data;
+  a_tileset_free ( tt->tiles );
+  g_free ( tt );
+}
+
+static void tac_track_apply ( VikAggregateLayer *val, TacTrackT *tt, gboolean add )
+{
+  TileSetIter iter;
+  gint x,y;
+  a_tileset_iter_init ( &iter, tt->tiles );
+  while ( a_tileset_iter_next(&iter, &x, &y) ) {
+    if ( add )
+      (void)a_tileset_ref ( val->tac_track_tiles, x, y );
+    else
+      (void)a_tileset_unref ( val->tac_track_tiles, x, y );
   }
-  return TRUE;
 }
 
 /*
- * Union Find stuff for labelling
+ * Storage of the per track contributions between sessions
+ * NB Only one zoom level (of the last calculation) is kept
  */
+#define TAC_CACHE_MAGIC "VTAC"
+#define TAC_CACHE_VERSION 1
 
-/* The 'labels' array has the meaning that labels[x] is an alias for the label x; by
-   following this chain until x == labels[x], you can find the canonical name of an
-   equivalence class.  The labels start at one; labels[0] is a special value indicating
-   the highest label already used. */
+static gchar *tac_cache_filename ( void )
+{
+  return g_build_filename ( a_get_viking_dir(), "tac_cache.bin", NULL );
+}
 
-guint *labels;
-guint n_labels = 0; /* length of the labels array */
+static void tac_cache_put_u32 ( GByteArray *ba, guint32 value )
+{
+  value = GUINT32_TO_LE ( value );
+  g_byte_array_append ( ba, (guint8*)&value, sizeof(value) );
+}
 
-/**
- * uf_find:
+static void tac_cache_put_u64 ( GByteArray *ba, guint64 value )
+{
+  value = GUINT64_TO_LE ( value );
+  g_byte_array_append ( ba, (guint8*)&value, sizeof(value) );
+}
+
+static gboolean tac_cache_get_u32 ( const guint8 **pos, const guint8 *end, guint32 *value )
+{
+  if ( end - *pos < (gssize)sizeof(guint32) )
+    return FALSE;
+  memcpy ( value, *pos, sizeof(guint32) );
+  *value = GUINT32_FROM_LE ( *value );
+  *pos += sizeof(guint32);
+  return TRUE;
+}
+
+static gboolean tac_cache_get_u64 ( const guint8 **pos, const guint8 *end, guint64 *value )
+{
+  if ( end - *pos < (gssize)sizeof(guint64) )
+    return FALSE;
+  memcpy ( value, *pos, sizeof(guint64) );
+  *value = GUINT64_FROM_LE ( *value );
+  *pos += sizeof(guint64);
+  return TRUE;
+}
+
+static void tac_cache_save ( VikAggregateLayer *val )
+{
+  GByteArray *ba = g_byte_array_new ();
+  g_byte_array_append ( ba, (guint8*)TAC_CACHE_MAGIC, 4 );
+  tac_cache_put_u32 ( ba, TAC_CACHE_VERSION );
+  guint64 zoom_bits;
+  memcpy ( &zoom_bits, &val->tac_tracks_zoom, sizeof(zoom_bits) );
+  tac_cache_put_u64 ( ba, zoom_bits );
+  tac_cache_put_u32 ( ba, g_hash_table_size(val->tac_tracks) );
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, val->tac_tracks );
+  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
+    TacTrackT *tt = value;
+    tac_cache_put_u64 ( ba, track_signature_hash(&tt->sig) );
+    tac_cache_put_u32 ( ba, a_tileset_size(tt->tiles) );
+    TileSetIter tsi;
+    gint x,y;
+    a_tileset_iter_init ( &tsi, tt->tiles );
+    while ( a_tileset_iter_next(&tsi, &x, &y) ) {
+      tac_cache_put_u32 ( ba, (guint32)x );
+      tac_cache_put_u32 ( ba, (guint32)y );
+    }
+  }
+
+  gchar *fn = tac_cache_filename ();
+  GError *error = NULL;
+  if ( !g_file_set_contents ( fn, (gchar*)ba->data, ba->len, &error ) ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+  }
+  g_free ( fn );
+  g_byte_array_free ( ba, TRUE );
+}
+
+/**
+ * Returns: A hash table of #TileSet keyed by the track signature hash, or NULL if nothing suitable is stored
+ */
+static GHashTable *tac_cache_load ( gdouble zoom )
+{
+  gchar *fn = tac_cache_filename ();
+  gchar *contents = NULL;
+  gsize length = 0;
+  gboolean ok = g_file_get_contents ( fn, &contents, &length, NULL );
+  g_free ( fn );
+  if ( !ok )
+    return NULL;
+
+  GHashTable *stored = NULL;
+  const guint8 *pos = (const guint8*)contents;
+  const guint8 *end = pos + length;
+  guint32 version, n_tracks;
+  guint64 zoom_bits;
+  if ( length < 4 || memcmp ( pos, TAC_CACHE_MAGIC, 4 ) != 0 )
+    goto done;
+  pos += 4;
+  if ( !tac_cache_get_u32 ( &pos, end, &version ) || version != TAC_CACHE_VERSION )
+    goto done;
+  if ( !tac_cache_get_u64 ( &pos, end, &zoom_bits ) || !tac_cache_get_u32 ( &pos, end, &n_tracks ) )
+    goto done;
+  gdouble stored_zoom;
+  memcpy ( &stored_zoom, &zoom_bits, sizeof(stored_zoom) );
+  if ( stored_zoom != zoom )
+    goto done;
+
+  stored = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, (GDestroyNotify)a_tileset_free );
+  for ( guint32 nn = 0; nn < n_tracks; nn++ ) {
+    guint64 hash;
+    guint32 n_tiles;
+    if ( !tac_cache_get_u64 ( &pos, end, &hash ) || !tac_cache_get_u32 ( &pos, end, &n_tiles ) )
+      break;
+    if ( (guint64)(end - pos) < (guint64)n_tiles * 8 )
+      break;
+    TileSet *tiles = a_tileset_new ();
+    for ( guint32 tt = 0; tt < n_tiles; tt++ ) {
+      guint32 x, y;
+      (void)tac_cache_get_u32 ( &pos, end, &x );
+      (void)tac_cache_get_u32 ( &pos, end, &y );
+      (void)a_tileset_add ( tiles, (gint32)x, (gint32)y );
+    }
+    gint64 *key = g_new ( gint64, 1 );
+    *key = (gint64)hash;
+    g_hash_table_replace ( stored, key, tiles );
+  }
+  g_debug ( "%s: %d stored track contributions", __FUNCTION__, g_hash_table_size(stored) );
+
+ done:
+  g_free ( contents );
+  return stored;
+}
+
+// A track that needs its contribution calculating
+typedef struct {
+  CalcTrackT *ctt;
+  TacTrackT *tt;
+  gboolean done;
+} TacJobT;
+
+// Shared by all the jobs
+typedef struct {
+  gdouble zoom;
+  gint tracks_processed;
+} TacCalcT;
+
+static void tac_job_thread ( TacJobT *job, TacCalcT *calc )
+{
+  job->tt->tiles = a_tileset_new ();
+  check_track ( job->tt->tiles, calc->zoom, job->ctt );
+  job->done = TRUE;
+  g_atomic_int_inc ( &calc->tracks_processed );
+}
+
+/**
+ * Process the jobs across all CPUs, each track getting its own set of tiles
+ *
+ * Returns: FALSE if cancelled, in which case only some of the jobs will be done
+ */
+static gboolean tac_jobs_calc ( VikAggregateLayer *val, GList *jobs, guint num_of_jobs, gpointer threaddata, guint total )
+{
+  if ( num_of_jobs < 1 )
+    return TRUE;
+
+  TacCalcT calc;
+  calc.zoom = val->zoom_level;
+  calc.tracks_processed = 0;
+
+  VikTaskGroup *group = a_background_tasks_new ();
+  GList *jl = jobs;
+  for ( guint nn = 0; nn < num_of_jobs && jl; nn++, jl = jl->next )
+    a_background_tasks_add ( group, (GFunc)tac_job_thread, jl->data, &calc );
+
+  // Report progress while waiting
+  gboolean ans = TRUE;
+  while ( !a_background_tasks_wait ( group, 100 ) ) {
+    if ( ans ) {
+      gdouble percent = (gdouble)g_atomic_int_get(&calc.tracks_processed)/(gdouble)total;
+      if ( a_background_thread_progress ( threaddata, percent ) != 0 ) {
+        a_background_tasks_cancel ( group );
+        ans = FALSE;
+      }
+    }
+  }
+  a_background_tasks_free ( group );
+  return ans;
+}
+
+/**
+ * Bring the per track contributions up to date with the current tracks,
+ *  only calculating those for tracks that are new or have changed
+ *
+ * Returns: FALSE if cancelled, although what has been processed is still used
+ */
+static gboolean tac_basic_calc ( CalculateThreadT *ct, gpointer threaddata, guint total )
+{
+  VikAggregateLayer *val = ct->val;
+  gboolean changed = FALSE;
+
+  if ( val->tac_tracks_zoom != val->zoom_level ) {
+    g_hash_table_remove_all ( val->tac_tracks );
+    a_tileset_clear ( val->tac_track_tiles );
+    val->tac_tracks_zoom = val->zoom_level;
+  }
+
+  // e.g. from a previous session
+  GHashTable *stored = NULL;
+  if ( g_hash_table_size(val->tac_tracks) == 0 )
+    stored = tac_cache_load ( val->zoom_level );
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, val->tac_tracks );
+  while ( g_hash_table_iter_next(&iter, &key, &value) )
+    ((TacTrackT*)value)->in_use = FALSE;
+
+  GList *jobs = NULL;
+  guint num_of_jobs = 0;
+  for ( GList *tl = ct->tracks; tl != NULL; tl = tl->next ) {
+    CalcTrackT *ctt = tl->data;
+    TrackSigT sig;
+    track_signature ( ctt->snap, &sig );
+
+    TacTrackT *tt = g_hash_table_lookup ( val->tac_tracks, ctt->id );
+    if ( tt ) {
+      if ( track_signature_equal ( &tt->sig, &sig ) ) {
+        tt->in_use = TRUE;
+        continue;
+      }
+      // Changed
+      tac_track_apply ( val, tt, FALSE );
+      g_hash_table_remove ( val->tac_tracks, ctt->id );
+    }
+    changed = TRUE;
+
+    tt = g_malloc0 ( sizeof(TacTrackT) );
+    tt->sig = sig;
+    tt->in_use = TRUE;
+    g_hash_table_insert ( val->tac_tracks, (gpointer)ctt->id, tt );
+
+    gint64 hash = (gint64)track_signature_hash ( &sig );
+    gpointer stored_key, stored_tiles;
+    if ( stored && g_hash_table_lookup_extended ( stored, &hash, &stored_key, &stored_tiles ) ) {
+      (void)g_hash_table_steal ( stored, &hash );
+      g_free ( stored_key );
+      tt->tiles = stored_tiles;
+      tac_track_apply ( val, tt, TRUE );
+    }
+    else {
+      TacJobT *job = g_malloc0 ( sizeof(TacJobT) );
+      job->ctt = ctt;
+      job->tt = tt;
+      jobs = g_list_prepend ( jobs, job );
+      num_of_jobs++;
+    }
+  }
+  if ( stored )
+    g_hash_table_destroy ( stored );
+
+  // Tracks that are no longer included
+  g_hash_table_iter_init ( &iter, val->tac_tracks );
+  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
+    TacTrackT *tt = value;
+    if ( !tt->in_use ) {
+      if ( tt->tiles )
+        tac_track_apply ( val, tt, FALSE );
+      g_hash_table_iter_remove ( &iter );
+      changed = TRUE;
+    }
+  }
+
+  g_debug ( "%s: %d tracks to process out of %d", __FUNCTION__, num_of_jobs, ct->num_of_tracks );
+  gboolean ans = tac_jobs_calc ( val, jobs, num_of_jobs, threaddata, total );
+
+  for ( GList *jl = jobs; jl; jl = jl->next ) {
+    TacJobT *job = jl->data;
+    if ( job->done )
+      tac_track_apply ( val, job->tt, TRUE );
+    else
+      // Not processed (i.e. cancelled), so forget about it to be calculated next time
+      g_hash_table_remove ( val->tac_tracks, job->ctt->id );
+  }
+  g_list_free_full ( jobs, g_free );
+
+  // Form the complete coverage
+  a_tileset_clear ( val->tiles );
+  val->num_tiles[BASIC] = a_tileset_union ( val->tiles, val->tac_track_tiles );
+
+  if ( changed && ans )
+    tac_cache_save ( val );
+
+  return ans;
+}
+
+static void ct_free ( CalculateThreadT *ct )
+{
+  ct->val->calculating = FALSE;
+  ct->val->tac_gen++;
+  g_list_free_full ( ct->tracks, (GDestroyNotify)calc_track_free );
+  g_free ( ct );
+}
+
+static void ct_cancel ( CalculateThreadT *ct )
+{
+  // Draw as much as we have processed so far
+  vik_layer_emit_update ( VIK_LAYER(ct->val) ); // NB update display from background
+}
+
+// Since previous square should have been checked, only need to consider the next outer row+column
+//  rather than rechecking the contents of the whole square again
+//  this is obviously gets more efficient as the square that needs checking gets bigger
+static gboolean is_square_next ( VikAggregateLayer *val, gint x, gint y, guint n )
+{
+  if ( ! a_tileset_contains_run(val->tiles, x, y + n - 1, n) )
+    return FALSE;
+  gint tmpx = x + n - 1;
+  for ( gint tmpy = y; tmpy < (y + n - 1); tmpy++ ) {
+    if ( ! a_tileset_contains(val->tiles, tmpx, tmpy) ) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static gboolean is_square ( VikAggregateLayer *val, gint x, gint y, guint n )
+{
+  for ( gint tmpy = y; tmpy < (y + n); tmpy++ ) {
+    if ( ! a_tileset_contains_run(val->tiles, x, tmpy, n) ) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/*
+ * Union Find stuff for labelling
+ */
+
+/* The 'labels' array has the meaning that labels[x] is an alias for the label x; by
+   following this chain until x == labels[x], you can find the canonical name of an
+   equivalence class.  The labels start at one; labels[0] is a special value indicating
+   the highest label already used. */
+
+typedef struct {
+  guint *labels;
+  guint n_labels; /* length of the labels array */
+} UnionFind;
+
+/**
+ * uf_find:
  *  returns the canonical label for the equivalence class containing x
  */
-static guint uf_find ( guint x ) {
+static guint uf_find ( UnionFind *uf, guint x ) {
+  guint *labels = uf->labels;
   guint y = x;
   while (labels[y] != y)
     y = labels[y];
@@ -1696,122 +2441,115 @@ static guint uf_find ( guint x ) {
  * uf_union:
  *   joins two equivalence classes and returns the canonical label of the resulting class.
  */
-static guint uf_union ( guint x, guint y ) {
-  return labels[uf_find(x)] = uf_find(y);
+static guint uf_union ( UnionFind *uf, guint x, guint y ) {
+  return uf->labels[uf_find(uf, x)] = uf_find(uf, y);
 }
 
 /**
  * uf_make_set:
  *  creates a new equivalence class and returns its label
  */
-static guint uf_make_set(void) {
-  labels[0]++;
-  labels[labels[0]] = labels[0];
-  return labels[0];
+static guint uf_make_set ( UnionFind *uf ) {
+  uf->labels[0]++;
+  uf->labels[uf->labels[0]] = uf->labels[0];
+  return uf->labels[0];
 }
 
 /**
  * uf_init:
  *   Allocate array for potential labels
  */
-static void uf_init ( guint max_labels ) {
-  n_labels = max_labels;
-  labels = g_malloc0_n ( sizeof(guint), n_labels );
-  labels[0] = 0;
+static void uf_init ( UnionFind *uf, guint max_labels ) {
+  uf->n_labels = max_labels;
+  uf->labels = g_malloc0_n ( sizeof(guint), uf->n_labels );
+  uf->labels[0] = 0;
 }
 
 /**
  * uf_finish: clean up
  */
-static void uf_finish ( void ) {
-  n_labels = 0;
-  g_free ( labels );
-  labels = NULL;
+static void uf_finish ( UnionFind *uf ) {
+  uf->n_labels = 0;
+  g_free ( uf->labels );
+  uf->labels = NULL;
 }
 
-// NB ATM This only tracks one such area
-//  (there might be multiple such areas)
-static void tac_contiguous_calc ( VikAggregateLayer *val )
+/**
+ * tac_label_calc:
+ *
+ * Label the tiles into connected areas, and find the largest one.
+ * Since the tile set is iterated in no particular order (unlike a full grid scan),
+ *  each tile is joined with any already labelled neighbour in all four directions.
+ *
+ * Returns: The number of separate areas
+ */
+static guint tac_label_calc ( TileSet *ts, guint *largest_label, guint *largest_size )
 {
-  clock_t begin = clock();
-
-  GHashTableIter iter;
-  gpointer key, value;
-  gint x,y;
-  gint tlx=G_MAXINT,tly=G_MAXINT,brx=-G_MAXINT,bry=-G_MAXINT;
+  static const gint dx[4] = { -1, 1, 0, 0 };
+  static const gint dy[4] = { 0, 0, -1, 1 };
 
-  // Get grid extents
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( x < tlx ) tlx = x;
-    if ( x > brx ) brx = x;
-    if ( y < tly ) tly = y;
-    if ( y > bry ) bry = y;
-  }
-  
-  // Process the grid according to 'labelling clusters on a grid'
-  // https://en.wikipedia.org/wiki/Hoshen%E2%80%93Kopelman_algorithm
-  guint size = (abs(tlx-brx) * abs(tly-bry)) / 2;
+  guint size = a_tileset_size ( ts );
   if ( size == 0 )
-    return;
+    return 0;
 
-  uf_init ( size );
-
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) ) {
-        guint label_up = tile_label (val->tiles, xx-1, yy ); // NB don't have to worry about -1 going out of bounds
-        guint label_left = tile_label (val->tiles, xx, yy-1 );
-        switch ( !!label_up + !!label_left ) {
-        case 0: // New
-          add_tile_label ( val->tiles, xx, yy, uf_make_set() );
-          break;
-        case 1: // Existing
-          add_tile_label ( val->tiles, xx, yy, MAX(label_up, label_left) );
-          break;
-        case 2: // Bind existing
-          add_tile_label ( val->tiles, xx, yy, uf_union(label_up, label_left) );
-          break;
-        default: // Should not happen
-          g_critical ("%s: labelling algorithm broken", __FUNCTION__);
-          break;
-        }
-      }
+  UnionFind uf;
+  uf_init ( &uf, size + 1 );
+
+  TileSetIter iter;
+  gint x,y;
+  a_tileset_iter_init ( &iter, ts );
+  while ( a_tileset_iter_next(&iter, &x, &y) ) {
+    guint label = 0;
+    for ( guint nn = 0; nn < 4; nn++ ) {
+      guint label_nb = a_tileset_get_label ( ts, x+dx[nn], y+dy[nn] );
+      if ( label_nb )
+        label = label ? uf_union ( &uf, label, label_nb ) : label_nb;
     }
+    if ( !label )
+      label = uf_make_set ( &uf );
+    a_tileset_set_label ( ts, x, y, label );
   }
 
-  // Reprocess the grid to compare the size of the labels
-  int *new_labels = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
-  int *sizes = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
-  
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) ) {
-        gint ll = uf_find(tile_label (val->tiles, xx, yy));
-        if (new_labels[ll] == 0) {
-          new_labels[0]++;
-          new_labels[ll] = new_labels[0];
-        }
-        sizes[new_labels[ll]]++;
-        add_tile_label ( val->tiles, xx, yy, new_labels[ll] );
-      }
+  // Reprocess the tiles to compare the size of the labels
+  guint *new_labels = g_malloc0_n ( sizeof(guint), uf.n_labels ); // allocate array, initialized to zero
+  guint *sizes = g_malloc0_n ( sizeof(guint), uf.n_labels ); // allocate array, initialized to zero
+
+  a_tileset_iter_init ( &iter, ts );
+  while ( a_tileset_iter_next(&iter, &x, &y) ) {
+    guint ll = uf_find ( &uf, a_tileset_get_label(ts, x, y) );
+    if (new_labels[ll] == 0) {
+      new_labels[0]++;
+      new_labels[ll] = new_labels[0];
     }
+    sizes[new_labels[ll]]++;
+    a_tileset_set_label ( ts, x, y, new_labels[ll] );
   }
-  gint total_clusters = new_labels[0];
+  guint total_clusters = new_labels[0];
 
-  guint largist = 0;
-  for ( guint ss = 1; ss < n_labels; ss++ ) {
-    if ( sizes[ss] > largist ) {
-      largist = sizes[ss];
-      val->cont_label = ss;
-      val->num_tiles[CONTIG] = largist;
+  *largest_size = 0;
+  for ( guint ss = 1; ss <= total_clusters; ss++ ) {
+    if ( sizes[ss] > *largest_size ) {
+      *largest_size = sizes[ss];
+      *largest_label = ss;
     }
   }
   g_free ( new_labels );
   g_free ( sizes );
-  uf_finish();
-  
+  uf_finish ( &uf );
+  return total_clusters;
+}
+
+// NB ATM This only tracks one such area
+//  (there might be multiple such areas)
+static void tac_contiguous_calc ( VikAggregateLayer *val )
+{
+  clock_t begin = clock();
+
+  guint largist = 0;
+  guint total_clusters = tac_label_calc ( val->tiles, &val->cont_label, &largist );
+  if ( largist )
+    val->num_tiles[CONTIG] = largist;
+
   clock_t end = clock();
   double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
   g_debug ( "%s: %f %d %d %d", __FUNCTION__, time_spent, total_clusters, largist, val->cont_label );
@@ -1823,91 +2561,22 @@ static void tac_cluster_calc ( VikAggregateLayer *val )
 {
   clock_t begin = clock();
 
-  GHashTableIter iter;
-  gpointer key, value;
+  TileSetIter iter;
   gint x,y;
 
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
+  a_tileset_iter_init ( &iter, val->tiles );
+  while ( a_tileset_iter_next(&iter, &x, &y) ) {
     if ( is_cluster(val->tiles, x, y) ) {
-      // Make new hashtable from just the tiles that are in a cluster
-      add_tile ( val->tiles_clust, x, y );
+      // Make new set from just the tiles that are in a cluster
+      a_tileset_add ( val->tiles_clust, x, y );
       val->num_tiles[CLUSTER]++;
     }
   }
 
-  gint tlx=G_MAXINT,tly=G_MAXINT,brx=-G_MAXINT,bry=-G_MAXINT;
-
-  // Get grid extents
-  g_hash_table_iter_init ( &iter, val->tiles_clust );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( x < tlx ) tlx = x;
-    if ( x > brx ) brx = x;
-    if ( y < tly ) tly = y;
-    if ( y > bry ) bry = y;
-  }
-  
-  guint size = (abs(tlx-brx) * abs(tly-bry)) / 2;
-  if ( size == 0 )
-    return;
-
-  uf_init ( size );
-
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles_clust, xx, yy) ) {
-        guint label_up = tile_label (val->tiles_clust, xx-1, yy ); // NB don't have to worry about -1 going out of bounds
-        guint label_left = tile_label (val->tiles_clust, xx, yy-1 );
-        switch ( !!label_up + !!label_left ) {
-        case 0: // New
-          add_tile_label ( val->tiles_clust, xx, yy, uf_make_set() );
-          break;
-        case 1: // Existing
-          add_tile_label ( val->tiles_clust, xx, yy, MAX(label_up, label_left) );
-          break;
-        case 2: // Bind existing
-          add_tile_label ( val->tiles_clust, xx, yy, uf_union(label_up, label_left) );
-          break;
-        default: // Should not happen
-          g_critical ("%s: labelling algorithm broken", __FUNCTION__);
-          break;
-        }
-      }
-    }
-  }
-
-  // Reprocess the grid to compare the size of the labels
-  int *new_labels = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
-  int *sizes = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
-  
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles_clust, xx, yy) ) {
-        gint ll = uf_find(tile_label (val->tiles_clust, xx, yy));
-        if (new_labels[ll] == 0) {
-          new_labels[0]++;
-          new_labels[ll] = new_labels[0];
-        }
-        sizes[new_labels[ll]]++;
-        add_tile_label ( val->tiles_clust, xx, yy, new_labels[ll] );
-      }
-    }
-  }
-  gint total_clusters = new_labels[0];
-
   guint largist = 0;
-  for ( guint ss = 1; ss < n_labels; ss++ ) {
-    if ( sizes[ss] > largist ) {
-      largist = sizes[ss];
-      val->clust_label = ss;
-      val->num_tiles[CLUSTER] = largist;
-    }
-  }
-  g_free ( new_labels );
-  g_free ( sizes );
-  uf_finish();
+  guint total_clusters = tac_label_calc ( val->tiles_clust, &val->clust_label, &largist );
+  if ( largist )
+    val->num_tiles[CLUSTER] = largist;
 
   clock_t end = clock();
   double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
@@ -1922,13 +2591,11 @@ static void tac_square_calc ( VikAggregateLayer *val )
   val->max_square = 1;
   clock_t begin = clock();
 
-  GHashTableIter iter;
-  gpointer key, value;
+  TileSetIter iter;
   gint x,y;
 
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
+  a_tileset_iter_init ( &iter, val->tiles );
+  while ( a_tileset_iter_next(&iter, &x, &y) ) {
     if ( is_square(val, x, y, val->max_square) ) {
       g_debug ( "%s: is_square %d at %d:%d", __FUNCTION__, val->max_square, x, y );
       val->xx = x;
@@ -1956,7 +2623,7 @@ static void tac_square_calc ( VikAggregateLayer *val )
  * Insert unreachable tiles to pretend they have been visited
  *  thus contributing to max squares, clusters and contiguous calculations
  * NB: ATM this doesn't effect the numbers reported too much as it uses the
- *  separate count 'num_tiles' rather than the number in the hash table
+ *  separate count 'num_tiles' rather than the number in the tile set
  */
 static void tac_unreachable ( VikAggregateLayer *val )
 {
@@ -1972,7 +2639,7 @@ static void tac_unreachable ( VikAggregateLayer *val )
   while ( g_hash_table_iter_next(&iter, &key, &value) ) {
     (void)sscanf ( key, "%d %d %d", &z, &x, &y );
     if ( z == zoom )
-      add_tile ( val->tiles, x, y );
+      (void)a_tileset_add ( val->tiles, x, y );
   }
 }
 
@@ -1981,9 +2648,7 @@ static void tac_unreachable ( VikAggregateLayer *val )
  */
 static gint tac_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
 {
-  clock_t begin = clock();
-
-  tac_unreachable ( ct->val );
+  gint64 begin = g_get_monotonic_time ();
 
   guint tracks_processed = 0;
   // This is used to prevent the progress going negative or otherwise over 100%
@@ -1994,19 +2659,14 @@ static gint tac_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
     (ct->val->on[CONTIG] * ct->num_of_tracks) +
     (ct->val->on[CLUSTER] * ct->num_of_tracks);
   
-  for ( GList *tl = ct->tracks_and_layers; tl != NULL; tl = tl->next ) {
-    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
-    gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
-
-    check_track ( ct->val, tl->data );
-    tracks_processed++;
-  }
+  gboolean completed = tac_basic_calc ( ct, threaddata, ct->num_of_tracks+extras );
+  tac_unreachable ( ct->val );
+  if ( !completed )
+    return -1;
+  tracks_processed = ct->num_of_tracks;
 
   // Timing for basic tile coverage
-  clock_t end = clock();
-  double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-  g_debug ( "%s: %f", __FUNCTION__, time_spent );
+  g_debug ( "%s: %f", __FUNCTION__, (gdouble)(g_get_monotonic_time () - begin) / G_USEC_PER_SEC );
 
   if ( ct->val->on[MAX_SQR] ) {
     gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
@@ -2036,6 +2696,7 @@ static gint tac_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
   }
   
   ct->val->calculating = FALSE;
+  ct->val->tac_gen++;
   vik_layer_emit_update ( VIK_LAYER(ct->val) ); // NB update display from background
 
   return 0;
@@ -2052,14 +2713,15 @@ static void tac_clear ( VikAggregateLayer *val )
   }
   val->cont_label = 0;
   val->clust_label = 0;
-  g_hash_table_remove_all ( val->tiles ); // No memory to remove ATM
-  g_hash_table_remove_all ( val->tiles_clust ); // No memory to remove ATM
+  a_tileset_clear ( val->tiles );
+  a_tileset_clear ( val->tiles_clust );
+  val->tac_gen++;
 }
 
 /**
- *
+ * Start afresh with the tracks to be included
  */
-static void tac_calculate ( VikAggregateLayer *val )
+static CalculateThreadT *tac_calculate_new ( VikAggregateLayer *val )
 {
   tac_clear ( val );
   val->calculating = TRUE;
@@ -2103,10 +2765,15 @@ static void tac_calculate ( VikAggregateLayer *val )
   g_list_free ( layers );
   g_date_free ( now );
 
-  CalculateThreadT *ct = g_malloc ( sizeof(CalculateThreadT) );
-  ct->tracks_and_layers = tracks_and_layers;
-  ct->val = val;
-  ct->num_of_tracks = g_list_length (tracks_and_layers);
+  return ct_new ( val, tracks_and_layers );
+}
+
+/**
+ *
+ */
+static void tac_calculate ( VikAggregateLayer *val )
+{
+  CalculateThreadT *ct = tac_calculate_new ( val );
   guint extras = ct->val->on[MAX_SQR] + ct->val->on[CONTIG] + ct->val->on[CLUSTER];
 
   a_background_thread ( BACKGROUND_POOL_LOCAL,
@@ -2119,6 +2786,45 @@ static void tac_calculate ( VikAggregateLayer *val )
                         ct->num_of_tracks + extras );
 }
 
+/**
+ * vik_aggregate_layer_tac_calculate:
+ *
+ * Calculate the Tracks Area Coverage in the calling thread, for use without a window.
+ * All of the extra analyses are included, whether or not they are drawn,
+ *  so that vik_aggregate_layer_tac_get_stats() has every value.
+ */
+void vik_aggregate_layer_tac_calculate ( VikAggregateLayer *val )
+{
+  gboolean on[CP_NUM];
+  memcpy ( on, val->on, sizeof(on) );
+  val->on[MAX_SQR] = val->on[CONTIG] = val->on[CLUSTER] = TRUE;
+
+  CalculateThreadT *ct = tac_calculate_new ( val );
+  (void)tac_calculate_thread ( ct, NULL );
+  ct_free ( ct );
+
+  memcpy ( val->on, on, sizeof(on) );
+}
+
+/**
+ * vik_aggregate_layer_tac_get_stats:
+ * @zoom:       The OSM zoom level of the tiles (as set by the Tile Area Level)
+ * @tiles:      The number of tiles visited
+ * @max_square: The side of the largest square of visited tiles
+ * @contiguous: The number of tiles in the largest contiguous area
+ * @cluster:    The number of tiles in the largest cluster (those surrounded on all four sides)
+ *
+ * The values from the last calculation of the Tracks Area Coverage
+ */
+void vik_aggregate_layer_tac_get_stats ( VikAggregateLayer *val, guint *zoom, guint *tiles, guint *max_square, guint *contiguous, guint *cluster )
+{
+  *zoom = (guint)map_utils_mpp_to_zoom_level ( val->zoom_level );
+  *tiles = val->num_tiles[BASIC];
+  *max_square = val->max_square;
+  *contiguous = val->num_tiles[CONTIG];
+  *cluster = val->num_tiles[CLUSTER];
+}
+
 static void rhomboidal (float *values, unsigned d, unsigned r)
 {
   for (guint y = 0 ; y < d ; ++y) {
@@ -2128,39 +2834,266 @@ static void rhomboidal (float *values, unsigned d, unsigned r)
   }
 }
 
-/**
- *
- */
-static void hm_track ( VikAggregateLayer *val, vik_trw_and_track_t *vtlist, gdouble mf, heatmap_t* hm, heatmap_stamp_t *stamp )
+// What a single track contributes to the heatmap
+typedef struct {
+  TrackSigT sig;
+  GArray *pixels; // Pairs of guint32: pixel index and number of trackpoints
+  gboolean in_use;
+} HmTrackT;
+
+static void hm_track_free ( gpointer data )
 {
-  int xx, yy;
-  VikTrack *trk = vtlist->trk;
-  GList *iter = trk->trackpoints;
-  while ( iter ) {
-    // Only do trackpoints with timestamps
-    // - i.e. hopefully to avoid artificial tracks
-    if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) ) {
-      coord_to_screen (val->hm_width, val->hm_height, mf, (struct LatLon*)val->hm_center, &VIK_TRACKPOINT(iter->data)->coord, &xx, &yy);
-      /*
-      struct LatLon *ll = (struct LatLon *)&VIK_TRACKPOINT(iter->data)->coord;
-      xx = (int)(val->hm_width/2 + ( mf * (ll->lon - center->lon) ));
-      yy = (int)(val->hm_height/2 + ( mf * ( MERCLAT(center->lat) - MERCLAT(ll->lat) ) ));
-      */
-      //heatmap_add_point ( hm, xx, yy );
-      heatmap_add_point_with_stamp ( hm, xx, yy, stamp );
-      //hm_point ( val, &VIK_TRACKPOINT(iter->data)->coord, hm );
-    }
-    iter = iter->next;
-  }
+  HmTrackT *ht = data;
+  g_array_free ( ht->pixels, TRUE );
+  g_free ( ht );
 }
 
-static void hm_img_free ( guchar *pixels, gpointer data )
+static void hm_track_apply ( VikAggregateLayer *val, HmTrackT *ht, gfloat sign )
 {
-  g_free ( pixels );
+  const guint32 *pairs = (const guint32*)ht->pixels->data;
+  for ( guint ii = 0; ii < ht->pixels->len; ii += 2 )
+    val->hm_counts[pairs[ii]] += sign * pairs[ii+1];
 }
 
 /**
- *
+ * Reset the trackpoint counts for new view settings
+ */
+static void hm_counts_reset ( VikAggregateLayer *val )
+{
+  g_hash_table_remove_all ( val->hm_tracks );
+  g_free ( val->hm_counts );
+  val->hm_counts = g_new0 ( gfloat, val->hm_width * val->hm_height );
+  val->hm_counts_width = val->hm_width;
+  val->hm_counts_height = val->hm_height;
+  val->hm_counts_zoom = val->hm_zoom;
+  val->hm_counts_scale = val->hm_scale;
+  val->hm_counts_center = val->hm_calc_center;
+  val->hm_counts_mode = val->hm_calc_mode;
+}
+
+/**
+ * Record a pixel covered by a line, only once per track
+ */
+static void hm_mark ( HmTrackT *ht, guint8 *marks, guint32 idx )
+{
+  if ( marks[idx] )
+    return;
+  marks[idx] = 1;
+  guint32 pair[2] = { idx, 1 };
+  g_array_append_vals ( ht->pixels, pair, 2 );
+}
+
+/**
+ * Bresenham line between two pixels (both of which must be within the image)
+ */
+static void hm_line ( gint width, HmTrackT *ht, guint8 *marks, gint x0, gint y0, gint x1, gint y1 )
+{
+  gint dx = abs ( x1 - x0 );
+  gint dy = -abs ( y1 - y0 );
+  gint sx = x0 < x1 ? 1 : -1;
+  gint sy = y0 < y1 ? 1 : -1;
+  gint err = dx + dy;
+  while ( TRUE ) {
+    hm_mark ( ht, marks, y0 * width + x0 );
+    if ( x0 == x1 && y0 == y1 )
+      break;
+    gint e2 = 2 * err;
+    if ( e2 >= dy ) {
+      err += dy;
+      x0 += sx;
+    }
+    if ( e2 <= dx ) {
+      err += dx;
+      y0 += sy;
+    }
+  }
+}
+
+/**
+ * For HM_MODE_POINTS count the trackpoints of the track in each pixel
+ *  (consecutive points in the same pixel are combined)
+ * For HM_MODE_LINES mark each pixel that the lines between the trackpoints pass through,
+ *  counting each pixel only once for the track. marks must be all clear on entry and is left so.
+ */
+static void hm_track ( VikAggregateLayer *val, const VikTrackSnapshot *snap, gdouble mf, HmTrackT *ht, guint8 *marks )
+{
+  const gint ww = val->hm_width;
+  const gint hh = val->hm_height;
+  struct LatLon *center = (struct LatLon*)&val->hm_calc_center;
+  // c.f. coord_to_screen() but without needing to recalculate the center for every trackpoint
+  const gdouble center_merclat = MERCLAT(center->lat);
+
+  gboolean have_prev = FALSE;
+  gdouble px = 0.0, py = 0.0;
+  gint pxx = 0, pyy = 0;
+  for ( guint ii = 0; ii < snap->n_points; ii++ ) {
+    const VikTrackSnapshotPoint *tp = &snap->points[ii];
+    // Lines are not drawn across gaps between segments
+    if ( tp->newsegment )
+      have_prev = FALSE;
+    // Only do trackpoints with timestamps
+    // - i.e. hopefully to avoid artificial tracks
+    if ( isnan(tp->timestamp) )
+      continue;
+    struct LatLon *ll = (struct LatLon*)&tp->coord;
+    gdouble xd = ww/2 + ( mf * (ll->lon - center->lon) );
+    gdouble yd = hh/2 + ( mf * ( center_merclat - MERCLAT(ll->lat) ) );
+    gint xx = (gint)floor ( xd );
+    gint yy = (gint)floor ( yd );
+
+    if ( val->hm_calc_mode == HM_MODE_LINES ) {
+      // Nothing more to draw for points in the same pixel as the previous one
+      if ( have_prev && xx == pxx && yy == pyy )
+        continue;
+      if ( have_prev ) {
+        gdouble x0 = px, y0 = py, x1 = xd, y1 = yd;
+        if ( a_heatmap_clip_segment ( ww, hh, &x0, &y0, &x1, &y1 ) )
+          hm_line ( ww, ht, marks, (gint)floor(x0), (gint)floor(y0), (gint)floor(x1), (gint)floor(y1) );
+      }
+      else if ( xx >= 0 && yy >= 0 && xx < ww && yy < hh )
+        hm_mark ( ht, marks, yy * ww + xx );
+      have_prev = TRUE;
+      px = xd;
+      py = yd;
+      pxx = xx;
+      pyy = yy;
+    }
+    else {
+      // Points off the image would not have been stamped
+      if ( xx >= 0 && yy >= 0 && xx < ww && yy < hh ) {
+        guint32 idx = yy * ww + xx;
+        guint len = ht->pixels->len;
+        if ( len && g_array_index ( ht->pixels, guint32, len-2 ) == idx )
+          g_array_index ( ht->pixels, guint32, len-1 )++;
+        else {
+          guint32 pair[2] = { idx, 1 };
+          g_array_append_vals ( ht->pixels, pair, 2 );
+        }
+      }
+    }
+  }
+
+  if ( marks ) {
+    const guint32 *pairs = (const guint32*)ht->pixels->data;
+    for ( guint ii = 0; ii < ht->pixels->len; ii += 2 )
+      marks[pairs[ii]] = 0;
+  }
+}
+
+// A horizontal band of the heatmap, generated by one thread
+typedef struct {
+  const gfloat *counts;
+  gint width;
+  gint height;
+  gint y0; // Rows [y0, y1) of the whole heatmap
+  gint y1;
+  guint radius;
+  const heatmap_stamp_t *stamp; // NULL for HM_MODE_LINES
+  heatmap_t *hm;
+  gfloat max;
+} HmBandT;
+
+/**
+ * Generate the band into its own heatmap which includes a margin of the stamp radius,
+ *  so that points just outside the band still contribute to it,
+ *  and then copy just the band into the whole heatmap
+ */
+static void hm_band_thread ( HmBandT *band, gpointer user_data )
+{
+  const gint rr = band->radius;
+  const gint top = MAX ( 0, band->y0 - rr );
+  const gint bottom = MIN ( band->height, band->y1 + rr );
+  const gint ww = band->width;
+  heatmap_t *sub = heatmap_new ( ww, bottom - top );
+
+  if ( band->stamp ) {
+    for ( gint yy = top; yy < bottom; yy++ ) {
+      const gfloat *row = band->counts + yy*ww;
+      for ( gint xx = 0; xx < ww; xx++ ) {
+        // NB Counts are always whole numbers, but allow for any rounding
+        if ( row[xx] > 0.5 )
+          heatmap_add_weighted_point_with_stamp ( sub, xx, yy - top, row[xx], band->stamp );
+      }
+    }
+  }
+  else
+    a_heatmap_blur ( band->counts + top*ww, ww, bottom - top, rr, sub );
+
+  band->max = 0.0;
+  const gfloat *src = sub->buf + (band->y0 - top)*ww;
+  gfloat *dst = band->hm->buf + band->y0*ww;
+  const gint nn = (band->y1 - band->y0) * ww;
+  for ( gint idx = 0; idx < nn; idx++ ) {
+    dst[idx] = src[idx];
+    if ( src[idx] > band->max )
+      band->max = src[idx];
+  }
+  heatmap_free ( sub );
+}
+
+/**
+ * Generate the heatmap from the pixel counts, split into bands processed across all CPUs
+ */
+static void hm_generate ( VikAggregateLayer *val, guint radius, heatmap_t *hm )
+{
+  const gint ww = val->hm_width;
+  const gint hh = val->hm_height;
+
+  heatmap_stamp_t *stamp = NULL;
+  if ( val->hm_calc_mode != HM_MODE_LINES ) {
+    unsigned d = 2*radius + 1;
+    float pts[d * d];
+    rhomboidal ( pts, d, radius );
+    stamp = heatmap_stamp_load ( d, d, pts );
+  }
+
+  // Each band recalculates its margins, so not worth splitting into bands much smaller than the stamp
+  guint n_bands = MIN ( util_get_number_of_cpus(), hh / MAX(16, 2*radius) );
+  if ( n_bands < 1 )
+    n_bands = 1;
+
+  HmBandT *bands = g_new0 ( HmBandT, n_bands );
+  for ( guint bb = 0; bb < n_bands; bb++ ) {
+    bands[bb].counts = val->hm_counts;
+    bands[bb].width = ww;
+    bands[bb].height = hh;
+    bands[bb].y0 = (hh * bb) / n_bands;
+    bands[bb].y1 = (hh * (bb+1)) / n_bands;
+    bands[bb].radius = radius;
+    bands[bb].stamp = stamp;
+    bands[bb].hm = hm;
+  }
+
+  if ( n_bands == 1 )
+    hm_band_thread ( &bands[0], NULL );
+  else {
+    VikTaskGroup *group = a_background_tasks_new ();
+    for ( guint bb = 0; bb < n_bands; bb++ )
+      a_background_tasks_add ( group, (GFunc)hm_band_thread, &bands[bb], NULL );
+    a_background_tasks_free ( group );
+  }
+
+  hm->max = 0.0;
+  for ( guint bb = 0; bb < n_bands; bb++ )
+    if ( bands[bb].max > hm->max )
+      hm->max = bands[bb].max;
+  g_debug ( "%s: %d bands", __FUNCTION__, n_bands );
+
+  g_free ( bands );
+  if ( stamp )
+    heatmap_stamp_free ( stamp );
+}
+
+static void hm_img_free ( guchar *pixels, gpointer data )
+{
+  g_free ( pixels );
+}
+
+/**
+ * The trackpoint counts of each track are kept, so when the heatmap is requested again
+ *  for the same view only the new or changed tracks need to be processed.
+ * Since stamping is linear, stamping each pixel once weighted by its count gives the same heatmap
+ *  as stamping every trackpoint individually.
  */
 static gint hm_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
 {
@@ -2168,49 +3101,100 @@ static gint hm_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
 
   clock_t begin = clock();
 
-  // Generate a stamp with a size relative to the zoom level
-  unsigned radius = map_utils_mpp_to_zoom_level ( val->hm_zoom ) *
-    (gdouble)val->hm_stamp_factor/(gdouble)width_default().u;
-  unsigned d = 2*radius + 1;
-  float pts[d * d];
-  rhomboidal ( pts, d, radius );
-  heatmap_stamp_t *stamp = heatmap_stamp_load ( d, d, pts );
-  heatmap_t* hm = heatmap_new ( val->hm_width, val->hm_height );
-
   int ww = val->hm_width;
   int hh = val->hm_height;
 
+  if ( !val->hm_counts ||
+       val->hm_counts_width != ww ||
+       val->hm_counts_height != hh ||
+       val->hm_counts_zoom != val->hm_zoom ||
+       val->hm_counts_scale != val->hm_scale ||
+       val->hm_counts_mode != val->hm_calc_mode ||
+       !vik_coord_equals ( &val->hm_counts_center, &val->hm_calc_center ) )
+    hm_counts_reset ( val );
+
   // Only needs calculating once
   gdouble mf = mercator_factor ( val->hm_zoom, val->hm_scale );
 
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, val->hm_tracks );
+  while ( g_hash_table_iter_next(&iter, &key, &value) )
+    ((HmTrackT*)value)->in_use = FALSE;
+
+  // For the per track dedupe of line pixels
+  guint8 *marks = NULL;
+  if ( val->hm_calc_mode == HM_MODE_LINES )
+    marks = g_new0 ( guint8, ww*hh );
+
   guint tracks_processed = 0;
-  for ( GList *tl = ct->tracks_and_layers; tl != NULL; tl = tl->next ) {
+  guint tracks_counted = 0;
+  for ( GList *tl = ct->tracks; tl != NULL; tl = tl->next ) {
     gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks);
     gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
+    if ( res != 0 ) {
+      g_free ( marks );
+      return -1;
+    }
+    tracks_processed++;
 
-    vik_trw_and_track_t *vtlist = tl->data;
-    if ( BBOX_INTERSECT ( vtlist->trk->bbox, val->hm_bbox ) )
-      hm_track ( ct->val, vtlist, mf, hm, stamp );
+    CalcTrackT *ctt = tl->data;
+    TrackSigT sig;
+    track_signature ( ctt->snap, &sig );
+    HmTrackT *ht = g_hash_table_lookup ( val->hm_tracks, ctt->id );
+    if ( ht ) {
+      if ( track_signature_equal ( &ht->sig, &sig ) ) {
+        ht->in_use = TRUE;
+        continue;
+      }
+      // Changed
+      hm_track_apply ( val, ht, -1.0 );
+      g_hash_table_remove ( val->hm_tracks, ctt->id );
+    }
 
-    tracks_processed++;
+    ht = g_malloc0 ( sizeof(HmTrackT) );
+    ht->sig = sig;
+    ht->in_use = TRUE;
+    ht->pixels = g_array_new ( FALSE, FALSE, sizeof(guint32) );
+    if ( BBOX_INTERSECT ( ctt->snap->bbox, val->hm_bbox ) )
+      hm_track ( ct->val, ctt->snap, mf, ht, marks );
+    hm_track_apply ( val, ht, 1.0 );
+    g_hash_table_insert ( val->hm_tracks, (gpointer)ctt->id, ht );
+    tracks_counted++;
   }
+  g_free ( marks );
+
+  // Tracks that are no longer present
+  g_hash_table_iter_init ( &iter, val->hm_tracks );
+  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
+    HmTrackT *ht = value;
+    if ( !ht->in_use ) {
+      hm_track_apply ( val, ht, -1.0 );
+      g_hash_table_iter_remove ( &iter );
+    }
+  }
+  g_debug ( "%s: %d tracks counted out of %d", __FUNCTION__, tracks_counted, tracks_processed );
 
   // Would be better if testing for any tracks actually used
   if ( tracks_processed > 0 ) {
+    // Generate a stamp with a size relative to the zoom level
+    unsigned radius = map_utils_mpp_to_zoom_level ( val->hm_zoom ) *
+      (gdouble)val->hm_stamp_factor/(gdouble)width_default().u;
+    heatmap_t* hm = heatmap_new ( ww, hh );
+    hm_generate ( val, radius, hm );
+
     unsigned char *image = g_malloc ( ww*hh*4 );
 
+    // Saturating at the maximum, as per heatmap_render_to()
+    const heatmap_colorscheme_t *colorscheme = heatmap_cs_default;
     if ( val->hm_style > 0 && val->hm_style < 4 )
-      heatmap_render_to ( hm, hm_colorschemes[val->hm_style-1], image );
-    else
-      heatmap_render_default_to ( hm, image );
+      colorscheme = hm_colorschemes[val->hm_style-1];
+    a_heatmap_render ( hm, colorscheme, hm->max > 0.0f ? hm->max : 1.0f, val->hm_alpha, image );
 
     val->hm_pixbuf = gdk_pixbuf_new_from_data ( image, GDK_COLORSPACE_RGB, TRUE, 8, ww, hh, 4*ww, hm_img_free, NULL );
-    val->hm_pixbuf = ui_pixbuf_set_alpha ( val->hm_pixbuf, val->hm_alpha );
-  }
 
-  heatmap_free ( hm );
-  heatmap_stamp_free ( stamp );
+    heatmap_free ( hm );
+  }
 
   // Timing
   clock_t end = clock();
@@ -2223,6 +3207,234 @@ static gint hm_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
   return 0;
 }
 
+/*
+ * Heatmap drawn as tiles, rendered on demand from an index of the track lines
+ *  so it can be panned and zoomed like a map layer without needing to be recalculated
+ */
+
+// Requests currently queued or being rendered, for all layers
+static GHashTable *hm_tile_requests = NULL;
+static GMutex hm_tile_mutex;
+
+static guint hm_tiles_radius ( VikAggregateLayer *val )
+{
+  return CLAMP ( val->hm_stamp_factor / 2, 1, 32 );
+}
+
+static const heatmap_colorscheme_t *hm_tiles_colorscheme ( VikAggregateLayer *val )
+{
+  if ( val->hm_style > 0 && val->hm_style < 4 )
+    return hm_colorschemes[val->hm_style-1];
+  return NULL;
+}
+
+/**
+ * Tiles in the cache are identified by this name,
+ *  thus when it changes any tiles rendered with previous settings are no longer used
+ */
+static void hm_tiles_name_update ( VikAggregateLayer *val )
+{
+  val->hm_tiles_gen++;
+  g_free ( val->hm_tiles_name );
+  val->hm_tiles_name = g_strdup_printf ( "heatmap-%p-%u", val, val->hm_tiles_gen );
+}
+
+/**
+ * Redraw the tiles with the current settings (e.g. colours)
+ */
+static void hm_tiles_refresh ( VikAggregateLayer *val )
+{
+  hm_tiles_name_update ( val );
+  a_mapcache_flush_type ( HM_TILES_CACHE_TYPE );
+  vik_layer_emit_update ( VIK_LAYER(val) );
+}
+
+typedef struct {
+  VikAggregateLayer *val;
+  HeatmapTiles *hmt;
+  MapCoord mc;
+  guint radius;
+  const heatmap_colorscheme_t *colorscheme;
+  guint8 alpha;
+  gchar *name;
+  gchar *request;
+} HmTileJobT;
+
+static void hm_tile_job_free ( HmTileJobT *job )
+{
+  a_heatmap_tiles_unref ( job->hmt );
+  g_free ( job->name );
+  // NB No need to free the request - as this is freed by the hash table destructor
+  g_free ( job );
+}
+
+static void hm_tile_thread ( HmTileJobT *job, gpointer threaddata )
+{
+  int res = a_background_thread_progress ( threaddata, 0 );
+  if ( res == 0 ) {
+    GdkPixbuf *pixbuf = a_heatmap_tiles_render ( job->hmt, 17 - job->mc.scale, job->mc.x, job->mc.y, job->radius, job->colorscheme, job->alpha );
+    if ( pixbuf ) {
+      a_mapcache_add ( pixbuf, (mapcache_extra_t){ 0.0 }, job->mc.x, job->mc.y, job->mc.z, HM_TILES_CACHE_TYPE, job->mc.scale, job->alpha, 0.0, 0.0, job->name, job->val );
+      g_object_unref ( pixbuf );
+    }
+  }
+
+  g_mutex_lock ( &hm_tile_mutex );
+  g_hash_table_remove ( hm_tile_requests, job->request );
+  g_mutex_unlock ( &hm_tile_mutex );
+
+  if ( res == 0 )
+    vik_layer_emit_update ( VIK_LAYER(job->val) ); // NB update display from background
+}
+
+/**
+ * Render the tile in the background, unless already requested
+ */
+static void hm_tile_request ( VikAggregateLayer *val, MapCoord *mc )
+{
+  gchar *request = g_strdup_printf ( "%d-%d-%d-%s", mc->x, mc->y, mc->scale, val->hm_tiles_name );
+
+  g_mutex_lock ( &hm_tile_mutex );
+  if ( !hm_tile_requests )
+    hm_tile_requests = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  if ( g_hash_table_contains ( hm_tile_requests, request ) ) {
+    g_mutex_unlock ( &hm_tile_mutex );
+    g_free ( request );
+    return;
+  }
+  g_hash_table_add ( hm_tile_requests, request );
+  g_mutex_unlock ( &hm_tile_mutex );
+
+  HmTileJobT *job = g_malloc0 ( sizeof(HmTileJobT) );
+  job->val = val;
+  job->hmt = a_heatmap_tiles_ref ( val->hm_tiles );
+  job->mc = *mc;
+  job->radius = hm_tiles_radius ( val );
+  job->colorscheme = hm_tiles_colorscheme ( val );
+  job->alpha = val->hm_alpha;
+  job->name = g_strdup ( val->hm_tiles_name );
+  job->request = request;
+
+  gchar *description = g_strdup_printf ( _("Heatmap Tile %d:%d:%d"), 17 - mc->scale, mc->x, mc->y );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(val),
+                        description,
+                        (vik_thr_func)hm_tile_thread,
+                        job,
+                        (vik_thr_free_func)hm_tile_job_free,
+                        NULL,
+                        1 );
+  g_free ( description );
+}
+
+/**
+ * Draw the heatmap tiles for the view, requesting any that are not yet available
+ *  As for Mapnik rendering, only drawn when the view is at one of the standard zoom levels
+ */
+static void hm_tiles_draw ( VikAggregateLayer *val, VikViewport *vvp )
+{
+  if ( vik_viewport_get_drawmode(vvp) != VIK_VIEWPORT_DRAWMODE_MERCATOR )
+    return;
+
+  VikCoord ul, br;
+  vik_viewport_screen_to_coord ( vvp, 0, 0, &ul );
+  vik_viewport_screen_to_coord ( vvp, vik_viewport_get_width(vvp), vik_viewport_get_height(vvp), &br );
+  gdouble xzoom = vik_viewport_get_xmpp ( vvp );
+  gdouble yzoom = vik_viewport_get_ympp ( vvp );
+
+  MapCoord ulm, brm;
+  if ( !map_utils_vikcoord_to_iTMS ( &ul, xzoom, yzoom, &ulm ) ||
+       !map_utils_vikcoord_to_iTMS ( &br, xzoom, yzoom, &brm ) )
+    return;
+
+  gint zoom = 17 - ulm.scale;
+  if ( zoom < 0 || zoom > HEATMAP_TILES_MAX_ZOOM )
+    return;
+
+  guint radius = hm_tiles_radius ( val );
+  const gint xmin = MIN(ulm.x, brm.x), xmax = MAX(ulm.x, brm.x);
+  const gint ymin = MIN(ulm.y, brm.y), ymax = MAX(ulm.y, brm.y);
+  for ( gint x = xmin; x <= xmax; x++ ) {
+    for ( gint y = ymin; y <= ymax; y++ ) {
+      if ( !a_heatmap_tiles_has_data ( val->hm_tiles, zoom, x, y, radius ) )
+        continue;
+      MapCoord mc = ulm;
+      mc.x = x;
+      mc.y = y;
+      GdkPixbuf *pixbuf = a_mapcache_get ( mc.x, mc.y, mc.z, HM_TILES_CACHE_TYPE, mc.scale, val->hm_alpha, 0.0, 0.0, val->hm_tiles_name, val );
+      if ( pixbuf ) {
+        VikCoord coord;
+        gint xx, yy;
+        map_utils_iTMS_to_vikcoord ( &mc, &coord );
+        vik_viewport_coord_to_screen ( vvp, &coord, &xx, &yy );
+        vik_viewport_draw_pixbuf ( vvp, pixbuf, 0, 0, xx, yy, 256, 256 );
+        g_object_unref ( pixbuf );
+      }
+      else
+        hm_tile_request ( val, &mc );
+    }
+  }
+}
+
+/**
+ * Build the index of the track lines, from which the tiles are then rendered
+ *
+ * Returns: NULL if cancelled
+ */
+static HeatmapTiles *hm_tiles_build ( CalculateThreadT *ct, gpointer threaddata )
+{
+  HeatmapTiles *hmt = a_heatmap_tiles_new ();
+
+  guint tracks_processed = 0;
+  for ( GList *tl = ct->tracks; tl != NULL; tl = tl->next ) {
+    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks);
+    gint res = a_background_thread_progress ( threaddata, percent );
+    if ( res != 0 ) {
+      a_heatmap_tiles_unref ( hmt );
+      return NULL;
+    }
+    a_heatmap_tiles_add_track ( hmt, ((CalcTrackT*)tl->data)->snap );
+    tracks_processed++;
+  }
+  a_heatmap_tiles_finish ( hmt );
+  return hmt;
+}
+
+static gint hm_tiles_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
+{
+  VikAggregateLayer *val = ct->val;
+  HeatmapTiles *hmt = hm_tiles_build ( ct, threaddata );
+  if ( !hmt ) {
+    val->hm_calculating = FALSE;
+    return -1;
+  }
+
+  val->hm_tiles = hmt;
+  val->hm_calculating = FALSE;
+  vik_layer_emit_update ( VIK_LAYER(val) ); // NB update display from background
+  return 0;
+}
+
+/**
+ * All the tracks of the TRW layers
+ */
+static CalculateThreadT *hm_ct_new ( VikAggregateLayer *val )
+{
+  GList *layers = NULL;
+  layers = vik_aggregate_layer_get_all_layers_of_type ( val, layers, VIK_LAYER_TRW, TRUE );
+
+  // For each TRW layers keep adding the tracks to build a list of all of them
+  GList *tracks_and_layers = NULL; // A list of #vik_trw_track_list_t
+  for ( GList *layer = layers; layer != NULL; layer = layer->next ) {
+    GList *tracks = g_hash_table_get_values ( vik_trw_layer_get_tracks( VIK_TRW_LAYER(layer->data) ) );
+    tracks_and_layers = g_list_concat ( tracks_and_layers, vik_trw_layer_build_track_list_t ( VIK_TRW_LAYER(layer->data), tracks ) );
+    g_list_free ( tracks );
+  }
+  g_list_free ( layers );
+
+  return ct_new ( val, tracks_and_layers );
+}
+
 /**
  *
  */
@@ -2237,10 +3449,10 @@ static void hm_calculate ( VikAggregateLayer *val )
   val->hm_zoom = (gint)vik_viewport_get_zoom ( vvp );
   val->hm_scaled_zoom = val->hm_zoom;
   val->hm_center = vik_viewport_get_center ( vvp );
+  val->hm_calc_center = *val->hm_center;
+  val->hm_calc_mode = val->hm_mode;
   vik_viewport_screen_to_coord ( vvp, 0, 0, &val->hm_tl );
   val->hm_scale = vik_viewport_get_scale ( vvp );
-  val->hm_scaled = FALSE;
-  val->hm_zoom_max = 0;
   if ( val->hm_zoom == 0 ) {
     g_warning ( "%s: Zoom invalid", __FUNCTION__ );
     return;
@@ -2248,28 +3460,15 @@ static void hm_calculate ( VikAggregateLayer *val )
 
   hm_clear ( val );
   val->hm_calculating = TRUE;
+  if ( val->hm_calc_mode == HM_MODE_TILES )
+    hm_tiles_name_update ( val );
 
-  GList *layers = NULL;
-  layers = vik_aggregate_layer_get_all_layers_of_type ( val, layers, VIK_LAYER_TRW, TRUE );
-
-  // For each TRW layers keep adding the tracks to build a list of all of them
-  GList *tracks_and_layers = NULL; // A list of #vik_trw_track_list_t
-  for ( GList *layer = layers; layer != NULL; layer = layer->next ) {
-    GList *tracks = g_hash_table_get_values ( vik_trw_layer_get_tracks( VIK_TRW_LAYER(layer->data) ) );
-    tracks_and_layers = g_list_concat ( tracks_and_layers, vik_trw_layer_build_track_list_t ( VIK_TRW_LAYER(layer->data), tracks ) );
-    g_list_free ( tracks );
-  }
-  g_list_free ( layers );
-
-  CalculateThreadT *ct = g_malloc ( sizeof(CalculateThreadT) );
-  ct->tracks_and_layers = tracks_and_layers;
-  ct->val = val;
-  ct->num_of_tracks = g_list_length ( tracks_and_layers );
+  CalculateThreadT *ct = hm_ct_new ( val );
 
   a_background_thread ( BACKGROUND_POOL_LOCAL,
                         VIK_GTK_WINDOW_FROM_LAYER(val),
                         _("Heatmap generation"),
-                        (vik_thr_func)hm_calculate_thread,
+                        val->hm_calc_mode == HM_MODE_TILES ? (vik_thr_func)hm_tiles_calculate_thread : (vik_thr_func)hm_calculate_thread,
                         ct,
                         (vik_thr_free_func)ct_free,
                         (vik_thr_free_func)ct_cancel,
@@ -2309,135 +3508,389 @@ static void tac_clear_cb ( menu_array_values values )
 typedef struct {
   VikAggregateLayer *val;
   gchar *fn;
+  HeatmapTiles *hmt; // Only for the heatmap
 } MBT_T;
 
 static void mbt_free ( MBT_T *mbt )
 {
+  a_heatmap_tiles_unref ( mbt->hmt );
   g_free ( mbt->fn );
   g_free ( mbt );
 }
 
-static gint tac_mbtiles_thread ( MBT_T *mbt, gpointer threaddata  )
+// Tiles written per transaction
+#define MBTILES_TRANSACTION_SIZE 4096
+
+/**
+ * Writing tiles into an MBTiles file
+ *
+ * Uses the deduplicated form of the MBTiles schema (a 'map' of tiles referencing 'images'),
+ *  since many tiles are identical - particularly for Tracks Area Coverage, where every tile is the same.
+ * Readers still access everything via the 'tiles' view.
+ */
+typedef struct {
+  sqlite3 *db;
+  sqlite3_stmt *insert_map;
+  sqlite3_stmt *insert_image;
+  GHashTable *images;   // PNG data (GBytes) -> the tile_id
+  guint pending;        // Tiles written in the current transaction
+} MBTilesWriterT;
+
+static void mbtiles_close ( MBTilesWriterT *mbw )
 {
-  VikAggregateLayer *val = mbt->val;
-  clock_t begin = clock();
-  guint num_tiles = 0;
-  gint result = 0;
+  if ( mbw->pending )
+    (void)sqlite3_exec ( mbw->db, "COMMIT;", 0, 0, NULL );
+  (void)sqlite3_finalize ( mbw->insert_map );
+  (void)sqlite3_finalize ( mbw->insert_image );
+  (void)sqlite3_close ( mbw->db );
+  g_hash_table_destroy ( mbw->images );
+  g_free ( mbw );
+}
 
-  gchar *msg = NULL;
-  sqlite3 *mbtiles;
-  int ans = sqlite3_open ( mbt->fn, &mbtiles );
+/**
+ * Returns: The opened file ready for inserting tiles, or NULL with the message set on failure
+ */
+static MBTilesWriterT *mbtiles_create ( const gchar *fn, gchar **msg )
+{
+  // Since any existing file is being overwritten, start afresh rather than dropping the tables
+  //  which then also avoids needing to vacuum out the old data
+  (void)g_remove ( fn );
+
+  MBTilesWriterT *mbw = g_malloc0 ( sizeof(MBTilesWriterT) );
+  mbw->images = g_hash_table_new_full ( g_bytes_hash, g_bytes_equal, (GDestroyNotify)g_bytes_unref, NULL );
+
+  int ans = sqlite3_open ( fn, &mbw->db );
   if ( ans != SQLITE_OK ) {
-    msg = g_strdup ( sqlite3_errmsg(mbtiles) );
-    goto cleanup;
+    *msg = g_strdup ( sqlite3_errmsg(mbw->db) );
+    mbtiles_close ( mbw );
+    return NULL;
   }
 
   char *err_msg = 0;
-  // Recreate tables and use fast writing options, since the data is not critical and the file can be easily regenerated
+  // Use fast writing options, since the data is not critical and the file can be easily regenerated
   char *cmd =
-    "DROP TABLE IF EXISTS tiles;"
-    "DROP TABLE IF EXISTS metadata;"
-    "CREATE TABLE tiles (zoom_level integer, tile_column integer, tile_row integer, tile_data blob);"
+    "CREATE TABLE map (zoom_level integer, tile_column integer, tile_row integer, tile_id integer);"
+    "CREATE TABLE images (tile_id integer primary key, tile_data blob);"
     "CREATE TABLE metadata (name text, value text);"
     "CREATE unique index name on metadata (name);"
-    "CREATE unique index tile_index on tiles (zoom_level, tile_column, tile_row);"
+    "CREATE unique index map_index on map (zoom_level, tile_column, tile_row);"
+    "CREATE VIEW tiles AS SELECT map.zoom_level AS zoom_level, map.tile_column AS tile_column, map.tile_row AS tile_row, images.tile_data AS tile_data"
+    " FROM map JOIN images ON images.tile_id = map.tile_id;"
     "PRAGMA synchronous=0;"
     "PRAGMA locking_mode=EXCLUSIVE;"
     "PRAGMA journal_mode=OFF;";
 
-  ans = sqlite3_exec ( mbtiles, cmd, 0, 0, &err_msg);
+  ans = sqlite3_exec ( mbw->db, cmd, 0, 0, &err_msg);
   if ( ans != SQLITE_OK ) {
-    msg = g_strdup ( err_msg );
+    *msg = g_strdup ( err_msg );
     sqlite3_free ( err_msg );
-    goto cleanup;
+    mbtiles_close ( mbw );
+    return NULL;
   }
 
+  if ( sqlite3_prepare_v2 ( mbw->db, "INSERT INTO map VALUES (?1, ?2, ?3, ?4);", -1, &mbw->insert_map, NULL ) != SQLITE_OK ||
+       sqlite3_prepare_v2 ( mbw->db, "INSERT INTO images VALUES (?1, ?2);", -1, &mbw->insert_image, NULL ) != SQLITE_OK ) {
+    *msg = g_strdup ( sqlite3_errmsg(mbw->db) );
+    mbtiles_close ( mbw );
+    return NULL;
+  }
+  return mbw;
+}
+
+/**
+ * Returns: The PNG data of the pixbuf, or NULL with the message set on failure
+ */
+static GBytes *mbtiles_encode ( GdkPixbuf *pixbuf, gchar **msg )
+{
+  gchar *buffer;
+  gsize size;
+  GError *error = NULL;
+  (void)gdk_pixbuf_save_to_buffer ( pixbuf, &buffer, &size, "png", &error, NULL );
+  if ( error ) {
+    *msg = g_strdup ( error->message );
+    g_error_free ( error );
+    return NULL;
+  }
+  return g_bytes_new_take ( buffer, size );
+}
+
+static gboolean mbtiles_step ( MBTilesWriterT *mbw, sqlite3_stmt *stmt, gchar **msg )
+{
+  int step = sqlite3_step ( stmt );
+  (void)sqlite3_reset ( stmt );
+  (void)sqlite3_clear_bindings ( stmt );
+  // This should always complete
+  if ( step != SQLITE_DONE ) {
+    *msg = g_strdup_printf ( "sqlite3_step result was %d", step );
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**
+ * Store the tile, given in the OSM x,y
+ *  Identical PNG data is only stored once
+ *
+ * Returns: FALSE with the message set on failure
+ */
+static gboolean mbtiles_insert ( MBTilesWriterT *mbw, guint zoom, gint x, gint y, GBytes *png, gchar **msg )
+{
+  if ( mbw->pending == 0 )
+    (void)sqlite3_exec ( mbw->db, "BEGIN;", 0, 0, NULL );
+
+  gpointer id;
+  if ( !g_hash_table_lookup_extended ( mbw->images, png, NULL, &id ) ) {
+    id = GUINT_TO_POINTER ( g_hash_table_size(mbw->images) + 1 );
+    gsize size;
+    gconstpointer data = g_bytes_get_data ( png, &size );
+    sqlite3_bind_int ( mbw->insert_image, 1, GPOINTER_TO_UINT(id) );
+    sqlite3_bind_blob ( mbw->insert_image, 2, data, size, SQLITE_STATIC );
+    if ( !mbtiles_step ( mbw, mbw->insert_image, msg ) )
+      return FALSE;
+    g_hash_table_insert ( mbw->images, g_bytes_ref(png), id );
+  }
+
+  gint flip_y = (gint) pow(2, zoom)-1 - y;
+  sqlite3_bind_int ( mbw->insert_map, 1, zoom );
+  sqlite3_bind_int ( mbw->insert_map, 2, x );
+  sqlite3_bind_int ( mbw->insert_map, 3, flip_y );
+  sqlite3_bind_int ( mbw->insert_map, 4, GPOINTER_TO_UINT(id) );
+  if ( !mbtiles_step ( mbw, mbw->insert_map, msg ) )
+    return FALSE;
+
+  if ( ++mbw->pending >= MBTILES_TRANSACTION_SIZE ) {
+    (void)sqlite3_exec ( mbw->db, "COMMIT;", 0, 0, NULL );
+    mbw->pending = 0;
+  }
+  return TRUE;
+}
+
+/**
+ * Complete writing all the tiles
+ */
+static void mbtiles_finish ( MBTilesWriterT *mbw )
+{
+  if ( mbw->pending ) {
+    (void)sqlite3_exec ( mbw->db, "COMMIT;", 0, 0, NULL );
+    mbw->pending = 0;
+  }
+  // Minimize filesize
+  (void)sqlite3_exec ( mbw->db, "ANALYZE; VACUUM;", 0, 0, NULL );
+  g_debug ( "%s: %d distinct images", __FUNCTION__, g_hash_table_size(mbw->images) );
+}
+
+static void mbtiles_report ( VikAggregateLayer *val, gchar *msg )
+{
+  if ( msg ) {
+    gchar *fullmsg = g_strdup_printf ( _("MBTiles file write problem: %s"), msg );
+    vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(val), fullmsg, VIK_STATUSBAR_INFO );
+    g_free ( fullmsg );
+    g_free ( msg );
+  }
+}
+
+/**
+ * Returns: -1 if cancelled, otherwise 0 with the message set on any failure
+ */
+static gint tac_mbtiles_write ( VikAggregateLayer *val, const gchar *fn, gpointer threaddata, gchar **msg )
+{
+  clock_t begin = clock();
+  guint num_tiles = 0;
+  gint result = 0;
+  GBytes *png = NULL;
+
+  MBTilesWriterT *mbw = mbtiles_create ( fn, msg );
+  if ( !mbw )
+    goto cleanup;
+
+  // All tiles are the same, so only needs encoding once
+  GdkPixbuf *pixbuf = layer_pixbuf_update ( NULL, val->color[BASIC], 256, 256, val->alpha[BASIC] );
+  png = mbtiles_encode ( pixbuf, msg );
+  g_object_unref ( pixbuf );
+  if ( !png )
+    goto cleanup;
+
   guint zoom = (guint)map_utils_mpp_to_zoom_level(val->zoom_level);
 
-  GHashTableIter iter;
-  gpointer key, value;
+  TileSetIter iter;
   gint x,y;
-  GdkPixbuf *pixbuf = NULL;
-  guint sz = g_hash_table_size ( val->tiles );
+  guint sz = a_tileset_size ( val->tiles );
 
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
+  a_tileset_iter_init ( &iter, val->tiles );
+  while ( a_tileset_iter_next(&iter, &x, &y) ) {
 
     num_tiles++;
-    gdouble percent = (gdouble)num_tiles/(gdouble)sz;
-    gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) {
-      result = -1;
-      goto cleanup;
+    // Progress updates are relatively expensive compared to inserting a tile
+    if ( num_tiles % 256 == 0 ) {
+      gdouble percent = (gdouble)num_tiles/(gdouble)sz;
+      gint res = a_background_thread_progress ( threaddata, percent );
+      if ( res != 0 ) {
+        result = -1;
+        goto cleanup;
+      }
     }
 
-    (void)sscanf ( key, "%d:%d", &x, &y );
+    if ( !mbtiles_insert ( mbw, zoom, x, y, png, msg ) )
+      goto cleanup;
+  }
+  mbtiles_finish ( mbw );
 
-    pixbuf = layer_pixbuf_update ( pixbuf, val->color[BASIC], 256, 256, val->alpha[BASIC] );
+ cleanup:
+  if ( png )
+    g_bytes_unref ( png );
+  if ( mbw )
+    mbtiles_close ( mbw );
+  clock_t end = clock();
+  double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
+  g_message ( "%s: %f %d\n", __FUNCTION__, time_spent, num_tiles );
 
-    gint flip_y = (gint) pow(2, zoom)-1 - y;
+  return result;
+}
 
-    gchar *ins = g_strdup_printf
-      ("INSERT INTO tiles VALUES (%d, %d, %d, ?);", zoom, x, flip_y);
+static gint tac_mbtiles_thread ( MBT_T *mbt, gpointer threaddata  )
+{
+  gchar *msg = NULL;
+  gint result = tac_mbtiles_write ( mbt->val, mbt->fn, threaddata, &msg );
+  mbtiles_report ( mbt->val, msg );
+  return result;
+}
 
-    sqlite3_stmt *sql_stmt;
-    ans = sqlite3_prepare_v2 ( mbtiles, ins, -1, &sql_stmt, NULL );
-    g_free ( ins );
-    if ( ans != SQLITE_OK ) {
-      msg = g_strdup ( sqlite3_errmsg(mbtiles) );
-      goto cleanup;
-    }
+// Beyond this the number of tiles (and so the time taken) tends to get excessive
+#define HM_TILES_EXPORT_MAX_ZOOM 16
 
-    gchar *buffer;
-    gsize size;
-    GError *error = NULL;
-    ans = gdk_pixbuf_save_to_buffer ( pixbuf, &buffer, &size, "png", &error, NULL );
-    if ( error ) {
-      msg = g_strdup ( error->message );
-      g_error_free ( error );
-      goto cleanup;
-    }
+// Tiles rendered in parallel before being written
+#define HM_TILES_EXPORT_BATCH 256
 
-    ans = sqlite3_bind_blob ( sql_stmt, 1, buffer, size, g_free );
-    if ( ans != SQLITE_OK ) {
-      msg = g_strdup ( err_msg );
-      sqlite3_free ( err_msg );
-      goto cleanup;
-    }
+typedef struct {
+  HeatmapTiles *hmt;
+  guint zoom;
+  gint x;
+  gint y;
+  guint radius;
+  const heatmap_colorscheme_t *colorscheme;
+  guint8 alpha;
+  GBytes *png; // Result, NULL if no tile
+  gchar *msg;  // Set on failure
+} HmExportTileT;
+
+static void hm_export_tile_thread ( HmExportTileT *et, gpointer user_data )
+{
+  GdkPixbuf *pixbuf = a_heatmap_tiles_render ( et->hmt, et->zoom, et->x, et->y, et->radius, et->colorscheme, et->alpha );
+  if ( pixbuf ) {
+    et->png = mbtiles_encode ( pixbuf, &et->msg );
+    g_object_unref ( pixbuf );
+  }
+}
 
-    int step = sqlite3_step ( sql_stmt );
-    // This should always complete
-    if ( step != SQLITE_DONE ) {
-      msg = g_strdup_printf ( "sqlite3_step result was %d", step );
-      goto cleanup;
-    }
+/**
+ * Render the whole pyramid of heatmap tiles into the MBTiles file
+ *  Tiles are rendered & encoded in batches across all CPUs, then written in order
+ *
+ * Returns: -1 if cancelled, otherwise 0 with the message set on any failure
+ */
+static gint hm_mbtiles_write ( VikAggregateLayer *val, HeatmapTiles *hmt, const gchar *fn, gpointer threaddata, gchar **msg )
+{
+  clock_t begin = clock();
+  guint num_tiles = 0;
+  gint result = 0;
+  guint radius = hm_tiles_radius ( val );
+  const heatmap_colorscheme_t *colorscheme = hm_tiles_colorscheme ( val );
+
+  // Determine all the tiles first, for the progress
+  GArray *tiles[HM_TILES_EXPORT_MAX_ZOOM+1];
+  guint total = 0;
+  for ( guint zz = 0; zz <= HM_TILES_EXPORT_MAX_ZOOM; zz++ ) {
+    tiles[zz] = a_heatmap_tiles_list ( hmt, zz, radius );
+    total += tiles[zz]->len / 2;
+  }
+
+  HmExportTileT *batch = g_new0 ( HmExportTileT, HM_TILES_EXPORT_BATCH );
+  guint n_threads = util_get_number_of_cpus ();
+
+  MBTilesWriterT *mbw = mbtiles_create ( fn, msg );
+  if ( !mbw )
+    goto cleanup;
+
+  for ( guint zz = 0; zz <= HM_TILES_EXPORT_MAX_ZOOM; zz++ ) {
+    for ( guint ii = 0; ii < tiles[zz]->len; ii += 2*HM_TILES_EXPORT_BATCH ) {
+      gdouble percent = (gdouble)num_tiles/(gdouble)total;
+      gint res = a_background_thread_progress ( threaddata, percent );
+      if ( res != 0 ) {
+        result = -1;
+        goto cleanup;
+      }
 
-    (void)sqlite3_finalize ( sql_stmt );
+      guint nn = MIN ( HM_TILES_EXPORT_BATCH, (tiles[zz]->len - ii) / 2 );
+      for ( guint bb = 0; bb < nn; bb++ ) {
+        batch[bb].hmt = hmt;
+        batch[bb].zoom = zz;
+        batch[bb].x = g_array_index ( tiles[zz], guint32, ii + 2*bb );
+        batch[bb].y = g_array_index ( tiles[zz], guint32, ii + 2*bb + 1 );
+        batch[bb].radius = radius;
+        batch[bb].colorscheme = colorscheme;
+        batch[bb].alpha = val->hm_alpha;
+        batch[bb].png = NULL;
+        batch[bb].msg = NULL;
+      }
 
-    // Minimize filesize
-    (void)sqlite3_exec ( mbtiles, "ANALYZE; VACUUM;", 0, 0, NULL );
+      if ( n_threads > 1 && nn > 1 ) {
+        VikTaskGroup *group = a_background_tasks_new ();
+        for ( guint bb = 0; bb < nn; bb++ )
+          a_background_tasks_add ( group, (GFunc)hm_export_tile_thread, &batch[bb], NULL );
+        a_background_tasks_free ( group );
+      }
+      else
+        for ( guint bb = 0; bb < nn; bb++ )
+          hm_export_tile_thread ( &batch[bb], NULL );
+
+      gboolean ok = TRUE;
+      for ( guint bb = 0; bb < nn; bb++ ) {
+        if ( ok ) {
+          if ( batch[bb].msg ) {
+            *msg = batch[bb].msg;
+            batch[bb].msg = NULL;
+            ok = FALSE;
+          }
+          else if ( batch[bb].png )
+            ok = mbtiles_insert ( mbw, zz, batch[bb].x, batch[bb].y, batch[bb].png, msg );
+        }
+        if ( batch[bb].png )
+          g_bytes_unref ( batch[bb].png );
+        g_free ( batch[bb].msg );
+      }
+      num_tiles += nn;
+      if ( !ok )
+        goto cleanup;
+    }
   }
+  mbtiles_finish ( mbw );
 
  cleanup:
-  (void)sqlite3_close ( mbtiles );
+  if ( mbw )
+    mbtiles_close ( mbw );
+  g_free ( batch );
+  for ( guint zz = 0; zz <= HM_TILES_EXPORT_MAX_ZOOM; zz++ )
+    g_array_free ( tiles[zz], TRUE );
   clock_t end = clock();
   double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
   g_message ( "%s: %f %d\n", __FUNCTION__, time_spent, num_tiles );
 
-  if ( msg ) {
-    gchar *fullmsg = g_strdup_printf ( _("MBTiles file write problem: %s"), msg );
-    vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(val), fullmsg, VIK_STATUSBAR_INFO );
-    g_free ( fullmsg );
-    g_free ( msg );
-  }
-
   return result;
 }
 
-static void tac_generate_mbtiles_cb ( menu_array_values values )
+static gint hm_mbtiles_thread ( MBT_T *mbt, gpointer threaddata  )
 {
-  VikAggregateLayer *val = VIK_AGGREGATE_LAYER(values[MA_VAL]);
+  gchar *msg = NULL;
+  gint result = hm_mbtiles_write ( mbt->val, mbt->hmt, mbt->fn, threaddata, &msg );
+  mbtiles_report ( mbt->val, msg );
+  return result;
+}
 
+/**
+ * Returns: The filename to export to, or NULL if cancelled
+ */
+static gchar *mbtiles_choose_file ( VikAggregateLayer *val )
+{
   gchar *fn = NULL;
   GtkWidget *dialog = gtk_file_chooser_dialog_new ( _("Export"),
 						    NULL,
@@ -2457,23 +3910,97 @@ static void tac_generate_mbtiles_cb ( menu_array_values values )
     fn = NULL;
   }
   gtk_widget_destroy ( dialog );
+  return fn;
+}
+
+static void tac_generate_mbtiles_cb ( menu_array_values values )
+{
+  VikAggregateLayer *val = VIK_AGGREGATE_LAYER(values[MA_VAL]);
+
+  gchar *fn = mbtiles_choose_file ( val );
+  if ( !fn )
+    return;
+
+  MBT_T *mbt = g_malloc0 ( sizeof(MBT_T) );
+  mbt->val = val;
+  mbt->fn = fn;
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(val),
+                        _("Creating MBTiles File"),
+                        (vik_thr_func)tac_mbtiles_thread,
+                        mbt,
+                        (vik_thr_free_func)mbt_free,
+                        NULL, // cancel() nothing to do, could delete file but ATM leave as progressed
+                        a_tileset_size(val->tiles) );
+}
+
+static void hm_generate_mbtiles_cb ( menu_array_values values )
+{
+  VikAggregateLayer *val = VIK_AGGREGATE_LAYER(values[MA_VAL]);
+  if ( !val->hm_tiles )
+    return;
 
+  gchar *fn = mbtiles_choose_file ( val );
   if ( !fn )
     return;
 
-  MBT_T *mbt = g_malloc ( sizeof(MBT_T) );
+  MBT_T *mbt = g_malloc0 ( sizeof(MBT_T) );
   mbt->val = val;
   mbt->fn = fn;
+  mbt->hmt = a_heatmap_tiles_ref ( val->hm_tiles );
   a_background_thread ( BACKGROUND_POOL_LOCAL,
                         VIK_GTK_WINDOW_FROM_LAYER(val),
                         _("Creating MBTiles File"),
-                        (vik_thr_func)tac_mbtiles_thread,
+                        (vik_thr_func)hm_mbtiles_thread,
                         mbt,
                         (vik_thr_free_func)mbt_free,
                         NULL, // cancel() nothing to do, could delete file but ATM leave as progressed
-                        g_hash_table_size(val->tiles) );
+                        1 );
+}
+#endif
+
+/**
+ * vik_aggregate_layer_tac_export_mbtiles:
+ * @msg: Set to the reason on failure, to be freed
+ *
+ * Write the tiles of the last Tracks Area Coverage calculation into an MBTiles file,
+ *  in the calling thread for use without a window.
+ */
+gboolean vik_aggregate_layer_tac_export_mbtiles ( VikAggregateLayer *val, const gchar *filename, gchar **msg )
+{
+  *msg = NULL;
+#ifdef HAVE_SQLITE3_H
+  return tac_mbtiles_write ( val, filename, NULL, msg ) == 0 && !*msg;
+#else
+  *msg = g_strdup ( _("MBTiles support not available") );
+  return FALSE;
+#endif
 }
+
+/**
+ * vik_aggregate_layer_heatmap_export_mbtiles:
+ * @msg: Set to the reason on failure, to be freed
+ *
+ * Write the tiled heatmap of all the tracks into an MBTiles file, using the heatmap width, style and alpha of the layer.
+ * All in the calling thread for use without a window, although the tiles are rendered across all CPUs.
+ */
+gboolean vik_aggregate_layer_heatmap_export_mbtiles ( VikAggregateLayer *val, const gchar *filename, gchar **msg )
+{
+  *msg = NULL;
+#ifdef HAVE_SQLITE3_H
+  CalculateThreadT *ct = hm_ct_new ( val );
+  HeatmapTiles *hmt = hm_tiles_build ( ct, NULL );
+  ct_free ( ct );
+  if ( !hmt )
+    return FALSE;
+  gboolean ans = hm_mbtiles_write ( val, hmt, filename, NULL, msg ) == 0 && !*msg;
+  a_heatmap_tiles_unref ( hmt );
+  return ans;
+#else
+  *msg = g_strdup ( _("MBTiles support not available") );
+  return FALSE;
 #endif
+}
 
 /**
  * View area of all TRW layers within an aggregrate layer
@@ -2630,7 +4157,12 @@ static void aggregate_build_submenu_hm ( VikAggregateLayer *val, GtkMenu *menu,
     gtk_widget_set_sensitive ( itemhmc, hm_available );
 
     GtkWidget *itemhmlr = vu_menu_add_item ( hm_submenu, _("_Remove"), GTK_STOCK_DELETE, G_CALLBACK(hm_clear_cb), values );
-    gtk_widget_set_sensitive ( itemhmlr, (val->hm_pixbuf != NULL) );
+    gtk_widget_set_sensitive ( itemhmlr, (val->hm_pixbuf != NULL || val->hm_tiles != NULL) );
+
+#ifdef HAVE_SQLITE3_H
+    if ( val->hm_tiles && hm_available )
+      (void)vu_menu_add_item ( hm_submenu, _("_Export as MBTiles"), GTK_STOCK_CONVERT, G_CALLBACK(hm_generate_mbtiles_cb), values );
+#endif
   }
 }
 
@@ -2731,7 +4263,7 @@ static gboolean aggregate_layer_selected_viewport_menu ( VikAggregateLayer *val,
 
     if ( map_utils_vikcoord_to_iTMS(&coord, val->zoom_level, val->zoom_level, &val->rc_menu_mc) ) {
       GtkWidget *itemtt = vu_menu_add_item ( sm, _("_Tracks in this Tile"), GTK_STOCK_INFO, G_CALLBACK(tac_track_list_cb), values );
-      available = available && is_tile_occupied ( val->tiles, val->rc_menu_mc.x, val->rc_menu_mc.y );
+      available = available && a_tileset_contains ( val->tiles, val->rc_menu_mc.x, val->rc_menu_mc.y );
       gtk_widget_set_sensitive ( itemtt, available );
     }
 
@@ -2746,6 +4278,238 @@ static gboolean aggregate_layer_selected_viewport_menu ( VikAggregateLayer *val,
   return FALSE;
 }
 
+/**************************************************************
+ **** ELEVATIONS
+ **************************************************************/
+
+typedef enum {
+  ELEV_DEM_OVERWRITE,
+  ELEV_DEM_KEEP_EXISTING,
+  ELEV_SMOOTH_INTERPOLATED,
+  ELEV_SMOOTH_FLAT,
+} ElevationOp;
+
+typedef struct {
+  VikAggregateLayer *val;
+  ElevationOp op;
+  GList *tracks;  // Referenced tracks (and routes) of all the TRW layers
+  GHashTable *tiles; // The SRTM degrees covered
+  GList *dems;    // Filenames of the DEMs loaded for this
+  gint changed;   // Atomic count of the points changed
+} ElevationJobT;
+
+static void elev_job_free ( ElevationJobT *job )
+{
+  g_list_free_full ( job->tracks, (GDestroyNotify)vik_track_free );
+  if ( job->tiles )
+    g_hash_table_destroy ( job->tiles );
+  // The DEMs are then kept in the DEM cache for a while, for any repeat
+  a_dems_list_free ( job->dems );
+  g_object_unref ( job->val );
+  g_free ( job );
+}
+
+/**
+ * The SRTM degrees of the points that are going to be given an elevation
+ */
+static GHashTable *elev_job_tiles ( ElevationJobT *job )
+{
+  GHashTable *tiles = vik_dem_layer_srtm_tiles_new ();
+  for ( GList *iter = job->tracks; iter; iter = iter->next ) {
+    for ( GList *tpl = VIK_TRACK(iter->data)->trackpoints; tpl; tpl = tpl->next ) {
+      VikTrackpoint *tp = VIK_TRACKPOINT(tpl->data);
+      if ( job->op == ELEV_DEM_KEEP_EXISTING && !isnan(tp->altitude) )
+        continue;
+      struct LatLon ll;
+      vik_coord_to_latlon ( &tp->coord, &ll );
+      vik_dem_layer_srtm_tiles_add ( tiles, &ll );
+    }
+  }
+  return tiles;
+}
+
+static void elev_apply_track ( VikTrack *trk, ElevationJobT *job )
+{
+  gulong changed = 0;
+  switch ( job->op ) {
+    case ELEV_DEM_OVERWRITE:       changed = vik_track_apply_dem_data ( trk, FALSE ); break;
+    case ELEV_DEM_KEEP_EXISTING:   changed = vik_track_apply_dem_data ( trk, TRUE ); break;
+    case ELEV_SMOOTH_INTERPOLATED: changed = vik_track_smooth_missing_elevation_data ( trk, FALSE ); break;
+    case ELEV_SMOOTH_FLAT:         changed = vik_track_smooth_missing_elevation_data ( trk, TRUE ); break;
+    default: break;
+  }
+  g_atomic_int_add ( &job->changed, (gint)changed );
+}
+
+/**
+ * Change all the tracks, spread over the background pool
+ *
+ * Returns: The number of points changed
+ */
+static gint elev_job_run ( ElevationJobT *job )
+{
+  VikTaskGroup *group = a_background_tasks_new ();
+  for ( GList *iter = job->tracks; iter; iter = iter->next )
+    a_background_tasks_add ( group, (GFunc)elev_apply_track, iter->data, job );
+  a_background_tasks_free ( group );
+  return g_atomic_int_get ( &job->changed );
+}
+
+/**
+ * Done from the main thread, so that nothing else is using the tracks meanwhile
+ */
+static void elev_job_apply ( ElevationJobT *job )
+{
+  gint changed = elev_job_run ( job );
+  gchar str[64];
+  g_snprintf ( str, sizeof(str), ngettext("%d point adjusted", "%d points adjusted", changed), changed );
+  a_dialog_info_msg ( VIK_GTK_WINDOW_FROM_LAYER(job->val), str );
+
+  if ( changed )
+    vik_layer_emit_update ( VIK_LAYER(job->val) );
+  elev_job_free ( job );
+}
+
+static gboolean elev_job_apply_idle ( ElevationJobT *job )
+{
+  elev_job_apply ( job );
+  return FALSE;
+}
+
+// The track references are only to be changed in the main thread
+static gboolean elev_job_free_idle ( ElevationJobT *job )
+{
+  elev_job_free ( job );
+  return FALSE;
+}
+
+/**
+ * Get the DEMs for the tracks (downloading any that are not yet available)
+ *  before the tracks are changed back in the main thread
+ */
+static gint elev_dem_thread ( ElevationJobT *job, gpointer threaddata )
+{
+  if ( vik_dem_layer_srtm_acquire ( job->tiles, &job->dems, threaddata ) ) {
+    (void)gdk_threads_add_idle ( (GSourceFunc)elev_job_free_idle, job );
+    return -1;
+  }
+  (void)gdk_threads_add_idle ( (GSourceFunc)elev_job_apply_idle, job );
+  return 0;
+}
+
+static ElevationJobT *elev_job_new ( VikAggregateLayer *val, ElevationOp op )
+{
+  ElevationJobT *job = g_malloc0 ( sizeof(ElevationJobT) );
+  job->val = g_object_ref ( val );
+  job->op = op;
+
+  GList *layers = vik_aggregate_layer_get_all_layers_of_type ( val, NULL, VIK_LAYER_TRW, TRUE );
+  for ( GList *layer = layers; layer; layer = layer->next ) {
+    VikTrwLayer *vtl = VIK_TRW_LAYER(layer->data);
+    GList *tracks = g_hash_table_get_values ( vik_trw_layer_get_tracks(vtl) );
+    tracks = g_list_concat ( tracks, g_hash_table_get_values ( vik_trw_layer_get_routes(vtl) ) );
+    for ( GList *iter = tracks; iter; iter = iter->next )
+      vik_track_ref ( VIK_TRACK(iter->data) );
+    job->tracks = g_list_concat ( job->tracks, tracks );
+  }
+  g_list_free ( layers );
+  return job;
+}
+
+static void aggregate_layer_elevations ( VikAggregateLayer *val, ElevationOp op )
+{
+  ElevationJobT *job = elev_job_new ( val, op );
+
+  if ( op == ELEV_SMOOTH_INTERPOLATED || op == ELEV_SMOOTH_FLAT ) {
+    elev_job_apply ( job );
+    return;
+  }
+
+  job->tiles = elev_job_tiles ( job );
+  guint count = g_hash_table_size ( job->tiles );
+  if ( !count ) {
+    elev_job_apply ( job );
+    return;
+  }
+
+  a_background_thread ( BACKGROUND_POOL_REMOTE,
+                        VIK_GTK_WINDOW_FROM_LAYER(val),
+                        _("Applying DEM data to all tracks"),
+                        (vik_thr_func)elev_dem_thread,
+                        job,
+                        NULL, // The thread itself frees the job or passes it on
+                        NULL,
+                        count );
+}
+
+/**
+ * As aggregate_layer_elevations() but all done in the calling thread,
+ *  for when there is no window
+ *
+ * Returns: The number of points changed, or -1 if stopped before all the DEMs were acquired
+ */
+static gint aggregate_layer_elevations_wait ( VikAggregateLayer *val, ElevationOp op )
+{
+  ElevationJobT *job = elev_job_new ( val, op );
+  gint changed = -1;
+  if ( op == ELEV_SMOOTH_INTERPOLATED || op == ELEV_SMOOTH_FLAT )
+    changed = elev_job_run ( job );
+  else {
+    job->tiles = elev_job_tiles ( job );
+    if ( vik_dem_layer_srtm_acquire ( job->tiles, &job->dems, NULL ) == 0 )
+      changed = elev_job_run ( job );
+  }
+  elev_job_free ( job );
+  return changed;
+}
+
+/**
+ * vik_aggregate_layer_apply_dem:
+ * @skip_existing: Only give elevations to the trackpoints without one
+ *
+ * Apply DEM data to all tracks and routes, downloading the SRTM DEMs as needed.
+ * Unlike the menu entries this is done in the calling thread, for use without a window.
+ *
+ * Returns: The number of points changed, or -1 if stopped before all the DEMs were acquired
+ */
+gint vik_aggregate_layer_apply_dem ( VikAggregateLayer *val, gboolean skip_existing )
+{
+  return aggregate_layer_elevations_wait ( val, skip_existing ? ELEV_DEM_KEEP_EXISTING : ELEV_DEM_OVERWRITE );
+}
+
+/**
+ * vik_aggregate_layer_smooth_elevations:
+ * @flat: Use the last known elevation, rather than interpolating
+ *
+ * Fill in the missing elevations of all tracks and routes, in the calling thread.
+ *
+ * Returns: The number of points changed
+ */
+gint vik_aggregate_layer_smooth_elevations ( VikAggregateLayer *val, gboolean flat )
+{
+  return aggregate_layer_elevations_wait ( val, flat ? ELEV_SMOOTH_FLAT : ELEV_SMOOTH_INTERPOLATED );
+}
+
+static void aggregate_layer_dem_overwrite ( menu_array_values values )
+{
+  aggregate_layer_elevations ( VIK_AGGREGATE_LAYER(values[MA_VAL]), ELEV_DEM_OVERWRITE );
+}
+
+static void aggregate_layer_dem_keep_existing ( menu_array_values values )
+{
+  aggregate_layer_elevations ( VIK_AGGREGATE_LAYER(values[MA_VAL]), ELEV_DEM_KEEP_EXISTING );
+}
+
+static void aggregate_layer_smooth_interpolated ( menu_array_values values )
+{
+  aggregate_layer_elevations ( VIK_AGGREGATE_LAYER(values[MA_VAL]), ELEV_SMOOTH_INTERPOLATED );
+}
+
+static void aggregate_layer_smooth_flat ( menu_array_values values )
+{
+  aggregate_layer_elevations ( VIK_AGGREGATE_LAYER(values[MA_VAL]), ELEV_SMOOTH_FLAT );
+}
+
 static void aggregate_layer_add_menu_items ( VikAggregateLayer *val, GtkMenu *menu, gpointer vlp )
 {
   // Data to pass on in menu functions
@@ -2782,6 +4546,8 @@ static void aggregate_layer_add_menu_items ( VikAggregateLayer *val, GtkMenu *me
   (void)vu_menu_add_item ( menu, _("_Statistics"), GTK_STOCK_INFO, G_CALLBACK(aggregate_layer_analyse), values );
   (void)vu_menu_add_item ( menu, _("Track _List..."), GTK_STOCK_INDEX, G_CALLBACK(aggregate_layer_track_list_dialog), values );
   (void)vu_menu_add_item ( menu, _("_Waypoint List..."), GTK_STOCK_INDEX, G_CALLBACK(aggregate_layer_waypoint_list_dialog), values );
+  GtkWidget *itempb = vu_menu_add_item ( menu, _("_Playback..."), GTK_STOCK_MEDIA_PLAY, G_CALLBACK(aggregate_layer_playback), values );
+  gtk_widget_set_tooltip_text ( itempb, _("Play back the visible tracks over time") );
 
   GtkMenu *search_submenu = GTK_MENU(gtk_menu_new());
   GtkWidget *itemsr = vu_menu_add_item ( menu, _("Searc_h"), GTK_STOCK_FIND, NULL, NULL );
@@ -2789,6 +4555,23 @@ static void aggregate_layer_add_menu_items ( VikAggregateLayer *val, GtkMenu *me
 
   GtkWidget *itemd = vu_menu_add_item ( search_submenu, _("By _Date..."), NULL, G_CALLBACK(aggregate_layer_search_date), values );
   gtk_widget_set_tooltip_text ( itemd, _("Find the first item with a specified date") );
+  GtkWidget *itemdt = vu_menu_add_item ( search_submenu, _("D_uplicate Tracks..."), NULL, G_CALLBACK(aggregate_layer_search_duplicate_tracks), values );
+  gtk_widget_set_tooltip_text ( itemdt, _("Find tracks in any of the layers that are copies of another track") );
+  GtkWidget *itemtv = vu_menu_add_item ( search_submenu, _("Tracks Through _View..."), NULL, G_CALLBACK(aggregate_layer_search_tracks_in_view), values );
+  gtk_widget_set_tooltip_text ( itemtv, _("Find tracks in any of the layers that pass through the part of the map being shown, and when") );
+
+  GtkMenu *elev_submenu = GTK_MENU(gtk_menu_new());
+  GtkWidget *iteme = vu_menu_add_item ( menu, _("_Elevations of All Tracks"), NULL, NULL, NULL );
+  gtk_menu_item_set_submenu ( GTK_MENU_ITEM(iteme), GTK_WIDGET(elev_submenu) );
+
+  GtkWidget *itemow = vu_menu_add_item ( elev_submenu, _("Apply DEM Data: _Overwrite"), "vik-icon-DEM Download", G_CALLBACK(aggregate_layer_dem_overwrite), values );
+  gtk_widget_set_tooltip_text ( itemow, _("Overwrite any existing elevation values with DEM values, downloading the DEMs as needed") );
+  GtkWidget *itemke = vu_menu_add_item ( elev_submenu, _("Apply DEM Data: _Keep Existing"), "vik-icon-DEM Download", G_CALLBACK(aggregate_layer_dem_keep_existing), values );
+  gtk_widget_set_tooltip_text ( itemke, _("Keep existing elevation values, only attempt for missing values, downloading the DEMs as needed") );
+  GtkWidget *itemintp = vu_menu_add_item ( elev_submenu, _("Smooth Missing Elevation Data: _Interpolated"), NULL, G_CALLBACK(aggregate_layer_smooth_interpolated), values );
+  gtk_widget_set_tooltip_text ( itemintp, _("Interpolate between known elevation values to derive values for the missing elevations") );
+  GtkWidget *itemflat = vu_menu_add_item ( elev_submenu, _("Smooth Missing Elevation Data: _Flat"), NULL, G_CALLBACK(aggregate_layer_smooth_flat), values );
+  gtk_widget_set_tooltip_text ( itemflat, _("Set unknown elevation values to the last known value") );
 
   GtkMenu *file_submenu = GTK_MENU(gtk_menu_new());
   GtkWidget *itemsf = vu_menu_add_item ( menu, _("_File"), GTK_STOCK_FILE, NULL, NULL );
@@ -2819,22 +4602,29 @@ void vik_aggregate_layer_free ( VikAggregateLayer *val )
   g_list_free ( val->children );
   if ( val->tracks_analysis_dialog != NULL )
     gtk_widget_destroy ( val->tracks_analysis_dialog );
-
-  g_hash_table_destroy ( val->tiles );
-  for ( guint ii=0; ii<CP_NUM; ii++ ) {
-    if ( val->pixbuf[ii] )
-      g_object_unref ( val->pixbuf[ii] );
-    if ( val->full_pixbuf[ii] )
-      g_object_unref ( val->full_pixbuf[ii] );
-  }
+  if ( val->playback_dialog != NULL )
+    gtk_widget_destroy ( val->playback_dialog );
+
+  a_tileset_free ( val->tiles );
+  if ( val->cover )
+    g_object_unref ( val->cover );
+  if ( val->full_pixbuf )
+    g_object_unref ( val->full_pixbuf );
   if ( val->unreachable_pixbuf )
     g_object_unref ( val->unreachable_pixbuf );
-  g_hash_table_destroy ( val->tiles_clust );
+  a_tileset_free ( val->tiles_clust );
+  g_hash_table_destroy ( val->tac_tracks );
+  a_tileset_free ( val->tac_track_tiles );
+  g_hash_table_destroy ( val->hm_tracks );
+  g_free ( val->hm_counts );
 
   if ( val->hm_pixbuf )
     g_object_unref ( val->hm_pixbuf );
-  if ( val->hm_pbf_scaled )
-    g_object_unref ( val->hm_pbf_scaled );
+  if ( val->hm_window )
+    g_object_unref ( val->hm_window );
+  a_heatmap_tiles_unref ( val->hm_tiles );
+  g_free ( val->hm_tiles_name );
+  a_mapcache_remove_layer ( val );
 }
 
 static void delete_layer_iter ( VikLayer *vl )
@@ -3037,6 +4827,33 @@ const GList *vik_aggregate_layer_get_children ( VikAggregateLayer *val )
   return val->children;
 }
 
+static GList *get_drawn_layers ( VikAggregateLayer *val, GList *layers )
+{
+  for ( GList *iter = val->children; iter; iter = iter->next ) {
+    VikLayer *vl = VIK_LAYER(iter->data);
+    layers = g_list_prepend ( layers, vl );
+    if ( vl->type == VIK_LAYER_AGGREGATE )
+      layers = get_drawn_layers ( VIK_AGGREGATE_LAYER(vl), layers );
+    else if ( vl->type == VIK_LAYER_GPS ) {
+      for ( const GList *gl = vik_gps_layer_get_children ( VIK_GPS_LAYER(vl) ); gl; gl = gl->next )
+        layers = g_list_prepend ( layers, gl->data );
+    }
+  }
+  return layers;
+}
+
+/**
+ * vik_aggregate_layer_get_drawn_layers:
+ *
+ * Returns: A list of all layers in the order they are drawn,
+ *  including those within nested aggregate layers and the sublayers of GPS layers.
+ *  Free the list (but not the layers) after use.
+ */
+GList *vik_aggregate_layer_get_drawn_layers ( VikAggregateLayer *val )
+{
+  return g_list_reverse ( get_drawn_layers ( val, NULL ) );
+}
+
 gboolean vik_aggregate_layer_is_empty ( VikAggregateLayer *val )
 {
   if ( val->children )
@@ -3100,6 +4917,28 @@ static const gchar* aggregate_layer_tooltip ( VikAggregateLayer *val )
   return tmp_buf;
 }
 
+static void aggregate_layer_get_memory ( VikAggregateLayer *val, VikLayerMemory *mem )
+{
+  // Only what is drawn or calculated for the analyses - the children report their own
+  gsize bytes = 0;
+  bytes += ui_pixbuf_get_bytes ( val->cover ) + ui_pixbuf_get_bytes ( val->full_pixbuf );
+  bytes += ui_pixbuf_get_bytes ( val->unreachable_pixbuf );
+  bytes += ui_pixbuf_get_bytes ( val->hm_pixbuf );
+  bytes += ui_pixbuf_get_bytes ( val->hm_window );
+  if ( val->hm_counts )
+    bytes += (gsize)val->hm_counts_width * val->hm_counts_height * sizeof(gfloat);
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, val->hm_tracks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    HmTrackT *ht = value;
+    bytes += sizeof(HmTrackT) + ht->pixels->len * g_array_get_element_size ( ht->pixels );
+  }
+  mapcache_stats_t stats;
+  a_mapcache_get_stats_layer ( val, &stats );
+  mem->bytes[VIK_LAYER_MEMORY_CACHES] += bytes + stats.bytes;
+}
+
 /**
  * Return number of layers held
  */
@@ -3138,47 +4977,297 @@ void vik_aggregate_layer_export_gpx_setup ( VikAggregateLayer *val )
   g_free ( auto_save_name );
 }
 
+enum {
+  EXPORT_WAYPOINTS = 0,
+  EXPORT_TRACKS,
+  EXPORT_ROUTES,
+  EXPORT_PASSES,
+};
+
+typedef struct {
+  GPtrArray *items; // Of #VikWaypoint or #VikTrack from one layer
+  guint next;       // Next item to be written
+  guint order;      // Position of the layer, so equal items are written in layer order
+} ExportSource;
+
+typedef struct {
+  gchar *name;
+  gchar *filename;
+  FILE *ff;
+  GpxWritingOptions options;
+  GPtrArray *sources[EXPORT_PASSES]; // Of #ExportSource, one per layer
+  GCompareFunc compare[EXPORT_PASSES]; // NULL to write in layer order
+  guint total;
+  guint written;
+  gint percent;
+  gboolean cancelled;
+} ExportGpxThreadT;
+
+static void export_source_free ( ExportSource *es )
+{
+  g_ptr_array_free ( es->items, TRUE );
+  g_free ( es );
+}
+
+// Compare functions for arrays of pointers
+static gint export_waypoint_compare_name ( gconstpointer a, gconstpointer b )
+{
+  return g_strcmp0 ( (*(VikWaypoint**)a)->name, (*(VikWaypoint**)b)->name );
+}
+
+static gint export_track_compare_name ( gconstpointer a, gconstpointer b )
+{
+  return g_strcmp0 ( (*(VikTrack**)a)->name, (*(VikTrack**)b)->name );
+}
+
+static gint export_track_compare_timestamp ( gconstpointer a, gconstpointer b )
+{
+  return vik_track_compare_timestamp ( *(VikTrack**)a, *(VikTrack**)b );
+}
+
+static gint export_source_compare ( ExportSource *sa, ExportSource *sb, GCompareFunc compare )
+{
+  gint ans = compare ( &sa->items->pdata[sa->next], &sb->items->pdata[sb->next] );
+  if ( ans == 0 )
+    ans = (gint)sa->order - (gint)sb->order;
+  return ans;
+}
+
 /**
- * vik_aggregate_layer_export_gpx_main:
+ * Restore the min heap property from position @ii downwards
+ */
+static void export_heap_sift_down ( ExportSource **heap, guint len, guint ii, GCompareFunc compare )
+{
+  while ( TRUE ) {
+    guint smallest = ii;
+    guint left = 2*ii + 1;
+    guint right = left + 1;
+    if ( left < len && export_source_compare(heap[left], heap[smallest], compare) < 0 )
+      smallest = left;
+    if ( right < len && export_source_compare(heap[right], heap[smallest], compare) < 0 )
+      smallest = right;
+    if ( smallest == ii )
+      break;
+    ExportSource *tmp = heap[ii];
+    heap[ii] = heap[smallest];
+    heap[smallest] = tmp;
+    ii = smallest;
+  }
+}
+
+/**
+ * Returns: TRUE if the export should stop
+ */
+static gboolean export_gpx_write_item ( ExportGpxThreadT *egt, GpxCombinedWriter *gcw, guint pass, gpointer item, gpointer threaddata )
+{
+  if ( pass == EXPORT_WAYPOINTS )
+    a_gpx_write_combined_waypoint ( gcw, VIK_WAYPOINT(item) );
+  else
+    a_gpx_write_combined_track ( gcw, VIK_TRACK(item) );
+  egt->written++;
+
+  // Only report each whole percent, as each report is passed onto the main loop
+  gint percent = (100 * egt->written) / egt->total;
+  if ( percent > egt->percent ) {
+    egt->percent = percent;
+    if ( a_background_thread_progress ( threaddata, (gdouble)egt->written/(gdouble)egt->total ) )
+      return TRUE;
+  }
+  return FALSE;
+}
+
+/**
+ * Write one kind of item from all the layers
  *
- * Exports all visible VikTrwLayers in this aggregate into a GPX file
+ * Each layer's items are sorted on their own and then merged together,
+ *  so the items are written as the merge proceeds rather than collecting everything into one big sorted list
  */
-gboolean vik_aggregate_layer_export_gpx_main ( VikAggregateLayer *val, const gchar *filename )
+static gboolean export_gpx_write_pass ( ExportGpxThreadT *egt, GpxCombinedWriter *gcw, guint pass, gpointer threaddata )
 {
-  gboolean ans = TRUE;
+  GPtrArray *sources = egt->sources[pass];
+  GCompareFunc compare = egt->compare[pass];
+
+  if ( !compare ) {
+    for ( guint ii = 0; ii < sources->len; ii++ ) {
+      ExportSource *es = g_ptr_array_index ( sources, ii );
+      for ( guint jj = 0; jj < es->items->len; jj++ )
+        if ( export_gpx_write_item ( egt, gcw, pass, g_ptr_array_index(es->items, jj), threaddata ) )
+          return TRUE;
+    }
+    return FALSE;
+  }
 
-  FILE *ff = g_fopen ( filename, "w" );
-  if ( ff ) {
-    GList *vtt = aggregate_layer_track_create_list ( VIK_LAYER(val), GINT_TO_POINTER(1) );
-    GList *vtwl = aggregate_layer_waypoint_create_list ( VIK_LAYER(val), GINT_TO_POINTER(1) );
-
-    // Scan list(s) of vtls to find latest version
-    gpx_version_t vers = GPX_V1_0; // default
-    for ( GList *iter = vtt; iter != NULL; iter = iter->next ) {
-      VikTrwLayer *vtl = ((vik_trw_and_track_t*)iter->data)->vtl;
-      if ( vik_trw_layer_get_gpx_version(vtl) == GPX_V1_1 ) {
-        vers = GPX_V1_1;
-        break;
-      }
+  ExportSource **heap = g_new ( ExportSource*, sources->len + 1 );
+  guint len = 0;
+  for ( guint ii = 0; ii < sources->len; ii++ ) {
+    ExportSource *es = g_ptr_array_index ( sources, ii );
+    if ( es->items->len ) {
+      g_ptr_array_sort ( es->items, compare );
+      heap[len++] = es;
     }
-    if ( vers == GPX_V1_0 ) {
-      for ( GList *iter = vtwl; iter != NULL; iter = iter->next ) {
-        VikTrwLayer *vtl = ((vik_trw_waypoint_list_t*)iter->data)->vtl;
-        if ( vik_trw_layer_get_gpx_version(vtl) == GPX_V1_1 ) {
-          vers = GPX_V1_1;
-          break;
-        }
-      }
+  }
+  for ( gint ii = (gint)len/2 - 1; ii >= 0; ii-- )
+    export_heap_sift_down ( heap, len, ii, compare );
+
+  gboolean stop = FALSE;
+  while ( len && !stop ) {
+    ExportSource *es = heap[0];
+    stop = export_gpx_write_item ( egt, gcw, pass, g_ptr_array_index(es->items, es->next), threaddata );
+    es->next++;
+    if ( es->next == es->items->len )
+      heap[0] = heap[--len];
+    export_heap_sift_down ( heap, len, 0, compare );
+  }
+  g_free ( heap );
+
+  return stop;
+}
+
+static gint export_gpx_thread ( ExportGpxThreadT *egt, gpointer threaddata )
+{
+  GpxCombinedWriter *gcw = a_gpx_write_combined_begin ( egt->name, egt->ff, &egt->options, NULL );
+
+  // GPX requires waypoints, then tracks and then routes
+  for ( guint pass = 0; pass < EXPORT_PASSES; pass++ )
+    if ( export_gpx_write_pass ( egt, gcw, pass, threaddata ) ) {
+      // Finish off the file (which will be removed anyway) to free the writer
+      a_gpx_write_combined_end ( gcw );
+      return -1;
     }
 
-    GpxWritingOptions options = { FALSE, FALSE, FALSE, FALSE, vers };
-    a_gpx_write_combined_file ( VIK_LAYER(val)->name, vtt, vtwl, ff, &options, NULL );
-    fclose ( ff );
-    g_list_free ( vtt );
-    g_list_free ( vtwl );
+  a_gpx_write_combined_end ( gcw );
+  return 0;
+}
+
+static void export_gpx_free ( ExportGpxThreadT *egt )
+{
+  if ( fclose ( egt->ff ) != 0 )
+    g_warning ( "%s: failed to write %s", __FUNCTION__, egt->filename );
+  // Don't leave a partial file behind
+  if ( egt->cancelled )
+    (void)g_remove ( egt->filename );
+  for ( guint pass = 0; pass < EXPORT_PASSES; pass++ )
+    g_ptr_array_free ( egt->sources[pass], TRUE );
+  g_free ( egt->name );
+  g_free ( egt->filename );
+  g_free ( egt );
+}
+
+static void export_gpx_cancel ( ExportGpxThreadT *egt )
+{
+  egt->cancelled = TRUE;
+}
+
+/**
+ * Gather the items of all visible VikTrwLayers, ready to write
+ *
+ * Returns: NULL if the file could not be opened
+ */
+static ExportGpxThreadT *export_gpx_new ( VikAggregateLayer *val, const gchar *filename )
+{
+  FILE *ff = g_fopen ( filename, "w" );
+  if ( !ff )
+    return NULL;
+
+  ExportGpxThreadT *egt = g_new0 ( ExportGpxThreadT, 1 );
+  egt->name = g_strdup ( VIK_LAYER(val)->name );
+  egt->filename = g_strdup ( filename );
+  egt->ff = ff;
+  for ( guint pass = 0; pass < EXPORT_PASSES; pass++ )
+    egt->sources[pass] = g_ptr_array_new_with_free_func ( (GDestroyNotify)export_source_free );
+
+  egt->compare[EXPORT_WAYPOINTS] = export_waypoint_compare_name;
+  // Sort method determined by preference
+  if ( a_vik_get_gpx_export_trk_sort() == VIK_GPX_EXPORT_TRK_SORT_TIME )
+    egt->compare[EXPORT_TRACKS] = export_track_compare_timestamp;
+  else if ( a_vik_get_gpx_export_trk_sort() == VIK_GPX_EXPORT_TRK_SORT_ALPHA )
+    egt->compare[EXPORT_TRACKS] = export_track_compare_name;
+  egt->compare[EXPORT_ROUTES] = egt->compare[EXPORT_TRACKS];
+
+  // Only item pointers are gathered here, the sorting is done in the background
+  gpx_version_t vers = GPX_V1_0; // default - use the latest version of any layer
+  GList *layers = NULL;
+  layers = vik_aggregate_layer_get_all_layers_of_type ( val, layers, VIK_LAYER_TRW, FALSE );
+  guint order = 0;
+  for ( GList *layer = layers; layer != NULL; layer = layer->next ) {
+    VikTrwLayer *vtl = VIK_TRW_LAYER(layer->data);
+    GHashTable *tables[EXPORT_PASSES] = { vik_trw_layer_get_waypoints(vtl),
+                                          vik_trw_layer_get_tracks(vtl),
+                                          vik_trw_layer_get_routes(vtl) };
+    gboolean has_items = FALSE;
+    for ( guint pass = 0; pass < EXPORT_PASSES; pass++ ) {
+      guint size = g_hash_table_size ( tables[pass] );
+      if ( !size )
+        continue;
+      ExportSource *es = g_new0 ( ExportSource, 1 );
+      es->items = g_ptr_array_sized_new ( size );
+      es->order = order;
+      GHashTableIter iter;
+      gpointer value;
+      g_hash_table_iter_init ( &iter, tables[pass] );
+      while ( g_hash_table_iter_next ( &iter, NULL, &value ) )
+        g_ptr_array_add ( es->items, value );
+      g_ptr_array_add ( egt->sources[pass], es );
+      egt->total += size;
+      has_items = TRUE;
+    }
+    if ( has_items && vik_trw_layer_get_gpx_version(vtl) == GPX_V1_1 )
+      vers = GPX_V1_1;
+    order++;
   }
-  else
-    ans = FALSE;
+  g_list_free ( layers );
 
-  return ans;
+  GpxWritingOptions options = { FALSE, FALSE, FALSE, FALSE, vers };
+  egt->options = options;
+  return egt;
+}
+
+/**
+ * vik_aggregate_layer_export_gpx_main:
+ *
+ * Exports all visible VikTrwLayers in this aggregate into a GPX file
+ *
+ * The file is written in the background; the returned value only indicates whether the file could be opened
+ */
+gboolean vik_aggregate_layer_export_gpx_main ( VikAggregateLayer *val, const gchar *filename )
+{
+  ExportGpxThreadT *egt = export_gpx_new ( val, filename );
+  if ( !egt )
+    return FALSE;
+
+  if ( !egt->total ) {
+    // Nothing to sort, so just write the empty file
+    export_gpx_thread ( egt, NULL );
+    export_gpx_free ( egt );
+    return TRUE;
+  }
+
+  gchar *msg = g_strdup_printf ( _("Exporting to %s"), filename );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(val),
+                        msg,
+                        (vik_thr_func)export_gpx_thread,
+                        egt,
+                        (vik_thr_free_func)export_gpx_free,
+                        (vik_thr_free_func)export_gpx_cancel,
+                        100 );
+  g_free ( msg );
+
+  return TRUE;
+}
+
+/**
+ * vik_aggregate_layer_export_gpx:
+ *
+ * As vik_aggregate_layer_export_gpx_main() but the file is written in the calling thread,
+ *  for use without a window
+ */
+gboolean vik_aggregate_layer_export_gpx ( VikAggregateLayer *val, const gchar *filename )
+{
+  ExportGpxThreadT *egt = export_gpx_new ( val, filename );
+  if ( !egt )
+    return FALSE;
+  (void)export_gpx_thread ( egt, NULL );
+  export_gpx_free ( egt );
+  return TRUE;
 }
@@ -25,6 +25,7 @@
 #include <glib.h>
 
 #include "viklayer.h"
+#include "trackarea.h"
 
 G_BEGIN_DECLS
 
@@ -65,6 +66,7 @@ gboolean vik_aggregate_layer_load_layers ( VikAggregateLayer *val, FILE *f, gpoi
 gboolean vik_aggregate_layer_is_empty ( VikAggregateLayer *val );
 
 const GList *vik_aggregate_layer_get_children ( VikAggregateLayer *val );
+GList *vik_aggregate_layer_get_drawn_layers ( VikAggregateLayer *val );
 GList *vik_aggregate_layer_get_all_layers_of_type(VikAggregateLayer *val, GList *layers, VikLayerTypeEnum type, gboolean include_invisible);
 guint vik_aggregate_layer_count ( VikAggregateLayer *val );
 
@@ -75,6 +77,16 @@ void vik_aggregate_layer_file_load_complete ( VikAggregateLayer *val );
 void vik_aggregate_layer_export_gpx_setup ( VikAggregateLayer *val );
 gboolean vik_aggregate_layer_export_gpx_main ( VikAggregateLayer *val, const gchar *filename );
 
+// The same operations as from the layer's menu, but done in the calling thread for use without a window (e.g. by viking-batch)
+gint vik_aggregate_layer_apply_dem ( VikAggregateLayer *val, gboolean skip_existing );
+gint vik_aggregate_layer_smooth_elevations ( VikAggregateLayer *val, gboolean flat );
+void vik_aggregate_layer_tac_calculate ( VikAggregateLayer *val );
+void vik_aggregate_layer_tac_get_stats ( VikAggregateLayer *val, guint *zoom, guint *tiles, guint *max_square, guint *contiguous, guint *cluster );
+gboolean vik_aggregate_layer_tac_export_mbtiles ( VikAggregateLayer *val, const gchar *filename, gchar **msg );
+gboolean vik_aggregate_layer_heatmap_export_mbtiles ( VikAggregateLayer *val, const gchar *filename, gchar **msg );
+gboolean vik_aggregate_layer_export_gpx ( VikAggregateLayer *val, const gchar *filename );
+void vik_aggregate_layer_find_tracks_in_area ( VikAggregateLayer *val, const TrackArea *area, const gchar *name, VikTrack *outline );
+
 G_END_DECLS
 
 #endif
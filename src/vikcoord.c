@@ -42,6 +42,47 @@ void vik_coord_convert(VikCoord *coord, VikCoordMode dest_mode)
   }
 }
 
+// Positions are converted in packed blocks of this many
+#define CONVERT_BLOCK 256
+
+/**
+ * vik_coord_convert_array:
+ * @coords: Pointers to the coordinates to convert in place
+ *
+ * As vik_coord_convert() for many coordinates, such as all those of a track
+ */
+void vik_coord_convert_array(VikCoord **coords, guint count, VikCoordMode dest_mode)
+{
+  struct LatLon ll[CONVERT_BLOCK];
+  struct UTM utm[CONVERT_BLOCK];
+  VikCoord *todo[CONVERT_BLOCK];
+  guint ii = 0;
+  while ( ii < count ) {
+    guint nn = 0;
+    for ( ; ii < count && nn < CONVERT_BLOCK; ii++ ) {
+      VikCoord *coord = coords[ii];
+      if ( coord->mode == dest_mode )
+        continue;
+      if ( dest_mode == VIK_COORD_LATLON )
+        utm[nn] = *VIK_UTM(coord);
+      else
+        ll[nn] = *VIK_LATLON(coord);
+      todo[nn++] = coord;
+    }
+    if ( dest_mode == VIK_COORD_LATLON )
+      a_coords_utm_to_latlon_array ( utm, ll, nn );
+    else
+      a_coords_latlon_to_utm_array ( ll, utm, nn );
+    for ( guint jj = 0; jj < nn; jj++ ) {
+      if ( dest_mode == VIK_COORD_LATLON )
+        *VIK_LATLON(todo[jj]) = ll[jj];
+      else
+        *VIK_UTM(todo[jj]) = utm[jj];
+      todo[jj]->mode = dest_mode;
+    }
+  }
+}
+
 void vik_coord_copy_convert(const VikCoord *coord, VikCoordMode dest_mode, VikCoord *dest)
 {
   if ( coord->mode == dest_mode ) {
@@ -73,6 +114,22 @@ gdouble vik_coord_diff(const VikCoord *c1, const VikCoord *c2)
     return a_coords_latlon_diff ( (const struct LatLon *) c1, (const struct LatLon *) c2 );
 }
 
+/**
+ * vik_coord_diff_fast:
+ *
+ * As vik_coord_diff() but using a_coords_latlon_diff_fast(),
+ *  for summing the many short distances between trackpoints
+ */
+gdouble vik_coord_diff_fast ( const VikCoord *c1, const VikCoord *c2 )
+{
+  if ( c1->mode == VIK_COORD_LATLON && c2->mode == VIK_COORD_LATLON )
+    return a_coords_latlon_diff_fast ( (const struct LatLon *) c1, (const struct LatLon *) c2 );
+  struct LatLon a, b;
+  vik_coord_to_latlon ( c1, &a );
+  vik_coord_to_latlon ( c2, &b );
+  return a_coords_latlon_diff_fast ( &a, &b );
+}
+
 void vik_coord_load_from_latlon ( VikCoord *coord, VikCoordMode mode, const struct LatLon *ll )
 {
   if ( mode == VIK_COORD_LATLON )
@@ -44,9 +44,18 @@ typedef struct {
 /* notice we can cast to either UTM or LatLon */
 /* possible more modes to come? xy? we'll leave that as an option */
 
+// Remembered timezone of a position, see vu_get_tz_at_location_cached()
+typedef struct {
+  VikCoord coord;
+  const gchar *tz; // NULL when no timezone is known there
+  gboolean valid;
+} VikCoordTZ;
+
 void vik_coord_convert(VikCoord *coord, VikCoordMode dest_mode);
+void vik_coord_convert_array(VikCoord **coords, guint count, VikCoordMode dest_mode);
 void vik_coord_copy_convert(const VikCoord *coord, VikCoordMode dest_mode, VikCoord *dest);
 gdouble vik_coord_diff(const VikCoord *c1, const VikCoord *c2);
+gdouble vik_coord_diff_fast ( const VikCoord *c1, const VikCoord *c2 );
 
 void vik_coord_load_from_latlon ( VikCoord *coord, VikCoordMode mode, const struct LatLon *ll );
 void vik_coord_load_from_utm ( VikCoord *coord, VikCoordMode mode, const struct UTM *utm );
@@ -126,14 +126,47 @@ VikLayerInterface vik_coord_layer_interface = {
   (VikLayerFuncSelectedViewportMenu)    NULL,
 
   (VikLayerFuncRefresh)                 NULL,
+  (VikLayerFuncGetMemory)               NULL,
 };
 
+typedef enum {
+  GRID_DEGREES = 0,
+  GRID_MINUTES,
+  GRID_SECONDS,
+  GRID_NUM_WEIGHTS
+} GridWeight;
+
+typedef struct {
+  VikCoord start;
+  VikCoord end;
+} GridLineT;
+
+/**
+ * Grid lines computed for an area somewhat larger than the display,
+ *  so they can be reused whilst panning at the same scale
+ */
+typedef struct {
+  gboolean valid;
+  VikCoordMode mode;
+  VikViewportDrawMode drawmode;
+  gdouble xmpp, ympp;
+  gint width, height;
+  gdouble deg_inc;
+  gint zone;
+  gdouble min_x, max_x; // Area covered; in easting and northing, or longitude and latitude
+  gdouble min_y, max_y;
+  GArray *lines[GRID_NUM_WEIGHTS]; // Of GridLineT
+} GridCacheT;
+
 struct _VikCoordLayer {
   VikLayer vl;
   GdkGC *gc;
+  GdkGC *minutes_gc;
+  GdkGC *seconds_gc;
   gdouble deg_inc;
   guint8 line_thickness;
   GdkColor color;
+  GridCacheT grid;
 };
 
 GType vik_coord_layer_get_type ()
@@ -185,7 +218,13 @@ gboolean coord_layer_set_param ( VikCoordLayer *vcl, VikLayerSetParam *vlsp )
         coord_layer_update_gc ( vcl, vlsp->vp );
       break;
     case PARAM_MIN_INC: vcl->deg_inc = vlsp->data.d / 60.0; break;
-    case PARAM_LINE_THICKNESS: if ( vlsp->data.u >= 1 && vlsp->data.u <= 15 ) vcl->line_thickness = vlsp->data.u; break;
+    case PARAM_LINE_THICKNESS:
+      if ( vlsp->data.u >= 1 && vlsp->data.u <= 15 ) {
+        vcl->line_thickness = vlsp->data.u;
+        if ( vcl->gc )
+          coord_layer_update_gc ( vcl, vlsp->vp );
+      }
+      break;
     default: break;
   }
   return TRUE;
@@ -215,199 +254,294 @@ static VikCoordLayer *coord_layer_new ( VikViewport *vvp )
   VikCoordLayer *vcl = VIK_COORD_LAYER ( g_object_new ( VIK_COORD_LAYER_TYPE, NULL ) );
   vik_layer_set_type ( VIK_LAYER(vcl), VIK_LAYER_COORD );
 
-  vik_layer_set_defaults ( VIK_LAYER(vcl), vvp );
-
   vcl->gc = NULL;
+  vcl->minutes_gc = NULL;
+  vcl->seconds_gc = NULL;
+  vcl->grid.valid = FALSE;
+  for ( guint ww = 0; ww < GRID_NUM_WEIGHTS; ww++ )
+    vcl->grid.lines[ww] = g_array_new ( FALSE, FALSE, sizeof(GridLineT) );
+
+  vik_layer_set_defaults ( VIK_LAYER(vcl), vvp );
 
   return vcl;
 }
 
-static void coord_layer_draw ( VikCoordLayer *vcl, VikViewport *vp )
+/**
+ * Extend a range by at least half its size either side, to the next multiple of that half;
+ *  so the area covered only changes once the view has moved some way
+ */
+static void grid_cover ( gdouble lo, gdouble hi, gdouble *cover_lo, gdouble *cover_hi )
 {
-  if ( !vcl->gc ) {
+  gdouble half = (hi - lo) / 2;
+  if ( half <= 0.0 ) {
+    *cover_lo = lo;
+    *cover_hi = hi;
     return;
   }
+  *cover_lo = ( floor ( lo / half ) - 1 ) * half;
+  *cover_hi = ( ceil ( hi / half ) + 1 ) * half;
+}
 
-  if ( vik_viewport_get_coord_mode(vp) != VIK_COORD_UTM ) 
-  {
-    VikCoord left, right, left2, right2;
-    gdouble l, r, i, j;
-    gint x1, y1, x2, y2, smod = 1, mmod = 1;
-    gboolean mins = FALSE, secs = FALSE;
-    GdkGC *dgc = vik_viewport_new_gc_from_color(vp, &(vcl->color), vcl->line_thickness);
-    GdkGC *mgc = vik_viewport_new_gc_from_color(vp, &(vcl->color), MAX(vcl->line_thickness/2, 1));
-    GdkGC *sgc = vik_viewport_new_gc_from_color(vp, &(vcl->color), MAX(vcl->line_thickness/5, 1));
-
-    vik_viewport_screen_to_coord ( vp, 0, 0, &left );
-    vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp), 0, &right );
-    vik_viewport_screen_to_coord ( vp, 0, vik_viewport_get_height(vp), &left2 );
-    vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp), vik_viewport_get_height(vp), &right2 );
-
-#define CLINE(gc, c1, c2) { \
-	  vik_viewport_coord_to_screen(vp, (c1), &x1, &y1);  \
-	  vik_viewport_coord_to_screen(vp, (c2), &x2, &y2);  \
-	  vik_viewport_draw_line (vp, (gc), x1, y1, x2, y2); \
-	}
-
-    l = left.east_west;
-    r = right.east_west;
-    if (60*fabs(l-r) < 4) {
-      secs = TRUE;
-      smod = MIN(6, (int)ceil(3600*fabs(l-r)/30.0));
-    }
-    if (fabs(l-r) < 4) {
-      mins = TRUE;
-      mmod = MIN(6, (int)ceil(60*fabs(l-r)/30.0));
-    }
-    for (i=floor(l*60); i<ceil(r*60); i+=1.0) {
-      if (secs) {
-	for (j=i*60+1; j<(i+1)*60; j+=1.0) {
-	  left.east_west = j/3600.0;
-	  left2.east_west = j/3600.0;
-	  if ((int)j % smod == 0) CLINE(sgc, &left, &left2);
-	}
-      }
-      if (mins) {
-	left.east_west = i/60.0;
-	left2.east_west = i/60.0;
-	if ((int)i % mmod == 0) CLINE(mgc, &left, &left2);
-      }
-      if ((int)i % 60 == 0) {
-	left.east_west = i/60.0;
-	left2.east_west = i/60.0;
-	CLINE(dgc, &left, &left2);
+static void grid_add_line ( GridCacheT *grid, GridWeight weight, const VikCoord *start, const VikCoord *end )
+{
+  GridLineT line = { *start, *end };
+  g_array_append_val ( grid->lines[weight], line );
+}
+
+/**
+ * Lines of latitude and longitude every degree, with minutes and seconds as well when zoomed in
+ */
+static void grid_compute_latlon ( GridCacheT *grid, gdouble l, gdouble r )
+{
+  VikCoord bottom, top, left, right;
+  gdouble i, j;
+  gint smod = 1, mmod = 1;
+  gboolean mins = FALSE, secs = FALSE;
+
+  bottom.mode = top.mode = left.mode = right.mode = VIK_COORD_LATLON;
+  bottom.north_south = grid->min_y;
+  top.north_south = grid->max_y;
+  left.east_west = grid->min_x;
+  right.east_west = grid->max_x;
+
+  // How much detail depends on the width of the display, not the area covered
+  if (60*fabs(l-r) < 4) {
+    secs = TRUE;
+    smod = MIN(6, (int)ceil(3600*fabs(l-r)/30.0));
+  }
+  if (fabs(l-r) < 4) {
+    mins = TRUE;
+    mmod = MIN(6, (int)ceil(60*fabs(l-r)/30.0));
+  }
+
+  for (i=floor(grid->min_x*60); i<ceil(grid->max_x*60); i+=1.0) {
+    if (secs) {
+      for (j=i*60+1; j<(i+1)*60; j+=1.0) {
+        bottom.east_west = top.east_west = j/3600.0;
+        if ((int)j % smod == 0) grid_add_line ( grid, GRID_SECONDS, &bottom, &top );
       }
     }
+    bottom.east_west = top.east_west = i/60.0;
+    if (mins && (int)i % mmod == 0) grid_add_line ( grid, GRID_MINUTES, &bottom, &top );
+    if ((int)i % 60 == 0) grid_add_line ( grid, GRID_DEGREES, &bottom, &top );
+  }
 
-    vik_viewport_screen_to_coord ( vp, 0, 0, &left );
-    l = left2.north_south;
-    r = left.north_south;
-    for (i=floor(l*60); i<ceil(r*60); i+=1.0) {
-      if (secs) {
-	for (j=i*60+1; j<(i+1)*60; j+=1.0) {
-	  left.north_south = j/3600.0;
-	  right.north_south = j/3600.0;
-	  if ((int)j % smod == 0) CLINE(sgc, &left, &right);
-	}
-      }
-      if (mins) {
-	left.north_south = i/60.0;
-	right.north_south = i/60.0;
-	if ((int)i % mmod == 0) CLINE(mgc, &left, &right);
-      }
-      if ((int)i % 60 == 0) {
-	left.north_south = i/60.0;
-	right.north_south = i/60.0;
-	CLINE(dgc, &left, &right);
+  for (i=floor(grid->min_y*60); i<ceil(grid->max_y*60); i+=1.0) {
+    if (secs) {
+      for (j=i*60+1; j<(i+1)*60; j+=1.0) {
+        left.north_south = right.north_south = j/3600.0;
+        if ((int)j % smod == 0) grid_add_line ( grid, GRID_SECONDS, &left, &right );
       }
     }
-#undef CLINE
-    g_object_unref(dgc);
-    g_object_unref(sgc);
-    g_object_unref(mgc);
-    return;
+    left.north_south = right.north_south = i/60.0;
+    if (mins && (int)i % mmod == 0) grid_add_line ( grid, GRID_MINUTES, &left, &right );
+    if ((int)i % 60 == 0) grid_add_line ( grid, GRID_DEGREES, &left, &right );
   }
+}
 
-  if ( vik_viewport_get_coord_mode(vp) == VIK_COORD_UTM ) 
-  {
-    const struct UTM *center = (const struct UTM *)vik_viewport_get_center ( vp );
-    gdouble xmpp = vik_viewport_get_xmpp ( vp ), ympp = vik_viewport_get_ympp ( vp );
-    guint16 width = vik_viewport_get_width ( vp ), height = vik_viewport_get_height ( vp );
-    struct LatLon ll, ll2, min, max;
-    double lon;
-    int x1, x2;
-    struct UTM utm;
+/**
+ * Lines of latitude and longitude every deg_inc, as straight lines in the UTM zone of the display
+ */
+static void grid_compute_utm ( GridCacheT *grid, const struct UTM *center )
+{
+  struct LatLon ll, ll2, min, max;
+  double lon;
+  struct UTM utm;
+  VikCoord start, end;
 
-    utm = *center;
-    utm.northing = center->northing - ( ympp * height / 2 );
+  start.mode = end.mode = VIK_COORD_UTM;
+  start.utm_zone = end.utm_zone = center->zone;
+  start.utm_letter = end.utm_letter = center->letter;
 
-    a_coords_utm_to_latlon ( &utm, &ll );
+  {
+    /* find corner coords in lat/lon.
+      start at whichever is less: top or bottom left lon. goto whichever more: top or bottom right lon
+    */
+    struct LatLon topleft, topright, bottomleft, bottomright;
+    struct UTM temp_utm;
+    temp_utm = *center;
+    temp_utm.easting = grid->min_x;
+    temp_utm.northing = grid->max_y;
+    a_coords_utm_to_latlon ( &temp_utm, &topleft );
+    temp_utm.easting = grid->max_x;
+    a_coords_utm_to_latlon ( &temp_utm, &topright );
+    temp_utm.northing = grid->min_y;
+    a_coords_utm_to_latlon ( &temp_utm, &bottomright );
+    temp_utm.easting = grid->min_x;
+    a_coords_utm_to_latlon ( &temp_utm, &bottomleft );
+    min.lon = (topleft.lon < bottomleft.lon) ? topleft.lon : bottomleft.lon;
+    max.lon = (topright.lon > bottomright.lon) ? topright.lon : bottomright.lon;
+    min.lat = (bottomleft.lat < bottomright.lat) ? bottomleft.lat : bottomright.lat;
+    max.lat = (topleft.lat > topright.lat) ? topleft.lat : topright.lat;
+  }
 
-    utm.northing = center->northing + ( ympp * height / 2 );
+  /* Can zoom out more than whole world and so the above can give invalid positions */
+  /* Restrict values properly so drawing doesn't go into a near 'infinite' loop */
+  if ( min.lon < -180.0 )
+    min.lon = -180.0;
+  if ( max.lon > 180.0 )
+    max.lon = 180.0;
+  if ( min.lat < -90.0 )
+    min.lat = -90.0;
+  if ( max.lat > 90.0 )
+    max.lat = 90.0;
+
+  utm = *center;
+  utm.northing = grid->min_y;
+  a_coords_utm_to_latlon ( &utm, &ll );
+  utm.northing = grid->max_y;
+  a_coords_utm_to_latlon ( &utm, &ll2 );
+
+  lon = ((double) ((long) ((min.lon)/ grid->deg_inc))) * grid->deg_inc;
+  ll.lon = ll2.lon = lon;
+  start.north_south = grid->min_y;
+  end.north_south = grid->max_y;
+
+  for (; ll.lon <= max.lon; ll.lon+=grid->deg_inc, ll2.lon+=grid->deg_inc )
+  {
+    a_coords_latlon_to_utm ( &ll, &utm );
+    start.east_west = utm.easting;
+    a_coords_latlon_to_utm ( &ll2, &utm );
+    end.east_west = utm.easting;
+    grid_add_line ( grid, GRID_DEGREES, &start, &end );
+  }
 
-    a_coords_utm_to_latlon ( &utm, &ll2 );
+  utm = *center;
+  utm.easting = grid->min_x;
+  a_coords_utm_to_latlon ( &utm, &ll );
+  utm.easting = grid->max_x;
+  a_coords_utm_to_latlon ( &utm, &ll2 );
 
-    {
-      /* find corner coords in lat/lon.
-        start at whichever is less: top or bottom left lon. goto whichever more: top or bottom right lon
-      */
-      struct LatLon topleft, topright, bottomleft, bottomright;
-      struct UTM temp_utm;
-      temp_utm = *center;
-      temp_utm.easting -= (width/2)*xmpp;
-      temp_utm.northing += (height/2)*ympp;
-      a_coords_utm_to_latlon ( &temp_utm, &topleft );
-      temp_utm.easting += (width*xmpp);
-      a_coords_utm_to_latlon ( &temp_utm, &topright );
-      temp_utm.northing -= (height*ympp);
-      a_coords_utm_to_latlon ( &temp_utm, &bottomright );
-      temp_utm.easting -= (width*xmpp);
-      a_coords_utm_to_latlon ( &temp_utm, &bottomleft );
-      min.lon = (topleft.lon < bottomleft.lon) ? topleft.lon : bottomleft.lon;
-      max.lon = (topright.lon > bottomright.lon) ? topright.lon : bottomright.lon;
-      min.lat = (bottomleft.lat < bottomright.lat) ? bottomleft.lat : bottomright.lat;
-      max.lat = (topleft.lat > topright.lat) ? topleft.lat : topright.lat;
-    }
+  /* really lat, just reusing a variable */
+  lon = ((double) ((long) ((min.lat)/ grid->deg_inc))) * grid->deg_inc;
+  ll.lat = ll2.lat = lon;
+  start.east_west = grid->min_x;
+  end.east_west = grid->max_x;
 
-    /* Can zoom out more than whole world and so the above can give invalid positions */
-    /* Restrict values properly so drawing doesn't go into a near 'infinite' loop */
-    if ( min.lon < -180.0 )
-      min.lon = -180.0;
-    if ( max.lon > 180.0 )
-      max.lon = 180.0;
-    if ( min.lat < -90.0 )
-      min.lat = -90.0;
-    if ( max.lat > 90.0 )
-      max.lat = 90.0;
-
-    lon = ((double) ((long) ((min.lon)/ vcl->deg_inc))) * vcl->deg_inc;
-    ll.lon = ll2.lon = lon;
-
-    for (; ll.lon <= max.lon; ll.lon+=vcl->deg_inc, ll2.lon+=vcl->deg_inc )
-    {
-      a_coords_latlon_to_utm ( &ll, &utm );
-      x1 = ( (utm.easting - center->easting) / xmpp ) + (width / 2);
-      a_coords_latlon_to_utm ( &ll2, &utm );
-      x2 = ( (utm.easting - center->easting) / xmpp ) + (width / 2);
-      vik_viewport_draw_line (vp, vcl->gc, x1, height, x2, 0);
-    }
+  for (; ll.lat <= max.lat ; ll.lat+=grid->deg_inc, ll2.lat+=grid->deg_inc )
+  {
+    a_coords_latlon_to_utm ( &ll, &utm );
+    start.north_south = utm.northing;
+    a_coords_latlon_to_utm ( &ll2, &utm );
+    end.north_south = utm.northing;
+    grid_add_line ( grid, GRID_DEGREES, &start, &end );
+  }
+}
 
-    utm = *center;
-    utm.easting = center->easting - ( xmpp * width / 2 );
+/**
+ * The grid lines for the display, reusing those from the last draw when they cover it
+ */
+static GridCacheT *coord_layer_get_grid ( VikCoordLayer *vcl, VikViewport *vp )
+{
+  GridCacheT *grid = &vcl->grid;
+  VikCoordMode mode = vik_viewport_get_coord_mode ( vp );
+  VikViewportDrawMode drawmode = vik_viewport_get_drawmode ( vp );
+  gdouble xmpp = vik_viewport_get_xmpp ( vp ), ympp = vik_viewport_get_ympp ( vp );
+  gint width = vik_viewport_get_width ( vp ), height = vik_viewport_get_height ( vp );
+  gint zone = 0;
+  gdouble l, r, b, t;
+
+  if ( mode == VIK_COORD_UTM ) {
+    const struct UTM *center = (const struct UTM *)vik_viewport_get_center ( vp );
+    zone = center->zone;
+    l = center->easting - ( xmpp * width / 2 );
+    r = center->easting + ( xmpp * width / 2 );
+    b = center->northing - ( ympp * height / 2 );
+    t = center->northing + ( ympp * height / 2 );
+  }
+  else {
+    VikCoord topleft, topright, bottomleft;
+    vik_viewport_screen_to_coord ( vp, 0, 0, &topleft );
+    vik_viewport_screen_to_coord ( vp, width, 0, &topright );
+    vik_viewport_screen_to_coord ( vp, 0, height, &bottomleft );
+    l = topleft.east_west;
+    r = topright.east_west;
+    b = bottomleft.north_south;
+    t = topleft.north_south;
+  }
 
-    a_coords_utm_to_latlon ( &utm, &ll );
+  if ( grid->valid && grid->mode == mode && grid->drawmode == drawmode &&
+       grid->xmpp == xmpp && grid->ympp == ympp && grid->width == width && grid->height == height &&
+       grid->deg_inc == vcl->deg_inc && grid->zone == zone &&
+       l >= grid->min_x && r <= grid->max_x && b >= grid->min_y && t <= grid->max_y )
+    return grid;
+
+  for ( guint ww = 0; ww < GRID_NUM_WEIGHTS; ww++ )
+    g_array_set_size ( grid->lines[ww], 0 );
+  grid->mode = mode;
+  grid->drawmode = drawmode;
+  grid->xmpp = xmpp;
+  grid->ympp = ympp;
+  grid->width = width;
+  grid->height = height;
+  grid->deg_inc = vcl->deg_inc;
+  grid->zone = zone;
+  grid_cover ( l, r, &grid->min_x, &grid->max_x );
+  grid_cover ( b, t, &grid->min_y, &grid->max_y );
+
+  if ( mode == VIK_COORD_UTM )
+    grid_compute_utm ( grid, (const struct UTM *)vik_viewport_get_center ( vp ) );
+  else {
+    grid->min_y = MAX ( grid->min_y, -90.0 );
+    grid->max_y = MIN ( grid->max_y, 90.0 );
+    grid_compute_latlon ( grid, l, r );
+  }
+  grid->valid = TRUE;
+  return grid;
+}
 
-    utm.easting = center->easting + ( xmpp * width / 2 );
+static void grid_draw_lines ( VikViewport *vp, GdkGC *gc, GArray *lines )
+{
+  if ( !lines->len )
+    return;
+  GdkSegment *segs = g_malloc ( lines->len * sizeof(GdkSegment) );
+  for ( guint ii = 0; ii < lines->len; ii++ ) {
+    GridLineT *line = &g_array_index ( lines, GridLineT, ii );
+    vik_viewport_coord_to_screen ( vp, &line->start, &segs[ii].x1, &segs[ii].y1 );
+    vik_viewport_coord_to_screen ( vp, &line->end, &segs[ii].x2, &segs[ii].y2 );
+  }
+  vik_viewport_draw_segments ( vp, gc, segs, lines->len );
+  g_free ( segs );
+}
 
-    a_coords_utm_to_latlon ( &utm, &ll2 );
+static void coord_layer_draw ( VikCoordLayer *vcl, VikViewport *vp )
+{
+  if ( !vcl->gc ) {
+    return;
+  }
 
-    /* really lat, just reusing a variable */
-    lon = ((double) ((long) ((min.lat)/ vcl->deg_inc))) * vcl->deg_inc;
-    ll.lat = ll2.lat = lon;
+  GridCacheT *grid = coord_layer_get_grid ( vcl, vp );
 
-    for (; ll.lat <= max.lat ; ll.lat+=vcl->deg_inc, ll2.lat+=vcl->deg_inc )
-    {
-      a_coords_latlon_to_utm ( &ll, &utm );
-      x1 = (height / 2) - ( (utm.northing - center->northing) / ympp );
-      a_coords_latlon_to_utm ( &ll2, &utm );
-      x2 = (height / 2) - ( (utm.northing - center->northing) / ympp );
-      vik_viewport_draw_line (vp, vcl->gc, width, x2, 0, x1);
-    }
-  }
+  // Finest first, so the main lines are on top
+  grid_draw_lines ( vp, vcl->seconds_gc, grid->lines[GRID_SECONDS] );
+  grid_draw_lines ( vp, vcl->minutes_gc, grid->lines[GRID_MINUTES] );
+  grid_draw_lines ( vp, vcl->gc, grid->lines[GRID_DEGREES] );
 }
 
 static void coord_layer_free ( VikCoordLayer *vcl )
 {
   if ( vcl->gc != NULL )
     g_object_unref ( G_OBJECT(vcl->gc) );
+  if ( vcl->minutes_gc != NULL )
+    g_object_unref ( G_OBJECT(vcl->minutes_gc) );
+  if ( vcl->seconds_gc != NULL )
+    g_object_unref ( G_OBJECT(vcl->seconds_gc) );
+  for ( guint ww = 0; ww < GRID_NUM_WEIGHTS; ww++ )
+    g_array_free ( vcl->grid.lines[ww], TRUE );
 }
 
 static void coord_layer_update_gc ( VikCoordLayer *vcl, VikViewport *vp )
 {
   if ( vcl->gc )
     g_object_unref ( G_OBJECT(vcl->gc) );
+  if ( vcl->minutes_gc )
+    g_object_unref ( G_OBJECT(vcl->minutes_gc) );
+  if ( vcl->seconds_gc )
+    g_object_unref ( G_OBJECT(vcl->seconds_gc) );
 
   vcl->gc = vik_viewport_new_gc_from_color ( vp, &(vcl->color), vcl->line_thickness );
+  vcl->minutes_gc = vik_viewport_new_gc_from_color ( vp, &(vcl->color), MAX(vcl->line_thickness/2, 1) );
+  vcl->seconds_gc = vik_viewport_new_gc_from_color ( vp, &(vcl->color), MAX(vcl->line_thickness/5, 1) );
 }
 
 static VikCoordLayer *coord_layer_create ( VikViewport *vp )
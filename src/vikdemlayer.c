@@ -37,6 +37,10 @@
 #include "dem.h"
 #include "dems.h"
 #include "bbox.h"
+#include "mapcache.h"
+#include "existcache.h"
+#include "map_ids.h"
+#include "contours.h"
 
 #define DEM_FIXED_NAME "DEM"
 #define MAPS_CACHE_DIR maps_layer_default_dir()
@@ -52,11 +56,17 @@ static gchar *base_url = NULL;
 
 #define UNUSED_LINE_THICKNESS 3
 
+// Size in pixels of the (cached) images a lat/lon DEM is drawn from, one pixel per drawn sample
+#define DEM_TILE_SIZE 256
+// Rows of a tile that are positioned together on the display
+#define DEM_TILE_STRIP 8
+
 static VikDEMLayer *dem_layer_new ( VikViewport *vvp );
 static void dem_layer_draw ( VikDEMLayer *vdl, VikViewport *vp );
 static void dem_layer_free ( VikDEMLayer *vdl );
 static VikDEMLayer *dem_layer_create ( VikViewport *vp );
 static const gchar* dem_layer_tooltip( VikDEMLayer *vdl );
+static void dem_layer_get_memory ( VikDEMLayer *vdl, VikLayerMemory *mem );
 static void dem_layer_marshall( VikDEMLayer *vdl, guint8 **data, guint *len );
 static VikDEMLayer *dem_layer_unmarshall( guint8 *data, guint len, VikViewport *vvp );
 static gboolean dem_layer_set_param ( VikDEMLayer *vdl, VikLayerSetParam *vlsp );
@@ -65,6 +75,9 @@ static void dem_layer_change_param ( GtkWidget *widget, ui_change_values values
 static void dem_layer_post_read ( VikDEMLayer *vdl, VikViewport *vp, gboolean from_file );
 static void srtm_draw_existence ( VikViewport *vp );
 static void dem_layer_apply_colors ( VikDEMLayer *vdl );
+static gboolean dem_sample_color ( VikDEMLayer *vdl, VikDEM *dem, guint x, guint y, guint skip_factor, GdkColor *gcolor );
+typedef struct _DemContourTile DemContourTile;
+static void dem_contour_tile_free ( DemContourTile *dct );
 
 #ifdef VIK_CONFIG_DEM24K
 static void dem24k_draw_existence ( VikViewport *vp );
@@ -75,6 +88,7 @@ static VikLayerParamScale param_scales[] = {
   { -100, 30000, 10, 1 },
   { 0, 30000, 10, 1 },
   { 0, 255, 3, 0 }, // alpha
+  { 1, 5000, 10, 0 }, // contour interval
 };
 
 static gchar *params_source[] = {
@@ -88,6 +102,9 @@ static gchar *params_source[] = {
 static gchar *params_type[] = {
 	N_("Absolute height"),
 	N_("Height gradient"),
+	N_("Hillshade"),
+	N_("Slope"),
+	N_("Contours"),
 	NULL
 };
 
@@ -99,6 +116,9 @@ enum { DEM_SOURCE_SRTM,
 
 enum { DEM_TYPE_HEIGHT = 0,
        DEM_TYPE_GRADIENT,
+       DEM_TYPE_HILLSHADE,
+       DEM_TYPE_SLOPE,
+       DEM_TYPE_CONTOURS,
        DEM_TYPE_NONE,
 };
 
@@ -126,6 +146,10 @@ static VikLayerParamData min_elev_default ( void ) { return VIK_LPD_DOUBLE ( 0.0
 static VikLayerParamData max_elev_default ( void ) { return VIK_LPD_DOUBLE ( 1000.0 ); }
 static VikLayerParamData color_scheme_default ( void ) { return VIK_LPD_UINT ( DEM_CS_DEFAULT ); }
 static VikLayerParamData alpha_default ( void ) { return VIK_LPD_UINT ( 255 ); }
+static VikLayerParamData contour_interval_default ( void ) { return VIK_LPD_DOUBLE ( 50.0 ); }
+static VikLayerParamData contour_color_default ( void ) {
+  VikLayerParamData data; gdk_color_parse ( "#A0522D", &data.c ); return data;
+}
 
 static void reset_cb ( GtkWidget *widget, gpointer ptr )
 {
@@ -148,6 +172,9 @@ static VikLayerParam dem_layer_params[] = {
   { VIK_LAYER_DEM, "max_elev", VIK_LAYER_PARAM_DOUBLE, VIK_LAYER_GROUP_NONE, N_("Max Elev:"), VIK_LAYER_WIDGET_SPINBUTTON, param_scales + 0, NULL, NULL, max_elev_default, NULL, NULL },
   { VIK_LAYER_DEM, "alpha", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Alpha:"), VIK_LAYER_WIDGET_HSCALE, param_scales+2, NULL,
     N_("Control the Alpha value for transparency effects"), alpha_default, NULL, NULL },
+  { VIK_LAYER_DEM, "contour_interval", VIK_LAYER_PARAM_DOUBLE, VIK_LAYER_GROUP_NONE, N_("Contour Interval:"), VIK_LAYER_WIDGET_SPINBUTTON, param_scales + 3, NULL,
+    N_("The height between contour lines, with every fifth one drawn thicker and labelled"), contour_interval_default, NULL, NULL },
+  { VIK_LAYER_DEM, "contour_color", VIK_LAYER_PARAM_COLOR, VIK_LAYER_GROUP_NONE, N_("Contour Color:"), VIK_LAYER_WIDGET_COLOR, NULL, NULL, NULL, contour_color_default, NULL, NULL },
   { VIK_LAYER_DEM, "reset", VIK_LAYER_PARAM_PTR_DEFAULT, VIK_LAYER_GROUP_NONE, NULL,
     VIK_LAYER_WIDGET_BUTTON, N_("Reset to Defaults"), NULL, NULL, reset_default, NULL, NULL },
 };
@@ -164,6 +191,8 @@ enum {
       PARAM_MIN_ELEV,
       PARAM_MAX_ELEV,
       PARAM_ALPHA,
+      PARAM_CONTOUR_INTERVAL,
+      PARAM_CONTOUR_COLOR,
       PARAM_RESET,
       NUM_PARAMS
 };
@@ -287,6 +316,7 @@ VikLayerInterface vik_dem_layer_interface = {
   (VikLayerFuncSelectedViewportMenu)    NULL,
 
   (VikLayerFuncRefresh)                 NULL,
+  (VikLayerFuncGetMemory)               dem_layer_get_memory,
 };
 
 struct _VikDEMLayer {
@@ -301,12 +331,21 @@ struct _VikDEMLayer {
   guint source;
   guint type;
   guint alpha;
+  gdouble contour_interval;
+  GdkColor contour_color;
 
   GdkColor *height_colors;
   GdkColor *gradient_colors;
 
   guchar *pixels;
 
+  // Contour lines of tiles, by the DEM file, interval, skip factor and tile position
+  GHashTable *contour_tiles;
+  GQueue contour_order;  // Oldest first
+  gsize contour_size;
+  // A layout for each label text
+  GHashTable *contour_labels;
+
   // right click menu only stuff - similar to mapslayer
   GtkMenu *right_click_menu;
 };
@@ -352,6 +391,14 @@ static const gchar* dem_layer_tooltip( VikDEMLayer *vdl )
   return tmp_buf;
 }
 
+static void dem_layer_get_memory ( VikDEMLayer *vdl, VikLayerMemory *mem )
+{
+  // DEMs are shared between layers using the same files, so this is counted by each of them
+  for ( GList *iter = vdl->files; iter; iter = iter->next )
+    mem->bytes[VIK_LAYER_MEMORY_DEM] += a_dems_get_size ( (const gchar *)iter->data );
+  mem->bytes[VIK_LAYER_MEMORY_CACHES] += vdl->contour_size;
+}
+
 static void dem_layer_marshall( VikDEMLayer *vdl, guint8 **data, guint *len )
 {
   vik_layer_marshall_params ( VIK_LAYER(vdl), data, len );
@@ -472,6 +519,15 @@ gboolean dem_layer_set_param ( VikDEMLayer *vdl, VikLayerSetParam *vlsp )
       else
         vdl->max_elev = vlsp->data.d;
       break;
+    case PARAM_CONTOUR_INTERVAL:
+      /* Convert to store internally
+         NB file operation always in internal units (metres) */
+      if (!vlsp->is_file_operation && a_vik_get_units_height () == VIK_UNITS_HEIGHT_FEET )
+        vdl->contour_interval = VIK_FEET_TO_METERS(vlsp->data.d);
+      else
+        vdl->contour_interval = vlsp->data.d;
+      break;
+    case PARAM_CONTOUR_COLOR: vdl->contour_color = vlsp->data.c; break;
     case PARAM_ALPHA:
       if ( vlsp->data.u <= 255 ) vdl->alpha = vlsp->data.u;
       // Note since dem_layer_set_param() will be called for every parameter,
@@ -567,6 +623,15 @@ static VikLayerParamData dem_layer_get_param ( VikDEMLayer *vdl, guint16 id, gbo
         rv.d = vdl->max_elev;
       break;
     case PARAM_ALPHA: rv.u = vdl->alpha; break;
+    case PARAM_CONTOUR_INTERVAL:
+      /* Convert for display in desired units
+         NB file operation always in internal units (metres) */
+      if (!is_file_operation && a_vik_get_units_height () == VIK_UNITS_HEIGHT_FEET )
+        rv.d = VIK_METERS_TO_FEET(vdl->contour_interval);
+      else
+        rv.d = vdl->contour_interval;
+      break;
+    case PARAM_CONTOUR_COLOR: rv.c = vdl->contour_color; break;
     default: break;
   }
   return rv;
@@ -595,6 +660,18 @@ static void dem_layer_change_param ( GtkWidget *widget, ui_change_values values
 
     break;
   }
+    // Contour widgets only apply to contours
+  case PARAM_TYPE: {
+    VikLayerParamData vlpd = a_uibuilder_widget_get_value ( widget, values[UI_CHG_PARAM] );
+    gboolean sensitive = (vlpd.u == DEM_TYPE_CONTOURS);
+    GtkWidget **ww1 = values[UI_CHG_WIDGETS];
+    GtkWidget **ww2 = values[UI_CHG_LABELS];
+    for ( guint id = PARAM_CONTOUR_INTERVAL; id <= PARAM_CONTOUR_COLOR; id++ ) {
+      if ( ww1[id] ) gtk_widget_set_sensitive ( ww1[id], sensitive );
+      if ( ww2[id] ) gtk_widget_set_sensitive ( ww2[id], sensitive );
+    }
+    break;
+  }
 
   default: break;
   }
@@ -654,12 +731,17 @@ static VikDEMLayer *dem_layer_new ( VikViewport *vvp )
   VikDEMLayer *vdl = VIK_DEM_LAYER ( g_object_new ( VIK_DEM_LAYER_TYPE, NULL ) );
 
   vik_layer_set_type ( VIK_LAYER(vdl), VIK_LAYER_DEM );
+  a_mapcache_add_layer ( vdl );
 
   vdl->files = NULL;
 
   vdl->height_colors = g_malloc0 ( sizeof(GdkColor) * DEM_N_HEIGHT_COLORS );
   vdl->gradient_colors = g_malloc0 ( sizeof(GdkColor) * DEM_N_GRADIENT_COLORS );
 
+  vdl->contour_tiles = g_hash_table_new_full ( g_str_hash, g_str_equal, NULL, (GDestroyNotify)dem_contour_tile_free );
+  g_queue_init ( &vdl->contour_order );
+  vdl->contour_labels = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, g_object_unref );
+
   vik_layer_set_defaults ( VIK_LAYER(vdl), vvp );
 
   return vdl;
@@ -787,20 +869,20 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
       // NOTE: ( counter.lon <= end_lon + ESCALE_DEG*SKIP_FACTOR ) is neccessary so in high zoom modes,
       // the leftmost column does also get drawn, if the center point is out of viewport.
       if ( x < dem->n_columns ) {
-        column = g_ptr_array_index ( dem->columns, x );
+        column = vik_dem_get_column ( dem, x );
         // get previous and next column. catch out-of-bound.
 	gint32 new_x = x;
 	new_x -= gradient_skip_factor;
         if(new_x < 0)
-          prevcolumn = g_ptr_array_index ( dem->columns, 0);
+          prevcolumn = vik_dem_get_column ( dem, 0);
         else
-          prevcolumn = g_ptr_array_index ( dem->columns, new_x);
+          prevcolumn = vik_dem_get_column ( dem, new_x);
 	new_x = x;
 	new_x += gradient_skip_factor;
         if(new_x >= dem->n_columns)
-          nextcolumn = g_ptr_array_index ( dem->columns, dem->n_columns-1);
+          nextcolumn = vik_dem_get_column ( dem, dem->n_columns-1);
         else
-          nextcolumn = g_ptr_array_index ( dem->columns, new_x);
+          nextcolumn = vik_dem_get_column ( dem, new_x);
 
         for ( y=start_y, counter.lat = start_lat; counter.lat <= end_lat; counter.lat += nscale_deg * skip_factor, y += skip_factor ) {
           if ( y > column->n_points )
@@ -913,6 +995,14 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
                 }
                 pixels_set_area ( vdl->pixels, gcolor, vdl->alpha, width, box_x, box_y, box_width, box_height );
               }
+              else {
+                GdkColor gcolor;
+                if ( !dem_sample_color ( vdl, dem, x, y, skip_factor, &gcolor ) )
+                  continue;
+                if ( ((box_x + box_width) > width) )
+                  box_width = width - box_x;
+                pixels_set_area ( vdl->pixels, gcolor, vdl->alpha, width, box_x, box_y, box_width, box_height );
+              }
             }
           }
         } /* for y= */
@@ -975,11 +1065,23 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
 
     counter.zone = dem->utm_zone;
     counter.letter = dem->utm_letter;
+    GArray *coords = g_array_new ( FALSE, FALSE, sizeof(VikCoord) );
+    GArray *points = g_array_new ( FALSE, FALSE, sizeof(GdkPoint) );
 
     for ( x=start_x, counter.easting = start_eas; counter.easting <= end_eas; counter.easting += dem->east_scale * skip_factor, x += skip_factor ) {
       if ( x >= 0 && x < dem->n_columns ) {
-        column = g_ptr_array_index ( dem->columns, x );
-        for ( y=start_y, counter.northing = start_nor; counter.northing <= end_nor; counter.northing += dem->north_scale * skip_factor, y += skip_factor ) {
+        column = vik_dem_get_column ( dem, x );
+        // Project the whole column in one go
+        g_array_set_size ( coords, 0 );
+        for ( counter.northing = start_nor; counter.northing <= end_nor; counter.northing += dem->north_scale * skip_factor ) {
+          vik_coord_load_from_utm(&tmp, vik_viewport_get_coord_mode(vp), &counter);
+          g_array_append_val ( coords, tmp );
+        }
+        g_array_set_size ( points, coords->len );
+        vik_viewport_coords_to_screen ( vp, (VikCoord*)coords->data, coords->len, (GdkPoint*)points->data );
+
+        for ( guint ii = 0; ii < coords->len; ii++ ) {
+          y = start_y + ii * skip_factor;
           if ( y > column->n_points )
             continue;
           elev = column->points[y];
@@ -989,9 +1091,8 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
             elev=vdl->max_elev;
 
           {
-            gint a, b;
-            vik_coord_load_from_utm(&tmp, vik_viewport_get_coord_mode(vp), &counter);
-            vik_viewport_coord_to_screen(vp, &tmp, &a, &b);
+            gint a = g_array_index ( points, GdkPoint, ii ).x;
+            gint b = g_array_index ( points, GdkPoint, ii ).y;
             // Check a & b are in bounds:
             if ( a < 0 || b < 0 || (a > width) || (b > height) )
               continue;
@@ -1009,11 +1110,14 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
         } /* for y= */
       }
     } /* for x= */
+    g_array_free ( coords, TRUE );
+    g_array_free ( points, TRUE );
   }
 }
 
 /* return the continent for the specified lat, lon */
 /* TODO */
+/* NB Also used from background threads, hence the table is built only once */
 static const gchar *srtm_continent_dir ( gint lat, gint lon )
 {
   extern const char *_srtm_continent_data[];
@@ -1021,19 +1125,20 @@ static const gchar *srtm_continent_dir ( gint lat, gint lon )
   const gchar *continent;
   gchar name[16];
 
-  if (!srtm_continent) {
+  if (g_once_init_enter(&srtm_continent)) {
     const gchar **s;
 
-    srtm_continent = g_hash_table_new(g_str_hash, g_str_equal);
+    GHashTable *table = g_hash_table_new(g_str_hash, g_str_equal);
     s = _srtm_continent_data;
     while (*s != (gchar *)-1) {
       continent = *s++;
       while (*s) {
-        g_hash_table_insert(srtm_continent, (gpointer) *s, (gpointer) continent);
+        g_hash_table_insert(table, (gpointer) *s, (gpointer) continent);
         s++;
       }
       s++;
     }
+    g_once_init_leave(&srtm_continent, table);
   }
   g_snprintf(name, sizeof(name), "%c%02d%c%03d",
                   (lat >= 0) ? 'N' : 'S', ABS(lat),
@@ -1042,6 +1147,453 @@ static const gchar *srtm_continent_dir ( gint lat, gint lon )
   return(g_hash_table_lookup(srtm_continent, name));
 }
 
+/**
+ * Highest number of points in any column
+ */
+static guint dem_max_rows ( VikDEM *dem )
+{
+  if ( dem->grid )
+    return dem->grid_rows;
+  guint rows = 0;
+  for ( guint x = 0; x < dem->n_columns; x++ )
+    rows = MAX ( rows, ((VikDEMColumn*)g_ptr_array_index(dem->columns, x))->n_points );
+  return rows;
+}
+
+// Ground distance of one arc second along a meridian
+#define DEM_METRES_PER_ARCSEC 30.87
+// Slopes at or above this angle (in degrees) get the last gradient colour
+#define DEM_SLOPE_MAX 45.0
+
+/**
+ * Slope (in degrees) and the light reflected from a sun in the north west at 45 degrees,
+ *  from Horn's (Sobel) 3x3 kernel over the samples either side of this one
+ */
+static void dem_sample_shading ( VikDEM *dem, guint x, guint y, guint skip_factor, gint16 elev, gdouble *slope, gdouble *shade )
+{
+  const guint n_points = vik_dem_get_column(dem, x)->n_points;
+  const guint xs[3] = { (x < skip_factor) ? 0 : x - skip_factor, x, MIN ( x + skip_factor, dem->n_columns - 1 ) };
+  const guint ys[3] = { (y < skip_factor) ? 0 : y - skip_factor, y, MIN ( y + skip_factor, n_points - 1 ) };
+
+  // z[column][row] with row 0 being the most southerly
+  gdouble z[3][3];
+  for ( guint i = 0; i < 3; i++ )
+    for ( guint j = 0; j < 3; j++ ) {
+      gint16 neighbour = vik_dem_get_xy ( dem, xs[i], ys[j] );
+      z[i][j] = (neighbour == VIK_DEM_INVALID_ELEVATION) ? elev : neighbour;
+    }
+
+  const gdouble lat = (dem->min_north + y * dem->north_scale) / 3600.0;
+  const gdouble east_metres = (xs[2] - xs[0]) * dem->east_scale * DEM_METRES_PER_ARCSEC * cos ( DEG2RAD(lat) );
+  const gdouble north_metres = (ys[2] - ys[0]) * dem->north_scale * DEM_METRES_PER_ARCSEC;
+
+  gdouble dz_east = 0.0, dz_north = 0.0;
+  if ( east_metres > 0.0 )
+    dz_east = ((z[2][0] + 2*z[2][1] + z[2][2]) - (z[0][0] + 2*z[0][1] + z[0][2])) / (4 * east_metres);
+  if ( north_metres > 0.0 )
+    dz_north = ((z[0][2] + 2*z[1][2] + z[2][2]) - (z[0][0] + 2*z[1][0] + z[2][0])) / (4 * north_metres);
+
+  const gdouble gradient = sqrt ( dz_east*dz_east + dz_north*dz_north );
+  *slope = RAD2DEG ( atan ( gradient ) );
+
+  // Surface normal (-dz_east, -dz_north, 1) against the light at (-0.5, 0.5, 0.707)
+  gdouble lit = (0.5*dz_east - 0.5*dz_north + M_SQRT1_2) / sqrt ( 1.0 + gradient*gradient );
+  *shade = CLAMP ( lit, 0.0, 1.0 );
+}
+
+/**
+ * Work out the colour of a sample as per vik_dem_layer_draw_dem()
+ * Returns FALSE if nothing should be drawn there
+ */
+static gboolean dem_sample_color ( VikDEMLayer *vdl, VikDEM *dem, guint x, guint y, guint skip_factor, GdkColor *gcolor )
+{
+  gint16 elev = vik_dem_get_xy ( dem, x, y );
+  if ( elev == VIK_DEM_INVALID_ELEVATION )
+    return FALSE;
+
+  if ( vdl->type == DEM_TYPE_GRADIENT ) {
+    // calculate and sum gradient in all directions
+    const guint prev_x = (x < skip_factor) ? 0 : x - skip_factor;
+    const guint next_x = MIN ( x + skip_factor, dem->n_columns - 1 );
+    const guint prev_y = (y < skip_factor) ? 0 : y - skip_factor;
+    guint next_y = y + skip_factor;
+    if ( next_y >= vik_dem_get_column(dem, x)->n_points )
+      next_y = y;
+    gint16 change = 0;
+    change += get_height_difference(elev, vik_dem_get_xy(dem, prev_x, prev_y));
+    change += get_height_difference(elev, vik_dem_get_xy(dem, x, prev_y));
+    change += get_height_difference(elev, vik_dem_get_xy(dem, next_x, prev_y));
+    change += get_height_difference(elev, vik_dem_get_xy(dem, prev_x, y));
+    change += get_height_difference(elev, vik_dem_get_xy(dem, next_x, y));
+    change += get_height_difference(elev, vik_dem_get_xy(dem, prev_x, next_y));
+    change += get_height_difference(elev, vik_dem_get_xy(dem, x, next_y));
+    change += get_height_difference(elev, vik_dem_get_xy(dem, next_x, next_y));
+
+    change = change / ((skip_factor > 1) ? log(skip_factor) : 0.55); // FIXME: better calc.
+    if ( change < vdl->min_elev )
+      change = ceil ( vdl->min_elev );
+    if ( change > vdl->max_elev )
+      change = vdl->max_elev;
+
+    guint index = (gint)floor(((change - vdl->min_elev)/(vdl->max_elev - vdl->min_elev))*(DEM_N_GRADIENT_COLORS-2))+1;
+    *gcolor = vdl->gradient_colors[index];
+    return TRUE;
+  }
+
+  if ( vdl->type == DEM_TYPE_HILLSHADE || vdl->type == DEM_TYPE_SLOPE ) {
+    gdouble slope, shade;
+    dem_sample_shading ( dem, x, y, skip_factor, elev, &slope, &shade );
+    if ( vdl->type == DEM_TYPE_HILLSHADE ) {
+      gcolor->red = gcolor->green = gcolor->blue = (guint16)(shade * 65535);
+    }
+    else {
+      guint index = (guint)floor((MIN(slope, DEM_SLOPE_MAX)/DEM_SLOPE_MAX)*(DEM_N_GRADIENT_COLORS-2))+1;
+      *gcolor = vdl->gradient_colors[index];
+    }
+    return TRUE;
+  }
+
+  if ( vdl->type == DEM_TYPE_HEIGHT ) {
+    /* If 'sea' colour or below the defined mininum draw in the configurable colour */
+    if ( elev <= vdl->min_elev )
+      *gcolor = vdl->color;
+    else {
+      if ( elev > vdl->max_elev )
+        elev = vdl->max_elev;
+      guint index = (gint)floor(((elev - vdl->min_elev)/(vdl->max_elev - vdl->min_elev))*(DEM_N_HEIGHT_COLORS-2))+1;
+      *gcolor = vdl->height_colors[index];
+    }
+    return TRUE;
+  }
+  return FALSE;
+}
+
+/**
+ * Colour in a tile of samples, with the first row being the most northerly
+ */
+static GdkPixbuf *dem_tile_render ( VikDEMLayer *vdl, VikDEM *dem, guint x0, guint y0, guint skip_factor, guint n_rows )
+{
+  const guint cols = MIN ( DEM_TILE_SIZE, (dem->n_columns - x0 + skip_factor - 1) / skip_factor );
+  const guint rows = MIN ( DEM_TILE_SIZE, (n_rows - y0 + skip_factor - 1) / skip_factor );
+
+  GdkPixbuf *pixbuf = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, TRUE, 8, cols, rows );
+  gdk_pixbuf_fill ( pixbuf, 0x00000000 );
+  guchar *pixels = gdk_pixbuf_get_pixels ( pixbuf );
+  const gint rowstride = gdk_pixbuf_get_rowstride ( pixbuf );
+
+  for ( guint ii = 0; ii < cols; ii++ ) {
+    const guint x = x0 + ii * skip_factor;
+    const guint n_points = vik_dem_get_column(dem, x)->n_points;
+    for ( guint jj = 0; jj < rows; jj++ ) {
+      const guint y = y0 + jj * skip_factor;
+      if ( y >= n_points )
+        break;
+      GdkColor gcolor;
+      if ( !dem_sample_color ( vdl, dem, x, y, skip_factor, &gcolor ) )
+        continue;
+      guchar *px = pixels + (rows - 1 - jj) * rowstride + ii * 4;
+      px[0] = gcolor.red / 256;
+      px[1] = gcolor.green / 256;
+      px[2] = gcolor.blue / 256;
+      px[3] = vdl->alpha;
+    }
+  }
+  return pixbuf;
+}
+
+static void dem_latlon_to_screen ( VikViewport *vp, gdouble lat, gdouble lon, gint *x, gint *y )
+{
+  struct LatLon ll = { lat, lon };
+  VikCoord coord;
+  vik_coord_load_from_latlon ( &coord, vik_viewport_get_coord_mode(vp), &ll );
+  vik_viewport_coord_to_screen ( vp, &coord, x, y );
+}
+
+/**
+ * Put a tile of samples starting at x0,y0 onto the frame
+ */
+static void dem_tile_draw ( VikViewport *vp, VikDEM *dem, GdkPixbuf *tile, guint x0, guint y0, guint skip_factor, GdkPixbuf *frame )
+{
+  const gint cols = gdk_pixbuf_get_width ( tile );
+  const gint rows = gdk_pixbuf_get_height ( tile );
+  const gint frame_width = gdk_pixbuf_get_width ( frame );
+  const gint frame_height = gdk_pixbuf_get_height ( frame );
+  const gdouble escale_deg = dem->east_scale * skip_factor / 3600.0;
+  const gdouble nscale_deg = dem->north_scale * skip_factor / 3600.0;
+  // As when drawing sample by sample, each sample's box is centred on its position
+  const gdouble west = (dem->min_east + x0 * dem->east_scale) / 3600.0 - escale_deg / 2;
+  const gdouble north = (dem->min_north + (y0 + (rows - 1) * skip_factor) * dem->north_scale) / 3600.0 + nscale_deg / 2;
+
+  gint sx0, sx1, sy0, sy1;
+  dem_latlon_to_screen ( vp, north, west, &sx0, &sy0 );
+  dem_latlon_to_screen ( vp, north, west + cols * escale_deg, &sx1, &sy1 );
+  const gint dx0 = MAX ( 0, sx0 );
+  const gint dx1 = MIN ( frame_width, sx1 );
+  if ( dx1 <= dx0 )
+    return;
+  const gdouble scale_x = (gdouble)(sx1 - sx0) / cols;
+
+  // Latitude need not be linear on the display (e.g. Mercator),
+  //  so position the tile in strips that are each near enough linear
+  for ( gint r0 = 0; r0 < rows && sy0 < frame_height; r0 += DEM_TILE_STRIP ) {
+    const gint r1 = MIN ( rows, r0 + DEM_TILE_STRIP );
+    gint dummy;
+    dem_latlon_to_screen ( vp, north - r1 * nscale_deg, west, &dummy, &sy1 );
+    const gint dy0 = MAX ( 0, sy0 );
+    const gint dy1 = MIN ( frame_height, sy1 );
+    if ( dy1 > dy0 ) {
+      const gdouble scale_y = (gdouble)(sy1 - sy0) / (r1 - r0);
+      gdk_pixbuf_composite ( tile, frame, dx0, dy0, dx1 - dx0, dy1 - dy0,
+                             sx0, sy0 - r0 * scale_y, scale_x, scale_y, GDK_INTERP_NEAREST, 255 );
+    }
+    sy0 = sy1;
+  }
+}
+
+/**
+ * Draw a lat/lon DEM from tiles of its colouring, which are kept in the map cache
+ *  so panning around does not need to work out all the colours again
+ */
+/**
+ * The range of the tiles (of DEM_TILE_SIZE samples at the skip factor each way) of a lat/lon DEM that are in view
+ *
+ * Returns: FALSE if there are none
+ */
+static gboolean dem_visible_tiles ( VikViewport *vp, VikDEM *dem, guint *n_rows, guint *skip_factor, gint *tx0, gint *tx1, gint *ty0, gint *ty1 )
+{
+  LatLonBBox vp_bbox = vik_viewport_get_bbox ( vp );
+  LatLonBBox dem_bbox = vik_dem_get_bbox ( dem );
+  if ( ! BBOX_INTERSECT(dem_bbox, vp_bbox) )
+    return FALSE;
+
+  *n_rows = dem_max_rows ( dem );
+  if ( !dem->n_columns || !*n_rows )
+    return FALSE;
+
+  *skip_factor = ceil ( vik_viewport_get_xmpp(vp) / 80 ); /* todo: smarter calculation. */
+  const guint span = DEM_TILE_SIZE * *skip_factor;
+
+  // Viewport extent in samples, allowing for the sample boxes overlapping the edges
+  const gdouble xmin = (vp_bbox.west * 3600 - dem->min_east) / dem->east_scale - *skip_factor;
+  const gdouble xmax = (vp_bbox.east * 3600 - dem->min_east) / dem->east_scale + *skip_factor;
+  const gdouble ymin = (vp_bbox.south * 3600 - dem->min_north) / dem->north_scale - *skip_factor;
+  const gdouble ymax = (vp_bbox.north * 3600 - dem->min_north) / dem->north_scale + *skip_factor;
+  *tx0 = MAX ( 0, (gint)floor(xmin / span) );
+  *tx1 = MIN ( (gint)((dem->n_columns - 1) / span), (gint)floor(xmax / span) );
+  *ty0 = MAX ( 0, (gint)floor(ymin / span) );
+  *ty1 = MIN ( (gint)((*n_rows - 1) / span), (gint)floor(ymax / span) );
+  return TRUE;
+}
+
+static void dem_layer_draw_dem_tiles ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *dem, const gchar *name, GdkPixbuf *frame )
+{
+  guint n_rows, skip_factor;
+  gint tx0, tx1, ty0, ty1;
+  if ( !dem_visible_tiles ( vp, dem, &n_rows, &skip_factor, &tx0, &tx1, &ty0, &ty1 ) )
+    return;
+  const guint span = DEM_TILE_SIZE * skip_factor;
+
+  for ( gint tx = tx0; tx <= tx1; tx++ ) {
+    for ( gint ty = ty0; ty <= ty1; ty++ ) {
+      GdkPixbuf *tile = a_mapcache_get ( tx, ty, skip_factor, MAP_ID_DEM_RENDER, 0, vdl->alpha, 0.0, 0.0, name, vdl );
+      if ( !tile ) {
+        tile = dem_tile_render ( vdl, dem, tx * span, ty * span, skip_factor, n_rows );
+        a_mapcache_add ( tile, (mapcache_extra_t) { 0.0 }, tx, ty, skip_factor, MAP_ID_DEM_RENDER, 0, vdl->alpha, 0.0, 0.0, name, vdl );
+      }
+      dem_tile_draw ( vp, dem, tile, tx * span, ty * span, skip_factor, frame );
+      g_object_unref ( tile );
+    }
+  }
+}
+
+
+/**************************************************************
+ **** CONTOURS
+ **************************************************************/
+
+// Every this many intervals the contour is drawn thicker and labelled
+#define DEM_CONTOUR_INDEX 5
+// In samples at the skip factor, so the lines are simpler as the display zooms out
+#define DEM_CONTOUR_TOLERANCE 0.1
+// Beyond this the oldest tiles are dropped
+#define DEM_CONTOUR_CACHE_SIZE (32 * 1024 * 1024)
+// Pixels kept clear around each label
+#define DEM_CONTOUR_LABEL_SPACE 48
+
+struct _DemContourTile {
+  gchar *key;
+  GPtrArray *contours; // In samples at the skip factor from the south west of the tile
+  gsize size;
+};
+
+static void dem_contour_tile_free ( DemContourTile *dct )
+{
+  if ( dct->contours )
+    g_ptr_array_unref ( dct->contours );
+  g_free ( dct->key );
+  g_free ( dct );
+}
+
+typedef struct {
+  VikDEM *dem;
+  DemContourTile *tile;
+  guint x0, y0;
+  guint skip_factor;
+  gdouble interval;
+} DemContourDraw;
+
+/**
+ * Trace the contours of a tile, including the first samples of the next tiles so the lines meet up
+ */
+static void dem_contour_tile_trace ( DemContourDraw *dcd, gpointer user_data )
+{
+  VikDEM *dem = dcd->dem;
+  const guint skip_factor = dcd->skip_factor;
+  const guint n_rows = dem_max_rows ( dem );
+  const guint cols = MIN ( DEM_TILE_SIZE + 1, (dem->n_columns - dcd->x0 + skip_factor - 1) / skip_factor );
+  const guint rows = MIN ( DEM_TILE_SIZE + 1, (n_rows - dcd->y0 + skip_factor - 1) / skip_factor );
+
+  gint16 *grid = g_new ( gint16, cols * rows );
+  for ( guint ii = 0; ii < cols; ii++ )
+    for ( guint jj = 0; jj < rows; jj++ )
+      grid[jj*cols + ii] = vik_dem_get_xy ( dem, dcd->x0 + ii * skip_factor, dcd->y0 + jj * skip_factor );
+  dcd->tile->contours = a_contours_trace ( grid, cols, rows, VIK_DEM_INVALID_ELEVATION, dcd->interval, DEM_CONTOUR_TOLERANCE );
+  dcd->tile->size = a_contours_get_size ( dcd->tile->contours );
+  g_free ( grid );
+}
+
+static PangoLayout *dem_contour_label_layout ( VikDEMLayer *vdl, VikViewport *vp, gdouble level )
+{
+  if ( a_vik_get_units_height () == VIK_UNITS_HEIGHT_FEET )
+    level = VIK_METERS_TO_FEET(level);
+  gchar *text = g_strdup_printf ( "%.0f", level );
+  PangoLayout *layout = g_hash_table_lookup ( vdl->contour_labels, text );
+  if ( layout ) {
+    g_free ( text );
+    return layout;
+  }
+  layout = gtk_widget_create_pango_layout ( GTK_WIDGET(vp), NULL );
+  gchar *markup = g_strdup_printf ( "<span size=\"small\">%s</span>", text );
+  pango_layout_set_markup ( layout, markup, -1 );
+  g_free ( markup );
+  g_hash_table_insert ( vdl->contour_labels, text, layout );
+  return layout;
+}
+
+/**
+ * Label the middle of a contour, if it is on the display and clear of the other labels
+ */
+static void dem_contour_label ( VikDEMLayer *vdl, VikViewport *vp, GdkGC *gc, gdouble level, GdkPoint *points, guint n_points, GArray *labels )
+{
+  PangoLayout *layout = dem_contour_label_layout ( vdl, vp, level );
+  gint width, height;
+  pango_layout_get_pixel_size ( layout, &width, &height );
+  const GdkPoint *mid = &points[n_points/2];
+  GdkRectangle rect = { mid->x - width/2, mid->y - height/2, width, height };
+  if ( rect.x < 0 || rect.y < 0 ||
+       rect.x + width > vik_viewport_get_width(vp) || rect.y + height > vik_viewport_get_height(vp) )
+    return;
+
+  GdkRectangle clear = { rect.x - DEM_CONTOUR_LABEL_SPACE, rect.y - DEM_CONTOUR_LABEL_SPACE,
+                         width + 2*DEM_CONTOUR_LABEL_SPACE, height + 2*DEM_CONTOUR_LABEL_SPACE };
+  GdkRectangle overlap;
+  for ( guint ii = 0; ii < labels->len; ii++ )
+    if ( gdk_rectangle_intersect ( &clear, &g_array_index(labels, GdkRectangle, ii), &overlap ) )
+      return;
+  g_array_append_val ( labels, rect );
+  vik_viewport_draw_layout ( vp, gc, rect.x, rect.y, layout );
+}
+
+static void dem_contour_tile_draw ( VikDEMLayer *vdl, VikViewport *vp, DemContourDraw *dcd, GdkGC *gc, GdkGC *index_gc, GArray *points, GArray *labels )
+{
+  VikDEM *dem = dcd->dem;
+  const gdouble escale_deg = dem->east_scale * dcd->skip_factor / 3600.0;
+  const gdouble nscale_deg = dem->north_scale * dcd->skip_factor / 3600.0;
+  const gdouble west = (dem->min_east + dcd->x0 * dem->east_scale) / 3600.0;
+  const gdouble south = (dem->min_north + dcd->y0 * dem->north_scale) / 3600.0;
+
+  for ( guint cc = 0; cc < dcd->tile->contours->len; cc++ ) {
+    Contour *contour = g_ptr_array_index ( dcd->tile->contours, cc );
+    g_array_set_size ( points, contour->n_points );
+    GdkPoint *pts = (GdkPoint*)points->data;
+    for ( guint ii = 0; ii < contour->n_points; ii++ )
+      dem_latlon_to_screen ( vp, south + contour->points[2*ii+1] * nscale_deg, west + contour->points[2*ii] * escale_deg, &pts[ii].x, &pts[ii].y );
+
+    const gboolean is_index = ( (gint64)round(contour->level / dcd->interval) % DEM_CONTOUR_INDEX ) == 0;
+    vik_viewport_draw_lines ( vp, is_index ? index_gc : gc, pts, contour->n_points );
+    if ( is_index )
+      dem_contour_label ( vdl, vp, gc, contour->level, pts, contour->n_points, labels );
+  }
+}
+
+/**
+ * Draw the contours of the lat/lon DEMs,
+ *  first tracing those of the tiles in view that are not already cached (in parallel)
+ */
+static void dem_layer_draw_contours ( VikDEMLayer *vdl, VikViewport *vp )
+{
+  GArray *draws = g_array_new ( FALSE, FALSE, sizeof(DemContourDraw) );
+  GArray *traces = g_array_new ( FALSE, FALSE, sizeof(guint) );
+
+  for ( GList *iter = vdl->files; iter; iter = iter->next ) {
+    VikDEM *dem = a_dems_get ( (const gchar *)iter->data );
+    if ( !dem || dem->horiz_units != VIK_DEM_HORIZ_LL_ARCSECONDS )
+      continue;
+    guint n_rows, skip_factor;
+    gint tx0, tx1, ty0, ty1;
+    if ( !dem_visible_tiles ( vp, dem, &n_rows, &skip_factor, &tx0, &tx1, &ty0, &ty1 ) )
+      continue;
+    const guint span = DEM_TILE_SIZE * skip_factor;
+    for ( gint tx = tx0; tx <= tx1; tx++ ) {
+      for ( gint ty = ty0; ty <= ty1; ty++ ) {
+        gchar *key = g_strdup_printf ( "%s|%g|%u|%d|%d", (const gchar *)iter->data, vdl->contour_interval, skip_factor, tx, ty );
+        DemContourTile *tile = g_hash_table_lookup ( vdl->contour_tiles, key );
+        if ( tile )
+          g_free ( key );
+        else {
+          tile = g_new0 ( DemContourTile, 1 );
+          tile->key = key;
+          g_hash_table_insert ( vdl->contour_tiles, tile->key, tile );
+          g_queue_push_tail ( &vdl->contour_order, tile );
+          g_array_append_val ( traces, draws->len );
+        }
+        DemContourDraw dcd = { dem, tile, tx * span, ty * span, skip_factor, vdl->contour_interval };
+        g_array_append_val ( draws, dcd );
+      }
+    }
+  }
+
+  if ( traces->len ) {
+    VikTaskGroup *group = a_background_tasks_new ();
+    for ( guint ii = 0; ii < traces->len; ii++ )
+      a_background_tasks_add ( group, (GFunc)dem_contour_tile_trace, &g_array_index(draws, DemContourDraw, g_array_index(traces, guint, ii)), NULL );
+    a_background_tasks_free ( group );
+    for ( guint ii = 0; ii < traces->len; ii++ )
+      vdl->contour_size += g_array_index(draws, DemContourDraw, g_array_index(traces, guint, ii)).tile->size;
+  }
+
+  GdkGC *gc = vik_viewport_new_gc_from_color ( vp, &vdl->contour_color, 1 );
+  GdkGC *index_gc = vik_viewport_new_gc_from_color ( vp, &vdl->contour_color, 2 );
+  GArray *points = g_array_new ( FALSE, FALSE, sizeof(GdkPoint) );
+  GArray *labels = g_array_new ( FALSE, FALSE, sizeof(GdkRectangle) );
+  for ( guint ii = 0; ii < draws->len; ii++ )
+    dem_contour_tile_draw ( vdl, vp, &g_array_index(draws, DemContourDraw, ii), gc, index_gc, points, labels );
+  g_array_free ( labels, TRUE );
+  g_array_free ( points, TRUE );
+  g_object_unref ( index_gc );
+  g_object_unref ( gc );
+
+  // Drop the oldest, now that nothing is being drawn from them
+  while ( vdl->contour_size > DEM_CONTOUR_CACHE_SIZE && vdl->contour_order.length > draws->len ) {
+    DemContourTile *oldest = g_queue_pop_head ( &vdl->contour_order );
+    vdl->contour_size -= oldest->size;
+    g_hash_table_remove ( vdl->contour_tiles, oldest->key );
+  }
+
+  g_array_free ( traces, TRUE );
+  g_array_free ( draws, TRUE );
+}
+
 static void dem_layer_draw ( VikDEMLayer *vdl, VikViewport *vp )
 {
   GList *dems_iter = vdl->files;
@@ -1057,20 +1609,42 @@ static void dem_layer_draw ( VikDEMLayer *vdl, VikViewport *vp )
     dem24k_draw_existence ( vp );
 #endif
 
+  if ( vdl->type == DEM_TYPE_CONTOURS ) {
+    dem_layer_draw_contours ( vdl, vp );
+    return;
+  }
+
   const guint width = vik_viewport_get_width ( vp );
   const guint height = vik_viewport_get_height ( vp );
 
   // RGBA, natural alignment of rows on 4 byte boundary
   vdl->pixels = g_malloc0 ( sizeof(guchar*) * width * height * 4 );
+  GdkPixbuf *pixbuf = gdk_pixbuf_new_from_data ( vdl->pixels, GDK_COLORSPACE_RGB, TRUE, 8, width, height, width*4, NULL, NULL );
+
+  // Tiles can be used when longitude is linear on the display
+  const VikViewportDrawMode mode = vik_viewport_get_drawmode ( vp );
+  const gboolean use_tiles = (mode == VIK_VIEWPORT_DRAWMODE_MERCATOR || mode == VIK_VIEWPORT_DRAWMODE_LATLON);
+  // Everything affecting the colouring identifies the cached tiles, along with the DEM itself
+  gchar *style = g_strdup_printf ( "%d:%d:%g:%g:%04x%04x%04x:%04x%04x%04x:%04x%04x%04x", vdl->type, vdl->color_scheme, vdl->min_elev, vdl->max_elev,
+                                   vdl->color.red, vdl->color.green, vdl->color.blue,
+                                   vdl->color_min.red, vdl->color_min.green, vdl->color_min.blue,
+                                   vdl->color_max.red, vdl->color_max.green, vdl->color_max.blue );
 
   while ( dems_iter ) {
     dem = a_dems_get ( (const char *) (dems_iter->data) );
-    if ( dem )
-      vik_dem_layer_draw_dem ( vdl, vp, dem );
+    if ( dem ) {
+      if ( use_tiles && dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS && vdl->type != DEM_TYPE_NONE ) {
+        gchar *name = g_strdup_printf ( "%s|%s", style, (const gchar *)dems_iter->data );
+        dem_layer_draw_dem_tiles ( vdl, vp, dem, name, pixbuf );
+        g_free ( name );
+      }
+      else
+        vik_dem_layer_draw_dem ( vdl, vp, dem );
+    }
     dems_iter = dems_iter->next;
   }
+  g_free ( style );
 
-  GdkPixbuf *pixbuf = gdk_pixbuf_new_from_data ( vdl->pixels, GDK_COLORSPACE_RGB, TRUE, 8, width, height, width*4, NULL, NULL );
   vik_viewport_draw_pixbuf ( vp, pixbuf, 0, 0, 0, 0, width, height );
   g_object_unref ( pixbuf );
   g_free ( vdl->pixels );
@@ -1078,10 +1652,15 @@ static void dem_layer_draw ( VikDEMLayer *vdl, VikViewport *vp )
 
 static void dem_layer_free ( VikDEMLayer *vdl )
 {
+  a_mapcache_remove_layer ( vdl );
   a_dems_list_free ( vdl->files );
 
   g_free ( vdl->height_colors );
   g_free ( vdl->gradient_colors );
+
+  g_queue_clear ( &vdl->contour_order );
+  g_hash_table_destroy ( vdl->contour_tiles );
+  g_hash_table_destroy ( vdl->contour_labels );
 }
 
 VikDEMLayer *dem_layer_create ( VikViewport *vp )
@@ -1107,16 +1686,34 @@ typedef struct {
  *  SOURCE: SRTM                                  *
  **************************************************/
 
-static void srtm_dem_download_thread ( DEMDownloadParams *p, gpointer threaddata )
+/**
+ * Returns: The URL of the SRTM file covering the degree at lat, lon or NULL if there is no such file
+ */
+static gchar *srtm_source_url ( gint intlat, gint intlon )
 {
-  gint intlat, intlon;
-  const gchar *continent_dir;
+  const gchar *continent_dir = srtm_continent_dir(intlat, intlon);
+  if (!continent_dir)
+    return NULL;
 
-  intlat = (int)floor(p->lat);
-  intlon = (int)floor(p->lon);
-  continent_dir = srtm_continent_dir(intlat, intlon);
+  return g_strdup_printf("%s/%s/%c%02d%c%03d.hgt.zip",
+                base_url,
+                continent_dir,
+		(intlat >= 0) ? 'N' : 'S',
+		ABS(intlat),
+		(intlon >= 0) ? 'E' : 'W',
+		ABS(intlon) );
+}
 
-  if (!continent_dir) {
+static DownloadResult_t srtm_download ( const gchar *src_url, const gchar *dest )
+{
+  static DownloadFileOptions options = { FALSE, FALSE, NULL, 5, NULL, a_check_map_file, NULL, NULL };
+  return a_http_download_get_url ( src_url, NULL, dest, &options, NULL );
+}
+
+static void srtm_dem_download_thread ( DEMDownloadParams *p, gpointer threaddata )
+{
+  gchar *src_url = srtm_source_url ( (gint)floor(p->lat), (gint)floor(p->lon) );
+  if (!src_url) {
     if ( p->vdl ) {
       gchar *msg = g_strdup_printf ( _("No SRTM data available for %f, %f"), p->lat, p->lon );
       vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(p->vdl), msg, VIK_STATUSBAR_INFO );
@@ -1125,16 +1722,7 @@ static void srtm_dem_download_thread ( DEMDownloadParams *p, gpointer threaddata
     return;
   }
 
-  gchar *src_url = g_strdup_printf("%s/%s/%c%02d%c%03d.hgt.zip",
-                base_url,
-                continent_dir,
-		(intlat >= 0) ? 'N' : 'S',
-		ABS(intlat),
-		(intlon >= 0) ? 'E' : 'W',
-		ABS(intlon) );
-
-  static DownloadFileOptions options = { FALSE, FALSE, NULL, 5, NULL, a_check_map_file, NULL, NULL };
-  DownloadResult_t result = a_http_download_get_url ( src_url, NULL, p->dest, &options, NULL );
+  DownloadResult_t result = srtm_download ( src_url, p->dest );
   switch ( result ) {
     case DOWNLOAD_PARAMETERS_ERROR:
     case DOWNLOAD_CONTENT_ERROR:
@@ -1152,6 +1740,7 @@ static void srtm_dem_download_thread ( DEMDownloadParams *p, gpointer threaddata
     }
     case DOWNLOAD_SUCCESS:
     case DOWNLOAD_NOT_REQUIRED:
+    case DOWNLOAD_NOT_MODIFIED:
     default:
       break;
   }
@@ -1180,6 +1769,175 @@ static gchar *srtm_lat_lon_to_dest_fn ( gdouble lat, gdouble lon )
 
 }
 
+/**************************************************
+ *  SRTM ACQUISITION                              *
+ **************************************************/
+
+// Downloads in progress at once
+#define SRTM_BATCH_SIZE 8
+
+// Never zero, so that it can be stored directly in a hash table
+#define srtm_tile_key(lat,lon) GINT_TO_POINTER( ((lat)+90) * 360 + ((lon)+180) + 1 )
+#define srtm_tile_lat(key) ( (GPOINTER_TO_INT(key)-1) / 360 - 90 )
+#define srtm_tile_lon(key) ( (GPOINTER_TO_INT(key)-1) % 360 - 180 )
+
+/**
+ * vik_dem_layer_srtm_tiles_new:
+ *
+ * Returns: A set of the whole degrees covered by SRTM DEMs, to be filled in
+ *  and then passed to vik_dem_layer_srtm_acquire(). Free with g_hash_table_destroy().
+ */
+GHashTable *vik_dem_layer_srtm_tiles_new ( void )
+{
+  return g_hash_table_new ( g_direct_hash, g_direct_equal );
+}
+
+void vik_dem_layer_srtm_tiles_add ( GHashTable *tiles, const struct LatLon *ll )
+{
+  gint lat = CLAMP ( (gint)floor(ll->lat), -90, 89 );
+  gint lon = CLAMP ( (gint)floor(ll->lon), -180, 179 );
+  g_hash_table_add ( tiles, srtm_tile_key(lat, lon) );
+}
+
+void vik_dem_layer_srtm_tiles_add_bbox ( GHashTable *tiles, LatLonBBox bbox )
+{
+  for ( gint lat = (gint)floor(bbox.south); lat <= (gint)floor(bbox.north); lat++ )
+    for ( gint lon = (gint)floor(bbox.west); lon <= (gint)floor(bbox.east); lon++ ) {
+      struct LatLon ll = { lat, lon };
+      vik_dem_layer_srtm_tiles_add ( tiles, &ll );
+    }
+}
+
+typedef struct {
+  VikTaskGroup *group;  // Loading of the DEMs
+  GMutex lock;
+  GList *dems;          // Filenames of the DEMs loaded, guarded by the lock
+  gint cancelled;       // Atomic
+  gpointer threaddata;
+  guint total;
+  guint done;
+} SrtmAcquire;
+
+typedef struct {
+  SrtmAcquire *sa;
+  gchar *filename;
+} SrtmTile;
+
+static void srtm_load_task ( gchar *filename, SrtmAcquire *sa )
+{
+  if ( !g_atomic_int_get(&sa->cancelled) && a_dems_load ( filename ) ) {
+    g_mutex_lock ( &sa->lock );
+    sa->dems = g_list_prepend ( sa->dems, filename );
+    g_mutex_unlock ( &sa->lock );
+  }
+  else
+    g_free ( filename );
+}
+
+/**
+ * Returns: FALSE if the thread has been cancelled
+ */
+static gboolean srtm_tile_progress ( SrtmAcquire *sa )
+{
+  sa->done++;
+  if ( a_background_thread_progress ( sa->threaddata, (gdouble)sa->done / sa->total ) != 0 ) {
+    g_atomic_int_set ( &sa->cancelled, 1 );
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**
+ * A tile is available (or not), so start loading it straight away
+ *  while the other downloads carry on
+ */
+static gboolean srtm_tile_done ( DownloadResult_t result, SrtmTile *st )
+{
+  SrtmAcquire *sa = st->sa;
+  if ( result == DOWNLOAD_SUCCESS || result == DOWNLOAD_NOT_REQUIRED || result == DOWNLOAD_NOT_MODIFIED )
+    a_background_tasks_add ( sa->group, (GFunc)srtm_load_task, st->filename, sa );
+  else {
+    g_warning ( "%s: %s failed %d", __FUNCTION__, st->filename, result );
+    g_free ( st->filename );
+  }
+  g_free ( st );
+  return srtm_tile_progress ( sa );
+}
+
+/**
+ * vik_dem_layer_srtm_acquire:
+ * @tiles:      The degrees wanted, as from vik_dem_layer_srtm_tiles_add()
+ * @dems:       Set to the list of filenames of the DEMs loaded, for a_dems_list_free()
+ * @threaddata: Of the background thread this is called from, for the progress
+ *
+ * Download the SRTM DEMs not already in the maps cache directory, several at once,
+ *  and load each one as soon as it is available, so that the decoding overlaps the downloads.
+ *
+ * Returns: 0 when successful or -1 if the thread has been cancelled
+ *  (in which case not all of the DEMs will have been loaded)
+ */
+gint vik_dem_layer_srtm_acquire ( GHashTable *tiles, GList **dems, gpointer threaddata )
+{
+  SrtmAcquire sa;
+  sa.group = a_background_tasks_new ();
+  g_mutex_init ( &sa.lock );
+  sa.dems = NULL;
+  sa.cancelled = 0;
+  sa.threaddata = threaddata;
+  sa.total = g_hash_table_size ( tiles );
+  sa.done = 0;
+
+  void *batch = a_download_batch_new ();
+  gint res = 0;
+  GHashTableIter iter;
+  gpointer key;
+  g_hash_table_iter_init ( &iter, tiles );
+  while ( !res && g_hash_table_iter_next ( &iter, &key, NULL ) ) {
+    gint lat = srtm_tile_lat ( key );
+    gint lon = srtm_tile_lon ( key );
+    gchar *src_url = srtm_source_url ( lat, lon );
+    if ( !src_url ) {
+      // Nothing to get, e.g. over the sea
+      res = srtm_tile_progress ( &sa ) ? 0 : -1;
+      continue;
+    }
+
+    SrtmTile *st = g_malloc ( sizeof(SrtmTile) );
+    st->sa = &sa;
+    gchar *dem_file = srtm_lat_lon_to_dest_fn ( lat, lon );
+    st->filename = g_strdup_printf ( "%s%s", MAPS_CACHE_DIR, dem_file );
+    g_free ( dem_file );
+
+    GStatBuf sb;
+    if ( g_stat ( st->filename, &sb ) == 0 && sb.st_size )
+      res = srtm_tile_done ( DOWNLOAD_NOT_REQUIRED, st ) ? 0 : -1;
+    else if ( batch ) {
+      DownloadFileOptions *options = g_malloc0 ( sizeof(DownloadFileOptions) );
+      options->follow_location = 5;
+      options->check_file = a_check_map_file;
+      a_http_download_batch_add ( batch, src_url, NULL, st->filename, options, (DownloadBatchDoneFunc)srtm_tile_done, st );
+      // Keep the queue topped up, only waiting for transfers when it is full
+      res = a_download_batch_run ( batch, SRTM_BATCH_SIZE - 1 );
+    }
+    else
+      res = srtm_tile_done ( srtm_download ( src_url, st->filename ), st ) ? 0 : -1;
+    g_free ( src_url );
+  }
+  if ( batch ) {
+    if ( !res )
+      res = a_download_batch_run ( batch, 0 );
+    a_download_batch_free ( batch );
+  }
+  if ( res )
+    g_atomic_int_set ( &sa.cancelled, 1 );
+
+  // Wait for the loading to finish
+  a_background_tasks_free ( sa.group );
+  g_mutex_clear ( &sa.lock );
+  *dems = sa.dems;
+  return res ? -1 : 0;
+}
+
 /* TODO: generalize */
 static void srtm_draw_existence ( VikViewport *vp )
 {
@@ -1202,7 +1960,7 @@ static void srtm_draw_existence ( VikViewport *vp )
 		ABS(i),
 		(j >= 0) ? 'E' : 'W',
 		ABS(j) );
-      if ( g_file_test(buf, G_FILE_TEST_EXISTS ) == TRUE ) {
+      if ( a_existcache_file_exists ( buf ) ) {
         VikCoord ne, sw;
         gint x1, y1, x2, y2;
         sw.north_south = i;
@@ -1238,6 +1996,9 @@ static void dem24k_dem_download_thread ( DEMDownloadParams *p, gpointer threadda
   /* FIX: don't use system, use execv or something. check for existence */
   system(cmdline);
   g_free ( cmdline );
+  // Written by another program, so not seen by the existence cache otherwise
+  if ( g_file_test ( p->dest, G_FILE_TEST_EXISTS ) )
+    a_existcache_add ( p->dest );
 }
 
 static gchar *dem24k_lat_lon_to_dest_fn ( gdouble lat, gdouble lon )
@@ -1259,27 +2020,15 @@ static void dem24k_draw_existence ( VikViewport *vp )
   vik_viewport_get_min_max_lat_lon ( vp, &min_lat, &max_lat, &min_lon, &max_lon );
 
   for (i = floor(min_lat*8)/8; i <= floor(max_lat*8)/8; i+=0.125) {
-    /* check lat dir first -- faster */
-    g_snprintf(buf, sizeof(buf), "%sdem24k/%d/",
-        MAPS_CACHE_DIR,
-	(gint) i );
-    if ( g_file_test(buf, G_FILE_TEST_EXISTS) == FALSE )
-      continue;
     for (j = floor(min_lon*8)/8; j <= floor(max_lon*8)/8; j+=0.125) {
-      /* check lon dir first -- faster */
-      g_snprintf(buf, sizeof(buf), "%sdem24k/%d/%d/",
-        MAPS_CACHE_DIR,
-	(gint) i,
-        (gint) j );
-      if ( g_file_test(buf, G_FILE_TEST_EXISTS) == FALSE )
-        continue;
+      // Missing lat or lon directories are remembered as part of the existence cache
       g_snprintf(buf, sizeof(buf), "%sdem24k/%d/%d/%.03f,%.03f.dem",
 	        MAPS_CACHE_DIR,
 		(gint) i,
 		(gint) j,
 		floor(i*8)/8,
 		floor(j*8)/8 );
-      if ( g_file_test(buf, G_FILE_TEST_EXISTS ) == TRUE ) {
+      if ( a_existcache_file_exists ( buf ) ) {
         VikCoord ne, sw;
         gint x1, y1, x2, y2;
         sw.north_south = i;
@@ -1362,6 +2111,81 @@ static void free_dem_download_params ( DEMDownloadParams *p )
   g_free ( p );
 }
 
+typedef struct {
+  VikDEMLayer *vdl;
+  GHashTable *tiles;
+  GList *dems;
+} DEMViewDownload;
+
+static void dem_view_download_free ( DEMViewDownload *dvd )
+{
+  a_dems_list_free ( dvd->dems );
+  g_hash_table_destroy ( dvd->tiles );
+  g_object_unref ( dvd->vdl );
+  g_free ( dvd );
+}
+
+/**
+ * Add the DEMs to the layer, apart from any it already has
+ */
+static gboolean dem_view_download_finish ( DEMViewDownload *dvd )
+{
+  GList *iter = dvd->dems;
+  while ( iter ) {
+    GList *next = iter->next;
+    if ( !g_list_find_custom ( dvd->vdl->files, iter->data, (GCompareFunc)g_strcmp0 ) ) {
+      dvd->dems = g_list_remove_link ( dvd->dems, iter );
+      dvd->vdl->files = g_list_concat ( dvd->vdl->files, iter );
+    }
+    iter = next;
+  }
+  vik_layer_emit_update ( VIK_LAYER(dvd->vdl) );
+  dem_view_download_free ( dvd );
+  return FALSE;
+}
+
+static gboolean dem_view_download_free_idle ( DEMViewDownload *dvd )
+{
+  dem_view_download_free ( dvd );
+  return FALSE;
+}
+
+static gint dem_view_download_thread ( DEMViewDownload *dvd, gpointer threaddata )
+{
+  // The layer is only to be changed in the main thread
+  if ( vik_dem_layer_srtm_acquire ( dvd->tiles, &dvd->dems, threaddata ) ) {
+    (void)gdk_threads_add_idle ( (GSourceFunc)dem_view_download_free_idle, dvd );
+    return -1;
+  }
+  (void)gdk_threads_add_idle ( (GSourceFunc)dem_view_download_finish, dvd );
+  return 0;
+}
+
+/**
+ * Get all the SRTM DEMs covering the view
+ */
+static void dem_layer_download_view ( GtkWidget *widget, VikDEMLayer *vdl )
+{
+  if ( vdl->source != DEM_SOURCE_SRTM ) {
+    a_dialog_info_msg ( VIK_GTK_WINDOW_FROM_LAYER(vdl), _("Downloading the whole view is only available for SRTM DEMs") );
+    return;
+  }
+  VikViewport *vvp = vik_window_viewport ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vdl)) );
+  DEMViewDownload *dvd = g_malloc0 ( sizeof(DEMViewDownload) );
+  dvd->vdl = g_object_ref ( vdl );
+  dvd->tiles = vik_dem_layer_srtm_tiles_new ();
+  vik_dem_layer_srtm_tiles_add_bbox ( dvd->tiles, vik_viewport_get_bbox(vvp) );
+
+  a_background_thread ( BACKGROUND_POOL_REMOTE,
+                        VIK_GTK_WINDOW_FROM_LAYER(vdl),
+                        _("Downloading DEMs"),
+                        (vik_thr_func)dem_view_download_thread,
+                        dvd,
+                        NULL, // The thread itself frees the data or passes it on
+                        NULL,
+                        g_hash_table_size ( dvd->tiles ) );
+}
+
 static gpointer dem_layer_download_create ( VikWindow *vw, VikViewport *vvp)
 {
   return vvp;
@@ -1372,23 +2196,8 @@ static gpointer dem_layer_download_create ( VikWindow *vw, VikViewport *vvp)
  */
 static void dem_layer_file_info ( GtkWidget *widget, struct LatLon *ll )
 {
-  gint intlat, intlon;
-  const gchar *continent_dir;
-
-  intlat = (int)floor(ll->lat);
-  intlon = (int)floor(ll->lon);
-  continent_dir = srtm_continent_dir(intlat, intlon);
-
-  gchar *source = NULL;
-  if ( continent_dir )
-    source = g_strdup_printf ( "%s/%s/%c%02d%c%03d.hgt.zip",
-                               base_url,
-                               continent_dir,
-                               (intlat >= 0) ? 'N' : 'S',
-                               ABS(intlat),
-                               (intlon >= 0) ? 'E' : 'W',
-                               ABS(intlon) );
-  else
+  gchar *source = srtm_source_url ( (gint)floor(ll->lat), (gint)floor(ll->lon) );
+  if ( !source )
     // Probably not over any land...
     source = g_strdup ( _("No DEM File Available") );
 
@@ -1478,6 +2287,8 @@ static VikLayerToolFuncStatus dem_layer_download_release ( VikDEMLayer *vdl, Gdk
       vdl->right_click_menu = GTK_MENU ( gtk_menu_new () );
       GtkWidget *item = vu_menu_add_item ( vdl->right_click_menu, _("_Show DEM File Information"), GTK_STOCK_INFO, NULL, NULL );
       g_signal_connect ( G_OBJECT(item), "activate", G_CALLBACK(dem_layer_file_info), &ll );
+      item = vu_menu_add_item ( vdl->right_click_menu, _("_Download DEMs for the Current View"), GTK_STOCK_SAVE, NULL, NULL );
+      g_signal_connect ( G_OBJECT(item), "activate", G_CALLBACK(dem_layer_download_view), vdl );
     }
 
     gtk_menu_popup ( vdl->right_click_menu, NULL, NULL, NULL, NULL, event->button, event->time );
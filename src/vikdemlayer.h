@@ -23,6 +23,7 @@
 #define _VIKING_DEMLAYER_H
 
 #include "viklayer.h"
+#include "bbox.h"
 
 G_BEGIN_DECLS
 
@@ -42,6 +43,11 @@ GType vik_dem_layer_get_type ();
 
 typedef struct _VikDEMLayer VikDEMLayer;
 
+GHashTable *vik_dem_layer_srtm_tiles_new ( void );
+void vik_dem_layer_srtm_tiles_add ( GHashTable *tiles, const struct LatLon *ll );
+void vik_dem_layer_srtm_tiles_add_bbox ( GHashTable *tiles, LatLonBBox bbox );
+gint vik_dem_layer_srtm_acquire ( GHashTable *tiles, GList **dems, gpointer threaddata );
+
 G_END_DECLS
 
 #endif
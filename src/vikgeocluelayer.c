@@ -357,29 +357,14 @@ static void geoclue_layer_draw ( VikGeoclueLayer *vgl, VikViewport *vp )
 	// NB I don't understand this half drawn business
 	// This is just copied from vikgpslayer.c
 	VikLayer *vl;
-	VikLayer *trigger = VIK_LAYER(vik_viewport_get_trigger( vp ));
 
 	vl = VIK_LAYER(vgl->trw);
-	if (vl == trigger) {
-		if ( vik_viewport_get_half_drawn ( vp ) ) {
-			vik_viewport_set_half_drawn ( vp, FALSE );
-			vik_viewport_snapshot_load( vp );
-		} else {
-			vik_viewport_snapshot_save( vp );
-		}
-	}
+	vik_viewport_snapshot_reached ( vp, vl );
 	if ( !vik_viewport_get_half_drawn(vp) )
 		vik_layer_draw ( vl, vp );
 
 	if ( vgl->tracking ) {
-		if ( VIK_LAYER(vgl) == trigger ) {
-			if ( vik_viewport_get_half_drawn ( vp ) ) {
-				vik_viewport_set_half_drawn ( vp, FALSE );
-				vik_viewport_snapshot_load ( vp );
-			} else {
-				vik_viewport_snapshot_save ( vp );
-			}
-		}
+		vik_viewport_snapshot_reached ( vp, VIK_LAYER(vgl) );
 		if ( !vik_viewport_get_half_drawn(vp) )
 			tracking_draw ( vgl, vp );
   }
@@ -24,6 +24,10 @@
 #include <ctype.h>
 
 #include "vikmapslayer.h"
+#include "background.h"
+#include "mapcache.h"
+#include "imagecache.h"
+#include "map_ids.h"
 
 /*
 static VikLayerParamData image_default ( void )
@@ -57,6 +61,7 @@ enum {
   NUM_PARAMS };
 
 static const gchar* georef_layer_tooltip ( VikGeorefLayer *vgl );
+static void georef_layer_get_memory ( VikGeorefLayer *vgl, VikLayerMemory *mem );
 static void georef_layer_marshall( VikGeorefLayer *vgl, guint8 **data, guint *len );
 static VikGeorefLayer *georef_layer_unmarshall( guint8 *data, guint len, VikViewport *vvp );
 static gboolean georef_layer_set_param ( VikGeorefLayer *vgl, VikLayerSetParam *vlsp );
@@ -162,6 +167,7 @@ VikLayerInterface vik_georef_layer_interface = {
   (VikLayerFuncSelectedViewportMenu)    NULL,
 
   (VikLayerFuncRefresh)                 NULL,
+  (VikLayerFuncGetMemory)               georef_layer_get_memory,
 };
 
 typedef struct {
@@ -182,10 +188,13 @@ typedef struct {
   GtkWidget *imageentry;
 } changeable_widgets;
 
+typedef struct _GeorefPyramidJob GeorefPyramidJob;
+
 struct _VikGeorefLayer {
   VikLayer vl;
   gchar *image;
   GdkPixbuf *pixbuf;
+  gboolean pixbuf_shared; // From the image cache, so must not be modified
   guint8 alpha;
 
   struct UTM corner; // Top Left
@@ -193,8 +202,21 @@ struct _VikGeorefLayer {
   struct LatLon ll_br; // Bottom Right
   guint width, height;
 
-  GdkPixbuf *scaled;
+  GdkPixbuf *scaled; // The visible part of the image at the scaled size
   guint32 scaled_width, scaled_height;
+  gint32 scaled_x, scaled_y; // Screen position of the image when scaled
+
+  // Large images are drawn from a tile pyramid instead of the pixbuf
+  gchar *pyramid_dir; // Once available
+  guint pyramid_levels;
+  GeorefPyramidJob *pyramid_job; // Whilst being built
+
+  // Otherwise an image only decoded when drawn, at the resolution it is drawn at
+  VikGeorefSourceFunc source_load;
+  gpointer source;
+  GDestroyNotify source_free;
+  gchar *source_id;
+  gboolean source_failed; // So not to keep trying
 
   gint click_x, click_y;
   changeable_widgets cw;
@@ -239,6 +261,14 @@ static const gchar* georef_layer_tooltip ( VikGeorefLayer *vgl )
   return vgl->image;
 }
 
+static void georef_layer_get_memory ( VikGeorefLayer *vgl, VikLayerMemory *mem )
+{
+  mapcache_stats_t stats;
+  a_mapcache_get_stats_layer ( vgl, &stats );
+  mem->bytes[VIK_LAYER_MEMORY_IMAGES] += ui_pixbuf_get_bytes ( vgl->pixbuf );
+  mem->bytes[VIK_LAYER_MEMORY_CACHES] += ui_pixbuf_get_bytes ( vgl->scaled ) + stats.bytes;
+}
+
 static void georef_layer_marshall( VikGeorefLayer *vgl, guint8 **data, guint *len )
 {
   vik_layer_marshall_params ( VIK_LAYER(vgl), data, len );
@@ -273,10 +303,24 @@ static gboolean georef_layer_set_param ( VikGeorefLayer *vgl, VikLayerSetParam *
 
 static void create_image_file ( VikGeorefLayer *vgl )
 {
+  GError *error = NULL;
+  GdkPixbuf *pixbuf = NULL;
+  if ( vgl->pixbuf )
+    pixbuf = g_object_ref ( vgl->pixbuf );
+  else {
+    // Only now is the whole image needed
+    pixbuf = vgl->source_load ( vgl->source, 1, &error );
+    if ( !pixbuf ) {
+      g_warning ( "%s: %s", __FUNCTION__, error ? error->message : vgl->source_id );
+      g_clear_error ( &error );
+      return;
+    }
+  }
+
   // Create in .viking-maps
   gchar *filename = g_strconcat ( maps_layer_default_dir(), vik_layer_get_name(VIK_LAYER(vgl)), ".jpg", NULL );
-  GError *error = NULL;
-  gdk_pixbuf_save ( vgl->pixbuf, filename, "jpeg", &error, NULL );
+  gdk_pixbuf_save ( pixbuf, filename, "jpeg", &error, NULL );
+  g_object_unref ( pixbuf );
   if ( error ) {
     g_warning ( "%s", error->message );
     g_error_free ( error );
@@ -295,7 +339,7 @@ static VikLayerParamData georef_layer_get_param ( VikGeorefLayer *vgl, guint16 i
     case PARAM_IMAGE: {
       gboolean set = FALSE;
       if ( is_file_operation ) {
-        if ( vgl->pixbuf && !vgl->image ) {
+        if ( (vgl->pixbuf || vgl->source) && !vgl->image ) {
           // Force creation of image file
           create_image_file ( vgl );
         }
@@ -328,6 +372,7 @@ static VikGeorefLayer *georef_layer_new ( VikViewport *vvp )
 {
   VikGeorefLayer *vgl = VIK_GEOREF_LAYER ( g_object_new ( VIK_GEOREF_LAYER_TYPE, NULL ) );
   vik_layer_set_type ( VIK_LAYER(vgl), VIK_LAYER_GEOREF );
+  a_mapcache_add_layer ( vgl );
 
   // Since GeoRef layer doesn't use uibuilder
   //  initializing this way won't do anything yet..
@@ -345,6 +390,11 @@ static VikGeorefLayer *georef_layer_new ( VikViewport *vvp )
   vgl->scaled = NULL;
   vgl->scaled_width = 0;
   vgl->scaled_height = 0;
+  vgl->scaled_x = 0;
+  vgl->scaled_y = 0;
+  vgl->pyramid_dir = NULL;
+  vgl->pyramid_levels = 0;
+  vgl->pyramid_job = NULL;
   vgl->ll_br.lat = 0.0;
   vgl->ll_br.lon = 0.0;
   vgl->alpha = 255;
@@ -399,12 +449,372 @@ static void georef_layer_mpp_from_coords ( VikCoordMode mode, struct LatLon ll_t
   *ympp = (diffy / height) / factor;
 }
 
-static void georef_layer_draw ( VikGeorefLayer *vgl, VikViewport *vp )
+/*
+ * Tile pyramid
+ *
+ * Large images are cut once into tiles at the full size and at each halving of it,
+ *  stored on disk next to the map tiles. Then only the visible tiles of the overview
+ *  closest to the current zoom need to be read (into the map cache) and scaled,
+ *  rather than holding and rescaling the whole image.
+ */
+#define VIK_SETTINGS_GEOREF_TILE_THRESHOLD "georef_tile_threshold"
+#define GEOREF_TILE_THRESHOLD_DEFAULT 4096
+#define GEOREF_TILE_SIZE 256
+#define GEOREF_PYRAMID_INFO "pyramid.txt"
+// Beyond 1/8 a JPEG decoder has to scale after decoding anyway
+#define GEOREF_SOURCE_MAX_SHRINK 8
+
+struct _GeorefPyramidJob {
+  VikGeorefLayer *vgl; // NULL when the layer no longer wants it
+  gchar *image;
+  gchar *dir;
+  guint width, height;
+  guint levels;
+  gboolean complete;
+};
+
+/**
+ * Images with a side larger than this number of pixels use a tile pyramid
+ */
+static gint georef_tile_threshold ( void )
+{
+  gint threshold = GEOREF_TILE_THRESHOLD_DEFAULT;
+  (void)a_settings_get_integer ( VIK_SETTINGS_GEOREF_TILE_THRESHOLD, &threshold );
+  return threshold;
+}
+
+/**
+ * Where the pyramid of the image is kept,
+ *  such that a changed image file gets a new pyramid
+ */
+static gchar *georef_pyramid_dir ( const gchar *image )
+{
+  GStatBuf st;
+  if ( g_stat ( image, &st ) != 0 )
+    return NULL;
+  gchar *key = g_strdup_printf ( "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT, image, (gint64)st.st_size, (gint64)st.st_mtime );
+  gchar *checksum = g_compute_checksum_for_string ( G_CHECKSUM_SHA1, key, -1 );
+  gchar *dir = g_build_filename ( maps_layer_default_dir(), "georef", checksum, NULL );
+  g_free ( checksum );
+  g_free ( key );
+  return dir;
+}
+
+static gchar *georef_pyramid_tile_filename ( const gchar *dir, guint level, gint tx, gint ty )
+{
+  return g_strdup_printf ( "%s%c%u%c%d_%d.png", dir, G_DIR_SEPARATOR, level, G_DIR_SEPARATOR, tx, ty );
+}
+
+/**
+ * Number of levels until the image fits in a single tile
+ */
+static guint georef_pyramid_levels ( guint width, guint height )
+{
+  guint levels = 1;
+  while ( width > GEOREF_TILE_SIZE || height > GEOREF_TILE_SIZE ) {
+    width = (width + 1) / 2;
+    height = (height + 1) / 2;
+    levels++;
+  }
+  return levels;
+}
+
+/**
+ * The info file is written last, so it only exists for a complete pyramid
+ */
+static gboolean georef_pyramid_is_complete ( const gchar *dir, guint width, guint height, guint levels )
+{
+  gchar *fn = g_build_filename ( dir, GEOREF_PYRAMID_INFO, NULL );
+  gchar *contents = NULL;
+  gboolean ans = FALSE;
+  if ( g_file_get_contents ( fn, &contents, NULL, NULL ) ) {
+    guint ww, hh, ll, tt;
+    if ( sscanf ( contents, "%u %u %u %u", &ww, &hh, &ll, &tt ) == 4 )
+      ans = ( ww == width && hh == height && ll == levels && tt == GEOREF_TILE_SIZE );
+    g_free ( contents );
+  }
+  g_free ( fn );
+  return ans;
+}
+
+static void georef_pyramid_thread ( GeorefPyramidJob *job, gpointer threaddata )
+{
+  GError *error = NULL;
+  GdkPixbuf *level = gdk_pixbuf_new_from_file ( job->image, &error );
+  if ( !level ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+    return;
+  }
+
+  guint total = 0;
+  guint ww = job->width, hh = job->height;
+  for ( guint zz = 0; zz < job->levels; zz++ ) {
+    total += ((ww + GEOREF_TILE_SIZE - 1) / GEOREF_TILE_SIZE) * ((hh + GEOREF_TILE_SIZE - 1) / GEOREF_TILE_SIZE);
+    ww = (ww + 1) / 2;
+    hh = (hh + 1) / 2;
+  }
+
+  guint done = 0;
+  gboolean ok = TRUE;
+  for ( guint zz = 0; ok && zz < job->levels; zz++ ) {
+    gchar *level_dir = g_strdup_printf ( "%s%c%u", job->dir, G_DIR_SEPARATOR, zz );
+    if ( g_mkdir_with_parents ( level_dir, 0777 ) != 0 ) {
+      g_warning ( "%s: Could not create %s", __FUNCTION__, level_dir );
+      ok = FALSE;
+    }
+    g_free ( level_dir );
+
+    const gint level_width = gdk_pixbuf_get_width ( level );
+    const gint level_height = gdk_pixbuf_get_height ( level );
+    for ( gint ty = 0; ok && ty * GEOREF_TILE_SIZE < level_height; ty++ ) {
+      for ( gint tx = 0; ok && tx * GEOREF_TILE_SIZE < level_width; tx++ ) {
+        GdkPixbuf *tile = gdk_pixbuf_new_subpixbuf ( level, tx * GEOREF_TILE_SIZE, ty * GEOREF_TILE_SIZE,
+                                                     MIN(GEOREF_TILE_SIZE, level_width - tx * GEOREF_TILE_SIZE),
+                                                     MIN(GEOREF_TILE_SIZE, level_height - ty * GEOREF_TILE_SIZE) );
+        gchar *fn = georef_pyramid_tile_filename ( job->dir, zz, tx, ty );
+        // Favour speed over size, these are only a cache
+        if ( !gdk_pixbuf_save ( tile, fn, "png", &error, "compression", "1", NULL ) ) {
+          g_warning ( "%s: %s", __FUNCTION__, error->message );
+          g_clear_error ( &error );
+          ok = FALSE;
+        }
+        g_free ( fn );
+        g_object_unref ( tile );
+        done++;
+        if ( a_background_thread_progress ( threaddata, (gdouble)done / total ) != 0 )
+          ok = FALSE; // Cancelled
+      }
+    }
+
+    if ( ok && zz + 1 < job->levels ) {
+      GdkPixbuf *next = gdk_pixbuf_scale_simple ( level, MAX(1, (level_width + 1) / 2), MAX(1, (level_height + 1) / 2), GDK_INTERP_BILINEAR );
+      g_object_unref ( level );
+      level = next;
+      ok = ( level != NULL );
+    }
+  }
+  if ( level )
+    g_object_unref ( level );
+
+  if ( ok ) {
+    gchar *fn = g_build_filename ( job->dir, GEOREF_PYRAMID_INFO, NULL );
+    gchar *contents = g_strdup_printf ( "%u %u %u %u\n", job->width, job->height, job->levels, GEOREF_TILE_SIZE );
+    if ( g_file_set_contents ( fn, contents, -1, &error ) )
+      job->complete = TRUE;
+    else {
+      g_warning ( "%s: %s", __FUNCTION__, error->message );
+      g_error_free ( error );
+    }
+    g_free ( contents );
+    g_free ( fn );
+  }
+}
+
+/**
+ * In the main thread, start using the pyramid if the layer still wants it
+ */
+static gboolean georef_pyramid_done ( gpointer data )
+{
+  GeorefPyramidJob *job = data;
+  VikGeorefLayer *vgl = job->vgl;
+  if ( vgl ) {
+    vgl->pyramid_job = NULL;
+    if ( job->complete ) {
+      vgl->pyramid_dir = job->dir;
+      job->dir = NULL;
+      vgl->pyramid_levels = job->levels;
+      vik_layer_emit_update ( VIK_LAYER(vgl) );
+    }
+  }
+  g_free ( job->image );
+  g_free ( job->dir );
+  g_free ( job );
+  return FALSE;
+}
+
+static void georef_pyramid_job_free ( GeorefPyramidJob *job )
+{
+  // Runs in the background thread
+  gdk_threads_add_idle ( georef_pyramid_done, job );
+}
+
+/**
+ * Stop using any pyramid, leaving any build of one to complete for next time
+ */
+static void georef_layer_pyramid_clear ( VikGeorefLayer *vgl )
+{
+  if ( vgl->pyramid_job ) {
+    vgl->pyramid_job->vgl = NULL;
+    vgl->pyramid_job = NULL;
+  }
+  g_free ( vgl->pyramid_dir );
+  vgl->pyramid_dir = NULL;
+  vgl->pyramid_levels = 0;
+}
+
+/**
+ * Use the existing pyramid for the image, or start building it
+ *
+ * Returns: FALSE if the image should be loaded directly instead
+ */
+static gboolean georef_layer_pyramid_load ( VikGeorefLayer *vgl, guint width, guint height )
+{
+  gchar *dir = georef_pyramid_dir ( vgl->image );
+  if ( !dir )
+    return FALSE;
+
+  vgl->width = width;
+  vgl->height = height;
+  guint levels = georef_pyramid_levels ( width, height );
+  if ( georef_pyramid_is_complete ( dir, width, height, levels ) ) {
+    vgl->pyramid_dir = dir;
+    vgl->pyramid_levels = levels;
+    return TRUE;
+  }
+
+  GeorefPyramidJob *job = g_malloc0 ( sizeof(GeorefPyramidJob) );
+  job->vgl = vgl;
+  job->image = g_strdup ( vgl->image );
+  job->dir = dir;
+  job->width = width;
+  job->height = height;
+  job->levels = levels;
+  vgl->pyramid_job = job;
+
+  gchar *basename = g_path_get_basename ( vgl->image );
+  gchar *msg = g_strdup_printf ( _("Preparing tiles of %s"), basename );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(vgl),
+                        msg,
+                        (vik_thr_func) georef_pyramid_thread,
+                        job,
+                        (vik_thr_free_func) georef_pyramid_job_free,
+                        NULL,
+                        1 );
+  g_free ( msg );
+  g_free ( basename );
+  return TRUE;
+}
+
+/**
+ * Draw the visible tiles from the overview closest to (but not less than) the display resolution
+ *
+ * @x, @y:                        Screen position of the top left of the image
+ * @layer_width, @layer_height:  Size of the whole image on the screen
+ */
+static void georef_layer_draw_tiles ( VikGeorefLayer *vgl, VikViewport *vp, gint x, gint y, guint layer_width, guint layer_height )
+{
+  const gint vp_width = vik_viewport_get_width ( vp );
+  const gint vp_height = vik_viewport_get_height ( vp );
+
+  // Image pixels per screen pixel
+  const gdouble shrink = MIN ( (gdouble)vgl->width / layer_width, (gdouble)vgl->height / layer_height );
+  guint zz = 0;
+  guint level_width = vgl->width, level_height = vgl->height;
+  while ( zz + 1 < vgl->pyramid_levels && (gdouble)(1 << (zz + 1)) <= shrink ) {
+    level_width = (level_width + 1) / 2;
+    level_height = (level_height + 1) / 2;
+    zz++;
+  }
+  const gdouble scale_x = (gdouble)layer_width / level_width;
+  const gdouble scale_y = (gdouble)layer_height / level_height;
+
+  const gint tx0 = MAX ( 0, (gint)floor(-x / scale_x / GEOREF_TILE_SIZE) );
+  const gint tx1 = MIN ( (gint)((level_width - 1) / GEOREF_TILE_SIZE), (gint)floor((vp_width - x) / scale_x / GEOREF_TILE_SIZE) );
+  const gint ty0 = MAX ( 0, (gint)floor(-y / scale_y / GEOREF_TILE_SIZE) );
+  const gint ty1 = MIN ( (gint)((level_height - 1) / GEOREF_TILE_SIZE), (gint)floor((vp_height - y) / scale_y / GEOREF_TILE_SIZE) );
+
+  for ( gint tx = tx0; tx <= tx1; tx++ ) {
+    // Edges from the same calculation for neighbouring tiles, so they abut exactly
+    const gint sx0 = x + (gint)floor ( tx * GEOREF_TILE_SIZE * scale_x );
+    const gint sx1 = x + (gint)floor ( MIN((guint)(tx + 1) * GEOREF_TILE_SIZE, level_width) * scale_x );
+    for ( gint ty = ty0; ty <= ty1; ty++ ) {
+      const gint sy0 = y + (gint)floor ( ty * GEOREF_TILE_SIZE * scale_y );
+      const gint sy1 = y + (gint)floor ( MIN((guint)(ty + 1) * GEOREF_TILE_SIZE, level_height) * scale_y );
+      if ( sx1 <= sx0 || sy1 <= sy0 )
+        continue;
+
+      GdkPixbuf *tile = a_mapcache_get ( tx, ty, zz, MAP_ID_GEOREF_TILES, 0, vgl->alpha, scale_x, scale_y, vgl->pyramid_dir, vgl );
+      if ( !tile ) {
+        gchar *fn = georef_pyramid_tile_filename ( vgl->pyramid_dir, zz, tx, ty );
+        tile = gdk_pixbuf_new_from_file ( fn, NULL );
+        g_free ( fn );
+        if ( !tile )
+          continue;
+        if ( vgl->alpha < 255 )
+          tile = ui_pixbuf_set_alpha ( tile, vgl->alpha );
+        if ( tile && (gdk_pixbuf_get_width(tile) != sx1 - sx0 || gdk_pixbuf_get_height(tile) != sy1 - sy0) ) {
+          GdkPixbuf *scaled = gdk_pixbuf_scale_simple ( tile, sx1 - sx0, sy1 - sy0, GDK_INTERP_BILINEAR );
+          g_object_unref ( tile );
+          tile = scaled;
+        }
+        if ( !tile )
+          continue;
+        a_mapcache_add ( tile, (mapcache_extra_t) { 0.0 }, tx, ty, zz, MAP_ID_GEOREF_TILES, 0, vgl->alpha, scale_x, scale_y, vgl->pyramid_dir, vgl );
+      }
+      vik_viewport_draw_pixbuf ( vp, tile, 0, 0, sx0, sy0, sx1 - sx0, sy1 - sy0 );
+      g_object_unref ( tile );
+    }
+  }
+}
+
+/**
+ * Decode the source image at the smallest power of two reduction that is still at least the display resolution
+ *  (for a JPEG only this fraction of the DCT is then done)
+ * The decoded images are kept in the map cache, so evicted with the map tiles when memory is needed
+ *
+ * @layer_width, @layer_height:  Size of the whole image on the screen
+ */
+static GdkPixbuf *georef_layer_source_get ( VikGeorefLayer *vgl, guint layer_width, guint layer_height )
+{
+  if ( vgl->source_failed )
+    return NULL;
+
+  // Image pixels per screen pixel
+  const gdouble shrink = MIN ( (gdouble)vgl->width / layer_width, (gdouble)vgl->height / layer_height );
+  guint zz = 0;
+  while ( zz < GEOREF_SOURCE_MAX_SHRINK && (gdouble)(1 << (zz + 1)) <= shrink &&
+          (vgl->width >> (zz + 1)) > 0 && (vgl->height >> (zz + 1)) > 0 )
+    zz++;
+
+  GdkPixbuf *pixbuf = a_mapcache_get ( -1, -1, zz, MAP_ID_GEOREF_TILES, 0, vgl->alpha, 0.0, 0.0, vgl->source_id, vgl );
+  if ( pixbuf )
+    return pixbuf;
+
+  GError *error = NULL;
+  pixbuf = vgl->source_load ( vgl->source, 1 << zz, &error );
+  if ( !pixbuf ) {
+    g_warning ( "%s: %s", __FUNCTION__, error ? error->message : vgl->source_id );
+    g_clear_error ( &error );
+    vgl->source_failed = TRUE;
+    return NULL;
+  }
+  if ( vgl->alpha < 255 )
+    pixbuf = ui_pixbuf_set_alpha ( pixbuf, vgl->alpha );
+  if ( pixbuf )
+    a_mapcache_add ( pixbuf, (mapcache_extra_t) { 0.0 }, -1, -1, zz, MAP_ID_GEOREF_TILES, 0, vgl->alpha, 0.0, 0.0, vgl->source_id, vgl );
+  return pixbuf;
+}
+
+/**
+ * Returns: A new reference to the image to scale for drawing at this size
+ */
+static GdkPixbuf *georef_layer_get_image ( VikGeorefLayer *vgl, guint layer_width, guint layer_height )
 {
   if ( vgl->pixbuf )
+    return g_object_ref ( vgl->pixbuf );
+  if ( vgl->source )
+    return georef_layer_source_get ( vgl, layer_width, layer_height );
+  return NULL;
+}
+
+static void georef_layer_draw ( VikGeorefLayer *vgl, VikViewport *vp )
+{
+  if ( vgl->pixbuf || vgl->pyramid_dir || vgl->source )
   {
     gdouble xmpp = vik_viewport_get_xmpp(vp), ympp = vik_viewport_get_ympp(vp);
-    GdkPixbuf *pixbuf = vgl->pixbuf;
+    GdkPixbuf *pixbuf = NULL;
     guint layer_width = vgl->width;
     guint layer_height = vgl->height;
 
@@ -430,19 +840,44 @@ static void georef_layer_draw ( VikGeorefLayer *vgl, VikViewport *vp )
     // If image not in viewport bounds - no need to draw it (or bother with any scaling)
     if ( (x < 0 || x < width) && (y < 0 || y < height) && x+layer_width > 0 && y+layer_height > 0 ) {
 
+      if ( vgl->pyramid_dir )
+      {
+        georef_layer_draw_tiles ( vgl, vp, x, y, layer_width, layer_height );
+        return;
+      }
+
       if ( scale )
       {
+        // Only scale the part of the image within the viewport,
+        //  so zooming right in does not create a huge image
+        const gint x0 = MAX ( 0, x );
+        const gint y0 = MAX ( 0, y );
+        const gint x1 = MIN ( (gint)width, x + (gint)layer_width );
+        const gint y1 = MIN ( (gint)height, y + (gint)layer_height );
+        if ( x1 <= x0 || y1 <= y0 )
+          return;
+
         /* rescale if necessary */
-        if (layer_width == vgl->scaled_width && layer_height == vgl->scaled_height && vgl->scaled != NULL)
+        if ( vgl->scaled != NULL &&
+             layer_width == vgl->scaled_width && layer_height == vgl->scaled_height &&
+             x == vgl->scaled_x && y == vgl->scaled_y &&
+             x1 - x0 == gdk_pixbuf_get_width(vgl->scaled) && y1 - y0 == gdk_pixbuf_get_height(vgl->scaled) )
           pixbuf = vgl->scaled;
         else
         {
-          pixbuf = gdk_pixbuf_scale_simple(
-            vgl->pixbuf,
-            layer_width,
-            layer_height,
-            GDK_INTERP_BILINEAR
-          );
+          GdkPixbuf *image = georef_layer_get_image ( vgl, layer_width, layer_height );
+          if ( !image )
+            return;
+          pixbuf = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, gdk_pixbuf_get_has_alpha(image), 8, x1 - x0, y1 - y0 );
+          if ( !pixbuf ) {
+            g_object_unref ( image );
+            return;
+          }
+          gdk_pixbuf_scale ( image, pixbuf, 0, 0, x1 - x0, y1 - y0, x - x0, y - y0,
+                             (gdouble)layer_width / gdk_pixbuf_get_width(image),
+                             (gdouble)layer_height / gdk_pixbuf_get_height(image),
+                             GDK_INTERP_BILINEAR );
+          g_object_unref ( image );
 
           if (vgl->scaled != NULL)
             g_object_unref(vgl->scaled);
@@ -450,21 +885,36 @@ static void georef_layer_draw ( VikGeorefLayer *vgl, VikViewport *vp )
           vgl->scaled = pixbuf;
           vgl->scaled_width = layer_width;
           vgl->scaled_height = layer_height;
+          vgl->scaled_x = x;
+          vgl->scaled_y = y;
+        }
+        vik_viewport_draw_pixbuf ( vp, pixbuf, 0, 0, x0, y0, x1 - x0, y1 - y0 );
+      }
+      else
+      {
+        pixbuf = georef_layer_get_image ( vgl, layer_width, layer_height );
+        if ( pixbuf ) {
+          vik_viewport_draw_pixbuf ( vp, pixbuf, 0, 0, x, y, layer_width, layer_height );
+          g_object_unref ( pixbuf );
         }
       }
-      vik_viewport_draw_pixbuf ( vp, pixbuf, 0, 0, x, y, layer_width, layer_height ); /* todo: draw only what we need to. */
     }
   }
 }
 
 static void georef_layer_free ( VikGeorefLayer *vgl )
 {
+  georef_layer_pyramid_clear ( vgl );
+  a_mapcache_remove_layer ( vgl );
   if ( vgl->image )
     g_free ( vgl->image );
   if ( vgl->scaled )
     g_object_unref ( vgl->scaled );
   if ( vgl->pixbuf )
     g_object_unref ( vgl->pixbuf );
+  if ( vgl->source && vgl->source_free )
+    vgl->source_free ( vgl->source );
+  g_free ( vgl->source_id );
 }
 
 static VikGeorefLayer *georef_layer_create ( VikViewport *vp )
@@ -484,14 +934,28 @@ static void georef_layer_load_image ( VikGeorefLayer *vgl, VikViewport *vp, gboo
     return;
 
   if ( vgl->pixbuf )
+  {
     g_object_unref ( G_OBJECT(vgl->pixbuf) );
+    vgl->pixbuf = NULL;
+  }
   if ( vgl->scaled )
   {
     g_object_unref ( G_OBJECT(vgl->scaled) );
     vgl->scaled = NULL;
   }
+  georef_layer_pyramid_clear ( vgl );
+
+  // Large images are not loaded here, but drawn from tiles of them
+  gint file_width, file_height;
+  gint threshold = georef_tile_threshold ();
+  if ( threshold > 0 && gdk_pixbuf_get_file_info ( vgl->image, &file_width, &file_height ) &&
+       MAX(file_width, file_height) > threshold )
+    if ( georef_layer_pyramid_load ( vgl, file_width, file_height ) )
+      return;
 
-  vgl->pixbuf = gdk_pixbuf_new_from_file ( vgl->image, &gx );
+  // Shared with any other layer showing the same image, e.g. in another window
+  vgl->pixbuf = a_image_cache_load ( vgl->image, vgl->alpha, &gx );
+  vgl->pixbuf_shared = (vgl->pixbuf != NULL);
 
   if (gx)
   {
@@ -503,15 +967,13 @@ static void georef_layer_load_image ( VikGeorefLayer *vgl, VikViewport *vp, gboo
   {
     vgl->width = gdk_pixbuf_get_width ( vgl->pixbuf );
     vgl->height = gdk_pixbuf_get_height ( vgl->pixbuf );
-
-    if ( vgl->pixbuf && vgl->alpha <= 255 )
-      vgl->pixbuf = ui_pixbuf_set_alpha ( vgl->pixbuf, vgl->alpha );
   }
   /* should find length and width here too */
 }
 
 static void georef_layer_set_image ( VikGeorefLayer *vgl, const gchar *image )
 {
+  georef_layer_pyramid_clear ( vgl );
   if ( vgl->image )
     g_free ( vgl->image );
   if ( vgl->scaled )
@@ -985,7 +1447,7 @@ static gboolean georef_layer_dialog ( VikGeorefLayer *vgl, gpointer vp, GtkWindo
       vgl->ll_br = get_ll_br (vgl);
       check_br_is_good_or_msg_user ( vgl );
       // TODO check if image has changed otherwise no need to regenerate pixbuf
-      if ( !vgl->pixbuf ) {
+      if ( !vgl->pixbuf && !vgl->source ) {
         if ( g_strcmp0 (vgl->image, vik_file_entry_get_filename(VIK_FILE_ENTRY(cw.imageentry)) ) != 0 ) {
           georef_layer_set_image ( vgl, vik_file_entry_get_filename(VIK_FILE_ENTRY(cw.imageentry)) );
           georef_layer_load_image ( vgl, VIK_VIEWPORT(vp), FALSE );
@@ -993,7 +1455,15 @@ static gboolean georef_layer_dialog ( VikGeorefLayer *vgl, gpointer vp, GtkWindo
       }
 
       vgl->alpha = (guint8) gtk_range_get_value ( GTK_RANGE(alpha_scale) );
-      if ( vgl->pixbuf && vgl->alpha <= 255 )
+      if ( vgl->pixbuf && vgl->pixbuf_shared ) {
+        // Rather than changing the image others may be using, get the one with this alpha
+        GdkPixbuf *pixbuf = a_image_cache_load ( vgl->image, vgl->alpha, NULL );
+        if ( pixbuf ) {
+          g_object_unref ( vgl->pixbuf );
+          vgl->pixbuf = pixbuf;
+        }
+      }
+      else if ( vgl->pixbuf && vgl->alpha <= 255 )
         vgl->pixbuf = ui_pixbuf_set_alpha ( vgl->pixbuf, vgl->alpha );
       if ( vgl->scaled && vgl->alpha <= 255 )
         vgl->scaled = ui_pixbuf_set_alpha ( vgl->scaled, vgl->alpha );
@@ -1125,6 +1595,40 @@ static void goto_center_ll ( VikViewport *vp,
   vik_viewport_set_center_coord ( vp, &vc_center, TRUE );
 }
 
+/**
+ * Position the layer (of known width and height) between the corners, and show it
+ *
+ * Returns: FALSE if the image has no size
+ */
+static gboolean georef_layer_place ( VikGeorefLayer *vgl, VikViewport *vp, VikCoord *coord_tl, VikCoord *coord_br )
+{
+  vik_coord_to_utm ( coord_tl, &(vgl->corner) );
+  vik_coord_to_latlon ( coord_br, &(vgl->ll_br) );
+
+  if ( vgl->width > 0 && vgl->height > 0 ) {
+
+    struct LatLon ll_tl;
+    vik_coord_to_latlon ( coord_tl, &ll_tl);
+    struct LatLon ll_br;
+    vik_coord_to_latlon ( coord_br, &ll_br);
+
+    VikCoordMode mode = vik_viewport_get_coord_mode (vp);
+
+    gdouble xmpp, ympp;
+    georef_layer_mpp_from_coords ( mode, ll_tl, ll_br, vgl->width, vgl->height, &xmpp, &ympp );
+    vgl->mpp_easting = xmpp;
+    vgl->mpp_northing = ympp;
+
+    goto_center_ll ( vp, ll_tl, ll_br);
+    // Set best zoom level
+    struct LatLon maxmin[2] = { ll_tl, ll_br };
+    vu_zoom_to_show_latlons ( vik_viewport_get_coord_mode(vp), vp, maxmin );
+
+    return TRUE;
+  }
+  return FALSE;
+}
+
 /**
  * vik_georef_layer_create:
  *
@@ -1143,35 +1647,48 @@ VikGeorefLayer *vik_georef_layer_create ( VikViewport *vp,
 
   vgl->pixbuf = pixbuf;
 
-  vik_coord_to_utm ( coord_tl, &(vgl->corner) );
-  vik_coord_to_latlon ( coord_br, &(vgl->ll_br) );
-
   if ( vgl->pixbuf ) {
     vgl->width = gdk_pixbuf_get_width ( vgl->pixbuf );
     vgl->height = gdk_pixbuf_get_height ( vgl->pixbuf );
 
-    if ( vgl->width > 0 && vgl->height > 0 ) {
-
-      struct LatLon ll_tl;
-      vik_coord_to_latlon ( coord_tl, &ll_tl);
-      struct LatLon ll_br;
-      vik_coord_to_latlon ( coord_br, &ll_br);
+    if ( georef_layer_place ( vgl, vp, coord_tl, coord_br ) )
+      return vgl;
+  }
 
-      VikCoordMode mode = vik_viewport_get_coord_mode (vp);
+  // Bad image
+  georef_layer_free ( vgl );
+  return NULL;
+}
 
-      gdouble xmpp, ympp;
-      georef_layer_mpp_from_coords ( mode, ll_tl, ll_br, vgl->width, vgl->height, &xmpp, &ympp );
-      vgl->mpp_easting = xmpp;
-      vgl->mpp_northing = ympp;
+/**
+ * vik_georef_layer_create_from_source:
+ *
+ * Nothing is decoded until the layer is drawn, so many large images can be opened quickly
+ */
+VikGeorefLayer *vik_georef_layer_create_from_source ( VikViewport *vp,
+                                                      VikLayersPanel *vlp,
+                                                      const gchar *name,
+                                                      guint width,
+                                                      guint height,
+                                                      VikGeorefSourceFunc load,
+                                                      gpointer source,
+                                                      GDestroyNotify source_free,
+                                                      const gchar *source_id,
+                                                      VikCoord *coord_tl,
+                                                      VikCoord *coord_br )
+{
+  VikGeorefLayer *vgl = georef_layer_new ( vp );
+  vik_layer_rename ( VIK_LAYER(vgl), name );
 
-      goto_center_ll ( vp, ll_tl, ll_br);
-      // Set best zoom level
-      struct LatLon maxmin[2] = { ll_tl, ll_br };
-      vu_zoom_to_show_latlons ( vik_viewport_get_coord_mode(vp), vp, maxmin );
+  vgl->source_load = load;
+  vgl->source = source;
+  vgl->source_free = source_free;
+  vgl->source_id = g_strdup ( source_id );
+  vgl->width = width;
+  vgl->height = height;
 
-      return vgl;
-    }
-  }
+  if ( georef_layer_place ( vgl, vp, coord_tl, coord_br ) )
+    return vgl;
 
   // Bad image
   georef_layer_free ( vgl );
@@ -51,6 +51,24 @@ VikGeorefLayer *vik_georef_layer_create ( VikViewport *vp,
                                           VikCoord *coord_tr,
                                           VikCoord *coord_br );
 
+// Decode the image with its width and height divided by shrink (at least 1 pixel)
+typedef GdkPixbuf* (*VikGeorefSourceFunc) ( gpointer source, guint shrink, GError **error );
+
+// For an image that is only decoded when drawn, and then at no more than the resolution drawn at
+// source_id: Identifies the image in the map cache
+// The layer takes ownership of source, freeing it with source_free
+VikGeorefLayer *vik_georef_layer_create_from_source ( VikViewport *vp,
+                                                      VikLayersPanel *vlp,
+                                                      const gchar *name,
+                                                      guint width,
+                                                      guint height,
+                                                      VikGeorefSourceFunc load,
+                                                      gpointer source,
+                                                      GDestroyNotify source_free,
+                                                      const gchar *source_id,
+                                                      VikCoord *coord_tl,
+                                                      VikCoord *coord_br );
+
 G_END_DECLS
 
 #endif
@@ -24,6 +24,7 @@
 #include "vikgototool.h"
 #include "vikgoto.h"
 #include "background.h"
+#include "placeindex.h"
 
 static gchar *last_goto_str = NULL;
 static VikCoord *last_coord = NULL;
@@ -399,6 +400,8 @@ struct _VikGotoPanel {
   GtkTreeView *results_view;
   GtkListStore *results_store;
   VikLayersPanel *vlp;
+  guint generation;   // Of the latest search, so any slower earlier results are not shown
+  guint typing_timer;
 };
 
 static void vik_goto_panel_init ( VikGotoPanel *vgp )
@@ -408,6 +411,8 @@ static void vik_goto_panel_init ( VikGotoPanel *vgp )
 static void goto_panel_finalize ( GObject *gob )
 {
   VikGotoPanel *vgp = VIK_GOTO_PANEL ( gob );
+  if ( vgp->typing_timer )
+    g_source_remove ( vgp->typing_timer );
   g_object_unref ( vgp->results_store );
   G_OBJECT_CLASS(parent_class)->finalize(gob);
 }
@@ -435,6 +440,8 @@ typedef struct {
   gchar *goto_str;
   VikViewport *vvp;
   VikGotoPanel *vgp;
+  guint generation;
+  gboolean offline;
   // Protection in case owning window is closed whilst thread is in progress
   // c.f. weak refs used in vikmapslayer.c
   gboolean alive;
@@ -470,6 +477,12 @@ static gboolean _idle_update ( gpointer user_data )
   SearchThreadT *stt = (SearchThreadT*)user_data;
   VikGotoPanel *vgp = stt->vgp;
 
+  // Superseded by a search on what has been typed since
+  if ( stt->generation != vgp->generation ) {
+    stt_free ( stt );
+    return FALSE;
+  }
+
   gtk_list_store_clear ( vgp->results_store );
 
   GtkTreeViewColumn *desc_col = gtk_tree_view_get_column ( GTK_TREE_VIEW(vgp->results_view), VIK_GOTO_SEARCH_DESC_COL );
@@ -496,7 +509,7 @@ static gboolean _idle_update ( gpointer user_data )
     gtk_tree_view_column_set_title ( desc_col, _("No results") );
 
   if ( stt->answer != 0 )
-    gtk_tree_view_column_set_title ( desc_col, _("Service request failure") );
+    gtk_tree_view_column_set_title ( desc_col, stt->offline ? _("Search unavailable") : _("Service request failure") );
 
   gtk_widget_set_sensitive ( vgp->find_button, TRUE );
 
@@ -530,8 +543,50 @@ static int get_locations_thread ( SearchThreadT *stt, gpointer threaddata )
   return 0;
 }
 
+#define GOTO_PANEL_MAX_WAYPOINTS 20
+
+/**
+ * Waypoints with a name matching the search, which can't be in any offline index
+ */
+static GList *goto_panel_find_waypoints ( VikGotoPanel *vgp, const gchar *srch_str )
+{
+  GList *candidates = NULL;
+  guint count = 0;
+  gchar *query = a_place_index_normalize ( srch_str );
+  GList *layers = vik_layers_panel_get_all_layers_of_type ( vgp->vlp, VIK_LAYER_TRW, TRUE );
+  for ( GList *iter = layers; iter && count < GOTO_PANEL_MAX_WAYPOINTS; iter = iter->next ) {
+    VikTrwLayer *vtl = VIK_TRW_LAYER(iter->data);
+    GHashTableIter wpi;
+    gpointer value;
+    g_hash_table_iter_init ( &wpi, vik_trw_layer_get_waypoints(vtl) );
+    while ( count < GOTO_PANEL_MAX_WAYPOINTS && g_hash_table_iter_next ( &wpi, NULL, &value ) ) {
+      VikWaypoint *wp = VIK_WAYPOINT(value);
+      if ( !wp->name )
+        continue;
+      gchar *name = a_place_index_normalize ( wp->name );
+      if ( a_place_index_name_matches ( name, query ) ) {
+        struct VikGotoCandidate *cand = g_malloc ( sizeof(struct VikGotoCandidate) );
+        cand->description = g_strdup_printf ( "%s (%s)", wp->name, vik_layer_get_name(VIK_LAYER(vtl)) );
+        vik_coord_to_latlon ( &wp->coord, &cand->ll );
+        candidates = g_list_prepend ( candidates, cand );
+        count++;
+      }
+      g_free ( name );
+    }
+  }
+  g_list_free ( layers );
+  g_free ( query );
+  return g_list_reverse ( candidates );
+}
+
 static void goto_panel_search_response ( VikGotoPanel *vgp )
 {
+  // Already searching for what has been typed
+  if ( vgp->typing_timer ) {
+    g_source_remove ( vgp->typing_timer );
+    vgp->typing_timer = 0;
+  }
+
   gint atool = gtk_combo_box_get_active ( GTK_COMBO_BOX(vgp->tool_list) );
   if ( atool < 0 ) {
     g_critical ( "%s: %s", __FUNCTION__, "No goto provider" );
@@ -552,10 +607,13 @@ static void goto_panel_search_response ( VikGotoPanel *vgp )
   SearchThreadT *stt = g_malloc ( sizeof(SearchThreadT) );
 
   stt->tool = g_list_nth_data ( goto_tools_list, atool );
-  stt->candidates = NULL;
   stt->vvp = vik_layers_panel_get_viewport ( vgp->vlp );
   stt->vgp = vgp;
+  stt->generation = ++vgp->generation;
+  stt->offline = vik_goto_tool_searches_offline ( stt->tool );
   stt->goto_str = g_strdup ( gtk_entry_get_text ( GTK_ENTRY(vgp->goto_entry) ) );
+  // Own waypoints first, as the most likely to be wanted
+  stt->candidates = stt->offline ? goto_panel_find_waypoints ( vgp, stt->goto_str ) : NULL;
   stt->alive = TRUE;
   stt->mutex = vik_mutex_new();
 
@@ -563,7 +621,7 @@ static void goto_panel_search_response ( VikGotoPanel *vgp )
 
   g_object_weak_ref ( G_OBJECT(vgp->vlp), weak_ref_cb, stt );
 
-  a_background_thread ( BACKGROUND_POOL_REMOTE,
+  a_background_thread ( stt->offline ? BACKGROUND_POOL_LOCAL : BACKGROUND_POOL_REMOTE,
                         GTK_WINDOW(VIK_WINDOW(VIK_GTK_WINDOW_FROM_WIDGET(vgp->vlp))),
                         msg,
                         (vik_thr_func)get_locations_thread,
@@ -575,6 +633,38 @@ static void goto_panel_search_response ( VikGotoPanel *vgp )
   g_free ( msg );
 }
 
+static gboolean goto_panel_typing_timeout ( VikGotoPanel *vgp )
+{
+  vgp->typing_timer = 0;
+  goto_panel_search_response ( vgp );
+  return FALSE;
+}
+
+// Wait for a pause in the typing, rather than searching on every key press
+#define GOTO_PANEL_TYPING_DELAY 200
+
+/**
+ * Search as the text is typed, when the tool can answer quickly enough
+ */
+static void goto_panel_entry_changed ( GtkEditable *editable, VikGotoPanel *vgp )
+{
+  gint atool = gtk_combo_box_get_active ( GTK_COMBO_BOX(vgp->tool_list) );
+  if ( atool < 0 || !vik_goto_tool_searches_offline ( g_list_nth_data ( goto_tools_list, atool ) ) )
+    return;
+
+  if ( vgp->typing_timer )
+    g_source_remove ( vgp->typing_timer );
+  vgp->typing_timer = 0;
+
+  if ( gtk_entry_get_text_length ( GTK_ENTRY(vgp->goto_entry) ) > 0 )
+    vgp->typing_timer = g_timeout_add ( GOTO_PANEL_TYPING_DELAY, (GSourceFunc)goto_panel_typing_timeout, vgp );
+  else {
+    // Forget any search still in progress
+    vgp->generation++;
+    goto_panel_search_clear ( vgp );
+  }
+}
+
 /**
  *
  */
@@ -600,6 +690,7 @@ GtkWidget* vik_goto_panel_widget ( VikLayersPanel *vlp )
   gtk_widget_set_tooltip_text ( vgp->goto_entry, _("Enter address or place name:") );
   // 'find' when press return in the entry
   g_signal_connect_swapped ( vgp->goto_entry, "activate", G_CALLBACK(goto_panel_search_response), vgp );
+  g_signal_connect ( vgp->goto_entry, "changed", G_CALLBACK(goto_panel_entry_changed), vgp );
 
   vgp->results_store = gtk_list_store_new ( VIK_GOTO_SEARCH_NUM_COLS,
                                             G_TYPE_STRING,
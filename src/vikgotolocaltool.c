@@ -0,0 +1,273 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/**
+ * SECTION:vikgotolocaltool
+ * @short_description: A goto tool working offline
+ *
+ * The #VikGotoLocalTool class searches an index of place names built from
+ *  a geonames.org dump, without any network access.
+ * It is quick enough for the results to be updated while the search is typed.
+ *
+ * The index is built the first time the tool is used, and again whenever the dump is newer than it.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "dir.h"
+#include "placeindex.h"
+
+#include "vikgotolocaltool.h"
+
+// Enough to choose from, without filling the list with places that will never be picked
+#define GOTO_LOCAL_TOOL_MAX_CANDIDATES 50
+
+static void vik_goto_local_tool_finalize ( GObject *gob );
+
+static gboolean vik_goto_local_tool_search_offline ( VikGotoTool *self, const gchar *srch_str, GList **candidates );
+
+typedef struct _VikGotoLocalToolPrivate VikGotoLocalToolPrivate;
+struct _VikGotoLocalToolPrivate
+{
+  gchar *index_file;
+  gchar *geonames_file;
+
+  GMutex mutex;
+  PlaceIndex *index;
+  gboolean unusable; // Only report a problem with the index once
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE (VikGotoLocalTool, vik_goto_local_tool, VIK_GOTO_TOOL_TYPE)
+#define VIK_GOTO_LOCAL_TOOL_PRIVATE(o)  (vik_goto_local_tool_get_instance_private (VIK_GOTO_LOCAL_TOOL(o)))
+
+/* properties */
+enum
+{
+  PROP_0,
+
+  PROP_INDEX_FILE,
+  PROP_GEONAMES_FILE,
+};
+
+static void
+vik_goto_local_tool_set_property (GObject      *object,
+                          guint         property_id,
+                          const GValue *value,
+                          GParamSpec   *pspec)
+{
+  VikGotoLocalToolPrivate *priv = VIK_GOTO_LOCAL_TOOL_PRIVATE ( object );
+
+  switch (property_id)
+    {
+    case PROP_INDEX_FILE:
+      g_free (priv->index_file);
+      priv->index_file = g_strdup(g_value_get_string (value));
+      break;
+
+    case PROP_GEONAMES_FILE:
+      g_free (priv->geonames_file);
+      priv->geonames_file = g_strdup(g_value_get_string (value));
+      break;
+
+    default:
+      /* We don't have any other property... */
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+vik_goto_local_tool_get_property (GObject    *object,
+                          guint       property_id,
+                          GValue     *value,
+                          GParamSpec *pspec)
+{
+  VikGotoLocalToolPrivate *priv = VIK_GOTO_LOCAL_TOOL_PRIVATE ( object );
+
+  switch (property_id)
+    {
+    case PROP_INDEX_FILE:
+      g_value_set_string (value, priv->index_file);
+      break;
+
+    case PROP_GEONAMES_FILE:
+      g_value_set_string (value, priv->geonames_file);
+      break;
+
+    default:
+      /* We don't have any other property... */
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void vik_goto_local_tool_class_init ( VikGotoLocalToolClass *klass )
+{
+  GObjectClass *object_class;
+  VikGotoToolClass *parent_class;
+  GParamSpec *pspec = NULL;
+
+  object_class = G_OBJECT_CLASS (klass);
+
+  object_class->set_property = vik_goto_local_tool_set_property;
+  object_class->get_property = vik_goto_local_tool_get_property;
+  object_class->finalize = vik_goto_local_tool_finalize;
+
+  parent_class = VIK_GOTO_TOOL_CLASS (klass);
+
+  parent_class->search_offline = vik_goto_local_tool_search_offline;
+
+  /**
+   * VikGotoLocalTool:index-file:
+   *
+   * The place index, relative to the Viking directory unless absolute.
+   */
+  pspec = g_param_spec_string ("index-file",
+                               "Index file",
+                               "The place index file",
+                               NULL /* default value */,
+                               G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_INDEX_FILE, pspec);
+
+
+  /**
+   * VikGotoLocalTool:geonames-file:
+   *
+   * The geonames.org dump (e.g. cities1000.txt) to build the index from,
+   * relative to the Viking directory unless absolute.
+   * Without it the index file has to have been made already.
+   */
+  pspec = g_param_spec_string ("geonames-file",
+                               "Geonames file",
+                               "The geonames.org dump to build the index from",
+                               NULL /* default value */,
+                               G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_GEONAMES_FILE, pspec);
+}
+
+static void vik_goto_local_tool_init ( VikGotoLocalTool *self )
+{
+  VikGotoLocalToolPrivate *priv = VIK_GOTO_LOCAL_TOOL_PRIVATE ( self );
+
+  priv->index_file = NULL;
+  priv->geonames_file = NULL;
+
+  g_mutex_init ( &priv->mutex );
+  priv->index = NULL;
+  priv->unusable = FALSE;
+}
+
+static void vik_goto_local_tool_finalize ( GObject *gob )
+{
+  VikGotoLocalToolPrivate *priv = VIK_GOTO_LOCAL_TOOL_PRIVATE ( gob );
+
+  g_free (priv->index_file);
+  priv->index_file = NULL;
+  g_free (priv->geonames_file);
+  priv->geonames_file = NULL;
+
+  a_place_index_free ( priv->index );
+  priv->index = NULL;
+  g_mutex_clear ( &priv->mutex );
+
+  G_OBJECT_CLASS (vik_goto_local_tool_parent_class)->finalize(gob);
+}
+
+static gchar *
+resolve_file ( const gchar *filename )
+{
+  if ( g_path_is_absolute ( filename ) )
+    return g_strdup ( filename );
+  return g_build_filename ( a_get_viking_dir(), filename, NULL );
+}
+
+/**
+ * The index, building it first if needed
+ * Searches are made from a background thread, but the index is only built once
+ */
+static PlaceIndex *
+vik_goto_local_tool_get_index ( VikGotoTool *self )
+{
+  VikGotoLocalToolPrivate *priv = VIK_GOTO_LOCAL_TOOL_PRIVATE ( self );
+
+  g_mutex_lock ( &priv->mutex );
+  if ( !priv->index && !priv->unusable ) {
+    priv->unusable = TRUE;
+    if ( !priv->index_file ) {
+      g_warning ( "%s: no index-file given for %s", __FUNCTION__, vik_goto_tool_get_label ( self ) );
+      g_mutex_unlock ( &priv->mutex );
+      return NULL;
+    }
+
+    gchar *index_file = resolve_file ( priv->index_file );
+    GError *error = NULL;
+    if ( priv->geonames_file ) {
+      gchar *geonames_file = resolve_file ( priv->geonames_file );
+      GStatBuf geonames_stat, index_stat;
+      if ( g_stat ( geonames_file, &geonames_stat ) == 0 &&
+           ( g_stat ( index_file, &index_stat ) != 0 || index_stat.st_mtime < geonames_stat.st_mtime ) ) {
+        g_message ( "%s: building %s from %s", __FUNCTION__, index_file, geonames_file );
+        if ( !a_place_index_build ( geonames_file, index_file, &error ) ) {
+          // Any previous index can still be used
+          g_warning ( "%s: %s", __FUNCTION__, error->message );
+          g_clear_error ( &error );
+        }
+      }
+      g_free ( geonames_file );
+    }
+
+    priv->index = a_place_index_open ( index_file, &error );
+    if ( priv->index )
+      priv->unusable = FALSE;
+    else {
+      g_warning ( "%s: %s", __FUNCTION__, error->message );
+      g_error_free ( error );
+    }
+    g_free ( index_file );
+  }
+  g_mutex_unlock ( &priv->mutex );
+  return priv->index;
+}
+
+static void add_candidate ( const gchar *name, const struct LatLon *ll, gpointer user_data )
+{
+  GList **candidates = user_data;
+  struct VikGotoCandidate *cand = g_malloc ( sizeof(struct VikGotoCandidate) );
+  cand->description = g_strdup ( name );
+  cand->ll = *ll;
+  *candidates = g_list_prepend ( *candidates, cand );
+}
+
+static gboolean
+vik_goto_local_tool_search_offline ( VikGotoTool *self, const gchar *srch_str, GList **candidates )
+{
+  PlaceIndex *pi = vik_goto_local_tool_get_index ( self );
+  if ( !pi )
+    return FALSE;
+
+  GList *found = NULL;
+  (void)a_place_index_search ( pi, srch_str, GOTO_LOCAL_TOOL_MAX_CANDIDATES, add_candidate, &found );
+  *candidates = g_list_concat ( *candidates, g_list_reverse ( found ) );
+  return TRUE;
+}
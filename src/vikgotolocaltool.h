@@ -0,0 +1,52 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef __VIK_GOTO_LOCAL_TOOL_H
+#define __VIK_GOTO_LOCAL_TOOL_H
+
+#include <glib.h>
+
+#include "vikgototool.h"
+
+G_BEGIN_DECLS
+
+#define VIK_GOTO_LOCAL_TOOL_TYPE            (vik_goto_local_tool_get_type ())
+#define VIK_GOTO_LOCAL_TOOL(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), VIK_GOTO_LOCAL_TOOL_TYPE, VikGotoLocalTool))
+#define VIK_GOTO_LOCAL_TOOL_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), VIK_GOTO_LOCAL_TOOL_TYPE, VikGotoLocalToolClass))
+#define IS_VIK_GOTO_LOCAL_TOOL(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), VIK_GOTO_LOCAL_TOOL_TYPE))
+#define IS_VIK_GOTO_LOCAL_TOOL_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), VIK_GOTO_LOCAL_TOOL_TYPE))
+#define VIK_GOTO_LOCAL_TOOL_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), VIK_GOTO_LOCAL_TOOL_TYPE, VikGotoLocalToolClass))
+
+
+typedef struct _VikGotoLocalTool VikGotoLocalTool;
+typedef struct _VikGotoLocalToolClass VikGotoLocalToolClass;
+
+struct _VikGotoLocalToolClass
+{
+  VikGotoToolClass object_class;
+};
+
+GType vik_goto_local_tool_get_type ();
+
+struct _VikGotoLocalTool {
+  VikGotoTool obj;
+};
+
+G_END_DECLS
+
+#endif
@@ -25,6 +25,7 @@
 
 #include "vikgototool.h"
 #include "util.h"
+#include "curl_download.h"
 
 #include <string.h>
 
@@ -204,6 +205,30 @@ static gboolean vik_goto_tool_parse_file_for_candidates (VikGotoTool *self, gcha
   return VIK_GOTO_TOOL_GET_CLASS( self )->parse_file_for_candidates( self, filename, candidates );
 }
 
+/**
+ * Whether the search results can be downloaded into memory and parsed from there,
+ *  rather than via a temporary file
+ */
+static gboolean vik_goto_tool_parses_data ( VikGotoTool *self, gboolean candidates )
+{
+  VikGotoToolClass *klass = VIK_GOTO_TOOL_GET_CLASS( self );
+  if ( candidates ? !klass->parse_data_for_candidates : !klass->parse_data_for_latlon )
+    return FALSE;
+  // File based checks and conversions can't be applied
+  DownloadFileOptions *options = vik_goto_tool_get_download_options ( self );
+  return !options || ( !options->check_file && !options->convert_file );
+}
+
+/**
+ * vik_goto_tool_searches_offline:
+ *
+ * Returns: TRUE if searches are quick enough to be made while the search string is typed
+ */
+gboolean vik_goto_tool_searches_offline ( VikGotoTool *self )
+{
+  return VIK_GOTO_TOOL_GET_CLASS( self )->search_offline != NULL;
+}
+
 /**
  * vik_goto_tool_get_coord:
  *
@@ -226,10 +251,36 @@ int vik_goto_tool_get_coord ( VikGotoTool *self, VikViewport *vvp, gchar *srch_s
   int ret = 0;  /* OK */
   struct LatLon ll;
 
+  if ( vik_goto_tool_searches_offline ( self ) ) {
+    GList *candidates = NULL;
+    if ( !VIK_GOTO_TOOL_GET_CLASS( self )->search_offline( self, srch_str, &candidates ) )
+      return 1;
+    if ( !candidates )
+      return -1;
+    struct VikGotoCandidate *best = candidates->data;
+    vik_coord_load_from_latlon ( coord, vik_viewport_get_coord_mode(vvp), &best->ll );
+    g_list_free_full ( candidates, vik_goto_tool_free_candidate );
+    return 0;
+  }
+
   escaped_srch_str = g_uri_escape_string(srch_str, NULL, TRUE);
 
   uri = g_strdup_printf(vik_goto_tool_get_url_format(self), escaped_srch_str);
 
+  if ( vik_goto_tool_parses_data ( self, FALSE ) ) {
+    gsize size;
+    gchar *data = curl_download_get_data ( uri, vik_goto_tool_get_download_options(self), &size );
+    if ( !data )
+      ret = 1;
+    else if ( !VIK_GOTO_TOOL_GET_CLASS( self )->parse_data_for_latlon( self, data, size, &ll ) )
+      ret = -1;
+    else
+      vik_coord_load_from_latlon ( coord, vik_viewport_get_coord_mode(vvp), &ll );
+    g_free ( data );
+    tmpname = NULL;
+    goto done_no_file;
+  }
+
   tmpname = a_download_uri_to_tmp_file ( uri, vik_goto_tool_get_download_options(self) );
 
   if ( !tmpname ) {
@@ -273,10 +324,25 @@ int vik_goto_tool_get_candidates ( VikGotoTool *self, gchar *srch_str, GList **c
   gchar *escaped_srch_str;
   int ret = 0;  /* OK */
 
+  if ( vik_goto_tool_searches_offline ( self ) )
+    return VIK_GOTO_TOOL_GET_CLASS( self )->search_offline( self, srch_str, candidates ) ? 0 : 1;
+
   escaped_srch_str = g_uri_escape_string(srch_str, NULL, TRUE);
 
   uri = g_strdup_printf(vik_goto_tool_get_url_format(self), escaped_srch_str);
 
+  if ( vik_goto_tool_parses_data ( self, TRUE ) ) {
+    gsize size;
+    gchar *data = curl_download_get_data ( uri, vik_goto_tool_get_download_options(self), &size );
+    if ( !data )
+      ret = 1;
+    else if ( !VIK_GOTO_TOOL_GET_CLASS( self )->parse_data_for_candidates( self, data, size, candidates ) )
+      ret = -1;
+    g_free ( data );
+    tmpname = NULL;
+    goto done_no_file;
+  }
+
   tmpname = a_download_uri_to_tmp_file ( uri, vik_goto_tool_get_download_options(self) );
 
   if ( !tmpname ) {
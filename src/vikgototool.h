@@ -47,6 +47,12 @@ struct _VikGotoToolClass
   DownloadFileOptions *(* get_download_options) (VikGotoTool *self);
   gboolean (* parse_file_for_latlon) (VikGotoTool *self, gchar *filename, struct LatLon *ll);
   gboolean (* parse_file_for_candidates) (VikGotoTool *self, gchar *filename, GList **candidates);
+  // Optional - parse the downloaded results directly from memory
+  gboolean (* parse_data_for_latlon) (VikGotoTool *self, const gchar *data, gsize len, struct LatLon *ll);
+  gboolean (* parse_data_for_candidates) (VikGotoTool *self, const gchar *data, gsize len, GList **candidates);
+  // Optional - search without any network access, instead of downloading from the URL
+  //  Returns FALSE when the search is not possible, e.g. the data is missing
+  gboolean (* search_offline) (VikGotoTool *self, const gchar *srch_str, GList **candidates);
 };
 
 GType vik_goto_tool_get_type ();
@@ -65,6 +71,7 @@ gboolean vik_goto_tool_parse_file_for_latlon (VikGotoTool *self, gchar *filename
 int vik_goto_tool_get_coord ( VikGotoTool *self, VikViewport *vvp, gchar *srch_str, VikCoord *coord );
 int vik_goto_tool_get_candidates ( VikGotoTool *self, gchar *srch_str, GList **candidates );
 void vik_goto_tool_free_candidate ( gpointer candidate );
+gboolean vik_goto_tool_searches_offline ( VikGotoTool *self );
 
 G_END_DECLS
 
@@ -28,6 +28,8 @@ static gchar *vik_goto_xml_tool_get_url_format ( VikGotoTool *self );
 static gboolean vik_goto_xml_tool_parse_file(VikGotoTool *self, gchar *filename);
 static gboolean vik_goto_xml_tool_parse_file_for_latlon(VikGotoTool *self, gchar *filename, struct LatLon *ll);
 static gboolean vik_goto_xml_tool_parse_file_for_candidates(VikGotoTool *self, gchar *filename, GList **candidates);
+static gboolean vik_goto_xml_tool_parse_data_for_latlon(VikGotoTool *self, const gchar *data, gsize len, struct LatLon *ll);
+static gboolean vik_goto_xml_tool_parse_data_for_candidates(VikGotoTool *self, const gchar *data, gsize len, GList **candidates);
 
 typedef struct _VikGotoXmlToolPrivate VikGotoXmlToolPrivate;
 
@@ -289,6 +291,8 @@ vik_goto_xml_tool_class_init ( VikGotoXmlToolClass *klass )
   parent_class->get_url_format = vik_goto_xml_tool_get_url_format;
   parent_class->parse_file_for_latlon = vik_goto_xml_tool_parse_file_for_latlon;
   parent_class->parse_file_for_candidates = vik_goto_xml_tool_parse_file_for_candidates;
+  parent_class->parse_data_for_latlon = vik_goto_xml_tool_parse_data_for_latlon;
+  parent_class->parse_data_for_candidates = vik_goto_xml_tool_parse_data_for_candidates;
 }
 
 static void
@@ -452,9 +456,8 @@ _text (GMarkupParseContext *context,
 }
 
 static gboolean
-vik_goto_xml_tool_parse_file(VikGotoTool *self, gchar *filename)
+vik_goto_xml_tool_parse_data(VikGotoTool *self, const gchar *data, gsize len)
 {
-	g_debug("Parse %s", filename);
 	GMarkupParser xml_parser;
 	GMarkupParseContext *xml_context = NULL;
 	GError *error = NULL;
@@ -467,11 +470,6 @@ vik_goto_xml_tool_parse_file(VikGotoTool *self, gchar *filename)
            priv->lon_path, priv->lon_attr,
            priv->desc_path, priv->desc_attr);
 
-	FILE *file = g_fopen (filename, "r");
-	if (file == NULL)
-		/* TODO emit warning */
-		return FALSE;
-	
 	/* setup context parse (ie callbacks) */
 	if (priv->lat_attr != NULL || priv->lon_attr != NULL)
     // At least one coordinate uses an attribute
@@ -493,20 +491,15 @@ vik_goto_xml_tool_parse_file(VikGotoTool *self, gchar *filename)
 	priv->ll.lat = NAN;
 	priv->ll.lon = NAN;
 	
-	gchar buff[BUFSIZ];
-	size_t nb;
-	while (xml_context &&
-	       (nb = fread (buff, sizeof(gchar), BUFSIZ, file)) > 0)
+	// The whole of the data in one go
+	if (len > 0 && !g_markup_parse_context_parse(xml_context, data, len, &error))
 	{
-		if (!g_markup_parse_context_parse(xml_context, buff, nb, &error))
-		{
-			fprintf(stderr, "%s: parsing error: %s.\n",
-				__FUNCTION__, error->message);
-			g_markup_parse_context_free(xml_context);
-			xml_context = NULL;
-		}
-		g_clear_error (&error);
+		fprintf(stderr, "%s: parsing error: %s.\n",
+			__FUNCTION__, error->message);
+		g_markup_parse_context_free(xml_context);
+		xml_context = NULL;
 	}
+	g_clear_error (&error);
 	/* cleanup */
 	if (xml_context &&
 	    !g_markup_parse_context_end_parse(xml_context, &error))
@@ -517,7 +510,6 @@ vik_goto_xml_tool_parse_file(VikGotoTool *self, gchar *filename)
 	if (xml_context)
 		g_markup_parse_context_free(xml_context);
 	xml_context = NULL;
-	fclose (file);
 
     // As candidates are individually prepended,
     //  the list is reversed to preserve the ordering
@@ -528,11 +520,21 @@ vik_goto_xml_tool_parse_file(VikGotoTool *self, gchar *filename)
 }
 
 static gboolean
-vik_goto_xml_tool_parse_file_for_latlon(VikGotoTool *self, gchar *filename, struct LatLon *ll)
+vik_goto_xml_tool_parse_file(VikGotoTool *self, gchar *filename)
 {
-  if (!vik_goto_xml_tool_parse_file(self, filename))
-    return FALSE;
+	g_debug("Parse %s", filename);
+	GMappedFile *mf = g_mapped_file_new (filename, FALSE, NULL);
+	if (mf == NULL)
+		/* TODO emit warning */
+		return FALSE;
+	gboolean ans = vik_goto_xml_tool_parse_data(self, g_mapped_file_get_contents(mf), g_mapped_file_get_length(mf));
+	g_mapped_file_unref (mf);
+	return ans;
+}
 
+static gboolean
+vik_goto_xml_tool_get_latlon(VikGotoTool *self, struct LatLon *ll)
+{
   VikGotoXmlToolPrivate *priv = GOTO_XML_TOOL_GET_PRIVATE (self);
 
   if (ll != NULL)
@@ -547,6 +549,14 @@ vik_goto_xml_tool_parse_file_for_latlon(VikGotoTool *self, gchar *filename, stru
     return TRUE;
 }
 
+static gboolean
+vik_goto_xml_tool_parse_file_for_latlon(VikGotoTool *self, gchar *filename, struct LatLon *ll)
+{
+  if (!vik_goto_xml_tool_parse_file(self, filename))
+    return FALSE;
+  return vik_goto_xml_tool_get_latlon(self, ll);
+}
+
 static gboolean
 vik_goto_xml_tool_parse_file_for_candidates(VikGotoTool *self, gchar *filename, GList **candidates)
 {
@@ -556,6 +566,23 @@ vik_goto_xml_tool_parse_file_for_candidates(VikGotoTool *self, gchar *filename,
   return vik_goto_xml_tool_parse_file(self, filename);
 }
 
+static gboolean
+vik_goto_xml_tool_parse_data_for_latlon(VikGotoTool *self, const gchar *data, gsize len, struct LatLon *ll)
+{
+  if (!vik_goto_xml_tool_parse_data(self, data, len))
+    return FALSE;
+  return vik_goto_xml_tool_get_latlon(self, ll);
+}
+
+static gboolean
+vik_goto_xml_tool_parse_data_for_candidates(VikGotoTool *self, const gchar *data, gsize len, GList **candidates)
+{
+  VikGotoXmlToolPrivate *priv = GOTO_XML_TOOL_GET_PRIVATE (self);
+  priv->candidates = candidates;
+
+  return vik_goto_xml_tool_parse_data(self, data, len);
+}
+
 static gchar *
 vik_goto_xml_tool_get_url_format ( VikGotoTool *self )
 {
@@ -61,6 +61,7 @@ static void gps_empty_realtime_cb( gpointer layer_and_vlp[2] );
 static void gps_start_stop_tracking_cb( gpointer layer_and_vlp[2] );
 static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp);
 static void rt_gpsd_disconnect(VikGpsLayer *vgl);
+static void realtime_overlay_set ( VikGpsLayer *vgl, VikViewport *vp );
 static gboolean rt_gpsd_connect(VikGpsLayer *vgl, gboolean ask_if_failed);
 static VikLayerParamData color_default_tri ( void ) {
   VikLayerParamData data; gdk_color_parse ( "#203070", &data.c ); return data;
@@ -177,6 +178,15 @@ enum {
 
 static VikLayerParamData moving_map_method_default ( void ) { return VIK_LPD_UINT ( VEHICLE_POSITION_ON_SCREEN ); }
 
+static VikLayerParamScale params_redraw_rate[] = { {0.1, 25.0, 0.1, 1} };
+static VikLayerParamData redraw_rate_default ( void ) { return VIK_LPD_DOUBLE ( 1.0 ); }
+
+static VikLayerParamScale params_min_distance[] = { {0, 1000, 1, 0} };
+static VikLayerParamData min_distance_default ( void ) { return VIK_LPD_UINT ( 0 ); }
+
+// Enough for the last minute or so of positions with high rate receivers
+#define REALTIME_RECENT_SIZE 600
+
 static VikLayerParamData gpsd_host_default ( void )
 {
   VikLayerParamData data;
@@ -228,6 +238,10 @@ static VikLayerParam gps_layer_params[] = {
   { VIK_LAYER_GPS, "moving_map_method", VIK_LAYER_PARAM_UINT, GROUP_REALTIME_MODE, N_("Moving Map Method:"), VIK_LAYER_WIDGET_RADIOGROUP_STATIC, params_vehicle_position, NULL, NULL, moving_map_method_default, NULL, NULL },
   { VIK_LAYER_GPS, "indicator_color", VIK_LAYER_PARAM_COLOR, GROUP_REALTIME_MODE, N_("Indicator Color:"), VIK_LAYER_WIDGET_COLOR, NULL, NULL, NULL, color_default_tri, NULL, NULL },
   { VIK_LAYER_GPS, "realtime_update_statusbar", VIK_LAYER_PARAM_BOOLEAN, GROUP_REALTIME_MODE, N_("Update Statusbar:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, N_("Display information in the statusbar on GPS updates"), vik_lpd_true_default, NULL, NULL },
+  { VIK_LAYER_GPS, "realtime_redraw_rate", VIK_LAYER_PARAM_DOUBLE, GROUP_REALTIME_MODE, N_("Max Redraws per Second:"), VIK_LAYER_WIDGET_SPINBUTTON, params_redraw_rate, NULL,
+    N_("The most times per second the map is redrawn or moved for GPS updates. In between only the position and the newest part of the track are drawn."), redraw_rate_default, NULL, NULL },
+  { VIK_LAYER_GPS, "realtime_min_distance", VIK_LAYER_PARAM_UINT, GROUP_REALTIME_MODE, N_("Min Distance Between Points (m):"), VIK_LAYER_WIDGET_SPINBUTTON, params_min_distance, NULL,
+    N_("When recording, a change of direction or altitude is only added to the track once moved at least this far. Use this to save fewer points from high rate receivers."), min_distance_default, NULL, NULL },
   { VIK_LAYER_GPS, "auto_connect", VIK_LAYER_PARAM_BOOLEAN, GROUP_REALTIME_MODE, N_("Auto Connect"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, N_("Automatically connect to GPSD"), vik_lpd_false_default, NULL, NULL },
   { VIK_LAYER_GPS, "gpsd_host", VIK_LAYER_PARAM_STRING, GROUP_REALTIME_MODE, N_("Gpsd Host:"), VIK_LAYER_WIDGET_ENTRY, NULL, NULL, NULL, gpsd_host_default, NULL, NULL },
   { VIK_LAYER_GPS, "gpsd_port", VIK_LAYER_PARAM_STRING, GROUP_REALTIME_MODE, N_("Gpsd Port:"), VIK_LAYER_WIDGET_ENTRY, NULL, NULL, NULL, gpsd_port_default, NULL, NULL },
@@ -247,6 +261,8 @@ enum {
   PARAM_VEHICLE_POSITION,
   PARAM_INDICATOR_COLOR,
   PARAM_REALTIME_UPDATE_STATUSBAR,
+  PARAM_REALTIME_REDRAW_RATE,
+  PARAM_REALTIME_MIN_DISTANCE,
   PARAM_GPSD_CONNECT,
   PARAM_GPSD_HOST,
   PARAM_GPSD_PORT,
@@ -318,6 +334,7 @@ VikLayerInterface vik_gps_layer_interface = {
   (VikLayerFuncSelectedViewportMenu)    NULL,
 
   (VikLayerFuncRefresh)                 NULL,
+  (VikLayerFuncGetMemory)               NULL,
 };
 
 enum {TRW_DOWNLOAD=0, TRW_UPLOAD,
@@ -369,6 +386,19 @@ struct _VikGpsLayer {
   GdkGC *realtime_track_pt1_gc;
   GdkGC *realtime_track_pt2_gc;
 
+  // Drawing on the window between full redraws
+  VikViewport *overlay_vp;
+  guint redraw_timer;
+  gint64 last_redraw;
+  // Ring buffer of the most recent positions, for drawing on the window
+  struct LatLon *recent;
+  guint recent_start;
+  guint recent_count;
+  // Trackpoints kept from the GPS updates, then added to the track in batches when redrawn
+  GQueue pending;
+  GList *realtime_tail; // End of the trackpoint list of the realtime track
+  VikTrackpoint *realtime_last_tp; // The last trackpoint kept, whether pending or in the track
+
   /* params */
   gboolean auto_connect_to_gpsd;
   gchar *gpsd_host;
@@ -379,6 +409,8 @@ struct _VikGpsLayer {
   guint vehicle_position;
   GdkColor indicator_color;
   gboolean realtime_update_statusbar;
+  gdouble realtime_redraw_rate;
+  guint realtime_min_distance;
   VikTrackpoint *trkpt;
   VikTrackpoint *trkpt_prev;
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
@@ -637,6 +669,14 @@ static gboolean gps_layer_set_param ( VikGpsLayer *vgl, VikLayerSetParam *vlsp )
     case PARAM_REALTIME_UPDATE_STATUSBAR:
       vgl->realtime_update_statusbar = vlsp->data.b;
       break;
+    case PARAM_REALTIME_REDRAW_RATE:
+      if ( vlsp->data.d >= params_redraw_rate[0].min && vlsp->data.d <= params_redraw_rate[0].max )
+        vgl->realtime_redraw_rate = vlsp->data.d;
+      break;
+    case PARAM_REALTIME_MIN_DISTANCE:
+      if ( vlsp->data.u <= params_min_distance[0].max )
+        vgl->realtime_min_distance = vlsp->data.u;
+      break;
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
     default: break;
   }
@@ -703,6 +743,12 @@ static VikLayerParamData gps_layer_get_param ( VikGpsLayer *vgl, guint16 id, gbo
     case PARAM_REALTIME_UPDATE_STATUSBAR:
       rv.b = vgl->realtime_update_statusbar;
       break;
+    case PARAM_REALTIME_REDRAW_RATE:
+      rv.d = vgl->realtime_redraw_rate;
+      break;
+    case PARAM_REALTIME_MIN_DISTANCE:
+      rv.u = vgl->realtime_min_distance;
+      break;
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
     default: break;
   }
@@ -729,6 +775,15 @@ VikGpsLayer *vik_gps_layer_new (VikViewport *vp)
   vgl->realtime_io_channel = NULL;
   vgl->realtime_io_watch_id = 0;
   vgl->realtime_retry_timer = 0;
+  vgl->overlay_vp = NULL;
+  vgl->recent = g_new ( struct LatLon, REALTIME_RECENT_SIZE );
+  vgl->recent_start = 0;
+  vgl->recent_count = 0;
+  g_queue_init ( &vgl->pending );
+  vgl->realtime_tail = NULL;
+  vgl->realtime_last_tp = NULL;
+  vgl->redraw_timer = 0;
+  vgl->last_redraw = 0;
   if ( vp ) {
     layer_update_indictor_gc ( vgl, vp );
     vgl->realtime_track_bg_gc = vik_viewport_new_gc ( vp, "grey", 2 );
@@ -759,31 +814,17 @@ static void vik_gps_layer_draw ( VikGpsLayer *vgl, VikViewport *vp )
 {
   gint i;
   VikLayer *vl;
-  VikLayer *trigger = VIK_LAYER(vik_viewport_get_trigger( vp ));
 
   for (i = 0; i < NUM_TRW; i++) {
     vl = VIK_LAYER(vgl->trw_children[i]);
-    if (vl == trigger) {
-      if ( vik_viewport_get_half_drawn ( vp ) ) {
-        vik_viewport_set_half_drawn ( vp, FALSE );
-        vik_viewport_snapshot_load( vp );
-      } else {
-        vik_viewport_snapshot_save( vp );
-      }
-    }
+    vik_viewport_snapshot_reached ( vp, vl );
     if (!vik_viewport_get_half_drawn(vp))
       vik_layer_draw ( vl, vp );
   }
 #if defined (VIK_CONFIG_REALTIME_GPS_TRACKING) && defined (GPSD_API_MAJOR_VERSION)
-  if (vgl->realtime_tracking) {
-    if (VIK_LAYER(vgl) == trigger) {
-      if ( vik_viewport_get_half_drawn ( vp ) ) {
-        vik_viewport_set_half_drawn ( vp, FALSE );
-        vik_viewport_snapshot_load( vp );
-      } else {
-        vik_viewport_snapshot_save( vp );
-      }
-    }
+  // Otherwise drawn via the overlay
+  if (vgl->realtime_tracking && vp != vgl->overlay_vp) {
+    vik_viewport_snapshot_reached ( vp, VIK_LAYER(vgl) );
     if (!vik_viewport_get_half_drawn(vp))
       realtime_tracking_draw(vgl, vp);
   }
@@ -845,6 +886,10 @@ static void vik_gps_layer_free ( VikGpsLayer *vgl )
   }
 #if defined (VIK_CONFIG_REALTIME_GPS_TRACKING) && defined (GPSD_API_MAJOR_VERSION)
   rt_gpsd_disconnect(vgl);
+  if ( vgl->redraw_timer )
+    g_source_remove ( vgl->redraw_timer );
+  realtime_overlay_set ( vgl, NULL );
+  g_free ( vgl->recent );
   if (vgl->realtime_track_gc != NULL)
     g_object_unref(vgl->realtime_track_gc);
   if (vgl->realtime_track_bg_gc != NULL)
@@ -1622,7 +1667,10 @@ static void gps_empty_all_cb( gpointer layer_and_vlp[2] )
 }
 
 #if defined (VIK_CONFIG_REALTIME_GPS_TRACKING) && defined (GPSD_API_MAJOR_VERSION)
-static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp)
+/**
+ * Work out the shape of the position indicator, if it is within the viewport
+ */
+static gboolean realtime_indicator ( VikGpsLayer *vgl, VikViewport *vp, GdkPoint trian[3], GdkPoint trian_bg[3], gint *x, gint *y )
 {
   struct LatLon ll;
   VikCoord nw, se;
@@ -1637,7 +1685,6 @@ static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp)
        vgl->realtime_fix.fix.longitude < lse.lon &&
        !isnan (vgl->realtime_fix.fix.track) ) {
     VikCoord gps;
-    gint x, y;
     gint half_back_x, half_back_y;
     gint half_back_bg_x, half_back_bg_y;
     gint pt_x, pt_y;
@@ -1648,15 +1695,15 @@ static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp)
     ll.lat = vgl->realtime_fix.fix.latitude;
     ll.lon = vgl->realtime_fix.fix.longitude;
     vik_coord_load_from_latlon ( &gps, vik_viewport_get_coord_mode(vp), &ll);
-    vik_viewport_coord_to_screen ( vp, &gps, &x, &y );
+    vik_viewport_coord_to_screen ( vp, &gps, x, y );
 
     gdouble heading_cos = cos(DEG2RAD(vgl->realtime_fix.fix.track));
     gdouble heading_sin = sin(DEG2RAD(vgl->realtime_fix.fix.track));
 
-    half_back_y = y+8*heading_cos;
-    half_back_x = x-8*heading_sin;
-    half_back_bg_y = y+10*heading_cos;
-    half_back_bg_x = x-10*heading_sin;
+    half_back_y = *y+8*heading_cos;
+    half_back_x = *x-8*heading_sin;
+    half_back_bg_y = *y+10*heading_cos;
+    half_back_bg_x = *x-10*heading_sin;
 
     pt_y = half_back_y-24*heading_cos;
     pt_x = half_back_x+24*heading_sin;
@@ -1673,9 +1720,22 @@ static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp)
     side2bg_y = half_back_bg_y-11*heading_sin;
     side2bg_x = half_back_bg_x-11*heading_cos;
 
-     GdkPoint trian[3] = { { pt_x, pt_y }, {side1_x, side1_y}, {side2_x, side2_y} };
-     GdkPoint trian_bg[3] = { { ptbg_x, pt_y }, {side1bg_x, side1bg_y}, {side2bg_x, side2bg_y} };
+    trian[0].x = pt_x; trian[0].y = pt_y;
+    trian[1].x = side1_x; trian[1].y = side1_y;
+    trian[2].x = side2_x; trian[2].y = side2_y;
+    trian_bg[0].x = ptbg_x; trian_bg[0].y = pt_y;
+    trian_bg[1].x = side1bg_x; trian_bg[1].y = side1bg_y;
+    trian_bg[2].x = side2bg_x; trian_bg[2].y = side2bg_y;
+    return TRUE;
+  }
+  return FALSE;
+}
 
+static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp)
+{
+  GdkPoint trian[3], trian_bg[3];
+  gint x, y;
+  if ( realtime_indicator ( vgl, vp, trian, trian_bg, &x, &y ) ) {
      vik_viewport_draw_polygon ( vp, vgl->realtime_track_bg_gc, TRUE, trian_bg, 3 );
      vik_viewport_draw_polygon ( vp, vgl->realtime_track_gc, TRUE, trian, 3 );
      vik_viewport_draw_rectangle ( vp,
@@ -1684,10 +1744,146 @@ static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp)
   }
 }
 
+// Grow the area to include the points, allowing for the line width
+static void area_add_points ( GdkRectangle *area, GdkPoint *points, guint npoints )
+{
+  for ( guint ii = 0; ii < npoints; ii++ ) {
+    GdkRectangle pt = { points[ii].x - 3, points[ii].y - 3, 7, 7 };
+    if ( area->width == 0 || area->height == 0 )
+      *area = pt;
+    else
+      gdk_rectangle_union ( area, &pt, area );
+  }
+}
+
+/**
+ * Draw the position indicator and the most recent positions straight onto the window,
+ *  so each GPS update does not need all the layers redrawing
+ */
+static void realtime_overlay_draw ( VikViewport *vp, GdkDrawable *drawable, GdkRectangle *area, VikGpsLayer *vgl )
+{
+  if ( !VIK_LAYER(vgl)->visible )
+    return;
+
+  guint len = vgl->recent_count;
+  if ( len > 1 && VIK_LAYER(vgl->trw_children[TRW_REALTIME])->visible ) {
+    VikCoord *coords = g_new ( VikCoord, len );
+    GdkPoint *points = g_new ( GdkPoint, len );
+    for ( guint ii = 0; ii < len; ii++ )
+      vik_coord_load_from_latlon ( &coords[ii], vik_viewport_get_coord_mode(vp), &vgl->recent[(vgl->recent_start + ii) % REALTIME_RECENT_SIZE] );
+    vik_viewport_coords_to_screen ( vp, coords, len, points );
+    gdk_draw_lines ( drawable, vgl->realtime_track_gc, points, len );
+    area_add_points ( area, points, len );
+    g_free ( points );
+    g_free ( coords );
+  }
+
+  GdkPoint trian[3], trian_bg[3];
+  gint x, y;
+  if ( realtime_indicator ( vgl, vp, trian, trian_bg, &x, &y ) ) {
+    gdk_draw_polygon ( drawable, vgl->realtime_track_bg_gc, TRUE, trian_bg, 3 );
+    gdk_draw_polygon ( drawable, vgl->realtime_track_gc, TRUE, trian, 3 );
+    gdk_draw_rectangle ( drawable,
+        (vgl->realtime_fix.fix.mode > MODE_2D) ? vgl->realtime_track_pt2_gc : vgl->realtime_track_pt1_gc,
+        TRUE, x-2, y-2, 4, 4 );
+    area_add_points ( area, trian_bg, 3 );
+    area_add_points ( area, trian, 3 );
+  }
+}
+
+static void realtime_overlay_set ( VikGpsLayer *vgl, VikViewport *vp )
+{
+  if ( vgl->overlay_vp == vp )
+    return;
+  if ( vgl->overlay_vp ) {
+    vik_viewport_remove_overlay ( vgl->overlay_vp, (VikViewportOverlayFunc)realtime_overlay_draw, vgl );
+    g_object_unref ( vgl->overlay_vp );
+  }
+  vgl->overlay_vp = vp;
+  if ( vp ) {
+    g_object_ref ( vp );
+    vik_viewport_add_overlay ( vp, (VikViewportOverlayFunc)realtime_overlay_draw, vgl );
+  }
+}
+
+static void realtime_recent_add ( VikGpsLayer *vgl, const struct LatLon *ll )
+{
+  if ( vgl->recent_count < REALTIME_RECENT_SIZE )
+    vgl->recent[(vgl->recent_start + vgl->recent_count++) % REALTIME_RECENT_SIZE] = *ll;
+  else {
+    // Overwrite the oldest
+    vgl->recent[vgl->recent_start] = *ll;
+    vgl->recent_start = (vgl->recent_start + 1) % REALTIME_RECENT_SIZE;
+  }
+}
+
+/**
+ * Add the pending trackpoints to the track
+ */
+static void realtime_flush ( VikGpsLayer *vgl )
+{
+  if ( !vgl->realtime_track || g_queue_is_empty(&vgl->pending) )
+    return;
+  vgl->realtime_tail = vik_track_append_trackpoints ( vgl->realtime_track, vgl->realtime_tail, vgl->pending.head );
+  g_queue_init ( &vgl->pending );
+}
+
+/**
+ * Remove the last kept trackpoint, wherever it is now
+ */
+static void realtime_remove_last_tp ( VikGpsLayer *vgl )
+{
+  VikTrackpoint *tp = vgl->realtime_last_tp;
+  if ( !tp )
+    return;
+  if ( g_queue_peek_tail(&vgl->pending) == tp )
+    (void)g_queue_pop_tail ( &vgl->pending );
+  else if ( vgl->realtime_tail && vgl->realtime_tail->data == tp ) {
+    GList *prev = vgl->realtime_tail->prev;
+    vgl->realtime_track->trackpoints = g_list_delete_link ( vgl->realtime_track->trackpoints, vgl->realtime_tail );
+    vgl->realtime_tail = prev;
+    vik_track_clear_caches ( vgl->realtime_track );
+  }
+  else
+    return;
+  vik_trackpoint_free ( tp );
+  vgl->realtime_last_tp = NULL;
+}
+
+static gboolean realtime_redraw ( VikGpsLayer *vgl )
+{
+  vgl->redraw_timer = 0;
+  vgl->last_redraw = g_get_monotonic_time ();
+  realtime_flush ( vgl );
+  vik_layer_emit_update ( VIK_LAYER(vgl->trw_children[TRW_REALTIME]) );
+  return FALSE;
+}
+
+/**
+ * Returns: Whether a full redraw is allowed now, according to the maximum redraw rate
+ */
+static gboolean realtime_redraw_due ( VikGpsLayer *vgl )
+{
+  return g_get_monotonic_time () - vgl->last_redraw >= G_USEC_PER_SEC / vgl->realtime_redraw_rate;
+}
+
+/**
+ * Redraw the realtime track layer as soon as the maximum redraw rate allows
+ */
+static void realtime_schedule_redraw ( VikGpsLayer *vgl )
+{
+  if ( vgl->redraw_timer )
+    return;
+  gint64 wait = vgl->last_redraw + (gint64)(G_USEC_PER_SEC / vgl->realtime_redraw_rate) - g_get_monotonic_time ();
+  if ( wait <= 0 )
+    (void)realtime_redraw ( vgl );
+  else
+    vgl->redraw_timer = g_timeout_add ( wait / 1000 + 1, (GSourceFunc)realtime_redraw, vgl );
+}
+
 static VikTrackpoint* create_realtime_trackpoint(VikGpsLayer *vgl, gboolean forced)
 {
     struct LatLon ll;
-    GList *last_tp;
 
 #if GPSD_API_MAJOR_VERSION >= 9
     gdouble cur_timestamp = vgl->realtime_fix.fix.time.tv_sec +
@@ -1709,20 +1905,29 @@ static VikTrackpoint* create_realtime_trackpoint(VikGpsLayer *vgl, gboolean forc
       int last_heading = isnan(vgl->last_fix.fix.track) ? 0 : (int)floor(vgl->last_fix.fix.track);
       int alt = isnan(vgl->realtime_fix.fix.altitude) ? 0 : (int)floor(vgl->realtime_fix.fix.altitude);
       int last_alt = isnan(vgl->last_fix.fix.altitude) ? 0 : (int)floor(vgl->last_fix.fix.altitude);
-      if (((last_tp = g_list_last(vgl->realtime_track->trackpoints)) != NULL) &&
+      if ((vgl->realtime_last_tp != NULL) &&
           (vgl->realtime_fix.fix.mode > MODE_2D) &&
           (vgl->last_fix.fix.mode <= MODE_2D) &&
           ((cur_timestamp - last_timestamp) < 2)) {
-        g_free(last_tp->data);
-        vgl->realtime_track->trackpoints = g_list_delete_link(vgl->realtime_track->trackpoints, last_tp);
+        realtime_remove_last_tp(vgl);
         replace = TRUE;
       }
+      ll.lat = vgl->realtime_fix.fix.latitude;
+      ll.lon = vgl->realtime_fix.fix.longitude;
+      // Ignore small movements, such as the jitter of a high rate receiver
+      gboolean moved = TRUE;
+      if (vgl->realtime_min_distance && vgl->realtime_last_tp) {
+        struct LatLon last_ll;
+        vik_coord_to_latlon(&vgl->realtime_last_tp->coord, &last_ll);
+        moved = a_coords_latlon_diff(&ll, &last_ll) >= vgl->realtime_min_distance;
+      }
       if (replace ||
           ((cur_timestamp != last_timestamp) &&
           ((forced || 
-            ((heading < last_heading) && (heading < (last_heading - 3))) || 
-            ((heading > last_heading) && (heading > (last_heading + 3))) ||
-            (alt && (alt != last_alt)))))) {
+            (moved &&
+             (((heading < last_heading) && (heading < (last_heading - 3))) || 
+              ((heading > last_heading) && (heading > (last_heading + 3))) ||
+              (alt && (alt != last_alt)))))))) {
         /* TODO: check for new segments */
         VikTrackpoint *tp = vik_trackpoint_new();
         tp->newsegment = FALSE;
@@ -1739,12 +1944,12 @@ static VikTrackpoint* create_realtime_trackpoint(VikGpsLayer *vgl, gboolean forc
         tp->nsats = vgl->realtime_fix.satellites_used;
         tp->fix_mode = vgl->realtime_fix.fix.mode;
 
-        ll.lat = vgl->realtime_fix.fix.latitude;
-        ll.lon = vgl->realtime_fix.fix.longitude;
         vik_coord_load_from_latlon(&tp->coord,
              vik_trw_layer_get_coord_mode(vgl->trw_children[TRW_REALTIME]), &ll);
 
-        vik_track_add_trackpoint ( vgl->realtime_track, tp, TRUE ); // Ensure bounds is recalculated
+        // Added to the track when next drawn
+        g_queue_push_tail ( &vgl->pending, tp );
+        vgl->realtime_last_tp = tp;
         vgl->realtime_fix.dirty = FALSE;
         vgl->realtime_fix.satellites_used = 0;
         vgl->last_fix = vgl->realtime_fix;
@@ -1798,12 +2003,35 @@ static void gpsd_raw_hook(VglGpsd *vgpsd, gchar *data)
     vik_coord_load_from_latlon(&vehicle_coord,
            vik_trw_layer_get_coord_mode(vgl->trw_children[TRW_REALTIME]), &ll);
 
-    if ((vgl->vehicle_position == VEHICLE_POSITION_CENTERED) ||
-        (vgl->realtime_jump_to_start && vgl->first_realtime_trackpoint)) {
+    vgl->trkpt = create_realtime_trackpoint ( vgl, FALSE );
+
+    // Every position is shown, even if not kept in the track
+    if ( vgl->realtime_record )
+      realtime_recent_add ( vgl, &ll );
+
+    if ( vgl->trkpt ) {
+      if ( vgl->realtime_update_statusbar )
+	update_statusbar ( vgl, vw );
+      vgl->trkpt_prev = vgl->trkpt;
+    }
+
+    realtime_overlay_set ( vgl, vvp );
+
+    // Moving the map is also limited to the redraw rate, in between just the indicator moves
+    gboolean moved = FALSE;
+    if (vgl->realtime_jump_to_start && vgl->first_realtime_trackpoint) {
       vik_viewport_set_center_coord(vvp, &vehicle_coord, FALSE);
       update_all = TRUE;
     }
-    else if (vgl->vehicle_position == VEHICLE_POSITION_ON_SCREEN) {
+    else if (vgl->vehicle_position == VEHICLE_POSITION_CENTERED && realtime_redraw_due(vgl)) {
+      gint vx, vy;
+      vik_viewport_coord_to_screen(vvp, &vehicle_coord, &vx, &vy);
+      if (vx != vik_viewport_get_width(vvp)/2 || vy != vik_viewport_get_height(vvp)/2) {
+        vik_window_center_screen(vw, vx, vy);
+        moved = TRUE;
+      }
+    }
+    else if (vgl->vehicle_position == VEHICLE_POSITION_ON_SCREEN && realtime_redraw_due(vgl)) {
       const int hdiv = 6;
       const int vdiv = 6;
       const int px = 20; /* adjust ment in pixels to make sure vehicle is inside the box */
@@ -1812,30 +2040,35 @@ static void gpsd_raw_hook(VglGpsd *vgpsd, gchar *data)
       gint vx, vy;
 
       vik_viewport_coord_to_screen(vvp, &vehicle_coord, &vx, &vy);
-      update_all = TRUE;
+      moved = TRUE;
       if (vx < (width/hdiv))
-        vik_viewport_set_center_screen(vvp, vx - width/2 + width/hdiv + px, vy);
+        vik_window_center_screen(vw, vx - width/2 + width/hdiv + px, vy);
       else if (vx > (width - width/hdiv))
-        vik_viewport_set_center_screen(vvp, vx + width/2 - width/hdiv - px, vy);
+        vik_window_center_screen(vw, vx + width/2 - width/hdiv - px, vy);
       else if (vy < (height/vdiv))
-        vik_viewport_set_center_screen(vvp, vx, vy - height/2 + height/vdiv + px);
+        vik_window_center_screen(vw, vx, vy - height/2 + height/vdiv + px);
       else if (vy > (height - height/vdiv))
-        vik_viewport_set_center_screen(vvp, vx, vy + height/2 - height/vdiv - px);
+        vik_window_center_screen(vw, vx, vy + height/2 - height/vdiv - px);
       else
-        update_all = FALSE;
+        moved = FALSE;
     }
 
     vgl->first_realtime_trackpoint = FALSE;
 
-    vgl->trkpt = create_realtime_trackpoint ( vgl, FALSE );
-
-    if ( vgl->trkpt ) {
-      if ( vgl->realtime_update_statusbar )
-	update_statusbar ( vgl, vw );
-      vgl->trkpt_prev = vgl->trkpt;
+    if ( update_all ) {
+      vgl->last_redraw = g_get_monotonic_time ();
+      realtime_flush ( vgl );
+      vik_layer_emit_update ( VIK_LAYER(vgl) ); // NB update from background thread
+    }
+    else {
+      // Any move has already been drawn, including the overlay
+      if ( moved )
+        vgl->last_redraw = g_get_monotonic_time ();
+      else
+        vik_viewport_sync_overlays ( vvp );
+      if ( vgl->trkpt )
+        realtime_schedule_redraw ( vgl );
     }
-
-    vik_layer_emit_update ( update_all ? VIK_LAYER(vgl) : VIK_LAYER(vgl->trw_children[TRW_REALTIME]) ); // NB update from background thread
   }
 }
 
@@ -2044,6 +2277,12 @@ static void rt_gpsd_disconnect(VikGpsLayer *vgl)
     vgl->vgpsd = NULL;
   }
 
+  realtime_flush(vgl);
+  // Anything still pending when there is no track
+  g_list_free_full(vgl->pending.head, (GDestroyNotify)vik_trackpoint_free);
+  g_queue_init(&vgl->pending);
+  vgl->realtime_tail = NULL;
+  vgl->realtime_last_tp = NULL;
   if (vgl->realtime_record && vgl->realtime_track) {
     if ((vgl->realtime_track->trackpoints == NULL) || (vgl->realtime_track->trackpoints->next == NULL))
       vik_trw_layer_delete_track(vgl->trw_children[TRW_REALTIME], vgl->realtime_track);
@@ -2072,6 +2311,14 @@ static void gps_start_stop_tracking_cb( gpointer layer_and_vlp[2])
     vgl->first_realtime_trackpoint = FALSE;
     vgl->trkpt = NULL;
     rt_gpsd_disconnect(vgl);
+    realtime_overlay_set ( vgl, NULL );
+    vgl->recent_count = 0;
+    // Draw any track only shown in the overlay
+    if ( vgl->redraw_timer ) {
+      g_source_remove ( vgl->redraw_timer );
+      vgl->redraw_timer = 0;
+      vik_layer_emit_update ( VIK_LAYER(vgl->trw_children[TRW_REALTIME]) );
+    }
   }
 }
 
@@ -22,6 +22,7 @@
  */
 #include "viking.h"
 #include "viklayer_defaults.h"
+#include "memoryusage.h"
 
 /* functions common to all layers. */
 /* TODO longone: rename interface free -> finalize */
@@ -257,6 +258,34 @@ gdouble vik_layer_get_timestamp ( VikLayer *vl )
   return 0;
 }
 
+/**
+ * vik_layer_get_memory:
+ *
+ * The approximate memory held by the layer itself (not including any child layers)
+ */
+void vik_layer_get_memory ( VikLayer *vl, VikLayerMemory *mem )
+{
+  memset ( mem, 0, sizeof(VikLayerMemory) );
+  if ( vik_layer_interfaces[vl->type]->get_memory )
+    vik_layer_interfaces[vl->type]->get_memory ( vl, mem );
+}
+
+gsize vik_layer_memory_total ( const VikLayerMemory *mem )
+{
+  gsize total = 0;
+  for ( guint ii = 0; ii < VIK_LAYER_MEMORY_NUM; ii++ )
+    total += mem->bytes[ii];
+  return total;
+}
+
+const gchar *vik_layer_memory_type_name ( VikLayerMemoryType type )
+{
+  static const gchar *names[VIK_LAYER_MEMORY_NUM] = {
+    N_("Points"), N_("Strings"), N_("Extensions"), N_("Images"), N_("DEM"), N_("Caches") };
+  g_return_val_if_fail ( type < VIK_LAYER_MEMORY_NUM, NULL );
+  return _(names[type]);
+}
+
 VikLayer *vik_layer_create ( VikLayerTypeEnum type, VikViewport *vp, gboolean interactive )
 {
   VikLayer *new_layer = NULL;
@@ -298,8 +327,12 @@ gboolean vik_layer_properties ( VikLayer *layer, VikViewport *vp, gboolean have_
 void vik_layer_draw ( VikLayer *l, VikViewport *vp )
 {
   if ( l->visible )
-    if ( vik_layer_interfaces[l->type]->draw )
+    if ( vik_layer_interfaces[l->type]->draw ) {
+      // Cheap enough to always measure, for the performance display
+      gint64 start = g_get_monotonic_time ();
       vik_layer_interfaces[l->type]->draw ( l, vp );
+      l->draw_time = g_get_monotonic_time () - start;
+    }
 }
 
 void vik_layer_change_coord_mode ( VikLayer *l, VikCoordMode mode )
@@ -597,6 +630,8 @@ void vik_layer_post_read ( VikLayer *layer, VikViewport *vp, gboolean from_file
 {
   if ( vik_layer_interfaces[layer->type]->post_read )
     vik_layer_interfaces[layer->type]->post_read ( layer, vp, from_file );
+  if ( from_file )
+    a_memory_usage_check ( layer );
 }
 
 // Wrapper function to keep compiler happy
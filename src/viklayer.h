@@ -62,6 +62,9 @@ struct _VikLayer {
 
   /* for explicit "polymorphism" (function type switching) */
   VikLayerTypeEnum type;
+
+  gint64 draw_time; // Microseconds taken by the most recent draw (including any sublayers)
+  gboolean memory_warned; // See a_memory_usage_check()
 };
 
 /* I think most of these are ignored,
@@ -189,6 +192,25 @@ typedef double        (*VikLayerFuncGetTimestamp)          (VikLayer *);
 //  useful to hook in a separate redraw
 typedef gboolean      (*VikLayerFuncRefresh)               (VikLayer *);
 
+// Kinds of memory held by a layer, see vik_layer_get_memory()
+typedef enum {
+  VIK_LAYER_MEMORY_POINTS,     // Tracks, trackpoints and waypoints
+  VIK_LAYER_MEMORY_STRINGS,    // Names, comments, descriptions and so on
+  VIK_LAYER_MEMORY_EXTENSIONS, // Unparsed GPX extensions
+  VIK_LAYER_MEMORY_IMAGES,     // Images and thumbnails
+  VIK_LAYER_MEMORY_DEM,        // Loaded DEM tiles
+  VIK_LAYER_MEMORY_CACHES,     // Cached surfaces, map tiles and derived data
+  VIK_LAYER_MEMORY_NUM
+} VikLayerMemoryType;
+
+// Approximate bytes of each kind
+typedef struct {
+  gsize bytes[VIK_LAYER_MEMORY_NUM];
+} VikLayerMemory;
+
+// Add the layer's own memory to the totals (not including any child layers)
+typedef void          (*VikLayerFuncGetMemory)             (VikLayer *, VikLayerMemory *);
+
 typedef enum {
   VIK_MENU_ITEM_PROPERTY=1,
   VIK_MENU_ITEM_CUT=2,
@@ -268,6 +290,8 @@ struct _VikLayerInterface {
   VikLayerFuncSelectedViewportMenu  show_viewport_menu;
 
   VikLayerFuncRefresh               refresh;
+
+  VikLayerFuncGetMemory             get_memory;
 };
 
 VikLayerInterface *vik_layer_get_interface ( VikLayerTypeEnum type );
@@ -282,6 +306,10 @@ const gchar *vik_layer_get_name ( VikLayer *l );
 
 gdouble vik_layer_get_timestamp ( VikLayer *vl );
 
+void vik_layer_get_memory ( VikLayer *vl, VikLayerMemory *mem );
+gsize vik_layer_memory_total ( const VikLayerMemory *mem );
+const gchar *vik_layer_memory_type_name ( VikLayerMemoryType type );
+
 gboolean vik_layer_set_param ( VikLayer *vl, VikLayerSetParam *vlsp );
 
 void vik_layer_set_defaults ( VikLayer *vl, VikViewport *vvp );
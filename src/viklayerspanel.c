@@ -22,6 +22,7 @@
 #include "viking.h"
 #include <gdk/gdkkeysyms.h>
 #include "vikgoto.h"
+#include "memoryusage.h"
 
 enum {
   VLP_UPDATE_SIGNAL,
@@ -131,6 +132,7 @@ static GtkWidget* layers_panel_create_popup ( VikLayersPanel *vlp, gboolean full
 
   if ( full ) {
     (void)vu_menu_add_item ( GTK_MENU(menu), NULL, GTK_STOCK_PROPERTIES, G_CALLBACK(vik_layers_panel_properties), vlp );
+    (void)vu_menu_add_item ( GTK_MENU(menu), _("_Memory Usage"), NULL, G_CALLBACK(vik_layers_panel_memory_usage), vlp );
     for ( ii = 0; ii < G_N_ELEMENTS(entries); ii++ ) {
       (void)vu_menu_add_item ( GTK_MENU(menu), entries[ii].label, entries[ii].stock_id, G_CALLBACK(entries[ii].callback), vlp );
     }
@@ -683,6 +685,7 @@ static void layers_popup ( VikLayersPanel *vlp, GtkTreeIter *iter, gint mouse_bu
 	if (menu_selection & VIK_MENU_ITEM_PROPERTY) {
           (void)vu_menu_add_item ( menu, NULL, GTK_STOCK_PROPERTIES, G_CALLBACK(vik_layers_panel_properties), vlp );
 	}
+        (void)vu_menu_add_item ( menu, _("_Memory Usage"), NULL, G_CALLBACK(vik_layers_panel_memory_usage), vlp );
 
 	if (menu_selection & VIK_MENU_ITEM_CUT) {
           (void)vu_menu_add_item ( menu, NULL, GTK_STOCK_CUT, G_CALLBACK(vik_layers_panel_cut_selected), vlp );
@@ -851,6 +854,16 @@ gboolean vik_layers_panel_properties ( VikLayersPanel *vlp )
     return FALSE;
 }
 
+void vik_layers_panel_memory_usage ( VikLayersPanel *vlp )
+{
+  GtkTreeIter iter;
+  if ( vik_treeview_get_selected_iter ( vlp->vt, &iter ) && vik_treeview_item_get_type ( vlp->vt, &iter ) == VIK_TREEVIEW_TYPE_LAYER )
+  {
+    VikLayer *layer = VIK_LAYER( vik_treeview_item_get_pointer ( vlp->vt, &iter ) );
+    a_memory_usage_show ( VIK_GTK_WINDOW_FROM_WIDGET(vlp), layer, FALSE );
+  }
+}
+
 void vik_layers_panel_draw_all ( VikLayersPanel *vlp )
 {
   if ( vlp->vvp && VIK_LAYER(vlp->toplayer)->visible )
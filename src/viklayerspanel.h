@@ -63,6 +63,7 @@ void vik_layers_panel_set_viewport ( VikLayersPanel *vlp, VikViewport *vvp );
 VikViewport *vik_layers_panel_get_viewport ( VikLayersPanel *vlp );
 void vik_layers_panel_emit_update ( VikLayersPanel *vlp );
 gboolean vik_layers_panel_properties ( VikLayersPanel *vlp );
+void vik_layers_panel_memory_usage ( VikLayersPanel *vlp );
 gboolean vik_layers_panel_new_layer ( VikLayersPanel *vlp, VikLayerTypeEnum type );
 void vik_layers_panel_clear ( VikLayersPanel *vlp );
 VikAggregateLayer *vik_layers_panel_get_top_layer ( VikLayersPanel *vlp );
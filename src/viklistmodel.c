@@ -0,0 +1,225 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * A read only list for a GtkTreeView, where the value of a cell is only worked out when
+ *  it is first asked for and then remembered.
+ * Thus a view in fixed height mode on a long list only computes the rows that get shown,
+ *  and sorting by a column (e.g. via GtkTreeModelSort) only computes that column.
+ */
+#include "viklistmodel.h"
+
+typedef struct {
+	guint32 filled; // Bitmask of the columns with values
+	GValue *values; // Allocated on first use
+} ListRow;
+
+struct _VikListModel {
+	GObject object;
+	gint stamp;
+	gint n_columns;
+	GType types[VIK_LIST_MODEL_MAX_COLUMNS];
+	GPtrArray *items;
+	ListRow *rows;
+	VikListModelFillFunc fill_func;
+	gpointer user_data;
+};
+
+static void vik_list_model_tree_model_init ( GtkTreeModelIface *iface );
+
+G_DEFINE_TYPE_WITH_CODE (VikListModel, vik_list_model, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL, vik_list_model_tree_model_init))
+
+static void vik_list_model_finalize ( GObject *object )
+{
+	VikListModel *vlm = VIK_LIST_MODEL(object);
+	for ( guint ii = 0; ii < vlm->items->len; ii++ ) {
+		ListRow *row = &vlm->rows[ii];
+		if ( row->values ) {
+			for ( gint cc = 0; cc < vlm->n_columns; cc++ )
+				g_value_unset ( &row->values[cc] );
+			g_free ( row->values );
+		}
+	}
+	g_free ( vlm->rows );
+	g_ptr_array_unref ( vlm->items );
+
+	G_OBJECT_CLASS(vik_list_model_parent_class)->finalize ( object );
+}
+
+static void vik_list_model_class_init ( VikListModelClass *klass )
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = vik_list_model_finalize;
+}
+
+static void vik_list_model_init ( VikListModel *vlm )
+{
+	vlm->stamp = g_random_int ();
+}
+
+/**
+ * vik_list_model_new:
+ * @n_columns: Up to VIK_LIST_MODEL_MAX_COLUMNS
+ * @types:     The type of each column
+ * @items:     The item for each row, a reference is taken on the array
+ * @fill_func: Called to get the values of a row when needed
+ *
+ * The list can not be changed afterwards.
+ */
+VikListModel *vik_list_model_new ( gint n_columns, const GType *types, GPtrArray *items, VikListModelFillFunc fill_func, gpointer user_data )
+{
+	g_return_val_if_fail ( n_columns > 0 && n_columns <= VIK_LIST_MODEL_MAX_COLUMNS, NULL );
+
+	VikListModel *vlm = VIK_LIST_MODEL(g_object_new ( VIK_LIST_MODEL_TYPE, NULL ));
+	vlm->n_columns = n_columns;
+	for ( gint cc = 0; cc < n_columns; cc++ )
+		vlm->types[cc] = types[cc];
+	vlm->items = g_ptr_array_ref ( items );
+	vlm->rows = g_new0 ( ListRow, items->len ? items->len : 1 );
+	vlm->fill_func = fill_func;
+	vlm->user_data = user_data;
+	return vlm;
+}
+
+/**
+ * vik_list_model_get_item:
+ *
+ * Returns: The item of the row, without needing any of its values
+ */
+gpointer vik_list_model_get_item ( VikListModel *vlm, GtkTreeIter *iter )
+{
+	g_return_val_if_fail ( iter->stamp == vlm->stamp, NULL );
+	return g_ptr_array_index ( vlm->items, GPOINTER_TO_UINT(iter->user_data) );
+}
+
+static GtkTreeModelFlags list_model_get_flags ( GtkTreeModel *model )
+{
+	return GTK_TREE_MODEL_LIST_ONLY | GTK_TREE_MODEL_ITERS_PERSIST;
+}
+
+static gint list_model_get_n_columns ( GtkTreeModel *model )
+{
+	return VIK_LIST_MODEL(model)->n_columns;
+}
+
+static GType list_model_get_column_type ( GtkTreeModel *model, gint index )
+{
+	VikListModel *vlm = VIK_LIST_MODEL(model);
+	g_return_val_if_fail ( index >= 0 && index < vlm->n_columns, G_TYPE_INVALID );
+	return vlm->types[index];
+}
+
+static gboolean list_model_set_iter ( VikListModel *vlm, GtkTreeIter *iter, gint index )
+{
+	if ( index < 0 || index >= (gint)vlm->items->len ) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+	iter->stamp = vlm->stamp;
+	iter->user_data = GINT_TO_POINTER(index);
+	return TRUE;
+}
+
+static gboolean list_model_get_iter ( GtkTreeModel *model, GtkTreeIter *iter, GtkTreePath *path )
+{
+	if ( gtk_tree_path_get_depth (path) != 1 )
+		return FALSE;
+	return list_model_set_iter ( VIK_LIST_MODEL(model), iter, gtk_tree_path_get_indices(path)[0] );
+}
+
+static GtkTreePath *list_model_get_path ( GtkTreeModel *model, GtkTreeIter *iter )
+{
+	g_return_val_if_fail ( iter->stamp == VIK_LIST_MODEL(model)->stamp, NULL );
+	GtkTreePath *path = gtk_tree_path_new ();
+	gtk_tree_path_append_index ( path, GPOINTER_TO_INT(iter->user_data) );
+	return path;
+}
+
+static void list_model_get_value ( GtkTreeModel *model, GtkTreeIter *iter, gint column, GValue *value )
+{
+	VikListModel *vlm = VIK_LIST_MODEL(model);
+	g_return_if_fail ( iter->stamp == vlm->stamp );
+	g_return_if_fail ( column >= 0 && column < vlm->n_columns );
+
+	guint index = GPOINTER_TO_UINT(iter->user_data);
+	ListRow *row = &vlm->rows[index];
+	if ( !row->values ) {
+		row->values = g_new0 ( GValue, vlm->n_columns );
+		for ( gint cc = 0; cc < vlm->n_columns; cc++ )
+			g_value_init ( &row->values[cc], vlm->types[cc] );
+	}
+	if ( !(row->filled & (1 << column)) )
+		row->filled |= vlm->fill_func ( g_ptr_array_index(vlm->items, index), column, row->values, vlm->user_data ) | (1 << column);
+
+	g_value_init ( value, vlm->types[column] );
+	g_value_copy ( &row->values[column], value );
+}
+
+static gboolean list_model_iter_next ( GtkTreeModel *model, GtkTreeIter *iter )
+{
+	return list_model_set_iter ( VIK_LIST_MODEL(model), iter, GPOINTER_TO_INT(iter->user_data) + 1 );
+}
+
+static gboolean list_model_iter_children ( GtkTreeModel *model, GtkTreeIter *iter, GtkTreeIter *parent )
+{
+	if ( parent )
+		return FALSE;
+	return list_model_set_iter ( VIK_LIST_MODEL(model), iter, 0 );
+}
+
+static gboolean list_model_iter_has_child ( GtkTreeModel *model, GtkTreeIter *iter )
+{
+	return FALSE;
+}
+
+static gint list_model_iter_n_children ( GtkTreeModel *model, GtkTreeIter *iter )
+{
+	if ( iter )
+		return 0;
+	return VIK_LIST_MODEL(model)->items->len;
+}
+
+static gboolean list_model_iter_nth_child ( GtkTreeModel *model, GtkTreeIter *iter, GtkTreeIter *parent, gint n )
+{
+	if ( parent )
+		return FALSE;
+	return list_model_set_iter ( VIK_LIST_MODEL(model), iter, n );
+}
+
+static gboolean list_model_iter_parent ( GtkTreeModel *model, GtkTreeIter *iter, GtkTreeIter *child )
+{
+	return FALSE;
+}
+
+static void vik_list_model_tree_model_init ( GtkTreeModelIface *iface )
+{
+	iface->get_flags = list_model_get_flags;
+	iface->get_n_columns = list_model_get_n_columns;
+	iface->get_column_type = list_model_get_column_type;
+	iface->get_iter = list_model_get_iter;
+	iface->get_path = list_model_get_path;
+	iface->get_value = list_model_get_value;
+	iface->iter_next = list_model_iter_next;
+	iface->iter_children = list_model_iter_children;
+	iface->iter_has_child = list_model_iter_has_child;
+	iface->iter_n_children = list_model_iter_n_children;
+	iface->iter_nth_child = list_model_iter_nth_child;
+	iface->iter_parent = list_model_iter_parent;
+}
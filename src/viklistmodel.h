@@ -0,0 +1,61 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _VIKING_LISTMODEL_H
+#define _VIKING_LISTMODEL_H
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define VIK_LIST_MODEL_TYPE            (vik_list_model_get_type ())
+#define VIK_LIST_MODEL(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), VIK_LIST_MODEL_TYPE, VikListModel))
+#define VIK_LIST_MODEL_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), VIK_LIST_MODEL_TYPE, VikListModelClass))
+#define IS_VIK_LIST_MODEL(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), VIK_LIST_MODEL_TYPE))
+
+#define VIK_LIST_MODEL_MAX_COLUMNS 32
+
+typedef struct _VikListModel VikListModel;
+typedef struct _VikListModelClass VikListModelClass;
+
+struct _VikListModelClass
+{
+	GObjectClass object_class;
+};
+
+/**
+ * VikListModelFillFunc:
+ * @item:   The item of the row
+ * @column: The column wanted
+ * @values: The values of the row, already initialized to the column types
+ *
+ * Set the value of the column, and optionally any other columns that are obtained together.
+ *
+ * Returns: The bitmask of the columns set, which must include @column
+ */
+typedef guint32 (*VikListModelFillFunc) ( gpointer item, gint column, GValue *values, gpointer user_data );
+
+GType vik_list_model_get_type ();
+
+VikListModel *vik_list_model_new ( gint n_columns, const GType *types, GPtrArray *items, VikListModelFillFunc fill_func, gpointer user_data );
+gpointer vik_list_model_get_item ( VikListModel *vlm, GtkTreeIter *iter );
+
+G_END_DECLS
+
+#endif
@@ -26,9 +26,13 @@
 #include "maputils.h"
 #include "mapcoord.h"
 #include "mapcache.h"
+#include "metatile.h"
+#include "pixbufpool.h"
+#include "tiledecode.h"
 #include "dir.h"
 #include "mapnik_interface.h"
 #include "background.h"
+#include "trace.h"
 
 #include "vikmapslayer.h"
 
@@ -69,6 +73,15 @@ static void reset_cb ( GtkWidget *widget, gpointer ptr )
 
 static VikLayerParamData reset_default ( void ) { return VIK_LPD_PTR(reset_cb); }
 
+enum {
+  MAPNIK_CACHE_LAYOUT_FILES = 0,
+  MAPNIK_CACHE_LAYOUT_METATILES, // As renderd writes them
+  MAPNIK_CACHE_LAYOUT_NUM
+};
+
+static gchar *params_cache_layouts[] = { N_("Tile Files"), N_("Metatiles"), NULL };
+static VikLayerParamData cache_layout_default ( void ) { return VIK_LPD_UINT(MAPNIK_CACHE_LAYOUT_FILES); }
+
 VikLayerParam mapnik_layer_params[] = {
   { VIK_LAYER_MAPNIK, "config-file-mml", VIK_LAYER_PARAM_STRING, VIK_LAYER_GROUP_NONE, N_("CSS (MML) Config File:"), VIK_LAYER_WIDGET_FILEENTRY, GINT_TO_POINTER(VF_FILTER_CARTO), NULL,
     N_("CartoCSS configuration file"), file_default, NULL, NULL },
@@ -80,6 +93,8 @@ VikLayerParam mapnik_layer_params[] = {
     NULL, vik_lpd_true_default, NULL, NULL },
   { VIK_LAYER_MAPNIK, "file-cache-dir", VIK_LAYER_PARAM_STRING, VIK_LAYER_GROUP_NONE, N_("File Cache Directory:"), VIK_LAYER_WIDGET_FOLDERENTRY, NULL, NULL,
     NULL, cache_dir_default, NULL, NULL },
+  { VIK_LAYER_MAPNIK, "file-cache-layout", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("File Cache Layout:"), VIK_LAYER_WIDGET_COMBOBOX, params_cache_layouts, NULL,
+    N_("Metatiles keep 8x8 tiles in each file, the same as a renderd tile server"), cache_layout_default, NULL, NULL },
   { VIK_LAYER_MAPNIK, "reset", VIK_LAYER_PARAM_PTR_DEFAULT, VIK_LAYER_GROUP_NONE, NULL,
     VIK_LAYER_WIDGET_BUTTON, N_("Reset to Defaults"), NULL, NULL, reset_default, NULL, NULL },
 };
@@ -90,20 +105,26 @@ enum {
   PARAM_ALPHA,
   PARAM_USE_FILE_CACHE,
   PARAM_FILE_CACHE_DIR,
+  PARAM_FILE_CACHE_LAYOUT,
   PARAM_RESET,
   NUM_PARAMS };
 
 static const gchar* mapnik_layer_tooltip ( VikMapnikLayer *vml );
+static void mapnik_layer_get_memory ( VikMapnikLayer *vml, VikLayerMemory *mem );
 static void mapnik_layer_marshall( VikMapnikLayer *vml, guint8 **data, guint *len );
 static VikMapnikLayer *mapnik_layer_unmarshall( guint8 *data, guint len, VikViewport *vvp );
 static gboolean mapnik_layer_set_param ( VikMapnikLayer *vml, guint16 id, VikLayerParamData data, VikViewport *vp, gboolean is_file_operation );
 static VikLayerParamData mapnik_layer_get_param ( VikMapnikLayer *vml, guint16 id, gboolean is_file_operation );
+static void render_stats_reset ( VikMapnikLayer *vml );
 static VikMapnikLayer *mapnik_layer_new ( VikViewport *vvp );
 static VikMapnikLayer *mapnik_layer_create ( VikViewport *vp );
 static void mapnik_layer_free ( VikMapnikLayer *vml );
 static void mapnik_layer_draw ( VikMapnikLayer *vml, VikViewport *vp );
 static void mapnik_layer_add_menu_items ( VikMapnikLayer *vml, GtkMenu *menu, gpointer vlp );
 
+typedef struct _SaveInfo SaveInfo;
+static void save_pixbuf ( SaveInfo *si, gpointer user_data );
+
 static gpointer mapnik_feature_create ( VikWindow *vw, VikViewport *vvp)
 {
   return vvp;
@@ -196,8 +217,23 @@ VikLayerInterface vik_mapnik_layer_interface = {
 	(VikLayerFuncSelectedViewportMenu)    NULL,
 
 	(VikLayerFuncRefresh)                 NULL,
+	(VikLayerFuncGetMemory)               mapnik_layer_get_memory,
 };
 
+// Render time profiling
+#define RENDER_STATS_ZOOMS 24
+#define RENDER_STATS_BUCKETS 8
+#define RENDER_STATS_SLOWEST 20
+// Upper bounds of the histogram buckets in seconds (the last is unbounded)
+static const gdouble render_stats_bounds[RENDER_STATS_BUCKETS-1] = { 0.05, 0.1, 0.25, 0.5, 1.0, 2.0, 5.0 };
+
+typedef struct {
+	gint zoom;
+	gint x, y;
+	guint block;
+	gdouble duration;
+} RenderTime;
+
 struct _VikMapnikLayer {
 	VikLayer vl;
 	gchar *filename_css; // CartoCSS MML File - use 'carto' to convert into xml
@@ -211,11 +247,24 @@ struct _VikMapnikLayer {
 
 	gboolean use_file_cache;
 	gchar *file_cache_dir;
+	guint file_cache_layout;
 
 	VikCoord rerender_ul;
 	VikCoord rerender_br;
 	gdouble rerender_zoom;
 	GtkWidget *right_click_menu;
+
+	// View at the last draw, to predict where it goes next
+	gboolean last_valid;
+	VikCoord last_center;
+	gdouble last_xmpp;
+	gint zoom_trend; // <0 zooming in, >0 zooming out
+
+	// Render durations since the configuration was loaded
+	GMutex *stats_mutex;
+	guint stats_hist[RENDER_STATS_ZOOMS][RENDER_STATS_BUCKETS];
+	gdouble stats_total[RENDER_STATS_ZOOMS];
+	GArray *stats_slowest; // Of RenderTime, slowest first
 };
 
 #define MAPNIK_PREFS_GROUP_KEY "mapnik"
@@ -262,6 +311,9 @@ static VikLayerParamData carto_default ( void ) {
 
 static VikLayerParamData rr_to_default ( void ) { return VIK_LPD_UINT(168); } // One week in hours
 
+static gchar *params_render_blocks[] = { N_("1x1"), N_("2x2"), N_("4x4"), NULL };
+static VikLayerParamData render_block_default ( void ) { return VIK_LPD_UINT(1); } // 2x2
+
 static VikLayerParam prefs[] = {
 	// Changing these values only applies before first mapnik layer is 'created'
 	{ VIK_LAYER_NUM_TYPES, MAPNIK_PREFS_NAMESPACE"plugins_directory", VIK_LAYER_PARAM_STRING, VIK_LAYER_GROUP_NONE, N_("Plugins Directory:"), VIK_LAYER_WIDGET_FOLDERENTRY, NULL, NULL, N_("You need to restart Viking for a change to this value to be used"), plugins_default, NULL, NULL },
@@ -270,12 +322,19 @@ static VikLayerParam prefs[] = {
 	{ VIK_LAYER_NUM_TYPES, MAPNIK_PREFS_NAMESPACE"rerender_after", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Rerender Timeout (hours):"), VIK_LAYER_WIDGET_SPINBUTTON, &scales[2], NULL, N_("You need to restart Viking for a change to this value to be used"), rr_to_default, NULL, NULL },
 	// Changeable any time
 	{ VIK_LAYER_NUM_TYPES, MAPNIK_PREFS_NAMESPACE"carto", VIK_LAYER_PARAM_STRING, VIK_LAYER_GROUP_NONE, N_("CartoCSS:"), VIK_LAYER_WIDGET_FILEENTRY, NULL, NULL,  N_("The program to convert CartoCSS files into Mapnik XML"), carto_default, NULL, NULL },
+	{ VIK_LAYER_NUM_TYPES, MAPNIK_PREFS_NAMESPACE"prerender", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Prerender:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, N_("Render tiles in advance where the view is expected to move to next"), vik_lpd_true_default, NULL, NULL },
+	{ VIK_LAYER_NUM_TYPES, MAPNIK_PREFS_NAMESPACE"render_block", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Render Block (tiles):"), VIK_LAYER_WIDGET_COMBOBOX, params_render_blocks, NULL, N_("Neighbouring tiles rendered together. Larger blocks spend less time overall in setting up each render."), render_block_default, NULL, NULL },
 };
 
 static time_t planet_import_time;
 
 static GMutex *tp_mutex;
 static GHashTable *requests = NULL;
+static GThreadPool *save_pool = NULL; // Writing to the file cache
+
+// Speculative rendering - any queued renders from older generations are abandoned
+static gint prerender_generation = 1;
+static gint prerender_count = 0; // Queued or running
 
 /**
  * vik_mapnik_layer_init:
@@ -302,6 +361,8 @@ void vik_mapnik_layer_post_init (void)
 	// Just storing keys only
 	requests = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
 
+	save_pool = g_thread_pool_new ( (GFunc)save_pixbuf, NULL, 1, FALSE, NULL );
+
 	guint hours = a_preferences_get (MAPNIK_PREFS_NAMESPACE"rerender_after")->u;
 	GDateTime *now = g_date_time_new_now_local ();
 	GDateTime *then = g_date_time_add_hours (now, -hours);
@@ -324,6 +385,8 @@ void vik_mapnik_layer_uninit ()
 {
 	vik_mutex_free (tp_mutex);
 	g_hash_table_destroy ( requests );
+	// Finish off any pending saves
+	g_thread_pool_free ( save_pool, FALSE, TRUE );
 }
 
 // NB Only performed once per program run
@@ -366,6 +429,13 @@ static const gchar* mapnik_layer_tooltip ( VikMapnikLayer *vml )
 	return vml->filename_xml;
 }
 
+static void mapnik_layer_get_memory ( VikMapnikLayer *vml, VikLayerMemory *mem )
+{
+	mapcache_stats_t stats;
+	a_mapcache_get_stats_layer ( vml, &stats );
+	mem->bytes[VIK_LAYER_MEMORY_CACHES] += stats.bytes;
+}
+
 static void mapnik_layer_set_file_xml ( VikMapnikLayer *vml, const gchar *name )
 {
 	if ( vml->filename_xml )
@@ -411,6 +481,7 @@ static gboolean mapnik_layer_set_param ( VikMapnikLayer *vml, guint16 id, VikLay
 		case PARAM_ALPHA: if ( data.u <= 255 ) vml->alpha = data.u; break;
 		case PARAM_USE_FILE_CACHE: vml->use_file_cache = data.b; break;
 		case PARAM_FILE_CACHE_DIR: mapnik_layer_set_cache_dir (vml, data.s); break;
+		case PARAM_FILE_CACHE_LAYOUT: if ( data.u < MAPNIK_CACHE_LAYOUT_NUM ) vml->file_cache_layout = data.u; break;
 		default: break;
 	}
 	return TRUE;
@@ -457,6 +528,7 @@ static VikLayerParamData mapnik_layer_get_param ( VikMapnikLayer *vml, guint16 i
 		case PARAM_ALPHA: data.u = vml->alpha; break;
 		case PARAM_USE_FILE_CACHE: data.b = vml->use_file_cache; break;
 		case PARAM_FILE_CACHE_DIR: data.s = vml->file_cache_dir; break;
+		case PARAM_FILE_CACHE_LAYOUT: data.u = vml->file_cache_layout; break;
 		default: break;
 	}
 	return data;
@@ -469,10 +541,17 @@ static VikMapnikLayer *mapnik_layer_new ( VikViewport *vvp )
 {
 	VikMapnikLayer *vml = VIK_MAPNIK_LAYER ( g_object_new ( VIK_MAPNIK_LAYER_TYPE, NULL ) );
 	vik_layer_set_type ( VIK_LAYER(vml), VIK_LAYER_MAPNIK );
+	a_mapcache_add_layer ( vml );
 	vik_layer_set_defaults ( VIK_LAYER(vml), vvp );
 	vml->tile_size_x = size_default().u; // FUTURE: Is there any use in this being configurable?
 	vml->loaded = FALSE;
 	vml->mi = mapnik_interface_new();
+	vml->last_valid = FALSE;
+	vml->zoom_trend = 0;
+	vml->stats_mutex = vik_mutex_new ();
+	memset ( vml->stats_hist, 0, sizeof(vml->stats_hist) );
+	memset ( vml->stats_total, 0, sizeof(vml->stats_total) );
+	vml->stats_slowest = g_array_new ( FALSE, FALSE, sizeof(RenderTime) );
 	return vml;
 }
 
@@ -605,6 +684,7 @@ static void mapnik_layer_post_read (VikLayer *vl, VikViewport *vvp, gboolean fro
 	}
 	else {
 		vml->loaded = TRUE;
+		render_stats_reset ( vml );
 		if ( !from_file )
 			ui_add_recent_file ( vml->filename_xml );
 	}
@@ -618,24 +698,115 @@ static gchar *get_filename ( gchar *dir, guint x, guint y, guint z)
 	return g_strdup_printf ( MAPNIK_LAYER_FILE_CACHE_LAYOUT, dir, (17-z), x, y );
 }
 
-static void possibly_save_pixbuf ( VikMapnikLayer *vml, GdkPixbuf *pixbuf, MapCoord *ulm )
+/**
+ * Free returned string after use
+ *
+ * Returns: The file in the cache holding the tile
+ */
+static gchar *get_cache_filename ( VikMapnikLayer *vml, MapCoord *mc )
 {
-	if ( vml->use_file_cache ) {
-		if ( vml->file_cache_dir ) {
-			GError *error = NULL;
-			gchar *filename = get_filename ( vml->file_cache_dir, ulm->x, ulm->y, ulm->scale );
+	if ( vml->file_cache_layout == MAPNIK_CACHE_LAYOUT_METATILES ) {
+		char path[PATH_MAX];
+		(void)xyz_to_meta ( path, sizeof(path), vml->file_cache_dir, mc->x, mc->y, 17 - mc->scale );
+		return g_strdup ( path );
+	}
+	return get_filename ( vml->file_cache_dir, mc->x, mc->y, mc->scale );
+}
 
-			gchar *dir = g_path_get_dirname ( filename );
-			if ( !g_file_test ( filename, G_FILE_TEST_EXISTS ) )
-				if ( g_mkdir_with_parents ( dir , 0777 ) != 0 )
-					g_warning ("%s: Failed to mkdir %s", __FUNCTION__, dir );
-			g_free ( dir );
+static gint metatile_offset ( MapCoord *mc )
+{
+	return (mc->x & (METATILE-1)) * METATILE + (mc->y & (METATILE-1));
+}
+
+struct _SaveInfo {
+	gchar *filename; // Or for a metatile, the cache directory
+	GdkPixbuf *pixbuf;
+	// For a metatile - the tiles by their offset within it (any not rendered are NULL)
+	gint x, y, zoom;
+	GdkPixbuf *tiles[METATILE*METATILE];
+};
 
-			if ( !gdk_pixbuf_save (pixbuf, filename, "png", &error, NULL ) ) {
+/**
+ * Write the rendered tiles into their metatile, keeping the other tiles already there
+ */
+static void save_metatile ( SaveInfo *si )
+{
+	GBytes *tiles[METATILE*METATILE];
+	for ( guint ii = 0; ii < METATILE*METATILE; ii++ ) {
+		tiles[ii] = NULL;
+		if ( si->tiles[ii] ) {
+			gchar *buffer;
+			gsize size;
+			GError *error = NULL;
+			if ( gdk_pixbuf_save_to_buffer ( si->tiles[ii], &buffer, &size, "png", &error, NULL ) )
+				tiles[ii] = g_bytes_new_take ( buffer, size );
+			else {
 				g_warning ("%s: %s", __FUNCTION__, error->message );
 				g_error_free (error);
 			}
-			g_free (filename);
+			g_object_unref ( si->tiles[ii] );
+		}
+	}
+
+	char log_msg[PATH_MAX];
+	if ( metatile_write ( si->filename, si->x, si->y, si->zoom, tiles, log_msg ) < 0 )
+		g_warning ("%s: %s", __FUNCTION__, log_msg );
+
+	for ( guint ii = 0; ii < METATILE*METATILE; ii++ )
+		if ( tiles[ii] )
+			g_bytes_unref ( tiles[ii] );
+}
+
+/**
+ * Write a rendered tile to the file cache - runs in the save thread
+ */
+static void save_pixbuf ( SaveInfo *si, gpointer user_data )
+{
+	if ( !si->pixbuf ) {
+		save_metatile ( si );
+		g_free ( si->filename );
+		g_free ( si );
+		return;
+	}
+
+	GError *error = NULL;
+	gchar *dir = g_path_get_dirname ( si->filename );
+	if ( !g_file_test ( dir, G_FILE_TEST_EXISTS ) )
+		if ( g_mkdir_with_parents ( dir , 0777 ) != 0 )
+			g_warning ("%s: Failed to mkdir %s", __FUNCTION__, dir );
+	g_free ( dir );
+
+	if ( !gdk_pixbuf_save (si->pixbuf, si->filename, "png", &error, NULL ) ) {
+		g_warning ("%s: %s", __FUNCTION__, error->message );
+		g_error_free (error);
+	}
+	g_object_unref ( si->pixbuf );
+	g_free ( si->filename );
+	g_free ( si );
+}
+
+/**
+ * Queue the tile to be saved, so rendering can carry on without waiting for the PNG encoding
+ *  NB The pixbuf must not be modified afterwards
+ *
+ * With a metatile cache, the tile is instead added to the metatile save (if any),
+ *  which is queued once all the tiles of the render are in it
+ */
+static void possibly_save_pixbuf ( VikMapnikLayer *vml, GdkPixbuf *pixbuf, MapCoord *ulm, SaveInfo *msi )
+{
+	if ( msi ) {
+		gint offset = metatile_offset ( ulm );
+		if ( msi->tiles[offset] )
+			g_object_unref ( msi->tiles[offset] );
+		msi->tiles[offset] = g_object_ref ( pixbuf );
+		return;
+	}
+	if ( vml->use_file_cache ) {
+		if ( vml->file_cache_dir ) {
+			SaveInfo *si = g_malloc0 ( sizeof(SaveInfo) );
+			si->filename = get_filename ( vml->file_cache_dir, ulm->x, ulm->y, ulm->scale );
+			si->pixbuf = g_object_ref ( pixbuf );
+			g_thread_pool_push ( save_pool, si, NULL );
 		}
 	}
 }
@@ -646,32 +817,125 @@ typedef struct
 	VikCoord *ul;
 	VikCoord *br;
 	MapCoord *ulmc;
+	guint block;
+	gboolean speculative; // Only wanted if the view moves as predicted
+	guint generation;
 	const gchar* request;
 } RenderInfo;
 
+static void render_stats_reset ( VikMapnikLayer *vml )
+{
+	g_mutex_lock ( vml->stats_mutex );
+	memset ( vml->stats_hist, 0, sizeof(vml->stats_hist) );
+	memset ( vml->stats_total, 0, sizeof(vml->stats_total) );
+	g_array_set_size ( vml->stats_slowest, 0 );
+	g_mutex_unlock ( vml->stats_mutex );
+}
+
+/**
+ * Record how long a render took - may be called from any thread
+ */
+static void render_stats_add ( VikMapnikLayer *vml, MapCoord *ulm, guint block, gdouble duration )
+{
+	RenderTime rt = { CLAMP(17 - ulm->scale, 0, RENDER_STATS_ZOOMS-1), ulm->x, ulm->y, block, duration };
+	guint bucket = 0;
+	while ( bucket < RENDER_STATS_BUCKETS-1 && duration >= render_stats_bounds[bucket] )
+		bucket++;
+
+	g_mutex_lock ( vml->stats_mutex );
+	vml->stats_hist[rt.zoom][bucket]++;
+	vml->stats_total[rt.zoom] += duration;
+	// Keep the slowest in order
+	guint ii = 0;
+	while ( ii < vml->stats_slowest->len && g_array_index(vml->stats_slowest, RenderTime, ii).duration >= duration )
+		ii++;
+	if ( ii < RENDER_STATS_SLOWEST ) {
+		g_array_insert_val ( vml->stats_slowest, ii, rt );
+		if ( vml->stats_slowest->len > RENDER_STATS_SLOWEST )
+			g_array_set_size ( vml->stats_slowest, RENDER_STATS_SLOWEST );
+	}
+	g_mutex_unlock ( vml->stats_mutex );
+}
+
+/**
+ * The number of tiles along each side of a block to be rendered together
+ */
+static guint render_block_size ( MapCoord *ulm )
+{
+	guint block = 1 << MIN(a_preferences_get(MAPNIK_PREFS_NAMESPACE"render_block")->u, 2);
+	// Not more than the whole world at this zoom level
+	gint zoom = 17 - ulm->scale;
+	while ( block > 1 && (zoom < 0 || (1 << zoom) < (gint)block) )
+		block /= 2;
+	return block;
+}
+
 /**
  * render:
  *
  * Common render function which can run in separate thread
+ *  Renders a block of tiles starting at ulm in one go, then splits it up
  */
-static void render ( VikMapnikLayer *vml, VikCoord *ul, VikCoord *br, MapCoord *ulm )
+static void render ( VikMapnikLayer *vml, VikCoord *ul, VikCoord *br, MapCoord *ulm, guint block )
 {
+	guint size = vml->tile_size_x;
 	gint64 tt1 = g_get_real_time ();
-	GdkPixbuf *pixbuf = mapnik_interface_render ( vml->mi, ul->north_south, ul->east_west, br->north_south, br->east_west );
+	VIK_TRACE_TILE ( "mapnik", "render", TRACE_PHASE_BEGIN, ulm->x, ulm->y, ulm->scale );
+	GdkPixbuf *pixbuf = mapnik_interface_render_size ( vml->mi, ul->north_south, ul->east_west, br->north_south, br->east_west, size*block, size*block );
+	VIK_TRACE_ARG ( "mapnik", "render", TRACE_PHASE_END, "block", block );
 	gint64 tt2 = g_get_real_time ();
 	gdouble tt = (gdouble)(tt2-tt1)/1000000;
-	g_debug ( "Mapnik rendering completed in %.3f seconds", tt );
-	if ( !pixbuf ) {
-		// A pixbuf to stick into cache incase of an unrenderable area - otherwise will get continually re-requested
-		pixbuf = gdk_pixbuf_scale_simple ( ui_get_icon("vikmapniklayer", 16), vml->tile_size_x, vml->tile_size_x, GDK_INTERP_BILINEAR );
+	g_debug ( "Mapnik rendering of %dx%d tiles completed in %.3f seconds", block, block, tt );
+	render_stats_add ( vml, ulm, block, tt );
+
+	// Blocks are aligned to their size, so all the tiles of one fall in the same metatile
+	SaveInfo *msi = NULL;
+	if ( vml->use_file_cache && vml->file_cache_dir && vml->file_cache_layout == MAPNIK_CACHE_LAYOUT_METATILES ) {
+		msi = g_malloc0 ( sizeof(SaveInfo) );
+		msi->filename = g_strdup ( vml->file_cache_dir );
+		msi->x = ulm->x;
+		msi->y = ulm->y;
+		msi->zoom = 17 - ulm->scale;
 	}
-	possibly_save_pixbuf ( vml, pixbuf, ulm );
 
-	// NB Mapnik can apply alpha, but use our own function for now
-	if ( vml->alpha < 255 )
-		pixbuf = ui_pixbuf_scale_alpha ( pixbuf, vml->alpha );
-	a_mapcache_add ( pixbuf, (mapcache_extra_t){ tt }, ulm->x, ulm->y, ulm->z, MAP_ID_MAPNIK_RENDER, ulm->scale, vml->alpha, 0.0, 0.0, vml->filename_xml );
-	g_object_unref(pixbuf);
+	for ( guint xx = 0; xx < block; xx++ ) {
+		for ( guint yy = 0; yy < block; yy++ ) {
+			MapCoord mc = *ulm;
+			mc.x += xx;
+			mc.y += yy;
+			GdkPixbuf *tile;
+			if ( !pixbuf )
+				// A pixbuf to stick into cache incase of an unrenderable area - otherwise will get continually re-requested
+				tile = gdk_pixbuf_scale_simple ( ui_get_icon("vikmapniklayer", 16), size, size, GDK_INTERP_BILINEAR );
+			else if ( block == 1 )
+				// Use the rendered image as is
+				tile = g_object_ref ( pixbuf );
+			else {
+				// Copy so the cached tiles don't keep the whole block in memory
+				GdkPixbuf *sub = gdk_pixbuf_new_subpixbuf ( pixbuf, xx*size, yy*size, size, size );
+				tile = a_pixbuf_pool_copy ( sub );
+				g_object_unref ( sub );
+			}
+			possibly_save_pixbuf ( vml, tile, &mc, msi );
+
+			// NB Mapnik can apply alpha, but use our own function for now
+			if ( vml->alpha < 255 ) {
+				// Alpha is applied in place, so leave any queued save with the original
+				if ( vml->use_file_cache ) {
+					GdkPixbuf *copy = a_pixbuf_pool_copy ( tile );
+					g_object_unref ( tile );
+					tile = copy;
+				}
+				tile = ui_pixbuf_scale_alpha ( tile, vml->alpha );
+			}
+			a_mapcache_add ( tile, (mapcache_extra_t){ tt }, mc.x, mc.y, mc.z, MAP_ID_MAPNIK_RENDER, mc.scale, vml->alpha, 0.0, 0.0, vml->filename_xml, vml );
+			g_object_unref(tile);
+		}
+	}
+	if ( msi )
+		g_thread_pool_push ( save_pool, msi, NULL );
+	if ( pixbuf )
+		g_object_unref(pixbuf);
 }
 
 static void render_info_free ( RenderInfo *data )
@@ -686,15 +950,28 @@ static void render_info_free ( RenderInfo *data )
 static void background ( RenderInfo *data, gpointer threaddata )
 {
 	int res = a_background_thread_progress ( threaddata, 0 );
+
+	// A speculative render is dropped once the view has changed since, as a new prediction will have been made
+	g_mutex_lock(tp_mutex);
+	gboolean speculative = data->speculative;
+	g_mutex_unlock(tp_mutex);
+	if ( speculative && data->generation != (guint)g_atomic_int_get(&prerender_generation) )
+		res = -1;
+
 	if (res == 0) {
-		render ( data->vml, data->ul, data->br, data->ulmc );
+		render ( data->vml, data->ul, data->br, data->ulmc, data->block );
 	}
 
 	g_mutex_lock(tp_mutex);
 	g_hash_table_remove (requests, data->request);
+	speculative = data->speculative;
 	g_mutex_unlock(tp_mutex);
 
-	if (res == 0)
+	if ( data->generation )
+		g_atomic_int_add ( &prerender_count, -1 );
+
+	// Nothing to show for an off screen render
+	if (res == 0 && !speculative)
 		vik_layer_emit_update ( VIK_LAYER(data->vml) ); // NB update display from background
 }
 
@@ -703,20 +980,24 @@ static void render_cancel_cleanup (RenderInfo *data)
 	// Anything?
 }
 
-#define REQUEST_HASHKEY_FORMAT "%d-%d-%d-%d-%d"
+#define REQUEST_HASHKEY_FORMAT "%d-%d-%d-%d-%d-%d"
 
 /**
  * Thread
  */
-static void thread_add (VikMapnikLayer *vml, MapCoord *mul, VikCoord *ul, VikCoord *br, gint x, gint y, gint z, gint zoom, const gchar* name )
+static void thread_add (VikMapnikLayer *vml, MapCoord *mul, VikCoord *ul, VikCoord *br, guint block, gint x, gint y, gint z, gint zoom, const gchar* name, gboolean speculative )
 {
 	// Create request
 	guint nn = name ? g_str_hash ( name ) : 0;
-	gchar *request = g_strdup_printf ( REQUEST_HASHKEY_FORMAT, x, y, z, zoom, nn );
+	gchar *request = g_strdup_printf ( REQUEST_HASHKEY_FORMAT, x, y, z, zoom, block, nn );
 
 	g_mutex_lock(tp_mutex);
 
-	if ( g_hash_table_lookup_extended (requests, request, NULL, NULL ) ) {
+	RenderInfo *existing = NULL;
+	if ( g_hash_table_lookup_extended (requests, request, NULL, (gpointer*)&existing ) ) {
+		// Now actually wanted, so ensure it does get rendered
+		if ( !speculative && existing )
+			existing->speculative = FALSE;
 		g_free ( request );
 		g_mutex_unlock (tp_mutex);
 		return;
@@ -730,14 +1011,23 @@ static void thread_add (VikMapnikLayer *vml, MapCoord *mul, VikCoord *ul, VikCoo
 	memcpy(ri->ul, ul, sizeof(VikCoord));
 	memcpy(ri->br, br, sizeof(VikCoord));
 	memcpy(ri->ulmc, mul, sizeof(MapCoord));
+	ri->block = block;
+	ri->speculative = speculative;
+	ri->generation = 0;
+	if ( speculative ) {
+		ri->generation = g_atomic_int_get ( &prerender_generation );
+		g_atomic_int_inc ( &prerender_count );
+	}
 	ri->request = request;
 
-	g_hash_table_insert ( requests, request, NULL );
+	g_hash_table_insert ( requests, request, ri );
 
 	g_mutex_unlock (tp_mutex);
 
 	gchar *basename = g_path_get_basename (name);
-	gchar *description = g_strdup_printf ( _("Mapnik Render %d:%d:%d %s"), zoom, x, y, basename );
+	gchar *description = speculative ?
+		g_strdup_printf ( _("Mapnik Prerender %d:%d:%d %s"), zoom, x, y, basename ) :
+		g_strdup_printf ( _("Mapnik Render %d:%d:%d %s"), zoom, x, y, basename );
 	g_free ( basename );
 	a_background_thread ( BACKGROUND_POOL_LOCAL_MAPNIK,
 	                      VIK_GTK_WINDOW_FROM_LAYER(vml),
@@ -760,21 +1050,34 @@ static GdkPixbuf *load_pixbuf ( VikMapnikLayer *vml, MapCoord *ulm, MapCoord *br
 {
 	*rerender = FALSE;
 	GdkPixbuf *pixbuf = NULL;
-	gchar *filename = get_filename ( vml->file_cache_dir, ulm->x, ulm->y, ulm->scale );
+	gchar *filename = get_cache_filename ( vml, ulm );
 
 	GStatBuf gsb;
 	if ( g_stat ( filename, &gsb ) == 0 ) {
 		// Get from disk
 		GError *error = NULL;
-		pixbuf = gdk_pixbuf_new_from_file ( filename, &error );
+		if ( vml->file_cache_layout == MAPNIK_CACHE_LAYOUT_METATILES ) {
+			int compressed = 0;
+			char log_msg[PATH_MAX];
+			GBytes *bytes = metatile_get ( vml->file_cache_dir, ulm->x, ulm->y, 17 - ulm->scale, &compressed, log_msg );
+			if ( !bytes )
+				g_warning ("%s: %s", __FUNCTION__, log_msg );
+			// Otherwise an empty entry is a tile not rendered yet
+			else if ( g_bytes_get_size ( bytes ) > 0 && !compressed )
+				pixbuf = a_tile_decode ( bytes, 1, &error );
+			if ( bytes )
+				g_bytes_unref ( bytes );
+		}
+		else
+			pixbuf = gdk_pixbuf_new_from_file ( filename, &error );
 		if ( error ) {
 			g_warning ("%s: %s", __FUNCTION__, error->message );
 			g_error_free ( error );
 		}
-		else {
+		else if ( pixbuf ) {
 			if ( vml->alpha < 255 )
 				pixbuf = ui_pixbuf_set_alpha ( pixbuf, vml->alpha );
-			a_mapcache_add ( pixbuf, (mapcache_extra_t) { -42.0 }, ulm->x, ulm->y, ulm->z, MAP_ID_MAPNIK_RENDER, ulm->scale, vml->alpha, 0.0, 0.0, vml->filename_xml );
+			a_mapcache_add ( pixbuf, (mapcache_extra_t) { -42.0 }, ulm->x, ulm->y, ulm->z, MAP_ID_MAPNIK_RENDER, ulm->scale, vml->alpha, 0.0, 0.0, vml->filename_xml, vml );
 		}
 		// If file is too old mark for rerendering
 		if ( planet_import_time < gsb.st_mtime ) {
@@ -786,6 +1089,34 @@ static GdkPixbuf *load_pixbuf ( VikMapnikLayer *vml, MapCoord *ulm, MapCoord *br
 	return pixbuf;
 }
 
+/**
+ * Get the block of tiles containing this tile, and the area it covers
+ */
+static MapCoord render_block_get ( MapCoord *ulm, VikCoord *ul, VikCoord *br, guint *block )
+{
+	*block = render_block_size ( ulm );
+	MapCoord bulm = *ulm;
+	bulm.x = ulm->x & ~(*block-1);
+	bulm.y = ulm->y & ~(*block-1);
+	MapCoord bbrm = bulm;
+	bbrm.x += *block;
+	bbrm.y += *block;
+	map_utils_iTMS_to_vikcoord (&bulm, ul);
+	map_utils_iTMS_to_vikcoord (&bbrm, br);
+	return bulm;
+}
+
+/**
+ * Render the whole block containing this tile in the background
+ */
+static void render_block_add ( VikMapnikLayer *vml, MapCoord *ulm, gboolean speculative )
+{
+	VikCoord ul; VikCoord br;
+	guint block;
+	MapCoord bulm = render_block_get ( ulm, &ul, &br, &block );
+	thread_add (vml, &bulm, &ul, &br, block, bulm.x, bulm.y, bulm.z, bulm.scale, vml->filename_xml, speculative );
+}
+
 /**
  * Caller has to decrease reference counter of returned
  * GdkPixbuf, when buffer is no longer needed.
@@ -795,10 +1126,7 @@ static GdkPixbuf *get_pixbuf ( VikMapnikLayer *vml, MapCoord *ulm, MapCoord *brm
 	VikCoord ul; VikCoord br;
 	GdkPixbuf *pixbuf = NULL;
 
-	map_utils_iTMS_to_vikcoord (ulm, &ul);
-	map_utils_iTMS_to_vikcoord (brm, &br);
-
-	pixbuf = a_mapcache_get ( ulm->x, ulm->y, ulm->z, MAP_ID_MAPNIK_RENDER, ulm->scale, vml->alpha, 0.0, 0.0, vml->filename_xml );
+	pixbuf = a_mapcache_get ( ulm->x, ulm->y, ulm->z, MAP_ID_MAPNIK_RENDER, ulm->scale, vml->alpha, 0.0, 0.0, vml->filename_xml, vml );
 
 	if ( ! pixbuf ) {
 		gboolean rerender = FALSE;
@@ -806,10 +1134,12 @@ static GdkPixbuf *get_pixbuf ( VikMapnikLayer *vml, MapCoord *ulm, MapCoord *brm
 			pixbuf = load_pixbuf ( vml, ulm, brm, &rerender );
 		if ( ! pixbuf || rerender ) {
 			if ( TRUE )
-				thread_add (vml, ulm, &ul, &br, ulm->x, ulm->y, ulm->z, ulm->scale, vml->filename_xml );
+				render_block_add ( vml, ulm, FALSE );
 			else {
 				// Run in the foreground
-				render ( vml, &ul, &br, ulm );
+				guint block;
+				MapCoord bulm = render_block_get ( ulm, &ul, &br, &block );
+				render ( vml, &ul, &br, &bulm, block );
 				vik_layer_emit_update ( VIK_LAYER(vml) );
 			}
 		}
@@ -818,6 +1148,122 @@ static GdkPixbuf *get_pixbuf ( VikMapnikLayer *vml, MapCoord *ulm, MapCoord *brm
 	return pixbuf;
 }
 
+#define VIK_SETTINGS_MAPNIK_PRERENDER_MAX "mapnik_prerender_max"
+
+/**
+ * Queue a speculative render of the tile if not already available
+ *
+ * Returns FALSE when no more speculative renders should be queued
+ */
+static gboolean prerender_tile ( VikMapnikLayer *vml, MapCoord *mc )
+{
+	// Keep speculative renders to a share of the threads, leaving the rest for what is actually wanted
+	gint max = a_preferences_get("mapnik.background_max_threads_local_mapnik")->u / 2;
+	gint tmp;
+	if ( a_settings_get_integer ( VIK_SETTINGS_MAPNIK_PRERENDER_MAX, &tmp ) )
+		max = tmp;
+	if ( g_atomic_int_get ( &prerender_count ) >= MAX(max, 1) )
+		return FALSE;
+
+	if ( mc->x < 0 || mc->y < 0 || (17 - mc->scale) < 0 || mc->x >= (1 << (17 - mc->scale)) || mc->y >= (1 << (17 - mc->scale)) )
+		return TRUE;
+	if ( a_mapcache_contains ( mc->x, mc->y, mc->z, MAP_ID_MAPNIK_RENDER, mc->scale, vml->alpha, 0.0, 0.0, vml->filename_xml ) )
+		return TRUE;
+	if ( vml->use_file_cache && vml->file_cache_dir ) {
+		gchar *filename = get_cache_filename ( vml, mc );
+		GStatBuf gsb;
+		gboolean fresh = g_stat ( filename, &gsb ) == 0 && gsb.st_mtime <= planet_import_time;
+		g_free ( filename );
+		if ( fresh && vml->file_cache_layout == MAPNIK_CACHE_LAYOUT_METATILES ) {
+			// The metatile may not have this tile in it yet
+			int compressed = 0;
+			char log_msg[PATH_MAX];
+			GBytes *bytes = metatile_get ( vml->file_cache_dir, mc->x, mc->y, 17 - mc->scale, &compressed, log_msg );
+			fresh = bytes && g_bytes_get_size ( bytes ) > 0;
+			if ( bytes )
+				g_bytes_unref ( bytes );
+		}
+		if ( fresh )
+			return TRUE;
+	}
+	render_block_add ( vml, mc, TRUE );
+	return TRUE;
+}
+
+/**
+ * Predict where the view will be next from how it has just changed
+ *  and render the tiles there in advance:
+ *  . Panning - the tiles just beyond the edge in the direction of movement
+ *  . Zooming - the tiles around the centre at the next zoom level
+ */
+static void prerender ( VikMapnikLayer *vml, VikViewport *vvp, MapCoord *ulm, gint xmin, gint xmax, gint ymin, gint ymax )
+{
+	const VikCoord *center = vik_viewport_get_center ( vvp );
+	gdouble xmpp = vik_viewport_get_xmpp ( vvp );
+	gboolean was_valid = vml->last_valid;
+	VikCoord last_center = vml->last_center;
+	gdouble last_xmpp = vml->last_xmpp;
+	vml->last_valid = TRUE;
+	vml->last_center = *center;
+	vml->last_xmpp = xmpp;
+
+	if ( !was_valid || (vik_coord_equals ( &last_center, center ) && last_xmpp == xmpp) )
+		return;
+
+	// The view has changed, so earlier predictions are no longer wanted
+	g_atomic_int_inc ( &prerender_generation );
+
+	if ( !a_preferences_get(MAPNIK_PREFS_NAMESPACE"prerender")->b )
+		return;
+
+	gint width = vik_viewport_get_width ( vvp );
+	gint height = vik_viewport_get_height ( vvp );
+	MapCoord mc = *ulm;
+
+	if ( last_xmpp != xmpp ) {
+		vml->zoom_trend = (xmpp < last_xmpp) ? -1 : 1;
+	}
+	else {
+		// Movement of the centre in pixels since the last draw
+		gint lx, ly;
+		vik_viewport_coord_to_screen ( vvp, &last_center, &lx, &ly );
+		gint dx = width/2 - lx;
+		gint dy = height/2 - ly;
+		// Tiles to look ahead - for a faster pan go further
+		gint sx = (dx == 0) ? 0 : ((dx > 0) ? 1 : -1) * CLAMP((ABS(dx) + (gint)vml->tile_size_x - 1) / (gint)vml->tile_size_x, 1, 2);
+		gint sy = (dy == 0) ? 0 : ((dy > 0) ? 1 : -1) * CLAMP((ABS(dy) + (gint)vml->tile_size_x - 1) / (gint)vml->tile_size_x, 1, 2);
+		for ( gint x = xmin + sx; x <= xmax + sx; x++ ) {
+			for ( gint y = ymin + sy; y <= ymax + sy; y++ ) {
+				// Only those not already on screen
+				if ( x >= xmin && x <= xmax && y >= ymin && y <= ymax )
+					continue;
+				mc.x = x;
+				mc.y = y;
+				if ( !prerender_tile ( vml, &mc ) )
+					return;
+			}
+		}
+	}
+
+	if ( vml->zoom_trend ) {
+		gdouble next_mpp = vml->zoom_trend < 0 ? xmpp / 2 : xmpp * 2;
+		VikCoord cc = *center;
+		if ( !map_utils_vikcoord_to_iTMS ( &cc, next_mpp, next_mpp, &mc ) )
+			return;
+		gint hw = (width / 2) / vml->tile_size_x + 1;
+		gint hh = (height / 2) / vml->tile_size_x + 1;
+		gint cx = mc.x, cy = mc.y;
+		for ( gint x = cx - hw; x <= cx + hw; x++ ) {
+			for ( gint y = cy - hh; y <= cy + hh; y++ ) {
+				mc.x = x;
+				mc.y = y;
+				if ( !prerender_tile ( vml, &mc ) )
+					return;
+			}
+		}
+	}
+}
+
 /**
  *
  */
@@ -880,6 +1326,11 @@ static void mapnik_layer_draw ( VikMapnikLayer *vml, VikViewport *vvp )
 			}
 		}
 
+		// Only queued after the visible tiles, so they are rendered first
+		ulm.x = xmin;
+		ulm.y = ymin;
+		prerender ( vml, vvp, &ulm, xmin, xmax, ymin, ymax );
+
 		// Done after so drawn on top
 		// Just a handy guide to tile blocks.
 		if ( vik_debug && vik_verbose ) {
@@ -909,6 +1360,11 @@ static void mapnik_layer_draw ( VikMapnikLayer *vml, VikViewport *vvp )
  */
 static void mapnik_layer_free ( VikMapnikLayer *vml )
 {
+	// Abandon any speculative renders
+	g_atomic_int_inc ( &prerender_generation );
+	a_mapcache_remove_layer ( vml );
+	g_array_free ( vml->stats_slowest, TRUE );
+	vik_mutex_free ( vml->stats_mutex );
 	mapnik_interface_free ( vml->mi );
 	if ( vml->filename_css )
 		g_free ( vml->filename_css );
@@ -929,6 +1385,123 @@ typedef enum {
 
 typedef gpointer menu_array_values[MA_LAST];
 
+/**
+ * Show the render time histogram for each zoom level and the slowest renders
+ */
+static void mapnik_layer_render_stats ( menu_array_values values )
+{
+	VikMapnikLayer *vml = values[MA_VML];
+	GArray *array = g_array_new ( FALSE, TRUE, sizeof(gchar*) );
+
+	g_mutex_lock ( vml->stats_mutex );
+	for ( guint zz = 0; zz < RENDER_STATS_ZOOMS; zz++ ) {
+		guint count = 0;
+		for ( guint bb = 0; bb < RENDER_STATS_BUCKETS; bb++ )
+			count += vml->stats_hist[zz][bb];
+		if ( !count )
+			continue;
+		GString *gs = g_string_new ( NULL );
+		g_string_printf ( gs, _("Zoom %d: %d renders, mean %.2fs:"), zz, count, vml->stats_total[zz] / count );
+		for ( guint bb = 0; bb < RENDER_STATS_BUCKETS; bb++ ) {
+			if ( bb < RENDER_STATS_BUCKETS-1 )
+				g_string_append_printf ( gs, "  <%.2fs %d", render_stats_bounds[bb], vml->stats_hist[zz][bb] );
+			else
+				g_string_append_printf ( gs, "  >=%.2fs %d", render_stats_bounds[bb-1], vml->stats_hist[zz][bb] );
+		}
+		gchar *str = g_string_free ( gs, FALSE );
+		g_array_append_val ( array, str );
+	}
+	if ( vml->stats_slowest->len ) {
+		gchar *str = g_strdup ( _("Slowest renders (zoom/x/y):") );
+		g_array_append_val ( array, str );
+	}
+	for ( guint ii = 0; ii < vml->stats_slowest->len; ii++ ) {
+		RenderTime *rt = &g_array_index ( vml->stats_slowest, RenderTime, ii );
+		gchar *str = g_strdup_printf ( "%d/%d/%d (%dx%d) %.2fs", rt->zoom, rt->x, rt->y, rt->block, rt->block, rt->duration );
+		g_array_append_val ( array, str );
+	}
+	g_mutex_unlock ( vml->stats_mutex );
+
+	if ( !array->len ) {
+		gchar *str = g_strdup ( _("No tiles rendered yet") );
+		g_array_append_val ( array, str );
+	}
+	a_dialog_list ( VIK_GTK_WINDOW_FROM_LAYER(vml), _("Render Statistics"), array, 5 );
+	for ( guint ii = 0; ii < array->len; ii++ )
+		g_free ( g_array_index(array, gchar*, ii) );
+	g_array_free ( array, TRUE );
+}
+
+/**
+ * Save the render statistics as CSV:
+ *  the histogram rows, then a blank line, then the slowest renders
+ */
+static gboolean render_stats_write ( VikMapnikLayer *vml, FILE *ff )
+{
+	gchar lo[G_ASCII_DTOSTR_BUF_SIZE], hi[G_ASCII_DTOSTR_BUF_SIZE];
+	g_mutex_lock ( vml->stats_mutex );
+	fprintf ( ff, "zoom,from_seconds,to_seconds,renders\n" );
+	for ( guint zz = 0; zz < RENDER_STATS_ZOOMS; zz++ ) {
+		guint count = 0;
+		for ( guint bb = 0; bb < RENDER_STATS_BUCKETS; bb++ )
+			count += vml->stats_hist[zz][bb];
+		if ( !count )
+			continue;
+		for ( guint bb = 0; bb < RENDER_STATS_BUCKETS; bb++ ) {
+			g_ascii_formatd ( lo, sizeof(lo), "%.2f", bb ? render_stats_bounds[bb-1] : 0.0 );
+			if ( bb < RENDER_STATS_BUCKETS-1 )
+				g_ascii_formatd ( hi, sizeof(hi), "%.2f", render_stats_bounds[bb] );
+			else
+				hi[0] = '\0';
+			fprintf ( ff, "%d,%s,%s,%d\n", zz, lo, hi, vml->stats_hist[zz][bb] );
+		}
+	}
+	fprintf ( ff, "\nzoom,x,y,tiles,seconds\n" );
+	for ( guint ii = 0; ii < vml->stats_slowest->len; ii++ ) {
+		RenderTime *rt = &g_array_index ( vml->stats_slowest, RenderTime, ii );
+		g_ascii_formatd ( lo, sizeof(lo), "%.3f", rt->duration );
+		fprintf ( ff, "%d,%d,%d,%d,%s\n", rt->zoom, rt->x, rt->y, rt->block*rt->block, lo );
+	}
+	g_mutex_unlock ( vml->stats_mutex );
+	return !ferror ( ff );
+}
+
+static void mapnik_layer_render_stats_export ( menu_array_values values )
+{
+	VikMapnikLayer *vml = values[MA_VML];
+
+	gchar *fn = NULL;
+	GtkWidget *dialog = gtk_file_chooser_dialog_new ( _("Export Render Statistics"),
+	                                                  VIK_GTK_WINDOW_FROM_LAYER(vml),
+	                                                  GTK_FILE_CHOOSER_ACTION_SAVE,
+	                                                  GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+	                                                  GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
+	                                                  NULL );
+	gchar *name = g_strdup_printf ( "%s.csv", vik_layer_get_name(VIK_LAYER(vml)) );
+	gtk_file_chooser_set_current_name ( GTK_FILE_CHOOSER(dialog), name );
+	g_free ( name );
+
+	while ( gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT ) {
+		fn = gtk_file_chooser_get_filename ( GTK_FILE_CHOOSER(dialog) );
+		if ( g_file_test(fn, G_FILE_TEST_EXISTS) == FALSE || a_dialog_yes_or_no ( GTK_WINDOW(dialog), _("The file \"%s\" exists, do you wish to overwrite it?"), a_file_basename ( fn ) ) )
+			break;
+		g_free ( fn );
+		fn = NULL;
+	}
+	gtk_widget_destroy ( dialog );
+
+	if ( !fn )
+		return;
+
+	FILE *ff = g_fopen ( fn, "w" );
+	gboolean ok = ff && render_stats_write ( vml, ff );
+	if ( ff )
+		ok = (fclose ( ff ) == 0) && ok;
+	if ( !ok )
+		a_dialog_error_msg_extra ( VIK_GTK_WINDOW_FROM_LAYER(vml), _("Unable to write to file %s"), fn );
+	g_free ( fn );
+}
+
 /**
  *
  */
@@ -944,6 +1517,9 @@ static void mapnik_layer_reload ( menu_array_values values )
 {
 	VikMapnikLayer *vml = values[MA_VML];
 	VikViewport *vvp = values[MA_VVP];
+	// Read the file again even if unchanged, as the files it refers to may not be
+	if ( vml->filename_xml )
+		mapnik_interface_forget_map_file ( vml->filename_xml );
 	mapnik_layer_post_read (VIK_LAYER(vml), vvp, FALSE);
 	mapnik_layer_draw ( vml, vvp );
 }
@@ -971,8 +1547,10 @@ static void mapnik_layer_carto ( menu_array_values values )
 		                           ans );
 		g_free ( ans );
 	}
-	else
+	else {
+		render_stats_reset ( vml );
 		mapnik_layer_draw ( vml, vvp );
+	}
 }
 
 /**
@@ -1027,6 +1605,8 @@ static void mapnik_layer_add_menu_items ( VikMapnikLayer *vml, GtkMenu *menu, gp
 	}
 
 	(void)vu_menu_add_item ( menu, NULL, GTK_STOCK_INFO, G_CALLBACK(mapnik_layer_information), values );
+	(void)vu_menu_add_item ( menu, _("Render _Statistics"), NULL, G_CALLBACK(mapnik_layer_render_stats), values );
+	(void)vu_menu_add_item ( menu, _("_Export Render Statistics..."), GTK_STOCK_SAVE_AS, G_CALLBACK(mapnik_layer_render_stats_export), values );
 	(void)vu_menu_add_item ( menu, NULL, GTK_STOCK_ABOUT, G_CALLBACK(mapnik_layer_about), values );
 }
 
@@ -1045,7 +1625,7 @@ static void mapnik_layer_rerender ( VikMapnikLayer *vml )
 	brm.x = brm.x+1;
 	brm.y = brm.y+1;
 	map_utils_iTMS_to_vikcoord (&brm, &vml->rerender_br );
-	thread_add (vml, &ulm, &vml->rerender_ul, &vml->rerender_br, ulm.x, ulm.y, ulm.z, ulm.scale, vml->filename_xml );
+	thread_add (vml, &ulm, &vml->rerender_ul, &vml->rerender_br, 1, ulm.x, ulm.y, ulm.z, ulm.scale, vml->filename_xml, FALSE );
 }
 
 /**
@@ -1059,7 +1639,7 @@ static void mapnik_layer_tile_info ( VikMapnikLayer *vml )
 
 	mapcache_extra_t extra = a_mapcache_get_extra ( ulm.x, ulm.y, ulm.z, MAP_ID_MAPNIK_RENDER, ulm.scale, vml->alpha, 0.0, 0.0, vml->filename_xml );
 
-	gchar *filename = get_filename ( vml->file_cache_dir, ulm.x, ulm.y, ulm.scale );
+	gchar *filename = get_cache_filename ( vml, &ulm );
 	gchar *filemsg = NULL;
 	gchar *timemsg = NULL;
 
@@ -35,15 +35,17 @@
 #include "vikmapsourcedefault.h"
 #include "maputils.h"
 #include "mapcache.h"
+#include "existcache.h"
+#include "diskcache.h"
 #include "background.h"
 #include "vikmapslayer.h"
 #include "metatile.h"
+#include "mbtilescache.h"
+#include "tiledecode.h"
 #include "map_ids.h"
+#include "trace.h"
 
-#ifdef HAVE_SQLITE3_H
-#include "sqlite3.h"
 #include <gio/gio.h>
-#endif
 
 #define MAP_FIXED_NAME "Map"
 
@@ -65,6 +67,21 @@ static guint SCALE_INC_DOWN = 4;
 #define VIK_SETTINGS_MAP_SCALE_SMALLER_ZOOM_FIRST "maps_scale_smaller_zoom_first"
 static gboolean SCALE_SMALLER_ZOOM_FIRST = TRUE;
 
+#define VIK_SETTINGS_MAP_ASYNC_DECODE "maps_async_decode"
+static gboolean ASYNC_DECODE = TRUE;
+
+#define VIK_SETTINGS_MAP_IDLE_PREFETCH "maps_idle_prefetch"
+static gboolean IDLE_PREFETCH = TRUE; /* load the tiles around the display into the cache when otherwise idle */
+
+#define VIK_SETTINGS_MAP_DOWNLOAD_BATCH_SIZE "maps_download_batch_size"
+static guint DOWNLOAD_BATCH_SIZE = 32;
+
+#define VIK_SETTINGS_MAP_DOWNLOAD_CANCEL_MARGIN "maps_download_cancel_margin"
+static gint DOWNLOAD_CANCEL_MARGIN = 2; /* tiles beyond the display before an automatic download is dropped */
+
+#define VIK_SETTINGS_MAP_SEED_RATE "maps_seed_rate"
+static gdouble SEED_RATE = 4.0; /* tiles per second, unless the map source specifies its own rate */
+
 /****** MAP TYPES ******/
 
 static GList *__map_types = NULL;
@@ -90,6 +107,7 @@ static gdouble __mapzooms_y[] = { 0.0, 0.125, 0.25, 0.5, 1.0, 2.0, 4.0, 8.0, 16.
 
 static void maps_layer_post_read (VikLayer *vl, VikViewport *vp, gboolean from_file);
 static const gchar* maps_layer_tooltip ( VikMapsLayer *vml );
+static void maps_layer_get_memory ( VikMapsLayer *vml, VikLayerMemory *mem );
 static void maps_layer_marshall( VikMapsLayer *vml, guint8 **data, guint *len );
 static VikMapsLayer *maps_layer_unmarshall( guint8 *data, guint len, VikViewport *vvp );
 static gboolean maps_layer_set_param ( VikMapsLayer *vml, VikLayerSetParam *vlsp );
@@ -99,17 +117,23 @@ static void maps_layer_draw ( VikMapsLayer *vml, VikViewport *vvp );
 static VikMapsLayer *maps_layer_new ( VikViewport *vvp );
 static void maps_layer_free ( VikMapsLayer *vml );
 static VikLayerToolFuncStatus maps_layer_download_release ( VikMapsLayer *vml, GdkEventButton *event, VikViewport *vvp );
+static void seed_resume ( VikMapsLayer *vml );
 static VikLayerToolFuncStatus maps_layer_download_click ( VikMapsLayer *vml, GdkEventButton *event, VikViewport *vvp );
 static gpointer maps_layer_download_create ( VikWindow *vw, VikViewport *vvp );
 static void maps_layer_set_cache_dir ( VikMapsLayer *vml, const gchar *dir );
-static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload );
+static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload, gboolean follow_display );
+static void download_focus_set ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gdouble xzoom, gdouble yzoom );
 static void maps_layer_add_menu_items ( VikMapsLayer *vml, GtkMenu *menu, VikLayersPanel *vlp );
 static guint map_uniq_id_to_index ( guint uniq_id );
+static guint map_index_to_uniq_id ( guint16 index );
+static guint maps_layer_get_set_maptype ( VikMapsLayer *vml );
+static void decode_missing_clear ( VikMapsLayer *vml );
 
 
 static VikLayerParamScale params_scales[] = {
   /* min, max, step, digits (decimal places) */
  { 0, 255, 3, 0 }, /* alpha */
+ { 0, 4096, 4, 0 }, /* cache quota (MB) */
 };
 
 static VikLayerParamData id_default ( void ) { return VIK_LPD_UINT ( MAP_ID_OPEN_TOPO_MAP ); }
@@ -128,8 +152,13 @@ static VikLayerParamData file_default ( void )
 }
 static VikLayerParamData alpha_default ( void ) { return VIK_LPD_UINT ( 255 ); }
 static VikLayerParamData mapzoom_default ( void ) { return VIK_LPD_UINT ( 0 ); }
+static VikLayerParamData cache_quota_default ( void ) { return VIK_LPD_UINT ( 0 ); }
 
-static gchar *cache_types[] = { "Viking", N_("OSM"), NULL };
+static gchar *cache_types[] = { "Viking", N_("OSM"),
+#ifdef HAVE_SQLITE3_H
+                                 N_("MBTiles"),
+#endif
+                                 NULL };
 static VikMapsCacheLayout cache_layout_default_value = VIK_MAPS_CACHE_LAYOUT_OSM;
 static VikLayerParamData cache_layout_default ( void ) { return VIK_LPD_UINT ( cache_layout_default_value ); }
 
@@ -156,6 +185,9 @@ VikLayerParam maps_layer_params[] = {
   { VIK_LAYER_MAPS, "mapzoom", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Zoom Level:"), VIK_LAYER_WIDGET_COMBOBOX, params_mapzooms, NULL,
     N_("Determines the method of displaying map tiles for the current zoom level. 'Viking Zoom Level' uses the best matching level, otherwise setting a fixed value will always use map tiles of the specified value regardless of the actual zoom level."),
     mapzoom_default, NULL, NULL },
+  { VIK_LAYER_MAPS, "cache_quota", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Memory Cache Quota (MB):"), VIK_LAYER_WIDGET_SPINBUTTON, &params_scales[1], NULL,
+    N_("A soft limit on the memory used by the tiles of this layer in the map cache, to prevent an overlay pushing out the tiles of other layers. 0 means no specific limit."),
+    cache_quota_default, NULL, NULL },
   { VIK_LAYER_MAPS, "reset", VIK_LAYER_PARAM_PTR_DEFAULT, VIK_LAYER_GROUP_NONE, NULL,
     VIK_LAYER_WIDGET_BUTTON, N_("Reset to Defaults"), NULL, NULL, reset_default, NULL, NULL },
 };
@@ -169,6 +201,7 @@ enum {
   PARAM_AUTODOWNLOAD,
   PARAM_ONLYMISSING,
   PARAM_MAPZOOM,
+  PARAM_CACHE_QUOTA,
   PARAM_RESET,
   NUM_PARAMS
 };
@@ -267,16 +300,34 @@ VikLayerInterface vik_maps_layer_interface = {
   (VikLayerFuncSelectedViewportMenu)    NULL,
 
   (VikLayerFuncRefresh)                 NULL,
+  (VikLayerFuncGetMemory)               maps_layer_get_memory,
 };
 
+/* The area currently on display, used to order and cancel tile downloads */
+typedef struct {
+  guint generation; // Changes whenever the area changes (0 = never drawn)
+  gdouble xzoom, yzoom;
+  VikCoord ul, br, center;
+} MapDownloadFocus;
+
+/* The tiles drawn, to load those around them when idle */
+typedef struct {
+  MapCoord mapcoord; // The scale and zone of the tiles
+  gint xmin, xmax, ymin, ymax;
+  guint reduce;
+  guint tile_bytes;  // Estimated size of each decoded tile
+} MapPrefetchArea;
+
 struct _VikMapsLayer {
   VikLayer vl;
   guint maptype;
+  gboolean hidpi; // Whether maptype is the HiDPI version of the map type set, for the display
   gchar *cache_dir;
   VikMapsCacheLayout cache_layout;
   guint8 alpha;
   guint mapzoom_id;
   gdouble xmapzoom, ymapzoom;
+  guint cache_quota; // MB
 
   gboolean autodownload;
   gboolean adl_only_missing;
@@ -290,11 +341,34 @@ struct _VikMapsLayer {
   VikCoord redownload_ul, redownload_br; /* right click menu only */
   VikViewport *redownload_vvp;
   gchar *filename;
-#ifdef HAVE_SQLITE3_H
-  sqlite3 *mbtiles;
-#endif
+  MBTilesCache *mbtiles; // Only for MBTiles map sources
+  MBTilesCache *tile_db; // Only for the MBTiles cache layout
+  DiskCacheArea *disk_area; // Only for tiles downloaded into individual files
+  // Background tile loading
+  GMutex *decode_mutex;
+  GHashTable *decode_pending; // Tiles queued for loading
+  GHashTable *decode_missing; // Tiles known to be unavailable
+  GArray *decode_requests;    // Tiles wanted by the current draw - only used in the main thread
+  // Idle prefetching - only used in the main thread, other than the generation
+  guint prefetch_source;
+  MapPrefetchArea prefetch_area; // As last drawn
+  MapPrefetchArea prefetched;    // As last prefetched around
+  gint prefetch_generation;      // Changes when a newer prefetch starts, so older ones stop
+  // Download prioritisation
+  MapDownloadFocus focus;     // Protected by rq_mutex
 };
 
+typedef enum {
+  GET_PIXBUF_SYNC = 0, // Load from disk (etc...) immediately
+  GET_PIXBUF_ASYNC,    // Queue loading from disk in the background
+  GET_PIXBUF_CACHE_ONLY,
+} GetPixbufMode;
+
+typedef struct {
+  MapCoord mapcoord;
+  guint reduce;
+} MapDecodeRequest;
+
 enum { REDOWNLOAD_NONE = 0,    /* download only missing maps */
        REDOWNLOAD_BAD,         /* download missing and bad maps */
        REDOWNLOAD_NEW,         /* download missing maps that are newer on server only */
@@ -314,6 +388,10 @@ static VikLayerParam prefs[] = {
 //  as well as the same requests from a single layer
 static GMutex *rq_mutex;
 static GHashTable *requests = NULL;
+// Job files of pre-seeding in progress
+static GHashTable *seed_running = NULL;
+// Map source id to the time the next pre-seed tile may be downloaded
+static GHashTable *seed_slots = NULL;
 
 void maps_layer_init ()
 {
@@ -344,16 +422,37 @@ void maps_layer_init ()
   if ( a_settings_get_boolean ( VIK_SETTINGS_MAP_SCALE_SMALLER_ZOOM_FIRST, &gbtmp ) )
     SCALE_SMALLER_ZOOM_FIRST = gbtmp;
 
+  if ( a_settings_get_boolean ( VIK_SETTINGS_MAP_ASYNC_DECODE, &gbtmp ) )
+    ASYNC_DECODE = gbtmp;
+
+  if ( a_settings_get_boolean ( VIK_SETTINGS_MAP_IDLE_PREFETCH, &gbtmp ) )
+    IDLE_PREFETCH = gbtmp;
+
+  if ( a_settings_get_integer ( VIK_SETTINGS_MAP_DOWNLOAD_BATCH_SIZE, &gitmp ) )
+    DOWNLOAD_BATCH_SIZE = MAX ( gitmp, 0 );
+
+  if ( a_settings_get_integer ( VIK_SETTINGS_MAP_DOWNLOAD_CANCEL_MARGIN, &gitmp ) )
+    DOWNLOAD_CANCEL_MARGIN = MAX ( gitmp, 0 );
+
+  if ( a_settings_get_double ( VIK_SETTINGS_MAP_SEED_RATE, &gdtmp ) )
+    SEED_RATE = gdtmp;
+
   rq_mutex = vik_mutex_new();
 
   // Just storing keys only
   requests = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+
+  seed_running = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  seed_slots = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
 }
 
 void maps_layer_uninit ()
 {
   vik_mutex_free ( rq_mutex );
   g_hash_table_destroy ( requests );
+  g_hash_table_destroy ( seed_running );
+  g_hash_table_destroy ( seed_slots );
+  metatile_cache_clear ();
 }
 
 /****************************************/
@@ -422,6 +521,11 @@ void maps_layer_register_map_source ( VikMapSource *map )
   {
     _add_map_source (id, label, map);
   }
+
+  // Also available to select directly, e.g. for more detail at the same zoom level
+  VikMapSource *hidpi = vik_map_source_get_hidpi ( map );
+  if ( hidpi )
+    maps_layer_register_map_source ( hidpi );
 }
 
 #define MAPS_LAYER_NTH_LABEL(n) (params_maptypes[n])
@@ -455,7 +559,7 @@ static void requests_clear ( guint maptype )
  */
 guint vik_maps_layer_get_map_type(VikMapsLayer *vml)
 {
-  return MAPS_LAYER_NTH_ID(vml->maptype);
+  return map_index_to_uniq_id ( maps_layer_get_set_maptype ( vml ) );
 }
 
 /**
@@ -467,8 +571,37 @@ void vik_maps_layer_set_map_type(VikMapsLayer *vml, guint map_type)
   guint maptype = map_uniq_id_to_index ( map_type );
   if ( maptype == NUM_MAP_TYPES )
     g_warning ( _("%s: Unknown map type %d"), __FUNCTION__, map_type );
-  else
+  else {
     vml->maptype = maptype;
+    vml->hidpi = FALSE;
+  }
+}
+
+void vik_maps_layer_set_autodownload ( VikMapsLayer *vml, gboolean autodownload )
+{
+  vml->autodownload = autodownload;
+}
+
+/**
+ * Number of tiles queued to be loaded from disk for display
+ */
+guint vik_maps_layer_get_tiles_loading ( VikMapsLayer *vml )
+{
+  g_mutex_lock ( vml->decode_mutex );
+  guint count = g_hash_table_size ( vml->decode_pending );
+  g_mutex_unlock ( vml->decode_mutex );
+  return count;
+}
+
+/**
+ * Number of tile downloads outstanding, for all map layers
+ */
+guint maps_layer_get_tiles_downloading ( void )
+{
+  g_mutex_lock ( rq_mutex );
+  guint count = requests ? g_hash_table_size ( requests ) : 0;
+  g_mutex_unlock ( rq_mutex );
+  return count;
 }
 
 /**
@@ -496,6 +629,9 @@ gchar *vik_maps_layer_get_map_label(VikMapsLayer *vml)
 #define DIRECTDIRACCESS "%s%d" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d%s"
 #define DIRECTDIRACCESS_WITH_NAME "%s%s" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d%s"
 #define DIRSTRUCTURE "%st%ds%dz%d" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d"
+// Where tiles are downloaded to before going into the MBTiles cache file
+#define MBTILESSTAGING "%s.staging" G_DIR_SEPARATOR_S "t%d" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d%s"
+#define MBTILESCACHE "%s%s.mbtiles"
 #define MAPS_CACHE_DIR maps_layer_default_dir()
 
 #ifdef WINDOWS
@@ -651,6 +787,19 @@ static guint map_uniq_id_to_index ( guint uniq_id )
   return NUM_MAP_TYPES; /* no such thing */
 }
 
+/**
+ * The map type as set, rather than any HiDPI version of it used for the display
+ */
+static guint maps_layer_get_set_maptype ( VikMapsLayer *vml )
+{
+  if ( vml->hidpi ) {
+    guint maptype = map_uniq_id_to_index ( map_index_to_uniq_id(vml->maptype) - MAP_ID_HIDPI_OFFSET );
+    if ( maptype != NUM_MAP_TYPES )
+      return maptype;
+  }
+  return vml->maptype;
+}
+
 #define VIK_SETTINGS_MAP_LICENSE_SHOWN "map_license_shown"
 
 /**
@@ -669,7 +818,12 @@ static gboolean maps_layer_set_param ( VikMapsLayer *vml, VikLayerSetParam *vlsp
   switch ( vlsp->id )
   {
     case PARAM_CACHE_DIR: maps_layer_set_cache_dir ( vml, vlsp->data.s ); break;
-    case PARAM_CACHE_LAYOUT: if ( vlsp->data.u < VIK_MAPS_CACHE_LAYOUT_NUM ) vml->cache_layout = vlsp->data.u; break;
+    case PARAM_CACHE_LAYOUT:
+      if ( vlsp->data.u < VIK_MAPS_CACHE_LAYOUT_NUM ) vml->cache_layout = vlsp->data.u;
+#ifndef HAVE_SQLITE3_H
+      if ( vml->cache_layout == VIK_MAPS_CACHE_LAYOUT_MBTILES ) vml->cache_layout = VIK_MAPS_CACHE_LAYOUT_OSM;
+#endif
+      break;
     case PARAM_FILE: maps_layer_set_file ( vml, vlsp->data.s ); break;
     case PARAM_MAPTYPE: {
       guint maptype = map_uniq_id_to_index(vlsp->data.u);
@@ -677,6 +831,7 @@ static gboolean maps_layer_set_param ( VikMapsLayer *vml, VikLayerSetParam *vlsp
         g_warning ( _("%s: Unknown map type %d"), __FUNCTION__, vlsp->data.u );
       else {
         vml->maptype = maptype;
+        vml->hidpi = FALSE;
 
         // When loading from a file don't need the license reminder - ensure it's saved into the 'seen' list
         if ( vlsp->is_file_operation ) {
@@ -707,6 +862,21 @@ static gboolean maps_layer_set_param ( VikMapsLayer *vml, VikLayerSetParam *vlsp
       } else
 	g_warning (_("Unknown Map Zoom"));
       break;
+    case PARAM_CACHE_QUOTA:
+      vml->cache_quota = vlsp->data.u;
+      a_mapcache_set_layer_quota ( vml, vml->cache_quota * 1024 * 1024 );
+      break;
+    default: break;
+  }
+
+  // Tile availability may be different with these changes
+  switch ( vlsp->id ) {
+    case PARAM_MAPTYPE:
+    case PARAM_CACHE_DIR:
+    case PARAM_CACHE_LAYOUT:
+    case PARAM_FILE:
+      decode_missing_clear ( vml );
+      break;
     default: break;
   }
   return TRUE;
@@ -743,11 +913,12 @@ static VikLayerParamData maps_layer_get_param ( VikMapsLayer *vml, guint16 id, g
     }
     case PARAM_CACHE_LAYOUT: rv.u = vml->cache_layout; break;
     case PARAM_FILE: rv.s = vml->filename; break;
-    case PARAM_MAPTYPE: rv.u = map_index_to_uniq_id ( vml->maptype ); break;
+    case PARAM_MAPTYPE: rv.u = map_index_to_uniq_id ( maps_layer_get_set_maptype ( vml ) ); break;
     case PARAM_ALPHA: rv.u = vml->alpha; break;
     case PARAM_AUTODOWNLOAD: rv.b = vml->autodownload; break;
     case PARAM_ONLYMISSING: rv.b = vml->adl_only_missing; break;
     case PARAM_MAPZOOM: rv.u = vml->mapzoom_id; break;
+    case PARAM_CACHE_QUOTA: rv.u = vml->cache_quota; break;
     default: break;
   }
   return rv;
@@ -823,6 +994,13 @@ static VikMapsLayer *maps_layer_new ( VikViewport *vvp )
   VikMapsLayer *vml = VIK_MAPS_LAYER ( g_object_new ( VIK_MAPS_LAYER_TYPE, NULL ) );
   vik_layer_set_type ( VIK_LAYER(vml), VIK_LAYER_MAPS );
 
+  // Needed before setting any parameters
+  vml->decode_mutex = vik_mutex_new ();
+  vml->decode_pending = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, NULL );
+  vml->decode_missing = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, NULL );
+  vml->decode_requests = g_array_new ( FALSE, FALSE, sizeof(MapDecodeRequest) );
+  a_mapcache_add_layer ( vml );
+
   vml->filename = NULL;
   vik_layer_set_defaults ( VIK_LAYER(vml), vvp );
 
@@ -837,6 +1015,16 @@ static VikMapsLayer *maps_layer_new ( VikViewport *vvp )
 
 static void maps_layer_free ( VikMapsLayer *vml )
 {
+  a_mapcache_remove_layer ( vml );
+  a_mbtiles_cache_unref ( vml->tile_db );
+  if ( vml->prefetch_source )
+    g_source_remove ( vml->prefetch_source );
+  // Any outstanding background loading is prevented from accessing this layer via the weak reference
+  g_hash_table_destroy ( vml->decode_pending );
+  g_hash_table_destroy ( vml->decode_missing );
+  g_array_free ( vml->decode_requests, TRUE );
+  vik_mutex_free ( vml->decode_mutex );
+
   g_free ( vml->cache_dir );
   vml->cache_dir = NULL;
   if ( vml->dl_right_click_menu )
@@ -846,41 +1034,129 @@ static void maps_layer_free ( VikMapsLayer *vml )
   g_free ( vml->filename );
   vml->filename = NULL;
 
-#ifdef HAVE_SQLITE3_H
-  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
-  if ( vik_map_source_is_mbtiles ( map ) ) {
-    if ( vml->mbtiles ) {
-      int ans = sqlite3_close ( vml->mbtiles );
-      if ( ans != SQLITE_OK ) {
-        // Only to console for information purposes only
-        g_warning ( "%s: SQL Close problem: %s", __FUNCTION__, sqlite3_errstr(ans) );
+  a_mbtiles_cache_unref ( vml->mbtiles );
+  vml->mbtiles = NULL;
+}
+
+static void maps_layer_mbtiles_open ( VikMapsLayer *vml, VikViewport *vp, VikMapSource *map )
+{
+  if ( !vik_map_source_is_mbtiles ( map ) )
+    return;
+
+  // Already open (the shared connections and their prepared statements are kept)
+  if ( vml->mbtiles && !g_strcmp0 ( vml->filename, a_mbtiles_cache_get_filename ( vml->mbtiles ) ) )
+    return;
+
+  a_mbtiles_cache_unref ( vml->mbtiles );
+  vml->mbtiles = NULL;
+
+  if ( !vml->filename )
+    return;
+
+  vml->mbtiles = a_mbtiles_cache_open ( vml->filename, FALSE );
+  if ( !vml->mbtiles )
+    a_dialog_error_msg_extra ( VIK_GTK_WINDOW_FROM_WIDGET(vp),
+                               _("Failed to open MBTiles file: %s"),
+                               vml->filename );
+}
+
+/**
+ * Which files on disk are this map's downloaded tiles, for keeping within the disk cache limit
+ * Tiles accessed directly are the user's own data, so are never removed
+ */
+static void maps_layer_disk_area_update ( VikMapsLayer *vml, VikMapSource *map )
+{
+  vml->disk_area = NULL;
+  if ( !vml->cache_dir || vik_map_source_is_direct_file_access ( map ) )
+    return;
+  switch ( vml->cache_layout ) {
+    case VIK_MAPS_CACHE_LAYOUT_OSM: {
+      const gchar *name = vik_map_source_get_name ( map );
+      // Matching the directories of get_filename()
+      if ( name && !g_strcmp0 ( vml->cache_dir, MAPS_CACHE_DIR ) ) {
+        gchar *root = g_strconcat ( vml->cache_dir, name, G_DIR_SEPARATOR_S, NULL );
+        vml->disk_area = a_diskcache_area_get ( root, NULL );
+        g_free ( root );
       }
+      else
+        vml->disk_area = a_diskcache_area_get ( vml->cache_dir, NULL );
+      break;
+    }
+    case VIK_MAPS_CACHE_LAYOUT_MBTILES:
+      // Only the single cache file, which is not trimmed
+      break;
+    default: {
+      gchar *prefix = g_strdup_printf ( "t%ds", vik_map_source_get_uniq_id ( map ) );
+      vml->disk_area = a_diskcache_area_get ( vml->cache_dir, prefix );
+      g_free ( prefix );
+      break;
     }
   }
-#endif
+  a_diskcache_area_check ( vml->disk_area );
 }
 
-static void maps_layer_mbtiles_open ( VikMapsLayer *vml, VikViewport *vp, VikMapSource *map )
+/**
+ * Open (or create) the cache file when using the MBTiles cache layout
+ */
+static void maps_layer_tile_db_open ( VikMapsLayer *vml, VikMapSource *map )
 {
-#ifdef HAVE_SQLITE3_H
-  // Do some SQL stuff
-  if ( vik_map_source_is_mbtiles ( map ) ) {
-    int ans = sqlite3_open_v2 ( vml->filename,
-                                &(vml->mbtiles),
-                                SQLITE_OPEN_READONLY,
-                                NULL );
-    if ( ans != SQLITE_OK ) {
-      // That didn't work, so here's why:
-      g_warning ( "%s: %s", __FUNCTION__, sqlite3_errmsg ( vml->mbtiles ) );
+  gchar *filename = NULL;
+  if ( vml->cache_layout == VIK_MAPS_CACHE_LAYOUT_MBTILES && !vik_map_source_is_direct_file_access ( map ) ) {
+    const gchar *name = vik_map_source_get_name ( map );
+    gchar *id = g_strdup_printf ( "t%d", vik_map_source_get_uniq_id ( map ) );
+    filename = g_strdup_printf ( MBTILESCACHE, vml->cache_dir, name ? name : id );
+    g_free ( id );
+  }
+
+  // Unchanged
+  if ( vml->tile_db && !g_strcmp0 ( filename, a_mbtiles_cache_get_filename ( vml->tile_db ) ) ) {
+    g_free ( filename );
+    return;
+  }
 
-      a_dialog_error_msg_extra ( VIK_GTK_WINDOW_FROM_WIDGET(vp),
-                                 _("Failed to open MBTiles file: %s"),
-                                 vml->filename );
-      (void)sqlite3_close ( vml->mbtiles );
-      vml->mbtiles = NULL;
+  a_mbtiles_cache_unref ( vml->tile_db );
+  vml->tile_db = NULL;
+  if ( filename ) {
+    if ( g_mkdir_with_parents ( vml->cache_dir, 0777 ) != 0 )
+      g_warning ( "%s: Failed to mkdir %s", __FUNCTION__, vml->cache_dir );
+    vml->tile_db = a_mbtiles_cache_open ( filename, TRUE );
+    if ( vml->tile_db ) {
+      a_mbtiles_cache_set_metadata ( vml->tile_db, "name", vik_map_source_get_label ( map ) );
+      const gchar *ext = vik_map_source_get_file_extension ( map );
+      if ( ext && ext[0] == '.' )
+        a_mbtiles_cache_set_metadata ( vml->tile_db, "format", ext+1 );
     }
+    else
+      g_warning ( "%s: Unable to use %s", __FUNCTION__, filename );
+    g_free ( filename );
   }
-#endif
+}
+
+/**
+ * Use the HiDPI version of the map type (if it has one) when the display has more device pixels per pixel,
+ *  so tiles are downloaded, cached and drawn at the density they are shown
+ */
+static void maps_layer_set_hidpi ( VikMapsLayer *vml, gboolean hidpi )
+{
+  if ( hidpi == vml->hidpi )
+    return;
+
+  guint maptype = maps_layer_get_set_maptype ( vml );
+  if ( hidpi ) {
+    VikMapSource *map = vik_map_source_get_hidpi ( MAPS_LAYER_NTH_TYPE(maptype) );
+    if ( !map )
+      return;
+    maptype = map_uniq_id_to_index ( vik_map_source_get_uniq_id(map) );
+    if ( maptype == NUM_MAP_TYPES )
+      return;
+  }
+  vml->maptype = maptype;
+  vml->hidpi = hidpi;
+
+  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+  maps_layer_tile_db_open ( vml, map );
+  maps_layer_disk_area_update ( vml, map );
+  decode_missing_clear ( vml );
 }
 
 static void maps_layer_post_read (VikLayer *vl, VikViewport *vp, gboolean from_file)
@@ -906,6 +1182,8 @@ static void maps_layer_post_read (VikLayer *vl, VikViewport *vp, gboolean from_f
   
   // Performed in post read as we now know the map type
   maps_layer_mbtiles_open ( vml, vp, map );
+  maps_layer_tile_db_open ( vml, map );
+  maps_layer_disk_area_update ( vml, map );
 
   // If the on Disk OSM Tile Layout type
   if ( vik_map_source_get_uniq_id(map) == MAP_ID_OSM_ON_DISK ) {
@@ -914,6 +1192,9 @@ static void maps_layer_post_read (VikLayer *vl, VikViewport *vp, gboolean from_f
     g_free ( vml->filename );
     vml->filename = g_strdup (vml->cache_dir);
   }
+
+  // Carry on with any unfinished pre-seeding for this map
+  seed_resume ( vml );
 }
 
 static const gchar* maps_layer_tooltip ( VikMapsLayer *vml )
@@ -921,6 +1202,14 @@ static const gchar* maps_layer_tooltip ( VikMapsLayer *vml )
   return vik_maps_layer_get_map_label ( vml );
 }
 
+static void maps_layer_get_memory ( VikMapsLayer *vml, VikLayerMemory *mem )
+{
+  // Tiles are shared between layers of the same map, but are counted by the layer that cached them
+  mapcache_stats_t stats;
+  a_mapcache_get_stats_layer ( vml, &stats );
+  mem->bytes[VIK_LAYER_MEMORY_CACHES] += stats.bytes;
+}
+
 static void maps_layer_marshall( VikMapsLayer *vml, guint8 **data, guint *len )
 {
   vik_layer_marshall_params ( VIK_LAYER(vml), data, len );
@@ -938,201 +1227,68 @@ static VikMapsLayer *maps_layer_unmarshall( guint8 *data, guint len, VikViewport
 /****** DRAWING ******/
 /*********************/
 
-static GdkPixbuf *pixbuf_shrink ( GdkPixbuf *pixbuf, gdouble xshrinkfactor, gdouble yshrinkfactor )
-{
-  GdkPixbuf *tmp;
-  guint16 width = gdk_pixbuf_get_width(pixbuf), height = gdk_pixbuf_get_height(pixbuf);
-  tmp = gdk_pixbuf_scale_simple(pixbuf, ceil(width * xshrinkfactor), ceil(height * yshrinkfactor), GDK_INTERP_BILINEAR);
-  g_object_unref ( G_OBJECT(pixbuf) );
-  return tmp;
-}
-
-#ifdef HAVE_SQLITE3_H
-/*
-static int sql_select_tile_dump_cb (void *data, int cols, char **fields, char **col_names )
-{
-  g_warning ( "Found %d columns", cols );
-  int i;
-  for ( i = 0; i < cols; i++ ) {
-    g_warning ( "SQL processing %s = %s", col_names[i], fields[i] );
-  }
-  return 0;
-}
-*/
-
 /**
- *
+ * Convert tile file data into a pixbuf, as per the map source
  */
-static GdkPixbuf *get_pixbuf_sql_exec ( sqlite3 *sql, gint xx, gint yy, gint zoom )
+static GdkPixbuf *pixbuf_new_from_bytes ( VikMapSource *map, MapCoord *mapcoord, gint x, gint y, GBytes *bytes, guint reduce, GError **error )
 {
-  GdkPixbuf *pixbuf = NULL;
-
-  // MBTiles stored internally with the flipping y thingy (i.e. TMS scheme).
-  gint flip_y = (gint) pow(2, zoom)-1 - yy;
-  gchar *statement = g_strdup_printf ( "SELECT tile_data FROM tiles WHERE zoom_level=%d AND tile_column=%d AND tile_row=%d;", zoom, xx, flip_y );
-
-  gboolean finished = FALSE;
-
-  sqlite3_stmt *sql_stmt = NULL;
-  int ans = sqlite3_prepare_v2 ( sql, statement, -1, &sql_stmt, NULL );
-  if ( ans != SQLITE_OK ) {
-    g_warning ( "%s: %s - %s: %s", __FUNCTION__, "prepare failure", sqlite3_errstr(ans), statement );
-    finished = TRUE;
-  }
-
-  while ( !finished ) {
-    ans = sqlite3_step ( sql_stmt );
-    switch (ans) {
-      case SQLITE_ROW: {
-        // Get tile_data blob
-        int count = sqlite3_column_count(sql_stmt);
-        if ( count != 1 )  {
-          g_warning ( "%s: %s - %d", __FUNCTION__, "count not one", count );
-          finished = TRUE;
-        }
-        else {
-          const void *data = sqlite3_column_blob ( sql_stmt, 0 );
-          int bytes = sqlite3_column_bytes ( sql_stmt, 0 );
-          if ( bytes < 1 )  {
-            g_warning ( "%s: %s (%d)", __FUNCTION__, "not enough bytes", bytes );
-            finished = TRUE;
-          }
-          else {
-            // Convert these blob bytes into a pixbuf via these streaming operations
-            GInputStream *stream = g_memory_input_stream_new_from_data ( data, bytes, NULL );
-            GError *error = NULL;
-            pixbuf = gdk_pixbuf_new_from_stream ( stream, NULL, &error );
-            if ( error ) {
-              g_warning ( "%s: %s", __FUNCTION__, error->message );
-              g_error_free ( error );
-            }
-            g_input_stream_close ( stream, NULL, NULL );
-          }
-        }
-        break;
-      }
-      default:
-       // e.g. SQLITE_DONE | SQLITE_ERROR | SQLITE_MISUSE | etc...
-       // Finished normally
-       //  and give up on any errors
-       if ( ans != SQLITE_DONE )
-         g_warning ( "%s: %s - %s", __FUNCTION__, "step issue", sqlite3_errstr(ans) );
-       finished = TRUE;
-       break;
-    }
-  }
-  (void)sqlite3_finalize ( sql_stmt );
-  
-  g_free ( statement );
-
-  return pixbuf;
+  MapCoord tile = *mapcoord;
+  tile.x = x;
+  tile.y = y;
+  return vik_map_source_decode_tile ( map, bytes, &tile, reduce, error );
 }
-#endif
 
-static GdkPixbuf *get_mbtiles_pixbuf ( VikMapsLayer *vml, gint xx, gint yy, gint zoom )
+static GBytes *get_mbtiles_bytes ( VikMapsLayer *vml, guint16 id, MapCoord *mapcoord )
 {
-  GdkPixbuf *pixbuf = NULL;
+  GBytes *bytes = NULL;
 
-#ifdef HAVE_SQLITE3_H
   if ( vml->mbtiles ) {
-    /*
-    gchar *statement = g_strdup_printf ( "SELECT name FROM sqlite_master WHERE type='table';" );
-    char *errMsg = NULL;
-    int ans = sqlite3_exec ( vml->mbtiles, statement, sql_select_tile_dump_cb, pixbuf, &errMsg );
-    if ( ans != SQLITE_OK ) {
-      // Only to console for information purposes only
-      g_warning ( "SQL problem: %d for %s - error: %s", ans, statement, errMsg );
-      sqlite3_free( errMsg );
-    }
-    g_free ( statement );
-    */
-
-    // Reading BLOBS is a bit more involved and so can't use the simpler sqlite3_exec ()
-    // Hence this specific function
-    pixbuf = get_pixbuf_sql_exec ( vml->mbtiles, xx, yy, zoom );
+    bytes = a_mapcache_encoded_get ( mapcoord->x, mapcoord->y, mapcoord->z, id, mapcoord->scale, vml->filename );
+    if ( !bytes ) {
+      bytes = a_mbtiles_cache_get ( vml->mbtiles, 17 - mapcoord->scale, mapcoord->x, mapcoord->y );
+      a_mapcache_encoded_add ( bytes, mapcoord->x, mapcoord->y, mapcoord->z, id, mapcoord->scale, vml->filename );
+    }
   }
-#endif
 
-  return pixbuf;
+  return bytes;
 }
 
-static GdkPixbuf *get_pixbuf_from_metatile ( VikMapsLayer *vml, gint xx, gint yy, gint zz )
+static GBytes *get_metatile_bytes ( VikMapsLayer *vml, MapCoord *mapcoord )
 {
-  const int tile_max = METATILE_MAX_SIZE;
   char err_msg[PATH_MAX];
-  char *buf;
-  int len;
   int compressed;
 
-  buf = g_malloc(tile_max);
-  if (!buf) {
-      return NULL;
-  }
-
   err_msg[0] = 0;
-  len = metatile_read(vml->cache_dir, xx, yy, zz, buf, tile_max, &compressed, err_msg);
+  // The metatile stays mapped, so neighbouring tiles are quick to get
+  GBytes *bytes = metatile_get ( vml->cache_dir, mapcoord->x, mapcoord->y, 17 - mapcoord->scale, &compressed, err_msg );
 
-  if (len > 0) {
+  if ( bytes ) {
     if (compressed) {
       // Not handled yet - I don't think this is used often - so implement later if necessary
       g_warning ( "Compressed metatiles not implemented:%s", __FUNCTION__);
-      g_free(buf);
+      g_bytes_unref ( bytes );
       return NULL;
     }
-
-    // Convert these buf bytes into a pixbuf via these streaming operations
-    GdkPixbuf *pixbuf = NULL;
-
-    GInputStream *stream = g_memory_input_stream_new_from_data ( buf, len, NULL );
-    GError *error = NULL;
-    pixbuf = gdk_pixbuf_new_from_stream ( stream, NULL, &error );
-    if (error) {
-      g_warning ( "%s: %s", __FUNCTION__, error->message );
-      g_error_free ( error );
-    }
-    g_input_stream_close ( stream, NULL, NULL );
-
-    g_free(buf);
-    return pixbuf;
+    return bytes;
   }
   else {
-    g_free(buf);
     g_warning ( "FAILED:%s %s", __FUNCTION__, err_msg);
     return NULL;
   }
 }
 
 /**
- * Caller has to decrease reference counter of returned
- * GdkPixbuf, when buffer is no longer needed.
+ * Only the tile as decoded is cached, since the alpha and any scaling are applied when drawing.
+ * Thus changing the layer's opacity or the zoom does not need the tiles processing again,
+ *  and there is just one copy of each tile in memory.
  */
-static GdkPixbuf *pixbuf_apply_settings ( GdkPixbuf *pixbuf, VikMapsLayer *vml, guint vp_scale,
-                                          MapCoord *mapcoord, gdouble xshrinkfactor, gdouble yshrinkfactor )
+static GdkPixbuf *pixbuf_cache_add ( GdkPixbuf *pixbuf, VikMapsLayer *vml, MapCoord *mapcoord, guint reduce )
 {
-  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
-  // Apply alpha setting
-  if ( pixbuf && vml->alpha < 255 )
-    pixbuf = ui_pixbuf_set_alpha ( pixbuf, vml->alpha );
-
-  if ( pixbuf && ( xshrinkfactor != 1.0 || yshrinkfactor != 1.0 ) )
-     pixbuf = pixbuf_shrink ( pixbuf, xshrinkfactor, yshrinkfactor );
-
-  // TODO reconsider combining with shrinkfactors above...
-  if ( pixbuf && ( vp_scale != 1 || vik_map_source_get_scale(map) != 1 ) ) {
-    gdouble xscale = vp_scale;
-    gdouble yscale = vp_scale;
-    if ( vik_map_source_get_scale(map) != 0.0 ) {
-      xscale = vp_scale / vik_map_source_get_scale(map);
-      yscale = vp_scale / vik_map_source_get_scale(map);
-    }
-    pixbuf = pixbuf_shrink ( pixbuf, xscale, yscale );
-  }
-
+  // Reduced size tiles are kept apart, as if they were for a different shrinkfactor
   if ( pixbuf )
     a_mapcache_add ( pixbuf, (mapcache_extra_t) {0.0}, mapcoord->x, mapcoord->y,
-                     mapcoord->z, vik_map_source_get_uniq_id(map),
-                     mapcoord->scale, vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
-
+                     mapcoord->z, vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(vml->maptype)),
+                     mapcoord->scale, 255, 1.0/reduce, 1.0/reduce, vml->filename, vml );
   return pixbuf;
 }
 
@@ -1161,6 +1317,10 @@ static void get_filename ( const gchar *cache_dir,
       else
         g_snprintf ( filename_buf, buf_len, DIRECTDIRACCESS, cache_dir, (17 - scale), x, y, file_extension );
       break;
+    case VIK_MAPS_CACHE_LAYOUT_MBTILES:
+      // Only the download location
+      g_snprintf ( filename_buf, buf_len, MBTILESSTAGING, cache_dir, id, (17 - scale), x, y, file_extension );
+      break;
     default:
       g_snprintf ( filename_buf, buf_len, DIRSTRUCTURE, cache_dir, id, scale, z, x, y );
       break;
@@ -1168,130 +1328,722 @@ static void get_filename ( const gchar *cache_dir,
 }
 
 /**
- * Caller has to decrease reference counter of returned
- * GdkPixbuf, when buffer is no longer needed.
+ * Whether the tile is in the cache, and if so its size
+ * For the MBTiles cache layout the filename is not used
  */
-static GdkPixbuf *get_pixbuf ( VikMapsLayer *vml, guint16 id, guint vp_scale, const gchar* mapname, MapCoord *mapcoord,
-                               gchar *filename_buf, gint buf_len, gdouble xshrinkfactor, gdouble yshrinkfactor )
+static gboolean tile_is_stored ( MBTilesCache *tile_db, const gchar *filename, gint scale, gint x, gint y, goffset *size )
 {
-  GdkPixbuf *pixbuf;
-
-  /* get the thing */
-  pixbuf = a_mapcache_get ( mapcoord->x, mapcoord->y, mapcoord->z,
-                            id, mapcoord->scale, vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
-
-  if ( ! pixbuf ) {
-    VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
-    if ( vik_map_source_is_direct_file_access(map) ) {
-      // ATM MBTiles must be 'a direct access type'
-      if ( vik_map_source_is_mbtiles(map) ) {
-        pixbuf = get_mbtiles_pixbuf ( vml, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
-        pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor );
-        // return now to avoid file tests that aren't appropriate for this map type
-        return pixbuf;
-      }
-      else if ( vik_map_source_is_osm_meta_tiles(map) ) {
-        pixbuf = get_pixbuf_from_metatile ( vml, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
-        pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor );
-        return pixbuf;
-      }
-      else
-        get_filename ( vml->cache_dir, VIK_MAPS_CACHE_LAYOUT_OSM, id, NULL,
-                       mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y, filename_buf, buf_len,
-                       vik_map_source_get_file_extension(map) );
-    }
-    else
-      get_filename ( vml->cache_dir, vml->cache_layout, id, mapname,
-                     mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y, filename_buf, buf_len,
-                     vik_map_source_get_file_extension(map) );
+  goffset file_size = -1;
+  if ( tile_db )
+    file_size = a_mbtiles_cache_size ( tile_db, 17 - scale, x, y );
+  else {
+    // Most tiles not yet downloaded are answered without going to the filesystem
+    GStatBuf stat_buf;
+    if ( a_existcache_file_exists ( filename ) && g_stat ( filename, &stat_buf ) == 0 )
+      file_size = stat_buf.st_size;
+  }
+  if ( size )
+    *size = file_size;
+  return file_size >= 0;
+}
 
-    if ( g_file_test ( filename_buf, G_FILE_TEST_EXISTS ) == TRUE)
-    {
-      GError *gx = NULL;
-      pixbuf = gdk_pixbuf_new_from_file ( filename_buf, &gx );
+/**
+ * Returns: The tile file data from the cache, or NULL if not available
+ */
+static GBytes *tile_stored_get ( MBTilesCache *tile_db, const gchar *filename, gint scale, gint x, gint y )
+{
+  if ( tile_db )
+    return a_mbtiles_cache_get ( tile_db, 17 - scale, x, y );
 
-      /* free the pixbuf on error */
-      if (gx)
-      {
-        if ( gx->domain != GDK_PIXBUF_ERROR || gx->code != GDK_PIXBUF_ERROR_CORRUPT_IMAGE ) {
-          // Report a warning
-          if ( IS_VIK_WINDOW ((VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml)) ) {
-            gchar* msg = g_strdup_printf ( _("Couldn't open image file: %s"), gx->message );
-            vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml), msg, VIK_STATUSBAR_INFO );
-            g_free (msg);
-          }
-        }
+  if ( !a_existcache_file_exists ( filename ) )
+    return NULL;
+  gchar *contents = NULL;
+  gsize length = 0;
+  if ( g_file_get_contents ( filename, &contents, &length, NULL ) )
+    return g_bytes_new_take ( contents, length );
+  // Removed since the directory was listed
+  a_existcache_remove ( filename );
+  return NULL;
+}
 
-        g_error_free ( gx );
-        if ( pixbuf )
-          g_object_unref ( G_OBJECT(pixbuf) );
-        pixbuf = NULL;
-      } else {
-        pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor );
-      }
-    }
+static void tile_stored_remove ( MBTilesCache *tile_db, const gchar *filename, gint scale, gint x, gint y )
+{
+  if ( tile_db )
+    a_mbtiles_cache_remove ( tile_db, 17 - scale, x, y );
+  else {
+    if ( g_remove ( filename ) )
+      g_warning ( "REDOWNLOAD failed to remove: %s", filename );
+    a_existcache_remove ( filename );
   }
-  return pixbuf;
 }
 
-static gboolean should_start_autodownload(VikMapsLayer *vml, VikViewport *vvp)
+/**
+ * Pack the tile position into a single value for the decode hash tables
+ */
+static gint64 *decode_key_new ( MapCoord *mapcoord )
 {
-  const VikCoord *center = vik_viewport_get_center ( vvp );
+  gint64 *key = g_new ( gint64, 1 );
+  *key = ((gint64)(mapcoord->x & 0xFFFFFFF) << 36) |
+         ((gint64)(mapcoord->y & 0xFFFFFFF) << 8) |
+         (((mapcoord->scale + 64) & 0x7F) ^ ((mapcoord->z & 0x1) << 7));
+  return key;
+}
 
-  if (vik_window_get_pan_move (VIK_WINDOW(VIK_GTK_WINDOW_FROM_WIDGET(GTK_WIDGET(vvp)))))
-    /* D'n'D pan in action: do not download */
-    return FALSE;
+static gboolean decode_is_missing ( VikMapsLayer *vml, MapCoord *mapcoord )
+{
+  gint64 *key = decode_key_new ( mapcoord );
+  g_mutex_lock ( vml->decode_mutex );
+  gboolean missing = g_hash_table_contains ( vml->decode_missing, key );
+  g_mutex_unlock ( vml->decode_mutex );
+  g_free ( key );
+  return missing;
+}
 
-  // Don't attempt to download unsupported zoom levels
-  gdouble xzoom = vik_viewport_get_xmpp ( vvp );
-  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
-  guint8 zl = map_utils_mpp_to_zoom_level ( xzoom );
-  if ( zl < vik_map_source_get_zoom_min(map) || zl > vik_map_source_get_zoom_max(map) )
-    return FALSE;
+static gboolean decode_is_pending ( VikMapsLayer *vml, MapCoord *mapcoord )
+{
+  gint64 *key = decode_key_new ( mapcoord );
+  g_mutex_lock ( vml->decode_mutex );
+  gboolean pending = g_hash_table_contains ( vml->decode_pending, key );
+  g_mutex_unlock ( vml->decode_mutex );
+  g_free ( key );
+  return pending;
+}
 
-  if (vml->last_center == NULL) {
-    VikCoord *new_center = g_malloc(sizeof(VikCoord));
-    *new_center = *center;
-    vml->last_center = new_center;
-    vml->last_xmpp = vik_viewport_get_xmpp(vvp);
-    vml->last_ympp = vik_viewport_get_ympp(vvp);
-    return TRUE;
+/**
+ * Add to the tiles wanted for the current draw, unless already queued
+ * Only called from the main thread
+ */
+static void decode_request_add ( VikMapsLayer *vml, MapCoord *mapcoord, guint reduce )
+{
+  gint64 *key = decode_key_new ( mapcoord );
+  g_mutex_lock ( vml->decode_mutex );
+  gboolean pending = g_hash_table_contains ( vml->decode_pending, key );
+  if ( !pending )
+    g_hash_table_add ( vml->decode_pending, key );
+  g_mutex_unlock ( vml->decode_mutex );
+  if ( pending ) {
+    g_free ( key );
+    return;
   }
+  MapDecodeRequest mdr = { *mapcoord, reduce };
+  g_array_append_val ( vml->decode_requests, mdr );
+}
 
-  /* TODO: perhaps vik_coord_diff() */
-  if (vik_coord_equals(vml->last_center, center)
-      && (vml->last_xmpp == vik_viewport_get_xmpp(vvp))
-      && (vml->last_ympp == vik_viewport_get_ympp(vvp)))
-    return FALSE;
-
-  *(vml->last_center) = *center;
-    vml->last_xmpp = vik_viewport_get_xmpp(vvp);
-    vml->last_ympp = vik_viewport_get_ympp(vvp);
-  return TRUE;
+/**
+ * Forget which tiles were previously found to be unavailable
+ *  e.g. since they may have now been downloaded
+ */
+static void decode_missing_clear ( VikMapsLayer *vml )
+{
+  g_mutex_lock ( vml->decode_mutex );
+  g_hash_table_remove_all ( vml->decode_missing );
+  g_mutex_unlock ( vml->decode_mutex );
+  // Likewise the tiles around the display may now be available (reduce is never 0 for a drawn area)
+  memset ( &vml->prefetched, 0, sizeof(MapPrefetchArea) );
 }
 
 /**
- *
+ * Get the tile file data from wherever the map source keeps it,
+ *  avoiding going to disk if the data is still in memory
+ * Returns: The data to decode, or NULL if the tile is not available
  */
-gboolean try_draw_scale_down (VikMapsLayer *vml, VikViewport *vvp, guint vp_scale, MapCoord ulm, gint xx, gint yy, gint tilesize_x_ceil, gint tilesize_y_ceil,
-                              gdouble xshrinkfactor, gdouble yshrinkfactor, guint id, const gchar *mapname, gchar *path_buf, guint max_path_len, gdouble off_x, gdouble off_y)
+static GBytes *get_tile_bytes ( VikMapsLayer *vml, guint16 id, const gchar* mapname, MapCoord *mapcoord,
+                                gchar *filename_buf, gint buf_len )
 {
-  GdkPixbuf *pixbuf;
-  int scale_inc;
-  for (scale_inc = 1; scale_inc <= SCALE_INC_DOWN; scale_inc++) {
-    // Try with smaller zooms
-    int scale_factor = 1 << scale_inc;  /*  2^scale_inc */
-    MapCoord ulm2 = ulm;
-    ulm2.x = ulm.x / scale_factor;
+  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+  if ( vik_map_source_is_direct_file_access(map) ) {
+    // ATM MBTiles must be 'a direct access type'
+    if ( vik_map_source_is_mbtiles(map) )
+      // return now to avoid file tests that aren't appropriate for this map type
+      return get_mbtiles_bytes ( vml, id, mapcoord );
+    else if ( vik_map_source_is_osm_meta_tiles(map) )
+      return get_metatile_bytes ( vml, mapcoord );
+    else
+      get_filename ( vml->cache_dir, VIK_MAPS_CACHE_LAYOUT_OSM, id, NULL,
+                     mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y, filename_buf, buf_len,
+                     vik_map_source_get_file_extension(map) );
+  }
+  else
+    get_filename ( vml->cache_dir, vml->cache_layout, id, mapname,
+                   mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y, filename_buf, buf_len,
+                   vik_map_source_get_file_extension(map) );
+
+  GBytes *bytes = a_mapcache_encoded_get ( mapcoord->x, mapcoord->y, mapcoord->z, id, mapcoord->scale, vml->filename );
+  if ( !bytes ) {
+    bytes = tile_stored_get ( vml->tile_db, filename_buf, mapcoord->scale, mapcoord->x, mapcoord->y );
+    if ( bytes && !vml->tile_db )
+      a_diskcache_area_used ( vml->disk_area, filename_buf );
+    if ( bytes )
+      a_mapcache_encoded_add ( bytes, mapcoord->x, mapcoord->y, mapcoord->z, id, mapcoord->scale, vml->filename );
+  }
+  return bytes;
+}
+
+/**
+ * Decode the tile file data
+ * This does not use the layer, so needs no lock on it whilst the (slow) decoding happens
+ *
+ * @error: Set when the failure should be reported; a corrupt image just gives no pixbuf
+ */
+static GdkPixbuf *tile_decode ( VikMapSource *map, MapCoord *mapcoord, GBytes *bytes, guint reduce, GError **error )
+{
+  GError *gx = NULL;
+  GdkPixbuf *pixbuf = pixbuf_new_from_bytes ( map, mapcoord, mapcoord->x, mapcoord->y, bytes, reduce, &gx );
+
+  /* free the pixbuf on error */
+  if ( gx ) {
+    if ( pixbuf )
+      g_object_unref ( G_OBJECT(pixbuf) );
+    pixbuf = NULL;
+    if ( gx->domain != GDK_PIXBUF_ERROR || gx->code != GDK_PIXBUF_ERROR_CORRUPT_IMAGE )
+      g_propagate_error ( error, gx );
+    else
+      g_error_free ( gx );
+  }
+  return pixbuf;
+}
+
+/**
+ * Show the decoding failure, which is then freed
+ */
+static void tile_decode_error_report ( VikMapsLayer *vml, GError *error )
+{
+  if ( IS_VIK_WINDOW ((VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml)) ) {
+    gchar* msg = g_strdup_printf ( _("Couldn't open image file: %s"), error->message );
+    vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml), msg, VIK_STATUSBAR_INFO );
+    g_free (msg);
+  }
+  g_error_free ( error );
+}
+
+/**
+ * Caller has to decrease reference counter of returned
+ * GdkPixbuf, when buffer is no longer needed.
+ *
+ * reduce: the tile will be drawn at no more than 1/reduce of its size,
+ *  so it may be decoded that much smaller (see a_tile_decode())
+ */
+static GdkPixbuf *get_pixbuf ( VikMapsLayer *vml, guint16 id, const gchar* mapname, MapCoord *mapcoord,
+                               gchar *filename_buf, gint buf_len, GetPixbufMode mode, guint reduce )
+{
+  GdkPixbuf *pixbuf;
+
+  /* get the thing */
+  pixbuf = a_mapcache_get ( mapcoord->x, mapcoord->y, mapcoord->z,
+                            id, mapcoord->scale, 255, 1.0/reduce, 1.0/reduce, vml->filename, vml );
+  // A full size tile will do just as well
+  if ( ! pixbuf && reduce > 1 )
+    pixbuf = a_mapcache_get ( mapcoord->x, mapcoord->y, mapcoord->z,
+                              id, mapcoord->scale, 255, 1.0, 1.0, vml->filename, vml );
+
+  if ( ! pixbuf && mode == GET_PIXBUF_CACHE_ONLY )
+    return NULL;
+
+  if ( ! pixbuf && mode == GET_PIXBUF_ASYNC ) {
+    if ( !decode_is_missing ( vml, mapcoord ) )
+      decode_request_add ( vml, mapcoord, reduce );
+    return NULL;
+  }
+
+  if ( ! pixbuf ) {
+    GBytes *bytes = get_tile_bytes ( vml, id, mapname, mapcoord, filename_buf, buf_len );
+    if ( bytes ) {
+      GError *error = NULL;
+      pixbuf = tile_decode ( MAPS_LAYER_NTH_TYPE(vml->maptype), mapcoord, bytes, reduce, &error );
+      g_bytes_unref ( bytes );
+      if ( error )
+        tile_decode_error_report ( vml, error );
+      pixbuf = pixbuf_cache_add ( pixbuf, vml, mapcoord, reduce );
+    }
+  }
+  return pixbuf;
+}
+
+typedef struct {
+  VikMapsLayer *vml;
+  guint16 id;
+  MapCoord mapcoord;
+} MapPrefetch;
+
+static void prefetch_tile_cb ( gint x, gint y, GBytes *bytes, gpointer user_data )
+{
+  MapPrefetch *mp = user_data;
+  if ( !a_mapcache_encoded_contains ( x, y, mp->mapcoord.z, mp->id, mp->mapcoord.scale, mp->vml->filename ) )
+    a_mapcache_encoded_add ( bytes, x, y, mp->mapcoord.z, mp->id, mp->mapcoord.scale, mp->vml->filename );
+}
+
+/**
+ * Read the tiles in the rectangle from the MBTiles file with one query,
+ *  putting the file data in the map cache ready for decoding
+ */
+static void maps_layer_prefetch ( VikMapsLayer *vml, guint16 id, MapCoord *mapcoord, gint xmin, gint xmax, gint ymin, gint ymax )
+{
+  MBTilesCache *mbc = vml->tile_db ? vml->tile_db : vml->mbtiles;
+  if ( !mbc )
+    return;
+  MapPrefetch mp = { vml, id, *mapcoord };
+  guint count = a_mbtiles_cache_get_range ( mbc, 17 - mapcoord->scale, xmin, xmax, ymin, ymax, prefetch_tile_cb, &mp );
+  g_debug ( "%s: %d tiles for %d,%d - %d,%d", __FUNCTION__, count, xmin, ymin, xmax, ymax );
+}
+
+/**
+ * Prefetch the tiles in the rectangle that are not already available in memory
+ *  Only worthwhile when more than one tile would be read
+ */
+static void maps_layer_prefetch_missing ( VikMapsLayer *vml, guint16 id, MapCoord *mapcoord, gint xmin, gint xmax, gint ymin, gint ymax )
+{
+  if ( !vml->tile_db && !vml->mbtiles )
+    return;
+
+  gint x0 = G_MAXINT, x1 = G_MININT, y0 = G_MAXINT, y1 = G_MININT;
+  guint missing = 0;
+  for ( gint x = xmin; x <= xmax; x++ ) {
+    for ( gint y = ymin; y <= ymax; y++ ) {
+      if ( a_mapcache_contains ( x, y, mapcoord->z, id, mapcoord->scale, 255, 1.0, 1.0, vml->filename ) ||
+           a_mapcache_encoded_contains ( x, y, mapcoord->z, id, mapcoord->scale, vml->filename ) )
+        continue;
+      missing++;
+      x0 = MIN(x0, x); x1 = MAX(x1, x);
+      y0 = MIN(y0, y); y1 = MAX(y1, y);
+    }
+  }
+  if ( missing > 1 )
+    maps_layer_prefetch ( vml, id, mapcoord, x0, x1, y0, y1 );
+}
+
+static gboolean should_start_autodownload(VikMapsLayer *vml, VikViewport *vvp)
+{
+  const VikCoord *center = vik_viewport_get_center ( vvp );
+
+  if (vik_window_get_pan_move (VIK_WINDOW(VIK_GTK_WINDOW_FROM_WIDGET(GTK_WIDGET(vvp)))))
+    /* D'n'D pan in action: do not download */
+    return FALSE;
+
+  // Don't attempt to download unsupported zoom levels
+  gdouble xzoom = vik_viewport_get_xmpp ( vvp );
+  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+  guint8 zl = map_utils_mpp_to_zoom_level ( xzoom );
+  if ( zl < vik_map_source_get_zoom_min(map) || zl > vik_map_source_get_zoom_max(map) )
+    return FALSE;
+
+  if (vml->last_center == NULL) {
+    VikCoord *new_center = g_malloc(sizeof(VikCoord));
+    *new_center = *center;
+    vml->last_center = new_center;
+    vml->last_xmpp = vik_viewport_get_xmpp(vvp);
+    vml->last_ympp = vik_viewport_get_ympp(vvp);
+    return TRUE;
+  }
+
+  /* TODO: perhaps vik_coord_diff() */
+  if (vik_coord_equals(vml->last_center, center)
+      && (vml->last_xmpp == vik_viewport_get_xmpp(vvp))
+      && (vml->last_ympp == vik_viewport_get_ympp(vvp)))
+    return FALSE;
+
+  *(vml->last_center) = *center;
+    vml->last_xmpp = vik_viewport_get_xmpp(vvp);
+    vml->last_ympp = vik_viewport_get_ympp(vvp);
+  return TRUE;
+}
+
+/* pass along data to thread, exists even if layer is deleted. */
+typedef struct {
+  VikMapsLayer *vml;
+  gboolean map_layer_alive;
+  GMutex *mutex;
+  GArray *requests;
+  guint16 id;
+  const gchar *mapname;
+  gchar *filename_buf;
+  gint maxlen;
+  gint prefetch_generation; // 0 when loading tiles for the display
+} MapDecodeInfo;
+
+static void decode_weak_ref_cb ( gpointer ptr, GObject *dead_vml )
+{
+  MapDecodeInfo *mdi = ptr;
+  g_mutex_lock ( mdi->mutex );
+  mdi->map_layer_alive = FALSE;
+  g_mutex_unlock ( mdi->mutex );
+}
+
+// Number of tiles loaded before updating the display
+#define DECODE_UPDATE_INTERVAL 8
+// Extra tiles around the requested ones to read from MBTiles files
+#define DECODE_READ_AHEAD 1
+
+/**
+ * Read all the requested tiles (and some neighbours ready for panning) at once
+ *  MBTiles files only
+ */
+static void map_decode_prefetch ( MapDecodeInfo *mdi )
+{
+  if ( !mdi->requests->len )
+    return;
+
+  MapCoord *first = &g_array_index ( mdi->requests, MapDecodeRequest, 0 ).mapcoord;
+  gint x0 = first->x, x1 = first->x, y0 = first->y, y1 = first->y;
+  for ( guint ii = 1; ii < mdi->requests->len; ii++ ) {
+    MapCoord *mc = &g_array_index ( mdi->requests, MapDecodeRequest, ii ).mapcoord;
+    // Ignore any other scales (e.g. from trying to fill in missing tiles)
+    if ( mc->scale != first->scale || mc->z != first->z )
+      continue;
+    x0 = MIN(x0, mc->x); x1 = MAX(x1, mc->x);
+    y0 = MIN(y0, mc->y); y1 = MAX(y1, mc->y);
+  }
+
+  g_mutex_lock ( mdi->mutex );
+  if ( mdi->map_layer_alive )
+    maps_layer_prefetch ( mdi->vml, mdi->id, first, x0 - DECODE_READ_AHEAD, x1 + DECODE_READ_AHEAD, y0 - DECODE_READ_AHEAD, y1 + DECODE_READ_AHEAD );
+  g_mutex_unlock ( mdi->mutex );
+}
+
+/**
+ * Load the requested tiles into the map cache
+ *  then the display is updated to draw them
+ */
+static int map_decode_thread ( MapDecodeInfo *mdi, gpointer threaddata )
+{
+  guint loaded = 0;
+  map_decode_prefetch ( mdi );
+  for ( guint ii = 0; ii < mdi->requests->len; ii++ ) {
+    int res = a_background_thread_progress ( threaddata, ((gdouble)(ii+1)) / mdi->requests->len ); /* this also calls testcancel */
+    if ( res != 0 )
+      return -1;
+
+    MapDecodeRequest *mdr = &g_array_index ( mdi->requests, MapDecodeRequest, ii );
+
+    // Prevent the layer being deleted whilst getting the tile data
+    g_mutex_lock ( mdi->mutex );
+    if ( !mdi->map_layer_alive ) {
+      g_mutex_unlock ( mdi->mutex );
+      return -1;
+    }
+    if ( mdi->prefetch_generation ) {
+      // Superseded by moving the display
+      if ( mdi->prefetch_generation != g_atomic_int_get ( &mdi->vml->prefetch_generation ) ) {
+        g_mutex_unlock ( mdi->mutex );
+        return -1;
+      }
+      // Leave any tile the display is now waiting for to its own load
+      if ( decode_is_pending ( mdi->vml, &mdr->mapcoord ) ) {
+        g_mutex_unlock ( mdi->mutex );
+        continue;
+      }
+    }
+    VikMapSource *map = MAPS_LAYER_NTH_TYPE(mdi->vml->maptype);
+    GdkPixbuf *pixbuf = get_pixbuf ( mdi->vml, mdi->id, mdi->mapname, &mdr->mapcoord,
+                                     mdi->filename_buf, mdi->maxlen, GET_PIXBUF_CACHE_ONLY, mdr->reduce );
+    GBytes *bytes = NULL;
+    if ( !pixbuf )
+      bytes = get_tile_bytes ( mdi->vml, mdi->id, mdi->mapname, &mdr->mapcoord, mdi->filename_buf, mdi->maxlen );
+    g_mutex_unlock ( mdi->mutex );
+
+    // Decode without the lock, so the main thread is not held up by it meanwhile
+    GError *error = NULL;
+    if ( bytes )
+      pixbuf = tile_decode ( map, &mdr->mapcoord, bytes, mdr->reduce, &error );
+
+    g_mutex_lock ( mdi->mutex );
+    if ( !mdi->map_layer_alive ) {
+      g_mutex_unlock ( mdi->mutex );
+      if ( bytes )
+        g_bytes_unref ( bytes );
+      if ( pixbuf )
+        g_object_unref ( pixbuf );
+      if ( error )
+        g_error_free ( error );
+      return -1;
+    }
+    if ( bytes ) {
+      g_bytes_unref ( bytes );
+      if ( error )
+        tile_decode_error_report ( mdi->vml, error );
+      pixbuf_cache_add ( pixbuf, mdi->vml, &mdr->mapcoord, mdr->reduce );
+    }
+
+    // Prefetched tiles are not on display
+    if ( !mdi->prefetch_generation ) {
+      gint64 *key = decode_key_new ( &mdr->mapcoord );
+      g_mutex_lock ( mdi->vml->decode_mutex );
+      (void)g_hash_table_remove ( mdi->vml->decode_pending, key );
+      if ( pixbuf )
+        g_free ( key );
+      else
+        g_hash_table_add ( mdi->vml->decode_missing, key );
+      g_mutex_unlock ( mdi->vml->decode_mutex );
+
+      if ( pixbuf && ++loaded % DECODE_UPDATE_INTERVAL == 0 )
+        vik_layer_emit_update ( VIK_LAYER(mdi->vml) ); // NB update display from background
+    }
+    g_mutex_unlock ( mdi->mutex );
+    if ( pixbuf )
+      g_object_unref ( pixbuf );
+  }
+
+  g_mutex_lock ( mdi->mutex );
+  // Even if no tiles were loaded, redraw so that other scales can be tried for missing tiles
+  //  (prefetched tiles are not on display, so no redraw for those)
+  if ( mdi->map_layer_alive && !mdi->prefetch_generation )
+    vik_layer_emit_update ( VIK_LAYER(mdi->vml) );
+  g_mutex_unlock ( mdi->mutex );
+  return 0;
+}
+
+static void mdi_decode_free ( MapDecodeInfo *mdi )
+{
+  g_mutex_lock ( mdi->mutex );
+  if ( mdi->map_layer_alive && !mdi->prefetch_generation ) {
+    // Ensure any unfinished requests (e.g. when cancelled) can be requested again
+    g_mutex_lock ( mdi->vml->decode_mutex );
+    for ( guint ii = 0; ii < mdi->requests->len; ii++ ) {
+      gint64 *key = decode_key_new ( &g_array_index(mdi->requests, MapDecodeRequest, ii).mapcoord );
+      (void)g_hash_table_remove ( mdi->vml->decode_pending, key );
+      g_free ( key );
+    }
+    g_mutex_unlock ( mdi->vml->decode_mutex );
+  }
+  if ( mdi->map_layer_alive )
+    g_object_weak_unref ( G_OBJECT(mdi->vml), decode_weak_ref_cb, mdi );
+  g_mutex_unlock ( mdi->mutex );
+  g_array_free ( mdi->requests, TRUE );
+  g_free ( mdi->filename_buf );
+  vik_mutex_free ( mdi->mutex );
+  g_free ( mdi );
+}
+
+/**
+ * Order tiles so those from the same metatile are loaded together
+ */
+static gint decode_request_metatile_compare ( gconstpointer a, gconstpointer b )
+{
+  const MapCoord *ma = &((const MapDecodeRequest*)a)->mapcoord;
+  const MapCoord *mb = &((const MapDecodeRequest*)b)->mapcoord;
+  if ( ma->scale != mb->scale )
+    return ma->scale - mb->scale;
+  if ( ma->x / METATILE != mb->x / METATILE )
+    return ma->x / METATILE - mb->x / METATILE;
+  return ma->y / METATILE - mb->y / METATILE;
+}
+
+/**
+ * Load the tiles wanted by the current draw in the background
+ */
+static void start_decode_thread ( VikMapsLayer *vml, guint16 id, const gchar *mapname )
+{
+  MapDecodeInfo *mdi = g_malloc ( sizeof(MapDecodeInfo) );
+  mdi->vml = vml;
+  mdi->map_layer_alive = TRUE;
+  mdi->mutex = vik_mutex_new ();
+  // Take the requests, leaving a new empty array for the next draw
+  mdi->requests = vml->decode_requests;
+  vml->decode_requests = g_array_new ( FALSE, FALSE, sizeof(MapDecodeRequest) );
+  // Each metatile is then read just once, with all its wanted tiles decoded in turn
+  if ( vik_map_source_is_osm_meta_tiles ( MAPS_LAYER_NTH_TYPE(vml->maptype) ) )
+    g_array_sort ( mdi->requests, decode_request_metatile_compare );
+  mdi->id = id;
+  mdi->mapname = mapname;
+  mdi->maxlen = strlen ( vml->cache_dir ) + 40;
+  mdi->filename_buf = g_malloc ( mdi->maxlen * sizeof(gchar) );
+  mdi->prefetch_generation = 0;
+
+  gchar *tmp = g_strdup_printf ( ngettext("Loading %d %s map...", "Loading %d %s maps...", mdi->requests->len),
+                                 mdi->requests->len, MAPS_LAYER_NTH_LABEL(vml->maptype) );
+  g_object_weak_ref ( G_OBJECT(mdi->vml), decode_weak_ref_cb, mdi );
+  // Tiles for the display
+  a_background_thread_with_priority ( BACKGROUND_POOL_LOCAL,
+                        BACKGROUND_PRIORITY_INTERACTIVE,
+                        VIK_GTK_WINDOW_FROM_LAYER(vml),
+                        tmp,
+                        (vik_thr_func) map_decode_thread,
+                        mdi,
+                        (vik_thr_free_func) mdi_decode_free,
+                        NULL,
+                        mdi->requests->len );
+  g_free ( tmp );
+}
+
+static gboolean prefetch_area_equal ( const MapPrefetchArea *a, const MapPrefetchArea *b )
+{
+  return a->mapcoord.scale == b->mapcoord.scale && a->mapcoord.z == b->mapcoord.z &&
+    a->xmin == b->xmin && a->xmax == b->xmax && a->ymin == b->ymin && a->ymax == b->ymax && a->reduce == b->reduce;
+}
+
+/**
+ * Add the tile to those to prefetch, unless already in memory or known to be unavailable
+ */
+static void prefetch_request_add ( VikMapsLayer *vml, GArray *requests, guint max, guint16 id, gint x, gint y, gint z, gint scale, guint reduce )
+{
+  MapCoord mc = { x, y, z, scale };
+  if ( requests->len >= max ||
+       a_mapcache_contains ( x, y, z, id, scale, 255, 1.0/reduce, 1.0/reduce, vml->filename ) ||
+       decode_is_missing ( vml, &mc ) || decode_is_pending ( vml, &mc ) )
+    return;
+  MapDecodeRequest mdr = { mc, reduce };
+  g_array_append_val ( requests, mdr );
+}
+
+/**
+ * Load into the cache the ring of tiles around those on display and the same area at the next zoom levels,
+ *  so panning or zooming by a step can draw them immediately
+ */
+static gboolean maps_layer_prefetch_idle ( VikMapsLayer *vml )
+{
+  vml->prefetch_source = 0;
+  MapPrefetchArea *pa = &vml->prefetch_area;
+  if ( prefetch_area_equal ( pa, &vml->prefetched ) )
+    return FALSE;
+  vml->prefetched = *pa;
+
+  // Prefetched tiles go in as the most recently used, pushing out the oldest,
+  //  so only as many as fit alongside the tiles on display are wanted.
+  // Just half of that room, as the cache is split into parts which may fill unevenly
+  guint64 limit = a_mapcache_get_max_size ();
+  if ( vml->cache_quota )
+    limit = MIN ( limit, (guint64)vml->cache_quota * 1024 * 1024 );
+  guint64 visible = (guint64)(pa->xmax - pa->xmin + 1) * (pa->ymax - pa->ymin + 1) * pa->tile_bytes;
+  if ( visible >= limit || !pa->tile_bytes )
+    return FALSE;
+  guint max = (limit - visible) / 2 / pa->tile_bytes;
+
+  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+  guint16 id = vik_map_source_get_uniq_id ( map );
+  gint scale = pa->mapcoord.scale, z = pa->mapcoord.z;
+  GArray *requests = g_array_new ( FALSE, FALSE, sizeof(MapDecodeRequest) );
+
+  // The ring around the display
+  for ( gint x = pa->xmin - 1; x <= pa->xmax + 1; x++ )
+    for ( gint y = pa->ymin - 1; y <= pa->ymax + 1; y++ )
+      if ( x < pa->xmin || x > pa->xmax || y < pa->ymin || y > pa->ymax )
+        prefetch_request_add ( vml, requests, max, id, x, y, z, scale, pa->reduce );
+
+  // Zooming in
+  if ( 17 - (scale - 1) <= vik_map_source_get_zoom_max ( map ) )
+    for ( gint x = pa->xmin * 2; x <= pa->xmax * 2 + 1; x++ )
+      for ( gint y = pa->ymin * 2; y <= pa->ymax * 2 + 1; y++ )
+        prefetch_request_add ( vml, requests, max, id, x, y, z, scale - 1, pa->reduce );
+
+  // Zooming out
+  if ( 17 - (scale + 1) >= vik_map_source_get_zoom_min ( map ) )
+    for ( gint x = pa->xmin / 2; x <= pa->xmax / 2; x++ )
+      for ( gint y = pa->ymin / 2; y <= pa->ymax / 2; y++ )
+        prefetch_request_add ( vml, requests, max, id, x, y, z, scale + 1, pa->reduce );
+
+  if ( !requests->len ) {
+    g_array_free ( requests, TRUE );
+    return FALSE;
+  }
+
+  MapDecodeInfo *mdi = g_malloc ( sizeof(MapDecodeInfo) );
+  mdi->vml = vml;
+  mdi->map_layer_alive = TRUE;
+  mdi->mutex = vik_mutex_new ();
+  mdi->requests = requests;
+  mdi->id = id;
+  mdi->mapname = vik_map_source_get_name ( map );
+  mdi->maxlen = strlen ( vml->cache_dir ) + 40;
+  mdi->filename_buf = g_malloc ( mdi->maxlen * sizeof(gchar) );
+  // Any earlier prefetch still going is no longer needed
+  mdi->prefetch_generation = g_atomic_int_add ( &vml->prefetch_generation, 1 ) + 1;
+  if ( !mdi->prefetch_generation )
+    mdi->prefetch_generation = g_atomic_int_add ( &vml->prefetch_generation, 1 ) + 1;
+
+  gchar *tmp = g_strdup_printf ( ngettext("Prefetching %d %s map...", "Prefetching %d %s maps...", requests->len),
+                                 requests->len, MAPS_LAYER_NTH_LABEL(vml->maptype) );
+  g_object_weak_ref ( G_OBJECT(mdi->vml), decode_weak_ref_cb, mdi );
+  a_background_thread_with_priority ( BACKGROUND_POOL_LOCAL,
+                        BACKGROUND_PRIORITY_BULK,
+                        VIK_GTK_WINDOW_FROM_LAYER(vml),
+                        tmp,
+                        (vik_thr_func) map_decode_thread,
+                        mdi,
+                        (vik_thr_free_func) mdi_decode_free,
+                        NULL,
+                        requests->len );
+  g_free ( tmp );
+  return FALSE;
+}
+
+/**
+ * Once all the tiles on display are drawn, prefetch those around them when next idle
+ */
+static void maps_layer_prefetch_schedule ( VikMapsLayer *vml, const MapPrefetchArea *pa )
+{
+  if ( prefetch_area_equal ( pa, &vml->prefetched ) )
+    return;
+  vml->prefetch_area = *pa;
+  if ( !vml->prefetch_source )
+    vml->prefetch_source = g_idle_add_full ( G_PRIORITY_LOW, (GSourceFunc)maps_layer_prefetch_idle, vml, NULL );
+}
+
+/**
+ * Draw the region of the tile (as decoded) over the destination rectangle,
+ *  with the scaling and the layer's alpha applied by the compositing
+ */
+static void maps_layer_draw_tile ( VikMapsLayer *vml, VikViewport *vvp, GdkPixbuf *pixbuf, gint src_x, gint src_y, gint src_width, gint src_height,
+                                   gint dest_x, gint dest_y, gint dest_width, gint dest_height )
+{
+  vik_viewport_draw_pixbuf_scaled ( vvp, pixbuf, src_x, src_y, src_width, src_height, dest_x, dest_y, dest_width, dest_height, vml->alpha );
+}
+
+/**
+ * Draw the part of a tile from a lower zoom level covering the missing tile
+ */
+static void draw_ancestor ( VikMapsLayer *vml, VikViewport *vvp, GdkPixbuf *pixbuf, MapCoord *ulm, gint scale_factor, gint xx, gint yy,
+                            gint tilesize_x_ceil, gint tilesize_y_ceil, gdouble off_x, gdouble off_y )
+{
+  gint src_width = gdk_pixbuf_get_width ( pixbuf ) / scale_factor;
+  gint src_height = gdk_pixbuf_get_height ( pixbuf ) / scale_factor;
+  gint xa = off_x / scale_factor;
+  gint ya = off_y / scale_factor;
+  maps_layer_draw_tile ( vml, vvp, pixbuf, (ulm->x % scale_factor) * src_width, (ulm->y % scale_factor) * src_height, src_width, src_height,
+                         xx+xa, yy+ya, tilesize_x_ceil, tilesize_y_ceil );
+}
+
+/**
+ * Draw a tile from a higher zoom level into its part of the missing tile
+ */
+static void draw_descendant ( VikMapsLayer *vml, VikViewport *vvp, GdkPixbuf *pixbuf, gint pict_x, gint pict_y, gint scale_factor, gint xx, gint yy,
+                              gint tilesize_x_ceil, gint tilesize_y_ceil, gdouble off_x, gdouble off_y )
+{
+  gint dest_x = xx + pict_x * (tilesize_x_ceil / scale_factor);
+  gint dest_y = yy + pict_y * (tilesize_y_ceil / scale_factor);
+  gint xa = off_x / scale_factor;
+  gint ya = off_y / scale_factor;
+  maps_layer_draw_tile ( vml, vvp, pixbuf, 0, 0, gdk_pixbuf_get_width(pixbuf), gdk_pixbuf_get_height(pixbuf),
+                         dest_x+xa, dest_y+ya, tilesize_x_ceil / scale_factor, tilesize_y_ceil / scale_factor );
+}
+
+/**
+ * Use a tile from a lower zoom level in place of the missing one
+ */
+gboolean try_draw_scale_down (VikMapsLayer *vml, VikViewport *vvp, MapCoord ulm, gint xx, gint yy, gint tilesize_x_ceil, gint tilesize_y_ceil,
+                              guint id, const gchar *mapname, gchar *path_buf, guint max_path_len, gdouble off_x, gdouble off_y, GetPixbufMode mode)
+{
+  // Whichever of the tiles above is already in memory
+  guint levels = 0;
+  GdkPixbuf *pixbuf = a_mapcache_get_ancestor ( ulm.x, ulm.y, ulm.z, id, ulm.scale, 255, vml->filename, SCALE_INC_DOWN, &levels );
+  if ( pixbuf ) {
+    draw_ancestor ( vml, vvp, pixbuf, &ulm, 1 << levels, xx, yy, tilesize_x_ceil, tilesize_y_ceil, off_x, off_y );
+    g_object_unref ( pixbuf );
+    return TRUE;
+  }
+  if ( mode == GET_PIXBUF_CACHE_ONLY )
+    return FALSE;
+
+  // Otherwise load them
+  int scale_inc;
+  for (scale_inc = 1; scale_inc <= SCALE_INC_DOWN; scale_inc++) {
+    // Try with smaller zooms
+    int scale_factor = 1 << scale_inc;  /*  2^scale_inc */
+    MapCoord ulm2 = ulm;
+    ulm2.x = ulm.x / scale_factor;
     ulm2.y = ulm.y / scale_factor;
     ulm2.scale = ulm.scale + scale_inc;
-    pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm2, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor );
+    pixbuf = get_pixbuf ( vml, id, mapname, &ulm2, path_buf, max_path_len, mode, 1 );
     if ( pixbuf ) {
-      gint src_x = (ulm.x % scale_factor) * tilesize_x_ceil;
-      gint src_y = (ulm.y % scale_factor) * tilesize_y_ceil;
-      gint xa = off_x / scale_factor;
-      gint ya = off_y / scale_factor;
-      vik_viewport_draw_pixbuf ( vvp, pixbuf, src_x, src_y, xx+xa, yy+ya, tilesize_x_ceil, tilesize_y_ceil );
+      draw_ancestor ( vml, vvp, pixbuf, &ulm, scale_factor, xx, yy, tilesize_x_ceil, tilesize_y_ceil, off_x, off_y );
       g_object_unref(pixbuf);
       return TRUE;
     }
@@ -1300,14 +2052,30 @@ gboolean try_draw_scale_down (VikMapsLayer *vml, VikViewport *vvp, guint vp_scal
 }
 
 /**
- *
+ * Use tiles from higher zoom levels in place of the missing one
  */
-gboolean try_draw_scale_up (VikMapsLayer *vml, VikViewport *vvp, guint vp_scale, MapCoord ulm, gint xx, gint yy, gint tilesize_x_ceil, gint tilesize_y_ceil,
-                            gdouble xshrinkfactor, gdouble yshrinkfactor, guint id, const gchar *mapname, gchar *path_buf, guint max_path_len, gdouble off_x, gdouble off_y)
+gboolean try_draw_scale_up (VikMapsLayer *vml, VikViewport *vvp, MapCoord ulm, gint xx, gint yy, gint tilesize_x_ceil, gint tilesize_y_ceil,
+                            guint id, const gchar *mapname, gchar *path_buf, guint max_path_len, gdouble off_x, gdouble off_y, GetPixbufMode mode)
 {
   GdkPixbuf *pixbuf;
   gboolean ans = FALSE;
-  // Try with bigger zooms
+
+  // Whichever of the tiles below are already in memory - in level order so the more detailed are drawn on top
+  GArray *tiles = a_mapcache_get_descendants ( ulm.x, ulm.y, ulm.z, id, ulm.scale, 255, vml->filename, SCALE_INC_UP );
+  if ( tiles ) {
+    for ( guint ii = 0; ii < tiles->len; ii++ ) {
+      mapcache_tile_t *tile = &g_array_index ( tiles, mapcache_tile_t, ii );
+      int scale_factor = 1 << tile->levels;
+      draw_descendant ( vml, vvp, tile->pixbuf, tile->x - ulm.x * scale_factor, tile->y - ulm.y * scale_factor, scale_factor,
+                        xx, yy, tilesize_x_ceil, tilesize_y_ceil, off_x, off_y );
+    }
+    a_mapcache_tiles_free ( tiles );
+    return TRUE;
+  }
+  if ( mode == GET_PIXBUF_CACHE_ONLY )
+    return FALSE;
+
+  // Otherwise load them
   int scale_dec;
   for (scale_dec = 1; scale_dec <= SCALE_INC_UP; scale_dec++) {
     int pict_x, pict_y;
@@ -1321,13 +2089,9 @@ gboolean try_draw_scale_up (VikMapsLayer *vml, VikViewport *vvp, guint vp_scale,
         MapCoord ulm3 = ulm2;
         ulm3.x += pict_x;
         ulm3.y += pict_y;
-        pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm3, path_buf, max_path_len, xshrinkfactor / scale_factor, yshrinkfactor / scale_factor );
+        pixbuf = get_pixbuf ( vml, id, mapname, &ulm3, path_buf, max_path_len, mode, 1 );
         if ( pixbuf ) {
-          gint dest_x = xx + pict_x * (tilesize_x_ceil / scale_factor);
-          gint dest_y = yy + pict_y * (tilesize_y_ceil / scale_factor);
-          gint xa = off_x / scale_factor;
-          gint ya = off_y / scale_factor;
-          vik_viewport_draw_pixbuf ( vvp, pixbuf, 0, 0, dest_x+xa, dest_y+ya, tilesize_x_ceil / scale_factor, tilesize_y_ceil / scale_factor );
+          draw_descendant ( vml, vvp, pixbuf, pict_x, pict_y, scale_factor, xx, yy, tilesize_x_ceil, tilesize_y_ceil, off_x, off_y );
           g_object_unref(pixbuf);
           ans = TRUE;
         }
@@ -1397,15 +2161,33 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
     gchar *path_buf = g_malloc ( max_path_len * sizeof(char) );
 
     guint vp_scale = vik_viewport_get_scale ( vvp );
+
+    // When tiles are drawn shrunk, they need not be decoded at full size
+    // NB The map scale is the pixel density of its tiles, e.g. 2 for HiDPI tiles
+    gdouble density = vik_map_source_get_scale ( map ) > 0.0 ? vik_map_source_get_scale ( map ) : 1.0;
+    guint reduce = 1;
+    while ( reduce < TILE_DECODE_MAX_REDUCE && MAX(xshrinkfactor, yshrinkfactor) * vp_scale * reduce * 2 <= density )
+      reduce *= 2;
+
+    // Only load tiles in the background for the interactive display
+    //  other drawing (e.g. image export) needs everything immediately
+    GetPixbufMode mode = GET_PIXBUF_SYNC;
+    if ( ASYNC_DECODE && IS_VIK_WINDOW ((VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml)) &&
+         vvp == vik_window_viewport((VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml)) )
+      mode = GET_PIXBUF_ASYNC;
+
+    // Interactive display so tile downloads should concentrate here
+    if ( mode == GET_PIXBUF_ASYNC )
+      download_focus_set ( vml, vvp, ul, br, xzoom, yzoom );
     
     if ( (!existence_only) && vml->autodownload  && should_start_autodownload(vml, vvp)) {
       g_debug("%s: Starting autodownload", __FUNCTION__);
       if ( !vml->adl_only_missing && vik_map_source_supports_download_only_new (map) )
         // Try to download newer tiles
-        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NEW );
+        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NEW, TRUE );
       else
         // Download only missing tiles
-        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NONE );
+        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NONE, TRUE );
     }
 
     // Get drawing offset (ATM a single value that applies to all zoom levels)
@@ -1413,22 +2195,33 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
     gdouble xa = vik_map_source_get_offset_x ( map ) / xzoom;
     gdouble ya = -vik_map_source_get_offset_y ( map ) / yzoom;
 
+    // Read all the needed tiles from MBTiles files in one go
+    if ( mode == GET_PIXBUF_SYNC && !existence_only )
+      maps_layer_prefetch_missing ( vml, id, &ulm, xmin, xmax, ymin, ymax );
+
     if ( vik_map_source_get_tilesize_x(map) == 0 && !existence_only ) {
       for ( x = xmin; x <= xmax; x++ ) {
         for ( y = ymin; y <= ymax; y++ ) {
           ulm.x = x;
           ulm.y = y;
-          pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm, path_buf, max_path_len, xshrinkfactor, yshrinkfactor );
+          pixbuf = get_pixbuf ( vml, id, mapname, &ulm, path_buf, max_path_len, mode, 1 );
           if ( pixbuf ) {
-            width = gdk_pixbuf_get_width ( pixbuf );
-            height = gdk_pixbuf_get_height ( pixbuf );
+            // Size on screen
+            gdouble xscale = xshrinkfactor * vp_scale;
+            gdouble yscale = yshrinkfactor * vp_scale;
+            if ( vik_map_source_get_scale(map) != 0.0 ) {
+              xscale /= vik_map_source_get_scale(map);
+              yscale /= vik_map_source_get_scale(map);
+            }
+            width = ceil ( gdk_pixbuf_get_width(pixbuf) * xscale );
+            height = ceil ( gdk_pixbuf_get_height(pixbuf) * yscale );
 
             vik_map_source_mapcoord_to_center_coord ( map, &ulm, &coord );
             vik_viewport_coord_to_screen ( vvp, &coord, &xx, &yy );
             xx -= (width/2);
             yy -= (height/2);
 
-            vik_viewport_draw_pixbuf ( vvp, pixbuf, 0, 0, xx+xa, yy+ya, width, height );
+            maps_layer_draw_tile ( vml, vvp, pixbuf, 0, 0, gdk_pixbuf_get_width(pixbuf), gdk_pixbuf_get_height(pixbuf), xx+xa, yy+ya, width, height );
             g_object_unref(pixbuf);
           }
         }
@@ -1469,30 +2262,33 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
               get_filename ( vml->cache_dir, vml->cache_layout, id, vik_map_source_get_name(map),
                              ulm.scale, ulm.z, ulm.x, ulm.y, path_buf, max_path_len, vik_map_source_get_file_extension(map) );
 
-            if ( g_file_test ( path_buf, G_FILE_TEST_EXISTS ) == TRUE ) {
+            if ( tile_is_stored ( vml->tile_db, path_buf, ulm.scale, ulm.x, ulm.y, NULL ) ) {
 	      GdkGC *black_gc = vik_viewport_get_black_gc(vvp);
               vik_viewport_draw_line ( vvp, black_gc, xx+tilesize_x_ceil, yy, xx, yy+tilesize_y_ceil );
             }
           } else {
             // Try correct scale first
-            int scale_factor = 1;
-            pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor );
+            pixbuf = get_pixbuf ( vml, id, mapname, &ulm, path_buf, max_path_len, mode, reduce );
             if ( pixbuf ) {
-              gint src_x = (ulm.x % scale_factor) * tilesize_x_ceil;
-              gint src_y = (ulm.y % scale_factor) * tilesize_y_ceil;
-              vik_viewport_draw_pixbuf ( vvp, pixbuf, src_x, src_y, xx+xa, yy+ya, tilesize_x_ceil, tilesize_y_ceil );
+              maps_layer_draw_tile ( vml, vvp, pixbuf, 0, 0, gdk_pixbuf_get_width(pixbuf), gdk_pixbuf_get_height(pixbuf),
+                                     xx+xa, yy+ya, tilesize_x_ceil, tilesize_y_ceil );
               g_object_unref(pixbuf);
             }
             else {
+              // Whilst the correct tile is being loaded, only use other scales already in memory
+              //  otherwise (when the tile is known to be unavailable) also load the other scales
+              GetPixbufMode other_mode = mode;
+              if ( mode == GET_PIXBUF_ASYNC && !decode_is_missing ( vml, &ulm ) )
+                other_mode = GET_PIXBUF_CACHE_ONLY;
               // Otherwise try different scales
               if ( SCALE_SMALLER_ZOOM_FIRST ) {
-                if ( !try_draw_scale_down(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya) ) {
-                  try_draw_scale_up(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya);
+                if ( !try_draw_scale_down(vml,vvp,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,id,mapname,path_buf,max_path_len, xa, ya, other_mode) ) {
+                  try_draw_scale_up(vml,vvp,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,id,mapname,path_buf,max_path_len, xa, ya, other_mode);
                 }
               }
               else {
-                if ( !try_draw_scale_up(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya) ) {
-                  try_draw_scale_down(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya);
+                if ( !try_draw_scale_up(vml,vvp,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,id,mapname,path_buf,max_path_len, xa, ya, other_mode) ) {
+                  try_draw_scale_down(vml,vvp,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,id,mapname,path_buf,max_path_len, xa, ya, other_mode);
                 }
               }
             }
@@ -1530,11 +2326,24 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
 
     }
     g_free ( path_buf );
+
+    if ( vml->decode_requests->len )
+      start_decode_thread ( vml, id, mapname );
+    else if ( mode == GET_PIXBUF_ASYNC && IDLE_PREFETCH && !existence_only && vik_map_source_get_tilesize_x(map) ) {
+      MapPrefetchArea pa = { ulm, xmin, xmax, ymin, ymax, reduce,
+                             vik_map_source_get_tilesize_x(map) * vik_map_source_get_tilesize_y(map) * 4 / (reduce * reduce) };
+      maps_layer_prefetch_schedule ( vml, &pa );
+    }
   }
 }
 
 static void maps_layer_draw ( VikMapsLayer *vml, VikViewport *vvp )
 {
+  // Only follow the window's display, rather than switching back and forth for other drawing (e.g. image export)
+  if ( IS_VIK_WINDOW ((VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml)) &&
+       vvp == vik_window_viewport((VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml)) )
+    maps_layer_set_hidpi ( vml, vik_viewport_get_scale(vvp) > 1 );
+
   if ( vik_map_source_get_drawmode(MAPS_LAYER_NTH_TYPE(vml->maptype)) == vik_viewport_get_drawmode ( vvp ) )
   {
     VikCoord ul, br;
@@ -1577,6 +2386,7 @@ typedef struct {
   gchar *cache_dir;
   gchar *filename_buf;
   VikMapsCacheLayout cache_layout;
+  MBTilesCache *tile_db;
   gint x0, y0, xf, yf;
   MapCoord mapcoord;
   gint maptype;
@@ -1584,6 +2394,11 @@ typedef struct {
   gint mapstoget;
   gint redownload;
   gboolean refresh_display;
+  gboolean follow_display; // Drop tiles no longer near the display (i.e. automatic downloads)
+  gdouble xzoom, yzoom;
+  guint focus_generation;  // Of the display area that the tile order was last based on
+  guint unchanged;         // Tiles the server confirmed are still current
+  guint64 bytes_saved;     // Size of those tiles, i.e. what didn't need to be transferred again
   VikMapsLayer *vml;
   VikViewport *vvp;
   gboolean map_layer_alive;
@@ -1592,6 +2407,11 @@ typedef struct {
 
 static void mdi_free ( MapDownloadInfo *mdi )
 {
+  if ( mdi->tile_db ) {
+    // Don't leave the downloaded tiles waiting for another download to be committed
+    (void)a_mbtiles_cache_flush ( mdi->tile_db );
+    a_mbtiles_cache_unref ( mdi->tile_db );
+  }
   vik_mutex_free(mdi->mutex);
   g_free ( mdi->cache_dir );
   mdi->cache_dir = NULL;
@@ -1645,16 +2465,340 @@ static void mark_request_complete ( MapDownloadInfo *mdi, gint x, gint y )
   g_free ( request );
 }
 
-static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
+/**
+ * Move a downloaded tile into the MBTiles cache file
+ */
+static gboolean tile_db_store ( MapDownloadInfo *mdi, gint x, gint y )
 {
-  void *handle = vik_map_source_download_handle_init(MAPS_LAYER_NTH_TYPE(mdi->maptype));
-  guint donemaps = 0;
-  MapCoord mcoord = mdi->mapcoord;
-  gint x, y;
-  gboolean needed[mdi->xf-mdi->x0+1][mdi->yf-mdi->y0+1];
+  VikMapSource *map = MAPS_LAYER_NTH_TYPE(mdi->maptype);
+  gchar *filename = g_malloc ( mdi->maxlen * sizeof(gchar) );
+  get_filename ( mdi->cache_dir, mdi->cache_layout,
+                 vik_map_source_get_uniq_id(map),
+                 vik_map_source_get_name(map),
+                 mdi->mapcoord.scale, mdi->mapcoord.z, x, y, filename, mdi->maxlen,
+                 vik_map_source_get_file_extension(map) );
+  gboolean ans = FALSE;
+  GBytes *bytes = tile_stored_get ( NULL, filename, mdi->mapcoord.scale, x, y );
+  if ( bytes ) {
+    ans = a_mbtiles_cache_put ( mdi->tile_db, 17 - mdi->mapcoord.scale, x, y, bytes );
+    g_bytes_unref ( bytes );
+    if ( g_remove ( filename ) )
+      g_warning ( "%s: Failed to remove: %s", __FUNCTION__, filename );
+  }
+  g_free ( filename );
+  return ans;
+}
 
-  for ( x = mdi->x0; x <= mdi->xf; x++ ) {
-    mcoord.x = x;
+/**
+ * Report the outcome of a tile download and update the display
+ */
+static void map_tile_finished ( MapDownloadInfo *mdi, gint x, gint y, DownloadResult_t dr, gboolean remove_mem_cache, goffset existing_size )
+{
+  gboolean need_download = TRUE;
+  const gchar *problem = NULL;
+  if ( dr == DOWNLOAD_SUCCESS && mdi->tile_db ) {
+    VIK_TRACE_TILE ( "download", "tile db store", TRACE_PHASE_BEGIN, x, y, mdi->mapcoord.scale );
+    if ( !tile_db_store ( mdi, x, y ) )
+      dr = DOWNLOAD_FILE_WRITE_ERROR;
+    VIK_TRACE ( "download", "tile db store", TRACE_PHASE_END );
+  }
+  switch ( dr ) {
+    case DOWNLOAD_PARAMETERS_ERROR:
+    case DOWNLOAD_HTTP_ERROR:
+    case DOWNLOAD_CONTENT_ERROR:
+      // TODO: ?? count up the number of download errors somehow...
+      problem = _("Failed to download tile");
+      break;
+    case DOWNLOAD_FILE_WRITE_ERROR:
+      problem = _("Unable to save tile");
+      break;
+    case DOWNLOAD_SUCCESS: break;
+    case DOWNLOAD_NOT_REQUIRED:
+      need_download = FALSE;
+      break;
+    case DOWNLOAD_NOT_MODIFIED:
+      // Revalidated, so what is already in memory is still good too
+      mdi->unchanged++;
+      mdi->bytes_saved += existing_size;
+      need_download = FALSE;
+      remove_mem_cache = FALSE;
+      break;
+    default:
+      break;
+  }
+
+  mark_request_complete ( mdi, x, y );
+
+  g_mutex_lock(mdi->mutex);
+  if (problem && mdi->map_layer_alive) {
+    gchar* msg = g_strdup_printf ( "%s: %s", vik_maps_layer_get_map_label (mdi->vml), problem );
+    vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(mdi->vml), msg, VIK_STATUSBAR_INFO );
+    g_free (msg);
+  }
+  if (remove_mem_cache)
+      a_mapcache_remove_all_shrinkfactors ( x, y, mdi->mapcoord.z, vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(mdi->maptype)), mdi->mapcoord.scale, mdi->vml->filename );
+  if (need_download && mdi->map_layer_alive)
+      decode_missing_clear ( mdi->vml );
+  if (mdi->refresh_display && mdi->map_layer_alive) {
+    /* TODO: check if it's on visible area */
+    if ( need_download ) {
+      vik_layer_emit_update ( VIK_LAYER(mdi->vml) ); // NB update display from background
+    }
+  }
+  g_mutex_unlock(mdi->mutex);
+}
+
+/* A tile queued in a download batch */
+typedef struct {
+  MapDownloadInfo *mdi;
+  gpointer threaddata;
+  gint x, y;
+  gboolean remove_mem_cache;
+  goffset existing_size;
+} MapTileRequest;
+
+static gboolean map_tile_batch_done ( DownloadResult_t dr, gpointer user_data )
+{
+  MapTileRequest *mtr = (MapTileRequest*)user_data;
+  gboolean carry_on = ( a_background_testcancel ( mtr->threaddata ) == 0 );
+  if ( carry_on )
+    map_tile_finished ( mtr->mdi, mtr->x, mtr->y, dr, mtr->remove_mem_cache, mtr->existing_size );
+  else
+    mark_request_complete ( mtr->mdi, mtr->x, mtr->y );
+  g_free ( mtr );
+  return carry_on;
+}
+
+/* A tile still to be processed by a download thread */
+typedef struct {
+  gint x, y;
+  gint64 priority; // Lower is sooner; negative means no longer wanted
+} MapDownloadTile;
+
+static gint map_download_tile_compare ( gconstpointer a, gconstpointer b )
+{
+  const MapDownloadTile *ta = a;
+  const MapDownloadTile *tb = b;
+  // Reverse order, so the next tile is taken from the end of the array
+  if ( ta->priority != tb->priority )
+    return ta->priority > tb->priority ? -1 : 1;
+  if ( ta->x != tb->x )
+    return tb->x - ta->x;
+  return tb->y - ta->y;
+}
+
+/**
+ * Reorder the remaining tiles by distance from the centre of the display,
+ *  whenever the display has moved since last time.
+ * For automatic downloads, tiles that are now well off the display
+ *  (or at a different zoom level) are marked as no longer wanted.
+ */
+static void map_download_prioritise ( MapDownloadInfo *mdi, GArray *tiles )
+{
+  MapDownloadFocus focus = { 0 };
+  gboolean alive;
+
+  g_mutex_lock ( mdi->mutex );
+  alive = mdi->map_layer_alive;
+  if ( alive ) {
+    g_mutex_lock ( rq_mutex );
+    focus = mdi->vml->focus;
+    g_mutex_unlock ( rq_mutex );
+  }
+  g_mutex_unlock ( mdi->mutex );
+
+  if ( !alive ) {
+    if ( !mdi->follow_display || mdi->focus_generation == G_MAXUINT )
+      return;
+    // Nowhere to display the tiles anymore
+    for ( guint ii = 0; ii < tiles->len; ii++ )
+      g_array_index ( tiles, MapDownloadTile, ii ).priority = -1;
+    mdi->focus_generation = G_MAXUINT;
+    return;
+  }
+
+  if ( focus.generation == 0 || focus.generation == mdi->focus_generation )
+    return;
+  mdi->focus_generation = focus.generation;
+
+  VikMapSource *map = MAPS_LAYER_NTH_TYPE(mdi->maptype);
+  gboolean same_zoom = ( focus.xzoom == mdi->xzoom && focus.yzoom == mdi->yzoom );
+  MapCoord ulm, brm, cm;
+  if ( !same_zoom ||
+       !vik_map_source_coord_to_mapcoord ( map, &focus.ul, mdi->xzoom, mdi->yzoom, &ulm ) ||
+       !vik_map_source_coord_to_mapcoord ( map, &focus.br, mdi->xzoom, mdi->yzoom, &brm ) ||
+       !vik_map_source_coord_to_mapcoord ( map, &focus.center, mdi->xzoom, mdi->yzoom, &cm ) ) {
+    // Display is not showing these tiles at all
+    if ( mdi->follow_display ) {
+      for ( guint ii = 0; ii < tiles->len; ii++ )
+        g_array_index ( tiles, MapDownloadTile, ii ).priority = -1;
+    }
+    return;
+  }
+
+  const gint xmin = MIN(ulm.x, brm.x) - DOWNLOAD_CANCEL_MARGIN;
+  const gint xmax = MAX(ulm.x, brm.x) + DOWNLOAD_CANCEL_MARGIN;
+  const gint ymin = MIN(ulm.y, brm.y) - DOWNLOAD_CANCEL_MARGIN;
+  const gint ymax = MAX(ulm.y, brm.y) + DOWNLOAD_CANCEL_MARGIN;
+
+  for ( guint ii = 0; ii < tiles->len; ii++ ) {
+    MapDownloadTile *tile = &g_array_index ( tiles, MapDownloadTile, ii );
+    if ( tile->priority < 0 )
+      continue;
+    if ( mdi->follow_display &&
+         (tile->x < xmin || tile->x > xmax || tile->y < ymin || tile->y > ymax) ) {
+      tile->priority = -1;
+      continue;
+    }
+    gint64 dx = tile->x - cm.x;
+    gint64 dy = tile->y - cm.y;
+    tile->priority = dx*dx + dy*dy;
+  }
+  g_array_sort ( tiles, map_download_tile_compare );
+}
+
+/**
+ * Save a tile cut out of a larger image, in the format of the map source's files
+ */
+static gboolean tile_file_save ( GdkPixbuf *pixbuf, const gchar *filename, const gchar *format )
+{
+  gchar *buffer = NULL;
+  gsize size = 0;
+  GError *error = NULL;
+  gboolean ans = FALSE;
+  if ( gdk_pixbuf_save_to_buffer ( pixbuf, &buffer, &size, format, &error, NULL ) ) {
+    gchar *dir = g_path_get_dirname ( filename );
+    if ( g_mkdir_with_parents ( dir, 0777 ) != 0 )
+      g_warning ( "%s: Failed to mkdir %s", __FUNCTION__, dir );
+    else if ( g_file_set_contents ( filename, buffer, size, &error ) ) {
+      a_existcache_add ( filename );
+      ans = TRUE;
+    }
+    g_free ( dir );
+    g_free ( buffer );
+  }
+  if ( error ) {
+    g_warning ( "%s: %s: %s", __FUNCTION__, filename, error->message );
+    g_error_free ( error );
+  }
+  return ans;
+}
+
+/**
+ * For map sources that can, download the whole block of tiles containing x,y
+ *  as a single image and save each tile of it.
+ * Other tiles of the block still waiting in tiles are removed and finished here,
+ *  so they are done in the order the prioritised tiles want their blocks.
+ *
+ * Returns: The result for the tile x,y
+ */
+static DownloadResult_t map_download_block ( MapDownloadInfo *mdi, gint x, gint y, gint block, GArray *tiles, guint *donemaps, void *handle )
+{
+  VikMapSource *map = MAPS_LAYER_NTH_TYPE(mdi->maptype);
+  MapCoord bc = mdi->mapcoord;
+  // Blocks are aligned so neighbouring requests share them
+  bc.x = x - ((x % block) + block) % block;
+  bc.y = y - ((y % block) + block) % block;
+
+  gchar *block_fn = g_strconcat ( mdi->filename_buf, ".block.tmp", NULL );
+  VIK_TRACE_TILE ( "download", "download block", TRACE_PHASE_BEGIN, bc.x, bc.y, bc.scale );
+  DownloadResult_t dr = vik_map_source_download_block ( map, &bc, block, block_fn, handle );
+  VIK_TRACE_ARG ( "download", "download block", TRACE_PHASE_END, "result", dr );
+  if ( dr != DOWNLOAD_SUCCESS ) {
+    g_free ( block_fn );
+    return dr;
+  }
+
+  GError *error = NULL;
+  GdkPixbuf *image = gdk_pixbuf_new_from_file ( block_fn, &error );
+  if ( g_remove ( block_fn ) )
+    g_warning ( "%s: Failed to remove: %s", __FUNCTION__, block_fn );
+  a_existcache_remove ( block_fn );
+  g_free ( block_fn );
+
+  const gint tile_w = vik_map_source_get_tilesize_x ( map );
+  const gint tile_h = vik_map_source_get_tilesize_y ( map );
+  if ( !image || gdk_pixbuf_get_width ( image ) != block * tile_w || gdk_pixbuf_get_height ( image ) != block * tile_h ) {
+    if ( error ) {
+      g_warning ( "%s: %s", __FUNCTION__, error->message );
+      g_error_free ( error );
+    }
+    else
+      g_warning ( "%s: Block image is not %dx%d tiles", __FUNCTION__, block, block );
+    if ( image )
+      g_object_unref ( image );
+    return DOWNLOAD_CONTENT_ERROR;
+  }
+
+  const gchar *ext = vik_map_source_get_file_extension ( map );
+  const gchar *format = ( g_ascii_strcasecmp ( ext, ".jpg" ) == 0 || g_ascii_strcasecmp ( ext, ".jpeg" ) == 0 ) ? "jpeg" : "png";
+  gchar *filename = g_malloc ( mdi->maxlen * sizeof(gchar) );
+  MapCoord mcoord = mdi->mapcoord;
+  DownloadResult_t ans = DOWNLOAD_FILE_WRITE_ERROR;
+
+  for ( gint ii = 0; ii < block; ii++ ) {
+    for ( gint jj = 0; jj < block; jj++ ) {
+      mcoord.x = bc.x + ii;
+      mcoord.y = bc.y + jj;
+      gboolean this_tile = ( mcoord.x == x && mcoord.y == y );
+      if ( !this_tile && !is_in_area ( map, mcoord ) )
+        continue;
+
+      // Whether it is still waiting to be processed by this thread
+      gint wanted = -1;
+      if ( !this_tile ) {
+        for ( guint kk = 0; kk < tiles->len; kk++ ) {
+          MapDownloadTile *tile = &g_array_index ( tiles, MapDownloadTile, kk );
+          if ( tile->x == mcoord.x && tile->y == mcoord.y && tile->priority >= 0 ) {
+            wanted = kk;
+            break;
+          }
+        }
+      }
+
+      get_filename ( mdi->cache_dir, mdi->cache_layout,
+                     vik_map_source_get_uniq_id(map), vik_map_source_get_name(map),
+                     mdi->mapcoord.scale, mdi->mapcoord.z, mcoord.x, mcoord.y, filename, mdi->maxlen, ext );
+
+      // Don't replace existing tiles, unless they were going to be downloaded again anyway
+      if ( !this_tile && tile_is_stored ( mdi->tile_db, filename, mdi->mapcoord.scale, mcoord.x, mcoord.y, NULL ) &&
+           !(wanted >= 0 && mdi->redownload == REDOWNLOAD_ALL) )
+        continue;
+
+      GdkPixbuf *tile_pixbuf = gdk_pixbuf_new_subpixbuf ( image, ii * tile_w, jj * tile_h, tile_w, tile_h );
+      gboolean saved = tile_file_save ( tile_pixbuf, filename, format );
+      g_object_unref ( tile_pixbuf );
+
+      if ( this_tile )
+        ans = saved ? DOWNLOAD_SUCCESS : DOWNLOAD_FILE_WRITE_ERROR;
+      else if ( wanted >= 0 ) {
+        g_array_remove_index ( tiles, wanted );
+        (*donemaps)++;
+        map_tile_finished ( mdi, mcoord.x, mcoord.y, saved ? DOWNLOAD_SUCCESS : DOWNLOAD_FILE_WRITE_ERROR, TRUE, 0 );
+      }
+      else if ( saved && mdi->tile_db )
+        (void)tile_db_store ( mdi, mcoord.x, mcoord.y );
+    }
+  }
+  g_free ( filename );
+  g_object_unref ( image );
+  return ans;
+}
+
+static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
+{
+  void *handle = vik_map_source_download_handle_init(MAPS_LAYER_NTH_TYPE(mdi->maptype));
+  // Download several tiles at once over shared connections when possible
+  void *batch = DOWNLOAD_BATCH_SIZE > 1 ? a_download_batch_new () : NULL;
+  // Or several neighbouring tiles in one request
+  const gint block = vik_map_source_get_download_block_size ( MAPS_LAYER_NTH_TYPE(mdi->maptype) );
+  guint donemaps = 0;
+  MapCoord mcoord = mdi->mapcoord;
+  gint x, y;
+  GArray *tiles = g_array_new ( FALSE, FALSE, sizeof(MapDownloadTile) );
+
+  for ( x = mdi->x0; x <= mdi->xf; x++ ) {
+    mcoord.x = x;
     for ( y = mdi->y0; y <= mdi->yf; y++ ) {
       mcoord.y = y;
       // Only attempt to download a tile from supported areas
@@ -1663,16 +2807,25 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
 
         // Avoid requesting the same tile when already waiting for this request to complete from another thread
         //  such as scrolling the map around and/or zoomed in/out and come back to a view covering the same tiles
+        VIK_TRACE ( "download", "rq_mutex", TRACE_PHASE_BEGIN );
         g_mutex_lock ( rq_mutex );
-	needed[mdi->xf-x][mdi->yf-y] = ! g_hash_table_lookup_extended ( requests, request, NULL, NULL );
-        if ( needed[mdi->xf-x][mdi->yf-y] ) {
+        VIK_TRACE ( "download", "rq_mutex", TRACE_PHASE_END );
+        gboolean needed = ! g_hash_table_lookup_extended ( requests, request, NULL, NULL );
+        if ( needed ) {
           if ( vik_verbose )
-            g_debug ( "%s: %d %d Inserting request %s", __FUNCTION__, mdi->xf-x, mdi->yf-y, request );
-          g_hash_table_insert ( requests, request, NULL );
+            g_debug ( "%s: %d %d Inserting request %s", __FUNCTION__, x, y, request );
+          g_hash_table_insert ( requests, request, mdi );
         }
         g_mutex_unlock ( rq_mutex );
 
-        if ( !needed[mdi->xf-x][mdi->yf-y] ) {
+        if ( needed ) {
+          VIK_TRACE_TILE ( "download", "request", TRACE_PHASE_INSTANT, x, y, mcoord.scale );
+          // Initially in raster order, until prioritised against the display
+          MapDownloadTile tile = { x, y, 0 };
+          g_array_append_val ( tiles, tile );
+        }
+        else {
+          VIK_TRACE_TILE ( "download", "dedupe", TRACE_PHASE_INSTANT, x, y, mcoord.scale );
           if ( vik_verbose )
             g_debug ( "%s: Request for %s already in progress", __FUNCTION__, request );
           g_free ( request );
@@ -1680,353 +2833,1243 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
       }
     }
   }
+  // Reverse so the first tile is at the end
+  g_array_sort ( tiles, map_download_tile_compare );
+
+  while ( tiles->len ) {
+    map_download_prioritise ( mdi, tiles );
+
+    MapDownloadTile tile = g_array_index ( tiles, MapDownloadTile, tiles->len-1 );
+    g_array_set_size ( tiles, tiles->len-1 );
+    x = tile.x;
+    y = tile.y;
+
+    gboolean remove_mem_cache = FALSE;
+    gboolean need_download = FALSE;
+    goffset existing_size = 0;
+    donemaps++;
+    int res = a_background_thread_progress ( threaddata, ((gdouble)donemaps) / mdi->mapstoget ); /* this also calls testcancel */
+    if (res != 0) {
+      requests_clear ( mdi->maptype );
+      a_download_batch_free ( batch );
+      vik_map_source_download_handle_cleanup(MAPS_LAYER_NTH_TYPE(mdi->maptype), handle);
+      g_array_free ( tiles, TRUE );
+      return -1;
+    }
 
-  for ( x = mdi->x0; x <= mdi->xf; x++ ) {
-    mcoord.x = x;
-    for ( y = mdi->y0; y <= mdi->yf; y++ ) {
-      mcoord.y = y;
+    // Dropped as the display has moved away, so allow it to be requested again
+    if ( tile.priority < 0 ) {
+      mark_request_complete ( mdi, x, y );
+      continue;
+    }
 
-      // Only attempt to download a tile from supported areas
-      if ( is_in_area ( MAPS_LAYER_NTH_TYPE(mdi->maptype), mcoord ) ) {
+    get_filename ( mdi->cache_dir, mdi->cache_layout,
+                   vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(mdi->maptype)),
+                   vik_map_source_get_name(MAPS_LAYER_NTH_TYPE(mdi->maptype)),
+                   mdi->mapcoord.scale, mdi->mapcoord.z, x, y, mdi->filename_buf, mdi->maxlen,
+                   vik_map_source_get_file_extension(MAPS_LAYER_NTH_TYPE(mdi->maptype)) );
 
-        gboolean remove_mem_cache = FALSE;
-        gboolean need_download = FALSE;
-        donemaps++;
-        int res = a_background_thread_progress ( threaddata, ((gdouble)donemaps) / mdi->mapstoget ); /* this also calls testcancel */
-        if (res != 0) {
-          requests_clear ( mdi->maptype );
-          vik_map_source_download_handle_cleanup(MAPS_LAYER_NTH_TYPE(mdi->maptype), handle);
-          return -1;
-        }
-        // Skip as already being requested
-        if ( !needed[mdi->xf-x][mdi->yf-y] ) {
+    if ( !tile_is_stored ( mdi->tile_db, mdi->filename_buf, mdi->mapcoord.scale, x, y, &existing_size ) ) {
+      need_download = TRUE;
+      remove_mem_cache = TRUE;
+
+    } else {  /* in case map file already exists */
+      switch (mdi->redownload) {
+        case REDOWNLOAD_NONE:
+          mark_request_complete ( mdi, x, y );
           continue;
+
+        case REDOWNLOAD_BAD:
+        {
+          /* see if this one is bad or what */
+          GError *gx = NULL;
+          GdkPixbuf *pixbuf = NULL;
+          GBytes *bytes = tile_stored_get ( mdi->tile_db, mdi->filename_buf, mdi->mapcoord.scale, x, y );
+          if ( bytes ) {
+            pixbuf = pixbuf_new_from_bytes ( MAPS_LAYER_NTH_TYPE(mdi->maptype), &mdi->mapcoord, x, y, bytes, 1, &gx );
+            g_bytes_unref ( bytes );
+          }
+          if (gx || (!pixbuf)) {
+            tile_stored_remove ( mdi->tile_db, mdi->filename_buf, mdi->mapcoord.scale, x, y );
+            need_download = TRUE;
+            remove_mem_cache = TRUE;
+            if ( gx )
+              g_error_free ( gx );
+            if ( pixbuf )
+              g_object_unref ( pixbuf );
+
+          } else {
+            g_object_unref ( pixbuf );
+          }
+          break;
         }
 
-        get_filename ( mdi->cache_dir, mdi->cache_layout,
-                       vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(mdi->maptype)),
-                       vik_map_source_get_name(MAPS_LAYER_NTH_TYPE(mdi->maptype)),
-                       mdi->mapcoord.scale, mdi->mapcoord.z, x, y, mdi->filename_buf, mdi->maxlen,
-                       vik_map_source_get_file_extension(MAPS_LAYER_NTH_TYPE(mdi->maptype)) );
+        case REDOWNLOAD_NEW:
+          need_download = TRUE;
+          remove_mem_cache = TRUE;
+          break;
 
-        if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE ) {
+        case REDOWNLOAD_ALL:
+          /* FIXME: need a better way than to erase file in case of server/network problem */
+          tile_stored_remove ( mdi->tile_db, mdi->filename_buf, mdi->mapcoord.scale, x, y );
           need_download = TRUE;
           remove_mem_cache = TRUE;
+          break;
 
-        } else {  /* in case map file already exists */
-          switch (mdi->redownload) {
-            case REDOWNLOAD_NONE:
-              mark_request_complete ( mdi, x, y );
-              continue;
-
-            case REDOWNLOAD_BAD:
-            {
-              /* see if this one is bad or what */
-              GError *gx = NULL;
-              GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file ( mdi->filename_buf, &gx );
-              if (gx || (!pixbuf)) {
-                if ( g_remove ( mdi->filename_buf ) )
-                  g_warning ( "REDOWNLOAD failed to remove: %s", mdi->filename_buf );
-                need_download = TRUE;
-                remove_mem_cache = TRUE;
-                g_error_free ( gx );
-
-              } else {
-                g_object_unref ( pixbuf );
-              }
-              break;
-            }
+        case DOWNLOAD_OR_REFRESH:
+          remove_mem_cache = TRUE;
+          break;
 
-            case REDOWNLOAD_NEW:
-              need_download = TRUE;
-              remove_mem_cache = TRUE;
-              break;
-
-            case REDOWNLOAD_ALL:
-              /* FIXME: need a better way than to erase file in case of server/network problem */
-              if ( g_remove ( mdi->filename_buf ) )
-                g_warning ( "REDOWNLOAD failed to remove: %s", mdi->filename_buf );
-              need_download = TRUE;
-              remove_mem_cache = TRUE;
-              break;
-
-            case DOWNLOAD_OR_REFRESH:
-              remove_mem_cache = TRUE;
-              break;
-
-            default:
-              g_warning ( "redownload state %d unknown", mdi->redownload);
-          }
+        default:
+          g_warning ( "redownload state %d unknown", mdi->redownload);
+      }
+    }
+
+    mdi->mapcoord.x = x; mdi->mapcoord.y = y;
+
+    // Checking whether a stored tile is out of date needs its own request
+    if ( need_download && block > 1 && !(mdi->redownload == REDOWNLOAD_NEW && existing_size >= 0) ) {
+      DownloadResult_t dr = map_download_block ( mdi, x, y, block, tiles, &donemaps, handle );
+      map_tile_finished ( mdi, x, y, dr, remove_mem_cache, existing_size );
+      mdi->mapcoord.x = mdi->mapcoord.y = 0;
+      continue;
+    }
+
+    if ( need_download && batch ) {
+      MapTileRequest *mtr = g_malloc ( sizeof(MapTileRequest) );
+      mtr->mdi = mdi;
+      mtr->threaddata = threaddata;
+      mtr->x = x;
+      mtr->y = y;
+      mtr->remove_mem_cache = remove_mem_cache;
+      mtr->existing_size = existing_size;
+      if ( vik_map_source_download_batch_add ( MAPS_LAYER_NTH_TYPE(mdi->maptype), &(mdi->mapcoord), mdi->filename_buf, batch, map_tile_batch_done, mtr ) ) {
+        VIK_TRACE_TILE ( "download", "batch add", TRACE_PHASE_INSTANT, x, y, mdi->mapcoord.scale );
+        mdi->mapcoord.x = mdi->mapcoord.y = 0;
+        // Keep the queue topped up, only waiting for transfers when it is full
+        if ( a_download_batch_run ( batch, DOWNLOAD_BATCH_SIZE - 1 ) ) {
+          requests_clear ( mdi->maptype );
+          a_download_batch_free ( batch );
+          vik_map_source_download_handle_cleanup(MAPS_LAYER_NTH_TYPE(mdi->maptype), handle);
+          g_array_free ( tiles, TRUE );
+          return -1;
         }
+        continue;
+      }
+      // Map source can't use a batch, so use a normal download from now on
+      g_free ( mtr );
+      a_download_batch_free ( batch );
+      batch = NULL;
+    }
 
-        mdi->mapcoord.x = x; mdi->mapcoord.y = y;
-
-        if (need_download) {
-          DownloadResult_t dr = vik_map_source_download( MAPS_LAYER_NTH_TYPE(mdi->maptype), &(mdi->mapcoord), mdi->filename_buf, handle);
-          switch ( dr ) {
-            case DOWNLOAD_PARAMETERS_ERROR:
-            case DOWNLOAD_HTTP_ERROR:
-            case DOWNLOAD_CONTENT_ERROR: {
-              // TODO: ?? count up the number of download errors somehow...
-              gchar* msg = g_strdup_printf ( "%s: %s", vik_maps_layer_get_map_label (mdi->vml), _("Failed to download tile") );
-              vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(mdi->vml), msg, VIK_STATUSBAR_INFO );
-              g_free (msg);
-              break;
-            }
-            case DOWNLOAD_FILE_WRITE_ERROR: {
-              gchar* msg = g_strdup_printf ( "%s: %s", vik_maps_layer_get_map_label (mdi->vml), _("Unable to save tile") );
-              vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(mdi->vml), msg, VIK_STATUSBAR_INFO );
-              g_free (msg);
-              break;
+    DownloadResult_t dr = DOWNLOAD_NOT_REQUIRED;
+    if (need_download) {
+      VIK_TRACE_TILE ( "download", "download", TRACE_PHASE_BEGIN, x, y, mdi->mapcoord.scale );
+      dr = vik_map_source_download( MAPS_LAYER_NTH_TYPE(mdi->maptype), &(mdi->mapcoord), mdi->filename_buf, handle);
+      VIK_TRACE_ARG ( "download", "download", TRACE_PHASE_END, "result", dr );
+    }
+    map_tile_finished ( mdi, x, y, dr, remove_mem_cache, existing_size );
+    mdi->mapcoord.x = mdi->mapcoord.y = 0; /* we're temporarily between downloads */
+  }
+  g_array_free ( tiles, TRUE );
+
+  if ( batch ) {
+    gint res = a_download_batch_run ( batch, 0 );
+    a_download_batch_free ( batch );
+    if ( res ) {
+      requests_clear ( mdi->maptype );
+      vik_map_source_download_handle_cleanup(MAPS_LAYER_NTH_TYPE(mdi->maptype), handle);
+      return -1;
+    }
+  }
+  vik_map_source_download_handle_cleanup(MAPS_LAYER_NTH_TYPE(mdi->maptype), handle);
+
+  g_mutex_lock(mdi->mutex);
+  if ( mdi->unchanged && mdi->map_layer_alive ) {
+    gchar *size_str = g_format_size ( mdi->bytes_saved );
+    gchar *msg = g_strdup_printf ( ngettext("%s: %d tile unchanged, saved %s", "%s: %d tiles unchanged, saved %s", mdi->unchanged),
+                                   vik_maps_layer_get_map_label (mdi->vml), mdi->unchanged, size_str );
+    vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(mdi->vml), msg, VIK_STATUSBAR_INFO );
+    g_free ( msg );
+    g_free ( size_str );
+  }
+  if (mdi->map_layer_alive)
+    g_object_weak_unref(G_OBJECT(mdi->vml), weak_ref_cb, mdi);
+  g_mutex_unlock(mdi->mutex); 
+  return 0;
+}
+
+static void mdi_cancel_cleanup ( MapDownloadInfo *mdi )
+{
+  if ( mdi->mapcoord.x || mdi->mapcoord.y )
+  {
+    get_filename ( mdi->cache_dir, mdi->cache_layout,
+                   vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(mdi->maptype)),
+                   vik_map_source_get_name(MAPS_LAYER_NTH_TYPE(mdi->maptype)),
+                   mdi->mapcoord.scale, mdi->mapcoord.z, mdi->mapcoord.x, mdi->mapcoord.y, mdi->filename_buf, mdi->maxlen,
+                   vik_map_source_get_file_extension(MAPS_LAYER_NTH_TYPE(mdi->maptype)) );
+    if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == TRUE)
+    {
+      if ( g_remove ( mdi->filename_buf ) )
+        g_warning ( "Cleanup failed to remove: %s", mdi->filename_buf );
+      a_existcache_remove ( mdi->filename_buf );
+    }
+  }
+
+  requests_clear ( mdi->maptype );
+}
+
+/**
+ * Record the area on display, so any downloads in progress for this layer
+ *  can get the tiles that are visible first.
+ */
+static void download_focus_set ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gdouble xzoom, gdouble yzoom )
+{
+  const VikCoord *center = vik_viewport_get_center ( vvp );
+  g_mutex_lock ( rq_mutex );
+  MapDownloadFocus *focus = &vml->focus;
+  if ( focus->generation == 0 ||
+       focus->xzoom != xzoom || focus->yzoom != yzoom ||
+       !vik_coord_equals ( &focus->ul, ul ) || !vik_coord_equals ( &focus->br, br ) ||
+       !vik_coord_equals ( &focus->center, center ) ) {
+    focus->xzoom = xzoom;
+    focus->yzoom = yzoom;
+    focus->ul = *ul;
+    focus->br = *br;
+    focus->center = *center;
+    focus->generation++;
+    // Avoid the special values
+    if ( focus->generation == 0 || focus->generation == G_MAXUINT )
+      focus->generation = 1;
+  }
+  g_mutex_unlock ( rq_mutex );
+}
+
+static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload, gboolean follow_display )
+{
+  gdouble xzoom = vml->xmapzoom ? vml->xmapzoom : vik_viewport_get_xmpp ( vvp );
+  gdouble yzoom = vml->ymapzoom ? vml->ymapzoom : vik_viewport_get_ympp ( vvp );
+  MapCoord ulm, brm;
+  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+
+  // Don't ever attempt download on direct access
+  if ( vik_map_source_is_direct_file_access ( map ) )
+    return;
+
+  // Make room for the new tiles, if the disk cache is due a check
+  a_diskcache_area_check ( vml->disk_area );
+
+  if ( vik_map_source_coord_to_mapcoord ( map, ul, xzoom, yzoom, &ulm ) 
+    && vik_map_source_coord_to_mapcoord ( map, br, xzoom, yzoom, &brm ) )
+  {
+    MapDownloadInfo *mdi = g_malloc ( sizeof(MapDownloadInfo) );
+    gint a, b;
+
+    mdi->vml = vml;
+    mdi->vvp = vvp;
+    mdi->map_layer_alive = TRUE;
+    mdi->mutex = vik_mutex_new();
+    mdi->refresh_display = TRUE;
+    mdi->follow_display = follow_display;
+    mdi->xzoom = xzoom;
+    mdi->yzoom = yzoom;
+    mdi->focus_generation = 0;
+    mdi->unchanged = 0;
+    mdi->bytes_saved = 0;
+
+    /* cache_dir and buffer for dest filename */
+    mdi->cache_dir = g_strdup ( vml->cache_dir );
+    mdi->maxlen = strlen ( vml->cache_dir ) + 40;
+    mdi->filename_buf = g_malloc ( mdi->maxlen * sizeof(gchar) );
+    mdi->cache_layout = vml->cache_layout;
+    mdi->tile_db = vml->tile_db ? a_mbtiles_cache_ref ( vml->tile_db ) : NULL;
+    mdi->maptype = vml->maptype;
+
+    mdi->mapcoord = ulm;
+    mdi->redownload = redownload;
+
+    mdi->x0 = MIN(ulm.x, brm.x);
+    mdi->xf = MAX(ulm.x, brm.x);
+    mdi->y0 = MIN(ulm.y, brm.y);
+    mdi->yf = MAX(ulm.y, brm.y);
+
+    mdi->mapstoget = 0;
+
+    MapCoord mcoord = mdi->mapcoord;
+    // Jobs already getting tiles of the display
+    GHashTable *owners = NULL;
+
+    // Always calculate how many we need
+    for ( a = mdi->x0; a <= mdi->xf; a++ ) {
+      mcoord.x = a;
+      for ( b = mdi->y0; b <= mdi->yf; b++ ) {
+        mcoord.y = b;
+        // Only count tiles from supported areas
+        if ( is_in_area (map, mcoord) ) {
+          gchar *request = create_request_string ( mdi, a, b );
+          gpointer owner = NULL;
+          // Only count it if not an outstanding request
+          if ( !g_hash_table_lookup_extended(requests, request, NULL, &owner ) ) {
+            if ( mdi->redownload )
+              // Note this count is quite simplistic,
+              //  we still might not attempt to get a newer version of existing tiles
+              //  such as due to file timestamps/tile age parameter, use-etag properties and so on
+              //  these details are currently in the map/download functions
+              mdi->mapstoget++;
+            else {
+              // Otherwise only if file is missing
+              get_filename ( mdi->cache_dir, mdi->cache_layout,
+                             vik_map_source_get_uniq_id(map),
+                             vik_map_source_get_name(map),
+                             ulm.scale, ulm.z, a, b, mdi->filename_buf, mdi->maxlen,
+                             vik_map_source_get_file_extension(map) );
+              if ( !tile_is_stored ( mdi->tile_db, mdi->filename_buf, ulm.scale, a, b, NULL ) ) {
+                mdi->mapstoget++;
+              }
             }
-            case DOWNLOAD_SUCCESS: break;
-            case DOWNLOAD_NOT_REQUIRED:
-	      need_download = FALSE;
-	      break;
-            default:
-              break;
           }
+          else if ( follow_display && owner ) {
+            if ( !owners )
+              owners = g_hash_table_new ( g_direct_hash, g_direct_equal );
+            g_hash_table_add ( owners, owner );
+          }
+          g_free ( request );
         }
+      }
+    }
+
+    // Ensure whatever is getting the displayed tiles is not held up by other jobs
+    if ( owners ) {
+      GHashTableIter iter;
+      gpointer owner;
+      g_hash_table_iter_init ( &iter, owners );
+      while ( g_hash_table_iter_next ( &iter, &owner, NULL ) )
+        a_background_thread_raise_priority ( owner, BACKGROUND_PRIORITY_INTERACTIVE );
+      g_hash_table_destroy ( owners );
+    }
+
+    mdi->mapcoord.x = mdi->mapcoord.y = 0; /* for cleanup -- no current map */
+
+    if ( mdi->mapstoget )
+    {
+      const gchar *tmp_str;
+      gchar *tmp;
+
+      if (redownload) 
+      {
+        if (redownload == REDOWNLOAD_BAD)
+          tmp_str = ngettext("Redownloading up to %d %s map...", "Redownloading up to %d %s maps...", mdi->mapstoget);
+        else
+          tmp_str = ngettext("Redownloading %d %s map...", "Redownloading %d %s maps...", mdi->mapstoget);
+      } 
+      else 
+      {
+        tmp_str = ngettext("Downloading %d %s map...", "Downloading %d %s maps...", mdi->mapstoget);
+      }
+      tmp = g_strdup_printf ( tmp_str, mdi->mapstoget, MAPS_LAYER_NTH_LABEL(vml->maptype));
+ 
+      g_object_weak_ref(G_OBJECT(mdi->vml), weak_ref_cb, mdi);
+      /* launch the thread */
+      // Downloads for the display go ahead of anything else
+      a_background_thread_with_priority ( BACKGROUND_POOL_REMOTE,
+                            follow_display ? BACKGROUND_PRIORITY_INTERACTIVE : BACKGROUND_PRIORITY_NORMAL,
+                            VIK_GTK_WINDOW_FROM_LAYER(vml), /* parent window */
+                            tmp,                                              /* description string */
+                            (vik_thr_func) map_download_thread,               /* function to call within thread */
+                            mdi,                                              /* pass along data */
+                            (vik_thr_free_func) mdi_free,                     /* function to free pass along data */
+                            (vik_thr_free_func) mdi_cancel_cleanup,
+                            mdi->mapstoget );
+      g_free ( tmp );
+    }
+    else
+      mdi_free ( mdi );
+  }
+}
+
+static void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, VikCoord *ul, VikCoord *br, gdouble zoom, gint download_method )
+{
+  MapCoord ulm, brm;
+  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+
+  // Don't ever attempt download on direct access
+  if ( vik_map_source_is_direct_file_access ( map ) )
+    return;
+
+  if (!vik_map_source_coord_to_mapcoord(map, ul, zoom, zoom, &ulm) 
+    || !vik_map_source_coord_to_mapcoord(map, br, zoom, zoom, &brm)) {
+    g_warning("%s() coord_to_mapcoord() failed", __PRETTY_FUNCTION__);
+    return;
+  }
+
+  MapDownloadInfo *mdi = g_malloc(sizeof(MapDownloadInfo));
+  gint i, j;
+
+  mdi->vml = vml;
+  mdi->vvp = vvp;
+  mdi->map_layer_alive = TRUE;
+  mdi->mutex = vik_mutex_new();
+  mdi->refresh_display = TRUE;
+  mdi->follow_display = FALSE;
+  mdi->xzoom = mdi->yzoom = zoom;
+  mdi->focus_generation = 0;
+  mdi->unchanged = 0;
+  mdi->bytes_saved = 0;
+
+  mdi->cache_dir = g_strdup ( vml->cache_dir );
+  mdi->maxlen = strlen ( vml->cache_dir ) + 40;
+  mdi->filename_buf = g_malloc ( mdi->maxlen * sizeof(gchar) );
+  mdi->maptype = vml->maptype;
+  mdi->cache_layout = vml->cache_layout;
+  mdi->tile_db = vml->tile_db ? a_mbtiles_cache_ref ( vml->tile_db ) : NULL;
+
+  mdi->mapcoord = ulm;
+  mdi->redownload = download_method;
+
+  mdi->x0 = MIN(ulm.x, brm.x);
+  mdi->xf = MAX(ulm.x, brm.x);
+  mdi->y0 = MIN(ulm.y, brm.y);
+  mdi->yf = MAX(ulm.y, brm.y);
+
+  mdi->mapstoget = 0;
+
+  MapCoord mcoord = mdi->mapcoord;
+
+  for (i = mdi->x0; i <= mdi->xf; i++) {
+    mcoord.x = i;
+    for (j = mdi->y0; j <= mdi->yf; j++) {
+      mcoord.y = j;
+      // Only count tiles from supported areas
+      if ( is_in_area (map, mcoord) ) {
+        get_filename ( mdi->cache_dir, mdi->cache_layout,
+                       vik_map_source_get_uniq_id(map),
+                       vik_map_source_get_name(map),
+                       ulm.scale, ulm.z, i, j, mdi->filename_buf, mdi->maxlen,
+                       vik_map_source_get_file_extension(map) );
+        if ( !tile_is_stored ( mdi->tile_db, mdi->filename_buf, ulm.scale, i, j, NULL ) )
+              mdi->mapstoget++;
+      }
+    }
+  }
+
+  mdi->mapcoord.x = mdi->mapcoord.y = 0; /* for cleanup -- no current map */
+
+  if (mdi->mapstoget) {
+    gchar *tmp;
+    const gchar *fmt;
+    fmt = ngettext("Downloading %d %s map...",
+                   "Downloading %d %s maps...",
+		   mdi->mapstoget);
+    tmp = g_strdup_printf ( fmt, mdi->mapstoget, MAPS_LAYER_NTH_LABEL(vml->maptype) );
+
+    g_object_weak_ref(G_OBJECT(mdi->vml), weak_ref_cb, mdi);
+
+    // launch the thread
+    a_background_thread_with_priority ( BACKGROUND_POOL_REMOTE,
+                          BACKGROUND_PRIORITY_BULK,
+                          VIK_GTK_WINDOW_FROM_LAYER(vml), /* parent window */
+                          tmp,                                /* description string */
+                          (vik_thr_func) map_download_thread, /* function to call within thread */
+                          mdi,                                /* pass along data */
+                          (vik_thr_free_func) mdi_free,       /* function to free pass along data */
+                          (vik_thr_free_func) mdi_cancel_cleanup,
+                          mdi->mapstoget );
+    g_free ( tmp );
+  }
+  else
+    mdi_free ( mdi );
+}
+
+/**************************/
+/****** PRE-SEEDING *******/
+/**************************/
+
+// Files in the cache directory recording the state of each pre-seed job
+#define SEED_FILE_EXTENSION ".seed"
+#define SEED_GROUP "Seed"
+// Tiles downloaded between saving the job state
+#define SEED_CHECKPOINT 256
+// Tiles considered between progress updates
+#define SEED_PROGRESS_STEP 64
+#define SEED_METRES_PER_DEGREE 111319.49
+
+/* pass along data to thread, exists even if layer is deleted. */
+typedef struct {
+  MapDownloadInfo *mdi;  // Tile naming, request tracking and result reporting
+  gchar *job_file;
+  gboolean registered;   // In seed_running
+  VikMapsSeedArea area;
+  gdouble corridor;      // Metres either side of the line
+  GArray *points;        // struct LatLon
+  gdouble zoom_min;      // Metres per pixel
+  gdouble zoom_max;
+  gdouble zoom;          // Zoom level currently being worked through
+  gboolean zoom_ready;   // Tile range of the current zoom level is set up
+  gboolean resume_pos;   // x & y are from the job file
+  gint x, y;             // Next tile to be considered
+  GArray *tiles;         // SeedTile - of a corridor at the current zoom level, in the order considered
+  guint tile_idx;        // Next of the tiles to be considered
+  guint downloaded;      // Over all runs of this job
+  guint considered;      // During this run
+  guint estimate;        // Tiles possibly to be considered during this run
+} SeedJob;
+
+typedef struct {
+  gint x, y;
+} SeedTile;
+
+/* A tile queued by a pre-seed job */
+typedef struct {
+  SeedJob *job;
+  gpointer threaddata;
+  gint x, y;
+} SeedTileRequest;
 
-        mark_request_complete ( mdi, x, y );
+static SeedJob *seed_job_new ( VikMapsLayer *vml )
+{
+  SeedJob *job = g_malloc0 ( sizeof(SeedJob) );
+  MapDownloadInfo *mdi = g_malloc0 ( sizeof(MapDownloadInfo) );
+
+  mdi->vml = vml;
+  mdi->vvp = NULL;
+  mdi->map_layer_alive = TRUE;
+  mdi->mutex = vik_mutex_new();
+  // Tiles are mostly going to be elsewhere, so don't keep redrawing
+  mdi->refresh_display = FALSE;
+  mdi->follow_display = FALSE;
+  mdi->cache_dir = g_strdup ( vml->cache_dir );
+  mdi->maxlen = strlen ( vml->cache_dir ) + 40;
+  mdi->filename_buf = g_malloc ( mdi->maxlen * sizeof(gchar) );
+  mdi->maptype = vml->maptype;
+  mdi->cache_layout = vml->cache_layout;
+  mdi->tile_db = vml->tile_db ? a_mbtiles_cache_ref ( vml->tile_db ) : NULL;
+  mdi->redownload = REDOWNLOAD_NONE;
+
+  job->mdi = mdi;
+  job->points = g_array_new ( FALSE, FALSE, sizeof(struct LatLon) );
+  return job;
+}
+
+static void seed_job_free ( SeedJob *job )
+{
+  if ( job->registered ) {
+    g_mutex_lock ( rq_mutex );
+    (void)g_hash_table_remove ( seed_running, job->job_file );
+    g_mutex_unlock ( rq_mutex );
+
+    g_mutex_lock ( job->mdi->mutex );
+    if ( job->mdi->map_layer_alive )
+      g_object_weak_unref ( G_OBJECT(job->mdi->vml), weak_ref_cb, job->mdi );
+    g_mutex_unlock ( job->mdi->mutex );
+  }
+  g_free ( job->job_file );
+  g_array_free ( job->points, TRUE );
+  if ( job->tiles )
+    g_array_free ( job->tiles, TRUE );
+  mdi_free ( job->mdi );
+  g_free ( job );
+}
+
+static gboolean seed_job_save ( SeedJob *job )
+{
+  GKeyFile *kf = g_key_file_new ();
+  g_key_file_set_integer ( kf, SEED_GROUP, "map", MAPS_LAYER_NTH_ID(job->mdi->maptype) );
+  g_key_file_set_string ( kf, SEED_GROUP, "area", job->area == VIK_MAPS_SEED_POLYGON ? "polygon" : "corridor" );
+  g_key_file_set_double ( kf, SEED_GROUP, "corridor", job->corridor );
+  g_key_file_set_double ( kf, SEED_GROUP, "zoom_min", job->zoom_min );
+  g_key_file_set_double ( kf, SEED_GROUP, "zoom_max", job->zoom_max );
+  g_key_file_set_double ( kf, SEED_GROUP, "zoom", job->zoom );
+  g_key_file_set_boolean ( kf, SEED_GROUP, "started", job->zoom_ready );
+  g_key_file_set_integer ( kf, SEED_GROUP, "x", job->x );
+  g_key_file_set_integer ( kf, SEED_GROUP, "y", job->y );
+  g_key_file_set_integer ( kf, SEED_GROUP, "downloaded", job->downloaded );
+
+  gdouble *coords = g_new ( gdouble, job->points->len * 2 );
+  for ( guint ii = 0; ii < job->points->len; ii++ ) {
+    struct LatLon *ll = &g_array_index ( job->points, struct LatLon, ii );
+    coords[2*ii] = ll->lat;
+    coords[2*ii+1] = ll->lon;
+  }
+  g_key_file_set_double_list ( kf, SEED_GROUP, "points", coords, job->points->len * 2 );
+  g_free ( coords );
+
+  gsize length = 0;
+  gchar *data = g_key_file_to_data ( kf, &length, NULL );
+  GError *error = NULL;
+  gboolean ans = g_file_set_contents ( job->job_file, data, length, &error );
+  if ( !ans ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+  }
+  g_free ( data );
+  g_key_file_free ( kf );
+  return ans;
+}
+
+static SeedJob *seed_job_load ( VikMapsLayer *vml, const gchar *job_file )
+{
+  GKeyFile *kf = g_key_file_new ();
+  if ( !g_key_file_load_from_file ( kf, job_file, G_KEY_FILE_NONE, NULL ) ) {
+    g_key_file_free ( kf );
+    return NULL;
+  }
+
+  GError *error = NULL;
+  guint map_id = g_key_file_get_integer ( kf, SEED_GROUP, "map", &error );
+  if ( error || map_id != MAPS_LAYER_NTH_ID(vml->maptype) ) {
+    if ( error )
+      g_error_free ( error );
+    g_key_file_free ( kf );
+    return NULL;
+  }
+
+  SeedJob *job = seed_job_new ( vml );
+  job->job_file = g_strdup ( job_file );
+  gchar *area = g_key_file_get_string ( kf, SEED_GROUP, "area", NULL );
+  job->area = g_strcmp0 ( area, "polygon" ) ? VIK_MAPS_SEED_CORRIDOR : VIK_MAPS_SEED_POLYGON;
+  g_free ( area );
+  job->corridor = g_key_file_get_double ( kf, SEED_GROUP, "corridor", NULL );
+  job->zoom_min = g_key_file_get_double ( kf, SEED_GROUP, "zoom_min", NULL );
+  job->zoom_max = g_key_file_get_double ( kf, SEED_GROUP, "zoom_max", NULL );
+  job->zoom = g_key_file_get_double ( kf, SEED_GROUP, "zoom", NULL );
+  job->resume_pos = g_key_file_get_boolean ( kf, SEED_GROUP, "started", NULL );
+  job->x = g_key_file_get_integer ( kf, SEED_GROUP, "x", NULL );
+  job->y = g_key_file_get_integer ( kf, SEED_GROUP, "y", NULL );
+  job->downloaded = g_key_file_get_integer ( kf, SEED_GROUP, "downloaded", NULL );
+
+  gsize len = 0;
+  gdouble *coords = g_key_file_get_double_list ( kf, SEED_GROUP, "points", &len, NULL );
+  for ( gsize ii = 0; ii+1 < len; ii += 2 ) {
+    struct LatLon ll = { coords[ii], coords[ii+1] };
+    g_array_append_val ( job->points, ll );
+  }
+  g_free ( coords );
+  g_key_file_free ( kf );
+
+  if ( !job->points->len || job->zoom_min <= 0.0 || job->zoom_max < job->zoom_min ) {
+    g_warning ( "%s: Invalid job file %s", __FUNCTION__, job_file );
+    seed_job_free ( job );
+    return NULL;
+  }
+  return job;
+}
+
+/**
+ * Ray casting test of the position against the closed outline of the points
+ */
+static gboolean seed_inside_polygon ( GArray *points, const struct LatLon *ll )
+{
+  gboolean inside = FALSE;
+  for ( guint ii = 0, jj = points->len-1; ii < points->len; jj = ii++ ) {
+    const struct LatLon *aa = &g_array_index ( points, struct LatLon, ii );
+    const struct LatLon *bb = &g_array_index ( points, struct LatLon, jj );
+    if ( ((aa->lat > ll->lat) != (bb->lat > ll->lat)) &&
+         (ll->lon < (bb->lon - aa->lon) * (ll->lat - aa->lat) / (bb->lat - aa->lat) + aa->lon) )
+      inside = !inside;
+  }
+  return inside;
+}
+
+/**
+ * Whether the tile is within the outline of a polygon area
+ */
+static gboolean seed_tile_wanted ( SeedJob *job, VikMapSource *map, gint x, gint y )
+{
+  MapCoord mc = job->mdi->mapcoord;
+  mc.x = x;
+  mc.y = y;
+  if ( !is_in_area ( map, mc ) )
+    return FALSE;
+
+  VikCoord vc;
+  struct LatLon centre, next;
+  vik_map_source_mapcoord_to_center_coord ( map, &mc, &vc );
+  vik_coord_to_latlon ( &vc, &centre );
+  // The diagonally adjacent tile gives the tile size hereabouts
+  mc.x++;
+  mc.y++;
+  vik_map_source_mapcoord_to_center_coord ( map, &mc, &vc );
+  vik_coord_to_latlon ( &vc, &next );
+  gdouble half_lat = fabs ( next.lat - centre.lat ) / 2;
+  gdouble half_lon = fabs ( next.lon - centre.lon ) / 2;
+
+  if ( seed_inside_polygon ( job->points, &centre ) )
+    return TRUE;
+  // Tiles on the edge
+  for ( gint ii = 0; ii < 4; ii++ ) {
+    struct LatLon corner = { centre.lat + ((ii & 1) ? half_lat : -half_lat),
+                             centre.lon + ((ii & 2) ? half_lon : -half_lon) };
+    if ( seed_inside_polygon ( job->points, &corner ) )
+      return TRUE;
+  }
+  // Outline passing through the tile without enclosing any corner
+  for ( guint ii = 0; ii < job->points->len; ii++ ) {
+    struct LatLon *ll = &g_array_index ( job->points, struct LatLon, ii );
+    if ( fabs ( ll->lat - centre.lat ) <= half_lat && fabs ( ll->lon - centre.lon ) <= half_lon )
+      return TRUE;
+  }
+  return FALSE;
+}
+
+/**
+ * Get the size of the tile containing the position, in degrees and in metres
+ */
+static gboolean seed_tile_size ( VikMapSource *map, gdouble zoom, const struct LatLon *ll, struct LatLon *deg, struct LatLon *metres )
+{
+  VikCoord vc;
+  MapCoord mc;
+  vik_coord_load_from_latlon ( &vc, VIK_COORD_LATLON, ll );
+  if ( !vik_map_source_coord_to_mapcoord ( map, &vc, zoom, zoom, &mc ) )
+    return FALSE;
+  struct LatLon centre, next;
+  vik_map_source_mapcoord_to_center_coord ( map, &mc, &vc );
+  vik_coord_to_latlon ( &vc, &centre );
+  mc.x++;
+  mc.y++;
+  vik_map_source_mapcoord_to_center_coord ( map, &mc, &vc );
+  vik_coord_to_latlon ( &vc, &next );
+  deg->lat = fabs ( next.lat - centre.lat );
+  deg->lon = fabs ( next.lon - centre.lon );
+  metres->lat = deg->lat * SEED_METRES_PER_DEGREE;
+  metres->lon = deg->lon * SEED_METRES_PER_DEGREE * cos ( DEG2RAD(centre.lat) );
+  return deg->lat > 0.0 && deg->lon > 0.0;
+}
+
+/**
+ * The tiles within the corridor distance of anywhere in a tile, as the half height of each column either side of it
+ * i.e. those whose nearest edge is within the distance of the far edge of the tile the line is in
+ */
+static void seed_corridor_heights ( GArray *heights, gdouble corridor, const struct LatLon *metres )
+{
+  g_array_set_size ( heights, 0 );
+  gdouble rx = corridor / metres->lon;
+  gdouble ry = corridor / metres->lat;
+  for ( gint dx = 0; ; dx++ ) {
+    gdouble ex = rx > 0.0 ? MAX ( dx - 1, 0 ) / rx : dx;
+    if ( ex > 1.0 || (corridor <= 0.0 && dx > 0) )
+      break;
+    gint hh = corridor > 0.0 ? (gint)floor ( ry * sqrt ( 1.0 - ex*ex ) ) + 1 : 0;
+    g_array_append_val ( heights, hh );
+  }
+}
+
+/**
+ * Add the tiles around the tile at cx,cy, except those already added around the previous one at px,py
+ */
+static void seed_corridor_add ( GArray *tiles, GArray *heights, gint cx, gint cy, gboolean previous, gint px, gint py )
+{
+  gint radius = heights->len - 1;
+  for ( gint dx = -radius; dx <= radius; dx++ ) {
+    SeedTile tile = { cx + dx, 0 };
+    gint hh = g_array_index ( heights, gint, ABS(dx) );
+    gint lo = cy - hh, hi = cy + hh;
+    gint olo = G_MAXINT, ohi = G_MININT;
+    if ( previous && ABS(tile.x - px) <= radius ) {
+      gint oh = g_array_index ( heights, gint, ABS(tile.x - px) );
+      olo = py - oh;
+      ohi = py + oh;
+    }
+    for ( tile.y = lo; tile.y <= hi; tile.y++ ) {
+      if ( tile.y >= olo && tile.y <= ohi )
+        tile.y = ohi;
+      else
+        g_array_append_val ( tiles, tile );
+    }
+  }
+}
+
+static gint seed_tile_compare ( gconstpointer aa, gconstpointer bb )
+{
+  const SeedTile *ta = aa, *tb = bb;
+  if ( ta->x != tb->x )
+    return ta->x < tb->x ? -1 : 1;
+  return ta->y < tb->y ? -1 : (ta->y > tb->y);
+}
+
+/**
+ * Rasterise the line buffered by the corridor distance directly in tile space,
+ *  so the work is in proportion to the area of the corridor rather than of its bounds
+ * The line is walked in steps of half a tile, adding the tiles about each step not already about the previous step.
+ *
+ * Returns: The tiles sorted by x then y as per the order of considering the bounds, or NULL if none
+ */
+static GArray *seed_corridor_tiles ( SeedJob *job, VikMapSource *map, gdouble zoom, MapCoord *first )
+{
+  GArray *tiles = g_array_new ( FALSE, FALSE, sizeof(SeedTile) );
+  GArray *heights = g_array_new ( FALSE, FALSE, sizeof(gint) );
+  GArray *segment_heights = g_array_new ( FALSE, FALSE, sizeof(gint) );
+  gboolean previous = FALSE;
+  gint px = 0, py = 0;
+
+  for ( guint ii = 0; ii < job->points->len; ii++ ) {
+    const struct LatLon *aa = &g_array_index ( job->points, struct LatLon, ii );
+    const struct LatLon *bb = (ii+1 < job->points->len) ? &g_array_index ( job->points, struct LatLon, ii+1 ) : aa;
+    struct LatLon deg, metres;
+    if ( !seed_tile_size ( map, zoom, aa, &deg, &metres ) )
+      continue;
+    // The tile size changes with latitude, so only start afresh when that makes a difference
+    seed_corridor_heights ( segment_heights, job->corridor, &metres );
+    if ( segment_heights->len != heights->len ||
+         memcmp ( segment_heights->data, heights->data, heights->len * sizeof(gint) ) ) {
+      GArray *tmp = heights;
+      heights = segment_heights;
+      segment_heights = tmp;
+      previous = FALSE;
+    }
+
+    gint steps = (gint)ceil ( MAX ( fabs(bb->lat - aa->lat) / deg.lat, fabs(bb->lon - aa->lon) / deg.lon ) * 2 );
+    for ( gint ss = 0; ss <= steps; ss++ ) {
+      gdouble ff = steps ? (gdouble)ss / steps : 0.0;
+      struct LatLon ll = { aa->lat + ff * (bb->lat - aa->lat), aa->lon + ff * (bb->lon - aa->lon) };
+      VikCoord vc;
+      MapCoord mc;
+      vik_coord_load_from_latlon ( &vc, VIK_COORD_LATLON, &ll );
+      if ( !vik_map_source_coord_to_mapcoord ( map, &vc, zoom, zoom, &mc ) )
+        continue;
+      if ( previous && mc.x == px && mc.y == py )
+        continue;
+      if ( !tiles->len )
+        *first = mc;
+      seed_corridor_add ( tiles, heights, mc.x, mc.y, previous, px, py );
+      previous = TRUE;
+      px = mc.x;
+      py = mc.y;
+    }
+  }
+  g_array_free ( heights, TRUE );
+  g_array_free ( segment_heights, TRUE );
+
+  if ( !tiles->len ) {
+    g_array_free ( tiles, TRUE );
+    return NULL;
+  }
+
+  // Remove duplicates from where the line comes back on itself
+  g_array_sort ( tiles, seed_tile_compare );
+  guint kept = 1;
+  for ( guint ii = 1; ii < tiles->len; ii++ )
+    if ( seed_tile_compare ( &g_array_index(tiles, SeedTile, ii), &g_array_index(tiles, SeedTile, kept-1) ) )
+      g_array_index ( tiles, SeedTile, kept++ ) = g_array_index ( tiles, SeedTile, ii );
+  g_array_set_size ( tiles, kept );
+  return tiles;
+}
+
+/**
+ * Get the range of tiles covering the bounds of a polygon area at the zoom level
+ */
+static gboolean seed_tile_range ( SeedJob *job, VikMapSource *map, gdouble zoom, MapCoord *ulm, MapCoord *brm )
+{
+  struct LatLon min = { 90.0, 180.0 };
+  struct LatLon max = { -90.0, -180.0 };
+  for ( guint ii = 0; ii < job->points->len; ii++ ) {
+    struct LatLon *ll = &g_array_index ( job->points, struct LatLon, ii );
+    min.lat = MIN ( min.lat, ll->lat );
+    min.lon = MIN ( min.lon, ll->lon );
+    max.lat = MAX ( max.lat, ll->lat );
+    max.lon = MAX ( max.lon, ll->lon );
+  }
+  struct LatLon ll_ul = { max.lat, min.lon };
+  struct LatLon ll_br = { min.lat, max.lon };
+  VikCoord ul, br;
+  vik_coord_load_from_latlon ( &ul, VIK_COORD_LATLON, &ll_ul );
+  vik_coord_load_from_latlon ( &br, VIK_COORD_LATLON, &ll_br );
+  return vik_map_source_coord_to_mapcoord ( map, &ul, zoom, zoom, ulm ) &&
+         vik_map_source_coord_to_mapcoord ( map, &br, zoom, zoom, brm );
+}
+
+static gboolean seed_zoom_setup ( SeedJob *job, VikMapSource *map )
+{
+  MapDownloadInfo *mdi = job->mdi;
+  MapCoord ulm, brm;
+
+  if ( job->tiles ) {
+    g_array_free ( job->tiles, TRUE );
+    job->tiles = NULL;
+  }
+  if ( job->area == VIK_MAPS_SEED_CORRIDOR ) {
+    job->tiles = seed_corridor_tiles ( job, map, job->zoom, &ulm );
+    if ( !job->tiles )
+      return FALSE;
+    // Only the scale and zone of the range are used
+    brm = ulm;
+    ulm.x = g_array_index ( job->tiles, SeedTile, 0 ).x;
+    brm.x = g_array_index ( job->tiles, SeedTile, job->tiles->len-1 ).x;
+    ulm.y = brm.y = g_array_index ( job->tiles, SeedTile, 0 ).y;
+    for ( guint ii = 0; ii < job->tiles->len; ii++ ) {
+      ulm.y = MIN ( ulm.y, g_array_index ( job->tiles, SeedTile, ii ).y );
+      brm.y = MAX ( brm.y, g_array_index ( job->tiles, SeedTile, ii ).y );
+    }
+  }
+  else if ( !seed_tile_range ( job, map, job->zoom, &ulm, &brm ) )
+    return FALSE;
+
+  mdi->mapcoord = ulm;
+  mdi->xzoom = mdi->yzoom = job->zoom;
+  mdi->x0 = MIN(ulm.x, brm.x);
+  mdi->xf = MAX(ulm.x, brm.x);
+  mdi->y0 = MIN(ulm.y, brm.y);
+  mdi->yf = MAX(ulm.y, brm.y);
+
+  if ( job->resume_pos ) {
+    job->resume_pos = FALSE;
+    job->x = CLAMP ( job->x, mdi->x0, mdi->xf+1 );
+    job->y = CLAMP ( job->y, mdi->y0, mdi->yf+1 );
+  }
+  else {
+    job->x = mdi->x0;
+    job->y = mdi->y0;
+  }
+  if ( job->tiles ) {
+    // Carry on from the first tile not before the position
+    SeedTile pos = { job->x, job->y };
+    job->tile_idx = 0;
+    while ( job->tile_idx < job->tiles->len &&
+            seed_tile_compare ( &g_array_index(job->tiles, SeedTile, job->tile_idx), &pos ) < 0 )
+      job->tile_idx++;
+  }
+  job->zoom_ready = TRUE;
+  return TRUE;
+}
 
-        g_mutex_lock(mdi->mutex);
-        if (remove_mem_cache)
-            a_mapcache_remove_all_shrinkfactors ( x, y, mdi->mapcoord.z, vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(mdi->maptype)), mdi->mapcoord.scale, mdi->vml->filename );
-        if (mdi->refresh_display && mdi->map_layer_alive) {
-          /* TODO: check if it's on visible area */
-          if ( need_download ) {
-            vik_layer_emit_update ( VIK_LAYER(mdi->vml) ); // NB update display from background
-          }
-        }
-        g_mutex_unlock(mdi->mutex);
-        mdi->mapcoord.x = mdi->mapcoord.y = 0; /* we're temporarily between downloads */
+/**
+ * Upper bound of the tiles to be considered from the current zoom level onwards
+ */
+static guint seed_estimate ( SeedJob *job, VikMapSource *map )
+{
+  guint64 count = 0;
+  for ( gdouble zoom = job->zoom; zoom >= job->zoom_min * 0.999; zoom /= 2 ) {
+    MapCoord ulm, brm;
+    if ( job->area == VIK_MAPS_SEED_CORRIDOR ) {
+      GArray *tiles = seed_corridor_tiles ( job, map, zoom, &ulm );
+      if ( tiles ) {
+        count += tiles->len;
+        g_array_free ( tiles, TRUE );
       }
     }
+    else if ( seed_tile_range ( job, map, zoom, &ulm, &brm ) )
+      count += (guint64)(ABS(brm.x - ulm.x) + 1) * (ABS(brm.y - ulm.y) + 1);
   }
-  vik_map_source_download_handle_cleanup(MAPS_LAYER_NTH_TYPE(mdi->maptype), handle);
-  g_mutex_lock(mdi->mutex);
-  if (mdi->map_layer_alive)
-    g_object_weak_unref(G_OBJECT(mdi->vml), weak_ref_cb, mdi);
-  g_mutex_unlock(mdi->mutex); 
-  return 0;
+  return MIN ( count, G_MAXINT );
 }
 
-static void mdi_cancel_cleanup ( MapDownloadInfo *mdi )
+/**
+ * Lazily enumerate the tiles of the area, most detailed first
+ * Returns 1 with the next tile, 0 when there are no more, or -1 when cancelled
+ */
+static gint seed_next_tile ( SeedJob *job, VikMapSource *map, gpointer threaddata, gint *x, gint *y )
 {
-  if ( mdi->mapcoord.x || mdi->mapcoord.y )
-  {
-    get_filename ( mdi->cache_dir, mdi->cache_layout,
-                   vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(mdi->maptype)),
-                   vik_map_source_get_name(MAPS_LAYER_NTH_TYPE(mdi->maptype)),
-                   mdi->mapcoord.scale, mdi->mapcoord.z, mdi->mapcoord.x, mdi->mapcoord.y, mdi->filename_buf, mdi->maxlen,
-                   vik_map_source_get_file_extension(MAPS_LAYER_NTH_TYPE(mdi->maptype)) );
-    if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == TRUE)
-    {
-      if ( g_remove ( mdi->filename_buf ) )
-        g_warning ( "Cleanup failed to remove: %s", mdi->filename_buf );
+  MapDownloadInfo *mdi = job->mdi;
+  while ( job->zoom >= job->zoom_min * 0.999 ) {
+    if ( !job->zoom_ready && !seed_zoom_setup ( job, map ) ) {
+      job->zoom /= 2;
+      continue;
+    }
+    while ( job->tiles && job->tile_idx < job->tiles->len ) {
+      SeedTile *tile = &g_array_index ( job->tiles, SeedTile, job->tile_idx++ );
+      // Record where to carry on from
+      if ( job->tile_idx < job->tiles->len ) {
+        job->x = g_array_index ( job->tiles, SeedTile, job->tile_idx ).x;
+        job->y = g_array_index ( job->tiles, SeedTile, job->tile_idx ).y;
+      }
+      else {
+        job->x = mdi->xf + 1;
+        job->y = mdi->y0;
+      }
+      if ( ++job->considered % SEED_PROGRESS_STEP == 0 ) {
+        gdouble fraction = job->estimate ? (gdouble)job->considered / job->estimate : 0.0;
+        if ( a_background_thread_progress ( threaddata, fraction ) != 0 )
+          return -1;
+      }
+      MapCoord mc = mdi->mapcoord;
+      mc.x = tile->x;
+      mc.y = tile->y;
+      if ( is_in_area ( map, mc ) ) {
+        *x = tile->x;
+        *y = tile->y;
+        return 1;
+      }
+    }
+    while ( !job->tiles && job->x <= mdi->xf ) {
+      if ( job->y > mdi->yf ) {
+        job->x++;
+        job->y = mdi->y0;
+        continue;
+      }
+      gint tx = job->x;
+      gint ty = job->y++;
+      if ( ++job->considered % SEED_PROGRESS_STEP == 0 ) {
+        gdouble fraction = job->estimate ? (gdouble)job->considered / job->estimate : 0.0;
+        if ( a_background_thread_progress ( threaddata, fraction ) != 0 )
+          return -1;
+      }
+      if ( seed_tile_wanted ( job, map, tx, ty ) ) {
+        *x = tx;
+        *y = ty;
+        return 1;
+      }
     }
+    job->zoom /= 2;
+    job->zoom_ready = FALSE;
   }
-
-  requests_clear ( mdi->maptype );
+  return 0;
 }
 
-static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload )
+/**
+ * Wait until the bulk download rate allows another tile from this map source
+ * The rate is shared by all jobs using the same map source
+ */
+static void seed_throttle ( VikMapSource *map )
 {
-  gdouble xzoom = vml->xmapzoom ? vml->xmapzoom : vik_viewport_get_xmpp ( vvp );
-  gdouble yzoom = vml->ymapzoom ? vml->ymapzoom : vik_viewport_get_ympp ( vvp );
-  MapCoord ulm, brm;
-  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
-
-  // Don't ever attempt download on direct access
-  if ( vik_map_source_is_direct_file_access ( map ) )
+  gdouble rate = SEED_RATE;
+  if ( VIK_IS_MAP_SOURCE_DEFAULT(map) ) {
+    gdouble source_rate = vik_map_source_default_get_download_rate ( VIK_MAP_SOURCE_DEFAULT(map) );
+    if ( source_rate > 0.0 )
+      rate = source_rate;
+  }
+  if ( rate <= 0.0 )
     return;
 
-  if ( vik_map_source_coord_to_mapcoord ( map, ul, xzoom, yzoom, &ulm ) 
-    && vik_map_source_coord_to_mapcoord ( map, br, xzoom, yzoom, &brm ) )
-  {
-    MapDownloadInfo *mdi = g_malloc ( sizeof(MapDownloadInfo) );
-    gint a, b;
-
-    mdi->vml = vml;
-    mdi->vvp = vvp;
-    mdi->map_layer_alive = TRUE;
-    mdi->mutex = vik_mutex_new();
-    mdi->refresh_display = TRUE;
+  gint64 interval = (gint64)(G_USEC_PER_SEC / rate);
+  gpointer key = GUINT_TO_POINTER ( vik_map_source_get_uniq_id(map) );
 
-    /* cache_dir and buffer for dest filename */
-    mdi->cache_dir = g_strdup ( vml->cache_dir );
-    mdi->maxlen = strlen ( vml->cache_dir ) + 40;
-    mdi->filename_buf = g_malloc ( mdi->maxlen * sizeof(gchar) );
-    mdi->cache_layout = vml->cache_layout;
-    mdi->maptype = vml->maptype;
+  g_mutex_lock ( rq_mutex );
+  gint64 now = g_get_monotonic_time ();
+  gint64 *next = g_hash_table_lookup ( seed_slots, key );
+  if ( !next ) {
+    next = g_new ( gint64, 1 );
+    *next = now;
+    g_hash_table_insert ( seed_slots, key, next );
+  }
+  gint64 slot = MAX ( *next, now );
+  *next = slot + interval;
+  g_mutex_unlock ( rq_mutex );
 
-    mdi->mapcoord = ulm;
-    mdi->redownload = redownload;
+  if ( slot > now )
+    g_usleep ( slot - now );
+}
 
-    mdi->x0 = MIN(ulm.x, brm.x);
-    mdi->xf = MAX(ulm.x, brm.x);
-    mdi->y0 = MIN(ulm.y, brm.y);
-    mdi->yf = MAX(ulm.y, brm.y);
+static gboolean seed_tile_done ( DownloadResult_t dr, gpointer user_data )
+{
+  SeedTileRequest *str = (SeedTileRequest*)user_data;
+  gboolean carry_on = ( a_background_testcancel ( str->threaddata ) == 0 );
+  if ( dr == DOWNLOAD_SUCCESS )
+    str->job->downloaded++;
+  if ( carry_on )
+    map_tile_finished ( str->job->mdi, str->x, str->y, dr, FALSE, 0 );
+  else
+    mark_request_complete ( str->job->mdi, str->x, str->y );
+  g_free ( str );
+  return carry_on;
+}
 
-    mdi->mapstoget = 0;
+static int seed_thread ( SeedJob *job, gpointer threaddata )
+{
+  MapDownloadInfo *mdi = job->mdi;
+  VikMapSource *map = MAPS_LAYER_NTH_TYPE(mdi->maptype);
+  void *handle = vik_map_source_download_handle_init ( map );
+  void *batch = DOWNLOAD_BATCH_SIZE > 1 ? a_download_batch_new () : NULL;
+  guint since_checkpoint = 0;
+  gboolean layer_gone = FALSE;
+  gint x, y;
+  gint res;
+
+  while ( (res = seed_next_tile ( job, map, threaddata, &x, &y )) > 0 ) {
+    g_mutex_lock ( mdi->mutex );
+    layer_gone = !mdi->map_layer_alive;
+    g_mutex_unlock ( mdi->mutex );
+    if ( layer_gone ) {
+      res = -1;
+      break;
+    }
 
-    MapCoord mcoord = mdi->mapcoord;
+    get_filename ( mdi->cache_dir, mdi->cache_layout,
+                   vik_map_source_get_uniq_id(map),
+                   vik_map_source_get_name(map),
+                   mdi->mapcoord.scale, mdi->mapcoord.z, x, y, mdi->filename_buf, mdi->maxlen,
+                   vik_map_source_get_file_extension(map) );
+    if ( tile_is_stored ( mdi->tile_db, mdi->filename_buf, mdi->mapcoord.scale, x, y, NULL ) )
+      continue;
+
+    // Don't download a tile that something else is already getting
+    gchar *request = create_request_string ( mdi, x, y );
+    g_mutex_lock ( rq_mutex );
+    gboolean needed = !g_hash_table_lookup_extended ( requests, request, NULL, NULL );
+    if ( needed )
+      g_hash_table_insert ( requests, request, job );
+    g_mutex_unlock ( rq_mutex );
+    if ( !needed ) {
+      g_free ( request );
+      continue;
+    }
 
-    // Always calculate how many we need
-    for ( a = mdi->x0; a <= mdi->xf; a++ ) {
-      mcoord.x = a;
-      for ( b = mdi->y0; b <= mdi->yf; b++ ) {
-        mcoord.y = b;
-        // Only count tiles from supported areas
-        if ( is_in_area (map, mcoord) ) {
-          gchar *request = create_request_string ( mdi, a, b );
-          // Only count it if not an outstanding request
-          if ( !g_hash_table_lookup_extended(requests, request, NULL, NULL ) ) {
-            if ( mdi->redownload )
-              // Note this count is quite simplistic,
-              //  we still might not attempt to get a newer version of existing tiles
-              //  such as due to file timestamps/tile age parameter, use-etag properties and so on
-              //  these details are currently in the map/download functions
-              mdi->mapstoget++;
-            else {
-              // Otherwise only if file is missing
-              get_filename ( mdi->cache_dir, mdi->cache_layout,
-                             vik_map_source_get_uniq_id(map),
-                             vik_map_source_get_name(map),
-                             ulm.scale, ulm.z, a, b, mdi->filename_buf, mdi->maxlen,
-                             vik_map_source_get_file_extension(map) );
-              if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE ) {
-                mdi->mapstoget++;
-              }
-            }
-          }
-          g_free ( request );
+    seed_throttle ( map );
+
+    SeedTileRequest *str = g_malloc ( sizeof(SeedTileRequest) );
+    str->job = job;
+    str->threaddata = threaddata;
+    str->x = x;
+    str->y = y;
+    MapCoord mc = mdi->mapcoord;
+    mc.x = x;
+    mc.y = y;
+    if ( batch ) {
+      if ( vik_map_source_download_batch_add ( map, &mc, mdi->filename_buf, batch, seed_tile_done, str ) ) {
+        if ( a_download_batch_run ( batch, DOWNLOAD_BATCH_SIZE - 1 ) ) {
+          res = -1;
+          break;
         }
       }
+      else {
+        // Map source can't use a batch, so use a normal download from now on
+        a_download_batch_free ( batch );
+        batch = NULL;
+      }
+    }
+    if ( !batch ) {
+      DownloadResult_t dr = vik_map_source_download ( map, &mc, mdi->filename_buf, handle );
+      if ( !seed_tile_done ( dr, str ) ) {
+        res = -1;
+        break;
+      }
     }
 
-    mdi->mapcoord.x = mdi->mapcoord.y = 0; /* for cleanup -- no current map */
-
-    if ( mdi->mapstoget )
-    {
-      const gchar *tmp_str;
-      gchar *tmp;
-
-      if (redownload) 
-      {
-        if (redownload == REDOWNLOAD_BAD)
-          tmp_str = ngettext("Redownloading up to %d %s map...", "Redownloading up to %d %s maps...", mdi->mapstoget);
-        else
-          tmp_str = ngettext("Redownloading %d %s map...", "Redownloading %d %s maps...", mdi->mapstoget);
-      } 
-      else 
-      {
-        tmp_str = ngettext("Downloading %d %s map...", "Downloading %d %s maps...", mdi->mapstoget);
+    if ( ++since_checkpoint >= SEED_CHECKPOINT ) {
+      // Only record progress once everything before it has been downloaded
+      if ( batch && a_download_batch_run ( batch, 0 ) ) {
+        res = -1;
+        break;
       }
-      tmp = g_strdup_printf ( tmp_str, mdi->mapstoget, MAPS_LAYER_NTH_LABEL(vml->maptype));
- 
-      g_object_weak_ref(G_OBJECT(mdi->vml), weak_ref_cb, mdi);
-      /* launch the thread */
-      a_background_thread ( BACKGROUND_POOL_REMOTE,
-                            VIK_GTK_WINDOW_FROM_LAYER(vml), /* parent window */
-                            tmp,                                              /* description string */
-                            (vik_thr_func) map_download_thread,               /* function to call within thread */
-                            mdi,                                              /* pass along data */
-                            (vik_thr_free_func) mdi_free,                     /* function to free pass along data */
-                            (vik_thr_free_func) mdi_cancel_cleanup,
-                            mdi->mapstoget );
-      g_free ( tmp );
+      (void)seed_job_save ( job );
+      since_checkpoint = 0;
     }
-    else
-      mdi_free ( mdi );
   }
-}
 
-static void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, VikCoord *ul, VikCoord *br, gdouble zoom, gint download_method )
-{
-  MapCoord ulm, brm;
-  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
-
-  // Don't ever attempt download on direct access
-  if ( vik_map_source_is_direct_file_access ( map ) )
-    return;
-
-  if (!vik_map_source_coord_to_mapcoord(map, ul, zoom, zoom, &ulm) 
-    || !vik_map_source_coord_to_mapcoord(map, br, zoom, zoom, &brm)) {
-    g_warning("%s() coord_to_mapcoord() failed", __PRETTY_FUNCTION__);
-    return;
+  if ( res == 0 && batch && a_download_batch_run ( batch, 0 ) )
+    res = -1;
+  a_download_batch_free ( batch );
+  vik_map_source_download_handle_cleanup ( map, handle );
+
+  if ( res < 0 ) {
+    // Keep the job for next time if Viking is stopping or the map layer has gone,
+    //  otherwise it has been deliberately cancelled
+    if ( !layer_gone && a_background_testcancel ( NULL ) == 0 )
+      if ( g_remove ( job->job_file ) )
+        g_warning ( "%s: Failed to remove: %s", __FUNCTION__, job->job_file );
+    return -1;
   }
 
-  MapDownloadInfo *mdi = g_malloc(sizeof(MapDownloadInfo));
-  gint i, j;
-
-  mdi->vml = vml;
-  mdi->vvp = vvp;
-  mdi->map_layer_alive = TRUE;
-  mdi->mutex = vik_mutex_new();
-  mdi->refresh_display = TRUE;
+  if ( g_remove ( job->job_file ) )
+    g_warning ( "%s: Failed to remove: %s", __FUNCTION__, job->job_file );
 
-  mdi->cache_dir = g_strdup ( vml->cache_dir );
-  mdi->maxlen = strlen ( vml->cache_dir ) + 40;
-  mdi->filename_buf = g_malloc ( mdi->maxlen * sizeof(gchar) );
-  mdi->maptype = vml->maptype;
-  mdi->cache_layout = vml->cache_layout;
+  g_mutex_lock ( mdi->mutex );
+  if ( mdi->map_layer_alive ) {
+    gchar *msg = g_strdup_printf ( ngettext("%s: Pre-seeding complete, %d tile downloaded", "%s: Pre-seeding complete, %d tiles downloaded", job->downloaded),
+                                   vik_maps_layer_get_map_label (mdi->vml), job->downloaded );
+    vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(mdi->vml), msg, VIK_STATUSBAR_INFO );
+    g_free ( msg );
+  }
+  g_mutex_unlock ( mdi->mutex );
+  return 0;
+}
 
-  mdi->mapcoord = ulm;
-  mdi->redownload = download_method;
+static void seed_job_start ( SeedJob *job )
+{
+  VikMapsLayer *vml = job->mdi->vml;
+  VikMapSource *map = MAPS_LAYER_NTH_TYPE(job->mdi->maptype);
 
-  mdi->x0 = MIN(ulm.x, brm.x);
-  mdi->xf = MAX(ulm.x, brm.x);
-  mdi->y0 = MIN(ulm.y, brm.y);
-  mdi->yf = MAX(ulm.y, brm.y);
+  g_mutex_lock ( rq_mutex );
+  g_hash_table_add ( seed_running, g_strdup ( job->job_file ) );
+  g_mutex_unlock ( rq_mutex );
+  job->registered = TRUE;
+
+  g_object_weak_ref ( G_OBJECT(vml), weak_ref_cb, job->mdi );
+
+  job->estimate = seed_estimate ( job, map );
+  gchar *tmp = g_strdup_printf ( _("Pre-seeding %s maps..."), MAPS_LAYER_NTH_LABEL(job->mdi->maptype) );
+  a_background_thread_with_priority ( BACKGROUND_POOL_REMOTE,
+                        BACKGROUND_PRIORITY_BULK,
+                        VIK_GTK_WINDOW_FROM_LAYER(vml), /* parent window */
+                        tmp,                             /* description string */
+                        (vik_thr_func) seed_thread,      /* function to call within thread */
+                        job,                             /* pass along data */
+                        (vik_thr_free_func) seed_job_free, /* function to free pass along data */
+                        NULL,
+                        job->estimate / SEED_PROGRESS_STEP + 1 );
+  g_free ( tmp );
+}
 
-  mdi->mapstoget = 0;
+/**
+ * Continue any pre-seed jobs for this map left unfinished by a previous run
+ */
+static void seed_resume ( VikMapsLayer *vml )
+{
+  if ( vik_map_source_is_direct_file_access ( MAPS_LAYER_NTH_TYPE(vml->maptype) ) )
+    return;
 
-  MapCoord mcoord = mdi->mapcoord;
+  GDir *dir = g_dir_open ( vml->cache_dir, 0, NULL );
+  if ( !dir )
+    return;
 
-  for (i = mdi->x0; i <= mdi->xf; i++) {
-    mcoord.x = i;
-    for (j = mdi->y0; j <= mdi->yf; j++) {
-      mcoord.y = j;
-      // Only count tiles from supported areas
-      if ( is_in_area (map, mcoord) ) {
-        get_filename ( mdi->cache_dir, mdi->cache_layout,
-                       vik_map_source_get_uniq_id(map),
-                       vik_map_source_get_name(map),
-                       ulm.scale, ulm.z, i, j, mdi->filename_buf, mdi->maxlen,
-                       vik_map_source_get_file_extension(map) );
-        if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE )
-              mdi->mapstoget++;
-      }
+  gchar *prefix = g_strdup_printf ( "seed-%d-", MAPS_LAYER_NTH_ID(vml->maptype) );
+  const gchar *name;
+  while ( (name = g_dir_read_name ( dir )) ) {
+    if ( !g_str_has_prefix ( name, prefix ) || !g_str_has_suffix ( name, SEED_FILE_EXTENSION ) )
+      continue;
+    gchar *job_file = g_strconcat ( vml->cache_dir, name, NULL );
+    g_mutex_lock ( rq_mutex );
+    gboolean running = g_hash_table_contains ( seed_running, job_file );
+    g_mutex_unlock ( rq_mutex );
+    if ( !running ) {
+      SeedJob *job = seed_job_load ( vml, job_file );
+      if ( job )
+        seed_job_start ( job );
     }
+    g_free ( job_file );
   }
+  g_free ( prefix );
+  g_dir_close ( dir );
+}
 
-  mdi->mapcoord.x = mdi->mapcoord.y = 0; /* for cleanup -- no current map */
-
-  if (mdi->mapstoget) {
-    gchar *tmp;
-    const gchar *fmt;
-    fmt = ngettext("Downloading %d %s map...",
-                   "Downloading %d %s maps...",
-		   mdi->mapstoget);
-    tmp = g_strdup_printf ( fmt, mdi->mapstoget, MAPS_LAYER_NTH_LABEL(vml->maptype) );
-
-    g_object_weak_ref(G_OBJECT(mdi->vml), weak_ref_cb, mdi);
+/**
+ * vik_maps_layer_seed:
+ * @vml:      The Map Layer
+ * @points:   The positions (struct LatLon) defining the area
+ * @area:     How the positions define the area
+ * @corridor: The distance in metres either side of the line for %VIK_MAPS_SEED_CORRIDOR
+ * @zoom_min: The most detailed zoom level to download (metres per pixel)
+ * @zoom_max: The least detailed zoom level to download
+ *
+ * Download all missing tiles of an area over a range of zoom levels,
+ *  for use when offline.
+ * The job state is kept in the cache directory,
+ *  so it continues the next time the map is used if it is not finished beforehand.
+ */
+void vik_maps_layer_seed ( VikMapsLayer *vml, GArray *points, VikMapsSeedArea area, gdouble corridor, gdouble zoom_min, gdouble zoom_max )
+{
+  // Don't ever attempt download on direct access
+  if ( vik_map_source_is_direct_file_access ( MAPS_LAYER_NTH_TYPE(vml->maptype) ) )
+    return;
+  if ( !points->len || zoom_min <= 0.0 || zoom_max <= 0.0 )
+    return;
 
-    // launch the thread
-    a_background_thread ( BACKGROUND_POOL_REMOTE,
-                          VIK_GTK_WINDOW_FROM_LAYER(vml), /* parent window */
-                          tmp,                                /* description string */
-                          (vik_thr_func) map_download_thread, /* function to call within thread */
-                          mdi,                                /* pass along data */
-                          (vik_thr_free_func) mdi_free,       /* function to free pass along data */
-                          (vik_thr_free_func) mdi_cancel_cleanup,
-                          mdi->mapstoget );
-    g_free ( tmp );
+  SeedJob *job = seed_job_new ( vml );
+  job->job_file = g_strdup_printf ( "%sseed-%d-%" G_GINT64_FORMAT SEED_FILE_EXTENSION,
+                                    vml->cache_dir, MAPS_LAYER_NTH_ID(vml->maptype), g_get_real_time() );
+  job->area = area;
+  job->corridor = MAX ( corridor, 0.0 );
+  job->zoom_min = MIN ( zoom_min, zoom_max );
+  job->zoom_max = MAX ( zoom_min, zoom_max );
+  job->zoom = job->zoom_max;
+  g_array_append_vals ( job->points, points->data, points->len );
+
+  if ( g_mkdir_with_parents ( vml->cache_dir, 0777 ) != 0 || !seed_job_save ( job ) ) {
+    gchar *msg = g_strdup_printf ( _("%s: Unable to save pre-seed job"), vik_maps_layer_get_map_label (vml) );
+    vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml), msg, VIK_STATUSBAR_INFO );
+    g_free ( msg );
+    seed_job_free ( job );
+    return;
   }
-  else
-    mdi_free ( mdi );
+  seed_job_start ( job );
 }
 
 /**
@@ -2046,17 +4089,17 @@ void vik_maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, VikC
 
 static void maps_layer_redownload_bad ( VikMapsLayer *vml )
 {
-  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_BAD );
+  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_BAD, FALSE );
 }
 
 static void maps_layer_redownload_all ( VikMapsLayer *vml )
 {
-  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_ALL );
+  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_ALL, FALSE );
 }
 
 static void maps_layer_redownload_new ( VikMapsLayer *vml )
 {
-  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_NEW );
+  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_NEW, FALSE );
 }
 
 /**
@@ -2084,7 +4127,12 @@ static void maps_layer_tile_info ( VikMapsLayer *vml )
       gchar *exists = NULL;
       gint zoom = 17 - ulm.scale;
       if ( vml->mbtiles ) {
-        GdkPixbuf *pixbuf = get_pixbuf_sql_exec ( vml->mbtiles, ulm.x, ulm.y, zoom );
+        GdkPixbuf *pixbuf = NULL;
+        GBytes *bytes = a_mbtiles_cache_get ( vml->mbtiles, zoom, ulm.x, ulm.y );
+        if ( bytes ) {
+          pixbuf = pixbuf_new_from_bytes ( map, &ulm, ulm.x, ulm.y, bytes, 1, NULL );
+          g_bytes_unref ( bytes );
+        }
         if ( pixbuf ) {
           exists = g_strdup ( _("YES") );
           g_object_unref ( G_OBJECT(pixbuf) );
@@ -2139,7 +4187,18 @@ static void maps_layer_tile_info ( VikMapsLayer *vml )
   gchar *filemsg = NULL;
   gchar *timemsg = NULL;
 
-  if ( g_file_test ( filename, G_FILE_TEST_EXISTS ) ) {
+  if ( vml->tile_db ) {
+    // Individual tiles in the cache file have no timestamp
+    gint zoom = 17 - ulm.scale;
+    if ( tile_is_stored ( vml->tile_db, NULL, ulm.scale, ulm.x, ulm.y, NULL ) )
+      filemsg = g_strdup_printf ( _("Tile File: %s (%d%s%d%s%d)"), a_mbtiles_cache_get_filename(vml->tile_db),
+                                  zoom, G_DIR_SEPARATOR_S, ulm.x, G_DIR_SEPARATOR_S, ulm.y );
+    else
+      filemsg = g_strdup_printf ( _("Tile File: %s (%d%s%d%s%d) [Not Available]"), a_mbtiles_cache_get_filename(vml->tile_db),
+                                  zoom, G_DIR_SEPARATOR_S, ulm.x, G_DIR_SEPARATOR_S, ulm.y );
+    g_array_append_val ( array, filemsg );
+  }
+  else if ( g_file_test ( filename, G_FILE_TEST_EXISTS ) ) {
     filemsg = g_strconcat ( "Tile File: ", filename, NULL );
     // Get some timestamp information of the tile
     GStatBuf stat_buf;
@@ -2159,9 +4218,31 @@ static void maps_layer_tile_info ( VikMapsLayer *vml )
     g_array_append_val ( array, filemsg );
   }
 
-  a_dialog_list (  VIK_GTK_WINDOW_FROM_LAYER(vml), _("Tile Information"), array, 5 );
+  // Memory cache usage
+  mapcache_stats_t stats;
+  a_mapcache_get_stats_layer ( vml, &stats );
+  gchar *stats_str = a_mapcache_stats_to_string ( &stats );
+  gchar *layermsg = g_strdup_printf ( _("Memory Cache (this layer): %s"), stats_str );
+  g_free ( stats_str );
+  g_array_append_val ( array, layermsg );
+
+  a_mapcache_get_stats_type ( vik_map_source_get_uniq_id(map), &stats );
+  stats_str = a_mapcache_stats_to_string ( &stats );
+  gchar *typemsg = g_strdup_printf ( _("Memory Cache (this map type): %s"), stats_str );
+  g_free ( stats_str );
+  g_array_append_val ( array, typemsg );
+
+  stats_str = a_diskcache_area_usage_string ( vml->disk_area );
+  gchar *diskmsg = g_strdup_printf ( _("Disk Cache (this map): %s"), stats_str );
+  g_free ( stats_str );
+  g_array_append_val ( array, diskmsg );
+
+  a_dialog_list (  VIK_GTK_WINDOW_FROM_LAYER(vml), _("Tile Information"), array, 6 );
   g_array_free ( array, TRUE );
 
+  g_free ( diskmsg );
+  g_free ( typemsg );
+  g_free ( layermsg );
   g_free ( timemsg );
   g_free ( filemsg );
   g_free ( source );
@@ -2179,7 +4260,7 @@ static VikLayerToolFuncStatus maps_layer_download_release ( VikMapsLayer *vml, G
       VikCoord ul, br;
       vik_viewport_screen_to_coord ( vvp, MAX(0, MIN(event->x, vml->dl_tool_x)), MAX(0, MIN(event->y, vml->dl_tool_y)), &ul );
       vik_viewport_screen_to_coord ( vvp, MIN(vik_viewport_get_width(vvp), MAX(event->x, vml->dl_tool_x)), MIN(vik_viewport_get_height(vvp), MAX ( event->y, vml->dl_tool_y ) ), &br );
-      start_download_thread ( vml, vvp, &ul, &br, DOWNLOAD_OR_REFRESH );
+      start_download_thread ( vml, vvp, &ul, &br, DOWNLOAD_OR_REFRESH, FALSE );
       vml->dl_tool_x = vml->dl_tool_y = -1;
       return VIK_LAYER_TOOL_ACK;
     }
@@ -2270,7 +4351,7 @@ static void download_onscreen_maps ( menu_array_values values, gint redownload )
   if ( vik_map_source_get_drawmode(map) == vp_drawmode &&
        vik_map_source_coord_to_mapcoord ( map, &ul, xzoom, yzoom, &ulm ) &&
        vik_map_source_coord_to_mapcoord ( map, &br, xzoom, yzoom, &brm ) )
-    start_download_thread ( vml, vvp, &ul, &br, redownload );
+    start_download_thread ( vml, vvp, &ul, &br, redownload, FALSE );
   else if (vik_map_source_get_drawmode(map) != vp_drawmode) {
     const gchar *drawmode_name = vik_viewport_get_drawmode_name (vvp, vik_map_source_get_drawmode(map));
     gchar *err = g_strdup_printf(_("Wrong drawmode for this map.\nSelect \"%s\" from View menu and try again."), _(drawmode_name));
@@ -2347,12 +4428,18 @@ static gint maps_layer_how_many_maps ( VikMapsLayer *vml, VikViewport *vvp, VikC
   mdi->map_layer_alive = TRUE;
   mdi->mutex = vik_mutex_new();
   mdi->refresh_display = FALSE;
+  mdi->follow_display = FALSE;
+  mdi->xzoom = mdi->yzoom = zoom;
+  mdi->focus_generation = 0;
+  mdi->unchanged = 0;
+  mdi->bytes_saved = 0;
 
   mdi->cache_dir = g_strdup ( vml->cache_dir );
   mdi->maxlen = strlen ( vml->cache_dir ) + 40;
   mdi->filename_buf = g_malloc ( mdi->maxlen * sizeof(gchar) );
   mdi->maptype = vml->maptype;
   mdi->cache_layout = vml->cache_layout;
+  mdi->tile_db = vml->tile_db ? a_mbtiles_cache_ref ( vml->tile_db ) : NULL;
 
   mdi->mapcoord = ulm;
   mdi->redownload = redownload;
@@ -2387,14 +4474,19 @@ static gint maps_layer_how_many_maps ( VikMapsLayer *vml, VikViewport *vvp, VikC
             mdi->mapstoget++;
           }
           else {
-            if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE ) {
+            if ( !tile_is_stored ( mdi->tile_db, mdi->filename_buf, ulm.scale, i, j, NULL ) ) {
               // Missing
               mdi->mapstoget++;
             }
             else {
               if ( mdi->redownload == REDOWNLOAD_BAD ) {
                 /* see if this one is bad or what */
-                GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file ( mdi->filename_buf, NULL );
+                GdkPixbuf *pixbuf = NULL;
+                GBytes *bytes = tile_stored_get ( mdi->tile_db, mdi->filename_buf, ulm.scale, i, j );
+                if ( bytes ) {
+                  pixbuf = pixbuf_new_from_bytes ( map, &ulm, i, j, bytes, 1, NULL );
+                  g_bytes_unref ( bytes );
+                }
                 if ( !pixbuf ) {
                   mdi->mapstoget++;
                 } else {
@@ -2600,6 +4692,9 @@ static void maps_layer_flush ( menu_array_values values )
 {
   VikMapsLayer *vml = VIK_MAPS_LAYER(values[MA_VML]);
   a_mapcache_flush_type ( vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(vml->maptype)) );
+  decode_missing_clear ( vml );
+  // Also see tiles changed by other programs
+  a_existcache_flush ();
 }
 
 static void maps_layer_add_menu_items ( VikMapsLayer *vml, GtkMenu *menu, VikLayersPanel *vlp )
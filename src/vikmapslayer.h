@@ -50,6 +50,7 @@ typedef struct _VikMapsLayer VikMapsLayer;
 typedef enum {
   VIK_MAPS_CACHE_LAYOUT_VIKING=0, // CacheDir/t<MapId>s<VikingZoom>z0/X/Y (NB no file extension) - Legacy default layout
   VIK_MAPS_CACHE_LAYOUT_OSM,      // CacheDir/<OptionalMapName>/OSMZoomLevel/X/Y.ext (Default ext=png)
+  VIK_MAPS_CACHE_LAYOUT_MBTILES,  // CacheDir/<MapName>.mbtiles (Only available with SQLite support)
   VIK_MAPS_CACHE_LAYOUT_NUM       // Last enum
 } VikMapsCacheLayout;
 
@@ -58,6 +59,11 @@ typedef enum {
 //  http://wiki.openstreetmap.org/wiki/TMS
 //  http://wiki.osgeo.org/wiki/Tile_Map_Service_Specification
 
+typedef enum {
+  VIK_MAPS_SEED_CORRIDOR=0, // Tiles within a distance of the line through the points
+  VIK_MAPS_SEED_POLYGON,    // Tiles inside the outline of the points
+} VikMapsSeedArea;
+
 void maps_layer_init ();
 void maps_layer_uninit ();
 void maps_layer_set_autodownload_default ( gboolean autodownload );
@@ -67,9 +73,13 @@ void maps_layer_register_map_source ( VikMapSource *map );
 void vik_maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, VikCoord *ul, VikCoord *br, gdouble zoom );
 guint vik_maps_layer_get_map_type(VikMapsLayer *vml);
 void vik_maps_layer_set_map_type(VikMapsLayer *vml, guint map_type);
+void vik_maps_layer_set_autodownload ( VikMapsLayer *vml, gboolean autodownload );
+guint vik_maps_layer_get_tiles_loading ( VikMapsLayer *vml );
+guint maps_layer_get_tiles_downloading ( void );
 gchar *vik_maps_layer_get_map_label(VikMapsLayer *vml);
 gchar *maps_layer_default_dir ();
 void vik_maps_layer_download ( VikMapsLayer *vml, VikViewport *vvp, gboolean only_new );
+void vik_maps_layer_seed ( VikMapsLayer *vml, GArray *points, VikMapsSeedArea area, gdouble corridor, gdouble zoom_min, gdouble zoom_max );
 
 G_END_DECLS
 
@@ -33,12 +33,14 @@
 #include "mapcoord.h"
 #include "download.h"
 #include "vikmapsource.h"
+#include "tiledecode.h"
 
 static void vik_map_source_init (VikMapSource *object);
 static void vik_map_source_finalize (GObject *object);
 static void vik_map_source_class_init (VikMapSourceClass *klass);
 
 static gboolean _supports_download_only_new (VikMapSource *object);
+static GdkPixbuf *_decode_tile (VikMapSource *object, GBytes *bytes, MapCoord *src, guint reduce, GError **error);
 
 G_DEFINE_ABSTRACT_TYPE (VikMapSource, vik_map_source, G_TYPE_OBJECT);
 
@@ -88,6 +90,11 @@ vik_map_source_class_init (VikMapSourceClass *klass)
 	klass->download = NULL;
 	klass->download_handle_init = NULL;
 	klass->download_handle_cleanup = NULL;
+	klass->download_batch_add = NULL;
+	klass->get_download_block_size = NULL;
+	klass->download_block = NULL;
+	klass->decode_tile = _decode_tile;
+	klass->get_hidpi = NULL;
 	
 	object_class->finalize = vik_map_source_finalize;
 }
@@ -99,6 +106,13 @@ _supports_download_only_new (VikMapSource *self)
 	return FALSE;
 }
 
+static GdkPixbuf *
+_decode_tile (VikMapSource *self, GBytes *bytes, MapCoord *src, guint reduce, GError **error)
+{
+	// Default feature: tiles are images in any format that GdkPixbuf supports
+	return a_tile_decode ( bytes, reduce, error );
+}
+
 /**
  * vik_map_source_get_copyright:
  * @self: the VikMapSource of interest.
@@ -529,3 +543,123 @@ vik_map_source_download_handle_cleanup (VikMapSource * self, void * handle)
 
 	(*klass->download_handle_cleanup)(self, handle);
 }
+
+/**
+ * vik_map_source_download_batch_add:
+ * @self:    The VikMapSource of interest.
+ * @src:     The map location to download
+ * @dest_fn: The filename to save the result in
+ * @batch:   The batch created by a_download_batch_new()
+ * @done:    Called with the result of the download
+ *
+ * Returns: FALSE if this map source can not download in a batch,
+ *  in which case use vik_map_source_download() instead
+ */
+gboolean
+vik_map_source_download_batch_add (VikMapSource * self, MapCoord * src, const gchar * dest_fn, void * batch, DownloadBatchDoneFunc done, gpointer user_data)
+{
+	VikMapSourceClass *klass;
+	g_return_val_if_fail (self != NULL, FALSE);
+	g_return_val_if_fail (VIK_IS_MAP_SOURCE (self), FALSE);
+	klass = VIK_MAP_SOURCE_GET_CLASS(self);
+
+	if (klass->download_batch_add == NULL)
+		return FALSE;
+
+	return (*klass->download_batch_add)(self, src, dest_fn, batch, done, user_data);
+}
+
+/**
+ * vik_map_source_get_download_block_size:
+ * @self:    The VikMapSource of interest.
+ *
+ * Returns: The number of tiles along each side of the blocks
+ *  fetched by vik_map_source_download_block(), or 1 if it is not supported
+ */
+guint
+vik_map_source_get_download_block_size (VikMapSource * self)
+{
+	VikMapSourceClass *klass;
+	g_return_val_if_fail (self != NULL, 1);
+	g_return_val_if_fail (VIK_IS_MAP_SOURCE (self), 1);
+	klass = VIK_MAP_SOURCE_GET_CLASS(self);
+
+	if (klass->get_download_block_size == NULL)
+		return 1;
+
+	return MAX (1, (*klass->get_download_block_size)(self));
+}
+
+/**
+ * vik_map_source_download_block:
+ * @self:    The VikMapSource of interest.
+ * @src:     The top left tile of the block
+ * @size:    The number of tiles along each side of the block
+ * @dest_fn: The filename to save the single image of the whole block in
+ *
+ * Returns: How the download went, as per vik_map_source_download()
+ */
+int
+vik_map_source_download_block (VikMapSource * self, MapCoord * src, guint size, const gchar * dest_fn, void * handle)
+{
+	VikMapSourceClass *klass;
+	g_return_val_if_fail (self != NULL, DOWNLOAD_PARAMETERS_ERROR);
+	g_return_val_if_fail (VIK_IS_MAP_SOURCE (self), DOWNLOAD_PARAMETERS_ERROR);
+	klass = VIK_MAP_SOURCE_GET_CLASS(self);
+
+	if (klass->download_block == NULL)
+		return DOWNLOAD_PARAMETERS_ERROR;
+
+	return (*klass->download_block)(self, src, size, dest_fn, handle);
+}
+
+/**
+ * vik_map_source_decode_tile:
+ * @self:  The VikMapSource of interest.
+ * @bytes: The tile file data, as downloaded or stored
+ * @src:   The map location of the tile
+ * @reduce: The tile will be drawn at 1/reduce of its size or smaller (1, 2, 4 or 8),
+ *          so the image may be made smaller by up to this factor
+ *
+ * Convert the tile data into the image to draw.
+ * May be called from any thread.
+ *
+ * Returns: The image, or NULL on failure (when @error is set)
+ */
+GdkPixbuf *
+vik_map_source_decode_tile (VikMapSource * self, GBytes * bytes, MapCoord * src, guint reduce, GError ** error)
+{
+	VikMapSourceClass *klass;
+	g_return_val_if_fail (self != NULL, NULL);
+	g_return_val_if_fail (VIK_IS_MAP_SOURCE (self), NULL);
+	klass = VIK_MAP_SOURCE_GET_CLASS(self);
+
+	g_return_val_if_fail (klass->decode_tile != NULL, NULL);
+
+	return (*klass->decode_tile)(self, bytes, src, reduce, error);
+}
+
+/**
+ * vik_map_source_get_hidpi:
+ * @self: The VikMapSource of interest.
+ *
+ * The same map with tiles of a higher pixel density (e.g. '@2x' tiles),
+ *  for displays drawn at more than one device pixel per logical pixel.
+ * Its tiles cover the same area as the tiles of @self,
+ *  with vik_map_source_get_scale() giving their pixel density.
+ *
+ * Returns: The HiDPI version of the map (owned by @self), or NULL if there isn't one
+ */
+VikMapSource *
+vik_map_source_get_hidpi (VikMapSource * self)
+{
+	VikMapSourceClass *klass;
+	g_return_val_if_fail (self != NULL, NULL);
+	g_return_val_if_fail (VIK_IS_MAP_SOURCE (self), NULL);
+	klass = VIK_MAP_SOURCE_GET_CLASS(self);
+
+	if (klass->get_hidpi == NULL)
+		return NULL;
+
+	return (*klass->get_hidpi)(self);
+}
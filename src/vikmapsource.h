@@ -26,6 +26,7 @@
 #include "vikcoord.h"
 #include "mapcoord.h"
 #include "bbox.h"
+#include "download.h"
 
 G_BEGIN_DECLS
 
@@ -74,6 +75,11 @@ struct _VikMapSourceClass
 	int (* download) (VikMapSource * self, MapCoord * src, const gchar * dest_fn, void * handle);
 	void * (* download_handle_init) (VikMapSource * self);
 	void (* download_handle_cleanup) (VikMapSource * self, void * handle);
+	gboolean (* download_batch_add) (VikMapSource * self, MapCoord * src, const gchar * dest_fn, void * batch, DownloadBatchDoneFunc done, gpointer user_data);
+	guint (* get_download_block_size) (VikMapSource * self);
+	int (* download_block) (VikMapSource * self, MapCoord * src, guint size, const gchar * dest_fn, void * handle);
+	GdkPixbuf * (* decode_tile) (VikMapSource * self, GBytes * bytes, MapCoord * src, guint reduce, GError ** error);
+	VikMapSource * (* get_hidpi) (VikMapSource * self);
 };
 
 struct _VikMapSource
@@ -113,6 +119,11 @@ void vik_map_source_mapcoord_to_center_coord (VikMapSource * self, MapCoord *src
 int vik_map_source_download (VikMapSource * self, MapCoord * src, const gchar * dest_fn, void * handle);
 void * vik_map_source_download_handle_init (VikMapSource * self);
 void vik_map_source_download_handle_cleanup (VikMapSource * self, void * handle);
+gboolean vik_map_source_download_batch_add (VikMapSource * self, MapCoord * src, const gchar * dest_fn, void * batch, DownloadBatchDoneFunc done, gpointer user_data);
+guint vik_map_source_get_download_block_size (VikMapSource * self);
+int vik_map_source_download_block (VikMapSource * self, MapCoord * src, guint size, const gchar * dest_fn, void * handle);
+GdkPixbuf *vik_map_source_decode_tile (VikMapSource * self, GBytes * bytes, MapCoord * src, guint reduce, GError ** error);
+VikMapSource *vik_map_source_get_hidpi (VikMapSource * self);
 
 G_END_DECLS
 
@@ -50,6 +50,7 @@ static gdouble map_source_get_offset_y (VikMapSource *self);
 static DownloadResult_t _download ( VikMapSource *self, MapCoord *src, const gchar *dest_fn, void *handle );
 static void * _download_handle_init ( VikMapSource *self );
 static void _download_handle_cleanup ( VikMapSource *self, void *handle );
+static gboolean _download_batch_add ( VikMapSource *self, MapCoord *src, const gchar *dest_fn, void *batch, DownloadBatchDoneFunc done, gpointer user_data );
 
 typedef struct _VikMapSourceDefaultPrivate VikMapSourceDefaultPrivate;
 struct _VikMapSourceDefaultPrivate
@@ -70,6 +71,7 @@ struct _VikMapSourceDefaultPrivate
 	gchar *file_extension;
 	gdouble offset_x;
 	gdouble offset_y;
+	gdouble download_rate;
 };
 
 G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE (VikMapSourceDefault, vik_map_source_default, VIK_TYPE_MAP_SOURCE);
@@ -93,6 +95,7 @@ enum
   PROP_FILE_EXTENSION,
   PROP_OFFSET_X,
   PROP_OFFSET_Y,
+  PROP_DOWNLOAD_RATE,
 };
 
 static void
@@ -204,6 +207,10 @@ vik_map_source_default_set_property (GObject      *object,
       priv->offset_y = g_value_get_double (value);
       break;
 
+    case PROP_DOWNLOAD_RATE:
+      priv->download_rate = g_value_get_double (value);
+      break;
+
     default:
       /* We don't have any other property... */
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -273,6 +280,10 @@ vik_map_source_default_get_property (GObject    *object,
       g_value_set_double (value, priv->offset_y);
       break;
 
+    case PROP_DOWNLOAD_RATE:
+      g_value_set_double (value, priv->download_rate);
+      break;
+
     default:
       /* We don't have any other property... */
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -308,6 +319,7 @@ vik_map_source_default_class_init (VikMapSourceDefaultClass *klass)
 	parent_class->download =                 _download;
 	parent_class->download_handle_init =     _download_handle_init;
 	parent_class->download_handle_cleanup =  _download_handle_cleanup;
+	parent_class->download_batch_add =       _download_batch_add;
 
 	/* Default implementation of methods */
 	klass->get_uri = NULL;
@@ -418,6 +430,15 @@ vik_map_source_default_class_init (VikMapSourceDefaultClass *klass)
 	                             G_PARAM_READWRITE);
 	g_object_class_install_property (object_class, PROP_OFFSET_Y, pspec);
 
+	pspec = g_param_spec_double ("download-rate",
+	                             "Download rate",
+	                             "The maximum number of tiles per second for bulk downloads (0 means use the default)",
+	                             0.0, // minimum value
+	                             G_MAXDOUBLE, // maximum value
+	                             0.0, // default value
+	                             G_PARAM_READWRITE);
+	g_object_class_install_property (object_class, PROP_DOWNLOAD_RATE, pspec);
+
 	object_class->finalize = vik_map_source_default_finalize;
 }
 
@@ -550,6 +571,19 @@ _download ( VikMapSource *self, MapCoord *src, const gchar *dest_fn, void *handl
    return res;
 }
 
+static gboolean
+_download_batch_add ( VikMapSource *self, MapCoord *src, const gchar *dest_fn, void *batch, DownloadBatchDoneFunc done, gpointer user_data )
+{
+   gchar *uri = vik_map_source_default_get_uri(VIK_MAP_SOURCE_DEFAULT(self), src);
+   gchar *host = vik_map_source_default_get_hostname(VIK_MAP_SOURCE_DEFAULT(self));
+   // Options are owned by the batch
+   DownloadFileOptions *options = vik_map_source_default_get_download_options(VIK_MAP_SOURCE_DEFAULT(self), src);
+   a_http_download_batch_add ( batch, host, uri, dest_fn, options, done, user_data );
+   g_free ( uri );
+   g_free ( host );
+   return TRUE;
+}
+
 static const gchar *
 map_source_get_file_extension (VikMapSource *self)
 {
@@ -665,3 +699,17 @@ vik_map_source_default_get_url_display( VikMapSourceDefault *self, MapCoord *src
 
 	return newstr;
 }
+
+/**
+ * vik_map_source_default_get_download_rate:
+ *
+ * Returns: The maximum tiles per second this source should be bulk downloaded at,
+ *  or 0 if the source does not say
+ */
+gdouble
+vik_map_source_default_get_download_rate( VikMapSourceDefault *self )
+{
+	g_return_val_if_fail (VIK_IS_MAP_SOURCE_DEFAULT(self), 0.0);
+	VikMapSourceDefaultPrivate *priv = VIK_MAP_SOURCE_DEFAULT_PRIVATE(self);
+	return priv->download_rate;
+}
@@ -60,6 +60,7 @@ gchar * vik_map_source_default_get_uri( VikMapSourceDefault *self, MapCoord *src
 gchar * vik_map_source_default_get_hostname( VikMapSourceDefault *self );
 DownloadFileOptions * vik_map_source_default_get_download_options( VikMapSourceDefault *self, MapCoord *src );
 gchar * vik_map_source_default_get_url_display( VikMapSourceDefault *self, MapCoord *src );
+gdouble vik_map_source_default_get_download_rate( VikMapSourceDefault *self );
 
 G_END_DECLS
 
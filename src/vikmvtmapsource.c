@@ -0,0 +1,258 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+ /**
+  * SECTION:vikmvtmapsource
+  * @short_description: the class for vector tile map sources
+  *
+  * The #VikMvtMapSource class handles slippy map sources whose tiles are
+  * Mapbox Vector Tiles (from a web service, a directory or an MBTiles file)
+  * rather than images. Each tile is drawn by Viking itself as per a simple
+  * style (see mvt.c), which happens in the threads that load the tiles.
+  *
+  * As for other tiles, the (much smaller) tile data and the drawn images are
+  * held by the map cache. The decoded geometry of recent tiles is also kept,
+  * so the tile need not be decoded again to draw it at a different size.
+  */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "vikmvtmapsource.h"
+#include "mvt.h"
+#include "util.h"
+#include "dir.h"
+
+static GdkPixbuf *_decode_tile ( VikMapSource *self, GBytes *bytes, MapCoord *src, guint reduce, GError **error );
+
+// Enough for the tiles of a large display, and the ones around it
+#define DECODED_CACHE_SIZE 64
+
+typedef struct {
+  gint x, y, z, scale;
+  gsize size;
+  guint hash;
+  MvtTile *tile;
+} DecodedTile;
+
+typedef struct _VikMvtMapSourcePrivate VikMvtMapSourcePrivate;
+struct _VikMvtMapSourcePrivate
+{
+  gchar *style_file;
+  MvtStyle *style;
+  GMutex decoded_lock;
+  GQueue decoded; // DecodedTile - most recently used first
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE (VikMvtMapSource, vik_mvt_map_source, VIK_TYPE_SLIPPY_MAP_SOURCE);
+#define VIK_MVT_MAP_SOURCE_PRIVATE(o)  (vik_mvt_map_source_get_instance_private (VIK_MVT_MAP_SOURCE(o)))
+
+/* properties */
+enum
+{
+  PROP_0,
+
+  PROP_STYLE,
+};
+
+static void
+vik_mvt_map_source_init (VikMvtMapSource *self)
+{
+  VikMvtMapSourcePrivate *priv = VIK_MVT_MAP_SOURCE_PRIVATE (self);
+
+  priv->style_file = NULL;
+  priv->style = NULL;
+  g_mutex_init ( &priv->decoded_lock );
+  g_queue_init ( &priv->decoded );
+}
+
+static void
+decoded_tile_free ( DecodedTile *dt )
+{
+  a_mvt_tile_unref ( dt->tile );
+  g_free ( dt );
+}
+
+static void
+vik_mvt_map_source_finalize (GObject *object)
+{
+  VikMvtMapSourcePrivate *priv = VIK_MVT_MAP_SOURCE_PRIVATE (object);
+
+  g_free ( priv->style_file );
+  priv->style_file = NULL;
+  a_mvt_style_free ( priv->style );
+  priv->style = NULL;
+  g_queue_free_full ( &priv->decoded, (GDestroyNotify)decoded_tile_free );
+  g_mutex_clear ( &priv->decoded_lock );
+
+  G_OBJECT_CLASS (vik_mvt_map_source_parent_class)->finalize (object);
+}
+
+/**
+ * Load the style now, so drawing (in any thread) only ever reads it
+ */
+static void
+load_style ( VikMvtMapSourcePrivate *priv )
+{
+  a_mvt_style_free ( priv->style );
+  priv->style = NULL;
+  if ( priv->style_file ) {
+    // Relative to the user's Viking directory, alongside the maps.xml file that would refer to it
+    gchar *filename = util_make_absolute_filename ( priv->style_file, a_get_viking_dir() );
+    GError *error = NULL;
+    priv->style = a_mvt_style_new_from_file ( filename ? filename : priv->style_file, &error );
+    if ( error ) {
+      g_warning ( "%s: %s", __FUNCTION__, error->message );
+      g_error_free ( error );
+    }
+    g_free ( filename );
+  }
+  if ( !priv->style )
+    priv->style = a_mvt_style_new_default ();
+}
+
+static void
+vik_mvt_map_source_set_property (GObject      *object,
+                                 guint         property_id,
+                                 const GValue *value,
+                                 GParamSpec   *pspec)
+{
+  VikMvtMapSourcePrivate *priv = VIK_MVT_MAP_SOURCE_PRIVATE (object);
+
+  switch (property_id)
+    {
+    case PROP_STYLE:
+      g_free (priv->style_file);
+      priv->style_file = g_value_dup_string (value);
+      load_style ( priv );
+      break;
+
+    default:
+      /* We don't have any other property... */
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+vik_mvt_map_source_get_property (GObject    *object,
+                                 guint       property_id,
+                                 GValue     *value,
+                                 GParamSpec *pspec)
+{
+  VikMvtMapSourcePrivate *priv = VIK_MVT_MAP_SOURCE_PRIVATE (object);
+
+  switch (property_id)
+    {
+    case PROP_STYLE:
+      g_value_set_string (value, priv->style_file);
+      break;
+
+    default:
+      /* We don't have any other property... */
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+vik_mvt_map_source_class_init (VikMvtMapSourceClass *klass)
+{
+	GObjectClass* object_class = G_OBJECT_CLASS (klass);
+	VikMapSourceClass* base_class = VIK_MAP_SOURCE_CLASS (klass);
+	GParamSpec *pspec = NULL;
+
+	object_class->set_property = vik_mvt_map_source_set_property;
+	object_class->get_property = vik_mvt_map_source_get_property;
+
+	/* Overiding methods */
+	base_class->decode_tile = _decode_tile;
+
+	// As a construct property, the (default) style is always loaded
+	pspec = g_param_spec_string ("style",
+	                             "Style",
+	                             "The file describing how to draw the tiles, relative to the Viking directory. The built in style is for the OpenMapTiles schema",
+	                             NULL /* default value */,
+	                             G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+	g_object_class_install_property (object_class, PROP_STYLE, pspec);
+
+	object_class->finalize = vik_mvt_map_source_finalize;
+}
+
+/**
+ * Get the decoded tile, either from those kept or by decoding it now
+ */
+static MvtTile *
+decoded_get ( VikMvtMapSourcePrivate *priv, GBytes *bytes, MapCoord *src, GError **error )
+{
+  // The data is part of the key, as the same position may be read from different files
+  gsize size = g_bytes_get_size ( bytes );
+  guint hash = g_bytes_hash ( bytes );
+
+  g_mutex_lock ( &priv->decoded_lock );
+  for ( GList *iter = priv->decoded.head; iter; iter = iter->next ) {
+    DecodedTile *dt = iter->data;
+    if ( dt->x == src->x && dt->y == src->y && dt->z == src->z && dt->scale == src->scale &&
+         dt->size == size && dt->hash == hash ) {
+      g_queue_unlink ( &priv->decoded, iter );
+      g_queue_push_head_link ( &priv->decoded, iter );
+      MvtTile *tile = a_mvt_tile_ref ( dt->tile );
+      g_mutex_unlock ( &priv->decoded_lock );
+      return tile;
+    }
+  }
+  g_mutex_unlock ( &priv->decoded_lock );
+
+  MvtTile *tile = a_mvt_tile_decode ( g_bytes_get_data ( bytes, NULL ), size, error );
+  if ( !tile )
+    return NULL;
+
+  DecodedTile *dt = g_new0 ( DecodedTile, 1 );
+  dt->x = src->x;
+  dt->y = src->y;
+  dt->z = src->z;
+  dt->scale = src->scale;
+  dt->size = size;
+  dt->hash = hash;
+  dt->tile = a_mvt_tile_ref ( tile );
+
+  g_mutex_lock ( &priv->decoded_lock );
+  g_queue_push_head ( &priv->decoded, dt );
+  while ( priv->decoded.length > DECODED_CACHE_SIZE )
+    decoded_tile_free ( g_queue_pop_tail ( &priv->decoded ) );
+  g_mutex_unlock ( &priv->decoded_lock );
+  return tile;
+}
+
+static GdkPixbuf *
+_decode_tile ( VikMapSource *self, GBytes *bytes, MapCoord *src, guint reduce, GError **error )
+{
+	g_return_val_if_fail (VIK_IS_MVT_MAP_SOURCE(self), NULL);
+
+	VikMvtMapSourcePrivate *priv = VIK_MVT_MAP_SOURCE_PRIVATE(self);
+
+	MvtTile *tile = decoded_get ( priv, bytes, src, error );
+	if ( !tile )
+		return NULL;
+
+	GdkPixbuf *pixbuf = a_mvt_tile_render ( tile, priv->style, 17 - src->scale, vik_map_source_get_tilesize_x(self) );
+	a_mvt_tile_unref ( tile );
+	return pixbuf;
+}
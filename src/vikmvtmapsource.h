@@ -0,0 +1,52 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _VIK_MVT_MAP_SOURCE_H
+#define _VIK_MVT_MAP_SOURCE_H
+
+#include <glib.h>
+
+#include "vikslippymapsource.h"
+
+G_BEGIN_DECLS
+
+#define VIK_TYPE_MVT_MAP_SOURCE             (vik_mvt_map_source_get_type ())
+#define VIK_MVT_MAP_SOURCE(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), VIK_TYPE_MVT_MAP_SOURCE, VikMvtMapSource))
+#define VIK_MVT_MAP_SOURCE_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), VIK_TYPE_MVT_MAP_SOURCE, VikMvtMapSourceClass))
+#define VIK_IS_MVT_MAP_SOURCE(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), VIK_TYPE_MVT_MAP_SOURCE))
+#define VIK_IS_MVT_MAP_SOURCE_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), VIK_TYPE_MVT_MAP_SOURCE))
+#define VIK_MVT_MAP_SOURCE_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), VIK_TYPE_MVT_MAP_SOURCE, VikMvtMapSourceClass))
+
+typedef struct _VikMvtMapSourceClass VikMvtMapSourceClass;
+typedef struct _VikMvtMapSource VikMvtMapSource;
+
+struct _VikMvtMapSourceClass
+{
+	VikSlippyMapSourceClass parent_class;
+};
+
+struct _VikMvtMapSource
+{
+	VikSlippyMapSource parent_instance;
+};
+
+GType vik_mvt_map_source_get_type (void) G_GNUC_CONST;
+
+G_END_DECLS
+
+#endif /* _VIK_MVT_MAP_SOURCE_H_ */
@@ -38,6 +38,9 @@
 #include "babel.h"
 
 #include "preferences.h"
+#include "settings.h"
+#include "background.h"
+#include "viklayer.h"
 
 #include "vikrouting.h"
 #include "vikroutingengine.h"
@@ -135,6 +138,314 @@ vik_routing_default_find(VikTrwLayer *vt, struct LatLon start, struct LatLon end
   return vik_routing_engine_find ( engine, vt, start, end );
 }
 
+/*
+ * Routes found are kept, so asking again for the same leg (e.g. after an undo in the
+ *  route finder) does not need another request to the engine.
+ * The key is the engine id and the end points; an engine's other options are fixed
+ *  by its configuration, so are known from its id.
+ */
+#define VIK_SETTINGS_ROUTING_CACHE_SIZE "routing_cache_size"
+#define VIK_SETTINGS_ROUTING_RACE_ENGINES "routing_race_engines"
+
+typedef struct {
+  gchar *key;
+  GList *trackpoints;
+} RouteCacheT;
+
+static GMutex route_cache_mutex;
+static GHashTable *route_cache = NULL;
+static GQueue route_cache_queue = G_QUEUE_INIT; // Least recently used first
+static guint route_cache_size = 0;
+
+static GList *trackpoints_copy ( GList *trackpoints )
+{
+  return g_list_copy_deep ( trackpoints, (GCopyFunc)vik_trackpoint_copy, NULL );
+}
+
+static void trackpoints_free ( GList *trackpoints )
+{
+  g_list_free_full ( trackpoints, (GDestroyNotify)vik_trackpoint_free );
+}
+
+static void route_cache_free ( RouteCacheT *rc )
+{
+  g_free ( rc->key );
+  trackpoints_free ( rc->trackpoints );
+  g_free ( rc );
+}
+
+static gchar *route_cache_key ( VikRoutingEngine *engine, struct LatLon start, struct LatLon end )
+{
+  return g_strdup_printf ( "%s %.6f %.6f %.6f %.6f", vik_routing_engine_get_id ( engine ),
+                           start.lat, start.lon, end.lat, end.lon );
+}
+
+/**
+ * Returns: A copy of the trackpoints of the route, or NULL if not known
+ */
+static GList *route_cache_lookup ( VikRoutingEngine *engine, struct LatLon start, struct LatLon end )
+{
+  GList *trackpoints = NULL;
+  gchar *key = route_cache_key ( engine, start, end );
+  g_mutex_lock ( &route_cache_mutex );
+  GList *link = route_cache ? g_hash_table_lookup ( route_cache, key ) : NULL;
+  if ( link ) {
+    g_queue_unlink ( &route_cache_queue, link );
+    g_queue_push_tail_link ( &route_cache_queue, link );
+    trackpoints = trackpoints_copy ( ((RouteCacheT*)link->data)->trackpoints );
+  }
+  g_mutex_unlock ( &route_cache_mutex );
+  g_free ( key );
+  return trackpoints;
+}
+
+static void route_cache_add ( VikRoutingEngine *engine, struct LatLon start, struct LatLon end, GList *trackpoints )
+{
+  gchar *key = route_cache_key ( engine, start, end );
+  g_mutex_lock ( &route_cache_mutex );
+  if ( !route_cache ) {
+    gint size = 200;
+    if ( a_settings_get_integer ( VIK_SETTINGS_ROUTING_CACHE_SIZE, &size ) )
+      size = MAX ( size, 0 );
+    route_cache_size = size;
+    route_cache = g_hash_table_new ( g_str_hash, g_str_equal );
+  }
+  if ( route_cache_size && !g_hash_table_contains ( route_cache, key ) ) {
+    RouteCacheT *rc = g_malloc ( sizeof(RouteCacheT) );
+    rc->key = key;
+    rc->trackpoints = trackpoints_copy ( trackpoints );
+    g_queue_push_tail ( &route_cache_queue, rc );
+    g_hash_table_insert ( route_cache, key, g_queue_peek_tail_link ( &route_cache_queue ) );
+    key = NULL;
+    while ( g_queue_get_length ( &route_cache_queue ) > route_cache_size ) {
+      RouteCacheT *old = g_queue_pop_head ( &route_cache_queue );
+      g_hash_table_remove ( route_cache, old->key );
+      route_cache_free ( old );
+    }
+  }
+  g_mutex_unlock ( &route_cache_mutex );
+  g_free ( key );
+}
+
+/**
+ * vik_routing_cache_clear:
+ *
+ * Forget all the routes found so far.
+ */
+void
+vik_routing_cache_clear ( void )
+{
+  g_mutex_lock ( &route_cache_mutex );
+  if ( route_cache )
+    g_hash_table_remove_all ( route_cache );
+  RouteCacheT *rc;
+  while ( (rc = g_queue_pop_head ( &route_cache_queue )) )
+    route_cache_free ( rc );
+  g_mutex_unlock ( &route_cache_mutex );
+}
+
+/**
+ * Ask the engine for the route, with the result put in the temporary layer
+ *
+ * Returns: The trackpoints of the (first) route or track returned, or NULL on failure
+ */
+static GList *routing_find ( VikRoutingEngine *engine, VikTrwLayer *vtl, struct LatLon start, struct LatLon end )
+{
+  if ( !vik_routing_engine_find ( engine, vtl, start, end ) )
+    return NULL;
+
+  GList *trackpoints = NULL;
+  GHashTable *tables[2] = { vik_trw_layer_get_routes ( vtl ), vik_trw_layer_get_tracks ( vtl ) };
+  for ( guint ii = 0; ii < G_N_ELEMENTS(tables) && !trackpoints; ii++ ) {
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init ( &iter, tables[ii] );
+    while ( !trackpoints && g_hash_table_iter_next ( &iter, NULL, &value ) ) {
+      VikTrack *trk = VIK_TRACK(value);
+      trackpoints = trk->trackpoints;
+      trk->trackpoints = NULL;
+    }
+  }
+
+  if ( trackpoints )
+    route_cache_add ( engine, start, end, trackpoints );
+  return trackpoints;
+}
+
+/**
+ * vik_routing_find_route:
+ * @engine: The engine to use
+ *
+ * Route computation, using any previous result for the same end points.
+ *
+ * Returns: The trackpoints of the route (to be freed by the caller), or NULL on failure
+ */
+GList *
+vik_routing_find_route ( VikRoutingEngine *engine, struct LatLon start, struct LatLon end )
+{
+  GList *trackpoints = route_cache_lookup ( engine, start, end );
+  if ( !trackpoints ) {
+    VikTrwLayer *vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, NULL, FALSE ));
+    trackpoints = routing_find ( engine, vtl, start, end );
+    g_object_unref ( vtl );
+  }
+  return trackpoints;
+}
+
+/**
+ * vik_routing_race_engines:
+ *
+ * The engines to ask at once for each route, the first good answer being used:
+ *  the default engine plus any others named in the routing_race_engines setting.
+ *
+ * Returns: A list of the engines, to be freed (but not the engines) after use
+ */
+GList *
+vik_routing_race_engines ( void )
+{
+  GList *engines = NULL;
+  VikRoutingEngine *engine = vik_routing_default_engine ( );
+  if ( engine )
+    engines = g_list_append ( engines, engine );
+
+  GList *ids = a_settings_get_string_list ( VIK_SETTINGS_ROUTING_RACE_ENGINES );
+  for ( GList *gl = ids; gl; gl = g_list_next(gl) ) {
+    engine = vik_routing_find_engine ( gl->data );
+    if ( engine && !g_list_find ( engines, engine ) )
+      engines = g_list_append ( engines, engine );
+    else if ( !engine )
+      g_warning ( "%s: Unknown routing engine %s", __FUNCTION__, (gchar*)gl->data );
+  }
+  g_list_free_full ( ids, g_free );
+  return engines;
+}
+
+typedef struct {
+  struct LatLon start;
+  struct LatLon end;
+  VikRoutingResultFunc func;
+  gpointer user_data;
+  guint remaining; // Engines yet to answer
+  gint answered;   // Set, atomically, once a route has been found
+} RoutingRequestT;
+
+typedef struct {
+  RoutingRequestT *req;
+  VikRoutingEngine *engine;
+  VikTrwLayer *vtl;
+  GList *trackpoints;
+} RoutingJobT;
+
+// Called in the main thread, so the request needs no lock
+static gboolean routing_job_done ( gpointer data )
+{
+  RoutingJobT *job = data;
+  RoutingRequestT *req = job->req;
+
+  req->remaining--;
+  if ( job->trackpoints && req->func ) {
+    req->func ( job->engine, job->trackpoints, req->user_data );
+    req->func = NULL;
+  }
+  else {
+    trackpoints_free ( job->trackpoints );
+    // No engine succeeded
+    if ( !req->remaining && req->func )
+      req->func ( NULL, NULL, req->user_data );
+  }
+  if ( !req->remaining )
+    g_free ( req );
+
+  if ( job->vtl )
+    g_object_unref ( job->vtl );
+  g_object_unref ( job->engine );
+  g_free ( job );
+  return FALSE;
+}
+
+static void routing_job_free ( RoutingJobT *job )
+{
+  // Since from a background thread
+  (void)gdk_threads_add_idle ( routing_job_done, job );
+}
+
+static int routing_job_thread ( RoutingJobT *job, gpointer threaddata )
+{
+  (void)a_background_thread_progress ( threaddata, 0.0 );
+  // Don't bother if another engine has already answered, or the user cancelled
+  if ( g_atomic_int_get ( &job->req->answered ) || a_background_testcancel ( threaddata ) )
+    return -1;
+
+  job->trackpoints = routing_find ( job->engine, job->vtl, job->req->start, job->req->end );
+  if ( job->trackpoints )
+    g_atomic_int_set ( &job->req->answered, TRUE );
+  return 0;
+}
+
+/**
+ * vik_routing_find_route_async:
+ * @engines: The engines to ask, all at the same time
+ * @parent:  The window to show the requests against
+ * @func:    Called in the main thread with the first route found,
+ *           or with no route if all the engines fail
+ *
+ * Route computation in the background, so many routes can be found at once.
+ * The result comes from the first engine to answer successfully, or from
+ *  a previous result for the same end points of any of the engines.
+ */
+void
+vik_routing_find_route_async ( GList *engines, GtkWindow *parent, struct LatLon start, struct LatLon end, VikRoutingResultFunc func, gpointer user_data )
+{
+  RoutingRequestT *req = g_malloc0 ( sizeof(RoutingRequestT) );
+  req->start = start;
+  req->end = end;
+  req->func = func;
+  req->user_data = user_data;
+
+  for ( GList *gl = engines; gl; gl = g_list_next(gl) ) {
+    GList *trackpoints = route_cache_lookup ( VIK_ROUTING_ENGINE(gl->data), start, end );
+    if ( trackpoints ) {
+      // Still answer via the main loop, so results always arrive in the same way
+      RoutingJobT *job = g_malloc0 ( sizeof(RoutingJobT) );
+      job->req = req;
+      job->engine = g_object_ref ( gl->data );
+      job->trackpoints = trackpoints;
+      req->remaining = 1;
+      (void)gdk_threads_add_idle ( routing_job_done, job );
+      return;
+    }
+  }
+
+  for ( GList *gl = engines; gl; gl = g_list_next(gl) ) {
+    RoutingJobT *job = g_malloc0 ( sizeof(RoutingJobT) );
+    job->req = req;
+    job->engine = g_object_ref ( gl->data );
+    // Layers are created here rather than in the thread, as any layer creation may use settings and defaults
+    job->vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, NULL, FALSE ));
+    req->remaining++;
+
+    gchar *msg = g_strdup_printf ( _("Querying %s for route between (%.3f, %.3f) and (%.3f, %.3f)"),
+                                   vik_routing_engine_get_label ( job->engine ),
+                                   start.lat, start.lon, end.lat, end.lon );
+    a_background_thread_with_priority ( BACKGROUND_POOL_REMOTE,
+                                        BACKGROUND_PRIORITY_INTERACTIVE,
+                                        parent,
+                                        msg,
+                                        (vik_thr_func)routing_job_thread,
+                                        job,
+                                        (vik_thr_free_func)routing_job_free,
+                                        NULL,
+                                        1 );
+    g_free ( msg );
+  }
+
+  if ( !req->remaining ) {
+    if ( func )
+      func ( NULL, NULL, user_data );
+    g_free ( req );
+  }
+}
+
 /**
  * vik_routing_register:
  * @engine: new routing engine to register
@@ -208,6 +519,7 @@ vik_routing_unregister_all ()
   g_list_foreach ( routing_engine_list, (GFunc) g_object_unref, NULL );
   g_strfreev ( routing_engine_labels );
   g_strfreev ( routing_engine_ids );
+  vik_routing_cache_clear ( );
 }
 
 /**
@@ -30,6 +30,13 @@ G_BEGIN_DECLS
 /* Default */
 gboolean vik_routing_default_find ( VikTrwLayer *vt, struct LatLon start, struct LatLon end );
 
+/* Cached and background route computation */
+typedef void (*VikRoutingResultFunc) ( VikRoutingEngine *engine, GList *trackpoints, gpointer user_data );
+GList *vik_routing_find_route ( VikRoutingEngine *engine, struct LatLon start, struct LatLon end );
+void vik_routing_find_route_async ( GList *engines, GtkWindow *parent, struct LatLon start, struct LatLon end, VikRoutingResultFunc func, gpointer user_data );
+GList *vik_routing_race_engines ( void );
+void vik_routing_cache_clear ( void );
+
 /* Routing engines management */
 void vik_routing_prefs_init();
 void vik_routing_register( VikRoutingEngine *engine );
@@ -0,0 +1,366 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/**
+ * SECTION:vikroutinglocalengine
+ * @short_description: A routing engine working offline
+ *
+ * The #VikRoutingLocalEngine class finds routes over a road graph
+ *  built from an OpenStreetMap extract, without any network access.
+ *
+ * The graph is built (which can take a while for a large extract) the first time
+ *  the engine is used, and again whenever the extract is newer than it.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "dir.h"
+#include "routegraph.h"
+#include "viktrwlayer.h"
+
+#include "vikroutinglocalengine.h"
+
+static void vik_routing_local_engine_finalize ( GObject *gob );
+
+static gboolean vik_routing_local_engine_find ( VikRoutingEngine *self, VikTrwLayer *vtl, struct LatLon start, struct LatLon end );
+static gboolean vik_routing_local_engine_supports_direction ( VikRoutingEngine *self );
+static gboolean vik_routing_local_engine_refine ( VikRoutingEngine *self, VikTrwLayer *vtl, VikTrack *vt );
+static gboolean vik_routing_local_engine_supports_refine ( VikRoutingEngine *self );
+
+typedef struct _VikRoutingLocalEnginePrivate VikRoutingLocalEnginePrivate;
+struct _VikRoutingLocalEnginePrivate
+{
+  gchar *graph_file;
+  gchar *osm_file;
+  gchar *profile;
+
+  GMutex mutex;
+  RouteGraph *graph;
+  gboolean unusable; // Only report a problem with the graph once
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE (VikRoutingLocalEngine, vik_routing_local_engine, VIK_ROUTING_ENGINE_TYPE)
+#define VIK_ROUTING_LOCAL_ENGINE_PRIVATE(o)  (vik_routing_local_engine_get_instance_private (VIK_ROUTING_LOCAL_ENGINE(o)))
+
+/* properties */
+enum
+{
+  PROP_0,
+
+  PROP_GRAPH_FILE,
+  PROP_OSM_FILE,
+  PROP_PROFILE,
+};
+
+static void
+vik_routing_local_engine_set_property (GObject      *object,
+                          guint         property_id,
+                          const GValue *value,
+                          GParamSpec   *pspec)
+{
+  VikRoutingLocalEnginePrivate *priv = VIK_ROUTING_LOCAL_ENGINE_PRIVATE ( object );
+
+  switch (property_id)
+    {
+    case PROP_GRAPH_FILE:
+      g_free (priv->graph_file);
+      priv->graph_file = g_strdup(g_value_get_string (value));
+      break;
+
+    case PROP_OSM_FILE:
+      g_free (priv->osm_file);
+      priv->osm_file = g_strdup(g_value_get_string (value));
+      break;
+
+    case PROP_PROFILE:
+      g_free (priv->profile);
+      priv->profile = g_strdup(g_value_get_string (value));
+      break;
+
+    default:
+      /* We don't have any other property... */
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+vik_routing_local_engine_get_property (GObject    *object,
+                          guint       property_id,
+                          GValue     *value,
+                          GParamSpec *pspec)
+{
+  VikRoutingLocalEnginePrivate *priv = VIK_ROUTING_LOCAL_ENGINE_PRIVATE ( object );
+
+  switch (property_id)
+    {
+    case PROP_GRAPH_FILE:
+      g_value_set_string (value, priv->graph_file);
+      break;
+
+    case PROP_OSM_FILE:
+      g_value_set_string (value, priv->osm_file);
+      break;
+
+    case PROP_PROFILE:
+      g_value_set_string (value, priv->profile);
+      break;
+
+    default:
+      /* We don't have any other property... */
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void vik_routing_local_engine_class_init ( VikRoutingLocalEngineClass *klass )
+{
+  GObjectClass *object_class;
+  VikRoutingEngineClass *parent_class;
+  GParamSpec *pspec = NULL;
+
+  object_class = G_OBJECT_CLASS (klass);
+
+  object_class->set_property = vik_routing_local_engine_set_property;
+  object_class->get_property = vik_routing_local_engine_get_property;
+  object_class->finalize = vik_routing_local_engine_finalize;
+
+  parent_class = VIK_ROUTING_ENGINE_CLASS (klass);
+
+  parent_class->find = vik_routing_local_engine_find;
+  parent_class->supports_direction = vik_routing_local_engine_supports_direction;
+  parent_class->refine = vik_routing_local_engine_refine;
+  parent_class->supports_refine = vik_routing_local_engine_supports_refine;
+
+  /**
+   * VikRoutingLocalEngine:graph-file:
+   *
+   * The road graph, relative to the Viking directory unless absolute.
+   */
+  pspec = g_param_spec_string ("graph-file",
+                               "Graph file",
+                               "The road graph file",
+                               NULL /* default value */,
+                               G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_GRAPH_FILE, pspec);
+
+
+  /**
+   * VikRoutingLocalEngine:osm-file:
+   *
+   * The OpenStreetMap extract (in the PBF format) to build the graph from,
+   * relative to the Viking directory unless absolute.
+   * Without it the graph file has to have been made already.
+   */
+  pspec = g_param_spec_string ("osm-file",
+                               "OSM file",
+                               "The OpenStreetMap PBF extract to build the graph from",
+                               NULL /* default value */,
+                               G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_OSM_FILE, pspec);
+
+
+  /**
+   * VikRoutingLocalEngine:profile:
+   *
+   * Which roads can be used, and how fast: "car", "bicycle" or "foot".
+   */
+  pspec = g_param_spec_string ("profile",
+                               "Profile",
+                               "The kind of transport: car, bicycle or foot",
+                               "car" /* default value */,
+                               G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_PROFILE, pspec);
+}
+
+static void vik_routing_local_engine_init ( VikRoutingLocalEngine *self )
+{
+  VikRoutingLocalEnginePrivate *priv = VIK_ROUTING_LOCAL_ENGINE_PRIVATE ( self );
+
+  priv->graph_file = NULL;
+  priv->osm_file = NULL;
+  priv->profile = NULL;
+
+  g_mutex_init ( &priv->mutex );
+  priv->graph = NULL;
+  priv->unusable = FALSE;
+}
+
+static void vik_routing_local_engine_finalize ( GObject *gob )
+{
+  VikRoutingLocalEnginePrivate *priv = VIK_ROUTING_LOCAL_ENGINE_PRIVATE ( gob );
+
+  g_free (priv->graph_file);
+  priv->graph_file = NULL;
+  g_free (priv->osm_file);
+  priv->osm_file = NULL;
+  g_free (priv->profile);
+  priv->profile = NULL;
+
+  a_route_graph_free ( priv->graph );
+  priv->graph = NULL;
+  g_mutex_clear ( &priv->mutex );
+
+  G_OBJECT_CLASS (vik_routing_local_engine_parent_class)->finalize(gob);
+}
+
+static gchar *
+resolve_file ( const gchar *filename )
+{
+  if ( g_path_is_absolute ( filename ) )
+    return g_strdup ( filename );
+  return g_build_filename ( a_get_viking_dir(), filename, NULL );
+}
+
+/**
+ * The graph, building it first if needed
+ * Routes may be searched for from several threads at once, but the graph is only built once
+ */
+static RouteGraph *
+vik_routing_local_engine_get_graph ( VikRoutingEngine *self )
+{
+  VikRoutingLocalEnginePrivate *priv = VIK_ROUTING_LOCAL_ENGINE_PRIVATE ( self );
+
+  g_mutex_lock ( &priv->mutex );
+  if ( !priv->graph && !priv->unusable ) {
+    priv->unusable = TRUE;
+    if ( !priv->graph_file ) {
+      g_warning ( "%s: no graph-file given for %s", __FUNCTION__, vik_routing_engine_get_id ( self ) );
+      g_mutex_unlock ( &priv->mutex );
+      return NULL;
+    }
+
+    gchar *graph_file = resolve_file ( priv->graph_file );
+    GError *error = NULL;
+    if ( priv->osm_file ) {
+      gchar *osm_file = resolve_file ( priv->osm_file );
+      GStatBuf osm_stat, graph_stat;
+      if ( g_stat ( osm_file, &osm_stat ) == 0 &&
+           ( g_stat ( graph_file, &graph_stat ) != 0 || graph_stat.st_mtime < osm_stat.st_mtime ) ) {
+        RouteGraphProfile profile = ROUTE_GRAPH_CAR;
+        if ( priv->profile && !a_route_graph_profile_from_name ( priv->profile, &profile ) )
+          g_warning ( "%s: unknown profile %s", __FUNCTION__, priv->profile );
+        g_message ( "%s: building %s from %s", __FUNCTION__, graph_file, osm_file );
+        if ( !a_route_graph_build ( osm_file, graph_file, profile, &error ) ) {
+          // Any previous graph can still be used
+          g_warning ( "%s: %s", __FUNCTION__, error->message );
+          g_clear_error ( &error );
+        }
+      }
+      g_free ( osm_file );
+    }
+
+    priv->graph = a_route_graph_open ( graph_file, &error );
+    if ( priv->graph )
+      priv->unusable = FALSE;
+    else {
+      g_warning ( "%s: %s", __FUNCTION__, error->message );
+      g_error_free ( error );
+    }
+    g_free ( graph_file );
+  }
+  g_mutex_unlock ( &priv->mutex );
+  return priv->graph;
+}
+
+/**
+ * Route between the positions, adding the route's trackpoints onto the end of the track
+ */
+static gboolean
+append_route ( VikRoutingEngine *self, VikTrwLayer *vtl, VikTrack *tr, struct LatLon *start, struct LatLon *end )
+{
+  RouteGraph *rg = vik_routing_local_engine_get_graph ( self );
+  if ( !rg )
+    return FALSE;
+
+  GError *error = NULL;
+  GArray *points = a_route_graph_find ( rg, start, end, &error );
+  if ( !points ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+    return FALSE;
+  }
+
+  VikCoordMode mode = vik_trw_layer_get_coord_mode ( vtl );
+  GList *tpl = NULL;
+  // Continuing from the previous leg, which finished at this point
+  guint first = tr->trackpoints ? 1 : 0;
+  for ( guint ii = points->len; ii > first; ii-- ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    vik_coord_load_from_latlon ( &tp->coord, mode, &g_array_index ( points, struct LatLon, ii-1 ) );
+    tpl = g_list_prepend ( tpl, tp );
+  }
+  (void)vik_track_append_trackpoints ( tr, NULL, tpl );
+  g_array_free ( points, TRUE );
+  return TRUE;
+}
+
+static gboolean
+vik_routing_local_engine_find ( VikRoutingEngine *self, VikTrwLayer *vtl, struct LatLon start, struct LatLon end )
+{
+  VikTrack *tr = vik_track_new ();
+  tr->is_route = TRUE;
+  if ( !append_route ( self, vtl, tr, &start, &end ) ) {
+    vik_track_free ( tr );
+    return FALSE;
+  }
+  vik_trw_layer_filein_add_track ( vtl, vik_routing_engine_get_label ( self ), tr );
+  return TRUE;
+}
+
+static gboolean
+vik_routing_local_engine_supports_direction ( VikRoutingEngine *self )
+{
+  return FALSE;
+}
+
+/**
+ * Route via each of the track's points in turn
+ */
+static gboolean
+vik_routing_local_engine_refine ( VikRoutingEngine *self, VikTrwLayer *vtl, VikTrack *vt )
+{
+  if ( !vt->trackpoints || !vt->trackpoints->next )
+    return FALSE;
+
+  VikTrack *tr = vik_track_new ();
+  tr->is_route = TRUE;
+  for ( GList *iter = vt->trackpoints; iter->next; iter = iter->next ) {
+    struct LatLon start, end;
+    vik_coord_to_latlon ( &VIK_TRACKPOINT(iter->data)->coord, &start );
+    vik_coord_to_latlon ( &VIK_TRACKPOINT(iter->next->data)->coord, &end );
+    if ( !append_route ( self, vtl, tr, &start, &end ) ) {
+      vik_track_free ( tr );
+      return FALSE;
+    }
+  }
+  vik_trw_layer_filein_add_track ( vtl, vik_routing_engine_get_label ( self ), tr );
+  return TRUE;
+}
+
+static gboolean
+vik_routing_local_engine_supports_refine ( VikRoutingEngine *self )
+{
+  return TRUE;
+}
@@ -47,6 +47,7 @@
 
 #include "vikslippymapsource.h"
 #include "maputils.h"
+#include "map_ids.h"
 
 static gboolean _coord_to_mapcoord ( VikMapSource *self, const VikCoord *src, gdouble xzoom, gdouble yzoom, MapCoord *dest );
 static void _mapcoord_to_center_coord ( VikMapSource *self, MapCoord *src, VikCoord *dest );
@@ -61,6 +62,7 @@ static gdouble _get_lat_min(VikMapSource *self );
 static gdouble _get_lat_max(VikMapSource *self );
 static gdouble _get_lon_min(VikMapSource *self );
 static gdouble _get_lon_max(VikMapSource *self );
+static VikMapSource *_get_hidpi (VikMapSource *self );
 
 static gchar *_get_uri( VikMapSourceDefault *self, MapCoord *src );
 static gchar *_get_hostname( VikMapSourceDefault *self );
@@ -85,6 +87,10 @@ struct _VikSlippyMapSourcePrivate
   gboolean is_osm_meta_tiles; // http://wiki.openstreetmap.org/wiki/Meta_tiles as used by tirex or renderd
   // Mainly for ARCGIS Tile Server URL Layout // http://help.arcgis.com/EN/arcgisserver/10.0/apis/rest/tile.html
   gboolean switch_xy;
+  // Tiles of a higher pixel density, covering the same area as the normal tiles
+  gchar *url_hidpi;
+  guint tilesize_hidpi;
+  VikMapSource *hidpi; // Created when first wanted
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (VikSlippyMapSource, vik_slippy_map_source, VIK_TYPE_MAP_SOURCE_DEFAULT);
@@ -112,6 +118,8 @@ enum
   PROP_IS_MBTILES,
   PROP_IS_OSM_META_TILES,
   PROP_SWITCH_XY,
+  PROP_URL_HIDPI,
+  PROP_TILESIZE_HIDPI,
 };
 
 static void
@@ -139,6 +147,9 @@ vik_slippy_map_source_init (VikSlippyMapSource *self)
   priv->is_mbtiles = FALSE;
   priv->is_osm_meta_tiles = FALSE;
   priv->switch_xy = FALSE;
+  priv->url_hidpi = NULL;
+  priv->tilesize_hidpi = 512;
+  priv->hidpi = NULL;
 
   g_object_set (G_OBJECT (self),
                 "tilesize-x", 256,
@@ -163,6 +174,11 @@ vik_slippy_map_source_finalize (GObject *object)
   priv->options.referer = NULL;
   g_free (priv->options.custom_http_headers);
   priv->options.custom_http_headers = NULL;
+  g_free (priv->url_hidpi);
+  priv->url_hidpi = NULL;
+  if (priv->hidpi)
+    g_object_unref (priv->hidpi);
+  priv->hidpi = NULL;
 
   G_OBJECT_CLASS (vik_slippy_map_source_parent_class)->finalize (object);
 }
@@ -256,6 +272,15 @@ vik_slippy_map_source_set_property (GObject      *object,
       priv->switch_xy = g_value_get_boolean (value);
       break;
 
+    case PROP_URL_HIDPI:
+      g_free (priv->url_hidpi);
+      priv->url_hidpi = g_value_dup_string (value);
+      break;
+
+    case PROP_TILESIZE_HIDPI:
+      priv->tilesize_hidpi = g_value_get_uint (value);
+      break;
+
     default:
       /* We don't have any other property... */
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -341,6 +366,14 @@ vik_slippy_map_source_get_property (GObject    *object,
       g_value_set_boolean (value, priv->switch_xy);
       break;
 
+    case PROP_URL_HIDPI:
+      g_value_set_string (value, priv->url_hidpi);
+      break;
+
+    case PROP_TILESIZE_HIDPI:
+      g_value_set_uint (value, priv->tilesize_hidpi);
+      break;
+
     default:
       /* We don't have any other property... */
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -372,6 +405,7 @@ vik_slippy_map_source_class_init (VikSlippyMapSourceClass *klass)
 	grandparent_class->get_lat_max = _get_lat_max;
 	grandparent_class->get_lon_min = _get_lon_min;
 	grandparent_class->get_lon_max = _get_lon_max;
+	grandparent_class->get_hidpi = _get_hidpi;
 
 	parent_class->get_uri = _get_uri;
 	parent_class->get_hostname = _get_hostname;
@@ -510,6 +544,22 @@ vik_slippy_map_source_class_init (VikSlippyMapSourceClass *klass)
 	                              G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
 	g_object_class_install_property (object_class, PROP_SWITCH_XY, pspec);
 
+	pspec = g_param_spec_string ("url-hidpi",
+	                             "HiDPI URL",
+	                             "The template of the URL of higher pixel density tiles (e.g. '@2x' tiles), for HiDPI displays",
+	                             NULL /* default value */,
+	                             G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+	g_object_class_install_property (object_class, PROP_URL_HIDPI, pspec);
+
+	pspec = g_param_spec_uint ("tilesize-hidpi",
+	                           "HiDPI tile size",
+	                           "The size in pixels of the tiles from 'url-hidpi'",
+	                           1,  // minimum value,
+	                           G_MAXUINT16, // maximum value
+	                           512, // default value
+	                           G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+	g_object_class_install_property (object_class, PROP_TILESIZE_HIDPI, pspec);
+
 	object_class->finalize = vik_slippy_map_source_finalize;
 }
 
@@ -620,6 +670,73 @@ _get_lon_max (VikMapSource *self)
   return priv->lon_max;
 }
 
+/**
+ * A copy of this map except for the tiles' URL and pixel density
+ */
+static VikMapSource *
+_get_hidpi (VikMapSource *self)
+{
+	g_return_val_if_fail (VIK_IS_SLIPPY_MAP_SOURCE(self), NULL);
+	VikSlippyMapSourcePrivate *priv = VIK_SLIPPY_MAP_SOURCE_PRIVATE(self);
+
+	if ( priv->hidpi || !priv->url_hidpi )
+		return priv->hidpi;
+
+	guint16 id = vik_map_source_get_uniq_id ( self );
+	guint16 tilesize = vik_map_source_get_tilesize_x ( self );
+	if ( id >= MAP_ID_HIDPI_OFFSET || tilesize == 0 )
+		return NULL;
+
+	// Kept apart from the normal tiles in the caches by the id and the name
+	const gchar *name = vik_map_source_get_name ( self );
+	gchar *hidpi_name = name ? g_strdup_printf ( "%s@2x", name ) : NULL;
+	gchar *hidpi_label = g_strdup_printf ( "%s (HiDPI)", vik_map_source_get_label ( self ) );
+	const gchar *own[] = { "id", "name", "label", "url", "url-hidpi", "scale" };
+
+	guint n_pspecs = 0;
+	GParamSpec **pspecs = g_object_class_list_properties ( G_OBJECT_GET_CLASS(self), &n_pspecs );
+	GParameter *parameters = g_new0 ( GParameter, n_pspecs + G_N_ELEMENTS(own) );
+	guint nn = 0;
+	for ( guint pp = 0; pp < n_pspecs; pp++ ) {
+		if ( (pspecs[pp]->flags & G_PARAM_READWRITE) != G_PARAM_READWRITE )
+			continue;
+		gboolean skip = FALSE;
+		for ( guint oo = 0; oo < G_N_ELEMENTS(own); oo++ )
+			if ( !g_strcmp0 ( pspecs[pp]->name, own[oo] ) )
+				skip = TRUE;
+		if ( skip )
+			continue;
+		parameters[nn].name = pspecs[pp]->name;
+		g_value_init ( &parameters[nn].value, pspecs[pp]->value_type );
+		g_object_get_property ( G_OBJECT(self), pspecs[pp]->name, &parameters[nn].value );
+		nn++;
+	}
+	parameters[nn].name = "id";
+	g_value_init ( &parameters[nn].value, G_TYPE_UINT );
+	g_value_set_uint ( &parameters[nn++].value, id + MAP_ID_HIDPI_OFFSET );
+	parameters[nn].name = "name";
+	g_value_init ( &parameters[nn].value, G_TYPE_STRING );
+	g_value_take_string ( &parameters[nn++].value, hidpi_name );
+	parameters[nn].name = "label";
+	g_value_init ( &parameters[nn].value, G_TYPE_STRING );
+	g_value_take_string ( &parameters[nn++].value, hidpi_label );
+	parameters[nn].name = "url";
+	g_value_init ( &parameters[nn].value, G_TYPE_STRING );
+	g_value_set_string ( &parameters[nn++].value, priv->url_hidpi );
+	// The tiles keep the same nominal size, as they cover the same area, but have more pixels
+	parameters[nn].name = "scale";
+	g_value_init ( &parameters[nn].value, G_TYPE_DOUBLE );
+	g_value_set_double ( &parameters[nn++].value, (gdouble)priv->tilesize_hidpi / tilesize );
+
+	priv->hidpi = VIK_MAP_SOURCE ( g_object_newv ( G_OBJECT_TYPE(self), nn, parameters ) );
+
+	for ( guint pp = 0; pp < nn; pp++ )
+		g_value_unset ( &parameters[pp].value );
+	g_free ( parameters );
+	g_free ( pspecs );
+	return priv->hidpi;
+}
+
 static gboolean
 _coord_to_mapcoord ( VikMapSource *self, const VikCoord *src, gdouble xzoom, gdouble yzoom, MapCoord *dest )
 {
@@ -38,6 +38,104 @@
 #include "globals.h"
 #include "dems.h"
 #include "settings.h"
+#include "trwbinary.h"
+#include "stringpool.h"
+#include "gpx.h"
+
+struct _VikTrackPositions {
+  guint n;
+  GList **tpls;
+  gdouble *dist;        // Distance from the start including gaps, as per vik_track_get_length_including_gaps()
+  gdouble *length;      // Distance from the start excluding gaps, as per vik_track_get_length()
+  gboolean times_ordered; // All timestamps are valid and never decrease
+};
+
+static VikTrackPositions *track_get_positions ( VikTrack *tr );
+static gdouble *positions_get_times ( VikTrackPositions *vtp );
+static guint positions_search_dist ( VikTrackPositions *vtp, gdouble dist );
+static guint positions_interpolate ( VikTrackPositions *vtp, gdouble start, gdouble step, guint count, struct LatLon *lls );
+static void trackpoints_free ( GList *tps );
+
+/**
+ * vik_track_decode_extensions:
+ *
+ * Set the sensor values of the trackpoints (heart rate, cadence and so on)
+ *  from their GPX extensions, when this was left until needed on reading the file.
+ * Normally called automatically by the functions that use these values.
+ */
+void vik_track_decode_extensions ( VikTrack *tr )
+{
+  if ( !tr->extensions_pending )
+    return;
+  tr->extensions_pending = FALSE;
+  a_gpx_decode_trackpoint_extensions ( tr->trackpoints );
+  vik_track_clear_caches ( tr );
+}
+
+// Only a change to the cached state of the track, hence OK in functions of a const track
+static inline void track_decode_pending ( const VikTrack *tr )
+{
+  if ( G_UNLIKELY(tr->packed) )
+    vik_track_unpack ( (VikTrack*)tr );
+  if ( G_UNLIKELY(tr->extensions_pending) )
+    vik_track_decode_extensions ( (VikTrack*)tr );
+}
+
+/**
+ * vik_track_pack:
+ *
+ * Whilst a track is not going to be used (e.g. it is hidden and not being edited),
+ *  its trackpoints can be held in the compact binary form (see trwbinary.c) instead,
+ *  which is typically a tenth of the size.
+ * The bounds of the track remain available, but anything else needs vik_track_unpack() first.
+ * Only tracks in lat/lon coordinates are packed, as for these the binary form is lossless.
+ *
+ * Returns: Whether the track is now packed
+ */
+gboolean vik_track_pack ( VikTrack *tr )
+{
+  if ( tr->packed )
+    return TRUE;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next )
+    if ( VIK_TRACKPOINT(iter->data)->coord.mode != VIK_COORD_LATLON )
+      return FALSE;
+  if ( !tr->trackpoints )
+    return FALSE;
+
+  GByteArray *b = g_byte_array_new ();
+  a_trwbinary_write_track ( tr, b );
+  tr->packed = g_byte_array_free_to_bytes ( b );
+  trackpoints_free ( tr->trackpoints );
+  g_list_free ( tr->trackpoints );
+  tr->trackpoints = NULL;
+  vik_track_clear_caches ( tr );
+  return TRUE;
+}
+
+/**
+ * vik_track_unpack:
+ *
+ * Restore the trackpoints of a packed track, so it can be used normally again
+ */
+void vik_track_unpack ( VikTrack *tr )
+{
+  if ( G_LIKELY(!tr->packed) )
+    return;
+
+  gsize len;
+  const guint8 *data = g_bytes_get_data ( tr->packed, &len );
+  VikTrack *tmp = a_trwbinary_read_track ( data, len );
+  if ( tmp ) {
+    tr->trackpoints = tmp->trackpoints;
+    tmp->trackpoints = NULL;
+    vik_track_free ( tmp );
+  }
+  else
+    g_critical ( "%s: unable to unpack track %s", __FUNCTION__, tr->name );
+  g_bytes_unref ( tr->packed );
+  tr->packed = NULL;
+  vik_track_clear_caches ( tr );
+}
 
 VikTrack *vik_track_new()
 {
@@ -108,22 +206,20 @@ void vik_track_set_description(VikTrack *tr, const gchar *description)
 
 void vik_track_set_source(VikTrack *tr, const gchar *source)
 {
-  if ( tr->source )
-    g_free ( tr->source );
+  a_string_pool_release ( tr->source );
 
   if ( source && source[0] != '\0' )
-    tr->source = g_strdup(source);
+    tr->source = (gchar*)a_string_pool_intern ( source );
   else
     tr->source = NULL;
 }
 
 void vik_track_set_type(VikTrack *tr, const gchar *type)
 {
-  if ( tr->type )
-    g_free ( tr->type );
+  a_string_pool_release ( tr->type );
 
   if ( type && type[0] != '\0' )
-    tr->type = g_strdup(type);
+    tr->type = (gchar*)a_string_pool_intern ( type );
   else
     tr->type = NULL;
 }
@@ -139,9 +235,16 @@ void vik_track_set_extensions ( VikTrack *tr, const gchar *value )
     tr->extensions = NULL;
 }
 
+/**
+ * vik_track_ref:
+ *
+ * Safe to call from any thread, as is vik_track_free() for the final release.
+ * NB Holding a reference only keeps the track allocated,
+ *  for reading the trackpoints in another thread use vik_track_get_snapshot()
+ */
 void vik_track_ref(VikTrack *tr)
 {
-  tr->ref_count++;
+  g_atomic_int_inc ( &tr->ref_count );
 }
 
 void vik_track_set_property_dialog(VikTrack *tr, GtkWidget *dialog)
@@ -157,7 +260,7 @@ void vik_track_clear_property_dialog(VikTrack *tr)
 
 void vik_track_free(VikTrack *tr)
 {
-  if ( tr->ref_count-- > 1 )
+  if ( !g_atomic_int_dec_and_test ( &tr->ref_count ) )
     return;
 
   if ( tr->name )
@@ -166,14 +269,15 @@ void vik_track_free(VikTrack *tr)
     g_free ( tr->comment );
   if ( tr->description )
     g_free ( tr->description );
-  if ( tr->source )
-    g_free ( tr->source );
-  if ( tr->type )
-    g_free ( tr->type );
+  a_string_pool_release ( tr->source );
+  a_string_pool_release ( tr->type );
   if ( tr->extensions )
     g_free ( tr->extensions );
-  g_list_foreach ( tr->trackpoints, (GFunc) vik_trackpoint_free, NULL );
+  trackpoints_free ( tr->trackpoints );
   g_list_free( tr->trackpoints );
+  if ( tr->packed )
+    g_bytes_unref ( tr->packed );
+  vik_track_clear_caches ( tr );
   if (tr->property_dialog)
     if ( GTK_IS_WIDGET(tr->property_dialog) )
       gtk_widget_destroy ( GTK_WIDGET(tr->property_dialog) );
@@ -192,6 +296,8 @@ void vik_track_free(VikTrack *tr)
  */
 VikTrack *vik_track_copy ( const VikTrack *tr, gboolean copy_points )
 {
+  if ( copy_points && tr->packed )
+    vik_track_unpack ( (VikTrack*)tr );
   VikTrack *new_tr = vik_track_new();
   new_tr->visible = tr->visible;
   new_tr->is_route = tr->is_route;
@@ -201,6 +307,7 @@ VikTrack *vik_track_copy ( const VikTrack *tr, gboolean copy_points )
   new_tr->has_color = tr->has_color;
   new_tr->color = tr->color;
   new_tr->bbox = tr->bbox;
+  new_tr->extensions_pending = tr->extensions_pending;
   new_tr->trackpoints = NULL;
   if ( copy_points )
   {
@@ -223,9 +330,119 @@ VikTrack *vik_track_copy ( const VikTrack *tr, gboolean copy_points )
   return new_tr;
 }
 
+/*
+ * Trackpoints are allocated from blocks of many trackpoints,
+ *  since files and devices can supply millions of them
+ *  and allocating each one individually is a significant cost.
+ * Each block keeps a count of its trackpoints in use,
+ *  so a block is released as soon as all its trackpoints are freed
+ *  (e.g. when a track or layer is deleted).
+ * NB Thus trackpoints must only be freed via vik_trackpoint_free()
+ */
+#define TP_BLOCK_SIZE 1024
+
+typedef struct _TPBlock TPBlock;
+
+typedef struct {
+  TPBlock *block;
+  VikTrackpoint tp;
+} TPSlot;
+
+typedef union _TPFree TPFree;
+union _TPFree {
+  TPSlot slot;
+  struct {
+    TPBlock *block;
+    TPFree *next;
+  } link;
+};
+
+struct _TPBlock {
+  TPBlock *prev, *next; // In the list of blocks with space available
+  TPFree *free_slots;   // Slots that have been freed
+  guint fresh;          // Slots never yet used start from here
+  guint used;
+  TPFree slots[TP_BLOCK_SIZE];
+};
+
+static TPBlock *tp_blocks_available = NULL;
+G_LOCK_DEFINE_STATIC(tp_blocks);
+
+static VikTrackpoint *tp_block_alloc ( void )
+{
+  TPBlock *block;
+  TPFree *slot;
+
+  G_LOCK(tp_blocks);
+  block = tp_blocks_available;
+  if ( !block ) {
+    block = g_malloc ( sizeof(TPBlock) );
+    block->prev = block->next = NULL;
+    block->free_slots = NULL;
+    block->fresh = 0;
+    block->used = 0;
+    tp_blocks_available = block;
+  }
+
+  if ( block->free_slots ) {
+    slot = block->free_slots;
+    block->free_slots = slot->link.next;
+  }
+  else
+    slot = &block->slots[block->fresh++];
+  slot->slot.block = block;
+
+  // Full blocks are no longer considered for allocation
+  if ( ++block->used == TP_BLOCK_SIZE ) {
+    tp_blocks_available = block->next;
+    if ( block->next )
+      block->next->prev = NULL;
+    block->next = NULL;
+  }
+  G_UNLOCK(tp_blocks);
+
+  return &slot->slot.tp;
+}
+
+// NB Must be called holding the lock
+static void tp_block_release ( VikTrackpoint *tp )
+{
+  TPFree *slot = (TPFree*)((guint8*)tp - G_STRUCT_OFFSET(TPSlot, tp));
+  TPBlock *block = slot->slot.block;
+
+  gboolean was_full = (block->used == TP_BLOCK_SIZE);
+  block->used--;
+
+  if ( block->used == 0 ) {
+    if ( !was_full ) {
+      if ( block->prev )
+        block->prev->next = block->next;
+      else
+        tp_blocks_available = block->next;
+      if ( block->next )
+        block->next->prev = block->prev;
+    }
+    g_free ( block );
+    return;
+  }
+
+  slot->link.block = block;
+  slot->link.next = block->free_slots;
+  block->free_slots = slot;
+
+  if ( was_full ) {
+    block->prev = NULL;
+    block->next = tp_blocks_available;
+    if ( tp_blocks_available )
+      tp_blocks_available->prev = block;
+    tp_blocks_available = block;
+  }
+}
+
 VikTrackpoint *vik_trackpoint_new()
 {
-  VikTrackpoint *tp = g_malloc0(sizeof(VikTrackpoint));
+  VikTrackpoint *tp = tp_block_alloc ();
+  memset ( tp, 0, sizeof(VikTrackpoint) );
   tp->timestamp = NAN;
   tp->speed = NAN;
   tp->course = NAN;
@@ -242,8 +459,27 @@ VikTrackpoint *vik_trackpoint_new()
 void vik_trackpoint_free(VikTrackpoint *tp)
 {
   g_free(tp->name);
-  g_free(tp->extensions);
-  g_free(tp);
+  a_string_pool_release ( tp->extensions );
+  G_LOCK(tp_blocks);
+  tp_block_release ( tp );
+  G_UNLOCK(tp_blocks);
+}
+
+/**
+ * Free all the trackpoints of the list (but not the list itself)
+ */
+static void trackpoints_free ( GList *tps )
+{
+  for ( GList *iter = tps; iter; iter = iter->next ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    g_free ( tp->name );
+    a_string_pool_release ( tp->extensions );
+  }
+  // Only take the lock once for the whole list
+  G_LOCK(tp_blocks);
+  for ( GList *iter = tps; iter; iter = iter->next )
+    tp_block_release ( VIK_TRACKPOINT(iter->data) );
+  G_UNLOCK(tp_blocks);
 }
 
 void vik_trackpoint_set_name(VikTrackpoint *tp, const gchar *name)
@@ -262,14 +498,12 @@ void vik_trackpoint_set_name(VikTrackpoint *tp, const gchar *name)
 
 void vik_trackpoint_set_extensions(VikTrackpoint *tp, const gchar *value)
 {
-  if ( tp->extensions )
-    g_free ( tp->extensions );
+  // Often identical for many trackpoints, so these are shared
+  a_string_pool_release ( tp->extensions );
   if ( value && value[0] == '\0' )
     tp->extensions = NULL;
-  else if ( value )
-    tp->extensions = g_strdup ( value );
   else
-    tp->extensions = NULL;
+    tp->extensions = (gchar*)a_string_pool_intern ( value );
 }
 
 VikTrackpoint *vik_trackpoint_copy(VikTrackpoint *tp)
@@ -278,8 +512,7 @@ VikTrackpoint *vik_trackpoint_copy(VikTrackpoint *tp)
   memcpy ( new_tp, tp, sizeof(VikTrackpoint) );
   if ( tp->name )
     new_tp->name = g_strdup (tp->name);
-  if ( tp->extensions )
-    new_tp->extensions = g_strdup (tp->extensions);
+  new_tp->extensions = (gchar*)a_string_pool_intern ( tp->extensions );
   return new_tp;
 }
 
@@ -289,23 +522,38 @@ VikTrackpoint *vik_trackpoint_copy(VikTrackpoint *tp)
  *
  * A faster bounds check, since it only considers the last track point
  */
+static void track_bounds_add_tp ( VikTrack *trk, VikTrackpoint *tp )
+{
+  struct LatLon ll;
+  // See if this trackpoint increases the track bounds and update if so
+  vik_coord_to_latlon ( &(tp->coord), &ll );
+  if ( ll.lat > trk->bbox.north )
+    trk->bbox.north = ll.lat;
+  if ( ll.lon < trk->bbox.west )
+    trk->bbox.west = ll.lon;
+  if ( ll.lat < trk->bbox.south )
+    trk->bbox.south = ll.lat;
+  if ( ll.lon > trk->bbox.east )
+    trk->bbox.east = ll.lon;
+}
+
+/**
+ * Start the bounds afresh from the given trackpoint
+ */
+static void track_bbox_set_tp ( VikTrack *trk, VikTrackpoint *tp )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( &(tp->coord), &ll );
+  trk->bbox.north = trk->bbox.south = ll.lat;
+  trk->bbox.east = trk->bbox.west = ll.lon;
+}
+
 static void track_recalculate_bounds_last_tp ( VikTrack *trk )
 {
   GList *tpl = g_list_last ( trk->trackpoints );
 
-  if ( tpl ) {
-    struct LatLon ll;
-    // See if this trackpoint increases the track bounds and update if so
-    vik_coord_to_latlon ( &(VIK_TRACKPOINT(tpl->data)->coord), &ll );
-    if ( ll.lat > trk->bbox.north )
-      trk->bbox.north = ll.lat;
-    if ( ll.lon < trk->bbox.west )
-      trk->bbox.west = ll.lon;
-    if ( ll.lat < trk->bbox.south )
-      trk->bbox.south = ll.lat;
-    if ( ll.lon > trk->bbox.east )
-      trk->bbox.east = ll.lon;
-  }
+  if ( tpl )
+    track_bounds_add_tp ( trk, VIK_TRACKPOINT(tpl->data) );
 }
 
 /**
@@ -323,41 +571,64 @@ void vik_track_add_trackpoint ( VikTrack *tr, VikTrackpoint *tp, gboolean recalc
   // When it's the first trackpoint need to ensure the bounding box is initialized correctly
   gboolean adding_first_point = tr->trackpoints ? FALSE : TRUE;
   tr->trackpoints = g_list_append ( tr->trackpoints, tp );
+  vik_track_clear_caches ( tr );
   if ( adding_first_point )
     vik_track_calculate_bounds ( tr );
   else if ( recalculate )
     track_recalculate_bounds_last_tp ( tr );
 }
 
+/**
+ * vik_track_append_trackpoints:
+ * @tr:   The track to which the trackpoints will be added
+ * @tail: The last item of the track's trackpoint list if known, to save finding it
+ * @tpl:  The trackpoints to add - the list itself is taken over by the track
+ *
+ * Add many trackpoints to the end in one go, such as when continually recording,
+ *  only extending the bounds by the new trackpoints
+ *
+ * Returns: The new last item of the trackpoint list
+ */
+GList *vik_track_append_trackpoints ( VikTrack *tr, GList *tail, GList *tpl )
+{
+  if ( !tpl )
+    return tail;
+  gboolean adding_first_point = tr->trackpoints ? FALSE : TRUE;
+  if ( adding_first_point )
+    tr->trackpoints = tpl;
+  else {
+    if ( !tail )
+      tail = g_list_last ( tr->trackpoints );
+    tail->next = tpl;
+    tpl->prev = tail;
+  }
+  vik_track_clear_caches ( tr );
+  if ( adding_first_point )
+    vik_track_calculate_bounds ( tr );
+  for ( ; tpl; tpl = tpl->next ) {
+    if ( !adding_first_point )
+      track_bounds_add_tp ( tr, VIK_TRACKPOINT(tpl->data) );
+    tail = tpl;
+  }
+  return tail;
+}
+
 /**
  * vik_track_get_length_to_trackpoint:
  *
  */
 gdouble vik_track_get_length_to_trackpoint (const VikTrack *tr, const VikTrackpoint *tp)
 {
-  gdouble len = 0.0;
-  if ( tr->trackpoints )
-  {
-    // Is it the very first track point?
-    if ( VIK_TRACKPOINT(tr->trackpoints->data) == tp )
-      return len;
-
-    GList *iter = tr->trackpoints->next;
-    while (iter)
-    {
-      VikTrackpoint *tp1 = VIK_TRACKPOINT(iter->data);
-      if ( ! tp1->newsegment )
-        len += vik_coord_diff ( &(tp1->coord),
-                                &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-
-      // Exit when we reach the desired point
-      if ( tp1 == tp )
-        break;
+  if ( !tr->trackpoints )
+    return 0.0;
 
-      iter = iter->next;
-    }
-  }
-  return len;
+  // The distances are only a cache of the track, hence OK to generate them here
+  VikTrackPositions *vtp = track_get_positions ( (VikTrack*)tr );
+  guint ii = 0;
+  // NB If not found it's the whole length
+  while ( ii < vtp->n-1 && vtp->tpls[ii]->data != tp )
+    ii++;
+  return vtp->length[ii];
 }
 
 gdouble vik_track_get_length(const VikTrack *tr)
@@ -369,7 +640,7 @@ gdouble vik_track_get_length(const VikTrack *tr)
     while (iter)
     {
       if ( ! VIK_TRACKPOINT(iter->data)->newsegment )
-        len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
+        len += vik_coord_diff_fast ( &(VIK_TRACKPOINT(iter->data)->coord),
                                 &(VIK_TRACKPOINT(iter->prev->data)->coord) );
       iter = iter->next;
     }
@@ -385,7 +656,7 @@ gdouble vik_track_get_length_including_gaps(const VikTrack *tr)
     GList *iter = tr->trackpoints->next;
     while (iter)
     {
-      len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
+      len += vik_coord_diff_fast ( &(VIK_TRACKPOINT(iter->data)->coord),
                               &(VIK_TRACKPOINT(iter->prev->data)->coord) );
       iter = iter->next;
     }
@@ -418,29 +689,8 @@ gulong vik_track_get_dup_point_count ( const VikTrack *tr )
  */
 gulong vik_track_remove_dup_points ( VikTrack *tr )
 {
-  gulong num = 0;
-  GList *iter = tr->trackpoints;
-  while ( iter )
-  {
-    if ( iter->next && vik_coord_equals ( &(VIK_TRACKPOINT(iter->data)->coord),
-                       &(VIK_TRACKPOINT(iter->next->data)->coord) ) )
-    {
-      num++;
-      // Maintain track segments
-      if ( VIK_TRACKPOINT(iter->next->data)->newsegment && (iter->next)->next )
-        VIK_TRACKPOINT(((iter->next)->next)->data)->newsegment = TRUE;
-
-      vik_trackpoint_free ( iter->next->data );
-      tr->trackpoints = g_list_delete_link ( tr->trackpoints, iter->next );
-    }
-    else
-      iter = iter->next;
-  }
-
-  // NB isn't really be necessary as removing duplicate points shouldn't alter the bounds!
-  vik_track_calculate_bounds ( tr );
-
-  return num;
+  // NB removing duplicate points doesn't alter the bounds
+  return vik_track_tidy ( tr, VIK_TRACK_TIDY_DUP_POINTS, 0, FALSE );
 }
 
 /*
@@ -469,31 +719,7 @@ gulong vik_track_get_same_time_point_count ( const VikTrack *tr )
  */
 gulong vik_track_remove_same_time_points ( VikTrack *tr )
 {
-  gulong num = 0;
-  GList *iter = tr->trackpoints;
-  while ( iter ) {
-    if ( iter->next &&
-	 ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) &&
-           !isnan(VIK_TRACKPOINT(iter->next->data)->timestamp) ) &&
-         ( VIK_TRACKPOINT(iter->data)->timestamp ==
-           VIK_TRACKPOINT(iter->next->data)->timestamp) ) {
-
-      num++;
-      
-      // Maintain track segments
-      if ( VIK_TRACKPOINT(iter->next->data)->newsegment && (iter->next)->next )
-        VIK_TRACKPOINT(((iter->next)->next)->data)->newsegment = TRUE;
-
-      vik_trackpoint_free ( iter->next->data );
-      tr->trackpoints = g_list_delete_link ( tr->trackpoints, iter->next );
-    }
-    else
-      iter = iter->next;
-  }
-
-  vik_track_calculate_bounds ( tr );
-
-  return num;
+  return vik_track_tidy ( tr, VIK_TRACK_TIDY_SAME_TIME_POINTS, 0, TRUE );
 }
 
 /**
@@ -515,33 +741,93 @@ gulong vik_track_remove_same_time_points ( VikTrack *tr )
  */
 gboolean vik_track_remove_dodgy_first_point ( VikTrack *vt, guint speed, gboolean recalc_bounds )
 {
-  gboolean deleted = FALSE;
+  return vik_track_tidy ( vt, VIK_TRACK_TIDY_DODGY_FIRST_POINT, speed, recalc_bounds ) > 0;
+}
 
-  if ( vt->trackpoints ) {
-    GList *iter = g_list_first ( vt->trackpoints );
-    VikTrackpoint *tp1 = VIK_TRACKPOINT(iter->data);
+/**
+ * Whether the first trackpoint is too far away in time from the second,
+ *  see vik_track_remove_dodgy_first_point()
+ */
+static gboolean track_first_point_dodgy ( GList *first, guint speed )
+{
+  VikTrackpoint *tp1 = VIK_TRACKPOINT(first->data);
+  if ( isnan(tp1->timestamp) || !first->next )
+    return FALSE;
+  VikTrackpoint *tp2 = VIK_TRACKPOINT(first->next->data);
+  if ( isnan(tp2->timestamp) )
+    return FALSE;
 
-    if ( !isnan(tp1->timestamp) ) {
-      if ( iter->next ) {
-        VikTrackpoint *tp2 = VIK_TRACKPOINT(iter->next->data);
-        if ( !isnan(tp2->timestamp) ) {
-          gdouble dist_diff = vik_coord_diff ( &tp1->coord, &tp2->coord );
-          gdouble time_diff = tp2->timestamp - tp1->timestamp;
-
-	  gdouble spd = fabs(dist_diff / time_diff);
-          if ( spd > speed ) {
-            deleted = TRUE;
-            vik_trackpoint_free ( tp1 );
-            vt->trackpoints = g_list_delete_link ( vt->trackpoints, iter );
-            if ( recalc_bounds )
-              vik_track_calculate_bounds ( vt );
-	  }
-	}
+  gdouble dist_diff = vik_coord_diff_fast ( &tp1->coord, &tp2->coord );
+  gdouble time_diff = tp2->timestamp - tp1->timestamp;
+  gdouble spd = fabs(dist_diff / time_diff);
+  return spd > speed;
+}
+
+/**
+ * vik_track_tidy:
+ * @tr:            The track
+ * @flags:         Which of the #VikTrackTidyFlags removals to apply
+ * @speed:         Maximum speed in m/s for %VIK_TRACK_TIDY_DODGY_FIRST_POINT
+ * @recalc_bounds: Whether track bounds should be recalculated when points are removed
+ *
+ * Apply several of the trackpoint removals in a single pass, relinking the trackpoint list in place.
+ * Each trackpoint is compared to the last one kept,
+ *  and the segment start of any point removed moves on to the next one kept.
+ * The tracks are independent, so different tracks may be tidied by different threads at once.
+ *
+ * Returns: The number of trackpoints removed
+ */
+gulong vik_track_tidy ( VikTrack *tr, VikTrackTidyFlags flags, guint speed, gboolean recalc_bounds )
+{
+  gulong num = 0;
+  GList *iter = tr->trackpoints;
+  if ( !iter )
+    return num;
+
+  if ( (flags & VIK_TRACK_TIDY_DODGY_FIRST_POINT) && track_first_point_dodgy ( iter, speed ) ) {
+    tr->trackpoints = iter->next;
+    tr->trackpoints->prev = NULL;
+    vik_trackpoint_free ( iter->data );
+    g_list_free_1 ( iter );
+    num++;
+  }
+
+  GList *kept = tr->trackpoints;
+  gboolean newsegment = FALSE;
+  iter = kept->next;
+  while ( iter ) {
+    GList *next = iter->next;
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    VikTrackpoint *tp_kept = VIK_TRACKPOINT(kept->data);
+    if ( ( (flags & VIK_TRACK_TIDY_DUP_POINTS) && vik_coord_equals ( &tp_kept->coord, &tp->coord ) ) ||
+         ( (flags & VIK_TRACK_TIDY_SAME_TIME_POINTS) &&
+           !isnan(tp_kept->timestamp) && !isnan(tp->timestamp) && tp_kept->timestamp == tp->timestamp ) ) {
+      num++;
+      // Maintain track segments
+      newsegment = newsegment || tp->newsegment;
+      vik_trackpoint_free ( tp );
+      g_list_free_1 ( iter );
+    }
+    else {
+      if ( newsegment ) {
+        tp->newsegment = TRUE;
+        newsegment = FALSE;
       }
+      kept->next = iter;
+      iter->prev = kept;
+      kept = iter;
     }
+    iter = next;
   }
+  kept->next = NULL;
 
-  return deleted;
+  if ( num ) {
+    if ( recalc_bounds )
+      vik_track_calculate_bounds ( tr );
+    else
+      vik_track_clear_caches ( tr );
+  }
+  return num;
 }
 
 /*
@@ -551,6 +837,7 @@ gboolean vik_track_remove_dodgy_first_point ( VikTrack *vt, guint speed, gboolea
  */
 void vik_track_to_routepoints ( VikTrack *tr )
 {
+  vik_track_clear_caches ( tr );
   GList *iter = tr->trackpoints;
   while ( iter ) {
 
@@ -563,7 +850,7 @@ void vik_track_to_routepoints ( VikTrack *tr )
     VIK_TRACKPOINT(iter->data)->pdop = NAN;
     VIK_TRACKPOINT(iter->data)->nsats = 0;
     VIK_TRACKPOINT(iter->data)->fix_mode = VIK_GPS_MODE_NOT_SEEN;
-    g_free ( VIK_TRACKPOINT(iter->data)->extensions );
+    a_string_pool_release ( VIK_TRACKPOINT(iter->data)->extensions );
     VIK_TRACKPOINT(iter->data)->extensions = NULL;
     VIK_TRACKPOINT(iter->data)->heart_rate = 0;
     VIK_TRACKPOINT(iter->data)->cadence = VIK_TRKPT_CADENCE_NONE;
@@ -591,7 +878,6 @@ guint vik_track_get_segment_count(const VikTrack *tr)
 VikTrack **vik_track_split_into_segments(VikTrack *t, guint *ret_len)
 {
   VikTrack **rv;
-  VikTrack *tr;
   guint i;
   guint segs = vik_track_get_segment_count(t);
   GList *iter;
@@ -602,25 +888,27 @@ VikTrack **vik_track_split_into_segments(VikTrack *t, guint *ret_len)
     return NULL;
   }
 
+  // Copy the trackpoints straight into each segment's track in one pass,
+  //  accumulating the bounds of each segment on the way
   rv = g_malloc ( segs * sizeof(VikTrack *) );
-  tr = vik_track_copy ( t, TRUE );
-  rv[0] = tr;
-  iter = tr->trackpoints;
-
-  i = 1;
-  while ( (iter = iter->next) )
+  i = 0;
+  GList *tail = NULL;
+  for ( iter = t->trackpoints; iter; iter = iter->next )
   {
-    if ( VIK_TRACKPOINT(iter->data)->newsegment )
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    if ( !tail || tp->newsegment )
     {
-      iter->prev->next = NULL;
-      iter->prev = NULL;
-      rv[i] = vik_track_copy ( tr, FALSE );
-      rv[i]->trackpoints = iter;
-
-      vik_track_calculate_bounds ( rv[i] );
-
+      rv[i] = vik_track_copy ( t, FALSE );
+      tail = rv[i]->trackpoints = g_list_alloc ();
+      tail->data = vik_trackpoint_copy ( tp );
+      track_bbox_set_tp ( rv[i], tp );
       i++;
     }
+    else
+    {
+      tail = g_list_append ( tail, vik_trackpoint_copy ( tp ) )->next;
+      track_bounds_add_tp ( rv[i-1], tp );
+    }
   }
   *ret_len = segs;
   return rv;
@@ -632,6 +920,7 @@ VikTrack **vik_track_split_into_segments(VikTrack *t, guint *ret_len)
  */
 guint vik_track_merge_segments(VikTrack *tr)
 {
+  vik_track_clear_caches ( tr );
   guint num = 0;
   GList *iter = tr->trackpoints;
   if ( !iter )
@@ -655,23 +944,22 @@ void vik_track_reverse ( VikTrack *tr )
   if ( ! tr->trackpoints )
     return;
 
-  tr->trackpoints = g_list_reverse(tr->trackpoints);
-
-  /* fix 'newsegment' */
-  GList *iter = g_list_last ( tr->trackpoints );
+  /* fix 'newsegment' in the same pass as reversing the list:
+     a segment now starts where one used to end */
+  GList *iter = tr->trackpoints;
+  GList *prev = NULL;
   while ( iter )
   {
-    if ( ! iter->next ) /* last segment, was first, cancel newsegment. */
-      VIK_TRACKPOINT(iter->data)->newsegment = FALSE;
-    if ( ! iter->prev ) /* first segment by convention has newsegment flag. */
-      VIK_TRACKPOINT(iter->data)->newsegment = TRUE;
-    else if ( VIK_TRACKPOINT(iter->data)->newsegment && iter->next )
-    {
-      VIK_TRACKPOINT(iter->next->data)->newsegment = TRUE;
-      VIK_TRACKPOINT(iter->data)->newsegment = FALSE;
-    }
-    iter = iter->prev;
+    GList *next = iter->next;
+    /* the last segment, was first - by convention the first has the newsegment flag */
+    VIK_TRACKPOINT(iter->data)->newsegment = ! next || VIK_TRACKPOINT(next->data)->newsegment;
+    iter->next = prev;
+    iter->prev = next;
+    prev = iter;
+    iter = next;
   }
+  tr->trackpoints = prev;
+  vik_track_clear_caches ( tr );
 }
 
 /**
@@ -728,7 +1016,7 @@ gdouble vik_track_get_average_speed(const VikTrack *tr)
            !isnan(VIK_TRACKPOINT(iter->prev->data)->timestamp) &&
           (! VIK_TRACKPOINT(iter->data)->newsegment) )
       {
-        len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
+        len += vik_coord_diff_fast ( &(VIK_TRACKPOINT(iter->data)->coord),
                                 &(VIK_TRACKPOINT(iter->prev->data)->coord) );
         time += ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
       }
@@ -762,7 +1050,7 @@ gdouble vik_track_get_average_speed_moving (const VikTrack *tr, int stop_length_
           (! VIK_TRACKPOINT(iter->data)->newsegment) )
       {
 	if ( ( VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp ) < stop_length_seconds ) {
-	  len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
+	  len += vik_coord_diff_fast ( &(VIK_TRACKPOINT(iter->data)->coord),
 				  &(VIK_TRACKPOINT(iter->prev->data)->coord) );
 	
 	  time += ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
@@ -786,7 +1074,7 @@ gdouble vik_track_get_max_speed(const VikTrack *tr)
            !isnan(VIK_TRACKPOINT(iter->prev->data)->timestamp) &&
           (! VIK_TRACKPOINT(iter->data)->newsegment) )
       {
-        speed =  vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) )
+        speed =  vik_coord_diff_fast ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) )
                  / ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
         if ( speed > maxspeed )
           maxspeed = speed;
@@ -797,9 +1085,152 @@ gdouble vik_track_get_max_speed(const VikTrack *tr)
   return maxspeed;
 }
 
+/**
+ * Gather all the summary values in one walk of the trackpoints
+ */
+static void track_summary_calculate ( const VikTrack *tr, VikTrackSummary *summary )
+{
+  memset ( summary, 0, sizeof(VikTrackSummary) );
+  summary->min_alt = 25000;
+  summary->max_alt = -5000;
+  summary->min_temp = 274;
+  summary->max_temp = -274;
+  summary->max_cadence = VIK_TRKPT_CADENCE_NONE;
+  summary->max_power = VIK_TRKPT_POWER_NONE;
+
+  gdouble speed_len = 0.0, speed_time = 0.0;
+  gdouble moving_len = 0.0, moving_time = 0.0;
+  gulong hr_count = 0, cad_count = 0, temp_count = 0, pow_count = 0;
+  gdouble hr_sum = 0.0, cad_sum = 0.0, temp_sum = 0.0, pow_sum = 0.0;
+
+  VikTrackpoint *tp2 = NULL;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next ) {
+    VikTrackpoint *tp1 = VIK_TRACKPOINT(iter->data);
+    summary->tp_count++;
+    if ( !isnan(tp1->altitude) ) {
+      if ( tp1->altitude > summary->max_alt )
+        summary->max_alt = tp1->altitude;
+      if ( tp1->altitude < summary->min_alt )
+        summary->min_alt = tp1->altitude;
+    }
+    if ( !tp2 ) {
+      summary->segment_count = 1;
+      tp2 = tp1;
+      continue;
+    }
+
+    // NB (as per the individual functions) these values skip the first trackpoint
+    if ( tp1->heart_rate > summary->max_heart_rate )
+      summary->max_heart_rate = tp1->heart_rate;
+    if ( (gint)tp1->heart_rate > 0 ) {
+      hr_sum += tp1->heart_rate;
+      hr_count++;
+    }
+    if ( tp1->cadence > summary->max_cadence )
+      summary->max_cadence = tp1->cadence;
+    if ( tp1->cadence != VIK_TRKPT_CADENCE_NONE ) {
+      cad_sum += tp1->cadence;
+      cad_count++;
+    }
+    if ( !isnan(tp1->temp) ) {
+      if ( tp1->temp > summary->max_temp )
+        summary->max_temp = tp1->temp;
+      if ( tp1->temp < summary->min_temp )
+        summary->min_temp = tp1->temp;
+      temp_sum += tp1->temp;
+      temp_count++;
+    }
+    if ( tp1->power > summary->max_power )
+      summary->max_power = tp1->power;
+    if ( tp1->power != VIK_TRKPT_POWER_NONE ) {
+      pow_sum += tp1->power;
+      pow_count++;
+    }
+
+    if ( vik_coord_equals ( &(tp2->coord), &(tp1->coord) ) )
+      summary->dup_point_count++;
+
+    gdouble diff = vik_coord_diff_fast ( &(tp1->coord), &(tp2->coord) );
+    summary->length_inc_gaps += diff;
+
+    if ( tp1->newsegment )
+      summary->segment_count++;
+    else {
+      summary->length += diff;
+      if ( !isnan(tp1->timestamp) && !isnan(tp2->timestamp) ) {
+        gdouble dt = ABS(tp1->timestamp - tp2->timestamp);
+        gdouble speed = diff / dt;
+        if ( speed > summary->max_speed )
+          summary->max_speed = speed;
+        speed_len += diff;
+        speed_time += dt;
+        if ( (tp1->timestamp - tp2->timestamp) < VIK_TRACK_SUMMARY_STOP_LENGTH ) {
+          moving_len += diff;
+          moving_time += dt;
+        }
+      }
+    }
+
+    if ( !isnan(tp1->altitude) && !isnan(tp2->altitude) ) {
+      gdouble elev = tp1->altitude - tp2->altitude;
+      if ( elev > 0 )
+        summary->elev_up += elev;
+      else
+        summary->elev_down -= elev;
+    }
+    tp2 = tp1;
+  }
+
+  summary->start_time = summary->end_time = NAN;
+  if ( tr->trackpoints ) {
+    summary->start_time = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
+    summary->end_time = tp2->timestamp;
+  }
+
+  if ( !tr->trackpoints )
+    summary->elev_up = summary->elev_down = NAN;
+  summary->has_alt = (summary->min_alt != 25000);
+
+  // Duration only counts when the track starts with a time
+  if ( tr->trackpoints && !isnan(VIK_TRACKPOINT(tr->trackpoints->data)->timestamp) )
+    summary->duration = speed_time;
+  summary->avg_speed = (speed_time == 0) ? 0 : ABS(speed_len/speed_time);
+  summary->avg_speed_moving = (moving_time == 0) ? 0 : ABS(moving_len/moving_time);
+
+  summary->avg_heart_rate = hr_count ? hr_sum / hr_count : NAN;
+  summary->avg_cadence = cad_count ? cad_sum / cad_count : NAN;
+  summary->avg_temp = temp_count ? temp_sum / temp_count : NAN;
+  summary->avg_power = pow_count ? pow_sum / pow_count : NAN;
+  summary->has_temp = (temp_count > 0);
+  if ( !summary->has_temp )
+    summary->min_temp = summary->max_temp = NAN;
+}
+
+/**
+ * vik_track_get_summary:
+ *
+ * Fill in the common statistics of the track,
+ *  giving the same results as the individual functions but only walking the trackpoints once
+ *  and computing each distance once.
+ * The result is remembered until the trackpoints are changed (see vik_track_clear_caches()).
+ * Use this when several of these values are wanted, especially for large numbers of trackpoints.
+ */
+void vik_track_get_summary ( const VikTrack *tr, VikTrackSummary *summary )
+{
+  track_decode_pending ( tr );
+  if ( !tr->summary ) {
+    // Only a cache of the track, hence OK to store here
+    VikTrack *trk = (VikTrack*)tr;
+    trk->summary = g_malloc ( sizeof(VikTrackSummary) );
+    track_summary_calculate ( tr, trk->summary );
+  }
+  *summary = *tr->summary;
+}
+
 // Returns 0 if not available
 guint vik_track_get_max_heart_rate ( const VikTrack *tr )
 {
+  track_decode_pending ( tr );
   guint max = 0, val;
   if ( tr->trackpoints ) {
     GList *iter = tr->trackpoints->next;
@@ -824,6 +1255,7 @@ guint vik_track_get_max_heart_rate ( const VikTrack *tr )
 // Returns NAN if not available
 gdouble vik_track_get_avg_heart_rate ( const VikTrack *tr )
 {
+  track_decode_pending ( tr );
   gdouble avg = 0.0;
   gulong count = 0;
   gint val;
@@ -845,6 +1277,7 @@ gdouble vik_track_get_avg_heart_rate ( const VikTrack *tr )
 
 VikTrackpoint *vik_track_get_tp_by_max_heart_rate ( const VikTrack *tr )
 {
+  track_decode_pending ( tr );
   VikTrackpoint *tp = NULL;
   guint max = 0, val;
   if ( tr->trackpoints ) {
@@ -871,6 +1304,7 @@ VikTrackpoint *vik_track_get_tp_by_max_heart_rate ( const VikTrack *tr )
  */
 gdouble *vik_track_make_time_map_for ( const VikTrack *tr, guint16 num_chunks, VikTrackValueType value_type )
 {
+  track_decode_pending ( tr );
   GList *iter = tr->trackpoints;
   if ( !iter || !iter->next ) // zero or one-point track
     return NULL;
@@ -995,6 +1429,7 @@ gdouble *vik_track_make_time_map_for ( const VikTrack *tr, guint16 num_chunks, V
 // Returns VIK_TRKPT_CADENCE_NONE if not valid
 gint vik_track_get_max_cadence ( const VikTrack *tr )
 {
+  track_decode_pending ( tr );
   gint max = VIK_TRKPT_CADENCE_NONE, val;
   if ( tr->trackpoints ) {
     GList *iter = tr->trackpoints->next;
@@ -1011,6 +1446,7 @@ gint vik_track_get_max_cadence ( const VikTrack *tr )
 // Returns VIK_TRKPT_CADENCE_NONE if not valid
 gdouble vik_track_get_avg_cadence ( const VikTrack *tr )
 {
+  track_decode_pending ( tr );
   gdouble avg = 0;
   gint val;
   gulong count = 0;
@@ -1032,6 +1468,7 @@ gdouble vik_track_get_avg_cadence ( const VikTrack *tr )
 
 VikTrackpoint *vik_track_get_tp_by_max_cadence ( const VikTrack *tr )
 {
+  track_decode_pending ( tr );
   VikTrackpoint *tp = NULL;
   gint max = VIK_TRKPT_CADENCE_NONE, val;
   if ( tr->trackpoints ) {
@@ -1057,6 +1494,7 @@ VikTrackpoint *vik_track_get_tp_by_max_cadence ( const VikTrack *tr )
  */
 gboolean vik_track_get_minmax_temp ( const VikTrack *tr, gdouble *min_temp, gdouble *max_temp )
 {
+  track_decode_pending ( tr );
   gdouble max = -274;
   gdouble min = 274;
   gdouble val;
@@ -1087,6 +1525,7 @@ gboolean vik_track_get_minmax_temp ( const VikTrack *tr, gdouble *min_temp, gdou
 
 VikTrackpoint *vik_track_get_tp_by_min_temp ( const VikTrack *tr )
 {
+  track_decode_pending ( tr );
   VikTrackpoint *tp = NULL;
   gdouble min = 274, val;
   if ( tr->trackpoints ) {
@@ -1105,6 +1544,7 @@ VikTrackpoint *vik_track_get_tp_by_min_temp ( const VikTrack *tr )
 
 VikTrackpoint *vik_track_get_tp_by_max_temp ( const VikTrack *tr )
 {
+  track_decode_pending ( tr );
   VikTrackpoint *tp = NULL;
   gdouble max = -273, val;
   if ( tr->trackpoints ) {
@@ -1124,6 +1564,7 @@ VikTrackpoint *vik_track_get_tp_by_max_temp ( const VikTrack *tr )
 // Returns NAN if not available
 gdouble vik_track_get_avg_temp ( const VikTrack *tr )
 {
+  track_decode_pending ( tr );
   gdouble avg = 0, val;
   gulong count = 0;
   if ( tr->trackpoints ) {
@@ -1145,6 +1586,7 @@ gdouble vik_track_get_avg_temp ( const VikTrack *tr )
 // Returns VIK_TRKPT_POWER_NONE if not valid
 gint vik_track_get_max_power ( const VikTrack *tr )
 {
+  track_decode_pending ( tr );
   gint max = VIK_TRKPT_POWER_NONE, val;
   if ( tr->trackpoints ) {
     GList *iter = tr->trackpoints->next;
@@ -1162,6 +1604,7 @@ gint vik_track_get_max_power ( const VikTrack *tr )
 // Returns VIK_TRKPT_POWER_NONE if not valid
 gdouble vik_track_get_avg_power ( const VikTrack *tr )
 {
+  track_decode_pending ( tr );
   gdouble avg = 0;
   gint val;
   gulong count = 0;
@@ -1183,6 +1626,7 @@ gdouble vik_track_get_avg_power ( const VikTrack *tr )
 
 VikTrackpoint *vik_track_get_tp_by_max_power ( const VikTrack *tr )
 {
+  track_decode_pending ( tr );
   VikTrackpoint *tp = NULL;
   gint max = VIK_TRKPT_POWER_NONE, val;
   if ( tr->trackpoints ) {
@@ -1201,12 +1645,17 @@ VikTrackpoint *vik_track_get_tp_by_max_power ( const VikTrack *tr )
 
 void vik_track_convert ( VikTrack *tr, VikCoordMode dest_mode )
 {
-  GList *iter = tr->trackpoints;
-  while (iter)
-  {
-    vik_coord_convert ( &(VIK_TRACKPOINT(iter->data)->coord), dest_mode );
-    iter = iter->next;
+  VikCoord *coords[256];
+  guint nn = 0;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next ) {
+    coords[nn++] = &(VIK_TRACKPOINT(iter->data)->coord);
+    if ( nn == G_N_ELEMENTS(coords) ) {
+      vik_coord_convert_array ( coords, nn, dest_mode );
+      nn = 0;
+    }
   }
+  vik_coord_convert_array ( coords, nn, dest_mode );
+  vik_track_clear_caches ( tr );
 }
 
 /* I understood this when I wrote it ... maybe ... Basically it eats up the
@@ -1245,9 +1694,13 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
 
   iter = tr->trackpoints;
 
+  // The map functions only read the cached distances, so share them rather than recomputing for every graph
+  VikTrackPositions *vtp = track_get_positions ( (VikTrack*)tr );
+  guint kk = 0; // Index of iter
+
   pts = g_malloc ( sizeof(gdouble) * num_chunks );
 
-  total_length = vik_track_get_length_including_gaps ( tr );
+  total_length = vtp->dist[vtp->n-1];
   chunk_length = total_length / num_chunks;
 
   /* Zero chunk_length (eg, track of 2 tp with the same loc) will cause crash */
@@ -1261,8 +1714,7 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
   current_chunk = 0;
   current_seg_length = 0;
 
-  current_seg_length = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-      &(VIK_TRACKPOINT(iter->next->data)->coord) );
+  current_seg_length = vtp->dist[1] - vtp->dist[0];
   altitude1 = VIK_TRACKPOINT(iter->data)->altitude;
   altitude2 = VIK_TRACKPOINT(iter->next->data)->altitude;
   dist_along_seg = 0;
@@ -1299,9 +1751,9 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
 
       /* get intervening segs */
       iter = iter->next;
+      kk++;
       while ( iter && iter->next ) {
-        current_seg_length = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-            &(VIK_TRACKPOINT(iter->next->data)->coord) );
+        current_seg_length = vtp->dist[kk+1] - vtp->dist[kk];
         altitude1 = VIK_TRACKPOINT(iter->data)->altitude;
         altitude2 = VIK_TRACKPOINT(iter->next->data)->altitude;
         ignore_it = VIK_TRACKPOINT(iter->next->data)->newsegment;
@@ -1310,6 +1762,7 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
           current_dist += current_seg_length;
           current_area_under_curve += current_seg_length * (altitude1+altitude2) * 0.5;
           iter = iter->next;
+          kk++;
         } else {
           break;
         }
@@ -1377,7 +1830,10 @@ gdouble *vik_track_make_gradient_map ( const VikTrack *tr, guint16 num_chunks )
 
   g_return_val_if_fail ( num_chunks < MAX_NUM_CHUNKS, NULL );
 
-  total_length = vik_track_get_length_including_gaps ( tr );
+  if ( !tr->trackpoints )
+    return NULL;
+  VikTrackPositions *vtp = track_get_positions ( (VikTrack*)tr );
+  total_length = vtp->dist[vtp->n-1];
   chunk_length = total_length / num_chunks;
 
   /* Zero chunk_length (eg, track of 2 tp with the same loc) will cause crash */
@@ -1412,8 +1868,7 @@ gdouble *vik_track_make_speed_map ( const VikTrack *tr, guint16 num_chunks )
 {
   gdouble *v, *s, *t;
   gdouble duration, chunk_dur;
-  int i, pt_count, numpts, index;
-  GList *iter;
+  int i, index;
 
   if ( ! tr->trackpoints )
     return NULL;
@@ -1431,25 +1886,14 @@ gdouble *vik_track_make_speed_map ( const VikTrack *tr, guint16 num_chunks )
     g_warning("negative duration: unsorted trackpoint timestamps?");
     return NULL;
   }
-  pt_count = vik_track_get_tp_count(tr);
+  VikTrackPositions *vtp = track_get_positions ( (VikTrack*)tr );
 
   v = g_malloc ( sizeof(gdouble) * num_chunks );
   chunk_dur = duration / num_chunks;
 
-  s = g_malloc(sizeof(double) * pt_count);
-  t = g_malloc(sizeof(double) * pt_count);
-
-  iter = tr->trackpoints->next;
-  numpts = 0;
-  s[0] = 0;
-  t[0] = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  numpts++;
-  while (iter) {
-    s[numpts] = s[numpts-1] + vik_coord_diff ( &(VIK_TRACKPOINT(iter->prev->data)->coord), &(VIK_TRACKPOINT(iter->data)->coord) );
-    t[numpts] = VIK_TRACKPOINT(iter->data)->timestamp;
-    numpts++;
-    iter = iter->next;
-  }
+  // Cumulative distances are shared, only the times need gathering
+  s = vtp->dist;
+  t = positions_get_times ( vtp );
 
   /* In the following computation, we iterate through periods of time of duration chunk_dur.
    * The first period begins at the beginning of the track.  The last period ends at the end of the track.
@@ -1475,7 +1919,6 @@ gdouble *vik_track_make_speed_map ( const VikTrack *tr, guint16 num_chunks )
       v[i] = 0;
     }
   }
-  g_free(s);
   g_free(t);
   return v;
 }
@@ -1487,8 +1930,7 @@ gdouble *vik_track_make_distance_map ( const VikTrack *tr, guint16 num_chunks )
 {
   gdouble *v, *s, *t;
   gdouble duration, chunk_dur;
-  int i, pt_count, numpts, index;
-  GList *iter;
+  int i, index;
 
   if ( ! tr->trackpoints )
     return NULL;
@@ -1505,25 +1947,14 @@ gdouble *vik_track_make_distance_map ( const VikTrack *tr, guint16 num_chunks )
     g_warning("negative duration: unsorted trackpoint timestamps?");
     return NULL;
   }
-  pt_count = vik_track_get_tp_count(tr);
+  VikTrackPositions *vtp = track_get_positions ( (VikTrack*)tr );
 
   v = g_malloc ( sizeof(gdouble) * num_chunks );
   chunk_dur = duration / num_chunks;
 
-  s = g_malloc(sizeof(double) * pt_count);
-  t = g_malloc(sizeof(double) * pt_count);
-
-  iter = tr->trackpoints->next;
-  numpts = 0;
-  s[0] = 0;
-  t[0] = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  numpts++;
-  while (iter) {
-    s[numpts] = s[numpts-1] + vik_coord_diff ( &(VIK_TRACKPOINT(iter->prev->data)->coord), &(VIK_TRACKPOINT(iter->data)->coord) );
-    t[numpts] = VIK_TRACKPOINT(iter->data)->timestamp;
-    numpts++;
-    iter = iter->next;
-  }
+  // Cumulative distances are shared, only the times need gathering
+  s = vtp->dist;
+  t = positions_get_times ( vtp );
 
   /* In the following computation, we iterate through periods of time of duration chunk_dur.
    * The first period begins at the beginning of the track.  The last period ends at the end of the track.
@@ -1549,7 +1980,6 @@ gdouble *vik_track_make_distance_map ( const VikTrack *tr, guint16 num_chunks )
       v[i] = 0;
     }
   }
-  g_free(s);
   g_free(t);
   return v;
 }
@@ -1560,8 +1990,7 @@ gdouble *vik_track_make_distance_map ( const VikTrack *tr, guint16 num_chunks )
 gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks )
 {
   gdouble *v, *s, *t;
-  gint i, pt_count, numpts, index;
-  GList *iter;
+  gint i, index;
   gdouble duration, total_length, chunk_length;
 
   if ( ! tr->trackpoints )
@@ -1580,30 +2009,18 @@ gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks
     return NULL;
   }
 
-  total_length = vik_track_get_length_including_gaps ( tr );
+  VikTrackPositions *vtp = track_get_positions ( (VikTrack*)tr );
+  total_length = vtp->dist[vtp->n-1];
   chunk_length = total_length / num_chunks;
-  pt_count = vik_track_get_tp_count(tr);
 
   if (chunk_length <= 0) {
     return NULL;
   }
 
   v = g_malloc ( sizeof(gdouble) * num_chunks );
-  s = g_malloc ( sizeof(double) * pt_count );
-  t = g_malloc ( sizeof(double) * pt_count );
-
   // No special handling of segments ATM...
-  iter = tr->trackpoints->next;
-  numpts = 0;
-  s[0] = 0;
-  t[0] = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  numpts++;
-  while (iter) {
-    s[numpts] = s[numpts-1] + vik_coord_diff ( &(VIK_TRACKPOINT(iter->prev->data)->coord), &(VIK_TRACKPOINT(iter->data)->coord) );
-    t[numpts] = VIK_TRACKPOINT(iter->data)->timestamp;
-    numpts++;
-    iter = iter->next;
-  }
+  s = vtp->dist;
+  t = positions_get_times ( vtp );
 
   // Iterate through a portion of the track to get an average speed for that part
   // This will essentially interpolate between segments, which I think is right given the usage of 'get_length_including_gaps'
@@ -1626,7 +2043,6 @@ gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks
       v[i] = 0;
     }
   }
-  g_free(s);
   g_free(t);
   return v;
 }
@@ -1644,88 +2060,52 @@ gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks
  */
 VikTrackpoint *vik_track_get_tp_by_dist ( VikTrack *trk, gdouble meters_from_start, gboolean get_next_point, gdouble *tp_metres_from_start )
 {
-  gdouble current_dist = 0.0;
-  gdouble current_inc = 0.0;
   if ( tp_metres_from_start )
     *tp_metres_from_start = 0.0;
 
-  if ( trk->trackpoints ) {
-    GList *iter = g_list_next ( g_list_first ( trk->trackpoints ) );
-    while (iter) {
-      current_inc = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                     &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      current_dist += current_inc;
-      if ( current_dist >= meters_from_start )
-        break;
-      iter = g_list_next ( iter );
-    }
-    // passed the end of the track
-    if ( !iter )
-      return NULL;
+  if ( !trk->trackpoints )
+    return NULL;
 
-    if ( tp_metres_from_start )
-      *tp_metres_from_start = current_dist;
+  VikTrackPositions *vtp = track_get_positions ( trk );
+  guint ii = positions_search_dist ( vtp, meters_from_start );
+  // passed the end of the track
+  if ( ii >= vtp->n )
+    return NULL;
 
-    // we've gone past the distance already, is the previous trackpoint wanted?
-    if ( !get_next_point ) {
-      if ( iter->prev ) {
-        if ( tp_metres_from_start )
-          *tp_metres_from_start = current_dist-current_inc;
-        return VIK_TRACKPOINT(iter->prev->data);
-      }
-    }
-    return VIK_TRACKPOINT(iter->data);
-  }
+  // we've gone past the distance already, is the previous trackpoint wanted?
+  if ( !get_next_point )
+    ii--;
 
-  return NULL;
+  if ( tp_metres_from_start )
+    *tp_metres_from_start = vtp->dist[ii];
+  return VIK_TRACKPOINT(vtp->tpls[ii]->data);
 }
 
 /* by Alex Foobarian */
 VikTrackpoint *vik_track_get_closest_tp_by_percentage_dist ( VikTrack *tr, gdouble reldist, gdouble *meters_from_start )
 {
-  gdouble dist = vik_track_get_length_including_gaps(tr) * reldist;
-  gdouble current_dist = 0.0;
-  gdouble current_inc = 0.0;
-  if ( tr->trackpoints )
-  {
-    GList *iter = tr->trackpoints->next;
-    GList *last_iter = NULL;
-    gdouble last_dist = 0.0;
-    while (iter)
-    {
-      current_inc = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                     &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      last_dist = current_dist;
-      current_dist += current_inc;
-      if ( current_dist >= dist )
-        break;
-      last_iter = iter;
-      iter = iter->next;
-    }
-    if (!iter) { /* passing the end the track */
-      if (last_iter) {
-        if (meters_from_start)
-          *meters_from_start = last_dist;
-        return(VIK_TRACKPOINT(last_iter->data));
-      }
-      else
-        return NULL;
-    }
-    /* we've gone past the dist already, was prev trackpoint closer? */
-    /* should do a vik_coord_average_weighted() thingy. */
-    if ( iter->prev && fabs(current_dist-current_inc-dist) < fabs(current_dist-dist) ) {
-      if (meters_from_start)
-        *meters_from_start = last_dist;
-      iter = iter->prev;
-    }
-    else
-      if (meters_from_start)
-        *meters_from_start = current_dist;
+  if ( !tr->trackpoints || !tr->trackpoints->next )
+    return NULL;
 
-    return VIK_TRACKPOINT(iter->data);
+  VikTrackPositions *vtp = track_get_positions ( tr );
+  gdouble dist = vtp->dist[vtp->n-1] * reldist;
+  guint ii = positions_search_dist ( vtp, dist );
 
+  if ( ii >= vtp->n ) { /* passing the end the track */
+    // NB reports the distance of the penultimate trackpoint (as it always has)
+    if (meters_from_start)
+      *meters_from_start = vtp->dist[vtp->n-2];
+    return VIK_TRACKPOINT(vtp->tpls[vtp->n-1]->data);
   }
-  return NULL;
+
+  /* we've gone past the dist already, was prev trackpoint closer? */
+  /* should do a vik_coord_average_weighted() thingy. */
+  if ( fabs(vtp->dist[ii-1]-dist) < fabs(vtp->dist[ii]-dist) )
+    ii--;
+
+  if (meters_from_start)
+    *meters_from_start = vtp->dist[ii];
+  return VIK_TRACKPOINT(vtp->tpls[ii]->data);
 }
 
 VikTrackpoint *vik_track_get_closest_tp_by_percentage_time ( VikTrack *tr, gdouble reltime, gdouble *seconds_from_start )
@@ -1740,6 +2120,36 @@ VikTrackpoint *vik_track_get_closest_tp_by_percentage_time ( VikTrack *tr, gdoub
 
   t_pos = t_start + t_total * reltime;
 
+  VikTrackPositions *vtp = track_get_positions ( tr );
+  if ( vtp->times_ordered ) {
+    // Find the first trackpoint not before the position
+    guint lo = 0, hi = vtp->n;
+    while ( lo < hi ) {
+      guint mid = lo + (hi - lo) / 2;
+      if ( VIK_TRACKPOINT(vtp->tpls[mid]->data)->timestamp >= t_pos )
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+    guint ii = lo;
+    if ( ii == vtp->n ) {
+      /* last trackpoint: accommodate for round-off */
+      if ( !(t_pos < VIK_TRACKPOINT(vtp->tpls[ii-1]->data)->timestamp + 3) )
+        return NULL;
+      ii--;
+    }
+    else if ( ii > 0 && VIK_TRACKPOINT(vtp->tpls[ii]->data)->timestamp != t_pos ) {
+      gdouble t_before = t_pos - VIK_TRACKPOINT(vtp->tpls[ii-1]->data)->timestamp;
+      gdouble t_after = VIK_TRACKPOINT(vtp->tpls[ii]->data)->timestamp - t_pos;
+      if (t_before <= t_after)
+        ii--;
+    }
+    if (seconds_from_start)
+      *seconds_from_start = VIK_TRACKPOINT(vtp->tpls[ii]->data)->timestamp - t_start;
+    return VIK_TRACKPOINT(vtp->tpls[ii]->data);
+  }
+
+  // Otherwise timestamps are missing or out of order, so consider each trackpoint in turn
   GList *iter = tr->trackpoints;
 
   while (iter) {
@@ -1781,7 +2191,7 @@ VikTrackpoint* vik_track_get_tp_by_max_speed ( const VikTrack *tr )
       if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) &&
            !isnan(VIK_TRACKPOINT(iter->prev->data)->timestamp) &&
 	   (! VIK_TRACKPOINT(iter->data)->newsegment) ) {
-	speed =  vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) )
+	speed =  vik_coord_diff_fast ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) )
 	  / ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
 	if ( speed > maxspeed ) {
 	  maxspeed = speed;
@@ -1878,6 +2288,139 @@ VikTrackpoint *vik_track_get_tp_prev ( const VikTrack *tr, VikTrackpoint *tp )
   return tp_prev;
 }
 
+/**
+ * vik_track_cursor_set:
+ * @tpl: The trackpoint within the trackpoints of @tr, or NULL for none
+ *
+ * Position the cursor at a known list entry; its index is then only worked out if asked for
+ */
+void vik_track_cursor_set ( VikTrackCursor *cur, VikTrack *tr, GList *tpl )
+{
+  cur->trk = tr;
+  cur->tpl = tr ? tpl : NULL;
+  cur->index = -1;
+}
+
+void vik_track_cursor_clear ( VikTrackCursor *cur )
+{
+  vik_track_cursor_set ( cur, NULL, NULL );
+}
+
+/**
+ * vik_track_cursor_seek:
+ *
+ * Position the cursor at the trackpoint with this index, directly via the positions index of the track
+ *
+ * Returns: FALSE if there is no such trackpoint (then the cursor is unchanged)
+ */
+gboolean vik_track_cursor_seek ( VikTrackCursor *cur, VikTrack *tr, guint index )
+{
+  track_decode_pending ( tr );
+  VikTrackPositions *vtp = track_get_positions ( tr );
+  if ( index >= vtp->n )
+    return FALSE;
+  cur->trk = tr;
+  cur->tpl = vtp->tpls[index];
+  cur->index = index;
+  cur->changes = vik_track_get_changes_count ();
+  return TRUE;
+}
+
+/**
+ * vik_track_cursor_find:
+ *
+ * Position the cursor at the trackpoint,
+ *  checking beside where the cursor already is before searching the whole track
+ *
+ * Returns: FALSE if the trackpoint is not in the track (then the cursor is unchanged)
+ */
+gboolean vik_track_cursor_find ( VikTrackCursor *cur, VikTrack *tr, VikTrackpoint *tp )
+{
+  if ( cur->trk == tr && cur->tpl ) {
+    if ( cur->tpl->data == tp )
+      return TRUE;
+    if ( cur->tpl->next && cur->tpl->next->data == tp )
+      return vik_track_cursor_next ( cur );
+    if ( cur->tpl->prev && cur->tpl->prev->data == tp )
+      return vik_track_cursor_prev ( cur );
+  }
+  track_decode_pending ( tr );
+  VikTrackPositions *vtp = track_get_positions ( tr );
+  for ( guint ii = 0; ii < vtp->n; ii++ )
+    if ( vtp->tpls[ii]->data == tp )
+      return vik_track_cursor_seek ( cur, tr, ii );
+  return FALSE;
+}
+
+/**
+ * vik_track_cursor_next:
+ *
+ * Returns: FALSE if already at the last trackpoint (or not at any)
+ */
+gboolean vik_track_cursor_next ( VikTrackCursor *cur )
+{
+  if ( !cur->tpl || !cur->tpl->next )
+    return FALSE;
+  cur->tpl = cur->tpl->next;
+  if ( cur->index >= 0 )
+    cur->index++;
+  return TRUE;
+}
+
+/**
+ * vik_track_cursor_prev:
+ *
+ * Returns: FALSE if already at the first trackpoint (or not at any)
+ */
+gboolean vik_track_cursor_prev ( VikTrackCursor *cur )
+{
+  if ( !cur->tpl || !cur->tpl->prev )
+    return FALSE;
+  cur->tpl = cur->tpl->prev;
+  if ( cur->index >= 0 )
+    cur->index--;
+  return TRUE;
+}
+
+/**
+ * vik_track_cursor_get_index:
+ *
+ * The index is remembered until any track is changed, so stepping along the track keeps it known.
+ * Otherwise it is found from the positions index of the track.
+ *
+ * Returns: The index of the trackpoint in the track, or -1 if not at any
+ */
+gint vik_track_cursor_get_index ( VikTrackCursor *cur )
+{
+  if ( !cur->tpl )
+    return -1;
+  if ( cur->index >= 0 && cur->changes == vik_track_get_changes_count() )
+    return cur->index;
+  VikTrackPositions *vtp = track_get_positions ( cur->trk );
+  for ( guint ii = 0; ii < vtp->n; ii++ ) {
+    if ( vtp->tpls[ii] == cur->tpl ) {
+      cur->index = ii;
+      cur->changes = vik_track_get_changes_count ();
+      return ii;
+    }
+  }
+  g_critical ( "%s: trackpoint not in its track", __FUNCTION__ );
+  return -1;
+}
+
+/**
+ * vik_track_cursor_get_count:
+ *
+ * Returns: The number of trackpoints in the track of the cursor, without counting through them again
+ */
+guint vik_track_cursor_get_count ( VikTrackCursor *cur )
+{
+  if ( !cur->trk )
+    return 0;
+  track_decode_pending ( cur->trk );
+  return track_get_positions ( cur->trk )->n;
+}
+
 /**
  * vik_track_get_minmax_alt:
  *
@@ -1908,103 +2451,169 @@ gboolean vik_track_get_minmax_alt ( const VikTrack *tr, gdouble *min_alt, gdoubl
   return FALSE;
 }
 
+// Derived values that drawing wants every time
+struct _VikTrackDrawValues {
+  gboolean alt_found; // Whether has_alt, min_alt and max_alt are valid
+  gboolean has_alt;
+  gdouble min_alt;
+  gdouble max_alt;
+  gint speed_stop_length; // The stop length avg_speed_moving was found for, -1 if not yet
+  gdouble avg_speed_moving;
+  gdouble label_interval; // What label_positions were found for
+  guint label_count;
+  GArray *label_positions; // Of struct LatLon, see vik_track_get_dist_label_positions()
+};
+
+static VikTrackDrawValues *track_get_draw_values ( const VikTrack *tr )
+{
+  if ( !tr->draw_values ) {
+    // Only a cache of the track, hence OK to store here
+    VikTrack *trk = (VikTrack*)tr;
+    trk->draw_values = g_malloc0 ( sizeof(VikTrackDrawValues) );
+    trk->draw_values->speed_stop_length = -1;
+  }
+  return tr->draw_values;
+}
+
+/**
+ * vik_track_get_minmax_alt_cached:
+ *
+ * As vik_track_get_minmax_alt(), but the result is remembered
+ *  until the trackpoints are changed (see vik_track_clear_caches()).
+ * Intended for drawing, so redraws don't walk every trackpoint first.
+ */
+gboolean vik_track_get_minmax_alt_cached ( const VikTrack *tr, gdouble *min_alt, gdouble *max_alt )
+{
+  VikTrackDrawValues *dv = track_get_draw_values ( tr );
+  if ( !dv->alt_found ) {
+    dv->has_alt = vik_track_get_minmax_alt ( tr, &dv->min_alt, &dv->max_alt );
+    dv->alt_found = TRUE;
+  }
+  *min_alt = dv->min_alt;
+  *max_alt = dv->max_alt;
+  return dv->has_alt;
+}
+
+/**
+ * vik_track_get_average_speed_moving_cached:
+ *
+ * As vik_track_get_average_speed_moving(), remembered in the same way as vik_track_get_minmax_alt_cached()
+ */
+gdouble vik_track_get_average_speed_moving_cached ( const VikTrack *tr, int stop_length_seconds )
+{
+  VikTrackDrawValues *dv = track_get_draw_values ( tr );
+  if ( dv->speed_stop_length != stop_length_seconds ) {
+    dv->avg_speed_moving = vik_track_get_average_speed_moving ( tr, stop_length_seconds );
+    dv->speed_stop_length = stop_length_seconds;
+  }
+  return dv->avg_speed_moving;
+}
+
+/**
+ * vik_track_get_length_including_gaps_cached:
+ *
+ * As vik_track_get_length_including_gaps(), but from the cumulative distances kept for positional lookups
+ */
+gdouble vik_track_get_length_including_gaps_cached ( VikTrack *tr )
+{
+  if ( !tr->trackpoints )
+    return 0.0;
+  VikTrackPositions *vtp = track_get_positions ( tr );
+  return vtp->dist[vtp->n-1];
+}
+
+/**
+ * vik_track_get_dist_label_positions:
+ * @interval: Metres (including gaps) between each position
+ * @count:    The most positions wanted
+ *
+ * Find the positions at each multiple of the interval along the track,
+ *  interpolated between the trackpoints either side,
+ *  in a single sweep along the cumulative distances.
+ * The result is remembered for the same interval and count until the trackpoints are changed.
+ *
+ * Returns: An array of struct LatLon owned by the track,
+ *  with fewer than count entries when the track is not long enough
+ */
+const GArray *vik_track_get_dist_label_positions ( VikTrack *tr, gdouble interval, guint count )
+{
+  VikTrackDrawValues *dv = track_get_draw_values ( tr );
+  if ( dv->label_positions && dv->label_interval == interval && dv->label_count == count )
+    return dv->label_positions;
+
+  if ( dv->label_positions )
+    g_array_set_size ( dv->label_positions, 0 );
+  else
+    dv->label_positions = g_array_new ( FALSE, FALSE, sizeof(struct LatLon) );
+  dv->label_interval = interval;
+  dv->label_count = count;
+
+  if ( !tr->trackpoints || interval <= 0.0 )
+    return dv->label_positions;
+
+  g_array_set_size ( dv->label_positions, count );
+  guint found = positions_interpolate ( track_get_positions ( tr ), interval, interval, count,
+                                        (struct LatLon*)dv->label_positions->data );
+  g_array_set_size ( dv->label_positions, found );
+  return dv->label_positions;
+}
+
+/**
+ * vik_track_make_position_map:
+ *
+ * Find the position in the middle of each of the equal distance chunks of the track (including gaps),
+ *  e.g. for looking up other values along the track for each column of a graph
+ *
+ * Returns: An array of num_chunks positions (to be freed), or NULL if the track has no length
+ */
+VikCoord *vik_track_make_position_map ( const VikTrack *tr, guint16 num_chunks )
+{
+  if ( !tr->trackpoints || !num_chunks )
+    return NULL;
+  // The distances are only a cache of the track, hence OK to generate them here
+  VikTrackPositions *vtp = track_get_positions ( (VikTrack*)tr );
+  gdouble total_length = vtp->dist[vtp->n-1];
+  if ( total_length <= 0.0 )
+    return NULL;
+
+  gdouble step = total_length / num_chunks;
+  struct LatLon *lls = g_new ( struct LatLon, num_chunks );
+  guint found = positions_interpolate ( vtp, step / 2, step, num_chunks, lls );
+  VikCoord *coords = g_new ( VikCoord, num_chunks );
+  VikCoord *last = &(VIK_TRACKPOINT(vtp->tpls[vtp->n-1]->data)->coord);
+  for ( guint ii = 0; ii < num_chunks; ii++ ) {
+    // Only rounding could stop the last few being found
+    if ( ii < found )
+      vik_coord_load_from_latlon ( &coords[ii], last->mode, &lls[ii] );
+    else
+      coords[ii] = *last;
+  }
+  g_free ( lls );
+  return coords;
+}
+
+/**
+ * vik_track_marshall:
+ *
+ * Uses the compact binary form of the track (see trwbinary.c),
+ *  which is also suitable for passing to another process
+ */
 void vik_track_marshall ( VikTrack *tr, guint8 **data, guint *datalen)
 {
-  GList *tps;
   GByteArray *b = g_byte_array_new();
-  guint len;
-  guint intp, ntp;
-
-  g_byte_array_append(b, (guint8 *)tr, sizeof(*tr));
-
-  /* we'll fill out number of trackpoints later */
-  intp = b->len;
-  g_byte_array_append(b, (guint8 *)&len, sizeof(len));
-
-  // This allocates space for variant sized strings
-  //  and copies that amount of data from the track to byte array
-#define vtm_append(s) \
-  len = (s) ? strlen(s)+1 : 0; \
-  g_byte_array_append(b, (guint8 *)&len, sizeof(len)); \
-  if (s) g_byte_array_append(b, (guint8 *)s, len);
-
-  tps = tr->trackpoints;
-  ntp = 0;
-  while (tps) {
-    g_byte_array_append(b, (guint8 *)tps->data, sizeof(VikTrackpoint));
-    vtm_append(VIK_TRACKPOINT(tps->data)->name);
-    tps = tps->next;
-    ntp++;
-  }
-  *(guint *)(b->data + intp) = ntp;
-
-  vtm_append(tr->name);
-  vtm_append(tr->comment);
-  vtm_append(tr->description);
-  vtm_append(tr->source);
-  vtm_append(tr->type);
-  vtm_append(tr->extensions);
-
-  *data = b->data;
+  a_trwbinary_write_track ( tr, b );
   *datalen = b->len;
-  g_byte_array_free(b, FALSE);
+  *data = g_byte_array_free ( b, FALSE );
 }
 
 /*
  * Take a byte array and convert it into a Track
+ * The track is in latitude/longitude coordinates, so convert it as necessary
+ * Returns NULL if the data is not valid
  */
 VikTrack *vik_track_unmarshall (const guint8 *data_in, guint datalen)
 {
-  guint len;
-  VikTrack *new_tr = vik_track_new();
-  VikTrackpoint *new_tp;
-  guint ntp;
-  gint i;
-  guint8 *data = (guint8*)data_in;
-
-  /* basic properties: */
-  new_tr->visible = ((VikTrack *)data)->visible;
-  new_tr->is_route = ((VikTrack *)data)->is_route;
-  new_tr->draw_name_mode = ((VikTrack *)data)->draw_name_mode;
-  new_tr->max_number_dist_labels = ((VikTrack *)data)->max_number_dist_labels;
-  new_tr->has_color = ((VikTrack *)data)->has_color;
-  new_tr->color = ((VikTrack *)data)->color;
-  new_tr->bbox = ((VikTrack *)data)->bbox;
-  new_tr->number = ((VikTrack *)data)->number;
-
-  data += sizeof(*new_tr);
-
-  ntp = *(guint *)data;
-  data += sizeof(ntp);
-
-#define vtu_get(s) \
-  len = *(guint *)data; \
-  data += sizeof(len); \
-  if (len) { \
-    (s) = g_strdup((gchar *)data); \
-  } else { \
-    (s) = NULL; \
-  } \
-  data += len;
-
-  for (i=0; i<ntp; i++) {
-    new_tp = vik_trackpoint_new();
-    memcpy(new_tp, data, sizeof(*new_tp));
-    data += sizeof(*new_tp);
-    vtu_get(new_tp->name);
-    new_tr->trackpoints = g_list_prepend(new_tr->trackpoints, new_tp);
-  }
-  if ( new_tr->trackpoints )
-    new_tr->trackpoints = g_list_reverse(new_tr->trackpoints);
-
-  vtu_get(new_tr->name);
-  vtu_get(new_tr->comment);
-  vtu_get(new_tr->description);
-  vtu_get(new_tr->source);
-  vtu_get(new_tr->type);
-  vtu_get(new_tr->extensions);
-
-  return new_tr;
+  return a_trwbinary_read_track ( data_in, datalen );
 }
 
 /**
@@ -2044,6 +2653,918 @@ void vik_track_calculate_bounds ( VikTrack *trk )
   trk->bbox.east = bottomright.lon;
   trk->bbox.south = bottomright.lat;
   trk->bbox.west = topleft.lon;
+
+  vik_track_clear_caches ( trk );
+}
+
+// Level 0 keeps points that deviate by more than a quarter of a metre,
+//  each following level doubles the tolerance
+#define SIMPLIFY_LEVELS 20
+#define SIMPLIFY_BASE_TOLERANCE 0.25
+
+// The full trackpoint list plus each of the simplified ones
+#define MERCATOR_LISTS (SIMPLIFY_LEVELS+1)
+
+struct _VikTrackMercator {
+  GList *lists[MERCATOR_LISTS];
+  gdouble *lats[MERCATOR_LISTS];
+  guint counts[MERCATOR_LISTS];
+};
+
+// Chunks of the full trackpoint list plus each of the simplified ones
+struct _VikTrackChunks {
+  GList *lists[MERCATOR_LISTS];
+  GArray *runs[MERCATOR_LISTS];
+};
+
+// Number of times any track has been changed, see vik_track_get_changes_count()
+static gint track_changes = 0;
+
+/**
+ * vik_track_clear_caches:
+ *
+ * Discard the simplified versions, the projected latitudes and the search index of the track.
+ * Called automatically by vik_track_calculate_bounds(),
+ *  otherwise should be called whenever the trackpoints are changed without a bounds update.
+ */
+void vik_track_clear_caches ( VikTrack *tr )
+{
+  g_atomic_int_inc ( &track_changes );
+  // Any threads still using the snapshot keep it until they are done
+  vik_track_snapshot_unref ( tr->snapshot );
+  tr->snapshot = NULL;
+  g_free ( tr->summary );
+  tr->summary = NULL;
+  if ( tr->draw_values ) {
+    if ( tr->draw_values->label_positions )
+      g_array_free ( tr->draw_values->label_positions, TRUE );
+    g_free ( tr->draw_values );
+    tr->draw_values = NULL;
+  }
+  if ( tr->positions ) {
+    g_free ( tr->positions->tpls );
+    g_free ( tr->positions->dist );
+    g_free ( tr->positions->length );
+    g_free ( tr->positions );
+    tr->positions = NULL;
+  }
+  if ( tr->chunks ) {
+    for ( guint ii = 0; ii < MERCATOR_LISTS; ii++ )
+      if ( tr->chunks->runs[ii] )
+        g_array_free ( tr->chunks->runs[ii], TRUE );
+    g_free ( tr->chunks );
+    tr->chunks = NULL;
+  }
+  if ( tr->mercator ) {
+    for ( guint ii = 0; ii < MERCATOR_LISTS; ii++ )
+      g_free ( tr->mercator->lats[ii] );
+    g_free ( tr->mercator );
+    tr->mercator = NULL;
+  }
+  if ( !tr->simplified )
+    return;
+  for ( guint level = 0; level < SIMPLIFY_LEVELS; level++ ) {
+    g_list_foreach ( tr->simplified[level], (GFunc)g_free, NULL );
+    g_list_free ( tr->simplified[level] );
+  }
+  g_free ( tr->simplified );
+  tr->simplified = NULL;
+}
+
+/**
+ * vik_track_get_changes_count:
+ *
+ * Returns: A count that changes whenever the trackpoints of any track are changed,
+ *  so anything derived from the tracks can detect that it may need updating
+ */
+guint vik_track_get_changes_count ( void )
+{
+  return (guint)g_atomic_int_get ( &track_changes );
+}
+
+static gsize string_bytes ( const gchar *str )
+{
+  return str ? strlen ( str ) + 1 : 0;
+}
+
+/**
+ * vik_track_get_memory:
+ *
+ * Add the approximate memory used by the track to each of the totals.
+ * Trackpoint extensions are shared via the string pool, so each is only counted
+ *  at the start of a run of trackpoints using it, as an estimate of the track's share.
+ */
+void vik_track_get_memory ( const VikTrack *tr, gsize *points, gsize *strings, gsize *extensions, gsize *caches )
+{
+  *points += sizeof(VikTrack);
+  *strings += string_bytes ( tr->name ) + string_bytes ( tr->comment ) + string_bytes ( tr->description );
+  *extensions += string_bytes ( tr->extensions );
+
+  guint n = 0;
+  const gchar *last_ext = NULL;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next, n++ ) {
+    const VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    *strings += string_bytes ( tp->name );
+    if ( tp->extensions != last_ext )
+      *extensions += string_bytes ( tp->extensions );
+    last_ext = tp->extensions;
+  }
+  *points += n * (sizeof(VikTrackpoint) + sizeof(GList));
+  if ( tr->packed )
+    *points += g_bytes_get_size ( tr->packed );
+
+  // Everything generated on demand
+  if ( tr->summary )
+    *caches += sizeof(VikTrackSummary);
+  if ( tr->draw_values ) {
+    *caches += sizeof(VikTrackDrawValues);
+    if ( tr->draw_values->label_positions )
+      *caches += tr->draw_values->label_positions->len * sizeof(struct LatLon);
+  }
+  if ( tr->positions )
+    *caches += sizeof(VikTrackPositions) + tr->positions->n * (sizeof(GList*) + 2 * sizeof(gdouble));
+  if ( tr->chunks ) {
+    *caches += sizeof(VikTrackChunks);
+    for ( guint ii = 0; ii < MERCATOR_LISTS; ii++ )
+      if ( tr->chunks->runs[ii] )
+        *caches += tr->chunks->runs[ii]->len * sizeof(VikTrackChunk);
+  }
+  if ( tr->mercator ) {
+    *caches += sizeof(VikTrackMercator);
+    for ( guint ii = 0; ii < MERCATOR_LISTS; ii++ )
+      if ( tr->mercator->lats[ii] )
+        *caches += tr->mercator->counts[ii] * sizeof(gdouble);
+  }
+  if ( tr->simplified )
+    for ( guint level = 0; level < SIMPLIFY_LEVELS; level++ )
+      *caches += g_list_length ( tr->simplified[level] ) * (sizeof(VikTrackpoint) + sizeof(GList));
+  if ( tr->snapshot )
+    *caches += sizeof(VikTrackSnapshot) + tr->snapshot->n_points * sizeof(VikTrackSnapshotPoint);
+}
+
+/**
+ * vik_track_get_snapshot:
+ *
+ * For reading the trackpoints in background threads,
+ *  whilst the track itself may be edited or even deleted in the main thread.
+ * The snapshot is only made once after each change of the track, so is cheap to get again,
+ *  and edits never wait for the threads - the next change just drops the track's reference to it.
+ *
+ * Must be called from the main thread (as any other track modification)
+ *
+ * Returns: A new reference to the unchanging copy of the current trackpoint positions,
+ *  release with vik_track_snapshot_unref()
+ */
+VikTrackSnapshot *vik_track_get_snapshot ( VikTrack *tr )
+{
+  if ( !tr->snapshot ) {
+    guint n = g_list_length ( tr->trackpoints );
+    // Points are in the same block straight after the header
+    VikTrackSnapshot *snap = g_malloc ( sizeof(VikTrackSnapshot) + n * sizeof(VikTrackSnapshotPoint) );
+    snap->ref_count = 1;
+    snap->bbox = tr->bbox;
+    snap->n_points = n;
+    snap->points = (VikTrackSnapshotPoint*)(snap + 1);
+    VikTrackSnapshotPoint *sp = snap->points;
+    for ( GList *iter = tr->trackpoints; iter; iter = iter->next, sp++ ) {
+      const VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+      sp->coord = tp->coord;
+      sp->timestamp = tp->timestamp;
+      sp->altitude = tp->altitude;
+      sp->newsegment = tp->newsegment;
+    }
+    tr->snapshot = snap;
+  }
+  return vik_track_snapshot_ref ( tr->snapshot );
+}
+
+/**
+ * vik_track_snapshot_ref:
+ *
+ * Safe to call from any thread
+ */
+VikTrackSnapshot *vik_track_snapshot_ref ( VikTrackSnapshot *snap )
+{
+  g_atomic_int_inc ( &snap->ref_count );
+  return snap;
+}
+
+/**
+ * vik_track_snapshot_unref:
+ *
+ * Safe to call from any thread
+ */
+void vik_track_snapshot_unref ( VikTrackSnapshot *snap )
+{
+  if ( snap && g_atomic_int_dec_and_test ( &snap->ref_count ) )
+    g_free ( snap );
+}
+
+/**
+ * Get the cumulative distances along the track, generating them if necessary
+ *  so that positional lookups don't need to walk the track and recompute every distance each time.
+ */
+static VikTrackPositions *track_get_positions ( VikTrack *tr )
+{
+  if ( tr->positions )
+    return tr->positions;
+
+  VikTrackPositions *vtp = g_malloc ( sizeof(VikTrackPositions) );
+  vtp->n = g_list_length ( tr->trackpoints );
+  vtp->tpls = g_new ( GList*, vtp->n );
+  vtp->dist = g_new ( gdouble, vtp->n );
+  vtp->length = g_new ( gdouble, vtp->n );
+  vtp->times_ordered = TRUE;
+
+  // The distances between the points are calculated together, into the dist array for now
+  struct LatLon *lls = g_new ( struct LatLon, vtp->n );
+  guint ii = 0;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next, ii++ ) {
+    vtp->tpls[ii] = iter;
+    vik_coord_to_latlon ( &(VIK_TRACKPOINT(iter->data)->coord), &lls[ii] );
+  }
+  a_coords_latlon_diffs ( lls, vtp->dist + 1, vtp->n );
+  g_free ( lls );
+
+  ii = 0;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next, ii++ ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    if ( ii == 0 ) {
+      vtp->dist[ii] = vtp->length[ii] = 0.0;
+    }
+    else {
+      VikTrackpoint *tp_prev = VIK_TRACKPOINT(iter->prev->data);
+      gdouble inc = vtp->dist[ii];
+      vtp->dist[ii] = vtp->dist[ii-1] + inc;
+      vtp->length[ii] = vtp->length[ii-1] + (tp->newsegment ? 0.0 : inc);
+      if ( !(tp->timestamp >= tp_prev->timestamp) )
+        vtp->times_ordered = FALSE;
+    }
+    if ( isnan(tp->timestamp) )
+      vtp->times_ordered = FALSE;
+  }
+
+  tr->positions = vtp;
+  return vtp;
+}
+
+/**
+ * Find the positions at the distances start, start+step, ... along the track (including gaps),
+ *  interpolated between the trackpoints either side, in a single sweep along the cumulative distances
+ *
+ * Returns: How many were found, fewer than count when the track is not long enough
+ */
+static guint positions_interpolate ( VikTrackPositions *vtp, gdouble start, gdouble step, guint count, struct LatLon *lls )
+{
+  guint ii = 1;
+  guint found = 0;
+  for ( ; found < count; found++ ) {
+    gdouble dist = start + step * found;
+    // Distances only increase, so carry on from where the previous one was found
+    while ( ii < vtp->n && vtp->dist[ii] < dist )
+      ii++;
+    if ( ii >= vtp->n )
+      break;
+
+    gdouble dist_between_tps = vtp->dist[ii] - vtp->dist[ii-1];
+    gdouble ratio = 0.0;
+    // Prevent division by 0 errors
+    if ( dist_between_tps > 0.0 )
+      ratio = (dist - vtp->dist[ii-1]) / dist_between_tps;
+
+    // Using a simple ratio - may not be perfectly correct due to lat/long projections
+    //  but good enough over the small distance between trackpoints
+    struct LatLon ll_current, ll_next;
+    vik_coord_to_latlon ( &(VIK_TRACKPOINT(vtp->tpls[ii-1]->data)->coord), &ll_current );
+    vik_coord_to_latlon ( &(VIK_TRACKPOINT(vtp->tpls[ii]->data)->coord), &ll_next );
+    lls[found].lat = ll_current.lat + (ll_next.lat-ll_current.lat)*ratio;
+    lls[found].lon = ll_current.lon + (ll_next.lon-ll_current.lon)*ratio;
+  }
+  return found;
+}
+
+/**
+ * Returns: A newly allocated array of the timestamps of the positions
+ */
+static gdouble *positions_get_times ( VikTrackPositions *vtp )
+{
+  gdouble *times = g_new ( gdouble, vtp->n );
+  for ( guint ii = 0; ii < vtp->n; ii++ )
+    times[ii] = VIK_TRACKPOINT(vtp->tpls[ii]->data)->timestamp;
+  return times;
+}
+
+/**
+ * Returns: The index of the first position beyond the start at least the given distance along the track,
+ *  or vtp->n if there is none
+ */
+static guint positions_search_dist ( VikTrackPositions *vtp, gdouble dist )
+{
+  guint lo = 1, hi = vtp->n;
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    if ( vtp->dist[mid] >= dist )
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return lo;
+}
+
+#define CHUNK_SIZE 64
+
+/**
+ * Split the list into runs of consecutive trackpoints, recording the bounds of each
+ */
+static GArray *track_build_chunks ( GList *list )
+{
+  GArray *chunks = g_array_new ( FALSE, FALSE, sizeof(VikTrackChunk) );
+  VikTrackChunk chunk = { NULL, 0, { 0.0, 0.0, 0.0, 0.0 } };
+
+  for ( GList *iter = list; iter; iter = iter->next ) {
+    struct LatLon ll;
+    vik_coord_to_latlon ( &(VIK_TRACKPOINT(iter->data)->coord), &ll );
+    if ( chunk.count == 0 ) {
+      chunk.start = iter;
+      chunk.bbox.north = chunk.bbox.south = ll.lat;
+      chunk.bbox.east = chunk.bbox.west = ll.lon;
+    }
+    else {
+      if ( ll.lat > chunk.bbox.north ) chunk.bbox.north = ll.lat;
+      if ( ll.lat < chunk.bbox.south ) chunk.bbox.south = ll.lat;
+      if ( ll.lon > chunk.bbox.east ) chunk.bbox.east = ll.lon;
+      if ( ll.lon < chunk.bbox.west ) chunk.bbox.west = ll.lon;
+    }
+    if ( ++chunk.count == CHUNK_SIZE ) {
+      g_array_append_val ( chunks, chunk );
+      chunk.count = 0;
+    }
+  }
+  if ( chunk.count )
+    g_array_append_val ( chunks, chunk );
+
+  return chunks;
+}
+
+/**
+ * vik_track_get_chunks:
+ * @list: Either the track's own trackpoints or a list from vik_track_get_simplified_trackpoints()
+ *
+ * Returns: The #VikTrackChunk runs of consecutive trackpoints of the list in order,
+ *  each of the same fixed size apart from the last,
+ *  so that areas of no interest can be passed over a whole run at a time.
+ *  These are generated on demand and owned by the track, so must not be modified.
+ */
+GArray *vik_track_get_chunks ( VikTrack *tr, GList *list )
+{
+  g_return_val_if_fail ( list != NULL, NULL );
+
+  if ( !tr->chunks )
+    tr->chunks = g_new0 ( VikTrackChunks, 1 );
+
+  guint slot;
+  for ( slot = 0; slot < MERCATOR_LISTS && tr->chunks->lists[slot]; slot++ ) {
+    if ( tr->chunks->lists[slot] == list )
+      return tr->chunks->runs[slot];
+  }
+  // Not expected as there are only so many simplified lists, but otherwise start afresh
+  if ( slot == MERCATOR_LISTS ) {
+    for ( slot = 0; slot < MERCATOR_LISTS; slot++ ) {
+      g_array_free ( tr->chunks->runs[slot], TRUE );
+      tr->chunks->lists[slot] = NULL;
+      tr->chunks->runs[slot] = NULL;
+    }
+    slot = 0;
+  }
+
+  tr->chunks->lists[slot] = list;
+  tr->chunks->runs[slot] = track_build_chunks ( list );
+  return tr->chunks->runs[slot];
+}
+
+/**
+ * vik_track_foreach_in_bbox:
+ * @bbox: The area of interest
+ * @func: Called with the list position of each trackpoint that may be within the area
+ *
+ * Visit the trackpoints near the given area, without having to consider every trackpoint of the track.
+ * The trackpoints are grouped into runs with their bounds computed on first use,
+ *  such that whole runs outside of the area can be skipped.
+ * NB Some trackpoints outside of the area may also be visited.
+ */
+void vik_track_foreach_in_bbox ( VikTrack *tr, LatLonBBox bbox, VikTrackTplFunc func, gpointer user_data )
+{
+  if ( !tr->trackpoints )
+    return;
+
+  GArray *chunks = vik_track_get_chunks ( tr, tr->trackpoints );
+  for ( guint ii = 0; ii < chunks->len; ii++ ) {
+    VikTrackChunk *chunk = &g_array_index ( chunks, VikTrackChunk, ii );
+    // Inclusive comparison, as a run may consist of a single position
+    if ( chunk->bbox.south > bbox.north || chunk->bbox.north < bbox.south ||
+         chunk->bbox.west > bbox.east || chunk->bbox.east < bbox.west )
+      continue;
+    GList *iter = chunk->start;
+    for ( guint jj = 0; jj < chunk->count && iter; jj++, iter = iter->next )
+      func ( iter, user_data );
+  }
+}
+
+/**
+ * Extend the bounds by those of another
+ */
+static void bbox_union ( LatLonBBox *bbox, const LatLonBBox *other )
+{
+  if ( other->north > bbox->north ) bbox->north = other->north;
+  if ( other->south < bbox->south ) bbox->south = other->south;
+  if ( other->east > bbox->east ) bbox->east = other->east;
+  if ( other->west < bbox->west ) bbox->west = other->west;
+}
+
+/**
+ * vik_track_split_at:
+ * @tr:    The track to split
+ * @split: The trackpoint of @tr at which to split, which must not be the first or the last
+ * @position: (out) (optional): The position of @split within @tr
+ *
+ * The trackpoints after @split are moved over to a new track with the same properties,
+ *  starting with a copy of @split so that the two tracks still meet.
+ * The bounds of both tracks are merged from the bounds of the runs of trackpoints (see vik_track_get_chunks()),
+ *  such that only the run in which the split occurs needs its trackpoints considering again.
+ *
+ * Returns: The new track
+ */
+VikTrack *vik_track_split_at ( VikTrack *tr, GList *split, guint *position )
+{
+  g_return_val_if_fail ( split && split->prev && split->next, NULL );
+
+  GArray *chunks = vik_track_get_chunks ( tr, tr->trackpoints );
+  VikTrack *tr_new = vik_track_copy ( tr, FALSE );
+  track_bbox_set_tp ( tr, VIK_TRACKPOINT(split->data) );
+  track_bbox_set_tp ( tr_new, VIK_TRACKPOINT(split->data) );
+
+  // Every run is either wholly before the split, wholly after it or contains it
+  guint pos = 0;
+  gboolean found = FALSE;
+  for ( guint ii = 0; ii < chunks->len; ii++ ) {
+    VikTrackChunk *chunk = &g_array_index ( chunks, VikTrackChunk, ii );
+    if ( found ) {
+      bbox_union ( &tr_new->bbox, &chunk->bbox );
+      continue;
+    }
+    GList *iter = chunk->start;
+    guint jj = 0;
+    for ( ; jj < chunk->count && iter != split; jj++ )
+      iter = iter->next;
+    if ( jj == chunk->count ) {
+      bbox_union ( &tr->bbox, &chunk->bbox );
+      pos += chunk->count;
+      continue;
+    }
+    found = TRUE;
+    pos += jj;
+    for ( iter = chunk->start; iter != split; iter = iter->next )
+      track_bounds_add_tp ( tr, VIK_TRACKPOINT(iter->data) );
+    for ( iter = split->next, jj++; jj < chunk->count; iter = iter->next, jj++ )
+      track_bounds_add_tp ( tr_new, VIK_TRACKPOINT(iter->data) );
+  }
+
+  GList *newglist = g_list_alloc ();
+  newglist->data = vik_trackpoint_copy ( VIK_TRACKPOINT(split->data) );
+  newglist->next = split->next;
+  split->next->prev = newglist;
+  split->next = NULL;
+  tr_new->trackpoints = newglist;
+
+  vik_track_clear_caches ( tr );
+  if ( position )
+    *position = pos;
+  return tr_new;
+}
+
+/**
+ * Squared distance of point p from the line segment a-b
+ */
+static gdouble simplify_distance_sq ( const gdouble *p, const gdouble *a, const gdouble *b )
+{
+  gdouble dx = b[0] - a[0];
+  gdouble dy = b[1] - a[1];
+  gdouble len_sq = dx*dx + dy*dy;
+  gdouble t = 0.0;
+  if ( len_sq > 0.0 ) {
+    t = ((p[0] - a[0])*dx + (p[1] - a[1])*dy) / len_sq;
+    t = CLAMP ( t, 0.0, 1.0 );
+  }
+  gdouble ex = a[0] + t*dx - p[0];
+  gdouble ey = a[1] + t*dy - p[1];
+  return ex*ex + ey*ey;
+}
+
+/**
+ * The trackpoints of the track in an array, with their positions
+ *  in a simple equirectangular projection into metres
+ */
+static gdouble *track_project ( const VikTrack *tr, VikTrackpoint ***tps_out, guint *n_out )
+{
+  guint n = g_list_length ( tr->trackpoints );
+  VikTrackpoint **tps = g_new ( VikTrackpoint*, n );
+  gdouble *xy = g_new ( gdouble, 2*n );
+
+  gdouble scale = 0.0;
+  guint i = 0;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next, i++ ) {
+    struct LatLon ll;
+    tps[i] = VIK_TRACKPOINT(iter->data);
+    vik_coord_to_latlon ( &tps[i]->coord, &ll );
+    if ( i == 0 )
+      scale = cos ( DEG2RAD(ll.lat) );
+    xy[2*i] = ll.lon * scale * 111319.49;
+    xy[2*i+1] = ll.lat * 111319.49;
+  }
+
+  *tps_out = tps;
+  *n_out = n;
+  return xy;
+}
+
+/**
+ * Douglas-Peucker reduction of the trackpoints, done per segment
+ *  so the segment start and end points are always kept.
+ *
+ * Returns: Which of the trackpoints are kept
+ */
+static gboolean *track_simplify_keep ( VikTrackpoint **tps, const gdouble *xy, guint n, gdouble tolerance )
+{
+  gboolean *keep = g_new0 ( gboolean, n );
+  guint *stack = g_new ( guint, 2*n );
+  guint ss = 0;
+
+  guint start = 0;
+  for ( guint i = 1; i <= n; i++ ) {
+    if ( i == n || tps[i]->newsegment ) {
+      keep[start] = keep[i-1] = TRUE;
+      if ( i-1 > start+1 ) {
+        stack[ss++] = start;
+        stack[ss++] = i-1;
+      }
+      start = i;
+    }
+  }
+
+  const gdouble tol_sq = tolerance * tolerance;
+  while ( ss ) {
+    guint last = stack[--ss];
+    guint first = stack[--ss];
+    gdouble max_sq = 0.0;
+    guint index = first;
+    for ( guint j = first+1; j < last; j++ ) {
+      gdouble d_sq = simplify_distance_sq ( &xy[2*j], &xy[2*first], &xy[2*last] );
+      if ( d_sq > max_sq ) {
+        max_sq = d_sq;
+        index = j;
+      }
+    }
+    if ( max_sq > tol_sq ) {
+      keep[index] = TRUE;
+      if ( index > first+1 ) {
+        stack[ss++] = first;
+        stack[ss++] = index;
+      }
+      if ( last > index+1 ) {
+        stack[ss++] = index;
+        stack[ss++] = last;
+      }
+    }
+  }
+
+  g_free ( stack );
+  return keep;
+}
+
+/**
+ * The resulting list holds shallow copies of the kept trackpoints
+ *  (without the name or extensions), thus it remains safe to use
+ *  even if the track is changed and the list is not cleared in time.
+ */
+static GList *track_simplify ( VikTrack *tr, gdouble tolerance )
+{
+  VikTrackpoint **tps;
+  guint n;
+  gdouble *xy = track_project ( tr, &tps, &n );
+  gboolean *keep = track_simplify_keep ( tps, xy, n, tolerance );
+
+  GList *list = NULL;
+  for ( guint i = 0; i < n; i++ ) {
+    if ( keep[i] ) {
+      VikTrackpoint *tp = g_memdup ( tps[i], sizeof(VikTrackpoint) );
+      tp->name = NULL;
+      tp->extensions = NULL;
+      list = g_list_prepend ( list, tp );
+    }
+  }
+
+  g_free ( keep );
+  g_free ( xy );
+  g_free ( tps );
+  return g_list_reverse ( list );
+}
+
+/**
+ * A new track with full copies of the kept trackpoints
+ */
+static VikTrack *track_copy_kept ( const VikTrack *tr, VikTrackpoint **tps, const gboolean *keep, guint n )
+{
+  VikTrack *new_tr = vik_track_copy ( tr, FALSE );
+  for ( guint i = 0; i < n; i++ )
+    if ( keep[i] )
+      new_tr->trackpoints = g_list_prepend ( new_tr->trackpoints, vik_trackpoint_copy ( tps[i] ) );
+  new_tr->trackpoints = g_list_reverse ( new_tr->trackpoints );
+  vik_track_calculate_bounds ( new_tr );
+  return new_tr;
+}
+
+/**
+ * vik_track_copy_simplified:
+ * @tolerance: The most, in metres, any removed trackpoint may be off the simplified track
+ *
+ * Douglas-Peucker simplification of the track.
+ * The track itself is not changed, so this may be used on many tracks in parallel.
+ *
+ * Returns: A new track with the remaining trackpoints
+ */
+VikTrack *vik_track_copy_simplified ( const VikTrack *tr, gdouble tolerance )
+{
+  VikTrackpoint **tps;
+  guint n;
+  gdouble *xy = track_project ( tr, &tps, &n );
+  gboolean *keep = track_simplify_keep ( tps, xy, n, tolerance );
+  VikTrack *new_tr = track_copy_kept ( tr, tps, keep, n );
+  g_free ( keep );
+  g_free ( xy );
+  g_free ( tps );
+  return new_tr;
+}
+
+/**
+ * vik_track_simplify:
+ * @tolerance: The most, in metres, any removed trackpoint may be off the simplified track
+ *
+ * As vik_track_copy_simplified() but removing the trackpoints from the track itself.
+ * As for vik_track_tidy(), different tracks may be simplified by different threads at once.
+ *
+ * Returns: The number of trackpoints removed
+ */
+gulong vik_track_simplify ( VikTrack *tr, gdouble tolerance )
+{
+  VikTrackpoint **tps;
+  guint n;
+  gdouble *xy = track_project ( tr, &tps, &n );
+  gboolean *keep = track_simplify_keep ( tps, xy, n, tolerance );
+
+  gulong num = 0;
+  GList *iter = tr->trackpoints;
+  for ( guint i = 0; i < n; i++ ) {
+    GList *next = iter->next;
+    if ( !keep[i] ) {
+      // Segment starts are always kept, so there are no segments to maintain
+      tr->trackpoints = g_list_delete_link ( tr->trackpoints, iter );
+      vik_trackpoint_free ( tps[i] );
+      num++;
+    }
+    iter = next;
+  }
+  if ( num )
+    vik_track_calculate_bounds ( tr );
+
+  g_free ( keep );
+  g_free ( xy );
+  g_free ( tps );
+  return num;
+}
+
+/*
+ * Binary min heap of the trackpoints that may be removed, by how far each is
+ *  off the line between its remaining neighbours
+ */
+typedef struct {
+  guint *heap;
+  guint *pos; // Of each trackpoint in the heap, or G_MAXUINT if not there
+  gdouble *cost;
+  guint size;
+} ReduceHeap;
+
+static void reduce_heap_swap ( ReduceHeap *rh, guint aa, guint bb )
+{
+  guint tmp = rh->heap[aa];
+  rh->heap[aa] = rh->heap[bb];
+  rh->heap[bb] = tmp;
+  rh->pos[rh->heap[aa]] = aa;
+  rh->pos[rh->heap[bb]] = bb;
+}
+
+static void reduce_heap_update ( ReduceHeap *rh, guint hh )
+{
+  while ( hh > 0 && rh->cost[rh->heap[hh]] < rh->cost[rh->heap[(hh-1)/2]] ) {
+    reduce_heap_swap ( rh, hh, (hh-1)/2 );
+    hh = (hh-1)/2;
+  }
+  while ( TRUE ) {
+    guint least = hh;
+    guint left = 2*hh + 1;
+    guint right = left + 1;
+    if ( left < rh->size && rh->cost[rh->heap[left]] < rh->cost[rh->heap[least]] )
+      least = left;
+    if ( right < rh->size && rh->cost[rh->heap[right]] < rh->cost[rh->heap[least]] )
+      least = right;
+    if ( least == hh )
+      break;
+    reduce_heap_swap ( rh, hh, least );
+    hh = least;
+  }
+}
+
+/**
+ * vik_track_copy_reduced:
+ * @max_points: How many trackpoints to keep
+ *
+ * Simplify the track to the given number of trackpoints, by repeatedly removing
+ *  the trackpoint that is nearest to the line between its neighbours
+ *  (in the manner of Visvalingam-Whyatt, with the crosstrack error as used by GPSBabel).
+ * Segment start and end points are always kept, so there may be more than requested.
+ * The track itself is not changed, so this may be used on many tracks in parallel.
+ *
+ * Returns: A new track with the remaining trackpoints
+ */
+VikTrack *vik_track_copy_reduced ( const VikTrack *tr, guint max_points )
+{
+  VikTrackpoint **tps;
+  guint n;
+  gdouble *xy = track_project ( tr, &tps, &n );
+  gboolean *keep = g_new ( gboolean, n );
+  guint *prev = g_new ( guint, n );
+  guint *next = g_new ( guint, n );
+  ReduceHeap rh;
+  rh.heap = g_new ( guint, n );
+  rh.pos = g_new ( guint, n );
+  rh.cost = g_new ( gdouble, n );
+  rh.size = 0;
+
+  for ( guint i = 0; i < n; i++ ) {
+    keep[i] = TRUE;
+    prev[i] = i - 1;
+    next[i] = i + 1;
+    rh.pos[i] = G_MAXUINT;
+    gboolean end = ( i == 0 || i == n-1 || tps[i]->newsegment || tps[i+1]->newsegment );
+    if ( !end ) {
+      rh.cost[i] = simplify_distance_sq ( &xy[2*i], &xy[2*(i-1)], &xy[2*(i+1)] );
+      rh.heap[rh.size] = i;
+      rh.pos[i] = rh.size;
+      rh.size++;
+    }
+  }
+  for ( guint hh = rh.size / 2; hh-- > 0; )
+    reduce_heap_update ( &rh, hh );
+
+  guint remaining = n;
+  while ( remaining > max_points && rh.size ) {
+    guint i = rh.heap[0];
+    keep[i] = FALSE;
+    remaining--;
+    rh.pos[i] = G_MAXUINT;
+    rh.size--;
+    if ( rh.size ) {
+      rh.heap[0] = rh.heap[rh.size];
+      rh.pos[rh.heap[0]] = 0;
+      reduce_heap_update ( &rh, 0 );
+    }
+    // Neighbours now measured against their new neighbours
+    next[prev[i]] = next[i];
+    prev[next[i]] = prev[i];
+    guint nbs[2] = { prev[i], next[i] };
+    for ( guint j = 0; j < 2; j++ ) {
+      guint nb = nbs[j];
+      if ( rh.pos[nb] != G_MAXUINT ) {
+        rh.cost[nb] = simplify_distance_sq ( &xy[2*nb], &xy[2*prev[nb]], &xy[2*next[nb]] );
+        reduce_heap_update ( &rh, rh.pos[nb] );
+      }
+    }
+  }
+
+  VikTrack *new_tr = track_copy_kept ( tr, tps, keep, n );
+  g_free ( rh.cost );
+  g_free ( rh.pos );
+  g_free ( rh.heap );
+  g_free ( next );
+  g_free ( prev );
+  g_free ( keep );
+  g_free ( xy );
+  g_free ( tps );
+  return new_tr;
+}
+
+/**
+ * vik_track_copy_thinned:
+ * @distance: Keep a trackpoint at least this far (in metres) from the last one kept, 0 to ignore
+ * @seconds:  Keep a trackpoint at least this long after the last one kept, 0 to ignore
+ *
+ * Decimate the track by distance and/or time.
+ * Segment start and end points are always kept.
+ * The track itself is not changed, so this may be used on many tracks in parallel.
+ *
+ * Returns: A new track with the remaining trackpoints
+ */
+VikTrack *vik_track_copy_thinned ( const VikTrack *tr, gdouble distance, guint seconds )
+{
+  VikTrack *new_tr = vik_track_copy ( tr, FALSE );
+  VikTrackpoint *last = NULL;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    gboolean keep = ( !last || tp->newsegment || !iter->next || VIK_TRACKPOINT(iter->next->data)->newsegment );
+    if ( !keep && distance <= 0.0 && seconds == 0 )
+      keep = TRUE;
+    if ( !keep && distance > 0.0 && vik_coord_diff ( &tp->coord, &last->coord ) >= distance )
+      keep = TRUE;
+    if ( !keep && seconds && !isnan(tp->timestamp) && !isnan(last->timestamp) &&
+         tp->timestamp - last->timestamp >= seconds )
+      keep = TRUE;
+    if ( keep ) {
+      new_tr->trackpoints = g_list_prepend ( new_tr->trackpoints, vik_trackpoint_copy ( tp ) );
+      last = tp;
+    }
+  }
+  new_tr->trackpoints = g_list_reverse ( new_tr->trackpoints );
+  vik_track_calculate_bounds ( new_tr );
+  return new_tr;
+}
+
+/**
+ * vik_track_get_simplified_trackpoints:
+ * @mpp: The metres per pixel the track is to be drawn at
+ *
+ * Returns: A list of trackpoints visually equivalent to the full track at the given scale.
+ *  This is either the track's own trackpoint list, or a cached reduced version of it
+ *  (which is owned by the track and must not be modified).
+ *  The reduced versions are generated on demand and only include copies of the trackpoint data,
+ *  so should only be used for drawing.
+ */
+GList *vik_track_get_simplified_trackpoints ( VikTrack *tr, gdouble mpp )
+{
+  // Allow up to half a pixel of deviation
+  gdouble tolerance = mpp / 2.0;
+  if ( tolerance < SIMPLIFY_BASE_TOLERANCE || !tr->trackpoints || !tr->trackpoints->next )
+    return tr->trackpoints;
+
+  gint level = (gint)floor ( log2 ( tolerance / SIMPLIFY_BASE_TOLERANCE ) );
+  level = MIN ( level, SIMPLIFY_LEVELS-1 );
+
+  if ( !tr->simplified )
+    tr->simplified = g_new0 ( GList*, SIMPLIFY_LEVELS );
+  if ( !tr->simplified[level] )
+    tr->simplified[level] = track_simplify ( tr, SIMPLIFY_BASE_TOLERANCE * (1 << level) );
+
+  return tr->simplified[level];
+}
+
+/**
+ * vik_track_get_mercator_lats:
+ * @list:  Either the track's own trackpoints or a list from vik_track_get_simplified_trackpoints()
+ * @count: Returns the number of values
+ *
+ * Returns: The MERCLAT() value of the latitude of each trackpoint in the list, in order,
+ *  so that drawing in the Mercator drawmode only needs to scale and offset them.
+ *  These are generated on demand and owned by the track, so must not be modified.
+ *  NULL if the trackpoints are not in the Lat/Lon coordinate mode.
+ */
+const gdouble *vik_track_get_mercator_lats ( VikTrack *tr, GList *list, guint *count )
+{
+  *count = 0;
+  if ( !list || VIK_TRACKPOINT(list->data)->coord.mode != VIK_COORD_LATLON )
+    return NULL;
+
+  if ( !tr->mercator )
+    tr->mercator = g_new0 ( VikTrackMercator, 1 );
+
+  guint slot;
+  for ( slot = 0; slot < MERCATOR_LISTS && tr->mercator->lists[slot]; slot++ ) {
+    if ( tr->mercator->lists[slot] == list ) {
+      *count = tr->mercator->counts[slot];
+      return tr->mercator->lats[slot];
+    }
+  }
+  if ( slot == MERCATOR_LISTS )
+    return NULL;
+
+  guint nn = g_list_length ( list );
+  gdouble *lats = g_new ( gdouble, nn );
+  guint ii = 0;
+  for ( GList *iter = list; iter; iter = iter->next, ii++ )
+    lats[ii] = MERCLAT ( VIK_TRACKPOINT(iter->data)->coord.north_south );
+
+  tr->mercator->lists[slot] = list;
+  tr->mercator->lats[slot] = lats;
+  tr->mercator->counts[slot] = nn;
+  *count = nn;
+  return lats;
 }
 
 /**
@@ -2053,6 +3574,7 @@ void vik_track_calculate_bounds ( VikTrack *trk )
  */
 void vik_track_anonymize_times ( VikTrack *tr )
 {
+  vik_track_clear_caches ( tr );
   GTimeVal gtv;
   // Check result just to please Coverity - even though it shouldn't fail as it's a hard coded value here!
   if ( !g_time_val_from_iso8601 ( "1901-01-01T00:00:00Z", &gtv ) ) {
@@ -2078,6 +3600,7 @@ void vik_track_anonymize_times ( VikTrack *tr )
     }
     tp_iter = tp_iter->next;
   }
+  vik_track_clear_caches ( tr );
 }
 
 /**
@@ -2091,6 +3614,7 @@ void vik_track_anonymize_times ( VikTrack *tr )
  */
 void vik_track_interpolate_times ( VikTrack *tr )
 {
+  vik_track_clear_caches ( tr );
   gdouble tr_dist, cur_dist;
   gdouble tsdiff, tsfirst;
 
@@ -2118,12 +3642,13 @@ void vik_track_interpolate_times ( VikTrack *tr )
         while ( iter->next && iter->next->next ) {
           iter = iter->next;
           tp = VIK_TRACKPOINT(iter->data);
-          cur_dist += vik_coord_diff ( &(tp->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) );
+          cur_dist += vik_coord_diff_fast ( &(tp->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) );
 
           tp->timestamp = (cur_dist / tr_dist) * tsdiff + tsfirst;
         }
         // Some points may now have the same time so remove them.
         vik_track_remove_same_time_points ( tr );
+        vik_track_clear_caches ( tr );
       }
     }
   }
@@ -2137,25 +3662,40 @@ void vik_track_interpolate_times ( VikTrack *tr )
  */
 gulong vik_track_apply_dem_data ( VikTrack *tr, gboolean skip_existing )
 {
+  vik_track_clear_caches ( tr );
   gulong num = 0;
   GList *tp_iter;
-  gint16 elev;
-  tp_iter = tr->trackpoints;
-  while ( tp_iter ) {
+
+  // Gather the positions wanting an elevation so the DEMs can be searched all in one go
+  guint len = g_list_length ( tr->trackpoints );
+  VikTrackpoint **tps = g_new ( VikTrackpoint*, len );
+  VikCoord *coords = g_new ( VikCoord, len );
+  guint count = 0;
+  for ( tp_iter = tr->trackpoints; tp_iter; tp_iter = tp_iter->next ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(tp_iter->data);
     // Don't apply if the point already has a value and the overwrite is off
-    if ( !(skip_existing && !isnan(VIK_TRACKPOINT(tp_iter->data)->altitude)) ) {
-      /* TODO: of the 4 possible choices we have for choosing an elevation
-       * (trackpoint in between samples), choose the one with the least elevation change
-       * as the last */
-      elev = a_dems_get_elev_by_coord ( &(VIK_TRACKPOINT(tp_iter->data)->coord), VIK_DEM_INTERPOL_BEST );
-
-      if ( elev != VIK_DEM_INVALID_ELEVATION ) {
-        VIK_TRACKPOINT(tp_iter->data)->altitude = elev;
-	num++;
+    if ( !(skip_existing && !isnan(tp->altitude)) ) {
+      tps[count] = tp;
+      coords[count] = tp->coord;
+      count++;
+    }
+  }
+
+  /* TODO: of the 4 possible choices we have for choosing an elevation
+   * (trackpoint in between samples), choose the one with the least elevation change
+   * as the last */
+  gint16 *elevs = g_new ( gint16, count );
+  if ( a_dems_get_elevs_by_coords ( coords, count, VIK_DEM_INTERPOL_BEST, elevs ) ) {
+    for ( guint ii = 0; ii < count; ii++ ) {
+      if ( elevs[ii] != VIK_DEM_INVALID_ELEVATION ) {
+        tps[ii]->altitude = elevs[ii];
+        num++;
       }
     }
-    tp_iter = tp_iter->next;
   }
+  g_free ( elevs );
+  g_free ( coords );
+  g_free ( tps );
   return num;
 }
 
@@ -2229,6 +3769,7 @@ static void smoothie ( GList *tp1, GList *tp2, gdouble elev1, gdouble elev2, gui
  */
 gulong vik_track_smooth_missing_elevation_data ( VikTrack *tr, gboolean flat )
 {
+  vik_track_clear_caches ( tr );
   gulong num = 0;
 
   GList *tp_iter;
@@ -2294,14 +3835,11 @@ gulong vik_track_smooth_missing_elevation_data ( VikTrack *tr, gboolean flat )
  */
 void vik_track_steal_and_append_trackpoints ( VikTrack *t1, VikTrack *t2 )
 {
-  if ( t1->trackpoints ) {
-    t1->trackpoints = g_list_concat ( t1->trackpoints, t2->trackpoints );
-  } else
-    t1->trackpoints = t2->trackpoints;
+  // Trackpoints updated - only the bounds of those added need considering
+  (void)vik_track_append_trackpoints ( t1, NULL, t2->trackpoints );
+  t1->extensions_pending |= t2->extensions_pending;
   t2->trackpoints = NULL;
-
-  // Trackpoints updated - so update the bounds
-  vik_track_calculate_bounds ( t1 );
+  vik_track_clear_caches ( t2 );
 }
 
 /**
@@ -2322,6 +3860,7 @@ VikCoord *vik_track_cut_back_to_double_point ( VikTrack *tr )
   while ( iter->next )
     iter = iter->next;
 
+  vik_track_clear_caches ( tr );
 
   while ( iter->prev ) {
     VikCoord *cur_coord = &((VikTrackpoint*)iter->data)->coord;
@@ -2334,7 +3873,7 @@ VikCoord *vik_track_cut_back_to_double_point ( VikTrack *tr )
 
       /* truncate trackpoint list */
       iter->prev = NULL; /* pretend it's the end */
-      g_list_foreach ( iter, (GFunc) g_free, NULL );
+      trackpoints_free ( iter );
       g_list_free( iter );
 
       prev->next = NULL;
@@ -2347,7 +3886,7 @@ VikCoord *vik_track_cut_back_to_double_point ( VikTrack *tr )
   /* no double point found! */
   rv = g_malloc(sizeof(VikCoord));
   *rv = ((VikTrackpoint*) tr->trackpoints->data)->coord;
-  g_list_foreach ( tr->trackpoints, (GFunc) g_free, NULL );
+  trackpoints_free ( tr->trackpoints );
   g_list_free( tr->trackpoints );
   tr->trackpoints = NULL;
   return rv;
@@ -2452,7 +3991,7 @@ GArray *vik_track_speed_splits (const VikTrack *tr, gdouble split_length )
          !tp1->newsegment ) {
 
       gdouble diff;
-      len += vik_coord_diff ( &(tp2->coord), &(tp1->coord) );
+      len += vik_coord_diff_fast ( &(tp2->coord), &(tp1->coord) );
       time += ABS(tp1->timestamp - tp2->timestamp);
 
       if ( !isnan(tp1->altitude) && !isnan(tp2->altitude) ) {
@@ -2471,7 +4010,7 @@ GArray *vik_track_speed_splits (const VikTrack *tr, gdouble split_length )
         //  need to interpolate back to the split point to get proper split metrics
 
         // This bit assumes individual distances between track points won't ever be bigger than the split distances
-        gdouble tmp_len = vik_coord_diff ( &(tp1->coord), &tp2->coord);
+        gdouble tmp_len = vik_coord_diff_fast ( &(tp1->coord), &tp2->coord);
         gdouble over_dist = len - split_length;
         // Ratio of the distance to the virtual split point, compared to point that is over the split point
         gdouble scale = (split_length - (len - tmp_len)) / tmp_len;
@@ -40,10 +40,12 @@ G_BEGIN_DECLS
 #define VIK_TRACKPOINT(x) ((VikTrackpoint *)(x))
 
 typedef struct _VikTrackpoint VikTrackpoint;
+// NB Members are ordered to avoid padding, as there can be millions of these
+//  The values most used for drawing and analysis are kept together at the start
 struct _VikTrackpoint {
-  gchar* name;
   VikCoord coord;
   gboolean newsegment;
+  gint power;        // Watts: VIK_TRKPT_POWER_NONE if data unavailable
   gdouble timestamp;  	/* NAN if data unavailable */
   gdouble altitude;	/* NAN if data unavailable */
   gdouble speed;  	/* NAN if data unavailable */
@@ -53,11 +55,11 @@ struct _VikTrackpoint {
   gdouble hdop;     /* NAN if data unavailable */
   gdouble vdop;     /* NAN if data unavailable */
   gdouble pdop;     /* NAN if data unavailable */
-  gchar *extensions; // GPX 1.1 extensions - currently uneditable
   guint heart_rate;  // Beats per Minute (bpm): 0 if data unavailable
   gint cadence;      // In Revs Per Minute (RPM): VIK_TRKPT_CADENCE_NONE if data unavailable
   gdouble temp;      // Temperature is in degrees C: NAN if data unavailable
-  gint power;        // Watts: VIK_TRKPT_POWER_NONE if data unavailable
+  gchar* name;
+  gchar *extensions; // GPX 1.1 extensions - currently uneditable, shared via the string pool
 };
 
 typedef enum {
@@ -76,6 +78,13 @@ typedef enum {
 //  This is simpler than having to rewrite particularly every track function for route version
 //   given that they do the same things
 //  Mostly this matters in the display in deciding where and how they are shown
+typedef struct _VikTrackPositions VikTrackPositions;
+typedef struct _VikTrackSummary VikTrackSummary;
+typedef struct _VikTrackMercator VikTrackMercator;
+typedef struct _VikTrackChunks VikTrackChunks;
+typedef struct _VikTrackDrawValues VikTrackDrawValues;
+typedef struct _VikTrackSnapshot VikTrackSnapshot;
+
 typedef struct _VikTrack VikTrack;
 struct _VikTrack {
   GList *trackpoints;
@@ -85,16 +94,27 @@ struct _VikTrack {
   guint8 max_number_dist_labels;
   gchar *comment;
   gchar *description;
-  gchar *source;
+  gchar *source; // Shared via the string pool, as per the type
   guint number;
-  gchar *type;
-  guint8 ref_count;
+  gchar *type; // Shared via the string pool, so only use vik_track_set_type()
+  gint ref_count; // Atomic
   gchar *name;
   gchar *extensions; // GPX 1.1 extensions - currently uneditable
   GtkWidget *property_dialog;
   gboolean has_color;
   GdkColor color;
   LatLonBBox bbox;
+  GList **simplified; // Lazily generated reduced copies of the trackpoints for drawing, see vik_track_get_simplified_trackpoints()
+  VikTrackChunks *chunks; // Lazily generated bounds of runs of trackpoints for searching and drawing, see vik_track_get_chunks()
+  VikTrackPositions *positions; // Lazily generated distances along the track, for the positional lookups
+  VikTrackSummary *summary; // Remembered result of vik_track_get_summary()
+  VikTrackMercator *mercator; // Lazily generated projected latitudes for drawing, see vik_track_get_mercator_lats()
+  VikTrackDrawValues *draw_values; // Remembered values needed on every redraw, see vik_track_get_minmax_alt_cached()
+  VikTrackSnapshot *snapshot; // Copy of the trackpoints for background threads, see vik_track_get_snapshot()
+  VikCoordTZ tz_cache; // Timezone at the first trackpoint
+  gboolean extensions_pending; // Sensor values of the trackpoints not yet read from their extensions, see vik_track_decode_extensions()
+  GBytes *packed; // The trackpoints whilst the track is unused (then trackpoints is NULL), see vik_track_pack()
+  gint64 unused_since; // Monotonic time, for the owner to decide when to pack the track
 };
 
 typedef struct {
@@ -105,6 +125,40 @@ typedef struct {
   gdouble elev_down; // Loss in elevation: Metres
 } VikTrackSpeedSplits_t;
 
+// Stop length used for the summary's moving average speed
+#define VIK_TRACK_SUMMARY_STOP_LENGTH 60
+
+// The common statistics of a whole track, as gathered in a single pass
+// Each value is as per the corresponding individual vik_track_get_*() function
+struct _VikTrackSummary {
+  gulong tp_count;
+  guint segment_count;
+  gulong dup_point_count;
+  gdouble length;    // Metres
+  gdouble length_inc_gaps;
+  gdouble duration;  // Seconds - within segments
+  gdouble start_time; // Timestamps of the first and last trackpoints, NAN if not available
+  gdouble end_time;
+  gdouble max_speed; // m/s
+  gdouble avg_speed;
+  gdouble avg_speed_moving; // Using VIK_TRACK_SUMMARY_STOP_LENGTH
+  gboolean has_alt;  // Whether min_alt and max_alt are valid
+  gdouble min_alt;
+  gdouble max_alt;
+  gdouble elev_up;   // Metres
+  gdouble elev_down;
+  guint max_heart_rate;
+  gdouble avg_heart_rate;
+  gint max_cadence;
+  gdouble avg_cadence;
+  gboolean has_temp; // Whether min_temp and max_temp are valid
+  gdouble min_temp;
+  gdouble max_temp;
+  gdouble avg_temp;
+  gint max_power;
+  gdouble avg_power;
+};
+
 VikTrack *vik_track_new();
 void vik_track_set_defaults(VikTrack *tr);
 void vik_track_set_name(VikTrack *tr, const gchar *name);
@@ -113,6 +167,9 @@ void vik_track_set_description(VikTrack *tr, const gchar *description);
 void vik_track_set_source(VikTrack *tr, const gchar *source);
 void vik_track_set_type(VikTrack *tr, const gchar *type);
 void vik_track_set_extensions(VikTrack *tr, const gchar *value);
+void vik_track_decode_extensions ( VikTrack *tr );
+gboolean vik_track_pack ( VikTrack *tr );
+void vik_track_unpack ( VikTrack *tr );
 void vik_track_ref(VikTrack *tr);
 void vik_track_free(VikTrack *tr);
 VikTrack *vik_track_copy ( const VikTrack *tr, gboolean copy_points );
@@ -125,6 +182,7 @@ void vik_trackpoint_set_extensions(VikTrackpoint *tp, const gchar *value);
 gboolean vik_trackpoint_apply_dem_data(VikTrackpoint *tp);
 
 void vik_track_add_trackpoint(VikTrack *tr, VikTrackpoint *tp, gboolean recalculate);
+GList *vik_track_append_trackpoints ( VikTrack *tr, GList *tail, GList *tpl );
 gdouble vik_track_get_length_to_trackpoint (const VikTrack *tr, const VikTrackpoint *tp);
 gdouble vik_track_get_length(const VikTrack *tr);
 gdouble vik_track_get_length_including_gaps(const VikTrack *tr);
@@ -142,9 +200,18 @@ gulong vik_track_remove_same_time_points ( VikTrack *vt );
 
 gboolean vik_track_remove_dodgy_first_point ( VikTrack *vt, guint speed, gboolean recalc_bounds );
 
+typedef enum {
+  VIK_TRACK_TIDY_DODGY_FIRST_POINT = 1 << 0,
+  VIK_TRACK_TIDY_DUP_POINTS        = 1 << 1,
+  VIK_TRACK_TIDY_SAME_TIME_POINTS  = 1 << 2,
+} VikTrackTidyFlags;
+
+gulong vik_track_tidy ( VikTrack *tr, VikTrackTidyFlags flags, guint speed, gboolean recalc_bounds );
+
 void vik_track_to_routepoints ( VikTrack *tr );
 
 gdouble vik_track_get_max_speed(const VikTrack *tr);
+void vik_track_get_summary ( const VikTrack *tr, VikTrackSummary *summary );
 gdouble vik_track_get_average_speed(const VikTrack *tr);
 gdouble vik_track_get_average_speed_moving ( const VikTrack *tr, int stop_length_seconds );
 
@@ -178,11 +245,32 @@ VikTrackpoint *vik_track_get_tp_by_min_alt ( const VikTrack *tr );
 VikTrackpoint *vik_track_get_tp_first ( const VikTrack *tr );
 VikTrackpoint *vik_track_get_tp_last ( const VikTrack *tr );
 VikTrackpoint *vik_track_get_tp_prev ( const VikTrack *tr, VikTrackpoint *tp );
+
+// A position at one of the trackpoints of a track, for stepping along it in either direction
+//  without searching from the start each time (see vik_track_cursor_set())
+typedef struct {
+  VikTrack *trk;
+  GList *tpl;     // The current trackpoint, NULL when none
+  gint index;     // Of the current trackpoint when known, otherwise -1
+  guint changes;  // The vik_track_get_changes_count() when the index was known
+} VikTrackCursor;
+
+#define vik_track_cursor_get_tp(cur) ((cur)->tpl ? VIK_TRACKPOINT((cur)->tpl->data) : NULL)
+
+void vik_track_cursor_set ( VikTrackCursor *cur, VikTrack *tr, GList *tpl );
+void vik_track_cursor_clear ( VikTrackCursor *cur );
+gboolean vik_track_cursor_seek ( VikTrackCursor *cur, VikTrack *tr, guint index );
+gboolean vik_track_cursor_find ( VikTrackCursor *cur, VikTrack *tr, VikTrackpoint *tp );
+gboolean vik_track_cursor_next ( VikTrackCursor *cur );
+gboolean vik_track_cursor_prev ( VikTrackCursor *cur );
+gint vik_track_cursor_get_index ( VikTrackCursor *cur );
+guint vik_track_cursor_get_count ( VikTrackCursor *cur );
 gdouble *vik_track_make_gradient_map ( const VikTrack *tr, guint16 num_chunks );
 gdouble *vik_track_make_speed_map ( const VikTrack *tr, guint16 num_chunks );
 gdouble *vik_track_make_distance_map ( const VikTrack *tr, guint16 num_chunks );
 gdouble *vik_track_make_elevation_time_map ( const VikTrack *tr, guint16 num_chunks );
 gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks );
+VikCoord *vik_track_make_position_map ( const VikTrack *tr, guint16 num_chunks );
 typedef enum {
   TRACK_VALUE_ELEVATION=0,
   TRACK_VALUE_HEART_RATE,
@@ -193,11 +281,58 @@ typedef enum {
 } VikTrackValueType;
 gdouble *vik_track_make_time_map_for ( const VikTrack *tr, guint16 num_chunks, VikTrackValueType value_type );
 gboolean vik_track_get_minmax_alt ( const VikTrack *tr, gdouble *min_alt, gdouble *max_alt );
+gboolean vik_track_get_minmax_alt_cached ( const VikTrack *tr, gdouble *min_alt, gdouble *max_alt );
+gdouble vik_track_get_average_speed_moving_cached ( const VikTrack *tr, int stop_length_seconds );
+gdouble vik_track_get_length_including_gaps_cached ( VikTrack *tr );
+const GArray *vik_track_get_dist_label_positions ( VikTrack *tr, gdouble interval, guint count );
 void vik_track_marshall ( VikTrack *tr, guint8 **data, guint *len);
 VikTrack *vik_track_unmarshall (const guint8 *data_in, guint datalen);
 
 void vik_track_calculate_bounds ( VikTrack *trk );
 
+GList *vik_track_get_simplified_trackpoints ( VikTrack *tr, gdouble mpp );
+VikTrack *vik_track_copy_simplified ( const VikTrack *tr, gdouble tolerance );
+gulong vik_track_simplify ( VikTrack *tr, gdouble tolerance );
+VikTrack *vik_track_copy_reduced ( const VikTrack *tr, guint max_points );
+VikTrack *vik_track_copy_thinned ( const VikTrack *tr, gdouble distance, guint seconds );
+const gdouble *vik_track_get_mercator_lats ( VikTrack *tr, GList *list, guint *count );
+void vik_track_clear_caches ( VikTrack *tr );
+guint vik_track_get_changes_count ( void );
+
+// A run of consecutive trackpoints of a list and the area they cover
+typedef struct {
+  GList *start;
+  guint count;
+  LatLonBBox bbox;
+} VikTrackChunk;
+
+GArray *vik_track_get_chunks ( VikTrack *tr, GList *list );
+
+// The values of a trackpoint used by background analysis
+typedef struct {
+  VikCoord coord;
+  gdouble timestamp;
+  gdouble altitude;
+  gboolean newsegment;
+} VikTrackSnapshotPoint;
+
+// Read only copy of the trackpoints at a point in time, which may be shared between threads
+struct _VikTrackSnapshot {
+  gint ref_count; // Atomic
+  LatLonBBox bbox;
+  guint n_points;
+  VikTrackSnapshotPoint *points;
+};
+
+void vik_track_get_memory ( const VikTrack *tr, gsize *points, gsize *strings, gsize *extensions, gsize *caches );
+
+VikTrackSnapshot *vik_track_get_snapshot ( VikTrack *tr );
+VikTrackSnapshot *vik_track_snapshot_ref ( VikTrackSnapshot *snap );
+void vik_track_snapshot_unref ( VikTrackSnapshot *snap );
+typedef void (*VikTrackTplFunc) ( GList *tpl, gpointer user_data );
+void vik_track_foreach_in_bbox ( VikTrack *tr, LatLonBBox bbox, VikTrackTplFunc func, gpointer user_data );
+VikTrack *vik_track_split_at ( VikTrack *tr, GList *split, guint *position );
+
 void vik_track_anonymize_times ( VikTrack *tr );
 void vik_track_interpolate_times ( VikTrack *tr );
 gulong vik_track_apply_dem_data ( VikTrack *tr, gboolean skip_existing );
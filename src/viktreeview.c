@@ -771,42 +771,53 @@ typedef struct _SortTuple
 } SortTuple;
 
 /**
- *
+ * Shared by the in place sort of existing rows and the presort of new rows
  */
-static gint sort_tuple_compare ( gconstpointer a, gconstpointer b, gpointer order )
+static gint sort_values_compare ( const gchar *name_a, gdouble timestamp_a, guint number_a,
+                                  const gchar *name_b, gdouble timestamp_b, guint number_b,
+                                  vik_layer_sort_order_t order )
 {
-  SortTuple *sa = (SortTuple *)a;
-  SortTuple *sb = (SortTuple *)b;
-
   gint answer = -1;
-  if ( GPOINTER_TO_INT(order) < VL_SO_DATE_ASCENDING ) {
+  if ( order < VL_SO_DATE_ASCENDING ) {
     // Alphabetical comparison
     // Default ascending order
-    answer = g_strcmp0 ( sa->name, sb->name );
+    answer = g_strcmp0 ( name_a, name_b );
     // Invert sort order for descending order
-    if ( GPOINTER_TO_INT(order) == VL_SO_ALPHABETICAL_DESCENDING )
+    if ( order == VL_SO_ALPHABETICAL_DESCENDING )
       answer = -answer;
   }
-  else if ( GPOINTER_TO_INT(order) < VL_SO_NUMBER_ASCENDING ) {
+  else if ( order < VL_SO_NUMBER_ASCENDING ) {
     // Date comparison
-    gboolean ans = ( sa->timestamp > sb->timestamp );
+    gboolean ans = ( timestamp_a > timestamp_b );
     if ( ans )
       answer = 1;
     // Invert sort order for descending order
-    if ( GPOINTER_TO_INT(order) == VL_SO_DATE_DESCENDING )
+    if ( order == VL_SO_DATE_DESCENDING )
       answer = -answer;
   } else {
     // Number comparison
-    gboolean ans = ( sa->number > sb->number );
+    gboolean ans = ( number_a > number_b );
     if ( ans )
       answer = 1;
     // Invert sort order for descending order
-    if ( GPOINTER_TO_INT(order) == VL_SO_NUMBER_DESCENDING )
+    if ( order == VL_SO_NUMBER_DESCENDING )
       answer = -answer;
   }
   return answer;
 }
 
+/**
+ *
+ */
+static gint sort_tuple_compare ( gconstpointer a, gconstpointer b, gpointer order )
+{
+  SortTuple *sa = (SortTuple *)a;
+  SortTuple *sb = (SortTuple *)b;
+  return sort_values_compare ( sa->name, sa->timestamp, sa->number,
+                               sb->name, sb->timestamp, sb->number,
+                               GPOINTER_TO_INT(order) );
+}
+
 /**
  * Note: I don't believe we can sensibility use built in model sort gtk_tree_model_sort_new_with_model() on the name,
  * since that would also sort the layers - but that needs to be user controlled for ordering, such as which maps get drawn on top.
@@ -873,6 +884,120 @@ void vik_treeview_sort_children ( VikTreeview *vt, GtkTreeIter *parent, vik_laye
   g_free ( positions );
 }
 
+static gint sublayer_compare ( gconstpointer a, gconstpointer b, gpointer order )
+{
+  const VikTreeviewSublayer *sa = a;
+  const VikTreeviewSublayer *sb = b;
+  return sort_values_compare ( sa->name, sa->timestamp, sa->number,
+                               sb->name, sb->timestamp, sb->number,
+                               GPOINTER_TO_INT(order) );
+}
+
+static void collect_expanded_cb ( GtkTreeView *tree_view, GtkTreePath *path, gpointer user_data )
+{
+  GSList **expanded = user_data;
+  *expanded = g_slist_prepend ( *expanded, gtk_tree_path_copy(path) );
+}
+
+// Below this many rows it is cheaper to let the view follow each insert
+//  than to detach the model and restore the view state afterwards
+#define DETACH_MODEL_THRESHOLD 200
+
+/**
+ * vik_treeview_add_sublayers:
+ * @vt:          The treeview to operate on
+ * @parent_iter: The level within the treeview to add to
+ * @parent:      As for vik_treeview_add_sublayer()
+ * @data:        The sublayer type of all the items
+ * @items:       The items to add, the iter of each is set on return
+ * @count:       The number of items
+ * @order:       How the items should be sorted
+ *
+ * Add many sublayer items in one go, such as when a layer with many thousands of waypoints is realized.
+ *
+ * When there are no existing children the items are sorted before inserting them,
+ *  so no reordering is needed afterwards. NB this reorders the @items array.
+ * For large numbers of items the model is detached from the view during the inserts,
+ *  otherwise each row insert makes the view update itself.
+ * The expanded rows, selection and scroll position are restored afterwards.
+ */
+void vik_treeview_add_sublayers ( VikTreeview *vt, GtkTreeIter *parent_iter, gpointer parent, gint data,
+                                  VikTreeviewSublayer *items, guint count, vik_layer_sort_order_t order )
+{
+  if ( count == 0 )
+    return;
+
+  gboolean sort_after = FALSE;
+  if ( order != VL_SO_NONE ) {
+    if ( gtk_tree_model_iter_has_child ( vt->model, parent_iter ) )
+      sort_after = TRUE;
+    else
+      g_qsort_with_data ( items, count, sizeof(VikTreeviewSublayer), sublayer_compare, GINT_TO_POINTER(order) );
+  }
+
+  GtkTreeView *tree_view = GTK_TREE_VIEW ( vt );
+  GtkTreeSelection *selection = gtk_tree_view_get_selection ( tree_view );
+  gboolean detach = ( count >= DETACH_MODEL_THRESHOLD && gtk_tree_view_get_model(tree_view) );
+
+  GSList *expanded = NULL;
+  GtkTreeIter selected;
+  gboolean have_selected = FALSE;
+  GtkTreePath *top_path = NULL;
+
+  if ( detach ) {
+    // Only rows beneath parent_iter get added, so paths elsewhere remain valid
+    gtk_tree_view_map_expanded_rows ( tree_view, collect_expanded_cb, &expanded );
+    have_selected = gtk_tree_selection_get_selected ( selection, NULL, &selected );
+    if ( !gtk_tree_view_get_visible_range ( tree_view, &top_path, NULL ) )
+      top_path = NULL;
+
+    g_signal_handlers_block_by_func ( selection, select_cb, vt );
+    g_object_ref ( vt->model );
+    gtk_tree_view_set_model ( tree_view, NULL );
+  }
+
+  for ( guint ii = 0; ii < count; ii++ ) {
+    // Setting all values as part of the insert means only one row signal per item
+    gtk_tree_store_insert_with_values ( GTK_TREE_STORE(vt->model), &(items[ii].iter), parent_iter, -1,
+                                        NAME_COLUMN, items[ii].name,
+                                        VISIBLE_COLUMN, items[ii].visible,
+                                        TYPE_COLUMN, VIK_TREEVIEW_TYPE_SUBLAYER,
+                                        ITEM_PARENT_COLUMN, parent,
+                                        ITEM_POINTER_COLUMN, items[ii].item,
+                                        ITEM_DATA_COLUMN, data,
+                                        EDITABLE_COLUMN, TRUE,
+                                        ICON_COLUMN, items[ii].icon,
+                                        ITEM_TIMESTAMP_COLUMN, items[ii].timestamp,
+                                        ITEM_NUMBER_COLUMN, items[ii].number,
+                                        -1 );
+  }
+
+  if ( sort_after )
+    vik_treeview_sort_children ( vt, parent_iter, order );
+
+  if ( detach ) {
+    gtk_tree_view_set_model ( tree_view, vt->model );
+    g_object_unref ( vt->model );
+
+    // Parents must be expanded before their children, so restore in the order they were found
+    expanded = g_slist_reverse ( expanded );
+    for ( GSList *it = expanded; it; it = it->next ) {
+      gtk_tree_view_expand_row ( tree_view, (GtkTreePath*)it->data, FALSE );
+      gtk_tree_path_free ( (GtkTreePath*)it->data );
+    }
+    g_slist_free ( expanded );
+
+    if ( have_selected )
+      gtk_tree_selection_select_iter ( selection, &selected );
+    g_signal_handlers_unblock_by_func ( selection, select_cb, vt );
+
+    if ( top_path ) {
+      gtk_tree_view_scroll_to_cell ( tree_view, top_path, NULL, TRUE, 0.0, 0.0 );
+      gtk_tree_path_free ( top_path );
+    }
+  }
+}
+
 static void vik_treeview_finalize ( GObject *gob )
 {
   VikTreeview *vt = VIK_TREEVIEW ( gob );
@@ -98,6 +98,25 @@ void vik_treeview_insert_layer ( VikTreeview *vt, GtkTreeIter *parent_iter, GtkT
 void vik_treeview_add_sublayer ( VikTreeview *vt, GtkTreeIter *parent_iter, GtkTreeIter *iter, const gchar *name, gpointer parent, gpointer item,
                                  gint data, GdkPixbuf *icon, gboolean editable, gdouble timestamp, guint number );
 
+/**
+ * VikTreeviewSublayer:
+ *
+ * One entry for vik_treeview_add_sublayers().
+ * The iter is filled in on return.
+ */
+typedef struct {
+  const gchar *name;
+  gpointer item;
+  GdkPixbuf *icon;
+  gboolean visible;
+  gdouble timestamp;
+  guint number;
+  GtkTreeIter iter;
+} VikTreeviewSublayer;
+
+void vik_treeview_add_sublayers ( VikTreeview *vt, GtkTreeIter *parent_iter, gpointer parent, gint data,
+                                  VikTreeviewSublayer *items, guint count, vik_layer_sort_order_t order );
+
 gboolean vik_treeview_get_iter_with_name ( VikTreeview *vt, GtkTreeIter *iter, GtkTreeIter *parent_iter, const gchar *name );
 
 void vik_treeview_sort_children ( VikTreeview *vt, GtkTreeIter *parent, vik_layer_sort_order_t order );
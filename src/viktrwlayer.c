@@ -43,6 +43,11 @@
 #include "thumbnails.h"
 #include "background.h"
 #include "gpx.h"
+#include "trwbinary.h"
+#include "autosave.h"
+#include "tracktimeindex.h"
+#include "pickbuffer.h"
+#include "tracklod.h"
 #include "geojson.h"
 #include "babel.h"
 #include "dem.h"
@@ -107,6 +112,8 @@ typedef enum {
   VIK_EXTERNAL_TYPE_LAST
 } trw_external_type_t;
 
+typedef struct _TrwPick TrwPick;
+
 struct _VikTrwLayer {
   VikLayer vl;
   GHashTable *tracks;
@@ -117,7 +124,15 @@ struct _VikTrwLayer {
   GHashTable *waypoints;
   GtkTreeIter tracks_iter, routes_iter, waypoints_iter;
   gboolean tracks_visible, routes_visible, waypoints_visible;
+  gboolean items_deferred; // Item rows not yet in the treeview, see trw_layer_realize_items()
+  gulong expand_handler;
   LatLonBBox waypoints_bbox;
+  TrackTimeIndex *tracks_time_index; // Lazily generated, see trw_layer_get_tracks_time_index()
+  guint pack_timer_id; // See trw_layer_pack_sweep()
+  guint packed_count; // Tracks or routes packed since last unpacking them all (some may have since been unpacked)
+  TrackLod *lod; // Lazily created, see trw_layer_draw_lod()
+  gboolean lod_forced; // See vik_trw_layer_set_lod_forced()
+  GHashTable *waypoints_names, *tracks_names, *routes_names; // Lazily generated, see trw_layer_names_get()
 
   gboolean track_draw_labels;
   guint8 drawmode;
@@ -152,10 +167,12 @@ struct _VikTrwLayer {
   font_size_t wp_font_size;
   gchar *wp_fsize_str;
   vik_layer_sort_order_t wp_sort_order;
+  gboolean wp_cluster;
+  guint wp_cluster_zoom; // Index into params_wp_cluster_zooms
 
   gdouble track_draw_speed_factor;
   GArray *track_gc;
-  GdkGC *track_1color_gc;
+  GHashTable *track_color_gcs; // GCs for DRAWMODE_BY_TRACK, keyed by the track colour
   GdkColor track_color;
   GdkGC *current_track_gc;
   // Separate GC for a track's potential new point as drawn via separate method
@@ -185,8 +202,7 @@ struct _VikTrwLayer {
   gboolean waypoint_rightclick;
 
   /* track editing tool */
-  GList *current_tpl;
-  VikTrack *current_tp_track;
+  VikTrackCursor current_tp; // The selected trackpoint
   VikTrwLayerTpwin *tpwin;
 
   /* track editing tool -- more specifically, moving tps */
@@ -195,7 +211,14 @@ struct _VikTrwLayer {
   /* route finder tool */
   gboolean route_finder_check_added_track;
   VikTrack *route_finder_added_track;
-  gboolean route_finder_append;
+  GList *route_legs;         // Legs still being found, in order
+  VikTrack *route_legs_track; // Which the legs are for, held while any are
+
+  /* edit journal */
+  GQueue journal_undo; // Latest edit first
+  GQueue journal_redo;
+  GList *journal_unrecorded; // Deltas of the latest edits, yet to be recorded for autosave
+  guint journal_record_id;
 
   gboolean drawlabels;
   gboolean drawimages;
@@ -207,6 +230,9 @@ struct _VikTrwLayer {
   /* for waypoint text */
   PangoLayout *wplabellayout;
 
+  // Pixel sizes of label markups, so labels can be placed without laying them out every draw
+  GHashTable *label_sizes;
+
   gboolean has_verified_thumbnails;
 
   GtkMenu *wp_right_click_menu;
@@ -224,8 +250,62 @@ struct _VikTrwLayer {
   gchar *external_file;
   gboolean external_loaded;
   gchar *external_dirpath;
+  // Following changes to a read only external file, e.g. as a logger appends to it
+  GFileMonitor *external_monitor;
+  guint external_reload_id;
+  GpxResume *external_resume;
+
+  // Binary layer data not yet decoded (see trw_ensure_layer_loaded())
+  GBytes *pending_data;
+  gchar *pending_dirpath;
+  LatLonBBox pending_bbox;
+  gboolean pending_bbox_valid;
+
+  // Screen positions of the trackpoints, for selecting without searching every track
+  //  Made on demand and discarded whenever the layer is drawn, see trw_layer_search_closest_tp()
+  TrwPick *track_pick;
+  TrwPick *route_pick;
 };
 
+#define LABEL_GRID_CELL_SIZE 64
+
+/**
+ * Screen areas taken by labels, by grid cells of the viewport
+ */
+typedef struct {
+  gint cols;
+  gint rows;
+  GArray **cells; // Of GdkRectangle, created as needed
+} LabelGridT;
+
+/**
+ * How a GC draws lines, for drawing the same with Cairo
+ */
+typedef struct {
+  gdouble red, green, blue;
+  gint width;
+  cairo_line_cap_t cap;
+  cairo_line_join_t join;
+  gboolean dashed;
+} RenderedStyleT;
+
+typedef struct {
+  const RenderedStyleT *style;
+  guint start; // Index of its first point
+  guint count;
+  GdkRectangle extent; // Including the line width
+} RenderedLineT;
+
+/**
+ * Track lines collected whilst drawing, then all drawn antialiased via vik_viewport_draw_rendered()
+ */
+typedef struct {
+  GHashTable *styles; // Key is the GC
+  GArray *lines; // Of RenderedLineT
+  GArray *points; // Of GdkPoint
+  GPtrArray *label_tracks; // Labelled once the lines are drawn, so the labels are on top
+} RenderedLinesT;
+
 struct DrawingParams {
   VikViewport *vp;
   VikTrwLayer *vtl;
@@ -238,7 +318,12 @@ struct DrawingParams {
   gboolean one_zone, lat_lon;
   gdouble ce1, ce2, cn1, cn2;
   LatLonBBox bbox;
+  LatLonBBox track_bbox; // The view extended by the size of the trackpoint symbols
   gboolean highlight;
+  gboolean mercator; // Whether vvm is valid
+  VikViewportMercator vvm;
+  LabelGridT *labels; // Labels so far, when overlapping ones are not drawn
+  RenderedLinesT *rendered; // When track lines are drawn afterwards with Cairo
 };
 
 static gboolean trw_layer_delete_waypoint ( VikTrwLayer *vtl, VikWaypoint *wp );
@@ -267,6 +352,7 @@ static void trw_layer_find_maxmin (VikTrwLayer *vtl, struct LatLon maxmin[2]);
 
 static void trw_layer_edit_track_gcs ( VikTrwLayer *vtl, VikViewport *vp );
 static void trw_layer_free_track_gcs ( VikTrwLayer *vtl );
+static void trw_layer_pick_clear ( VikTrwLayer *vtl );
 
 static void trw_layer_draw_track_cb ( const gpointer id, VikTrack *track, struct DrawingParams *dp );
 static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct DrawingParams *dp );
@@ -295,6 +381,8 @@ static void trw_layer_delete_points_same_position ( menu_array_sublayer values )
 static void trw_layer_delete_points_same_time ( menu_array_sublayer values );
 static void trw_layer_reverse ( menu_array_sublayer values );
 static void trw_layer_download_map_along_track_cb ( menu_array_sublayer values );
+static void trw_layer_seed_maps_cb ( menu_array_sublayer values );
+static void trw_layer_tracks_through_route_cb ( menu_array_sublayer values );
 static void trw_layer_edit_trackpoint ( menu_array_sublayer values );
 static void trw_layer_show_picture ( menu_array_sublayer values );
 static void trw_layer_gps_upload_any ( menu_array_sublayer values );
@@ -335,6 +423,7 @@ static void trw_layer_acquire_geocache_cb ( menu_array_layer values );
 static void trw_layer_acquire_geotagged_cb ( menu_array_layer values );
 #endif
 static void trw_layer_acquire_file_cb ( menu_array_layer values );
+static void trw_layer_acquire_fit_cb ( menu_array_layer values );
 static void trw_layer_gps_upload ( menu_array_layer values );
 
 static void trw_layer_track_list_dialog_single ( menu_array_sublayer values );
@@ -354,15 +443,20 @@ static void trw_layer_goto_waypoint ( menu_array_sublayer values );
 static void trw_layer_waypoint_gc_webpage ( menu_array_sublayer values );
 static void trw_layer_waypoint_webpage ( menu_array_sublayer values );
 
-static void trw_layer_realize_waypoint ( gpointer id, VikWaypoint *wp, gpointer pass_along[5] );
-static void trw_layer_realize_track ( gpointer id, VikTrack *track, gpointer pass_along[5] );
+static void trw_layer_realize_items ( VikTrwLayer *vtl );
+static void trw_layer_unpack_tracks ( VikTrwLayer *vtl );
 
 static void trw_layer_insert_tp_beside_current_tp ( VikTrwLayer *vtl, gboolean before, gboolean is_route );
 static void trw_layer_cancel_current_tp ( VikTrwLayer *vtl, gboolean destroy );
+static void trw_layer_journal_clear ( VikTrwLayer *vtl );
+static const gchar *trw_layer_journal_description ( VikTrwLayer *vtl, gboolean undo );
+static void trw_layer_undo ( menu_array_layer values );
+static void trw_layer_redo ( menu_array_layer values );
 static void trw_layer_tpwin_response ( VikTrwLayer *vtl, gint response );
 
 static void trw_layer_sort_order_specified ( VikTrwLayer *vtl, guint sublayer_type, vik_layer_sort_order_t order );
 static void trw_layer_sort_all ( VikTrwLayer *vtl );
+static void trw_layer_update_treeview_iter ( VikTrwLayer *vtl, VikTrack *trk, GtkTreeIter *iter, gboolean do_sort );
 
 static VikLayerToolFuncStatus tool_edit_trackpoint_click ( VikTrwLayer *vtl, GdkEventButton *event, gpointer data );
 static VikLayerToolFuncStatus tool_edit_trackpoint_move ( VikTrwLayer *vtl, GdkEventMotion *event, gpointer data );
@@ -389,7 +483,7 @@ static VikTrackpoint *closest_tp_in_interval ( VikTrwLayer *vtl, VikViewport *vv
 static VikWaypoint *closest_wp_in_interval ( VikTrwLayer *vtl, VikViewport *vvp, gint x, gint y );
 
 static void waypoint_convert ( const gpointer id, VikWaypoint *wp, VikCoordMode *dest_mode );
-static void track_convert ( const gpointer id, VikTrack *tr, VikCoordMode *dest_mode );
+static void track_convert ( const gpointer id, VikTrack *tr, gpointer pass_along[2] );
 
 static gchar *highest_wp_number_get(VikTrwLayer *vtl);
 static void highest_wp_number_reset(VikTrwLayer *vtl);
@@ -575,6 +669,9 @@ static gchar* params_sort_order_wp[] = {
   NULL
 };
 
+// Metres per pixel zoom levels, being powers of two
+static gchar *params_wp_cluster_zooms[] = { "1", "2", "4", "8", "16", "32", "64", "128", "256", "512", "1024", NULL };
+
 // Needs to align with trw_external_type_t
 static gchar* params_external_type[] = {
   N_("No"),
@@ -636,6 +733,8 @@ static VikLayerParamData image_cache_size_default ( void ) { return VIK_LPD_UINT
 
 static VikLayerParamData sort_order_default ( void ) { return VIK_LPD_UINT ( 0 ); }
 
+static VikLayerParamData wp_cluster_zoom_default ( void ) { return VIK_LPD_UINT ( 5 ); } // 32 m/pixel
+
 static VikLayerParamData string_default ( void )
 {
   VikLayerParamData data;
@@ -702,6 +801,10 @@ VikLayerParam trw_layer_params[] = {
   { VIK_LAYER_TRW, "wpsize", VIK_LAYER_PARAM_UINT, GROUP_WAYPOINTS, N_("Waypoint size:"), VIK_LAYER_WIDGET_SPINBUTTON, &params_scales[7], NULL, NULL, wpsize_default, NULL, NULL },
   { VIK_LAYER_TRW, "wpsyms", VIK_LAYER_PARAM_BOOLEAN, GROUP_WAYPOINTS, N_("Draw Waypoint Symbols:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, NULL, vik_lpd_true_default, NULL, NULL },
   { VIK_LAYER_TRW, "wpsortorder", VIK_LAYER_PARAM_UINT, GROUP_WAYPOINTS, N_("Waypoint Sort Order:"), VIK_LAYER_WIDGET_COMBOBOX, params_sort_order_wp, NULL, NULL, sort_order_default, NULL, NULL },
+  { VIK_LAYER_TRW, "wpcluster", VIK_LAYER_PARAM_BOOLEAN, GROUP_WAYPOINTS, N_("Cluster Waypoints:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
+    N_("When zoomed out, waypoints close together on the display are drawn as a single marker showing how many there are"), vik_lpd_false_default, NULL, NULL },
+  { VIK_LAYER_TRW, "wpclusterzoom", VIK_LAYER_PARAM_UINT, GROUP_WAYPOINTS, N_("Cluster Beyond Zoom (m/pixel):"), VIK_LAYER_WIDGET_COMBOBOX, params_wp_cluster_zooms, NULL,
+    N_("Waypoints are clustered when zoomed out further than this"), wp_cluster_zoom_default, NULL, NULL },
 
   { VIK_LAYER_TRW, "drawimages", VIK_LAYER_PARAM_BOOLEAN, GROUP_IMAGES, N_("Draw Waypoint Images"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, NULL, vik_lpd_true_default, NULL, NULL },
   { VIK_LAYER_TRW, "image_size", VIK_LAYER_PARAM_UINT, GROUP_IMAGES, N_("Image Size (pixels):"), VIK_LAYER_WIDGET_HSCALE, &params_scales[3], NULL, NULL, image_size_default, NULL, NULL },
@@ -759,6 +862,8 @@ enum {
   PARAM_WPSIZE,
   PARAM_WPSYMS,
   PARAM_WPSO,
+  PARAM_WPCL,
+  PARAM_WPCLZ,
   // WP images
   PARAM_DI,
   PARAM_IS,
@@ -790,6 +895,7 @@ static VikTrwLayer* trw_layer_create ( VikViewport *vp );
 static void trw_layer_realize ( VikTrwLayer *vtl, VikTreeview *vt, GtkTreeIter *layer_iter );
 static void trw_layer_post_read ( VikTrwLayer *vtl, VikViewport *vvp, gboolean from_file );
 static void trw_layer_free ( VikTrwLayer *trwlayer );
+static void trw_layer_route_legs_abandon ( VikTrwLayer *vtl, GList *from );
 static void trw_layer_draw ( VikTrwLayer *l, VikViewport *vvp );
 static void trw_layer_change_coord_mode ( VikTrwLayer *vtl, VikCoordMode dest_mode );
 static gdouble trw_layer_get_timestamp ( VikTrwLayer *vtl );
@@ -800,12 +906,14 @@ static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *men
 static const gchar* trw_layer_sublayer_rename_request ( VikTrwLayer *l, const gchar *newname, gpointer vlp, gint subtype, gpointer sublayer, GtkTreeIter *iter );
 static gboolean trw_layer_sublayer_toggle_visible ( VikTrwLayer *l, gint subtype, gpointer sublayer );
 static const gchar* trw_layer_layer_tooltip ( VikTrwLayer *vtl );
+static void trw_layer_get_memory ( VikTrwLayer *vtl, VikLayerMemory *mem );
 static const gchar* trw_layer_sublayer_tooltip ( VikTrwLayer *l, gint subtype, gpointer sublayer );
 static gboolean trw_layer_selected ( VikTrwLayer *l, gint subtype, gpointer sublayer, gint type, gpointer vlp );
 static void trw_layer_layer_toggle_visible ( VikTrwLayer *vtl );
 static void trw_layer_marshall ( VikTrwLayer *vtl, guint8 **data, guint *len );
 static VikTrwLayer *trw_layer_unmarshall ( const guint8 *data_in, guint len, VikViewport *vvp );
 static gboolean trw_layer_set_param ( VikTrwLayer *vtl, VikLayerSetParam *vlsp );
+static void pixbuf_free ( GdkPixbuf *pixbuf );
 static VikLayerParamData trw_layer_get_param ( VikTrwLayer *vtl, guint16 id, gboolean is_file_operation );
 static void trw_layer_change_param ( GtkWidget *widget, ui_change_values values );
 static void trw_layer_del_item ( VikTrwLayer *vtl, gint subtype, gpointer sublayer );
@@ -823,6 +931,8 @@ static gboolean trw_read_file ( VikTrwLayer *trw, FILE *f, const gchar *dirpath
 static void trw_write_file_external ( VikTrwLayer *trw, FILE *f, const gchar *dirpath );
 static gboolean trw_read_file_external ( VikTrwLayer *trw, FILE *f, const gchar *dirpath );
 static gboolean trw_load_external_layer ( VikTrwLayer *trw );
+static void trw_layer_external_monitor ( VikTrwLayer *trw );
+static void trw_layer_external_unmonitor ( VikTrwLayer *trw );
 static void trw_update_layer_icon ( VikTrwLayer *trw );
 
 /* End Layer Interface function definitions */
@@ -890,14 +1000,13 @@ VikLayerInterface vik_trw_layer_interface = {
   (VikLayerFuncSelectedViewportMenu)    trw_layer_show_selected_viewport_menu,
 
   (VikLayerFuncRefresh)                 vik_trw_layer_propwin_main_refresh,
+  (VikLayerFuncGetMemory)               trw_layer_get_memory,
 };
 
 static gboolean have_diary_program = FALSE;
 static gchar *diary_program = NULL;
 #define VIK_SETTINGS_EXTERNAL_DIARY_PROGRAM "external_diary_program"
 
-static gboolean have_geojson_export = FALSE;
-
 static gboolean have_astro_program = FALSE;
 static gchar *astro_program = NULL;
 #define VIK_SETTINGS_EXTERNAL_ASTRO_PROGRAM "external_astro_program"
@@ -961,12 +1070,6 @@ static void vik_trwlayer_class_init ( VikTrwLayerClass *klass )
     g_free ( cmd );
   }
 
-  gchar* geojson_prog = g_find_program_in_path ( a_geojson_program_export() );
-  if ( geojson_prog ) {
-    have_geojson_export = TRUE;
-    g_free ( geojson_prog );
-  }
-
   // Astronomy Domain
   if ( ! a_settings_get_string ( VIK_SETTINGS_EXTERNAL_ASTRO_PROGRAM, &astro_program ) ) {
 #ifdef WINDOWS
@@ -1074,6 +1177,56 @@ gpx_version_t vik_trw_layer_get_gpx_version ( VikTrwLayer *vtl )
   return vtl->gpx_version;
 }
 
+/**
+ * Whether the layer's data is held in another file, rather than in the .vik file
+ */
+gboolean vik_trw_layer_is_external ( VikTrwLayer *vtl )
+{
+  return vtl->external_layer != VIK_TRW_LAYER_INTERNAL;
+}
+
+/**
+ * vik_trw_layer_set_pending_data:
+ * @data:    A layer block as written by a_trwbinary_write_layer()
+ * @dirpath: The directory of the .vik file, for relative filenames
+ *
+ * Defer reading the layer's items until the layer is drawn in view or otherwise needed
+ */
+void vik_trw_layer_set_pending_data ( VikTrwLayer *vtl, GBytes *data, const gchar *dirpath )
+{
+  if ( vtl->pending_data )
+    g_bytes_unref ( vtl->pending_data );
+  g_free ( vtl->pending_dirpath );
+  vtl->pending_data = g_bytes_ref ( data );
+  vtl->pending_dirpath = g_strdup ( dirpath );
+  gsize length;
+  gconstpointer ptr = g_bytes_get_data ( data, &length );
+  vtl->pending_bbox_valid = a_trwbinary_read_bounds ( ptr, length, &vtl->pending_bbox );
+}
+
+/**
+ * Returns: The layer block not yet read in, otherwise NULL
+ */
+GBytes *vik_trw_layer_get_pending_data ( VikTrwLayer *vtl )
+{
+  return vtl->pending_data;
+}
+
+/**
+ * Take an in memory copy of a pending layer block,
+ *  so it no longer depends on the (mapped) file it came from
+ */
+void vik_trw_layer_detach_pending_data ( VikTrwLayer *vtl )
+{
+  if ( !vtl->pending_data )
+    return;
+  gsize length;
+  gconstpointer ptr = g_bytes_get_data ( vtl->pending_data, &length );
+  GBytes *copy = g_bytes_new ( ptr, length );
+  g_bytes_unref ( vtl->pending_data );
+  vtl->pending_data = copy;
+}
+
 void vik_trw_layer_set_gpx_version ( VikTrwLayer *vtl, gpx_version_t value )
 {
   vtl->gpx_version = value;
@@ -1104,47 +1257,64 @@ void vik_trw_layer_set_gpx_extensions ( VikTrwLayer *vtl, gchar *value)
 
 typedef struct {
   gboolean found;
-  const gchar *date_str;
+  gdouble from;
+  gdouble to;
   const VikTrack *trk;
   const VikWaypoint *wpt;
   gpointer trk_id;
   gpointer wpt_id;
 } date_finder_type;
 
-static gboolean trw_layer_find_date_track ( const gpointer id, const VikTrack *trk, date_finder_type *df )
+static gboolean trw_layer_find_date_waypoint ( const gpointer id, const VikWaypoint *wpt, date_finder_type *df )
 {
-  gchar date_buf[20];
-  date_buf[0] = '\0';
-  // Might be an easier way to compare dates rather than converting the strings all the time...
-  if ( trk->trackpoints && !isnan(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp) ) {
-    time_t time = round(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp);
-    strftime (date_buf, sizeof(date_buf), "%Y-%m-%d", gmtime(&time));
-
-    if ( ! g_strcmp0 ( df->date_str, date_buf ) ) {
-      df->found = TRUE;
-      df->trk = trk;
-      df->trk_id = id;
-    }
+  // NB Match as per the rounded time in seconds
+  if ( !isnan(wpt->timestamp) && wpt->timestamp >= df->from && wpt->timestamp < df->to ) {
+    df->found = TRUE;
+    df->wpt = wpt;
+    df->wpt_id = id;
   }
   return df->found;
 }
 
-static gboolean trw_layer_find_date_waypoint ( const gpointer id, const VikWaypoint *wpt, date_finder_type *df )
+/**
+ * Convert the date string (YYYY-MM-DD as in UTC) into the period it covers
+ */
+static gboolean trw_layer_date_period ( const gchar *date_str, gdouble *from, gdouble *to )
 {
-  gchar date_buf[20];
-  date_buf[0] = '\0';
-  // Might be an easier way to compare dates rather than converting the strings all the time...
-  if ( !isnan(wpt->timestamp) ) {
-    time_t time = round ( wpt->timestamp );
-    strftime (date_buf, sizeof(date_buf), "%Y-%m-%d", gmtime(&time));
+  gint year, month, day;
+  if ( !date_str || sscanf ( date_str, "%d-%d-%d", &year, &month, &day ) != 3 )
+    return FALSE;
+  GDateTime *gdt = g_date_time_new_utc ( year, month, day, 0, 0, 0 );
+  if ( !gdt )
+    return FALSE;
+  // Times within half a second before midnight round to the next day
+  *from = (gdouble)g_date_time_to_unix ( gdt ) - 0.5;
+  *to = *from + 86400;
+  g_date_time_unref ( gdt );
+  return TRUE;
+}
 
-    if ( ! g_strcmp0 ( df->date_str, date_buf ) ) {
-      df->found = TRUE;
-      df->wpt = wpt;
-      df->wpt_id = id;
-    }
+/**
+ * Get the index of the tracks by time, regenerating it if necessary
+ */
+static TrackTimeIndex *trw_layer_get_tracks_time_index ( VikTrwLayer *vtl )
+{
+  if ( vtl->tracks_time_index && !a_track_time_index_is_current(vtl->tracks_time_index) ) {
+    a_track_time_index_free ( vtl->tracks_time_index );
+    vtl->tracks_time_index = NULL;
   }
-  return df->found;
+  if ( !vtl->tracks_time_index )
+    vtl->tracks_time_index = a_track_time_index_new ( vtl->tracks );
+  return vtl->tracks_time_index;
+}
+
+/**
+ * Call whenever tracks are added or removed
+ */
+static void trw_layer_tracks_time_index_invalidate ( VikTrwLayer *vtl )
+{
+  a_track_time_index_free ( vtl->tracks_time_index );
+  vtl->tracks_time_index = NULL;
 }
 
 /**
@@ -1154,12 +1324,17 @@ gboolean vik_trw_layer_find_date ( VikTrwLayer *vtl, const gchar *date_str, VikC
 {
   date_finder_type df;
   df.found = FALSE;
-  df.date_str = date_str;
   df.trk = NULL;
   df.wpt = NULL;
+  if ( !trw_layer_date_period ( date_str, &df.from, &df.to ) )
+    return FALSE;
+  trw_ensure_layer_loaded ( vtl );
+  trw_layer_unpack_tracks ( vtl );
   // Only tracks ATM
-  if ( do_tracks )
-    g_hash_table_find ( vtl->tracks, (GHRFunc) trw_layer_find_date_track, &df );
+  if ( do_tracks ) {
+    df.trk = a_track_time_index_find_start ( trw_layer_get_tracks_time_index(vtl), df.from, df.to, &df.trk_id );
+    df.found = (df.trk != NULL);
+  }
   else
     g_hash_table_find ( vtl->waypoints, (GHRFunc) trw_layer_find_date_waypoint, &df );
 
@@ -1168,10 +1343,12 @@ gboolean vik_trw_layer_find_date ( VikTrwLayer *vtl, const gchar *date_str, VikC
       struct LatLon maxmin[2] = { {0,0}, {0,0} };
       trw_layer_find_maxmin_tracks ( NULL, df.trk, maxmin );
       trw_layer_zoom_to_show_latlons ( vtl, vvp, maxmin );
+      trw_layer_realize_items ( vtl );
       vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, g_hash_table_lookup (vtl->tracks_iters, df.trk_id), TRUE );
     }
     else if ( df.wpt ) {
       vik_viewport_set_center_coord ( vvp, &(df.wpt->coord), TRUE );
+      trw_layer_realize_items ( vtl );
       vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, g_hash_table_lookup (vtl->waypoints_iters, df.wpt_id), TRUE );
     }
     vik_layer_emit_update ( VIK_LAYER(vtl) );
@@ -1182,6 +1359,7 @@ gboolean vik_trw_layer_find_date ( VikTrwLayer *vtl, const gchar *date_str, VikC
 static void trw_layer_del_item ( VikTrwLayer *vtl, gint subtype, gpointer sublayer )
 {
   static menu_array_sublayer values;
+  trw_layer_unpack_tracks ( vtl );
   if (!sublayer) {
     return;
   }
@@ -1201,6 +1379,7 @@ static void trw_layer_del_item ( VikTrwLayer *vtl, gint subtype, gpointer sublay
 static void trw_layer_cut_item ( VikTrwLayer *vtl, gint subtype, gpointer sublayer )
 {
   static menu_array_sublayer values;
+  trw_layer_unpack_tracks ( vtl );
   if (!sublayer) {
     return;
   }
@@ -1223,12 +1402,10 @@ static void trw_layer_copy_item_cb ( menu_array_sublayer values)
   VikTrwLayer *vtl = VIK_TRW_LAYER(values[MA_VTL]);
   gint subtype = GPOINTER_TO_INT (values[MA_SUBTYPE]);
   gpointer sublayer = values[MA_SUBLAYER_ID];
-  guint8 *data = NULL;
-  guint len;
 
-  trw_layer_copy_item( vtl, subtype, sublayer, &data, &len);
+  gpointer item = vik_trw_layer_copy_shared_item ( vtl, subtype, sublayer );
 
-  if (data) {
+  if (item) {
     const gchar* name;
     if ( subtype == VIK_TRW_LAYER_SUBLAYER_WAYPOINT ) {
       VikWaypoint *wp = g_hash_table_lookup ( vtl->waypoints, sublayer);
@@ -1252,8 +1429,7 @@ static void trw_layer_copy_item_cb ( menu_array_sublayer values)
         name = NULL; // Broken :(
     }
 
-    a_clipboard_copy( VIK_CLIPBOARD_DATA_SUBLAYER, VIK_LAYER_TRW,
-		      subtype, len, name, data);
+    a_clipboard_copy_trw_item ( subtype, name, item );
   }
 }
 
@@ -1275,6 +1451,8 @@ static void trw_layer_copy_item ( VikTrwLayer *vtl, gint subtype, gpointer subla
   guint8 *id;
   guint il;
 
+  trw_layer_unpack_tracks ( vtl );
+
   if (!sublayer) {
     *item = NULL;
     return;
@@ -1298,18 +1476,17 @@ static void trw_layer_copy_item ( VikTrwLayer *vtl, gint subtype, gpointer subla
   *item = ba->data;
 }
 
-static gboolean trw_layer_paste_item ( VikTrwLayer *vtl, gint subtype, guint8 *item, guint len )
+/**
+ * Add the waypoint or track (of the sublayer type), which becomes owned by the layer
+ */
+static gboolean trw_layer_paste_object ( VikTrwLayer *vtl, gint subtype, gpointer object )
 {
-  if ( !item )
-    return FALSE;
-
   gchar *name;
 
   if ( subtype == VIK_TRW_LAYER_SUBLAYER_WAYPOINT )
   {
-    VikWaypoint *w;
+    VikWaypoint *w = object;
 
-    w = vik_waypoint_unmarshall ( item, len );
     // When copying - we'll create a new name based on the original
     name = trw_layer_new_unique_sublayer_name(vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, w->name);
     vik_trw_layer_add_waypoint ( vtl, name, w );
@@ -1325,9 +1502,8 @@ static gboolean trw_layer_paste_item ( VikTrwLayer *vtl, gint subtype, guint8 *i
   }
   if ( subtype == VIK_TRW_LAYER_SUBLAYER_TRACK )
   {
-    VikTrack *t;
+    VikTrack *t = object;
 
-    t = vik_track_unmarshall ( item, len );
     // When copying - we'll create a new name based on the original
     name = trw_layer_new_unique_sublayer_name(vtl, VIK_TRW_LAYER_SUBLAYER_TRACK, t->name);
     vik_trw_layer_add_track ( vtl, name, t );
@@ -1341,9 +1517,8 @@ static gboolean trw_layer_paste_item ( VikTrwLayer *vtl, gint subtype, guint8 *i
   }
   if ( subtype == VIK_TRW_LAYER_SUBLAYER_ROUTE )
   {
-    VikTrack *t;
+    VikTrack *t = object;
 
-    t = vik_track_unmarshall ( item, len );
     // When copying - we'll create a new name based on the original
     name = trw_layer_new_unique_sublayer_name(vtl, VIK_TRW_LAYER_SUBLAYER_ROUTE, t->name);
     vik_trw_layer_add_route ( vtl, name, t );
@@ -1358,6 +1533,85 @@ static gboolean trw_layer_paste_item ( VikTrwLayer *vtl, gint subtype, guint8 *i
   return FALSE;
 }
 
+static gboolean trw_layer_paste_item ( VikTrwLayer *vtl, gint subtype, guint8 *item, guint len )
+{
+  if ( !item )
+    return FALSE;
+
+  if ( subtype == VIK_TRW_LAYER_SUBLAYER_WAYPOINT )
+    return trw_layer_paste_object ( vtl, subtype, vik_waypoint_unmarshall ( item, len ) );
+  if ( subtype == VIK_TRW_LAYER_SUBLAYER_TRACK || subtype == VIK_TRW_LAYER_SUBLAYER_ROUTE ) {
+    VikTrack *trk = vik_track_unmarshall ( item, len );
+    if ( !trk )
+      return FALSE;
+    // Keep the kind as per where it is being pasted
+    trk->is_route = ( subtype == VIK_TRW_LAYER_SUBLAYER_ROUTE );
+    return trw_layer_paste_object ( vtl, subtype, trk );
+  }
+  return FALSE;
+}
+
+/**
+ * vik_trw_layer_copy_shared_item:
+ *
+ * Take a copy of the item as it is now, for the clipboard to keep within this process.
+ * Thus a copy and paste within the program needs no marshalling.
+ *
+ * Returns: The copy to be freed with vik_trw_layer_free_shared_item(), or NULL
+ */
+gpointer vik_trw_layer_copy_shared_item ( VikTrwLayer *vtl, gint subtype, gpointer sublayer )
+{
+  if ( !sublayer )
+    return NULL;
+
+  if ( subtype == VIK_TRW_LAYER_SUBLAYER_WAYPOINT ) {
+    VikWaypoint *wp = g_hash_table_lookup ( vtl->waypoints, sublayer );
+    return wp ? vik_waypoint_copy ( wp ) : NULL;
+  }
+  VikTrack *trk = g_hash_table_lookup ( subtype == VIK_TRW_LAYER_SUBLAYER_TRACK ? vtl->tracks : vtl->routes, sublayer );
+  return trk ? vik_track_copy ( trk, TRUE ) : NULL;
+}
+
+/**
+ * vik_trw_layer_marshall_shared_item:
+ *
+ * Only needed when the item is requested by another process
+ */
+void vik_trw_layer_marshall_shared_item ( gint subtype, gpointer item, guint8 **data, guint *len )
+{
+  if ( subtype == VIK_TRW_LAYER_SUBLAYER_WAYPOINT )
+    vik_waypoint_marshall ( item, data, len );
+  else
+    vik_track_marshall ( item, data, len );
+}
+
+/**
+ * vik_trw_layer_paste_shared_item:
+ *
+ * Add a further copy of the shared item to the layer
+ */
+gboolean vik_trw_layer_paste_shared_item ( VikTrwLayer *vtl, gint subtype, gpointer item )
+{
+  if ( !item )
+    return FALSE;
+
+  if ( subtype == VIK_TRW_LAYER_SUBLAYER_WAYPOINT )
+    return trw_layer_paste_object ( vtl, subtype, vik_waypoint_copy ( item ) );
+  if ( subtype == VIK_TRW_LAYER_SUBLAYER_TRACK || subtype == VIK_TRW_LAYER_SUBLAYER_ROUTE )
+    return trw_layer_paste_object ( vtl, subtype, vik_track_copy ( item, TRUE ) );
+  return FALSE;
+}
+
+void vik_trw_layer_free_shared_item ( gint subtype, gpointer item )
+{
+  if ( !item )
+    return;
+  if ( subtype == VIK_TRW_LAYER_SUBLAYER_WAYPOINT )
+    vik_waypoint_free ( item );
+  else
+    vik_track_free ( item );
+}
+
 static void trw_layer_free_copied_item ( gint subtype, gpointer item )
 {
   if (item) {
@@ -1365,6 +1619,15 @@ static void trw_layer_free_copied_item ( gint subtype, gpointer item )
   }
 }
 
+/**
+ * A new image cache rather than emptying the current one, as that may be shared with other views of the layer
+ */
+static void trw_layer_image_cache_reset ( VikTrwLayer *vtl )
+{
+  g_hash_table_unref ( vtl->image_cache );
+  vtl->image_cache = g_hash_table_new_full ( g_str_hash, g_str_equal, NULL, (GDestroyNotify) pixbuf_free );
+}
+
 static gboolean trw_layer_set_param ( VikTrwLayer *vtl, VikLayerSetParam *vlsp )
 {
   switch ( vlsp->id )
@@ -1452,13 +1715,13 @@ static gboolean trw_layer_set_param ( VikTrwLayer *vtl, VikLayerSetParam *vlsp )
     case PARAM_IS:
       if ( vlsp->data.u != vtl->image_size ) {
         vtl->image_size = vlsp->data.u;
-        g_hash_table_remove_all ( vtl->image_cache );
+        trw_layer_image_cache_reset ( vtl );
       }
       break;
     case PARAM_IA:
       if ( vlsp->data.u != vtl->image_alpha ) {
         vtl->image_alpha = vlsp->data.u;
-        g_hash_table_remove_all ( vtl->image_cache );
+        trw_layer_image_cache_reset ( vtl );
       }
       break;
     case PARAM_ICS:
@@ -1515,6 +1778,8 @@ static gboolean trw_layer_set_param ( VikTrwLayer *vtl, VikLayerSetParam *vlsp )
               trw_layer_sort_order_specified ( vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINTS, vtl->wp_sort_order );
       }
       break;
+    case PARAM_WPCL: vtl->wp_cluster = vlsp->data.b; break;
+    case PARAM_WPCLZ: if ( vlsp->data.u < G_N_ELEMENTS(params_wp_cluster_zooms)-1 ) vtl->wp_cluster_zoom = vlsp->data.u; break;
     // Metadata
     case PARAM_MDDESC:
       if ( vlsp->data.s && vtl->metadata ) {
@@ -1553,12 +1818,16 @@ static gboolean trw_layer_set_param ( VikTrwLayer *vtl, VikLayerSetParam *vlsp )
       break;
     case PARAM_EXTL:
       if ( vlsp->data.u < VIK_EXTERNAL_TYPE_LAST ) {
+          if ( vlsp->data.u != vtl->external_layer )
+            trw_layer_external_unmonitor ( vtl );
           vtl->external_layer = vlsp->data.u;
           trw_update_layer_icon ( vtl );
       }
       break;
     case PARAM_EXTF:
       if ( vlsp->data.s ) {
+        if ( g_strcmp0 ( vlsp->data.s, vtl->external_file ) )
+          trw_layer_external_unmonitor ( vtl );
         g_free (vtl->external_file);
         vtl->external_file = g_strdup (vlsp->data.s);
       }
@@ -1610,6 +1879,8 @@ static VikLayerParamData trw_layer_get_param ( VikTrwLayer *vtl, guint16 id, gbo
     case PARAM_WPSYMS: rv.b = vtl->wp_draw_symbols; break;
     case PARAM_WPFONTSIZE: rv.u = vtl->wp_font_size; break;
     case PARAM_WPSO: rv.u = vtl->wp_sort_order; break;
+    case PARAM_WPCL: rv.b = vtl->wp_cluster; break;
+    case PARAM_WPCLZ: rv.u = vtl->wp_cluster_zoom; break;
     // Metadata
     case PARAM_MDDESC: if (vtl->metadata) { rv.s = vtl->metadata->description; } break;
     case PARAM_MDAUTH: if (vtl->metadata) { rv.s = vtl->metadata->author; } break;
@@ -1721,6 +1992,9 @@ static void trw_layer_change_param ( GtkWidget *widget, ui_change_values values
 
 static void trw_layer_marshall( VikTrwLayer *vtl, guint8 **data, guint *len )
 {
+  trw_ensure_layer_loaded ( vtl );
+  trw_layer_unpack_tracks ( vtl );
+
   guint8 *pd;
   guint pl;
 
@@ -1817,9 +2091,11 @@ static VikTrwLayer *trw_layer_unmarshall ( const guint8 *data_in, guint len, Vik
 
       // Also remember to (attempt to) convert each coordinate in case this is pasted into a different drawmode
       if ( pl == VIK_TRW_LAYER_SUBLAYER_TRACK ) {
-        VikTrack *trk = vik_track_unmarshall ( data + sizeof_len_and_subtype, 0 );
-        vik_trw_layer_add_track ( vtl, NULL, trk );
-        vik_track_convert (trk, vtl->coord_mode);
+        VikTrack *trk = vik_track_unmarshall ( data + sizeof_len_and_subtype, tlm_size );
+        if ( trk ) {
+          vik_trw_layer_add_track ( vtl, NULL, trk );
+          vik_track_convert (trk, vtl->coord_mode);
+        }
       }
       if ( pl == VIK_TRW_LAYER_SUBLAYER_WAYPOINT ) {
         VikWaypoint *wp = vik_waypoint_unmarshall ( data + sizeof_len_and_subtype, 0 );
@@ -1827,9 +2103,11 @@ static VikTrwLayer *trw_layer_unmarshall ( const guint8 *data_in, guint len, Vik
         waypoint_convert (NULL, wp, &vtl->coord_mode);
       }
       if ( pl == VIK_TRW_LAYER_SUBLAYER_ROUTE ) {
-        VikTrack *trk = vik_track_unmarshall ( data + sizeof_len_and_subtype, 0 );
-        vik_trw_layer_add_route ( vtl, NULL, trk );
-        vik_track_convert (trk, vtl->coord_mode);
+        VikTrack *trk = vik_track_unmarshall ( data + sizeof_len_and_subtype, tlm_size );
+        if ( trk ) {
+          vik_trw_layer_add_route ( vtl, NULL, trk );
+          vik_track_convert (trk, vtl->coord_mode);
+        }
       }
     }
     // Don't shift data pointer to beyond our buffer of data - as otherwise it could point to anything
@@ -1879,6 +2157,104 @@ static void pixbuf_free ( GdkPixbuf *pixbuf )
   g_object_unref ( G_OBJECT(pixbuf) );
 }
 
+/*** Packed tracks ***/
+
+// Tracks that have been hidden and unused for a while have their trackpoints packed (see vik_track_pack()),
+//  which for a large archive of mostly hidden tracks saves most of the memory.
+// Anything that may use the trackpoints of hidden tracks unpacks them all first,
+//  whereas drawing or selecting a track only unpacks that one.
+#define VIK_SETTINGS_TRW_PACK_TRACKS_AFTER "trw_pack_tracks_after"
+#define TRW_PACK_TRACKS_AFTER_DEFAULT 600 // Seconds, 0 to never pack tracks
+#define TRW_PACK_SWEEP_INTERVAL 60 // Seconds
+
+static gint trw_layer_pack_tracks_after ( void )
+{
+  static gint after = -1;
+  if ( after < 0 ) {
+    if ( !a_settings_get_integer ( VIK_SETTINGS_TRW_PACK_TRACKS_AFTER, &after ) || after < 0 )
+      after = TRW_PACK_TRACKS_AFTER_DEFAULT;
+  }
+  return after;
+}
+
+/**
+ * Restore the trackpoints of any packed tracks or routes
+ */
+static void trw_layer_unpack_tracks ( VikTrwLayer *vtl )
+{
+  if ( !vtl->packed_count )
+    return;
+  GHashTable *tables[] = { vtl->tracks, vtl->routes };
+  GHashTableIter iter;
+  gpointer key, value;
+  for ( guint ii = 0; ii < G_N_ELEMENTS(tables); ii++ ) {
+    g_hash_table_iter_init ( &iter, tables[ii] );
+    while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+      vik_track_unpack ( VIK_TRACK(value) );
+      VIK_TRACK(value)->unused_since = 0;
+    }
+  }
+  vtl->packed_count = 0;
+}
+
+/**
+ * Periodically pack the tracks that have been hidden and otherwise unused for long enough
+ */
+static gboolean trw_layer_pack_sweep ( VikTrwLayer *vtl )
+{
+  // Not whilst something may be part way through using the trackpoints:
+  //  from a modal dialog or in a background job
+  if ( gtk_grab_get_current() )
+    return TRUE;
+  guint queued, running;
+  a_background_get_pool_stats ( BACKGROUND_POOL_LOCAL, &queued, &running );
+  if ( queued || running )
+    return TRUE;
+  a_background_get_pool_stats ( BACKGROUND_POOL_REMOTE, &queued, &running );
+  if ( queued || running )
+    return TRUE;
+
+  gboolean layer_shown = vtl->vl.visible;
+  GHashTable *selected_tracks = NULL;
+  gpointer selected_track = NULL;
+  if ( vtl->vl.realized ) {
+    layer_shown = vik_treeview_item_get_visible_tree ( vtl->vl.vt, &(vtl->vl.iter) );
+    VikWindow *vw = VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl));
+    if ( vw && vik_window_get_containing_trw_layer(vw) == vtl ) {
+      selected_tracks = vik_window_get_selected_tracks ( vw );
+      selected_track = vik_window_get_selected_track ( vw );
+    }
+  }
+
+  const gint64 now = g_get_monotonic_time ();
+  const gint64 after = (gint64)trw_layer_pack_tracks_after() * G_USEC_PER_SEC;
+  GHashTable *tables[] = { vtl->tracks, vtl->routes };
+  GHashTableIter iter;
+  gpointer key, value;
+  for ( guint ii = 0; ii < G_N_ELEMENTS(tables); ii++ ) {
+    gboolean shown = layer_shown && ( tables[ii] == vtl->routes ? vtl->routes_visible : vtl->tracks_visible );
+    gboolean selected = ( tables[ii] == selected_tracks );
+    g_hash_table_iter_init ( &iter, tables[ii] );
+    while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+      VikTrack *trk = VIK_TRACK(value);
+      if ( trk->packed )
+        continue;
+      // Anything else holding on to the track (e.g. the edit journal) may use its trackpoints
+      if ( (shown && trk->visible) || selected || trk == selected_track ||
+           g_atomic_int_get ( &trk->ref_count ) > 1 || trk->property_dialog ||
+           trk == vtl->current_track || trk == vtl->current_tp.trk || trk == vtl->route_finder_added_track ) {
+        trk->unused_since = 0;
+        continue;
+      }
+      if ( !trk->unused_since )
+        trk->unused_since = now;
+      else if ( now - trk->unused_since >= after && vik_track_pack ( trk ) )
+        vtl->packed_count++;
+    }
+  }
+  return TRUE;
+}
+
 // Stick a 1 at the end of the function name to make it more unique
 //  thus more easily searchable in a simple text editor
 static VikTrwLayer* trw_layer_new1 ( VikViewport *vvp )
@@ -1918,6 +2294,9 @@ static VikTrwLayer* trw_layer_new1 ( VikViewport *vvp )
   rv->draw_sync_do = TRUE;
   rv->coord_mode = VIK_COORD_LATLON;
 
+  if ( trw_layer_pack_tracks_after() > 0 )
+    rv->pack_timer_id = g_timeout_add_seconds ( TRW_PACK_SWEEP_INTERVAL, (GSourceFunc)trw_layer_pack_sweep, rv );
+
   // Everything else is 0, FALSE or NULL
 
   return rv;
@@ -1926,12 +2305,32 @@ static VikTrwLayer* trw_layer_new1 ( VikViewport *vvp )
 
 static void trw_layer_free ( VikTrwLayer *trwlayer )
 {
+  // Too late to record anything
+  g_list_free ( trwlayer->journal_unrecorded );
+  trwlayer->journal_unrecorded = NULL;
+  if ( trwlayer->journal_record_id )
+    (void)g_source_remove ( trwlayer->journal_record_id );
+  if ( trwlayer->pack_timer_id )
+    (void)g_source_remove ( trwlayer->pack_timer_id );
+  trw_layer_journal_clear ( trwlayer );
+  trw_layer_pick_clear ( trwlayer );
+  if ( trwlayer->route_legs )
+    trw_layer_route_legs_abandon ( trwlayer, trwlayer->route_legs );
+
   g_hash_table_destroy(trwlayer->waypoints);
   g_hash_table_destroy(trwlayer->waypoints_iters);
   g_hash_table_destroy(trwlayer->tracks);
   g_hash_table_destroy(trwlayer->tracks_iters);
   g_hash_table_destroy(trwlayer->routes);
   g_hash_table_destroy(trwlayer->routes_iters);
+  a_track_time_index_free ( trwlayer->tracks_time_index );
+  a_track_lod_free ( trwlayer->lod );
+  if ( trwlayer->waypoints_names )
+    g_hash_table_destroy ( trwlayer->waypoints_names );
+  if ( trwlayer->tracks_names )
+    g_hash_table_destroy ( trwlayer->tracks_names );
+  if ( trwlayer->routes_names )
+    g_hash_table_destroy ( trwlayer->routes_names );
 
   /* ODC: replace with GArray */
   trw_layer_free_track_gcs ( trwlayer );
@@ -1948,6 +2347,9 @@ static void trw_layer_free ( VikTrwLayer *trwlayer )
   if ( trwlayer->wplabellayout != NULL)
     g_object_unref ( G_OBJECT ( trwlayer->wplabellayout ) );
 
+  if ( trwlayer->label_sizes )
+    g_hash_table_destroy ( trwlayer->label_sizes );
+
   if ( trwlayer->waypoint_gc != NULL )
     g_object_unref ( G_OBJECT ( trwlayer->waypoint_gc ) );
 
@@ -1972,11 +2374,16 @@ static void trw_layer_free ( VikTrwLayer *trwlayer )
   if ( trwlayer->tracks_analysis_dialog != NULL )
     gtk_widget_destroy ( GTK_WIDGET(trwlayer->tracks_analysis_dialog) );
 
-  g_hash_table_destroy ( trwlayer->image_cache );
+  g_hash_table_unref ( trwlayer->image_cache );
 
+  trw_layer_external_unmonitor ( trwlayer );
   g_free ( trwlayer->external_file );
   g_free ( trwlayer->external_dirpath );
 
+  if ( trwlayer->pending_data )
+    g_bytes_unref ( trwlayer->pending_data );
+  g_free ( trwlayer->pending_dirpath );
+
   if ( trwlayer->crosshair_cursor )
   {
     gdk_cursor_unref ( trwlayer->crosshair_cursor );
@@ -2029,6 +2436,126 @@ static void init_drawing_params ( struct DrawingParams *dp, VikTrwLayer *vtl, Vi
   }
 
   dp->bbox = vik_viewport_get_bbox ( vp );
+  // Allow for the largest trackpoint symbol (of a stop on the selected trackpoint)
+  //  drawn for a position just outside of the view
+  gdouble margin = 6.0 * vtl->drawpoints_size + 1.0;
+  dp->track_bbox = dp->bbox;
+  if ( dp->width && dp->height ) {
+    dp->track_bbox.north += margin * (dp->bbox.north - dp->bbox.south) / dp->height;
+    dp->track_bbox.south -= margin * (dp->bbox.north - dp->bbox.south) / dp->height;
+    dp->track_bbox.east += margin * (dp->bbox.east - dp->bbox.west) / dp->width;
+    dp->track_bbox.west -= margin * (dp->bbox.east - dp->bbox.west) / dp->width;
+  }
+  dp->mercator = vik_viewport_get_mercator ( vp, &dp->vvm );
+  dp->labels = NULL;
+  dp->rendered = NULL;
+}
+
+static LabelGridT *label_grid_new ( gint width, gint height )
+{
+  LabelGridT *grid = g_malloc ( sizeof(LabelGridT) );
+  grid->cols = MAX ( 1, (width + LABEL_GRID_CELL_SIZE - 1) / LABEL_GRID_CELL_SIZE );
+  grid->rows = MAX ( 1, (height + LABEL_GRID_CELL_SIZE - 1) / LABEL_GRID_CELL_SIZE );
+  grid->cells = g_malloc0 ( sizeof(GArray*) * grid->cols * grid->rows );
+  return grid;
+}
+
+static void label_grid_free ( LabelGridT *grid )
+{
+  for ( gint ii = 0; ii < grid->cols * grid->rows; ii++ )
+    if ( grid->cells[ii] )
+      g_array_free ( grid->cells[ii], TRUE );
+  g_free ( grid->cells );
+  g_free ( grid );
+}
+
+/**
+ * label_grid_place:
+ *
+ * Returns: FALSE if the area overlaps a label already placed,
+ *  otherwise TRUE with the area now taken
+ */
+static gboolean label_grid_place ( LabelGridT *grid, GdkRectangle *area )
+{
+  const gint c0 = CLAMP ( area->x / LABEL_GRID_CELL_SIZE, 0, grid->cols - 1 );
+  const gint c1 = CLAMP ( (area->x + area->width) / LABEL_GRID_CELL_SIZE, 0, grid->cols - 1 );
+  const gint r0 = CLAMP ( area->y / LABEL_GRID_CELL_SIZE, 0, grid->rows - 1 );
+  const gint r1 = CLAMP ( (area->y + area->height) / LABEL_GRID_CELL_SIZE, 0, grid->rows - 1 );
+
+  for ( gint rr = r0; rr <= r1; rr++ )
+    for ( gint cc = c0; cc <= c1; cc++ ) {
+      GArray *cell = grid->cells[rr * grid->cols + cc];
+      if ( !cell )
+        continue;
+      for ( guint ii = 0; ii < cell->len; ii++ )
+        if ( gdk_rectangle_intersect ( area, &g_array_index(cell, GdkRectangle, ii), NULL ) )
+          return FALSE;
+    }
+
+  for ( gint rr = r0; rr <= r1; rr++ )
+    for ( gint cc = c0; cc <= c1; cc++ ) {
+      GArray **cell = &grid->cells[rr * grid->cols + cc];
+      if ( !*cell )
+        *cell = g_array_new ( FALSE, FALSE, sizeof(GdkRectangle) );
+      g_array_append_val ( *cell, *area );
+    }
+  return TRUE;
+}
+
+static void label_layout_set ( PangoLayout *layout, const gchar *markup, const gchar *text )
+{
+  if ( pango_parse_markup ( markup, -1, 0, NULL, NULL, NULL, NULL ) )
+    pango_layout_set_markup ( layout, markup, -1 );
+  else
+    // Fallback if parse failure
+    pango_layout_set_text ( layout, text, -1 );
+}
+
+#define LABEL_SIZES_MAX 50000
+
+/**
+ * trw_layer_label_size:
+ * @layout_set: Set to TRUE when the layout had to be used to measure the label
+ *
+ * Get the pixel size of a label, remembering it for subsequent draws
+ */
+static void trw_layer_label_size ( VikTrwLayer *vtl, PangoLayout *layout, const gchar *markup, const gchar *text, gint *width, gint *height, gboolean *layout_set )
+{
+  if ( !vtl->label_sizes )
+    vtl->label_sizes = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+
+  gpointer size;
+  if ( g_hash_table_lookup_extended ( vtl->label_sizes, markup, NULL, &size ) ) {
+    *width = GPOINTER_TO_UINT(size) >> 16;
+    *height = GPOINTER_TO_UINT(size) & 0xffff;
+    *layout_set = FALSE;
+    return;
+  }
+
+  label_layout_set ( layout, markup, text );
+  pango_layout_get_pixel_size ( layout, width, height );
+  *layout_set = TRUE;
+
+  // Simply start again should there be too many different labels
+  if ( g_hash_table_size(vtl->label_sizes) >= LABEL_SIZES_MAX )
+    g_hash_table_remove_all ( vtl->label_sizes );
+  g_hash_table_insert ( vtl->label_sizes, g_strdup(markup),
+                        GUINT_TO_POINTER((CLAMP(*width,0,0xffff) << 16) | CLAMP(*height,0,0xffff)) );
+}
+
+/**
+ * trw_layer_label_visible:
+ *
+ * Whether a label in this screen area is to be drawn,
+ *  i.e. when it's on the display and, if overlapping labels are not drawn, it is clear of them
+ */
+static gboolean trw_layer_label_visible ( struct DrawingParams *dp, GdkRectangle *area )
+{
+  if ( area->x + area->width < 0 || area->y + area->height < 0 || area->x > dp->width || area->y > dp->height )
+    return FALSE;
+  if ( dp->labels )
+    return label_grid_place ( dp->labels, area );
+  return TRUE;
 }
 
 /*
@@ -2063,29 +2590,218 @@ static void draw_utm_skip_insignia ( VikViewport *vvp, GdkGC *gc, gint x, gint y
   vik_viewport_draw_line ( vvp, gc, x+5, y-5, x-5, y+5 );
 }
 
+/**
+ * Get the GC for drawing a track in its own colour
+ * These are kept until the track GCs are remade (e.g. on a line thickness change)
+ *  rather than being created every time a track is drawn
+ */
+static GdkGC *trw_layer_get_track_color_gc ( VikTrwLayer *vtl, VikViewport *vp, GdkColor *color )
+{
+  if ( !vtl->track_color_gcs )
+    vtl->track_color_gcs = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_object_unref );
 
-static void trw_layer_draw_track_label ( gchar *name, gchar *fgcolour, gchar *bgcolour, struct DrawingParams *dp, VikCoord *coord )
+  // Track colours are only ever set to 8 bits per channel
+  guint key = ((color->red >> 8) << 16) | ((color->green >> 8) << 8) | (color->blue >> 8);
+  GdkGC *gc = g_hash_table_lookup ( vtl->track_color_gcs, GUINT_TO_POINTER(key) );
+  if ( !gc ) {
+    gc = vik_viewport_new_gc_from_color ( vp, color, vtl->line_thickness );
+    g_hash_table_insert ( vtl->track_color_gcs, GUINT_TO_POINTER(key), gc );
+  }
+  return gc;
+}
+
+#define TRACK_POLYLINE_SIZE 256
+
+/**
+ * Consecutive track lines in the same GC, collected so they are drawn in one go
+ */
+typedef struct {
+  VikViewport *vp;
+  RenderedLinesT *rendered; // Collected here instead, when set
+  GdkGC *gc;
+  gint count;
+  GdkPoint points[TRACK_POLYLINE_SIZE];
+} TrackPolylineT;
+
+static RenderedLinesT *rendered_lines_new ( void )
 {
-  gchar *label_markup = g_strdup_printf ( "<span foreground=\"%s\" background=\"%s\" size=\"%s\">%s</span>", fgcolour, bgcolour, dp->vtl->track_fsize_str, name );
+  RenderedLinesT *rl = g_new ( RenderedLinesT, 1 );
+  rl->styles = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
+  rl->lines = g_array_new ( FALSE, FALSE, sizeof(RenderedLineT) );
+  rl->points = g_array_new ( FALSE, FALSE, sizeof(GdkPoint) );
+  rl->label_tracks = g_ptr_array_new ();
+  return rl;
+}
 
-  if ( pango_parse_markup ( label_markup, -1, 0, NULL, NULL, NULL, NULL ) )
-    pango_layout_set_markup ( dp->vtl->tracklabellayout, label_markup, -1 );
-  else
-    // Fallback if parse failure
-    pango_layout_set_text ( dp->vtl->tracklabellayout, name, -1 );
+static void rendered_lines_free ( RenderedLinesT *rl )
+{
+  g_hash_table_destroy ( rl->styles );
+  g_array_free ( rl->lines, TRUE );
+  g_array_free ( rl->points, TRUE );
+  g_ptr_array_free ( rl->label_tracks, TRUE );
+  g_free ( rl );
+}
 
-  g_free ( label_markup );
+static const RenderedStyleT *rendered_style_get ( RenderedLinesT *rl, GdkGC *gc )
+{
+  RenderedStyleT *style = g_hash_table_lookup ( rl->styles, gc );
+  if ( style )
+    return style;
 
-  gint label_x, label_y;
-  gint width, height;
-  pango_layout_get_pixel_size ( dp->vtl->tracklabellayout, &width, &height );
+  GdkGCValues values;
+  gdk_gc_get_values ( gc, &values );
+  GdkColor color;
+  gdk_colormap_query_color ( gdk_gc_get_colormap(gc), values.foreground.pixel, &color );
 
-  vik_viewport_coord_to_screen ( dp->vp, coord, &label_x, &label_y );
-  vik_viewport_draw_layout ( dp->vp, dp->vtl->track_bg_gc, label_x-width/2, label_y-height/2, dp->vtl->tracklabellayout );
+  style = g_new ( RenderedStyleT, 1 );
+  style->red = color.red / 65535.0;
+  style->green = color.green / 65535.0;
+  style->blue = color.blue / 65535.0;
+  // A width of 0 is GDK's thinnest line
+  style->width = MAX ( 1, values.line_width );
+  switch ( values.cap_style ) {
+    case GDK_CAP_ROUND: style->cap = CAIRO_LINE_CAP_ROUND; break;
+    case GDK_CAP_PROJECTING: style->cap = CAIRO_LINE_CAP_SQUARE; break;
+    default: style->cap = CAIRO_LINE_CAP_BUTT; break;
+  }
+  switch ( values.join_style ) {
+    case GDK_JOIN_ROUND: style->join = CAIRO_LINE_JOIN_ROUND; break;
+    case GDK_JOIN_BEVEL: style->join = CAIRO_LINE_JOIN_BEVEL; break;
+    default: style->join = CAIRO_LINE_JOIN_MITER; break;
+  }
+  style->dashed = values.line_style != GDK_LINE_SOLID;
+  g_hash_table_insert ( rl->styles, gc, style );
+  return style;
 }
 
-/**
- * distance_in_preferred_units:
+static void rendered_lines_add ( RenderedLinesT *rl, GdkGC *gc, const GdkPoint *points, gint count )
+{
+  RenderedLineT line;
+  line.style = rendered_style_get ( rl, gc );
+  line.start = rl->points->len;
+  line.count = count;
+
+  gint x1 = points[0].x, x2 = points[0].x, y1 = points[0].y, y2 = points[0].y;
+  for ( gint ii = 1; ii < count; ii++ ) {
+    x1 = MIN ( x1, points[ii].x ); x2 = MAX ( x2, points[ii].x );
+    y1 = MIN ( y1, points[ii].y ); y2 = MAX ( y2, points[ii].y );
+  }
+  // Mitred corners can reach out to Cairo's default miter limit of 10 times the half width
+  gint margin = ( line.style->join == CAIRO_LINE_JOIN_MITER ? 5 : 1 ) * line.style->width + 1;
+  line.extent.x = x1 - margin;
+  line.extent.y = y1 - margin;
+  line.extent.width = x2 - x1 + 2*margin;
+  line.extent.height = y2 - y1 + 2*margin;
+
+  g_array_append_vals ( rl->points, points, count );
+  g_array_append_val ( rl->lines, line );
+}
+
+/**
+ * Draw the collected lines that are in the band being rendered
+ * Called from the rendering threads, so the collected lines are only read
+ */
+static void rendered_lines_render ( cairo_t *cr, RenderedLinesT *rl )
+{
+  // As GDK's default dashes
+  static const gdouble dashes[] = { 4.0, 4.0 };
+  gdouble cx1, cy1, cx2, cy2;
+  cairo_clip_extents ( cr, &cx1, &cy1, &cx2, &cy2 );
+
+  const RenderedStyleT *style = NULL;
+  for ( guint ii = 0; ii < rl->lines->len; ii++ ) {
+    RenderedLineT *line = &g_array_index ( rl->lines, RenderedLineT, ii );
+    if ( line->extent.x > cx2 || line->extent.x + line->extent.width < cx1 ||
+         line->extent.y > cy2 || line->extent.y + line->extent.height < cy1 )
+      continue;
+
+    if ( line->style != style ) {
+      style = line->style;
+      cairo_set_source_rgb ( cr, style->red, style->green, style->blue );
+      cairo_set_line_width ( cr, style->width );
+      cairo_set_line_cap ( cr, style->cap );
+      cairo_set_line_join ( cr, style->join );
+      cairo_set_dash ( cr, dashes, style->dashed ? G_N_ELEMENTS(dashes) : 0, 0.0 );
+    }
+
+    // Through the middle of the pixels, as GDK draws them
+    GdkPoint *points = &g_array_index ( rl->points, GdkPoint, line->start );
+    cairo_move_to ( cr, points[0].x + 0.5, points[0].y + 0.5 );
+    for ( guint jj = 1; jj < line->count; jj++ )
+      cairo_line_to ( cr, points[jj].x + 0.5, points[jj].y + 0.5 );
+    cairo_stroke ( cr );
+  }
+}
+
+static void track_polyline_flush ( TrackPolylineT *pl )
+{
+  if ( pl->count > 1 ) {
+    if ( pl->rendered )
+      rendered_lines_add ( pl->rendered, pl->gc, pl->points, pl->count );
+    else
+      vik_viewport_draw_lines ( pl->vp, pl->gc, pl->points, pl->count );
+  }
+  pl->count = 0;
+}
+
+/**
+ * Ensure the collected lines are drawn first when something else is drawn in a different GC,
+ *  so the drawing order is kept
+ */
+static void track_polyline_sync ( TrackPolylineT *pl, GdkGC *gc )
+{
+  if ( pl->count && gc != pl->gc )
+    track_polyline_flush ( pl );
+}
+
+static void track_polyline_add ( TrackPolylineT *pl, GdkGC *gc, gint x1, gint y1, gint x2, gint y2 )
+{
+  if ( pl->count ) {
+    GdkPoint *last = &pl->points[pl->count-1];
+    if ( gc != pl->gc || last->x != x1 || last->y != y1 )
+      track_polyline_flush ( pl );
+    else if ( pl->count == TRACK_POLYLINE_SIZE ) {
+      // Full - so draw it and carry on from the last point
+      track_polyline_flush ( pl );
+      pl->count = 1;
+      pl->points[0].x = x1;
+      pl->points[0].y = y1;
+    }
+  }
+  if ( !pl->count ) {
+    pl->gc = gc;
+    pl->points[0].x = x1;
+    pl->points[0].y = y1;
+    pl->count = 1;
+  }
+  pl->points[pl->count].x = x2;
+  pl->points[pl->count].y = y2;
+  pl->count++;
+}
+
+
+static void trw_layer_draw_track_label ( gchar *name, gchar *fgcolour, gchar *bgcolour, struct DrawingParams *dp, VikCoord *coord )
+{
+  gchar *label_markup = g_strdup_printf ( "<span foreground=\"%s\" background=\"%s\" size=\"%s\">%s</span>", fgcolour, bgcolour, dp->vtl->track_fsize_str, name );
+
+  gint label_x, label_y;
+  gint width, height;
+  gboolean layout_set;
+  trw_layer_label_size ( dp->vtl, dp->vtl->tracklabellayout, label_markup, name, &width, &height, &layout_set );
+
+  vik_viewport_coord_to_screen ( dp->vp, coord, &label_x, &label_y );
+  GdkRectangle area = { label_x-width/2, label_y-height/2, width, height };
+  if ( trw_layer_label_visible ( dp, &area ) ) {
+    if ( !layout_set )
+      label_layout_set ( dp->vtl->tracklabellayout, label_markup, name );
+    vik_viewport_draw_layout ( dp->vp, dp->vtl->track_bg_gc, area.x, area.y, dp->vtl->tracklabellayout );
+  }
+
+  g_free ( label_markup );
+}
+
+/**
+ * distance_in_preferred_units:
  * @dist: The source distance in standard SI Units (i.e. metres)
  *
  * TODO: This is a generic function that could be moved into globals.c or utils.c
@@ -2127,7 +2843,7 @@ static void trw_layer_draw_dist_labels ( struct DrawingParams *dp, VikTrack *trk
                                     25.0, 40.0, 50.0, 75.0, 100.0,
                                     150.0, 200.0, 250.0, 500.0, 1000.0};
 
-  gdouble dist = vik_track_get_length_including_gaps ( trk ) / (trk->max_number_dist_labels+1);
+  gdouble dist = vik_track_get_length_including_gaps_cached ( trk ) / (trk->max_number_dist_labels+1);
 
   // Convert to specified unit to find the friendly breakdown value
   dist = distance_in_preferred_units ( dist );
@@ -2144,95 +2860,76 @@ static void trw_layer_draw_dist_labels ( struct DrawingParams *dp, VikTrack *trk
 
   vik_units_distance_t dist_units = a_vik_get_units_distance ();
 
-  for ( i = 1; i < trk->max_number_dist_labels+1; i++ ) {
-    gdouble dist_i = dist * i;
+  // Convert distance back into metres for use in finding the positions
+  gdouble interval;
+  switch (dist_units) {
+  case VIK_UNITS_DISTANCE_MILES:
+    interval = VIK_MILES_TO_METERS(dist);
+    break;
+  case VIK_UNITS_DISTANCE_NAUTICAL_MILES:
+    interval = VIK_NAUTICAL_MILES_TO_METERS(dist);
+    break;
+    // VIK_UNITS_DISTANCE_KILOMETRES:
+  default:
+    interval = dist*1000.0;
+    break;
+  }
 
-    // Convert distance back into metres for use in finding a trackpoint
-    switch (dist_units) {
-    case VIK_UNITS_DISTANCE_MILES:
-      dist_i = VIK_MILES_TO_METERS(dist_i);
-      break;
-    case VIK_UNITS_DISTANCE_NAUTICAL_MILES:
-      dist_i = VIK_NAUTICAL_MILES_TO_METERS(dist_i);
-      break;
-      // VIK_UNITS_DISTANCE_KILOMETRES:
-    default:
-      dist_i = dist_i*1000.0;
-      break;
-    }
+  // Found in one go along the track and remembered until the track is changed
+  const GArray *positions = vik_track_get_dist_label_positions ( trk, interval, trk->max_number_dist_labels );
+  if ( !positions->len )
+    return;
 
-    gdouble dist_current = 0.0;
-    VikTrackpoint *tp_current = vik_track_get_tp_by_dist ( trk, dist_i, FALSE, &dist_current );
-    gdouble dist_next = 0.0;
-    VikTrackpoint *tp_next = vik_track_get_tp_by_dist ( trk, dist_i, TRUE, &dist_next );
+  const gchar *units;
+  switch (dist_units) {
+  case VIK_UNITS_DISTANCE_MILES:
+    units = _("miles");
+    break;
+  case VIK_UNITS_DISTANCE_NAUTICAL_MILES:
+    units = _("NM");
+    break;
+    // VIK_UNITS_DISTANCE_KILOMETRES:
+  default:
+    units = _("km");
+    break;
+  }
 
-    gdouble dist_between_tps = fabs (dist_next - dist_current);
-    gdouble ratio = 0.0;
-    // Prevent division by 0 errors
-    if ( dist_between_tps > 0.0 )
-      ratio = fabs(dist_i-dist_current)/dist_between_tps;
+  gchar *fgcolour;
+  if ( dp->vtl->drawmode == DRAWMODE_BY_TRACK )
+    fgcolour = gdk_color_to_string ( &(trk->color) );
+  else
+    fgcolour = gdk_color_to_string ( &(dp->vtl->track_color) );
 
-    if ( tp_current && tp_next ) {
-      // Construct the name based on the distance value
-      gchar *name;
-      gchar *units;
-      switch (dist_units) {
-      case VIK_UNITS_DISTANCE_MILES:
-        units = g_strdup ( _("miles") );
-        break;
-      case VIK_UNITS_DISTANCE_NAUTICAL_MILES:
-        units = g_strdup ( _("NM") );
-        break;
-        // VIK_UNITS_DISTANCE_KILOMETRES:
-      default:
-        units = g_strdup ( _("km") );
-        break;
-      }
+  // if highlight mode on, then colour the background in the highlight colour
+  gchar *bgcolour;
+  if ( drawing_highlight )
+    bgcolour = g_strdup ( vik_viewport_get_highlight_color ( dp->vp ) );
+  else
+    bgcolour = gdk_color_to_string ( &(dp->vtl->track_bg_color) );
 
-      // Convert for display
-      dist_i = distance_in_preferred_units ( dist_i );
+  for ( guint nn = 1; nn <= positions->len; nn++ ) {
+    gdouble dist_i = dist * nn;
 
-      // Make the precision of the output related to the unit size.
-      if ( index == 0 )
-        name = g_strdup_printf ( "%.2f %s", dist_i, units);
-      else if ( index == 1 )
-        name = g_strdup_printf ( "%.1f %s", dist_i, units);
-      else
-        name = g_strdup_printf ( "%d %s", (gint)round(dist_i), units); // TODO single vs plurals
-      g_free ( units );
-
-      struct LatLon ll_current, ll_next;
-      vik_coord_to_latlon ( &tp_current->coord, &ll_current );
-      vik_coord_to_latlon ( &tp_next->coord, &ll_next );
-
-      // positional interpolation
-      // Using a simple ratio - may not be perfectly correct due to lat/long projections
-      //  but should be good enough over the small scale that I anticipate usage on
-      struct LatLon ll_new = { ll_current.lat + (ll_next.lat-ll_current.lat)*ratio,
-			       ll_current.lon + (ll_next.lon-ll_current.lon)*ratio };
-      VikCoord coord;
-      vik_coord_load_from_latlon ( &coord, dp->vtl->coord_mode, &ll_new );
-
-      gchar *fgcolour;
-      if ( dp->vtl->drawmode == DRAWMODE_BY_TRACK )
-        fgcolour = gdk_color_to_string ( &(trk->color) );
-      else
-        fgcolour = gdk_color_to_string ( &(dp->vtl->track_color) );
+    // Construct the name based on the distance value
+    // Make the precision of the output related to the unit size.
+    gchar *name;
+    if ( index == 0 )
+      name = g_strdup_printf ( "%.2f %s", dist_i, units);
+    else if ( index == 1 )
+      name = g_strdup_printf ( "%.1f %s", dist_i, units);
+    else
+      name = g_strdup_printf ( "%d %s", (gint)round(dist_i), units); // TODO single vs plurals
 
-      // if highlight mode on, then colour the background in the highlight colour
-      gchar *bgcolour;
-      if ( drawing_highlight )
-	bgcolour = g_strdup ( vik_viewport_get_highlight_color ( dp->vp ) );
-      else
-        bgcolour = gdk_color_to_string ( &(dp->vtl->track_bg_color) );
+    VikCoord coord;
+    vik_coord_load_from_latlon ( &coord, dp->vtl->coord_mode, &g_array_index ( positions, struct LatLon, nn-1 ) );
 
-      trw_layer_draw_track_label ( name, fgcolour, bgcolour, dp, &coord );
+    trw_layer_draw_track_label ( name, fgcolour, bgcolour, dp, &coord );
 
-      g_free ( fgcolour );
-      g_free ( bgcolour );
-      g_free ( name );
-    }
+    g_free ( name );
   }
+
+  g_free ( fgcolour );
+  g_free ( bgcolour );
 }
 
 /**
@@ -2367,13 +3064,40 @@ static void trw_layer_draw_point_names ( struct DrawingParams *dp, VikTrack *trk
   g_free ( bgcolour );
 }
 
+/**
+ * As vik_viewport_coord_to_screen(), but using the projected latitude of the trackpoint at this index when available
+ */
+static void trw_layer_trackpoint_to_screen ( struct DrawingParams *dp, const gdouble *merc_lats, guint merc_count, guint index, VikTrackpoint *tp, gint *x, gint *y )
+{
+  if ( index < merc_count ) {
+    *x = dp->vvm.width_2 + ( dp->vvm.xfactor * (tp->coord.east_west - dp->vvm.center_lon) );
+    *y = dp->vvm.height_2 + ( dp->vvm.yfactor * (dp->vvm.center_merc_lat - merc_lats[index]) );
+  }
+  else
+    vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), x, y );
+}
+
+static void trw_layer_draw_track_labels ( struct DrawingParams *dp, VikTrack *track, gboolean drawing_highlight )
+{
+  if ( track->max_number_dist_labels > 0 ) {
+    trw_layer_draw_dist_labels ( dp, track, drawing_highlight );
+  }
+  trw_layer_draw_point_names (dp, track, drawing_highlight );
+
+  if ( track->draw_name_mode != TRACK_DRAWNAME_NO ) {
+    trw_layer_draw_track_name_labels ( dp, track, drawing_highlight );
+  }
+}
+
 static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct DrawingParams *dp, gboolean draw_track_outline )
 {
   if ( ! track->visible )
     return;
+  // Only the tracks that are shown again need unpacking
+  vik_track_unpack ( track );
 
   /* TODO: this function is a mess, get rid of any redundancy */
-  GList *list = track->trackpoints;
+  GList *list;
   GdkGC *main_gc;
   gboolean useoldvals = TRUE;
 
@@ -2387,7 +3111,7 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
   guint8 tp_size;
 
   if ( dp->vtl->drawelevation ) {
-    if ( ( drawelevation = vik_track_get_minmax_alt ( track, &min_alt, &max_alt ) ) )
+    if ( ( drawelevation = vik_track_get_minmax_alt_cached ( track, &min_alt, &max_alt ) ) )
       alt_diff = max_alt - min_alt;
   }
 
@@ -2402,6 +3126,21 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
     drawstops = dp->vtl->drawstops;
   }
 
+  // When zoomed out draw a reduced version of the track that looks the same at this scale
+  //  but not when stops are shown (as they depend on every point's timestamp)
+  //  nor for tracks being edited (since the trackpoints themselves are needed)
+  if ( !drawstops && track != dp->vtl->current_track && track != dp->vtl->current_tp.trk )
+    list = vik_track_get_simplified_trackpoints ( track, dp->xmpp );
+  else
+    list = track->trackpoints;
+
+  // Similarly in the Mercator drawmode use the remembered projected latitudes of the trackpoints
+  const gdouble *merc_lats = NULL;
+  guint merc_count = 0;
+  if ( dp->mercator && track != dp->vtl->current_track && track != dp->vtl->current_tp.trk )
+    merc_lats = vik_track_get_mercator_lats ( track, list, &merc_count );
+  guint index = 0;
+
   gboolean drawing_highlight = FALSE;
   /* Current track - used for creation */
   if ( track == dp->vtl->current_track )
@@ -2417,10 +3156,7 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
       // Still need to figure out the gc according to the drawing mode:
       switch ( dp->vtl->drawmode ) {
       case DRAWMODE_BY_TRACK:
-        if ( dp->vtl->track_1color_gc )
-          g_object_unref ( dp->vtl->track_1color_gc );
-        dp->vtl->track_1color_gc = vik_viewport_new_gc_from_color ( dp->vp, &track->color, dp->vtl->line_thickness );
-        main_gc = dp->vtl->track_1color_gc;
+        main_gc = trw_layer_get_track_color_gc ( dp->vtl, dp->vp, &track->color );
 	break;
       default:
         // Mostly for DRAWMODE_ALL_SAME_COLOR
@@ -2435,9 +3171,9 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
     int x, y, oldx, oldy;
     VikTrackpoint *tp = VIK_TRACKPOINT(list->data);
   
-    tp_size = (list == dp->vtl->current_tpl) ? tp_size_cur : tp_size_reg;
+    tp_size = (list == dp->vtl->current_tp.tpl) ? tp_size_cur : tp_size_reg;
 
-    vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
+    trw_layer_trackpoint_to_screen ( dp, merc_lats, merc_count, index, tp, &x, &y );
 
     // Draw the first point as something a bit different from the normal points
     // ATM it's slightly bigger and a triangle
@@ -2455,15 +3191,40 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
     // If necessary calculate these values - which is done only once per track redraw
     if ( dp->vtl->drawmode == DRAWMODE_BY_SPEED ) {
       // the percentage factor away from the average speed determines transistions between the levels
-      average_speed = vik_track_get_average_speed_moving(track, dp->vtl->stop_length);
+      average_speed = vik_track_get_average_speed_moving_cached ( track, dp->vtl->stop_length );
       low_speed = average_speed - (average_speed*(dp->vtl->track_draw_speed_factor/100.0));
       high_speed = average_speed + (average_speed*(dp->vtl->track_draw_speed_factor/100.0));
     }
 
+    TrackPolylineT polyline;
+    polyline.vp = dp->vp;
+    polyline.rendered = dp->rendered;
+    polyline.count = 0;
+
+    // Runs of trackpoints entirely away from the view can be passed over,
+    //  except when drawing elevations as these extend beyond the trackpoints
+    GArray *chunks = dp->vtl->drawelevation ? NULL : vik_track_get_chunks ( track, list );
+    guint chunk_ii = 0;
+    guint chunk_start = 0;
+
     while ((list = g_list_next(list)))
     {
+      index++;
+
+      // Once the first trackpoint of such a run has been handled (for the line leaving the view),
+      //  continue from its last trackpoint (for the line coming back into the view)
+      if ( chunks && index == chunk_start + 1 ) {
+        VikTrackChunk *chunk = &g_array_index ( chunks, VikTrackChunk, chunk_ii );
+        chunk_ii++;
+        chunk_start += chunk->count;
+        if ( chunk_ii < chunks->len && !BBOX_INTERSECT ( chunk->bbox, dp->track_bbox ) ) {
+          list = g_array_index ( chunks, VikTrackChunk, chunk_ii ).start->prev;
+          index = chunk_start - 1;
+          useoldvals = FALSE;
+        }
+      }
       tp = VIK_TRACKPOINT(list->data);
-      tp_size = (list == dp->vtl->current_tpl) ? tp_size_cur : tp_size_reg;
+      tp_size = (list == dp->vtl->current_tp.tpl) ? tp_size_cur : tp_size_reg;
 
       VikTrackpoint *tp2 = VIK_TRACKPOINT(list->prev->data);
       // See if in a different lat/lon 'quadrant' so don't draw massively long lines (presumably wrong way around the Earth)
@@ -2481,7 +3242,7 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
              tp->coord.east_west < dp->ce2 && tp->coord.east_west > dp->ce1 &&  /* both UTM and lat lon */
              tp->coord.north_south > dp->cn1 && tp->coord.north_south < dp->cn2 ) )
       {
-        vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
+        trw_layer_trackpoint_to_screen ( dp, merc_lats, merc_count, index, tp, &x, &y );
 
 	/*
 	 * If points are the same in display coordinates, don't draw.
@@ -2490,8 +3251,10 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
 	{
 	  // Still need to process points to ensure 'stops' are drawn if required
 	  if ( drawstops && drawpoints && ! draw_track_outline && list->next &&
-	       (VIK_TRACKPOINT(list->next->data)->timestamp - VIK_TRACKPOINT(list->data)->timestamp > dp->vtl->stop_length) )
+	       (VIK_TRACKPOINT(list->next->data)->timestamp - VIK_TRACKPOINT(list->data)->timestamp > dp->vtl->stop_length) ) {
+	    track_polyline_sync ( &polyline, g_array_index(dp->vtl->track_gc, GdkGC *, VIK_TRW_LAYER_TRACK_GC_STOP) );
 	    vik_viewport_draw_arc ( dp->vp, g_array_index(dp->vtl->track_gc, GdkGC *, VIK_TRW_LAYER_TRACK_GC_STOP), TRUE, x-(3*tp_size), y-(3*tp_size), 6*tp_size, 6*tp_size, 0, 360*64 );
+	  }
 
 	  goto skip;
 	}
@@ -2515,34 +3278,41 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
 	     * This is drawn first so the trackpoint will be drawn on top
 	     */
             /* stops */
-            if ( drawstops && VIK_TRACKPOINT(list->next->data)->timestamp - VIK_TRACKPOINT(list->data)->timestamp > dp->vtl->stop_length )
+            if ( drawstops && VIK_TRACKPOINT(list->next->data)->timestamp - VIK_TRACKPOINT(list->data)->timestamp > dp->vtl->stop_length ) {
 	      /* Stop point.  Draw 6x circle. Always in redish colour */
+              track_polyline_sync ( &polyline, g_array_index(dp->vtl->track_gc, GdkGC *, VIK_TRW_LAYER_TRACK_GC_STOP) );
               vik_viewport_draw_arc ( dp->vp, g_array_index(dp->vtl->track_gc, GdkGC *, VIK_TRW_LAYER_TRACK_GC_STOP), TRUE, x-(3*tp_size), y-(3*tp_size), 6*tp_size, 6*tp_size, 0, 360*64 );
+            }
 
 	    /* Regular point - draw 2x square. */
+            track_polyline_sync ( &polyline, main_gc );
 	    vik_viewport_draw_rectangle ( dp->vp, main_gc, TRUE, x-tp_size, y-tp_size, 2*tp_size, 2*tp_size );
           }
-          else
+          else {
 	    /* Final point - draw 4x circle. */
+            track_polyline_sync ( &polyline, main_gc );
             vik_viewport_draw_arc ( dp->vp, main_gc, TRUE, x-(2*tp_size), y-(2*tp_size), 4*tp_size, 4*tp_size, 0, 360*64 );
+          }
         }
 
         if ((!tp->newsegment) && (dp->vtl->drawlines))
         {
 
           /* UTM only: zone check */
-          if ( drawpoints && dp->vtl->coord_mode == VIK_COORD_UTM && tp->coord.utm_zone != dp->center->utm_zone )
+          if ( drawpoints && dp->vtl->coord_mode == VIK_COORD_UTM && tp->coord.utm_zone != dp->center->utm_zone ) {
+            track_polyline_sync ( &polyline, main_gc );
             draw_utm_skip_insignia (  dp->vp, main_gc, x, y);
+          }
 
           if (!useoldvals)
-            vik_viewport_coord_to_screen ( dp->vp, &(tp2->coord), &oldx, &oldy );
+            trw_layer_trackpoint_to_screen ( dp, merc_lats, merc_count, index-1, tp2, &oldx, &oldy );
 
           if ( draw_track_outline ) {
-            vik_viewport_draw_line ( dp->vp, dp->vtl->track_bg_gc, oldx, oldy, x, y);
+            track_polyline_add ( &polyline, dp->vtl->track_bg_gc, oldx, oldy, x, y );
           }
           else {
 
-            vik_viewport_draw_line ( dp->vp, main_gc, oldx, oldy, x, y);
+            track_polyline_add ( &polyline, main_gc, oldx, oldy, x, y );
 
             if ( dp->vtl->drawelevation && list->next && !isnan(VIK_TRACKPOINT(list->next->data)->altitude) ) {
               GdkPoint tmp[4];
@@ -2562,9 +3332,10 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
 		tmp_gc = gtk_widget_get_style(GTK_WIDGET(dp->vp))->light_gc[3];
 	      else
 		tmp_gc = gtk_widget_get_style(GTK_WIDGET(dp->vp))->dark_gc[0];
+	      track_polyline_sync ( &polyline, tmp_gc );
 	      vik_viewport_draw_polygon ( dp->vp, tmp_gc, TRUE, tmp, 4);
 
-              vik_viewport_draw_line ( dp->vp, main_gc, oldx, oldy-FIXALTITUDE(list->data), x, y-FIXALTITUDE(list->next->data));
+              track_polyline_add ( &polyline, main_gc, oldx, oldy-FIXALTITUDE(list->data), x, y-FIXALTITUDE(list->next->data) );
             }
           }
         }
@@ -2580,6 +3351,7 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
           if ( len > 1 ) {
             gdouble dx = (oldx - midx) / len;
             gdouble dy = (oldy - midy) / len;
+            track_polyline_sync ( &polyline, main_gc );
             vik_viewport_draw_line ( dp->vp, main_gc, midx, midy, midx + (dx * dp->cc + dy * dp->ss), midy + (dy * dp->cc - dx * dp->ss) );
             vik_viewport_draw_line ( dp->vp, main_gc, midx, midy, midx + (dx * dp->cc - dy * dp->ss), midy + (dy * dp->cc + dx * dp->ss) );
           }
@@ -2595,7 +3367,7 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
         {
           if ( dp->vtl->coord_mode != VIK_COORD_UTM || tp->coord.utm_zone == dp->center->utm_zone )
           {
-            vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
+            trw_layer_trackpoint_to_screen ( dp, merc_lats, merc_count, index, tp, &x, &y );
 
             if ( !drawing_highlight && (dp->vtl->drawmode == DRAWMODE_BY_SPEED) ) {
               main_gc = g_array_index(dp->vtl->track_gc, GdkGC *, track_section_colour_by_speed ( dp->vtl, tp, tp2, average_speed, low_speed, high_speed ));
@@ -2607,9 +3379,9 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
 	    if ( x != oldx || y != oldy )
 	      {
 		if ( draw_track_outline )
-		  vik_viewport_draw_line ( dp->vp, dp->vtl->track_bg_gc, oldx, oldy, x, y);
+		  track_polyline_add ( &polyline, dp->vtl->track_bg_gc, oldx, oldy, x, y );
 		else
-		  vik_viewport_draw_line ( dp->vp, main_gc, oldx, oldy, x, y);
+		  track_polyline_add ( &polyline, main_gc, oldx, oldy, x, y );
 	      }
           }
           else 
@@ -2620,6 +3392,7 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
 	    if ( x != oldx || y != oldy )
 	      {
 		vik_viewport_coord_to_screen ( dp->vp, &(tp2->coord), &x, &y );
+		track_polyline_sync ( &polyline, main_gc );
 		draw_utm_skip_insignia ( dp->vp, main_gc, x, y );
 	      }
           }
@@ -2627,17 +3400,15 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
         useoldvals = FALSE;
       }
     }
+    track_polyline_flush ( &polyline );
 
     // Labels drawn after the trackpoints, so the labels are on top
-    if ( dp->vtl->track_draw_labels ) {
-      if ( track->max_number_dist_labels > 0 ) {
-        trw_layer_draw_dist_labels ( dp, track, drawing_highlight );
-      }
-      trw_layer_draw_point_names (dp, track, drawing_highlight );
-
-      if ( track->draw_name_mode != TRACK_DRAWNAME_NO ) {
-        trw_layer_draw_track_name_labels ( dp, track, drawing_highlight );
-      }
+    //  (and only once, when not just drawing the outline)
+    if ( dp->vtl->track_draw_labels && !draw_track_outline ) {
+      if ( dp->rendered )
+        g_ptr_array_add ( dp->rendered->label_tracks, track );
+      else
+        trw_layer_draw_track_labels ( dp, track, drawing_highlight );
     }
   }
 }
@@ -2649,12 +3420,17 @@ static void trw_layer_draw_track_cb ( const gpointer id, VikTrack *track, struct
   }
 }
 
+static gboolean trw_layer_waypoint_in_view ( VikWaypoint *wp, struct DrawingParams *dp )
+{
+  return wp->visible &&
+    ( (!dp->one_zone && !dp->lat_lon) || ( ( dp->lat_lon || wp->coord.utm_zone == dp->center->utm_zone ) &&
+             wp->coord.east_west < dp->ce2 && wp->coord.east_west > dp->ce1 &&
+             wp->coord.north_south > dp->cn1 && wp->coord.north_south < dp->cn2 ) );
+}
+
 static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct DrawingParams *dp )
 {
-  if ( wp->visible )
-  if ( (!dp->one_zone && !dp->lat_lon) || ( ( dp->lat_lon || wp->coord.utm_zone == dp->center->utm_zone ) && 
-             wp->coord.east_west < dp->ce2 && wp->coord.east_west > dp->ce1 && 
-             wp->coord.north_south > dp->cn1 && wp->coord.north_south < dp->cn2 ) )
+  if ( trw_layer_waypoint_in_view ( wp, dp ) )
   {
     gint x, y;
     vik_viewport_coord_to_screen ( dp->vp, &(wp->coord), &x, &y );
@@ -2670,10 +3446,12 @@ static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct
       if ( !pixbuf )
       {
         gchar *image = wp->image;
-        GdkPixbuf *regularthumb = a_thumbnails_get ( wp->image );
+        gboolean loading;
+        // The layer is redrawn once a thumbnail not yet in memory has been loaded
+        GdkPixbuf *regularthumb = a_thumbnails_get_cached ( wp->image, (ThumbnailLoadedFunc)vik_layer_emit_update, G_OBJECT(dp->vtl), &loading );
         if ( ! regularthumb )
         {
-          regularthumb = a_thumbnails_get_default (); /* cache one 'not yet loaded' for all thumbs not loaded */
+          regularthumb = a_thumbnails_get_default (); /* cache one 'not yet loaded' for all thumbs not loaded (or still loading) */
           image = "\x12\x00"; /* this shouldn't occur naturally. */
         }
         if ( regularthumb )
@@ -2756,32 +3534,31 @@ static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct
       /* thanks to the GPSDrive people (Fritz Ganter et al.) for hints on this part ... yah, I'm too lazy to study documentation */
       gint label_x, label_y;
       gint width, height;
+      gboolean layout_set;
       // Hopefully name won't break the markup (may need to sanitize - g_markup_escape_text())
 
-      // Could this stored in the waypoint rather than recreating each pass?
       gchar *wp_label_markup = g_strdup_printf ( "<span size=\"%s\">%s</span>", dp->vtl->wp_fsize_str, wp->name );
 
-      if ( pango_parse_markup ( wp_label_markup, -1, 0, NULL, NULL, NULL, NULL ) )
-        pango_layout_set_markup ( dp->vtl->wplabellayout, wp_label_markup, -1 );
-      else
-        // Fallback if parse failure
-        pango_layout_set_text ( dp->vtl->wplabellayout, wp->name, -1 );
-
-      g_free ( wp_label_markup );
-
-      pango_layout_get_pixel_size ( dp->vtl->wplabellayout, &width, &height );
+      trw_layer_label_size ( dp->vtl, dp->vtl->wplabellayout, wp_label_markup, wp->name, &width, &height, &layout_set );
       label_x = x - width/2;
       if ( wp->symbol_pixbuf )
         label_y = y - height - 2 - gdk_pixbuf_get_height(wp->symbol_pixbuf)/2;
       else
         label_y = y - dp->vtl->wp_size - height - 2;
 
-      /* if highlight mode on, then draw background text in highlight colour */
-      if ( dp->highlight )
-        vik_viewport_draw_rectangle ( dp->vp, vik_viewport_get_gc_highlight (dp->vp), TRUE, label_x - 1, label_y-1,width+2,height+2);
-      else
-        vik_viewport_draw_rectangle ( dp->vp, dp->vtl->waypoint_bg_gc, TRUE, label_x - 1, label_y-1,width+2,height+2);
-      vik_viewport_draw_layout ( dp->vp, dp->vtl->waypoint_text_gc, label_x, label_y, dp->vtl->wplabellayout );
+      GdkRectangle area = { label_x-1, label_y-1, width+2, height+2 };
+      if ( trw_layer_label_visible ( dp, &area ) ) {
+        if ( !layout_set )
+          label_layout_set ( dp->vtl->wplabellayout, wp_label_markup, wp->name );
+        /* if highlight mode on, then draw background text in highlight colour */
+        if ( dp->highlight )
+          vik_viewport_draw_rectangle ( dp->vp, vik_viewport_get_gc_highlight (dp->vp), TRUE, area.x, area.y, area.width, area.height );
+        else
+          vik_viewport_draw_rectangle ( dp->vp, dp->vtl->waypoint_bg_gc, TRUE, area.x, area.y, area.width, area.height );
+        vik_viewport_draw_layout ( dp->vp, dp->vtl->waypoint_text_gc, label_x, label_y, dp->vtl->wplabellayout );
+      }
+
+      g_free ( wp_label_markup );
     }
   }
 }
@@ -2793,25 +3570,266 @@ static void trw_layer_draw_waypoint_cb ( gpointer id, VikWaypoint *wp, struct Dr
   }
 }
 
+#define WP_CLUSTER_SIZE 48
+
+// Waypoints within the same grid cell of the display
+typedef struct {
+  VikWaypoint *wp; // The first one
+  guint count;
+  gint64 sum_x, sum_y;
+} WaypointClusterT;
+
+typedef struct {
+  struct DrawingParams *dp;
+  GHashTable *cells;
+  gint origin_x, origin_y;
+} WaypointClusteringT;
+
+static void trw_layer_cluster_waypoint_cb ( gpointer id, VikWaypoint *wp, WaypointClusteringT *wc )
+{
+  if ( !trw_layer_waypoint_in_view ( wp, wc->dp ) )
+    return;
+
+  gint x, y;
+  vik_viewport_coord_to_screen ( wc->dp->vp, &(wp->coord), &x, &y );
+  // Cells are aligned to a fixed position, so clusters stay the same whilst panning
+  const gint cx = (gint)floor ( (gdouble)(x - wc->origin_x) / WP_CLUSTER_SIZE );
+  const gint cy = (gint)floor ( (gdouble)(y - wc->origin_y) / WP_CLUSTER_SIZE );
+  const guint key = ((guint)(cx & 0xffff) << 16) | (guint)(cy & 0xffff);
+
+  WaypointClusterT *cluster = g_hash_table_lookup ( wc->cells, GUINT_TO_POINTER(key) );
+  if ( !cluster ) {
+    cluster = g_malloc0 ( sizeof(WaypointClusterT) );
+    cluster->wp = wp;
+    g_hash_table_insert ( wc->cells, GUINT_TO_POINTER(key), cluster );
+  }
+  cluster->count++;
+  cluster->sum_x += x;
+  cluster->sum_y += y;
+}
+
+static void trw_layer_draw_cluster_cb ( gpointer key, WaypointClusterT *cluster, struct DrawingParams *dp )
+{
+  if ( cluster->count == 1 ) {
+    trw_layer_draw_waypoint ( NULL, cluster->wp, dp );
+    return;
+  }
+
+  // Marker at the average position, with the number of waypoints
+  const gint x = cluster->sum_x / cluster->count;
+  const gint y = cluster->sum_y / cluster->count;
+  gchar *count = g_strdup_printf ( "%u", cluster->count );
+  pango_layout_set_text ( dp->vtl->wplabellayout, count, -1 );
+  g_free ( count );
+  gint width, height;
+  pango_layout_get_pixel_size ( dp->vtl->wplabellayout, &width, &height );
+  const gint radius = MAX ( width, height ) / 2 + 3;
+
+  GdkGC *bg_gc = dp->highlight ? vik_viewport_get_gc_highlight ( dp->vp ) : dp->vtl->waypoint_bg_gc;
+  vik_viewport_draw_arc ( dp->vp, bg_gc, TRUE, x - radius, y - radius, radius*2, radius*2, 0, 360*64 );
+  vik_viewport_draw_arc ( dp->vp, dp->vtl->waypoint_gc, FALSE, x - radius, y - radius, radius*2, radius*2, 0, 360*64 );
+  vik_viewport_draw_layout ( dp->vp, dp->vtl->waypoint_text_gc, x - width/2, y - height/2, dp->vtl->wplabellayout );
+}
+
+/**
+ * Draw the waypoints grouped by grid cells of the display,
+ *  thus many waypoints in an area only take one marker
+ */
+static void trw_layer_draw_waypoints_clustered ( VikTrwLayer *vtl, struct DrawingParams *dp )
+{
+  WaypointClusteringT wc;
+  wc.dp = dp;
+  wc.cells = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
+
+  // Use the display position of 0,0 as the cell alignment
+  VikCoord origin;
+  struct LatLon ll = { 0.0, 0.0 };
+  vik_coord_load_from_latlon ( &origin, vik_viewport_get_coord_mode(dp->vp), &ll );
+  if ( origin.mode == VIK_COORD_UTM && dp->one_zone )
+    origin.utm_zone = dp->center->utm_zone;
+  vik_viewport_coord_to_screen ( dp->vp, &origin, &wc.origin_x, &wc.origin_y );
+
+  g_hash_table_foreach ( vtl->waypoints, (GHFunc)trw_layer_cluster_waypoint_cb, &wc );
+  g_hash_table_foreach ( wc.cells, (GHFunc)trw_layer_draw_cluster_cb, dp );
+  g_hash_table_destroy ( wc.cells );
+}
+
+/*** Drawing lots of tracks ***/
+
+// With more tracks in view than this for each 256x256 pixels of the display,
+//  they merge into a mass of lines that takes a long time to draw individually,
+//  so instead the lines of all the tracks are drawn from tiles (see tracklod.h).
+// On zooming in there are fewer tracks in view, and they are drawn individually once more.
+#define VIK_SETTINGS_TRW_LOD_TRACKS_PER_TILE "trw_lod_tracks_per_tile"
+#define TRW_LOD_TRACKS_PER_TILE_DEFAULT 50 // 0 to always draw the tracks individually
+
+static gint trw_layer_lod_tracks_per_tile ( void )
+{
+  static gint per_tile = -1;
+  if ( per_tile < 0 ) {
+    if ( !a_settings_get_integer ( VIK_SETTINGS_TRW_LOD_TRACKS_PER_TILE, &per_tile ) || per_tile < 0 )
+      per_tile = TRW_LOD_TRACKS_PER_TILE_DEFAULT;
+  }
+  return per_tile;
+}
+
+static guint trw_layer_count_tracks_in_bbox ( VikTrwLayer *vtl, LatLonBBox bbox )
+{
+  guint count = 0;
+  GHashTable *tables[] = { vtl->tracks, vtl->routes };
+  gboolean shown[] = { vtl->tracks_visible, vtl->routes_visible };
+  GHashTableIter iter;
+  gpointer key, value;
+  for ( guint ii = 0; ii < G_N_ELEMENTS(tables); ii++ ) {
+    if ( !shown[ii] )
+      continue;
+    g_hash_table_iter_init ( &iter, tables[ii] );
+    while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+      if ( VIK_TRACK(value)->visible && BBOX_INTERSECT ( VIK_TRACK(value)->bbox, bbox ) )
+        count++;
+  }
+  return count;
+}
+
+/**
+ * vik_trw_layer_count_tracks_in_view:
+ *
+ * Returns: The number of tracks and routes that would be drawn in the view
+ */
+guint vik_trw_layer_count_tracks_in_view ( VikTrwLayer *vtl, VikViewport *vvp )
+{
+  return trw_layer_count_tracks_in_bbox ( vtl, vik_viewport_get_bbox ( vvp ) );
+}
+
+/**
+ * vik_trw_layer_lod_wanted:
+ *
+ * Returns: Whether this many tracks in the view would be better drawn from tiles
+ */
+gboolean vik_trw_layer_lod_wanted ( VikViewport *vvp, guint tracks_in_view )
+{
+  const gint per_tile = trw_layer_lod_tracks_per_tile ();
+  if ( !per_tile || !a_track_lod_available ( vvp ) )
+    return FALSE;
+  gdouble tiles = MAX ( 1.0, vik_viewport_get_width(vvp) / 256.0 * vik_viewport_get_height(vvp) / 256.0 );
+  return tracks_in_view > per_tile * tiles;
+}
+
+/**
+ * vik_trw_layer_set_lod_forced:
+ *
+ * Draw the tracks from tiles whenever possible, regardless of how many there are in this layer
+ *  e.g. as lots of tracks are spread over many layers
+ */
+void vik_trw_layer_set_lod_forced ( VikTrwLayer *vtl, gboolean forced )
+{
+  vtl->lod_forced = forced;
+}
+
+/**
+ * Draw the tracks and routes from tiles, when there are too many to draw individually
+ *
+ * Returns: FALSE if they should be drawn individually
+ */
+static gboolean trw_layer_draw_lod ( VikTrwLayer *vtl, struct DrawingParams *dp )
+{
+  if ( !vtl->tracks_visible && !vtl->routes_visible )
+    return FALSE;
+  if ( vtl->lod_forced ) {
+    if ( !a_track_lod_available ( dp->vp ) )
+      return FALSE;
+  }
+  else if ( !vik_trw_layer_lod_wanted ( dp->vp, trw_layer_count_tracks_in_bbox ( vtl, dp->bbox ) ) )
+    return FALSE;
+
+  if ( !vtl->lod )
+    vtl->lod = a_track_lod_new ( VIK_LAYER(vtl) );
+  a_track_lod_set_colour ( vtl->lod, &vtl->track_color );
+
+  // Tiles cover all the tracks, except those being edited which are drawn individually so changes show straight away
+  GPtrArray *tracks = g_ptr_array_new ();
+  GHashTable *tables[] = { vtl->tracks, vtl->routes };
+  gboolean shown[] = { vtl->tracks_visible, vtl->routes_visible };
+  GHashTableIter iter;
+  gpointer key, value;
+  for ( guint ii = 0; ii < G_N_ELEMENTS(tables); ii++ ) {
+    if ( !shown[ii] )
+      continue;
+    g_hash_table_iter_init ( &iter, tables[ii] );
+    while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+      VikTrack *trk = VIK_TRACK(value);
+      if ( !trk->visible || trk == vtl->current_track || trk == vtl->current_tp.trk )
+        continue;
+      vik_track_unpack ( trk );
+      g_ptr_array_add ( tracks, trk );
+    }
+  }
+  a_track_lod_update ( vtl->lod, tracks );
+  g_ptr_array_free ( tracks, TRUE );
+  a_track_lod_draw ( vtl->lod, dp->vp );
+
+  if ( vtl->current_track )
+    trw_layer_draw_track_cb ( NULL, vtl->current_track, dp );
+  if ( vtl->current_tp.trk && vtl->current_tp.trk != vtl->current_track )
+    trw_layer_draw_track_cb ( NULL, vtl->current_tp.trk, dp );
+  return TRUE;
+}
+
 static void trw_layer_draw_with_highlight ( VikTrwLayer *l, VikViewport *vvp, gboolean highlight )
 {
   static struct DrawingParams dp;
   g_assert ( l != NULL );
 
+  // Whatever has changed, the positions for selecting are made afresh for what is now drawn
+  trw_layer_pick_clear ( l );
+
   init_drawing_params ( &dp, l, vvp, highlight );
+  if ( a_vik_get_hide_overlapping_labels() )
+    dp.labels = label_grid_new ( dp.width, dp.height );
+  // Track and route lines are smoothed by rendering them client side, except for the highlight
+  if ( a_vik_get_antialias() && !highlight )
+    dp.rendered = rendered_lines_new ();
+
+  if ( !trw_layer_draw_lod ( l, &dp ) ) {
+    if ( l->tracks_visible )
+      g_hash_table_foreach ( l->tracks, (GHFunc) trw_layer_draw_track_cb, &dp );
+
+    if ( l->routes_visible )
+      g_hash_table_foreach ( l->routes, (GHFunc) trw_layer_draw_track_cb, &dp );
+  }
 
-  if ( l->tracks_visible )
-    g_hash_table_foreach ( l->tracks, (GHFunc) trw_layer_draw_track_cb, &dp );
+  if ( dp.rendered ) {
+    if ( dp.rendered->lines->len )
+      vik_viewport_draw_rendered ( vvp, (VikViewportRenderFunc)rendered_lines_render, dp.rendered );
+    for ( guint ii = 0; ii < dp.rendered->label_tracks->len; ii++ )
+      trw_layer_draw_track_labels ( &dp, g_ptr_array_index(dp.rendered->label_tracks, ii), FALSE );
+    rendered_lines_free ( dp.rendered );
+    dp.rendered = NULL;
+  }
 
-  if ( l->routes_visible )
-    g_hash_table_foreach ( l->routes, (GHFunc) trw_layer_draw_track_cb, &dp );
+  if ( l->waypoints_visible ) {
+    if ( l->wp_cluster && dp.xmpp > (1 << l->wp_cluster_zoom) ) {
+      if ( BBOX_INTERSECT ( l->waypoints_bbox, dp.bbox ) )
+        trw_layer_draw_waypoints_clustered ( l, &dp );
+    }
+    else
+      g_hash_table_foreach ( l->waypoints, (GHFunc) trw_layer_draw_waypoint_cb, &dp );
+  }
 
-  if (l->waypoints_visible)
-    g_hash_table_foreach ( l->waypoints, (GHFunc) trw_layer_draw_waypoint_cb, &dp );
+  if ( dp.labels ) {
+    label_grid_free ( dp.labels );
+    dp.labels = NULL;
+  }
 }
 
 static void trw_layer_draw ( VikTrwLayer *l, VikViewport *vvp )
 {
+  // Nothing to draw until the layer comes into view
+  if ( l->pending_data && l->pending_bbox_valid ) {
+    LatLonBBox bbox = vik_viewport_get_bbox ( vvp );
+    if ( !BBOX_INTERSECT(l->pending_bbox, bbox) )
+      return;
+  }
   trw_ensure_layer_loaded ( l );
   // If this layer is to be highlighted - then don't draw now - as it will be drawn later on in the specific highlight draw stage
   // This may seem slightly inefficient to test each time for every layer
@@ -2890,10 +3908,10 @@ static void trw_layer_free_track_gcs ( VikTrwLayer *vtl )
     g_object_unref ( vtl->track_bg_gc );
     vtl->track_bg_gc = NULL;
   }
-  if ( vtl->track_1color_gc )
+  if ( vtl->track_color_gcs )
   {
-    g_object_unref ( vtl->track_1color_gc );
-    vtl->track_1color_gc = NULL;
+    g_hash_table_destroy ( vtl->track_color_gcs );
+    vtl->track_color_gcs = NULL;
   }
   if ( vtl->current_track_gc ) 
   {
@@ -3005,50 +4023,76 @@ GdkPixbuf* get_wp_sym_small ( gchar *symbol )
   return wp_icon;
 }
 
-static void trw_layer_realize_track ( gpointer id, VikTrack *track, gpointer pass_along[5] )
+/*
+ * Add the rows for all the tracks or routes in one go
+ */
+static void trw_layer_realize_tracks ( VikTrwLayer *vtl, GHashTable *tracks, GHashTable *iters, GtkTreeIter *parent_iter, gint sublayer_type )
 {
-  GtkTreeIter *new_iter = g_malloc(sizeof(GtkTreeIter));
-
-  GdkPixbuf *pixbuf = NULL;
-
-  if ( track->has_color )
-    pixbuf = ui_pixbuf_new ( &track->color, SMALL_ICON_SIZE, SMALL_ICON_SIZE );
-
-  gdouble timestamp = 0;
-  VikTrackpoint *tpt = vik_track_get_tp_first(track);
-  if ( tpt && !isnan(tpt->timestamp) )
-    timestamp = tpt->timestamp;
+  guint count = g_hash_table_size ( tracks );
+  if ( count == 0 )
+    return;
 
-  vik_treeview_add_sublayer ( (VikTreeview *) pass_along[3], (GtkTreeIter *) pass_along[0], (GtkTreeIter *) pass_along[1], track->name, pass_along[2], id, GPOINTER_TO_INT (pass_along[4]), pixbuf, TRUE, timestamp, track->number );
+  VikTreeviewSublayer *items = g_new0 ( VikTreeviewSublayer, count );
 
-  if ( pixbuf )
-    g_object_unref (pixbuf);
+  GHashTableIter iter;
+  gpointer key, value;
+  guint ii = 0;
+  g_hash_table_iter_init ( &iter, tracks );
+  while ( g_hash_table_iter_next (&iter, &key, &value) ) {
+    VikTrack *track = VIK_TRACK(value);
+    items[ii].name = track->name;
+    items[ii].item = key;
+    if ( track->has_color )
+      items[ii].icon = ui_pixbuf_new ( &track->color, SMALL_ICON_SIZE, SMALL_ICON_SIZE );
+    items[ii].visible = track->visible;
+    VikTrackpoint *tpt = vik_track_get_tp_first(track);
+    if ( tpt && !isnan(tpt->timestamp) )
+      items[ii].timestamp = tpt->timestamp;
+    items[ii].number = track->number;
+    ii++;
+  }
 
-  *new_iter = *((GtkTreeIter *) pass_along[1]);
-  if ( track->is_route )
-    g_hash_table_insert ( VIK_TRW_LAYER(pass_along[2])->routes_iters, id, new_iter );
-  else
-    g_hash_table_insert ( VIK_TRW_LAYER(pass_along[2])->tracks_iters, id, new_iter );
+  vik_treeview_add_sublayers ( VIK_LAYER(vtl)->vt, parent_iter, vtl, sublayer_type, items, count, vtl->track_sort_order );
 
-  if ( ! track->visible )
-    vik_treeview_item_set_visible ( (VikTreeview *) pass_along[3], (GtkTreeIter *) pass_along[1], FALSE );
+  for ( ii = 0; ii < count; ii++ ) {
+    g_hash_table_insert ( iters, items[ii].item, g_memdup ( &(items[ii].iter), sizeof(GtkTreeIter) ) );
+    if ( items[ii].icon )
+      g_object_unref ( items[ii].icon );
+  }
+  g_free ( items );
 }
 
-static void trw_layer_realize_waypoint ( gpointer id, VikWaypoint *wp, gpointer pass_along[5] )
+/*
+ * Add the rows for all the waypoints in one go
+ */
+static void trw_layer_realize_waypoints ( VikTrwLayer *vtl )
 {
-  GtkTreeIter *new_iter = g_malloc(sizeof(GtkTreeIter));
-
-  gdouble timestamp = 0;
-  if ( !isnan(wp->timestamp) )
-    timestamp = wp->timestamp;
-
-  vik_treeview_add_sublayer ( (VikTreeview *) pass_along[3], (GtkTreeIter *) pass_along[0], (GtkTreeIter *) pass_along[1], wp->name, pass_along[2], id, GPOINTER_TO_UINT (pass_along[4]), get_wp_sym_small (wp->symbol), TRUE, timestamp, 0 );
+  guint count = g_hash_table_size ( vtl->waypoints );
+  if ( count == 0 )
+    return;
 
-  *new_iter = *((GtkTreeIter *) pass_along[1]);
-  g_hash_table_insert ( VIK_TRW_LAYER(pass_along[2])->waypoints_iters, id, new_iter );
+  VikTreeviewSublayer *items = g_new0 ( VikTreeviewSublayer, count );
 
-  if ( ! wp->visible )
-    vik_treeview_item_set_visible ( (VikTreeview *) pass_along[3], (GtkTreeIter *) pass_along[1], FALSE );
+  GHashTableIter iter;
+  gpointer key, value;
+  guint ii = 0;
+  g_hash_table_iter_init ( &iter, vtl->waypoints );
+  while ( g_hash_table_iter_next (&iter, &key, &value) ) {
+    VikWaypoint *wp = VIK_WAYPOINT(value);
+    items[ii].name = wp->name;
+    items[ii].item = key;
+    items[ii].icon = get_wp_sym_small ( wp->symbol );
+    items[ii].visible = wp->visible;
+    if ( !isnan(wp->timestamp) )
+      items[ii].timestamp = wp->timestamp;
+    ii++;
+  }
+
+  vik_treeview_add_sublayers ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, items, count, vtl->wp_sort_order );
+
+  for ( ii = 0; ii < count; ii++ )
+    g_hash_table_insert ( vtl->waypoints_iters, items[ii].item, g_memdup ( &(items[ii].iter), sizeof(GtkTreeIter) ) );
+  g_free ( items );
 }
 
 static void trw_layer_add_sublayer_tracks ( VikTrwLayer *vtl, VikTreeview *vt, GtkTreeIter *layer_iter )
@@ -3066,44 +4110,78 @@ static void trw_layer_add_sublayer_routes ( VikTrwLayer *vtl, VikTreeview *vt, G
   vik_treeview_add_sublayer ( (VikTreeview *) vt, layer_iter, &(vtl->routes_iter), _("Routes"), vtl, NULL, VIK_TRW_LAYER_SUBLAYER_ROUTES, NULL, FALSE, 0, 0 );
 }
 
+/*
+ * Add the rows of the individual items if this was put off when the layer was realized
+ * Call this before looking up the iter of an item
+ */
+static void trw_layer_realize_items ( VikTrwLayer *vtl )
+{
+  if ( !vtl->items_deferred )
+    return;
+  vtl->items_deferred = FALSE;
+  trw_layer_unpack_tracks ( vtl );
+
+  if ( vtl->expand_handler ) {
+    g_signal_handler_disconnect ( VIK_LAYER(vtl)->vt, vtl->expand_handler );
+    vtl->expand_handler = 0;
+  }
+
+  trw_layer_realize_tracks ( vtl, vtl->tracks, vtl->tracks_iters, &(vtl->tracks_iter), VIK_TRW_LAYER_SUBLAYER_TRACK );
+  trw_layer_realize_tracks ( vtl, vtl->routes, vtl->routes_iters, &(vtl->routes_iter), VIK_TRW_LAYER_SUBLAYER_ROUTE );
+  trw_layer_realize_waypoints ( vtl );
+}
+
+/*
+ * Fill in the item rows just before the layer is first opened up in the treeview
+ */
+static gboolean trw_layer_test_expand_row_cb ( GtkTreeView *tree_view, GtkTreeIter *iter, GtkTreePath *path, VikTrwLayer *vtl )
+{
+  if ( vik_treeview_item_get_type ( VIK_LAYER(vtl)->vt, iter ) == VIK_TREEVIEW_TYPE_LAYER &&
+       vik_treeview_item_get_pointer ( VIK_LAYER(vtl)->vt, iter ) == vtl )
+    trw_layer_realize_items ( vtl );
+  // Allow the expansion
+  return FALSE;
+}
+
 static void trw_layer_realize ( VikTrwLayer *vtl, VikTreeview *vt, GtkTreeIter *layer_iter )
 {
-  GtkTreeIter iter2;
-  gpointer pass_along[5] = { &(vtl->tracks_iter), &iter2, vtl, vt, GINT_TO_POINTER(VIK_TRW_LAYER_SUBLAYER_TRACK) };
+  // Any previous rows went with the previous layer row
+  g_hash_table_remove_all ( vtl->tracks_iters );
+  g_hash_table_remove_all ( vtl->routes_iters );
+  g_hash_table_remove_all ( vtl->waypoints_iters );
+  if ( vtl->expand_handler ) {
+    g_signal_handler_disconnect ( vt, vtl->expand_handler );
+    vtl->expand_handler = 0;
+  }
 
   if ( g_hash_table_size (vtl->tracks) > 0 ) {
     trw_layer_add_sublayer_tracks ( vtl, vt , layer_iter );
-
-    g_hash_table_foreach ( vtl->tracks, (GHFunc) trw_layer_realize_track, pass_along );
-
     vik_treeview_item_set_visible ( vt, &(vtl->tracks_iter), vtl->tracks_visible );
   }
 
   if ( g_hash_table_size (vtl->routes) > 0 ) {
     trw_layer_add_sublayer_routes ( vtl, vt, layer_iter );
-
-    pass_along[0] = &(vtl->routes_iter);
-    pass_along[4] = GINT_TO_POINTER(VIK_TRW_LAYER_SUBLAYER_ROUTE);
-
-    g_hash_table_foreach ( vtl->routes, (GHFunc) trw_layer_realize_track, pass_along );
-
     vik_treeview_item_set_visible ( (VikTreeview *) vt, &(vtl->routes_iter), vtl->routes_visible );
   }
 
   if ( g_hash_table_size (vtl->waypoints) > 0 ) {
     trw_layer_add_sublayer_waypoints ( vtl, vt, layer_iter );
-
-    pass_along[0] = &(vtl->waypoints_iter);
-    pass_along[4] = GINT_TO_POINTER(VIK_TRW_LAYER_SUBLAYER_WAYPOINT);
-
-    g_hash_table_foreach ( vtl->waypoints, (GHFunc) trw_layer_realize_waypoint, pass_along );
-
     vik_treeview_item_set_visible ( (VikTreeview *) vt, &(vtl->waypoints_iter), vtl->waypoints_visible );
   }
 
-  trw_layer_verify_thumbnails ( vtl );
+  // A layer row starts closed, so the item rows are only needed once it is opened
+  //  (or when something wants to select or change an item)
+  // This saves a lot of time for layers with many thousands of items that never get looked at
+  vtl->items_deferred = TRUE;
+  GtkTreePath *path = gtk_tree_model_get_path ( gtk_tree_view_get_model(GTK_TREE_VIEW(vt)), layer_iter );
+  gboolean expanded = gtk_tree_view_row_expanded ( GTK_TREE_VIEW(vt), path );
+  gtk_tree_path_free ( path );
+  if ( expanded )
+    trw_layer_realize_items ( vtl );
+  else
+    vtl->expand_handler = g_signal_connect_object ( vt, "test-expand-row", G_CALLBACK(trw_layer_test_expand_row_cb), vtl, 0 );
 
-  trw_layer_sort_all ( vtl );
+  trw_layer_verify_thumbnails ( vtl );
 
   trw_update_layer_icon ( vtl );
 }
@@ -3254,6 +4332,9 @@ static const gchar* trw_layer_layer_tooltip ( VikTrwLayer *vtl )
   gchar tbuf2[64];
   gchar tbuf3[64];
   gchar tbuf4[10];
+
+  trw_ensure_layer_loaded ( vtl );
+  trw_layer_unpack_tracks ( vtl );
   tbuf1[0] = '\0';
   tbuf2[0] = '\0';
   tbuf3[0] = '\0';
@@ -3401,6 +4482,32 @@ static const gchar* trw_layer_layer_tooltip ( VikTrwLayer *vtl )
   return tmp_buf;
 }
 
+static void trw_layer_get_memory ( VikTrwLayer *vtl, VikLayerMemory *mem )
+{
+  GHashTable *tables[] = { vtl->tracks, vtl->routes };
+  GHashTableIter iter;
+  gpointer key, value;
+  for ( guint ii = 0; ii < G_N_ELEMENTS(tables); ii++ ) {
+    g_hash_table_iter_init ( &iter, tables[ii] );
+    while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+      vik_track_get_memory ( VIK_TRACK(value),
+                             &mem->bytes[VIK_LAYER_MEMORY_POINTS],
+                             &mem->bytes[VIK_LAYER_MEMORY_STRINGS],
+                             &mem->bytes[VIK_LAYER_MEMORY_EXTENSIONS],
+                             &mem->bytes[VIK_LAYER_MEMORY_CACHES] );
+  }
+  g_hash_table_iter_init ( &iter, vtl->waypoints );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+    vik_waypoint_get_memory ( VIK_WAYPOINT(value),
+                              &mem->bytes[VIK_LAYER_MEMORY_POINTS],
+                              &mem->bytes[VIK_LAYER_MEMORY_STRINGS],
+                              &mem->bytes[VIK_LAYER_MEMORY_EXTENSIONS] );
+  // Waypoint image thumbnails
+  g_hash_table_iter_init ( &iter, vtl->image_cache );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+    mem->bytes[VIK_LAYER_MEMORY_IMAGES] += ui_pixbuf_get_bytes ( (GdkPixbuf*)value );
+}
+
 static const gchar* trw_layer_sublayer_tooltip ( VikTrwLayer *l, gint subtype, gpointer sublayer )
 {
   switch ( subtype )
@@ -3437,6 +4544,7 @@ static const gchar* trw_layer_sublayer_tooltip ( VikTrwLayer *l, gint subtype, g
         tr = g_hash_table_lookup ( l->routes, sublayer );
 
       if ( tr ) {
+	vik_track_unpack ( tr );
 	// Could be a better way of handling strings - but this works...
 	gchar time_buf1[20];
 	gchar time_buf2[20];
@@ -3449,7 +4557,7 @@ static const gchar* trw_layer_sublayer_tooltip ( VikTrwLayer *l, gint subtype, g
           VikTrackpoint *tp1 = vik_track_get_tp_first ( tr );
           time_t first = tp1->timestamp;
           // %x     The preferred date representation for the current locale without the time.
-          gchar *time_str = vu_get_time_string ( &first, "%x: ", &tp1->coord, NULL );
+          gchar *time_str = vu_get_time_string_cached ( &first, "%x: ", &tp1->coord, &tr->tz_cache );
           g_strlcpy ( time_buf1, time_str, sizeof(time_buf1) );
           g_free ( time_str );
           gdouble dur = vik_track_get_duration ( tr, TRUE );
@@ -3525,8 +4633,11 @@ static const gchar* trw_layer_sublayer_tooltip ( VikTrwLayer *l, gint subtype, g
  * Function to show track point information on the statusbar
  *  Items displayed is controlled by the settings format code
  */
-static void set_statusbar_msg_info_trkpt ( VikTrwLayer *vtl, VikTrackpoint *trkpt )
+static void set_statusbar_msg_info_trkpt ( VikTrwLayer *vtl )
 {
+  VikTrackpoint *trkpt = vik_track_cursor_get_tp ( &vtl->current_tp );
+  if ( !trkpt )
+    return;
   gchar *statusbar_format_code = NULL;
   VikTrackpoint *trkpt_prev = NULL;
   if ( !a_settings_get_string ( VIK_SETTINGS_TRKPT_SELECTED_STATUSBAR_FORMAT, &statusbar_format_code ) ) {
@@ -3535,10 +4646,11 @@ static void set_statusbar_msg_info_trkpt ( VikTrwLayer *vtl, VikTrackpoint *trkp
   }
   else {
     // Format code may want to show speed - so may need previous trkpt to work it out
-    trkpt_prev = vik_track_get_tp_prev ( vtl->current_tp_track, trkpt );
+    if ( vtl->current_tp.tpl->prev )
+      trkpt_prev = VIK_TRACKPOINT(vtl->current_tp.tpl->prev->data);
   }
 
-  gchar *msg = vu_trackpoint_formatted_message ( statusbar_format_code, trkpt, trkpt_prev, vtl->current_tp_track, NAN );
+  gchar *msg = vu_trackpoint_formatted_message ( statusbar_format_code, trkpt, trkpt_prev, vtl->current_tp.trk, NAN );
   vik_statusbar_set_message ( vik_window_get_statusbar (VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl))), VIK_STATUSBAR_INFO, msg );
   g_free ( msg );
   g_free ( statusbar_format_code );
@@ -3696,6 +4808,7 @@ static gboolean trw_layer_selected ( VikTrwLayer *l, gint subtype, gpointer subl
 	  case VIK_TRW_LAYER_SUBLAYER_TRACK:
 	    {
 	      VikTrack *track = g_hash_table_lookup ( l->tracks, sublayer );
+              vik_track_unpack ( track );
               vik_window_set_selected_track ( vw, (gpointer)track, l );
               if ( show_graphs_for_track(gw, vw, l, track) )
                 return TRUE; // Mark for redraw
@@ -3711,6 +4824,7 @@ static gboolean trw_layer_selected ( VikTrwLayer *l, gint subtype, gpointer subl
 	  case VIK_TRW_LAYER_SUBLAYER_ROUTE:
 	    {
 	      VikTrack *track = g_hash_table_lookup ( l->routes, sublayer );
+	      vik_track_unpack ( track );
 	      vik_window_set_selected_track ( vw, (gpointer)track, l );
               if ( show_graphs_for_track(gw, vw, l, track) )
                 return TRUE; // Mark for redraw
@@ -3753,36 +4867,45 @@ static gboolean trw_layer_selected ( VikTrwLayer *l, gint subtype, gpointer subl
 
 GHashTable *vik_trw_layer_get_tracks ( VikTrwLayer *l )
 {
+  trw_ensure_layer_loaded ( l );
+  trw_layer_unpack_tracks ( l );
   return l->tracks;
 }
 
 GHashTable *vik_trw_layer_get_routes ( VikTrwLayer *l )
 {
+  trw_ensure_layer_loaded ( l );
+  trw_layer_unpack_tracks ( l );
   return l->routes;
 }
 
 GHashTable *vik_trw_layer_get_waypoints ( VikTrwLayer *l )
 {
+  trw_ensure_layer_loaded ( l );
   return l->waypoints;
 }
 
 GHashTable *vik_trw_layer_get_tracks_iters ( VikTrwLayer *vtl )
 {
+  trw_layer_realize_items ( vtl );
   return vtl->tracks_iters;
 }
 
 GHashTable *vik_trw_layer_get_routes_iters ( VikTrwLayer *vtl )
 {
+  trw_layer_realize_items ( vtl );
   return vtl->routes_iters;
 }
 
 GHashTable *vik_trw_layer_get_waypoints_iters ( VikTrwLayer *vtl )
 {
+  trw_layer_realize_items ( vtl );
   return vtl->waypoints_iters;
 }
 
 gboolean vik_trw_layer_is_empty ( VikTrwLayer *vtl )
 {
+  trw_ensure_layer_loaded ( vtl );
   return ! ( g_hash_table_size ( vtl->tracks ) ||
              g_hash_table_size ( vtl->routes ) ||
              g_hash_table_size ( vtl->waypoints ) );
@@ -3804,45 +4927,198 @@ gboolean vik_trw_layer_get_waypoints_visibility ( VikTrwLayer *vtl )
 }
 
 /*
- * ATM use a case sensitive find
- * Finds the first one
+ * Name indexes - from each name to the UUIDs of the items with that name (as names need not be unique),
+ *  so that finding items by name does not have to look through them all.
+ * Each is generated on first use and then kept up to date as items are added, renamed and deleted.
+ * Names may still be changed directly (e.g. by the waypoint properties dialog),
+ *  so entries are checked against the item whenever used and any no longer matching are dropped.
  */
-static gboolean trw_layer_waypoint_find ( const gpointer id, const VikWaypoint *wp, const gchar *name )
+static GHashTable **trw_layer_names_slot ( VikTrwLayer *vtl, GHashTable *items )
 {
-  if ( wp && wp->name )
-    if ( ! strcmp ( wp->name, name ) )
-      return TRUE;
-  return FALSE;
+  if ( items == vtl->waypoints )
+    return &vtl->waypoints_names;
+  if ( items == vtl->tracks )
+    return &vtl->tracks_names;
+  return &vtl->routes_names;
 }
 
-/*
- * Get waypoint by name - not guaranteed to be unique
- * Finds the first one
+static const gchar *trw_layer_item_name ( VikTrwLayer *vtl, GHashTable *items, gpointer item )
+{
+  if ( !item )
+    return NULL;
+  return items == vtl->waypoints ? VIK_WAYPOINT(item)->name : VIK_TRACK(item)->name;
+}
+
+static void names_insert ( GHashTable *names, const gchar *name, gpointer uuid )
+{
+  GPtrArray *uuids = g_hash_table_lookup ( names, name );
+  if ( !uuids ) {
+    uuids = g_ptr_array_new ();
+    g_hash_table_insert ( names, g_strdup(name), uuids );
+  }
+  g_ptr_array_add ( uuids, uuid );
+}
+
+/**
+ * Get the name index of the items, generating it if necessary
  */
-VikWaypoint *vik_trw_layer_get_waypoint ( VikTrwLayer *vtl, const gchar *name )
+static GHashTable *trw_layer_names_get ( VikTrwLayer *vtl, GHashTable *items )
+{
+  GHashTable **names = trw_layer_names_slot ( vtl, items );
+  if ( !*names ) {
+    *names = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_ptr_array_unref );
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init ( &iter, items );
+    while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+      const gchar *name = trw_layer_item_name ( vtl, items, value );
+      if ( name )
+        names_insert ( *names, name, key );
+    }
+  }
+  return *names;
+}
+
+static void trw_layer_names_clear ( VikTrwLayer *vtl, GHashTable *items )
 {
-  return g_hash_table_find ( vtl->waypoints, (GHRFunc) trw_layer_waypoint_find, (gpointer) name );
+  GHashTable **names = trw_layer_names_slot ( vtl, items );
+  if ( *names ) {
+    g_hash_table_destroy ( *names );
+    *names = NULL;
+  }
 }
 
-/*
- * ATM use a case sensitive find
- * Finds the first one
+/**
+ * Only updates an index already generated, as otherwise it will include the item when it is
+ */
+static void trw_layer_names_add ( VikTrwLayer *vtl, GHashTable *items, const gchar *name, gpointer uuid )
+{
+  GHashTable *names = *trw_layer_names_slot ( vtl, items );
+  if ( names && name )
+    names_insert ( names, name, uuid );
+}
+
+static void trw_layer_names_remove ( VikTrwLayer *vtl, GHashTable *items, const gchar *name, gpointer uuid )
+{
+  GHashTable *names = *trw_layer_names_slot ( vtl, items );
+  if ( !names || !name )
+    return;
+  GPtrArray *uuids = g_hash_table_lookup ( names, name );
+  // Keep the order, so the first item of a name stays the first
+  if ( uuids && g_ptr_array_remove ( uuids, uuid ) && uuids->len == 0 )
+    g_hash_table_remove ( names, name );
+}
+
+/**
+ * To be called before the item's name is changed, while the old name is still valid
+ */
+static void trw_layer_names_rename ( VikTrwLayer *vtl, GHashTable *items, gpointer uuid, const gchar *old_name, const gchar *new_name )
+{
+  if ( !uuid )
+    return;
+  trw_layer_names_remove ( vtl, items, old_name, uuid );
+  trw_layer_names_add ( vtl, items, new_name, uuid );
+}
+
+/**
+ * Drop any entries no longer referring to an item of the name
+ *
+ * Returns: The number of entries remaining
+ */
+static guint names_validate ( VikTrwLayer *vtl, GHashTable *items, const gchar *name, GPtrArray *uuids )
+{
+  for ( guint nn = 0; nn < uuids->len; ) {
+    if ( g_strcmp0 ( trw_layer_item_name ( vtl, items, g_hash_table_lookup(items, uuids->pdata[nn]) ), name ) == 0 )
+      nn++;
+    else
+      g_ptr_array_remove_index ( uuids, nn );
+  }
+  return uuids->len;
+}
+
+/**
+ * Returns: The UUIDs of the items with the name, or NULL if there are none
+ */
+static GPtrArray *trw_layer_names_lookup ( VikTrwLayer *vtl, GHashTable *items, const gchar *name )
+{
+  if ( !name )
+    return NULL;
+  GHashTable *names = trw_layer_names_get ( vtl, items );
+  GPtrArray *uuids = g_hash_table_lookup ( names, name );
+  if ( uuids && names_validate ( vtl, items, name, uuids ) == 0 ) {
+    g_hash_table_remove ( names, name );
+    uuids = NULL;
+  }
+  return uuids;
+}
+
+/**
+ * Returns: The first item with the name, or NULL if there is none
+ */
+static gpointer trw_layer_names_find ( VikTrwLayer *vtl, GHashTable *items, const gchar *name )
+{
+  GPtrArray *uuids = trw_layer_names_lookup ( vtl, items, name );
+  return uuids ? g_hash_table_lookup ( items, g_ptr_array_index(uuids, 0) ) : NULL;
+}
+
+/**
+ * Returns: The UUID of the item, or NULL if it is not in the layer
+ */
+static gpointer trw_layer_names_find_uuid ( VikTrwLayer *vtl, GHashTable *items, gpointer item )
+{
+  GPtrArray *uuids = trw_layer_names_lookup ( vtl, items, trw_layer_item_name ( vtl, items, item ) );
+  for ( guint nn = 0; uuids && nn < uuids->len; nn++ )
+    if ( g_hash_table_lookup ( items, g_ptr_array_index(uuids, nn) ) == item )
+      return g_ptr_array_index ( uuids, nn );
+
+  // Not indexed under its current name, so it may have been renamed directly
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, items );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    if ( value == item ) {
+      trw_layer_names_add ( vtl, items, trw_layer_item_name ( vtl, items, item ), key );
+      return key;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Whether any items have the same name
  */
-static gboolean trw_layer_track_find ( const gpointer id, const VikTrack *trk, const gchar *name )
+static gboolean trw_layer_names_has_duplicates ( VikTrwLayer *vtl, GHashTable *items )
 {
-  if ( trk && trk->name )
-    if ( ! strcmp ( trk->name, name ) )
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, trw_layer_names_get ( vtl, items ) );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+    if ( ((GPtrArray*)value)->len > 1 && names_validate ( vtl, items, key, value ) > 1 )
       return TRUE;
   return FALSE;
 }
 
+/*
+ * Get waypoint by name - not guaranteed to be unique
+ * Finds the first one
+ */
+VikWaypoint *vik_trw_layer_get_waypoint ( VikTrwLayer *vtl, const gchar *name )
+{
+  trw_ensure_layer_loaded ( vtl );
+  return trw_layer_names_find ( vtl, vtl->waypoints, name );
+}
+
 /*
  * Get track by name - not guaranteed to be unique
  * Finds the first one
  */
 VikTrack *vik_trw_layer_get_track ( VikTrwLayer *vtl, const gchar *name )
 {
-  return g_hash_table_find ( vtl->tracks, (GHRFunc) trw_layer_track_find, (gpointer) name );
+  trw_ensure_layer_loaded ( vtl );
+  VikTrack *trk = trw_layer_names_find ( vtl, vtl->tracks, name );
+  if ( trk )
+    vik_track_unpack ( trk );
+  return trk;
 }
 
 /*
@@ -3851,7 +5127,11 @@ VikTrack *vik_trw_layer_get_track ( VikTrwLayer *vtl, const gchar *name )
  */
 VikTrack *vik_trw_layer_get_route ( VikTrwLayer *vtl, const gchar *name )
 {
-  return g_hash_table_find ( vtl->routes, (GHRFunc) trw_layer_track_find, (gpointer) name );
+  trw_ensure_layer_loaded ( vtl );
+  VikTrack *trk = trw_layer_names_find ( vtl, vtl->routes, name );
+  if ( trk )
+    vik_track_unpack ( trk );
+  return trk;
 }
 
 static void trw_layer_find_maxmin_tracks ( const gpointer id, const VikTrack *trk, struct LatLon maxmin[2] )
@@ -3868,6 +5148,15 @@ static void trw_layer_find_maxmin_tracks ( const gpointer id, const VikTrack *tr
 
 static void trw_layer_find_maxmin (VikTrwLayer *vtl, struct LatLon maxmin[2])
 {
+  // The extent is known without loading the layer
+  if ( vtl->pending_data && vtl->pending_bbox_valid ) {
+    maxmin[0].lat = vtl->pending_bbox.north;
+    maxmin[1].lat = vtl->pending_bbox.south;
+    maxmin[0].lon = vtl->pending_bbox.east;
+    maxmin[1].lon = vtl->pending_bbox.west;
+    return;
+  }
+  trw_ensure_layer_loaded ( vtl );
   // Continually reuse maxmin to find the latest maximum and minimum values
   // First set to waypoints bounds
   maxmin[0].lat = vtl->waypoints_bbox.north;
@@ -4103,6 +5392,7 @@ static void trw_layer_goto_wp ( menu_array_layer values )
       gpointer wpf = g_hash_table_find ( vtl->waypoints, (GHRFunc) trw_layer_waypoint_find_uuid, (gpointer) &udata );
 
       if ( wpf && udata.uuid ) {
+        trw_layer_realize_items ( vtl );
         GtkTreeIter *it = g_hash_table_lookup ( vtl->waypoints_iters, udata.uuid );
         vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, it, TRUE );
       }
@@ -4306,6 +5596,14 @@ static void trw_layer_acquire_file_cb ( menu_array_layer values )
   trw_layer_acquire ( values, &vik_datasource_file_interface );
 }
 
+/*
+ * Acquire into this TRW Layer from FIT files, without needing GPS Babel
+ */
+static void trw_layer_acquire_fit_cb ( menu_array_layer values )
+{
+  trw_layer_acquire ( values, &vik_datasource_fit_interface );
+}
+
 static void trw_layer_gps_upload ( menu_array_layer values )
 {
   menu_array_sublayer data;
@@ -4576,6 +5874,9 @@ static GtkMenu* create_external_submenu ( GtkMenu *menu )
 
 static void trw_layer_add_menu_items ( VikTrwLayer *vtl, GtkMenu *menu, gpointer vlp )
 {
+  trw_ensure_layer_loaded ( vtl );
+  trw_layer_unpack_tracks ( vtl );
+
   static menu_array_layer data;
   data[MA_VTL] = vtl;
   data[MA_VLP] = vlp;
@@ -4588,6 +5889,20 @@ static void trw_layer_add_menu_items ( VikTrwLayer *vtl, GtkMenu *menu, gpointer
     (void)vu_menu_add_item ( menu, NULL, NULL, NULL, NULL ); // Just a separator
   }
 
+  const gchar *undo = trw_layer_journal_description ( vtl, TRUE );
+  gchar *undo_label = undo ? g_strdup_printf ( _("_Undo %s"), undo ) : g_strdup ( _("_Undo") );
+  GtkWidget *item_undo = vu_menu_add_item ( menu, undo_label, GTK_STOCK_UNDO, G_CALLBACK(trw_layer_undo), data );
+  gtk_widget_set_sensitive ( item_undo, undo != NULL );
+  g_free ( undo_label );
+
+  const gchar *redo = trw_layer_journal_description ( vtl, FALSE );
+  gchar *redo_label = redo ? g_strdup_printf ( _("_Redo %s"), redo ) : g_strdup ( _("_Redo") );
+  GtkWidget *item_redo = vu_menu_add_item ( menu, redo_label, GTK_STOCK_REDO, G_CALLBACK(trw_layer_redo), data );
+  gtk_widget_set_sensitive ( item_redo, redo != NULL );
+  g_free ( redo_label );
+
+  (void)vu_menu_add_item ( menu, NULL, NULL, NULL, NULL ); // Just a separator
+
   /* Now with icons */
   (void)vu_menu_add_item ( menu, _("_View Layer"), GTK_STOCK_ZOOM_FIT, G_CALLBACK(trw_layer_auto_view), data );
 
@@ -4620,8 +5935,7 @@ static void trw_layer_add_menu_items ( VikTrwLayer *vtl, GtkMenu *menu, gpointer
   if ( a_babel_available () )
     (void)vu_menu_add_item ( export_submenu, _("Export as _KML..."), NULL, G_CALLBACK(trw_layer_export_kml), data );
 
-  if ( have_geojson_export )
-    (void)vu_menu_add_item ( export_submenu, _("Export as GEO_JSON..."), NULL, G_CALLBACK(trw_layer_export_geojson), data );
+  (void)vu_menu_add_item ( export_submenu, _("Export as GEO_JSON..."), NULL, G_CALLBACK(trw_layer_export_geojson), data );
 
   if ( a_babel_available () )
     (void)vu_menu_add_item ( export_submenu, _("Export via GPSbabel..."), NULL, G_CALLBACK(trw_layer_export_babel), data );
@@ -4690,6 +6004,8 @@ static void trw_layer_add_menu_items ( VikTrwLayer *vtl, GtkMenu *menu, gpointer
   if ( a_babel_available () )
     (void)vu_menu_add_item ( acquire_submenu, _("From _File..."), NULL, G_CALLBACK(trw_layer_acquire_file_cb), data );
 
+  (void)vu_menu_add_item ( acquire_submenu, _("From F_IT Files..."), NULL, G_CALLBACK(trw_layer_acquire_fit_cb), data );
+
   vik_ext_tool_datasources_add_menu_items_to_menu ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl)), GTK_MENU (acquire_submenu) );
 
   GtkMenu *upload_submenu = GTK_MENU(gtk_menu_new());
@@ -4752,7 +6068,7 @@ static void trw_layer_add_menu_items ( VikTrwLayer *vtl, GtkMenu *menu, gpointer
 }
 
 // Fake Waypoint UUIDs vi simple increasing integer
-static guint wp_uuid = 0;
+static gint wp_uuid = 0;
 
 /**
  * vik_trw_layer_add_waypoint:
@@ -4761,7 +6077,8 @@ static guint wp_uuid = 0;
  */
 void vik_trw_layer_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp )
 {
-  wp_uuid++;
+  // Atomic as layers may be filled in from worker threads when loading files
+  guint uuid = (guint)g_atomic_int_add ( &wp_uuid, 1 ) + 1;
 
   if ( name )
     vik_waypoint_set_name (wp, name);
@@ -4772,7 +6089,11 @@ void vik_trw_layer_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp
     if ( g_hash_table_size (vtl->waypoints) == 0 ) {
       trw_layer_add_sublayer_waypoints ( vtl, VIK_LAYER(vtl)->vt, &(VIK_LAYER(vtl)->iter) );
     }
+  }
 
+  // The row gets added along with the others when the layer is opened
+  if ( VIK_LAYER(vtl)->realized && !vtl->items_deferred )
+  {
     GtkTreeIter *iter = g_malloc(sizeof(GtkTreeIter));
 
     gdouble timestamp = 0;
@@ -4780,28 +6101,29 @@ void vik_trw_layer_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp
       timestamp = wp->timestamp;
 
     // Visibility column always needed for waypoints
-    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), iter, wp->name, vtl, GUINT_TO_POINTER(wp_uuid), VIK_TRW_LAYER_SUBLAYER_WAYPOINT, get_wp_sym_small (wp->symbol), TRUE, timestamp, 0 );
+    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), iter, wp->name, vtl, GUINT_TO_POINTER(uuid), VIK_TRW_LAYER_SUBLAYER_WAYPOINT, get_wp_sym_small (wp->symbol), TRUE, timestamp, 0 );
 
     // Actual setting of visibility dependent on the waypoint
     vik_treeview_item_set_visible ( VIK_LAYER(vtl)->vt, iter, wp->visible );
 
-    g_hash_table_insert ( vtl->waypoints_iters, GUINT_TO_POINTER(wp_uuid), iter );
+    g_hash_table_insert ( vtl->waypoints_iters, GUINT_TO_POINTER(uuid), iter );
 
     // Sort now as post_read is not called on a realized waypoint
     vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), vtl->wp_sort_order );
   }
 
   highest_wp_number_add_wp(vtl, wp->name);
-  g_hash_table_insert ( vtl->waypoints, GUINT_TO_POINTER(wp_uuid), wp );
+  g_hash_table_insert ( vtl->waypoints, GUINT_TO_POINTER(uuid), wp );
+  trw_layer_names_add ( vtl, vtl->waypoints, wp->name, GUINT_TO_POINTER(uuid) );
  
 }
 
 // Fake Track UUIDs vi simple increasing integer
-static guint tr_uuid = 0;
+static gint tr_uuid = 0;
 
 void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
 {
-  tr_uuid++;
+  guint uuid = (guint)g_atomic_int_add ( &tr_uuid, 1 ) + 1;
 
   if ( name )
     vik_track_set_name ( t, name );
@@ -4812,7 +6134,11 @@ void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
     if ( g_hash_table_size (vtl->tracks) == 0 ) {
       trw_layer_add_sublayer_tracks ( vtl, VIK_LAYER(vtl)->vt, &(VIK_LAYER(vtl)->iter) );
     }
+  }
 
+  // The row gets added along with the others when the layer is opened
+  if ( VIK_LAYER(vtl)->realized && !vtl->items_deferred )
+  {
     GtkTreeIter *iter = g_malloc(sizeof(GtkTreeIter));
 
     gdouble timestamp = 0;
@@ -4821,28 +6147,30 @@ void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
       timestamp = tpt->timestamp;
 
     // Visibility column always needed for tracks
-    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), iter, t->name, vtl, GUINT_TO_POINTER(tr_uuid), VIK_TRW_LAYER_SUBLAYER_TRACK, NULL, TRUE, timestamp, t->number );
+    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), iter, t->name, vtl, GUINT_TO_POINTER(uuid), VIK_TRW_LAYER_SUBLAYER_TRACK, NULL, TRUE, timestamp, t->number );
 
     // Actual setting of visibility dependent on the track
     vik_treeview_item_set_visible ( VIK_LAYER(vtl)->vt, iter, t->visible );
 
-    g_hash_table_insert ( vtl->tracks_iters, GUINT_TO_POINTER(tr_uuid), iter );
+    g_hash_table_insert ( vtl->tracks_iters, GUINT_TO_POINTER(uuid), iter );
+
+    trw_layer_update_treeview_iter ( vtl, t, iter, FALSE );
 
     // Sort now as post_read is not called on a realized track
     vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), vtl->track_sort_order );
   }
 
-  g_hash_table_insert ( vtl->tracks, GUINT_TO_POINTER(tr_uuid), t );
-
-  trw_layer_update_treeview ( vtl, t, FALSE );
+  g_hash_table_insert ( vtl->tracks, GUINT_TO_POINTER(uuid), t );
+  trw_layer_names_add ( vtl, vtl->tracks, t->name, GUINT_TO_POINTER(uuid) );
+  trw_layer_tracks_time_index_invalidate ( vtl );
 }
 
 // Fake Route UUIDs vi simple increasing integer
-static guint rt_uuid = 0;
+static gint rt_uuid = 0;
 
 void vik_trw_layer_add_route ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
 {
-  rt_uuid++;
+  guint uuid = (guint)g_atomic_int_add ( &rt_uuid, 1 ) + 1;
 
   if ( name )
     vik_track_set_name ( t, name );
@@ -4853,28 +6181,76 @@ void vik_trw_layer_add_route ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
     if ( g_hash_table_size (vtl->routes) == 0 ) {
       trw_layer_add_sublayer_routes ( vtl, VIK_LAYER(vtl)->vt, &(VIK_LAYER(vtl)->iter) );
     }
+  }
 
+  // The row gets added along with the others when the layer is opened
+  if ( VIK_LAYER(vtl)->realized && !vtl->items_deferred )
+  {
     GtkTreeIter *iter = g_malloc(sizeof(GtkTreeIter));
     // Visibility column always needed for routes
-    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter), iter, t->name, vtl, GUINT_TO_POINTER(rt_uuid), VIK_TRW_LAYER_SUBLAYER_ROUTE, NULL, TRUE, 0, t->number ); // Routes don't have times
+    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter), iter, t->name, vtl, GUINT_TO_POINTER(uuid), VIK_TRW_LAYER_SUBLAYER_ROUTE, NULL, TRUE, 0, t->number ); // Routes don't have times
     // Actual setting of visibility dependent on the route
     vik_treeview_item_set_visible ( VIK_LAYER(vtl)->vt, iter, t->visible );
 
-    g_hash_table_insert ( vtl->routes_iters, GUINT_TO_POINTER(rt_uuid), iter );
+    g_hash_table_insert ( vtl->routes_iters, GUINT_TO_POINTER(uuid), iter );
+
+    trw_layer_update_treeview_iter ( vtl, t, iter, FALSE );
 
     // Sort now as post_read is not called on a realized route
     vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter), vtl->track_sort_order );
   }
 
-  g_hash_table_insert ( vtl->routes, GUINT_TO_POINTER(rt_uuid), t );
+  g_hash_table_insert ( vtl->routes, GUINT_TO_POINTER(uuid), t );
+  trw_layer_names_add ( vtl, vtl->routes, t->name, GUINT_TO_POINTER(uuid) );
+}
+
+/**
+ * vik_trw_layer_new_view:
+ *
+ * Returns: A new layer with the same settings, holding references to the same tracks, routes and waypoints
+ *  rather than copies of them, e.g. for another window showing the same project.
+ *  Changes to the items made via either layer are seen in both,
+ *  but adding or removing items only affects that layer.
+ *  The scaled waypoint images are shared too, until the image settings of either layer change.
+ */
+VikTrwLayer *vik_trw_layer_new_view ( VikTrwLayer *vtl, VikViewport *vvp )
+{
+  VikTrwLayer *rv = VIK_TRW_LAYER ( vik_layer_create ( VIK_LAYER_TRW, vvp, FALSE ) );
+  guint8 *data = NULL;
+  guint len = 0;
+  vik_layer_marshall_params ( VIK_LAYER(vtl), &data, &len );
+  vik_layer_unmarshall_params ( VIK_LAYER(rv), data, len, vvp );
+  g_free ( data );
+
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init ( &iter, vtl->waypoints );
+  while ( g_hash_table_iter_next ( &iter, NULL, &value ) ) {
+    vik_waypoint_ref ( VIK_WAYPOINT(value) );
+    vik_trw_layer_add_waypoint ( rv, NULL, VIK_WAYPOINT(value) );
+  }
+  g_hash_table_iter_init ( &iter, vtl->tracks );
+  while ( g_hash_table_iter_next ( &iter, NULL, &value ) ) {
+    vik_track_ref ( VIK_TRACK(value) );
+    vik_trw_layer_add_track ( rv, NULL, VIK_TRACK(value) );
+  }
+  g_hash_table_iter_init ( &iter, vtl->routes );
+  while ( g_hash_table_iter_next ( &iter, NULL, &value ) ) {
+    vik_track_ref ( VIK_TRACK(value) );
+    vik_trw_layer_add_route ( rv, NULL, VIK_TRACK(value) );
+  }
+  trw_layer_calculate_bounds_waypoints ( rv );
+
+  g_hash_table_unref ( rv->image_cache );
+  rv->image_cache = g_hash_table_ref ( vtl->image_cache );
 
-  trw_layer_update_treeview ( vtl, t, FALSE );
+  return rv;
 }
 
 /* to be called whenever a track has been deleted or may have been changed. */
 void trw_layer_cancel_tps_of_track ( VikTrwLayer *vtl, VikTrack *trk )
 {
-  if (vtl->current_tp_track == trk )
+  if (vtl->current_tp.trk == trk )
     trw_layer_cancel_current_tp ( vtl, FALSE );
 }
 
@@ -4956,52 +6332,38 @@ void vik_trw_layer_filein_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypo
 
 void vik_trw_layer_filein_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *tr )
 {
-  if ( vtl->route_finder_append && vtl->current_track ) {
-    vik_track_remove_dup_points ( tr ); /* make "double point" track work to undo */
-
-    // enforce end of current track equal to start of tr
-    VikTrackpoint *cur_end = vik_track_get_tp_last ( vtl->current_track );
-    VikTrackpoint *new_start = vik_track_get_tp_first ( tr );
-    if ( cur_end && new_start ) {
-      if ( ! vik_coord_equals ( &cur_end->coord, &new_start->coord ) ) {
-          vik_track_add_trackpoint ( vtl->current_track,
-                                     vik_trackpoint_copy ( cur_end ),
-                                     FALSE );
-      }
-    }
-
-    vik_track_steal_and_append_trackpoints ( vtl->current_track, tr );
-    vik_track_free ( tr );
-    vtl->route_finder_append = FALSE; /* this means we have added it */
-  } else {
-
-    // No more uniqueness of name forced when loading from a file
-    if ( tr->is_route )
-      vik_trw_layer_add_route ( vtl, name, tr );
-    else
-      vik_trw_layer_add_track ( vtl, name, tr );
+  // No more uniqueness of name forced when loading from a file
+  if ( tr->is_route )
+    vik_trw_layer_add_route ( vtl, name, tr );
+  else
+    vik_trw_layer_add_track ( vtl, name, tr );
 
-    if ( vtl->route_finder_check_added_track ) {
-      vik_track_remove_dup_points ( tr ); /* make "double point" track work to undo */
-      vtl->route_finder_added_track = tr;
-    }
+  if ( vtl->route_finder_check_added_track ) {
+    vik_track_remove_dup_points ( tr ); /* make "double point" track work to undo */
+    vtl->route_finder_added_track = tr;
   }
 }
 
+static void trw_layer_tidy_track_task ( VikTrack *trk, guint *speed )
+{
+  if ( vik_track_remove_dodgy_first_point ( trk, *speed, FALSE ) )
+    g_message ( "%s: Removed dodgy first point from track: %s", __FUNCTION__, trk->name );
+}
+
 /**
  * ATM Only for removing bad first points
+ * Each track is independent, so they are tidied in parallel
  */
 void vik_trw_layer_tidy_tracks ( VikTrwLayer *vtl, guint speed, gboolean recalc_bounds )
 {
   GHashTableIter iter;
   gpointer key, value;
 
+  VikTaskGroup *group = a_background_tasks_new ();
   g_hash_table_iter_init ( &iter, vtl->tracks );
-  while ( g_hash_table_iter_next (&iter, &key, &value) ) {
-    VikTrack *trk = VIK_TRACK(value);
-    if ( vik_track_remove_dodgy_first_point ( trk, speed, FALSE ) )
-      g_message ( "%s: Removed dodgy first point from track: %s", __FUNCTION__, trk->name );
-  }
+  while ( g_hash_table_iter_next (&iter, &key, &value) )
+    a_background_tasks_add ( group, (GFunc)trw_layer_tidy_track_task, value, &speed );
+  a_background_tasks_free ( group );
 }
 
 static void trw_layer_enum_item ( gpointer id, GList **tr, GList **l )
@@ -5070,6 +6432,8 @@ static void trw_layer_drag_drop_request ( VikTrwLayer *vtl_src, VikTrwLayer *vtl
   VikTreeview *vt = VIK_LAYER(vtl_src)->vt;
   gint type = vik_treeview_item_get_data(vt, src_item_iter);
 
+  trw_layer_unpack_tracks ( vtl_src );
+
   if (!vik_treeview_item_get_pointer(vt, src_item_iter)) {
     GList *items = NULL;
     GList *iter;
@@ -5120,7 +6484,7 @@ gboolean vik_trw_layer_delete_track ( VikTrwLayer *vtl, VikTrack *trk )
 
     if ( trk == vtl->current_track ) {
       vtl->current_track = NULL;
-      vtl->current_tp_track = NULL;
+      vik_track_cursor_clear ( &vtl->current_tp );
       vtl->moving_tp = FALSE;
     }
 
@@ -5129,23 +6493,23 @@ gboolean vik_trw_layer_delete_track ( VikTrwLayer *vtl, VikTrack *trk )
     if ( trk == vtl->route_finder_added_track )
       vtl->route_finder_added_track = NULL;
 
-    trku_udata udata;
-    udata.trk  = trk;
-    udata.uuid = NULL;
+    // Items are only removed along with their row
+    trw_layer_realize_items ( vtl );
 
-    // Hmmm, want key of it
-    gpointer trkf = g_hash_table_find ( vtl->tracks, (GHRFunc) trw_layer_track_find_uuid, &udata );
+    gpointer uuid = trw_layer_names_find_uuid ( vtl, vtl->tracks, trk );
 
-    if ( trkf && udata.uuid ) {
+    if ( uuid ) {
       /* could be current_tp, so we have to check */
       trw_layer_cancel_tps_of_track ( vtl, trk );
 
-      GtkTreeIter *it = g_hash_table_lookup ( vtl->tracks_iters, udata.uuid );
+      GtkTreeIter *it = g_hash_table_lookup ( vtl->tracks_iters, uuid );
 
       if ( it ) {
         vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, it );
-        g_hash_table_remove ( vtl->tracks_iters, udata.uuid );
-        g_hash_table_remove ( vtl->tracks, udata.uuid );
+        g_hash_table_remove ( vtl->tracks_iters, uuid );
+        trw_layer_names_remove ( vtl, vtl->tracks, trk->name, uuid );
+        g_hash_table_remove ( vtl->tracks, uuid );
+        trw_layer_tracks_time_index_invalidate ( vtl );
 
 	// If last sublayer, then remove sublayer container
 	if ( g_hash_table_size (vtl->tracks) == 0 ) {
@@ -5167,7 +6531,7 @@ gboolean vik_trw_layer_delete_route ( VikTrwLayer *vtl, VikTrack *trk )
 
     if ( trk == vtl->current_track ) {
       vtl->current_track = NULL;
-      vtl->current_tp_track = NULL;
+      vik_track_cursor_clear ( &vtl->current_tp );
       vtl->moving_tp = FALSE;
     }
 
@@ -5176,23 +6540,22 @@ gboolean vik_trw_layer_delete_route ( VikTrwLayer *vtl, VikTrack *trk )
     if ( trk == vtl->route_finder_added_track )
       vtl->route_finder_added_track = NULL;
 
-    trku_udata udata;
-    udata.trk  = trk;
-    udata.uuid = NULL;
+    // Items are only removed along with their row
+    trw_layer_realize_items ( vtl );
 
-    // Hmmm, want key of it
-    gpointer trkf = g_hash_table_find ( vtl->routes, (GHRFunc) trw_layer_track_find_uuid, &udata );
+    gpointer uuid = trw_layer_names_find_uuid ( vtl, vtl->routes, trk );
 
-    if ( trkf && udata.uuid ) {
+    if ( uuid ) {
       /* could be current_tp, so we have to check */
       trw_layer_cancel_tps_of_track ( vtl, trk );
 
-      GtkTreeIter *it = g_hash_table_lookup ( vtl->routes_iters, udata.uuid );
+      GtkTreeIter *it = g_hash_table_lookup ( vtl->routes_iters, uuid );
 
       if ( it ) {
         vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, it );
-        g_hash_table_remove ( vtl->routes_iters, udata.uuid );
-        g_hash_table_remove ( vtl->routes, udata.uuid );
+        g_hash_table_remove ( vtl->routes_iters, uuid );
+        trw_layer_names_remove ( vtl, vtl->routes, trk->name, uuid );
+        g_hash_table_remove ( vtl->routes, uuid );
 
         // If last sublayer, then remove sublayer container
         if ( g_hash_table_size (vtl->routes) == 0 ) {
@@ -5217,6 +6580,7 @@ static void delete_waypoint_low_level ( VikTrwLayer *vtl, VikWaypoint *wp, gpoin
   g_hash_table_remove ( vtl->waypoints_iters, uuid );
 
   highest_wp_number_remove_wp ( vtl, wp->name );
+  trw_layer_names_remove ( vtl, vtl->waypoints, wp->name, uuid );
   g_hash_table_remove ( vtl->waypoints, uuid ); // last because this frees the name
 }
 
@@ -5226,20 +6590,18 @@ static gboolean trw_layer_delete_waypoint ( VikTrwLayer *vtl, VikWaypoint *wp )
 
   if ( wp && wp->name ) {
 
+    // Items are only removed along with their row
+    trw_layer_realize_items ( vtl );
+
     was_visible = wp->visible;
-    
-    wpu_udata udata;
-    udata.wp   = wp;
-    udata.uuid = NULL;
 
-    // Hmmm, want key of it
-    gpointer wpf = g_hash_table_find ( vtl->waypoints, (GHRFunc) trw_layer_waypoint_find_uuid, (gpointer) &udata );
+    gpointer uuid = trw_layer_names_find_uuid ( vtl, vtl->waypoints, wp );
 
-    if ( wpf && udata.uuid ) {
-      GtkTreeIter *it = g_hash_table_lookup ( vtl->waypoints_iters, udata.uuid );
+    if ( uuid ) {
+      GtkTreeIter *it = g_hash_table_lookup ( vtl->waypoints_iters, uuid );
     
       if ( it ) {
-        delete_waypoint_low_level ( vtl, wp, udata.uuid, it );
+        delete_waypoint_low_level ( vtl, wp, uuid, it );
 
         if ( wp == vtl->current_wp ) {
           vtl->current_wp = NULL;
@@ -5261,17 +6623,6 @@ static gboolean trw_layer_delete_waypoint ( VikTrwLayer *vtl, VikWaypoint *wp )
   return was_visible;
 }
 
-// Only for temporary use by trw_layer_delete_waypoint_by_name
-static gboolean trw_layer_waypoint_find_uuid_by_name ( const gpointer id, const VikWaypoint *wp, gpointer udata )
-{
-  wpu_udata *user_data = udata;
-  if ( ! strcmp ( wp->name, user_data->wp->name ) ) {
-    user_data->uuid = id;
-    return TRUE;
-  }
-  return FALSE;
-}
-
 /*
  * Delete a waypoint by the given name
  * NOTE: ATM this will delete the first encountered Waypoint with the specified name
@@ -5279,40 +6630,13 @@ static gboolean trw_layer_waypoint_find_uuid_by_name ( const gpointer id, const
  */
 static gboolean trw_layer_delete_waypoint_by_name ( VikTrwLayer *vtl, const gchar *name )
 {
-  wpu_udata udata;
-  // Fake a waypoint with the given name
-  udata.wp   = vik_waypoint_new ();
-  vik_waypoint_set_name (udata.wp, name);
-  // Currently only the name is used in this waypoint find function
-  udata.uuid = NULL;
-
-  // Hmmm, want key of it
-  gpointer wpf = g_hash_table_find ( vtl->waypoints, (GHRFunc) trw_layer_waypoint_find_uuid_by_name, (gpointer) &udata );
-
-  vik_waypoint_free (udata.wp);
-
-  if ( wpf && udata.uuid )
-    return trw_layer_delete_waypoint (vtl, g_hash_table_lookup ( vtl->waypoints, udata.uuid ));
+  VikWaypoint *wp = trw_layer_names_find ( vtl, vtl->waypoints, name );
+  if ( wp )
+    return trw_layer_delete_waypoint ( vtl, wp );
   else
     return FALSE;
 }
 
-typedef struct {
-  VikTrack *trk; // input
-  gpointer uuid; // output
-} tpu_udata;
-
-// Only for temporary use by trw_layer_delete_track_by_name
-static gboolean trw_layer_track_find_uuid_by_name ( const gpointer id, const VikTrack *trk, gpointer udata )
-{
-  tpu_udata *user_data = udata;
-  if ( ! strcmp ( trk->name, user_data->trk->name ) ) {
-    user_data->uuid = id;
-    return TRUE;
-  }
-  return FALSE;
-}
-
 /*
  * Delete a track by the given name
  * NOTE: ATM this will delete the first encountered Track with the specified name
@@ -5320,28 +6644,14 @@ static gboolean trw_layer_track_find_uuid_by_name ( const gpointer id, const Vik
  */
 static gboolean trw_layer_delete_track_by_name ( VikTrwLayer *vtl, const gchar *name, GHashTable *ht_tracks )
 {
-  tpu_udata udata;
-  // Fake a track with the given name
-  udata.trk   = vik_track_new ();
-  vik_track_set_name (udata.trk, name);
-  // Currently only the name is used in this track find function
-  udata.uuid = NULL;
-
-  // Hmmm, want key of it
-  gpointer trkf = g_hash_table_find ( ht_tracks, (GHRFunc) trw_layer_track_find_uuid_by_name, &udata );
-
-  vik_track_free (udata.trk);
-
-  if ( trkf && udata.uuid ) {
-    // This could be a little better written...
-    if ( vtl->tracks == ht_tracks )
-      return vik_trw_layer_delete_track (vtl, g_hash_table_lookup ( ht_tracks, udata.uuid ));
-    if ( vtl->routes == ht_tracks )
-      return vik_trw_layer_delete_route (vtl, g_hash_table_lookup ( ht_tracks, udata.uuid ));
+  if ( ht_tracks != vtl->tracks && ht_tracks != vtl->routes )
     return FALSE;
-  }
-  else
+  VikTrack *trk = trw_layer_names_find ( vtl, ht_tracks, name );
+  if ( !trk )
     return FALSE;
+  if ( ht_tracks == vtl->routes )
+    return vik_trw_layer_delete_route ( vtl, trk );
+  return vik_trw_layer_delete_track ( vtl, trk );
 }
 
 static void remove_item_from_treeview ( const gpointer id, GtkTreeIter *it, VikTreeview * vt )
@@ -5353,7 +6663,7 @@ void vik_trw_layer_delete_all_routes ( VikTrwLayer *vtl )
 {
   vtl->current_track = NULL;
   vtl->route_finder_added_track = NULL;
-  if (vtl->current_tp_track)
+  if (vtl->current_tp.trk)
     trw_layer_cancel_current_tp(vtl, FALSE);
 
   g_hash_table_foreach(vtl->routes_iters, (GHFunc) remove_item_from_treeview, VIK_LAYER(vtl)->vt);
@@ -5362,6 +6672,7 @@ void vik_trw_layer_delete_all_routes ( VikTrwLayer *vtl )
   if ( g_hash_table_size (vtl->routes) > 0 )
     vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter) );
   g_hash_table_remove_all(vtl->routes);
+  trw_layer_names_clear ( vtl, vtl->routes );
 
   close_graphs_of_specific_track_or_type ( vtl, NULL, VIK_TRW_LAYER_SUBLAYER_ROUTES );
   vik_layer_emit_update ( VIK_LAYER(vtl) );
@@ -5371,7 +6682,7 @@ void vik_trw_layer_delete_all_tracks ( VikTrwLayer *vtl )
 {
   vtl->current_track = NULL;
   vtl->route_finder_added_track = NULL;
-  if (vtl->current_tp_track)
+  if (vtl->current_tp.trk)
     trw_layer_cancel_current_tp(vtl, FALSE);
 
   g_hash_table_foreach(vtl->tracks_iters, (GHFunc) remove_item_from_treeview, VIK_LAYER(vtl)->vt);
@@ -5380,6 +6691,8 @@ void vik_trw_layer_delete_all_tracks ( VikTrwLayer *vtl )
   if ( g_hash_table_size (vtl->tracks) > 0 )
     vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter) );
   g_hash_table_remove_all(vtl->tracks);
+  trw_layer_names_clear ( vtl, vtl->tracks );
+  trw_layer_tracks_time_index_invalidate ( vtl );
 
   close_graphs_of_specific_track_or_type ( vtl, NULL, VIK_TRW_LAYER_SUBLAYER_TRACKS );
   vik_layer_emit_update ( VIK_LAYER(vtl) );
@@ -5405,6 +6718,7 @@ void vik_trw_layer_delete_all_waypoints ( VikTrwLayer *vtl )
   if ( g_hash_table_size (vtl->waypoints) > 0 )
     vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter) );
   g_hash_table_remove_all(vtl->waypoints);
+  trw_layer_names_clear ( vtl, vtl->waypoints );
 
   vik_layer_emit_update ( VIK_LAYER(vtl) );
 }
@@ -5442,21 +6756,816 @@ static void trw_layer_delete_all_waypoints ( menu_array_layer values )
     vik_trw_layer_delete_all_waypoints (vtl);
 }
 
-static void trw_layer_delete_item ( menu_array_sublayer values )
+/*** Edit journal ***/
+
+// Each edit is recorded as the change made, rather than as a copy of the data,
+//  so undoing and redoing takes time in proportion to the change, not the size of the track.
+// Applying a delta makes the change in the other direction, and updates the delta so that
+//  applying it again reverses that; thus the same code does both undo and redo.
+
+#define VIK_SETTINGS_TRW_UNDO_LEVELS "trw_undo_levels"
+#define TRW_UNDO_LEVELS_DEFAULT 100
+
+typedef enum {
+  JOURNAL_TP_COORD, // A trackpoint moved
+  JOURNAL_TP_RANGE, // A run of trackpoints replaced by another (either may be empty)
+  JOURNAL_SPLIT,    // A track split into two at a trackpoint
+  JOURNAL_TRACK,    // A track or route added or deleted
+  JOURNAL_WP_COORD, // A waypoint moved
+  JOURNAL_NAME,     // A track, route or waypoint renamed
+} JournalDeltaType;
+
+typedef struct {
+  JournalDeltaType type;
+  VikTrack *trk;      // Referenced for as long as the delta exists
+  VikTrack *trk_new;  // The other part of a split, also referenced
+  VikTrackpoint *tp;  // For JOURNAL_TP_COORD, or the first one to take out for JOURNAL_TP_RANGE
+  VikWaypoint *wp;    // Waypoints are not referenced, so always verified via their uuid
+  gpointer wp_uuid;
+  VikCoord coord;     // The other position
+  guint index;        // Position in the list of trackpoints
+  GList *points;      // Owned trackpoints that are put in at the index
+  guint n_points;     // Then number of trackpoints at the index to take out
+  gboolean present;   // For JOURNAL_TRACK and JOURNAL_SPLIT: whether currently in the layer
+  gchar *name;        // The other name
+} JournalDelta;
+
+typedef struct {
+  gchar *description;
+  GList *deltas; // In the order they were made
+} JournalEdit;
+
+static void journal_delta_free ( JournalDelta *delta )
 {
-  VikTrwLayer *vtl = VIK_TRW_LAYER(values[MA_VTL]);
-  gboolean was_visible = FALSE;
-  if ( GPOINTER_TO_INT (values[MA_SUBTYPE]) == VIK_TRW_LAYER_SUBLAYER_WAYPOINT )
-  {
-    VikWaypoint *wp = g_hash_table_lookup ( vtl->waypoints, values[MA_SUBLAYER_ID] );
-    if ( wp && wp->name ) {
-      if ( GPOINTER_TO_INT (values[MA_CONFIRM]) )
-        // Get confirmation from the user
-        // Maybe this Waypoint Delete should be optional as is it could get annoying...
-        if ( ! a_dialog_yes_or_no ( VIK_GTK_WINDOW_FROM_LAYER(vtl),
-            _("Are you sure you want to delete the waypoint \"%s\"?"),
-            wp->name ) )
-          return;
+  if ( delta->trk )
+    vik_track_free ( delta->trk );
+  if ( delta->trk_new )
+    vik_track_free ( delta->trk_new );
+  g_list_free_full ( delta->points, (GDestroyNotify)vik_trackpoint_free );
+  g_free ( delta->name );
+  g_free ( delta );
+}
+
+static void journal_edit_free ( JournalEdit *edit )
+{
+  g_list_free_full ( edit->deltas, (GDestroyNotify)journal_delta_free );
+  g_free ( edit->description );
+  g_free ( edit );
+}
+
+/*
+ * Each journalled edit is also recorded for autosave (see autosave.c),
+ *  in a form that can be replayed onto a saved copy of the layer:
+ *  items are identified by name (so only when the name is unique) and trackpoints by their position.
+ * Records about a track give its number of trackpoints afterwards,
+ *  so replaying can tell when the track no longer matches.
+ */
+typedef enum {
+  RECORD_TP_COORD,     // (bsuu(dd)) is_route, track name, index, length, new latitude and longitude
+  RECORD_TP_RANGE,     // (bsuuuay)  is_route, track name, index, number removed, length, the inserted points (as a marshalled track)
+  RECORD_SPLIT,        // (bsuus)    is_route, track name, index of the split, length, name of the new track
+  RECORD_JOIN,         // (bssu)     is_route, track name, name of the track joined on, length
+  RECORD_TRACK_DELETE, // (bs)       is_route, track name
+  RECORD_TRACK_ADD,    // (ay)       the marshalled track
+  RECORD_WP_COORD,     // (s(dd))    waypoint name, new latitude and longitude
+  RECORD_NAME,         // (yss)      the sublayer type, old name, new name
+} RecordType;
+
+/**
+ * Whether the name of a track identifies it, given the number of items expected to have the name
+ */
+static gboolean record_name_unique ( VikTrwLayer *vtl, GHashTable *items, const gchar *name, guint expected )
+{
+  GPtrArray *uuids = trw_layer_names_lookup ( vtl, items, name );
+  return name && ( uuids ? uuids->len : 0 ) == expected;
+}
+
+static GVariant *record_track_points ( VikTrack *trk, GList *first, guint count )
+{
+  // Only the points are of interest, so a temporary track borrows them
+  VikTrack *tmp = vik_track_new ();
+  GList *iter = first;
+  for ( guint nn = 0; nn < count && iter; nn++, iter = iter->next )
+    tmp->trackpoints = g_list_prepend ( tmp->trackpoints, iter->data );
+  tmp->trackpoints = g_list_reverse ( tmp->trackpoints );
+  guint8 *data;
+  guint len;
+  vik_track_marshall ( tmp, &data, &len );
+  g_list_free ( tmp->trackpoints );
+  tmp->trackpoints = NULL;
+  vik_track_free ( tmp );
+  return g_variant_new_from_data ( G_VARIANT_TYPE_BYTESTRING, data, len, TRUE, g_free, data );
+}
+
+/**
+ * Record the change just made, of which the delta holds the reverse
+ */
+static void journal_delta_record ( VikTrwLayer *vtl, JournalDelta *delta )
+{
+  if ( !a_autosave_wanted ( VIK_LAYER(vtl) ) )
+    return;
+
+  VikTrack *trk = delta->trk;
+  GHashTable *items = trk ? (trk->is_route ? vtl->routes : vtl->tracks) : vtl->waypoints;
+  GVariant *payload = NULL;
+  guint type = 0;
+
+  switch ( delta->type ) {
+  case JOURNAL_TP_COORD: {
+    gint index = g_list_index ( trk->trackpoints, delta->tp );
+    if ( index < 0 || !record_name_unique ( vtl, items, trk->name, 1 ) )
+      break;
+    struct LatLon ll;
+    vik_coord_to_latlon ( &delta->tp->coord, &ll );
+    type = RECORD_TP_COORD;
+    payload = g_variant_new ( "(bsuu(dd))", trk->is_route, trk->name, (guint32)index,
+                              g_list_length(trk->trackpoints), ll.lat, ll.lon );
+    break;
+  }
+  case JOURNAL_TP_RANGE: {
+    GList *first = g_list_nth ( trk->trackpoints, delta->index );
+    if ( (delta->n_points && (!first || first->data != delta->tp)) || !record_name_unique ( vtl, items, trk->name, 1 ) )
+      break;
+    type = RECORD_TP_RANGE;
+    payload = g_variant_new ( "(bsuuu@ay)", trk->is_route, trk->name, delta->index, g_list_length(delta->points),
+                              g_list_length(trk->trackpoints), record_track_points ( trk, first, delta->n_points ) );
+    break;
+  }
+  case JOURNAL_SPLIT:
+    if ( !record_name_unique ( vtl, items, trk->name, 1 ) )
+      break;
+    if ( delta->present ) {
+      if ( !record_name_unique ( vtl, items, delta->trk_new->name, 1 ) )
+        break;
+      type = RECORD_SPLIT;
+      payload = g_variant_new ( "(bsuus)", trk->is_route, trk->name, delta->index,
+                                g_list_length(trk->trackpoints), delta->trk_new->name );
+    }
+    else {
+      // The other track has been deleted, so its name should not be found anymore
+      if ( !record_name_unique ( vtl, items, delta->trk_new->name, 0 ) )
+        break;
+      type = RECORD_JOIN;
+      payload = g_variant_new ( "(bssu)", trk->is_route, trk->name, delta->trk_new->name, g_list_length(trk->trackpoints) );
+    }
+    break;
+  case JOURNAL_TRACK:
+    if ( delta->present ) {
+      guint8 *data;
+      guint len;
+      vik_track_marshall ( trk, &data, &len );
+      type = RECORD_TRACK_ADD;
+      payload = g_variant_new ( "(@ay)", g_variant_new_from_data ( G_VARIANT_TYPE_BYTESTRING, data, len, TRUE, g_free, data ) );
+    }
+    else if ( record_name_unique ( vtl, items, trk->name, 0 ) ) {
+      type = RECORD_TRACK_DELETE;
+      payload = g_variant_new ( "(bs)", trk->is_route, trk->name );
+    }
+    break;
+  case JOURNAL_WP_COORD:
+    if ( g_hash_table_lookup(vtl->waypoints, delta->wp_uuid) == delta->wp &&
+         record_name_unique ( vtl, items, delta->wp->name, 1 ) ) {
+      struct LatLon ll;
+      vik_coord_to_latlon ( &delta->wp->coord, &ll );
+      type = RECORD_WP_COORD;
+      payload = g_variant_new ( "(s(dd))", delta->wp->name, ll.lat, ll.lon );
+    }
+    break;
+  case JOURNAL_NAME: {
+    const gchar *name = trk ? trk->name : NULL;
+    if ( !trk && g_hash_table_lookup(vtl->waypoints, delta->wp_uuid) == delta->wp )
+      name = delta->wp->name;
+    // No longer any other item with the old name
+    if ( !name || !record_name_unique ( vtl, items, delta->name, 0 ) )
+      break;
+    type = RECORD_NAME;
+    payload = g_variant_new ( "(yss)", trk ? (trk->is_route ? VIK_TRW_LAYER_SUBLAYER_ROUTE : VIK_TRW_LAYER_SUBLAYER_TRACK) : VIK_TRW_LAYER_SUBLAYER_WAYPOINT,
+                              delta->name, name );
+    break;
+  }
+  default: break;
+  }
+
+  if ( payload )
+    a_autosave_record ( VIK_LAYER(vtl), g_variant_new ( "(yv)", (guchar)type, payload ) );
+  else
+    a_autosave_suspend ( VIK_LAYER(vtl) );
+}
+
+static void trw_layer_journal_record ( VikTrwLayer *vtl )
+{
+  for ( GList *iter = vtl->journal_unrecorded; iter; iter = iter->next )
+    journal_delta_record ( vtl, iter->data );
+  g_list_free ( vtl->journal_unrecorded );
+  vtl->journal_unrecorded = NULL;
+  if ( vtl->journal_record_id ) {
+    (void)g_source_remove ( vtl->journal_record_id );
+    vtl->journal_record_id = 0;
+  }
+}
+
+static gboolean trw_layer_journal_record_idle ( VikTrwLayer *vtl )
+{
+  vtl->journal_record_id = 0;
+  trw_layer_journal_record ( vtl );
+  return FALSE;
+}
+
+static void trw_layer_journal_clear ( VikTrwLayer *vtl )
+{
+  trw_layer_journal_record ( vtl );
+  JournalEdit *edit;
+  while ( (edit = g_queue_pop_head(&vtl->journal_undo)) )
+    journal_edit_free ( edit );
+  while ( (edit = g_queue_pop_head(&vtl->journal_redo)) )
+    journal_edit_free ( edit );
+}
+
+static guint trw_layer_journal_levels ( void )
+{
+  gint levels = TRW_UNDO_LEVELS_DEFAULT;
+  (void)a_settings_get_integer ( VIK_SETTINGS_TRW_UNDO_LEVELS, &levels );
+  return MAX ( 0, levels );
+}
+
+/**
+ * Record an edit consisting of the single delta, which becomes owned by the journal
+ */
+static void trw_layer_journal_add ( VikTrwLayer *vtl, const gchar *description, JournalDelta *delta )
+{
+  // The previous edit has certainly been made by now
+  trw_layer_journal_record ( vtl );
+  guint levels = trw_layer_journal_levels ();
+  if ( !levels ) {
+    journal_delta_free ( delta );
+    // Nor can it be recorded
+    a_autosave_suspend ( VIK_LAYER(vtl) );
+    return;
+  }
+  JournalEdit *edit = g_malloc0 ( sizeof(JournalEdit) );
+  edit->description = g_strdup ( description );
+  edit->deltas = g_list_prepend ( NULL, delta );
+  g_queue_push_head ( &vtl->journal_undo, edit );
+  while ( g_queue_get_length(&vtl->journal_undo) > levels )
+    journal_edit_free ( g_queue_pop_tail(&vtl->journal_undo) );
+  // A new edit means what was undone can no longer be redone
+  while ( (edit = g_queue_pop_head(&vtl->journal_redo)) )
+    journal_edit_free ( edit );
+
+  // Edits are journalled just before being made, so are recorded for autosave once they have been
+  vtl->journal_unrecorded = g_list_append ( vtl->journal_unrecorded, delta );
+  if ( !vtl->journal_record_id )
+    vtl->journal_record_id = g_idle_add ( (GSourceFunc)trw_layer_journal_record_idle, vtl );
+}
+
+static JournalDelta *journal_delta_new ( JournalDeltaType type, VikTrack *trk )
+{
+  JournalDelta *delta = g_malloc0 ( sizeof(JournalDelta) );
+  delta->type = type;
+  if ( trk ) {
+    vik_track_ref ( trk );
+    delta->trk = trk;
+  }
+  return delta;
+}
+
+/**
+ * The trackpoint has been moved from the given position
+ */
+static void trw_layer_journal_tp_coord ( VikTrwLayer *vtl, VikTrack *trk, VikTrackpoint *tp, const VikCoord *old_coord )
+{
+  JournalDelta *delta = journal_delta_new ( JOURNAL_TP_COORD, trk );
+  delta->tp = tp;
+  delta->coord = *old_coord;
+  trw_layer_journal_add ( vtl, trk->is_route ? _("Move Routepoint") : _("Move Trackpoint"), delta );
+}
+
+/**
+ * At the index, the removed trackpoints have been replaced by the given number of trackpoints
+ *  (starting with the first inserted one). The removed trackpoints become owned by the journal.
+ */
+static void trw_layer_journal_tp_range ( VikTrwLayer *vtl, const gchar *description, VikTrack *trk, guint index,
+                                         GList *removed, guint n_inserted, VikTrackpoint *first_inserted )
+{
+  JournalDelta *delta = journal_delta_new ( JOURNAL_TP_RANGE, trk );
+  delta->tp = first_inserted;
+  delta->index = index;
+  delta->points = removed;
+  delta->n_points = n_inserted;
+  trw_layer_journal_add ( vtl, description, delta );
+}
+
+/**
+ * The track has been split after the trackpoint at the index, into the new track
+ */
+static void trw_layer_journal_split ( VikTrwLayer *vtl, VikTrack *trk, VikTrack *trk_new, guint index )
+{
+  JournalDelta *delta = journal_delta_new ( JOURNAL_SPLIT, trk );
+  vik_track_ref ( trk_new );
+  delta->trk_new = trk_new;
+  delta->index = index;
+  delta->present = TRUE;
+  trw_layer_journal_add ( vtl, trk->is_route ? _("Split Route") : _("Split Track"), delta );
+}
+
+/**
+ * Call before the track is deleted, so it is kept for an undo
+ */
+static void trw_layer_journal_track_delete ( VikTrwLayer *vtl, VikTrack *trk )
+{
+  JournalDelta *delta = journal_delta_new ( JOURNAL_TRACK, trk );
+  delta->present = FALSE;
+  trw_layer_journal_add ( vtl, trk->is_route ? _("Delete Route") : _("Delete Track"), delta );
+}
+
+static void trw_layer_journal_wp_coord ( VikTrwLayer *vtl, VikWaypoint *wp, gpointer uuid, const VikCoord *old_coord )
+{
+  JournalDelta *delta = journal_delta_new ( JOURNAL_WP_COORD, NULL );
+  delta->wp = wp;
+  delta->wp_uuid = uuid;
+  delta->coord = *old_coord;
+  trw_layer_journal_add ( vtl, _("Move Waypoint"), delta );
+}
+
+/**
+ * Either the track or the waypoint (with its uuid) has been renamed from the old name
+ */
+static void trw_layer_journal_name ( VikTrwLayer *vtl, VikTrack *trk, VikWaypoint *wp, gpointer wp_uuid, const gchar *old_name )
+{
+  JournalDelta *delta = journal_delta_new ( JOURNAL_NAME, trk );
+  delta->wp = wp;
+  delta->wp_uuid = wp_uuid;
+  delta->name = g_strdup ( old_name );
+  trw_layer_journal_add ( vtl, _("Rename"), delta );
+}
+
+static gboolean journal_track_in_layer ( VikTrwLayer *vtl, VikTrack *trk )
+{
+  trku_udata udata;
+  udata.trk  = trk;
+  udata.uuid = NULL;
+  return g_hash_table_find ( trk->is_route ? vtl->routes : vtl->tracks, (GHRFunc)trw_layer_track_find_uuid, &udata ) != NULL;
+}
+
+static void journal_track_rename ( VikTrwLayer *vtl, VikTrack *trk, const gchar *name )
+{
+  GHashTable *items = trk->is_route ? vtl->routes : vtl->tracks;
+  gpointer uuid = trw_layer_names_find_uuid ( vtl, items, trk );
+  trw_layer_names_rename ( vtl, items, uuid, trk->name, name );
+  vik_track_set_name ( trk, name );
+  if ( vtl->current_tp.trk == trk && vtl->tpwin )
+    vik_trw_layer_tpwin_set_track_name ( vtl->tpwin, name );
+  vik_trw_layer_propwin_update ( trk );
+
+  if ( uuid ) {
+    GtkTreeIter *it = g_hash_table_lookup ( trk->is_route ? vtl->routes_iters : vtl->tracks_iters, uuid );
+    if ( it ) {
+      vik_treeview_item_set_name ( VIK_LAYER(vtl)->vt, it, name );
+      vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, trk->is_route ? &(vtl->routes_iter) : &(vtl->tracks_iter), vtl->track_sort_order );
+    }
+  }
+}
+
+static void journal_track_changed ( VikTrack *trk )
+{
+  vik_track_clear_caches ( trk );
+  vik_track_calculate_bounds ( trk );
+}
+
+/**
+ * Returns: FALSE if the delta no longer fits the data (i.e. it has been changed by something not journalled)
+ */
+static gboolean journal_delta_apply ( VikTrwLayer *vtl, JournalDelta *delta )
+{
+  if ( delta->trk && delta->type != JOURNAL_TRACK && !journal_track_in_layer(vtl, delta->trk) )
+    return FALSE;
+
+  switch ( delta->type ) {
+  case JOURNAL_TP_COORD: {
+    if ( !g_list_find(delta->trk->trackpoints, delta->tp) )
+      return FALSE;
+    VikCoord coord = delta->tp->coord;
+    delta->tp->coord = delta->coord;
+    delta->coord = coord;
+    journal_track_changed ( delta->trk );
+    break;
+  }
+  case JOURNAL_TP_RANGE: {
+    VikTrack *trk = delta->trk;
+    guint length = g_list_length ( trk->trackpoints );
+    if ( delta->index + delta->n_points > length )
+      return FALSE;
+    // Detach the run to take out
+    GList *before = delta->index ? g_list_nth ( trk->trackpoints, delta->index - 1 ) : NULL;
+    GList *first = before ? before->next : trk->trackpoints;
+    GList *after = first;
+    GList *taken = NULL;
+    if ( delta->n_points ) {
+      if ( first->data != delta->tp )
+        return FALSE;
+      GList *last = g_list_nth ( first, delta->n_points - 1 );
+      after = last->next;
+      last->next = NULL;
+      taken = first;
+      taken->prev = NULL;
+    }
+    // Join in the run to put in
+    GList *put = delta->points;
+    guint n_put = 0;
+    GList *put_last = NULL;
+    for ( GList *iter = put; iter; iter = iter->next ) {
+      put_last = iter;
+      n_put++;
+    }
+    GList *new_next = put ? put : after;
+    if ( before )
+      before->next = new_next;
+    else
+      trk->trackpoints = new_next;
+    if ( put ) {
+      put->prev = before;
+      put_last->next = after;
+    }
+    if ( after )
+      after->prev = put ? put_last : before;
+    delta->points = taken;
+    delta->n_points = n_put;
+    delta->tp = put ? put->data : NULL;
+    journal_track_changed ( trk );
+    break;
+  }
+  case JOURNAL_SPLIT: {
+    VikTrack *trk = delta->trk;
+    VikTrack *trk_new = delta->trk_new;
+    if ( delta->present ) {
+      // Join back: the first point of the new track was a copy of the split point
+      if ( !journal_track_in_layer(vtl, trk_new) || !trk_new->trackpoints )
+        return FALSE;
+      GList *last = g_list_last ( trk->trackpoints );
+      if ( !last || g_list_length(trk->trackpoints) != delta->index + 1 )
+        return FALSE;
+      GList *first = trk_new->trackpoints;
+      GList *rest = first->next;
+      first->next = NULL;
+      trk_new->trackpoints = first;
+      last->next = rest;
+      if ( rest )
+        rest->prev = last;
+      if ( trk_new->is_route )
+        vik_trw_layer_delete_route ( vtl, trk_new );
+      else
+        vik_trw_layer_delete_track ( vtl, trk_new );
+      delta->present = FALSE;
+    }
+    else {
+      GList *split = g_list_nth ( trk->trackpoints, delta->index );
+      if ( !split || !split->next || !trk_new->trackpoints )
+        return FALSE;
+      GList *rest = split->next;
+      split->next = NULL;
+      rest->prev = trk_new->trackpoints;
+      trk_new->trackpoints->next = rest;
+      vik_track_ref ( trk_new ); // For the layer
+      if ( trk_new->is_route )
+        vik_trw_layer_add_route ( vtl, NULL, trk_new );
+      else
+        vik_trw_layer_add_track ( vtl, NULL, trk_new );
+      delta->present = TRUE;
+    }
+    journal_track_changed ( trk );
+    journal_track_changed ( trk_new );
+    break;
+  }
+  case JOURNAL_TRACK: {
+    VikTrack *trk = delta->trk;
+    if ( delta->present ) {
+      if ( !journal_track_in_layer(vtl, trk) )
+        return FALSE;
+      if ( trk->is_route )
+        vik_trw_layer_delete_route ( vtl, trk );
+      else
+        vik_trw_layer_delete_track ( vtl, trk );
+      delta->present = FALSE;
+    }
+    else {
+      if ( journal_track_in_layer(vtl, trk) )
+        return FALSE;
+      vik_track_ref ( trk ); // For the layer
+      if ( trk->is_route )
+        vik_trw_layer_add_route ( vtl, NULL, trk );
+      else
+        vik_trw_layer_add_track ( vtl, NULL, trk );
+      delta->present = TRUE;
+    }
+    break;
+  }
+  case JOURNAL_WP_COORD: {
+    if ( g_hash_table_lookup(vtl->waypoints, delta->wp_uuid) != delta->wp )
+      return FALSE;
+    VikCoord coord = delta->wp->coord;
+    delta->wp->coord = delta->coord;
+    delta->coord = coord;
+    trw_layer_calculate_bounds_waypoints ( vtl );
+    break;
+  }
+  case JOURNAL_NAME: {
+    if ( !delta->trk && g_hash_table_lookup(vtl->waypoints, delta->wp_uuid) != delta->wp )
+      return FALSE;
+    gchar *name = delta->name;
+    if ( delta->trk ) {
+      delta->name = g_strdup ( delta->trk->name );
+      journal_track_rename ( vtl, delta->trk, name );
+    }
+    else {
+      delta->name = g_strdup ( delta->wp->name );
+      trw_layer_waypoint_rename ( vtl, delta->wp, name );
+    }
+    g_free ( name );
+    break;
+  }
+  default: break;
+  }
+  return TRUE;
+}
+
+/**
+ * Undo (or redo) the latest edit, moving it to the other queue
+ */
+static void trw_layer_journal_apply ( VikTrwLayer *vtl, gboolean undo )
+{
+  GQueue *from = undo ? &vtl->journal_undo : &vtl->journal_redo;
+  GQueue *to = undo ? &vtl->journal_redo : &vtl->journal_undo;
+  trw_layer_journal_record ( vtl );
+  JournalEdit *edit = g_queue_pop_head ( from );
+  if ( !edit )
+    return;
+
+  // Any selected trackpoint could be affected
+  trw_layer_cancel_current_tp ( vtl, FALSE );
+  if ( vtl->current_wp ) {
+    vtl->current_wp = NULL;
+    vtl->current_wp_id = NULL;
+    vtl->moving_wp = FALSE;
+  }
+
+  gboolean ok = TRUE;
+  GList *deltas = undo ? g_list_last ( edit->deltas ) : edit->deltas;
+  for ( GList *iter = deltas; ok && iter; iter = undo ? iter->prev : iter->next ) {
+    ok = journal_delta_apply ( vtl, iter->data );
+    if ( ok )
+      journal_delta_record ( vtl, iter->data );
+  }
+
+  if ( ok )
+    g_queue_push_head ( to, edit );
+  else {
+    // The data has been edited in ways not journalled, so nothing more can be reliably undone
+    g_warning ( "%s: Can not %s '%s'", __FUNCTION__, undo ? "undo" : "redo", edit->description );
+    journal_edit_free ( edit );
+    trw_layer_journal_clear ( vtl );
+    a_autosave_suspend ( VIK_LAYER(vtl) );
+    a_dialog_error_msg ( VIK_GTK_WINDOW_FROM_LAYER(vtl), _("The changes can not be undone as the data has been changed by other means.") );
+  }
+  vik_layer_emit_update ( VIK_LAYER(vtl) );
+}
+
+static VikTrack *replay_track ( VikTrwLayer *vtl, gboolean is_route, const gchar *name )
+{
+  return trw_layer_names_find ( vtl, is_route ? vtl->routes : vtl->tracks, name );
+}
+
+static void replay_track_add ( VikTrwLayer *vtl, const gchar *name, VikTrack *trk )
+{
+  gchar *copy = g_strdup ( name );
+  if ( trk->is_route )
+    vik_trw_layer_add_route ( vtl, copy, trk );
+  else
+    vik_trw_layer_add_track ( vtl, copy, trk );
+  g_free ( copy );
+}
+
+static void replay_track_delete ( VikTrwLayer *vtl, VikTrack *trk )
+{
+  if ( trk->is_route )
+    vik_trw_layer_delete_route ( vtl, trk );
+  else
+    vik_trw_layer_delete_track ( vtl, trk );
+}
+
+static VikTrack *replay_unmarshall ( VikTrwLayer *vtl, GVariant *bytes )
+{
+  gsize len;
+  const guint8 *data = g_variant_get_fixed_array ( bytes, &len, sizeof(guint8) );
+  VikTrack *trk = vik_track_unmarshall ( data, len );
+  if ( trk )
+    vik_track_convert ( trk, vtl->coord_mode );
+  return trk;
+}
+
+/**
+ * vik_trw_layer_replay:
+ * @record: As given to a_autosave_record()
+ *
+ * Make a recorded change again, e.g. onto the saved copy of the layer it was made to
+ *
+ * Returns: FALSE if the record does not fit the layer
+ */
+gboolean vik_trw_layer_replay ( VikTrwLayer *vtl, GVariant *record )
+{
+  if ( !g_variant_is_of_type ( record, G_VARIANT_TYPE("(yv)") ) )
+    return FALSE;
+  trw_ensure_layer_loaded ( vtl );
+  trw_layer_unpack_tracks ( vtl );
+
+  guchar type;
+  GVariant *payload;
+  g_variant_get ( record, "(yv)", &type, &payload );
+  gboolean ok = FALSE;
+  gboolean is_route;
+  const gchar *name, *other;
+  guint32 index, length, count;
+  struct LatLon ll;
+  VikTrack *trk = NULL;
+
+  switch ( type ) {
+  case RECORD_TP_COORD: {
+    if ( !g_variant_is_of_type ( payload, G_VARIANT_TYPE("(bsuu(dd))") ) )
+      break;
+    g_variant_get ( payload, "(b&suu(dd))", &is_route, &name, &index, &length, &ll.lat, &ll.lon );
+    trk = replay_track ( vtl, is_route, name );
+    VikTrackpoint *tp = trk && g_list_length(trk->trackpoints) == length ? g_list_nth_data ( trk->trackpoints, index ) : NULL;
+    if ( !tp )
+      break;
+    vik_coord_load_from_latlon ( &tp->coord, vtl->coord_mode, &ll );
+    journal_track_changed ( trk );
+    ok = TRUE;
+    break;
+  }
+  case RECORD_TP_RANGE: {
+    if ( !g_variant_is_of_type ( payload, G_VARIANT_TYPE("(bsuuuay)") ) )
+      break;
+    GVariant *bytes;
+    g_variant_get ( payload, "(b&suuu@ay)", &is_route, &name, &index, &count, &length, &bytes );
+    trk = replay_track ( vtl, is_route, name );
+    VikTrack *points = NULL;
+    if ( trk && index + count <= g_list_length(trk->trackpoints) )
+      points = replay_unmarshall ( vtl, bytes );
+    g_variant_unref ( bytes );
+    if ( !points )
+      break;
+    GList *link = g_list_nth ( trk->trackpoints, index );
+    for ( guint nn = 0; nn < count; nn++ ) {
+      GList *next = link->next;
+      vik_trackpoint_free ( VIK_TRACKPOINT(link->data) );
+      trk->trackpoints = g_list_delete_link ( trk->trackpoints, link );
+      link = next;
+    }
+    GList *put = points->trackpoints;
+    points->trackpoints = NULL;
+    vik_track_free ( points );
+    if ( put ) {
+      GList *before = index ? g_list_nth ( trk->trackpoints, index - 1 ) : NULL;
+      GList *after = before ? before->next : trk->trackpoints;
+      GList *put_last = g_list_last ( put );
+      if ( before )
+        before->next = put;
+      else
+        trk->trackpoints = put;
+      put->prev = before;
+      put_last->next = after;
+      if ( after )
+        after->prev = put_last;
+    }
+    journal_track_changed ( trk );
+    ok = g_list_length ( trk->trackpoints ) == length;
+    break;
+  }
+  case RECORD_SPLIT: {
+    if ( !g_variant_is_of_type ( payload, G_VARIANT_TYPE("(bsuus)") ) )
+      break;
+    g_variant_get ( payload, "(b&suu&s)", &is_route, &name, &index, &length, &other );
+    trk = replay_track ( vtl, is_route, name );
+    GList *split = trk ? g_list_nth ( trk->trackpoints, index ) : NULL;
+    if ( !split || !split->prev || !split->next )
+      break;
+    replay_track_add ( vtl, other, vik_track_split_at ( trk, split, NULL ) );
+    ok = g_list_length ( trk->trackpoints ) == length;
+    break;
+  }
+  case RECORD_JOIN: {
+    if ( !g_variant_is_of_type ( payload, G_VARIANT_TYPE("(bssu)") ) )
+      break;
+    g_variant_get ( payload, "(b&s&su)", &is_route, &name, &other, &length );
+    trk = replay_track ( vtl, is_route, name );
+    VikTrack *trk_other = replay_track ( vtl, is_route, other );
+    if ( !trk || !trk_other || trk == trk_other || !trk_other->trackpoints )
+      break;
+    // The first point of the other track is a copy of the last of this one
+    GList *rest = trk_other->trackpoints->next;
+    trk_other->trackpoints->next = NULL;
+    if ( rest )
+      rest->prev = NULL;
+    trk->trackpoints = g_list_concat ( trk->trackpoints, rest );
+    replay_track_delete ( vtl, trk_other );
+    journal_track_changed ( trk );
+    ok = g_list_length ( trk->trackpoints ) == length;
+    break;
+  }
+  case RECORD_TRACK_DELETE:
+    if ( !g_variant_is_of_type ( payload, G_VARIANT_TYPE("(bs)") ) )
+      break;
+    g_variant_get ( payload, "(b&s)", &is_route, &name );
+    trk = replay_track ( vtl, is_route, name );
+    if ( trk ) {
+      replay_track_delete ( vtl, trk );
+      ok = TRUE;
+    }
+    break;
+  case RECORD_TRACK_ADD: {
+    if ( !g_variant_is_of_type ( payload, G_VARIANT_TYPE("(ay)") ) )
+      break;
+    GVariant *bytes = g_variant_get_child_value ( payload, 0 );
+    trk = replay_unmarshall ( vtl, bytes );
+    g_variant_unref ( bytes );
+    if ( trk ) {
+      replay_track_add ( vtl, trk->name, trk );
+      ok = TRUE;
+    }
+    break;
+  }
+  case RECORD_WP_COORD: {
+    if ( !g_variant_is_of_type ( payload, G_VARIANT_TYPE("(s(dd))") ) )
+      break;
+    g_variant_get ( payload, "(&s(dd))", &name, &ll.lat, &ll.lon );
+    VikWaypoint *wp = trw_layer_names_find ( vtl, vtl->waypoints, name );
+    if ( wp ) {
+      vik_coord_load_from_latlon ( &wp->coord, vtl->coord_mode, &ll );
+      trw_layer_calculate_bounds_waypoints ( vtl );
+      ok = TRUE;
+    }
+    break;
+  }
+  case RECORD_NAME: {
+    if ( !g_variant_is_of_type ( payload, G_VARIANT_TYPE("(yss)") ) )
+      break;
+    guchar subtype;
+    g_variant_get ( payload, "(y&s&s)", &subtype, &name, &other );
+    if ( subtype == VIK_TRW_LAYER_SUBLAYER_WAYPOINT ) {
+      VikWaypoint *wp = trw_layer_names_find ( vtl, vtl->waypoints, name );
+      if ( wp ) {
+        trw_layer_waypoint_rename ( vtl, wp, other );
+        ok = TRUE;
+      }
+    }
+    else {
+      trk = replay_track ( vtl, subtype == VIK_TRW_LAYER_SUBLAYER_ROUTE, name );
+      if ( trk ) {
+        journal_track_rename ( vtl, trk, other );
+        ok = TRUE;
+      }
+    }
+    break;
+  }
+  default: break;
+  }
+  g_variant_unref ( payload );
+  return ok;
+}
+
+/**
+ * Returns: The description of the edit that would be undone (or redone), or NULL if none
+ */
+static const gchar *trw_layer_journal_description ( VikTrwLayer *vtl, gboolean undo )
+{
+  JournalEdit *edit = g_queue_peek_head ( undo ? &vtl->journal_undo : &vtl->journal_redo );
+  return edit ? edit->description : NULL;
+}
+
+static void trw_layer_undo ( menu_array_layer values )
+{
+  trw_layer_journal_apply ( VIK_TRW_LAYER(values[MA_VTL]), TRUE );
+}
+
+static void trw_layer_redo ( menu_array_layer values )
+{
+  trw_layer_journal_apply ( VIK_TRW_LAYER(values[MA_VTL]), FALSE );
+}
+
+static void trw_layer_delete_item ( menu_array_sublayer values )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER(values[MA_VTL]);
+  gboolean was_visible = FALSE;
+  if ( GPOINTER_TO_INT (values[MA_SUBTYPE]) == VIK_TRW_LAYER_SUBLAYER_WAYPOINT )
+  {
+    VikWaypoint *wp = g_hash_table_lookup ( vtl->waypoints, values[MA_SUBLAYER_ID] );
+    if ( wp && wp->name ) {
+      if ( GPOINTER_TO_INT (values[MA_CONFIRM]) )
+        // Get confirmation from the user
+        // Maybe this Waypoint Delete should be optional as is it could get annoying...
+        if ( ! a_dialog_yes_or_no ( VIK_GTK_WINDOW_FROM_LAYER(vtl),
+            _("Are you sure you want to delete the waypoint \"%s\"?"),
+            wp->name ) )
+          return;
       was_visible = trw_layer_delete_waypoint ( vtl, wp );
       trw_layer_calculate_bounds_waypoints ( vtl );
       // Reset layer timestamp in case it has now changed
@@ -5473,6 +7582,7 @@ static void trw_layer_delete_item ( menu_array_sublayer values )
 				  _("Are you sure you want to delete the track \"%s\"?"),
 				  trk->name ) )
           return;
+      trw_layer_journal_track_delete ( vtl, trk );
       was_visible = vik_trw_layer_delete_track ( vtl, trk );
       // Reset layer timestamp in case it has now changed
       vik_treeview_item_set_timestamp ( vtl->vl.vt, &vtl->vl.iter, trw_layer_get_timestamp(vtl) );
@@ -5490,6 +7600,7 @@ static void trw_layer_delete_item ( menu_array_sublayer values )
                                     _("Are you sure you want to delete the route \"%s\"?"),
                                     trk->name ) )
           return;
+      trw_layer_journal_track_delete ( vtl, trk );
       was_visible = vik_trw_layer_delete_route ( vtl, trk );
     }
   }
@@ -5522,18 +7633,15 @@ void trw_layer_treeview_waypoint_align_time ( VikTrwLayer *vtl, VikWaypoint *wp
  */
 void trw_layer_waypoint_rename ( VikTrwLayer *vtl, VikWaypoint *wp, const gchar *new_name )
 {
-  vik_waypoint_set_name ( wp, new_name );
-
-  // Now update the treeview as well
-  wpu_udata udataU;
-  udataU.wp   = wp;
-  udataU.uuid = NULL;
-
   // Need key of it for treeview update
-  gpointer wpf = g_hash_table_find ( vtl->waypoints, (GHRFunc) trw_layer_waypoint_find_uuid, &udataU );
+  gpointer uuid = trw_layer_names_find_uuid ( vtl, vtl->waypoints, wp );
+  trw_layer_names_rename ( vtl, vtl->waypoints, uuid, wp->name, new_name );
+
+  vik_waypoint_set_name ( wp, new_name );
 
-  if ( wpf && udataU.uuid ) {
-    GtkTreeIter *it = g_hash_table_lookup ( vtl->waypoints_iters, udataU.uuid );
+  // Now update the treeview as well
+  if ( uuid ) {
+    GtkTreeIter *it = g_hash_table_lookup ( vtl->waypoints_iters, uuid );
 
     if ( it ) {
       vik_treeview_item_set_name ( VIK_LAYER(vtl)->vt, it, new_name );
@@ -5544,14 +7652,11 @@ void trw_layer_waypoint_rename ( VikTrwLayer *vtl, VikWaypoint *wp, const gchar
 
 void trw_layer_waypoint_properties_changed ( VikTrwLayer *vtl, VikWaypoint *wp )
 {
-  // Find in treeview
-  wpu_udata udataU;
-  udataU.wp   = wp;
-  udataU.uuid = NULL;
-  gpointer wpf = g_hash_table_find ( vtl->waypoints, (GHRFunc)trw_layer_waypoint_find_uuid, &udataU );
+  // Find in treeview - which also indexes it by any new name
+  gpointer uuid = trw_layer_names_find_uuid ( vtl, vtl->waypoints, wp );
 
-  if ( wpf && udataU.uuid ) {
-    GtkTreeIter *iter = g_hash_table_lookup ( vtl->waypoints_iters, udataU.uuid );
+  if ( uuid ) {
+    GtkTreeIter *iter = g_hash_table_lookup ( vtl->waypoints_iters, uuid );
     if ( iter ) {
       // Update treeview data
       vik_treeview_item_set_name ( VIK_LAYER(vtl)->vt, iter, wp->name );
@@ -5632,11 +7737,30 @@ static void trw_layer_track_statistics ( menu_array_sublayer values )
   }
 }
 
+/*
+ * Update the treeview row of the track - primarily to update the icon
+ */
+static void trw_layer_update_treeview_iter ( VikTrwLayer *vtl, VikTrack *trk, GtkTreeIter *iter, gboolean do_sort )
+{
+  GdkPixbuf *pixbuf = ui_pixbuf_new ( &trk->color, SMALL_ICON_SIZE, SMALL_ICON_SIZE );
+  vik_treeview_item_set_icon ( VIK_LAYER(vtl)->vt, iter, pixbuf );
+  g_object_unref (pixbuf);
+
+  if ( do_sort ) {
+    vik_treeview_item_set_number ( VIK_LAYER(vtl)->vt, iter, trk->number );
+    trw_layer_sort_order_specified ( vtl, trk->is_route ? VIK_TRW_LAYER_SUBLAYER_ROUTES : VIK_TRW_LAYER_SUBLAYER_TRACKS, vtl->track_sort_order );
+  }
+}
+
 /*
  * Update the treeview of the track id - primarily to update the icon
  */
 void trw_layer_update_treeview ( VikTrwLayer *vtl, VikTrack *trk, gboolean do_sort )
 {
+  // No row yet - it will be created with the current values
+  if ( !VIK_LAYER(vtl)->realized || vtl->items_deferred )
+    return;
+
   trku_udata udata;
   udata.trk  = trk;
   udata.uuid = NULL;
@@ -5655,17 +7779,8 @@ void trw_layer_update_treeview ( VikTrwLayer *vtl, VikTrack *trk, gboolean do_so
     else
       iter = g_hash_table_lookup ( vtl->tracks_iters, udata.uuid );
 
-    if ( iter ) {
-      GdkPixbuf *pixbuf = ui_pixbuf_new ( &trk->color, SMALL_ICON_SIZE, SMALL_ICON_SIZE );
-      vik_treeview_item_set_icon ( VIK_LAYER(vtl)->vt, iter, pixbuf );
-      g_object_unref (pixbuf);
-
-      if ( do_sort ) {
-	vik_treeview_item_set_number ( VIK_LAYER(vtl)->vt, iter, trk->number );
-        trw_layer_sort_order_specified ( vtl, trk->is_route ? VIK_TRW_LAYER_SUBLAYER_ROUTES : VIK_TRW_LAYER_SUBLAYER_TRACKS, vtl->track_sort_order );
-      }
-    }
-
+    if ( iter )
+      trw_layer_update_treeview_iter ( vtl, trk, iter, do_sort );
   }
 }
 
@@ -5748,40 +7863,31 @@ static void my_tpwin_set_tp ( VikTrwLayer *vtl );
 
 static void trw_layer_graph_draw_tp ( VikTrwLayer *vtl )
 {
-  if ( vtl->current_tpl ) {
+  if ( vtl->current_tp.tpl ) {
     VikWindow *vw = VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl));
     gpointer gw = vik_window_get_graphs_widgets ( vw );
     if ( gw )
-      vik_trw_layer_propwin_main_draw_blob ( gw, VIK_TRACKPOINT(vtl->current_tpl->data) );
+      vik_trw_layer_propwin_main_draw_blob ( gw, VIK_TRACKPOINT(vtl->current_tp.tpl->data) );
   }
 }
 
 static void trw_layer_select_trackpoint ( VikTrwLayer *vtl, VikTrack *trk, VikTrackpoint *tpt, gboolean draw_graph_blob )
 {
-  GList *tpl = g_list_find ( trk->trackpoints, tpt );
-  if ( tpl ) {
-    vtl->current_tpl = tpl;
-    vtl->current_tp_track = trk;
-  }
-  if ( draw_graph_blob ) {
+  // Typically the graph is followed along the track, so this is usually beside the current trackpoint
+  if ( vik_track_cursor_find ( &vtl->current_tp, trk, tpt ) && draw_graph_blob ) {
     trw_layer_graph_draw_tp ( vtl );
-    set_statusbar_msg_info_trkpt ( vtl, tpt );
+    set_statusbar_msg_info_trkpt ( vtl );
   }
 }
 
 void vik_trw_layer_goto_track_prev_point ( VikTrwLayer *vtl )
 {
-  if ( !vtl->current_tpl )
-    return;
-  if ( !vtl->current_tpl->prev )
+  if ( !vtl->current_tp.trk || !vik_track_cursor_prev ( &vtl->current_tp ) )
     return;
 
-  if ( vtl->current_tp_track ) {
-    vtl->current_tpl = vtl->current_tpl->prev;
-    if ( vtl->tpwin )
-      my_tpwin_set_tp ( vtl );
-    set_statusbar_msg_info_trkpt ( vtl, vtl->current_tpl->data );
-  }
+  if ( vtl->tpwin )
+    my_tpwin_set_tp ( vtl );
+  set_statusbar_msg_info_trkpt ( vtl );
   vik_layer_emit_update(VIK_LAYER(vtl));
   trw_layer_graph_draw_tp ( vtl );
 }
@@ -5793,17 +7899,12 @@ static void trw_layer_goto_track_prev_point ( menu_array_sublayer values )
 
 void vik_trw_layer_goto_track_next_point ( VikTrwLayer *vtl )
 {
-  if ( !vtl->current_tpl )
-    return;
-  if ( !vtl->current_tpl->next )
+  if ( !vtl->current_tp.trk || !vik_track_cursor_next ( &vtl->current_tp ) )
     return;
 
-  if ( vtl->current_tp_track ) {
-    vtl->current_tpl = vtl->current_tpl->next;
-    if ( vtl->tpwin )
-      my_tpwin_set_tp ( vtl );
-    set_statusbar_msg_info_trkpt ( vtl, vtl->current_tpl->data );
-  }
+  if ( vtl->tpwin )
+    my_tpwin_set_tp ( vtl );
+  set_statusbar_msg_info_trkpt ( vtl );
   vik_layer_emit_update(VIK_LAYER(vtl));
   trw_layer_graph_draw_tp ( vtl );
 }
@@ -6108,7 +8209,8 @@ static void trw_layer_rotate ( menu_array_sublayer values )
     seg = g_list_first ( track->trackpoints );
     tp = VIK_TRACKPOINT(seg->data);
     tp->newsegment = TRUE;
-    
+    vik_track_clear_caches ( track );
+
     vik_layer_emit_update ( VIK_LAYER(vtl) );
   }
 }
@@ -6614,24 +8716,24 @@ typedef struct {
 static void find_tracks_with_timestamp_type(gpointer key, gpointer value, gpointer udata)
 {
   twt_udata *user_data = udata;
-  VikTrackpoint *p1, *p2;
   VikTrack *trk = VIK_TRACK(value);
   if (trk == user_data->exclude) {
     return;
   }
 
   if (trk->trackpoints) {
-    p1 = vik_track_get_tp_first(trk);
-    p2 = vik_track_get_tp_last(trk);
+    // The first and last times are remembered in the summary, rather than having to find the last trackpoint each time
+    VikTrackSummary summary;
+    vik_track_get_summary ( trk, &summary );
 
     if ( user_data->with_timestamps ) {
-      if (isnan(p1->timestamp) || isnan(p2->timestamp)) {
+      if (isnan(summary.start_time) || isnan(summary.end_time)) {
 	return;
       }
     }
     else {
       // Don't add tracks with timestamps when getting non timestamp tracks
-      if (!isnan(p1->timestamp) || !isnan(p2->timestamp)) {
+      if (!isnan(summary.start_time) || !isnan(summary.end_time)) {
 	return;
       }
     }
@@ -6640,61 +8742,6 @@ static void find_tracks_with_timestamp_type(gpointer key, gpointer value, gpoint
   *(user_data->result) = g_list_prepend(*(user_data->result), key);
 }
 
-/**
- * find_nearby_tracks_by_time:
- *
- * Called for each track in track hash table.
- *  If the original track (in user_data[1]) is close enough (threshold period in user_data[2])
- *  to the current track, then the current track is added to the list in user_data[0]
- */
-static void find_nearby_tracks_by_time (gpointer key, gpointer value, gpointer user_data)
-{
-  VikTrack *trk = VIK_TRACK(value);
-
-  GList **nearby_tracks = ((gpointer *)user_data)[0];
-  VikTrack *orig_trk = VIK_TRACK(((gpointer *)user_data)[1]);
-
-  if ( !orig_trk || !orig_trk->trackpoints )
-    return;
-
-  /* outline: 
-   * detect reasons for not merging, and return
-   * if no reason is found not to merge, then do it.
-   */
-
-  twt_udata *udata = user_data;
-  // Exclude the original track from the compiled list
-  if (trk == udata->exclude) {
-    return;
-  }
-
-  gdouble t1 = vik_track_get_tp_first(orig_trk)->timestamp;
-  gdouble t2 = vik_track_get_tp_last(orig_trk)->timestamp;
-
-  if (trk->trackpoints) {
-
-    VikTrackpoint *p1 = vik_track_get_tp_first(trk);
-    VikTrackpoint *p2 = vik_track_get_tp_last(trk);
-
-    if (isnan(p1->timestamp) || isnan(p2->timestamp)) {
-      //g_print("no timestamp\n");
-      return;
-    }
-
-    guint threshold = GPOINTER_TO_UINT (((gpointer *)user_data)[2]);
-    //g_print("Got track named %s, times %d, %d\n", trk->name, p1->timestamp, p2->timestamp);
-    if (! (fabs(t1 - p2->timestamp) < threshold ||
-      /*  p1 p2      t1 t2 */
-      fabs(p1->timestamp - t2) < threshold)
-      /*  t1 t2      p1 p2 */
-    ) {
-      return;
-    }
-  }
-
-  *nearby_tracks = g_list_prepend(*nearby_tracks, value);
-}
-
 /* comparison function used to sort tracks; a and b are hash table keys */
 /* Not actively used - can be restored if needed
 static gint track_compare(gconstpointer a, gconstpointer b, gpointer user_data)
@@ -6813,6 +8860,7 @@ static void trw_layer_merge_with_other ( menu_array_sublayer values )
         else
           vik_trw_layer_delete_track (vtl, merge_track);
         track->trackpoints = g_list_sort(track->trackpoints, trackpoint_compare);
+        vik_track_clear_caches ( track );
       }
     }
     for (l = merge_list; l != NULL; l = g_list_next(l))
@@ -7065,50 +9113,27 @@ static void trw_layer_merge_by_timestamp ( menu_array_sublayer values )
     return;
   }
 
-  // keep attempting to merge all tracks until no merges within the time specified is possible
-  gboolean attempt_merge = TRUE;
-  GList *nearby_tracks = NULL;
-  GList *trps;
-  static gpointer params[3];
-
-  while ( attempt_merge ) {
-
-    // Don't try again unless tracks have changed
-    attempt_merge = FALSE;
-
-    trps = orig_trk->trackpoints;
-    if ( !trps )
-      return;
-
-    if (nearby_tracks) {
-      g_list_free(nearby_tracks);
-      nearby_tracks = NULL;
-    }
-
-    params[0] = &nearby_tracks;
-    params[1] = orig_trk;
-    params[2] = GUINT_TO_POINTER (threshold_in_minutes*60); // In seconds
-
-    /* get a list of adjacent-in-time tracks */
-    g_hash_table_foreach(vtl->tracks, find_nearby_tracks_by_time, params);
+  if ( !orig_trk->trackpoints )
+    return;
 
-    /* merge them */
-    GList *l = nearby_tracks;
-    while ( l ) {
+  // Find all the tracks that repeated merging of adjacent-in-time tracks would gather,
+  //  then merge them all in one go rather than recalculating the track after each merge
+  GList *nearby_tracks = a_track_time_index_find_mergeable ( trw_layer_get_tracks_time_index(vtl), orig_trk, threshold_in_minutes*60 );
+  if ( nearby_tracks ) {
+    GList *trps = NULL;
+    for ( GList *l = nearby_tracks; l; l = g_list_next(l) ) {
       /* remove trackpoints from merged track, delete track */
-      vik_track_steal_and_append_trackpoints ( orig_trk, VIK_TRACK(l->data) );
-      vik_trw_layer_delete_track (vtl, VIK_TRACK(l->data));
-
-      // Tracks have changed, therefore retry again against all the remaining tracks
-      attempt_merge = TRUE;
-
-      l = g_list_next(l);
+      VikTrack *trk = VIK_TRACK(l->data);
+      trps = g_list_concat ( trk->trackpoints, trps );
+      trk->trackpoints = NULL;
+      vik_track_clear_caches ( trk );
+      vik_trw_layer_delete_track ( vtl, trk );
     }
-
-    orig_trk->trackpoints = g_list_sort(orig_trk->trackpoints, trackpoint_compare);
+    orig_trk->trackpoints = g_list_concat ( orig_trk->trackpoints, trps );
+    orig_trk->trackpoints = g_list_sort ( orig_trk->trackpoints, trackpoint_compare );
+    vik_track_calculate_bounds ( orig_trk );
   }
-
-  g_list_free(nearby_tracks);
+  g_list_free ( nearby_tracks );
 
   if ( values[MA_VLP] )
     vik_layers_panel_calendar_update ( VIK_LAYERS_PANEL(values[MA_VLP]) );
@@ -7123,9 +9148,9 @@ static void trw_layer_split_create_segments ( menu_array_sublayer values )
 {
   VikTrwLayer *vtl = (VikTrwLayer *)values[MA_VTL];
 
-  if ( vtl->current_tpl && vtl->current_tp_track && !vtl->current_tp_track->is_route ) {
-    if ( vtl->current_tpl->next && vtl->current_tpl->prev ) {
-        VIK_TRACKPOINT(vtl->current_tpl->data)->newsegment = TRUE;
+  if ( vtl->current_tp.tpl && vtl->current_tp.trk && !vtl->current_tp.trk->is_route ) {
+    if ( vtl->current_tp.tpl->next && vtl->current_tp.tpl->prev ) {
+        VIK_TRACKPOINT(vtl->current_tp.tpl->data)->newsegment = TRUE;
         vik_layer_emit_update(VIK_LAYER(vtl));
     }
   }
@@ -7136,35 +9161,24 @@ static void trw_layer_split_create_segments ( menu_array_sublayer values )
  */
 static void trw_layer_split_at_selected_trackpoint ( VikTrwLayer *vtl, gint subtype )
 {
-  if ( !vtl->current_tpl )
+  if ( !vtl->current_tp.tpl )
     return;
 
-  if ( vtl->current_tpl->next && vtl->current_tpl->prev ) {
-    gchar *name = trw_layer_new_unique_sublayer_name(vtl, subtype, vtl->current_tp_track->name);
+  if ( vtl->current_tp.tpl->next && vtl->current_tp.tpl->prev ) {
+    gchar *name = trw_layer_new_unique_sublayer_name(vtl, subtype, vtl->current_tp.trk->name);
     if ( name ) {
-      VikTrack *tr = vik_track_copy ( vtl->current_tp_track, FALSE );
-      GList *newglist = g_list_alloc ();
-      newglist->prev = NULL;
-      newglist->next = vtl->current_tpl->next;
-      newglist->data = vik_trackpoint_copy(VIK_TRACKPOINT(vtl->current_tpl->data));
-      tr->trackpoints = newglist;
-
-      vtl->current_tpl->next->prev = newglist; /* end old track here */
-      vtl->current_tpl->next = NULL;
-
-      // Bounds of the selected track changed due to the split
-      vik_track_calculate_bounds ( vtl->current_tp_track );
+      // Bounds of both tracks are updated by the split
+      guint position;
+      VikTrack *tr = vik_track_split_at ( vtl->current_tp.trk, vtl->current_tp.tpl, &position );
 
-      vtl->current_tpl = newglist; /* change tp to first of new track. */
-      vtl->current_tp_track = tr;
+      VikTrack *tr_split = vtl->current_tp.trk;
+      vik_track_cursor_set ( &vtl->current_tp, tr, tr->trackpoints ); /* change tp to first of new track. */
 
       if ( tr->is_route )
         vik_trw_layer_add_route ( vtl, name, tr );
       else
         vik_trw_layer_add_track ( vtl, name, tr );
-
-      // Bounds of the new track created by the split
-      vik_track_calculate_bounds ( tr );
+      trw_layer_journal_split ( vtl, tr_split, tr, position );
 
       vik_layer_emit_update(VIK_LAYER(vtl));
     }
@@ -7396,30 +9410,36 @@ static void trw_layer_split_segments ( menu_array_sublayer values )
 }
 /* end of split/merge routines */
 
+static void trw_layer_trackpoint_selected_remove ( VikTrwLayer *vtl, VikTrack *trk )
+{
+  guint index = vik_track_cursor_get_index ( &vtl->current_tp );
+  trk->trackpoints = g_list_remove_link ( trk->trackpoints, vtl->current_tp.tpl );
+  trw_layer_journal_tp_range ( vtl, trk->is_route ? _("Delete Routepoint") : _("Delete Trackpoint"),
+                               trk, index, vtl->current_tp.tpl, 0, NULL );
+}
+
 static void trw_layer_trackpoint_selected_delete ( VikTrwLayer *vtl, VikTrack *trk )
 {
   GList *new_tpl;
 
   // Find available adjacent trackpoint
-  if ( (new_tpl = vtl->current_tpl->next) || (new_tpl = vtl->current_tpl->prev) ) {
-    if ( VIK_TRACKPOINT(vtl->current_tpl->data)->newsegment && vtl->current_tpl->next )
-      VIK_TRACKPOINT(vtl->current_tpl->next->data)->newsegment = TRUE; /* don't concat segments on del */
+  if ( (new_tpl = vtl->current_tp.tpl->next) || (new_tpl = vtl->current_tp.tpl->prev) ) {
+    if ( VIK_TRACKPOINT(vtl->current_tp.tpl->data)->newsegment && vtl->current_tp.tpl->next )
+      VIK_TRACKPOINT(vtl->current_tp.tpl->next->data)->newsegment = TRUE; /* don't concat segments on del */
 
-    // Delete current trackpoint
-    vik_trackpoint_free ( vtl->current_tpl->data );
-    trk->trackpoints = g_list_delete_link ( trk->trackpoints, vtl->current_tpl );
+    // Delete current trackpoint, kept in the journal
+    trw_layer_trackpoint_selected_remove ( vtl, trk );
 
     // Set to current to the available adjacent trackpoint
-    vtl->current_tpl = new_tpl;
+    vik_track_cursor_set ( &vtl->current_tp, vtl->current_tp.trk, new_tpl );
 
-    if ( vtl->current_tp_track ) {
-      vik_track_calculate_bounds ( vtl->current_tp_track );
+    if ( vtl->current_tp.trk ) {
+      vik_track_calculate_bounds ( vtl->current_tp.trk );
     }
   }
   else {
     // Delete current trackpoint
-    vik_trackpoint_free ( vtl->current_tpl->data );
-    trk->trackpoints = g_list_delete_link ( trk->trackpoints, vtl->current_tpl );
+    trw_layer_trackpoint_selected_remove ( vtl, trk );
     trw_layer_cancel_current_tp ( vtl, FALSE );
   }
 }
@@ -7439,7 +9459,7 @@ static void trw_layer_delete_point_selected ( menu_array_sublayer values )
   if ( !trk )
     return;
 
-  if ( !vtl->current_tpl )
+  if ( !vtl->current_tp.tpl )
     return;
 
   trw_layer_trackpoint_selected_delete ( vtl, trk );
@@ -7697,9 +9717,9 @@ static void trw_layer_astro ( menu_array_sublayer values )
       return;
 
     VikTrackpoint *tp = NULL;
-    if ( vtl->current_tpl )
+    if ( vtl->current_tp.tpl )
       // Current Trackpoint
-      tp = VIK_TRACKPOINT(vtl->current_tpl->data);
+      tp = VIK_TRACKPOINT(vtl->current_tp.tpl->data);
     else if ( trk->trackpoints )
       // Otherwise first trackpoint
       tp = VIK_TRACKPOINT(trk->trackpoints->data);
@@ -7786,144 +9806,93 @@ static void trw_layer_sorted_track_id_by_name_list (const gpointer id, const Vik
 }
 
 
-typedef struct {
-  gboolean    has_same_track_name;
-  const gchar *same_track_name;
-} same_track_name_udata;
-
-static gint check_tracks_for_same_name ( gconstpointer aa, gconstpointer bb, gpointer udata )
-{
-  const gchar* namea = (const gchar*) aa;
-  const gchar* nameb = (const gchar*) bb;
-
-  // the test
-  gint result = strcmp ( namea, nameb );
-
-  if ( result == 0 ) {
-    // Found two names the same
-    same_track_name_udata *user_data = udata;
-    user_data->has_same_track_name = TRUE;
-    user_data->same_track_name = namea;
-  }
-
-  // Leave ordering the same
-  return 0;
-}
-
-/**
- * Find out if any tracks have the same name in this hash table
- */
-static gboolean trw_layer_has_same_track_names ( GHashTable *ht_tracks )
-{
-  // Sort items by name, then compare if any next to each other are the same
-
-  GList *track_names = NULL;
-  g_hash_table_foreach ( ht_tracks, (GHFunc) trw_layer_sorted_track_id_by_name_list, &track_names );
-
-  // No tracks
-  if ( ! track_names )
-    return FALSE;
-
-  same_track_name_udata udata;
-  udata.has_same_track_name = FALSE;
-
-  // Use sort routine to traverse list comparing items
-  // Don't care how this list ends up ordered ( doesn't actually change ) - care about the returned status
-  GList *dummy_list = g_list_sort_with_data ( track_names, check_tracks_for_same_name, &udata );
-  // Still no tracks...
-  if ( ! dummy_list )
-    return FALSE;
-
-  return udata.has_same_track_name;
-}
-
 /**
- * Force unqiue track names for the track table specified
+ * Rename all but the first item of each name, following trw_layer_new_unique_sublayer_name() as in NAME#2, NAME#3 etc...
+ * This is a single pass, keeping a counter for each base name so that numbers already found to be in use are not tried again.
  * Note the panel is a required parameter to enable the update of the names displayed
- * Specify if on tracks or else on routes
  */
-static void vik_trw_layer_uniquify_tracks ( VikTrwLayer *vtl, VikLayersPanel *vlp, GHashTable *track_table, gboolean ontrack )
+static void trw_layer_names_uniquify ( VikTrwLayer *vtl, VikLayersPanel *vlp, GHashTable *items )
 {
-  // . Search list for an instance of repeated name
-  // . get track of this name
-  // . create new name
-  // . rename track & update equiv. treeview iter
-  // . repeat until all different
+  GHashTable *names = trw_layer_names_get ( vtl, items );
 
-  same_track_name_udata udata;
-
-  GList *track_names = NULL;
-  udata.has_same_track_name = FALSE;
-  udata.same_track_name = NULL;
-
-  g_hash_table_foreach ( track_table, (GHFunc) trw_layer_sorted_track_id_by_name_list, &track_names );
-
-  // No tracks
-  if ( ! track_names )
+  // Gather all those to rename first, as renaming changes the index
+  GList *renames = NULL;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, names );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    GPtrArray *uuids = value;
+    if ( uuids->len > 1 && names_validate ( vtl, items, key, uuids ) > 1 )
+      for ( guint nn = 1; nn < uuids->len; nn++ )
+        renames = g_list_prepend ( renames, g_ptr_array_index(uuids, nn) );
+  }
+  if ( !renames )
     return;
 
-  GList *dummy_list1 = g_list_sort_with_data ( track_names, check_tracks_for_same_name, &udata );
-
-  // Still no tracks...
-  if ( ! dummy_list1 )
-    return;
+  GHashTable *iters;
+  GtkTreeIter *parent;
+  if ( items == vtl->waypoints ) {
+    iters = vtl->waypoints_iters;
+    parent = &(vtl->waypoints_iter);
+  }
+  else if ( items == vtl->tracks ) {
+    iters = vtl->tracks_iters;
+    parent = &(vtl->tracks_iter);
+  }
+  else {
+    iters = vtl->routes_iters;
+    parent = &(vtl->routes_iter);
+  }
 
-  while ( udata.has_same_track_name ) {
+  GRegex *regex = g_regex_new ( "^(.*?)#(\\d+)", 0, 0, NULL );
+  GHashTable *counters = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
 
-    // Find a track with the same name
-    VikTrack *trk;
-    if ( ontrack )
-      trk = vik_trw_layer_get_track ( vtl, (gpointer) udata.same_track_name );
-    else
-      trk = vik_trw_layer_get_route ( vtl, (gpointer) udata.same_track_name );
+  for ( GList *ll = renames; ll; ll = ll->next ) {
+    gpointer uuid = ll->data;
+    gpointer item = g_hash_table_lookup ( items, uuid );
+    const gchar *name = trw_layer_item_name ( vtl, items, item );
 
-    if ( ! trk ) {
-      // Broken :(
-      g_critical("Houston, we've had a problem.");
-      vik_statusbar_set_message ( vik_window_get_statusbar (VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl))), VIK_STATUSBAR_INFO, 
-                                  _("Internal Error in vik_trw_layer_uniquify_tracks") );
-      return;
+    // If name is already of the form text#N then start from text#N+1
+    gchar *corename;
+    gint number = 2;
+    GMatchInfo *match = NULL;
+    if ( g_regex_match ( regex, name, 0, &match ) ) {
+      corename = g_match_info_fetch ( match, 1 );
+      gchar *digits = g_match_info_fetch ( match, 2 );
+      number = atoi ( digits ) + 1;
+      g_free ( digits );
     }
+    else
+      corename = g_strdup ( name );
+    g_match_info_free ( match );
+
+    number = MAX ( number, GPOINTER_TO_INT(g_hash_table_lookup ( counters, corename )) );
+    gchar *newname = NULL;
+    do {
+      g_free ( newname );
+      newname = g_strdup_printf ( "%s#%d", corename, number++ );
+    } while ( trw_layer_names_find ( vtl, items, newname ) );
+    g_hash_table_replace ( counters, corename, GINT_TO_POINTER(number) );
+
+    trw_layer_names_rename ( vtl, items, uuid, name, newname );
+    if ( items == vtl->waypoints )
+      vik_waypoint_set_name ( VIK_WAYPOINT(item), newname );
+    else
+      vik_track_set_name ( VIK_TRACK(item), newname );
 
-    // Rename it
-    gchar *newname = trw_layer_new_unique_sublayer_name ( vtl, VIK_TRW_LAYER_SUBLAYER_TRACK, udata.same_track_name );
-    vik_track_set_name ( trk, newname );
-
-    trku_udata udataU;
-    udataU.trk  = trk;
-    udataU.uuid = NULL;
-
-    // Need want key of it for treeview update
-    gpointer trkf = g_hash_table_find ( track_table, (GHRFunc) trw_layer_track_find_uuid, &udataU );
-
-    if ( trkf && udataU.uuid ) {
-
-      GtkTreeIter *it;
-      if ( ontrack )
-	it = g_hash_table_lookup ( vtl->tracks_iters, udataU.uuid );
-      else
-	it = g_hash_table_lookup ( vtl->routes_iters, udataU.uuid );
-
-      if ( it ) {
-        vik_treeview_item_set_name ( VIK_LAYER(vtl)->vt, it, newname );
-        if ( ontrack )
-          vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), vtl->track_sort_order );
-        else
-          vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter), vtl->track_sort_order );
-      }
-    }
+    GtkTreeIter *it = g_hash_table_lookup ( iters, uuid );
+    if ( it )
+      vik_treeview_item_set_name ( VIK_LAYER(vtl)->vt, it, newname );
     g_free ( newname );
+  }
 
-    // Start trying to find same names again...
-    track_names = NULL;
-    g_hash_table_foreach ( track_table, (GHFunc) trw_layer_sorted_track_id_by_name_list, &track_names );
-    udata.has_same_track_name = FALSE;
-    GList *dummy_list2 = g_list_sort_with_data ( track_names, check_tracks_for_same_name, &udata );
+  g_hash_table_destroy ( counters );
+  g_regex_unref ( regex );
+  g_list_free ( renames );
 
-    // No tracks any more - give up searching
-    if ( ! dummy_list2 )
-      udata.has_same_track_name = FALSE;
-  }
+  // Only sort once all are renamed
+  if ( VIK_LAYER(vtl)->realized && !vtl->items_deferred )
+    vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, parent, items == vtl->waypoints ? vtl->wp_sort_order : vtl->track_sort_order );
 
   // Update
   vik_layers_panel_emit_update ( vlp );
@@ -7996,10 +9965,10 @@ static void trw_layer_delete_tracks_from_selection ( menu_array_layer values )
   GList *all = NULL;
 
   // Ensure list of track names offered is unique
-  if ( trw_layer_has_same_track_names ( vtl->tracks ) ) {
+  if ( trw_layer_names_has_duplicates ( vtl, vtl->tracks ) ) {
     if ( a_dialog_yes_or_no_suppress ( VIK_GTK_WINDOW_FROM_LAYER(vtl),
 			      _("Multiple entries with the same name exist. This method only works with unique names. Force unique names now?"), NULL ) ) {
-      vik_trw_layer_uniquify_tracks ( vtl, VIK_LAYERS_PANEL(values[MA_VLP]), vtl->tracks, TRUE );
+      trw_layer_names_uniquify ( vtl, VIK_LAYERS_PANEL(values[MA_VLP]), vtl->tracks );
     }
     else
       return;
@@ -8046,10 +10015,10 @@ static void trw_layer_delete_routes_from_selection ( menu_array_layer values )
   GList *all = NULL;
 
   // Ensure list of track names offered is unique
-  if ( trw_layer_has_same_track_names ( vtl->routes ) ) {
+  if ( trw_layer_names_has_duplicates ( vtl, vtl->routes ) ) {
     if ( a_dialog_yes_or_no_suppress ( VIK_GTK_WINDOW_FROM_LAYER(vtl),
                               _("Multiple entries with the same name exist. This method only works with unique names. Force unique names now?"), NULL ) ) {
-      vik_trw_layer_uniquify_tracks ( vtl, VIK_LAYERS_PANEL(values[MA_VLP]), vtl->routes, FALSE );
+      trw_layer_names_uniquify ( vtl, VIK_LAYERS_PANEL(values[MA_VLP]), vtl->routes );
     }
     else
       return;
@@ -8084,120 +10053,12 @@ static void trw_layer_delete_routes_from_selection ( menu_array_layer values )
   }
 }
 
-typedef struct {
-  gboolean    has_same_waypoint_name;
-  const gchar *same_waypoint_name;
-} same_waypoint_name_udata;
-
-static gint check_waypoints_for_same_name ( gconstpointer aa, gconstpointer bb, gpointer udata )
-{
-  const gchar* namea = (const gchar*) aa;
-  const gchar* nameb = (const gchar*) bb;
-
-  // the test
-  gint result = strcmp ( namea, nameb );
-
-  if ( result == 0 ) {
-    // Found two names the same
-    same_waypoint_name_udata *user_data = udata;
-    user_data->has_same_waypoint_name = TRUE;
-    user_data->same_waypoint_name = namea;
-  }
-
-  // Leave ordering the same
-  return 0;
-}
-
 /**
  * Find out if any waypoints have the same name in this layer
  */
 gboolean trw_layer_has_same_waypoint_names ( VikTrwLayer *vtl )
 {
-  // Sort items by name, then compare if any next to each other are the same
-
-  GList *waypoint_names = NULL;
-  g_hash_table_foreach ( vtl->waypoints, (GHFunc) trw_layer_sorted_wp_id_by_name_list, &waypoint_names );
-
-  // No waypoints
-  if ( ! waypoint_names )
-    return FALSE;
-
-  same_waypoint_name_udata udata;
-  udata.has_same_waypoint_name = FALSE;
-
-  // Use sort routine to traverse list comparing items
-  // Don't care how this list ends up ordered ( doesn't actually change ) - care about the returned status
-  GList *dummy_list = g_list_sort_with_data ( waypoint_names, check_waypoints_for_same_name, &udata );
-  // Still no waypoints...
-  if ( ! dummy_list )
-    return FALSE;
-
-  return udata.has_same_waypoint_name;
-}
-
-/**
- * Force unqiue waypoint names for this layer
- * Note the panel is a required parameter to enable the update of the names displayed
- */
-static void vik_trw_layer_uniquify_waypoints ( VikTrwLayer *vtl, VikLayersPanel *vlp )
-{
-  // . Search list for an instance of repeated name
-  // . get waypoint of this name
-  // . create new name
-  // . rename waypoint & update equiv. treeview iter
-  // . repeat until all different
-
-  same_waypoint_name_udata udata;
-
-  GList *waypoint_names = NULL;
-  udata.has_same_waypoint_name = FALSE;
-  udata.same_waypoint_name = NULL;
-
-  g_hash_table_foreach ( vtl->waypoints, (GHFunc) trw_layer_sorted_wp_id_by_name_list, &waypoint_names );
-
-  // No waypoints
-  if ( ! waypoint_names )
-    return;
-
-  GList *dummy_list1 = g_list_sort_with_data ( waypoint_names, check_waypoints_for_same_name, &udata );
-
-  // Still no waypoints...
-  if ( ! dummy_list1 )
-    return;
-
-  while ( udata.has_same_waypoint_name ) {
-
-    // Find a waypoint with the same name
-    VikWaypoint *waypoint = vik_trw_layer_get_waypoint ( vtl, (gpointer) udata.same_waypoint_name );
-
-    if ( ! waypoint ) {
-      // Broken :(
-      g_critical("Houston, we've had a problem.");
-      vik_statusbar_set_message ( vik_window_get_statusbar (VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl))), VIK_STATUSBAR_INFO, 
-                                  _("Internal Error in vik_trw_layer_uniquify_waypoints") );
-      return;
-    }
-
-    // Rename it
-    gchar *newname = trw_layer_new_unique_sublayer_name ( vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, udata.same_waypoint_name );
-
-    trw_layer_waypoint_rename ( vtl, waypoint, newname );
-
-    g_free (newname);
-
-    // Start trying to find same names again...
-    waypoint_names = NULL;
-    g_hash_table_foreach ( vtl->waypoints, (GHFunc) trw_layer_sorted_wp_id_by_name_list, &waypoint_names );
-    udata.has_same_waypoint_name = FALSE;
-    GList *dummy_list2 = g_list_sort_with_data ( waypoint_names, check_waypoints_for_same_name, &udata );
-
-    // No waypoints any more - give up searching
-    if ( ! dummy_list2 )
-      udata.has_same_waypoint_name = FALSE;
-  }
-
-  // Update
-  vik_layers_panel_emit_update ( vlp );
+  return trw_layer_names_has_duplicates ( vtl, vtl->waypoints );
 }
 
 /**
@@ -8212,7 +10073,7 @@ static void trw_layer_delete_waypoints_from_selection ( menu_array_layer values
   if ( trw_layer_has_same_waypoint_names ( vtl ) ) {
     if ( a_dialog_yes_or_no_suppress ( VIK_GTK_WINDOW_FROM_LAYER(vtl),
 			      _("Multiple entries with the same name exist. This method only works with unique names. Force unique names now?"), NULL ) ) {
-      vik_trw_layer_uniquify_waypoints ( vtl, VIK_LAYERS_PANEL(values[MA_VLP]) );
+      trw_layer_names_uniquify ( vtl, VIK_LAYERS_PANEL(values[MA_VLP]), vtl->waypoints );
     }
     else
       return;
@@ -8259,6 +10120,9 @@ static void trw_layer_delete_waypoints_from_selection ( menu_array_layer values
  */
 static guint trw_layer_delete_duplicate_waypoints_main ( VikTrwLayer *vtl )
 {
+  // Items are only removed along with their row
+  trw_layer_realize_items ( vtl );
+
   GHashTableIter iter;
   gpointer key, value;
 
@@ -8711,6 +10575,7 @@ static void trw_layer_waypoint_webpage ( menu_array_sublayer values )
 
 static const gchar* trw_layer_sublayer_rename_request ( VikTrwLayer *l, const gchar *newname, gpointer vlp, gint subtype, gpointer sublayer, GtkTreeIter *iter )
 {
+  trw_layer_unpack_tracks ( l );
   if ( subtype == VIK_TRW_LAYER_SUBLAYER_WAYPOINT )
   {
     VikWaypoint *wp = g_hash_table_lookup ( l->waypoints, sublayer );
@@ -8731,6 +10596,8 @@ static const gchar* trw_layer_sublayer_rename_request ( VikTrwLayer *l, const gc
     }
 
     // Update WP name and refresh the treeview
+    trw_layer_journal_name ( l, NULL, wp, sublayer, wp->name );
+    trw_layer_names_rename ( l, l->waypoints, sublayer, wp->name, newname );
     vik_waypoint_set_name (wp, newname);
 
     vik_treeview_item_set_name ( VIK_LAYER(l)->vt, iter, newname );
@@ -8760,11 +10627,13 @@ static const gchar* trw_layer_sublayer_rename_request ( VikTrwLayer *l, const gc
         return NULL;
     }
     // Update track name and refresh GUI parts
+    trw_layer_journal_name ( l, trk, NULL, NULL, trk->name );
+    trw_layer_names_rename ( l, trk->is_route ? l->routes : l->tracks, sublayer, trk->name, newname );
     vik_track_set_name (trk, newname);
 
     // Update any subwindows that could be displaying this track which has changed name
     // Only one Track Edit Window
-    if ( l->current_tp_track == trk && l->tpwin ) {
+    if ( l->current_tp.trk == trk && l->tpwin ) {
       vik_trw_layer_tpwin_set_track_name ( l->tpwin, newname );
     }
     // Property Dialog of the track
@@ -8797,11 +10666,13 @@ static const gchar* trw_layer_sublayer_rename_request ( VikTrwLayer *l, const gc
         return NULL;
     }
     // Update track name and refresh GUI parts
+    trw_layer_journal_name ( l, trk, NULL, NULL, trk->name );
+    trw_layer_names_rename ( l, trk->is_route ? l->routes : l->tracks, sublayer, trk->name, newname );
     vik_track_set_name (trk, newname);
 
     // Update any subwindows that could be displaying this track which has changed name
     // Only one Track Edit Window
-    if ( l->current_tp_track == trk && l->tpwin ) {
+    if ( l->current_tp.trk == trk && l->tpwin ) {
       vik_trw_layer_tpwin_set_track_name ( l->tpwin, newname );
     }
     // Property Dialog of the track
@@ -8860,6 +10731,9 @@ static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *men
   gboolean rv = FALSE;
   gboolean may_have_extensions = (l->gpx_version != GPX_V1_0);
 
+  // Anything from here may use the other tracks too
+  trw_layer_unpack_tracks ( l );
+
   data[MA_VTL]         = l;
   data[MA_VLP]         = vlp;
   data[MA_SUBTYPE]     = GINT_TO_POINTER (subtype);
@@ -9119,12 +10993,12 @@ static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *men
     (void)vu_menu_add_item ( split_submenu, _("Split By _Number of Points..."), NULL, G_CALLBACK(trw_layer_split_by_n_points), data );
     GtkWidget *itemsnp = vu_menu_add_item ( split_submenu, _("Split at _Trackpoint"), NULL, G_CALLBACK(trw_layer_split_at_trackpoint), data );
     // Make it available only when a trackpoint is selected.
-    gtk_widget_set_sensitive ( itemsnp, (gboolean)GPOINTER_TO_INT(l->current_tpl) );
+    gtk_widget_set_sensitive ( itemsnp, (gboolean)GPOINTER_TO_INT(l->current_tp.tpl) );
 
     if ( subtype == VIK_TRW_LAYER_SUBLAYER_TRACK ) {
       GtkWidget *itemsns = vu_menu_add_item ( split_submenu, _("_Create Segment at Trackpoint"), NULL, G_CALLBACK(trw_layer_split_create_segments), data );
       // Make it available only when a trackpoint is selected.
-      gtk_widget_set_sensitive ( itemsns, (gboolean)GPOINTER_TO_INT(l->current_tpl) );
+      gtk_widget_set_sensitive ( itemsns, (gboolean)GPOINTER_TO_INT(l->current_tp.tpl) );
     }
 
     GtkMenu *insert_submenu = GTK_MENU(gtk_menu_new());
@@ -9133,10 +11007,10 @@ static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *men
 
     GtkWidget *itemib = vu_menu_add_item ( insert_submenu, _("Insert Point _Before Selected Point"), NULL, G_CALLBACK(trw_layer_insert_point_before), data );
     // Make it available only when a point is selected
-    gtk_widget_set_sensitive ( itemib, (gboolean)GPOINTER_TO_INT(l->current_tpl) );
+    gtk_widget_set_sensitive ( itemib, (gboolean)GPOINTER_TO_INT(l->current_tp.tpl) );
     GtkWidget *itemia = vu_menu_add_item ( insert_submenu, _("Insert Point _After Selected Point"), NULL, G_CALLBACK(trw_layer_insert_point_after), data );
     // Make it available only when a point is selected
-    gtk_widget_set_sensitive ( itemia, (gboolean)GPOINTER_TO_INT(l->current_tpl) );
+    gtk_widget_set_sensitive ( itemia, (gboolean)GPOINTER_TO_INT(l->current_tp.tpl) );
 
     GtkMenu *delete_submenu = GTK_MENU(gtk_menu_new());
     GtkWidget *itemdelete = vu_menu_add_item ( menu, _("Delete Poi_nts"), GTK_STOCK_DELETE, NULL, NULL );
@@ -9144,7 +11018,7 @@ static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *men
 
     GtkWidget *itemdsp = vu_menu_add_item ( delete_submenu, _("Delete _Selected Point"), GTK_STOCK_DELETE, G_CALLBACK(trw_layer_delete_point_selected), data );
     // Make it available only when a trackpoint is selected.
-    gtk_widget_set_sensitive ( itemdsp, (gboolean)GPOINTER_TO_INT(l->current_tpl) );
+    gtk_widget_set_sensitive ( itemdsp, (gboolean)GPOINTER_TO_INT(l->current_tp.tpl) );
     (void)vu_menu_add_item ( delete_submenu, _("Delete Points With The Same _Position"), NULL, G_CALLBACK(trw_layer_delete_points_same_position), data);
     (void)vu_menu_add_item ( delete_submenu, _("Delete Points With The Same _Time"), NULL, G_CALLBACK(trw_layer_delete_points_same_time), data );
 
@@ -9200,6 +11074,11 @@ static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *men
     if ( vlp ) {
       (void)vu_menu_add_item ( menu, (subtype == VIK_TRW_LAYER_SUBLAYER_TRACK) ? _("Down_load Maps Along Track...") : _("Down_load Maps Along Route..."),
                                "vik-icon-Maps Download", G_CALLBACK(trw_layer_download_map_along_track_cb), data );
+      (void)vu_menu_add_item ( menu, _("Pre-seed Maps..."), "vik-icon-Maps Download", G_CALLBACK(trw_layer_seed_maps_cb), data );
+      if ( subtype == VIK_TRW_LAYER_SUBLAYER_ROUTE ) {
+        GtkWidget *itemtr = vu_menu_add_item ( menu, _("Find Tracks _Through Route..."), GTK_STOCK_FIND, G_CALLBACK(trw_layer_tracks_through_route_cb), data );
+        gtk_widget_set_tooltip_text ( itemtr, _("Find tracks in any of the layers that pass inside the route, taken as the outline of an area") );
+      }
     }
 
     (void)vu_menu_add_item ( menu, (subtype == VIK_TRW_LAYER_SUBLAYER_TRACK) ? _("_Export Track as GPX...") : _("_Export Route as GPX..."),
@@ -9237,11 +11116,11 @@ static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *men
     }
   }
 
-  if ( l->current_tpl || l->current_wp ) {
+  if ( l->current_tp.tpl || l->current_wp ) {
     // For the selected point
     VikCoord *vc;
-    if ( l->current_tpl )
-      vc = &(VIK_TRACKPOINT(l->current_tpl->data)->coord);
+    if ( l->current_tp.tpl )
+      vc = &(VIK_TRACKPOINT(l->current_tp.tpl->data)->coord);
     else
       vc = &(l->current_wp->coord);
     vik_ext_tools_add_menu_items_to_menu ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(l)), GTK_MENU (external_submenu), vc );
@@ -9289,7 +11168,7 @@ static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *men
 
   if ( subtype == VIK_TRW_LAYER_SUBLAYER_TRACK || subtype == VIK_TRW_LAYER_SUBLAYER_ROUTE ) {
     // Only show on viewport popmenu when a trackpoint is selected
-    if ( ! vlp && l->current_tpl ) {
+    if ( ! vlp && l->current_tp.tpl ) {
       (void)vu_menu_add_item ( menu, NULL, NULL, NULL, NULL ); // Just a separator
       (void)vu_menu_add_item ( menu, _("_Edit Trackpoint"), GTK_STOCK_PROPERTIES, G_CALLBACK(trw_layer_edit_trackpoint), data );
     }
@@ -9328,20 +11207,20 @@ static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *men
 static void trw_layer_insert_tp_beside_current_tp ( VikTrwLayer *vtl, gboolean before, gboolean is_route )
 {
   // sanity check
-  if (!vtl->current_tpl)
+  if (!vtl->current_tp.tpl)
     return;
 
-  VikTrackpoint *tp_current = VIK_TRACKPOINT(vtl->current_tpl->data);
+  VikTrackpoint *tp_current = VIK_TRACKPOINT(vtl->current_tp.tpl->data);
   VikTrackpoint *tp_other = NULL;
 
   if ( before ) {
-    if (!vtl->current_tpl->prev)
+    if (!vtl->current_tp.tpl->prev)
       return;
-    tp_other = VIK_TRACKPOINT(vtl->current_tpl->prev->data);
+    tp_other = VIK_TRACKPOINT(vtl->current_tp.tpl->prev->data);
   } else {
-    if (!vtl->current_tpl->next)
+    if (!vtl->current_tp.tpl->next)
       return;
-    tp_other = VIK_TRACKPOINT(vtl->current_tpl->next->data);
+    tp_other = VIK_TRACKPOINT(vtl->current_tp.tpl->next->data);
   }
 
   // Use current and other trackpoints to form a new track point which is inserted into the tracklist
@@ -9377,16 +11256,22 @@ static void trw_layer_insert_tp_beside_current_tp ( VikTrwLayer *vtl, gboolean b
     /* DOP / sat values remain at defaults as they do not seem applicable to a dreamt up point */
 
     // Insert new point into the appropriate trackpoint list, either before or after the current trackpoint as directed   
-    VikTrack *trk = vtl->current_tp_track;
+    VikTrack *trk = vtl->current_tp.trk;
     if ( !trk )
       return;
 
-    gint index =  g_list_index ( trk->trackpoints, tp_current );
+    gint index = vik_track_cursor_get_index ( &vtl->current_tp );
     if ( index > -1 ) {
-      if ( !before )
+      GList *sibling = vtl->current_tp.tpl;
+      if ( !before ) {
         index = index + 1;
+        sibling = sibling->next;
+      }
       // NB no recalculation of bounds since it is inserted between points
-      trk->trackpoints = g_list_insert ( trk->trackpoints, tp_new, index );
+      trk->trackpoints = g_list_insert_before ( trk->trackpoints, sibling, tp_new );
+      vik_track_clear_caches ( trk );
+      trw_layer_journal_tp_range ( vtl, trk->is_route ? _("Insert Routepoint") : _("Insert Trackpoint"),
+                                   trk, index, NULL, 1, tp_new );
     }
   }
 
@@ -9405,22 +11290,22 @@ static void trw_layer_cancel_current_tp ( VikTrwLayer *vtl, gboolean destroy )
     else
       vik_trw_layer_tpwin_set_empty ( vtl->tpwin );
   }
-  if ( vtl->current_tpl )
+  if ( vtl->current_tp.tpl )
   {
-    vtl->current_tpl = NULL;
-    vtl->current_tp_track = NULL;
+    vik_track_cursor_clear ( &vtl->current_tp );
     vik_layer_emit_update(VIK_LAYER(vtl));
   }
 }
 
 static void my_tpwin_set_tp ( VikTrwLayer *vtl )
 {
-  VikTrack *trk = vtl->current_tp_track;
+  VikTrack *trk = vtl->current_tp.trk;
   VikCoord vc;
   // Notional center of a track is simply an average of the bounding box extremities
   struct LatLon center = { (trk->bbox.north+trk->bbox.south)/2, (trk->bbox.east+trk->bbox.west)/2 };
   vik_coord_load_from_latlon ( &vc, vtl->coord_mode, &center );
-  vik_trw_layer_tpwin_set_tp ( vtl->tpwin, vtl->current_tpl, trk->name, vtl->current_tp_track->is_route );
+  vik_track_decode_extensions ( trk );
+  vik_trw_layer_tpwin_set_tp ( vtl->tpwin, &vtl->current_tp );
 }
 
 static void trw_layer_tpwin_response ( VikTrwLayer *vtl, gint response )
@@ -9429,54 +11314,54 @@ static void trw_layer_tpwin_response ( VikTrwLayer *vtl, gint response )
   if ( response == VIK_TRW_LAYER_TPWIN_CLOSE )
     trw_layer_cancel_current_tp ( vtl, TRUE );
 
-  if ( vtl->current_tpl == NULL )
+  if ( vtl->current_tp.tpl == NULL )
     return;
 
-  if ( response == VIK_TRW_LAYER_TPWIN_SPLIT && vtl->current_tpl->next && vtl->current_tpl->prev )
+  if ( response == VIK_TRW_LAYER_TPWIN_SPLIT && vtl->current_tp.tpl->next && vtl->current_tp.tpl->prev )
   {
-    trw_layer_split_at_selected_trackpoint ( vtl, vtl->current_tp_track->is_route ? VIK_TRW_LAYER_SUBLAYER_ROUTE : VIK_TRW_LAYER_SUBLAYER_TRACK );
+    trw_layer_split_at_selected_trackpoint ( vtl, vtl->current_tp.trk->is_route ? VIK_TRW_LAYER_SUBLAYER_ROUTE : VIK_TRW_LAYER_SUBLAYER_TRACK );
     my_tpwin_set_tp ( vtl );
   }
   else if ( response == VIK_TRW_LAYER_TPWIN_DELETE )
   {
-    VikTrack *tr = vtl->current_tp_track;
+    VikTrack *tr = vtl->current_tp.trk;
     if ( !tr )
       return;
 
     trw_layer_trackpoint_selected_delete ( vtl, tr );
 
-    if ( vtl->current_tpl )
+    if ( vtl->current_tp.tpl )
       // Reset dialog with the available adjacent trackpoint
       my_tpwin_set_tp ( vtl );
 
     vik_layer_emit_update(VIK_LAYER(vtl));
   }
-  else if ( response == VIK_TRW_LAYER_TPWIN_FORWARD && vtl->current_tpl->next )
+  else if ( response == VIK_TRW_LAYER_TPWIN_FORWARD && vtl->current_tp.tpl->next )
   {
-    if ( vtl->current_tp_track ) {
-      vtl->current_tpl = vtl->current_tpl->next;
+    if ( vtl->current_tp.trk && vik_track_cursor_next ( &vtl->current_tp ) )
       my_tpwin_set_tp ( vtl );
-    }
     vik_layer_emit_update(VIK_LAYER(vtl)); /* TODO longone: either move or only update if tp is inside drawing window */
     trw_layer_graph_draw_tp ( vtl );
   }
-  else if ( response == VIK_TRW_LAYER_TPWIN_BACK && vtl->current_tpl->prev )
+  else if ( response == VIK_TRW_LAYER_TPWIN_BACK && vtl->current_tp.tpl->prev )
   {
-    if ( vtl->current_tp_track ) {
-      vtl->current_tpl = vtl->current_tpl->prev;
+    if ( vtl->current_tp.trk && vik_track_cursor_prev ( &vtl->current_tp ) )
       my_tpwin_set_tp ( vtl );
-    }
     vik_layer_emit_update(VIK_LAYER(vtl));
     trw_layer_graph_draw_tp ( vtl );
   }
-  else if ( response == VIK_TRW_LAYER_TPWIN_INSERT && vtl->current_tpl->next )
+  else if ( response == VIK_TRW_LAYER_TPWIN_INSERT && vtl->current_tp.tpl->next )
   {
-    if ( vtl->current_tp_track ) {
-      trw_layer_insert_tp_beside_current_tp ( vtl, FALSE, vtl->current_tp_track->is_route );
+    if ( vtl->current_tp.trk ) {
+      trw_layer_insert_tp_beside_current_tp ( vtl, FALSE, vtl->current_tp.trk->is_route );
     }
   }
-  else if ( response == VIK_TRW_LAYER_TPWIN_DATA_CHANGED )
+  else if ( response == VIK_TRW_LAYER_TPWIN_DATA_CHANGED ) {
+    // Position, altitude or time may have changed
+    if ( vtl->current_tp.trk )
+      vik_track_calculate_bounds ( vtl->current_tp.trk );
     vik_layer_emit_update(VIK_LAYER(vtl));
+  }
 }
 
 /**
@@ -9586,17 +11471,17 @@ void trw_layer_tpwin_init ( VikTrwLayer *vtl )
 
     gtk_widget_show_all ( GTK_WIDGET(vtl->tpwin) );
 
-    if ( vtl->current_tpl ) {
+    if ( vtl->current_tp.tpl ) {
       // get tp pixel position
-      VikTrackpoint *tp = VIK_TRACKPOINT(vtl->current_tpl->data);
+      VikTrackpoint *tp = VIK_TRACKPOINT(vtl->current_tp.tpl->data);
 
       // Shift up<->down to try not to obscure the trackpoint.
       trw_layer_dialog_shift ( vtl, GTK_WINDOW(vtl->tpwin), &(tp->coord), TRUE );
     }
   }
 
-  if ( vtl->current_tpl )
-    if ( vtl->current_tp_track )
+  if ( vtl->current_tp.tpl )
+    if ( vtl->current_tp.trk )
       my_tpwin_set_tp ( vtl );
   /* set layer name and TP data */
 }
@@ -9678,36 +11563,221 @@ static void waypoint_search_closest_tp ( gpointer id, VikWaypoint *wp, WPSearchP
     }
 }
 
-static void track_search_closest_tp ( gpointer id, VikTrack *t, TPSearchParams *params )
+/**
+ * The area covered by the search square around the screen position, for quick rejection of distant trackpoints
+ */
+static LatLonBBox tp_search_bbox ( TPSearchParams *params )
 {
-  GList *tpl = t->trackpoints;
-  VikTrackpoint *tp;
+  LatLonBBox bbox = { -90.0, 90.0, 180.0, -180.0 };
+  const gint corners[4][2] = { { -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 } };
+  // Include an extra pixel margin to allow for rounding
+  const gint size = params->size + 1;
+  for ( guint ii = 0; ii < G_N_ELEMENTS(corners); ii++ ) {
+    VikCoord coord;
+    struct LatLon ll;
+    vik_viewport_screen_to_coord ( params->vvp, params->x + corners[ii][0]*size, params->y + corners[ii][1]*size, &coord );
+    vik_coord_to_latlon ( &coord, &ll );
+    bbox.north = MAX ( bbox.north, ll.lat );
+    bbox.south = MIN ( bbox.south, ll.lat );
+    bbox.east = MAX ( bbox.east, ll.lon );
+    bbox.west = MIN ( bbox.west, ll.lon );
+  }
+  return bbox;
+}
+
+typedef struct {
+  gpointer id;
+  TPSearchParams *params;
+} TPSearchTrack;
+
+static void track_search_closest_tpl ( GList *tpl, TPSearchTrack *tst )
+{
+  TPSearchParams *params = tst->params;
+  VikTrackpoint *tp = VIK_TRACKPOINT(tpl->data);
+  gint x, y;
+
+  vik_viewport_coord_to_screen ( params->vvp, &(tp->coord), &x, &y );
+
+  if ( abs (x - params->x) <= params->size && abs (y - params->y) <= params->size &&
+      ((!params->closest_tp) ||        /* was the old trackpoint we already found closer than this one? */
+        abs(x - params->x)+abs(y - params->y) < abs(x - params->closest_x)+abs(y - params->closest_y)))
+  {
+    params->closest_track_id = tst->id;
+    params->closest_tp = tp;
+    params->closest_tpl = tpl;
+    params->closest_x = x;
+    params->closest_y = y;
+  }
+}
 
+static void track_search_closest_tp ( gpointer id, VikTrack *t, TPSearchParams *params )
+{
   if ( !t->visible )
     return;
 
   if ( ! BBOX_INTERSECT ( t->bbox, params->bbox ) )
     return;
 
-  while (tpl)
-  {
-    gint x, y;
-    tp = VIK_TRACKPOINT(tpl->data);
+  // Only trackpoints within the search area can match, so let the track skip over the rest
+  TPSearchTrack tst = { id, params };
+  vik_track_foreach_in_bbox ( t, params->bbox, (VikTrackTplFunc)track_search_closest_tpl, &tst );
+}
+
+#define VIK_SETTINGS_TRW_PICK_BUFFER "trw_pick_buffer"
+// Pixels around the display included, so positions just off screen can still be found from near the edge
+#define PICK_MARGIN 32
+
+typedef struct {
+  gpointer id;
+  VikTrack *trk;
+  GList *tpl;
+} TrwPickEntry;
+
+// The trackpoints of either the tracks or the routes, as they were drawn in a viewport
+struct _TrwPick {
+  PickBuffer *pb;
+  GArray *entries; // TrwPickEntry, each pixel value being the index + 1
+  VikViewport *vvp;
+  gint width, height;
+  gdouble xmpp, ympp;
+  VikCoord center;
+  VikViewportDrawMode drawmode;
+  gint track_changes;
+};
+
+typedef struct {
+  TrwPick *pick;
+  gpointer id;
+  VikTrack *trk;
+} TrwPickTrack;
+
+static void trw_pick_free ( TrwPick *pick )
+{
+  if ( !pick )
+    return;
+  a_pick_buffer_free ( pick->pb );
+  g_array_free ( pick->entries, TRUE );
+  g_free ( pick );
+}
+
+static void trw_layer_pick_clear ( VikTrwLayer *vtl )
+{
+  trw_pick_free ( vtl->track_pick );
+  vtl->track_pick = NULL;
+  trw_pick_free ( vtl->route_pick );
+  vtl->route_pick = NULL;
+}
+
+static gboolean trw_pick_use ( void )
+{
+  static gint use = -1;
+  if ( use == -1 ) {
+    gboolean tmp = TRUE;
+    (void)a_settings_get_boolean ( VIK_SETTINGS_TRW_PICK_BUFFER, &tmp );
+    use = tmp;
+  }
+  return use;
+}
+
+/**
+ * Whether the positions are still those of the viewport as it is now
+ */
+static gboolean trw_pick_valid ( TrwPick *pick, VikViewport *vvp )
+{
+  return pick->vvp == vvp &&
+    pick->width == vik_viewport_get_width ( vvp ) &&
+    pick->height == vik_viewport_get_height ( vvp ) &&
+    pick->xmpp == vik_viewport_get_xmpp ( vvp ) &&
+    pick->ympp == vik_viewport_get_ympp ( vvp ) &&
+    pick->drawmode == vik_viewport_get_drawmode ( vvp ) &&
+    vik_coord_equals ( &pick->center, vik_viewport_get_center ( vvp ) ) &&
+    pick->track_changes == vik_track_get_changes_count ();
+}
+
+static void trw_pick_add_tpl ( GList *tpl, TrwPickTrack *tpt )
+{
+  gint x, y;
+  vik_viewport_coord_to_screen ( tpt->pick->vvp, &(VIK_TRACKPOINT(tpl->data)->coord), &x, &y );
+  if ( a_pick_buffer_set ( tpt->pick->pb, x, y, tpt->pick->entries->len + 1 ) ) {
+    TrwPickEntry entry = { tpt->id, tpt->trk, tpl };
+    g_array_append_val ( tpt->pick->entries, entry );
+  }
+}
+
+static void trw_pick_add_track ( gpointer id, VikTrack *trk, TrwPickTrack *tpt )
+{
+  if ( !trk->visible )
+    return;
+  tpt->id = id;
+  tpt->trk = trk;
+  // The same area test as for searching, but around the whole display
+  TPSearchParams params;
+  params.vvp = tpt->pick->vvp;
+  params.x = tpt->pick->width / 2;
+  params.y = tpt->pick->height / 2;
+  params.size = MAX ( tpt->pick->width, tpt->pick->height ) / 2 + PICK_MARGIN;
+  LatLonBBox bbox = tp_search_bbox ( &params );
+  if ( BBOX_INTERSECT ( trk->bbox, bbox ) )
+    vik_track_foreach_in_bbox ( trk, bbox, (VikTrackTplFunc)trw_pick_add_tpl, tpt );
+}
+
+static TrwPick *trw_pick_new ( GHashTable *tracks, VikViewport *vvp )
+{
+  TrwPick *pick = g_new0 ( TrwPick, 1 );
+  pick->vvp = vvp;
+  pick->width = vik_viewport_get_width ( vvp );
+  pick->height = vik_viewport_get_height ( vvp );
+  pick->xmpp = vik_viewport_get_xmpp ( vvp );
+  pick->ympp = vik_viewport_get_ympp ( vvp );
+  pick->center = *vik_viewport_get_center ( vvp );
+  pick->drawmode = vik_viewport_get_drawmode ( vvp );
+  pick->track_changes = vik_track_get_changes_count ();
+  pick->pb = a_pick_buffer_new ( pick->width, pick->height, PICK_MARGIN );
+  pick->entries = g_array_new ( FALSE, FALSE, sizeof(TrwPickEntry) );
+  TrwPickTrack tpt = { pick, NULL, NULL };
+  g_hash_table_foreach ( tracks, (GHFunc)trw_pick_add_track, &tpt );
+  return pick;
+}
+
+/**
+ * Find the nearest trackpoint of the tracks (or routes) of the layer, in the same way as track_search_closest_tp()
+ *
+ * The first search after drawing records where every trackpoint on display is,
+ *  so subsequent searches (such as when following the pointer) only look at the pixels around the position
+ */
+static void trw_layer_search_closest_tp ( VikTrwLayer *vtl, GHashTable *tracks, TPSearchParams *params )
+{
+  TrwPick **pick = (tracks == vtl->routes) ? &vtl->route_pick : &vtl->track_pick;
+  if ( !trw_pick_use() || params->size > PICK_MARGIN || params->closest_tp ) {
+    g_hash_table_foreach ( tracks, (GHFunc) track_search_closest_tp, params );
+    return;
+  }
+
+  if ( *pick && !trw_pick_valid ( *pick, params->vvp ) ) {
+    trw_pick_free ( *pick );
+    *pick = NULL;
+  }
+  if ( !*pick )
+    *pick = trw_pick_new ( tracks, params->vvp );
 
-    vik_viewport_coord_to_screen ( params->vvp, &(tp->coord), &x, &y );
- 
-    if ( abs (x - params->x) <= params->size && abs (y - params->y) <= params->size &&
-        ((!params->closest_tp) ||        /* was the old trackpoint we already found closer than this one? */
-          abs(x - params->x)+abs(y - params->y) < abs(x - params->closest_x)+abs(y - params->closest_y)))
-    {
-      params->closest_track_id = id;
-      params->closest_tp = tp;
-      params->closest_tpl = tpl;
-      params->closest_x = x;
-      params->closest_y = y;
-    }
-    tpl = tpl->next;
+  gint x, y;
+  guint32 value = a_pick_buffer_closest ( (*pick)->pb, params->x, params->y, params->size, &x, &y );
+  if ( !value )
+    return;
+  TrwPickEntry *entry = &g_array_index ( (*pick)->entries, TrwPickEntry, value - 1 );
+  // Tracks removed or hidden since drawing are no longer wanted, so search properly
+  VikTrack *trk = g_hash_table_lookup ( tracks, entry->id );
+  if ( trk != entry->trk || !trk->visible ) {
+    trw_pick_free ( *pick );
+    *pick = NULL;
+    g_hash_table_foreach ( tracks, (GHFunc) track_search_closest_tp, params );
+    return;
   }
+  params->closest_track_id = entry->id;
+  params->closest_tp = VIK_TRACKPOINT(entry->tpl->data);
+  params->closest_tpl = entry->tpl;
+  params->closest_x = x;
+  params->closest_y = y;
 }
 
 // ATM: Leave this as 'Track' only.
@@ -9721,8 +11791,8 @@ static VikTrackpoint *closest_tp_in_interval ( VikTrwLayer *vtl, VikViewport *vv
   params.vvp = vvp;
   params.closest_track_id = NULL;
   params.closest_tp = NULL;
-  params.bbox = vik_viewport_get_bbox ( params.vvp );
-  g_hash_table_foreach ( vtl->tracks, (GHFunc) track_search_closest_tp, &params);
+  params.bbox = tp_search_bbox ( &params );
+  trw_layer_search_closest_tp ( vtl, vtl->tracks, &params );
   return params.closest_tp;
 }
 
@@ -9825,15 +11895,15 @@ static gboolean trw_layer_select_release ( VikTrwLayer *vtl, GdkEventButton *eve
       vtl->current_wp_id = NULL;
     }
     else {
-      if ( vtl->current_tpl ) {
-        VIK_TRACKPOINT(vtl->current_tpl->data)->coord = new_coord;
-        (void)vik_trackpoint_apply_dem_data ( VIK_TRACKPOINT(vtl->current_tpl->data) );
+      if ( vtl->current_tp.tpl ) {
+        VIK_TRACKPOINT(vtl->current_tp.tpl->data)->coord = new_coord;
+        (void)vik_trackpoint_apply_dem_data ( VIK_TRACKPOINT(vtl->current_tp.tpl->data) );
 
-        if ( vtl->current_tp_track )
-          vik_track_calculate_bounds ( vtl->current_tp_track );
+        if ( vtl->current_tp.trk )
+          vik_track_calculate_bounds ( vtl->current_tp.trk );
 
         if ( vtl->tpwin )
-          if ( vtl->current_tp_track )
+          if ( vtl->current_tp.trk )
             my_tpwin_set_tp ( vtl );
         // NB don't reset the selected trackpoint, thus ensuring it's still in the tpwin
       }
@@ -9882,6 +11952,7 @@ static gboolean trw_layer_select_click ( VikTrwLayer *vtl, GdkEventButton *event
     if ( wp_params.closest_wp )  {
 
       // Select
+      trw_layer_realize_items ( vtl );
       vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, g_hash_table_lookup ( vtl->waypoints_iters, wp_params.closest_wp_id ), TRUE );
 
       // Too easy to move it so must be holding shift to start immediately moving it
@@ -9929,14 +12000,15 @@ static gboolean trw_layer_select_click ( VikTrwLayer *vtl, GdkEventButton *event
   tp_params.closest_track_id = NULL;
   tp_params.closest_tp = NULL;
   tp_params.closest_tpl = NULL;
-  tp_params.bbox = bbox;
+  tp_params.bbox = tp_search_bbox ( &tp_params );
 
   if (vtl->tracks_visible) {
-    g_hash_table_foreach ( vtl->tracks, (GHFunc) track_search_closest_tp, &tp_params);
+    trw_layer_search_closest_tp ( vtl, vtl->tracks, &tp_params );
 
     if ( tp_params.closest_tp )  {
 
       // Always select + highlight the track
+      trw_layer_realize_items ( vtl );
       vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, g_hash_table_lookup ( vtl->tracks_iters, tp_params.closest_track_id ), TRUE );
 
       tet->is_waypoint = FALSE;
@@ -9944,17 +12016,16 @@ static gboolean trw_layer_select_click ( VikTrwLayer *vtl, GdkEventButton *event
       // Select the Trackpoint
       // Can move it immediately when control held or it's the previously selected tp
       if ( event->state & GDK_CONTROL_MASK ||
-	   vtl->current_tpl == tp_params.closest_tpl ) {
+	   vtl->current_tp.tpl == tp_params.closest_tpl ) {
 	// Put into 'move buffer'
 	// NB vvp & vw already set in tet
 	tet->vtl = (gpointer)vtl;
 	marker_begin_move (tet, event->x, event->y);
       }
 
-      vtl->current_tpl = tp_params.closest_tpl;
-      vtl->current_tp_track = g_hash_table_lookup ( vtl->tracks, tp_params.closest_track_id );
+      vik_track_cursor_set ( &vtl->current_tp, g_hash_table_lookup ( vtl->tracks, tp_params.closest_track_id ), tp_params.closest_tpl );
 
-      set_statusbar_msg_info_trkpt ( vtl, tp_params.closest_tp );
+      set_statusbar_msg_info_trkpt ( vtl );
 
       if ( vtl->tpwin )
         my_tpwin_set_tp ( vtl );
@@ -9968,11 +12039,12 @@ static gboolean trw_layer_select_click ( VikTrwLayer *vtl, GdkEventButton *event
 
   // Try again for routes
   if (vtl->routes_visible) {
-    g_hash_table_foreach ( vtl->routes, (GHFunc) track_search_closest_tp, &tp_params);
+    trw_layer_search_closest_tp ( vtl, vtl->routes, &tp_params );
 
     if ( tp_params.closest_tp )  {
 
       // Always select + highlight the track
+      trw_layer_realize_items ( vtl );
       vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, g_hash_table_lookup ( vtl->routes_iters, tp_params.closest_track_id ), TRUE );
 
       tet->is_waypoint = FALSE;
@@ -9980,17 +12052,16 @@ static gboolean trw_layer_select_click ( VikTrwLayer *vtl, GdkEventButton *event
       // Select the Trackpoint
       // Can move it immediately when control held or it's the previously selected tp
       if ( event->state & GDK_CONTROL_MASK ||
-	   vtl->current_tpl == tp_params.closest_tpl ) {
+	   vtl->current_tp.tpl == tp_params.closest_tpl ) {
 	// Put into 'move buffer'
 	// NB vvp & vw already set in tet
 	tet->vtl = (gpointer)vtl;
 	marker_begin_move (tet, event->x, event->y);
       }
 
-      vtl->current_tpl = tp_params.closest_tpl;
-      vtl->current_tp_track = g_hash_table_lookup ( vtl->routes, tp_params.closest_track_id );
+      vik_track_cursor_set ( &vtl->current_tp, g_hash_table_lookup ( vtl->routes, tp_params.closest_track_id ), tp_params.closest_tpl );
 
-      set_statusbar_msg_info_trkpt ( vtl, tp_params.closest_tp );
+      set_statusbar_msg_info_trkpt ( vtl );
 
       if ( vtl->tpwin )
         my_tpwin_set_tp ( vtl );
@@ -10046,6 +12117,7 @@ static gboolean trw_layer_show_selected_viewport_menu ( VikTrwLayer *vtl, GdkEve
 
       if ( trkf && udataU.uuid ) {
 
+        trw_layer_realize_items ( vtl );
         GtkTreeIter *iter;
         if ( track->is_route )
           iter = g_hash_table_lookup ( vtl->routes_iters, udataU.uuid );
@@ -10084,6 +12156,7 @@ static gboolean trw_layer_show_selected_viewport_menu ( VikTrwLayer *vtl, GdkEve
       gpointer wpf = g_hash_table_find ( vtl->waypoints, (GHRFunc) trw_layer_waypoint_find_uuid, (gpointer) &udata );
 
       if ( wpf && udata.uuid ) {
+        trw_layer_realize_items ( vtl );
         GtkTreeIter *iter = g_hash_table_lookup ( vtl->waypoints_iters, udata.uuid );
 
         trw_layer_sublayer_add_menu_items ( vtl,
@@ -10215,6 +12288,7 @@ static VikLayerToolFuncStatus tool_edit_waypoint_click ( VikTrwLayer *vtl, GdkEv
     else
       vtl->waypoint_rightclick = FALSE;
 
+    trw_layer_realize_items ( vtl );
     vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, g_hash_table_lookup ( vtl->waypoints_iters, params.closest_wp_id ), TRUE );
 
     vtl->current_wp = params.closest_wp;
@@ -10302,6 +12376,7 @@ static VikLayerToolFuncStatus tool_edit_waypoint_release ( VikTrwLayer *vtl, Gdk
 
     marker_end_move ( t );
 
+    trw_layer_journal_wp_coord ( vtl, vtl->current_wp, vtl->current_wp_id, &vtl->current_wp->coord );
     vtl->current_wp->coord = new_coord;
 
     trw_layer_calculate_bounds_waypoints ( vtl );
@@ -10315,6 +12390,7 @@ static VikLayerToolFuncStatus tool_edit_waypoint_release ( VikTrwLayer *vtl, Gdk
       g_object_ref_sink ( G_OBJECT(vtl->wp_right_click_menu) );
     if ( vtl->current_wp ) {
       vtl->wp_right_click_menu = GTK_MENU ( gtk_menu_new () );
+      trw_layer_realize_items ( vtl );
       trw_layer_sublayer_add_menu_items ( vtl, vtl->wp_right_click_menu, NULL, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, vtl->current_wp_id, g_hash_table_lookup ( vtl->waypoints_iters, vtl->current_wp_id ), vvp );
       // Using '0' is more reliable for activating submenu items than using 'event->button'.
       // Possibly https://bugzilla.gnome.org/show_bug.cgi?id=695488
@@ -10412,8 +12488,8 @@ void vik_trw_layer_trackpoint_draw ( VikTrwLayer *vtl, VikViewport *vvp, VikTrac
   passalong->drawable = gtk_widget_get_window ( GTK_WIDGET(vvp) );
   passalong->gc = vtl->track_graph_point_gc;
 
-  // NB using g_list_find() is not particularly efficient (to go from a VikTrackpoint* to the GList* entry)
-  //  as it potentially searching the entire list, and this function can be called a lot.
+  // NB going from a VikTrackpoint* to its GList* entry only avoids searching the track
+  //  when it is beside the current trackpoint (see vik_track_cursor_find()), and this function can be called a lot.
   // Hence another reason for the config open
 
   // Don't change the current selected/edit trackpoint if
@@ -10521,14 +12597,14 @@ static void update_statusbar ( VikTrwLayer *vtl )
 static gboolean tool_select_tp ( VikTrwLayer *vtl, TPSearchParams *params, gboolean search_tracks, gboolean search_routes )
 {
   if ( vtl->tracks_visible && search_tracks )
-    g_hash_table_foreach ( vtl->tracks, (GHFunc) track_search_closest_tp, params);
+    trw_layer_search_closest_tp ( vtl, vtl->tracks, params );
 
   if ( params->closest_tp )
   {
+    trw_layer_realize_items ( vtl );
     vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, g_hash_table_lookup ( vtl->tracks_iters, params->closest_track_id ), TRUE );
-    vtl->current_tpl = params->closest_tpl;
-    vtl->current_tp_track = g_hash_table_lookup ( vtl->tracks, params->closest_track_id );
-    set_statusbar_msg_info_trkpt ( vtl, params->closest_tp );
+    vik_track_cursor_set ( &vtl->current_tp, g_hash_table_lookup ( vtl->tracks, params->closest_track_id ), params->closest_tpl );
+    set_statusbar_msg_info_trkpt ( vtl );
     // Selection change only (no change to the layer)
     vik_layer_redraw ( VIK_LAYER(vtl) );
     trw_layer_graph_draw_tp ( vtl );
@@ -10536,14 +12612,14 @@ static gboolean tool_select_tp ( VikTrwLayer *vtl, TPSearchParams *params, gbool
   }
 
   if ( vtl->routes_visible && search_routes )
-    g_hash_table_foreach ( vtl->routes, (GHFunc) track_search_closest_tp, params);
+    trw_layer_search_closest_tp ( vtl, vtl->routes, params );
 
   if ( params->closest_tp )
   {
+    trw_layer_realize_items ( vtl );
     vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, g_hash_table_lookup ( vtl->routes_iters, params->closest_track_id ), TRUE );
-    vtl->current_tpl = params->closest_tpl;
-    vtl->current_tp_track = g_hash_table_lookup ( vtl->routes, params->closest_track_id );
-    set_statusbar_msg_info_trkpt ( vtl, params->closest_tp );
+    vik_track_cursor_set ( &vtl->current_tp, g_hash_table_lookup ( vtl->routes, params->closest_track_id ), params->closest_tpl );
+    set_statusbar_msg_info_trkpt ( vtl );
     // Selection change only (no change to the layer)
     vik_layer_redraw ( VIK_LAYER(vtl) );
     trw_layer_graph_draw_tp ( vtl );
@@ -10564,6 +12640,7 @@ static void tool_select_track ( VikTrwLayer *vtl, VikTrack *trk )
   {
     gpointer trkf = g_hash_table_find ( vtl->routes, (GHRFunc) trw_layer_track_find_uuid, &udata );
     if ( trkf && udata.uuid ) {
+      trw_layer_realize_items ( vtl );
       GtkTreeIter *it = g_hash_table_lookup ( vtl->routes_iters, udata.uuid );
       vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, it, TRUE );
     }
@@ -10572,12 +12649,35 @@ static void tool_select_track ( VikTrwLayer *vtl, VikTrack *trk )
   {
     gpointer trkf = g_hash_table_find ( vtl->tracks, (GHRFunc) trw_layer_track_find_uuid, &udata );
     if ( trkf && udata.uuid ) {
+      trw_layer_realize_items ( vtl );
       GtkTreeIter *it = g_hash_table_lookup ( vtl->tracks_iters, udata.uuid );
       vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, it, TRUE );
     }
   }
 }
 
+/**
+ * Add the trackpoints of a route found onto the end of the route being planned
+ */
+static void trw_layer_route_append_leg ( VikTrack *trk, GList *trackpoints )
+{
+  VikTrack *tr = vik_track_new ();
+  tr->trackpoints = trackpoints;
+  vik_track_remove_dup_points ( tr ); /* make "double point" track work to undo */
+
+  // enforce end of current track equal to start of tr
+  VikTrackpoint *cur_end = vik_track_get_tp_last ( trk );
+  VikTrackpoint *new_start = vik_track_get_tp_first ( tr );
+  if ( cur_end && new_start ) {
+    if ( ! vik_coord_equals ( &cur_end->coord, &new_start->coord ) ) {
+      vik_track_add_trackpoint ( trk, vik_trackpoint_copy ( cur_end ), FALSE );
+    }
+  }
+
+  vik_track_steal_and_append_trackpoints ( trk, tr );
+  vik_track_free ( tr );
+}
+
 // Add route to target to selected route, return TRUE on success
 static gboolean tool_plot_route ( VikTrwLayer *vtl, VikCoord *target )
 {
@@ -10591,8 +12691,6 @@ static gboolean tool_plot_route ( VikTrwLayer *vtl, VikCoord *target )
   vik_coord_to_latlon ( &(tp_start->coord), &start );
   vik_coord_to_latlon ( target, &end );
 
-  vtl->route_finder_append = TRUE;  // merge tracks.
-
   // update UI to let user know what's going on
   VikStatusbar *sb = vik_window_get_statusbar (VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl)));
   VikRoutingEngine *engine = vik_routing_default_engine ( );
@@ -10612,12 +12710,16 @@ static gboolean tool_plot_route ( VikTrwLayer *vtl, VikCoord *target )
   while ( gtk_events_pending ( ) )
     gtk_main_iteration ( );
 
-  gboolean find_status = vik_routing_default_find ( vtl, start, end );
+  GList *trackpoints = vik_routing_find_route ( engine, start, end );
+  gboolean find_status = trackpoints != NULL;
 
   if ( find_status && vtl->current_track ) {
+    trw_layer_route_append_leg ( vtl->current_track, trackpoints );
     gulong chgd = vik_track_apply_dem_data ( vtl->current_track, TRUE );
     g_debug ( "%s %ld points changed for DEM", __FUNCTION__, chgd );
   }
+  else
+    g_list_free_full ( trackpoints, (GDestroyNotify)vik_trackpoint_free );
 
   /* Update UI to say we're done */
   vik_window_clear_busy_cursor ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl)) );
@@ -10632,6 +12734,161 @@ static gboolean tool_plot_route ( VikTrwLayer *vtl, VikCoord *target )
   return find_status;
 }
 
+/*
+ * With the extended route finder each click adds a leg, which is found in the background.
+ * Thus many legs may be asked for at once, with the routes added to the route in order
+ *  as they arrive.
+ */
+typedef struct {
+  VikTrwLayer *vtl; // NULL once the leg is no longer wanted
+  struct LatLon end;
+  gboolean done;
+  GList *trackpoints;
+} RouteLegT;
+
+static void route_leg_free ( RouteLegT *leg )
+{
+  g_list_free_full ( leg->trackpoints, (GDestroyNotify)vik_trackpoint_free );
+  g_free ( leg );
+}
+
+/**
+ * Discard the legs from the given one onwards,
+ *  those still being found are freed when their answer comes
+ */
+static void trw_layer_route_legs_abandon ( VikTrwLayer *vtl, GList *from )
+{
+  for ( GList *gl = from; gl; gl = g_list_next(gl) ) {
+    RouteLegT *leg = gl->data;
+    if ( leg->done )
+      route_leg_free ( leg );
+    else
+      leg->vtl = NULL;
+  }
+  if ( from == vtl->route_legs )
+    vtl->route_legs = NULL;
+  else
+    from->prev->next = NULL;
+  g_list_free ( from );
+
+  if ( !vtl->route_legs && vtl->route_legs_track ) {
+    vik_track_free ( vtl->route_legs_track );
+    vtl->route_legs_track = NULL;
+  }
+}
+
+static void trw_layer_route_legs_message ( VikTrwLayer *vtl, const gchar *msg )
+{
+  // The layer may have been removed meanwhile
+  if ( VIK_LAYER(vtl)->vt )
+    vik_statusbar_set_message ( vik_window_get_statusbar ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl)) ), VIK_STATUSBAR_INFO, msg );
+}
+
+/**
+ * Add the legs found so far onto the route, up to the first one still being found
+ */
+static void trw_layer_route_legs_add ( VikTrwLayer *vtl )
+{
+  // The route is no longer being planned
+  if ( vtl->route_legs && vtl->route_legs_track != vtl->current_track )
+    trw_layer_route_legs_abandon ( vtl, vtl->route_legs );
+
+  gboolean added = FALSE;
+  gboolean failed = FALSE;
+  while ( vtl->route_legs && ((RouteLegT*)vtl->route_legs->data)->done ) {
+    RouteLegT *leg = vtl->route_legs->data;
+    if ( !leg->trackpoints ) {
+      // Later legs carry on from this one, so can't be used either
+      failed = TRUE;
+      break;
+    }
+    vtl->route_legs = g_list_delete_link ( vtl->route_legs, vtl->route_legs );
+    trw_layer_route_append_leg ( vtl->route_legs_track, leg->trackpoints );
+    leg->trackpoints = NULL;
+    route_leg_free ( leg );
+    added = TRUE;
+  }
+
+  if ( added ) {
+    gulong chgd = vik_track_apply_dem_data ( vtl->route_legs_track, TRUE );
+    g_debug ( "%s %ld points changed for DEM", __FUNCTION__, chgd );
+    vik_layer_emit_update ( VIK_LAYER(vtl) );
+  }
+
+  if ( failed ) {
+    trw_layer_route_legs_message ( vtl, _("Error getting route.") );
+    trw_layer_route_legs_abandon ( vtl, vtl->route_legs );
+  }
+  else if ( vtl->route_legs ) {
+    gchar *msg = g_strdup_printf ( _("Waiting for %d route legs."), g_list_length ( vtl->route_legs ) );
+    trw_layer_route_legs_message ( vtl, msg );
+    g_free ( msg );
+  }
+  else {
+    if ( added )
+      trw_layer_route_legs_message ( vtl, _("Route found.") );
+    if ( vtl->route_legs_track ) {
+      vik_track_free ( vtl->route_legs_track );
+      vtl->route_legs_track = NULL;
+    }
+  }
+}
+
+static void trw_layer_route_leg_found ( VikRoutingEngine *engine, GList *trackpoints, RouteLegT *leg )
+{
+  leg->done = TRUE;
+  leg->trackpoints = trackpoints;
+  if ( leg->vtl )
+    trw_layer_route_legs_add ( leg->vtl );
+  else
+    route_leg_free ( leg );
+}
+
+/**
+ * Ask for the route to the target from the end of the route being planned,
+ *  including any legs still being found
+ */
+static gboolean tool_plot_route_leg ( VikTrwLayer *vtl, VikCoord *target )
+{
+  if ( ! vtl->current_track  || ! vtl->current_track->is_route || ! vik_track_get_tp_first ( vtl->current_track ) )
+    return FALSE;
+
+  if ( vtl->route_legs && vtl->route_legs_track != vtl->current_track )
+    trw_layer_route_legs_abandon ( vtl, vtl->route_legs );
+
+  GList *engines = vik_routing_race_engines ( );
+  if ( ! engines ) {
+    trw_layer_route_legs_message ( vtl, "Cannot plan route without a default routing engine." );
+    return FALSE;
+  }
+
+  struct LatLon start;
+  if ( vtl->route_legs )
+    start = ((RouteLegT*)g_list_last ( vtl->route_legs )->data)->end;
+  else
+    vik_coord_to_latlon ( &(vik_track_get_tp_last ( vtl->current_track )->coord), &start );
+
+  RouteLegT *leg = g_malloc0 ( sizeof(RouteLegT) );
+  leg->vtl = vtl;
+  vik_coord_to_latlon ( target, &leg->end );
+  if ( !vtl->route_legs_track ) {
+    vtl->route_legs_track = vtl->current_track;
+    vik_track_ref ( vtl->route_legs_track );
+  }
+  vtl->route_legs = g_list_append ( vtl->route_legs, leg );
+
+  gchar *msg = g_strdup_printf ( _("Querying %s for route between (%.3f, %.3f) and (%.3f, %.3f)."),
+                                 vik_routing_engine_get_label ( VIK_ROUTING_ENGINE(engines->data) ),
+                                 start.lat, start.lon, leg->end.lat, leg->end.lon );
+  trw_layer_route_legs_message ( vtl, msg );
+  g_free ( msg );
+
+  vik_routing_find_route_async ( engines, VIK_GTK_WINDOW_FROM_LAYER(vtl), start, leg->end,
+                                 (VikRoutingResultFunc)trw_layer_route_leg_found, leg );
+  g_list_free ( engines );
+  return TRUE;
+}
+
 
 
 
@@ -10760,10 +13017,8 @@ static void undo_trackpoint_add ( VikTrwLayer *vtl )
 {
   // 'undo'
   if ( vtl->current_track->trackpoints ) {
-    // TODO rework this...
-    //vik_trackpoint_free ( vik_track_get_tp_last (vtl->current_track) );
     GList *last = g_list_last(vtl->current_track->trackpoints);
-    g_free ( last->data );
+    vik_trackpoint_free ( last->data );
     vtl->current_track->trackpoints = g_list_remove_link ( vtl->current_track->trackpoints, last );
 
     vik_track_calculate_bounds ( vtl->current_track );
@@ -10800,13 +13055,13 @@ static gboolean tool_edit_track_key_press ( VikTrwLayer *vtl, GdkEventKey *event
     vik_trw_layer_goto_track_next_point ( vtl );
     return TRUE;
   } else if ( ( event->keyval == GDK_KEY_bracketleft || event->keyval == GDK_KEY_KP_Subtract ) && !mods ) {
-    if ( vtl->current_tp_track ) {
-      trw_layer_insert_tp_beside_current_tp ( vtl, TRUE, vtl->current_tp_track->is_route );
+    if ( vtl->current_tp.trk ) {
+      trw_layer_insert_tp_beside_current_tp ( vtl, TRUE, vtl->current_tp.trk->is_route );
     }
     return TRUE;
   } else if ( ( event->keyval == GDK_KEY_bracketright || event->keyval == GDK_KEY_KP_Add ) && !mods ) {
-    if ( vtl->current_tp_track ) {
-      trw_layer_insert_tp_beside_current_tp ( vtl, FALSE, vtl->current_tp_track->is_route );
+    if ( vtl->current_tp.trk ) {
+      trw_layer_insert_tp_beside_current_tp ( vtl, FALSE, vtl->current_tp.trk->is_route );
     }
     return TRUE;
   }
@@ -10922,13 +13177,12 @@ static gboolean tool_edit_track_or_route_split ( VikTrwLayer *vtl, TPSearchParam
 {
   if ( tool_select_tp ( vtl, params, is_track, ! is_track ) )
   {
-    VikTrack *origin_tp_track = vtl->current_tp_track;
+    VikTrack *origin_tp_track = vtl->current_tp.trk;
 
     trw_layer_split_at_selected_trackpoint ( vtl, is_track ? VIK_TRW_LAYER_SUBLAYER_TRACK : VIK_TRW_LAYER_SUBLAYER_ROUTE );
 
     vtl->current_track = origin_tp_track;
-    vtl->current_tpl = NULL;
-    vtl->current_tp_track = NULL;
+    vik_track_cursor_clear ( &vtl->current_tp );
 
     vik_layer_emit_update(VIK_LAYER(vtl));
     return TRUE;
@@ -10943,35 +13197,40 @@ static VikLayerToolFuncStatus tool_edit_track_or_route_join ( VikTrwLayer *vtl,
   if ( vtl->current_track == NULL )
     return VIK_LAYER_TOOL_IGNORED;
 
+  // The join is made straight away, so must wait until the route has caught up
+  if ( in_route_finder && vtl->route_legs && vtl->route_legs_track == vtl->current_track ) {
+    trw_layer_route_legs_message ( vtl, _("Waiting for route legs before joining.") );
+    return VIK_LAYER_TOOL_IGNORED;
+  }
+
   VikTrack *origin_track = vtl->current_track;
   gboolean is_route = origin_track->is_route;
 
   if ( tool_select_tp ( vtl, params, ! is_route, is_route ) )
   {
     // don't join to self
-    if ( vtl->current_tp_track == origin_track )
+    if ( vtl->current_tp.trk == origin_track )
       return VIK_LAYER_TOOL_IGNORED;
 
     if ( in_route_finder )
     {
-      VikCoord *target = &(VIK_TRACKPOINT(vtl->current_tpl->data)->coord);
+      VikCoord *target = &(VIK_TRACKPOINT(vtl->current_tp.tpl->data)->coord);
       if ( ! tool_plot_route ( vtl, target ) )
         return VIK_LAYER_TOOL_IGNORED;
     }
 
     trw_layer_split_at_selected_trackpoint ( vtl, is_route ? VIK_TRW_LAYER_SUBLAYER_ROUTE : VIK_TRW_LAYER_SUBLAYER_TRACK );
-    vik_track_steal_and_append_trackpoints ( origin_track, vtl->current_tp_track );
-    VIK_TRACKPOINT(vtl->current_tpl->data)->newsegment = FALSE;
+    vik_track_steal_and_append_trackpoints ( origin_track, vtl->current_tp.trk );
+    VIK_TRACKPOINT(vtl->current_tp.tpl->data)->newsegment = FALSE;
 
     if ( is_route )
-      vik_trw_layer_delete_route ( vtl, vtl->current_tp_track );
+      vik_trw_layer_delete_route ( vtl, vtl->current_tp.trk );
     else
-      vik_trw_layer_delete_track ( vtl, vtl->current_tp_track );
+      vik_trw_layer_delete_track ( vtl, vtl->current_tp.trk );
 
     // Leave newly joined track selected
     tool_select_track ( vtl, origin_track );
-    vtl->current_tpl = NULL;
-    vtl->current_tp_track = NULL;
+    vik_track_cursor_clear ( &vtl->current_tp );
 
     vik_layer_emit_update( VIK_LAYER(vtl) );
     return VIK_LAYER_TOOL_ACK;
@@ -11031,7 +13290,7 @@ static VikLayerToolFuncStatus tool_edit_track_or_route_click_dispatch ( VikTrwLa
   params.closest_track_id = NULL;
   params.closest_tp = NULL;
   params.closest_tpl = NULL;
-  params.bbox = vik_viewport_get_bbox ( vvp );
+  params.bbox = tp_search_bbox ( &params );
 
   // if we're not already editing a track/route
   // (is_track == is_route means we want a track, but have a route, or vice versa)
@@ -11143,7 +13402,7 @@ static VikLayerToolFuncStatus tool_edit_trackpoint_click ( VikTrwLayer *vtl, Gdk
   params.closest_track_id = NULL;
   params.closest_tp = NULL;
   params.closest_tpl = NULL;
-  params.bbox = vik_viewport_get_bbox ( vvp );
+  params.bbox = tp_search_bbox ( &params );
 
   if ( event->button != 1 ) 
     return VIK_LAYER_TOOL_IGNORED;
@@ -11154,11 +13413,11 @@ static VikLayerToolFuncStatus tool_edit_trackpoint_click ( VikTrwLayer *vtl, Gdk
   if ( !vtl->vl.visible || !(vtl->tracks_visible || vtl->routes_visible) )
     return VIK_LAYER_TOOL_IGNORED;
 
-  if ( vtl->current_tpl )
+  if ( vtl->current_tp.tpl )
   {
     /* first check if it is within range of prev. tp. and if current_tp track is shown. (if it is, we are moving that trackpoint.) */
-    VikTrackpoint *tp = VIK_TRACKPOINT(vtl->current_tpl->data);
-    VikTrack *current_tr = vtl->current_tp_track;
+    VikTrackpoint *tp = VIK_TRACKPOINT(vtl->current_tp.tpl->data);
+    VikTrack *current_tr = vtl->current_tp.trk;
     if ( !current_tr )
       return VIK_LAYER_TOOL_IGNORED;
 
@@ -11201,10 +13460,10 @@ static VikLayerToolFuncStatus tool_edit_trackpoint_move ( VikTrwLayer *vtl, GdkE
     if ( event->state & GDK_CONTROL_MASK )
     {
       VikTrackpoint *tp = closest_tp_in_interval ( vtl, vvp, event->x, event->y );
-      if ( tp && tp != vtl->current_tpl->data )
+      if ( tp && tp != vtl->current_tp.tpl->data )
         new_coord = tp->coord;
     }
-    //    VIK_TRACKPOINT(vtl->current_tpl->data)->coord = new_coord;
+    //    VIK_TRACKPOINT(vtl->current_tp.tpl->data)->coord = new_coord;
     { 
       gint x, y;
       vik_viewport_coord_to_screen ( vvp, &new_coord, &x, &y );
@@ -11234,19 +13493,22 @@ static VikLayerToolFuncStatus tool_edit_trackpoint_release ( VikTrwLayer *vtl, G
     if ( event->state & GDK_CONTROL_MASK )
     {
       VikTrackpoint *tp = closest_tp_in_interval ( vtl, vvp, event->x, event->y );
-      if ( tp && tp != vtl->current_tpl->data )
+      if ( tp && tp != vtl->current_tp.tpl->data )
         new_coord = tp->coord;
     }
 
-    VIK_TRACKPOINT(vtl->current_tpl->data)->coord = new_coord;
-    if ( vtl->current_tp_track )
-      vik_track_calculate_bounds ( vtl->current_tp_track );
+    VikTrackpoint *tp_moved = VIK_TRACKPOINT(vtl->current_tp.tpl->data);
+    if ( vtl->current_tp.trk )
+      trw_layer_journal_tp_coord ( vtl, vtl->current_tp.trk, tp_moved, &tp_moved->coord );
+    tp_moved->coord = new_coord;
+    if ( vtl->current_tp.trk )
+      vik_track_calculate_bounds ( vtl->current_tp.trk );
 
     marker_end_move ( t );
 
     /* diff dist is diff from orig */
     if ( vtl->tpwin )
-      if ( vtl->current_tp_track )
+      if ( vtl->current_tp.trk )
         my_tpwin_set_tp ( vtl );
 
     vik_layer_emit_update ( VIK_LAYER(vtl) );
@@ -11260,6 +13522,13 @@ static VikLayerToolFuncStatus tool_edit_trackpoint_release ( VikTrwLayer *vtl, G
 
 static void tool_extended_route_finder_undo ( VikTrwLayer *vtl )
 {
+  // Drop the latest leg if still being found
+  if ( vtl->route_legs && vtl->route_legs_track == vtl->current_track ) {
+    trw_layer_route_legs_abandon ( vtl, g_list_last ( vtl->route_legs ) );
+    trw_layer_route_legs_add ( vtl );
+    return;
+  }
+
   VikCoord *new_end;
   new_end = vik_track_cut_back_to_double_point ( vtl->current_track );
   if ( new_end ) {
@@ -11305,7 +13574,7 @@ static VikLayerToolFuncStatus tool_extended_route_finder_click ( VikTrwLayer *vt
       params.closest_track_id = NULL;
       params.closest_tp = NULL;
       params.closest_tpl = NULL;
-      params.bbox = vik_viewport_get_bbox ( vvp );
+      params.bbox = tp_search_bbox ( &params );
 
       (void)tool_edit_track_or_route_join ( vtl, &params, TRUE );
     }
@@ -11313,8 +13582,7 @@ static VikLayerToolFuncStatus tool_extended_route_finder_click ( VikTrwLayer *vt
     {
       VikCoord tmp;
       vik_viewport_screen_to_coord ( vvp, event->x, event->y, &tmp );
-      tool_plot_route ( vtl, &tmp );
-      vik_layer_emit_update ( VIK_LAYER(vtl) );
+      tool_plot_route_leg ( vtl, &tmp );
     }
   } else {
     vtl->current_track = NULL;
@@ -11429,18 +13697,21 @@ typedef struct {
   GSList *pics;     // Image list
 } thumbnail_create_thread_data;
 
-static int create_thumbnails_thread ( thumbnail_create_thread_data *tctd, gpointer threaddata )
+static void create_thumbnail ( gchar *pic, gpointer user_data )
 {
-  guint total = g_slist_length(tctd->pics), done = 0;
-  while ( tctd->pics )
-  {
-    a_thumbnails_create ( (gchar *) tctd->pics->data );
-    int result = a_background_thread_progress ( threaddata, ((gdouble) ++done) / total );
-    if ( result != 0 )
-      return -1; /* Abort thread */
+  a_thumbnails_create ( pic );
+}
 
-    tctd->pics = tctd->pics->next;
-  }
+static int create_thumbnails_thread ( thumbnail_create_thread_data *tctd, gpointer threaddata )
+{
+  // Images are independent, so can be done in parallel
+  GPtrArray *pics = g_ptr_array_new ();
+  for ( GSList *iter = tctd->pics; iter; iter = iter->next )
+    g_ptr_array_add ( pics, iter->data );
+  int result = a_background_thread_parallel ( threaddata, (GFunc)create_thumbnail, pics->pdata, pics->len, NULL, TRUE );
+  g_ptr_array_free ( pics, TRUE );
+  if ( result != 0 )
+    return -1; /* Abort thread */
 
   // Redraw to show the thumbnails as they are now created
   if ( IS_VIK_LAYER(tctd->vtl) )
@@ -11524,7 +13795,9 @@ static void trw_layer_track_alloc_colors ( VikTrwLayer *vtl )
       VIK_TRACK(value)->has_color = TRUE;
     }
 
-    trw_layer_update_treeview ( vtl, VIK_TRACK(value), FALSE );
+    GtkTreeIter *it = g_hash_table_lookup ( vtl->tracks_iters, key );
+    if ( it )
+      trw_layer_update_treeview_iter ( vtl, VIK_TRACK(value), it, FALSE );
 
     ii++;
     if (ii > VIK_TRW_LAYER_TRACK_GCS)
@@ -11546,7 +13819,9 @@ static void trw_layer_track_alloc_colors ( VikTrwLayer *vtl )
       VIK_TRACK(value)->has_color = TRUE;
     }
 
-    trw_layer_update_treeview ( vtl, VIK_TRACK(value), FALSE );
+    GtkTreeIter *it = g_hash_table_lookup ( vtl->routes_iters, key );
+    if ( it )
+      trw_layer_update_treeview_iter ( vtl, VIK_TRACK(value), it, FALSE );
 
     ii = !ii;
   }
@@ -11607,7 +13882,8 @@ void trw_layer_calculate_bounds_tracks ( VikTrwLayer *vtl )
 
 static void trw_layer_sort_all ( VikTrwLayer *vtl )
 {
-  if ( ! VIK_LAYER(vtl)->vt )
+  // Deferred rows get added in order anyway
+  if ( ! VIK_LAYER(vtl)->vt || vtl->items_deferred )
     return;
 
   // Obviously need 2 to tango - sorting with only 1 (or less) is a lonely activity!
@@ -11627,20 +13903,10 @@ static void trw_layer_sort_all ( VikTrwLayer *vtl )
 static gdouble trw_layer_get_timestamp_tracks ( VikTrwLayer *vtl )
 {
   gdouble timestamp = NAN;
-  GList *gl = g_hash_table_get_values ( vtl->tracks );
-  gl = g_list_sort ( gl, vik_track_compare_timestamp );
-  gl = g_list_first ( gl );
-
-  if ( gl ) {
-    // Only need to check the first track as they have been sorted by time
-    VikTrack *trk = (VikTrack*)gl->data;
-    // Assume trackpoints already sorted by time
-    VikTrackpoint *tpt = vik_track_get_tp_first(trk);
-    if ( tpt && !isnan(tpt->timestamp) ) {
-      timestamp = tpt->timestamp;
-    }
-    g_list_free ( gl );
-  }
+  // Assume trackpoints already sorted by time
+  VikTrack *trk = a_track_time_index_get_first ( trw_layer_get_tracks_time_index(vtl), NULL );
+  if ( trk )
+    timestamp = vik_track_get_tp_first(trk)->timestamp;
   return timestamp;
 }
 
@@ -11672,6 +13938,7 @@ static gdouble trw_layer_get_timestamp_waypoints ( VikTrwLayer *vtl )
  */
 static gdouble trw_layer_get_timestamp ( VikTrwLayer *vtl )
 {
+  trw_layer_unpack_tracks ( vtl );
   gdouble timestamp_tracks = trw_layer_get_timestamp_tracks ( vtl );
   gdouble timestamp_waypoints = trw_layer_get_timestamp_waypoints ( vtl );
   // NB routes don't have timestamps - hence they are not considered
@@ -11690,8 +13957,22 @@ static gdouble trw_layer_get_timestamp ( VikTrwLayer *vtl )
   return timestamp_waypoints;
 }
 
+static void trw_layer_post_read_track_task ( VikTrack *trk, gpointer dedupl )
+{
+  if ( GPOINTER_TO_INT(dedupl) ) {
+    gulong count = vik_track_remove_dup_points ( trk );
+    if ( count )
+      g_debug ( "%s: Auto removed %ld duplicate points", __FUNCTION__, count );
+  }
+  vik_track_calculate_bounds ( trk );
+}
+
 static void trw_layer_post_read ( VikTrwLayer *vtl, VikViewport *vvp, gboolean from_file )
 {
+  // Performed once the data is actually loaded
+  if ( vtl->pending_data )
+    return;
+
   if ( VIK_LAYER(vtl)->realized )
     trw_layer_verify_thumbnails ( vtl );
   trw_layer_track_alloc_colors ( vtl );
@@ -11707,18 +13988,17 @@ static void trw_layer_post_read ( VikTrwLayer *vtl, VikViewport *vvp, gboolean f
     }
   }
 
-  if ( vtl->auto_dedupl ) {
-    g_hash_table_iter_init ( &iter, vtl->tracks );
-    while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
-      VikTrack *trk = VIK_TRACK(value);
-      gulong count = vik_track_remove_dup_points(trk);
-      if ( count )
-        g_debug ( "%s: Auto removed %ld duplicate points", __FUNCTION__, count );
-    }
-  }
+  // Each track is independent, so they are deduplicated and have their bounds calculated in parallel
+  VikTaskGroup *group = a_background_tasks_new ();
+  g_hash_table_iter_init ( &iter, vtl->tracks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+    a_background_tasks_add ( group, (GFunc)trw_layer_post_read_track_task, value, GINT_TO_POINTER(vtl->auto_dedupl) );
+  g_hash_table_iter_init ( &iter, vtl->routes );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+    a_background_tasks_add ( group, (GFunc)trw_layer_post_read_track_task, value, GINT_TO_POINTER(FALSE) );
 
   trw_layer_calculate_bounds_waypoints ( vtl );
-  trw_layer_calculate_bounds_tracks ( vtl );
+  a_background_tasks_free ( group );
 
   // Apply treeview sort after loading all the tracks for this layer
   //  (rather than sorted insert on each individual track additional)
@@ -11765,9 +14045,9 @@ VikCoordMode vik_trw_layer_get_coord_mode ( VikTrwLayer *vtl )
 gboolean vik_trw_layer_uniquify ( VikTrwLayer *vtl, VikLayersPanel *vlp )
 {
   if ( vtl && vlp ) {
-    vik_trw_layer_uniquify_tracks ( vtl, vlp, vtl->tracks, TRUE );
-    vik_trw_layer_uniquify_tracks ( vtl, vlp, vtl->routes, FALSE );
-    vik_trw_layer_uniquify_waypoints ( vtl, vlp );
+    trw_layer_names_uniquify ( vtl, vlp, vtl->tracks );
+    trw_layer_names_uniquify ( vtl, vlp, vtl->routes );
+    trw_layer_names_uniquify ( vtl, vlp, vtl->waypoints );
     return TRUE;
   }
   return FALSE;
@@ -11778,19 +14058,31 @@ static void waypoint_convert ( const gpointer id, VikWaypoint *wp, VikCoordMode
   vik_coord_convert ( &(wp->coord), *dest_mode );
 }
 
-static void track_convert ( const gpointer id, VikTrack *tr, VikCoordMode *dest_mode )
+static void track_convert_task ( VikTrack *tr, VikCoordMode *dest_mode )
 {
   vik_track_convert ( tr, *dest_mode );
 }
 
+static void track_convert ( const gpointer id, VikTrack *tr, gpointer pass_along[2] )
+{
+  a_background_tasks_add ( pass_along[0], (GFunc)track_convert_task, tr, pass_along[1] );
+}
+
 static void trw_layer_change_coord_mode ( VikTrwLayer *vtl, VikCoordMode dest_mode )
 {
   if ( vtl->coord_mode != dest_mode )
   {
+    trw_layer_unpack_tracks ( vtl );
+    // The recorded positions are in the old mode
+    trw_layer_journal_clear ( vtl );
     vtl->coord_mode = dest_mode;
+    // Each track is independent, so they are converted in parallel, whilst the waypoints are done here
+    VikTaskGroup *group = a_background_tasks_new ();
+    gpointer pass_along[2] = { group, &dest_mode };
+    g_hash_table_foreach ( vtl->tracks, (GHFunc) track_convert, pass_along );
+    g_hash_table_foreach ( vtl->routes, (GHFunc) track_convert, pass_along );
     g_hash_table_foreach ( vtl->waypoints, (GHFunc) waypoint_convert, &dest_mode );
-    g_hash_table_foreach ( vtl->tracks, (GHFunc) track_convert, &dest_mode );
-    g_hash_table_foreach ( vtl->routes, (GHFunc) track_convert, &dest_mode );
+    a_background_tasks_free ( group );
   }
 }
 
@@ -11806,154 +14098,26 @@ static guint16 trw_layer_get_menu_selection ( VikTrwLayer *vtl )
 
 /* ----------- Downloading maps along tracks --------------- */
 
-static int get_download_area_width(VikViewport *vvp, gdouble zoom_level, struct LatLon *wh)
-{
-  /* TODO: calculating based on current size of viewport */
-  const gdouble w_at_zoom_0_125 = 0.0013;
-  const gdouble h_at_zoom_0_125 = 0.0011;
-  gdouble zoom_factor = zoom_level/0.125;
-
-  wh->lat = h_at_zoom_0_125 * zoom_factor;
-  wh->lon = w_at_zoom_0_125 * zoom_factor;
-
-  return 0;   /* all OK */
-}
-
-static VikCoord *get_next_coord(VikCoord *from, VikCoord *to, struct LatLon *dist, gdouble gradient)
-{
-  if ((dist->lon >= ABS(to->east_west - from->east_west)) &&
-      (dist->lat >= ABS(to->north_south - from->north_south)))
-    return NULL;
-
-  VikCoord *coord = g_malloc(sizeof(VikCoord));
-  coord->mode = VIK_COORD_LATLON;
-
-  if (ABS(gradient) < 1) {
-    if (from->east_west > to->east_west)
-      coord->east_west = from->east_west - dist->lon;
-    else
-      coord->east_west = from->east_west + dist->lon;
-    coord->north_south = gradient * (coord->east_west - from->east_west) + from->north_south;
-  } else {
-    if (from->north_south > to->north_south)
-      coord->north_south = from->north_south - dist->lat;
-    else
-      coord->north_south = from->north_south + dist->lat;
-    coord->east_west = (1/gradient) * (coord->north_south - from->north_south) + from->north_south;
-  }
-
-  return coord;
-}
-
-static GList *add_fillins(GList *list, VikCoord *from, VikCoord *to, struct LatLon *dist)
-{
-  /* TODO: handle virtical track (to->east_west - from->east_west == 0) */
-  gdouble gradient = (to->north_south - from->north_south)/(to->east_west - from->east_west);
-
-  VikCoord *next = from;
-  while (TRUE) {
-    if ((next = get_next_coord(next, to, dist, gradient)) == NULL)
-        break;
-    list = g_list_prepend(list, next);
-  }
-
-  return list;
-}
+// Tiles either side of the track to also get, assuming the usual 256 pixel tiles
+#define DOWNLOAD_ALONG_TRACK_TILES 2
+#define DOWNLOAD_ALONG_TRACK_TILE_PIXELS 256
 
-void vik_track_download_map(VikTrack *tr, VikMapsLayer *vml, VikViewport *vvp, gdouble zoom_level)
+/**
+ * Download the maps as a pre-seed job of a corridor along the track,
+ *  so each tile is only requested once and the download carries on should Viking be stopped
+ */
+static void trw_layer_download_map_along_track ( VikTrack *trk, VikMapsLayer *vml, gdouble zoom_level )
 {
-  typedef struct _Rect {
-    VikCoord tl;
-    VikCoord br;
-    VikCoord center;
-  } Rect;
-#define GLRECT(iter) ((Rect *)((iter)->data))
-
-  struct LatLon wh;
-  GList *rects_to_download = NULL;
-  GList *rect_iter;
-
-  if (get_download_area_width(vvp, zoom_level, &wh))
-    return;
-
-  GList *iter = tr->trackpoints;
-  if (!iter)
-    return;
-
-  gboolean new_map = TRUE;
-  VikCoord *cur_coord, tl, br;
-  Rect *rect;
-  while (iter) {
-    cur_coord = &(VIK_TRACKPOINT(iter->data))->coord;
-    if (new_map) {
-      vik_coord_set_area(cur_coord, &wh, &tl, &br);
-      rect = g_malloc(sizeof(Rect));
-      rect->tl = tl;
-      rect->br = br;
-      rect->center = *cur_coord;
-      rects_to_download = g_list_prepend(rects_to_download, rect);
-      new_map = FALSE;
-      iter = iter->next;
-      continue;
-    }
-    gboolean found = FALSE;
-    for (rect_iter = rects_to_download; rect_iter; rect_iter = rect_iter->next) {
-      if (vik_coord_inside(cur_coord, &GLRECT(rect_iter)->tl, &GLRECT(rect_iter)->br)) {
-        found = TRUE;
-        break;
-      }
-    }
-    if (found)
-        iter = iter->next;
-    else
-      new_map = TRUE;
-  }
-
-  GList *fillins = NULL;
-  /* 'fillin' doesn't work in UTM mode - potentially ending up in massive loop continually allocating memory - hence don't do it */
-  /* seems that ATM the function get_next_coord works only for LATLON */
-  if ( cur_coord->mode == VIK_COORD_LATLON ) {
-    /* fill-ins for far apart points */
-    GList *cur_rect, *next_rect;
-    for (cur_rect = rects_to_download;
-	 (next_rect = cur_rect->next) != NULL;
-	 cur_rect = cur_rect->next) {
-      if ((wh.lon < ABS(GLRECT(cur_rect)->center.east_west - GLRECT(next_rect)->center.east_west)) ||
-	  (wh.lat < ABS(GLRECT(cur_rect)->center.north_south - GLRECT(next_rect)->center.north_south))) {
-	fillins = add_fillins(fillins, &GLRECT(cur_rect)->center, &GLRECT(next_rect)->center, &wh);
-      }
-    }
-  } else
-    g_message("%s: this feature works only in Mercator mode", __FUNCTION__);
-
-  if (fillins) {
-    GList *fiter = fillins;
-    while (fiter) {
-      cur_coord = (VikCoord *)(fiter->data);
-      vik_coord_set_area(cur_coord, &wh, &tl, &br);
-      rect = g_malloc(sizeof(Rect));
-      rect->tl = tl;
-      rect->br = br;
-      rect->center = *cur_coord;
-      rects_to_download = g_list_prepend(rects_to_download, rect);
-      fiter = fiter->next;
-    }
-  }
-
-  for (rect_iter = rects_to_download; rect_iter; rect_iter = rect_iter->next) {
-    vik_maps_layer_download_section (vml, vvp, &(((Rect *)(rect_iter->data))->tl), &(((Rect *)(rect_iter->data))->br), zoom_level);
-  }
-
-  if (fillins) {
-    for (iter = fillins; iter; iter = iter->next)
-      g_free(iter->data);
-    g_list_free(fillins);
-  }
-  if (rects_to_download) {
-    for (rect_iter = rects_to_download; rect_iter; rect_iter = rect_iter->next)
-      g_free(rect_iter->data);
-    g_list_free(rects_to_download);
+  GArray *points = g_array_new ( FALSE, FALSE, sizeof(struct LatLon) );
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+    struct LatLon ll;
+    vik_coord_to_latlon ( &VIK_TRACKPOINT(iter->data)->coord, &ll );
+    g_array_append_val ( points, ll );
   }
+  // Zoom is in metres per pixel
+  if ( points->len )
+    vik_maps_layer_seed ( vml, points, VIK_MAPS_SEED_CORRIDOR, DOWNLOAD_ALONG_TRACK_TILES * DOWNLOAD_ALONG_TRACK_TILE_PIXELS * zoom_level, zoom_level, zoom_level );
+  g_array_free ( points, TRUE );
 }
 
 static void trw_layer_download_map_along_track_cb ( menu_array_sublayer values )
@@ -12011,7 +14175,7 @@ static void trw_layer_download_map_along_track_cb ( menu_array_sublayer values )
   if (!a_dialog_map_n_zoom(VIK_GTK_WINDOW_FROM_LAYER(vtl), map_names, 0, zoomlist, default_zoom, &selected_map, &selected_zoom))
     goto done;
 
-  vik_track_download_map(trk, map_layers[selected_map], vvp, zoom_vals[selected_zoom]);
+  trw_layer_download_map_along_track ( trk, map_layers[selected_map], zoom_vals[selected_zoom] );
 
 done:
   for (i = 0; i < num_maps; i++)
@@ -12023,6 +14187,100 @@ done:
 
 }
 
+/**
+ * Download maps around or within the track for offline use
+ */
+static void trw_layer_seed_maps_cb ( menu_array_sublayer values )
+{
+  gchar *zoomlist[] = {"0.125", "0.25", "0.5", "1", "2", "4", "8", "16", "32", "64", "128", "256", "512", "1024", NULL };
+  gdouble zoom_vals[] = {0.125, 0.25, 0.5, 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024};
+  gint selected_map, zoom_first, zoom_last, default_zoom;
+  gboolean enclosed;
+  gdouble corridor;
+
+  VikTrwLayer *vtl = values[MA_VTL];
+  VikLayersPanel *vlp = values[MA_VLP];
+  VikTrack *trk;
+  if ( GPOINTER_TO_INT (values[MA_SUBTYPE]) == VIK_TRW_LAYER_SUBLAYER_ROUTE )
+    trk = (VikTrack *) g_hash_table_lookup ( vtl->routes, values[MA_SUBLAYER_ID] );
+  else
+    trk = (VikTrack *) g_hash_table_lookup ( vtl->tracks, values[MA_SUBLAYER_ID] );
+  if ( !trk || !trk->trackpoints )
+    return;
+
+  GList *vmls = vik_layers_panel_get_all_layers_of_type ( vlp, VIK_LAYER_MAPS, TRUE ); // Includes hidden map layer types
+  guint num_maps = g_list_length ( vmls );
+  if ( !num_maps ) {
+    a_dialog_error_msg ( VIK_GTK_WINDOW_FROM_LAYER(vtl), _("No map layer in use. Create one first") );
+    return;
+  }
+
+  gchar **map_names = g_malloc_n ( 1 + num_maps, sizeof(gpointer) );
+  VikMapsLayer **map_layers = g_malloc_n ( 1 + num_maps, sizeof(gpointer) );
+  guint nn = 0;
+  for ( GList *iter = vmls; iter; iter = iter->next, nn++ ) {
+    map_layers[nn] = VIK_MAPS_LAYER(iter->data);
+    map_names[nn] = vik_maps_layer_get_map_label ( map_layers[nn] );
+  }
+  map_layers[nn] = NULL;
+  map_names[nn] = NULL;
+
+  VikViewport *vvp = vik_window_viewport ( (VikWindow *)(VIK_GTK_WINDOW_FROM_LAYER(vtl)) );
+  gdouble cur_zoom = vik_viewport_get_zoom ( vvp );
+  for ( default_zoom = 0; default_zoom < G_N_ELEMENTS(zoom_vals); default_zoom++ ) {
+    if ( cur_zoom == zoom_vals[default_zoom] )
+      break;
+  }
+  default_zoom = (default_zoom == G_N_ELEMENTS(zoom_vals)) ? G_N_ELEMENTS(zoom_vals) - 1 : default_zoom;
+
+  if ( a_dialog_map_seed ( VIK_GTK_WINDOW_FROM_LAYER(vtl), map_names, 0, zoomlist, default_zoom,
+                           &selected_map, &zoom_first, &zoom_last, &enclosed, &corridor ) ) {
+    GArray *points = g_array_new ( FALSE, FALSE, sizeof(struct LatLon) );
+    for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+      struct LatLon ll;
+      vik_coord_to_latlon ( &VIK_TRACKPOINT(iter->data)->coord, &ll );
+      g_array_append_val ( points, ll );
+    }
+    vik_maps_layer_seed ( map_layers[selected_map], points,
+                          enclosed ? VIK_MAPS_SEED_POLYGON : VIK_MAPS_SEED_CORRIDOR, corridor,
+                          zoom_vals[zoom_first], zoom_vals[zoom_last] );
+    g_array_free ( points, TRUE );
+  }
+
+  for ( nn = 0; nn < num_maps; nn++ )
+    g_free ( map_names[nn] );
+  g_free ( map_names );
+  g_free ( map_layers );
+  g_list_free ( vmls );
+}
+
+/**
+ * Find tracks in all layers that go inside the route, as when pre-seeding maps enclosed by a route
+ */
+static void trw_layer_tracks_through_route_cb ( menu_array_sublayer values )
+{
+  VikTrwLayer *vtl = values[MA_VTL];
+  VikLayersPanel *vlp = values[MA_VLP];
+  VikTrack *trk = (VikTrack *) g_hash_table_lookup ( vtl->routes, values[MA_SUBLAYER_ID] );
+  if ( !trk )
+    return;
+
+  guint count = vik_track_get_tp_count ( trk );
+  if ( count < 3 ) {
+    a_dialog_error_msg ( VIK_GTK_WINDOW_FROM_LAYER(vtl), _("The route needs at least three points to outline an area.") );
+    return;
+  }
+  struct LatLon *points = g_new ( struct LatLon, count );
+  guint nn = 0;
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next )
+    vik_coord_to_latlon ( &VIK_TRACKPOINT(iter->data)->coord, &points[nn++] );
+  TrackArea *area = a_track_area_new_polygon ( points, count );
+  g_free ( points );
+
+  vik_aggregate_layer_find_tracks_in_area ( vik_layers_panel_get_top_layer(vlp), area, trk->name ? trk->name : _("Route"), trk );
+  a_track_area_free ( area );
+}
+
 /**** lowest waypoint number calculation ***/
 static gint highest_wp_number_name_to_number(const gchar *name) {
   if ( strlen(name) == 3 ) {
@@ -12181,26 +14439,32 @@ static gboolean trw_load_external_layer ( VikTrwLayer *trw )
 {
   g_assert ( trw != NULL && trw->external_file != NULL );
 
-  VikWindow *vw = VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(trw));
+  // Can now be loaded on any query of the layer, so there may not be a window
+  VikWindow *vw = VIK_LAYER(trw)->realized ? VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(trw)) : NULL;
   gchar *extfile_full = util_make_absolute_filename ( trw->external_file, trw->external_dirpath );
   gchar *extfile = extfile_full ? extfile_full : trw->external_file;
 
   gboolean failed = TRUE;
   FILE *ext_f = g_fopen ( extfile, "r" );
   if ( ext_f ) {
-    vik_window_set_busy_cursor ( vw );
+    if ( vw )
+      vik_window_set_busy_cursor ( vw );
 
     gchar *dirpath = g_path_get_dirname ( extfile );
-    failed = ! a_gpx_read_file ( trw, ext_f, dirpath, FALSE );
+    a_gpx_resume_free ( trw->external_resume );
+    failed = ! a_gpx_read_file_resumable ( trw, ext_f, dirpath, &trw->external_resume );
     g_free ( dirpath );
     fclose ( ext_f );
 
-    vik_window_clear_busy_cursor ( vw );
+    if ( vw )
+      vik_window_clear_busy_cursor ( vw );
+
+    trw_layer_external_monitor ( trw );
   }
 
   trw->external_loaded = ! failed;
 
-  if ( failed ) {
+  if ( failed && vw ) {
     gchar *msg = g_strdup_printf ( _("WARNING: issues encountered loading external layer %s from %s"), VIK_LAYER(trw)->name, extfile );
     vik_statusbar_set_message ( vik_window_get_statusbar ( vw ), VIK_STATUSBAR_INFO, msg );
     g_free ( msg );
@@ -12211,8 +14475,120 @@ static gboolean trw_load_external_layer ( VikTrwLayer *trw )
   return ! failed;
 }
 
+static gchar *trw_layer_external_filename ( VikTrwLayer *trw )
+{
+  gchar *extfile_full = util_make_absolute_filename ( trw->external_file, trw->external_dirpath );
+  return extfile_full ? extfile_full : g_strdup ( trw->external_file );
+}
+
+/**
+ * Bring the layer up to date with the external file,
+ *  only reading what has been added when it has just grown
+ */
+static gboolean trw_layer_external_reload ( VikTrwLayer *trw )
+{
+  trw->external_reload_id = 0;
+  gchar *extfile = trw_layer_external_filename ( trw );
+  // If not there then it's probably being replaced, which will be seen as another change
+  FILE *ff = g_fopen ( extfile, "r" );
+  if ( ff ) {
+    if ( trw->external_resume && a_gpx_read_file_resume ( trw->external_resume, ff ) ) {
+      g_debug ( "%s: read on from where %s ended", __FUNCTION__, extfile );
+      trw_layer_tracks_time_index_invalidate ( trw );
+    }
+    else {
+      // Otherwise changed, so start again
+      a_gpx_resume_free ( trw->external_resume );
+      trw->external_resume = NULL;
+      vik_trw_layer_delete_all_waypoints ( trw );
+      vik_trw_layer_delete_all_tracks ( trw );
+      vik_trw_layer_delete_all_routes ( trw );
+      rewind ( ff );
+      gchar *dirpath = g_path_get_dirname ( extfile );
+      if ( ! a_gpx_read_file_resumable ( trw, ff, dirpath, &trw->external_resume ) && VIK_LAYER(trw)->realized ) {
+        gchar *msg = g_strdup_printf ( _("WARNING: issues encountered loading external layer %s from %s"), VIK_LAYER(trw)->name, extfile );
+        vik_statusbar_set_message ( vik_window_get_statusbar ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(trw)) ), VIK_STATUSBAR_INFO, msg );
+        g_free ( msg );
+      }
+      g_free ( dirpath );
+    }
+    fclose ( ff );
+    trw_layer_post_read ( trw, NULL, TRUE );
+    vik_layer_emit_update ( VIK_LAYER(trw) );
+  }
+  g_free ( extfile );
+  return FALSE;
+}
+
+// Loggers may write in several pieces, so wait for the file to settle
+#define EXTERNAL_RELOAD_DELAY_MS 500
+
+static void trw_layer_external_changed_cb ( GFileMonitor *monitor, GFile *file, GFile *other_file, GFileMonitorEvent event, VikTrwLayer *trw )
+{
+  if ( event != G_FILE_MONITOR_EVENT_CHANGED && event != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT && event != G_FILE_MONITOR_EVENT_CREATED )
+    return;
+  if ( trw->external_reload_id )
+    g_source_remove ( trw->external_reload_id );
+  trw->external_reload_id = g_timeout_add ( EXTERNAL_RELOAD_DELAY_MS, (GSourceFunc)trw_layer_external_reload, trw );
+}
+
+/**
+ * Follow changes made by other programs to the file of a read only external layer.
+ * (Those of a writable external layer would clash with the edits in Viking)
+ */
+static void trw_layer_external_monitor ( VikTrwLayer *trw )
+{
+  if ( trw->external_layer != VIK_TRW_LAYER_EXTERNAL_NO_WRITE || trw->external_monitor || !trw->external_file )
+    return;
+  gchar *extfile = trw_layer_external_filename ( trw );
+  GFile *gf = g_file_new_for_path ( extfile );
+  trw->external_monitor = g_file_monitor_file ( gf, G_FILE_MONITOR_NONE, NULL, NULL );
+  if ( trw->external_monitor )
+    g_signal_connect ( trw->external_monitor, "changed", G_CALLBACK(trw_layer_external_changed_cb), trw );
+  g_object_unref ( gf );
+  g_free ( extfile );
+}
+
+static void trw_layer_external_unmonitor ( VikTrwLayer *trw )
+{
+  if ( trw->external_monitor ) {
+    g_file_monitor_cancel ( trw->external_monitor );
+    g_object_unref ( trw->external_monitor );
+    trw->external_monitor = NULL;
+  }
+  if ( trw->external_reload_id ) {
+    g_source_remove ( trw->external_reload_id );
+    trw->external_reload_id = 0;
+  }
+  a_gpx_resume_free ( trw->external_resume );
+  trw->external_resume = NULL;
+}
+
+/**
+ * Read in the layer's items if they have been deferred,
+ *  either from an external file or from a block of a binary .vik file
+ */
 void trw_ensure_layer_loaded ( VikTrwLayer *trw )
 {
+  if ( trw->pending_data ) {
+    // Cleared first as adding the items may trigger redraws
+    GBytes *data = trw->pending_data;
+    trw->pending_data = NULL;
+    gsize length;
+    gconstpointer ptr = g_bytes_get_data ( data, &length );
+    if ( ! a_trwbinary_read_layer ( trw, ptr, length, trw->pending_dirpath ) ) {
+      if ( VIK_LAYER(trw)->realized ) {
+        gchar *msg = g_strdup_printf ( _("WARNING: issues encountered loading layer %s"), VIK_LAYER(trw)->name );
+        vik_statusbar_set_message ( vik_window_get_statusbar ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(trw)) ), VIK_STATUSBAR_INFO, msg );
+        g_free ( msg );
+      }
+    }
+    g_bytes_unref ( data );
+    g_free ( trw->pending_dirpath );
+    trw->pending_dirpath = NULL;
+    trw_layer_post_read ( trw, NULL, TRUE );
+    return;
+  }
   if ( trw->external_layer != VIK_TRW_LAYER_INTERNAL && ! trw->external_loaded ) {
     // set to true for now else the load will trigger redraws that will
     // trigger reloads...
@@ -12226,14 +14602,20 @@ void trw_ensure_layer_loaded ( VikTrwLayer *trw )
 /**
  * Convert layer to an external layer.
  * Set as a read only layer (i.e. don't write back to file by default)
+ *
+ * @resume: If the file was read by a_gpx_read_file_resumable(), this is taken over,
+ *          otherwise the first change to the file means it is read again in full
  */
-void trw_layer_replace_external ( VikTrwLayer *trw, const gchar *external_file )
+void trw_layer_replace_external ( VikTrwLayer *trw, const gchar *external_file, GpxResume *resume )
 {
+  trw_layer_external_unmonitor ( trw );
   trw->external_layer = VIK_TRW_LAYER_EXTERNAL_NO_WRITE;
   trw_update_layer_icon ( trw );
   g_free ( trw->external_file );
   trw->external_file = g_strdup ( external_file );
   trw->external_loaded = TRUE;
+  trw->external_resume = resume;
+  trw_layer_external_monitor ( trw );
 }
 
 static void trw_update_layer_icon ( VikTrwLayer *trw )
@@ -12268,11 +14650,11 @@ static VikLayerToolFuncStatus tool_splitter_click ( VikTrwLayer *vtl, GdkEventBu
   params.closest_track_id = NULL;
   params.closest_tp = NULL;
   params.closest_tpl = NULL;
-  params.bbox = vik_viewport_get_bbox ( vvp );
+  params.bbox = tp_search_bbox ( &params );
 
   if ( tool_select_tp ( vtl, &params, TRUE, TRUE ) )
   {
-    trw_layer_split_at_selected_trackpoint ( vtl, vtl->current_tp_track->is_route ? VIK_TRW_LAYER_SUBLAYER_ROUTE : VIK_TRW_LAYER_SUBLAYER_TRACK );
+    trw_layer_split_at_selected_trackpoint ( vtl, vtl->current_tp.trk->is_route ? VIK_TRW_LAYER_SUBLAYER_ROUTE : VIK_TRW_LAYER_SUBLAYER_TRACK );
     return VIK_LAYER_TOOL_ACK;
   }
 
@@ -79,6 +79,10 @@ VikTRWMetadata *vik_trw_layer_get_metadata ( VikTrwLayer *vtl );
 void vik_trw_layer_set_metadata ( VikTrwLayer *vtl, VikTRWMetadata *metadata );
 
 gpx_version_t vik_trw_layer_get_gpx_version ( VikTrwLayer *vtl );
+gboolean vik_trw_layer_is_external ( VikTrwLayer *vtl );
+void vik_trw_layer_set_pending_data ( VikTrwLayer *vtl, GBytes *data, const gchar *dirpath );
+GBytes *vik_trw_layer_get_pending_data ( VikTrwLayer *vtl );
+void vik_trw_layer_detach_pending_data ( VikTrwLayer *vtl );
 void vik_trw_layer_set_gpx_version ( VikTrwLayer *vtl, gpx_version_t value );
 gchar *vik_trw_layer_get_gpx_header ( VikTrwLayer *vtl );
 void vik_trw_layer_set_gpx_header ( VikTrwLayer *vtl, gchar* value );
@@ -101,6 +105,7 @@ gint vik_trw_layer_get_property_tracks_line_thickness ( VikTrwLayer *vtl );
 void vik_trw_layer_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp );
 void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t );
 void vik_trw_layer_add_route ( VikTrwLayer *vtl, gchar *name, VikTrack *t );
+VikTrwLayer *vik_trw_layer_new_view ( VikTrwLayer *vtl, VikViewport *vvp );
 
 // Waypoint returned is the first one
 VikWaypoint *vik_trw_layer_get_waypoint ( VikTrwLayer *vtl, const gchar *name );
@@ -139,6 +144,10 @@ void vik_trw_layer_draw_highlight ( VikTrwLayer *vtl, VikViewport *vvp );
 void vik_trw_layer_draw_highlight_item ( VikTrwLayer *vtl, VikTrack *trk, VikWaypoint *wpt, VikViewport *vvp );
 void vik_trw_layer_draw_highlight_items ( VikTrwLayer *vtl, GHashTable *trks, GHashTable *wpts, VikViewport *vvp );
 
+guint vik_trw_layer_count_tracks_in_view ( VikTrwLayer *vtl, VikViewport *vvp );
+gboolean vik_trw_layer_lod_wanted ( VikViewport *vvp, guint tracks_in_view );
+void vik_trw_layer_set_lod_forced ( VikTrwLayer *vtl, gboolean forced );
+
 // E.g for creating a list of tracks with the corresponding layer it is in
 //  (thus a selection of tracks may be from differing layers)
 typedef struct {
@@ -183,7 +192,7 @@ void trw_layer_dialog_shift ( VikTrwLayer *vtl, GtkWindow *dialog, VikCoord *coo
 void trw_layer_tpwin_init ( VikTrwLayer *vtl );
 gboolean trw_layer_tpwin_is_shown ( VikTrwLayer *vtl );
 
-void trw_layer_replace_external ( VikTrwLayer *vtl, const gchar *external_file );
+void trw_layer_replace_external ( VikTrwLayer *vtl, const gchar *external_file, struct _GpxResume *resume );
 void trw_ensure_layer_loaded ( VikTrwLayer *trw );
 
 typedef struct {
@@ -206,6 +215,15 @@ GHashTable *vik_trw_layer_get_waypoints_iters ( VikTrwLayer *vtl );
 
 void vik_trw_layer_trackpoint_draw ( VikTrwLayer *vtl, VikViewport *vvp, VikTrack *trk, VikTrackpoint *tpt );
 
+// Copies of items held by the clipboard within this process
+gpointer vik_trw_layer_copy_shared_item ( VikTrwLayer *vtl, gint subtype, gpointer sublayer );
+void vik_trw_layer_marshall_shared_item ( gint subtype, gpointer item, guint8 **data, guint *len );
+gboolean vik_trw_layer_paste_shared_item ( VikTrwLayer *vtl, gint subtype, gpointer item );
+void vik_trw_layer_free_shared_item ( gint subtype, gpointer item );
+
+// Make a change recorded for autosave
+gboolean vik_trw_layer_replay ( VikTrwLayer *vtl, GVariant *record );
+
 #define VIK_SETTINGS_LIST_DATE_FORMAT "list_date_format"
 
 typedef enum _VikTRWDataType
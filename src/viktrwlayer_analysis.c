@@ -24,6 +24,7 @@
 #include "viking.h"
 #include "viktrwlayer_analysis.h"
 #include "viktrwlayer_tracklist.h"
+#include "background.h"
 
 // Units of each item are in SI Units
 // (as returned by the appropriate internal viking track functions)
@@ -128,12 +129,14 @@ static void val_analyse_track ( VikTrack *trk, gboolean include_no_times )
 	//gulong   trackpoints = vik_track_get_tp_count (trk);
 	//guint    segments    = vik_track_get_segment_count (trk);
 
-	gdouble t1 = NAN;
+	// Gather all the values in one go (and remembered for next time), as this may be looking at very many trackpoints
+	VikTrackSummary summary;
+	vik_track_get_summary ( trk, &summary );
 
 	// NB Subsecond resolution not needed, as just using the timestamp to get dates
-	if ( trk->trackpoints && !isnan(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp) ) {
-		t1 = VIK_TRACKPOINT(g_list_first(trk->trackpoints)->data)->timestamp;
-		gdouble t2 = VIK_TRACKPOINT(g_list_last(trk->trackpoints)->data)->timestamp;
+	gdouble t1 = summary.start_time;
+	if ( !isnan(t1) ) {
+		gdouble t2 = summary.end_time;
 
 		// Initialize to the first or smallest/largest value
 		for (guint ii = 0; ii < G_N_ELEMENTS(tracks_stats); ii++) {
@@ -167,8 +170,8 @@ static void val_analyse_track ( VikTrack *trk, gboolean include_no_times )
 
 		tracks_stats[TS_TRACKS].count++;
 
-		length    = vik_track_get_length (trk);
-		max_speed = vik_track_get_max_speed (trk);
+		length    = summary.length;
+		max_speed = summary.max_speed;
 
 		// NB A route shouldn't have times anyway
 		if ( !trk->is_route ) {
@@ -195,7 +198,9 @@ static void val_analyse_track ( VikTrack *trk, gboolean include_no_times )
 				tracks_stats[ii].max_speed = max_speed;
 		}
 
-		if ( vik_track_get_minmax_alt (trk, &min_alt, &max_alt) ) {
+		min_alt = summary.min_alt;
+		max_alt = summary.max_alt;
+		if ( summary.has_alt ) {
 			for (ii = 0; ii < G_N_ELEMENTS(tracks_stats); ii++) {
 				if ( min_alt < tracks_stats[ii].min_alt )
 					tracks_stats[ii].min_alt = min_alt;
@@ -204,7 +209,8 @@ static void val_analyse_track ( VikTrack *trk, gboolean include_no_times )
 			}
 		}
 
-		vik_track_get_total_elevation_gain (trk, &up, &down );
+		up = summary.elev_up;
+		down = summary.elev_down;
 
 		for (ii = 0; ii < G_N_ELEMENTS(tracks_stats); ii++) {
 			tracks_stats[ii].elev_gain += up;
@@ -245,18 +251,19 @@ static void val_analyse_track ( VikTrack *trk, gboolean include_no_times )
  */
 static void val_analyse_track_by_months ( VikTrack *trk )
 {
-	// NB Subsecond resolution not needed, as just using the timestamp to get dates
-	if ( trk->trackpoints && !isnan(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp) ) {
-		gdouble t1 = VIK_TRACKPOINT(g_list_first(trk->trackpoints)->data)->timestamp;
+	VikTrackSummary summary;
+	vik_track_get_summary ( trk, &summary );
 
+	// NB Subsecond resolution not needed, as just using the timestamp to get dates
+	if ( !isnan(summary.start_time) ) {
 		GDate* gdate = g_date_new ();
-		g_date_set_time_t ( gdate, (time_t)t1 );
+		g_date_set_time_t ( gdate, (time_t)summary.start_time );
 		GDateMonth mon = g_date_get_month ( gdate );
 		g_date_free ( gdate );
 
 		if ( mon != G_DATE_BAD_MONTH ) {
 			tracks_months[mon-1].count++;
-			tracks_months[mon-1].length += vik_track_get_length (trk);
+			tracks_months[mon-1].length += summary.length;
 		}
 		else
 			g_warning ("%s: Bad month %s", __FUNCTION__, trk->name );
@@ -483,34 +490,84 @@ typedef struct {
 } track_options_t;
 
 /**
- * val_analyse_item_maybe:
+ * val_track_included:
  * @vtlist: A track and the associated layer to consider for analysis
- * @data:   Whether to include invisible items
+ * @include_invisible: Whether to include invisible items
  *
- * Analyse this particular track
- *  considering whether it should be included depending on it's visibility
+ * Returns: Whether this track should be analysed, depending on it's visibility
  */
-static void val_analyse_item_maybe ( vik_trw_and_track_t *vtlist, const gpointer data )
+static gboolean val_track_included ( vik_trw_and_track_t *vtlist, gboolean include_invisible )
 {
-	track_options_t *tot = (track_options_t*)data;
 	VikTrack *trk = vtlist->trk;
 	VikTrwLayer *vtl = vtlist->vtl;
 
 	// Safety first - items shouldn't be deleted...
-	if ( !IS_VIK_TRW_LAYER(vtl) ) return;
-	if ( !trk ) return;
+	if ( !IS_VIK_TRW_LAYER(vtl) ) return FALSE;
+	if ( !trk ) return FALSE;
 
-	if ( !tot->include_invisible ) {
+	if ( !include_invisible ) {
 		// Skip invisible layers or sublayers
 		if ( !VIK_LAYER(vtl)->visible ||
 			 (trk->is_route && !vik_trw_layer_get_routes_visibility(vtl)) ||
 			 (!trk->is_route && !vik_trw_layer_get_tracks_visibility(vtl)) )
-			return;
+			return FALSE;
 
 		// Skip invisible tracks
 		if ( !trk->visible )
-			return;
+			return FALSE;
 	}
+	return TRUE;
+}
+
+static void val_summary_thread ( VikTrack *trk, gpointer user_data )
+{
+	VikTrackSummary summary;
+	vik_track_get_summary ( trk, &summary );
+}
+
+/**
+ * val_prepare_summaries:
+ *
+ * Get the summaries of all the tracks to be analysed that are not already known,
+ *  spread across all CPUs, so the analysis itself is then just combining the summaries
+ */
+static void val_prepare_summaries ( GList *tracks_and_layers, gboolean include_invisible )
+{
+	guint n_threads = util_get_number_of_cpus ();
+	if ( n_threads < 2 )
+		return;
+
+	VikTaskGroup *group = NULL;
+	for ( GList *gl = g_list_first(tracks_and_layers); gl; gl = gl->next ) {
+		vik_trw_and_track_t *vtlist = (vik_trw_and_track_t*)gl->data;
+		if ( !val_track_included ( vtlist, include_invisible ) )
+			continue;
+		// NB each track only occurs once in the list, so only one thread computes any given summary
+		if ( vtlist->trk->summary )
+			continue;
+		if ( !group )
+			group = a_background_tasks_new ();
+		a_background_tasks_add ( group, (GFunc)val_summary_thread, vtlist->trk, NULL );
+	}
+	if ( group )
+		a_background_tasks_free ( group );
+}
+
+/**
+ * val_analyse_item_maybe:
+ * @vtlist: A track and the associated layer to consider for analysis
+ * @data:   Whether to include invisible items
+ *
+ * Analyse this particular track
+ *  considering whether it should be included depending on it's visibility
+ */
+static void val_analyse_item_maybe ( vik_trw_and_track_t *vtlist, const gpointer data )
+{
+	track_options_t *tot = (track_options_t*)data;
+	VikTrack *trk = vtlist->trk;
+
+	if ( !val_track_included ( vtlist, tot->include_invisible ) )
+		return;
 
 	val_analyse_track ( trk, tot->include_no_times );
 }
@@ -527,29 +584,16 @@ static void val_analyse_item_by_months ( vik_trw_and_track_t *vtlist, const gpoi
 {
 	track_options_t *tot = (track_options_t*)data;
 	VikTrack *trk = vtlist->trk;
-	VikTrwLayer *vtl = vtlist->vtl;
 
-	// Safety first - items shouldn't be deleted...
-	if ( !IS_VIK_TRW_LAYER(vtl) ) return;
-	if ( !trk ) return;
-
-	if ( !tot->include_invisible ) {
-		// Skip invisible layers or sublayers
-		if ( !VIK_LAYER(vtl)->visible ||
-			 (trk->is_route && !vik_trw_layer_get_routes_visibility(vtl)) ||
-			 (!trk->is_route && !vik_trw_layer_get_tracks_visibility(vtl)) )
-			return;
-
-		// Skip invisible tracks
-		if ( !trk->visible )
-			return;
-	}
+	if ( !val_track_included ( vtlist, tot->include_invisible ) )
+		return;
 
 	// Is the track of this year?
-	if ( trk->trackpoints && !isnan(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp) ) {
-		gdouble t1 = VIK_TRACKPOINT(g_list_first(trk->trackpoints)->data)->timestamp;
+	VikTrackSummary summary;
+	vik_track_get_summary ( trk, &summary );
+	if ( !isnan(summary.start_time) ) {
 		GDate* gdate = g_date_new ();
-		g_date_set_time_t ( gdate, (time_t)t1 );
+		g_date_set_time_t ( gdate, (time_t)summary.start_time );
 		guint trk_year = g_date_get_year ( gdate );
 		g_date_free ( gdate );
 
@@ -581,6 +625,8 @@ static void val_analyse ( GtkWidget *widgets[], GList *tracks_and_layers, gboole
 		g_date_free ( gdate );
 	}
 
+	val_prepare_summaries ( tracks_and_layers, include_invisible );
+
 	track_options_t *tot = g_malloc0 (sizeof(track_options_t));
 	tot->include_invisible = include_invisible;
 	tot->include_no_times  = include_no_times;
@@ -607,6 +653,7 @@ static void val_analyse ( GtkWidget *widgets[], GList *tracks_and_layers, gboole
 static void val_analyse_months ( GList *tracks_and_layers, guint year, gboolean include_invisible )
 {
 	val_reset_months ( );
+	val_prepare_summaries ( tracks_and_layers, include_invisible );
 
 	track_options_t *tot = g_malloc0 (sizeof(track_options_t));
 	tot->include_invisible = include_invisible;
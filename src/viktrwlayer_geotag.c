@@ -26,6 +26,7 @@
 #include "viking.h"
 #include "vikfilelist.h"
 #include "geotag_exif.h"
+#include "geotagindex.h"
 #include "thumbnails.h"
 #include "background.h"
 
@@ -135,19 +136,30 @@ typedef struct {
 	VikTrwLayer *vtl;
 	gchar *image;
 	VikWaypoint *wpt;    // Use specified waypoint or otherwise the track(s) if NULL
-	VikTrack *track;     // Use specified track or all tracks if NULL
+	// Snapshots of the track(s) taken at the start, as the layer may be changed whilst the thread runs
+	GPtrArray *tracks;
+	VikTrackSnapshot *wpts_track; // The waypoints as a track, when all tracks are used
 	// User options...
 	option_values_t ov;
 	GList *files;
+	// If anything has changed
+	gboolean redraw;
+} geotag_options_t;
+
+// An image being geotagged, with its EXIF values as read in advance
+typedef struct {
+	gchar *image;
+	gchar *datetime;
+	gboolean has_gps;
+	// The match against the tracks
 	time_t PhotoTime;
-	// Store answer from interpolation for an image
 	gboolean found_match;
 	VikCoord coord;
 	gdouble altitude;
 	gdouble image_direction;
-	// If anything has changed
-	gboolean redraw;
-} geotag_options_t;
+	// Whether to write the position into the image
+	gboolean write_exif;
+} geotag_exif_t;
 
 #define VIK_SETTINGS_GEOTAG_CREATE_WAYPOINT      "geotag_create_waypoints"
 #define VIK_SETTINGS_GEOTAG_OVERWRITE_WAYPOINTS  "geotag_overwrite_waypoints"
@@ -211,105 +223,160 @@ static option_values_t get_default_values ( )
  *
  * Try using the adjacent trkpoints to get a direction
  */
-static gdouble get_heading_from_trackpoint ( GList *mytrkpt )
+static gdouble get_heading_from_trackpoint ( const VikTrackSnapshot *snap, guint pos )
 {
-	VikTrackpoint *trkpt = VIK_TRACKPOINT(mytrkpt->data);
+	const VikTrackSnapshotPoint *trkpt = &snap->points[pos];
 
-	if ( mytrkpt->prev )
-		return vik_coord_angle ( &VIK_TRACKPOINT(mytrkpt->prev->data)->coord, &trkpt->coord );
-	else if ( mytrkpt->next )
-		return vik_coord_angle ( &trkpt->coord, &VIK_TRACKPOINT(mytrkpt->prev->data)->coord );
+	if ( pos > 0 )
+		return vik_coord_angle ( &snap->points[pos-1].coord, &trkpt->coord );
+	else if ( pos + 1 < snap->n_points )
+		return vik_coord_angle ( &trkpt->coord, &snap->points[pos+1].coord );
 
 	// In the unlikely event of a single trackpoint track - can't guess a direction
 	return NAN;
 }
 
+// A time span of a track, either a single trackpoint or between two trackpoints
+typedef struct {
+	gdouble t0, t1;
+	const VikTrackSnapshot *snap;
+	guint first;
+	gboolean pair; // Between first and the next trackpoint, otherwise just the first
+	guint64 order; // Precedence should several spans match, by track and then position within it
+} geotag_span_t;
+
 /**
- * Correlate the image against the specified track
+ * Add the time spans of the track that images may be correlated against
  */
-static void trw_layer_geotag_track ( const gpointer id, VikTrack *track, geotag_options_t *options )
+static void geotag_timeline_add_track ( GArray *spans, const VikTrackSnapshot *snap, guint track_index, gboolean interpolate_segments )
 {
-	// If already found match then don't need to check this track
-	if ( options->found_match )
-		return;
-
-	VikTrackpoint *trkpt;
-	VikTrackpoint *trkpt_next;
-
-	GList *mytrkpt;
-	for ( mytrkpt = track->trackpoints; mytrkpt; mytrkpt = mytrkpt->next ) {
-
-		// Do something for this trackpoint...
+	for ( guint pos = 0; pos < snap->n_points; pos++ ) {
+		const VikTrackSnapshotPoint *trkpt = &snap->points[pos];
+		if ( isnan(trkpt->timestamp) )
+			continue;
 
-		trkpt = VIK_TRACKPOINT(mytrkpt->data);
+		// Exactly this point
+		geotag_span_t span = { trkpt->timestamp, trkpt->timestamp, snap, pos, FALSE, ((guint64)track_index << 32) | (pos * 2) };
+		g_array_append_val ( spans, span );
 
-		if ( isnan(trkpt->timestamp) ) {
+		// Now need two trackpoints, hence check next is available
+		if ( pos + 1 >= snap->n_points )
+			break;
+		const VikTrackSnapshotPoint *trkpt_next = &snap->points[pos+1];
+		if ( isnan(trkpt_next->timestamp) )
+			continue;
+		if ( trkpt->timestamp >= trkpt_next->timestamp )
+			continue;
+		// When interpolating between segments, no need for any special segment handling
+		if ( !interpolate_segments && trkpt_next->newsegment )
 			continue;
-		}
 
-		// is it exactly this point?
-		if ( options->PhotoTime == trkpt->timestamp ) {
-			options->coord = trkpt->coord;
-			options->altitude = trkpt->altitude;
-			options->found_match = TRUE;
-			if ( options->ov.auto_image_direction )
-				options->image_direction = get_heading_from_trackpoint ( mytrkpt );
-			break;
-		}
+		geotag_span_t pair = { trkpt->timestamp, trkpt_next->timestamp, snap, pos, TRUE, ((guint64)track_index << 32) | (pos * 2 + 1) };
+		g_array_append_val ( spans, pair );
+	}
+}
 
-		// Now need two trackpoints, hence check next is available
-		if ( !mytrkpt->next ) break;
-		trkpt_next = VIK_TRACKPOINT(mytrkpt->next->data);
+static gint geotag_span_compare ( gconstpointer a, gconstpointer b )
+{
+	const geotag_span_t *sa = a;
+	const geotag_span_t *sb = b;
+	if ( sa->t0 != sb->t0 )
+		return sa->t0 < sb->t0 ? -1 : 1;
+	return sa->order < sb->order ? -1 : (sa->order > sb->order ? 1 : 0);
+}
 
-		if ( isnan(trkpt_next->timestamp) ) continue;
-		if ( trkpt->timestamp == trkpt_next->timestamp ) continue;
-		if ( trkpt->timestamp > trkpt_next->timestamp ) continue;
+static gint geotag_photo_compare ( gconstpointer a, gconstpointer b )
+{
+	const geotag_exif_t *ea = *(geotag_exif_t**)a;
+	const geotag_exif_t *eb = *(geotag_exif_t**)b;
+	return ea->PhotoTime < eb->PhotoTime ? -1 : (ea->PhotoTime > eb->PhotoTime ? 1 : 0);
+}
 
-		// When interpolating between segments, no need for any special segment handling
-		if ( !options->ov.interpolate_segments )
-			// Don't check between segments
-			if ( trkpt_next->newsegment )
-				// Simply move on to consider next point
-				continue;
+static void geotag_apply_span ( geotag_exif_t *photo, geotag_span_t *span, gboolean auto_image_direction )
+{
+	const VikTrackSnapshotPoint *trkpt = &span->snap->points[span->first];
+	photo->found_match = TRUE;
+
+	if ( !span->pair ) {
+		photo->coord = trkpt->coord;
+		photo->altitude = trkpt->altitude;
+		if ( auto_image_direction )
+			photo->image_direction = get_heading_from_trackpoint ( span->snap, span->first );
+		return;
+	}
 
-		// Too far
-		if ( trkpt->timestamp > options->PhotoTime ) break;
+	const VikTrackSnapshotPoint *trkpt_next = &span->snap->points[span->first+1];
+	// Interpolate
+	/* Calculate the "scale": a decimal giving the relative distance
+	 * in time between the two points. Ie, a number between 0 and 1 -
+	 * 0 is the first point, 1 is the next point, and 0.5 would be
+	 * half way. */
+	gdouble tdiff = (gdouble)trkpt_next->timestamp - (gdouble)trkpt->timestamp;
+	gdouble scale = ((gdouble)photo->PhotoTime - (gdouble)trkpt->timestamp) / tdiff;
 
-		// Is is between this and the next point?
-		if ( (options->PhotoTime > trkpt->timestamp) && (options->PhotoTime < trkpt_next->timestamp) ) {
-			options->found_match = TRUE;
-			// Interpolate
-			/* Calculate the "scale": a decimal giving the relative distance
-			 * in time between the two points. Ie, a number between 0 and 1 -
-			 * 0 is the first point, 1 is the next point, and 0.5 would be
-			 * half way. */
-			gdouble tdiff = (gdouble)trkpt_next->timestamp - (gdouble)trkpt->timestamp;
-			gdouble scale = ((gdouble)options->PhotoTime - (gdouble)trkpt->timestamp) / tdiff;
+	photo->PhotoTime = photo->PhotoTime + (time_t)(tdiff * scale);
 
-			options->PhotoTime = options->PhotoTime + (time_t)(tdiff * scale);
+	struct LatLon ll_result, ll1, ll2;
 
-			struct LatLon ll_result, ll1, ll2;
+	vik_coord_to_latlon ( &(trkpt->coord), &ll1 );
+	vik_coord_to_latlon ( &(trkpt_next->coord), &ll2 );
 
-			vik_coord_to_latlon ( &(trkpt->coord), &ll1 );
-			vik_coord_to_latlon ( &(trkpt_next->coord), &ll2 );
+	ll_result.lat = ll1.lat + ((ll2.lat - ll1.lat) * scale);
 
-			ll_result.lat = ll1.lat + ((ll2.lat - ll1.lat) * scale);
+	// NB This won't cope with going over the 180 degrees longitude boundary
+	ll_result.lon = ll1.lon + ((ll2.lon - ll1.lon) * scale);
 
-			// NB This won't cope with going over the 180 degrees longitude boundary
-			ll_result.lon = ll1.lon + ((ll2.lon - ll1.lon) * scale);
+	// set coord
+	vik_coord_load_from_latlon ( &(photo->coord), VIK_COORD_LATLON, &ll_result );
 
-			// set coord
-			vik_coord_load_from_latlon ( &(options->coord), VIK_COORD_LATLON, &ll_result );
+	// Interpolate elevation
+	photo->altitude = trkpt->altitude + ((trkpt_next->altitude - trkpt->altitude) * scale);
 
-			// Interpolate elevation
-			options->altitude = trkpt->altitude + ((trkpt_next->altitude - trkpt->altitude) * scale);
+	if ( auto_image_direction )
+		photo->image_direction = vik_coord_angle ( &trkpt->coord, &trkpt_next->coord );
+}
 
-			if ( options->ov.auto_image_direction )
-				options->image_direction = vik_coord_angle ( &trkpt->coord, &trkpt_next->coord );
+/**
+ * Correlate the images against the time spans
+ *
+ * Both are in time order so this is a single pass through them together,
+ *  with the spans that have started but not yet ended kept as the candidates for each image
+ */
+static void geotag_timeline_match ( GArray *spans, GPtrArray *photos, gboolean auto_image_direction )
+{
+	g_array_sort ( spans, geotag_span_compare );
+	g_ptr_array_sort ( photos, geotag_photo_compare );
+
+	GPtrArray *active = g_ptr_array_new ();
+	guint next_span = 0;
+	for ( guint pp = 0; pp < photos->len; pp++ ) {
+		geotag_exif_t *photo = g_ptr_array_index ( photos, pp );
+		const gdouble when = (gdouble)photo->PhotoTime;
+
+		while ( next_span < spans->len && g_array_index(spans, geotag_span_t, next_span).t0 <= when ) {
+			g_ptr_array_add ( active, &g_array_index(spans, geotag_span_t, next_span) );
+			next_span++;
+		}
 
-			break;
+		geotag_span_t *best = NULL;
+		guint ii = 0;
+		while ( ii < active->len ) {
+			geotag_span_t *span = g_ptr_array_index ( active, ii );
+			// Images are in time order, so once finished a span can't match any later ones
+			if ( span->t1 < when ) {
+				g_ptr_array_remove_index_fast ( active, ii );
+				continue;
+			}
+			gboolean matches = span->pair ? (span->t0 < when && when < span->t1) : (span->t0 == when);
+			if ( matches && (!best || span->order < best->order) )
+				best = span;
+			ii++;
 		}
+
+		if ( best )
+			geotag_apply_span ( photo, best, auto_image_direction );
 	}
+	g_ptr_array_free ( active, TRUE );
 }
 
 /**
@@ -319,10 +386,10 @@ static void trw_layer_geotag_waypoint ( geotag_options_t *options )
 {
 	// Write EXIF if specified - although a fairly useless process if you've turned it off!
 	if ( options->ov.write_exif ) {
-		gboolean has_gps_exif = FALSE;
-		gchar* datetime = a_geotag_get_exif_date_from_file ( options->image, &has_gps_exif );
+		geotag_info_t info;
+		a_geotag_index_get ( options->image, &info );
 		// If image already has gps info - don't attempt to change it unless forced
-		if ( options->ov.overwrite_gps_exif || !has_gps_exif ) {
+		if ( options->ov.overwrite_gps_exif || !info.has_gps ) {
 			gint ans = a_geotag_write_exif_gps ( options->image, options->wpt->coord, options->wpt->altitude,
 			                                     options->wpt->image_direction, options->wpt->image_direction_ref,
 			                                     options->ov.no_change_mtime );
@@ -332,21 +399,22 @@ static void trw_layer_geotag_waypoint ( geotag_options_t *options )
 				g_free ( message );
 			}
 		}
-		g_free ( datetime );
+		a_geotag_info_clear ( &info );
 	}
 }
 
 /**
  * Backup method for the unusual case of having no timestamps on tracks, but have timestamps on (many?) waypoints
  * Possibly from KML files that have been generated by GPSBabel defaults which doesn't write tracks with timestamps
+ *
+ * Returns: A temporary track from the waypoints to perform the lookup
  */
-static void trw_layer_geotag_waypoints ( geotag_options_t *options )
+static VikTrack *geotag_waypoints_track ( VikTrwLayer *vtl )
 {
-	// Create a temporary track from the waypoints to perform the lookup
 	// c.f. trw_layer_convert_to_track()
 	VikTrack *trk = vik_track_new();
 	// Ensure sort by time
-	GList* gl = vu_sorted_list_from_hash_table ( vik_trw_layer_get_waypoints(options->vtl), VL_SO_DATE_ASCENDING, VIKING_WAYPOINT );
+	GList* gl = vu_sorted_list_from_hash_table ( vik_trw_layer_get_waypoints(vtl), VL_SO_DATE_ASCENDING, VIKING_WAYPOINT );
 
 	// Only need to copy the waypoint information relevant for geotagging
 	guint count = 1;
@@ -368,16 +436,62 @@ static void trw_layer_geotag_waypoints ( geotag_options_t *options )
 
 	g_list_free_full ( gl, g_free );
 	trk->trackpoints = g_list_reverse ( trk->trackpoints );
+	return trk;
+}
 
-	trw_layer_geotag_track ( NULL, trk, options );
+/**
+ * Correlate all the images to any track, or otherwise the waypoints within the TrackWaypoint layer
+ *
+ * Precedence is as per looking through each track in turn:
+ *  the first track with a match, then within it an exact trackpoint before an interpolated position
+ */
+static void trw_layer_geotag_match ( geotag_options_t *options, geotag_exif_t *exifs, guint count )
+{
+	GPtrArray *photos = g_ptr_array_sized_new ( count );
+	for ( guint ii = 0; ii < count; ii++ ) {
+		geotag_exif_t *exif = &exifs[ii];
+		exif->found_match = FALSE;
+		exif->image_direction = NAN;
+		if ( !exif->datetime )
+			continue;
+		// If image already has gps info - don't attempt to change it.
+		if ( !options->ov.overwrite_gps_exif && exif->has_gps )
+			continue;
+		exif->PhotoTime = ConvertToUnixTime ( exif->datetime, EXIF_DATE_FORMAT, options->ov.TimeZoneHours, options->ov.TimeZoneMins, options->ov.time_is_local );
+		// Apply any offset
+		exif->PhotoTime = exif->PhotoTime + options->ov.time_offset;
+		g_ptr_array_add ( photos, exif );
+	}
+
+	// Either the single specified track or all tracks
+	GArray *spans = g_array_new ( FALSE, FALSE, sizeof(geotag_span_t) );
+	for ( guint ii = 0; ii < options->tracks->len; ii++ )
+		geotag_timeline_add_track ( spans, g_ptr_array_index(options->tracks, ii), ii, options->ov.interpolate_segments );
+	if ( photos->len )
+		geotag_timeline_match ( spans, photos, options->ov.auto_image_direction );
+
+	if ( options->wpts_track ) {
+		// Try waypoints for any remaining
+		GPtrArray *remaining = g_ptr_array_new ();
+		for ( guint ii = 0; ii < photos->len; ii++ )
+			if ( !((geotag_exif_t*)g_ptr_array_index(photos, ii))->found_match )
+				g_ptr_array_add ( remaining, g_ptr_array_index(photos, ii) );
+		if ( remaining->len ) {
+			g_array_set_size ( spans, 0 );
+			geotag_timeline_add_track ( spans, options->wpts_track, 0, options->ov.interpolate_segments );
+			geotag_timeline_match ( spans, remaining, options->ov.auto_image_direction );
+		}
+		g_ptr_array_free ( remaining, TRUE );
+	}
 
-	vik_track_free ( trk );
+	g_array_free ( spans, TRUE );
+	g_ptr_array_free ( photos, TRUE );
 }
 
 /**
- * Correlate the image to any track, waypoints or waypoint within the TrackWaypoint layer
+ * Apply the match of the image, or the waypoint, within the TrackWaypoint layer
  */
-static void trw_layer_geotag_process ( geotag_options_t *options )
+static void trw_layer_geotag_process ( geotag_options_t *options, geotag_exif_t *exif )
 {
 	if ( !options->vtl || !IS_VIK_LAYER(options->vtl) )
 		return;
@@ -390,20 +504,16 @@ static void trw_layer_geotag_process ( geotag_options_t *options )
 		return;
 	}
 
-	gboolean has_gps_exif = FALSE;
-	gchar* datetime = a_geotag_get_exif_date_from_file ( options->image, &has_gps_exif );
-
-	if ( datetime ) {
+	if ( exif->datetime ) {
 	
 		// If image already has gps info - don't attempt to change it.
-		if ( !options->ov.overwrite_gps_exif && has_gps_exif ) {
+		if ( !options->ov.overwrite_gps_exif && exif->has_gps ) {
 			if ( options->ov.create_waypoints ) {
 				// Create waypoint with file information
 				gchar *name = NULL;
 				VikWaypoint *wp = a_geotag_create_waypoint_from_file ( options->image, vik_trw_layer_get_coord_mode (options->vtl), &name );
 				if ( !wp ) {
 					// Couldn't create Waypoint
-					g_free ( datetime );
 					return;
 				}
 				if ( !name )
@@ -429,38 +539,11 @@ static void trw_layer_geotag_process ( geotag_options_t *options )
 				// Mark for redraw
 				options->redraw = TRUE;
 			}
-			g_free ( datetime );
 			return;
 		}
 
-		options->PhotoTime = ConvertToUnixTime ( datetime, EXIF_DATE_FORMAT, options->ov.TimeZoneHours, options->ov.TimeZoneMins, options->ov.time_is_local );
-		g_free ( datetime );
-		
-		// Apply any offset
-		options->PhotoTime = options->PhotoTime + options->ov.time_offset;
-
-		options->found_match = FALSE;
-		options->image_direction = NAN;
-
-		if ( options->track ) {
-			// Single specified track
-			// NB Doesn't care about track id
-			trw_layer_geotag_track ( NULL, options->track, options );
-		}
-		else {
-			// Try all tracks
-			GHashTable *tracks = vik_trw_layer_get_tracks ( options->vtl );
-			if ( g_hash_table_size (tracks) > 0 ) {
-				g_hash_table_foreach ( tracks, (GHFunc) trw_layer_geotag_track, options );
-			}
-			if ( !options->found_match ) {
-				// Try waypoints
-				trw_layer_geotag_waypoints ( options );
-			}
-		}
-
 		// Match found ?
-		if ( options->found_match ) {
+		if ( exif->found_match ) {
 
 			if ( options->ov.create_waypoints ) {
 
@@ -475,10 +558,10 @@ static void trw_layer_geotag_process ( geotag_options_t *options )
 					VikWaypoint *wp = vik_trw_layer_get_waypoint ( options->vtl, name );
 					if ( wp ) {
 						// Found, so set new position, comment and image
-						(void)a_geotag_waypoint_positioned ( options->image, options->coord, options->altitude, &name, wp );
+						(void)a_geotag_waypoint_positioned ( options->image, exif->coord, exif->altitude, &name, wp );
 						wp->image_direction_ref = WP_IMAGE_DIRECTION_REF_TRUE;
-						wp->image_direction = options->image_direction;
-						wp->timestamp = options->PhotoTime;
+						wp->image_direction = exif->image_direction;
+						wp->timestamp = exif->PhotoTime;
 						updated_waypoint = TRUE;
 					}
 					g_free ( name );
@@ -487,12 +570,12 @@ static void trw_layer_geotag_process ( geotag_options_t *options )
 				if ( !updated_waypoint ) {
 					// Create waypoint with found position
 					gchar *name = NULL;
-					VikWaypoint *wp = a_geotag_waypoint_positioned ( options->image, options->coord, options->altitude, &name, NULL );
+					VikWaypoint *wp = a_geotag_waypoint_positioned ( options->image, exif->coord, exif->altitude, &name, NULL );
 					if ( !name )
 						name = g_strdup ( a_file_basename ( options->image ) );
 					wp->image_direction_ref = WP_IMAGE_DIRECTION_REF_TRUE;
-					wp->image_direction = options->image_direction;
-					wp->timestamp = options->PhotoTime;
+					wp->image_direction = exif->image_direction;
+					wp->timestamp = exif->PhotoTime;
 					vik_trw_layer_filein_add_waypoint ( options->vtl, name, wp );
 					g_free ( name );
 				}
@@ -501,17 +584,8 @@ static void trw_layer_geotag_process ( geotag_options_t *options )
 				options->redraw = TRUE;
 			}
 
-			// Write EXIF if specified
-			if ( options->ov.write_exif ) {
-				gint ans = a_geotag_write_exif_gps ( options->image, options->coord, options->altitude,
-				                                     options->image_direction, WP_IMAGE_DIRECTION_REF_TRUE,
-				                                     options->ov.no_change_mtime );
-				if ( ans != 0 ) {
-					gchar *message = g_strdup_printf ( _("Failed updating EXIF on %s"), options->image );
-					vik_window_statusbar_update ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(options->vtl)), message, VIK_STATUSBAR_INFO );
-					g_free ( message );
-				}
-			}
+			// Write EXIF if specified (done afterwards for all images together)
+			exif->write_exif = options->ov.write_exif;
 		}
 	}
 }
@@ -523,9 +597,42 @@ static void trw_layer_geotag_thread_free ( geotag_options_t *gtd )
 {
 	if ( gtd->files )
 		g_list_free ( gtd->files );
+	g_ptr_array_free ( gtd->tracks, TRUE );
+	vik_track_snapshot_unref ( gtd->wpts_track );
 	g_free ( gtd );
 }
 
+static void geotag_read_exif ( geotag_exif_t *exif, gpointer user_data )
+{
+	geotag_info_t info;
+	a_geotag_index_get ( exif->image, &info );
+	exif->has_gps = info.has_gps;
+	exif->datetime = info.datetime;
+	info.datetime = NULL;
+	a_geotag_info_clear ( &info );
+}
+
+static void geotag_write_exif ( geotag_exif_t *exif, geotag_options_t *options )
+{
+	gint ans = a_geotag_write_exif_gps ( exif->image, exif->coord, exif->altitude,
+	                                     exif->image_direction, WP_IMAGE_DIRECTION_REF_TRUE,
+	                                     options->ov.no_change_mtime );
+	if ( ans != 0 ) {
+		gchar *message = g_strdup_printf ( _("Failed updating EXIF on %s"), exif->image );
+		vik_window_statusbar_update ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(options->vtl)), message, VIK_STATUSBAR_INFO );
+		g_free ( message );
+	}
+}
+
+static void geotag_exifs_free ( geotag_exif_t *exifs, guint count )
+{
+	if ( !exifs )
+		return;
+	for ( guint ii = 0; ii < count; ii++ )
+		g_free ( exifs[ii].datetime );
+	g_free ( exifs );
+}
+
 /**
  * Run geotagging process in a separate thread
  */
@@ -535,18 +642,67 @@ static int trw_layer_geotag_thread ( geotag_options_t *options, gpointer threadd
 
 	// TODO decide how to report any issues to the user ...
 
-	// Foreach file attempt to geotag it
-	while ( options->files ) {
-		options->image = (gchar *) ( options->files->data );
-		trw_layer_geotag_process ( options );
-		options->files = options->files->next;
+	// Positioning via a single waypoint needs nothing else
+	if ( options->wpt ) {
+		while ( options->files ) {
+			options->image = (gchar *) ( options->files->data );
+			trw_layer_geotag_process ( options, NULL );
+			options->files = options->files->next;
+
+			// Update thread progress and detect stop requests
+			int result = a_background_thread_progress ( threaddata, ((gdouble) ++done) / total );
+			if ( result != 0 )
+				return -1; /* Abort thread */
+		}
+		return 0;
+	}
+
+	// Reading the images is independent of anything else, so do it in parallel first
+	geotag_exif_t *exifs = g_malloc0 ( sizeof(geotag_exif_t) * total );
+	gpointer *items = g_malloc ( sizeof(gpointer) * total );
+	guint ii = 0;
+	for ( GList *iter = options->files; iter; iter = iter->next, ii++ ) {
+		exifs[ii].image = iter->data;
+		items[ii] = &exifs[ii];
+	}
+	if ( a_background_thread_parallel ( threaddata, (GFunc)geotag_read_exif, items, total, NULL, FALSE ) != 0 ) {
+		g_free ( items );
+		geotag_exifs_free ( exifs, total );
+		return -1; /* Abort thread */
+	}
+
+	// Then all images against the tracks in one go
+	trw_layer_geotag_match ( options, exifs, total );
+	if ( a_background_testcancel ( threaddata ) != 0 ) {
+		g_free ( items );
+		geotag_exifs_free ( exifs, total );
+		return -1; /* Abort thread */
+	}
+
+	// Foreach file apply the geotag
+	guint writes = 0;
+	for ( done = 0; done < total; ) {
+		options->image = exifs[done].image;
+		trw_layer_geotag_process ( options, &exifs[done] );
+		if ( exifs[done].write_exif )
+			items[writes++] = &exifs[done];
 
 		// Update thread progress and detect stop requests
 		int result = a_background_thread_progress ( threaddata, ((gdouble) ++done) / total );
-		if ( result != 0 )
+		if ( result != 0 ) {
+			g_free ( items );
+			geotag_exifs_free ( exifs, total );
 			return -1; /* Abort thread */
+		}
 	}
 
+	// Writing into the images is again independent for each
+	int result = 0;
+	if ( writes )
+		result = a_background_thread_parallel ( threaddata, (GFunc)geotag_write_exif, items, writes, options, FALSE );
+	g_free ( items );
+	geotag_exifs_free ( exifs, total );
+
 	if ( options->redraw ) {
 		if ( IS_VIK_LAYER(options->vtl) ) {
 			trw_layer_calculate_bounds_waypoints ( options->vtl );
@@ -557,7 +713,8 @@ static int trw_layer_geotag_thread ( geotag_options_t *options, gpointer threadd
 		}
 	}
 
-	return 0;
+	// The waypoints have been updated regardless of any writes being stopped
+	return result != 0 ? -1 : 0;
 }
 
 /**
@@ -575,7 +732,22 @@ static void trw_layer_geotag_response_cb ( GtkDialog *dialog, gint resp, GeoTagW
 		geotag_options_t *options = g_malloc ( sizeof(geotag_options_t) );
 		options->vtl = widgets->vtl;
 		options->wpt = widgets->wpt;
-		options->track = widgets->track;
+		options->tracks = g_ptr_array_new_with_free_func ( (GDestroyNotify)vik_track_snapshot_unref );
+		options->wpts_track = NULL;
+		if ( widgets->track )
+			g_ptr_array_add ( options->tracks, vik_track_get_snapshot ( widgets->track ) );
+		else if ( !widgets->wpt ) {
+			GHashTableIter iter;
+			gpointer key, value;
+			g_hash_table_iter_init ( &iter, vik_trw_layer_get_tracks(options->vtl) );
+			while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+				g_ptr_array_add ( options->tracks, vik_track_get_snapshot ( VIK_TRACK(value) ) );
+			if ( g_hash_table_size(vik_trw_layer_get_waypoints(options->vtl)) ) {
+				VikTrack *trk = geotag_waypoints_track ( options->vtl );
+				options->wpts_track = vik_track_get_snapshot ( trk );
+				vik_track_free ( trk );
+			}
+		}
 		// Values extracted from the widgets:
 		options->ov.create_waypoints = gtk_toggle_button_get_active ( GTK_TOGGLE_BUTTON(widgets->create_waypoints_b) );
 		options->ov.overwrite_waypoints = gtk_toggle_button_get_active ( GTK_TOGGLE_BUTTON(widgets->overwrite_waypoints_b) );
@@ -0,0 +1,585 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * Play back the tracks of many layers over time
+ *
+ * The tracks drawn so far are kept on a surface of their own, with a mask of where has been drawn,
+ *  which is put on the viewport as an overlay so no layers need to be redrawn for each frame.
+ * Each frame only draws the segments between the previous time and the new one,
+ *  finding the tracks under way from a time index and the points within them by a binary search.
+ * The whole surface is only redrawn when the view changes, playback goes backwards,
+ *  or the start of the trail has moved on enough.
+ */
+#include "viking.h"
+#include "viktrwlayer_playback.h"
+#include "tracktimeindex.h"
+
+// Milliseconds between frames
+#define PLAYBACK_FRAME_MS 40
+#define PLAYBACK_LINE_WIDTH 3
+#define PLAYBACK_MARKER_SIZE 10
+// For tracks without a colour of their own
+#define PLAYBACK_DEFAULT_COLOR "blue"
+// Ten minutes of track every second
+#define PLAYBACK_DEFAULT_RATE 600
+// The trail can be this much longer than asked for, before it is redrawn to remove the oldest part
+#define PLAYBACK_TRAIL_SLACK 8
+
+typedef struct {
+  VikTrackSnapshot *snap;
+  GdkGC *gc;
+  guint first; // First point within the trail
+  guint next;  // First point not drawn yet
+} PlaybackTrackT;
+
+typedef struct {
+  GdkPoint pt;
+  GdkGC *gc;
+} PlaybackMarkerT;
+
+typedef struct {
+  GtkWidget *dialog;
+  VikLayer *vl;
+  VikViewport *vvp;
+  VikTrwlayerGetTracksAndLayersFunc get_tracks_and_layers_cb;
+  VikTrwlayerPlaybackCloseFunc on_close_cb;
+
+  GHashTable *tracks;   // Of VikTrack* to itself, each referenced for as long as the index uses it
+  TrackTimeIndex *tti;
+  GHashTable *playing;  // Of VikTrack* to PlaybackTrackT, for those drawn on the surface
+  GArray *markers;      // Of PlaybackMarkerT, the positions of tracks under way
+  gdouble start, end;   // Times of all the tracks
+  gdouble t0, t1;       // The period drawn on the surface
+  gdouble time;         // Playback position
+  gdouble rate;         // Seconds of track per second of playback
+  gdouble trail;        // Seconds of track behind the position to show, or 0 for all
+  guint timeout_id;
+  gint64 last_tick;
+
+  GdkPixmap *surface;
+  GdkBitmap *mask;
+  GdkGC *mask_gc;
+  GdkGC *blit_gc;
+  GdkGC *outline_gc;
+  GdkRectangle drawn;   // The part of the surface with anything on it
+  // The view the surface was drawn for
+  VikCoord center;
+  gdouble xmpp, ympp;
+  gint width, height;
+
+  GtkWidget *scale;
+  GtkWidget *time_l;
+  GtkWidget *play_b;
+  gboolean updating;
+} PlaybackT;
+
+static void playback_track_free ( PlaybackTrackT *pt )
+{
+  vik_track_snapshot_unref ( pt->snap );
+  g_object_unref ( pt->gc );
+  g_free ( pt );
+}
+
+static void area_add_rect ( GdkRectangle *area, gint x, gint y, gint width, gint height )
+{
+  GdkRectangle rect = { x, y, width, height };
+  if ( area->width > 0 && area->height > 0 )
+    gdk_rectangle_union ( area, &rect, area );
+  else
+    *area = rect;
+}
+
+/**
+ * Returns: The first point with a time not less than the value
+ *  Points are assumed to be in time order, as recorded
+ */
+static guint points_lower_bound ( VikTrackSnapshot *snap, gdouble time )
+{
+  guint lo = 0;
+  guint hi = snap->n_points;
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    if ( snap->points[mid].timestamp < time )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * Returns: The first point with a time greater than the value
+ */
+static guint points_upper_bound ( VikTrackSnapshot *snap, gdouble time )
+{
+  guint lo = 0;
+  guint hi = snap->n_points;
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    if ( snap->points[mid].timestamp <= time )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * (Re)collect the tracks with times, from visible layers
+ */
+static void playback_load ( PlaybackT *pb )
+{
+  if ( pb->tti )
+    a_track_time_index_free ( pb->tti );
+  g_hash_table_remove_all ( pb->playing );
+  g_hash_table_remove_all ( pb->tracks );
+
+  GList *tracks_and_layers = pb->get_tracks_and_layers_cb ( pb->vl, GINT_TO_POINTER(TRUE) );
+  for ( GList *iter = tracks_and_layers; iter; iter = iter->next ) {
+    VikTrack *trk = ((vik_trw_and_track_t*)iter->data)->trk;
+    if ( trk->visible && !trk->is_route && !g_hash_table_contains(pb->tracks, trk) ) {
+      vik_track_ref ( trk );
+      g_hash_table_insert ( pb->tracks, trk, trk );
+    }
+  }
+  g_list_free_full ( tracks_and_layers, g_free );
+
+  pb->tti = a_track_time_index_new ( pb->tracks );
+  pb->start = pb->end = NAN;
+  if ( a_track_time_index_get_first(pb->tti, NULL) ) {
+    // Find the whole span from the tracks covering all time
+    GList *all = a_track_time_index_find_overlapping ( pb->tti, -G_MAXDOUBLE, G_MAXDOUBLE );
+    for ( GList *iter = all; iter; iter = iter->next ) {
+      VikTrackSummary summary;
+      vik_track_get_summary ( VIK_TRACK(iter->data), &summary );
+      if ( isnan(pb->start) || summary.start_time < pb->start )
+        pb->start = summary.start_time;
+      gdouble end = isnan(summary.end_time) ? summary.start_time : summary.end_time;
+      if ( isnan(pb->end) || end > pb->end )
+        pb->end = end;
+    }
+    g_list_free ( all );
+  }
+}
+
+static gboolean playback_view_is_current ( PlaybackT *pb )
+{
+  return pb->surface &&
+    vik_coord_equals ( &pb->center, vik_viewport_get_center(pb->vvp) ) &&
+    pb->xmpp == vik_viewport_get_xmpp ( pb->vvp ) &&
+    pb->ympp == vik_viewport_get_ympp ( pb->vvp ) &&
+    pb->width == vik_viewport_get_width ( pb->vvp ) &&
+    pb->height == vik_viewport_get_height ( pb->vvp );
+}
+
+/**
+ * Empty the surface, ready to draw from the time given
+ */
+static void playback_reset ( PlaybackT *pb, gdouble t0 )
+{
+  GdkWindow *window = gtk_widget_get_window ( GTK_WIDGET(pb->vvp) );
+  gint width = vik_viewport_get_width ( pb->vvp );
+  gint height = vik_viewport_get_height ( pb->vvp );
+
+  if ( !pb->surface || pb->width != width || pb->height != height ) {
+    if ( pb->surface ) {
+      g_object_unref ( pb->surface );
+      g_object_unref ( pb->mask );
+      g_object_unref ( pb->mask_gc );
+      g_object_unref ( pb->blit_gc );
+    }
+    pb->surface = gdk_pixmap_new ( window, width, height, -1 );
+    pb->mask = gdk_pixmap_new ( window, width, height, 1 );
+    pb->mask_gc = gdk_gc_new ( pb->mask );
+    gdk_gc_set_line_attributes ( pb->mask_gc, PLAYBACK_LINE_WIDTH, GDK_LINE_SOLID, GDK_CAP_ROUND, GDK_JOIN_ROUND );
+    pb->blit_gc = gdk_gc_new ( window );
+    gdk_gc_set_clip_mask ( pb->blit_gc, pb->mask );
+    pb->drawn.x = pb->drawn.y = 0;
+    pb->drawn.width = width;
+    pb->drawn.height = height;
+  }
+  if ( pb->drawn.width > 0 && pb->drawn.height > 0 ) {
+    GdkColor clear = { 0, 0, 0, 0 };
+    gdk_gc_set_foreground ( pb->mask_gc, &clear );
+    gdk_draw_rectangle ( pb->mask, pb->mask_gc, TRUE, pb->drawn.x, pb->drawn.y, pb->drawn.width, pb->drawn.height );
+  }
+  GdkColor set = { 1, 0, 0, 0 };
+  gdk_gc_set_foreground ( pb->mask_gc, &set );
+  pb->drawn.x = pb->drawn.y = pb->drawn.width = pb->drawn.height = 0;
+
+  pb->center = *vik_viewport_get_center ( pb->vvp );
+  pb->xmpp = vik_viewport_get_xmpp ( pb->vvp );
+  pb->ympp = vik_viewport_get_ympp ( pb->vvp );
+  pb->width = width;
+  pb->height = height;
+
+  g_hash_table_remove_all ( pb->playing );
+  pb->t0 = pb->t1 = t0;
+}
+
+static PlaybackTrackT *playback_track_get ( PlaybackT *pb, VikTrack *trk )
+{
+  PlaybackTrackT *pt = g_hash_table_lookup ( pb->playing, trk );
+  if ( !pt ) {
+    pt = g_malloc ( sizeof(PlaybackTrackT) );
+    pt->snap = vik_track_get_snapshot ( trk );
+    if ( trk->has_color )
+      pt->gc = vik_viewport_new_gc_from_color ( pb->vvp, &trk->color, PLAYBACK_LINE_WIDTH );
+    else
+      pt->gc = vik_viewport_new_gc ( pb->vvp, PLAYBACK_DEFAULT_COLOR, PLAYBACK_LINE_WIDTH );
+    pt->first = points_lower_bound ( pt->snap, pb->t0 );
+    pt->next = pt->first;
+    g_hash_table_insert ( pb->playing, trk, pt );
+  }
+  return pt;
+}
+
+/**
+ * Draw the new parts of the tracks up to the time given, and find where those under way have got to
+ */
+static void playback_draw_to ( PlaybackT *pb, gdouble t1 )
+{
+  g_array_set_size ( pb->markers, 0 );
+
+  GList *trks = a_track_time_index_find_overlapping ( pb->tti, pb->t1, t1 );
+  for ( GList *iter = trks; iter; iter = iter->next ) {
+    PlaybackTrackT *pt = playback_track_get ( pb, VIK_TRACK(iter->data) );
+    guint end = points_upper_bound ( pt->snap, t1 );
+    if ( end <= pt->first )
+      continue;
+
+    // Join on to the last point already drawn
+    guint from = pt->next > pt->first ? pt->next - 1 : pt->first;
+    guint count = end - from;
+    VikCoord *coords = g_new ( VikCoord, count );
+    GdkPoint *points = g_new ( GdkPoint, count );
+    for ( guint ii = 0; ii < count; ii++ )
+      coords[ii] = pt->snap->points[from+ii].coord;
+    vik_viewport_coords_to_screen ( pb->vvp, coords, count, points );
+
+    if ( count > 1 ) {
+      GdkSegment *segs = g_new ( GdkSegment, count - 1 );
+      guint nsegs = 0;
+      gint xmin = points[0].x, xmax = points[0].x, ymin = points[0].y, ymax = points[0].y;
+      for ( guint ii = 1; ii < count; ii++ ) {
+        xmin = MIN ( xmin, points[ii].x );
+        xmax = MAX ( xmax, points[ii].x );
+        ymin = MIN ( ymin, points[ii].y );
+        ymax = MAX ( ymax, points[ii].y );
+        if ( pt->snap->points[from+ii].newsegment )
+          continue;
+        segs[nsegs].x1 = points[ii-1].x;
+        segs[nsegs].y1 = points[ii-1].y;
+        segs[nsegs].x2 = points[ii].x;
+        segs[nsegs].y2 = points[ii].y;
+        nsegs++;
+      }
+      if ( nsegs ) {
+        gdk_draw_segments ( pb->surface, pt->gc, segs, nsegs );
+        gdk_draw_segments ( pb->mask, pb->mask_gc, segs, nsegs );
+        area_add_rect ( &pb->drawn, xmin - PLAYBACK_LINE_WIDTH, ymin - PLAYBACK_LINE_WIDTH,
+                        xmax - xmin + 2*PLAYBACK_LINE_WIDTH, ymax - ymin + 2*PLAYBACK_LINE_WIDTH );
+      }
+      g_free ( segs );
+    }
+    pt->next = end;
+
+    if ( end < pt->snap->n_points ) {
+      PlaybackMarkerT marker = { points[count-1], pt->gc };
+      g_array_append_val ( pb->markers, marker );
+    }
+    g_free ( points );
+    g_free ( coords );
+  }
+  g_list_free ( trks );
+  pb->t1 = t1;
+}
+
+static void playback_overlay_draw ( VikViewport *vvp, GdkDrawable *drawable, GdkRectangle *area, PlaybackT *pb )
+{
+  if ( !playback_view_is_current(pb) ) {
+    // Everything moved, so draw it all again for this view
+    gdouble t1 = pb->t1;
+    playback_reset ( pb, pb->t0 );
+    playback_draw_to ( pb, t1 );
+  }
+
+  GdkRectangle screen = { 0, 0, pb->width, pb->height };
+  GdkRectangle visible;
+  if ( pb->drawn.width > 0 && gdk_rectangle_intersect(&pb->drawn, &screen, &visible) ) {
+    gdk_draw_drawable ( drawable, pb->blit_gc, pb->surface, visible.x, visible.y, visible.x, visible.y, visible.width, visible.height );
+    *area = visible;
+  }
+
+  const gint half = PLAYBACK_MARKER_SIZE / 2;
+  for ( guint ii = 0; ii < pb->markers->len; ii++ ) {
+    PlaybackMarkerT *marker = &g_array_index ( pb->markers, PlaybackMarkerT, ii );
+    gdk_draw_arc ( drawable, marker->gc, TRUE, marker->pt.x - half, marker->pt.y - half, PLAYBACK_MARKER_SIZE, PLAYBACK_MARKER_SIZE, 0, 360*64 );
+    gdk_draw_arc ( drawable, pb->outline_gc, FALSE, marker->pt.x - half, marker->pt.y - half, PLAYBACK_MARKER_SIZE, PLAYBACK_MARKER_SIZE, 0, 360*64 );
+    area_add_rect ( area, marker->pt.x - half - 1, marker->pt.y - half - 1, PLAYBACK_MARKER_SIZE + 2, PLAYBACK_MARKER_SIZE + 2 );
+  }
+}
+
+static void playback_update_time_label ( PlaybackT *pb )
+{
+  time_t tt = (time_t)pb->time;
+  gchar *str = vu_get_time_string ( &tt, "%c", vik_viewport_get_center(pb->vvp), NULL );
+  gtk_label_set_text ( GTK_LABEL(pb->time_l), str );
+  g_free ( str );
+}
+
+/**
+ * Show the tracks up to the playback position
+ */
+static void playback_show ( PlaybackT *pb )
+{
+  if ( !gtk_widget_get_window(GTK_WIDGET(pb->vvp)) )
+    return;
+
+  gboolean changed = FALSE;
+  if ( !a_track_time_index_is_current(pb->tti) ) {
+    // Tracks have been edited, so carry on with them as they are now
+    playback_load ( pb );
+    changed = TRUE;
+    if ( !isnan(pb->start) ) {
+      pb->updating = TRUE;
+      gtk_range_set_range ( GTK_RANGE(pb->scale), pb->start, MAX(pb->end, pb->start + 1) );
+      pb->updating = FALSE;
+      pb->time = CLAMP ( pb->time, pb->start, pb->end );
+    }
+  }
+
+  if ( isnan(pb->start) ) {
+    playback_reset ( pb, 0.0 );
+    g_array_set_size ( pb->markers, 0 );
+  }
+  else {
+    gdouble t0 = pb->trail > 0.0 ? pb->time - pb->trail : pb->start;
+    if ( changed || !playback_view_is_current(pb) || pb->time < pb->t1 || t0 < pb->t0 ||
+         t0 > pb->t0 + pb->trail / PLAYBACK_TRAIL_SLACK )
+      playback_reset ( pb, t0 );
+    playback_draw_to ( pb, pb->time );
+    playback_update_time_label ( pb );
+  }
+  vik_viewport_sync_overlays ( pb->vvp );
+}
+
+static void playback_stop ( PlaybackT *pb )
+{
+  if ( pb->timeout_id ) {
+    g_source_remove ( pb->timeout_id );
+    pb->timeout_id = 0;
+  }
+}
+
+static gboolean playback_tick ( PlaybackT *pb )
+{
+  gint64 now = g_get_monotonic_time ();
+  pb->time += pb->rate * (now - pb->last_tick) / G_USEC_PER_SEC;
+  pb->last_tick = now;
+  gboolean finished = isnan(pb->end) || pb->time >= pb->end;
+  if ( finished && !isnan(pb->end) )
+    pb->time = pb->end;
+
+  pb->updating = TRUE;
+  if ( !isnan(pb->end) )
+    gtk_range_set_value ( GTK_RANGE(pb->scale), pb->time );
+  if ( finished )
+    gtk_toggle_button_set_active ( GTK_TOGGLE_BUTTON(pb->play_b), FALSE );
+  pb->updating = FALSE;
+
+  playback_show ( pb );
+
+  if ( finished ) {
+    pb->timeout_id = 0;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static void playback_play_toggled ( GtkToggleButton *button, PlaybackT *pb )
+{
+  if ( pb->updating )
+    return;
+  if ( gtk_toggle_button_get_active(button) ) {
+    // Start again when at the end
+    if ( pb->time >= pb->end ) {
+      pb->time = pb->start;
+      playback_show ( pb );
+    }
+    pb->last_tick = g_get_monotonic_time ();
+    if ( !pb->timeout_id )
+      pb->timeout_id = g_timeout_add ( PLAYBACK_FRAME_MS, (GSourceFunc)playback_tick, pb );
+  }
+  else
+    playback_stop ( pb );
+}
+
+static void playback_scale_changed ( GtkRange *range, PlaybackT *pb )
+{
+  if ( pb->updating )
+    return;
+  pb->time = gtk_range_get_value ( range );
+  playback_show ( pb );
+}
+
+static void playback_rate_changed ( GtkSpinButton *spin, PlaybackT *pb )
+{
+  pb->rate = gtk_spin_button_get_value ( spin );
+}
+
+static void playback_trail_changed ( GtkSpinButton *spin, PlaybackT *pb )
+{
+  pb->trail = gtk_spin_button_get_value ( spin ) * 60.0;
+  playback_show ( pb );
+}
+
+static void playback_free ( PlaybackT *pb )
+{
+  playback_stop ( pb );
+  // Before the tracks, as these refer to them
+  g_hash_table_destroy ( pb->playing );
+  g_hash_table_destroy ( pb->tracks );
+  a_track_time_index_free ( pb->tti );
+  g_array_free ( pb->markers, TRUE );
+  if ( pb->surface ) {
+    g_object_unref ( pb->surface );
+    g_object_unref ( pb->mask );
+    g_object_unref ( pb->mask_gc );
+    g_object_unref ( pb->blit_gc );
+  }
+  if ( pb->outline_gc )
+    g_object_unref ( pb->outline_gc );
+  g_object_unref ( pb->vvp );
+  g_free ( pb );
+}
+
+static void playback_destroy ( GtkWidget *dialog, PlaybackT *pb )
+{
+  vik_viewport_remove_overlay ( pb->vvp, (VikViewportOverlayFunc)playback_overlay_draw, pb );
+  playback_free ( pb );
+}
+
+static void playback_response ( GtkWidget *dialog, gint resp, PlaybackT *pb )
+{
+  if ( pb->on_close_cb )
+    pb->on_close_cb ( dialog, resp, pb->vl );
+  else
+    gtk_widget_destroy ( dialog );
+}
+
+/**
+ * vik_trw_layer_playback_show:
+ * @window:                   A window from which the dialog will be derived
+ * @name:                     The name to be shown
+ * @vl:                       The #VikLayer passed on into get_tracks_and_layers_cb()
+ * @vvp:                      The viewport to play the tracks on
+ * @get_tracks_and_layers_cb: The function to call to get the tracks to be played, only from visible layers
+ * @on_close_cb:              The function to call when the dialog is closed, which should destroy it
+ *
+ * Display a dialog to play back the visible tracks over time,
+ *  drawing the tracks as they are made on top of the viewport
+ *
+ * Returns: The dialog created, or NULL if there are no tracks with times
+ */
+GtkWidget* vik_trw_layer_playback_show ( GtkWindow *window,
+                                         const gchar *name,
+                                         VikLayer *vl,
+                                         VikViewport *vvp,
+                                         VikTrwlayerGetTracksAndLayersFunc get_tracks_and_layers_cb,
+                                         VikTrwlayerPlaybackCloseFunc on_close_cb )
+{
+  PlaybackT *pb = g_malloc0 ( sizeof(PlaybackT) );
+  pb->vl = vl;
+  pb->vvp = g_object_ref ( vvp );
+  pb->get_tracks_and_layers_cb = get_tracks_and_layers_cb;
+  pb->on_close_cb = on_close_cb;
+  pb->tracks = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)vik_track_free );
+  pb->playing = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)playback_track_free );
+  pb->markers = g_array_new ( FALSE, FALSE, sizeof(PlaybackMarkerT) );
+  pb->rate = PLAYBACK_DEFAULT_RATE;
+  pb->trail = 0.0;
+
+  playback_load ( pb );
+  if ( isnan(pb->start) ) {
+    a_dialog_info_msg ( window, _("No visible tracks have timestamps to play back.") );
+    playback_free ( pb );
+    return NULL;
+  }
+  pb->time = pb->start;
+  pb->outline_gc = vik_viewport_new_gc ( vvp, "black", 1 );
+
+  GtkWidget *dialog = gtk_dialog_new_with_buttons ( _("Playback"),
+                                                    window,
+                                                    GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                    GTK_STOCK_CLOSE, GTK_RESPONSE_CLOSE,
+                                                    NULL );
+  pb->dialog = dialog;
+  GtkWidget *content = gtk_dialog_get_content_area ( GTK_DIALOG(dialog) );
+
+  GtkWidget *name_l = gtk_label_new ( NULL );
+  gchar *myname = g_markup_printf_escaped ( "<b>%s</b>", name );
+  gtk_label_set_markup ( GTK_LABEL(name_l), myname );
+  g_free ( myname );
+  gtk_box_pack_start ( GTK_BOX(content), name_l, FALSE, FALSE, 5 );
+
+  pb->time_l = gtk_label_new ( NULL );
+  gtk_box_pack_start ( GTK_BOX(content), pb->time_l, FALSE, FALSE, 5 );
+
+  pb->scale = gtk_hscale_new_with_range ( pb->start, MAX(pb->end, pb->start + 1), 1.0 );
+  gtk_scale_set_draw_value ( GTK_SCALE(pb->scale), FALSE );
+  gtk_widget_set_size_request ( pb->scale, 300, -1 );
+  gtk_box_pack_start ( GTK_BOX(content), pb->scale, FALSE, FALSE, 5 );
+
+  GtkWidget *table = gtk_table_new ( 3, 2, FALSE );
+  gtk_table_set_col_spacings ( GTK_TABLE(table), 5 );
+
+  pb->play_b = gtk_toggle_button_new_with_mnemonic ( _("_Play") );
+  gtk_button_set_image ( GTK_BUTTON(pb->play_b), gtk_image_new_from_stock(GTK_STOCK_MEDIA_PLAY, GTK_ICON_SIZE_BUTTON) );
+  gtk_table_attach_defaults ( GTK_TABLE(table), pb->play_b, 0, 2, 0, 1 );
+
+  GtkWidget *rate_l = gtk_label_new ( _("Speed (times real time):") );
+  GtkWidget *rate_sb = gtk_spin_button_new_with_range ( 1, 1000000, 60 );
+  gtk_spin_button_set_value ( GTK_SPIN_BUTTON(rate_sb), pb->rate );
+  gtk_widget_set_tooltip_text ( rate_sb, _("How many seconds of the tracks are played every second") );
+  gtk_table_attach_defaults ( GTK_TABLE(table), rate_l, 0, 1, 1, 2 );
+  gtk_table_attach_defaults ( GTK_TABLE(table), rate_sb, 1, 2, 1, 2 );
+
+  GtkWidget *trail_l = gtk_label_new ( _("Trail (minutes):") );
+  GtkWidget *trail_sb = gtk_spin_button_new_with_range ( 0, 10080, 5 );
+  gtk_spin_button_set_value ( GTK_SPIN_BUTTON(trail_sb), pb->trail / 60.0 );
+  gtk_widget_set_tooltip_text ( trail_sb, _("How much of the tracks to show behind the current time, 0 for all of it") );
+  gtk_table_attach_defaults ( GTK_TABLE(table), trail_l, 0, 1, 2, 3 );
+  gtk_table_attach_defaults ( GTK_TABLE(table), trail_sb, 1, 2, 2, 3 );
+
+  gtk_box_pack_start ( GTK_BOX(content), table, FALSE, FALSE, 5 );
+
+  g_signal_connect ( pb->play_b, "toggled", G_CALLBACK(playback_play_toggled), pb );
+  g_signal_connect ( pb->scale, "value-changed", G_CALLBACK(playback_scale_changed), pb );
+  g_signal_connect ( rate_sb, "value-changed", G_CALLBACK(playback_rate_changed), pb );
+  g_signal_connect ( trail_sb, "value-changed", G_CALLBACK(playback_trail_changed), pb );
+  g_signal_connect ( dialog, "response", G_CALLBACK(playback_response), pb );
+  g_signal_connect ( dialog, "destroy", G_CALLBACK(playback_destroy), pb );
+
+  vik_viewport_add_overlay ( vvp, (VikViewportOverlayFunc)playback_overlay_draw, pb );
+  playback_show ( pb );
+
+  gtk_widget_show_all ( dialog );
+  return dialog;
+}
@@ -147,6 +147,9 @@ typedef struct _propwidgets {
   guint     user_cia; // Chunk size set by the user (only for altitude graph ATM)
   gdouble   user_mina;
   gdouble   **values;
+  gint      values_width[PGT_END]; // Width the values were generated for, 0 when they need regenerating
+  gint16    *dem_elevs; // DEM elevation for each column of the distance graphs, see get_dem_elevs()
+  guint     dem_elevs_width; // As per values_width
   make_map_func make_map[PGT_END];
   convert_values_func convert_values[PGT_END];
   get_y_text_func get_y_text[PGT_END];
@@ -176,6 +179,16 @@ static PropWidgets *prop_widgets_new()
   return widgets;
 }
 
+/**
+ * The track has changed so all graph values need regenerating on the next draw
+ */
+static void invalidate_values ( PropWidgets *widgets )
+{
+  for ( VikPropWinGraphType_t pwgt = 0; pwgt < PGT_END; pwgt++ )
+    widgets->values_width[pwgt] = 0;
+  widgets->dem_elevs_width = 0;
+}
+
 static void prop_widgets_free(PropWidgets *widgets)
 {
   for ( VikPropWinGraphType_t pwgt = 0; pwgt < PGT_END; pwgt++ ) {
@@ -185,6 +198,7 @@ static void prop_widgets_free(PropWidgets *widgets)
      g_free ( widgets->values[pwgt] );
   }
   g_free ( widgets->values );
+  g_free ( widgets->dem_elevs );
   g_free(widgets);
 }
 
@@ -1135,7 +1149,27 @@ static void track_graph_leave ( GtkWidget *event_box, GdkEventMotion *event, Pro
  * Draws DEM points and a respresentative speed on the supplied pixmap
  *  Pixmap x axis should be distance based
  */
-static void draw_dem_alt_speed_dist ( VikTrack *tr,
+/**
+ * The DEM elevations for each column of the graphs, looked up together
+ */
+static gint16 *get_dem_elevs ( PropWidgets *widgets, guint width )
+{
+  if ( widgets->dem_elevs && widgets->dem_elevs_width == width )
+    return widgets->dem_elevs;
+
+  g_free ( widgets->dem_elevs );
+  widgets->dem_elevs = NULL;
+  widgets->dem_elevs_width = width;
+  VikCoord *coords = vik_track_make_position_map ( widgets->tr, width );
+  if ( coords ) {
+    widgets->dem_elevs = g_new ( gint16, width );
+    (void)a_dems_get_elevs_by_coords ( coords, width, VIK_DEM_INTERPOL_BEST, widgets->dem_elevs );
+    g_free ( coords );
+  }
+  return widgets->dem_elevs;
+}
+
+static void draw_dem_alt_speed_dist ( PropWidgets *widgets,
                                       GdkDrawable *pix,
                                       GdkGC *alt_gc,
                                       GdkGC *speed_gc,
@@ -1149,8 +1183,9 @@ static void draw_dem_alt_speed_dist ( VikTrack *tr,
                                       gboolean do_dem,
                                       gboolean do_speed )
 {
+  VikTrack *tr = widgets->tr;
   GList *iter;
-  gdouble total_length = vik_track_get_length_including_gaps(tr);
+  gdouble total_length = widgets->track_length_inc_gaps;
 
   gdouble dist = 0;
   gint h2 = height + MARGIN_Y; // Adjust height for x axis labelling offset
@@ -1158,33 +1193,43 @@ static void draw_dem_alt_speed_dist ( VikTrack *tr,
   gdouble schunk = chunks[cis]*LINES;
   vik_units_speed_t speed_units = a_vik_get_units_speed ();
 
-  for (iter = tr->trackpoints->next; iter; iter = iter->next) {
-    dist += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-			     &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-    int x = (width * dist)/total_length + margin;
-    if (do_dem) {
-      gint16 elev = a_dems_get_elev_by_coord(&(VIK_TRACKPOINT(iter->data)->coord), VIK_DEM_INTERPOL_BEST);
-      if ( elev != VIK_DEM_INVALID_ELEVATION ) {
-	// Convert into height units
-	if (a_vik_get_units_height () == VIK_UNITS_HEIGHT_FEET)
-	  elev =  VIK_METERS_TO_FEET(elev);
-	// No conversion needed if already in metres
-
-        // offset is in current height units
-        elev -= alt_offset;
-
-        // consider chunk size
-        int y_alt = h2 - ((height * elev)/achunk );
-        gdk_draw_rectangle(GDK_DRAWABLE(pix), alt_gc, TRUE, x-2, y_alt-2, 4, 4);
+  gint16 *elevs = do_dem ? get_dem_elevs ( widgets, width ) : NULL;
+  if ( elevs ) {
+    gboolean feet = (a_vik_get_units_height () == VIK_UNITS_HEIGHT_FEET);
+    // One value per column, joined up where the DEMs have coverage
+    gint prev_y = G_MININT;
+    for ( guint ii = 0; ii < width; ii++ ) {
+      if ( elevs[ii] == VIK_DEM_INVALID_ELEVATION ) {
+        prev_y = G_MININT;
+        continue;
       }
+      // Convert into height units
+      gdouble elev = feet ? VIK_METERS_TO_FEET(elevs[ii]) : elevs[ii];
+      // offset is in current height units
+      elev -= alt_offset;
+      // consider chunk size
+      int y_alt = h2 - ((height * elev)/achunk );
+      int x = ii + margin;
+      if ( prev_y == G_MININT )
+        gdk_draw_rectangle ( GDK_DRAWABLE(pix), alt_gc, TRUE, x-1, y_alt-1, 2, 2 );
+      else
+        gdk_draw_line ( GDK_DRAWABLE(pix), alt_gc, x-1, prev_y, x, y_alt );
+      prev_y = y_alt;
     }
-    if (do_speed) {
-      // This is just a speed indicator - no actual values can be inferred by user
-      if (!isnan(VIK_TRACKPOINT(iter->data)->speed)) {
-	gdouble spd = vu_speed_convert ( speed_units, VIK_TRACKPOINT(iter->data)->speed ) ;
-        int y_speed = h2 - (height * (spd-draw_min_speed))/schunk;
-        gdk_draw_rectangle(GDK_DRAWABLE(pix), speed_gc, TRUE, x-2, y_speed-2, 4, 4);
-      }
+  }
+
+  if ( !do_speed || total_length <= 0.0 )
+    return;
+
+  for (iter = tr->trackpoints->next; iter; iter = iter->next) {
+    dist += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
+                             &(VIK_TRACKPOINT(iter->prev->data)->coord) );
+    // This is just a speed indicator - no actual values can be inferred by user
+    if (!isnan(VIK_TRACKPOINT(iter->data)->speed)) {
+      int x = (width * dist)/total_length + margin;
+      gdouble spd = vu_speed_convert ( speed_units, VIK_TRACKPOINT(iter->data)->speed ) ;
+      int y_speed = h2 - (height * (spd-draw_min_speed))/schunk;
+      gdk_draw_rectangle(GDK_DRAWABLE(pix), speed_gc, TRUE, x-2, y_speed-2, 4, 4);
     }
   }
 }
@@ -1449,7 +1494,7 @@ static void draw_dem_gps_speed ( PropWidgets *widgets, GtkWidget *window, GdkPix
     min = widgets->user_mina;
   }
 
-  draw_dem_alt_speed_dist ( widgets->tr,
+  draw_dem_alt_speed_dist ( widgets,
                             GDK_DRAWABLE(pix),
                             dem_alt_gc,
                             gps_speed_gc,
@@ -1474,9 +1519,14 @@ static void draw_dem_gps_speed ( PropWidgets *widgets, GtkWidget *window, GdkPix
 static void evaluate_speeds ( PropWidgets *widgets )
 {
   const VikPropWinGraphType_t pwgt = PGT_SPEED_TIME;
+  if ( widgets->values[pwgt] && widgets->values_width[pwgt] == widgets->profile_width ) {
+    widgets->speeds_evaluated = TRUE;
+    return;
+  }
   if ( widgets->values[pwgt] )
     g_free ( widgets->values[pwgt] );
   widgets->values[pwgt] = vik_track_make_speed_map ( widgets->tr, widgets->profile_width );
+  widgets->values_width[pwgt] = widgets->profile_width;
   if ( widgets->values[pwgt] == NULL )
     return;
   speed_convert ( widgets->values[pwgt], widgets->profile_width );
@@ -1506,7 +1556,7 @@ static void draw_gps_speed_by_dist ( PropWidgets *widgets, GtkWidget *window, Gd
   gdk_color_parse ( "red", &color );
   gdk_gc_set_rgb_fg_color ( gc, &color);
 
-  draw_dem_alt_speed_dist ( widgets->tr,
+  draw_dem_alt_speed_dist ( widgets,
                             GDK_DRAWABLE(pix),
                             NULL,
                             gc,
@@ -1592,14 +1642,15 @@ static void draw_vt_gps_speed_extra ( gpointer ptr, GtkWidget *window, GdkPixmap
 }
 
 /**
- * Draw an image
+ * Generate the values (in display units) for a graph and work out its axis range
+ * Returns FALSE if the graph can not be drawn
  */
-static void draw_it ( GtkWidget *image, VikTrack *trk, PropWidgets *widgets, GtkWidget *window, VikPropWinGraphType_t pwgt )
+static gboolean make_values ( VikTrack *trk, PropWidgets *widgets, VikPropWinGraphType_t pwgt )
 {
-  guint i;
-
   if ( widgets->values[pwgt] )
     g_free ( widgets->values[pwgt] );
+  widgets->values[pwgt] = NULL;
+  widgets->values_width[pwgt] = widgets->profile_width;
 
   if ( widgets->make_map[pwgt] )
     widgets->values[pwgt] = widgets->make_map[pwgt] ( trk, widgets->profile_width );
@@ -1611,20 +1662,13 @@ static void draw_it ( GtkWidget *image, VikTrack *trk, PropWidgets *widgets, Gtk
     case PGT_CADENCE:        vtvt = TRACK_VALUE_CADENCE; break;
     case PGT_TEMP:           vtvt = TRACK_VALUE_TEMP; break;
     case PGT_POWER:          vtvt = TRACK_VALUE_POWER; break;
-    default: return; break;
+    default: return FALSE; break;
     }
     widgets->values[pwgt] = vik_track_make_time_map_for ( trk, widgets->profile_width, vtvt );
   }
 
   if ( widgets->values[pwgt] == NULL )
-    return;
-
-  if ( is_time_graph(pwgt) ) {
-    widgets->duration = vik_track_get_duration ( trk, TRUE );
-    // Negative time or other problem
-    if ( widgets->duration <= 0 )
-      return;
-  }
+    return FALSE;
 
   // Convert into appropriate units
   if ( widgets->convert_values[pwgt] )
@@ -1639,6 +1683,30 @@ static void draw_it ( GtkWidget *image, VikTrack *trk, PropWidgets *widgets, Gtk
 
   // Find suitable chunk index
   get_new_min_and_chunk_index ( widgets->min_value[pwgt], widgets->max_value[pwgt], chunks, G_N_ELEMENTS(chunks), &widgets->draw_min[pwgt], &widgets->ci[pwgt] );
+  return TRUE;
+}
+
+/**
+ * Draw an image
+ */
+static void draw_it ( GtkWidget *image, VikTrack *trk, PropWidgets *widgets, GtkWidget *window, VikPropWinGraphType_t pwgt )
+{
+  guint i;
+
+  // Values are kept until the track changes or the graphs get a different width
+  if ( widgets->values_width[pwgt] != widgets->profile_width ) {
+    if ( !make_values ( trk, widgets, pwgt ) )
+      return;
+  }
+  else if ( widgets->values[pwgt] == NULL )
+    return;
+
+  if ( is_time_graph(pwgt) ) {
+    widgets->duration = vik_track_get_duration ( trk, TRUE );
+    // Negative time or other problem
+    if ( widgets->duration <= 0 )
+      return;
+  }
 
   // Assign locally
   gdouble min = widgets->draw_min[pwgt];
@@ -1798,64 +1866,71 @@ static void clear_saved_img ( gboolean resized, PropWidgets *widgets, VikPropWin
 }
 
 /**
- * Draw all graphs
+ * Draw one graph, including any marker or blob
  */
-static void draw_all_graphs ( GtkWidget *widget, PropWidgets *widgets, gboolean resized )
+static void draw_graph ( GtkWidget *window, PropWidgets *widgets, VikPropWinGraphType_t pwgt, gboolean resized )
 {
-  // Draw graphs even if they are not visible
-  GtkWidget *window = gtk_widget_get_toplevel(widget);
   gdouble pc = NAN;
   gdouble pc_blob = NAN;
 
-  VikPropWinGraphType_t pwgt;
-  for ( pwgt = 0; pwgt < PGT_END; pwgt++ ) {
-    if ( widgets->event_box[pwgt] ) {
-      // Saved image no longer any good as we've resized, so we remove it here
-      clear_saved_img ( resized, widgets, pwgt );
+  // Saved image no longer any good as we've resized, so we remove it here
+  clear_saved_img ( resized, widgets, pwgt );
 
-      // Main drawing
-      draw_it ( widgets->image[pwgt], widgets->tr, widgets, window, pwgt );
+  // Main drawing
+  draw_it ( widgets->image[pwgt], widgets->tr, widgets, window, pwgt );
 
-      // Ensure marker or blob are redrawn if necessary
-      if ( widgets->is_marker_drawn || widgets->is_blob_drawn ) {
-
-        if ( is_time_graph(pwgt) )
-          pc = tp_percentage_by_time ( widgets->tr, widgets->marker_tp );
-        else
-          pc = tp_percentage_by_distance ( widgets->tr, widgets->marker_tp, widgets->track_length_inc_gaps );
+  // Ensure marker or blob are redrawn if necessary
+  if ( widgets->is_marker_drawn || widgets->is_blob_drawn ) {
 
-        gdouble x_blob = -MARGIN_X - 1.0; // i.e. Don't draw unless we get a valid value
-        guint   y_blob = 0;
-        if ( widgets->is_blob_drawn ) {
-          if ( is_time_graph(pwgt) )
-            pc_blob = tp_percentage_by_time ( widgets->tr, widgets->blob_tp );
-          else
-            pc_blob = tp_percentage_by_distance ( widgets->tr, widgets->blob_tp, widgets->track_length_inc_gaps );
-
-          if ( !isnan(pc_blob) ) {
-            x_blob = pc_blob * (widgets->profile_width-1);
-          }
-          y_blob = blob_y_position ( x_blob > 0 ? (guint)x_blob : 0, widgets, pwgt );
-        }
+    if ( is_time_graph(pwgt) )
+      pc = tp_percentage_by_time ( widgets->tr, widgets->marker_tp );
+    else
+      pc = tp_percentage_by_distance ( widgets->tr, widgets->marker_tp, widgets->track_length_inc_gaps );
 
-        gdouble marker_x = -1.0; // i.e. Don't draw unless we get a valid value
-        if ( !isnan(pc) ) {
-          marker_x = (pc * widgets->profile_width) + MARGIN_X;
-        }
+    gdouble x_blob = -MARGIN_X - 1.0; // i.e. Don't draw unless we get a valid value
+    guint   y_blob = 0;
+    if ( widgets->is_blob_drawn ) {
+      if ( is_time_graph(pwgt) )
+        pc_blob = tp_percentage_by_time ( widgets->tr, widgets->blob_tp );
+      else
+        pc_blob = tp_percentage_by_distance ( widgets->tr, widgets->blob_tp, widgets->track_length_inc_gaps );
 
-        save_image_and_draw_graph_marks ( widgets->image[pwgt],
-                                          marker_x,
-                                          gtk_widget_get_style(window)->black_gc,
-                                          x_blob+MARGIN_X,
-                                          y_blob+MARGIN_Y,
-                                          &widgets->graph_saved_img[pwgt],
-                                          widgets->profile_width,
-                                          widgets->profile_height,
-                                          BLOB_SIZE * vik_viewport_get_scale(widgets->vvp),
-                                          &widgets->is_marker_drawn,
-                                          &widgets->is_blob_drawn );
+      if ( !isnan(pc_blob) ) {
+        x_blob = pc_blob * (widgets->profile_width-1);
       }
+      y_blob = blob_y_position ( x_blob > 0 ? (guint)x_blob : 0, widgets, pwgt );
+    }
+
+    gdouble marker_x = -1.0; // i.e. Don't draw unless we get a valid value
+    if ( !isnan(pc) ) {
+      marker_x = (pc * widgets->profile_width) + MARGIN_X;
     }
+
+    save_image_and_draw_graph_marks ( widgets->image[pwgt],
+                                      marker_x,
+                                      gtk_widget_get_style(window)->black_gc,
+                                      x_blob+MARGIN_X,
+                                      y_blob+MARGIN_Y,
+                                      &widgets->graph_saved_img[pwgt],
+                                      widgets->profile_width,
+                                      widgets->profile_height,
+                                      BLOB_SIZE * vik_viewport_get_scale(widgets->vvp),
+                                      &widgets->is_marker_drawn,
+                                      &widgets->is_blob_drawn );
+  }
+}
+
+/**
+ * Draw all graphs
+ */
+static void draw_all_graphs ( GtkWidget *widget, PropWidgets *widgets, gboolean resized )
+{
+  // Draw graphs even if they are not visible
+  GtkWidget *window = gtk_widget_get_toplevel(widget);
+
+  for ( VikPropWinGraphType_t pwgt = 0; pwgt < PGT_END; pwgt++ ) {
+    if ( widgets->event_box[pwgt] )
+      draw_graph ( window, widgets, pwgt, resized );
   }
   widgets->speeds_evaluated = FALSE;
 }
@@ -2223,7 +2298,6 @@ static void propwin_response_cb( GtkDialog *dialog, gint resp, PropWidgets *widg
               vik_trw_layer_add_route ( vtl, new_tr_name, tracks[i] );
             else
               vik_trw_layer_add_track ( vtl, new_tr_name, tracks[i] );
-            vik_track_calculate_bounds ( tracks[i] );
 
             g_free ( new_tr_name );
 	  }
@@ -2261,15 +2335,26 @@ static void propwin_response_cb( GtkDialog *dialog, gint resp, PropWidgets *widg
  */
 static void checkbutton_toggle_cb ( GtkToggleButton *togglebutton, PropWidgets *widgets, gpointer dummy )
 {
+  GtkWidget *window = gtk_widget_get_toplevel ( widgets->dialog );
+  // Only the graph owning the button needs redrawing
   // Even though not resized, we'll pretend it is -
   //  as this invalidates the saved images (since the image may have changed)
   for ( VikPropWinGraphType_t pwgt = 0; pwgt < PGT_END; pwgt++ ) {
-    if ( widgets->w_show_dem[pwgt] )
-      widgets->show_dem[pwgt] = gtk_toggle_button_get_active ( GTK_TOGGLE_BUTTON(widgets->w_show_dem[pwgt]) );
-    if ( widgets->w_show_speed[pwgt] )
-      widgets->show_speed[pwgt] = gtk_toggle_button_get_active ( GTK_TOGGLE_BUTTON(widgets->w_show_speed[pwgt]) );
+    gboolean changed = FALSE;
+    if ( widgets->w_show_dem[pwgt] ) {
+      gboolean show = gtk_toggle_button_get_active ( GTK_TOGGLE_BUTTON(widgets->w_show_dem[pwgt]) );
+      changed = (show != widgets->show_dem[pwgt]);
+      widgets->show_dem[pwgt] = show;
+    }
+    if ( widgets->w_show_speed[pwgt] ) {
+      gboolean show = gtk_toggle_button_get_active ( GTK_TOGGLE_BUTTON(widgets->w_show_speed[pwgt]) );
+      changed = changed || (show != widgets->show_speed[pwgt]);
+      widgets->show_speed[pwgt] = show;
+    }
+    if ( changed && widgets->event_box[pwgt] )
+      draw_graph ( window, widgets, pwgt, TRUE );
   }
-  draw_all_graphs ( widgets->dialog, widgets, TRUE );
+  widgets->speeds_evaluated = FALSE;
 }
 
 /**
@@ -2627,35 +2712,42 @@ static GtkWidget *create_statistics_page ( PropWidgets *widgets, VikTrack *tr )
     N_("<b>Duration:</b>"),
   };
 
-  guint seg_count = vik_track_get_segment_count ( widgets->tr );
+  VikTrackSummary summary;
+  vik_track_get_summary ( tr, &summary );
+
+  guint seg_count = summary.segment_count;
 
   // Don't use minmax_array(widgets->values[PGT_ELEVATION_DISTANCE]), as that is a simplified representative of the points
   //  thus can miss the highest & lowest values by a few metres
   gdouble min_alt, max_alt;
-  if ( !vik_track_get_minmax_alt (widgets->tr, &min_alt, &max_alt) )
+  if ( summary.has_alt ) {
+    min_alt = summary.min_alt;
+    max_alt = summary.max_alt;
+  }
+  else
     min_alt = max_alt = NAN;
 
   vik_units_distance_t dist_units = a_vik_get_units_distance ();
 
   // NB This value not shown yet - but is used by internal calculations
-  widgets->track_length_inc_gaps = vik_track_get_length_including_gaps(tr);
+  widgets->track_length_inc_gaps = summary.length_inc_gaps;
 
-  tr_len = widgets->track_length = vik_track_get_length(tr);
+  tr_len = widgets->track_length = summary.length;
   vu_distance_text ( tmp_buf, sizeof(tmp_buf), dist_units, tr_len, TRUE, "%.2f", FALSE );
   widgets->w_track_length = content[cnt++] = ui_label_new_selectable ( tmp_buf );
 
-  tp_count = vik_track_get_tp_count(tr);
+  tp_count = summary.tp_count;
   g_snprintf(tmp_buf, sizeof(tmp_buf), "%lu", tp_count );
   widgets->w_tp_count = content[cnt++] = ui_label_new_selectable ( tmp_buf );
 
   g_snprintf(tmp_buf, sizeof(tmp_buf), "%u", seg_count );
   widgets->w_segment_count = content[cnt++] = ui_label_new_selectable ( tmp_buf );
 
-  g_snprintf(tmp_buf, sizeof(tmp_buf), "%lu", vik_track_get_dup_point_count(tr) );
+  g_snprintf(tmp_buf, sizeof(tmp_buf), "%lu", summary.dup_point_count );
   widgets->w_duptp_count = content[cnt++] = ui_label_new_selectable ( tmp_buf );
 
   vik_units_speed_t speed_units = a_vik_get_units_speed ();
-  tmp_speed = vik_track_get_max_speed(tr);
+  tmp_speed = summary.max_speed;
   if ( tmp_speed == 0 )
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("No Data"));
   else {
@@ -2663,7 +2755,7 @@ static GtkWidget *create_statistics_page ( PropWidgets *widgets, VikTrack *tr )
   }
   widgets->w_max_speed = content[cnt++] = ui_label_new_selectable ( tmp_buf );
 
-  tmp_speed = vik_track_get_average_speed(tr);
+  tmp_speed = summary.avg_speed;
   if ( tmp_speed == 0 )
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("No Data"));
   else {
@@ -2674,8 +2766,8 @@ static GtkWidget *create_statistics_page ( PropWidgets *widgets, VikTrack *tr )
   // Use 60sec as the default period to be considered stopped
   //  this is the TrackWaypoint draw stops default value 'vtl->stop_length'
   //  however this variable is not directly accessible - and I don't expect it's often changed from the default
-  //  so ATM just put in the number
-  tmp_speed = vik_track_get_average_speed_moving(tr, 60);
+  //  so ATM just use the summary value (which uses this number)
+  tmp_speed = summary.avg_speed_moving;
   if ( tmp_speed == 0 )
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("No Data"));
   else {
@@ -2706,7 +2798,8 @@ static GtkWidget *create_statistics_page ( PropWidgets *widgets, VikTrack *tr )
   }
   widgets->w_elev_range = content[cnt++] = ui_label_new_selectable ( tmp_buf );
 
-  vik_track_get_total_elevation_gain(tr, &max_alt, &min_alt );
+  max_alt = summary.elev_up;
+  min_alt = summary.elev_down;
   if ( isnan(min_alt) && isnan(max_alt) )
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("No Data"));
   else {
@@ -2762,7 +2855,7 @@ static GtkWidget *create_statistics_page ( PropWidgets *widgets, VikTrack *tr )
     g_free ( msg );
 
     gint total_duration_s = (gint)(t2-t1);
-    gint segments_duration_s = (gint)vik_track_get_duration(tr,FALSE);
+    gint segments_duration_s = (gint)summary.duration;
     gint total_duration_m = total_duration_s/60;
     gint segments_duration_m = segments_duration_s/60;
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("%d minutes - %d minutes moving"), total_duration_m, segments_duration_m);
@@ -2794,32 +2887,32 @@ static GtkWidget *create_statistics_page ( PropWidgets *widgets, VikTrack *tr )
   // However if made optional need way to align value to text label...
   table = create_table (cnt, stats_texts, content);
 
-  guint max_cad = vik_track_get_max_cadence ( tr );
+  guint max_cad = summary.max_cadence;
   if ( max_cad != VIK_TRKPT_CADENCE_NONE ) {
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("%d RPM"), max_cad);
     attach_to_table_extra ( table, tmp_buf, ++cnt, _("<b>Max Cadence:</b>") );
   }
 
-  gdouble avg_cad = vik_track_get_avg_cadence ( tr );
+  gdouble avg_cad = summary.avg_cadence;
   if ( !isnan(avg_cad) ) {
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("%.1f RPM"), avg_cad);
     attach_to_table_extra ( table, tmp_buf, ++cnt, _("<b>Avg. Cadence:</b>") );
   }
 
-  guint max_hr = vik_track_get_max_heart_rate ( tr );
+  guint max_hr = summary.max_heart_rate;
   if ( max_hr ) {
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("%d bpm"), max_hr);
     attach_to_table_extra ( table, tmp_buf, ++cnt, _("<b>Max Heart Rate:</b>") );
   }
 
-  gdouble avg_hr = vik_track_get_avg_heart_rate ( tr );
+  gdouble avg_hr = summary.avg_heart_rate;
   if ( !isnan(avg_hr) ) {
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("%.1f bpm"), avg_hr);
     attach_to_table_extra ( table, tmp_buf, ++cnt, _("<b>Avg. Heart Rate:</b>") );
   }
 
-  gdouble min_temp, max_temp;
-  if ( vik_track_get_minmax_temp(tr, &min_temp, &max_temp) ) {
+  gdouble min_temp = summary.min_temp, max_temp = summary.max_temp;
+  if ( summary.has_temp ) {
     if ( a_vik_get_units_temp() == VIK_UNITS_TEMP_CELSIUS )
       g_snprintf(tmp_buf, sizeof(tmp_buf), _("%.1f%sC / %.1f%sC"), min_temp, DEGREE_SYMBOL, max_temp, DEGREE_SYMBOL);
     else
@@ -2827,7 +2920,7 @@ static GtkWidget *create_statistics_page ( PropWidgets *widgets, VikTrack *tr )
     attach_to_table_extra ( table, tmp_buf, ++cnt, _("<b>Min/Max Temperature:</b>") );
   }
 
-  gdouble avg_temp = vik_track_get_avg_temp ( tr );
+  gdouble avg_temp = summary.avg_temp;
   if ( !isnan(avg_temp) ) {
     if ( a_vik_get_units_temp() == VIK_UNITS_TEMP_CELSIUS )
       g_snprintf(tmp_buf, sizeof(tmp_buf), _("%.1f%sC"), avg_temp, DEGREE_SYMBOL);
@@ -2836,13 +2929,13 @@ static GtkWidget *create_statistics_page ( PropWidgets *widgets, VikTrack *tr )
     attach_to_table_extra ( table, tmp_buf, ++cnt, _("<b>Avg. Temperature:</b>") );
   }
 
-  guint max_pow = vik_track_get_max_power ( tr );
+  guint max_pow = summary.max_power;
   if ( max_pow != VIK_TRKPT_POWER_NONE ) {
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("%d Watts"), max_pow);
     attach_to_table_extra ( table, tmp_buf, ++cnt, _("<b>Max Power:</b>") );
   }
 
-  gdouble avg_pow = vik_track_get_avg_power ( tr );
+  gdouble avg_pow = summary.avg_power;
   if ( !isnan(avg_pow) ) {
     g_snprintf(tmp_buf, sizeof(tmp_buf), _("%.1f Watts"), avg_pow);
     attach_to_table_extra ( table, tmp_buf, ++cnt, _("<b>Avg. Power:</b>") );
@@ -3366,6 +3459,7 @@ gboolean vik_trw_layer_propwin_main_refresh ( VikLayer *vl )
 
   // Should be on the right track...
   widgets->track_length_inc_gaps = vik_track_get_length_including_gaps ( widgets->tr );
+  invalidate_values ( widgets );
 
   if ( widgets->values[PGT_ELEVATION_DISTANCE] )
     g_free ( widgets->values[PGT_ELEVATION_DISTANCE] );
@@ -50,6 +50,8 @@ struct _VikTrwLayerTpwin {
   GtkWidget *button_back;
   GtkWidget *button_forward;
   VikTrackpoint *cur_tp;
+  gint cur_number; // Position of the current trackpoint counting from 1, or 0 when none
+  guint tp_count;
   gboolean sync_to_tp_block;
   gboolean configured;
 };
@@ -133,6 +135,8 @@ static void tpwin_sync_alt_to_tp ( VikTrwLayerTpwin *tpwin )
       tpwin->cur_tp->altitude = gtk_spin_button_get_value ( tpwin->alt );
       g_critical("Houston, we've had a problem. height=%d", height_units);
     }
+    // So values derived from the altitudes are updated
+    gtk_dialog_response ( GTK_DIALOG(tpwin), VIK_TRW_LAYER_TPWIN_DATA_CHANGED );
   }
 }
 
@@ -146,6 +150,7 @@ static void tpwin_sync_ts_to_tp ( VikTrwLayerTpwin *tpwin )
     if ( !isnan(tpwin->cur_tp->timestamp) ) {
       tpwin->cur_tp->timestamp = gtk_spin_button_get_value ( tpwin->ts );
       tpwin_update_times ( tpwin, tpwin->cur_tp );
+      gtk_dialog_response ( GTK_DIALOG(tpwin), VIK_TRW_LAYER_TPWIN_DATA_CHANGED );
     }
   }
 }
@@ -459,24 +464,25 @@ void vik_trw_layer_tpwin_set_empty ( VikTrwLayerTpwin *tpwin )
   gtk_label_set_text ( tpwin->temp, NULL );
   gtk_label_set_text ( tpwin->power, NULL );
 
+  tpwin->cur_number = 0;
   gtk_window_set_title ( GTK_WINDOW(tpwin), _("Trackpoint") );
 }
 
 /**
  * vik_trw_layer_tpwin_set_tp:
  * @tpwin:      The Trackpoint Edit Window
- * @tpl:        The #Glist of trackpoints pointing at the current trackpoint
- * @track_name: The name of the track in which the trackpoint belongs
- * @is_route:   Is the track of the trackpoint actually a route?
+ * @cur:        The current trackpoint in its track
  *
- * Sets the Trackpoint Edit Window to the values of the current trackpoint given in @tpl.
+ * Sets the Trackpoint Edit Window to the values of the current trackpoint given in @cur.
  *
  */
-void vik_trw_layer_tpwin_set_tp ( VikTrwLayerTpwin *tpwin, GList *tpl, const gchar *track_name, gboolean is_route )
+void vik_trw_layer_tpwin_set_tp ( VikTrwLayerTpwin *tpwin, VikTrackCursor *cur )
 {
   static char tmp_str[64];
   static struct LatLon ll;
+  GList *tpl = cur->tpl;
   VikTrackpoint *tp = VIK_TRACKPOINT(tpl->data);
+  gboolean is_route = cur->trk->is_route;
 
   if ( tp->name )
     gtk_entry_set_text ( GTK_ENTRY(tpwin->trkpt_name), tp->name );
@@ -506,7 +512,10 @@ void vik_trw_layer_tpwin_set_tp ( VikTrwLayerTpwin *tpwin, GList *tpl, const gch
     gtk_button_set_image ( GTK_BUTTON(tpwin->time), img );
   }
 
-  vik_trw_layer_tpwin_set_track_name ( tpwin, track_name );
+  // Normally known from stepping along the track, so this need not count through the trackpoints
+  tpwin->cur_number = vik_track_cursor_get_index ( cur ) + 1;
+  tpwin->tp_count = vik_track_cursor_get_count ( cur );
+  vik_trw_layer_tpwin_set_track_name ( tpwin, cur->trk->name );
 
   tpwin->sync_to_tp_block = TRUE; /* don't update while setting data. */
 
@@ -634,7 +643,11 @@ void vik_trw_layer_tpwin_set_tp ( VikTrwLayerTpwin *tpwin, GList *tpl, const gch
 
 void vik_trw_layer_tpwin_set_track_name ( VikTrwLayerTpwin *tpwin, const gchar *track_name )
 {
-  gchar *tmp_name = g_strdup_printf ( "%s: %s", track_name, _("Trackpoint") );
+  gchar *tmp_name;
+  if ( tpwin->cur_number )
+    tmp_name = g_strdup_printf ( _("%s: Trackpoint %d of %u"), track_name, tpwin->cur_number, tpwin->tp_count );
+  else
+    tmp_name = g_strdup_printf ( "%s: %s", track_name, _("Trackpoint") );
   gtk_window_set_title ( GTK_WINDOW(tpwin), tmp_name );
   g_free ( tmp_name );
   //gtk_label_set_text ( tpwin->track_name, track_name );
@@ -22,6 +22,7 @@
 #include "viking.h"
 #include "viktrwlayer_tracklist.h"
 #include "viktrwlayer_propwin.h"
+#include "viklistmodel.h"
 
 // Long formatted date+basic time - listing this way ensures the string comparison sort works - so no local type format %x or %c here!
 #define TRACK_LIST_DATE_FORMAT "%Y-%m-%d %H:%M"
@@ -62,7 +63,7 @@ static gboolean configure_event ( GtkWidget *widget, GdkEventConfigure *event, g
   return FALSE;
 }
 
-#define TRK_LIST_COLS 12
+#define TRK_LIST_COLS 13
 #define TRK_COL_NUM TRK_LIST_COLS-1
 #define TRW_COL_NUM TRK_COL_NUM-1
 
@@ -398,94 +399,88 @@ static gboolean trw_layer_track_button_pressed ( GtkWidget *tree_view,
 	return trw_layer_track_menu_popup ( tree_view, event, data );
 }
 
+typedef struct {
+	vik_units_distance_t dist_units;
+	vik_units_speed_t speed_units;
+	vik_units_height_t height_units;
+	gchar *date_format;
+	GHashTable *notes;
+} list_data_t;
+
+static void list_data_free ( list_data_t *ld )
+{
+	g_free ( ld->date_format );
+	if ( ld->notes )
+		g_hash_table_unref ( ld->notes );
+	g_free ( ld );
+}
+
+#define BASIC_COLS ((1<<0) | (1<<1) | (1<<3) | (1<<9) | (1<<TRW_COL_NUM) | (1<<TRK_COL_NUM))
+#define SUMMARY_COLS ((1<<4) | (1<<5) | (1<<6) | (1<<7) | (1<<8))
+
 /*
- * Foreach entry we copy the various individual track properties into the tree store
- *  formatting & converting the internal values into something for display
+ * The various individual track properties are only worked out when the row is shown (or sorted on),
+ *  formatting & converting the internal values into something for display.
+ * The values come in groups, so each group is calculated together.
  */
-static void trw_layer_track_list_add ( vik_trw_and_track_t *vtt,
-                                       GtkTreeStore *store,
-                                       vik_units_distance_t dist_units,
-                                       vik_units_speed_t speed_units,
-                                       vik_units_height_t height_units,
-                                       const gchar* date_format )
+static guint32 trw_layer_track_list_fill ( vik_trw_and_track_t *vtt, gint column, GValue *values, list_data_t *ld )
 {
-	GtkTreeIter t_iter;
 	VikTrack *trk = vtt->trk;
 	VikTrwLayer *vtl = vtt->vtl;
 
-	// Store unit converted value
-	gdouble trk_dist = vu_distance_convert ( dist_units, vik_track_get_length(trk) );
-
-	// Get start date
-	gchar time_buf[32];
-	time_buf[0] = '\0';
-	if ( trk->trackpoints && !isnan(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp) ) {
-		VikTrackpoint *tp = VIK_TRACKPOINT(trk->trackpoints->data);
-		time_t tt = tp->timestamp;
-		gchar *time = vu_get_time_string ( &tt, date_format, &tp->coord, NULL );
-		g_strlcpy ( time_buf, time, sizeof(time_buf) );
-		g_free ( time );
+	if ( column == 2 ) {
+		// Get start date
+		gchar *time = NULL;
+		if ( trk->trackpoints && !isnan(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp) ) {
+			VikTrackpoint *tp = VIK_TRACKPOINT(trk->trackpoints->data);
+			time_t tt = tp->timestamp;
+			time = vu_get_time_string_cached ( &tt, ld->date_format, &tp->coord, &trk->tz_cache );
+		}
+		g_value_take_string ( &values[2], time ? time : g_strdup("") );
+		return 1 << 2;
 	}
 
-	gboolean visible = trk->visible && (trk->is_route ? vik_trw_layer_get_routes_visibility(vtl) : vik_trw_layer_get_tracks_visibility(vtl));
-	visible = visible && vik_treeview_item_get_visible_tree ( VIK_LAYER(vtl)->vt, &(VIK_LAYER(vtl)->iter) );
-
-	guint trk_len_time = 0; // In minutes
-	if ( trk->trackpoints ) {
-		gdouble t1, t2;
-		t1 = VIK_TRACKPOINT(g_list_first(trk->trackpoints)->data)->timestamp;
-		t2 = VIK_TRACKPOINT(g_list_last(trk->trackpoints)->data)->timestamp;
-		if ( !isnan(t1) && !isnan(t2) )
-			trk_len_time = (int)round(labs(t2-t1)/60.0);
+	if ( column == 10 ) {
+		const gchar *notes = ld->notes ? g_hash_table_lookup ( ld->notes, trk ) : NULL;
+		g_value_set_string ( &values[10], notes ? notes : "" );
+		return 1 << 10;
 	}
 
-	gdouble av_speed = 0.0;
-	gdouble max_speed = 0.0;
-	gdouble max_alt = 0.0;
-
-	av_speed = vik_track_get_average_speed ( trk );
-	av_speed = vu_speed_convert ( speed_units, av_speed );
-
-	max_speed = vik_track_get_max_speed ( trk );
-	max_speed = vu_speed_convert ( speed_units, max_speed );
-
-	// TODO - make this a function to get min / max values?
-	gdouble *altitudes = NULL;
-	altitudes = vik_track_make_elevation_map ( trk, 500 );
-	if ( altitudes ) {
-		max_alt = -1000;
-		guint i;
-		for ( i=0; i < 500; i++ ) {
-			if ( !isnan(altitudes[i]) ) {
-				if ( altitudes[i] > max_alt )
-					max_alt = altitudes[i];
-			}
+	if ( (1 << column) & SUMMARY_COLS ) {
+		// Uses the remembered summary of the track
+		VikTrackSummary summary;
+		vik_track_get_summary ( trk, &summary );
+
+		guint trk_len_time = 0; // In minutes
+		if ( !isnan(summary.start_time) && !isnan(summary.end_time) )
+			trk_len_time = (int)round(fabs(summary.end_time-summary.start_time)/60.0);
+
+		gdouble max_alt = summary.has_alt ? summary.max_alt : 0.0;
+		switch (ld->height_units) {
+		case VIK_UNITS_HEIGHT_FEET: max_alt = VIK_METERS_TO_FEET(max_alt); break;
+		default:
+			// VIK_UNITS_HEIGHT_METRES: no need to convert
+			break;
 		}
-	}
-	g_free ( altitudes );
 
-	switch (height_units) {
-	case VIK_UNITS_HEIGHT_FEET: max_alt = VIK_METERS_TO_FEET(max_alt); break;
-	default:
-		// VIK_UNITS_HEIGHT_METRES: no need to convert
-		break;
+		g_value_set_double ( &values[4], vu_distance_convert ( ld->dist_units, summary.length ) );
+		g_value_set_uint ( &values[5], trk_len_time );
+		g_value_set_double ( &values[6], vu_speed_convert ( ld->speed_units, summary.avg_speed ) );
+		g_value_set_double ( &values[7], vu_speed_convert ( ld->speed_units, summary.max_speed ) );
+		g_value_set_int ( &values[8], (gint)round(max_alt) );
+		return SUMMARY_COLS;
 	}
 
-	gtk_tree_store_append ( store, &t_iter, NULL );
-	gtk_tree_store_set ( store, &t_iter,
-	                     0, VIK_LAYER(vtl)->name,
-	                     1, trk->name,
-	                     2, time_buf,
-	                     3, visible,
-	                     4, trk_dist,
-	                     5, trk_len_time,
-	                     6, av_speed,
-	                     7, max_speed,
-	                     8, (gint)round(max_alt),
-	                     9, trk->is_route,
-	                     TRW_COL_NUM, vtl,
-	                     TRK_COL_NUM, trk,
-	                     -1 );
+	gboolean visible = trk->visible && (trk->is_route ? vik_trw_layer_get_routes_visibility(vtl) : vik_trw_layer_get_tracks_visibility(vtl));
+	visible = visible && vik_treeview_item_get_visible_tree ( VIK_LAYER(vtl)->vt, &(VIK_LAYER(vtl)->iter) );
+
+	g_value_set_string ( &values[0], VIK_LAYER(vtl)->name );
+	g_value_set_string ( &values[1], trk->name );
+	g_value_set_boolean ( &values[3], visible );
+	g_value_set_boolean ( &values[9], trk->is_route );
+	g_value_set_pointer ( &values[TRW_COL_NUM], vtl );
+	g_value_set_pointer ( &values[TRK_COL_NUM], trk );
+	return BASIC_COLS;
 }
 
 static gboolean
@@ -554,53 +549,61 @@ filter_changed_cb (GtkEntry   *entry,
  * @dialog:            The dialog to create the widgets in
  * @tracks_and_layers: The list of tracks (and it's layer) to be shown
  * @show_layer_names:  Show the layer names that each track belongs to
+ * @notes_title:       The heading for the notes column
+ * @notes:             Optional text to show for each #VikTrack
  *
  * Create a table of tracks with corresponding track information
  * This table does not support being actively updated
  */
 static void vik_trw_layer_track_list_internal ( GtkWidget *dialog,
                                                 GList *tracks_and_layers,
-                                                gboolean show_layer_names )
+                                                gboolean show_layer_names,
+                                                const gchar *notes_title,
+                                                GHashTable *notes )
 {
 	if ( !tracks_and_layers )
 		return;
 
-	// It's simple storing the gdouble values in the tree store as the sort works automatically
+	// It's simple storing the gdouble values in the model as the sort works automatically
 	// Then apply specific cell data formatting (rather default double is to 6 decimal places!)
-	GtkTreeStore *store = gtk_tree_store_new ( TRK_LIST_COLS,
-	                                           G_TYPE_STRING,    // 0: Layer Name
-	                                           G_TYPE_STRING,    // 1: Track Name
-	                                           G_TYPE_STRING,    // 2: Date
-	                                           G_TYPE_BOOLEAN,   // 3: Visible
-	                                           G_TYPE_DOUBLE,    // 4: Distance
-	                                           G_TYPE_UINT,      // 5: Length in time
-	                                           G_TYPE_DOUBLE,    // 6: Av. Speed
-	                                           G_TYPE_DOUBLE,    // 7: Max Speed
-	                                           G_TYPE_INT,       // 8: Max Height
-	                                           G_TYPE_BOOLEAN,   // 9: Is Route
-	                                           G_TYPE_POINTER,   // 10: TrackWaypoint Layer pointer
-	                                           G_TYPE_POINTER ); // 11: Track pointer
+	const GType types[TRK_LIST_COLS] = {
+		G_TYPE_STRING,    // 0: Layer Name
+		G_TYPE_STRING,    // 1: Track Name
+		G_TYPE_STRING,    // 2: Date
+		G_TYPE_BOOLEAN,   // 3: Visible
+		G_TYPE_DOUBLE,    // 4: Distance
+		G_TYPE_UINT,      // 5: Length in time
+		G_TYPE_DOUBLE,    // 6: Av. Speed
+		G_TYPE_DOUBLE,    // 7: Max Speed
+		G_TYPE_INT,       // 8: Max Height
+		G_TYPE_BOOLEAN,   // 9: Is Route
+		G_TYPE_STRING,    // 10: Notes
+		G_TYPE_POINTER,   // 11: TrackWaypoint Layer pointer
+		G_TYPE_POINTER }; // 12: Track pointer
 
 	//gtk_tree_selection_set_select_function ( gtk_tree_view_get_selection (GTK_TREE_VIEW(vt)), vik_treeview_selection_filter, vt, NULL );
 
-	vik_units_distance_t dist_units = a_vik_get_units_distance ();
-	vik_units_speed_t speed_units = a_vik_get_units_speed ();
-	vik_units_height_t height_units = a_vik_get_units_height ();
-
-	//GList *gl = get_tracks_and_layers_cb ( vl, user_data );
-	//g_list_foreach ( tracks_and_layers, (GFunc) trw_layer_track_list_add, store );
-	gchar *date_format = NULL;
-	if ( !a_settings_get_string ( VIK_SETTINGS_LIST_DATE_FORMAT, &date_format ) )
-		date_format = g_strdup ( TRACK_LIST_DATE_FORMAT );
-
+	list_data_t *ld = g_malloc0 ( sizeof(list_data_t) );
+	ld->dist_units = a_vik_get_units_distance ();
+	ld->speed_units = a_vik_get_units_speed ();
+	ld->height_units = a_vik_get_units_height ();
+	if ( !a_settings_get_string ( VIK_SETTINGS_LIST_DATE_FORMAT, &ld->date_format ) )
+		ld->date_format = g_strdup ( TRACK_LIST_DATE_FORMAT );
+	ld->notes = notes ? g_hash_table_ref ( notes ) : NULL;
+	vik_units_distance_t dist_units = ld->dist_units;
+	vik_units_speed_t speed_units = ld->speed_units;
+	vik_units_height_t height_units = ld->height_units;
+
+	// Row values are only calculated when needed, so even very long lists are shown straightaway
 	gboolean is_only_routes = TRUE;
-	GList *gl = tracks_and_layers;
-	while ( gl ) {
-		trw_layer_track_list_add ( (vik_trw_and_track_t*)gl->data, store, dist_units, speed_units, height_units, date_format );
+	GPtrArray *items = g_ptr_array_sized_new ( g_list_length(tracks_and_layers) );
+	for ( GList *gl = tracks_and_layers; gl; gl = g_list_next(gl) ) {
+		g_ptr_array_add ( items, gl->data );
 		is_only_routes = is_only_routes & ((vik_trw_and_track_t*)gl->data)->trk->is_route;
-		gl = g_list_next ( gl );
 	}
-	g_free ( date_format );
+	VikListModel *store = vik_list_model_new ( TRK_LIST_COLS, types, items, (VikListModelFillFunc)trw_layer_track_list_fill, ld );
+	g_object_set_data_full ( G_OBJECT(store), "list-data", ld, (GDestroyNotify)list_data_free );
+	g_ptr_array_unref ( items );
 
 	GtkWidget *view = gtk_tree_view_new();
 	GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
@@ -632,6 +635,13 @@ static void vik_trw_layer_track_list_internal ( GtkWidget *dialog,
 	if ( !is_only_routes ) {
 		column = ui_new_column_text ( _("Date"), renderer, view, column_runner++ );
 		gtk_tree_view_column_set_expand ( column, TRUE );
+		// As the rows are not measured, ensure it is wide enough for a date
+		GDateTime *now = g_date_time_new_now_local ();
+		gchar *sample = g_date_time_format ( now, ld->date_format );
+		if ( sample )
+			gtk_tree_view_column_set_fixed_width ( column, ui_get_text_width(view, sample) + 10 );
+		g_free ( sample );
+		g_date_time_unref ( now );
 	} else
 		column_runner++;
 
@@ -687,6 +697,16 @@ static void vik_trw_layer_track_list_internal ( GtkWidget *dialog,
 	gtk_tree_view_append_column ( GTK_TREE_VIEW(view), column );
 	column_runner++;
 
+	if ( notes ) {
+		column = ui_new_column_text ( notes_title, renderer, view, column_runner++ );
+		gtk_tree_view_column_set_expand ( column, TRUE );
+	}
+	else
+		column_runner++;
+
+	// Only the rows being shown then need their values
+	ui_tree_view_set_fixed_height_mode ( view );
+
 	GtkTreeModelFilter *model = GTK_TREE_MODEL_FILTER(gtk_tree_model_filter_new ( GTK_TREE_MODEL(store), NULL));
 	GtkTreeModelSort *sorted = GTK_TREE_MODEL_SORT(gtk_tree_model_sort_new_with_model ( GTK_TREE_MODEL(model) ));
 
@@ -745,6 +765,26 @@ void vik_trw_layer_track_list_show_dialog ( gchar *title,
                                             gpointer user_data,
                                             VikTrwlayerGetTracksAndLayersFunc get_tracks_and_layers_cb,
                                             gboolean show_layer_names )
+{
+	vik_trw_layer_track_list_show_dialog_notes ( title, vl, user_data, get_tracks_and_layers_cb, show_layer_names, NULL, NULL );
+}
+
+/**
+ * vik_trw_layer_track_list_show_dialog_notes:
+ * @notes_title: The heading for the notes column
+ * @notes:       A #GHashTable of #VikTrack to text shown in an extra column
+ *               (or NULL for no extra column)
+ *
+ * As vik_trw_layer_track_list_show_dialog(), with something more to say about each track
+ *
+ */
+void vik_trw_layer_track_list_show_dialog_notes ( gchar *title,
+                                                  VikLayer *vl,
+                                                  gpointer user_data,
+                                                  VikTrwlayerGetTracksAndLayersFunc get_tracks_and_layers_cb,
+                                                  gboolean show_layer_names,
+                                                  const gchar *notes_title,
+                                                  GHashTable *notes )
 {
 	GtkWidget *dialog = gtk_dialog_new_with_buttons ( title,
 	                                                  VIK_GTK_WINDOW_FROM_LAYER(vl),
@@ -755,7 +795,7 @@ void vik_trw_layer_track_list_show_dialog ( gchar *title,
 
 	GList *gl = get_tracks_and_layers_cb ( vl, user_data );
 
-	vik_trw_layer_track_list_internal ( dialog, gl, show_layer_names );
+	vik_trw_layer_track_list_internal ( dialog, gl, show_layer_names, notes_title, notes );
 
 	// Use response to close the dialog with tidy up
 	g_signal_connect ( G_OBJECT(dialog), "response", G_CALLBACK(track_close_cb), gl );
@@ -767,7 +807,7 @@ void vik_trw_layer_track_list_show_dialog ( gchar *title,
 
 	// Ensure a reasonable number of items are shown
 	if ( width == 0 )
-		width = show_layer_names ? 1000 : 850;
+		width = (show_layer_names ? 1000 : 850) + (notes ? 250 : 0);
 
 	// ATM lock out on dialog run - to prevent list contents being manipulated in other parts of the GUI whilst shown here.
 	gtk_dialog_run (GTK_DIALOG (dialog));
@@ -33,6 +33,14 @@ void vik_trw_layer_track_list_show_dialog ( gchar *title,
                                             VikTrwlayerGetTracksAndLayersFunc get_tracks_and_layers_cb,
                                             gboolean is_aggregate );
 
+void vik_trw_layer_track_list_show_dialog_notes ( gchar *title,
+                                                  VikLayer *vl,
+                                                  gpointer user_data,
+                                                  VikTrwlayerGetTracksAndLayersFunc get_tracks_and_layers_cb,
+                                                  gboolean is_aggregate,
+                                                  const gchar *notes_title,
+                                                  GHashTable *notes );
+
 G_END_DECLS
 
 #endif
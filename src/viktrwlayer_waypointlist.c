@@ -23,6 +23,7 @@
 #include "viktrwlayer_waypointlist.h"
 #include "viktrwlayer_wpwin.h"
 #include "dem.h"
+#include "viklistmodel.h"
 
 // Long formatted date+basic time - listing this way ensures the string comparison sort works - so no local type format %x or %c here!
 #define WAYPOINT_LIST_DATE_FORMAT "%Y-%m-%d %H:%M"
@@ -425,27 +426,40 @@ static gboolean trw_layer_waypoint_button_pressed ( GtkWidget *tree_view,
 	return trw_layer_waypoint_menu_popup ( tree_view, event, data );
 }
 
+typedef struct {
+	vik_units_height_t height_units;
+	gchar *date_format;
+} list_data_t;
+
+static void list_data_free ( list_data_t *ld )
+{
+	g_free ( ld->date_format );
+	g_free ( ld );
+}
+
 /*
- * Foreach entry we copy the various individual waypoint properties into the tree store
+ * The various individual waypoint properties are only worked out when the row is shown (or sorted on),
  *  formatting & converting the internal values into something for display
  */
-static void trw_layer_waypoint_list_add ( vik_trw_waypoint_list_t *vtdl,
-                                          GtkTreeStore *store,
-                                          vik_units_height_t height_units,
-                                          const gchar* date_format )
+static guint32 trw_layer_waypoint_list_fill ( vik_trw_waypoint_list_t *vtdl, gint column, GValue *values, list_data_t *ld )
 {
-	GtkTreeIter t_iter;
 	VikWaypoint *wpt = vtdl->wpt;
 	VikTrwLayer *vtl = vtdl->vtl;
 
-	// Get start date
-	gchar time_buf[32];
-	time_buf[0] = '\0';
-	if ( !isnan(wpt->timestamp) ) {
-		time_t tt = wpt->timestamp;
-		gchar *time = vu_get_time_string ( &tt, date_format, &wpt->coord, NULL );
-		g_strlcpy ( time_buf, time, sizeof(time_buf) );
-		g_free ( time );
+	if ( column == 2 ) {
+		// Get start date
+		gchar *time = NULL;
+		if ( !isnan(wpt->timestamp) ) {
+			time_t tt = wpt->timestamp;
+			time = vu_get_time_string_cached ( &tt, ld->date_format, &wpt->coord, &wpt->tz_cache );
+		}
+		g_value_take_string ( &values[2], time ? time : g_strdup("") );
+		return 1 << 2;
+	}
+
+	if ( column == 6 ) {
+		g_value_set_object ( &values[6], get_wp_sym_small (wpt->symbol) );
+		return 1 << 6;
 	}
 
 	gboolean visible = wpt->visible && vik_trw_layer_get_waypoints_visibility ( vtl );
@@ -455,7 +469,7 @@ static void trw_layer_waypoint_list_add ( vik_trw_waypoint_list_t *vtdl,
 	if ( isnan(alt) ) {
 		alt = VIK_DEM_INVALID_ELEVATION;
 	} else {
-		switch (height_units) {
+		switch (ld->height_units) {
 		case VIK_UNITS_HEIGHT_FEET: alt = VIK_METERS_TO_FEET(alt); break;
 		default:
 			// VIK_UNITS_HEIGHT_METRES: no need to convert
@@ -463,18 +477,14 @@ static void trw_layer_waypoint_list_add ( vik_trw_waypoint_list_t *vtdl,
 		}
 	}
 
-	gtk_tree_store_append ( store, &t_iter, NULL );
-	gtk_tree_store_set ( store, &t_iter,
-	                     0, VIK_LAYER(vtl)->name,
-	                     1, wpt->name,
-	                     2, time_buf,
-	                     3, visible,
-	                     4, wpt->comment,
-	                     5, (gint)round(alt),
-	                     6, get_wp_sym_small (wpt->symbol),
-	                     TRW_COL_NUM, vtl,
-	                     WPT_COL_NUM, wpt,
-	                     -1 );
+	g_value_set_string ( &values[0], VIK_LAYER(vtl)->name );
+	g_value_set_string ( &values[1], wpt->name );
+	g_value_set_boolean ( &values[3], visible );
+	g_value_set_string ( &values[4], wpt->comment );
+	g_value_set_int ( &values[5], (gint)round(alt) );
+	g_value_set_pointer ( &values[TRW_COL_NUM], vtl );
+	g_value_set_pointer ( &values[WPT_COL_NUM], wpt );
+	return (1<<0) | (1<<1) | (1<<3) | (1<<4) | (1<<5) | (1<<TRW_COL_NUM) | (1<<WPT_COL_NUM);
 }
 
 static gboolean
@@ -595,36 +605,35 @@ static void vik_trw_layer_waypoint_list_internal ( GtkWidget *dialog,
 	if ( !waypoints_and_layers )
 		return;
 
-	// It's simple storing the gdouble values in the tree store as the sort works automatically
+	// It's simple storing the gdouble values in the model as the sort works automatically
 	// Then apply specific cell data formatting (rather default double is to 6 decimal places!)
 	// However not storing any doubles for waypoints ATM
-	GtkTreeStore *store = gtk_tree_store_new ( WPT_LIST_COLS,
-	                                           G_TYPE_STRING,    // 0: Layer Name
-	                                           G_TYPE_STRING,    // 1: Waypoint Name
-	                                           G_TYPE_STRING,    // 2: Date
-	                                           G_TYPE_BOOLEAN,   // 3: Visible
-	                                           G_TYPE_STRING,    // 4: Comment
-	                                           G_TYPE_INT,       // 5: Height
-	                                           GDK_TYPE_PIXBUF,  // 6: Symbol Icon
-	                                           G_TYPE_POINTER,   // 7: TrackWaypoint Layer pointer
-	                                           G_TYPE_POINTER ); // 8: Waypoint pointer
+	const GType types[WPT_LIST_COLS] = {
+		G_TYPE_STRING,    // 0: Layer Name
+		G_TYPE_STRING,    // 1: Waypoint Name
+		G_TYPE_STRING,    // 2: Date
+		G_TYPE_BOOLEAN,   // 3: Visible
+		G_TYPE_STRING,    // 4: Comment
+		G_TYPE_INT,       // 5: Height
+		GDK_TYPE_PIXBUF,  // 6: Symbol Icon
+		G_TYPE_POINTER,   // 7: TrackWaypoint Layer pointer
+		G_TYPE_POINTER }; // 8: Waypoint pointer
 
 	//gtk_tree_selection_set_select_function ( gtk_tree_view_get_selection (GTK_TREE_VIEW(vt)), vik_treeview_selection_filter, vt, NULL );
 
-	vik_units_height_t height_units = a_vik_get_units_height ();
-
-	//GList *gl = get_waypoints_and_layers_cb ( vl, user_data );
-	//g_list_foreach ( waypoints_and_layers, (GFunc) trw_layer_waypoint_list_add, store );
-	gchar *date_format = NULL;
-	if ( !a_settings_get_string ( VIK_SETTINGS_LIST_DATE_FORMAT, &date_format ) )
-		date_format = g_strdup ( WAYPOINT_LIST_DATE_FORMAT );
+	list_data_t *ld = g_malloc0 ( sizeof(list_data_t) );
+	ld->height_units = a_vik_get_units_height ();
+	if ( !a_settings_get_string ( VIK_SETTINGS_LIST_DATE_FORMAT, &ld->date_format ) )
+		ld->date_format = g_strdup ( WAYPOINT_LIST_DATE_FORMAT );
+	vik_units_height_t height_units = ld->height_units;
 
-	GList *gl = waypoints_and_layers;
-	while ( gl ) {
-		trw_layer_waypoint_list_add ( (vik_trw_waypoint_list_t*)gl->data, store, height_units, date_format );
-		gl = g_list_next ( gl );
-	}
-	g_free ( date_format );
+	// Row values are only calculated when needed, so even very long lists are shown straightaway
+	GPtrArray *items = g_ptr_array_sized_new ( g_list_length(waypoints_and_layers) );
+	for ( GList *gl = waypoints_and_layers; gl; gl = g_list_next(gl) )
+		g_ptr_array_add ( items, gl->data );
+	VikListModel *store = vik_list_model_new ( WPT_LIST_COLS, types, items, (VikListModelFillFunc)trw_layer_waypoint_list_fill, ld );
+	g_object_set_data_full ( G_OBJECT(store), "list-data", ld, (GDestroyNotify)list_data_free );
+	g_ptr_array_unref ( items );
 
 	GtkWidget *view = gtk_tree_view_new();
 	GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
@@ -652,6 +661,13 @@ static void vik_trw_layer_waypoint_list_internal ( GtkWidget *dialog,
 
 	column = ui_new_column_text ( _("Date"), renderer, view, column_runner++ );
 	gtk_tree_view_column_set_resizable ( column, TRUE );
+	// As the rows are not measured, ensure it is wide enough for a date
+	GDateTime *now = g_date_time_new_now_local ();
+	gchar *sample = g_date_time_format ( now, ld->date_format );
+	if ( sample )
+		gtk_tree_view_column_set_fixed_width ( column, ui_get_text_width(view, sample) + 10 );
+	g_free ( sample );
+	g_date_time_unref ( now );
 
 	GtkCellRenderer *renderer_toggle = gtk_cell_renderer_toggle_new ();
 	column = gtk_tree_view_column_new_with_attributes ( _("Visible"), renderer_toggle, "active", column_runner, NULL );
@@ -673,13 +689,16 @@ static void vik_trw_layer_waypoint_list_internal ( GtkWidget *dialog,
 	GtkCellRenderer *renderer_pixbuf = gtk_cell_renderer_pixbuf_new ();
 	g_object_set (G_OBJECT (renderer_pixbuf), "xalign", 0.5, NULL);
 	column = gtk_tree_view_column_new_with_attributes ( _("Symbol"), renderer_pixbuf, "pixbuf", column_runner++, NULL );
-	// Special sort required for pixbufs
-	gtk_tree_sortable_set_sort_func ( GTK_TREE_SORTABLE(store), column_runner, sort_pixbuf_compare_func, NULL, NULL );
 	gtk_tree_view_column_set_sort_column_id ( column, column_runner );
 	gtk_tree_view_append_column ( GTK_TREE_VIEW(view), column );
 
+	// Only the rows being shown then need their values
+	ui_tree_view_set_fixed_height_mode ( view );
+
 	GtkTreeModelFilter *model = GTK_TREE_MODEL_FILTER(gtk_tree_model_filter_new ( GTK_TREE_MODEL(store), NULL));
 	GtkTreeModelSort *sorted = GTK_TREE_MODEL_SORT(gtk_tree_model_sort_new_with_model ( GTK_TREE_MODEL(model) ));
+	// Special sort required for pixbufs
+	gtk_tree_sortable_set_sort_func ( GTK_TREE_SORTABLE(sorted), column_runner, sort_pixbuf_compare_func, NULL, NULL );
 
 	gtk_tree_view_set_model ( GTK_TREE_VIEW(view), GTK_TREE_MODEL(sorted) );
 	gtk_tree_selection_set_mode ( gtk_tree_view_get_selection(GTK_TREE_VIEW(view)), GTK_SELECTION_MULTIPLE );
@@ -24,6 +24,7 @@
 #include "garminsymbols.h"
 #ifdef VIK_CONFIG_GEOTAG
 #include "geotag_exif.h"
+#include "geotagindex.h"
 #endif
 #include "thumbnails.h"
 #include "viking.h"
@@ -33,7 +34,7 @@
 static void update_time ( GtkWidget *widget, VikWaypoint *wp )
 {
   time_t tt = (time_t)wp->timestamp;
-  gchar *msg = vu_get_time_string ( &tt, "%c", &(wp->coord), NULL );
+  gchar *msg = vu_get_time_string_cached ( &tt, "%c", &(wp->coord), &wp->tz_cache );
   gtk_button_set_label ( GTK_BUTTON(widget), msg );
   g_free ( msg );
 }
@@ -597,17 +598,16 @@ VikTrwLayerWpwin *vik_trw_layer_wpwin_show ( GtkWindow *parent, VikTrwLayerWpwin
 
 #ifdef VIK_CONFIG_GEOTAG
   if ( !is_new && wp->image ) {
-    gboolean hasGeotag;
-    gchar *ignore = a_geotag_get_exif_date_from_file ( wp->image, &hasGeotag );
-    g_free ( ignore );
-    gtk_toggle_button_set_active ( GTK_TOGGLE_BUTTON(ww->hasGeotagCB), hasGeotag );
+    geotag_info_t info;
+    a_geotag_index_get ( wp->image, &info );
+    gtk_toggle_button_set_active ( GTK_TOGGLE_BUTTON(ww->hasGeotagCB), info.has_gps );
 
-    if ( hasGeotag ) {
-      struct LatLon ll = a_geotag_get_position ( wp->image );
+    if ( info.has_gps ) {
       VikCoord coord;
-      vik_coord_load_from_latlon ( &coord, ww->coord_mode, &ll );
+      vik_coord_load_from_latlon ( &coord, ww->coord_mode, &info.ll );
       gtk_toggle_button_set_active ( GTK_TOGGLE_BUTTON(ww->consistentGeotagCB), vik_coord_equalish(&coord, &wp->coord) );
     }
+    a_geotag_info_clear ( &info );
   }
 
   if ( !is_new && !isnan(wp->image_direction) ) {
@@ -30,7 +30,7 @@
 #include "settings.h"
 #include "dir.h"
 #include "degrees_converters.h"
-#include "misc/kdtree.h"
+#include "latlontz.h"
 #include "misc/gtkhtml-private.h"
 
 #define FMT_MAX_NUMBER_CODES 9
@@ -528,65 +528,58 @@ gchar *vu_get_canonical_filename ( VikLayer *vl, const gchar *filename )
   return canonical;
 }
 
-static struct kdtree *kd = NULL;
+#define VIK_SETTINGS_NEAREST_TZ_FACTOR "utils_nearest_tz_factor"
+
+static GSList *lltzs = NULL;
+static gsize lltz_setup = 0;
+static gdouble nearest_tz_factor = 1.0;
+
+// Shared GTimeZones by identifier, as creating one means reading its definition
+static GHashTable *time_zones = NULL;
+G_LOCK_DEFINE_STATIC(time_zones);
 
 /**
  * load_ll_tz_dir
- * @dir: The directory from which to load the latlontz.txt file
+ * @dir: The directory from which to load the latlontz.bin or otherwise the latlontz.txt file
  *
- * Returns: The number of elements within the latlontz.txt loaded
+ * Returns: The number of elements within the latlontz loaded
  */
 static gint load_ll_tz_dir ( const gchar *dir )
 {
-	gint inserted = 0;
-	gchar *lltz = g_build_filename ( dir, "latlontz.txt", NULL );
-	if ( g_access(lltz, R_OK) == 0 ) {
-		gchar buffer[4096];
-		long line_num = 0;
-		FILE *ff = g_fopen ( lltz, "r" );
-		if ( ff ) {
-			while ( fgets ( buffer, 4096, ff ) ) {
-				line_num++;
-				gchar **components = g_strsplit (buffer, " ", 3);
-				guint nn = g_strv_length ( components );
-				if ( nn == 3 ) {
-					double pt[2] = { g_ascii_strtod (components[0], NULL), g_ascii_strtod (components[1], NULL) };
-					gchar *timezone = g_strchomp ( components[2] );
-					if ( kd_insert ( kd, pt, timezone ) )
-						g_critical ( "Insertion problem of %s for line %ld of latlontz.txt", timezone, line_num );
-					else
-						inserted++;
-					// NB Don't free timezone as it's part of the kdtree data now
-					g_free ( components[0] );
-					g_free ( components[1] );
-				} else {
-					g_warning ( "Line %ld of latlontz.txt does not have 3 parts", line_num );
-				}
-				g_free ( components );
-			}
-			fclose ( ff );
-		}
-		else {
-			g_warning ( "%s: Could not open %s", __FUNCTION__, lltz);
-		}
+	// Prefer the prebuilt form as it is used in place without processing
+	gchar *lltzbin = g_build_filename ( dir, "latlontz.bin", NULL );
+	LatLonTZ *lltz = NULL;
+	if ( g_access(lltzbin, R_OK) == 0 )
+		lltz = a_latlontz_new_from_binary ( lltzbin );
+	g_free ( lltzbin );
+
+	if ( !lltz ) {
+		gchar *lltztxt = g_build_filename ( dir, "latlontz.txt", NULL );
+		if ( g_access(lltztxt, R_OK) == 0 )
+			lltz = a_latlontz_new_from_text ( lltztxt );
+		g_free ( lltztxt );
 	}
-	g_free ( lltz );
 
-	return inserted;
+	if ( !lltz )
+		return 0;
+	lltzs = g_slist_prepend ( lltzs, lltz );
+	return a_latlontz_size ( lltz );
 }
 
 /**
  * vu_setup_lat_lon_tz_lookup:
  *
  * Can be called multiple times but only initializes the lookup once
+ * This is performed on first use, see vu_get_tz_at_location()
  */
 void vu_setup_lat_lon_tz_lookup ()
 {
-	// Only setup once
-	if ( kd )
+	// Only setup once, which may be from any thread
+	if ( !g_once_init_enter ( &lltz_setup ) )
 		return;
 
-	kd = kd_create(2);
+	if ( !a_settings_get_double(VIK_SETTINGS_NEAREST_TZ_FACTOR, &nearest_tz_factor) )
+		nearest_tz_factor = 1.0;
 
 	// Look in the directories of data path
 	gchar **data_dirs = a_get_viking_data_path();
@@ -601,6 +594,8 @@ void vu_setup_lat_lon_tz_lookup ()
 	g_debug ( "%s: Loaded %d elements", __FUNCTION__, loaded );
 	if ( loaded == 0 )
 		g_critical ( "%s: No lat/lon/timezones loaded", __FUNCTION__ );
+
+	g_once_init_leave ( &lltz_setup, 1 );
 }
 
 /**
@@ -611,21 +606,14 @@ void vu_setup_lat_lon_tz_lookup ()
  */
 void vu_finalize_lat_lon_tz_lookup ()
 {
-	if ( kd ) {
-		kd_data_destructor ( kd, g_free );
-		kd_free ( kd );
+	g_slist_free_full ( lltzs, (GDestroyNotify)a_latlontz_free );
+	lltzs = NULL;
+	if ( time_zones ) {
+		g_hash_table_destroy ( time_zones );
+		time_zones = NULL;
 	}
 }
 
-static double dist_sq( double *a1, double *a2, int dims ) {
-  double dist_sq = 0, diff;
-  while( --dims >= 0 ) {
-    diff = (a1[dims] - a2[dims]);
-    dist_sq += diff*diff;
-  }
-  return dist_sq;
-}
-
 static gchar* time_string_adjusted ( time_t *time, const gchar *format, gint offset_s )
 {
 	time_t *mytime = time;
@@ -638,6 +626,23 @@ static gchar* time_string_adjusted ( time_t *time, const gchar *format, gint off
 	return str;
 }
 
+/**
+ * Returns: The shared GTimeZone for the identifier, owned by the cache
+ */
+static GTimeZone* time_zone_get ( const gchar *tz )
+{
+	G_LOCK ( time_zones );
+	if ( !time_zones )
+		time_zones = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_time_zone_unref );
+	GTimeZone *gtz = g_hash_table_lookup ( time_zones, tz );
+	if ( !gtz ) {
+		gtz = g_time_zone_new ( tz );
+		g_hash_table_insert ( time_zones, g_strdup(tz), gtz );
+	}
+	G_UNLOCK ( time_zones );
+	return gtz;
+}
+
 static gchar* time_string_tz ( time_t *time, const gchar *format, GTimeZone *tz )
 {
 	GDateTime *utc = g_date_time_new_from_unix_utc (*time);
@@ -658,7 +663,6 @@ static gchar* time_string_tz ( time_t *time, const gchar *format, GTimeZone *tz
 	return str;
 }
 
-#define VIK_SETTINGS_NEAREST_TZ_FACTOR "utils_nearest_tz_factor"
 /**
  * vu_get_tz_at_location:
  *
@@ -672,37 +676,68 @@ static gchar* time_string_tz ( time_t *time, const gchar *format, GTimeZone *tz
 gchar* vu_get_tz_at_location ( const VikCoord* vc )
 {
 	gchar *tz = NULL;
-	if ( !vc || !kd )
+	if ( !vc )
+		return tz;
+
+	if ( a_vik_get_time_ref_frame() == VIK_TIME_REF_WORLD )
+		vu_setup_lat_lon_tz_lookup ();
+	if ( !lltzs )
 		return tz;
 
 	struct LatLon ll;
 	vik_coord_to_latlon ( vc, &ll );
-	double pt[2] = { ll.lat, ll.lon };
-
-	gdouble nearest;
-	if ( !a_settings_get_double(VIK_SETTINGS_NEAREST_TZ_FACTOR, &nearest) )
-		nearest = 1.0;
-
-	struct kdres *presults = kd_nearest_range ( kd, pt, nearest );
-	while( !kd_res_end( presults ) ) {
-		double pos[2];
-		gchar *ans = (gchar*)kd_res_item ( presults, pos );
-		// compute the distance of the current result from the pt
-		double dist = sqrt( dist_sq( pt, pos, 2 ) );
-		if ( dist < nearest ) {
-			//printf( "NEARER node at (%.3f, %.3f, %.3f) is %.3f away is %s\n", pos[0], pos[1], pos[2], dist, ans );
-			nearest = dist;
-			tz = ans;
-		}
-		kd_res_next ( presults );
+
+	gdouble nearest = nearest_tz_factor;
+
+	// Each search only finds locations nearer than the best so far
+	for ( GSList *iter = lltzs; iter; iter = iter->next ) {
+		const gchar *ans = a_latlontz_nearest ( iter->data, ll.lat, ll.lon, &nearest );
+		if ( ans )
+			tz = (gchar*)ans;
 	}
 	if ( vik_verbose )
-		g_debug ( "TZ lookup found %d results - picked %s", kd_res_size(presults), tz );
-	kd_res_free ( presults );
+		g_debug ( "TZ lookup picked %s at %.3f", tz, nearest );
 
 	return tz;
 }
 
+/**
+ * vu_get_tz_at_location_cached:
+ *
+ * @vc:     Position for which the time zone is desired
+ * @cache:  The remembered result for the object at that position, updated should the position have moved
+ *
+ * Returns: As vu_get_tz_at_location()
+ */
+const gchar* vu_get_tz_at_location_cached ( const VikCoord* vc, VikCoordTZ *cache )
+{
+	if ( !cache->valid || !vik_coord_equals ( &cache->coord, vc ) ) {
+		cache->tz = vu_get_tz_at_location ( vc );
+		cache->coord = *vc;
+		cache->valid = TRUE;
+	}
+	return cache->tz;
+}
+
+static gchar* time_string_world ( time_t *time, const gchar *format, const VikCoord* vc, const gchar *tz )
+{
+	if ( tz )
+		return time_string_tz ( time, format, time_zone_get ( tz ) );
+
+	if ( vc ) {
+		// No results (e.g. could be in the middle of a sea)
+		// Fallback to simplistic method that doesn't take into account Timezones of countries.
+		struct LatLon ll;
+		vik_coord_to_latlon ( vc, &ll );
+		return time_string_adjusted ( time, format, round ( ll.lon / 15.0 ) * 3600 );
+	}
+
+	GTimeZone *gtz = g_time_zone_new_local ();
+	gchar *str = time_string_tz ( time, format, gtz );
+	g_time_zone_unref ( gtz );
+	return str;
+}
+
 /**
  * vu_get_time_string:
  *
@@ -726,28 +761,10 @@ gchar* vu_get_time_string ( time_t *time, const gchar *format, const VikCoord* v
 			strftime ( str, 64, format, gmtime(time) ); // Always 'GMT'
 			break;
 		case VIK_TIME_REF_WORLD:
-			if ( vc && !tz ) {
-				// No timezone specified so work it out
-				gchar *mytz = vu_get_tz_at_location ( vc );
-				if ( mytz ) {
-					GTimeZone *gtz = g_time_zone_new ( mytz );
-					str = time_string_tz ( time, format, gtz );
-					g_time_zone_unref ( gtz );
-				}
-				else {
-					// No results (e.g. could be in the middle of a sea)
-					// Fallback to simplistic method that doesn't take into account Timezones of countries.
-					struct LatLon ll;
-					vik_coord_to_latlon ( vc, &ll );
-					str = time_string_adjusted ( time, format, round ( ll.lon / 15.0 ) * 3600 );
-				}
-			}
-			else {
-				// Use specified timezone
-				GTimeZone *gtz = g_time_zone_new ( tz );
-				str = time_string_tz ( time, format, gtz );
-				g_time_zone_unref ( gtz );
-			}
+			// No timezone specified so work it out
+			if ( vc && !tz )
+				tz = vu_get_tz_at_location ( vc );
+			str = time_string_world ( time, format, vc, tz );
 			break;
 		default: // VIK_TIME_REF_LOCALE
 			str = g_malloc ( 64 );
@@ -757,6 +774,22 @@ gchar* vu_get_time_string ( time_t *time, const gchar *format, const VikCoord* v
 	return str;
 }
 
+/**
+ * vu_get_time_string_cached:
+ *
+ * @cache:  Remembered timezone of the object at @vc, see vu_get_tz_at_location_cached()
+ *
+ * As vu_get_time_string() but avoiding looking up the timezone again for the same position,
+ *  for when formatting times of many objects such as in lists.
+ */
+gchar* vu_get_time_string_cached ( time_t *time, const gchar *format, const VikCoord* vc, VikCoordTZ *cache )
+{
+	if ( !format ) return NULL;
+	if ( vc && a_vik_get_time_ref_frame() == VIK_TIME_REF_WORLD )
+		return time_string_world ( time, format, vc, vu_get_tz_at_location_cached ( vc, cache ) );
+	return vu_get_time_string ( time, format, vc, NULL );
+}
+
 /**
  * vu_command_line:
  *
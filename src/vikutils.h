@@ -37,8 +37,10 @@ void vu_set_auto_features_on_first_run ( void );
 gchar *vu_get_canonical_filename ( VikLayer *vl, const gchar *filename );
 
 gchar* vu_get_time_string ( time_t *time, const gchar *format, const VikCoord *vc, const gchar *gtz );
+gchar* vu_get_time_string_cached ( time_t *time, const gchar *format, const VikCoord *vc, VikCoordTZ *cache );
 
 gchar* vu_get_tz_at_location ( const VikCoord* vc );
+const gchar* vu_get_tz_at_location_cached ( const VikCoord* vc, VikCoordTZ *cache );
 
 void vu_setup_lat_lon_tz_lookup ();
 void vu_finalize_lat_lon_tz_lookup ();
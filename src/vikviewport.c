@@ -50,6 +50,8 @@
 #include "globals.h"
 #include "settings.h"
 #include "dialog.h"
+#include "util.h"
+#include "background.h"
 
 gdouble mercator_factor ( gdouble x, guint scale )
 {
@@ -74,6 +76,17 @@ static void viewport_init_ra();
 
 static GObjectClass *parent_class;
 
+// The viewport state a buffer was drawn in
+typedef struct {
+  gboolean valid;
+  VikCoord center;
+  gdouble xmpp;
+  gdouble ympp;
+  gint width;
+  gint height;
+  VikViewportDrawMode drawmode;
+} ViewportStateT;
+
 struct _VikViewport {
   GtkDrawingArea drawing_area;
   GdkPixmap *scr_buffer;
@@ -112,10 +125,32 @@ struct _VikViewport {
 
   /* trigger stuff */
   gpointer trigger;
+  gpointer resume; // When half drawn, drawing starts again from this layer using the snapshot
   GdkPixmap *snapshot_buffer;
   gboolean half_drawn;
+  ViewportStateT snapshot_state;
+
+  // The layers as last drawn, without any decorations on top, for reuse when panning
+  GdkPixmap *scroll_buffer;
+  ViewportStateT scroll_state;
+  // Whilst drawing a strip, the viewport settings to restore afterwards
+  GdkPixmap *strip_buffer;
+  gint strip_x, strip_y;
+  VikCoord strip_center;
+  gint strip_width, strip_height;
+  gdouble strip_utm_zone_width;
+  gboolean strip_one_utm_zone;
+  gpointer strip_trigger;
+
+  GSList *overlays; // Drawn on the window on top of the buffer
 };
 
+typedef struct {
+  VikViewportOverlayFunc func;
+  gpointer data;
+  GdkRectangle area; // As last drawn on the window
+} ViewportOverlayT;
+
 static gdouble
 viewport_utm_zone_width ( VikViewport *vvp )
 {
@@ -281,7 +316,9 @@ vik_viewport_init ( VikViewport *vvp )
   // allow VVP to have focus -- enabling key events, etc...
   gtk_widget_set_can_focus ( GTK_WIDGET(vvp), TRUE );
 
-  default_vvp = vvp;
+  // Keep the first, rather than any temporary viewports created later
+  if ( !default_vvp )
+    default_vvp = vvp;
 }
 
 GdkColor vik_viewport_get_background_gdkcolor ( VikViewport *vvp )
@@ -392,6 +429,12 @@ void vik_viewport_configure_manually ( VikViewport *vvp, gint width, guint heigh
   if ( vvp->snapshot_buffer )
     g_object_unref ( G_OBJECT ( vvp->snapshot_buffer ) );
   vvp->snapshot_buffer = gdk_pixmap_new ( gtk_widget_get_window(GTK_WIDGET(vvp)), vvp->width, vvp->height, -1 );
+  vvp->snapshot_state.valid = FALSE;
+
+  if ( vvp->scroll_buffer )
+    g_object_unref ( G_OBJECT ( vvp->scroll_buffer ) );
+  vvp->scroll_buffer = gdk_pixmap_new ( gtk_widget_get_window(GTK_WIDGET(vvp)), vvp->width, vvp->height, -1 );
+  vvp->scroll_state.valid = FALSE;
 }
 
 
@@ -422,8 +465,14 @@ gboolean vik_viewport_configure ( VikViewport *vvp )
     g_object_unref ( G_OBJECT ( vvp->snapshot_buffer ) );
 
   vvp->snapshot_buffer = gdk_pixmap_new ( gtk_widget_get_window(GTK_WIDGET(vvp)), vvp->width, vvp->height, -1 );
+  vvp->snapshot_state.valid = FALSE;
   /* TODO trigger */
 
+  if ( vvp->scroll_buffer )
+    g_object_unref ( G_OBJECT ( vvp->scroll_buffer ) );
+  vvp->scroll_buffer = gdk_pixmap_new ( gtk_widget_get_window(GTK_WIDGET(vvp)), vvp->width, vvp->height, -1 );
+  vvp->scroll_state.valid = FALSE;
+
   /* this is down here so it can get a GC (necessary?) */
   if ( !vvp->background_gc )
   {
@@ -455,6 +504,9 @@ static void viewport_finalize ( GObject *gob )
   vik_viewport_reset_copyrights ( vvp );
   vik_viewport_reset_logos ( vvp );
 
+  if ( default_vvp == vvp )
+    default_vvp = NULL;
+
   if ( a_vik_get_startup_method ( ) == VIK_STARTUP_METHOD_LAST_LOCATION ) {
     struct LatLon ll;
     vik_coord_to_latlon ( &(vvp->center), &ll );
@@ -467,12 +519,17 @@ static void viewport_finalize ( GObject *gob )
   if ( vvp->centers )
     g_list_free_full ( vvp->centers, g_free );
 
+  g_slist_free_full ( vvp->overlays, g_free );
+
   if ( vvp->scr_buffer )
     g_object_unref ( G_OBJECT ( vvp->scr_buffer ) );
 
   if ( vvp->snapshot_buffer )
     g_object_unref ( G_OBJECT ( vvp->snapshot_buffer ) );
 
+  if ( vvp->scroll_buffer )
+    g_object_unref ( G_OBJECT ( vvp->scroll_buffer ) );
+
   if ( vvp->background_gc )
     g_object_unref ( G_OBJECT ( vvp->background_gc ) );
 
@@ -762,6 +819,30 @@ void vik_viewport_draw_logo ( VikViewport *vvp )
   }
 }
 
+/**
+ * vik_viewport_draw_text_panel:
+ *
+ * Draw some (multiline) text in a box at the top left of the viewport,
+ *  e.g. for the performance information
+ */
+void vik_viewport_draw_text_panel ( VikViewport *vvp, const gchar *text )
+{
+  g_return_if_fail ( vvp != NULL );
+
+  PangoRectangle logical_rect;
+  PangoLayout *pl = gtk_widget_create_pango_layout ( GTK_WIDGET(&vvp->drawing_area), NULL );
+  pango_layout_set_font_description ( pl, gtk_widget_get_style(GTK_WIDGET(&vvp->drawing_area))->font_desc );
+  pango_layout_set_text ( pl, text, -1 );
+  pango_layout_get_pixel_extents ( pl, NULL, &logical_rect );
+
+  GtkStyle *style = gtk_widget_get_style ( GTK_WIDGET(&vvp->drawing_area) );
+  vik_viewport_draw_rectangle ( vvp, style->white_gc, TRUE, PAD, PAD, logical_rect.width + PAD, logical_rect.height + PAD );
+  vik_viewport_draw_rectangle ( vvp, style->black_gc, FALSE, PAD, PAD, logical_rect.width + PAD, logical_rect.height + PAD );
+  vik_viewport_draw_layout ( vvp, style->black_gc, PAD + PAD/2, PAD + PAD/2, pl );
+
+  g_object_unref ( pl );
+}
+
 void vik_viewport_set_draw_highlight ( VikViewport *vvp, gboolean draw_highlight )
 {
   vvp->draw_highlight = draw_highlight;
@@ -772,10 +853,81 @@ gboolean vik_viewport_get_draw_highlight ( VikViewport *vvp )
   return vvp->draw_highlight;
 }
 
+static void viewport_draw_overlays ( VikViewport *vvp, GdkWindow *window )
+{
+  for ( GSList *iter = vvp->overlays; iter; iter = iter->next ) {
+    ViewportOverlayT *ov = iter->data;
+    ov->area.x = ov->area.y = ov->area.width = ov->area.height = 0;
+    ov->func ( vvp, GDK_DRAWABLE(window), &ov->area, ov->data );
+  }
+}
+
+// Put back what was under an overlay
+static void viewport_restore_overlay ( VikViewport *vvp, GdkWindow *window, ViewportOverlayT *ov )
+{
+  GdkRectangle screen = { 0, 0, vvp->width, vvp->height };
+  GdkRectangle area;
+  if ( ov->area.width > 0 && ov->area.height > 0 && gdk_rectangle_intersect ( &ov->area, &screen, &area ) )
+    gdk_draw_drawable ( window, gtk_widget_get_style(GTK_WIDGET(vvp))->bg_gc[0], GDK_DRAWABLE(vvp->scr_buffer),
+                        area.x, area.y, area.x, area.y, area.width, area.height );
+}
+
 void vik_viewport_sync ( VikViewport *vvp )
 {
   g_return_if_fail ( vvp != NULL );
   gdk_draw_drawable(gtk_widget_get_window(GTK_WIDGET(vvp)), gtk_widget_get_style(GTK_WIDGET(vvp))->bg_gc[0], GDK_DRAWABLE(vvp->scr_buffer), 0, 0, 0, 0, vvp->width, vvp->height);
+  viewport_draw_overlays ( vvp, gtk_widget_get_window(GTK_WIDGET(vvp)) );
+}
+
+/**
+ * vik_viewport_add_overlay:
+ * @func: Draws the overlay directly onto the window, setting the area it covers
+ *
+ * Overlays are drawn on top of the buffer whenever it is put on the window,
+ *  and can be redrawn by themselves via vik_viewport_sync_overlays() without redrawing any layers.
+ */
+void vik_viewport_add_overlay ( VikViewport *vvp, VikViewportOverlayFunc func, gpointer data )
+{
+  ViewportOverlayT *ov = g_malloc0 ( sizeof(ViewportOverlayT) );
+  ov->func = func;
+  ov->data = data;
+  vvp->overlays = g_slist_append ( vvp->overlays, ov );
+}
+
+/**
+ * vik_viewport_remove_overlay:
+ *
+ * Take the overlay off the window too
+ */
+void vik_viewport_remove_overlay ( VikViewport *vvp, VikViewportOverlayFunc func, gpointer data )
+{
+  GdkWindow *window = gtk_widget_get_window ( GTK_WIDGET(vvp) );
+  for ( GSList *iter = vvp->overlays; iter; iter = iter->next ) {
+    ViewportOverlayT *ov = iter->data;
+    if ( ov->func == func && ov->data == data ) {
+      if ( window && vvp->scr_buffer )
+        viewport_restore_overlay ( vvp, window, ov );
+      vvp->overlays = g_slist_delete_link ( vvp->overlays, iter );
+      g_free ( ov );
+      break;
+    }
+  }
+}
+
+/**
+ * vik_viewport_sync_overlays:
+ *
+ * Redraw only the overlays on the window, such as when what they show has moved
+ */
+void vik_viewport_sync_overlays ( VikViewport *vvp )
+{
+  GdkWindow *window = gtk_widget_get_window ( GTK_WIDGET(vvp) );
+  if ( !window || !vvp->scr_buffer )
+    return;
+  // Remove all before drawing any, so the overlays can not erase each other
+  for ( GSList *iter = vvp->overlays; iter; iter = iter->next )
+    viewport_restore_overlay ( vvp, window, iter->data );
+  viewport_draw_overlays ( vvp, window );
 }
 
 void vik_viewport_set_zoom ( VikViewport *vvp, gdouble xympp )
@@ -1232,7 +1384,7 @@ void vik_viewport_screen_to_coord ( VikViewport *vvp, int x, int y, VikCoord *co
  */
 void vik_viewport_coord_to_screen ( VikViewport *vvp, const VikCoord *coord, int *x, int *y )
 {
-  static VikCoord tmp;
+  VikCoord tmp;
   g_return_if_fail ( vvp != NULL );
 
   if ( coord->mode != vvp->coord_mode )
@@ -1271,6 +1423,126 @@ void vik_viewport_coord_to_screen ( VikViewport *vvp, const VikCoord *coord, int
   }
 }
 
+/**
+ * vik_viewport_get_mercator:
+ *
+ * Get the values to compute screen positions from longitudes and precomputed MERCLAT() latitudes:
+ *  x = width_2 + xfactor * (lon - center_lon)
+ *  y = height_2 + yfactor * (center_merc_lat - merc_lat)
+ * which is the same calculation as vik_viewport_coord_to_screen() does in the Mercator drawmode.
+ *
+ * Returns: FALSE if the viewport is not using the Mercator drawmode
+ */
+gboolean vik_viewport_get_mercator ( VikViewport *vvp, VikViewportMercator *vvm )
+{
+  if ( vvp->coord_mode != VIK_COORD_LATLON || vvp->drawmode != VIK_VIEWPORT_DRAWMODE_MERCATOR )
+    return FALSE;
+  vvm->center_lon = vvp->center.east_west;
+  vvm->center_merc_lat = MERCLAT(vvp->center.north_south);
+  vvm->xfactor = vvp->xmfactor;
+  vvm->yfactor = vvp->ymfactor;
+  vvm->width_2 = vvp->width_2;
+  vvm->height_2 = vvp->height_2;
+  return TRUE;
+}
+
+/**
+ * Find how far either side of the center latitude the Mercator projection can be approximated
+ *  by a cubic, whilst keeping within a small fraction of a pixel of the exact value.
+ * The coefficients of the cubic are returned in @aa.
+ */
+static gdouble mercator_approximation ( VikViewport *vvp, gdouble center_lat, gdouble aa[3] )
+{
+  // Derivatives of MERCLAT() at the center (in degrees)
+  const gdouble kk = DEG2RAD(1.0);
+  const gdouble sec = 1.0 / cos ( DEG2RAD(center_lat) );
+  const gdouble tn = tan ( DEG2RAD(center_lat) );
+  aa[0] = sec;
+  aa[1] = 0.5 * sec * tn * kk;
+  aa[2] = sec * (sec*sec + tn*tn) * kk * kk / 6.0;
+
+  const gdouble merc_center = MERCLAT(center_lat);
+  gdouble band = 1.0;
+  for ( guint ii = 0; ii < 30; ii++, band *= 0.5 ) {
+    if ( fabs(center_lat) + band >= 89.0 )
+      continue;
+    gdouble max_err = 0.0;
+    for ( gint side = -1; side <= 1; side += 2 ) {
+      gdouble dd = side * band;
+      gdouble approx = dd * (aa[0] + dd * (aa[1] + dd * aa[2]));
+      gdouble err = fabs ( vvp->ymfactor * (approx - (MERCLAT(center_lat + dd) - merc_center)) );
+      max_err = MAX ( max_err, err );
+    }
+    if ( max_err < 0.05 )
+      return band;
+  }
+  return 0.0;
+}
+
+/**
+ * vik_viewport_coords_to_screen:
+ * @coords: The positions, normally in the viewport's coordinate mode
+ * @count:  The number of positions
+ * @points: Receives the screen positions; must have room for @count entries
+ *
+ * Batch version of vik_viewport_coord_to_screen(), with the setup for the current
+ *  coordinate and drawing modes done once rather than for every position.
+ * In Mercator mode, positions close to the center latitude use a cubic approximation
+ *  of the projection, accurate to within a twentieth of a pixel.
+ *
+ * This only reads the viewport, so may be used from other threads
+ *  as long as the viewport is not changed meanwhile.
+ */
+void vik_viewport_coords_to_screen ( VikViewport *vvp, const VikCoord *coords, guint count, GdkPoint *points )
+{
+  g_return_if_fail ( vvp != NULL );
+
+  if ( vvp->coord_mode == VIK_COORD_UTM ) {
+    const struct UTM *center = (const struct UTM *) &(vvp->center);
+    const gdouble xmpp = vvp->xmpp, ympp = vvp->ympp;
+    for ( guint ii = 0; ii < count; ii++ ) {
+      const struct UTM *utm = (const struct UTM *) &coords[ii];
+      if ( coords[ii].mode != VIK_COORD_UTM || (center->zone != utm->zone && vvp->one_utm_zone) ) {
+        vik_viewport_coord_to_screen ( vvp, &coords[ii], &points[ii].x, &points[ii].y );
+        continue;
+      }
+      points[ii].x = ( (utm->easting - center->easting) / xmpp ) + vvp->width_2 - (center->zone - utm->zone) * vvp->utm_zone_width / xmpp;
+      points[ii].y = vvp->height_2 - ( (utm->northing - center->northing) / ympp );
+    }
+  }
+  else if ( vvp->drawmode == VIK_VIEWPORT_DRAWMODE_LATLON || vvp->drawmode == VIK_VIEWPORT_DRAWMODE_MERCATOR ) {
+    const struct LatLon *center = (const struct LatLon *) &(vvp->center);
+    const gdouble xmf = vvp->xmfactor, ymf = vvp->ymfactor;
+    const gboolean mercator = ( vvp->drawmode == VIK_VIEWPORT_DRAWMODE_MERCATOR );
+    gdouble aa[3] = { 1.0, 0.0, 0.0 };
+    gdouble band = G_MAXDOUBLE;
+    gdouble merc_center = center->lat;
+    if ( mercator ) {
+      band = mercator_approximation ( vvp, center->lat, aa );
+      merc_center = MERCLAT(center->lat);
+    }
+    for ( guint ii = 0; ii < count; ii++ ) {
+      if ( coords[ii].mode != VIK_COORD_LATLON ) {
+        vik_viewport_coord_to_screen ( vvp, &coords[ii], &points[ii].x, &points[ii].y );
+        continue;
+      }
+      const struct LatLon *ll = (const struct LatLon *) &coords[ii];
+      const gdouble dd = ll->lat - center->lat;
+      gdouble dy;
+      if ( fabs(dd) <= band )
+        dy = dd * (aa[0] + dd * (aa[1] + dd * aa[2]));
+      else
+        dy = MERCLAT(ll->lat) - merc_center;
+      points[ii].x = vvp->width_2 + xmf * (ll->lon - center->lon);
+      points[ii].y = vvp->height_2 - ymf * dy;
+    }
+  }
+  else {
+    for ( guint ii = 0; ii < count; ii++ )
+      vik_viewport_coord_to_screen ( vvp, &coords[ii], &points[ii].x, &points[ii].y );
+  }
+}
+
 /**
  * a_viewport_clip_line:
  * @x1: screen coord
@@ -1357,6 +1629,65 @@ void vik_viewport_draw_line ( VikViewport *vvp, GdkGC *gc, gint x1, gint y1, gin
   }
 }
 
+/**
+ * vik_viewport_draw_lines:
+ *
+ * Draw connected lines between the given points in a single request.
+ * Should any point be outside of what the X Window System can cope with,
+ *  the lines are drawn individually so each one gets clipped.
+ */
+void vik_viewport_draw_lines ( VikViewport *vvp, GdkGC *gc, GdkPoint *points, gint npoints )
+{
+  if ( npoints < 2 )
+    return;
+
+  gint xmin = points[0].x, xmax = points[0].x;
+  gint ymin = points[0].y, ymax = points[0].y;
+  for ( gint ii = 1; ii < npoints; ii++ ) {
+    xmin = MIN ( xmin, points[ii].x );
+    xmax = MAX ( xmax, points[ii].x );
+    ymin = MIN ( ymin, points[ii].y );
+    ymax = MAX ( ymax, points[ii].y );
+  }
+
+  if ( xmax < 0 || ymax < 0 || xmin > vvp->width || ymin > vvp->height )
+    return;
+
+  if ( xmin < G_MININT16 || ymin < G_MININT16 || xmax > G_MAXINT16 || ymax > G_MAXINT16 ) {
+    for ( gint ii = 1; ii < npoints; ii++ )
+      vik_viewport_draw_line ( vvp, gc, points[ii-1].x, points[ii-1].y, points[ii].x, points[ii].y );
+    return;
+  }
+
+  gdk_draw_lines ( vvp->scr_buffer, gc, points, npoints );
+}
+
+/**
+ * vik_viewport_draw_segments:
+ *
+ * Draw separate lines in a single request.
+ * Lines wholly off the viewport are left out, and any beyond what the X Window System
+ *  can cope with are drawn individually so each one gets clipped.
+ * NB The segments are overwritten in the process.
+ */
+void vik_viewport_draw_segments ( VikViewport *vvp, GdkGC *gc, GdkSegment *segs, gint nsegs )
+{
+  gint nn = 0;
+  for ( gint ii = 0; ii < nsegs; ii++ ) {
+    GdkSegment seg = segs[ii];
+    if ( ( seg.x1 < 0 && seg.x2 < 0 ) || ( seg.y1 < 0 && seg.y2 < 0 ) ||
+         ( seg.x1 > vvp->width && seg.x2 > vvp->width ) || ( seg.y1 > vvp->height && seg.y2 > vvp->height ) )
+      continue;
+    if ( MIN(seg.x1, seg.x2) < G_MININT16 || MIN(seg.y1, seg.y2) < G_MININT16 ||
+         MAX(seg.x1, seg.x2) > G_MAXINT16 || MAX(seg.y1, seg.y2) > G_MAXINT16 )
+      vik_viewport_draw_line ( vvp, gc, seg.x1, seg.y1, seg.x2, seg.y2 );
+    else
+      segs[nn++] = seg;
+  }
+  if ( nn )
+    gdk_draw_segments ( vvp->scr_buffer, gc, segs, nn );
+}
+
 void vik_viewport_draw_rectangle ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x1, gint y1, gint x2, gint y2 )
 {
   // Using 32 as half the default waypoint image size, so this draws ensures the highlight gets done
@@ -1374,6 +1705,114 @@ void vik_viewport_draw_pixbuf ( VikViewport *vvp, GdkPixbuf *pixbuf, gint src_x,
                     GDK_RGB_DITHER_NONE, 0, 0 );
 }
 
+/**
+ * vik_viewport_draw_pixbuf_scaled:
+ * @alpha: The opacity to draw with, 255 being fully opaque
+ *
+ * Draw the source region of the pixbuf stretched over the destination rectangle.
+ * The scaling and opacity are applied whilst compositing, so callers need not keep
+ *  processed copies of their images.
+ */
+void vik_viewport_draw_pixbuf_scaled ( VikViewport *vvp, GdkPixbuf *pixbuf, gint src_x, gint src_y, gint src_w, gint src_h,
+                                      gint dest_x, gint dest_y, gint dest_w, gint dest_h, guint8 alpha )
+{
+  if ( src_w <= 0 || src_h <= 0 || dest_w <= 0 || dest_h <= 0 || alpha == 0 )
+    return;
+
+  // Nothing to apply, so a plain copy is quicker
+  if ( alpha == 255 && src_w == dest_w && src_h == dest_h ) {
+    vik_viewport_draw_pixbuf ( vvp, pixbuf, src_x, src_y, dest_x, dest_y, dest_w, dest_h );
+    return;
+  }
+
+  cairo_t *cr = gdk_cairo_create ( vvp->scr_buffer );
+  cairo_rectangle ( cr, dest_x, dest_y, dest_w, dest_h );
+  cairo_clip ( cr );
+  cairo_translate ( cr, dest_x, dest_y );
+  cairo_scale ( cr, (gdouble)dest_w / src_w, (gdouble)dest_h / src_h );
+  gdk_cairo_set_source_pixbuf ( cr, pixbuf, -src_x, -src_y );
+  // Otherwise the edges fade into transparency when enlarged
+  cairo_pattern_set_extend ( cairo_get_source(cr), CAIRO_EXTEND_PAD );
+  if ( alpha == 255 )
+    cairo_paint ( cr );
+  else
+    cairo_paint_with_alpha ( cr, alpha / 255.0 );
+  cairo_destroy ( cr );
+}
+
+// A horizontal band of the viewport, rendered by one thread
+typedef struct {
+  VikViewportRenderFunc render;
+  gpointer data;
+  gint y;
+  cairo_antialias_t antialias;
+  cairo_surface_t *surface;
+} RenderBandT;
+
+static void render_band_thread ( RenderBandT *band, gpointer user_data )
+{
+  cairo_t *cr = cairo_create ( band->surface );
+  cairo_set_antialias ( cr, band->antialias );
+  // So the render function can draw in viewport coordinates
+  cairo_translate ( cr, 0, -band->y );
+  band->render ( cr, band->data );
+  cairo_destroy ( cr );
+  cairo_surface_flush ( band->surface );
+}
+
+#define RENDER_BAND_MIN_HEIGHT 64
+
+/**
+ * vik_viewport_draw_rendered:
+ * @render: Draws in viewport coordinates with Cairo
+ *
+ * Render into client side image surfaces and then put the result onto the viewport.
+ * The viewport is split into horizontal bands, rendered in parallel by a thread each,
+ *  so the rasterising can use all the CPUs.
+ * Thus the render function is called once per band, and only what falls within that band gets drawn.
+ */
+void vik_viewport_draw_rendered ( VikViewport *vvp, VikViewportRenderFunc render, gpointer data )
+{
+  if ( vvp->width < 1 || vvp->height < 1 )
+    return;
+
+  guint n_bands = CLAMP ( vvp->height / RENDER_BAND_MIN_HEIGHT, 1, util_get_number_of_cpus() );
+  const gint band_height = (vvp->height + n_bands - 1) / n_bands;
+  // Rounding up the height may leave fewer bands needed
+  n_bands = (vvp->height + band_height - 1) / band_height;
+
+  const cairo_antialias_t antialias = a_vik_get_antialias() ? CAIRO_ANTIALIAS_DEFAULT : CAIRO_ANTIALIAS_NONE;
+
+  RenderBandT *bands = g_new0 ( RenderBandT, n_bands );
+  for ( guint nn = 0; nn < n_bands; nn++ ) {
+    bands[nn].render = render;
+    bands[nn].data = data;
+    bands[nn].y = nn * band_height;
+    bands[nn].antialias = antialias;
+    bands[nn].surface = cairo_image_surface_create ( CAIRO_FORMAT_ARGB32, vvp->width,
+                                                     MIN(band_height, vvp->height - bands[nn].y) );
+  }
+
+  if ( n_bands == 1 )
+    render_band_thread ( &bands[0], NULL );
+  else {
+    VikTaskGroup *group = a_background_tasks_new ();
+    for ( guint nn = 0; nn < n_bands; nn++ )
+      a_background_tasks_add ( group, (GFunc)render_band_thread, &bands[nn], NULL );
+    // Wait for all bands to be done
+    a_background_tasks_free ( group );
+  }
+
+  cairo_t *cr = gdk_cairo_create ( vvp->scr_buffer );
+  for ( guint nn = 0; nn < n_bands; nn++ ) {
+    cairo_set_source_surface ( cr, bands[nn].surface, 0, bands[nn].y );
+    cairo_paint ( cr );
+    cairo_surface_destroy ( bands[nn].surface );
+  }
+  cairo_destroy ( cr );
+  g_free ( bands );
+}
+
 void vik_viewport_draw_arc ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x, gint y, gint width, gint height, gint angle1, gint angle2 )
 {
   gdk_draw_arc ( vvp->scr_buffer, gc, filled, x, y, width, height, angle1, angle2 );
@@ -1523,6 +1962,8 @@ VikViewportDrawMode vik_viewport_get_drawmode ( VikViewport *vvp )
 void vik_viewport_set_trigger ( VikViewport *vp, gpointer trigger )
 {
   vp->trigger = trigger;
+  // Needs to be taken again for the new trigger
+  vp->snapshot_state.valid = FALSE;
 }
 
 gpointer vik_viewport_get_trigger ( VikViewport *vp )
@@ -1530,9 +1971,77 @@ gpointer vik_viewport_get_trigger ( VikViewport *vp )
   return vp->trigger;
 }
 
+static void viewport_state_save ( VikViewport *vp, ViewportStateT *state )
+{
+  state->valid = TRUE;
+  state->center = vp->center;
+  state->xmpp = vp->xmpp;
+  state->ympp = vp->ympp;
+  state->width = vp->width;
+  state->height = vp->height;
+  state->drawmode = vp->drawmode;
+}
+
+static gboolean viewport_state_is_current ( VikViewport *vp, ViewportStateT *state )
+{
+  return state->valid &&
+    vik_coord_equals ( &state->center, &vp->center ) &&
+    state->xmpp == vp->xmpp &&
+    state->ympp == vp->ympp &&
+    state->width == vp->width &&
+    state->height == vp->height &&
+    state->drawmode == vp->drawmode;
+}
+
 void vik_viewport_snapshot_save ( VikViewport *vp )
 {
   gdk_draw_drawable ( vp->snapshot_buffer, vp->background_gc, vp->scr_buffer, 0, 0, 0, 0, -1, -1 );
+  viewport_state_save ( vp, &vp->snapshot_state );
+}
+
+/**
+ * vik_viewport_snapshot_is_current:
+ *
+ * Returns: TRUE if the snapshot was taken for the current trigger
+ *  with the viewport in the same position, zoom level, size and drawmode as now
+ */
+gboolean vik_viewport_snapshot_is_current ( VikViewport *vp )
+{
+  return viewport_state_is_current ( vp, &vp->snapshot_state );
+}
+
+/**
+ * vik_viewport_snapshot_resume:
+ * @resume: The layer from which drawing should start again
+ *
+ * Enter half drawn mode, such that nothing is drawn until the @resume layer is reached,
+ *  whereupon the snapshot is used for everything drawn below it.
+ * NB the trigger may be set to a later layer, when the snapshot is then taken again there.
+ */
+void vik_viewport_snapshot_resume ( VikViewport *vp, gpointer resume )
+{
+  vp->resume = resume;
+  vp->half_drawn = TRUE;
+}
+
+/**
+ * vik_viewport_snapshot_reached:
+ * @layer: The layer about to be drawn
+ *
+ * To be called by layers containing other layers, before drawing each of them.
+ * In half drawn mode the snapshot is loaded when the resume layer is reached,
+ *  otherwise the snapshot is saved when the trigger layer is reached.
+ */
+void vik_viewport_snapshot_reached ( VikViewport *vp, gpointer layer )
+{
+  if ( vp->half_drawn ) {
+    if ( layer == vp->resume ) {
+      vp->half_drawn = FALSE;
+      vik_viewport_snapshot_load ( vp );
+    }
+  }
+  else if ( layer == vp->trigger )
+    vik_viewport_snapshot_save ( vp );
 }
 
 void vik_viewport_snapshot_load ( VikViewport *vp )
@@ -1540,6 +2049,149 @@ void vik_viewport_snapshot_load ( VikViewport *vp )
   gdk_draw_drawable ( vp->scr_buffer, vp->background_gc, vp->snapshot_buffer, 0, 0, 0, 0, -1, -1 );
 }
 
+/******** panning *******/
+/**
+ * vik_viewport_scroll_save:
+ *
+ * Keep a copy of the layers as drawn, before any decorations are drawn on top
+ */
+void vik_viewport_scroll_save ( VikViewport *vp )
+{
+  gdk_draw_drawable ( vp->scroll_buffer, vp->background_gc, vp->scr_buffer, 0, 0, 0, 0, -1, -1 );
+  viewport_state_save ( vp, &vp->scroll_state );
+}
+
+/**
+ * vik_viewport_scroll_is_current:
+ *
+ * Returns: TRUE if the saved copy of the layers is for the viewport as it is now
+ */
+gboolean vik_viewport_scroll_is_current ( VikViewport *vp )
+{
+  return viewport_state_is_current ( vp, &vp->scroll_state );
+}
+
+/**
+ * vik_viewport_scroll:
+ * @dx: Pixels the drawing moves to the right
+ * @dy: Pixels the drawing moves down
+ *
+ * Move the saved copy of the layers, to match the viewport having been moved by this amount.
+ * The newly exposed parts then need to be drawn via vik_viewport_strip_begin() & vik_viewport_strip_end().
+ *
+ * Returns: FALSE if nothing drawn can be reused
+ */
+gboolean vik_viewport_scroll ( VikViewport *vp, gint dx, gint dy )
+{
+  if ( !vp->scroll_state.valid || ABS(dx) >= vp->width || ABS(dy) >= vp->height )
+    return FALSE;
+  // NB Overlapping copies within the same drawable are handled correctly
+  gdk_draw_drawable ( vp->scroll_buffer, vp->background_gc, vp->scroll_buffer, 0, 0, dx, dy, -1, -1 );
+  viewport_state_save ( vp, &vp->scroll_state );
+  return TRUE;
+}
+
+/**
+ * vik_viewport_scroll_load:
+ *
+ * Put the saved copy of the layers into the viewport, ready for any decorations to be drawn on top
+ */
+void vik_viewport_scroll_load ( VikViewport *vp )
+{
+  gdk_draw_drawable ( vp->scr_buffer, vp->background_gc, vp->scroll_buffer, 0, 0, 0, 0, -1, -1 );
+}
+
+/**
+ * vik_viewport_zoom_preview:
+ *
+ * Put the saved copy of the layers into the viewport enlarged or reduced, and moved,
+ *  to match the viewport's current zoom level and position.
+ * This is a quick stand in whilst zooming in steps, until the layers are drawn again.
+ * Cairo does the transform, so with the X server's Render extension it is done there.
+ *
+ * Returns: FALSE if the saved copy can not be used
+ */
+gboolean vik_viewport_zoom_preview ( VikViewport *vp )
+{
+  ViewportStateT *state = &vp->scroll_state;
+  if ( !state->valid || state->width != vp->width || state->height != vp->height ||
+       state->drawmode != vp->drawmode || state->center.mode != vp->coord_mode )
+    return FALSE;
+
+  // Where the middle of the copy is now, and its size relative to now
+  gint x, y;
+  vik_viewport_coord_to_screen ( vp, &state->center, &x, &y );
+  gdouble scale = state->xmpp / vp->xmpp;
+
+  cairo_t *cr = gdk_cairo_create ( vp->scr_buffer );
+  gdk_cairo_set_source_color ( cr, &vp->background_color );
+  cairo_paint ( cr );
+  cairo_translate ( cr, x, y );
+  cairo_scale ( cr, scale, scale );
+  cairo_translate ( cr, -vp->width / 2.0, -vp->height / 2.0 );
+  gdk_cairo_set_source_pixmap ( cr, vp->scroll_buffer, 0, 0 );
+  // Only shown briefly, so speed matters more than the quality
+  cairo_pattern_set_filter ( cairo_get_source ( cr ), CAIRO_FILTER_FAST );
+  cairo_paint ( cr );
+  cairo_destroy ( cr );
+  return TRUE;
+}
+
+/**
+ * vik_viewport_strip_begin:
+ *
+ * Make the viewport temporarily cover only the given area of itself,
+ *  so that drawing the layers only draws what is in that area.
+ * Must be followed by vik_viewport_strip_end()
+ */
+void vik_viewport_strip_begin ( VikViewport *vp, gint x, gint y, gint width, gint height )
+{
+  vp->strip_x = x;
+  vp->strip_y = y;
+  vp->strip_center = vp->center;
+  vp->strip_width = vp->width;
+  vp->strip_height = vp->height;
+  vp->strip_utm_zone_width = vp->utm_zone_width;
+  vp->strip_one_utm_zone = vp->one_utm_zone;
+  // Not drawing the whole viewport, so there is nothing worth taking a snapshot of
+  vp->strip_trigger = vp->trigger;
+  vp->trigger = NULL;
+
+  vik_viewport_set_center_screen ( vp, x + width/2, y + height/2 );
+  vp->width = width;
+  vp->height = height;
+  vp->width_2 = vp->width/2;
+  vp->height_2 = vp->height/2;
+  viewport_utm_zone_check ( vp );
+
+  vp->strip_buffer = vp->scr_buffer;
+  vp->scr_buffer = gdk_pixmap_new ( gtk_widget_get_window(GTK_WIDGET(vp)), width, height, -1 );
+  gdk_draw_rectangle ( GDK_DRAWABLE(vp->scr_buffer), vp->background_gc, TRUE, 0, 0, width, height );
+}
+
+/**
+ * vik_viewport_strip_end:
+ *
+ * Put what has been drawn in the area into the saved copy of the layers,
+ *  and restore the viewport to its normal extent.
+ */
+void vik_viewport_strip_end ( VikViewport *vp )
+{
+  gdk_draw_drawable ( vp->scroll_buffer, vp->background_gc, vp->scr_buffer, 0, 0, vp->strip_x, vp->strip_y, -1, -1 );
+  g_object_unref ( G_OBJECT ( vp->scr_buffer ) );
+  vp->scr_buffer = vp->strip_buffer;
+  vp->strip_buffer = NULL;
+
+  vp->center = vp->strip_center;
+  vp->width = vp->strip_width;
+  vp->height = vp->strip_height;
+  vp->width_2 = vp->width/2;
+  vp->height_2 = vp->height/2;
+  vp->utm_zone_width = vp->strip_utm_zone_width;
+  vp->one_utm_zone = vp->strip_one_utm_zone;
+  vp->trigger = vp->strip_trigger;
+}
+
 void vik_viewport_set_half_drawn(VikViewport *vp, gboolean half_drawn)
 {
   vp->half_drawn = half_drawn;
@@ -1659,7 +2311,8 @@ void vik_viewport_add_logo ( VikViewport *vp, const GdkPixbuf *logo )
   g_return_if_fail ( vp != NULL );
   if ( logo )
   {
-    GdkPixbuf *found = NULL; /* FIXME (GdkPixbuf*)g_slist_find_custom ( vp->logos, logo, (GCompareFunc)== ); */
+    // NB drawing in strips whilst panning may add the same logo more than once
+    GSList *found = g_slist_find ( vp->logos, logo );
     if ( found == NULL )
     {
       vp->logos = g_slist_prepend ( vp->logos, (gpointer)logo );
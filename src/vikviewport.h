@@ -67,6 +67,19 @@ gboolean vik_viewport_configure ( VikViewport *vp );
 /* coordinate transformations */
 void vik_viewport_screen_to_coord ( VikViewport *vvp, int x, int y, VikCoord *coord );
 void vik_viewport_coord_to_screen ( VikViewport *vvp, const VikCoord *coord, int *x, int *y );
+void vik_viewport_coords_to_screen ( VikViewport *vvp, const VikCoord *coords, guint count, GdkPoint *points );
+
+// The transform from longitude and MERCLAT() of latitude to screen positions, as used in the Mercator drawmode
+typedef struct {
+  gdouble center_lon;
+  gdouble center_merc_lat; // MERCLAT() of the center latitude
+  gdouble xfactor;         // Pixels per degree
+  gdouble yfactor;
+  gint width_2;
+  gint height_2;
+} VikViewportMercator;
+
+gboolean vik_viewport_get_mercator ( VikViewport *vvp, VikViewportMercator *vvm );
 
 
 /* viewport scale */
@@ -122,9 +135,28 @@ void vik_viewport_set_trigger ( VikViewport *vp, gpointer trigger );
 gpointer vik_viewport_get_trigger ( VikViewport *vp );
 void vik_viewport_snapshot_save ( VikViewport *vp );
 void vik_viewport_snapshot_load ( VikViewport *vp );
+gboolean vik_viewport_snapshot_is_current ( VikViewport *vp );
+void vik_viewport_snapshot_resume ( VikViewport *vp, gpointer resume );
+void vik_viewport_snapshot_reached ( VikViewport *vp, gpointer layer );
 void vik_viewport_set_half_drawn(VikViewport *vp, gboolean half_drawn);
 gboolean vik_viewport_get_half_drawn( VikViewport *vp );
 
+/* Panning */
+void vik_viewport_scroll_save ( VikViewport *vp );
+gboolean vik_viewport_scroll_is_current ( VikViewport *vp );
+gboolean vik_viewport_scroll ( VikViewport *vp, gint dx, gint dy );
+void vik_viewport_scroll_load ( VikViewport *vp );
+gboolean vik_viewport_zoom_preview ( VikViewport *vp );
+void vik_viewport_strip_begin ( VikViewport *vp, gint x, gint y, gint width, gint height );
+void vik_viewport_strip_end ( VikViewport *vp );
+
+/* Overlays */
+/* Drawn directly onto the drawable in screen coordinates, setting the area covered (left empty if nothing is drawn) */
+typedef void (*VikViewportOverlayFunc) ( VikViewport *vvp, GdkDrawable *drawable, GdkRectangle *area, gpointer data );
+void vik_viewport_add_overlay ( VikViewport *vvp, VikViewportOverlayFunc func, gpointer data );
+void vik_viewport_remove_overlay ( VikViewport *vvp, VikViewportOverlayFunc func, gpointer data );
+void vik_viewport_sync_overlays ( VikViewport *vvp );
+
 
 /***************************************************************************************************
  *  Drawing-related operations 
@@ -136,6 +168,8 @@ void vik_viewport_sync ( VikViewport *vvp );             /* draw buffer to windo
 void vik_viewport_clear ( VikViewport *vvp );
 void vik_viewport_draw_pixbuf ( VikViewport *vvp, GdkPixbuf *pixbuf, gint src_x, gint src_y,
                               gint dest_x, gint dest_y, gint w, gint h );
+void vik_viewport_draw_pixbuf_scaled ( VikViewport *vvp, GdkPixbuf *pixbuf, gint src_x, gint src_y, gint src_w, gint src_h,
+                                      gint dest_x, gint dest_y, gint dest_w, gint dest_h, guint8 alpha );
 gint vik_viewport_get_width ( VikViewport *vvp );
 gint vik_viewport_get_height ( VikViewport *vvp );
 
@@ -154,6 +188,7 @@ void vik_viewport_draw_centermark ( VikViewport *vvp );
 void vik_viewport_set_draw_centermark ( VikViewport *vvp, gboolean draw_centermark );
 gboolean vik_viewport_get_draw_centermark ( VikViewport *vvp );
 void vik_viewport_draw_logo ( VikViewport *vvp );
+void vik_viewport_draw_text_panel ( VikViewport *vvp, const gchar *text );
 void vik_viewport_set_draw_highlight ( VikViewport *vvp, gboolean draw_highlight );
 gboolean vik_viewport_get_draw_highlight ( VikViewport *vvp );
 
@@ -176,11 +211,19 @@ void vik_viewport_set_highlight_thickness ( VikViewport *vvp, gint thickness );
 /* Drawing primitives */
 void a_viewport_clip_line ( gint *x1, gint *y1, gint *x2, gint *y2 ); /* run this before drawing a line. vik_viewport_draw_line runs it for you */
 void vik_viewport_draw_line ( VikViewport *vvp, GdkGC *gc, gint x1, gint y1, gint x2, gint y2 );
+void vik_viewport_draw_lines ( VikViewport *vvp, GdkGC *gc, GdkPoint *points, gint npoints );
+void vik_viewport_draw_segments ( VikViewport *vvp, GdkGC *gc, GdkSegment *segs, gint nsegs );
 void vik_viewport_draw_rectangle ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x1, gint y1, gint x2, gint y2 );
 void vik_viewport_draw_arc ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x, gint y, gint width, gint height, gint angle1, gint angle2 );
 void vik_viewport_draw_polygon ( VikViewport *vvp, GdkGC *gc, gboolean filled, GdkPoint *points, gint npoints );
 void vik_viewport_draw_layout ( VikViewport *vvp, GdkGC *gc, gint x, gint y, PangoLayout *layout );
 
+/* Client side rendering */
+/* The render function is called from worker threads (each with its own band of the viewport)
+   so must not use GDK/GTK, only Cairo and the read only viewport functions such as vik_viewport_coord_to_screen */
+typedef void (*VikViewportRenderFunc) ( cairo_t *cr, gpointer data );
+void vik_viewport_draw_rendered ( VikViewport *vvp, VikViewportRenderFunc render, gpointer data );
+
 /* Utilities */
 void vik_viewport_compute_bearing ( VikViewport *vp, gint x1, gint y1, gint x2, gint y2, gdouble *angle, gdouble *baseangle );
 gdouble mercator_factor ( gdouble x, guint scale );
@@ -28,6 +28,7 @@
 #include "globals.h"
 #include "garminsymbols.h"
 #include "dems.h"
+#include "stringpool.h"
 #include <glib/gi18n.h>
 
 VikWaypoint *vik_waypoint_new()
@@ -46,6 +47,7 @@ VikWaypoint *vik_waypoint_new()
   wp->vdop = NAN;
   wp->pdop = NAN;
   wp->ageofdgpsdata = NAN;
+  wp->ref_count = 1;
   return wp;
 }
 
@@ -89,22 +91,20 @@ void vik_waypoint_set_description(VikWaypoint *wp, const gchar *description)
 
 void vik_waypoint_set_source(VikWaypoint *wp, const gchar *source)
 {
-  if ( wp->source )
-    g_free ( wp->source );
+  a_string_pool_release ( wp->source );
 
   if ( source && source[0] != '\0' )
-    wp->source = g_strdup(source);
+    wp->source = (gchar*)a_string_pool_intern ( source );
   else
     wp->source = NULL;
 }
 
 void vik_waypoint_set_type(VikWaypoint *wp, const gchar *type)
 {
-  if ( wp->type )
-    g_free ( wp->type );
+  a_string_pool_release ( wp->type );
 
   if ( type && type[0] != '\0' )
-    wp->type = g_strdup(type);
+    wp->type = (gchar*)a_string_pool_intern ( type );
   else
     wp->type = NULL;
 }
@@ -156,8 +156,7 @@ void vik_waypoint_set_symbol(VikWaypoint *wp, const gchar *symname)
 {
   const gchar *hashed_symname;
 
-  if ( wp->symbol )
-    g_free ( wp->symbol );
+  a_string_pool_release ( wp->symbol );
 
   // NB symbol_pixbuf is just a reference, so no need to free it
 
@@ -165,7 +164,7 @@ void vik_waypoint_set_symbol(VikWaypoint *wp, const gchar *symname)
     hashed_symname = a_get_hashed_sym ( symname );
     if ( hashed_symname )
       symname = hashed_symname;
-    wp->symbol = g_strdup ( symname );
+    wp->symbol = (gchar*)a_string_pool_intern ( symname );
     wp->symbol_pixbuf = a_get_wp_sym ( wp->symbol );
   }
   else {
@@ -185,31 +184,61 @@ void vik_waypoint_set_extensions(VikWaypoint *wp, const gchar *value)
     wp->extensions = NULL;
 }
 
+/**
+ * vik_waypoint_ref:
+ *
+ * For when the waypoint is held in more than one place, e.g. by layers of different windows.
+ * Each reference is released with vik_waypoint_free().
+ */
+void vik_waypoint_ref(VikWaypoint *wp)
+{
+  g_atomic_int_inc ( &wp->ref_count );
+}
+
 void vik_waypoint_free(VikWaypoint *wp)
 {
+  if ( !g_atomic_int_dec_and_test ( &wp->ref_count ) )
+    return;
+
   if ( wp->name )
     g_free ( wp->name );
   if ( wp->comment )
     g_free ( wp->comment );
   if ( wp->description )
     g_free ( wp->description );
-  if ( wp->source )
-    g_free ( wp->source );
+  a_string_pool_release ( wp->source );
   if ( wp->url )
     g_free ( wp->url );
   if ( wp->url_name )
     g_free ( wp->url_name );
-  if ( wp->type )
-    g_free ( wp->type );
+  a_string_pool_release ( wp->type );
   if ( wp->image )
     g_free ( wp->image );
-  if ( wp->symbol )
-    g_free ( wp->symbol );
+  a_string_pool_release ( wp->symbol );
   if ( wp->extensions )
     g_free ( wp->extensions );
   g_free ( wp );
 }
 
+static gsize string_bytes ( const gchar *str )
+{
+  return str ? strlen ( str ) + 1 : 0;
+}
+
+/**
+ * vik_waypoint_get_memory:
+ *
+ * Add the approximate memory used by the waypoint to each of the totals.
+ * The strings shared via the string pool are not counted.
+ */
+void vik_waypoint_get_memory ( const VikWaypoint *wp, gsize *points, gsize *strings, gsize *extensions )
+{
+  *points += sizeof(VikWaypoint);
+  *strings += string_bytes ( wp->name ) + string_bytes ( wp->comment ) + string_bytes ( wp->description ) +
+    string_bytes ( wp->url ) + string_bytes ( wp->url_name ) + string_bytes ( wp->image );
+  *extensions += string_bytes ( wp->extensions );
+}
+
 VikWaypoint *vik_waypoint_copy(const VikWaypoint *wp)
 {
   VikWaypoint *new_wp = vik_waypoint_new();
@@ -312,6 +341,7 @@ VikWaypoint *vik_waypoint_unmarshall (const guint8 *data_in, guint datalen)
   // This copies the fixed sized elements (i.e. visibility, altitude, image_width, etc...)
   memcpy(new_wp, data, sizeof(*new_wp));
   data += sizeof(*new_wp);
+  new_wp->ref_count = 1;
 
   // Now the variant sized strings...
 #define vwu_get(s) \
@@ -323,16 +353,21 @@ VikWaypoint *vik_waypoint_unmarshall (const guint8 *data_in, guint datalen)
     (s) = NULL; \
   } \
   data += len;
+#define vwu_get_pooled(s) \
+  len = *(guint *)data; \
+  data += sizeof(len); \
+  (s) = len ? (gchar*)a_string_pool_intern((gchar *)data) : NULL; \
+  data += len;
 
   vwu_get(new_wp->name);
   vwu_get(new_wp->comment);
   vwu_get(new_wp->description);
-  vwu_get(new_wp->source);
+  vwu_get_pooled(new_wp->source);
   vwu_get(new_wp->url);
   vwu_get(new_wp->url_name);
-  vwu_get(new_wp->type);
+  vwu_get_pooled(new_wp->type);
   vwu_get(new_wp->image); 
-  vwu_get(new_wp->symbol);
+  vwu_get_pooled(new_wp->symbol);
   vwu_get(new_wp->extensions);
   // Different Viking instances need their seperate versions
   //  copying to itself will get the same reference
@@ -340,4 +375,5 @@ VikWaypoint *vik_waypoint_unmarshall (const guint8 *data_in, guint datalen)
 
   return new_wp;
 #undef vwu_get
+#undef vwu_get_pooled
 }
@@ -50,10 +50,10 @@ struct _VikWaypoint {
   gchar *name;
   gchar *comment;
   gchar *description;
-  gchar *source;
+  gchar *source; // Shared via the string pool, as per the type and symbol
   gchar *url;
   gchar *url_name;
-  gchar *type;
+  gchar *type; // Shared via the string pool, so only use vik_waypoint_set_type()
   guint fix_mode;            /* VIK_GPS_MODE_NOT_SEEN if data unavailable */
   guint nsats;               /* number of satellites used. 0 if data unavailable */
   gdouble hdop;              /* NAN if data unavailable */
@@ -70,10 +70,12 @@ struct _VikWaypoint {
    * dimensions of the original image. */
   guint8 image_width;
   guint8 image_height;
-  gchar *symbol;
+  gchar *symbol; // Shared via the string pool, so only use vik_waypoint_set_symbol()
   gchar *extensions;         // GPX 1.1
   // Only for GUI display
   GdkPixbuf *symbol_pixbuf;
+  VikCoordTZ tz_cache;
+  gint ref_count; // Atomic
 };
 
 VikWaypoint *vik_waypoint_new();
@@ -88,8 +90,10 @@ void vik_waypoint_set_image(VikWaypoint *wp, const gchar *image);
 void vik_waypoint_set_image_direction_info(VikWaypoint *wp, gdouble direction, VikWaypointImageDirectionRef direction_ref);
 void vik_waypoint_set_symbol(VikWaypoint *wp, const gchar *symname);
 void vik_waypoint_set_extensions(VikWaypoint *wp, const gchar *value);
+void vik_waypoint_ref(VikWaypoint *wp);
 void vik_waypoint_free(VikWaypoint * wp);
 VikWaypoint *vik_waypoint_copy(const VikWaypoint *wp);
+void vik_waypoint_get_memory ( const VikWaypoint *wp, gsize *points, gsize *strings, gsize *extensions );
 void vik_waypoint_set_comment_no_copy(VikWaypoint *wp, gchar *comment);
 gboolean vik_waypoint_apply_dem_data ( VikWaypoint *wp, gboolean skip_existing );
 void vik_waypoint_marshall ( VikWaypoint *wp, guint8 **data, guint *len);
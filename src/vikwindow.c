@@ -29,6 +29,7 @@
 #include "vikgoto.h"
 #include "dems.h"
 #include "mapcache.h"
+#include "peercache.h"
 #include "print.h"
 #include "toolbar.h"
 #include "viklayer_defaults.h"
@@ -41,6 +42,9 @@
 #include "geonamessearch.h"
 #include "dir.h"
 #include "kmz.h"
+#include "trace.h"
+#include "memoryusage.h"
+#include "autosave.h"
 #ifdef HAVE_LIBGEOCLUE_2
 #include "libgeoclue.h"
 #endif
@@ -78,6 +82,8 @@ static VikWindow *window_new ();
 static void draw_update ( VikWindow *vw );
 
 static void newwindow_cb ( GtkAction *a, VikWindow *vw );
+static void new_view_cb ( GtkAction *a, VikWindow *vw );
+static void window_share_layers ( VikWindow *vw, VikWindow *src );
 
 // Signals
 static void destroy_window ( GtkWidget *widget,
@@ -207,6 +213,7 @@ struct _VikWindow {
   gboolean show_side_panel_tabs;
   gboolean show_side_panel_calendar;
   gboolean show_side_panel_goto;
+  gboolean show_performance;
 
   gboolean select_move;
   gboolean select_double_click;
@@ -228,6 +235,7 @@ struct _VikWindow {
   gchar *filename;
   gboolean modified;
   VikLoadType_t loaded_type;
+  gpointer share_group; // Windows sharing the same layer data have the same value (never dereferenced)
 
   gboolean only_updating_coord_mode_ui; /* hack for a bug in GTK */
   GtkUIManager *uim;
@@ -235,7 +243,17 @@ struct _VikWindow {
   GThread  *thread;
   /* half-drawn update */
   VikLayer *trigger;
-  VikCoord trigger_center;
+  gboolean trigger_multiple; // More than one layer has changed since the last draw
+  GList *trigger_below; // The layers drawn before the viewport's trigger, when last drawn
+
+  /* for the performance display */
+  gint64 frame_time; // Microseconds for the last full redraw
+
+  /* pointer position statusbar */
+  guint dem_status_id; // Pending elevation lookup, see window_set_position_status()
+  VikCoord dem_status_coord;
+  gint64 dem_status_time; // Of the last elevation lookup
+  mapcache_stats_t frame_mapcache; // Map cache usage during the last full redraw
 
   /* Store at this level for highlighted selection drawing since it applies to the viewport and the layers panel */
   /* Only one of these items can be selected at the same time */
@@ -578,7 +596,7 @@ void update_from_geoclue ( VikWindow *vw, struct LatLon ll, gdouble accuracy )
 void vik_window_new_window_finish ( VikWindow *vw )
 {
   // Don't add a map if we've loaded a Viking file already
-  if ( vw->filename )
+  if ( vw->filename || vw->loaded_type == LOAD_TYPE_VIK_SUCCESS )
     return;
 
   // Maybe add a default map layer
@@ -611,6 +629,8 @@ static void open_window ( VikWindow *vw, GSList *files, gboolean external )
   guint file_num = 0;
   guint num_files = g_slist_length(files);
   gboolean change_fn = (num_files == 1); // only change fn if one file
+  if ( num_files > 1 )
+    a_file_preload ( files, vw->viking_vvp );
   GSList *cur_file = files;
   while ( cur_file ) {
     // Only open a new window if a viking file
@@ -627,6 +647,7 @@ static void open_window ( VikWindow *vw, GSList *files, gboolean external )
     g_free (file_name);
     cur_file = g_slist_next (cur_file);
   }
+  a_file_preload_clear ();
   g_slist_free (files);
 }
 // End signals
@@ -659,9 +680,12 @@ static void window_finalize ( GObject *gob )
 
   if ( vw->sbiu_id )
     (void)g_source_remove ( vw->sbiu_id );
+  if ( vw->dem_status_id )
+    (void)g_source_remove ( vw->dem_status_id );
 
   a_background_remove_window ( vw );
   a_logging_remove_window ( vw );
+  a_autosave_remove_window ( vw );
 
   window_list = g_slist_remove ( window_list, vw );
 
@@ -676,6 +700,7 @@ static void window_finalize ( GObject *gob )
   g_free ( vw->vt->tools );
   g_free ( vw->vt );
   g_free ( vw->filename );
+  g_list_free ( vw->trigger_below );
 
   vik_toolbar_finalize ( vw->viking_vtb );
 
@@ -989,6 +1014,7 @@ static void vik_window_init ( VikWindow *vw )
   // Own signals
   g_signal_connect_swapped (G_OBJECT(vw->viking_vvp), "updated_center", G_CALLBACK(center_changed_cb), vw);
   g_signal_connect_swapped (G_OBJECT(vw->viking_vlp), "update", G_CALLBACK(draw_update), vw);
+  g_signal_connect_swapped (G_OBJECT(vw->viking_vlp), "update", G_CALLBACK(a_autosave_changed), vw);
   g_signal_connect_swapped (G_OBJECT(vw->viking_vlp), "delete_layer", G_CALLBACK(vik_window_clear_selected), vw);
 
   // Signals from GTK
@@ -1026,6 +1052,7 @@ static void vik_window_init ( VikWindow *vw )
 
   a_background_add_window ( vw );
   a_logging_add_window ( vw );
+  a_autosave_add_window ( vw, vik_layers_panel_get_top_layer(vw->viking_vlp), vw->viking_vvp );
 
   window_list = g_slist_prepend ( window_list, vw);
 
@@ -1345,6 +1372,13 @@ static void newwindow_cb ( GtkAction *a, VikWindow *vw )
   g_signal_emit ( G_OBJECT(vw), window_signals[VW_NEWWINDOW_SIGNAL], 0 );
 }
 
+static void new_view_cb ( GtkAction *a, VikWindow *vw )
+{
+  VikWindow *newvw = vik_window_new_window ();
+  if ( newvw )
+    window_share_layers ( newvw, vw );
+}
+
 static void draw_update ( VikWindow *vw )
 {
   draw_redraw (vw);
@@ -1394,8 +1428,11 @@ static void draw_status ( VikWindow *vw )
 void vik_window_set_redraw_trigger(VikLayer *vl)
 {
   VikWindow *vw = VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vl));
-  if (NULL != vw)
+  if (NULL != vw) {
+    if ( vw->trigger && vw->trigger != vl )
+      vw->trigger_multiple = TRUE;
     vw->trigger = vl;
+  }
 }
 
 /**
@@ -1451,28 +1488,8 @@ static gboolean window_configure_event ( VikWindow *vw, GdkEventConfigure *event
   return FALSE;
 }
 
-static void draw_redraw ( VikWindow *vw )
+static void draw_layers ( VikWindow *vw )
 {
-  VikCoord old_center = vw->trigger_center;
-  vw->trigger_center = *(vik_viewport_get_center(vw->viking_vvp));
-  VikLayer *new_trigger = vw->trigger;
-  vw->trigger = NULL;
-  gpointer gp = vik_viewport_get_trigger ( vw->viking_vvp );
-  VikLayer *old_trigger = NULL;
-  if ( !gp )
-    vik_viewport_set_trigger ( vw->viking_vvp, new_trigger );
-  else
-    old_trigger = VIK_LAYER(gp);
-
-  if ( ! new_trigger )
-    ; /* do nothing -- have to redraw everything. */
-  else if ( (old_trigger != new_trigger) || !vik_coord_equals(&old_center, &vw->trigger_center) || (new_trigger->type == VIK_LAYER_AGGREGATE) )
-    vik_viewport_set_trigger ( vw->viking_vvp, new_trigger ); /* todo: set to half_drawn mode if new trigger is above old */
-  else
-    vik_viewport_set_half_drawn ( vw->viking_vvp, TRUE );
-
-  /* actually draw */
-  vik_viewport_clear ( vw->viking_vvp);
   // Main layer drawing
   vik_layers_panel_draw_all ( vw->viking_vlp );
   // Draw highlight (possibly again but ensures it is on top - especially for when tracks overlap)
@@ -1487,13 +1504,198 @@ static void draw_redraw ( VikWindow *vw )
       vik_trw_layer_draw_highlight ( vw->selected_vtl, vw->viking_vvp );
     }
   }
+}
+
+static const gchar *pool_names[] = { "Remote", "Local", "Mapnik" };
+
+/**
+ * Show where the drawing time goes, and the state of the caches and background jobs
+ */
+static void draw_performance ( VikWindow *vw )
+{
+  // NB: No i18n as this is for diagnostics
+  GString *gs = g_string_new ( NULL );
+  g_string_append_printf ( gs, "Frame: %.1f ms", vw->frame_time / 1000.0 );
+
+  guint loading = 0;
+  GList *drawn = vik_aggregate_layer_get_drawn_layers ( vik_layers_panel_get_top_layer(vw->viking_vlp) );
+  for ( GList *iter = drawn; iter; iter = iter->next ) {
+    VikLayer *vl = VIK_LAYER(iter->data);
+    // Aggregate times include their children, so only show the individual layers
+    if ( !vl->visible || vl->type == VIK_LAYER_AGGREGATE )
+      continue;
+    g_string_append_printf ( gs, "\n  %s: %.1f ms", vik_layer_get_name(vl), vl->draw_time / 1000.0 );
+    if ( vl->type == VIK_LAYER_MAPS )
+      loading += vik_maps_layer_get_tiles_loading ( VIK_MAPS_LAYER(vl) );
+  }
+  g_list_free ( drawn );
+
+  guint64 lookups = vw->frame_mapcache.hits + vw->frame_mapcache.misses;
+  if ( lookups )
+    g_string_append_printf ( gs, "\nMap cache: %.0f%% hits of %" G_GUINT64_FORMAT,
+                             100.0 * vw->frame_mapcache.hits / lookups, lookups );
+  else
+    g_string_append ( gs, "\nMap cache: not used" );
+  g_string_append_printf ( gs, ", %d tiles, %.1f MB", a_mapcache_get_count(), a_mapcache_get_size() / 1048576.0 );
+
+  guint dem_hits, dem_loads, dem_evictions;
+  a_dems_get_cache_stats ( &dem_hits, &dem_loads, &dem_evictions );
+  if ( dem_hits + dem_loads )
+    g_string_append_printf ( gs, "\nDEM cache: %.0f%% hits, %d loads, %d evictions",
+                             100.0 * dem_hits / (dem_hits + dem_loads), dem_loads, dem_evictions );
+
+  for ( guint pp = 0; pp < G_N_ELEMENTS(pool_names); pp++ ) {
+#ifndef HAVE_LIBMAPNIK
+    if ( pp == 2 )
+      break;
+#endif
+    guint queued, running;
+    a_background_get_pool_stats ( pp, &queued, &running );
+    g_string_append_printf ( gs, "\nJobs %s: %d running, %d queued", pool_names[pp], running, queued );
+  }
+
+  g_string_append_printf ( gs, "\nTiles: %d downloading, %d loading", maps_layer_get_tiles_downloading(), loading );
+
+  vik_viewport_draw_text_panel ( vw->viking_vvp, gs->str );
+  g_string_free ( gs, TRUE );
+}
+
+static void draw_decorations ( VikWindow *vw )
+{
   // Other viewport decoration items on top if they are enabled/in use
   vik_viewport_draw_scale ( vw->viking_vvp );
   vik_viewport_draw_copyright ( vw->viking_vvp );
   vik_viewport_draw_centermark ( vw->viking_vvp );
   vik_viewport_draw_logo ( vw->viking_vvp );
+  if ( vw->show_performance )
+    draw_performance ( vw );
+}
+
+/**
+ * Draw the layers for just this area of the viewport
+ */
+static void draw_strip ( VikWindow *vw, gint x, gint y, gint width, gint height )
+{
+  vik_viewport_strip_begin ( vw->viking_vvp, x, y, width, height );
+  draw_layers ( vw );
+  vik_viewport_strip_end ( vw->viking_vvp );
+}
+
+/**
+ * Can drawing resume from the snapshot of the layers below the viewport's trigger?
+ * This requires that those layers are still the same and in the same order,
+ *  and that the changed layer is not one of them.
+ * NB the viewport's trigger may be a layer since deleted, so it is only compared and never dereferenced
+ */
+static gboolean trigger_below_unchanged ( VikWindow *vw, GList *drawn, gpointer trigger, VikLayer *changed )
+{
+  GList *below = vw->trigger_below;
+  for ( GList *iter = drawn; iter; iter = iter->next ) {
+    if ( iter->data == trigger )
+      return below == NULL;
+    if ( !below || below->data != iter->data || iter->data == changed )
+      return FALSE;
+    below = below->next;
+  }
+  // Trigger no longer exists
+  return FALSE;
+}
+
+static void draw_redraw ( VikWindow *vw )
+{
+  VikLayer *new_trigger = vw->trigger;
+  gboolean multiple = vw->trigger_multiple;
+  vw->trigger = NULL;
+  vw->trigger_multiple = FALSE;
+  gpointer old_trigger = vik_viewport_get_trigger ( vw->viking_vvp );
+  GList *drawn = vik_aggregate_layer_get_drawn_layers ( vik_layers_panel_get_top_layer(vw->viking_vlp) );
+
+  if ( !new_trigger || multiple || new_trigger->type == VIK_LAYER_AGGREGATE )
+    // Have to redraw everything, which also takes the snapshot again
+    vik_viewport_set_trigger ( vw->viking_vvp, old_trigger );
+  else if ( old_trigger &&
+            vik_viewport_snapshot_is_current ( vw->viking_vvp ) &&
+            trigger_below_unchanged ( vw, drawn, old_trigger, new_trigger ) ) {
+    // Only the layers from the old trigger upwards need drawing
+    // When the changed layer is above the old trigger, the snapshot moves up to it
+    //  so that subsequent changes to it only need to draw from there
+    vik_viewport_snapshot_resume ( vw->viking_vvp, old_trigger );
+    if ( new_trigger != old_trigger )
+      vik_viewport_set_trigger ( vw->viking_vvp, new_trigger );
+  }
+  else
+    vik_viewport_set_trigger ( vw->viking_vvp, new_trigger );
+
+  // Remember what is below the trigger for next time
+  g_list_free ( vw->trigger_below );
+  vw->trigger_below = NULL;
+  gpointer trigger = vik_viewport_get_trigger ( vw->viking_vvp );
+  for ( GList *iter = drawn; iter && iter->data != trigger; iter = iter->next )
+    vw->trigger_below = g_list_prepend ( vw->trigger_below, iter->data );
+  vw->trigger_below = g_list_reverse ( vw->trigger_below );
+  g_list_free ( drawn );
 
+  /* actually draw */
+  mapcache_stats_t mc_start, mc_end;
+  a_mapcache_get_stats ( &mc_start );
+  gint64 start = g_get_monotonic_time ();
+  vik_viewport_clear ( vw->viking_vvp);
+  draw_layers ( vw );
+  vw->frame_time = g_get_monotonic_time () - start;
+  a_mapcache_get_stats ( &mc_end );
+  vw->frame_mapcache.hits = mc_end.hits - mc_start.hits;
+  vw->frame_mapcache.misses = mc_end.misses - mc_start.misses;
   vik_viewport_set_half_drawn ( vw->viking_vvp, FALSE ); /* just in case. */
+  if ( a_vik_get_pan_by_scrolling() || a_vik_get_zoom_preview() )
+    vik_viewport_scroll_save ( vw->viking_vvp );
+  draw_decorations ( vw );
+}
+
+/**
+ * Draw just the newly exposed parts after the viewport has been panned by the given pixel offsets
+ *
+ * Returns: FALSE if a normal full redraw is needed instead
+ */
+static gboolean draw_scroll ( VikWindow *vw, gint dx, gint dy )
+{
+  if ( !vik_viewport_scroll ( vw->viking_vvp, dx, dy ) )
+    return FALSE;
+
+  gint width = vik_viewport_get_width ( vw->viking_vvp );
+  gint height = vik_viewport_get_height ( vw->viking_vvp );
+  // Columns on the left or right
+  if ( dx > 0 )
+    draw_strip ( vw, 0, 0, dx, height );
+  else if ( dx < 0 )
+    draw_strip ( vw, width + dx, 0, -dx, height );
+  // Rows at the top or bottom, less any part already drawn in the columns
+  gint x = MAX ( dx, 0 );
+  if ( dy > 0 )
+    draw_strip ( vw, x, 0, width - ABS(dx), dy );
+  else if ( dy < 0 )
+    draw_strip ( vw, x, height + dy, width - ABS(dx), -dy );
+
+  vik_viewport_scroll_load ( vw->viking_vvp );
+  draw_decorations ( vw );
+  return TRUE;
+}
+
+/**
+ * vik_window_center_screen:
+ *
+ * Move the viewport to be centered on this screen position and draw it straight away,
+ *  only drawing the newly exposed parts when panning by scrolling is enabled
+ */
+void vik_window_center_screen ( VikWindow *vw, gint x, gint y )
+{
+  gboolean scroll = a_vik_get_pan_by_scrolling() && vik_viewport_scroll_is_current ( vw->viking_vvp );
+  gint dx = vik_viewport_get_width(vw->viking_vvp)/2 - x;
+  gint dy = vik_viewport_get_height(vw->viking_vvp)/2 - y;
+  vik_viewport_set_center_screen ( vw->viking_vvp, x, y );
+  if ( scroll && draw_scroll ( vw, dx, dy ) )
+    (void)draw_sync ( vw );
+  else
+    draw_update ( vw );
 }
 
 gboolean draw_buf_done = TRUE;
@@ -1540,12 +1742,19 @@ static gboolean draw_click (VikWindow *vw, GdkEventButton *event)
 static void vik_window_pan_move (VikWindow *vw, GdkEventMotion *event)
 {
   if ( vw->pan_x != -1 ) {
-    vik_viewport_set_center_screen ( vw->viking_vvp, vik_viewport_get_width(vw->viking_vvp)/2 - event->x + vw->pan_x,
-                                     vik_viewport_get_height(vw->viking_vvp)/2 - event->y + vw->pan_y );
+    gboolean scroll = a_vik_get_pan_by_scrolling() && vik_viewport_scroll_is_current ( vw->viking_vvp );
+    gint dx = (gint)event->x - vw->pan_x;
+    gint dy = (gint)event->y - vw->pan_y;
+    vik_viewport_set_center_screen ( vw->viking_vvp, vik_viewport_get_width(vw->viking_vvp)/2 - dx,
+                                     vik_viewport_get_height(vw->viking_vvp)/2 - dy );
     vw->pan_move = TRUE;
     vw->pan_x = event->x;
     vw->pan_y = event->y;
-    draw_update ( vw );
+    // Reuse what is already drawn whilst moving; the full redraw occurs on release
+    if ( scroll && draw_scroll ( vw, dx, dy ) )
+      (void)draw_sync ( vw );
+    else
+      draw_update ( vw );
   }
 }
 
@@ -1573,28 +1782,72 @@ static void get_location_strings ( VikWindow *vw, struct UTM utm, gchar **lat, g
   }
 }
 
-static gboolean draw_mouse_motion (VikWindow *vw, GdkEventMotion *event)
+// Elevations shown for the pointer position, as the same places tend to be revisited
+#define DEM_STATUS_CACHE_SIZE 64
+// Milliseconds between DEM lookups while the pointer keeps moving
+#define DEM_STATUS_INTERVAL 40
+
+typedef struct {
+  struct UTM utm; // Rounded to the metre
+  VikDemInterpol method;
+  gint16 elev;
+} DemStatusEntry;
+
+static DemStatusEntry dem_status_cache[DEM_STATUS_CACHE_SIZE];
+static guint dem_status_count = 0;
+static guint dem_status_next = 0;
+static guint dem_status_changes = 0;
+
+static gboolean dem_status_cache_lookup ( const struct UTM *utm, VikDemInterpol method, gint16 *elev )
+{
+  // Forget everything when DEMs have been loaded or dropped
+  guint changes = a_dems_get_changes_count ();
+  if ( changes != dem_status_changes ) {
+    dem_status_changes = changes;
+    dem_status_count = 0;
+    dem_status_next = 0;
+  }
+  for ( guint ii = 0; ii < dem_status_count; ii++ ) {
+    DemStatusEntry *entry = &dem_status_cache[ii];
+    if ( entry->method == method && entry->utm.zone == utm->zone && entry->utm.letter == utm->letter &&
+         entry->utm.easting == utm->easting && entry->utm.northing == utm->northing ) {
+      *elev = entry->elev;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+static void dem_status_cache_add ( const struct UTM *utm, VikDemInterpol method, gint16 elev )
+{
+  DemStatusEntry *entry = &dem_status_cache[dem_status_next];
+  entry->utm = *utm;
+  entry->method = method;
+  entry->elev = elev;
+  dem_status_next = (dem_status_next + 1) % DEM_STATUS_CACHE_SIZE;
+  if ( dem_status_count < DEM_STATUS_CACHE_SIZE )
+    dem_status_count++;
+}
+
+static gboolean dem_status_timeout ( VikWindow *vw );
+
+/**
+ * Show the position and its elevation (when available) in the statusbar
+ *
+ * When throttled, DEM lookups are made at most every DEM_STATUS_INTERVAL
+ *  and otherwise left until the pointer stops
+ */
+static void window_set_position_status ( VikWindow *vw, const VikCoord *coord, gboolean throttle )
 {
-  static VikCoord coord;
-  static struct UTM utm;
   #define BUFFER_SIZE 50
-  static char pointer_buf[BUFFER_SIZE];
+  char pointer_buf[BUFFER_SIZE];
   gchar *lat = NULL, *lon = NULL;
-  gint16 alt;
+  gint16 alt = VIK_DEM_INVALID_ELEVATION;
   gdouble zoom;
   VikDemInterpol interpol_method;
+  struct UTM utm;
 
-  /* This is a hack, but work far the best, at least for single pointer systems.
-   * See http://bugzilla.gnome.org/show_bug.cgi?id=587714 for more. */
-  gint x, y;
-  gdk_window_get_pointer (event->window, &x, &y, NULL);
-  event->x = x;
-  event->y = y;
-
-  toolbox_move(vw->vt, event);
-
-  vik_viewport_screen_to_coord ( vw->viking_vvp, event->x, event->y, &coord );
-  vik_coord_to_utm ( &coord, &utm );
+  vik_coord_to_utm ( coord, &utm );
 
   get_location_strings ( vw, utm, &lat, &lon );
 
@@ -1606,7 +1859,25 @@ static gboolean draw_mouse_motion (VikWindow *vw, GdkEventMotion *event)
     interpol_method = VIK_DEM_INTERPOL_SIMPLE;
   else
     interpol_method = VIK_DEM_INTERPOL_BEST;
-  if ((alt = a_dems_get_elev_by_coord(&coord, interpol_method)) != VIK_DEM_INVALID_ELEVATION) {
+
+  struct UTM key = utm;
+  key.easting = round ( utm.easting );
+  key.northing = round ( utm.northing );
+  vw->dem_status_coord = *coord;
+  if ( !dem_status_cache_lookup ( &key, interpol_method, &alt ) ) {
+    gint64 now = g_get_monotonic_time ();
+    if ( throttle && now - vw->dem_status_time < DEM_STATUS_INTERVAL * 1000 ) {
+      if ( !vw->dem_status_id )
+        vw->dem_status_id = g_timeout_add ( DEM_STATUS_INTERVAL, (GSourceFunc)dem_status_timeout, vw );
+    }
+    else {
+      alt = a_dems_get_elev_by_coord ( coord, interpol_method );
+      dem_status_cache_add ( &key, interpol_method, alt );
+      vw->dem_status_time = now;
+    }
+  }
+
+  if ( alt != VIK_DEM_INVALID_ELEVATION ) {
     if ( a_vik_get_units_height () == VIK_UNITS_HEIGHT_METRES )
       g_snprintf ( pointer_buf, BUFFER_SIZE, _("%s %s %dm"), lat, lon, alt );
     else
@@ -1615,10 +1886,35 @@ static gboolean draw_mouse_motion (VikWindow *vw, GdkEventMotion *event)
   else
     g_snprintf ( pointer_buf, BUFFER_SIZE, _("%s %s"), lat, lon );
   g_free (lat);
-  lat = NULL;
   g_free (lon);
-  lon = NULL;
   vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_POSITION, pointer_buf );
+}
+
+/**
+ * Fill in the elevation of where the pointer stopped
+ */
+static gboolean dem_status_timeout ( VikWindow *vw )
+{
+  vw->dem_status_id = 0;
+  window_set_position_status ( vw, &vw->dem_status_coord, FALSE );
+  return FALSE;
+}
+
+static gboolean draw_mouse_motion (VikWindow *vw, GdkEventMotion *event)
+{
+  VikCoord coord;
+
+  /* This is a hack, but work far the best, at least for single pointer systems.
+   * See http://bugzilla.gnome.org/show_bug.cgi?id=587714 for more. */
+  gint x, y;
+  gdk_window_get_pointer (event->window, &x, &y, NULL);
+  event->x = x;
+  event->y = y;
+
+  toolbox_move(vw->vt, event);
+
+  vik_viewport_screen_to_coord ( vw->viking_vvp, event->x, event->y, &coord );
+  window_set_position_status ( vw, &coord, TRUE );
 
   // Middle button moving only
   if ( vw->pan_move_middle )
@@ -1816,6 +2112,10 @@ static gboolean draw_scroll (VikWindow *vw, GdkEventScroll *event)
     zoom_at_xy ( vw, event->x, event->y, TRUE, event->direction, 0 );
   }
 
+  // Meanwhile show what was last drawn, moved and resized to match
+  if ( a_vik_get_zoom_preview() && vik_viewport_zoom_preview ( vw->viking_vvp ) )
+    (void)draw_sync ( vw );
+
   // If a pending draw, remove it and create a new one
   //  thus avoiding intermediary screen redraws when transiting through several
   //  zoom levels in quick succession, as typical when scroll zooming.
@@ -3340,12 +3640,48 @@ static void help_cache_info_cb ( GtkAction *a, VikWindow *vw )
   // NB: No i18n as this is just for debug
   gint byte_size = a_mapcache_get_size();
   gchar *msg_sz = g_format_size_full ( byte_size, G_FORMAT_SIZE_LONG_FORMAT );
-  gchar *msg = g_strdup_printf ( "Map Cache size is %s with %d items", msg_sz, a_mapcache_get_count());
+  mapcache_stats_t stats;
+  a_mapcache_get_stats ( &stats );
+  gchar *msg = g_strdup_printf ( "Map Cache size is %s with %d items\nHits %" G_GUINT64_FORMAT ", Misses %" G_GUINT64_FORMAT ", Evictions %" G_GUINT64_FORMAT,
+                                 msg_sz, a_mapcache_get_count(), stats.hits, stats.misses, stats.evictions );
   a_dialog_info_msg_extra ( GTK_WINDOW(vw), "%s", msg );
   g_free ( msg_sz );
   g_free ( msg );
 }
 
+static void memory_usage_cb ( GtkAction *a, VikWindow *vw )
+{
+  a_memory_usage_show ( GTK_WINDOW(vw), VIK_LAYER(vik_layers_panel_get_top_layer(vw->viking_vlp)), TRUE );
+}
+
+static void trace_cb ( GtkAction *a, VikWindow *vw )
+{
+  // NB: No i18n as this is just for debug
+  if ( !vik_trace ) {
+    a_trace_start ();
+    a_dialog_info_msg ( GTK_WINDOW(vw), "Tracing started.\nUse this again to save the trace." );
+    return;
+  }
+
+  GtkWidget *dialog = gtk_file_chooser_dialog_new ( "Save Trace", GTK_WINDOW(vw),
+                                                    GTK_FILE_CHOOSER_ACTION_SAVE,
+                                                    GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+                                                    GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
+                                                    NULL );
+  gtk_file_chooser_set_do_overwrite_confirmation ( GTK_FILE_CHOOSER(dialog), TRUE );
+  gtk_file_chooser_set_current_name ( GTK_FILE_CHOOSER(dialog), "viking-trace.json" );
+  if ( gtk_dialog_run ( GTK_DIALOG(dialog) ) == GTK_RESPONSE_ACCEPT ) {
+    gchar *fn = gtk_file_chooser_get_filename ( GTK_FILE_CHOOSER(dialog) );
+    GError *error = NULL;
+    if ( !a_trace_save ( fn, &error ) ) {
+      a_dialog_error_msg_extra ( GTK_WINDOW(vw), "Failed to save the trace: %s", error->message );
+      g_error_free ( error );
+    }
+    g_free ( fn );
+  }
+  gtk_widget_destroy ( dialog );
+}
+
 static void back_forward_info_cb ( GtkAction *a, VikWindow *vw )
 {
   vik_viewport_show_centers ( vw->viking_vvp, GTK_WINDOW(vw) );
@@ -3964,11 +4300,117 @@ void calendar_update ( VikWindow *vw )
  * @last:  Indicates the last file in a possible list of files to be loaded
  *        Hence a draw operation can be performed
  */
+/**
+ * A view of the layer for another window.
+ * TrackWaypoint layers share their tracks, routes and waypoints.
+ * Other layers are copied, as the bulk of their data (map tiles, DEMs and images) is in the process wide caches.
+ */
+static VikLayer *window_layer_new_view ( VikLayer *vl, VikViewport *vvp )
+{
+  if ( vl->type == VIK_LAYER_TRW )
+    return VIK_LAYER(vik_trw_layer_new_view ( VIK_TRW_LAYER(vl), vvp ));
+
+  guint8 *data = NULL;
+  guint len = 0;
+  VikLayer *rv;
+  if ( vl->type == VIK_LAYER_AGGREGATE ) {
+    rv = vik_layer_create ( VIK_LAYER_AGGREGATE, vvp, FALSE );
+    vik_layer_marshall_params ( vl, &data, &len );
+    vik_layer_unmarshall_params ( rv, data, len, vvp );
+    for ( const GList *iter = vik_aggregate_layer_get_children ( VIK_AGGREGATE_LAYER(vl) ); iter; iter = iter->next )
+      vik_aggregate_layer_add_layer ( VIK_AGGREGATE_LAYER(rv), window_layer_new_view ( VIK_LAYER(iter->data), vvp ), FALSE );
+  }
+  else {
+    vik_layer_marshall ( vl, &data, &len );
+    rv = vik_layer_unmarshall ( data, len, vvp );
+  }
+  g_free ( data );
+  return rv;
+}
+
+/**
+ * Redraw for changes made in another window to the data shared with this one
+ */
+static void window_shared_update ( VikWindow *vw )
+{
+  // The items may have been moved
+  GList *layers = vik_aggregate_layer_get_all_layers_of_type ( vik_layers_panel_get_top_layer(vw->viking_vlp), NULL, VIK_LAYER_TRW, TRUE );
+  for ( GList *iter = layers; iter; iter = iter->next )
+    trw_layer_calculate_bounds_waypoints ( VIK_TRW_LAYER(iter->data) );
+  g_list_free ( layers );
+  draw_update ( vw );
+}
+
+/**
+ * Show the layers of the other window, sharing their data rather than loading another copy,
+ *  e.g. to keep more than one view of a large project open
+ */
+static void window_share_layers ( VikWindow *vw, VikWindow *src )
+{
+  VikAggregateLayer *top = vik_layers_panel_get_top_layer ( vw->viking_vlp );
+  for ( const GList *iter = vik_aggregate_layer_get_children ( vik_layers_panel_get_top_layer(src->viking_vlp) ); iter; iter = iter->next ) {
+    VikLayer *vl = window_layer_new_view ( VIK_LAYER(iter->data), vw->viking_vvp );
+    if ( vl )
+      vik_aggregate_layer_add_layer ( top, vl, FALSE );
+  }
+
+  // The data is journalled by the window it was loaded in
+  a_autosave_remove_window ( vw );
+
+  // Each window redraws for changes made in any of the others sharing the data
+  if ( !src->share_group )
+    src->share_group = src;
+  vw->share_group = src->share_group;
+  for ( GSList *iter = window_list; iter; iter = iter->next ) {
+    VikWindow *other = VIK_WINDOW(iter->data);
+    if ( other != vw && other->share_group == vw->share_group ) {
+      g_signal_connect_object ( G_OBJECT(other->viking_vlp), "update", G_CALLBACK(window_shared_update), vw, G_CONNECT_SWAPPED );
+      g_signal_connect_object ( G_OBJECT(vw->viking_vlp), "update", G_CALLBACK(window_shared_update), other, G_CONNECT_SWAPPED );
+    }
+  }
+
+  // Start from the same view
+  GtkWidget *mode_button = vik_window_get_drawmode_button ( vw, vik_viewport_get_drawmode ( src->viking_vvp ) );
+  gtk_check_menu_item_set_active ( GTK_CHECK_MENU_ITEM(mode_button), TRUE );
+  vik_viewport_set_zoom ( vw->viking_vvp, vik_viewport_get_zoom ( src->viking_vvp ) );
+  vik_viewport_set_center_coord ( vw->viking_vvp, vik_viewport_get_center ( src->viking_vvp ), FALSE );
+
+  window_set_filename ( vw, src->filename );
+  vw->loaded_type = src->loaded_type;
+  vik_layers_panel_calendar_update ( vw->viking_vlp );
+  draw_update ( vw );
+}
+
+/**
+ * Another window with the Viking file open
+ */
+static VikWindow *window_find_file ( VikWindow *vw, const gchar *filename )
+{
+  for ( GSList *iter = window_list; iter; iter = iter->next ) {
+    VikWindow *other = VIK_WINDOW(iter->data);
+    if ( other != vw && other->filename && !strcmp ( other->filename, filename ) )
+      return other;
+  }
+  return NULL;
+}
+
 void vik_window_open_file ( VikWindow *vw, const gchar *filename, gboolean change_filename, gboolean first, gboolean last, gboolean new_layer, gboolean external )
 {
   if ( first )
     vik_window_set_busy_cursor ( vw );
 
+  // Already open in another window, so show the same data rather than loading another copy
+  if ( change_filename && new_layer && !external &&
+       vik_aggregate_layer_is_empty ( vik_layers_panel_get_top_layer(vw->viking_vlp) ) ) {
+    VikWindow *other = window_find_file ( vw, filename );
+    if ( other ) {
+      window_share_layers ( vw, other );
+      update_recently_used_document ( vw, filename );
+      vik_window_clear_busy_cursor ( vw );
+      return;
+    }
+  }
+
   // Enable the *new* filename to be accessible by the Layers codez
   gchar *original_filename = g_strdup ( vw->filename );
   g_free ( vw->filename );
@@ -4013,6 +4455,12 @@ void vik_window_open_file ( VikWindow *vw, const gchar *filename, gboolean chang
     case LOAD_TYPE_KML_FAILURE:
       a_dialog_error_msg_extra ( GTK_WINDOW(vw), _("Unable to load malformed KML file %s"), filename );
       break;
+    case LOAD_TYPE_FIT_FAILURE:
+      a_dialog_error_msg_extra ( GTK_WINDOW(vw), _("Unable to load malformed FIT file %s"), filename );
+      break;
+    case LOAD_TYPE_GEOJSON_FAILURE:
+      a_dialog_error_msg_extra ( GTK_WINDOW(vw), _("Unable to load malformed GeoJSON file %s"), filename );
+      break;
     case LOAD_TYPE_UNSUPPORTED_FAILURE:
       a_dialog_error_msg_extra ( GTK_WINDOW(vw), _("Unsupported file type for %s"), filename );
       break;
@@ -4039,8 +4487,10 @@ void vik_window_open_file ( VikWindow *vw, const gchar *filename, gboolean chang
       restore_original_filename = TRUE; // NB Will actually get inverted by the 'success' component below
       GtkWidget *mode_button;
       /* Update UI */
-      if ( change_filename )
+      if ( change_filename ) {
         window_set_filename ( vw, filename );
+        a_autosave_set_project ( vw, filename );
+      }
       mode_button = vik_window_get_drawmode_button ( vw, vik_viewport_get_drawmode ( vw->viking_vvp ) );
       vw->only_updating_coord_mode_ui = TRUE; /* if we don't set this, it will change the coord to UTM if we click Lat/Lon. I don't know why. */
       gtk_check_menu_item_set_active ( GTK_CHECK_MENU_ITEM(mode_button), TRUE );
@@ -4097,6 +4547,52 @@ void vik_window_open_file ( VikWindow *vw, const gchar *filename, gboolean chang
   vik_window_clear_busy_cursor ( vw );
 }
 
+/**
+ * vik_window_recover:
+ *
+ * Offer to recover the work of any previous run that did not finish,
+ *  by loading the last full save and replaying the journal of the changes since
+ *  (into this window if it is still empty, otherwise into new ones)
+ */
+void vik_window_recover ( VikWindow *vw )
+{
+  GList *orphans = a_autosave_get_orphans ();
+  for ( GList *iter = orphans; iter; iter = iter->next ) {
+    const gchar *journal = iter->data;
+    gchar *project = NULL;
+    gchar *base = NULL;
+    if ( a_autosave_read_header ( journal, &project, &base ) && base &&
+         a_dialog_yes_or_no ( GTK_WINDOW(vw), _("Viking did not finish properly. Recover the unsaved changes to %s?"),
+                              project ? a_file_basename(project) : _("Untitled") ) ) {
+      VikWindow *target = vw;
+      if ( !vik_aggregate_layer_is_empty ( vik_layers_panel_get_top_layer(target->viking_vlp) ) )
+        target = vik_window_new_window ();
+      if ( target ) {
+        VikAggregateLayer *top = vik_layers_panel_get_top_layer ( target->viking_vlp );
+        // Loaded directly, as the base may be a checkpoint that should not appear as a recent file
+        target->loaded_type = a_file_load ( top, target->viking_vvp, NULL, base, TRUE, FALSE, NULL );
+        vik_aggregate_layer_file_load_complete ( top );
+        vik_layers_panel_change_coord_mode ( target->viking_vlp, vik_viewport_get_coord_mode ( target->viking_vvp ) );
+        guint total;
+        guint replayed = a_autosave_replay ( journal, top, &total );
+        window_set_filename ( target, project );
+        target->modified = TRUE;
+        // The recovered work is only held in memory again
+        a_autosave_set_project ( target, project );
+        a_autosave_checkpoint ( target );
+        draw_update ( target );
+        vik_layers_panel_calendar_update ( target->viking_vlp );
+        if ( replayed < total )
+          a_dialog_warning_msg ( GTK_WINDOW(target), _("Some of the latest changes could not be recovered.") );
+      }
+    }
+    a_autosave_discard ( journal );
+    g_free ( project );
+    g_free ( base );
+  }
+  g_list_free_full ( orphans, g_free );
+}
+
 static void load_file ( GtkAction *a, VikWindow *vw )
 {
   GSList *files = NULL;
@@ -4135,6 +4631,8 @@ static void load_file ( GtkAction *a, VikWindow *vw )
       guint num_files = g_slist_length(files);
       gboolean change_fn = !append && (num_files==1); // only change fn if one file
       gboolean first_vik_file = TRUE;
+      if ( !append && num_files > 1 )
+        a_file_preload ( files, vw->viking_vvp );
       cur_file = files;
       while ( cur_file ) {
         gchar *file_name = cur_file->data;
@@ -4160,6 +4658,7 @@ static void load_file ( GtkAction *a, VikWindow *vw )
         g_free (file_name);
         cur_file = g_slist_next (cur_file);
       }
+      a_file_preload_clear ();
       g_slist_free (files);
     }
   }
@@ -4240,18 +4739,35 @@ static gboolean save_file_as ( GtkAction *a, VikWindow *vw )
   return window_save_file_as ( vw, vik_layers_panel_get_top_layer(vw->viking_vlp), TRUE );
 }
 
+/**
+ * Only once the file has reached the disk is it known whether the save actually worked
+ */
+static void window_save_complete ( const gchar *filename, gboolean success, VikWindow *vw )
+{
+  if ( !success && gtk_widget_get_visible ( GTK_WIDGET(vw) ) ) {
+    // What is in the window is not on disk after all
+    vw->modified = TRUE;
+    a_dialog_error_msg_extra ( GTK_WINDOW(vw), _("Unable to save to %s. The file has been left as it was before saving."), filename );
+  }
+  g_object_unref ( vw );
+}
+
  static gboolean window_save ( VikWindow *vw, VikAggregateLayer *agg, gchar *filename )
 {
   vik_window_set_busy_cursor ( vw );
   gboolean success = TRUE;
 
-  if ( a_file_save(agg, vw->viking_vvp, filename) )
+  if ( a_file_save(agg, vw->viking_vvp, filename, (VikFileSavedFunc)window_save_complete, g_object_ref(vw)) )
   {
     update_recently_used_document ( vw, filename );
+    // Saved the whole project, so the autosave journal can start from here
+    if ( agg == vik_layers_panel_get_top_layer(vw->viking_vlp) && g_strcmp0 ( filename, vw->filename ) == 0 )
+      a_autosave_set_project ( vw, filename );
   }
   else
   {
     a_dialog_error_msg ( GTK_WINDOW(vw), _("The filename you requested could not be opened for writing.") );
+    g_object_unref ( vw );
     success = FALSE;
   }
   vik_window_clear_busy_cursor ( vw );
@@ -4437,6 +4953,11 @@ static void acquire_from_file ( GtkAction *a, VikWindow *vw )
   my_acquire ( vw, &vik_datasource_file_interface );
 }
 
+static void acquire_from_fit ( GtkAction *a, VikWindow *vw )
+{
+  my_acquire ( vw, &vik_datasource_fit_interface );
+}
+
 static void acquire_from_geojson ( GtkAction *a, VikWindow *vw )
 {
   my_acquire ( vw, &vik_datasource_geojson_interface );
@@ -4593,6 +5114,11 @@ static void preferences_cb ( GtkAction *a, VikWindow *vw )
 
   a_preferences_show_window ( GTK_WINDOW(vw) );
 
+  a_vik_refresh_preferences ();
+  a_mapcache_refresh_preferences ();
+  a_background_refresh_preferences ();
+  a_peercache_refresh_preferences ();
+
   // Has the waypoint size setting changed?
   if (wp_icon_size != a_vik_get_use_large_waypoint_icons()) {
     // Delete icon indexing 'cache' and so automatically regenerates with the new setting when changed
@@ -4616,6 +5142,7 @@ static void preferences_reset_cb ( GtkAction *a, VikWindow *vw )
   if ( a_dialog_yes_or_no ( GTK_WINDOW(vw), _("Are you sure you wish to reset all preferences back to the defaults?"), NULL ) ) {
     gchar *filename = a_preferences_reset_all_defaults();
     if ( filename ) {
+      a_vik_refresh_preferences ();
       a_dialog_info_msg_extra ( GTK_WINDOW(vw), _("A backup of the previous preferences was saved to: %s"), filename );
       toolbar_apply_settings ( vw->viking_vtb, vw->main_vbox, vw->menu_hbox, TRUE );
       vik_layers_panel_set_preferences ( vw->viking_vlp );
@@ -4789,17 +5316,44 @@ static void save_image_file ( VikWindow *vw, const gchar *fn, guint w, guint h,
   draw_update ( vw );
 }
 
+typedef struct {
+  GdkPixbuf *pixbuf;
+  gchar *filename;
+  gboolean save_as_png;
+  gchar *error_msg; // Set on failure
+} save_tile_t;
+
+// Maximum number of drawn tiles waiting to be saved, to limit the memory used
+#define SAVE_TILES_PENDING_MAX 8
+
+/**
+ * Compressing and writing an image is independent of GDK drawing,
+ *  so can be done by the task workers
+ */
+static void save_image_tile ( save_tile_t *st, gint *pending )
+{
+  GError *error = NULL;
+  VIK_TRACE_ARG ( "export", "save tile", TRACE_PHASE_BEGIN, "pixels", gdk_pixbuf_get_width(st->pixbuf) * gdk_pixbuf_get_height(st->pixbuf) );
+  gdk_pixbuf_save ( st->pixbuf, st->filename, st->save_as_png ? "png" : "jpeg", &error, NULL );
+  VIK_TRACE ( "export", "save tile", TRACE_PHASE_END );
+  if ( error ) {
+    st->error_msg = g_strdup_printf ( _("Unable to write to file %s: %s"), st->filename, error->message );
+    g_error_free ( error );
+  }
+  // Free the memory now rather than after the whole set
+  g_object_unref ( G_OBJECT(st->pixbuf) );
+  st->pixbuf = NULL;
+  (void)g_atomic_int_dec_and_test ( pending );
+}
+
 static void save_image_dir ( VikWindow *vw, const gchar *fn, guint w, guint h, gdouble zoom, gboolean save_as_png, guint tiles_w, guint tiles_h )
 {
-  gulong size = sizeof(gchar) * (strlen(fn) + 15);
-  gchar *name_of_file = g_malloc ( size );
   guint x = 1, y = 1;
   struct UTM utm_orig, utm;
 
   /* *** copied from above *** */
   GdkPixbuf *pixbuf_to_save;
   gdouble old_xmpp, old_ympp;
-  GError *error = NULL;
 
   /* backup old zoom & set new */
   old_xmpp = vik_viewport_get_xmpp ( vw->viking_vvp );
@@ -4817,11 +5371,16 @@ static void save_image_dir ( VikWindow *vw, const gchar *fn, guint w, guint h, g
 
   utm_orig = *((const struct UTM *)vik_viewport_get_center ( vw->viking_vvp ));
 
+  // Drawing has to stay in this thread, but each tile is saved by the task workers
+  //  whilst the following tiles are drawn
+  VikTaskGroup *group = a_background_tasks_new ();
+  save_tile_t *tiles = g_new0 ( save_tile_t, tiles_w * tiles_h );
+  gint pending = 0;
+
   for ( y = 1; y <= tiles_h; y++ )
   {
     for ( x = 1; x <= tiles_w; x++ )
     {
-      g_snprintf ( name_of_file, size, "%s%cy%d-x%d.%s", fn, G_DIR_SEPARATOR, y, x, save_as_png ? "png" : "jpg" );
       utm = utm_orig;
       if ( tiles_w & 0x1 )
         utm.easting += ((gdouble)x - ceil(((gdouble)tiles_w)/2)) * (w*zoom);
@@ -4839,16 +5398,21 @@ static void save_image_dir ( VikWindow *vw, const gchar *fn, guint w, guint h, g
 
       /* save buffer as file. */
       pixbuf_to_save = gdk_pixbuf_get_from_drawable ( NULL, GDK_DRAWABLE(vik_viewport_get_pixmap ( vw->viking_vvp )), NULL, 0, 0, 0, 0, w, h);
-      gdk_pixbuf_save ( pixbuf_to_save, name_of_file, save_as_png ? "png" : "jpeg", &error, NULL );
-      if (error)
-      {
-        gchar *msg = g_strdup_printf (_("Unable to write to file %s: %s"), name_of_file, error->message );
-        vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_INFO, msg );
-        g_free ( msg );
-        g_error_free (error);
+      if ( !pixbuf_to_save ) {
+        g_warning ( "Failed to generate internal pixmap size: %d x %d", w, h );
+        continue;
       }
 
-      g_object_unref ( G_OBJECT(pixbuf_to_save) );
+      // Help with the saving (in this thread too) when too far ahead of it
+      while ( g_atomic_int_get ( &pending ) >= SAVE_TILES_PENDING_MAX )
+        (void)a_background_tasks_wait ( group, 10 );
+
+      save_tile_t *st = &tiles[(y-1)*tiles_w + (x-1)];
+      st->pixbuf = pixbuf_to_save;
+      st->filename = g_strdup_printf ( "%s%cy%d-x%d.%s", fn, G_DIR_SEPARATOR, y, x, save_as_png ? "png" : "jpg" );
+      st->save_as_png = save_as_png;
+      g_atomic_int_inc ( &pending );
+      a_background_tasks_add ( group, (GFunc)save_image_tile, st, &pending );
     }
   }
 
@@ -4858,7 +5422,16 @@ static void save_image_dir ( VikWindow *vw, const gchar *fn, guint w, guint h, g
   (void)vik_viewport_configure ( vw->viking_vvp );
   draw_update ( vw );
 
-  g_free ( name_of_file );
+  a_background_tasks_free ( group );
+
+  for ( guint nn = 0; nn < tiles_w * tiles_h; nn++ ) {
+    if ( tiles[nn].error_msg ) {
+      vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_INFO, tiles[nn].error_msg );
+      g_free ( tiles[nn].error_msg );
+    }
+    g_free ( tiles[nn].filename );
+  }
+  g_free ( tiles );
 }
 
 static void draw_to_image_file_current_window_cb(GtkWidget* widget,GdkEventButton *event,gpointer *pass_along)
@@ -5358,6 +5931,12 @@ static void toggle_draw_highlight ( GtkAction *a, VikWindow *vw )
   draw_update ( vw );
 }
 
+static void toggle_draw_performance ( GtkAction *a, VikWindow *vw )
+{
+  vw->show_performance = gtk_toggle_action_get_active ( GTK_TOGGLE_ACTION(a) );
+  draw_update ( vw );
+}
+
 static void set_bg_color ( GtkAction *a, VikWindow *vw )
 {
   GtkWidget *colorsd = gtk_color_selection_dialog_new ( _("Choose a background color") );
@@ -5438,6 +6017,7 @@ static GtkActionEntry entries[] = {
   { "Help", NULL, N_("_Help"), 0, 0, 0 },
 
   { "New",       GTK_STOCK_NEW,          N_("_New"),                          "<control>N", N_("New file"),                                     (GCallback)newwindow_cb          },
+  { "NewView",   NULL,                   N_("New _View"),                     NULL,         N_("Another window showing the same layers, sharing their data"), (GCallback)new_view_cb },
   { "Open",      GTK_STOCK_OPEN,         N_("_Open..."),                         "<control>O", N_("Open a file"),                                  (GCallback)load_file             },
   { "OpenRecentFile", NULL,              N_("Open _Recent File"),         NULL,         NULL,                                               (GCallback)NULL },
   { "Append",    GTK_STOCK_ADD,          N_("Append _File..."),           NULL,         N_("Append data from a different file"),            (GCallback)load_file             },
@@ -5458,6 +6038,7 @@ static GtkActionEntry entries[] = {
   { "AcquireGeotag", NULL,               N_("From Geotagged _Images..."), NULL,         N_("Create waypoints from geotagged images"),       (GCallback)acquire_from_geotag   },
 #endif
   { "AcquireURL", NULL,                  N_("From _URL..."),              NULL,         N_("Get a file from a URL"),                        (GCallback)acquire_from_url },
+  { "AcquireFIT", NULL,                  N_("Import _FIT Files..."),      NULL,         N_("Import activity files from a watch or bike computer"), (GCallback)acquire_from_fit },
 #ifdef VIK_CONFIG_GEONAMES
   { "AcquireWikipedia", NULL,            N_("From _Wikipedia Waypoints"), NULL,         N_("Create waypoints from Wikipedia items in the current view"), (GCallback)acquire_from_wikipedia },
 #endif
@@ -5494,6 +6075,7 @@ static GtkActionEntry entries[] = {
   { "PanWest",   GTK_STOCK_GO_FORWARD,   N_("Pan _West"),                 "<control>Left",  NULL,                                           (GCallback)draw_pan_cb },
   { "BGJobs",    GTK_STOCK_EXECUTE,      N_("Background _Jobs"),              NULL,         N_("Background Jobs"),                          (GCallback)a_background_show_window },
   { "Log",       GTK_STOCK_INFO,         N_("Log"),                           NULL,         N_("Logged messages"),                          (GCallback)a_logging_show_window },
+  { "MemoryUsage", NULL,                N_("_Memory Usage"),                 NULL,         N_("Memory used by each layer"),                (GCallback)memory_usage_cb },
 
   { "Cut",       GTK_STOCK_CUT,          N_("Cu_t"),                          NULL,         N_("Cut selected layer"),                       (GCallback)menu_cut_layer_cb     },
   { "Copy",      GTK_STOCK_COPY,         N_("_Copy"),                         NULL,         N_("Copy selected layer"),                      (GCallback)menu_copy_layer_cb    },
@@ -5517,6 +6099,7 @@ static GtkActionEntry debug_entries[] = {
   { "MapCacheInfo", NULL,                "_Map Cache Info",                   NULL,         NULL,                                           (GCallback)help_cache_info_cb    },
   { "BackForwardInfo", NULL,             "_Back/Forward Info",                NULL,         NULL,                                           (GCallback)back_forward_info_cb  },
   { "BuildInfo", NULL,                   "_Build Info",                       NULL,         NULL,                                           (GCallback)build_info_cb  },
+  { "Trace", NULL,                       "_Trace...",                         NULL,         "Start tracing, or save the trace",             (GCallback)trace_cb  },
 };
 
 static GtkActionEntry entries_gpsbabel[] = {
@@ -5559,6 +6142,7 @@ static GtkToggleActionEntry toggle_entries[] = {
   { "ViewSidePanelCalendar",   NULL,        N_("Show Side Panel Ca_lendar"), "<shift>F8",  N_("Show Side Panel Calendar"),                (GCallback)view_side_panel_calendar_cb, TRUE },
   { "ViewSidePanelTabs",       NULL,        N_("Show Side Panel Tabs"),      "<shift>F10",  N_("Show Side Panel Tabs"),                    (GCallback)view_side_panel_tabs_cb, TRUE },
   { "ViewSidePanelGoto",       NULL,        N_("Show Side Panel Goto"),      "<shift>F7",  N_("Show Side Panel Goto"),                    (GCallback)view_side_panel_goto_cb, TRUE },
+  { "ShowPerformance",         NULL,        N_("Show Pe_rformance"),         "<shift>F6",  N_("Show drawing times and cache usage"),      (GCallback)toggle_draw_performance, FALSE },
 };
 
 // This must match the toggle entries order above
@@ -5576,6 +6160,7 @@ static gpointer toggle_entries_toolbar_cb[] = {
   (GCallback)tb_view_side_panel_calendar_cb,
   (GCallback)tb_view_side_panel_tabs_cb,
   (GCallback)tb_view_side_panel_goto_cb,
+  NULL,
 };
 
 #include "menu.xml.h"
@@ -5620,6 +6205,7 @@ static void window_create_ui( VikWindow *window )
            "<menuitem action='MapCacheInfo'/>"
            "<menuitem action='BackForwardInfo'/>"
            "<menuitem action='BuildInfo'/>"
+           "<menuitem action='Trace'/>"
          "</menu></menubar></ui>",
          -1, NULL ) ) {
       gtk_action_group_add_actions (action_group, debug_entries, G_N_ELEMENTS (debug_entries), window);
@@ -5653,7 +6239,8 @@ static void window_create_ui( VikWindow *window )
   }
 
   // Use this to see if GPSBabel is available:
-  if ( a_babel_available () ) {
+  //  (without waiting for the features of GPSBabel to be loaded)
+  if ( a_babel_found () ) {
     // If going to add more entries then might be worth creating a menu_gpsbabel.xml.h file
     if ( gtk_ui_manager_add_ui_from_string ( uim,
          "<ui>" \
@@ -5674,14 +6261,10 @@ static void window_create_ui( VikWindow *window )
   }
 
   // GeoJSON import capability
-  gchar *gjp = g_find_program_in_path ( a_geojson_program_import() );
-  if ( gjp ) {
-    if ( gtk_ui_manager_add_ui_from_string ( uim,
-         "<ui><menubar name='MainMenu'><menu action='File'><menu action='Acquire'><menuitem action='AcquireGeoJSON'/></menu></menu></menubar></ui>",
-         -1, &error ) )
-      gtk_action_group_add_actions ( action_group, entries_geojson, G_N_ELEMENTS (entries_geojson), window );
-    g_free ( gjp );
-  }
+  if ( gtk_ui_manager_add_ui_from_string ( uim,
+       "<ui><menubar name='MainMenu'><menu action='File'><menu action='Acquire'><menuitem action='AcquireGeoJSON'/></menu></menu></menubar></ui>",
+       -1, &error ) )
+    gtk_action_group_add_actions ( action_group, entries_geojson, G_N_ELEMENTS (entries_geojson), window );
 
   icon_factory = gtk_icon_factory_new ();
   gtk_icon_factory_add_default (icon_factory); 
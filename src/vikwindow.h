@@ -64,6 +64,7 @@ void vik_window_close_graphs ( VikWindow *vw );
 GtkWidget *vik_window_get_drawmode_button ( VikWindow *vw, VikViewportDrawMode mode );
 gboolean vik_window_get_pan_move ( VikWindow *vw );
 void vik_window_open_file ( VikWindow *vw, const gchar *filename, gboolean change_filename, gboolean first, gboolean last, gboolean new_layer, gboolean external );
+void vik_window_recover ( VikWindow *vw );
 struct _VikLayer;
 void vik_window_selected_layer(VikWindow *vw, struct _VikLayer *vl);
 struct _VikViewport * vik_window_viewport(VikWindow *vw);
@@ -76,6 +77,7 @@ gboolean vik_window_save_file_as ( VikWindow *vw, gpointer val ); // gpointer is
 void vik_window_statusbar_update (VikWindow *vw, const gchar* message, vik_statusbar_type_t vs_type);
 
 void vik_window_set_redraw_trigger(struct _VikLayer *vl);
+void vik_window_center_screen ( VikWindow *vw, gint x, gint y );
 
 void vik_window_enable_layer_tool ( VikWindow *vw, gint layer_id, gint tool_id );
 
@@ -50,6 +50,8 @@ static gdouble _get_lat_min(VikMapSource *self );
 static gdouble _get_lat_max(VikMapSource *self );
 static gdouble _get_lon_min(VikMapSource *self );
 static gdouble _get_lon_max(VikMapSource *self );
+static guint _get_download_block_size ( VikMapSource *self );
+static int _download_block ( VikMapSource *self, MapCoord *src, guint size, const gchar *dest_fn, void *handle );
 
 static gchar *_get_uri( VikMapSourceDefault *self, MapCoord *src );
 static gchar *_get_hostname( VikMapSourceDefault *self );
@@ -68,6 +70,7 @@ struct _VikWmscMapSourcePrivate
   gdouble lat_max; // Degrees
   gdouble lon_min; // Degrees
   gdouble lon_max; // Degrees
+  guint block_size; // Tiles along each side of a single GetMap request
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (VikWmscMapSource, vik_wmsc_map_source, VIK_TYPE_MAP_SOURCE_DEFAULT);
@@ -90,6 +93,7 @@ enum
   PROP_LAT_MAX,
   PROP_LON_MIN,
   PROP_LON_MAX,
+  PROP_DOWNLOAD_BLOCK_SIZE,
 };
 
 static void
@@ -112,6 +116,7 @@ vik_wmsc_map_source_init (VikWmscMapSource *self)
   priv->lat_max = 90.0;
   priv->lon_min = -180.0;
   priv->lon_max = 180.0;
+  priv->block_size = 1;
 
   g_object_set (G_OBJECT (self),
                 "tilesize-x", 256,
@@ -208,6 +213,10 @@ vik_wmsc_map_source_set_property (GObject      *object,
       priv->lon_max = g_value_get_double (value);
       break;
 
+    case PROP_DOWNLOAD_BLOCK_SIZE:
+      priv->block_size = g_value_get_uint (value);
+      break;
+
     default:
       /* We don't have any other property... */
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -273,6 +282,10 @@ vik_wmsc_map_source_get_property (GObject    *object,
       g_value_set_double (value, priv->lat_max);
       break;
 
+    case PROP_DOWNLOAD_BLOCK_SIZE:
+      g_value_set_uint (value, priv->block_size);
+      break;
+
     default:
       /* We don't have any other property... */
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -304,6 +317,8 @@ vik_wmsc_map_source_class_init (VikWmscMapSourceClass *klass)
 	grandparent_class->get_lat_max = _get_lat_max;
 	grandparent_class->get_lon_min = _get_lon_min;
 	grandparent_class->get_lon_max = _get_lon_max;
+	grandparent_class->get_download_block_size = _get_download_block_size;
+	grandparent_class->download_block = _download_block;
 
 	parent_class->get_uri = _get_uri;
 	parent_class->get_hostname = _get_hostname;
@@ -407,6 +422,15 @@ vik_wmsc_map_source_class_init (VikWmscMapSourceClass *klass)
 	                             G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
 	g_object_class_install_property (object_class, PROP_LON_MAX, pspec);
 
+	pspec = g_param_spec_uint ("download-block-size",
+	                           "Download block size",
+	                           "Number of tiles along each side of the image fetched by one request, the URL needs WIDTH and HEIGHT parameters",
+	                           1,  // minimum value,
+	                           16, // maximum value
+	                           1, // default value
+	                           G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+	g_object_class_install_property (object_class, PROP_DOWNLOAD_BLOCK_SIZE, pspec);
+
 	object_class->finalize = vik_wmsc_map_source_finalize;
 }
 
@@ -482,23 +506,23 @@ _mapcoord_to_center_coord ( VikMapSource *self, MapCoord *src, VikCoord *dest )
           src->x, src->y, dest->east_west, dest->north_south);
 }
 
+/**
+ * The URL for the bounding box of size x size tiles, starting from the top left tile src
+ */
 static gchar *
-_get_uri( VikMapSourceDefault *self, MapCoord *src )
+get_block_uri ( VikWmscMapSourcePrivate *priv, MapCoord *src, guint size )
 {
-	g_return_val_if_fail (VIK_IS_WMSC_MAP_SOURCE(self), NULL);
-	
-    VikWmscMapSourcePrivate *priv = VIK_WMSC_MAP_SOURCE_PRIVATE(self);
 	gdouble socalled_mpp;
 	if (src->scale >= 0)
 		socalled_mpp = VIK_GZ(src->scale);
 	else
 		socalled_mpp = 1.0/VIK_GZ(-src->scale);
 	gdouble minx = (gdouble)src->x * 180 / VIK_GZ(17) * socalled_mpp * 2 - 180;
-	gdouble maxx = (gdouble)(src->x + 1) * 180 / VIK_GZ(17) * socalled_mpp * 2 - 180;
+	gdouble maxx = (gdouble)(src->x + size) * 180 / VIK_GZ(17) * socalled_mpp * 2 - 180;
 	/* We should restore logic of viking:
      * tile index on Y axis follow a screen logic (top -> down)
      */
-	gdouble miny = -((gdouble)(src->y + 1) * 180 / VIK_GZ(17) * socalled_mpp * 2 - 90);
+	gdouble miny = -((gdouble)(src->y + size) * 180 / VIK_GZ(17) * socalled_mpp * 2 - 90);
 	gdouble maxy = -((gdouble)(src->y) * 180 / VIK_GZ(17) * socalled_mpp * 2 - 90);
 	
 	gchar sminx[G_ASCII_DTOSTR_BUF_SIZE];
@@ -514,7 +538,16 @@ _get_uri( VikMapSourceDefault *self, MapCoord *src )
 	gchar *uri = g_strdup_printf (priv->url, sminx, sminy, smaxx, smaxy);
 	
 	return uri;
-} 
+}
+
+static gchar *
+_get_uri( VikMapSourceDefault *self, MapCoord *src )
+{
+	g_return_val_if_fail (VIK_IS_WMSC_MAP_SOURCE(self), NULL);
+	
+    VikWmscMapSourcePrivate *priv = VIK_WMSC_MAP_SOURCE_PRIVATE(self);
+	return get_block_uri ( priv, src, 1 );
+}
 
 static gchar *
 _get_hostname( VikMapSourceDefault *self )
@@ -549,6 +582,74 @@ _get_download_options( VikMapSourceDefault *self, MapCoord *src )
 
 	return dfo;
 }
+
+/**
+ * Replace the values of the WIDTH and HEIGHT parameters of a GetMap request
+ */
+static gchar *
+uri_set_image_size ( const gchar *uri, guint width, guint height )
+{
+	GString *gs = g_string_new ( NULL );
+	const gchar *ptr = uri;
+	while ( *ptr ) {
+		if ( ptr > uri && (ptr[-1] == '?' || ptr[-1] == '&') ) {
+			guint value = 0;
+			gsize len = 0;
+			if ( g_ascii_strncasecmp ( ptr, "WIDTH=", 6 ) == 0 ) {
+				value = width;
+				len = 6;
+			}
+			else if ( g_ascii_strncasecmp ( ptr, "HEIGHT=", 7 ) == 0 ) {
+				value = height;
+				len = 7;
+			}
+			if ( len ) {
+				g_string_append_len ( gs, ptr, len );
+				g_string_append_printf ( gs, "%u", value );
+				ptr += len;
+				while ( g_ascii_isdigit ( *ptr ) )
+					ptr++;
+				continue;
+			}
+		}
+		g_string_append_c ( gs, *ptr );
+		ptr++;
+	}
+	return g_string_free ( gs, FALSE );
+}
+
+static guint
+_get_download_block_size ( VikMapSource *self )
+{
+	g_return_val_if_fail (VIK_IS_WMSC_MAP_SOURCE(self), 1);
+	VikWmscMapSourcePrivate *priv = VIK_WMSC_MAP_SOURCE_PRIVATE(self);
+	return priv->block_size;
+}
+
+/**
+ * Fetch the image of size x size tiles with one GetMap request
+ */
+static int
+_download_block ( VikMapSource *self, MapCoord *src, guint size, const gchar *dest_fn, void *handle )
+{
+	g_return_val_if_fail (VIK_IS_WMSC_MAP_SOURCE(self), DOWNLOAD_PARAMETERS_ERROR);
+	VikWmscMapSourcePrivate *priv = VIK_WMSC_MAP_SOURCE_PRIVATE(self);
+
+	gchar *block_uri = get_block_uri ( priv, src, size );
+	gchar *uri = uri_set_image_size ( block_uri,
+	                                  size * vik_map_source_get_tilesize_x(self),
+	                                  size * vik_map_source_get_tilesize_y(self) );
+	g_free ( block_uri );
+
+	DownloadFileOptions *options = _get_download_options ( VIK_MAP_SOURCE_DEFAULT(self), src );
+	// The block image is only a temporary file, so there is nothing to compare against
+	options->check_file_server_time = FALSE;
+	options->use_etag = FALSE;
+	DownloadResult_t res = a_http_download_get_url ( priv->hostname, uri, dest_fn, options, handle );
+	a_download_file_options_free ( options );
+	g_free ( uri );
+	return res;
+}
 /**
  *
  */
@@ -0,0 +1,378 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <glib/gi18n.h>
+#include "globals.h"
+#include "preferences.h"
+#include "dir.h"
+#include "mapcache.h"
+#include "dems.h"
+#include "warmcache.h"
+
+/*
+ * On exit the decoded tiles in the map cache and the DEMs loaded are written to one file,
+ *  most recently used first, up to the size limit.
+ * On the next startup that file is mapped and the tiles go straight back into the map cache,
+ *  with their pixels left in the mapping, so they are only read from disk as they get drawn.
+ * DEMs are taken from it instead of decoding their files, whilst the files are unchanged.
+ *
+ * File layout (in the native byte order, as it is only for this machine):
+ *  header, then the header and data of each entry, each aligned to WC_ALIGN,
+ *  then at index_offset the index of each entry followed by its key (padded to 8 bytes).
+ * The file is replaced as a whole, so any mapping of the previous one stays valid.
+ */
+#define WC_MAGIC "VIKWARM1"
+#define WC_FILENAME "warmcache.bin"
+#define WC_ALIGN 16
+#define WC_ROUND_UP(nn,aa) (((nn) + (aa) - 1) / (aa) * (aa))
+
+typedef struct {
+  gchar magic[8];
+  guint32 byte_order;
+  guint32 n_entries;
+  guint64 index_offset;
+} WarmCacheFileHeader;
+
+typedef struct {
+  guint32 kind;
+  guint32 key_len;
+  guint64 header_offset;
+  guint64 header_len;
+  guint64 data_offset;
+  guint64 data_len;
+} WarmCacheIndexEntry;
+
+typedef struct {
+  WarmCacheKind kind;
+  const guint8 *key; // In the mapping
+  gsize key_len;
+  gsize header_offset;
+  gsize header_len;
+  gsize data_offset;
+  gsize data_len;
+} WarmEntry;
+
+struct _WarmCacheWriter {
+  FILE *ff;
+  gchar *tmp_filename;
+  guint64 offset;
+  guint64 limit;
+  GByteArray *index;
+  guint n_entries;
+  gboolean failed;
+};
+
+// Only set up in a_warmcache_post_init() and freed in a_warmcache_uninit(),
+//  so lookups from any thread in between need no lock
+static GBytes *mapped = NULL;
+static GArray *entries = NULL;      // of WarmEntry, in file order
+static GHashTable *entry_table = NULL; // WarmEntry -> itself
+
+static VikLayerParamScale params_scales[] = {
+  /* min, max, step, digits (decimal places) */
+ { 0, 4096, 16, 0 },
+};
+
+static VikLayerParamData wcs_default ( void ) { return VIK_LPD_UINT(0); }
+
+static VikLayerParam prefs[] = {
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "warmcache_size", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Map and DEM cache kept between sessions (MB):"), VIK_LAYER_WIDGET_SPINBUTTON, params_scales, NULL,
+    N_("On exit the decoded map tiles and DEM data in memory are written to a file, up to this size, so the next session can use them straight away. 0 disables this."), wcs_default, NULL, NULL },
+};
+
+static guint64 wc_limit ( void )
+{
+  VikLayerParamData *pd = a_preferences_get ( VIKING_PREFERENCES_NAMESPACE "warmcache_size" );
+  return pd ? (guint64)pd->u * 1024 * 1024 : 0;
+}
+
+static gchar *wc_filename ( void )
+{
+  return g_build_filename ( a_get_viking_dir(), WC_FILENAME, NULL );
+}
+
+static guint wc_entry_hash ( gconstpointer ptr )
+{
+  const WarmEntry *we = ptr;
+  guint32 hh = 2166136261u ^ (guint32)we->kind;
+  for ( gsize ii = 0; ii < we->key_len; ii++ )
+    hh = (hh ^ we->key[ii]) * 16777619u;
+  return hh;
+}
+
+static gboolean wc_entry_equal ( gconstpointer aa, gconstpointer bb )
+{
+  const WarmEntry *wa = aa;
+  const WarmEntry *wb = bb;
+  return wa->kind == wb->kind && wa->key_len == wb->key_len && memcmp ( wa->key, wb->key, wa->key_len ) == 0;
+}
+
+void a_warmcache_init ( void )
+{
+  a_preferences_register ( &prefs[0], (VikLayerParamData){0}, VIKING_PREFERENCES_GROUP_KEY );
+}
+
+static inline gboolean wc_in_range ( guint64 offset, guint64 len, guint64 end )
+{
+  return len <= end && offset <= end - len;
+}
+
+/**
+ * Read the index of the mapped file
+ */
+static gboolean wc_read_index ( void )
+{
+  gsize length = 0;
+  const guint8 *contents = g_bytes_get_data ( mapped, &length );
+  WarmCacheFileHeader hdr;
+  if ( length < sizeof(hdr) )
+    return FALSE;
+  memcpy ( &hdr, contents, sizeof(hdr) );
+  if ( memcmp ( hdr.magic, WC_MAGIC, sizeof(hdr.magic) ) || hdr.byte_order != G_BYTE_ORDER ||
+       hdr.index_offset < sizeof(hdr) || hdr.index_offset > length )
+    return FALSE;
+
+  const guint8 *pos = contents + hdr.index_offset;
+  const guint8 *end = contents + length;
+  for ( guint32 nn = 0; nn < hdr.n_entries; nn++ ) {
+    WarmCacheIndexEntry ie;
+    if ( end - pos < (gssize)sizeof(ie) )
+      return FALSE;
+    memcpy ( &ie, pos, sizeof(ie) );
+    pos += sizeof(ie);
+    if ( (guint64)(end - pos) < WC_ROUND_UP((guint64)ie.key_len, 8) ||
+         !wc_in_range ( ie.header_offset, ie.header_len, hdr.index_offset ) ||
+         !wc_in_range ( ie.data_offset, ie.data_len, hdr.index_offset ) )
+      return FALSE;
+    WarmEntry we;
+    we.kind = ie.kind;
+    we.key = pos;
+    we.key_len = ie.key_len;
+    we.header_offset = ie.header_offset;
+    we.header_len = ie.header_len;
+    we.data_offset = ie.data_offset;
+    we.data_len = ie.data_len;
+    g_array_append_val ( entries, we );
+    pos += WC_ROUND_UP(ie.key_len, 8);
+  }
+  return TRUE;
+}
+
+/**
+ * a_warmcache_post_init:
+ *
+ * Once preferences are available, map the file left by the previous session (if enabled)
+ *  and put its tiles into the map cache
+ */
+void a_warmcache_post_init ( void )
+{
+  if ( !wc_limit() )
+    return;
+
+  gchar *fn = wc_filename ();
+  GError *error = NULL;
+  // Writable only so the mapping is private - the pixels are never actually changed
+  GMappedFile *mf = g_mapped_file_new ( fn, TRUE, &error );
+  g_free ( fn );
+  if ( !mf ) {
+    if ( !g_error_matches ( error, G_FILE_ERROR, G_FILE_ERROR_NOENT ) )
+      g_debug ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+    return;
+  }
+  mapped = g_mapped_file_get_bytes ( mf );
+  g_mapped_file_unref ( mf );
+
+  entries = g_array_new ( FALSE, FALSE, sizeof(WarmEntry) );
+  if ( !wc_read_index () ) {
+    g_warning ( "%s: Ignoring invalid cache file", __FUNCTION__ );
+    g_array_set_size ( entries, 0 );
+  }
+  entry_table = g_hash_table_new ( wc_entry_hash, wc_entry_equal );
+  for ( guint ii = 0; ii < entries->len; ii++ ) {
+    WarmEntry *we = &g_array_index ( entries, WarmEntry, ii );
+    g_hash_table_insert ( entry_table, we, we );
+  }
+  g_debug ( "%s: %d entries", __FUNCTION__, entries->len );
+
+  a_mapcache_warm_load ();
+}
+
+void a_warmcache_uninit ( void )
+{
+  if ( entry_table )
+    g_hash_table_destroy ( entry_table );
+  entry_table = NULL;
+  if ( entries )
+    g_array_free ( entries, TRUE );
+  entries = NULL;
+  // Anything still using an entry keeps the mapping
+  if ( mapped )
+    g_bytes_unref ( mapped );
+  mapped = NULL;
+}
+
+static void wc_entry_get ( const WarmEntry *we, GBytes **header, GBytes **data )
+{
+  *header = g_bytes_new_from_bytes ( mapped, we->header_offset, we->header_len );
+  *data = g_bytes_new_from_bytes ( mapped, we->data_offset, we->data_len );
+}
+
+/**
+ * a_warmcache_lookup:
+ * @header: (out): Returns the header of the entry
+ * @data:   (out): Returns the data of the entry
+ *
+ * Returns: TRUE if the entry was in the file from the previous session
+ */
+gboolean a_warmcache_lookup ( WarmCacheKind kind, gconstpointer key, gsize key_len, GBytes **header, GBytes **data )
+{
+  if ( !entry_table )
+    return FALSE;
+  WarmEntry lookup;
+  lookup.kind = kind;
+  lookup.key = key;
+  lookup.key_len = key_len;
+  const WarmEntry *we = g_hash_table_lookup ( entry_table, &lookup );
+  if ( !we )
+    return FALSE;
+  wc_entry_get ( we, header, data );
+  return TRUE;
+}
+
+/**
+ * a_warmcache_foreach:
+ *
+ * Call the function for each entry of the kind. The function takes over the header and data.
+ */
+void a_warmcache_foreach ( WarmCacheKind kind, WarmCacheFunc func, gpointer user_data )
+{
+  if ( !entries )
+    return;
+  for ( guint ii = entries->len; ii > 0; ii-- ) {
+    const WarmEntry *we = &g_array_index ( entries, WarmEntry, ii-1 );
+    if ( we->kind != kind )
+      continue;
+    GBytes *header, *data;
+    wc_entry_get ( we, &header, &data );
+    func ( we->key, we->key_len, header, data, user_data );
+  }
+}
+
+static void wc_write_padded ( WarmCacheWriter *wcw, gconstpointer data, gsize len )
+{
+  static const guint8 zeros[WC_ALIGN] = { 0 };
+  gsize pad = WC_ROUND_UP(len, WC_ALIGN) - len;
+  if ( (len && fwrite ( data, len, 1, wcw->ff ) != 1) ||
+       (pad && fwrite ( zeros, pad, 1, wcw->ff ) != 1) )
+    wcw->failed = TRUE;
+  wcw->offset += len + pad;
+}
+
+gboolean a_warmcache_write ( WarmCacheWriter *wcw, WarmCacheKind kind, gconstpointer key, gsize key_len, gconstpointer header, gsize header_len, gconstpointer data, gsize data_len )
+{
+  guint64 size = WC_ROUND_UP(header_len, WC_ALIGN) + WC_ROUND_UP(data_len, WC_ALIGN);
+  if ( wcw->failed || wcw->offset + size > wcw->limit )
+    return FALSE;
+
+  WarmCacheIndexEntry ie;
+  memset ( &ie, 0, sizeof(ie) );
+  ie.kind = kind;
+  ie.key_len = key_len;
+  ie.header_offset = wcw->offset;
+  ie.header_len = header_len;
+  wc_write_padded ( wcw, header, header_len );
+  ie.data_offset = wcw->offset;
+  ie.data_len = data_len;
+  wc_write_padded ( wcw, data, data_len );
+
+  static const guint8 zeros[8] = { 0 };
+  g_byte_array_append ( wcw->index, (guint8*)&ie, sizeof(ie) );
+  g_byte_array_append ( wcw->index, key, key_len );
+  g_byte_array_append ( wcw->index, zeros, WC_ROUND_UP(key_len, 8) - key_len );
+  wcw->n_entries++;
+  return !wcw->failed;
+}
+
+/**
+ * a_warmcache_save:
+ *
+ * Write the DEMs loaded and the decoded map tiles for the next session.
+ * DEMs go first since they are much slower to reload than tiles are to decode.
+ */
+void a_warmcache_save ( void )
+{
+  gchar *fn = wc_filename ();
+  guint64 limit = wc_limit ();
+  if ( !limit ) {
+    // Don't leave a file that will not be used
+    (void)g_remove ( fn );
+    g_free ( fn );
+    return;
+  }
+
+  WarmCacheWriter wcw;
+  memset ( &wcw, 0, sizeof(wcw) );
+  wcw.tmp_filename = g_strconcat ( fn, ".tmp", NULL );
+  wcw.ff = g_fopen ( wcw.tmp_filename, "wb" );
+  if ( !wcw.ff ) {
+    g_debug ( "%s: Can not write %s", __FUNCTION__, wcw.tmp_filename );
+    g_free ( wcw.tmp_filename );
+    g_free ( fn );
+    return;
+  }
+  wcw.index = g_byte_array_new ();
+  wcw.limit = sizeof(WarmCacheFileHeader) + limit;
+
+  // Space for the header, written once the index is known
+  WarmCacheFileHeader hdr;
+  memset ( &hdr, 0, sizeof(hdr) );
+  wc_write_padded ( &wcw, &hdr, sizeof(hdr) );
+
+  a_dems_warm_save ( &wcw );
+  a_mapcache_warm_save ( &wcw );
+
+  memcpy ( hdr.magic, WC_MAGIC, sizeof(hdr.magic) );
+  hdr.byte_order = G_BYTE_ORDER;
+  hdr.n_entries = wcw.n_entries;
+  hdr.index_offset = wcw.offset;
+  if ( fwrite ( wcw.index->data, wcw.index->len, 1, wcw.ff ) != 1 ||
+       fseek ( wcw.ff, 0, SEEK_SET ) != 0 ||
+       fwrite ( &hdr, sizeof(hdr), 1, wcw.ff ) != 1 )
+    wcw.failed = TRUE;
+  if ( fclose ( wcw.ff ) != 0 )
+    wcw.failed = TRUE;
+
+  if ( wcw.failed || g_rename ( wcw.tmp_filename, fn ) != 0 ) {
+    g_debug ( "%s: Failed to write %s", __FUNCTION__, fn );
+    (void)g_remove ( wcw.tmp_filename );
+  }
+  else
+    g_debug ( "%s: %d entries, %" G_GUINT64_FORMAT " bytes", __FUNCTION__, wcw.n_entries, wcw.offset );
+
+  g_byte_array_free ( wcw.index, TRUE );
+  g_free ( wcw.tmp_filename );
+  g_free ( fn );
+}
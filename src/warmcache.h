@@ -0,0 +1,54 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_WARMCACHE_H
+#define __VIKING_WARMCACHE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Keeping decoded map tiles and DEM grids in a file between sessions,
+//  which is mapped on the next startup so they can be used straight away
+typedef enum {
+  WARMCACHE_TILE = 1,
+  WARMCACHE_DEM,
+} WarmCacheKind;
+
+typedef struct _WarmCacheWriter WarmCacheWriter;
+
+void a_warmcache_init ( void );
+// Map the file left by the previous session and fill the caches from it
+void a_warmcache_post_init ( void );
+// Write the current contents of the caches for the next session
+void a_warmcache_save ( void );
+void a_warmcache_uninit ( void );
+
+// The header and data of an entry, which stay valid (in the mapped file) until unreferenced
+gboolean a_warmcache_lookup ( WarmCacheKind kind, gconstpointer key, gsize key_len, GBytes **header, GBytes **data );
+typedef void (*WarmCacheFunc) ( gconstpointer key, gsize key_len, GBytes *header, GBytes *data, gpointer user_data );
+// In the reverse of the order written, so adding each to an LRU queue leaves the first written as the most recent
+void a_warmcache_foreach ( WarmCacheKind kind, WarmCacheFunc func, gpointer user_data );
+
+// Returns: FALSE if the entry was not written as it would go over the size limit
+gboolean a_warmcache_write ( WarmCacheWriter *wcw, WarmCacheKind kind, gconstpointer key, gsize key_len, gconstpointer header, gsize header_len, gconstpointer data, gsize data_len );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,535 @@
+// Copyright: CC0
+//
+// Time bulk tile downloads against a mock tile server run within this program
+//
+// Usage: benchmark_download [--tiles N] [--latency MS] [--bandwidth KBPS] [--error-rate PERCENT]
+//                           [--size BYTES] [--pending N] [--connections N] [--no-etags] [--verbose]
+//
+// The server listens on the loopback interface, taking the given time to respond to each request,
+//  sending at no more than the given rate on each connection and failing the given proportion
+//  of requests (with 503 Service Unavailable). Tiles have an ETag so that a request with a
+//  matching If-None-Match gets 304 Not Modified.
+//
+// The same download code as the maps layer uses is run in the same ways:
+//  - a batch of downloads kept topped up with new tiles, sharing the connections (batch)
+//  - one download after another, reusing the connection (sequential)
+//  - the batch again once the tiles have aged, so they are checked with the server (revalidate)
+//
+// The results are output as JSON on stdout, one object per run, with the tiles per second,
+//  the connections the server accepted, the bytes it sent and percentiles of the time each tile took.
+//
+// Only HTTP/1.1 is served, so the HTTP/2 multiplexing used over TLS is not measured here.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <utime.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include "download.h"
+#include "curl_download.h"
+#include "settings.h"
+#include "preferences.h"
+#include "globals.h"
+
+static gint tiles = 500;
+static gint latency = 20;
+static gint bandwidth = 0;
+static gdouble error_rate = 0.0;
+static gint size = 20000;
+static gint pending = 16;
+static gint connections = 4;
+static gboolean no_etags = FALSE;
+static gboolean verbose = FALSE;
+
+static GOptionEntry entries[] =
+{
+  { "tiles", 'n', 0, G_OPTION_ARG_INT, &tiles, "Number of tiles downloaded in each run", "N" },
+  { "latency", 'l', 0, G_OPTION_ARG_INT, &latency, "Time the server takes to respond to each request", "MS" },
+  { "bandwidth", 'b', 0, G_OPTION_ARG_INT, &bandwidth, "Rate the server sends at on each connection (0 for unlimited)", "KBPS" },
+  { "error-rate", 'e', 0, G_OPTION_ARG_DOUBLE, &error_rate, "Percentage of requests the server fails", "PERCENT" },
+  { "size", 's', 0, G_OPTION_ARG_INT, &size, "Size of each tile", "BYTES" },
+  { "pending", 'p', 0, G_OPTION_ARG_INT, &pending, "Number of downloads kept queued in the batch", "N" },
+  { "connections", 'c', 0, G_OPTION_ARG_INT, &connections, "Maximum connections to the server (curl_max_host_connections)", "N" },
+  { "no-etags", 0, 0, G_OPTION_ARG_NONE, &no_etags, "Do not send or check ETags", NULL },
+  { "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose, "Show the warnings of failed downloads", NULL },
+  { NULL }
+};
+
+#define SEND_CHUNK 16384
+
+typedef struct {
+  GSocket *listener;
+  GCancellable *cancel;
+  GThread *thread;
+  guint16 port;
+  gchar *body;
+
+  GMutex lock;          // For everything below
+  GRand *rand;
+  GPtrArray *workers;   // Threads of the connections
+  guint connections;
+  guint requests;
+  guint64 bytes;
+} MockServer;
+
+static gboolean send_all ( MockServer *ms, GSocket *sock, const gchar *data, gsize len )
+{
+  while ( len ) {
+    gssize sent = g_socket_send ( sock, data, len, ms->cancel, NULL );
+    if ( sent <= 0 )
+      return FALSE;
+    data += sent;
+    len -= sent;
+    g_mutex_lock ( &ms->lock );
+    ms->bytes += sent;
+    g_mutex_unlock ( &ms->lock );
+  }
+  return TRUE;
+}
+
+/**
+ * Send the body no faster than the bandwidth allows
+ */
+static gboolean send_body ( MockServer *ms, GSocket *sock )
+{
+  gint64 start = g_get_monotonic_time ();
+  for ( gsize done = 0; done < (gsize)size; ) {
+    gsize len = MIN ( SEND_CHUNK, (gsize)size - done );
+    if ( !send_all ( ms, sock, ms->body + done, len ) )
+      return FALSE;
+    done += len;
+    if ( bandwidth > 0 ) {
+      gint64 due = start + (gint64)done * G_USEC_PER_SEC / ((gint64)bandwidth * 1000);
+      gint64 now = g_get_monotonic_time ();
+      if ( due > now )
+        g_usleep ( due - now );
+    }
+  }
+  return TRUE;
+}
+
+/**
+ * The value of the header, from the headers in lower case
+ */
+static gchar *header_value ( const gchar *headers, const gchar *name )
+{
+  const gchar *found = strstr ( headers, name );
+  if ( !found )
+    return NULL;
+  found += strlen ( name );
+  const gchar *end = strstr ( found, "\r\n" );
+  return g_strstrip ( g_strndup ( found, end ? end - found : strlen(found) ) );
+}
+
+/**
+ * Respond to one request, returning FALSE when the connection has gone
+ */
+static gboolean serve_request ( MockServer *ms, GSocket *sock, const gchar *request )
+{
+  gchar **parts = g_strsplit ( request, " ", 3 );
+  gchar *path = g_strdup ( parts[0] && parts[1] ? parts[1] : "/" );
+  g_strfreev ( parts );
+
+  gchar *lower = g_ascii_strdown ( request, -1 );
+  gchar *if_none_match = header_value ( lower, "\r\nif-none-match:" );
+  g_free ( lower );
+
+  // Each tile has its own ETag, that stays the same
+  gchar *etag = g_strdup_printf ( "\"%08x\"", g_str_hash ( path ) );
+  g_free ( path );
+
+  if ( latency > 0 )
+    g_usleep ( (gulong)latency * 1000 );
+
+  g_mutex_lock ( &ms->lock );
+  ms->requests++;
+  gboolean fail = error_rate > 0.0 && g_rand_double_range ( ms->rand, 0.0, 100.0 ) < error_rate;
+  gboolean unchanged = !fail && !no_etags && if_none_match && g_ascii_strcasecmp ( if_none_match, etag ) == 0;
+  g_mutex_unlock ( &ms->lock );
+
+  gchar *head;
+  if ( fail )
+    head = g_strdup ( "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n" );
+  else if ( unchanged )
+    head = g_strdup_printf ( "HTTP/1.1 304 Not Modified\r\nETag: %s\r\n\r\n", etag );
+  else if ( no_etags )
+    head = g_strdup_printf ( "HTTP/1.1 200 OK\r\nContent-Type: image/png\r\nContent-Length: %d\r\n\r\n", size );
+  else
+    head = g_strdup_printf ( "HTTP/1.1 200 OK\r\nContent-Type: image/png\r\nContent-Length: %d\r\nETag: %s\r\n\r\n", size, etag );
+
+  gboolean carry_on = send_all ( ms, sock, head, strlen(head) );
+  if ( carry_on && !fail && !unchanged )
+    carry_on = send_body ( ms, sock );
+
+  g_free ( head );
+  g_free ( etag );
+  g_free ( if_none_match );
+  return carry_on;
+}
+
+typedef struct {
+  MockServer *ms;
+  GSocket *sock;
+} MockConnection;
+
+/**
+ * Serve the requests on a connection until it is closed (as keep alive is the default in HTTP/1.1)
+ */
+static gpointer connection_run ( gpointer data )
+{
+  MockConnection *mc = data;
+  GString *buf = g_string_new ( NULL );
+  gchar block[4096];
+  gboolean carry_on = TRUE;
+
+  while ( carry_on ) {
+    gssize got = g_socket_receive ( mc->sock, block, sizeof(block), mc->ms->cancel, NULL );
+    if ( got <= 0 )
+      break;
+    g_string_append_len ( buf, block, got );
+    // Requests are only GETs, so each ends with the blank line after the headers
+    gchar *end;
+    while ( carry_on && (end = strstr ( buf->str, "\r\n\r\n" )) ) {
+      gsize len = end - buf->str + 4;
+      gchar *request = g_strndup ( buf->str, len );
+      carry_on = serve_request ( mc->ms, mc->sock, request );
+      g_free ( request );
+      g_string_erase ( buf, 0, len );
+    }
+  }
+
+  g_string_free ( buf, TRUE );
+  g_socket_close ( mc->sock, NULL );
+  g_object_unref ( mc->sock );
+  g_free ( mc );
+  return NULL;
+}
+
+static gpointer server_run ( gpointer data )
+{
+  MockServer *ms = data;
+  GSocket *sock;
+  while ( (sock = g_socket_accept ( ms->listener, ms->cancel, NULL )) ) {
+    MockConnection *mc = g_malloc ( sizeof(MockConnection) );
+    mc->ms = ms;
+    mc->sock = sock;
+    g_mutex_lock ( &ms->lock );
+    ms->connections++;
+    g_ptr_array_add ( ms->workers, g_thread_new ( "mockconnection", connection_run, mc ) );
+    g_mutex_unlock ( &ms->lock );
+  }
+  return NULL;
+}
+
+static MockServer *mock_server_start ( void )
+{
+  GError *error = NULL;
+  MockServer *ms = g_malloc0 ( sizeof(MockServer) );
+  g_mutex_init ( &ms->lock );
+  ms->rand = g_rand_new_with_seed ( 42 );
+  ms->workers = g_ptr_array_new ();
+  ms->cancel = g_cancellable_new ();
+  ms->body = g_malloc ( size );
+  for ( gint ii = 0; ii < size; ii++ )
+    ms->body[ii] = (gchar)(ii * 7);
+
+  ms->listener = g_socket_new ( G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, &error );
+  if ( ms->listener ) {
+    GInetAddress *loopback = g_inet_address_new_loopback ( G_SOCKET_FAMILY_IPV4 );
+    GSocketAddress *address = g_inet_socket_address_new ( loopback, 0 );
+    if ( g_socket_bind ( ms->listener, address, TRUE, &error ) && g_socket_listen ( ms->listener, &error ) ) {
+      GSocketAddress *bound = g_socket_get_local_address ( ms->listener, &error );
+      if ( bound ) {
+        ms->port = g_inet_socket_address_get_port ( G_INET_SOCKET_ADDRESS(bound) );
+        g_object_unref ( bound );
+      }
+    }
+    g_object_unref ( address );
+    g_object_unref ( loopback );
+  }
+  if ( error ) {
+    fprintf ( stderr, "Mock server failed: %s\n", error->message );
+    g_error_free ( error );
+    return NULL;
+  }
+
+  ms->thread = g_thread_new ( "mockserver", server_run, ms );
+  return ms;
+}
+
+static void mock_server_stop ( MockServer *ms )
+{
+  // Wakes up the accept and all the connections
+  g_cancellable_cancel ( ms->cancel );
+  g_thread_join ( ms->thread );
+  for ( guint ii = 0; ii < ms->workers->len; ii++ )
+    g_thread_join ( g_ptr_array_index ( ms->workers, ii ) );
+  g_ptr_array_free ( ms->workers, TRUE );
+  g_socket_close ( ms->listener, NULL );
+  g_object_unref ( ms->listener );
+  g_object_unref ( ms->cancel );
+  g_rand_free ( ms->rand );
+  g_mutex_clear ( &ms->lock );
+  g_free ( ms->body );
+  g_free ( ms );
+}
+
+typedef struct {
+  guint connections;
+  guint requests;
+  guint64 bytes;
+} ServerCounts;
+
+static ServerCounts mock_server_counts ( MockServer *ms )
+{
+  g_mutex_lock ( &ms->lock );
+  ServerCounts sc = { ms->connections, ms->requests, ms->bytes };
+  g_mutex_unlock ( &ms->lock );
+  return sc;
+}
+
+typedef struct {
+  gchar *fn;
+  gchar *uri;
+  gint64 start;
+  gint64 took;
+  DownloadResult_t result;
+} TileJob;
+
+static TileJob *tile_jobs_new ( const gchar *dir, guint zoom )
+{
+  TileJob *jobs = g_new0 ( TileJob, tiles );
+  for ( gint ii = 0; ii < tiles; ii++ ) {
+    // Rows of tiles, as over a map view
+    guint x = 1000 + ii % 32;
+    guint y = 2000 + ii / 32;
+    jobs[ii].fn = g_strdup_printf ( "%s%c%u%c%u%c%u.png", dir, G_DIR_SEPARATOR, zoom, G_DIR_SEPARATOR, x, G_DIR_SEPARATOR, y );
+    jobs[ii].uri = g_strdup_printf ( "/%u/%u/%u.png", zoom, x, y );
+  }
+  return jobs;
+}
+
+static void tile_jobs_free ( TileJob *jobs )
+{
+  for ( gint ii = 0; ii < tiles; ii++ ) {
+    (void)g_remove ( jobs[ii].fn );
+    gchar *etag_fn = g_strdup_printf ( "%s.etag", jobs[ii].fn );
+    (void)g_remove ( etag_fn );
+    g_free ( etag_fn );
+    g_free ( jobs[ii].fn );
+    g_free ( jobs[ii].uri );
+  }
+  g_free ( jobs );
+}
+
+static DownloadFileOptions *tile_options ( void )
+{
+  DownloadFileOptions *options = g_malloc0 ( sizeof(DownloadFileOptions) );
+  options->use_etag = !no_etags;
+  return options;
+}
+
+static gboolean tile_done ( DownloadResult_t result, gpointer user_data )
+{
+  TileJob *job = user_data;
+  job->took = g_get_monotonic_time () - job->start;
+  job->result = result;
+  return TRUE;
+}
+
+static gint compare_times ( gconstpointer a, gconstpointer b )
+{
+  gint64 aa = *(const gint64*)a;
+  gint64 bb = *(const gint64*)b;
+  return aa < bb ? -1 : (aa > bb ? 1 : 0);
+}
+
+static gboolean first_result = TRUE;
+
+/**
+ * Output one run, checking the tiles reported as downloaded are complete
+ *
+ * Returns: FALSE if any are not
+ */
+static gboolean report ( const gchar *name, TileJob *jobs, gint64 took, ServerCounts before, ServerCounts after )
+{
+  guint ok = 0, not_modified = 0, not_required = 0, failed = 0;
+  gboolean complete = TRUE;
+  gint64 *times = g_new ( gint64, tiles );
+  for ( gint ii = 0; ii < tiles; ii++ ) {
+    times[ii] = jobs[ii].took;
+    switch ( jobs[ii].result ) {
+    case DOWNLOAD_SUCCESS: {
+      GStatBuf buf;
+      if ( g_stat ( jobs[ii].fn, &buf ) != 0 || buf.st_size != size ) {
+        fprintf ( stderr, "FAILED: %s incomplete\n", jobs[ii].fn );
+        complete = FALSE;
+      }
+      ok++;
+      break;
+    }
+    case DOWNLOAD_NOT_MODIFIED: not_modified++; break;
+    case DOWNLOAD_NOT_REQUIRED: not_required++; break;
+    default: failed++; break;
+    }
+  }
+  qsort ( times, tiles, sizeof(gint64), compare_times );
+
+  printf ( "%s\n    { \"name\": \"%s\", ", first_result ? "" : ",", name );
+  first_result = FALSE;
+  printf ( "\"tiles\": %d, \"seconds\": %.3f, \"tiles_per_s\": %.1f, ",
+           tiles, took / 1e6, took ? tiles * 1e6 / took : 0.0 );
+  printf ( "\"ok\": %u, \"not_modified\": %u, \"not_required\": %u, \"failed\": %u, ",
+           ok, not_modified, not_required, failed );
+  printf ( "\"connections\": %u, \"requests\": %u, \"bytes\": %" G_GUINT64_FORMAT ", ",
+           after.connections - before.connections, after.requests - before.requests, after.bytes - before.bytes );
+  printf ( "\"p50_ms\": %.2f, \"p95_ms\": %.2f, \"p99_ms\": %.2f, \"max_ms\": %.2f }",
+           times[tiles / 2] / 1000.0, times[tiles * 95 / 100] / 1000.0,
+           times[tiles * 99 / 100] / 1000.0, times[tiles - 1] / 1000.0 );
+  fflush ( stdout );
+  g_free ( times );
+  return complete;
+}
+
+/**
+ * Download the tiles as the maps layer does, keeping the batch topped up with new tiles
+ */
+static void run_batch ( const gchar *host, TileJob *jobs )
+{
+  void *batch = a_download_batch_new ();
+  for ( gint ii = 0; ii < tiles; ii++ ) {
+    jobs[ii].start = g_get_monotonic_time ();
+    a_http_download_batch_add ( batch, host, jobs[ii].uri, jobs[ii].fn, tile_options(), tile_done, &jobs[ii] );
+    (void)a_download_batch_run ( batch, pending - 1 );
+  }
+  (void)a_download_batch_run ( batch, 0 );
+  a_download_batch_free ( batch );
+}
+
+/**
+ * Download the tiles one after another, as a single download thread does
+ */
+static void run_sequential ( const gchar *host, TileJob *jobs )
+{
+  void *handle = a_download_handle_init ();
+  DownloadFileOptions *options = tile_options ();
+  for ( gint ii = 0; ii < tiles; ii++ ) {
+    jobs[ii].start = g_get_monotonic_time ();
+    (void)tile_done ( a_http_download_get_url ( host, jobs[ii].uri, jobs[ii].fn, options, handle ), &jobs[ii] );
+  }
+  a_download_file_options_free ( options );
+  a_download_handle_cleanup ( handle );
+}
+
+/**
+ * Make the tiles older than the tile age, so they are checked with the server again
+ */
+static void age_tiles ( TileJob *jobs )
+{
+  struct utimbuf old = { 0, 0 };
+  old.actime = old.modtime = time(NULL) - 400 * 24 * 60 * 60;
+  for ( gint ii = 0; ii < tiles; ii++ )
+    (void)g_utime ( jobs[ii].fn, &old );
+}
+
+static void quiet_log ( const gchar *domain, GLogLevelFlags level, const gchar *message, gpointer user_data )
+{
+}
+
+int main ( int argc, char *argv[] )
+{
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new ( "- benchmark tile downloads from a mock server" );
+  g_option_context_add_main_entries ( context, entries, NULL );
+  if ( !g_option_context_parse ( context, &argc, &argv, &error ) ) {
+    fprintf ( stderr, "%s\n", error->message );
+    g_error_free ( error );
+    return 1;
+  }
+  g_option_context_free ( context );
+  if ( tiles < 1 || size < 1 || pending < 1 || connections < 1 )
+    return 1;
+
+  // Failed downloads are expected when the server is told to fail some
+  if ( !verbose )
+    g_log_set_default_handler ( quiet_log, NULL );
+
+  a_settings_init ();
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_download_init ();
+  a_settings_set_integer ( "curl_max_host_connections", connections );
+  curl_download_init ();
+
+  MockServer *ms = mock_server_start ();
+  if ( !ms )
+    return 1;
+  gchar *host = g_strdup_printf ( "http://127.0.0.1:%u", ms->port );
+  gchar *dir = g_dir_make_tmp ( "viking-benchmark-download.XXXXXX", NULL );
+  if ( !dir )
+    return 1;
+
+  printf ( "{\n  \"tiles\": %d,\n  \"latency_ms\": %d,\n  \"bandwidth_kbps\": %d,\n  \"error_rate\": %.2f,\n"
+           "  \"size\": %d,\n  \"pending\": %d,\n  \"max_connections\": %d,\n  \"etags\": %s,\n  \"http\": \"1.1\",\n"
+           "  \"results\": [",
+           tiles, latency, bandwidth, error_rate, size, pending, connections, no_etags ? "false" : "true" );
+
+  gboolean complete = TRUE;
+  TileJob *batch_jobs = tile_jobs_new ( dir, 17 );
+  TileJob *sequential_jobs = tile_jobs_new ( dir, 16 );
+  ServerCounts before = mock_server_counts ( ms );
+  gint64 start = g_get_monotonic_time ();
+
+  run_batch ( host, batch_jobs );
+  ServerCounts after = mock_server_counts ( ms );
+  complete &= report ( "batch", batch_jobs, g_get_monotonic_time () - start, before, after );
+
+  before = after;
+  start = g_get_monotonic_time ();
+  run_sequential ( host, sequential_jobs );
+  after = mock_server_counts ( ms );
+  complete &= report ( "sequential", sequential_jobs, g_get_monotonic_time () - start, before, after );
+
+  age_tiles ( batch_jobs );
+  before = after;
+  start = g_get_monotonic_time ();
+  run_batch ( host, batch_jobs );
+  after = mock_server_counts ( ms );
+  complete &= report ( "revalidate", batch_jobs, g_get_monotonic_time () - start, before, after );
+
+  printf ( "\n  ]\n}\n" );
+
+  tile_jobs_free ( sequential_jobs );
+  tile_jobs_free ( batch_jobs );
+  mock_server_stop ( ms );
+
+  // Remove the tile directories left empty
+  const gchar *zooms[] = { "16", "17" };
+  for ( guint zz = 0; zz < G_N_ELEMENTS(zooms); zz++ ) {
+    gchar *zdir = g_build_filename ( dir, zooms[zz], NULL );
+    GDir *gdir = g_dir_open ( zdir, 0, NULL );
+    if ( gdir ) {
+      const gchar *name;
+      while ( (name = g_dir_read_name ( gdir )) ) {
+        gchar *xdir = g_build_filename ( zdir, name, NULL );
+        (void)g_rmdir ( xdir );
+        g_free ( xdir );
+      }
+      g_dir_close ( gdir );
+    }
+    (void)g_rmdir ( zdir );
+    g_free ( zdir );
+  }
+  (void)g_rmdir ( dir );
+  g_free ( dir );
+  g_free ( host );
+
+  curl_download_uninit ();
+  a_download_uninit ();
+  a_preferences_uninit ();
+  // Not a_settings_uninit(), as that would save the changed connections setting
+
+  return complete ? 0 : 2;
+}
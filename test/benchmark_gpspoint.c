@@ -0,0 +1,81 @@
+// Copyright: CC0
+//
+// Time reading the TrackWaypoint layer data (GPSPoint text) embedded in .vik files
+//
+// Usage: benchmark_gpspoint [trackpoints] [repeats]
+//
+// A synthetic track of the given size is generated, in the same form as a_gpspoint_write_file()
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include "coords.h"
+#include "gpspoint.h"
+#include "viklayer.h"
+#include "viklayer_defaults.h"
+#include "settings.h"
+#include "preferences.h"
+#include "globals.h"
+
+static FILE *make_track_data ( guint n_points )
+{
+  FILE *ff = tmpfile ();
+  if ( !ff )
+    return NULL;
+  fprintf ( ff, "type=\"track\" name=\"Benchmark\"\n" );
+  for ( guint nn = 0; nn < n_points; nn++ ) {
+    gchar lat[COORDS_STR_BUFFER_SIZE];
+    gchar lon[COORDS_STR_BUFFER_SIZE];
+    gchar alt[COORDS_STR_BUFFER_SIZE];
+    a_coords_dtostr_buffer ( 51.0 + (nn % 5000) * 0.0000021, lat );
+    a_coords_dtostr_buffer ( -1.0 + nn * 0.000013, lon );
+    a_coords_dtostr_buffer ( 100.0 + (nn % 1000) * 0.1, alt );
+    fprintf ( ff, "type=\"trackpoint\" latitude=\"%s\" longitude=\"%s\" altitude=\"%s\" unixtime=\"%u\"",
+              lat, lon, alt, 1500000000 + nn );
+    if ( nn % 2 )
+      fprintf ( ff, " extended=\"yes\" speed=\"4.25\" course=\"270.5\" sat=\"9\" hr=\"%u\" cad=\"85\"", 120 + nn % 40 );
+    fprintf ( ff, "\n" );
+  }
+  fprintf ( ff, "type=\"trackend\"\n~EndLayerData\n" );
+  return ff;
+}
+
+int main ( int argc, char *argv[] )
+{
+  guint n_points = argc > 1 ? atoi(argv[1]) : 100000;
+  guint repeats = argc > 2 ? atoi(argv[2]) : 10;
+  if ( n_points < 1 || repeats < 1 )
+    return 1;
+
+  // Some stuff must be initialized as it gets auto used
+  a_settings_init ();
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_layer_defaults_init ();
+
+  FILE *ff = make_track_data ( n_points );
+  if ( !ff )
+    return 2;
+
+  int ans = 0;
+  gint64 total = 0;
+  for ( guint rr = 0; rr < repeats; rr++ ) {
+    rewind ( ff );
+    VikTrwLayer *vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, NULL, FALSE ));
+    gint64 start = g_get_monotonic_time ();
+    if ( !a_gpspoint_read_file ( vtl, ff, NULL ) )
+      ans = 3;
+    total += g_get_monotonic_time () - start;
+    g_object_unref ( vtl );
+  }
+  fclose ( ff );
+
+  printf ( "a_gpspoint_read_file: %.3f us per trackpoint (%u trackpoints x %u)\n",
+           (double)total / ((double)n_points * repeats), n_points, repeats );
+
+  vik_trwlayer_uninit ();
+  a_layer_defaults_uninit ();
+  a_preferences_uninit ();
+  a_settings_uninit ();
+
+  return ans;
+}
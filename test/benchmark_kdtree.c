@@ -0,0 +1,130 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * Time building the flat kd-tree and its nearest, k nearest and batch searches
+ *  for random locations, checking a sample of the results against a linear search
+ *
+ * Usage: benchmark_kdtree [points] [queries] [k]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "flatkdtree.h"
+
+static void random_locations(GRand *rand, gdouble *coords, guint count)
+{
+    guint ii;
+    for (ii = 0; ii < count; ii++) {
+        coords[2*ii] = g_rand_double_range(rand, -90.0, 90.0);
+        coords[2*ii+1] = g_rand_double_range(rand, -180.0, 180.0);
+    }
+}
+
+static gdouble linear_nearest(const gdouble *coords, guint count, const gdouble pt[2])
+{
+    gdouble best = G_MAXDOUBLE;
+    guint ii;
+    for (ii = 0; ii < count; ii++) {
+        gdouble d0 = pt[0] - coords[2*ii];
+        gdouble d1 = pt[1] - coords[2*ii+1];
+        best = MIN(best, d0*d0 + d1*d1);
+    }
+    return sqrt(best);
+}
+
+int main(int argc, char *argv[])
+{
+    guint points = argc > 1 ? atoi(argv[1]) : 100000;
+    guint queries = argc > 2 ? atoi(argv[2]) : 100000;
+    guint k = argc > 3 ? atoi(argv[3]) : 8;
+    if (points < 1 || queries < 1 || k < 1)
+        return 1;
+
+    GRand *rand = g_rand_new_with_seed(42);
+    gdouble *coords = g_new(gdouble, 2 * points);
+    gdouble *pts = g_new(gdouble, 2 * queries);
+    random_locations(rand, coords, points);
+    random_locations(rand, pts, queries);
+    g_rand_free(rand);
+
+    guint32 *ids = g_new(guint32, (gsize)queries * k);
+    gdouble *distances = g_new(gdouble, (gsize)queries * k);
+    guint *counts = g_new(guint, queries);
+    guint ii;
+    gint64 start;
+
+    start = g_get_monotonic_time();
+    FlatKDTree *tree = a_flat_kdtree_new(coords, points);
+    gint64 build_time = g_get_monotonic_time() - start;
+
+    start = g_get_monotonic_time();
+    for (ii = 0; ii < queries; ii++) {
+        gdouble distance = G_MAXDOUBLE;
+        ids[ii] = a_flat_kdtree_nearest(tree, pts + 2*ii, &distance);
+        distances[ii] = distance;
+    }
+    gint64 nearest_time = g_get_monotonic_time() - start;
+
+    // Check a sample against searching every point
+    for (ii = 0; ii < MIN(queries, 100); ii++) {
+        gdouble expected = linear_nearest(coords, points, pts + 2*ii);
+        if (fabs(expected - distances[ii]) > 1e-9) {
+            fprintf(stderr, "FAILED: query %u nearest %f expected %f\n", ii, distances[ii], expected);
+            return 2;
+        }
+    }
+
+    start = g_get_monotonic_time();
+    for (ii = 0; ii < queries; ii++)
+        counts[ii] = a_flat_kdtree_knn(tree, pts + 2*ii, k, G_MAXDOUBLE, ids + (gsize)ii*k, distances + (gsize)ii*k);
+    gint64 knn_time = g_get_monotonic_time() - start;
+
+    for (ii = 0; ii < MIN(queries, 100); ii++) {
+        gdouble expected = linear_nearest(coords, points, pts + 2*ii);
+        if (counts[ii] != MIN(k, points) || fabs(expected - distances[(gsize)ii*k]) > 1e-9) {
+            fprintf(stderr, "FAILED: query %u k nearest\n", ii);
+            return 3;
+        }
+    }
+
+    start = g_get_monotonic_time();
+    a_flat_kdtree_knn_batch(tree, pts, queries, k, G_MAXDOUBLE, ids, distances, counts, 1);
+    gint64 batch1_time = g_get_monotonic_time() - start;
+
+    start = g_get_monotonic_time();
+    a_flat_kdtree_knn_batch(tree, pts, queries, k, G_MAXDOUBLE, ids, distances, counts, 0);
+    gint64 batch_time = g_get_monotonic_time() - start;
+
+    printf("points %u, queries %u, k %u, threads %u\n", points, queries, k, g_get_num_processors());
+    printf("build:             %.2f ms\n", build_time / 1000.0);
+    printf("nearest:           %.3f us per query\n", (double)nearest_time / queries);
+    printf("k nearest:         %.3f us per query\n", (double)knn_time / queries);
+    printf("batch (1 thread):  %.3f us per query\n", (double)batch1_time / queries);
+    printf("batch (threads):   %.3f us per query\n", (double)batch_time / queries);
+
+    a_flat_kdtree_free(tree);
+    g_free(counts);
+    g_free(distances);
+    g_free(ids);
+    g_free(pts);
+    g_free(coords);
+    return 0;
+}
@@ -0,0 +1,448 @@
+// Copyright: CC0
+//
+// Time the core geodesic, projection and track functions over synthetic data
+//
+// Usage: benchmark_kernels [--size N] [--repeats R] [--only NAME]
+//
+// The results are output as JSON on stdout, one object per benchmark in a fixed order,
+//  so that runs can be compared for regression tracking.
+// Benchmarks needing a display (the viewport) are reported as skipped when there is none.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include "coords.h"
+#include "vikcoord.h"
+#include "viktrack.h"
+#include "viktrwlayer.h"
+#include "vikviewport.h"
+#include "gpx.h"
+#include "gpspoint.h"
+#include "dem.h"
+#include "mapcache.h"
+#include "heatmaptiles.h"
+#include "viklayer.h"
+#include "viklayer_defaults.h"
+#include "settings.h"
+#include "preferences.h"
+#include "globals.h"
+
+static gint size = 100000;
+static gint repeats = 5;
+static gchar *only = NULL;
+
+static GOptionEntry entries[] =
+{
+  { "size", 'n', 0, G_OPTION_ARG_INT, &size, "Number of items in each synthetic dataset", "N" },
+  { "repeats", 'r', 0, G_OPTION_ARG_INT, &repeats, "Number of times each benchmark is run", "R" },
+  { "only", 'o', 0, G_OPTION_ARG_STRING, &only, "Only run benchmarks whose name contains this", "NAME" },
+  { NULL }
+};
+
+static gboolean first_result = TRUE;
+
+// Sink for results so the compiler can not optimize the work away
+static volatile gdouble sink = 0.0;
+
+static gboolean wanted ( const gchar *name )
+{
+  return !only || strstr ( name, only );
+}
+
+/**
+ * Output one result, timing is the fastest of the repeats as that is the most stable
+ */
+static void report ( const gchar *name, guint items, gint64 best_us, gboolean skipped )
+{
+  printf ( "%s\n    { \"name\": \"%s\", ", first_result ? "" : ",", name );
+  first_result = FALSE;
+  if ( skipped )
+    printf ( "\"skipped\": true }" );
+  else
+    printf ( "\"items\": %u, \"repeats\": %d, \"best_ms\": %.3f, \"ns_per_item\": %.3f }",
+             items, repeats, best_us / 1000.0, items ? (best_us * 1000.0) / items : 0.0 );
+  fflush ( stdout );
+}
+
+#define BENCH_BEGIN(NAME) \
+  if ( wanted(NAME) ) { \
+    const gchar *bench_name = NAME; \
+    gint64 best = G_MAXINT64; \
+    for ( gint rr = 0; rr < repeats; rr++ ) { \
+      gint64 start = g_get_monotonic_time ();
+
+#define BENCH_END(ITEMS) \
+      gint64 took = g_get_monotonic_time () - start; \
+      if ( took < best ) best = took; \
+    } \
+    report ( bench_name, (ITEMS), best, FALSE ); \
+  }
+
+static struct LatLon *make_latlons ( guint n )
+{
+  struct LatLon *lls = g_new ( struct LatLon, n );
+  GRand *rand = g_rand_new_with_seed ( 42 );
+  for ( guint nn = 0; nn < n; nn++ ) {
+    lls[nn].lat = g_rand_double_range ( rand, -80.0, 84.0 );
+    lls[nn].lon = g_rand_double_range ( rand, -180.0, 180.0 );
+  }
+  g_rand_free ( rand );
+  return lls;
+}
+
+/**
+ * A wiggly track heading east from Stonehenge, with a point every second
+ */
+static VikTrack *make_track ( guint n )
+{
+  VikTrack *trk = vik_track_new ();
+  for ( guint nn = 0; nn < n; nn++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    struct LatLon ll = { 51.1789 + 0.001 * sin ( nn / 50.0 ), -1.8262 + nn * 0.00005 };
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    tp->timestamp = 1500000000.0 + nn;
+    tp->altitude = 100.0 + 20.0 * sin ( nn / 200.0 );
+    vik_track_add_trackpoint ( trk, tp, FALSE );
+  }
+  vik_track_calculate_bounds ( trk );
+  return trk;
+}
+
+static void bench_coords ( guint n )
+{
+  struct LatLon *lls = make_latlons ( n );
+  struct UTM *utms = g_new ( struct UTM, n );
+
+  BENCH_BEGIN ( "a_coords_latlon_to_utm" )
+    for ( guint nn = 0; nn < n; nn++ )
+      a_coords_latlon_to_utm ( &lls[nn], &utms[nn] );
+  BENCH_END ( n )
+
+  // Ensure there is something to convert back, even when only this one is run
+  for ( guint nn = 0; nn < n; nn++ )
+    a_coords_latlon_to_utm ( &lls[nn], &utms[nn] );
+
+  BENCH_BEGIN ( "a_coords_utm_to_latlon" )
+    struct LatLon ll;
+    for ( guint nn = 0; nn < n; nn++ ) {
+      a_coords_utm_to_latlon ( &utms[nn], &ll );
+      sink += ll.lat;
+    }
+  BENCH_END ( n )
+
+  BENCH_BEGIN ( "a_coords_latlon_diff" )
+    for ( guint nn = 1; nn < n; nn++ )
+      sink += a_coords_latlon_diff ( &lls[nn-1], &lls[nn] );
+  BENCH_END ( n - 1 )
+
+  // The fast distances are for nearby points, so along a path like make_track()
+  for ( guint nn = 0; nn < n; nn++ ) {
+    lls[nn].lat = 51.1789 + 0.001 * sin ( nn / 50.0 );
+    lls[nn].lon = -1.8262 + nn * 0.00005;
+  }
+
+  BENCH_BEGIN ( "a_coords_latlon_diff_fast" )
+    for ( guint nn = 1; nn < n; nn++ )
+      sink += a_coords_latlon_diff_fast ( &lls[nn-1], &lls[nn] );
+  BENCH_END ( n - 1 )
+
+  gdouble *diffs = g_new ( gdouble, n );
+  BENCH_BEGIN ( "a_coords_latlon_diffs" )
+    a_coords_latlon_diffs ( lls, diffs, n );
+    sink += diffs[n-2];
+  BENCH_END ( n - 1 )
+  g_free ( diffs );
+
+  g_free ( utms );
+  g_free ( lls );
+}
+
+static void bench_viewport ( guint n, gboolean have_display )
+{
+  if ( !wanted("vik_viewport_coord_to_screen") )
+    return;
+  if ( !have_display ) {
+    report ( "vik_viewport_coord_to_screen", 0, 0, TRUE );
+    return;
+  }
+
+  VikViewport *vvp = vik_viewport_new ();
+  g_object_ref_sink ( vvp );
+  vik_viewport_configure_manually ( vvp, 1024, 768 );
+  struct LatLon centre = { 51.1789, -1.8262 };
+  vik_viewport_set_center_latlon ( vvp, &centre, FALSE );
+  vik_viewport_set_zoom ( vvp, 2.0 );
+
+  VikCoord *coords = g_new ( VikCoord, n );
+  GRand *rand = g_rand_new_with_seed ( 42 );
+  for ( guint nn = 0; nn < n; nn++ ) {
+    struct LatLon ll = { centre.lat + g_rand_double_range ( rand, -0.01, 0.01 ),
+                         centre.lon + g_rand_double_range ( rand, -0.01, 0.01 ) };
+    vik_coord_load_from_latlon ( &coords[nn], vik_viewport_get_coord_mode(vvp), &ll );
+  }
+  g_rand_free ( rand );
+
+  BENCH_BEGIN ( "vik_viewport_coord_to_screen" )
+    gint x, y;
+    for ( guint nn = 0; nn < n; nn++ ) {
+      vik_viewport_coord_to_screen ( vvp, &coords[nn], &x, &y );
+      sink += x + y;
+    }
+  BENCH_END ( n )
+
+  g_free ( coords );
+  g_object_unref ( vvp );
+}
+
+static void bench_track ( guint n )
+{
+  VikTrack *trk = make_track ( n );
+
+  BENCH_BEGIN ( "vik_track_get_length" )
+    sink += vik_track_get_length ( trk );
+  BENCH_END ( n )
+
+#define BENCH_MAP(FUNC) \
+  BENCH_BEGIN ( #FUNC ) \
+    gdouble *map = FUNC ( trk, 500 ); \
+    if ( map ) sink += map[0]; \
+    g_free ( map ); \
+  BENCH_END ( n )
+
+  BENCH_MAP ( vik_track_make_elevation_map )
+  BENCH_MAP ( vik_track_make_gradient_map )
+  BENCH_MAP ( vik_track_make_speed_map )
+  BENCH_MAP ( vik_track_make_distance_map )
+  BENCH_MAP ( vik_track_make_elevation_time_map )
+  BENCH_MAP ( vik_track_make_speed_dist_map )
+
+  if ( wanted("a_heatmap_tiles") ) {
+    // Tile containing the start of the track at zoom 14
+    const gint zoom = 14;
+    gdouble scale = 1 << zoom;
+    gint tx = (gint)((-1.8262 + 180.0) / 360.0 * scale);
+    gdouble lat_rad = 51.1789 * G_PI / 180.0;
+    gint ty = (gint)((1.0 - log ( tan(lat_rad) + 1.0 / cos(lat_rad) ) / G_PI) / 2.0 * scale);
+
+    VikTrackSnapshot *snap = vik_track_get_snapshot ( trk );
+    HeatmapTiles *hmt = NULL;
+    BENCH_BEGIN ( "a_heatmap_tiles_add_track" )
+      if ( hmt )
+        a_heatmap_tiles_unref ( hmt );
+      hmt = a_heatmap_tiles_new ();
+      a_heatmap_tiles_add_track ( hmt, snap );
+      a_heatmap_tiles_finish ( hmt );
+    BENCH_END ( n )
+
+    if ( !hmt ) {
+      hmt = a_heatmap_tiles_new ();
+      a_heatmap_tiles_add_track ( hmt, snap );
+      a_heatmap_tiles_finish ( hmt );
+    }
+    vik_track_snapshot_unref ( snap );
+    BENCH_BEGIN ( "a_heatmap_tiles_render" )
+      GdkPixbuf *pixbuf = a_heatmap_tiles_render ( hmt, zoom, tx, ty, 4, heatmap_cs_default, 255 );
+      if ( pixbuf )
+        g_object_unref ( pixbuf );
+    BENCH_END ( 1 )
+    const guint8 colour[4] = { 0x2d, 0x87, 0x0a, 0xff };
+    BENCH_BEGIN ( "a_heatmap_tiles_render_lines" )
+      GdkPixbuf *pixbuf = a_heatmap_tiles_render_lines ( hmt, zoom, tx, ty, colour );
+      if ( pixbuf )
+        g_object_unref ( pixbuf );
+    BENCH_END ( 1 )
+    a_heatmap_tiles_unref ( hmt );
+  }
+
+  vik_track_free ( trk );
+}
+
+static void bench_files ( guint n )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, NULL, FALSE ));
+  vik_trw_layer_add_track ( vtl, "Benchmark", make_track ( n ) );
+
+  FILE *gpx = tmpfile ();
+  if ( !gpx ) {
+    g_object_unref ( vtl );
+    return;
+  }
+
+  BENCH_BEGIN ( "a_gpx_write_file" )
+    rewind ( gpx );
+    a_gpx_write_file ( vtl, gpx, NULL, NULL );
+    fflush ( gpx );
+  BENCH_END ( n )
+
+  // Ensure the file has content even when the write benchmark is not run
+  rewind ( gpx );
+  a_gpx_write_file ( vtl, gpx, NULL, NULL );
+  fflush ( gpx );
+
+  BENCH_BEGIN ( "a_gpx_read_file" )
+    rewind ( gpx );
+    VikTrwLayer *vtl2 = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, NULL, FALSE ));
+    (void)a_gpx_read_file ( vtl2, gpx, NULL, FALSE );
+    g_object_unref ( vtl2 );
+  BENCH_END ( n )
+  fclose ( gpx );
+
+  FILE *gpspoint = tmpfile ();
+  if ( gpspoint ) {
+    a_gpspoint_write_file ( vtl, gpspoint, NULL );
+    fprintf ( gpspoint, "~EndLayerData\n" );
+    fflush ( gpspoint );
+
+    BENCH_BEGIN ( "a_gpspoint_read_file" )
+      rewind ( gpspoint );
+      VikTrwLayer *vtl2 = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, NULL, FALSE ));
+      (void)a_gpspoint_read_file ( vtl2, gpspoint, NULL );
+      g_object_unref ( vtl2 );
+    BENCH_END ( n )
+    fclose ( gpspoint );
+  }
+
+  g_object_unref ( vtl );
+}
+
+/**
+ * Write a synthetic 3 arc second SRTM tile
+ */
+static gchar *make_dem_file ( const gchar *dir )
+{
+  const guint rows = 1201;
+  gchar *fn = g_build_filename ( dir, "N51W002.hgt", NULL );
+  guint8 *data = g_malloc ( rows * rows * 2 );
+  for ( guint yy = 0; yy < rows; yy++ )
+    for ( guint xx = 0; xx < rows; xx++ ) {
+      gint16 height = (gint16)(100 + 50 * sin ( xx / 40.0 ) + 50 * cos ( yy / 30.0 ));
+      // Big endian
+      data[(yy * rows + xx) * 2] = (guint8)((height >> 8) & 0xff);
+      data[(yy * rows + xx) * 2 + 1] = (guint8)(height & 0xff);
+    }
+  gboolean ok = g_file_set_contents ( fn, (gchar*)data, rows * rows * 2, NULL );
+  g_free ( data );
+  if ( !ok ) {
+    g_free ( fn );
+    return NULL;
+  }
+  return fn;
+}
+
+static void bench_dem ( guint n )
+{
+  if ( !wanted("vik_dem_get_") )
+    return;
+
+  gchar *dir = g_dir_make_tmp ( "viking-bench-XXXXXX", NULL );
+  if ( !dir )
+    return;
+  gchar *fn = make_dem_file ( dir );
+  VikDEM *dem = fn ? vik_dem_new_from_file ( fn ) : NULL;
+  if ( dem ) {
+    // Positions in arc seconds within the tile
+    gdouble *east = g_new ( gdouble, n );
+    gdouble *north = g_new ( gdouble, n );
+    GRand *rand = g_rand_new_with_seed ( 42 );
+    for ( guint nn = 0; nn < n; nn++ ) {
+      east[nn] = g_rand_double_range ( rand, dem->min_east + 10, dem->max_east - 10 );
+      north[nn] = g_rand_double_range ( rand, dem->min_north + 10, dem->max_north - 10 );
+    }
+    g_rand_free ( rand );
+
+#define BENCH_DEM(FUNC) \
+    BENCH_BEGIN ( #FUNC ) \
+      for ( guint nn = 0; nn < n; nn++ ) \
+        sink += FUNC ( dem, east[nn], north[nn] ); \
+    BENCH_END ( n )
+
+    BENCH_DEM ( vik_dem_get_east_north )
+    BENCH_DEM ( vik_dem_get_simple_interpol )
+    BENCH_DEM ( vik_dem_get_shepard_interpol )
+    BENCH_DEM ( vik_dem_get_best_interpol )
+
+    g_free ( east );
+    g_free ( north );
+    vik_dem_free ( dem );
+  }
+  if ( fn ) {
+    (void)g_remove ( fn );
+    g_free ( fn );
+  }
+  (void)g_rmdir ( dir );
+  g_free ( dir );
+}
+
+static void bench_mapcache ( guint n )
+{
+  if ( !wanted("a_mapcache_get") )
+    return;
+
+  // Enough tiles to exercise the lookup without exceeding the default cache size
+  const guint tiles = 256;
+  GdkPixbuf *pixbuf = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, TRUE, 8, 256, 256 );
+  gdk_pixbuf_fill ( pixbuf, 0x80808080 );
+  for ( guint tt = 0; tt < tiles; tt++ )
+    a_mapcache_add ( pixbuf, (mapcache_extra_t){ 0.0 }, tt % 16, tt / 16, 0, 13, 3, 255, 0.0, 0.0, NULL, NULL );
+  g_object_unref ( pixbuf );
+
+  BENCH_BEGIN ( "a_mapcache_get" )
+    for ( guint nn = 0; nn < n; nn++ ) {
+      guint tt = nn % tiles;
+      GdkPixbuf *pb = a_mapcache_get ( tt % 16, tt / 16, 0, 13, 3, 255, 0.0, 0.0, NULL, NULL );
+      if ( pb ) {
+        sink += 1;
+        g_object_unref ( pb );
+      }
+    }
+  BENCH_END ( n )
+}
+
+int main ( int argc, char *argv[] )
+{
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new ( "- benchmark core Viking functions" );
+  g_option_context_add_main_entries ( context, entries, NULL );
+  if ( !g_option_context_parse ( context, &argc, &argv, &error ) ) {
+    fprintf ( stderr, "%s\n", error->message );
+    g_error_free ( error );
+    return 1;
+  }
+  g_option_context_free ( context );
+  if ( size < 2 || repeats < 1 )
+    return 1;
+
+  // Only the viewport needs a display
+  gboolean have_display = gtk_init_check ( NULL, NULL );
+
+  // Some stuff must be initialized as it gets auto used
+  a_settings_init ();
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_layer_defaults_init ();
+  a_mapcache_init ();
+  a_mapcache_refresh_preferences ();
+
+  printf ( "{\n  \"size\": %d,\n  \"repeats\": %d,\n  \"results\": [", size, repeats );
+
+  bench_coords ( size );
+  bench_viewport ( size, have_display );
+  bench_track ( size );
+  bench_files ( size );
+  bench_dem ( size );
+  bench_mapcache ( size );
+
+  printf ( "\n  ]\n}\n" );
+
+  a_mapcache_uninit ();
+  vik_trwlayer_uninit ();
+  a_layer_defaults_uninit ();
+  a_preferences_uninit ();
+  a_settings_uninit ();
+  g_free ( only );
+
+  return 0;
+}
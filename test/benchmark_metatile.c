@@ -0,0 +1,81 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * Compare the per tile cost of metatile_read() and metatile_get()
+ *  when reading all the tiles of a metatile, as when drawing an 8x8 block
+ *
+ * Usage: benchmark_metatile [dir] [repeats]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+
+#include "metatile.h"
+
+int main ( int argc, char *argv[] )
+{
+    const int tile_max = METATILE_MAX_SIZE;
+    char err_msg[PATH_MAX];
+    int compressed;
+    // Same example metatile as test_metatile
+    int x0 = 4048;
+    int y0 = 2752;
+    int z = 13;
+    const char *dir = argc > 1 ? argv[1] : "metatile_example";
+    int repeats = argc > 2 ? atoi(argv[2]) : 100;
+    int tiles = repeats * METATILE * METATILE;
+    int x, y, ii;
+    gint64 start, read_time, get_time;
+    char *buf = malloc(tile_max);
+    if (!buf || repeats < 1)
+        return 1;
+
+    err_msg[0] = 0;
+    start = g_get_monotonic_time();
+    for (ii = 0; ii < repeats; ii++)
+        for (x = x0; x < x0 + METATILE; x++)
+            for (y = y0; y < y0 + METATILE; y++)
+                if (metatile_read(dir, x, y, z, buf, tile_max, &compressed, err_msg) < 0) {
+                    fprintf(stderr, "FAILED: %s\n", err_msg);
+                    free(buf);
+                    return 2;
+                }
+    read_time = g_get_monotonic_time() - start;
+    free(buf);
+
+    start = g_get_monotonic_time();
+    for (ii = 0; ii < repeats; ii++)
+        for (x = x0; x < x0 + METATILE; x++)
+            for (y = y0; y < y0 + METATILE; y++) {
+                GBytes *bytes = metatile_get(dir, x, y, z, &compressed, err_msg);
+                if (!bytes) {
+                    fprintf(stderr, "FAILED: %s\n", err_msg);
+                    return 3;
+                }
+                g_bytes_unref(bytes);
+            }
+    get_time = g_get_monotonic_time() - start;
+    metatile_cache_clear();
+
+    printf("metatile_read: %.2f us per tile\n", (double)read_time / tiles);
+    printf("metatile_get:  %.2f us per tile\n", (double)get_time / tiles);
+    return 0;
+}
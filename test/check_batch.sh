@@ -0,0 +1,43 @@
+#!/bin/sh
+
+# Enable running in test directory or via make distcheck when $srcdir is defined
+if [ -z "$srcdir" ]; then
+  srcdir=.
+fi
+
+outgpx=./testout-$$.gpx
+outvik=./testout-$$.vik
+summary=./testout-$$.json
+
+# Several GPX files, so they are read in parallel, all processed without a display
+env -u DISPLAY ../src/viking-batch --tidy --simplify 5 --smooth flat --tac-stats -o $outgpx \
+  "$srcdir/SF#022.gpx" $srcdir/sf_2134452.gpx $srcdir/RobRoute.gpx > $summary
+if [ $? != 0 ]; then
+  echo "viking-batch command failure"
+  exit 1
+fi
+
+for key in tracks tidy_removed simplify_removed smooth_changed tac output; do
+  if ! grep -q "\"$key\":" $summary; then
+    echo "viking-batch summary is missing $key"
+    exit 1
+  fi
+done
+
+if ! grep -q '<\(trk\|rte\)[ >]' $outgpx; then
+  echo "viking-batch did not write the tracks"
+  exit 1
+fi
+
+# The processed tracks read back the same from a Viking file
+../src/viking-batch -o $outvik $outgpx > /dev/null
+if [ $? != 0 ]; then
+  echo "viking-batch could not save a Viking file"
+  exit 1
+fi
+if [ "$(grep -c '^type="\(track\|route\)"' $outvik)" != "$(grep -c '<\(trk\|rte\)[ >]' $outgpx)" ]; then
+  echo "viking-batch saved a different number of tracks"
+  exit 1
+fi
+
+rm $outgpx $outvik $summary
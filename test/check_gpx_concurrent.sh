@@ -0,0 +1,12 @@
+#!/bin/sh
+
+# Enable running in test directory or via make distcheck when $srcdir is defined
+if [ -z "$srcdir" ]; then
+  srcdir=.
+fi
+
+./test_gpx_concurrent "$srcdir/SF#022.gpx" $srcdir/sf_2134452.gpx $srcdir/v900_advanced_mode.gpx $srcdir/RobRoute.gpx
+if [ $? != 0 ]; then
+  echo "test_gpx_concurrent failure"
+  exit 1
+fi
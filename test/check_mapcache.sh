@@ -0,0 +1,3 @@
+#!/bin/sh
+# Copyright: CC0
+./test_mapcache
@@ -0,0 +1,39 @@
+#!/bin/sh
+
+# Enable running in test directory or via make distcheck when $srcdir is defined
+if [ -z "$srcdir" ]; then
+  srcdir=.
+fi
+
+binfile=./testout-$$.vikb
+outfile=./testout-$$.vik
+
+# As per check_vik2vik.sh
+if [ -z "$REALTIME_GPS_TRACKING" ]; then
+    testvik=$srcdir/Simple_no-realtime-gps-tracking.vik
+elif [ -z "$GEOCLUE_ENABLED" ]; then
+    testvik=$srcdir/Simple_no-geoclue.vik
+else
+    testvik=$srcdir/Simple.vik
+fi
+
+# Round trip via the binary format should give the same text file back
+result=$(./vik2vik --binary $binfile < $testvik)
+if [ $? != 0 ]; then
+  echo "vik2vik binary save failure"
+  exit 1
+fi
+
+result=$(./vik2vik --input $binfile $outfile)
+if [ $? != 0 ]; then
+  echo "vik2vik binary load failure"
+  exit 1
+fi
+
+sed -i '/^directory=/d' $outfile
+grep -v "^directory=" $testvik | diff $outfile -
+if [ $? != 0 ]; then
+  echo "vik2vik binary round trip produced different result"
+  exit 1
+fi
+rm $binfile $outfile
@@ -0,0 +1,35 @@
+#!/bin/sh
+
+# Training workload for the profile guided build, see 'make pgo'
+# Exercises what dominates the real use: importing, the core track and coordinate functions,
+#  writing files and drawing through the headless render benchmark
+
+# Enable running in test directory or via make distcheck when $srcdir is defined
+if [ -z "$srcdir" ]; then
+  srcdir=.
+fi
+
+set -e
+
+# Import of a large track
+./benchmark_gpspoint 100000 3 > /dev/null
+
+# Track statistics, simplification, coordinate conversions, etc...
+./benchmark_kernels --repeats 3 > /dev/null
+
+# GPX reading and writing, sequentially and in parallel
+for gpx in "$srcdir/SF#022.gpx" $srcdir/sf_2134452.gpx $srcdir/v900_advanced_mode.gpx $srcdir/RobRoute.gpx; do
+  ./gpx2gpx < "$gpx" > /dev/null
+done
+./test_gpx_concurrent "$srcdir/SF#022.gpx" $srcdir/sf_2134452.gpx $srcdir/v900_advanced_mode.gpx $srcdir/RobRoute.gpx
+
+# Drawing needs a display, if necessary from a virtual X server
+viking=../src/viking
+render="$viking --render-benchmark $srcdir/sf_2134452.gpx $srcdir/RobRoute.gpx $srcdir/v900_advanced_mode.gpx"
+if [ -n "$DISPLAY" ]; then
+  $render > /dev/null
+elif command -v xvfb-run > /dev/null 2>&1; then
+  xvfb-run -a $render > /dev/null
+else
+  echo "pgo_train: no display available, so drawing is not part of the profile"
+fi
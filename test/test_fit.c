@@ -0,0 +1,261 @@
+// Read a small FIT activity file, made here by hand, checking the trackpoints and segments come out as recorded
+//  and that a truncated copy still gives the trackpoints before the damage
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "fit.h"
+#include "viklayer.h"
+#include "viklayer_defaults.h"
+#include "settings.h"
+#include "preferences.h"
+#include "globals.h"
+
+// Seconds since the FIT epoch of the first record
+#define TS0 1000000000
+#define FIT_EPOCH_OFFSET 631065600
+#define N_POSITIONS 6
+
+static void put_u8 ( GByteArray *ba, guint8 val )
+{
+  g_byte_array_append ( ba, &val, 1 );
+}
+
+static void put_u16 ( GByteArray *ba, guint16 val )
+{
+  put_u8 ( ba, val & 0xFF );
+  put_u8 ( ba, val >> 8 );
+}
+
+static void put_u32 ( GByteArray *ba, guint32 val )
+{
+  put_u16 ( ba, val & 0xFFFF );
+  put_u16 ( ba, val >> 16 );
+}
+
+static guint16 crc16 ( const guint8 *data, gsize len )
+{
+  guint16 crc = 0;
+  for ( gsize ii = 0; ii < len; ii++ ) {
+    crc ^= data[ii];
+    for ( guint bit = 0; bit < 8; bit++ )
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+  }
+  return crc;
+}
+
+// Fields are triplets of field number, size and base type
+static void put_definition ( GByteArray *ba, guint8 local, guint16 global, const guint8 *fields, guint n_fields )
+{
+  put_u8 ( ba, 0x40 | local );
+  put_u8 ( ba, 0 ); // Reserved
+  put_u8 ( ba, 0 ); // Little endian
+  put_u16 ( ba, global );
+  put_u8 ( ba, n_fields );
+  g_byte_array_append ( ba, fields, n_fields * 3 );
+}
+
+static gdouble position_lat ( guint ii ) { return 51.0 + ii * 0.001; }
+static gdouble position_lon ( guint ii ) { return -1.5 + ii * 0.001; }
+
+static gint32 to_semicircles ( gdouble degrees )
+{
+  return (gint32)lround ( degrees * 2147483648.0 / 180.0 );
+}
+
+// Timestamp, position, enhanced altitude and heart rate
+static void put_record ( GByteArray *ba, guint ii )
+{
+  put_u8 ( ba, 1 );
+  put_u32 ( ba, TS0 + ii );
+  put_u32 ( ba, to_semicircles ( position_lat(ii) ) );
+  put_u32 ( ba, to_semicircles ( position_lon(ii) ) );
+  put_u32 ( ba, (100 + ii + 500) * 5 );
+  put_u8 ( ba, 120 + ii );
+}
+
+/**
+ * Three records, a timer stop, then two more records,
+ *  a record without a position and finally one position with a compressed timestamp
+ *
+ * @record_end: Set to where each of the full records ends
+ */
+static GByteArray *make_fit ( guint record_end[] )
+{
+  static const guint8 file_id_fields[] = { 0, 1, 0x00 };
+  static const guint8 record_fields[] = { 253, 4, 0x86, 0, 4, 0x85, 1, 4, 0x85, 78, 4, 0x86, 3, 1, 0x02 };
+  static const guint8 event_fields[] = { 0, 1, 0x00, 1, 1, 0x00 };
+  static const guint8 sensor_fields[] = { 253, 4, 0x86, 3, 1, 0x02 };
+  static const guint8 position_fields[] = { 0, 4, 0x85, 1, 4, 0x85 };
+
+  GByteArray *ba = g_byte_array_new ();
+  put_u8 ( ba, 14 );    // Header size
+  put_u8 ( ba, 0x10 );  // Protocol version
+  put_u16 ( ba, 2100 ); // Profile version
+  put_u32 ( ba, 0 );    // Data size, filled in at the end
+  g_byte_array_append ( ba, (const guint8*)".FIT", 4 );
+  put_u16 ( ba, 0 );    // Header CRC, optional
+
+  put_definition ( ba, 0, 0, file_id_fields, 1 );
+  put_u8 ( ba, 0 );
+  put_u8 ( ba, 4 ); // Activity
+
+  put_definition ( ba, 1, 20, record_fields, 5 );
+  for ( guint ii = 0; ii < 3; ii++ ) {
+    put_record ( ba, ii );
+    record_end[ii] = ba->len;
+  }
+
+  put_definition ( ba, 2, 21, event_fields, 2 );
+  put_u8 ( ba, 2 );
+  put_u8 ( ba, 0 ); // Timer
+  put_u8 ( ba, 1 ); // Stop
+
+  for ( guint ii = 3; ii < 5; ii++ ) {
+    put_record ( ba, ii );
+    record_end[ii] = ba->len;
+  }
+
+  put_definition ( ba, 4, 20, sensor_fields, 2 );
+  put_u8 ( ba, 4 );
+  put_u32 ( ba, TS0 + 5 );
+  put_u8 ( ba, 150 );
+
+  put_definition ( ba, 3, 20, position_fields, 2 );
+  put_u8 ( ba, 0x80 | (3 << 5) | ((TS0 + 6) & 0x1F) );
+  put_u32 ( ba, to_semicircles ( position_lat(5) ) );
+  put_u32 ( ba, to_semicircles ( position_lon(5) ) );
+  record_end[5] = ba->len;
+
+  guint32 data_size = ba->len - 14;
+  for ( guint ii = 0; ii < 4; ii++ )
+    ba->data[4+ii] = (data_size >> (8*ii)) & 0xFF;
+  put_u16 ( ba, crc16 ( ba->data, ba->len ) );
+  return ba;
+}
+
+static VikTrack *read_fit ( VikTrwLayer *vtl, const guint8 *data, gsize len, gboolean *read_ok )
+{
+  *read_ok = FALSE;
+  FILE *ff = tmpfile ();
+  if ( !ff )
+    return NULL;
+  if ( fwrite ( data, 1, len, ff ) == len ) {
+    rewind ( ff );
+    *read_ok = a_fit_read_file ( vtl, ff, "Test" );
+  }
+  fclose ( ff );
+
+  GHashTable *tracks = vik_trw_layer_get_tracks ( vtl );
+  if ( g_hash_table_size ( tracks ) != 1 )
+    return NULL;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, tracks );
+  g_hash_table_iter_next ( &iter, &key, &value );
+  return VIK_TRACK(value);
+}
+
+static gboolean check_trackpoints ( VikTrack *trk, guint expected )
+{
+  gboolean ans = TRUE;
+  if ( g_list_length ( trk->trackpoints ) != expected ) {
+    fprintf ( stderr, "%u trackpoints rather than %u\n", g_list_length ( trk->trackpoints ), expected );
+    return FALSE;
+  }
+
+  guint ii = 0;
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next, ii++ ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    struct LatLon ll;
+    vik_coord_to_latlon ( &tp->coord, &ll );
+    if ( fabs ( ll.lat - position_lat(ii) ) > 1e-6 || fabs ( ll.lon - position_lon(ii) ) > 1e-6 ) {
+      fprintf ( stderr, "trackpoint %u: position %f,%f\n", ii, ll.lat, ll.lon );
+      ans = FALSE;
+    }
+    // The last one has its timestamp compressed, after the record without a position
+    gdouble timestamp = TS0 + FIT_EPOCH_OFFSET + ( ii < 5 ? ii : 6 );
+    if ( tp->timestamp != timestamp ) {
+      fprintf ( stderr, "trackpoint %u: timestamp %f\n", ii, tp->timestamp );
+      ans = FALSE;
+    }
+    if ( ii < 5 && ( tp->altitude != 100.0 + ii || tp->heart_rate != 120 + ii ) ) {
+      fprintf ( stderr, "trackpoint %u: altitude %f heart rate %u\n", ii, tp->altitude, tp->heart_rate );
+      ans = FALSE;
+    }
+    if ( ii == 5 && ( !isnan ( tp->altitude ) || tp->heart_rate ) ) {
+      fprintf ( stderr, "trackpoint %u: values from the record without a position\n", ii );
+      ans = FALSE;
+    }
+    // The timer stop starts a new segment
+    if ( tp->newsegment != ( ii == 0 || ii == 3 ) ) {
+      fprintf ( stderr, "trackpoint %u: newsegment %d\n", ii, tp->newsegment );
+      ans = FALSE;
+    }
+  }
+  return ans;
+}
+
+static gboolean check_complete ( GByteArray *ba )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, NULL, FALSE ));
+  gboolean read_ok;
+  VikTrack *trk = read_fit ( vtl, ba->data, ba->len, &read_ok );
+  gboolean ans = read_ok && trk;
+  if ( trk ) {
+    ans = check_trackpoints ( trk, N_POSITIONS ) && ans;
+    if ( g_strcmp0 ( trk->name, "Test" ) || trk->is_route ) {
+      fprintf ( stderr, "track: name %s, is route %d\n", trk->name, trk->is_route );
+      ans = FALSE;
+    }
+  }
+  if ( !ans )
+    fprintf ( stderr, "complete file: read failed\n" );
+  g_object_unref ( vtl );
+  return ans;
+}
+
+// Cut off part way through the third record, as a recording that was not finished properly
+static gboolean check_truncated ( GByteArray *ba, const guint record_end[] )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, NULL, FALSE ));
+  gboolean read_ok;
+  VikTrack *trk = read_fit ( vtl, ba->data, record_end[1] + 5, &read_ok );
+  gboolean ans = read_ok && trk && check_trackpoints ( trk, 2 );
+  if ( !ans )
+    fprintf ( stderr, "truncated file: earlier trackpoints not read\n" );
+  g_object_unref ( vtl );
+  return ans;
+}
+
+static gboolean check_header ( GByteArray *ba )
+{
+  const gchar gpx[] = "<?xml version=\"1.0\"?><gpx>";
+  return a_fit_check_header ( ba->data, ba->len ) &&
+    !a_fit_check_header ( ba->data, FIT_HEADER_MIN_SIZE - 1 ) &&
+    !a_fit_check_header ( (const guint8*)gpx, strlen(gpx) );
+}
+
+int main ( int argc, char *argv[] )
+{
+  // Some stuff must be initialized as it gets auto used
+  a_settings_init ();
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_layer_defaults_init ();
+
+  guint record_end[N_POSITIONS];
+  GByteArray *ba = make_fit ( record_end );
+  gboolean ans = check_header ( ba );
+  if ( !ans )
+    fprintf ( stderr, "header: not detected\n" );
+  ans = check_complete ( ba ) && ans;
+  ans = check_truncated ( ba, record_end ) && ans;
+  g_byte_array_unref ( ba );
+
+  vik_trwlayer_uninit ();
+
+  a_layer_defaults_uninit ();
+  a_preferences_uninit ();
+  a_settings_uninit ();
+  return ans ? 0 : 1;
+}
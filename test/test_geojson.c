@@ -0,0 +1,225 @@
+// Write waypoints, a track of two segments and a route as GeoJSON, read that back in,
+//  then check the items are as they were and writing them again gives the same GeoJSON
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "geojson.h"
+#include "viklayer.h"
+#include "viklayer_defaults.h"
+#include "settings.h"
+#include "preferences.h"
+#include "globals.h"
+
+#define TRACK_TIME 1500000100
+#define TRACK_POINTS 5
+// Index of the trackpoint starting the second segment
+#define TRACK_SEGMENT 3
+// Index of the trackpoint without an altitude
+#define TRACK_NO_ALT 1
+
+static void set_position ( VikCoord *coord, gdouble lat, gdouble lon )
+{
+  struct LatLon ll = { lat, lon };
+  vik_coord_load_from_latlon ( coord, VIK_COORD_LATLON, &ll );
+}
+
+static gboolean position_equal ( const VikCoord *coord, gdouble lat, gdouble lon )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( coord, &ll );
+  return fabs ( ll.lat - lat ) < 1e-9 && fabs ( ll.lon - lon ) < 1e-9;
+}
+
+static void make_items ( VikTrwLayer *vtl )
+{
+  VikWaypoint *wp = vik_waypoint_new ();
+  set_position ( &wp->coord, 52.5, -0.25 );
+  wp->altitude = 12.5;
+  wp->timestamp = 1500000000;
+  vik_waypoint_set_comment ( wp, "A \"quoted\"\tcomment\non two lines" );
+  vik_waypoint_set_description ( wp, "Caf\xc3\xa9" );
+  vik_waypoint_set_symbol ( wp, "Flag, Blue" );
+  vik_trw_layer_filein_add_waypoint ( vtl, "Alpha", wp );
+
+  wp = vik_waypoint_new ();
+  set_position ( &wp->coord, 52.625, -0.3 );
+  vik_trw_layer_filein_add_waypoint ( vtl, "Beta", wp );
+
+  VikTrack *trk = vik_track_new ();
+  trk->visible = TRUE;
+  vik_track_set_description ( trk, "Out and back" );
+  for ( guint ii = 0; ii < TRACK_POINTS; ii++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    set_position ( &tp->coord, 52.5 + ii * 0.0125, -0.25 - ii * 0.0025 );
+    tp->timestamp = TRACK_TIME + 10 * ii;
+    tp->altitude = ( ii == TRACK_NO_ALT ) ? NAN : 30.0 + ii;
+    tp->newsegment = ( ii == 0 || ii == TRACK_SEGMENT );
+    trk->trackpoints = g_list_append ( trk->trackpoints, tp );
+  }
+  vik_trw_layer_filein_add_track ( vtl, "Walk", trk );
+
+  trk = vik_track_new ();
+  trk->visible = TRUE;
+  trk->is_route = TRUE;
+  for ( guint ii = 0; ii < 3; ii++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    set_position ( &tp->coord, 51.0 - ii * 0.5, 0.5 * ii );
+    trk->trackpoints = g_list_append ( trk->trackpoints, tp );
+  }
+  vik_trw_layer_filein_add_track ( vtl, "Way", trk );
+}
+
+static gchar *layer_to_geojson ( VikTrwLayer *vtl )
+{
+  FILE *ff = tmpfile ();
+  if ( !ff )
+    return NULL;
+  a_geojson_write_file ( vtl, ff );
+  long len = ftell ( ff );
+  rewind ( ff );
+  gchar *str = g_malloc0 ( len + 1 );
+  if ( fread ( str, 1, len, ff ) != (size_t)len ) {
+    g_free ( str );
+    str = NULL;
+  }
+  fclose ( ff );
+  return str;
+}
+
+static gboolean layer_from_geojson ( VikTrwLayer *vtl, const gchar *str )
+{
+  FILE *ff = tmpfile ();
+  if ( !ff )
+    return FALSE;
+  gboolean ans = FALSE;
+  if ( fwrite ( str, 1, strlen(str), ff ) == strlen(str) ) {
+    rewind ( ff );
+    ans = a_geojson_read_file ( vtl, ff );
+  }
+  fclose ( ff );
+  return ans;
+}
+
+static gboolean waypoint_name_equal ( gpointer key, gpointer value, gpointer name )
+{
+  return g_strcmp0 ( VIK_WAYPOINT(value)->name, name ) == 0;
+}
+
+static gboolean track_name_equal ( gpointer key, gpointer value, gpointer name )
+{
+  return g_strcmp0 ( VIK_TRACK(value)->name, name ) == 0;
+}
+
+static gboolean check_waypoints ( VikTrwLayer *vtl )
+{
+  GHashTable *waypoints = vik_trw_layer_get_waypoints ( vtl );
+  VikWaypoint *alpha = g_hash_table_find ( waypoints, waypoint_name_equal, "Alpha" );
+  VikWaypoint *beta = g_hash_table_find ( waypoints, waypoint_name_equal, "Beta" );
+  if ( g_hash_table_size ( waypoints ) != 2 || !alpha || !beta ) {
+    fprintf ( stderr, "waypoints: %u read\n", g_hash_table_size ( waypoints ) );
+    return FALSE;
+  }
+
+  gboolean ans = TRUE;
+  if ( !position_equal ( &alpha->coord, 52.5, -0.25 ) || alpha->altitude != 12.5 || alpha->timestamp != 1500000000 ) {
+    fprintf ( stderr, "waypoint Alpha: position, altitude %f or time %f differs\n", alpha->altitude, alpha->timestamp );
+    ans = FALSE;
+  }
+  if ( g_strcmp0 ( alpha->comment, "A \"quoted\"\tcomment\non two lines" ) ||
+       g_strcmp0 ( alpha->description, "Caf\xc3\xa9" ) ||
+       g_strcmp0 ( alpha->symbol, "Flag, Blue" ) ) {
+    fprintf ( stderr, "waypoint Alpha: '%s' '%s' '%s'\n", alpha->comment, alpha->description, alpha->symbol );
+    ans = FALSE;
+  }
+  if ( !position_equal ( &beta->coord, 52.625, -0.3 ) || !isnan ( beta->altitude ) || !isnan ( beta->timestamp ) ) {
+    fprintf ( stderr, "waypoint Beta: position, altitude or time differs\n" );
+    ans = FALSE;
+  }
+  return ans;
+}
+
+static gboolean check_track ( VikTrwLayer *vtl )
+{
+  GHashTable *tracks = vik_trw_layer_get_tracks ( vtl );
+  VikTrack *trk = g_hash_table_find ( tracks, track_name_equal, "Walk" );
+  if ( g_hash_table_size ( tracks ) != 1 || !trk ) {
+    fprintf ( stderr, "tracks: %u read\n", g_hash_table_size ( tracks ) );
+    return FALSE;
+  }
+  if ( trk->is_route || g_strcmp0 ( trk->description, "Out and back" ) ||
+       g_list_length ( trk->trackpoints ) != TRACK_POINTS ) {
+    fprintf ( stderr, "track: '%s' of %u trackpoints\n", trk->description, g_list_length ( trk->trackpoints ) );
+    return FALSE;
+  }
+
+  gboolean ans = TRUE;
+  guint ii = 0;
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next, ii++ ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    gboolean alt_ok = ( ii == TRACK_NO_ALT ) ? isnan ( tp->altitude ) : tp->altitude == 30.0 + ii;
+    if ( !position_equal ( &tp->coord, 52.5 + ii * 0.0125, -0.25 - ii * 0.0025 ) || !alt_ok ||
+         tp->timestamp != TRACK_TIME + 10 * ii || tp->newsegment != ( ii == 0 || ii == TRACK_SEGMENT ) ) {
+      fprintf ( stderr, "trackpoint %u: altitude %f time %f newsegment %d\n", ii, tp->altitude, tp->timestamp, tp->newsegment );
+      ans = FALSE;
+    }
+  }
+  return ans;
+}
+
+static gboolean check_route ( VikTrwLayer *vtl )
+{
+  GHashTable *routes = vik_trw_layer_get_routes ( vtl );
+  VikTrack *trk = g_hash_table_find ( routes, track_name_equal, "Way" );
+  if ( g_hash_table_size ( routes ) != 1 || !trk || !trk->is_route || g_list_length ( trk->trackpoints ) != 3 ) {
+    fprintf ( stderr, "route: not read as written\n" );
+    return FALSE;
+  }
+  gboolean ans = TRUE;
+  guint ii = 0;
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next, ii++ ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    if ( !position_equal ( &tp->coord, 51.0 - ii * 0.5, 0.5 * ii ) || !isnan ( tp->timestamp ) || !isnan ( tp->altitude ) ) {
+      fprintf ( stderr, "routepoint %u: differs\n", ii );
+      ans = FALSE;
+    }
+  }
+  return ans;
+}
+
+int main ( int argc, char *argv[] )
+{
+  // Some stuff must be initialized as it gets auto used
+  a_settings_init ();
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_layer_defaults_init ();
+
+  VikTrwLayer *vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, NULL, FALSE ));
+  make_items ( vtl );
+  gchar *written = layer_to_geojson ( vtl );
+  g_object_unref ( vtl );
+
+  vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, NULL, FALSE ));
+  gboolean ans = written && layer_from_geojson ( vtl, written );
+  if ( !ans )
+    fprintf ( stderr, "GeoJSON not read\n" );
+  ans = check_waypoints ( vtl ) && ans;
+  ans = check_track ( vtl ) && ans;
+  ans = check_route ( vtl ) && ans;
+
+  gchar *rewritten = layer_to_geojson ( vtl );
+  if ( g_strcmp0 ( written, rewritten ) ) {
+    fprintf ( stderr, "GeoJSON differs when written again:\n%s\n%s\n", written, rewritten );
+    ans = FALSE;
+  }
+  g_free ( written );
+  g_free ( rewritten );
+  g_object_unref ( vtl );
+
+  vik_trwlayer_uninit ();
+
+  a_layer_defaults_uninit ();
+  a_preferences_uninit ();
+  a_settings_uninit ();
+  return ans ? 0 : 1;
+}
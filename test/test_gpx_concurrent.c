@@ -0,0 +1,107 @@
+// Read each of the given GPX files many times over at once in different threads,
+//  checking every result writes out the same as a single read of that file
+#include <stdio.h>
+#include <glib/gstdio.h>
+#include "gpx.h"
+#include "viklayer.h"
+#include "viklayer_defaults.h"
+#include "settings.h"
+#include "preferences.h"
+#include "globals.h"
+
+#define READS_PER_FILE 16
+
+typedef struct {
+  const gchar *filename;
+  VikTrwLayer *vtl;
+  gboolean read_ok;
+} ReadJob;
+
+static gboolean read_file ( const gchar *filename, VikTrwLayer *vtl )
+{
+  FILE *ff = g_fopen ( filename, "r" );
+  if ( !ff )
+    return FALSE;
+  gboolean ans = a_gpx_read_file ( vtl, ff, NULL, FALSE );
+  fclose ( ff );
+  return ans;
+}
+
+static void read_thread ( ReadJob *job, gpointer user_data )
+{
+  job->read_ok = read_file ( job->filename, job->vtl );
+}
+
+static gchar *layer_to_gpx ( VikTrwLayer *vtl )
+{
+  FILE *ff = tmpfile ();
+  if ( !ff )
+    return NULL;
+  a_gpx_write_file ( vtl, ff, NULL, NULL );
+  long len = ftell ( ff );
+  rewind ( ff );
+  gchar *str = g_malloc0 ( len + 1 );
+  if ( fread ( str, 1, len, ff ) != (size_t)len ) {
+    g_free ( str );
+    str = NULL;
+  }
+  fclose ( ff );
+  return str;
+}
+
+int main(int argc, char *argv[])
+{
+  int ans = 0;
+
+  // Some stuff must be initialized as it gets auto used
+  a_settings_init ();
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_layer_defaults_init ();
+
+  const guint n_files = argc - 1;
+  gchar **expected = g_new0 ( gchar*, n_files );
+  for ( guint ff = 0; ff < n_files; ff++ ) {
+    VikTrwLayer *vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, NULL, FALSE ));
+    if ( !read_file ( argv[ff+1], vtl ) ) {
+      fprintf ( stderr, "Could not read %s\n", argv[ff+1] );
+      ans = 1;
+    }
+    expected[ff] = layer_to_gpx ( vtl );
+    g_object_unref ( vtl );
+  }
+
+  // Interleave the files so different ones are read at the same time
+  const guint n_jobs = n_files * READS_PER_FILE;
+  ReadJob *jobs = g_new0 ( ReadJob, n_jobs );
+  GThreadPool *pool = g_thread_pool_new ( (GFunc)read_thread, NULL, MAX(4, g_get_num_processors()), FALSE, NULL );
+  for ( guint jj = 0; jj < n_jobs; jj++ ) {
+    jobs[jj].filename = argv[(jj % n_files) + 1];
+    jobs[jj].vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, NULL, FALSE ));
+    g_thread_pool_push ( pool, &jobs[jj], NULL );
+  }
+  g_thread_pool_free ( pool, FALSE, TRUE );
+
+  for ( guint jj = 0; jj < n_jobs; jj++ ) {
+    gchar *result = layer_to_gpx ( jobs[jj].vtl );
+    if ( !jobs[jj].read_ok || g_strcmp0 ( result, expected[jj % n_files] ) != 0 ) {
+      fprintf ( stderr, "Concurrent read %d of %s differs\n", jj / n_files, jobs[jj].filename );
+      ans = 1;
+    }
+    g_free ( result );
+    g_object_unref ( jobs[jj].vtl );
+  }
+  g_free ( jobs );
+
+  for ( guint ff = 0; ff < n_files; ff++ )
+    g_free ( expected[ff] );
+  g_free ( expected );
+
+  vik_trwlayer_uninit ();
+
+  a_layer_defaults_uninit ();
+  a_preferences_uninit ();
+  a_settings_uninit ();
+
+  return ans;
+}
@@ -0,0 +1,173 @@
+// Check the map cache's memory limit, eviction order, layer quotas and accounting, and the encoded tier
+#include <stdio.h>
+#include <string.h>
+#include "settings.h"
+#include "preferences.h"
+#include "globals.h"
+#include "mapcache.h"
+
+#define TILE_TYPE 1
+#define TILE_NAME "test"
+
+static GdkPixbuf *tile = NULL;
+static guint32 tile_size = 0;
+
+static void add_tile ( gint x, gint y, guint8 alpha, gconstpointer layer )
+{
+  a_mapcache_add ( tile, (mapcache_extra_t){ 0.0 }, x, y, 0, TILE_TYPE, 13, alpha, 0.0, 0.0, TILE_NAME, layer );
+}
+
+static gboolean has_tile ( gint x, gint y, guint8 alpha )
+{
+  return a_mapcache_contains ( x, y, 0, TILE_TYPE, 13, alpha, 0.0, 0.0, TILE_NAME );
+}
+
+static void set_sizes ( guint size_mb, guint encoded_size_mb )
+{
+  a_preferences_get(VIKING_PREFERENCES_NAMESPACE "mapcache_size")->u = size_mb;
+  a_preferences_get(VIKING_PREFERENCES_NAMESPACE "mapcache_encoded_size")->u = encoded_size_mb;
+  a_mapcache_refresh_preferences ();
+}
+
+// The whole of the configured size is used, however the tiles are spread over the shards
+static gboolean check_size ( void )
+{
+  a_mapcache_flush ();
+  for ( gint xx = 0; xx < 200; xx++ )
+    add_tile ( xx, 0, 255, NULL );
+  gint size = a_mapcache_get_size ();
+  gint max_size = a_mapcache_get_max_size ();
+  if ( size > max_size || size <= max_size - (gint)tile_size ) {
+    fprintf ( stderr, "size: %d bytes used of %d\n", size, max_size );
+    return FALSE;
+  }
+  return TRUE;
+}
+
+// The least recently used tiles are evicted first
+static gboolean check_eviction_order ( void )
+{
+  a_mapcache_flush ();
+  // Variants of one tile (here by alpha) all go in the same shard, so the order is exact
+  const guint capacity = a_mapcache_get_max_size () / tile_size;
+  for ( guint aa = 0; aa < capacity; aa++ )
+    add_tile ( 0, 0, aa, NULL );
+  GdkPixbuf *pixbuf = a_mapcache_get ( 0, 0, 0, TILE_TYPE, 13, 0, 0.0, 0.0, TILE_NAME, NULL );
+  if ( pixbuf )
+    g_object_unref ( pixbuf );
+  for ( guint aa = capacity; aa < capacity + 7; aa++ )
+    add_tile ( 0, 0, aa, NULL );
+
+  gboolean ans = has_tile ( 0, 0, 0 );
+  for ( guint aa = 1; aa < capacity + 7; aa++ )
+    ans = ( has_tile ( 0, 0, aa ) == ( aa > 7 ) ) && ans;
+  if ( !ans )
+    fprintf ( stderr, "eviction order: wrong tiles evicted\n" );
+  return ans;
+}
+
+// A layer's quota is for all its tiles, and they are only accounted to it whilst it exists
+static gboolean check_layer ( void )
+{
+  gboolean ans = TRUE;
+  static gint layer;
+  mapcache_stats_t stats;
+
+  a_mapcache_flush ();
+  a_mapcache_add_layer ( &layer );
+  a_mapcache_set_layer_quota ( &layer, 10 * tile_size );
+  for ( gint xx = 0; xx < 50; xx++ )
+    add_tile ( xx, 1, 255, &layer );
+  a_mapcache_get_stats_layer ( &layer, &stats );
+  if ( stats.count != 10 || stats.bytes != 10 * tile_size || stats.evictions != 40 || !has_tile ( 49, 1, 255 ) ) {
+    fprintf ( stderr, "quota: %u tiles of %" G_GUINT64_FORMAT " bytes, %" G_GUINT64_FORMAT " evictions\n",
+              stats.count, stats.bytes, stats.evictions );
+    ans = FALSE;
+  }
+
+  GdkPixbuf *pixbuf = a_mapcache_get ( 49, 1, 0, TILE_TYPE, 13, 255, 0.0, 0.0, TILE_NAME, &layer );
+  if ( pixbuf )
+    g_object_unref ( pixbuf );
+  a_mapcache_get_stats_layer ( &layer, &stats );
+  if ( stats.hits != 1 ) {
+    fprintf ( stderr, "layer hits: %" G_GUINT64_FORMAT "\n", stats.hits );
+    ans = FALSE;
+  }
+
+  // Late additions and lookups after the layer has gone are not accounted
+  a_mapcache_remove_layer ( &layer );
+  add_tile ( 100, 1, 255, &layer );
+  pixbuf = a_mapcache_get ( 100, 1, 0, TILE_TYPE, 13, 255, 0.0, 0.0, TILE_NAME, &layer );
+  if ( pixbuf )
+    g_object_unref ( pixbuf );
+  a_mapcache_get_stats_layer ( &layer, &stats );
+  if ( !pixbuf || stats.count || stats.bytes || stats.hits ) {
+    fprintf ( stderr, "removed layer: still accounted\n" );
+    ans = FALSE;
+  }
+  // Nor limited by the old quota
+  for ( gint xx = 0; xx < 20; xx++ )
+    add_tile ( xx, 2, 255, &layer );
+  for ( gint xx = 0; xx < 20; xx++ )
+    ans = has_tile ( xx, 2, 255 ) && ans;
+  if ( !ans )
+    fprintf ( stderr, "removed layer: tiles missing\n" );
+  return ans;
+}
+
+static gboolean check_encoded ( void )
+{
+  gboolean ans = TRUE;
+  a_mapcache_flush ();
+  const gchar data[] = "Not really a PNG";
+  GBytes *bytes = g_bytes_new_static ( data, sizeof(data) );
+  a_mapcache_encoded_add ( bytes, 3, 4, 0, TILE_TYPE, 13, TILE_NAME );
+  g_bytes_unref ( bytes );
+
+  GBytes *got = a_mapcache_encoded_get ( 3, 4, 0, TILE_TYPE, 13, TILE_NAME );
+  if ( !got || g_bytes_get_size ( got ) != sizeof(data) || memcmp ( g_bytes_get_data ( got, NULL ), data, sizeof(data) ) ) {
+    fprintf ( stderr, "encoded: data not returned as added\n" );
+    ans = FALSE;
+  }
+  if ( got )
+    g_bytes_unref ( got );
+
+  got = a_mapcache_encoded_get ( 4, 3, 0, TILE_TYPE, 13, TILE_NAME );
+  if ( got ) {
+    fprintf ( stderr, "encoded: found a tile never added\n" );
+    g_bytes_unref ( got );
+    ans = FALSE;
+  }
+
+  a_mapcache_flush ();
+  if ( a_mapcache_encoded_contains ( 3, 4, 0, TILE_TYPE, 13, TILE_NAME ) ) {
+    fprintf ( stderr, "encoded: still there after flushing\n" );
+    ans = FALSE;
+  }
+  return ans;
+}
+
+int main ( int argc, char *argv[] )
+{
+  a_settings_init ();
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_mapcache_init ();
+  set_sizes ( 1, 1 );
+
+  tile = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, TRUE, 8, 64, 64 );
+  gdk_pixbuf_fill ( tile, 0x336699ff );
+  a_mapcache_add ( tile, (mapcache_extra_t){ 0.0 }, 0, 0, 0, TILE_TYPE, 13, 255, 0.0, 0.0, TILE_NAME, NULL );
+  tile_size = a_mapcache_get_size ();
+
+  gboolean ans = check_size ();
+  ans = check_eviction_order () && ans;
+  ans = check_layer () && ans;
+  ans = check_encoded () && ans;
+
+  g_object_unref ( tile );
+  a_mapcache_uninit ();
+  a_preferences_uninit ();
+  a_settings_uninit ();
+  return ans ? 0 : 1;
+}
@@ -62,6 +62,18 @@ int main ( int argc, char *argv[] )
       len = metatile_read(dir, x, y, z, buf, tile_max, &compressed, err_msg);
 
     if (len > 0) {
+        // The mapped version should give the same data
+        int compressed2 = -1;
+        GBytes *bytes = metatile_get(argc > 1 ? argv[1] : dir, x, y, z, &compressed2, err_msg);
+        if (!bytes || g_bytes_get_size(bytes) != (gsize)len || compressed2 != compressed ||
+            memcmp(g_bytes_get_data(bytes, NULL), buf, len)) {
+            fprintf(stderr, "FAILED: metatile_get mismatch %s\n", err_msg);
+            free(buf);
+            return 4;
+        }
+        g_bytes_unref(bytes);
+        metatile_cache_clear();
+
         // Do something with buf
         // Just dump to a file
         FILE *fp;
@@ -0,0 +1,147 @@
+// Decode and draw a small vector tile, made here by hand, both as is and gzip compressed
+#include <stdio.h>
+#include <string.h>
+#include <gio/gio.h>
+#include "mvt.h"
+
+static void put_varint ( GByteArray *ba, guint64 val )
+{
+  do {
+    guint8 byte = val & 0x7f;
+    val >>= 7;
+    if ( val )
+      byte |= 0x80;
+    g_byte_array_append ( ba, &byte, 1 );
+  } while ( val );
+}
+
+static void put_bytes ( GByteArray *ba, guint field, const guint8 *data, gsize len )
+{
+  put_varint ( ba, (field << 3) | 2 );
+  put_varint ( ba, len );
+  g_byte_array_append ( ba, data, len );
+}
+
+static void put_string ( GByteArray *ba, guint field, const gchar *str )
+{
+  put_bytes ( ba, field, (const guint8*)str, strlen(str) );
+}
+
+static void put_packed ( GByteArray *ba, guint field, const guint32 *vals, guint n )
+{
+  GByteArray *packed = g_byte_array_new ();
+  for ( guint ii = 0; ii < n; ii++ )
+    put_varint ( packed, vals[ii] );
+  put_bytes ( ba, field, packed->data, packed->len );
+  g_byte_array_unref ( packed );
+}
+
+// One 'water' layer with a single square covering the whole tile
+static GByteArray *make_tile ( void )
+{
+  // MoveTo (0,0), LineTo (4096,0) (4096,4096) (0,4096), ClosePath - parameters are zigzag encoded
+  const guint32 geometry[] = { 9, 0, 0, 26, 8192, 0, 0, 8192, 8191, 0, 15 };
+  const guint32 tags[] = { 0, 0 };
+
+  GByteArray *feature = g_byte_array_new ();
+  put_packed ( feature, 2, tags, G_N_ELEMENTS(tags) );
+  put_varint ( feature, (3 << 3) | 0 );
+  put_varint ( feature, 3 ); // Polygon
+  put_packed ( feature, 4, geometry, G_N_ELEMENTS(geometry) );
+
+  GByteArray *value = g_byte_array_new ();
+  put_string ( value, 1, "lake" );
+
+  GByteArray *layer = g_byte_array_new ();
+  put_varint ( layer, (15 << 3) | 0 );
+  put_varint ( layer, 2 ); // Version
+  put_string ( layer, 1, "water" );
+  put_bytes ( layer, 2, feature->data, feature->len );
+  put_string ( layer, 3, "class" );
+  put_bytes ( layer, 4, value->data, value->len );
+  put_varint ( layer, (5 << 3) | 0 );
+  put_varint ( layer, 4096 ); // Extent
+
+  GByteArray *tile = g_byte_array_new ();
+  put_bytes ( tile, 3, layer->data, layer->len );
+
+  g_byte_array_unref ( feature );
+  g_byte_array_unref ( value );
+  g_byte_array_unref ( layer );
+  return tile;
+}
+
+static GByteArray *gzip ( GByteArray *ba )
+{
+  GZlibCompressor *compressor = g_zlib_compressor_new ( G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1 );
+  GByteArray *out = g_byte_array_new ();
+  guint8 buf[4096];
+  gsize read, written;
+  GConverterResult res = g_converter_convert ( G_CONVERTER(compressor), ba->data, ba->len, buf, sizeof(buf),
+                                               G_CONVERTER_INPUT_AT_END, &read, &written, NULL );
+  if ( res == G_CONVERTER_FINISHED )
+    g_byte_array_append ( out, buf, written );
+  g_object_unref ( compressor );
+  return out;
+}
+
+static gboolean check_tile ( GByteArray *ba, MvtStyle *style, const gchar *what )
+{
+  GError *error = NULL;
+  MvtTile *tile = a_mvt_tile_decode ( ba->data, ba->len, &error );
+  if ( !tile ) {
+    fprintf ( stderr, "%s: decode failed: %s\n", what, error ? error->message : "unknown" );
+    g_clear_error ( &error );
+    return FALSE;
+  }
+
+  gboolean ans = TRUE;
+  if ( a_mvt_tile_get_n_layers(tile) != 1 || a_mvt_tile_get_n_features(tile, "water") != 1 ) {
+    fprintf ( stderr, "%s: expected one layer with one feature, got %u layers\n", what, a_mvt_tile_get_n_layers(tile) );
+    ans = FALSE;
+  }
+
+  GdkPixbuf *pixbuf = a_mvt_tile_render ( tile, style, 10, 256 );
+  if ( !pixbuf || gdk_pixbuf_get_width(pixbuf) != 256 ) {
+    fprintf ( stderr, "%s: render failed\n", what );
+    ans = FALSE;
+  }
+  else {
+    // The middle should be the default style's water colour
+    guchar *px = gdk_pixbuf_get_pixels ( pixbuf ) + 128 * gdk_pixbuf_get_rowstride(pixbuf) + 128 * gdk_pixbuf_get_n_channels(pixbuf);
+    if ( px[0] != 0xaa || px[1] != 0xd3 || px[2] != 0xdf ) {
+      fprintf ( stderr, "%s: unexpected colour %02x%02x%02x\n", what, px[0], px[1], px[2] );
+      ans = FALSE;
+    }
+  }
+  if ( pixbuf )
+    g_object_unref ( pixbuf );
+  a_mvt_tile_unref ( tile );
+  return ans;
+}
+
+int main ( int argc, char *argv[] )
+{
+  MvtStyle *style = a_mvt_style_new_default ();
+  GByteArray *plain = make_tile ();
+  GByteArray *compressed = gzip ( plain );
+
+  gboolean ans = check_tile ( plain, style, "plain" );
+  ans = check_tile ( compressed, style, "gzip" ) && ans;
+
+  // Truncated data should be an error, not a crash
+  GError *error = NULL;
+  MvtTile *bad = a_mvt_tile_decode ( plain->data, plain->len - 5, &error );
+  if ( bad || !error ) {
+    fprintf ( stderr, "truncated tile was not rejected\n" );
+    ans = FALSE;
+  }
+  if ( bad )
+    a_mvt_tile_unref ( bad );
+  g_clear_error ( &error );
+
+  g_byte_array_unref ( plain );
+  g_byte_array_unref ( compressed );
+  a_mvt_style_free ( style );
+  return ans ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+// Build a place index from a few lines in the geonames.org dump format and search it
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <glib/gstdio.h>
+#include "placeindex.h"
+
+// geonameid, name, asciiname, alternatenames, latitude, longitude, feature class, feature code,
+//  country code, cc2, admin1-4, population, ...
+static const gchar *geonames =
+  "2657896\tZürich\tZurich\t\t47.36667\t8.55\tP\tPPLA\tCH\t\t25\t\t\t\t341730\t\t\t\tEurope/Zurich\t2020-01-01\n"
+  "2658972\tZug\tZug\t\t47.17242\t8.51745\tP\tPPLA\tCH\t\t09\t\t\t\t23435\t\t\t\tEurope/Zurich\t2020-01-01\n"
+  "2950159\tBerlin\tBerlin\t\t52.52437\t13.41053\tP\tPPLC\tDE\t\t16\t\t\t\t3426354\t\t\t\tEurope/Berlin\t2020-01-01\n"
+  "5083330\tBerlin\tBerlin\t\t44.46867\t-71.18508\tP\tPPL\tUS\t\tNH\t\t\t\t10051\t\t\t\tAmerica/New_York\t2020-01-01\n"
+  "2867714\tMünchen\tMunchen\t\t48.13743\t11.57549\tP\tPPLA\tDE\t\t02\t\t\t\t1260391\t\t\t\tEurope/Berlin\t2020-01-01\n"
+  "2950158\tNeu-Berlin\tNeu-Berlin\t\t52.6\t13.3\tP\tPPL\tDE\t\t16\t\t\t\t99999999\t\t\t\tEurope/Berlin\t2020-01-01\n"
+  "broken line\n";
+
+typedef struct {
+  GPtrArray *names;
+  GArray *lls;
+} ResultsT;
+
+static void add_result ( const gchar *name, const struct LatLon *ll, gpointer user_data )
+{
+  ResultsT *res = user_data;
+  g_ptr_array_add ( res->names, g_strdup ( name ) );
+  g_array_append_val ( res->lls, *ll );
+}
+
+/**
+ * Check the names found, in order
+ */
+static gboolean check_search ( PlaceIndex *pi, const gchar *query, guint max, const gchar **expected, guint n_expected )
+{
+  ResultsT res;
+  res.names = g_ptr_array_new_with_free_func ( g_free );
+  res.lls = g_array_new ( FALSE, FALSE, sizeof(struct LatLon) );
+  guint found = a_place_index_search ( pi, query, max, add_result, &res );
+  gboolean ans = found == n_expected && res.names->len == n_expected;
+  for ( guint ii = 0; ans && ii < n_expected; ii++ )
+    ans = g_strcmp0 ( g_ptr_array_index ( res.names, ii ), expected[ii] ) == 0;
+  if ( !ans ) {
+    fprintf ( stderr, "search '%s' gave %u:", query, found );
+    for ( guint ii = 0; ii < res.names->len; ii++ )
+      fprintf ( stderr, " '%s'", (gchar*)g_ptr_array_index ( res.names, ii ) );
+    fprintf ( stderr, "\n" );
+  }
+  g_ptr_array_free ( res.names, TRUE );
+  g_array_free ( res.lls, TRUE );
+  return ans;
+}
+
+static gboolean check_normalize ( const gchar *str, const gchar *expected )
+{
+  gchar *norm = a_place_index_normalize ( str );
+  gboolean ans = strcmp ( norm, expected ) == 0;
+  if ( !ans )
+    fprintf ( stderr, "normalize '%s' gave '%s', expected '%s'\n", str, norm, expected );
+  g_free ( norm );
+  return ans;
+}
+
+int main ( int argc, char *argv[] )
+{
+  gboolean ans = TRUE;
+  ans = check_normalize ( "  Saint-Étienne du Rouvray ", "saint etienne du rouvray" ) && ans;
+  ans = check_normalize ( "ZÜRICH", "zurich" ) && ans;
+  ans = check_normalize ( "--", "" ) && ans;
+  ans = a_place_index_name_matches ( "saint etienne du rouvray", "etienne d" ) && ans;
+  ans = !a_place_index_name_matches ( "saint etienne du rouvray", "tienne" ) && ans;
+
+  gchar *geonames_file = g_build_filename ( g_get_tmp_dir(), "test_placeindex.txt", NULL );
+  gchar *index_file = g_build_filename ( g_get_tmp_dir(), "test_placeindex.places", NULL );
+  ans = g_file_set_contents ( geonames_file, geonames, -1, NULL ) && ans;
+
+  GError *error = NULL;
+  if ( !a_place_index_build ( geonames_file, index_file, &error ) ) {
+    fprintf ( stderr, "build failed: %s\n", error ? error->message : "unknown" );
+    g_clear_error ( &error );
+    ans = FALSE;
+  }
+
+  PlaceIndex *pi = a_place_index_open ( index_file, &error );
+  if ( !pi ) {
+    fprintf ( stderr, "open failed: %s\n", error ? error->message : "unknown" );
+    g_clear_error ( &error );
+    ans = FALSE;
+  }
+  else {
+    if ( a_place_index_get_size ( pi ) != 6 ) {
+      fprintf ( stderr, "index has %u places\n", a_place_index_get_size ( pi ) );
+      ans = FALSE;
+    }
+    // Accents and case don't matter; most populous first
+    const gchar *zu[] = { "Zürich, CH", "Zug, CH" };
+    ans = check_search ( pi, "zu", 10, zu, 2 ) && ans;
+    ans = check_search ( pi, "Zü", 1, zu, 1 ) && ans;
+    // The start of a name before a later word in a name, even if more populous
+    const gchar *berlin[] = { "Berlin, DE", "Berlin, US", "Neu-Berlin, DE" };
+    ans = check_search ( pi, "berl", 10, berlin, 3 ) && ans;
+    const gchar *munchen[] = { "München, DE" };
+    ans = check_search ( pi, "munchen", 10, munchen, 1 ) && ans;
+    ans = check_search ( pi, "erlin", 10, NULL, 0 ) && ans;
+    ans = check_search ( pi, "", 10, NULL, 0 ) && ans;
+    ans = check_search ( pi, "zzz", 10, NULL, 0 ) && ans;
+  }
+  a_place_index_free ( pi );
+
+  // Not an index
+  PlaceIndex *bad = a_place_index_open ( geonames_file, &error );
+  if ( bad || !error ) {
+    fprintf ( stderr, "invalid index was not rejected\n" );
+    ans = FALSE;
+  }
+  a_place_index_free ( bad );
+  g_clear_error ( &error );
+
+  (void)g_remove ( geonames_file );
+  (void)g_remove ( index_file );
+  g_free ( geonames_file );
+  g_free ( index_file );
+  return ans ? 0 : 1;
+}
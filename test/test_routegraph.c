@@ -0,0 +1,284 @@
+// Build a route graph from a small OpenStreetMap PBF file, made here by hand, and find routes over it
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include "routegraph.h"
+
+static void put_varint ( GByteArray *ba, guint64 val )
+{
+  do {
+    guint8 byte = val & 0x7f;
+    val >>= 7;
+    if ( val )
+      byte |= 0x80;
+    g_byte_array_append ( ba, &byte, 1 );
+  } while ( val );
+}
+
+static void put_key ( GByteArray *ba, guint field, guint wire )
+{
+  put_varint ( ba, (field << 3) | wire );
+}
+
+static void put_bytes ( GByteArray *ba, guint field, const guint8 *data, gsize len )
+{
+  put_key ( ba, field, 2 );
+  put_varint ( ba, len );
+  g_byte_array_append ( ba, data, len );
+}
+
+static void put_string ( GByteArray *ba, guint field, const gchar *str )
+{
+  put_bytes ( ba, field, (const guint8*)str, strlen(str) );
+}
+
+static void put_sint ( GByteArray *ba, gint64 val )
+{
+  put_varint ( ba, ((guint64)val << 1) ^ (guint64)(val >> 63) );
+}
+
+// Delta coded, as the ids and coordinates in PBF files are
+static void put_packed_deltas ( GByteArray *ba, guint field, const gint64 *vals, guint n )
+{
+  GByteArray *packed = g_byte_array_new ();
+  for ( guint ii = 0; ii < n; ii++ )
+    put_sint ( packed, vals[ii] - (ii ? vals[ii-1] : 0) );
+  put_bytes ( ba, field, packed->data, packed->len );
+  g_byte_array_unref ( packed );
+}
+
+static void put_packed ( GByteArray *ba, guint field, const guint32 *vals, guint n )
+{
+  GByteArray *packed = g_byte_array_new ();
+  for ( guint ii = 0; ii < n; ii++ )
+    put_varint ( packed, vals[ii] );
+  put_bytes ( ba, field, packed->data, packed->len );
+  g_byte_array_unref ( packed );
+}
+
+static void put_block ( GByteArray *file, const gchar *type, GByteArray *data, gboolean compress )
+{
+  GByteArray *blob = g_byte_array_new ();
+  if ( compress ) {
+    GZlibCompressor *compressor = g_zlib_compressor_new ( G_ZLIB_COMPRESSOR_FORMAT_ZLIB, -1 );
+    guint8 buf[4096];
+    gsize read, written;
+    GConverterResult res = g_converter_convert ( G_CONVERTER(compressor), data->data, data->len, buf, sizeof(buf),
+                                                 G_CONVERTER_INPUT_AT_END, &read, &written, NULL );
+    put_key ( blob, 2, 0 );
+    put_varint ( blob, data->len );
+    if ( res == G_CONVERTER_FINISHED )
+      put_bytes ( blob, 3, buf, written );
+    g_object_unref ( compressor );
+  }
+  else
+    put_bytes ( blob, 1, data->data, data->len );
+
+  GByteArray *header = g_byte_array_new ();
+  put_string ( header, 1, type );
+  put_key ( header, 3, 0 );
+  put_varint ( header, blob->len );
+
+  guint8 len[4] = { header->len >> 24, header->len >> 16, header->len >> 8, header->len };
+  g_byte_array_append ( file, len, 4 );
+  g_byte_array_append ( file, header->data, header->len );
+  g_byte_array_append ( file, blob->data, blob->len );
+  g_byte_array_unref ( header );
+  g_byte_array_unref ( blob );
+}
+
+/*
+ * Roads in a 0.01 degree grid:
+ *
+ *   4 ---- 5 ---- 6
+ *   |      ^      |
+ *   |      |      7
+ *   |      |      |
+ *   1 ---- 2 ---- 3
+ *
+ * 1-4 is a footway and 5-2 is one way southwards; node 7 is just part of the shape of 3-6
+ */
+static const gint64 node_ids[] = { 1, 2, 3, 4, 5, 6, 7 };
+static const gint64 node_lats[] = { 510000000, 510000000, 510000000, 510100000, 510100000, 510100000, 510050000 };
+static const gint64 node_lons[] = { 0, 100000, 200000, 0, 100000, 200000, 200000 };
+
+static const gchar *strings[] = { "", "highway", "residential", "footway", "primary", "oneway", "yes" };
+
+typedef struct {
+  gint64 refs[3];
+  guint n_refs;
+  guint32 keys[2];
+  guint32 vals[2];
+  guint n_tags;
+} TestWayT;
+
+static const TestWayT ways[] = {
+  { { 1, 2, 3 }, 3, { 1 }, { 2 }, 1 },
+  { { 4, 5, 6 }, 3, { 1 }, { 2 }, 1 },
+  { { 3, 7, 6 }, 3, { 1 }, { 2 }, 1 },
+  { { 1, 4 }, 2, { 1 }, { 3 }, 1 },
+  { { 5, 2 }, 2, { 1, 5 }, { 4, 6 }, 2 },
+};
+
+static GByteArray *make_pbf ( void )
+{
+  GByteArray *file = g_byte_array_new ();
+
+  GByteArray *header = g_byte_array_new ();
+  put_string ( header, 4, "OsmSchema-V0.6" );
+  put_string ( header, 4, "DenseNodes" );
+  put_block ( file, "OSMHeader", header, FALSE );
+  g_byte_array_unref ( header );
+
+  GByteArray *table = g_byte_array_new ();
+  for ( guint ii = 0; ii < G_N_ELEMENTS(strings); ii++ )
+    put_string ( table, 1, strings[ii] );
+
+  GByteArray *dense = g_byte_array_new ();
+  put_packed_deltas ( dense, 1, node_ids, G_N_ELEMENTS(node_ids) );
+  put_packed_deltas ( dense, 8, node_lats, G_N_ELEMENTS(node_lats) );
+  put_packed_deltas ( dense, 9, node_lons, G_N_ELEMENTS(node_lons) );
+  GByteArray *nodes = g_byte_array_new ();
+  put_bytes ( nodes, 2, dense->data, dense->len );
+
+  GByteArray *way_group = g_byte_array_new ();
+  for ( guint ii = 0; ii < G_N_ELEMENTS(ways); ii++ ) {
+    GByteArray *way = g_byte_array_new ();
+    put_key ( way, 1, 0 );
+    put_varint ( way, 100 + ii );
+    put_packed ( way, 2, ways[ii].keys, ways[ii].n_tags );
+    put_packed ( way, 3, ways[ii].vals, ways[ii].n_tags );
+    put_packed_deltas ( way, 8, ways[ii].refs, ways[ii].n_refs );
+    put_bytes ( way_group, 3, way->data, way->len );
+    g_byte_array_unref ( way );
+  }
+
+  GByteArray *block = g_byte_array_new ();
+  put_bytes ( block, 1, table->data, table->len );
+  put_bytes ( block, 2, nodes->data, nodes->len );
+  put_bytes ( block, 2, way_group->data, way_group->len );
+  put_block ( file, "OSMData", block, TRUE );
+
+  g_byte_array_unref ( table );
+  g_byte_array_unref ( dense );
+  g_byte_array_unref ( nodes );
+  g_byte_array_unref ( way_group );
+  g_byte_array_unref ( block );
+  return file;
+}
+
+static gdouble route_length ( GArray *points )
+{
+  gdouble length = 0.0;
+  for ( guint ii = 1; ii < points->len; ii++ )
+    length += a_coords_latlon_diff ( &g_array_index(points, struct LatLon, ii-1), &g_array_index(points, struct LatLon, ii) );
+  return length;
+}
+
+static gboolean passes ( GArray *points, gdouble lat, gdouble lon )
+{
+  for ( guint ii = 0; ii < points->len; ii++ ) {
+    struct LatLon *ll = &g_array_index ( points, struct LatLon, ii );
+    if ( fabs(ll->lat - lat) < 1e-6 && fabs(ll->lon - lon) < 1e-6 )
+      return TRUE;
+  }
+  return FALSE;
+}
+
+/**
+ * Check the route is about the expected length and passes through (or avoids) the given node
+ */
+static gboolean check_route ( RouteGraph *rg, const gchar *what, struct LatLon start, struct LatLon end,
+                              gdouble expected, gint node, gboolean via )
+{
+  GError *error = NULL;
+  GArray *points = a_route_graph_find ( rg, &start, &end, &error );
+  if ( !points ) {
+    fprintf ( stderr, "%s: no route: %s\n", what, error ? error->message : "unknown" );
+    g_clear_error ( &error );
+    return FALSE;
+  }
+  gboolean ans = TRUE;
+  gdouble length = route_length ( points );
+  if ( fabs(length - expected) > 20.0 ) {
+    fprintf ( stderr, "%s: length %.0fm, expected %.0fm\n", what, length, expected );
+    ans = FALSE;
+  }
+  if ( passes ( points, node_lats[node-1] / 1e7, node_lons[node-1] / 1e7 ) != via ) {
+    fprintf ( stderr, "%s: route %s node %d\n", what, via ? "misses" : "goes through", node );
+    ans = FALSE;
+  }
+  g_array_free ( points, TRUE );
+  return ans;
+}
+
+int main ( int argc, char *argv[] )
+{
+  gchar *pbf_file = g_build_filename ( g_get_tmp_dir(), "test_routegraph.osm.pbf", NULL );
+  gchar *car_file = g_build_filename ( g_get_tmp_dir(), "test_routegraph_car.graph", NULL );
+  gchar *foot_file = g_build_filename ( g_get_tmp_dir(), "test_routegraph_foot.graph", NULL );
+  GByteArray *pbf = make_pbf ();
+  gboolean ans = g_file_set_contents ( pbf_file, (const gchar*)pbf->data, pbf->len, NULL );
+  g_byte_array_unref ( pbf );
+
+  GError *error = NULL;
+  if ( !a_route_graph_build ( pbf_file, car_file, ROUTE_GRAPH_CAR, &error ) ||
+       !a_route_graph_build ( pbf_file, foot_file, ROUTE_GRAPH_FOOT, &error ) ) {
+    fprintf ( stderr, "build failed: %s\n", error ? error->message : "unknown" );
+    g_clear_error ( &error );
+    ans = FALSE;
+  }
+
+  RouteGraph *car = a_route_graph_open ( car_file, &error );
+  RouteGraph *foot = a_route_graph_open ( foot_file, &error );
+  if ( !car || !foot ) {
+    fprintf ( stderr, "open failed: %s\n", error ? error->message : "unknown" );
+    g_clear_error ( &error );
+    ans = FALSE;
+  }
+  else {
+    // Metres between neighbouring nodes
+    const gdouble ew = 700.6, ns = 1113.2;
+    struct LatLon near1 = { 51.0, 0.0005 };
+    struct LatLon near4 = { 51.01, 0.0005 };
+    // The car can neither use the footway nor go north on the one way road
+    ans = check_route ( car, "car north", near1, near4, 1.95*ew + ns + 1.95*ew, 7, TRUE ) && ans;
+    ans = check_route ( car, "car south", near4, near1, 0.95*ew + ns + 0.95*ew, 2, TRUE ) && ans;
+    ans = check_route ( foot, "foot north", near1, near4, 0.05*ew + ns + 0.05*ew, 2, FALSE ) && ans;
+    // Both ends on the same road
+    struct LatLon along1 = { 51.0001, 0.002 };
+    struct LatLon along2 = { 50.9999, 0.006 };
+    ans = check_route ( car, "same road", along1, along2, 0.4*ew, 2, FALSE ) && ans;
+
+    struct LatLon far = { 52.0, 1.0 };
+    GArray *points = a_route_graph_find ( car, &far, &near1, &error );
+    if ( points || !g_error_matches ( error, ROUTE_GRAPH_ERROR, ROUTE_GRAPH_ERROR_NO_ROAD ) ) {
+      fprintf ( stderr, "route from nowhere was not rejected\n" );
+      ans = FALSE;
+    }
+    if ( points )
+      g_array_free ( points, TRUE );
+    g_clear_error ( &error );
+  }
+  a_route_graph_free ( car );
+  a_route_graph_free ( foot );
+
+  // Not a graph
+  RouteGraph *bad = a_route_graph_open ( pbf_file, &error );
+  if ( bad || !error ) {
+    fprintf ( stderr, "invalid graph was not rejected\n" );
+    ans = FALSE;
+  }
+  a_route_graph_free ( bad );
+  g_clear_error ( &error );
+
+  (void)g_remove ( pbf_file );
+  (void)g_remove ( car_file );
+  (void)g_remove ( foot_file );
+  g_free ( pbf_file );
+  g_free ( car_file );
+  g_free ( foot_file );
+  return ans ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+// Allocate and free many trackpoints, checking they are all distinct and initialized,
+//  that freeing some leaves the others intact, the freed ones are reused,
+//  and that several threads can allocate and free at once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "viktrack.h"
+
+// Spanning several of the blocks trackpoints are allocated from, with a partly used one at the end
+#define N_TRACKPOINTS (3 * 1024 + 7)
+#define N_THREADS 8
+#define N_PER_THREAD 5000
+
+static gboolean is_initialized ( VikTrackpoint *tp )
+{
+  return isnan ( tp->timestamp ) && isnan ( tp->altitude ) && isnan ( tp->speed ) &&
+    tp->cadence == VIK_TRKPT_CADENCE_NONE && tp->power == VIK_TRKPT_POWER_NONE &&
+    !tp->newsegment && !tp->heart_rate && !tp->name && !tp->extensions;
+}
+
+static gint pointer_compare ( gconstpointer a, gconstpointer b )
+{
+  guintptr pa = (guintptr)*(VikTrackpoint* const*)a;
+  guintptr pb = (guintptr)*(VikTrackpoint* const*)b;
+  return pa < pb ? -1 : pa > pb;
+}
+
+static gboolean check_distinct ( VikTrackpoint **tps, guint n )
+{
+  VikTrackpoint **sorted = g_new ( VikTrackpoint*, n );
+  memcpy ( sorted, tps, n * sizeof(VikTrackpoint*) );
+  qsort ( sorted, n, sizeof(VikTrackpoint*), pointer_compare );
+  gboolean ans = TRUE;
+  for ( guint ii = 1; ii < n; ii++ )
+    if ( (guintptr)sorted[ii] - (guintptr)sorted[ii-1] < sizeof(VikTrackpoint) )
+      ans = FALSE;
+  g_free ( sorted );
+  return ans;
+}
+
+static gboolean check_alloc_free_reuse ( void )
+{
+  gboolean ans = TRUE;
+  VikTrackpoint **tps = g_new ( VikTrackpoint*, N_TRACKPOINTS );
+  for ( guint ii = 0; ii < N_TRACKPOINTS; ii++ ) {
+    tps[ii] = vik_trackpoint_new ();
+    if ( !is_initialized ( tps[ii] ) ) {
+      fprintf ( stderr, "trackpoint %u: not initialized\n", ii );
+      ans = FALSE;
+    }
+    tps[ii]->altitude = ii;
+    tps[ii]->heart_rate = ii;
+    vik_trackpoint_set_name ( tps[ii], "tp" );
+  }
+  if ( !check_distinct ( tps, N_TRACKPOINTS ) ) {
+    fprintf ( stderr, "trackpoints overlap\n" );
+    ans = FALSE;
+  }
+
+  // Free every other one, and the others should be unaffected
+  GHashTable *freed = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  for ( guint ii = 0; ii < N_TRACKPOINTS; ii += 2 ) {
+    g_hash_table_add ( freed, tps[ii] );
+    vik_trackpoint_free ( tps[ii] );
+    tps[ii] = NULL;
+  }
+  for ( guint ii = 1; ii < N_TRACKPOINTS; ii += 2 ) {
+    if ( tps[ii]->altitude != ii || tps[ii]->heart_rate != ii || g_strcmp0 ( tps[ii]->name, "tp" ) ) {
+      fprintf ( stderr, "trackpoint %u: changed by freeing others\n", ii );
+      ans = FALSE;
+    }
+  }
+
+  // As many again should all go where the freed ones were, rather than taking more memory
+  guint reused = 0;
+  for ( guint ii = 0; ii < N_TRACKPOINTS; ii += 2 ) {
+    tps[ii] = vik_trackpoint_new ();
+    if ( g_hash_table_contains ( freed, tps[ii] ) )
+      reused++;
+    if ( !is_initialized ( tps[ii] ) ) {
+      fprintf ( stderr, "reused trackpoint %u: not initialized\n", ii );
+      ans = FALSE;
+    }
+  }
+  if ( reused != g_hash_table_size ( freed ) ) {
+    fprintf ( stderr, "%u of %u freed trackpoints reused\n", reused, g_hash_table_size ( freed ) );
+    ans = FALSE;
+  }
+  if ( !check_distinct ( tps, N_TRACKPOINTS ) ) {
+    fprintf ( stderr, "reused trackpoints overlap\n" );
+    ans = FALSE;
+  }
+  g_hash_table_destroy ( freed );
+
+  // Freeing all of them with the track
+  VikTrack *trk = vik_track_new ();
+  for ( guint ii = 0; ii < N_TRACKPOINTS; ii++ )
+    trk->trackpoints = g_list_prepend ( trk->trackpoints, tps[ii] );
+  vik_track_free ( trk );
+  g_free ( tps );
+  return ans;
+}
+
+static void alloc_thread ( gpointer data, gpointer user_data )
+{
+  guint id = GPOINTER_TO_UINT(data);
+  gint *failures = user_data;
+  VikTrackpoint **tps = g_new ( VikTrackpoint*, N_PER_THREAD );
+  for ( guint round = 0; round < 4; round++ ) {
+    for ( guint ii = 0; ii < N_PER_THREAD; ii++ ) {
+      tps[ii] = vik_trackpoint_new ();
+      tps[ii]->heart_rate = id;
+      tps[ii]->cadence = ii;
+    }
+    for ( guint ii = 0; ii < N_PER_THREAD; ii++ )
+      if ( tps[ii]->heart_rate != id || tps[ii]->cadence != (gint)ii )
+        g_atomic_int_inc ( failures );
+    for ( guint ii = 0; ii < N_PER_THREAD; ii++ )
+      vik_trackpoint_free ( tps[ii] );
+  }
+  g_free ( tps );
+}
+
+static gboolean check_threads ( void )
+{
+  gint failures = 0;
+  GThreadPool *pool = g_thread_pool_new ( alloc_thread, &failures, N_THREADS, TRUE, NULL );
+  for ( guint tt = 1; tt <= N_THREADS; tt++ )
+    g_thread_pool_push ( pool, GUINT_TO_POINTER(tt), NULL );
+  g_thread_pool_free ( pool, FALSE, TRUE );
+  if ( failures )
+    fprintf ( stderr, "threads: %d trackpoints overwritten\n", failures );
+  return failures == 0;
+}
+
+int main ( int argc, char *argv[] )
+{
+  gboolean ans = check_alloc_free_reuse ();
+  ans = check_threads () && ans;
+  return ans ? 0 : 1;
+}
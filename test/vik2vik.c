@@ -3,7 +3,11 @@
 //run like:
 // ./vik2vik < input.vik output.vik
 //
+// or to save in the binary format, and/or read from a named file (e.g. a binary one):
+// ./vik2vik [--binary] [--input input.vik] output.vik
+//
 #include <stdio.h>
+#include <string.h>
 #include "viklayer.h"
 #include "viklayer_defaults.h"
 #include "settings.h"
@@ -16,7 +20,18 @@
 
 int main(int argc, char *argv[])
 {
-  if ( argc != 2 )
+  gboolean binary = FALSE;
+  const char *input = NULL;
+  int ii = 1;
+  for ( ; ii < argc - 1; ii++ ) {
+    if ( strcmp ( argv[ii], "--binary" ) == 0 )
+      binary = TRUE;
+    else if ( strcmp ( argv[ii], "--input" ) == 0 && ii < argc - 2 )
+      input = argv[++ii];
+    else
+      break;
+  }
+  if ( ii != argc - 1 )
     return argc;
 
   // Some stuff must be initialized as it gets auto used
@@ -26,6 +41,9 @@ int main(int argc, char *argv[])
   a_layer_defaults_init ();
   modules_init();
 
+  if ( binary )
+    a_preferences_get ( VIKING_PREFERENCES_ADVANCED_NAMESPACE "save_binary_format" )->b = TRUE;
+
   int result = 0;
 
   // Seems to work without an $DISPLAY
@@ -35,10 +53,16 @@ int main(int argc, char *argv[])
   VikAggregateLayer* agg = vik_aggregate_layer_new ();
   VikViewport* vp = vik_viewport_new ();
 
-  lt = a_file_load_stream ( stdin, NULL, agg, vp, NULL, TRUE, FALSE, NULL, "NotUsedName" );
+  if ( input )
+    lt = a_file_load ( agg, vp, NULL, input, TRUE, FALSE, "NotUsedName" );
+  else
+    lt = a_file_load_stream ( stdin, NULL, agg, vp, NULL, TRUE, FALSE, NULL, "NotUsedName" );
   if ( lt < LOAD_TYPE_VIK_FAILURE_NON_FATAL )
     result++;
-  if ( !a_file_save(agg, vp, argv[1]) )
+  if ( !a_file_save(agg, vp, argv[ii], NULL, NULL) )
+    result++;
+  // The file is only complete once the save has finished in the background
+  if ( !a_file_save_wait() )
     result++;
 
   g_object_unref ( agg );